@@ -0,0 +1,472 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_customscan.c
+ *	  Custom scan that reads only the columns and chunk groups of a columnar
+ *	  table that a query needs.
+ *
+ * A sequential scan reads rows through the table access method, which does
+ * not know which columns the query uses, nor which quals the rows need to
+ * pass. A columnar scan passes both to the reader, such that the chunks of
+ * the other columns are not read or decompressed, and chunk groups whose
+ * minimum and maximum values show that none of their rows pass the quals
+ * are skipped altogether.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "access/table.h"
+#include "catalog/pg_class.h"
+#include "commands/explain.h"
+#include "distributed/columnar.h"
+#include "distributed/listutils.h"
+#include "executor/executor.h"
+#include "lib/stringinfo.h"
+#include "nodes/extensible.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/restrictinfo.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/spccache.h"
+
+
+/*
+ * ColumnarScanState is the execution state of a columnar scan.
+ */
+typedef struct ColumnarScanState
+{
+	CustomScanState customScanState;
+
+	/* columns used by the query, and quals used to skip chunk groups */
+	Bitmapset *projectedColumns;
+	List *whereClauseList;
+
+	/* reader of the table, opened when the first row is read */
+	ColumnarReadState *readState;
+} ColumnarScanState;
+
+
+/* GUC, determines whether queries on columnar tables use a columnar scan */
+bool EnableColumnarScan = true;
+
+
+static bool ColumnarScanSupported(RangeTblEntry *rangeTableEntry);
+static Bitmapset * ProjectedColumns(RelOptInfo *relOptInfo, int columnCount);
+static Cost ColumnarScanCost(PlannerInfo *root, RelOptInfo *relOptInfo,
+							 Path *seqScanPath, int projectedColumnCount,
+							 int columnCount);
+static Plan * PlanColumnarScanPath(PlannerInfo *root, RelOptInfo *rel,
+								   struct CustomPath *bestPath, List *tlist,
+								   List *clauses, List *customPlans);
+static Node * ColumnarCreateScan(CustomScan *scan);
+static void ColumnarBeginScan(CustomScanState *node, EState *estate, int eflags);
+static TupleTableSlot * ColumnarExecScan(CustomScanState *node);
+static TupleTableSlot * ColumnarScanNext(ScanState *node);
+static bool ColumnarScanRecheck(ScanState *node, TupleTableSlot *slot);
+static void ColumnarEndScan(CustomScanState *node);
+static void ColumnarReScan(CustomScanState *node);
+static void ColumnarExplainScan(CustomScanState *node, List *ancestors,
+								ExplainState *es);
+
+
+static CustomPathMethods ColumnarScanPathMethods = {
+	.CustomName = "ColumnarScanPath",
+	.PlanCustomPath = PlanColumnarScanPath,
+};
+
+static CustomScanMethods ColumnarScanMethods = {
+	"ColumnarScan",
+	ColumnarCreateScan
+};
+
+static CustomExecMethods ColumnarScanExecMethods = {
+	.CustomName = "ColumnarScan",
+	.BeginCustomScan = ColumnarBeginScan,
+	.ExecCustomScan = ColumnarExecScan,
+	.EndCustomScan = ColumnarEndScan,
+	.ReScanCustomScan = ColumnarReScan,
+	.ExplainCustomScan = ColumnarExplainScan
+};
+
+
+/*
+ * AddColumnarScanPath adds a columnar scan path for a columnar table. It is
+ * called from the set_rel_pathlist hook, after the sequential scan path was
+ * added. Columnar tables do not support parallel scans, so their partial
+ * paths are removed.
+ */
+void
+AddColumnarScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+					RangeTblEntry *rangeTableEntry)
+{
+	if (!ColumnarScanSupported(rangeTableEntry))
+	{
+		return;
+	}
+
+	Relation relation = table_open(rangeTableEntry->relid, NoLock);
+	bool isColumnarTable = IsColumnarTable(relation);
+	int columnCount = RelationGetDescr(relation)->natts;
+
+	table_close(relation, NoLock);
+
+	if (!isColumnarTable)
+	{
+		return;
+	}
+
+	relOptInfo->partial_pathlist = NIL;
+
+	if (!EnableColumnarScan)
+	{
+		return;
+	}
+
+	Path *seqScanPath = NULL;
+	Path *path = NULL;
+	foreach_ptr(path, relOptInfo->pathlist)
+	{
+		if (path->pathtype == T_SeqScan)
+		{
+			seqScanPath = path;
+			break;
+		}
+	}
+
+	if (seqScanPath == NULL)
+	{
+		return;
+	}
+
+	Bitmapset *projectedColumns = ProjectedColumns(relOptInfo, columnCount);
+	List *projectedColumnList = NIL;
+	int attributeNumber = -1;
+
+	while ((attributeNumber = bms_next_member(projectedColumns, attributeNumber)) >= 0)
+	{
+		projectedColumnList = lappend_int(projectedColumnList, attributeNumber);
+	}
+
+	CustomPath *columnarPath = makeNode(CustomPath);
+	columnarPath->path.pathtype = T_CustomScan;
+	columnarPath->path.parent = relOptInfo;
+	columnarPath->path.pathtarget = relOptInfo->reltarget;
+	columnarPath->path.param_info = seqScanPath->param_info;
+	columnarPath->path.rows = seqScanPath->rows;
+	columnarPath->path.startup_cost = seqScanPath->startup_cost;
+	columnarPath->path.total_cost =
+		ColumnarScanCost(root, relOptInfo, seqScanPath,
+						 list_length(projectedColumnList), columnCount);
+
+	columnarPath->methods = &ColumnarScanPathMethods;
+	columnarPath->custom_private = list_make1(projectedColumnList);
+
+	add_path(relOptInfo, (Path *) columnarPath);
+}
+
+
+/*
+ * ColumnarScanSupported returns whether the given range table entry is a
+ * plain scan of a table that a columnar scan could read.
+ */
+static bool
+ColumnarScanSupported(RangeTblEntry *rangeTableEntry)
+{
+	return rangeTableEntry->rtekind == RTE_RELATION &&
+		   !rangeTableEntry->inh &&
+		   rangeTableEntry->relkind == RELKIND_RELATION &&
+		   rangeTableEntry->tablesample == NULL;
+}
+
+
+/*
+ * ProjectedColumns returns the attribute numbers of the columns of the
+ * relation that are used above the scan or in the quals of the scan. A
+ * whole-row reference uses all columns.
+ */
+static Bitmapset *
+ProjectedColumns(RelOptInfo *relOptInfo, int columnCount)
+{
+	Bitmapset *projectedColumns = NULL;
+
+	List *columnList = pull_var_clause((Node *) relOptInfo->reltarget->exprs,
+									   PVC_RECURSE_PLACEHOLDERS);
+
+	RestrictInfo *restrictInfo = NULL;
+	foreach_ptr(restrictInfo, relOptInfo->baserestrictinfo)
+	{
+		columnList = list_concat(columnList,
+								 pull_var_clause((Node *) restrictInfo->clause,
+												 PVC_RECURSE_PLACEHOLDERS));
+	}
+
+	Var *column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		if (column->varattno == InvalidAttrNumber)
+		{
+			for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				projectedColumns = bms_add_member(projectedColumns, columnIndex + 1);
+			}
+		}
+		else if (column->varattno > 0)
+		{
+			projectedColumns = bms_add_member(projectedColumns, column->varattno);
+		}
+	}
+
+	return projectedColumns;
+}
+
+
+/*
+ * ColumnarScanCost returns the total cost of a columnar scan, which is the
+ * cost of the sequential scan without reading the pages of the columns that
+ * are not projected. Columns are assumed to take up the same space.
+ */
+static Cost
+ColumnarScanCost(PlannerInfo *root, RelOptInfo *relOptInfo, Path *seqScanPath,
+				 int projectedColumnCount, int columnCount)
+{
+	double sequentialPageCost = 0.0;
+
+	if (columnCount == 0)
+	{
+		return seqScanPath->total_cost;
+	}
+
+	get_tablespace_page_costs(relOptInfo->reltablespace, NULL, &sequentialPageCost);
+
+	double skippedFraction = 1.0 - (double) projectedColumnCount / columnCount;
+	Cost skippedCost = sequentialPageCost * relOptInfo->pages * skippedFraction;
+
+	return Max(seqScanPath->total_cost - skippedCost, seqScanPath->startup_cost);
+}
+
+
+/*
+ * PlanColumnarScanPath creates the CustomScan plan of a columnar scan path.
+ * The quals are applied to the rows that are read, and the quals that can
+ * be evaluated more than once are also passed to the reader in
+ * custom_exprs, to skip chunk groups.
+ */
+static Plan *
+PlanColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, struct CustomPath *bestPath,
+					 List *tlist, List *clauses, List *customPlans)
+{
+	List *qualList = extract_actual_clauses(clauses, false);
+	List *whereClauseList = NIL;
+
+	Node *qual = NULL;
+	foreach_ptr(qual, qualList)
+	{
+		if (!contain_subplans(qual) && !contain_volatile_functions(qual))
+		{
+			whereClauseList = lappend(whereClauseList, copyObject(qual));
+		}
+	}
+
+	CustomScan *customScan = makeNode(CustomScan);
+	customScan->methods = &ColumnarScanMethods;
+	customScan->scan.plan.targetlist = tlist;
+	customScan->scan.plan.qual = qualList;
+	customScan->scan.scanrelid = rel->relid;
+	customScan->custom_private = list_copy(bestPath->custom_private);
+	customScan->custom_exprs = whereClauseList;
+
+	return (Plan *) customScan;
+}
+
+
+/*
+ * ColumnarCreateScan creates the scan state of a columnar scan.
+ */
+static Node *
+ColumnarCreateScan(CustomScan *scan)
+{
+	ColumnarScanState *scanState = palloc0(sizeof(ColumnarScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &ColumnarScanExecMethods;
+
+	scanState->whereClauseList = scan->custom_exprs;
+
+	int attributeNumber = 0;
+	foreach_int(attributeNumber, (List *) linitial(scan->custom_private))
+	{
+		scanState->projectedColumns = bms_add_member(scanState->projectedColumns,
+													 attributeNumber);
+	}
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * ColumnarBeginScan does nothing, the table is read when the first row is
+ * asked for.
+ */
+static void
+ColumnarBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	/* this comment is for indentation consistency */
+}
+
+
+/*
+ * ColumnarExecScan returns the next row of the table that passes the quals
+ * of the scan.
+ */
+static TupleTableSlot *
+ColumnarExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, (ExecScanAccessMtd) ColumnarScanNext,
+					(ExecScanRecheckMtd) ColumnarScanRecheck);
+}
+
+
+/*
+ * ColumnarScanNext reads the next row of the table into the scan tuple slot.
+ * It returns an empty slot after the last row.
+ */
+static TupleTableSlot *
+ColumnarScanNext(ScanState *node)
+{
+	ColumnarScanState *scanState = (ColumnarScanState *) node;
+	TupleTableSlot *scanSlot = node->ss_ScanTupleSlot;
+	Relation relation = node->ss_currentRelation;
+	EState *executorState = node->ps.state;
+	uint64 rowNumber = 0;
+
+	if (scanState->readState == NULL)
+	{
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(executorState->es_query_cxt);
+
+		scanState->readState = ColumnarBeginRead(relation, executorState->es_snapshot,
+												 scanState->projectedColumns,
+												 scanState->whereClauseList);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	ExecClearTuple(scanSlot);
+
+	if (!ColumnarReadNextRow(scanState->readState, scanSlot->tts_values,
+							 scanSlot->tts_isnull, &rowNumber))
+	{
+		return scanSlot;
+	}
+
+	ExecStoreVirtualTuple(scanSlot);
+	scanSlot->tts_tableOid = RelationGetRelid(relation);
+	ItemPointerSet(&scanSlot->tts_tid, (BlockNumber) (rowNumber / MaxOffsetNumber),
+				   (OffsetNumber) (rowNumber % MaxOffsetNumber) + FirstOffsetNumber);
+
+	return scanSlot;
+}
+
+
+/*
+ * ColumnarScanRecheck is never called since columnar tables do not support
+ * locking rows.
+ */
+static bool
+ColumnarScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * ColumnarEndScan closes the reader of the table.
+ */
+static void
+ColumnarEndScan(CustomScanState *node)
+{
+	ColumnarScanState *scanState = (ColumnarScanState *) node;
+
+	if (scanState->readState != NULL)
+	{
+		ColumnarEndRead(scanState->readState);
+		scanState->readState = NULL;
+	}
+}
+
+
+/*
+ * ColumnarReScan restarts the scan from the first row of the table.
+ */
+static void
+ColumnarReScan(CustomScanState *node)
+{
+	ColumnarScanState *scanState = (ColumnarScanState *) node;
+
+	if (scanState->readState != NULL)
+	{
+		ColumnarRescan(scanState->readState);
+	}
+
+	ExecScanReScan(&node->ss);
+}
+
+
+/*
+ * ColumnarExplainScan shows the columns that the scan reads and, for
+ * EXPLAIN ANALYZE, the number of chunk groups it skipped.
+ */
+static void
+ColumnarExplainScan(CustomScanState *node, List *ancestors, ExplainState *es)
+{
+	ColumnarScanState *scanState = (ColumnarScanState *) node;
+	TupleDesc tupleDescriptor = RelationGetDescr(node->ss.ss_currentRelation);
+	StringInfo projectedColumnString = makeStringInfo();
+	int attributeNumber = -1;
+
+	while ((attributeNumber = bms_next_member(scanState->projectedColumns,
+											  attributeNumber)) >= 0)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor,
+													attributeNumber - 1);
+
+		if (projectedColumnString->len > 0)
+		{
+			appendStringInfoString(projectedColumnString, ", ");
+		}
+
+		appendStringInfoString(projectedColumnString,
+							   quote_identifier(NameStr(attribute->attname)));
+	}
+
+	ExplainPropertyText("Columnar Projected Columns", projectedColumnString->data, es);
+
+	if (es->analyze && scanState->readState != NULL)
+	{
+		ExplainPropertyInteger("Columnar Chunk Groups Skipped", NULL,
+							   ColumnarChunkGroupsSkipped(scanState->readState), es);
+	}
+}
+
+
+/*
+ * RegisterColumnarScanMethods lets PostgreSQL know about the columnar scan.
+ */
+void
+RegisterColumnarScanMethods(void)
+{
+	RegisterCustomScanMethods(&ColumnarScanMethods);
+}
+
+
+#endif
@@ -0,0 +1,792 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_reader.c
+ *	  Reading the rows of columnar relations.
+ *
+ * A read walks the chain of stripes from the first block up to the blocks
+ * that were reserved when the read started, and skips the stripes that are
+ * not visible to its snapshot. Of the visible stripes, it reads the skip
+ * list, and then one chunk group at a time only the column chunks of the
+ * columns that the query needs. Chunk groups for which the minimum and
+ * maximum values in the skip list prove that none of their rows pass the
+ * quals of the query are skipped entirely, the same way as the blocks of
+ * columnar intermediate results.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "access/htup_details.h"
+#include "access/nbtree.h"
+#include "access/transam.h"
+#include "access/tupmacs.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "common/pg_lzcompress.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/columnar.h"
+#include "distributed/listutils.h"
+#include "libpq/pqformat.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/optimizer.h"
+#include "storage/procarray.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/typcache.h"
+
+
+/* description of a column chunk in the skip list */
+typedef struct ColumnChunkSkipNode
+{
+	uint32 nullCount;
+	uint32 nullBitmapLength;
+	uint8 compression;
+	uint32 storedLength;
+	uint32 rawLength;
+	uint64 chunkOffset;
+
+	/* minimum and maximum value, only deserialized for columns in quals */
+	char *minimumData;
+	int32 minimumLength;
+	char *maximumData;
+	int32 maximumLength;
+} ColumnChunkSkipNode;
+
+
+/* description of a chunk group in the skip list */
+typedef struct ChunkGroupSkipNode
+{
+	uint32 rowCount;
+	ColumnChunkSkipNode *columnChunks;
+} ChunkGroupSkipNode;
+
+
+/*
+ * ColumnarReadState holds the stripe and the chunk group that a read is
+ * currently returning rows of.
+ */
+struct ColumnarReadState
+{
+	Relation relation;
+	Snapshot snapshot;
+	TupleDesc tupleDescriptor;
+	int columnCount;
+	bool *projectedColumns;
+
+	/* quals used to skip chunk groups */
+	List *whereClauseList;
+	Var **whereColumns;
+	bool *useMinMax;
+	Oid *greaterEqualOperators;
+	Oid *lessEqualOperators;
+
+	/* next stripe to read, and the end of the blocks reserved at the start */
+	BlockNumber nextStripeBlock;
+	BlockNumber endStripeBlock;
+
+	/* current stripe, allocated in the stripe context */
+	MemoryContext stripeContext;
+	bool stripeLoaded;
+	BlockNumber stripeFirstBlock;
+	ColumnarStripeHeader stripeHeader;
+	uint64 *columnDataOffsets;
+	ChunkGroupSkipNode *chunkGroups;
+	uint32 nextChunkGroupIndex;
+	uint64 nextChunkGroupFirstRow;
+
+	/* current chunk group, allocated in the chunk group context */
+	MemoryContext chunkGroupContext;
+	uint64 chunkGroupFirstRow;
+	uint32 chunkGroupRowCount;
+	uint32 chunkGroupRowIndex;
+	bits8 **nullBitmaps;
+	char **columnValues;
+	uint32 *valueOffsets;
+
+	uint64 chunkGroupsSkipped;
+};
+
+
+static void InitializeMinMaxColumns(ColumnarReadState *readState);
+static bool LoadNextStripe(ColumnarReadState *readState);
+static void ReadStripeSkipList(ColumnarReadState *readState);
+static bool LoadNextChunkGroup(ColumnarReadState *readState);
+static bool ChunkGroupRefuted(ColumnarReadState *readState,
+							  ChunkGroupSkipNode *chunkGroup);
+static Node * ColumnChunkConstraint(ColumnarReadState *readState, int columnIndex,
+									uint32 rowCount, ColumnChunkSkipNode *columnChunk);
+static Datum SkipListValue(Form_pg_attribute attribute, char *valueData,
+						   int32 valueLength);
+static void ReadColumnChunk(ColumnarReadState *readState, int columnIndex,
+							ColumnChunkSkipNode *columnChunk);
+
+
+/*
+ * ColumnarBeginRead starts reading the rows of the given relation that are
+ * visible to the given snapshot. Only the columns in projectedColumns are
+ * read, the other columns are returned as NULL. Chunk groups whose rows
+ * cannot pass the quals in whereClauseList are skipped, the quals are not
+ * otherwise applied.
+ */
+ColumnarReadState *
+ColumnarBeginRead(Relation relation, Snapshot snapshot, Bitmapset *projectedColumns,
+				  List *whereClauseList)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	int columnCount = tupleDescriptor->natts;
+	ColumnarMetapage metapage;
+
+	/* rows that this transaction buffered become visible to its reads */
+	ColumnarFlushPendingWrites(relation);
+
+	ColumnarReadMetapage(relation, &metapage);
+
+	ColumnarReadState *readState = palloc0(sizeof(ColumnarReadState));
+	readState->relation = relation;
+	readState->snapshot = snapshot;
+	readState->tupleDescriptor = tupleDescriptor;
+	readState->columnCount = columnCount;
+	readState->projectedColumns = palloc0(columnCount * sizeof(bool));
+	readState->whereClauseList = whereClauseList;
+	readState->whereColumns = palloc0(columnCount * sizeof(Var *));
+	readState->useMinMax = palloc0(columnCount * sizeof(bool));
+	readState->greaterEqualOperators = palloc0(columnCount * sizeof(Oid));
+	readState->lessEqualOperators = palloc0(columnCount * sizeof(Oid));
+	readState->nextStripeBlock = COLUMNAR_FIRST_STRIPE_BLOCKNO;
+	readState->endStripeBlock = metapage.nextStripeBlock;
+	readState->nullBitmaps = palloc0(columnCount * sizeof(bits8 *));
+	readState->columnValues = palloc0(columnCount * sizeof(char *));
+	readState->valueOffsets = palloc0(columnCount * sizeof(uint32));
+	readState->stripeContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Columnar Read Stripe",
+													 ALLOCSET_DEFAULT_SIZES);
+	readState->chunkGroupContext = AllocSetContextCreate(CurrentMemoryContext,
+														 "Columnar Read Chunk Group",
+														 ALLOCSET_DEFAULT_SIZES);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		readState->projectedColumns[columnIndex] =
+			!attribute->attisdropped &&
+			bms_is_member(columnIndex + 1, projectedColumns);
+	}
+
+	InitializeMinMaxColumns(readState);
+
+	return readState;
+}
+
+
+/*
+ * InitializeMinMaxColumns finds the columns in the quals whose minimum and
+ * maximum values can be compared using their btree operators.
+ */
+static void
+InitializeMinMaxColumns(ColumnarReadState *readState)
+{
+	TupleDesc tupleDescriptor = readState->tupleDescriptor;
+	int columnCount = readState->columnCount;
+
+	List *whereColumnList = pull_var_clause((Node *) readState->whereClauseList,
+											PVC_RECURSE_PLACEHOLDERS);
+	Var *column = NULL;
+	foreach_ptr(column, whereColumnList)
+	{
+		if (column->varlevelsup == 0 && column->varattno > 0 &&
+			column->varattno <= columnCount &&
+			readState->whereColumns[column->varattno - 1] == NULL)
+		{
+			readState->whereColumns[column->varattno - 1] = column;
+		}
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Var *whereColumn = readState->whereColumns[columnIndex];
+
+		if (whereColumn == NULL || whereColumn->vartype != attribute->atttypid ||
+			attribute->attisdropped)
+		{
+			continue;
+		}
+
+		/* the writer ordered the values with the default btree operator class */
+		TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+													  TYPECACHE_BTREE_OPFAMILY);
+		if (!OidIsValid(typeEntry->btree_opf) ||
+			typeEntry->btree_opintype != attribute->atttypid)
+		{
+			continue;
+		}
+
+		readState->greaterEqualOperators[columnIndex] =
+			get_opfamily_member(typeEntry->btree_opf, attribute->atttypid,
+								attribute->atttypid, BTGreaterEqualStrategyNumber);
+		readState->lessEqualOperators[columnIndex] =
+			get_opfamily_member(typeEntry->btree_opf, attribute->atttypid,
+								attribute->atttypid, BTLessEqualStrategyNumber);
+
+		readState->useMinMax[columnIndex] =
+			OidIsValid(readState->greaterEqualOperators[columnIndex]) &&
+			OidIsValid(readState->lessEqualOperators[columnIndex]);
+	}
+}
+
+
+/*
+ * ColumnarReadNextRow reads the next row into the given arrays, and sets
+ * rowNumber to the number of the row within the relation. Values point into
+ * memory of the read state that is valid until the next call. It returns
+ * false after the last row.
+ */
+bool
+ColumnarReadNextRow(ColumnarReadState *readState, Datum *values, bool *nulls,
+					uint64 *rowNumber)
+{
+	while (readState->chunkGroupRowIndex >= readState->chunkGroupRowCount)
+	{
+		if (!LoadNextChunkGroup(readState))
+		{
+			return false;
+		}
+	}
+
+	uint32 rowIndex = readState->chunkGroupRowIndex;
+	int stripeColumnCount = readState->stripeHeader.columnCount;
+
+	for (int columnIndex = 0; columnIndex < readState->columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(readState->tupleDescriptor,
+													columnIndex);
+		bits8 *nullBitmap = readState->nullBitmaps[columnIndex];
+
+		values[columnIndex] = (Datum) 0;
+		nulls[columnIndex] = true;
+
+		if (!readState->projectedColumns[columnIndex])
+		{
+			continue;
+		}
+		else if (columnIndex >= stripeColumnCount)
+		{
+			/* the column was added after the stripe was written */
+			values[columnIndex] = getmissingattr(readState->tupleDescriptor,
+												 columnIndex + 1, &nulls[columnIndex]);
+			continue;
+		}
+		else if (nullBitmap != NULL && att_isnull(rowIndex, nullBitmap))
+		{
+			continue;
+		}
+
+		char *columnValues = readState->columnValues[columnIndex];
+		uint32 valueOffset = readState->valueOffsets[columnIndex];
+
+		valueOffset = att_align_pointer(valueOffset, attribute->attalign,
+										attribute->attlen, columnValues + valueOffset);
+		values[columnIndex] = fetchatt(attribute, columnValues + valueOffset);
+		nulls[columnIndex] = false;
+
+		readState->valueOffsets[columnIndex] =
+			att_addlength_pointer(valueOffset, attribute->attlen,
+								  columnValues + valueOffset);
+	}
+
+	*rowNumber = readState->stripeHeader.firstRowNumber +
+				 readState->chunkGroupFirstRow + rowIndex;
+
+	readState->chunkGroupRowIndex++;
+
+	return true;
+}
+
+
+/*
+ * LoadNextChunkGroup reads the projected column chunks of the next chunk
+ * group whose rows may pass the quals, moving on to the next visible stripe
+ * when needed. It returns false after the last chunk group.
+ */
+static bool
+LoadNextChunkGroup(ColumnarReadState *readState)
+{
+	while (true)
+	{
+		if (!readState->stripeLoaded ||
+			readState->nextChunkGroupIndex >= readState->stripeHeader.chunkGroupCount)
+		{
+			if (!LoadNextStripe(readState))
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		ChunkGroupSkipNode *chunkGroup =
+			&readState->chunkGroups[readState->nextChunkGroupIndex];
+		uint64 chunkGroupFirstRow = readState->nextChunkGroupFirstRow;
+
+		readState->nextChunkGroupIndex++;
+		readState->nextChunkGroupFirstRow += chunkGroup->rowCount;
+
+		MemoryContextReset(readState->chunkGroupContext);
+
+		if (ChunkGroupRefuted(readState, chunkGroup))
+		{
+			readState->chunkGroupsSkipped++;
+			continue;
+		}
+
+		int stripeColumnCount = readState->stripeHeader.columnCount;
+
+		for (int columnIndex = 0; columnIndex < readState->columnCount; columnIndex++)
+		{
+			readState->nullBitmaps[columnIndex] = NULL;
+			readState->columnValues[columnIndex] = NULL;
+			readState->valueOffsets[columnIndex] = 0;
+
+			if (readState->projectedColumns[columnIndex] &&
+				columnIndex < stripeColumnCount)
+			{
+				ReadColumnChunk(readState, columnIndex,
+								&chunkGroup->columnChunks[columnIndex]);
+			}
+		}
+
+		readState->chunkGroupFirstRow = chunkGroupFirstRow;
+		readState->chunkGroupRowCount = chunkGroup->rowCount;
+		readState->chunkGroupRowIndex = 0;
+
+		return true;
+	}
+}
+
+
+/*
+ * LoadNextStripe moves on to the next stripe that is visible to the snapshot
+ * of the read and reads its skip list. It returns false after the last
+ * stripe.
+ */
+static bool
+LoadNextStripe(ColumnarReadState *readState)
+{
+	readState->stripeLoaded = false;
+	readState->chunkGroupRowCount = 0;
+	readState->chunkGroupRowIndex = 0;
+
+	MemoryContextReset(readState->chunkGroupContext);
+	MemoryContextReset(readState->stripeContext);
+
+	while (readState->nextStripeBlock < readState->endStripeBlock)
+	{
+		BlockNumber stripeBlock = readState->nextStripeBlock;
+		ColumnarStripeHeader *stripeHeader = &readState->stripeHeader;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!ColumnarReadStripeHeader(readState->relation, stripeBlock, stripeHeader))
+		{
+			/* a crash may have lost the blocks of uncommitted stripes */
+			return false;
+		}
+
+		readState->nextStripeBlock += stripeHeader->blockCount;
+
+		if (!ColumnarStripeVisible(stripeHeader, readState->snapshot))
+		{
+			continue;
+		}
+
+		if (stripeHeader->columnCount > readState->columnCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("columnar relation \"%s\" has a stripe with "
+								   "more columns than the relation",
+								   RelationGetRelationName(readState->relation))));
+		}
+
+		readState->stripeFirstBlock = stripeBlock;
+		readState->stripeLoaded = true;
+		readState->nextChunkGroupIndex = 0;
+		readState->nextChunkGroupFirstRow = 0;
+
+		ReadStripeSkipList(readState);
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * ReadStripeSkipList reads the skip list of the current stripe into the
+ * stripe context.
+ */
+static void
+ReadStripeSkipList(ColumnarReadState *readState)
+{
+	ColumnarStripeHeader *stripeHeader = &readState->stripeHeader;
+	int stripeColumnCount = stripeHeader->columnCount;
+	uint64 dataOffset = sizeof(ColumnarStripeHeader) + stripeHeader->skipListLength;
+	StringInfoData skipList;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->stripeContext);
+
+	initStringInfo(&skipList);
+	enlargeStringInfo(&skipList, stripeHeader->skipListLength);
+
+	ColumnarReadStripeData(readState->relation, readState->stripeFirstBlock,
+						   sizeof(ColumnarStripeHeader), skipList.data,
+						   stripeHeader->skipListLength);
+	skipList.len = stripeHeader->skipListLength;
+
+	readState->columnDataOffsets = palloc0(stripeColumnCount * sizeof(uint64));
+
+	for (int columnIndex = 0; columnIndex < stripeColumnCount; columnIndex++)
+	{
+		readState->columnDataOffsets[columnIndex] =
+			dataOffset + pq_getmsgint64(&skipList);
+
+		/* the length of the column data is not needed for reading */
+		(void) pq_getmsgint64(&skipList);
+	}
+
+	readState->chunkGroups = palloc0(stripeHeader->chunkGroupCount *
+									 sizeof(ChunkGroupSkipNode));
+
+	for (uint32 chunkGroupIndex = 0; chunkGroupIndex < stripeHeader->chunkGroupCount;
+		 chunkGroupIndex++)
+	{
+		ChunkGroupSkipNode *chunkGroup = &readState->chunkGroups[chunkGroupIndex];
+
+		chunkGroup->rowCount = pq_getmsgint(&skipList, 4);
+		chunkGroup->columnChunks = palloc0(stripeColumnCount *
+										   sizeof(ColumnChunkSkipNode));
+
+		for (int columnIndex = 0; columnIndex < stripeColumnCount; columnIndex++)
+		{
+			ColumnChunkSkipNode *columnChunk = &chunkGroup->columnChunks[columnIndex];
+
+			columnChunk->nullCount = pq_getmsgint(&skipList, 4);
+			columnChunk->nullBitmapLength = pq_getmsgint(&skipList, 4);
+			columnChunk->compression = pq_getmsgbyte(&skipList);
+			columnChunk->storedLength = pq_getmsgint(&skipList, 4);
+			columnChunk->rawLength = pq_getmsgint(&skipList, 4);
+			columnChunk->chunkOffset = pq_getmsgint64(&skipList);
+
+			columnChunk->minimumLength = (int32) pq_getmsgint(&skipList, 4);
+			if (columnChunk->minimumLength >= 0)
+			{
+				columnChunk->minimumData =
+					(char *) pq_getmsgbytes(&skipList, columnChunk->minimumLength);
+			}
+
+			columnChunk->maximumLength = (int32) pq_getmsgint(&skipList, 4);
+			if (columnChunk->maximumLength >= 0)
+			{
+				columnChunk->maximumData =
+					(char *) pq_getmsgbytes(&skipList, columnChunk->maximumLength);
+			}
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ChunkGroupRefuted returns whether the minimum and maximum values of the
+ * given chunk group prove that none of its rows pass the quals.
+ */
+static bool
+ChunkGroupRefuted(ColumnarReadState *readState, ChunkGroupSkipNode *chunkGroup)
+{
+	List *constraintList = NIL;
+
+	if (readState->whereClauseList == NIL)
+	{
+		return false;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->chunkGroupContext);
+
+	for (int columnIndex = 0; columnIndex < readState->stripeHeader.columnCount;
+		 columnIndex++)
+	{
+		if (!readState->useMinMax[columnIndex])
+		{
+			continue;
+		}
+
+		Node *constraint = ColumnChunkConstraint(readState, columnIndex,
+												 chunkGroup->rowCount,
+												 &chunkGroup->columnChunks[columnIndex]);
+		if (constraint != NULL)
+		{
+			constraintList = lappend(constraintList, constraint);
+		}
+	}
+
+	bool refuted = constraintList != NIL &&
+				   predicate_refuted_by(readState->whereClauseList, constraintList,
+										false);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return refuted;
+}
+
+
+/*
+ * ColumnChunkConstraint returns an expression that holds for all rows of the
+ * given column chunk, or NULL if the chunk has no minimum and maximum value.
+ */
+static Node *
+ColumnChunkConstraint(ColumnarReadState *readState, int columnIndex, uint32 rowCount,
+					  ColumnChunkSkipNode *columnChunk)
+{
+	Form_pg_attribute attribute = TupleDescAttr(readState->tupleDescriptor,
+												columnIndex);
+	Var *column = readState->whereColumns[columnIndex];
+
+	NullTest *nullTest = makeNode(NullTest);
+	nullTest->arg = (Expr *) column;
+	nullTest->nulltesttype = IS_NULL;
+	nullTest->argisrow = false;
+	nullTest->location = -1;
+
+	if (columnChunk->nullCount == rowCount)
+	{
+		return (Node *) nullTest;
+	}
+	else if (columnChunk->minimumData == NULL || columnChunk->maximumData == NULL)
+	{
+		return NULL;
+	}
+
+	Datum minimumValue = SkipListValue(attribute, columnChunk->minimumData,
+									   columnChunk->minimumLength);
+	Datum maximumValue = SkipListValue(attribute, columnChunk->maximumData,
+									   columnChunk->maximumLength);
+
+	Const *minimumConst = makeConst(attribute->atttypid, attribute->atttypmod,
+									attribute->attcollation, attribute->attlen,
+									minimumValue, false, attribute->attbyval);
+	Const *maximumConst = makeConst(attribute->atttypid, attribute->atttypmod,
+									attribute->attcollation, attribute->attlen,
+									maximumValue, false, attribute->attbyval);
+
+	Oid greaterEqualOperator = readState->greaterEqualOperators[columnIndex];
+	OpExpr *lowerBound = (OpExpr *) make_opclause(greaterEqualOperator, BOOLOID, false,
+												  (Expr *) column,
+												  (Expr *) minimumConst,
+												  InvalidOid, attribute->attcollation);
+	lowerBound->opfuncid = get_opcode(greaterEqualOperator);
+
+	Oid lessEqualOperator = readState->lessEqualOperators[columnIndex];
+	OpExpr *upperBound = (OpExpr *) make_opclause(lessEqualOperator, BOOLOID, false,
+												  (Expr *) column,
+												  (Expr *) maximumConst,
+												  InvalidOid, attribute->attcollation);
+	upperBound->opfuncid = get_opcode(lessEqualOperator);
+
+	Node *constraint = (Node *) make_andclause(list_make2(lowerBound, upperBound));
+
+	if (columnChunk->nullCount > 0)
+	{
+		constraint = (Node *) make_orclause(list_make2(constraint, nullTest));
+	}
+
+	return constraint;
+}
+
+
+/*
+ * SkipListValue returns a minimum or maximum value from the skip list as a
+ * datum, copied into aligned memory.
+ */
+static Datum
+SkipListValue(Form_pg_attribute attribute, char *valueData, int32 valueLength)
+{
+	char *alignedData = palloc(valueLength + 1);
+
+	memcpy_s(alignedData, valueLength + 1, valueData, valueLength);
+
+	return fetchatt(attribute, alignedData);
+}
+
+
+/*
+ * ReadColumnChunk reads the NULL bitmap and the values of a column chunk of
+ * the current stripe into the chunk group context, and decompresses the
+ * values if needed.
+ */
+static void
+ReadColumnChunk(ColumnarReadState *readState, int columnIndex,
+				ColumnChunkSkipNode *columnChunk)
+{
+	uint64 chunkOffset = readState->columnDataOffsets[columnIndex] +
+						 columnChunk->chunkOffset;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->chunkGroupContext);
+
+	if (columnChunk->nullBitmapLength > 0)
+	{
+		bits8 *nullBitmap = palloc(columnChunk->nullBitmapLength);
+
+		ColumnarReadStripeData(readState->relation, readState->stripeFirstBlock,
+							   chunkOffset, (char *) nullBitmap,
+							   columnChunk->nullBitmapLength);
+
+		readState->nullBitmaps[columnIndex] = nullBitmap;
+		chunkOffset += columnChunk->nullBitmapLength;
+	}
+
+	char *storedValues = palloc(columnChunk->storedLength + 1);
+
+	ColumnarReadStripeData(readState->relation, readState->stripeFirstBlock,
+						   chunkOffset, storedValues, columnChunk->storedLength);
+
+	if (columnChunk->compression == COLUMNAR_COMPRESSION_PGLZ)
+	{
+		char *rawValues = palloc(columnChunk->rawLength + 1);
+		int32 rawLength = pglz_decompress(storedValues, columnChunk->storedLength,
+										  rawValues, columnChunk->rawLength, true);
+
+		if (rawLength != (int32) columnChunk->rawLength)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("columnar relation \"%s\" has a corrupt "
+								   "compressed column chunk",
+								   RelationGetRelationName(readState->relation))));
+		}
+
+		pfree(storedValues);
+		storedValues = rawValues;
+	}
+	else if (columnChunk->compression != COLUMNAR_COMPRESSION_NONE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("columnar relation \"%s\" has a column chunk with "
+							   "unknown compression %d",
+							   RelationGetRelationName(readState->relation),
+							   columnChunk->compression)));
+	}
+
+	readState->columnValues[columnIndex] = storedValues;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ColumnarStripeVisible returns whether the rows of the given stripe are
+ * visible to the given snapshot. A stripe is written by a single
+ * (sub)transaction, so its visibility follows from its transaction id the
+ * same way as that of a heap tuple that was never deleted. Without an MVCC
+ * snapshot, as for ANALYZE and CLUSTER, the stripes of all committed
+ * transactions are visible.
+ */
+bool
+ColumnarStripeVisible(ColumnarStripeHeader *stripeHeader, Snapshot snapshot)
+{
+	TransactionId transactionId = stripeHeader->xid;
+
+	if (stripeHeader->flags & COLUMNAR_STRIPE_ABORTED)
+	{
+		return false;
+	}
+	else if (stripeHeader->flags & COLUMNAR_STRIPE_FROZEN)
+	{
+		return true;
+	}
+	else if (TransactionIdIsCurrentTransactionId(transactionId))
+	{
+		/* rows written by later commands of this transaction are not visible */
+		return snapshot == NULL || snapshot->snapshot_type != SNAPSHOT_MVCC ||
+			   stripeHeader->cid < snapshot->curcid;
+	}
+	else if (snapshot != NULL && snapshot->snapshot_type == SNAPSHOT_MVCC)
+	{
+		return !XidInMVCCSnapshot(transactionId, snapshot) &&
+			   TransactionIdDidCommit(transactionId);
+	}
+
+	return !TransactionIdIsInProgress(transactionId) &&
+		   TransactionIdDidCommit(transactionId);
+}
+
+
+/*
+ * ColumnarRescan restarts the read from the first stripe.
+ */
+void
+ColumnarRescan(ColumnarReadState *readState)
+{
+	readState->nextStripeBlock = COLUMNAR_FIRST_STRIPE_BLOCKNO;
+	readState->stripeLoaded = false;
+	readState->chunkGroupRowCount = 0;
+	readState->chunkGroupRowIndex = 0;
+
+	MemoryContextReset(readState->chunkGroupContext);
+	MemoryContextReset(readState->stripeContext);
+}
+
+
+/*
+ * ColumnarRowBlockNumber maps the row that was read last to one of the
+ * blocks of its stripe, such that ANALYZE can sample rows by block.
+ */
+BlockNumber
+ColumnarRowBlockNumber(ColumnarReadState *readState)
+{
+	ColumnarStripeHeader *stripeHeader = &readState->stripeHeader;
+	uint64 stripeRowIndex = readState->chunkGroupFirstRow +
+							readState->chunkGroupRowIndex - 1;
+
+	return readState->stripeFirstBlock +
+		   (BlockNumber) (stripeRowIndex * stripeHeader->blockCount /
+						  stripeHeader->rowCount);
+}
+
+
+/*
+ * ColumnarChunkGroupsSkipped returns the number of chunk groups that the read
+ * skipped because of its quals.
+ */
+uint64
+ColumnarChunkGroupsSkipped(ColumnarReadState *readState)
+{
+	return readState->chunkGroupsSkipped;
+}
+
+
+/*
+ * ColumnarEndRead frees the memory of the read.
+ */
+void
+ColumnarEndRead(ColumnarReadState *readState)
+{
+	MemoryContextDelete(readState->chunkGroupContext);
+	MemoryContextDelete(readState->stripeContext);
+
+	pfree(readState);
+}
+
+
+#endif
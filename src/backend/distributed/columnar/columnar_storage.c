@@ -0,0 +1,387 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_storage.c
+ *	  Page layout of columnar relations.
+ *
+ * A columnar relation stores its data in the main fork through the buffer
+ * manager, such that it is WAL-logged, replicated and crash safe like any
+ * other relation. All changes are WAL-logged as generic WAL records.
+ *
+ * The first block is a metapage that tracks the blocks reserved so far. The
+ * other blocks hold stripes, each of which is a run of consecutive blocks
+ * that is written once by a single transaction. The bytes of a stripe are
+ * laid out one after the other in the data area of its blocks, starting with
+ * a ColumnarStripeHeader. Reserving the blocks of a stripe and writing its
+ * first block happens in a single WAL record, such that the chain of stripe
+ * headers is never broken, also not after a crash in the middle of writing a
+ * stripe.
+ *
+ * The metapage is created when the first stripe is written, such that an
+ * empty relation, including the init fork of an unlogged relation, has no
+ * blocks at all.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "access/generic_xlog.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/columnar.h"
+#include "storage/bufmgr.h"
+#include "storage/lmgr.h"
+#include "utils/rel.h"
+
+
+static Buffer ColumnarLockMetapageForReservation(Relation relation);
+static void ColumnarExtendRelation(Relation relation, BlockNumber blockCount);
+static void ColumnarWritePages(Relation relation, BlockNumber firstBlock,
+							   BlockNumber firstPageIndex, char *stripeData,
+							   uint64 stripeLength);
+static void ColumnarFillPage(Page page, char *stripeData, uint64 stripeLength,
+							 BlockNumber pageIndex);
+
+
+/*
+ * ColumnarReadMetapage reads the metapage of the given relation into the
+ * given struct. A relation without blocks has an empty metapage.
+ */
+void
+ColumnarReadMetapage(Relation relation, ColumnarMetapage *metapage)
+{
+	if (RelationGetNumberOfBlocks(relation) == 0)
+	{
+		memset(metapage, 0, sizeof(ColumnarMetapage));
+		metapage->magicNumber = COLUMNAR_METAPAGE_MAGIC_NUMBER;
+		metapage->version = COLUMNAR_STORAGE_VERSION;
+		metapage->nextStripeBlock = COLUMNAR_FIRST_STRIPE_BLOCKNO;
+
+		return;
+	}
+
+	Buffer buffer = ReadBuffer(relation, COLUMNAR_METAPAGE_BLOCKNO);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+
+	memcpy_s(metapage, sizeof(ColumnarMetapage),
+			 PageGetContents(BufferGetPage(buffer)), sizeof(ColumnarMetapage));
+
+	UnlockReleaseBuffer(buffer);
+
+	if (metapage->magicNumber != COLUMNAR_METAPAGE_MAGIC_NUMBER ||
+		metapage->version != COLUMNAR_STORAGE_VERSION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("columnar relation \"%s\" has an invalid metapage",
+							   RelationGetRelationName(relation))));
+	}
+}
+
+
+/*
+ * ColumnarWriteStripe reserves the blocks for the given stripe and writes it
+ * into them. The stripe data starts with a ColumnarStripeHeader, of which
+ * the block count and the number of the first row are filled in here. The
+ * function returns the first block of the stripe.
+ */
+BlockNumber
+ColumnarWriteStripe(Relation relation, char *stripeData, uint64 stripeLength)
+{
+	ColumnarStripeHeader *stripeHeader = (ColumnarStripeHeader *) stripeData;
+	BlockNumber blockCount = COLUMNAR_STRIPE_BLOCK_COUNT(stripeLength);
+	bool relationIsLocal = RELATION_IS_LOCAL(relation);
+
+	Assert(stripeLength >= sizeof(ColumnarStripeHeader));
+
+	/* only one backend at a time reserves blocks and extends the relation */
+	if (!relationIsLocal)
+	{
+		LockRelationForExtension(relation, ExclusiveLock);
+	}
+
+	Buffer metaBuffer = ColumnarLockMetapageForReservation(relation);
+	ColumnarMetapage *metapage =
+		(ColumnarMetapage *) PageGetContents(BufferGetPage(metaBuffer));
+
+	BlockNumber firstBlock = metapage->nextStripeBlock;
+
+	stripeHeader->blockCount = blockCount;
+	stripeHeader->firstRowNumber = metapage->nextRowNumber;
+
+	ColumnarExtendRelation(relation, firstBlock + blockCount);
+
+	Buffer firstBuffer = ReadBufferExtended(relation, MAIN_FORKNUM, firstBlock,
+											RBM_ZERO_AND_LOCK, NULL);
+
+	/* reserve the blocks and write the first block in one record */
+	GenericXLogState *state = GenericXLogStart(relation);
+	Page metaPage = GenericXLogRegisterBuffer(state, metaBuffer, 0);
+	Page firstPage = GenericXLogRegisterBuffer(state, firstBuffer,
+											   GENERIC_XLOG_FULL_IMAGE);
+
+	metapage = (ColumnarMetapage *) PageGetContents(metaPage);
+	metapage->nextStripeBlock = firstBlock + blockCount;
+	metapage->nextRowNumber += stripeHeader->rowCount;
+
+	ColumnarFillPage(firstPage, stripeData, stripeLength, 0);
+
+	GenericXLogFinish(state);
+
+	UnlockReleaseBuffer(firstBuffer);
+	UnlockReleaseBuffer(metaBuffer);
+
+	if (!relationIsLocal)
+	{
+		UnlockRelationForExtension(relation, ExclusiveLock);
+	}
+
+	/* the other blocks are only read once the stripe is known to be visible */
+	ColumnarWritePages(relation, firstBlock, 1, stripeData, stripeLength);
+
+	return firstBlock;
+}
+
+
+/*
+ * ColumnarLockMetapageForReservation returns the metapage buffer, locked
+ * exclusively, and creates the metapage first if the relation is empty. The
+ * caller holds the extension lock.
+ */
+static Buffer
+ColumnarLockMetapageForReservation(Relation relation)
+{
+	if (RelationGetNumberOfBlocks(relation) == 0)
+	{
+		Buffer buffer = ReadBufferExtended(relation, MAIN_FORKNUM, P_NEW,
+										   RBM_ZERO_AND_LOCK, NULL);
+
+		Assert(BufferGetBlockNumber(buffer) == COLUMNAR_METAPAGE_BLOCKNO);
+
+		GenericXLogState *state = GenericXLogStart(relation);
+		Page page = GenericXLogRegisterBuffer(state, buffer, GENERIC_XLOG_FULL_IMAGE);
+
+		PageInit(page, BLCKSZ, 0);
+
+		ColumnarMetapage *metapage = (ColumnarMetapage *) PageGetContents(page);
+		memset(metapage, 0, sizeof(ColumnarMetapage));
+		metapage->magicNumber = COLUMNAR_METAPAGE_MAGIC_NUMBER;
+		metapage->version = COLUMNAR_STORAGE_VERSION;
+		metapage->nextStripeBlock = COLUMNAR_FIRST_STRIPE_BLOCKNO;
+		metapage->nextRowNumber = 0;
+
+		((PageHeader) page)->pd_lower = COLUMNAR_PAGE_DATA_OFFSET +
+										sizeof(ColumnarMetapage);
+
+		GenericXLogFinish(state);
+
+		return buffer;
+	}
+
+	Buffer buffer = ReadBuffer(relation, COLUMNAR_METAPAGE_BLOCKNO);
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+
+	ColumnarMetapage *metapage = (ColumnarMetapage *) PageGetContents(
+		BufferGetPage(buffer));
+	if (metapage->magicNumber != COLUMNAR_METAPAGE_MAGIC_NUMBER ||
+		metapage->version != COLUMNAR_STORAGE_VERSION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("columnar relation \"%s\" has an invalid metapage",
+							   RelationGetRelationName(relation))));
+	}
+
+	return buffer;
+}
+
+
+/*
+ * ColumnarExtendRelation extends the relation to the given number of blocks.
+ * Blocks may already exist beyond the reserved ones when a writer failed
+ * after extending the relation, in which case they are reused.
+ */
+static void
+ColumnarExtendRelation(Relation relation, BlockNumber blockCount)
+{
+	BlockNumber currentBlockCount = RelationGetNumberOfBlocks(relation);
+
+	while (currentBlockCount < blockCount)
+	{
+		Buffer buffer = ReadBufferExtended(relation, MAIN_FORKNUM, P_NEW,
+										   RBM_NORMAL, NULL);
+
+		ReleaseBuffer(buffer);
+		currentBlockCount++;
+	}
+}
+
+
+/*
+ * ColumnarWritePages writes the pages of a stripe, starting at the given
+ * page index, into the blocks reserved for it. Up to MAX_GENERIC_XLOG_PAGES
+ * pages are written per WAL record.
+ */
+static void
+ColumnarWritePages(Relation relation, BlockNumber firstBlock, BlockNumber firstPageIndex,
+				   char *stripeData, uint64 stripeLength)
+{
+	BlockNumber blockCount = COLUMNAR_STRIPE_BLOCK_COUNT(stripeLength);
+	BlockNumber pageIndex = firstPageIndex;
+
+	while (pageIndex < blockCount)
+	{
+		Buffer buffers[MAX_GENERIC_XLOG_PAGES];
+		int bufferCount = 0;
+
+		GenericXLogState *state = GenericXLogStart(relation);
+
+		while (bufferCount < MAX_GENERIC_XLOG_PAGES && pageIndex < blockCount)
+		{
+			Buffer buffer = ReadBufferExtended(relation, MAIN_FORKNUM,
+											   firstBlock + pageIndex,
+											   RBM_ZERO_AND_LOCK, NULL);
+			Page page = GenericXLogRegisterBuffer(state, buffer,
+												  GENERIC_XLOG_FULL_IMAGE);
+
+			ColumnarFillPage(page, stripeData, stripeLength, pageIndex);
+
+			buffers[bufferCount++] = buffer;
+			pageIndex++;
+		}
+
+		GenericXLogFinish(state);
+
+		for (int bufferIndex = 0; bufferIndex < bufferCount; bufferIndex++)
+		{
+			UnlockReleaseBuffer(buffers[bufferIndex]);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * ColumnarFillPage initializes the given page with the bytes of the stripe
+ * that belong on the page with the given index.
+ */
+static void
+ColumnarFillPage(Page page, char *stripeData, uint64 stripeLength, BlockNumber pageIndex)
+{
+	uint64 pageOffset = (uint64) pageIndex * COLUMNAR_BYTES_PER_PAGE;
+	uint64 pageLength = Min(stripeLength - pageOffset, COLUMNAR_BYTES_PER_PAGE);
+
+	PageInit(page, BLCKSZ, 0);
+
+	memcpy_s(PageGetContents(page), COLUMNAR_BYTES_PER_PAGE,
+			 stripeData + pageOffset, pageLength);
+
+	/* the rest of the page is a hole that full page images leave out */
+	((PageHeader) page)->pd_lower = COLUMNAR_PAGE_DATA_OFFSET + pageLength;
+}
+
+
+/*
+ * ColumnarReadStripeHeader reads the header of the stripe that starts at the
+ * given block. It returns false if the block is beyond the end of the
+ * relation.
+ */
+bool
+ColumnarReadStripeHeader(Relation relation, BlockNumber blockNumber,
+						 ColumnarStripeHeader *stripeHeader)
+{
+	if (blockNumber >= RelationGetNumberOfBlocks(relation))
+	{
+		return false;
+	}
+
+	Buffer buffer = ReadBuffer(relation, blockNumber);
+	LockBuffer(buffer, BUFFER_LOCK_SHARE);
+
+	memcpy_s(stripeHeader, sizeof(ColumnarStripeHeader),
+			 PageGetContents(BufferGetPage(buffer)), sizeof(ColumnarStripeHeader));
+
+	UnlockReleaseBuffer(buffer);
+
+	if (stripeHeader->magicNumber != COLUMNAR_STRIPE_MAGIC_NUMBER ||
+		stripeHeader->blockCount == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("columnar relation \"%s\" has an invalid stripe "
+							   "header in block %u",
+							   RelationGetRelationName(relation), blockNumber)));
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnarReadStripeData reads length bytes at the given offset within the
+ * stripe that starts at the given block.
+ */
+void
+ColumnarReadStripeData(Relation relation, BlockNumber firstBlock, uint64 offset,
+					   char *data, uint64 length)
+{
+	uint64 bytesRead = 0;
+
+	while (bytesRead < length)
+	{
+		uint64 stripeOffset = offset + bytesRead;
+		BlockNumber blockNumber = firstBlock +
+								  (BlockNumber) (stripeOffset / COLUMNAR_BYTES_PER_PAGE);
+		uint64 pageOffset = stripeOffset % COLUMNAR_BYTES_PER_PAGE;
+		uint64 chunkLength = Min(length - bytesRead,
+								 COLUMNAR_BYTES_PER_PAGE - pageOffset);
+
+		Buffer buffer = ReadBuffer(relation, blockNumber);
+		LockBuffer(buffer, BUFFER_LOCK_SHARE);
+
+		Page page = BufferGetPage(buffer);
+		if (COLUMNAR_PAGE_DATA_OFFSET + pageOffset + chunkLength >
+			((PageHeader) page)->pd_lower)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("columnar relation \"%s\" has a truncated "
+								   "stripe in block %u",
+								   RelationGetRelationName(relation), blockNumber)));
+		}
+
+		memcpy_s(data + bytesRead, length - bytesRead,
+				 PageGetContents(page) + pageOffset, chunkLength);
+
+		UnlockReleaseBuffer(buffer);
+
+		bytesRead += chunkLength;
+	}
+}
+
+
+/*
+ * ColumnarSetStripeFlags sets the given flags in the header of the stripe
+ * that starts at the given block.
+ */
+void
+ColumnarSetStripeFlags(Relation relation, BlockNumber blockNumber, uint16 flags)
+{
+	Buffer buffer = ReadBuffer(relation, blockNumber);
+	LockBuffer(buffer, BUFFER_LOCK_EXCLUSIVE);
+
+	GenericXLogState *state = GenericXLogStart(relation);
+	Page page = GenericXLogRegisterBuffer(state, buffer, 0);
+
+	ColumnarStripeHeader *stripeHeader = (ColumnarStripeHeader *) PageGetContents(page);
+	stripeHeader->flags |= flags;
+
+	GenericXLogFinish(state);
+
+	UnlockReleaseBuffer(buffer);
+}
+
+
+#endif
@@ -0,0 +1,787 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_tableam.c
+ *	  The columnar table access method.
+ *
+ * Tables created with USING columnar store their rows in stripes of column
+ * chunks (see columnar_writer.c), which are compressed well and from which
+ * queries only read the columns and chunk groups they need. Columnar tables
+ * are meant for append-only data: rows can be inserted, copied and read, and
+ * tables can be truncated, rewritten and vacuumed, but rows cannot be
+ * updated, deleted or locked, and the tables cannot have indexes.
+ *
+ * Scans through the table access method read all columns. The ColumnarScan
+ * custom scan (see columnar_customscan.c) is used for queries instead, such
+ * that only the columns the query needs are read, and chunk groups are
+ * skipped based on the quals.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "access/multixact.h"
+#include "access/tableam.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/index.h"
+#include "catalog/storage.h"
+#include "catalog/storage_xlog.h"
+#include "commands/vacuum.h"
+#include "distributed/columnar.h"
+#include "executor/tuptable.h"
+#include "storage/bufmgr.h"
+#include "storage/procarray.h"
+#include "storage/smgr.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+
+/* scan descriptor of a columnar table scan */
+typedef struct ColumnarScanDescData
+{
+	TableScanDescData rs_base;
+	ColumnarReadState *readState;
+
+	/* block requested by ANALYZE, and the row read ahead of it */
+	BlockNumber analyzeBlockNumber;
+	bool hasPendingAnalyzeRow;
+	BlockNumber pendingAnalyzeRowBlock;
+} ColumnarScanDescData;
+
+typedef struct ColumnarScanDescData *ColumnarScanDesc;
+
+
+static const TableAmRoutine columnar_methods;
+
+
+static void ColumnarRowNumberToTid(uint64 rowNumber, ItemPointer tid);
+static void ErrorColumnarFeatureNotSupported(const char *operation);
+
+
+PG_FUNCTION_INFO_V1(columnar_handler);
+
+
+/*
+ * IsColumnarTable returns whether the given relation uses the columnar
+ * access method.
+ */
+bool
+IsColumnarTable(Relation relation)
+{
+	return relation->rd_tableam == &columnar_methods;
+}
+
+
+/*
+ * ColumnarRowNumberToTid converts the number of a row in a columnar table
+ * into a tuple identifier that is unique within the table, for ctid.
+ */
+static void
+ColumnarRowNumberToTid(uint64 rowNumber, ItemPointer tid)
+{
+	ItemPointerSet(tid, (BlockNumber) (rowNumber / MaxOffsetNumber),
+				   (OffsetNumber) (rowNumber % MaxOffsetNumber) + FirstOffsetNumber);
+}
+
+
+/*
+ * ErrorColumnarFeatureNotSupported throws an error for an operation that
+ * columnar tables do not support.
+ */
+static void
+ErrorColumnarFeatureNotSupported(const char *operation)
+{
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("%s is not supported for columnar tables", operation)));
+}
+
+
+static const TupleTableSlotOps *
+columnar_slot_callbacks(Relation relation)
+{
+	return &TTSOpsVirtual;
+}
+
+
+static TableScanDesc
+columnar_scan_begin(Relation relation, Snapshot snapshot, int nkeys, ScanKey key,
+					ParallelTableScanDesc parallelScan, uint32 flags)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	Bitmapset *projectedColumns = NULL;
+
+	if (parallelScan != NULL)
+	{
+		ErrorColumnarFeatureNotSupported("parallel scan");
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		projectedColumns = bms_add_member(projectedColumns, columnIndex + 1);
+	}
+
+	ColumnarScanDesc scan = palloc0(sizeof(ColumnarScanDescData));
+	scan->rs_base.rs_rd = relation;
+	scan->rs_base.rs_snapshot = snapshot;
+	scan->rs_base.rs_nkeys = nkeys;
+	scan->rs_base.rs_key = key;
+	scan->rs_base.rs_flags = flags;
+	scan->rs_base.rs_parallel = parallelScan;
+	scan->readState = ColumnarBeginRead(relation, snapshot, projectedColumns, NIL);
+
+	return (TableScanDesc) scan;
+}
+
+
+static void
+columnar_scan_end(TableScanDesc sscan)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	ColumnarEndRead(scan->readState);
+
+	pfree(scan);
+}
+
+
+static void
+columnar_scan_rescan(TableScanDesc sscan, ScanKey key, bool set_params,
+					 bool allow_strat, bool allow_sync, bool allow_pagemode)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	ColumnarRescan(scan->readState);
+	scan->hasPendingAnalyzeRow = false;
+}
+
+
+static bool
+columnar_scan_getnextslot(TableScanDesc sscan, ScanDirection direction,
+						  TupleTableSlot *slot)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+	uint64 rowNumber = 0;
+
+	ExecClearTuple(slot);
+
+	if (!ColumnarReadNextRow(scan->readState, slot->tts_values, slot->tts_isnull,
+							 &rowNumber))
+	{
+		return false;
+	}
+
+	ExecStoreVirtualTuple(slot);
+	slot->tts_tableOid = RelationGetRelid(sscan->rs_rd);
+	ColumnarRowNumberToTid(rowNumber, &slot->tts_tid);
+
+	pgstat_count_heap_getnext(sscan->rs_rd);
+
+	return true;
+}
+
+
+static IndexFetchTableData *
+columnar_index_fetch_begin(Relation relation)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+
+	return NULL;
+}
+
+
+static void
+columnar_index_fetch_reset(IndexFetchTableData *scan)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+}
+
+
+static void
+columnar_index_fetch_end(IndexFetchTableData *scan)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+}
+
+
+static bool
+columnar_index_fetch_tuple(struct IndexFetchTableData *scan, ItemPointer tid,
+						   Snapshot snapshot, TupleTableSlot *slot,
+						   bool *call_again, bool *all_dead)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+
+	return false;
+}
+
+
+static bool
+columnar_fetch_row_version(Relation relation, ItemPointer tid, Snapshot snapshot,
+						   TupleTableSlot *slot)
+{
+	ErrorColumnarFeatureNotSupported("fetching rows by ctid");
+
+	return false;
+}
+
+
+static void
+columnar_get_latest_tid(TableScanDesc sscan, ItemPointer tid)
+{
+	ErrorColumnarFeatureNotSupported("fetching rows by ctid");
+}
+
+
+static bool
+columnar_tuple_tid_valid(TableScanDesc scan, ItemPointer tid)
+{
+	ErrorColumnarFeatureNotSupported("fetching rows by ctid");
+
+	return false;
+}
+
+
+static bool
+columnar_tuple_satisfies_snapshot(Relation relation, TupleTableSlot *slot,
+								  Snapshot snapshot)
+{
+	ErrorColumnarFeatureNotSupported("fetching rows by ctid");
+
+	return false;
+}
+
+
+static TransactionId
+columnar_compute_xid_horizon_for_tuples(Relation relation, ItemPointerData *tids,
+										int nitems)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+
+	return InvalidTransactionId;
+}
+
+
+static void
+columnar_tuple_insert(Relation relation, TupleTableSlot *slot, CommandId cid,
+					  int options, BulkInsertState bistate)
+{
+	slot_getallattrs(slot);
+
+	ColumnarWriteRow(relation, slot->tts_values, slot->tts_isnull, cid);
+
+	/* rows only get a row number once their stripe is written */
+	slot->tts_tableOid = RelationGetRelid(relation);
+	ItemPointerSetInvalid(&slot->tts_tid);
+}
+
+
+static void
+columnar_tuple_insert_speculative(Relation relation, TupleTableSlot *slot,
+								  CommandId cid, int options,
+								  BulkInsertState bistate, uint32 specToken)
+{
+	ErrorColumnarFeatureNotSupported("INSERT ... ON CONFLICT");
+}
+
+
+static void
+columnar_tuple_complete_speculative(Relation relation, TupleTableSlot *slot,
+									uint32 specToken, bool succeeded)
+{
+	ErrorColumnarFeatureNotSupported("INSERT ... ON CONFLICT");
+}
+
+
+static void
+columnar_multi_insert(Relation relation, TupleTableSlot **slots, int ntuples,
+					  CommandId cid, int options, BulkInsertState bistate)
+{
+	for (int slotIndex = 0; slotIndex < ntuples; slotIndex++)
+	{
+		columnar_tuple_insert(relation, slots[slotIndex], cid, options, bistate);
+	}
+}
+
+
+static TM_Result
+columnar_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
+					  Snapshot snapshot, Snapshot crosscheck, bool wait,
+					  TM_FailureData *tmfd, bool changingPart)
+{
+	ErrorColumnarFeatureNotSupported("DELETE");
+
+	return TM_Ok;
+}
+
+
+static TM_Result
+columnar_tuple_update(Relation relation, ItemPointer otid, TupleTableSlot *slot,
+					  CommandId cid, Snapshot snapshot, Snapshot crosscheck,
+					  bool wait, TM_FailureData *tmfd, LockTupleMode *lockmode,
+					  bool *update_indexes)
+{
+	ErrorColumnarFeatureNotSupported("UPDATE");
+
+	return TM_Ok;
+}
+
+
+static TM_Result
+columnar_tuple_lock(Relation relation, ItemPointer tid, Snapshot snapshot,
+					TupleTableSlot *slot, CommandId cid, LockTupleMode mode,
+					LockWaitPolicy wait_policy, uint8 flags, TM_FailureData *tmfd)
+{
+	ErrorColumnarFeatureNotSupported("locking rows");
+
+	return TM_Ok;
+}
+
+
+static void
+columnar_finish_bulk_insert(Relation relation, int options)
+{
+	/* buffered rows are written when the stripe is full or at commit */
+}
+
+
+static void
+columnar_relation_set_new_filenode(Relation relation, const RelFileNode *newrnode,
+								   char persistence, TransactionId *freezeXid,
+								   MultiXactId *minmulti)
+{
+	/* rows buffered for the old file node are gone along with it */
+	ColumnarDiscardPendingWrites(relation->rd_node);
+
+	*freezeXid = RecentXmin;
+	*minmulti = GetOldestMultiXactId();
+
+	SMgrRelation srel = RelationCreateStorage(*newrnode, persistence);
+
+	/* the init fork of an unlogged table is empty, like the table */
+	if (persistence == RELPERSISTENCE_UNLOGGED)
+	{
+		smgrcreate(srel, INIT_FORKNUM, false);
+		log_smgrcreate(newrnode, INIT_FORKNUM);
+		smgrimmedsync(srel, INIT_FORKNUM);
+	}
+
+	smgrclose(srel);
+}
+
+
+static void
+columnar_relation_nontransactional_truncate(Relation relation)
+{
+	ColumnarDiscardPendingWrites(relation->rd_node);
+
+	RelationTruncate(relation, 0);
+}
+
+
+static void
+columnar_relation_copy_data(Relation relation, const RelFileNode *newrnode)
+{
+	char persistence = relation->rd_rel->relpersistence;
+
+	ColumnarFlushPendingWrites(relation);
+
+	SMgrRelation dstrel = smgropen(*newrnode, relation->rd_backend);
+	RelationOpenSmgr(relation);
+
+	FlushRelationBuffers(relation);
+
+	RelationCreateStorage(*newrnode, persistence);
+	RelationCopyStorage(relation->rd_smgr, dstrel, MAIN_FORKNUM, persistence);
+
+	for (ForkNumber forkNumber = MAIN_FORKNUM + 1; forkNumber <= MAX_FORKNUM;
+		 forkNumber++)
+	{
+		if (smgrexists(relation->rd_smgr, forkNumber))
+		{
+			smgrcreate(dstrel, forkNumber, false);
+
+			if (persistence == RELPERSISTENCE_PERMANENT ||
+				(persistence == RELPERSISTENCE_UNLOGGED && forkNumber == INIT_FORKNUM))
+			{
+				log_smgrcreate(newrnode, forkNumber);
+			}
+
+			RelationCopyStorage(relation->rd_smgr, dstrel, forkNumber, persistence);
+		}
+	}
+
+	smgrclose(dstrel);
+}
+
+
+/*
+ * columnar_relation_copy_for_cluster rewrites the committed rows of a table
+ * for VACUUM FULL, which leaves out the stripes of aborted transactions.
+ */
+static void
+columnar_relation_copy_for_cluster(Relation oldHeap, Relation newHeap,
+								   Relation oldIndex, bool use_sort,
+								   TransactionId OldestXmin,
+								   TransactionId *xid_cutoff,
+								   MultiXactId *multi_cutoff,
+								   double *num_tuples,
+								   double *tups_vacuumed,
+								   double *tups_recently_dead)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(oldHeap);
+	int columnCount = tupleDescriptor->natts;
+	Bitmapset *projectedColumns = NULL;
+	uint64 rowNumber = 0;
+
+	if (oldIndex != NULL || use_sort)
+	{
+		ErrorColumnarFeatureNotSupported("clustering on an index");
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		projectedColumns = bms_add_member(projectedColumns, columnIndex + 1);
+	}
+
+	Datum *values = palloc0(columnCount * sizeof(Datum));
+	bool *nulls = palloc0(columnCount * sizeof(bool));
+	CommandId commandId = GetCurrentCommandId(true);
+
+	ColumnarReadState *readState = ColumnarBeginRead(oldHeap, SnapshotAny,
+													 projectedColumns, NIL);
+
+	*num_tuples = 0;
+	*tups_vacuumed = 0;
+	*tups_recently_dead = 0;
+
+	while (ColumnarReadNextRow(readState, values, nulls, &rowNumber))
+	{
+		ColumnarWriteRow(newHeap, values, nulls, commandId);
+		(*num_tuples)++;
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	ColumnarEndRead(readState);
+	ColumnarFlushPendingWrites(newHeap);
+}
+
+
+/*
+ * columnar_vacuum freezes the stripes of committed transactions that all
+ * snapshots can see, and marks the stripes of aborted transactions such
+ * that their transaction ids are never looked up again. This allows the
+ * relfrozenxid of the table to advance. The space of aborted stripes is
+ * only reclaimed by VACUUM FULL.
+ */
+static void
+columnar_vacuum(Relation relation, VacuumParams *params, BufferAccessStrategy bstrategy)
+{
+	TransactionId oldestXmin = InvalidTransactionId;
+	TransactionId freezeLimit = InvalidTransactionId;
+	TransactionId xidFullScanLimit = InvalidTransactionId;
+	MultiXactId multiXactCutoff = InvalidMultiXactId;
+	MultiXactId multiXactFullScanLimit = InvalidMultiXactId;
+	ColumnarMetapage metapage;
+	ColumnarStripeHeader stripeHeader;
+	double liveRowCount = 0;
+
+	vacuum_set_xid_limits(relation, params->freeze_min_age, params->freeze_table_age,
+						  params->multixact_freeze_min_age,
+						  params->multixact_freeze_table_age, &oldestXmin,
+						  &freezeLimit, &xidFullScanLimit, &multiXactCutoff,
+						  &multiXactFullScanLimit);
+
+	ColumnarReadMetapage(relation, &metapage);
+
+	BlockNumber stripeBlock = COLUMNAR_FIRST_STRIPE_BLOCKNO;
+
+	while (stripeBlock < metapage.nextStripeBlock &&
+		   ColumnarReadStripeHeader(relation, stripeBlock, &stripeHeader))
+	{
+		TransactionId transactionId = stripeHeader.xid;
+
+		vacuum_delay_point();
+
+		if (stripeHeader.flags & COLUMNAR_STRIPE_FROZEN)
+		{
+			liveRowCount += stripeHeader.rowCount;
+		}
+		else if (stripeHeader.flags & COLUMNAR_STRIPE_ABORTED)
+		{
+			/* nothing to do */
+		}
+		else if (TransactionIdIsInProgress(transactionId))
+		{
+			/* the transaction started after oldestXmin, so it is not frozen yet */
+		}
+		else if (TransactionIdDidCommit(transactionId))
+		{
+			liveRowCount += stripeHeader.rowCount;
+
+			if (TransactionIdPrecedes(transactionId, oldestXmin))
+			{
+				ColumnarSetStripeFlags(relation, stripeBlock, COLUMNAR_STRIPE_FROZEN);
+			}
+		}
+		else
+		{
+			/* the transaction aborted or crashed */
+			ColumnarSetStripeFlags(relation, stripeBlock, COLUMNAR_STRIPE_ABORTED);
+		}
+
+		stripeBlock += stripeHeader.blockCount;
+	}
+
+	/* all stripes of transactions before oldestXmin are now frozen or aborted */
+	vac_update_relstats(relation, RelationGetNumberOfBlocks(relation), liveRowCount,
+						0, false, oldestXmin, multiXactCutoff, false);
+
+	pgstat_report_vacuum(RelationGetRelid(relation), relation->rd_rel->relisshared,
+						 (PgStat_Counter) liveRowCount, 0);
+}
+
+
+static bool
+columnar_scan_analyze_next_block(TableScanDesc sscan, BlockNumber blockno,
+								 BufferAccessStrategy bstrategy)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	scan->analyzeBlockNumber = blockno;
+
+	return true;
+}
+
+
+/*
+ * columnar_scan_analyze_next_tuple returns the next row that belongs to the
+ * block that ANALYZE asked for. Rows are not stored in blocks, but each row
+ * is mapped to a block of its stripe, such that sampling blocks samples
+ * rows uniformly. The rows of a stripe need to be read one after the other,
+ * so this reads through the rows of the blocks that are not sampled.
+ */
+static bool
+columnar_scan_analyze_next_tuple(TableScanDesc sscan, TransactionId OldestXmin,
+								 double *liverows, double *deadrows,
+								 TupleTableSlot *slot)
+{
+	ColumnarScanDesc scan = (ColumnarScanDesc) sscan;
+
+	while (true)
+	{
+		if (!scan->hasPendingAnalyzeRow)
+		{
+			if (!columnar_scan_getnextslot(sscan, ForwardScanDirection, slot))
+			{
+				return false;
+			}
+
+			scan->pendingAnalyzeRowBlock = ColumnarRowBlockNumber(scan->readState);
+			scan->hasPendingAnalyzeRow = true;
+		}
+
+		if (scan->pendingAnalyzeRowBlock > scan->analyzeBlockNumber)
+		{
+			/* keep the row in the slot for a later block */
+			return false;
+		}
+
+		scan->hasPendingAnalyzeRow = false;
+
+		if (scan->pendingAnalyzeRowBlock == scan->analyzeBlockNumber)
+		{
+			(*liverows)++;
+			return true;
+		}
+	}
+}
+
+
+static double
+columnar_index_build_range_scan(Relation tableRelation, Relation indexRelation,
+								IndexInfo *indexInfo, bool allow_sync,
+								bool anyvisible, bool progress,
+								BlockNumber start_blockno, BlockNumber numblocks,
+								IndexBuildCallback callback, void *callback_state,
+								TableScanDesc scan)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+
+	return 0;
+}
+
+
+static void
+columnar_index_validate_scan(Relation tableRelation, Relation indexRelation,
+							 IndexInfo *indexInfo, Snapshot snapshot,
+							 ValidateIndexState *state)
+{
+	ErrorColumnarFeatureNotSupported("indexing");
+}
+
+
+static uint64
+columnar_relation_size(Relation relation, ForkNumber forkNumber)
+{
+	uint64 blockCount = 0;
+
+	RelationOpenSmgr(relation);
+
+	if (forkNumber == InvalidForkNumber)
+	{
+		for (int forkIndex = 0; forkIndex < MAX_FORKNUM; forkIndex++)
+		{
+			blockCount += smgrnblocks(relation->rd_smgr, forkIndex);
+		}
+	}
+	else
+	{
+		blockCount = smgrnblocks(relation->rd_smgr, forkNumber);
+	}
+
+	return blockCount * BLCKSZ;
+}
+
+
+static bool
+columnar_relation_needs_toast_table(Relation relation)
+{
+	/* values are stored detoasted in column chunks */
+	return false;
+}
+
+
+/*
+ * columnar_estimate_rel_size estimates the number of rows from the number of
+ * rows written to the table, which includes rows of aborted transactions.
+ */
+static void
+columnar_estimate_rel_size(Relation relation, int32 *attr_widths, BlockNumber *pages,
+						   double *tuples, double *allvisfrac)
+{
+	ColumnarMetapage metapage;
+
+	ColumnarReadMetapage(relation, &metapage);
+
+	*pages = RelationGetNumberOfBlocks(relation);
+	*tuples = (double) metapage.nextRowNumber;
+	*allvisfrac = 0;
+}
+
+
+static bool
+columnar_scan_bitmap_next_block(TableScanDesc scan, TBMIterateResult *tbmres)
+{
+	ErrorColumnarFeatureNotSupported("bitmap scan");
+
+	return false;
+}
+
+
+static bool
+columnar_scan_bitmap_next_tuple(TableScanDesc scan, TBMIterateResult *tbmres,
+								TupleTableSlot *slot)
+{
+	ErrorColumnarFeatureNotSupported("bitmap scan");
+
+	return false;
+}
+
+
+static bool
+columnar_scan_sample_next_block(TableScanDesc scan, SampleScanState *scanstate)
+{
+	ErrorColumnarFeatureNotSupported("TABLESAMPLE");
+
+	return false;
+}
+
+
+static bool
+columnar_scan_sample_next_tuple(TableScanDesc scan, SampleScanState *scanstate,
+								TupleTableSlot *slot)
+{
+	ErrorColumnarFeatureNotSupported("TABLESAMPLE");
+
+	return false;
+}
+
+
+static const TableAmRoutine columnar_methods = {
+	.type = T_TableAmRoutine,
+
+	.slot_callbacks = columnar_slot_callbacks,
+
+	.scan_begin = columnar_scan_begin,
+	.scan_end = columnar_scan_end,
+	.scan_rescan = columnar_scan_rescan,
+	.scan_getnextslot = columnar_scan_getnextslot,
+
+	/* parallel scans are not supported, see AddColumnarScanPath */
+	.parallelscan_estimate = table_block_parallelscan_estimate,
+	.parallelscan_initialize = table_block_parallelscan_initialize,
+	.parallelscan_reinitialize = table_block_parallelscan_reinitialize,
+
+	.index_fetch_begin = columnar_index_fetch_begin,
+	.index_fetch_reset = columnar_index_fetch_reset,
+	.index_fetch_end = columnar_index_fetch_end,
+	.index_fetch_tuple = columnar_index_fetch_tuple,
+
+	.tuple_insert = columnar_tuple_insert,
+	.tuple_insert_speculative = columnar_tuple_insert_speculative,
+	.tuple_complete_speculative = columnar_tuple_complete_speculative,
+	.multi_insert = columnar_multi_insert,
+	.tuple_delete = columnar_tuple_delete,
+	.tuple_update = columnar_tuple_update,
+	.tuple_lock = columnar_tuple_lock,
+	.finish_bulk_insert = columnar_finish_bulk_insert,
+
+	.tuple_fetch_row_version = columnar_fetch_row_version,
+	.tuple_get_latest_tid = columnar_get_latest_tid,
+	.tuple_tid_valid = columnar_tuple_tid_valid,
+	.tuple_satisfies_snapshot = columnar_tuple_satisfies_snapshot,
+	.compute_xid_horizon_for_tuples = columnar_compute_xid_horizon_for_tuples,
+
+	.relation_set_new_filenode = columnar_relation_set_new_filenode,
+	.relation_nontransactional_truncate = columnar_relation_nontransactional_truncate,
+	.relation_copy_data = columnar_relation_copy_data,
+	.relation_copy_for_cluster = columnar_relation_copy_for_cluster,
+	.relation_vacuum = columnar_vacuum,
+	.scan_analyze_next_block = columnar_scan_analyze_next_block,
+	.scan_analyze_next_tuple = columnar_scan_analyze_next_tuple,
+	.index_build_range_scan = columnar_index_build_range_scan,
+	.index_validate_scan = columnar_index_validate_scan,
+
+	.relation_size = columnar_relation_size,
+	.relation_needs_toast_table = columnar_relation_needs_toast_table,
+
+	.relation_estimate_size = columnar_estimate_rel_size,
+
+	.scan_bitmap_next_block = columnar_scan_bitmap_next_block,
+	.scan_bitmap_next_tuple = columnar_scan_bitmap_next_tuple,
+	.scan_sample_next_block = columnar_scan_sample_next_block,
+	.scan_sample_next_tuple = columnar_scan_sample_next_tuple
+};
+
+
+/*
+ * columnar_handler returns the routines of the columnar table access method.
+ */
+Datum
+columnar_handler(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(&columnar_methods);
+}
+
+
+#endif
@@ -0,0 +1,760 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_writer.c
+ *	  Buffering rows of columnar relations and writing them as stripes.
+ *
+ * Rows inserted into a columnar relation are buffered in a write state per
+ * relation and (sub)transaction. Every citus.columnar_chunk_group_row_count
+ * rows form a chunk group, in which the values of each column are stored
+ * together as a column chunk, optionally compressed, along with the number
+ * of NULLs and the smallest and largest value of the column. Every
+ * citus.columnar_stripe_row_count rows, the chunk groups are written to the
+ * relation as a stripe with the following layout:
+ *
+ *   ColumnarStripeHeader
+ *   skip list   per column: uint64 offset and uint64 length of the column's
+ *               chunks within the data area
+ *               per chunk group: uint32 row count, and per column: uint32
+ *               null count, uint32 length of the NULL bitmap, uint8
+ *               compression, uint32 stored and uint32 raw length of the
+ *               values, uint64 offset of the chunk within the column, and
+ *               the minimum and maximum value, each as an int32 length (-1
+ *               if there is none) followed by the value
+ *   data area   per column, per chunk group: the NULL bitmap if there are
+ *               NULLs, followed by the non-NULL values
+ *
+ * Integers in the skip list are in network byte order. Values are stored in
+ * the same format as in heap tuples, such that the reader can return
+ * pointers into the decompressed chunks, and the chunks of a column are
+ * stored together such that reading a few columns only reads their pages.
+ *
+ * Buffered rows are written when the stripe is full, before the relation is
+ * read in the same transaction, and before the transaction commits. Rows of
+ * aborted subtransactions are discarded.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "access/tupmacs.h"
+#include "access/xact.h"
+#include "common/pg_lzcompress.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/columnar.h"
+#include "distributed/listutils.h"
+#include "libpq/pqformat.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/typcache.h"
+
+
+/* upper bounds on the size of the values of a chunk group and of a stripe */
+#define COLUMNAR_CHUNK_GROUP_MAX_SIZE (64 * 1024 * 1024)
+#define COLUMNAR_STRIPE_MAX_SIZE (256 * 1024 * 1024)
+
+/* values that are shorter than this are not worth compressing */
+#define COLUMNAR_COMPRESSION_MIN_SIZE 64
+
+
+/*
+ * ColumnChunkBuffer holds the values of one column in the current chunk
+ * group.
+ */
+typedef struct ColumnChunkBuffer
+{
+	StringInfo values;
+	bits8 *nullBitmap;
+	uint32 nullCount;
+
+	bool hasMinMax;
+	Datum minimum;
+	Datum maximum;
+} ColumnChunkBuffer;
+
+
+/*
+ * ColumnarWriteState holds the rows that a (sub)transaction inserted into a
+ * columnar relation and did not write yet.
+ */
+typedef struct ColumnarWriteState
+{
+	Oid relationId;
+	RelFileNode relFileNode;
+	SubTransactionId subTransactionId;
+
+	/* transaction and last command that inserted rows */
+	TransactionId transactionId;
+	CommandId commandId;
+
+	TupleDesc tupleDescriptor;
+	FmgrInfo **compareFunctions;
+	int compression;
+	int chunkGroupRowLimit;
+	int stripeRowLimit;
+
+	/* current chunk group, allocated in the chunk group context */
+	MemoryContext chunkGroupContext;
+	ColumnChunkBuffer *columnChunks;
+	uint32 chunkGroupRowCount;
+
+	/* finished chunk groups of the stripe, allocated in the stripe context */
+	MemoryContext stripeContext;
+	StringInfo chunkGroupSkipList;
+	StringInfo *columnData;
+	uint32 chunkGroupCount;
+	uint64 stripeRowCount;
+	uint64 stripeDataSize;
+} ColumnarWriteState;
+
+
+/* GUC, compression of column chunks */
+int ColumnarCompression = COLUMNAR_COMPRESSION_PGLZ;
+
+/* GUC, number of rows per stripe */
+int ColumnarStripeRowCount = 150000;
+
+/* GUC, number of rows per chunk group */
+int ColumnarChunkGroupRowCount = 10000;
+
+
+/* write states of the current transaction, allocated in WriteStateContext */
+static List *PendingWriteStates = NIL;
+static MemoryContext WriteStateContext = NULL;
+
+
+static ColumnarWriteState * FindOrCreateWriteState(Relation relation);
+static void ResetChunkGroup(ColumnarWriteState *writeState);
+static void ResetStripe(ColumnarWriteState *writeState);
+static void UpdateChunkMinMax(ColumnarWriteState *writeState, int columnIndex,
+							  Datum value);
+static void FlushChunkGroup(ColumnarWriteState *writeState);
+static void AppendChunkValues(ColumnarWriteState *writeState, int columnIndex);
+static void AppendSkipListValue(StringInfo skipList, Form_pg_attribute attribute,
+								bool hasValue, Datum value);
+static void FlushStripe(ColumnarWriteState *writeState, Relation relation);
+static void AppendColumnValue(StringInfo buffer, Form_pg_attribute attribute,
+							  Datum value);
+
+
+/*
+ * ColumnarWriteRow buffers a row that is inserted into the given columnar
+ * relation by the given command, and writes a stripe when it is full.
+ */
+void
+ColumnarWriteRow(Relation relation, Datum *values, bool *nulls, CommandId commandId)
+{
+	ColumnarWriteState *writeState = FindOrCreateWriteState(relation);
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	uint32 rowIndex = writeState->chunkGroupRowCount;
+	bool chunkGroupFull = false;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->chunkGroupContext);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnChunkBuffer *columnChunk = &writeState->columnChunks[columnIndex];
+
+		if (attribute->attisdropped || nulls[columnIndex])
+		{
+			columnChunk->nullCount++;
+			continue;
+		}
+
+		Datum value = values[columnIndex];
+
+		if (attribute->attlen == -1)
+		{
+			/* store the whole value, not a pointer to a toasted value */
+			value = PointerGetDatum(PG_DETOAST_DATUM_PACKED(value));
+		}
+
+		columnChunk->nullBitmap[rowIndex / 8] |= (1 << (rowIndex % 8));
+
+		AppendColumnValue(columnChunk->values, attribute, value);
+		UpdateChunkMinMax(writeState, columnIndex, value);
+
+		if (columnChunk->values->len >= COLUMNAR_CHUNK_GROUP_MAX_SIZE)
+		{
+			chunkGroupFull = true;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	writeState->chunkGroupRowCount++;
+	writeState->commandId = commandId;
+
+	if (chunkGroupFull ||
+		writeState->chunkGroupRowCount >= writeState->chunkGroupRowLimit)
+	{
+		FlushChunkGroup(writeState);
+
+		if (writeState->stripeRowCount >= writeState->stripeRowLimit ||
+			writeState->stripeDataSize >= COLUMNAR_STRIPE_MAX_SIZE)
+		{
+			FlushStripe(writeState, relation);
+		}
+	}
+}
+
+
+/*
+ * FindOrCreateWriteState returns the write state of the current
+ * subtransaction for the given relation. Rows buffered by an outer
+ * subtransaction are written first, such that each write state only holds
+ * rows of one subtransaction.
+ */
+static ColumnarWriteState *
+FindOrCreateWriteState(Relation relation)
+{
+	SubTransactionId subTransactionId = GetCurrentSubTransactionId();
+
+	ColumnarWriteState *writeState = NULL;
+	foreach_ptr(writeState, PendingWriteStates)
+	{
+		if (RelFileNodeEquals(writeState->relFileNode, relation->rd_node) &&
+			writeState->subTransactionId == subTransactionId)
+		{
+			return writeState;
+		}
+	}
+
+	ColumnarFlushPendingWrites(relation);
+
+	if (WriteStateContext == NULL)
+	{
+		WriteStateContext = AllocSetContextCreate(TopTransactionContext,
+												  "Columnar Write States",
+												  ALLOCSET_DEFAULT_SIZES);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(WriteStateContext);
+
+	TupleDesc tupleDescriptor = CreateTupleDescCopy(RelationGetDescr(relation));
+	int columnCount = tupleDescriptor->natts;
+
+	writeState = palloc0(sizeof(ColumnarWriteState));
+	writeState->relationId = RelationGetRelid(relation);
+	writeState->relFileNode = relation->rd_node;
+	writeState->subTransactionId = subTransactionId;
+	writeState->transactionId = GetCurrentTransactionId();
+	writeState->tupleDescriptor = tupleDescriptor;
+	writeState->compareFunctions = palloc0(columnCount * sizeof(FmgrInfo *));
+	writeState->compression = ColumnarCompression;
+	writeState->chunkGroupRowLimit = ColumnarChunkGroupRowCount;
+	writeState->stripeRowLimit = ColumnarStripeRowCount;
+	writeState->columnChunks = palloc0(columnCount * sizeof(ColumnChunkBuffer));
+	writeState->chunkGroupContext = AllocSetContextCreate(WriteStateContext,
+														  "Columnar Chunk Group",
+														  ALLOCSET_DEFAULT_SIZES);
+	writeState->stripeContext = AllocSetContextCreate(WriteStateContext,
+													  "Columnar Stripe",
+													  ALLOCSET_DEFAULT_SIZES);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+													  TYPECACHE_CMP_PROC_FINFO);
+		if (OidIsValid(typeEntry->cmp_proc_finfo.fn_oid))
+		{
+			FmgrInfo *compareFunction = palloc0(sizeof(FmgrInfo));
+
+			fmgr_info_copy(compareFunction, &typeEntry->cmp_proc_finfo,
+						   WriteStateContext);
+			writeState->compareFunctions[columnIndex] = compareFunction;
+		}
+	}
+
+	PendingWriteStates = lappend(PendingWriteStates, writeState);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ResetStripe(writeState);
+	ResetChunkGroup(writeState);
+
+	return writeState;
+}
+
+
+/*
+ * ResetChunkGroup starts a new, empty chunk group.
+ */
+static void
+ResetChunkGroup(ColumnarWriteState *writeState)
+{
+	int columnCount = writeState->tupleDescriptor->natts;
+	int nullBitmapLength = (writeState->chunkGroupRowLimit + 7) / 8;
+
+	MemoryContextReset(writeState->chunkGroupContext);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->chunkGroupContext);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnChunkBuffer *columnChunk = &writeState->columnChunks[columnIndex];
+
+		columnChunk->values = makeStringInfo();
+		columnChunk->nullBitmap = palloc0(nullBitmapLength);
+		columnChunk->nullCount = 0;
+		columnChunk->hasMinMax = false;
+		columnChunk->minimum = (Datum) 0;
+		columnChunk->maximum = (Datum) 0;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	writeState->chunkGroupRowCount = 0;
+}
+
+
+/*
+ * ResetStripe starts a new, empty stripe.
+ */
+static void
+ResetStripe(ColumnarWriteState *writeState)
+{
+	int columnCount = writeState->tupleDescriptor->natts;
+
+	MemoryContextReset(writeState->stripeContext);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeContext);
+
+	writeState->chunkGroupSkipList = makeStringInfo();
+	writeState->columnData = palloc0(columnCount * sizeof(StringInfo));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		writeState->columnData[columnIndex] = makeStringInfo();
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	writeState->chunkGroupCount = 0;
+	writeState->stripeRowCount = 0;
+	writeState->stripeDataSize = 0;
+}
+
+
+/*
+ * UpdateChunkMinMax updates the minimum and maximum value of the given column
+ * in the current chunk group with the given value.
+ */
+static void
+UpdateChunkMinMax(ColumnarWriteState *writeState, int columnIndex, Datum value)
+{
+	Form_pg_attribute attribute = TupleDescAttr(writeState->tupleDescriptor,
+												columnIndex);
+	ColumnChunkBuffer *columnChunk = &writeState->columnChunks[columnIndex];
+	FmgrInfo *compareFunction = writeState->compareFunctions[columnIndex];
+	Oid collationId = attribute->attcollation;
+
+	if (compareFunction == NULL)
+	{
+		return;
+	}
+
+	if (!columnChunk->hasMinMax)
+	{
+		Datum valueCopy = datumCopy(value, attribute->attbyval, attribute->attlen);
+
+		columnChunk->minimum = valueCopy;
+		columnChunk->maximum = valueCopy;
+		columnChunk->hasMinMax = true;
+
+		return;
+	}
+
+	if (DatumGetInt32(FunctionCall2Coll(compareFunction, collationId, value,
+										columnChunk->minimum)) < 0)
+	{
+		columnChunk->minimum = datumCopy(value, attribute->attbyval, attribute->attlen);
+	}
+	else if (DatumGetInt32(FunctionCall2Coll(compareFunction, collationId, value,
+											 columnChunk->maximum)) > 0)
+	{
+		columnChunk->maximum = datumCopy(value, attribute->attbyval, attribute->attlen);
+	}
+}
+
+
+/*
+ * FlushChunkGroup appends the column chunks of the current chunk group to
+ * the stripe, and starts a new chunk group.
+ */
+static void
+FlushChunkGroup(ColumnarWriteState *writeState)
+{
+	int columnCount = writeState->tupleDescriptor->natts;
+
+	if (writeState->chunkGroupRowCount == 0)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeContext);
+
+	pq_sendint32(writeState->chunkGroupSkipList, writeState->chunkGroupRowCount);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		AppendChunkValues(writeState, columnIndex);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	writeState->chunkGroupCount++;
+	writeState->stripeRowCount += writeState->chunkGroupRowCount;
+
+	ResetChunkGroup(writeState);
+}
+
+
+/*
+ * AppendChunkValues appends the NULL bitmap and the values of a column in
+ * the current chunk group to the column's data, and describes them in the
+ * skip list.
+ */
+static void
+AppendChunkValues(ColumnarWriteState *writeState, int columnIndex)
+{
+	Form_pg_attribute attribute = TupleDescAttr(writeState->tupleDescriptor,
+												columnIndex);
+	ColumnChunkBuffer *columnChunk = &writeState->columnChunks[columnIndex];
+	StringInfo columnData = writeState->columnData[columnIndex];
+	StringInfo skipList = writeState->chunkGroupSkipList;
+	StringInfo values = columnChunk->values;
+	uint64 chunkOffset = columnData->len;
+	uint32 nullBitmapLength = 0;
+	char *storedValues = values->data;
+	int32 storedLength = values->len;
+	uint8 compression = COLUMNAR_COMPRESSION_NONE;
+
+	if (columnChunk->nullCount > 0)
+	{
+		nullBitmapLength = (writeState->chunkGroupRowCount + 7) / 8;
+		appendBinaryStringInfo(columnData, (char *) columnChunk->nullBitmap,
+							   nullBitmapLength);
+	}
+
+	if (writeState->compression == COLUMNAR_COMPRESSION_PGLZ &&
+		values->len >= COLUMNAR_COMPRESSION_MIN_SIZE)
+	{
+		char *compressedValues = palloc(PGLZ_MAX_OUTPUT(values->len));
+		int32 compressedLength = pglz_compress(values->data, values->len,
+											   compressedValues,
+											   PGLZ_strategy_default);
+
+		/* store the values as they are if they did not compress well */
+		if (compressedLength >= 0)
+		{
+			storedValues = compressedValues;
+			storedLength = compressedLength;
+			compression = COLUMNAR_COMPRESSION_PGLZ;
+		}
+	}
+
+	appendBinaryStringInfo(columnData, storedValues, storedLength);
+
+	pq_sendint32(skipList, columnChunk->nullCount);
+	pq_sendint32(skipList, nullBitmapLength);
+	pq_sendbyte(skipList, compression);
+	pq_sendint32(skipList, storedLength);
+	pq_sendint32(skipList, values->len);
+	pq_sendint64(skipList, chunkOffset);
+
+	AppendSkipListValue(skipList, attribute, columnChunk->hasMinMax,
+						columnChunk->minimum);
+	AppendSkipListValue(skipList, attribute, columnChunk->hasMinMax,
+						columnChunk->maximum);
+
+	writeState->stripeDataSize += nullBitmapLength + storedLength;
+}
+
+
+/*
+ * AppendSkipListValue appends a minimum or maximum value to the skip list,
+ * in the same format as the values in column chunks.
+ */
+static void
+AppendSkipListValue(StringInfo skipList, Form_pg_attribute attribute, bool hasValue,
+					Datum value)
+{
+	if (!hasValue)
+	{
+		pq_sendint32(skipList, -1);
+		return;
+	}
+
+	StringInfo valueData = makeStringInfo();
+	AppendColumnValue(valueData, attribute, value);
+
+	pq_sendint32(skipList, valueData->len);
+	pq_sendbytes(skipList, valueData->data, valueData->len);
+
+	FreeStringInfo(valueData);
+}
+
+
+/*
+ * AppendColumnValue appends a value to the given buffer in the format of
+ * heap tuples, aligned relative to the start of the buffer.
+ */
+static void
+AppendColumnValue(StringInfo buffer, Form_pg_attribute attribute, Datum value)
+{
+	int valueOffset = att_align_datum(buffer->len, attribute->attalign,
+									  attribute->attlen, value);
+	int valueLength = att_addlength_datum(0, attribute->attlen, value);
+
+	enlargeStringInfo(buffer, valueOffset - buffer->len + valueLength);
+
+	/* the reader relies on padding being zero to recognize short varlenas */
+	memset(buffer->data + buffer->len, 0, valueOffset - buffer->len);
+
+	if (attribute->attbyval)
+	{
+		store_att_byval(buffer->data + valueOffset, value, attribute->attlen);
+	}
+	else
+	{
+		memcpy_s(buffer->data + valueOffset, buffer->maxlen - valueOffset,
+				 DatumGetPointer(value), valueLength);
+	}
+
+	buffer->len = valueOffset + valueLength;
+	buffer->data[buffer->len] = '\0';
+}
+
+
+/*
+ * FlushStripe writes the buffered rows of the given write state to the
+ * relation as a stripe.
+ */
+static void
+FlushStripe(ColumnarWriteState *writeState, Relation relation)
+{
+	int columnCount = writeState->tupleDescriptor->natts;
+
+	FlushChunkGroup(writeState);
+
+	if (writeState->stripeRowCount == 0)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeContext);
+
+	StringInfo skipList = makeStringInfo();
+	uint64 dataLength = 0;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		StringInfo columnData = writeState->columnData[columnIndex];
+
+		pq_sendint64(skipList, dataLength);
+		pq_sendint64(skipList, columnData->len);
+
+		dataLength += columnData->len;
+	}
+
+	appendBinaryStringInfo(skipList, writeState->chunkGroupSkipList->data,
+						   writeState->chunkGroupSkipList->len);
+
+	uint64 stripeLength = sizeof(ColumnarStripeHeader) + skipList->len + dataLength;
+	char *stripeData = MemoryContextAllocHuge(writeState->stripeContext, stripeLength);
+
+	ColumnarStripeHeader *stripeHeader = (ColumnarStripeHeader *) stripeData;
+	memset(stripeHeader, 0, sizeof(ColumnarStripeHeader));
+	stripeHeader->magicNumber = COLUMNAR_STRIPE_MAGIC_NUMBER;
+	stripeHeader->columnCount = columnCount;
+	stripeHeader->xid = writeState->transactionId;
+	stripeHeader->cid = writeState->commandId;
+	stripeHeader->chunkGroupCount = writeState->chunkGroupCount;
+	stripeHeader->rowCount = writeState->stripeRowCount;
+	stripeHeader->skipListLength = skipList->len;
+	stripeHeader->dataLength = dataLength;
+
+	uint64 stripeOffset = sizeof(ColumnarStripeHeader);
+
+	memcpy_s(stripeData + stripeOffset, stripeLength - stripeOffset,
+			 skipList->data, skipList->len);
+	stripeOffset += skipList->len;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		StringInfo columnData = writeState->columnData[columnIndex];
+
+		memcpy_s(stripeData + stripeOffset, stripeLength - stripeOffset,
+				 columnData->data, columnData->len);
+		stripeOffset += columnData->len;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	ColumnarWriteStripe(relation, stripeData, stripeLength);
+
+	ResetStripe(writeState);
+}
+
+
+/*
+ * ColumnarFlushPendingWrites writes the rows that the current transaction
+ * buffered for the given relation, such that they can be read.
+ */
+void
+ColumnarFlushPendingWrites(Relation relation)
+{
+	ListCell *writeStateCell = NULL;
+	ListCell *previousCell = NULL;
+	ListCell *nextCell = NULL;
+
+	for (writeStateCell = list_head(PendingWriteStates); writeStateCell != NULL;
+		 writeStateCell = nextCell)
+	{
+		ColumnarWriteState *writeState = (ColumnarWriteState *) lfirst(writeStateCell);
+
+		nextCell = lnext(writeStateCell);
+
+		if (!RelFileNodeEquals(writeState->relFileNode, relation->rd_node))
+		{
+			previousCell = writeStateCell;
+			continue;
+		}
+
+		FlushStripe(writeState, relation);
+
+		PendingWriteStates = list_delete_cell(PendingWriteStates, writeStateCell,
+											  previousCell);
+	}
+}
+
+
+/*
+ * ColumnarDiscardPendingWrites drops the rows that the current transaction
+ * buffered for the given relation file node, which is truncated or replaced.
+ */
+void
+ColumnarDiscardPendingWrites(RelFileNode relFileNode)
+{
+	ListCell *writeStateCell = NULL;
+	ListCell *previousCell = NULL;
+	ListCell *nextCell = NULL;
+
+	for (writeStateCell = list_head(PendingWriteStates); writeStateCell != NULL;
+		 writeStateCell = nextCell)
+	{
+		ColumnarWriteState *writeState = (ColumnarWriteState *) lfirst(writeStateCell);
+
+		nextCell = lnext(writeStateCell);
+
+		if (!RelFileNodeEquals(writeState->relFileNode, relFileNode))
+		{
+			previousCell = writeStateCell;
+			continue;
+		}
+
+		PendingWriteStates = list_delete_cell(PendingWriteStates, writeStateCell,
+											  previousCell);
+	}
+}
+
+
+/*
+ * ColumnarFlushAllPendingWrites writes the rows that the current transaction
+ * buffered for any relation. It is called before the transaction commits or
+ * is prepared. Relations that were dropped or rewritten since are skipped.
+ */
+void
+ColumnarFlushAllPendingWrites(void)
+{
+	while (PendingWriteStates != NIL)
+	{
+		ColumnarWriteState *writeState =
+			(ColumnarWriteState *) linitial(PendingWriteStates);
+
+		Relation relation = RelationIdGetRelation(writeState->relationId);
+		if (relation == NULL)
+		{
+			PendingWriteStates = list_delete_first(PendingWriteStates);
+			continue;
+		}
+
+		if (RelFileNodeEquals(relation->rd_node, writeState->relFileNode))
+		{
+			ColumnarFlushPendingWrites(relation);
+		}
+		else
+		{
+			ColumnarDiscardPendingWrites(writeState->relFileNode);
+		}
+
+		RelationClose(relation);
+	}
+}
+
+
+/*
+ * ColumnarResetPendingWrites forgets the write states at the end of the
+ * transaction, their memory is freed along with the transaction's memory.
+ */
+void
+ColumnarResetPendingWrites(void)
+{
+	PendingWriteStates = NIL;
+	WriteStateContext = NULL;
+}
+
+
+/*
+ * ColumnarAtEOSubXact hands the write states of a committed subtransaction
+ * to its parent, and drops those of an aborted subtransaction.
+ */
+void
+ColumnarAtEOSubXact(bool isCommit, SubTransactionId subId, SubTransactionId parentSubId)
+{
+	ListCell *writeStateCell = NULL;
+	ListCell *previousCell = NULL;
+	ListCell *nextCell = NULL;
+
+	for (writeStateCell = list_head(PendingWriteStates); writeStateCell != NULL;
+		 writeStateCell = nextCell)
+	{
+		ColumnarWriteState *writeState = (ColumnarWriteState *) lfirst(writeStateCell);
+
+		nextCell = lnext(writeStateCell);
+
+		if (writeState->subTransactionId != subId)
+		{
+			previousCell = writeStateCell;
+		}
+		else if (isCommit)
+		{
+			writeState->subTransactionId = parentSubId;
+			previousCell = writeStateCell;
+		}
+		else
+		{
+			PendingWriteStates = list_delete_cell(PendingWriteStates, writeStateCell,
+												  previousCell);
+		}
+	}
+}
+
+
+#endif
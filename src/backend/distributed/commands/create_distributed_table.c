@@ -36,6 +36,7 @@
 #include "commands/trigger.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/columnar.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
 #include "distributed/distribution_column.h"
@@ -60,6 +61,7 @@
 #include "nodes/execnodes.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
+#include "optimizer/planner.h"
 #include "parser/parse_expr.h"
 #include "parser/parse_node.h"
 #include "parser/parse_relation.h"
@@ -68,6 +70,7 @@
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
@@ -84,6 +87,25 @@
 int ReplicationModel = REPLICATION_MODEL_COORDINATOR;
 
 
+/*
+ * LocalTableCopyDestReceiver forwards the rows read from the local table to the
+ * CitusCopyDestReceiver that sends them to the shards, and reports progress.
+ */
+typedef struct LocalTableCopyDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* receiver that sends the rows to the shards */
+	DestReceiver *copyDest;
+
+	/* executor state whose per-tuple memory is used by copyDest */
+	EState *executorState;
+
+	uint64 rowsCopied;
+} LocalTableCopyDestReceiver;
+
+
 /* local function forward declarations */
 static char AppropriateReplicationModel(char distributionMethod, bool viaDeprecatedAPI);
 static void CreateHashDistributedTableShards(Oid relationId, Oid colocatedTableId,
@@ -109,12 +131,21 @@ static List * TupleDescColumnNameList(TupleDesc tupleDescriptor);
 static bool RelationUsesIdentityColumns(TupleDesc relationDesc);
 static bool DistributionColumnUsesGeneratedStoredColumn(TupleDesc relationDesc,
 														Var *distributionColumn);
-static bool RelationUsesHeapAccessMethodOrNone(Relation relation);
+static bool RelationUsesSupportedAccessMethodOrNone(Relation relation);
 static bool CanUseExclusiveConnections(Oid relationId, bool localTableEmpty);
 static void DoCopyFromLocalTableIntoShards(Relation distributedRelation,
+										   List *columnNameList,
 										   DestReceiver *copyDest,
-										   TupleTableSlot *slot,
 										   EState *estate);
+static PlannedStmt * LocalTableScanPlan(Relation distributedRelation,
+										List *columnNameList);
+static DestReceiver * CreateLocalTableCopyDestReceiver(DestReceiver *copyDest,
+													   EState *executorState);
+static void LocalTableCopyDestReceiverStartup(DestReceiver *dest, int operation,
+											  TupleDesc inputTupleDescriptor);
+static bool LocalTableCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void LocalTableCopyDestReceiverShutdown(DestReceiver *dest);
+static void LocalTableCopyDestReceiverDestroy(DestReceiver *dest);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(master_create_distributed_table);
@@ -654,10 +685,10 @@ EnsureRelationCanBeDistributed(Oid relationId, Var *distributionColumn,
 	TupleDesc relationDesc = RelationGetDescr(relation);
 	char *relationName = RelationGetRelationName(relation);
 
-	if (!RelationUsesHeapAccessMethodOrNone(relation))
+	if (!RelationUsesSupportedAccessMethodOrNone(relation))
 	{
-		ereport(ERROR, (errmsg(
-							"cannot distribute relations using non-heap access methods")));
+		ereport(ERROR, (errmsg("cannot distribute relations using access methods "
+							   "other than heap and columnar")));
 	}
 
 #if PG_VERSION_NUM < PG_VERSION_12
@@ -1196,11 +1227,10 @@ RegularTable(Oid relationId)
  * opens a connection and starts a COPY for each shard placement that will have
  * data.
  *
- * We could call the planner and executor here and send the output to the
- * DestReceiver, but we are in a tricky spot here since Citus is already
- * intercepting queries on this table in the planner and executor hooks and we
- * want to read from the local table. To keep it simple, we perform a heap scan
- * directly on the table.
+ * Citus is already intercepting queries on this table in the planner hook, so
+ * we plan the query that reads the local table with the standard planner and
+ * send its output to the DestReceiver. This lets large tables be read by a
+ * parallel sequential scan.
  *
  * Any writes on the table that are started during this operation will be handled
  * as distributed queries once the current transaction commits. SELECTs will
@@ -1238,25 +1268,35 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	 */
 	PushActiveSnapshot(GetLatestSnapshot());
 
-	/* get the table columns */
+	/* get the table columns, which are also the columns of the rows we read */
 	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
-	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
-														  &TTSOpsHeapTuple);
 	List *columnNameList = TupleDescColumnNameList(tupleDescriptor);
 
 	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
 
-	/* determine the partition column in the tuple descriptor */
+	/* determine the partition column in the rows we read */
 	Var *partitionColumn = PartitionColumn(distributedRelationId, 0);
 	if (partitionColumn != NULL)
 	{
-		partitionColumnIndex = partitionColumn->varattno - 1;
+		char *partitionColumnName = get_attname(distributedRelationId,
+												partitionColumn->varattno, false);
+		int columnIndex = 0;
+
+		char *columnName = NULL;
+		foreach_ptr(columnName, columnNameList)
+		{
+			if (strncmp(columnName, partitionColumnName, NAMEDATALEN) == 0)
+			{
+				partitionColumnIndex = columnIndex;
+				break;
+			}
+
+			columnIndex++;
+		}
 	}
 
 	/* initialise per-tuple memory context */
 	EState *estate = CreateExecutorState();
-	ExprContext *econtext = GetPerTupleExprContext(estate);
-	econtext->ecxt_scantuple = slot;
 
 	bool stopOnFailure = true;
 	DestReceiver *copyDest =
@@ -1266,17 +1306,10 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 													 estate, stopOnFailure,
 													 NULL);
 
-	/* initialise state for writing to shards, we'll open connections on demand */
-	copyDest->rStartup(copyDest, 0, tupleDescriptor);
-
-	DoCopyFromLocalTableIntoShards(distributedRelation, copyDest, slot, estate);
-
-	/* finish writing into the shards */
-	copyDest->rShutdown(copyDest);
-	copyDest->rDestroy(copyDest);
+	DoCopyFromLocalTableIntoShards(distributedRelation, columnNameList, copyDest,
+								   estate);
 
 	/* free memory and close the relation */
-	ExecDropSingleTupleTableSlot(slot);
 	FreeExecutorState(estate);
 	heap_close(distributedRelation, NoLock);
 
@@ -1287,54 +1320,27 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 /*
  * DoCopyFromLocalTableIntoShards performs a copy operation
  * from local tables into shards.
+ *
+ * The local table is read by a query, so that PostgreSQL can use a parallel
+ * sequential scan for large tables. Parallel workers then share reading the
+ * heap and deforming the tuples, while this backend sends the rows to the
+ * shards within the distributed transaction.
  */
 static void
 DoCopyFromLocalTableIntoShards(Relation distributedRelation,
+							   List *columnNameList,
 							   DestReceiver *copyDest,
-							   TupleTableSlot *slot,
 							   EState *estate)
 {
-	/* begin reading from local table */
-#if PG_VERSION_NUM >= PG_VERSION_12
-	TableScanDesc scan = table_beginscan(distributedRelation, GetActiveSnapshot(), 0,
-										 NULL);
-#else
-	HeapScanDesc scan = heap_beginscan(distributedRelation, GetActiveSnapshot(), 0, NULL);
-#endif
+	PlannedStmt *scanPlan = LocalTableScanPlan(distributedRelation, columnNameList);
+	DestReceiver *localTableDest = CreateLocalTableCopyDestReceiver(copyDest, estate);
+	LocalTableCopyDestReceiver *localTableCopyDest =
+		(LocalTableCopyDestReceiver *) localTableDest;
 
-	MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
-
-	uint64 rowsCopied = 0;
-	HeapTuple tuple = NULL;
-	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
-	{
-		/* materialize tuple and send it to a shard */
-#if PG_VERSION_NUM >= PG_VERSION_12
-		ExecStoreHeapTuple(tuple, slot, false);
-#else
-		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
-#endif
-		copyDest->receiveSlot(slot, copyDest);
-
-		/* clear tuple memory */
-		ResetPerTupleExprContext(estate);
-
-		/* make sure we roll back on cancellation */
-		CHECK_FOR_INTERRUPTS();
-
-		if (rowsCopied == 0)
-		{
-			ereport(NOTICE, (errmsg("Copying data from local table...")));
-		}
-
-		rowsCopied++;
-
-		if (rowsCopied % LOG_PER_TUPLE_AMOUNT == 0)
-		{
-			ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
-		}
-	}
+	/* the copy receiver opens connections on demand once rows arrive */
+	ExecutePlanIntoDestReceiver(scanPlan, NULL, localTableDest);
 
+	uint64 rowsCopied = localTableCopyDest->rowsCopied;
 	if (rowsCopied % LOG_PER_TUPLE_AMOUNT != 0)
 	{
 		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
@@ -1352,14 +1358,174 @@ DoCopyFromLocalTableIntoShards(Relation distributedRelation,
 								 qualifiedRelationName)));
 	}
 
+	localTableDest->rDestroy(localTableDest);
+}
+
+
+/*
+ * LocalTableScanPlan plans a query that reads the given columns from the local
+ * data of the given relation.
+ *
+ * We call standard_planner() directly, since the relation is already marked as
+ * distributed and the distributed planner would otherwise plan a query on its
+ * shards. We also let the planner ignore the cost of passing rows from the
+ * parallel workers to this backend, which is otherwise so high for a query
+ * that returns all rows that it would never choose a parallel scan. The number
+ * of workers is still limited by max_parallel_workers_per_gather, and small
+ * tables are still read without workers.
+ *
+ * When the coordinator has placements of the relation, rows for those
+ * placements are written locally, which cannot happen while in parallel mode,
+ * so we do not use a parallel scan in that case.
+ */
+static PlannedStmt *
+LocalTableScanPlan(Relation distributedRelation, List *columnNameList)
+{
+	Oid relationId = RelationGetRelid(distributedRelation);
+	char *qualifiedRelationName = generate_qualified_relation_name(relationId);
+	StringInfo columnsString = makeStringInfo();
+	StringInfo scanQueryString = makeStringInfo();
+	int cursorOptions = 0;
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, columnNameList)
+	{
+		if (columnsString->len > 0)
+		{
+			appendStringInfoString(columnsString, ", ");
+		}
+
+		appendStringInfoString(columnsString, quote_identifier(columnName));
+	}
+
+	appendStringInfo(scanQueryString, "SELECT %s FROM ONLY %s", columnsString->data,
+					 qualifiedRelationName);
+
+	Query *scanQuery = ParseQueryString(scanQueryString->data, NULL, 0);
+
+	List *localPlacementList = GroupShardPlacementsForTableOnGroup(relationId,
+																   GetLocalGroupId());
+	if (localPlacementList == NIL)
+	{
+		cursorOptions |= CURSOR_OPT_PARALLEL_OK;
+	}
+
+	int gucNestLevel = NewGUCNestLevel();
+
+	(void) set_config_option("parallel_setup_cost", "0", PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+	(void) set_config_option("parallel_tuple_cost", "0", PGC_USERSET, PGC_S_SESSION,
+							 GUC_ACTION_SAVE, true, 0, false);
+
+	PlannedStmt *scanPlan = standard_planner(scanQuery, cursorOptions, NULL);
+
+	AtEOXact_GUC(true, gucNestLevel);
+
+	return scanPlan;
+}
+
+
+/*
+ * CreateLocalTableCopyDestReceiver creates a DestReceiver that forwards rows
+ * to the given copy receiver, whose per-tuple memory lives in executorState.
+ */
+static DestReceiver *
+CreateLocalTableCopyDestReceiver(DestReceiver *copyDest, EState *executorState)
+{
+	LocalTableCopyDestReceiver *localTableCopyDest =
+		palloc0(sizeof(LocalTableCopyDestReceiver));
+
+	localTableCopyDest->pub.receiveSlot = LocalTableCopyDestReceiverReceive;
+	localTableCopyDest->pub.rStartup = LocalTableCopyDestReceiverStartup;
+	localTableCopyDest->pub.rShutdown = LocalTableCopyDestReceiverShutdown;
+	localTableCopyDest->pub.rDestroy = LocalTableCopyDestReceiverDestroy;
+	localTableCopyDest->pub.mydest = DestCopyOut;
+
+	localTableCopyDest->copyDest = copyDest;
+	localTableCopyDest->executorState = executorState;
+	localTableCopyDest->rowsCopied = 0;
+
+	return (DestReceiver *) localTableCopyDest;
+}
+
+
+/*
+ * LocalTableCopyDestReceiverStartup initialises the copy receiver for rows of
+ * the scan query.
+ */
+static void
+LocalTableCopyDestReceiverStartup(DestReceiver *dest, int operation,
+								  TupleDesc inputTupleDescriptor)
+{
+	LocalTableCopyDestReceiver *localTableCopyDest = (LocalTableCopyDestReceiver *) dest;
+	DestReceiver *copyDest = localTableCopyDest->copyDest;
+
+	copyDest->rStartup(copyDest, operation, inputTupleDescriptor);
+}
+
+
+/*
+ * LocalTableCopyDestReceiverReceive sends a row of the local table to its
+ * shard and logs the progress of the copy.
+ */
+static bool
+LocalTableCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	LocalTableCopyDestReceiver *localTableCopyDest = (LocalTableCopyDestReceiver *) dest;
+	DestReceiver *copyDest = localTableCopyDest->copyDest;
+	EState *executorState = localTableCopyDest->executorState;
+
+	if (localTableCopyDest->rowsCopied == 0)
+	{
+		ereport(NOTICE, (errmsg("Copying data from local table...")));
+	}
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetPerTupleMemoryContext(executorState));
+
+	copyDest->receiveSlot(slot, copyDest);
+
 	MemoryContextSwitchTo(oldContext);
 
-	/* finish reading from the local table */
-#if PG_VERSION_NUM >= PG_VERSION_12
-	table_endscan(scan);
-#else
-	heap_endscan(scan);
-#endif
+	/* clear tuple memory */
+	ResetPerTupleExprContext(executorState);
+
+	localTableCopyDest->rowsCopied++;
+
+	if (localTableCopyDest->rowsCopied % LOG_PER_TUPLE_AMOUNT == 0)
+	{
+		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows",
+								localTableCopyDest->rowsCopied)));
+	}
+
+	return true;
+}
+
+
+/*
+ * LocalTableCopyDestReceiverShutdown finishes writing into the shards.
+ */
+static void
+LocalTableCopyDestReceiverShutdown(DestReceiver *dest)
+{
+	LocalTableCopyDestReceiver *localTableCopyDest = (LocalTableCopyDestReceiver *) dest;
+	DestReceiver *copyDest = localTableCopyDest->copyDest;
+
+	copyDest->rShutdown(copyDest);
+}
+
+
+/*
+ * LocalTableCopyDestReceiverDestroy frees the copy receiver along with this one.
+ */
+static void
+LocalTableCopyDestReceiverDestroy(DestReceiver *dest)
+{
+	LocalTableCopyDestReceiver *localTableCopyDest = (LocalTableCopyDestReceiver *) dest;
+	DestReceiver *copyDest = localTableCopyDest->copyDest;
+
+	copyDest->rDestroy(copyDest);
+	pfree(localTableCopyDest);
 }
 
 
@@ -1437,15 +1603,17 @@ DistributionColumnUsesGeneratedStoredColumn(TupleDesc relationDesc,
 
 
 /*
- * Returns whether given relation uses default access method
+ * Returns whether given relation uses the heap or columnar access method, or
+ * does not have an access method.
  */
 static bool
-RelationUsesHeapAccessMethodOrNone(Relation relation)
+RelationUsesSupportedAccessMethodOrNone(Relation relation)
 {
 #if PG_VERSION_NUM >= PG_VERSION_12
 
 	return relation->rd_rel->relkind != RELKIND_RELATION ||
-		   relation->rd_amhandler == HEAP_TABLE_AM_HANDLER_OID;
+		   relation->rd_amhandler == HEAP_TABLE_AM_HANDLER_OID ||
+		   IsColumnarTable(relation);
 #else
 	return true;
 #endif
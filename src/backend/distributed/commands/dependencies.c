@@ -244,12 +244,11 @@ GetDependencyCreateDDLCommands(const ObjectAddress *dependency)
 
 
 /*
- * ReplicateAllDependenciesToNode replicate all previously marked objects to a worker
- * node. The function also sets clusterHasDistributedFunction if there are any
- * distributed functions.
+ * DependencyCreateCommandListForNode returns the commands to create all
+ * previously marked objects on a worker node, in dependency order.
  */
-void
-ReplicateAllDependenciesToNode(const char *nodeName, int nodePort)
+List *
+DependencyCreateCommandListForNode(const char *nodeName, int nodePort)
 {
 	List *ddlCommands = NIL;
 
@@ -288,17 +287,8 @@ ReplicateAllDependenciesToNode(const char *nodeName, int nodePort)
 		ddlCommands = list_concat(ddlCommands,
 								  GetDependencyCreateDDLCommands(dependency));
 	}
-	if (list_length(ddlCommands) <= 0)
-	{
-		/* no commands to replicate dependencies to the new worker */
-		return;
-	}
-
-	/* since we are executing ddl commands lets disable propagation, primarily for mx */
-	ddlCommands = list_concat(list_make1(DISABLE_DDL_PROPAGATION), ddlCommands);
 
-	SendCommandListToWorkerInSingleTransaction(nodeName, nodePort,
-											   CitusExtensionOwnerName(), ddlCommands);
+	return ddlCommands;
 }
 
 
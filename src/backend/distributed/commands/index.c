@@ -15,11 +15,13 @@
 #include "access/genam.h"
 #endif
 #include "access/htup_details.h"
+#include "access/tupdesc.h"
 #include "access/xact.h"
 #include "catalog/catalog.h"
 #include "catalog/index.h"
 #include "catalog/namespace.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 #include "commands/tablecmds.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
@@ -29,9 +31,11 @@
 #include "distributed/listutils.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/resource_lock.h"
 #include "distributed/version_compat.h"
+#include "executor/tuptable.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "nodes/parsenodes.h"
@@ -40,9 +44,27 @@
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+/* config variable(s) managed via guc.c */
+int MaxIndexBuildPoolSize = 0;
+
+
+/* state of the index on a shard placement, see ShardPlacementIndexStates */
+typedef enum ShardIndexState
+{
+	SHARD_INDEX_MISSING,
+	SHARD_INDEX_INVALID,
+	SHARD_INDEX_VALID
+} ShardIndexState;
+
 
 /* Local functions forward declarations for helper functions */
 static List * CreateIndexTaskList(Oid relationId, IndexStmt *indexStmt);
+static bool IsInvalidIndexOfRelation(Oid indexRelationId, Oid relationId);
+static List * ResumeConcurrentIndexTaskList(Oid relationId, IndexStmt *indexStmt);
+static ShardIndexState * ShardPlacementIndexStates(List *placementList, char *schemaName,
+												   char *indexName);
 static List * CreateReindexTaskList(Oid relationId, ReindexStmt *reindexStmt);
 static void RangeVarCallbackForDropIndex(const RangeVar *rel, Oid relOid, Oid oldRelOid,
 										 void *arg);
@@ -180,6 +202,28 @@ PreprocessIndexStmt(Node *node, const char *createIndexCommand)
 				ddlJob->concurrentIndexCmd = createIndexStatement->concurrent;
 				ddlJob->commandString = createIndexCommand;
 				ddlJob->taskList = CreateIndexTaskList(relationId, createIndexStatement);
+				ddlJob->targetPoolSize = MaxIndexBuildPoolSize;
+
+				ddlJobs = list_make1(ddlJob);
+			}
+			else if (createIndexStatement->concurrent &&
+					 createIndexStatement->if_not_exists &&
+					 IsInvalidIndexOfRelation(indexRelationId, relationId))
+			{
+				/*
+				 * A previous CREATE INDEX CONCURRENTLY failed partially and left
+				 * behind an invalid index. Rather than building the index on all
+				 * shards again, only build it on the shard placements that do not
+				 * have a valid index yet. PostprocessIndexStmt marks the index
+				 * valid once all of them succeed.
+				 */
+				DDLJob *ddlJob = palloc0(sizeof(DDLJob));
+				ddlJob->targetRelationId = relationId;
+				ddlJob->concurrentIndexCmd = true;
+				ddlJob->commandString = createIndexCommand;
+				ddlJob->taskList = ResumeConcurrentIndexTaskList(relationId,
+																 createIndexStatement);
+				ddlJob->targetPoolSize = MaxIndexBuildPoolSize;
 
 				ddlJobs = list_make1(ddlJob);
 			}
@@ -289,6 +333,7 @@ PreprocessReindexStmt(Node *node, const char *reindexCommand)
 #endif
 			ddlJob->commandString = reindexCommand;
 			ddlJob->taskList = CreateReindexTaskList(relationId, reindexStatement);
+			ddlJob->targetPoolSize = MaxIndexBuildPoolSize;
 
 			ddlJobs = list_make1(ddlJob);
 		}
@@ -542,6 +587,214 @@ CreateIndexTaskList(Oid relationId, IndexStmt *indexStmt)
 }
 
 
+/*
+ * IsInvalidIndexOfRelation returns whether the given relation is an index on
+ * the given table that is marked invalid.
+ */
+static bool
+IsInvalidIndexOfRelation(Oid indexRelationId, Oid relationId)
+{
+	bool isInvalidIndex = false;
+
+	HeapTuple indexTuple = SearchSysCache1(INDEXRELID,
+										   ObjectIdGetDatum(indexRelationId));
+	if (!HeapTupleIsValid(indexTuple))
+	{
+		return false;
+	}
+
+	Form_pg_index indexForm = (Form_pg_index) GETSTRUCT(indexTuple);
+	if (indexForm->indrelid == relationId && !indexForm->indisvalid)
+	{
+		isInvalidIndex = true;
+	}
+
+	ReleaseSysCache(indexTuple);
+
+	return isInvalidIndex;
+}
+
+
+/*
+ * ResumeConcurrentIndexTaskList builds a list of tasks that completes a
+ * partially failed CREATE INDEX CONCURRENTLY on the given distributed table.
+ * Shard placements that already have a valid index are skipped, placements
+ * without the index get it built concurrently and placements on which the
+ * earlier build left an invalid index get it rebuilt.
+ */
+static List *
+ResumeConcurrentIndexTaskList(Oid relationId, IndexStmt *indexStmt)
+{
+	List *taskList = NIL;
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	List *placementList = NIL;
+	char *indexName = indexStmt->idxname;
+	char *schemaName = indexStmt->relation->schemaname;
+	StringInfoData ddlString;
+	uint64 jobId = INVALID_JOB_ID;
+	int taskId = 1;
+
+	initStringInfo(&ddlString);
+
+	/* lock metadata before getting placement lists */
+	LockShardListMetadata(shardIntervalList, ShareLock);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		placementList = list_concat(placementList,
+									ActiveShardPlacementList(shardInterval->shardId));
+	}
+
+	ShardIndexState *indexStates = ShardPlacementIndexStates(placementList, schemaName,
+															 indexName);
+
+	int placementIndex = 0;
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		ShardIndexState indexState = indexStates[placementIndex++];
+		uint64 shardId = placement->shardId;
+
+		if (indexState == SHARD_INDEX_VALID)
+		{
+			continue;
+		}
+		else if (indexState == SHARD_INDEX_MISSING)
+		{
+			deparse_shard_index_statement(indexStmt, relationId, shardId, &ddlString);
+		}
+		else
+		{
+			char *shardIndexName = pstrdup(indexName);
+
+			AppendShardIdToName(&shardIndexName, shardId);
+
+			/* rebuilding replaces the invalid index left behind by the failure */
+#if PG_VERSION_NUM >= PG_VERSION_12
+			appendStringInfo(&ddlString, "REINDEX INDEX CONCURRENTLY %s",
+							 quote_qualified_identifier(schemaName, shardIndexName));
+#else
+			appendStringInfo(&ddlString, "REINDEX INDEX %s",
+							 quote_qualified_identifier(schemaName, shardIndexName));
+#endif
+		}
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = jobId;
+		task->taskId = taskId++;
+		task->taskType = DDL_TASK;
+		SetTaskQueryString(task, pstrdup(ddlString.data));
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->dependentTaskList = NULL;
+		task->anchorShardId = shardId;
+		task->taskPlacementList = list_make1(placement);
+
+		taskList = lappend(taskList, task);
+
+		resetStringInfo(&ddlString);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * ShardPlacementIndexStates looks up the state of the index with the given
+ * name on each of the given shard placements, and returns an array with the
+ * state of each placement in the order of the list.
+ */
+static ShardIndexState *
+ShardPlacementIndexStates(List *placementList, char *schemaName, char *indexName)
+{
+	int placementCount = list_length(placementList);
+	ShardIndexState *indexStates = palloc0(placementCount * sizeof(ShardIndexState));
+	List *taskList = NIL;
+	StringInfoData queryString;
+	int placementIndex = 0;
+
+	initStringInfo(&queryString);
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		char *shardIndexName = pstrdup(indexName);
+		AppendShardIdToName(&shardIndexName, placement->shardId);
+
+		/* return the placement index with the result to find its placement */
+		appendStringInfo(&queryString,
+						 "SELECT %d, (SELECT indisvalid FROM pg_catalog.pg_index "
+						 "WHERE indexrelid OPERATOR(pg_catalog.=) "
+						 "pg_catalog.to_regclass(%s)::pg_catalog.oid)",
+						 placementIndex,
+						 quote_literal_cstr(quote_qualified_identifier(schemaName,
+																	   shardIndexName)));
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = INVALID_JOB_ID;
+		task->taskId = placementIndex + 1;
+		task->taskType = SELECT_TASK;
+		SetTaskQueryString(task, pstrdup(queryString.data));
+		task->anchorShardId = placement->shardId;
+		task->taskPlacementList = list_make1(placement);
+
+		taskList = lappend(taskList, task);
+
+		resetStringInfo(&queryString);
+		placementIndex++;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "placement_index",
+					   INT4OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "index_valid",
+					   BOOLOID, -1, 0);
+
+	bool randomAccess = false;
+	bool interTransactions = false;
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(randomAccess, interTransactions,
+														work_mem);
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, taskList, tupleDescriptor,
+								  tupleStore, true);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		int resultIndex = DatumGetInt32(slot_getattr(slot, 1, &isNull));
+		Datum indexValidDatum = slot_getattr(slot, 2, &isNull);
+
+		Assert(resultIndex >= 0 && resultIndex < placementCount);
+
+		if (isNull)
+		{
+			indexStates[resultIndex] = SHARD_INDEX_MISSING;
+		}
+		else if (DatumGetBool(indexValidDatum))
+		{
+			indexStates[resultIndex] = SHARD_INDEX_VALID;
+		}
+		else
+		{
+			indexStates[resultIndex] = SHARD_INDEX_INVALID;
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return indexStates;
+}
+
+
 /*
  * CreateReindexTaskList builds a list of tasks to execute a REINDEX command
  * against a specified distributed table.
@@ -13,6 +13,10 @@
  * even if user did not do a copy with binary format, it is possible that
  * we are going to be using binary format internally.
  *
+ * When the incoming tuples provide all the columns of a plain shard
+ * relation without triggers, we skip the serialization and insert the
+ * tuples directly into the shard in batches instead.
+ *
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -22,18 +26,56 @@
 #include "postgres.h"
 #include "commands/copy.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_type.h"
 #include "parser/parse_relation.h"
 #include "utils/lsyscache.h"
 #include "nodes/makefuncs.h"
 #include "safe_lib.h"
 #include <netinet/in.h> /* for htons */
 
+#include "distributed/pg_version_constants.h"
+
+#include "access/heapam.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "access/tableam.h"
+#endif
+#include "access/xact.h"
+#include "executor/executor.h"
 #include "distributed/transmit.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/local_executor.h"
 #include "distributed/local_multi_copy.h"
 #include "distributed/shard_utils.h"
+#include "distributed/version_compat.h"
+
+
+/*
+ * LocalShardInsertState keeps the state for inserting tuples directly into
+ * a local shard relation. Tuples are buffered in slots that belong to the
+ * shard relation and inserted in a single multi-insert once the batch fills up.
+ */
+struct LocalShardInsertState
+{
+	Relation shardRelation;
+
+	/* executor state used for checking constraints and inserting index entries */
+	EState *executorState;
+	ResultRelInfo *resultRelInfo;
+	BulkInsertState bulkInsertState;
+
+	/* attribute number in the shard for each column of the incoming tuples */
+	AttrNumber *shardAttributeNumbers;
+
+	/* buffered tuples that are not inserted yet */
+	TupleTableSlot **bufferedSlots;
+	int bufferedSlotCount;
+	int createdSlotCount;
+	Size bufferedTupleBytes;
+
+	/* line of the buffered tuple that is checked or indexed, for error context */
+	int currentLine;
+};
 
 static int ReadFromLocalBufferCallback(void *outBuf, int minRead, int maxRead);
 static void AddSlotToBuffer(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
@@ -43,6 +85,11 @@ static bool ShouldSendCopyNow(StringInfo buffer);
 static void DoLocalCopy(StringInfo buffer, Oid relationId, int64 shardId,
 						CopyStmt *copyStatement, bool isEndOfCopy);
 static bool ShouldAddBinaryHeaders(StringInfo buffer, bool isBinary);
+static AttrNumber * ShardAttributeNumbersForCopy(CitusCopyDestReceiver *copyDest,
+												 Relation shardRelation);
+static bool ShardRelationAllowsDirectInsert(Relation shardRelation);
+static void FlushLocalShardInsertBuffer(LocalShardInsertState *insertState);
+static void LocalShardInsertErrorCallback(void *arg);
 
 /*
  * LocalCopyBuffer is used in copy callback to return the copied rows.
@@ -177,6 +224,421 @@ DoLocalCopy(StringInfo buffer, Oid relationId, int64 shardId, CopyStmt *copyStat
 }
 
 
+/*
+ * BeginLocalShardInsert prepares the state for inserting the tuples of the
+ * given copy directly into the local placement of the shard with the given id.
+ * The function returns NULL if the tuples cannot be inserted directly, in which
+ * case the caller should fall back to WriteTupleToLocalShard.
+ */
+LocalShardInsertState *
+BeginLocalShardInsert(CitusCopyDestReceiver *copyDest, int64 shardId)
+{
+	if (copyDest->intermediateResultIdPrefix != NULL)
+	{
+		return NULL;
+	}
+
+	Oid shardOid = GetTableLocalShardOid(copyDest->distributedRelationId, shardId);
+	if (!OidIsValid(shardOid))
+	{
+		return NULL;
+	}
+
+	Relation shardRelation = heap_open(shardOid, RowExclusiveLock);
+	if (!ShardRelationAllowsDirectInsert(shardRelation))
+	{
+		heap_close(shardRelation, NoLock);
+		return NULL;
+	}
+
+	AttrNumber *shardAttributeNumbers = ShardAttributeNumbersForCopy(copyDest,
+																	 shardRelation);
+	if (shardAttributeNumbers == NULL)
+	{
+		heap_close(shardRelation, NoLock);
+		return NULL;
+	}
+
+	LocalShardInsertState *insertState = palloc0(sizeof(LocalShardInsertState));
+	insertState->shardRelation = shardRelation;
+	insertState->shardAttributeNumbers = shardAttributeNumbers;
+	insertState->bulkInsertState = GetBulkInsertState();
+	insertState->bufferedSlots =
+		palloc0(LOCAL_SHARD_INSERT_BATCH_SIZE * sizeof(TupleTableSlot *));
+
+	/* range table is set so that we can report constraint violations */
+	EState *executorState = CreateExecutorState();
+	List *rangeTable = CreateRangeTable(shardRelation, ACL_INSERT);
+#if PG_VERSION_NUM >= PG_VERSION_12
+	ExecInitRangeTable(executorState, rangeTable);
+#else
+	executorState->es_range_table = rangeTable;
+#endif
+
+	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, shardRelation, 1, NULL, 0);
+	ExecOpenIndices(resultRelInfo, false);
+
+	executorState->es_result_relations = resultRelInfo;
+	executorState->es_num_result_relations = 1;
+	executorState->es_result_relation_info = resultRelInfo;
+	executorState->es_output_cid = GetCurrentCommandId(true);
+
+	insertState->executorState = executorState;
+	insertState->resultRelInfo = resultRelInfo;
+
+	return insertState;
+}
+
+
+/*
+ * ShardRelationAllowsDirectInsert returns whether tuples can be inserted into
+ * the given shard relation without going through CopyFrom. We only do that for
+ * plain tables that are not partitions and have no triggers (including foreign
+ * key triggers), generated columns and domain typed columns, such that we do
+ * not have to replicate the corresponding logic of CopyFrom.
+ */
+static bool
+ShardRelationAllowsDirectInsert(Relation shardRelation)
+{
+	if (shardRelation->rd_rel->relkind != RELKIND_RELATION)
+	{
+		return false;
+	}
+
+	/* CopyFrom checks the partition constraint of tuples copied into partitions */
+	if (shardRelation->rd_rel->relispartition)
+	{
+		return false;
+	}
+
+	if (shardRelation->trigdesc != NULL)
+	{
+		return false;
+	}
+
+	TupleDesc shardTupleDescriptor = RelationGetDescr(shardRelation);
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	if (shardTupleDescriptor->constr != NULL &&
+		shardTupleDescriptor->constr->has_generated_stored)
+	{
+		return false;
+	}
+#endif
+
+	for (int attributeIndex = 0; attributeIndex < shardTupleDescriptor->natts;
+		 attributeIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(shardTupleDescriptor,
+													attributeIndex);
+		if (attribute->attisdropped)
+		{
+			continue;
+		}
+
+		if (get_typtype(attribute->atttypid) == TYPTYPE_DOMAIN)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ShardAttributeNumbersForCopy maps the columns of the tuples of the copy to
+ * the attribute numbers of the shard relation. The function returns NULL if
+ * the tuples do not provide a value for each column of the shard, since the
+ * defaults for the missing columns are only filled in by CopyFrom.
+ */
+static AttrNumber *
+ShardAttributeNumbersForCopy(CitusCopyDestReceiver *copyDest, Relation shardRelation)
+{
+	TupleDesc inputTupleDescriptor = copyDest->tupleDescriptor;
+	TupleDesc shardTupleDescriptor = RelationGetDescr(shardRelation);
+	Oid shardOid = RelationGetRelid(shardRelation);
+	int inputColumnCount = inputTupleDescriptor->natts;
+	int mappedColumnCount = 0;
+	ListCell *columnNameCell = list_head(copyDest->columnNameList);
+
+	AttrNumber *shardAttributeNumbers = palloc0(inputColumnCount * sizeof(AttrNumber));
+
+	for (int columnIndex = 0; columnIndex < inputColumnCount; columnIndex++)
+	{
+		Form_pg_attribute inputColumn = TupleDescAttr(inputTupleDescriptor, columnIndex);
+
+		/* skip the same columns as ColumnCoercionPaths does */
+		if (inputColumn->attisdropped
+#if PG_VERSION_NUM >= PG_VERSION_12
+			|| inputColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		if (columnNameCell == NULL)
+		{
+			break;
+		}
+
+		char *columnName = lfirst(columnNameCell);
+		AttrNumber shardAttributeNumber = get_attnum(shardOid, columnName);
+		if (shardAttributeNumber == InvalidAttrNumber)
+		{
+			pfree(shardAttributeNumbers);
+			return NULL;
+		}
+
+		shardAttributeNumbers[columnIndex] = shardAttributeNumber;
+		mappedColumnCount++;
+
+		columnNameCell = lnext(columnNameCell);
+	}
+
+	int shardColumnCount = 0;
+	for (int attributeIndex = 0; attributeIndex < shardTupleDescriptor->natts;
+		 attributeIndex++)
+	{
+		if (!TupleDescAttr(shardTupleDescriptor, attributeIndex)->attisdropped)
+		{
+			shardColumnCount++;
+		}
+	}
+
+	if (mappedColumnCount != shardColumnCount)
+	{
+		pfree(shardAttributeNumbers);
+		return NULL;
+	}
+
+	return shardAttributeNumbers;
+}
+
+
+/*
+ * InsertTupleIntoLocalShard adds the given slot to the batch of tuples of the
+ * local shard, and inserts the batch once it fills up.
+ */
+void
+InsertTupleIntoLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
+						  LocalShardInsertState *insertState)
+{
+	/*
+	 * Since we are doing a local copy, the following statements should
+	 * use local execution to see the changes
+	 */
+	SetLocalExecutionStatus(LOCAL_EXECUTION_REQUIRED);
+
+	Relation shardRelation = insertState->shardRelation;
+	EState *executorState = insertState->executorState;
+	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
+	int slotIndex = insertState->bufferedSlotCount;
+
+	if (slotIndex == insertState->createdSlotCount)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(executorState->es_query_cxt);
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+		insertState->bufferedSlots[slotIndex] = table_slot_create(shardRelation, NULL);
+#else
+		insertState->bufferedSlots[slotIndex] =
+			MakeSingleTupleTableSlot(RelationGetDescr(shardRelation));
+#endif
+		insertState->createdSlotCount++;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	TupleTableSlot *shardSlot = insertState->bufferedSlots[slotIndex];
+	int shardColumnCount = shardSlot->tts_tupleDescriptor->natts;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(
+														 executorState));
+
+	ExecClearTuple(shardSlot);
+	memset(shardSlot->tts_values, 0, shardColumnCount * sizeof(Datum));
+	memset(shardSlot->tts_isnull, true, shardColumnCount * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < slot->tts_tupleDescriptor->natts;
+		 columnIndex++)
+	{
+		AttrNumber shardAttributeNumber = insertState->shardAttributeNumbers[columnIndex];
+		if (shardAttributeNumber == InvalidAttrNumber)
+		{
+			continue;
+		}
+
+		Datum value = slot->tts_values[columnIndex];
+		bool isNull = slot->tts_isnull[columnIndex];
+
+		if (!isNull && columnCoercionPaths != NULL)
+		{
+			value = CoerceColumnValue(value, &columnCoercionPaths[columnIndex]);
+		}
+
+		shardSlot->tts_values[shardAttributeNumber - 1] = value;
+		shardSlot->tts_isnull[shardAttributeNumber - 1] = isNull;
+	}
+
+	ExecStoreVirtualTuple(shardSlot);
+
+	/* copy the values out of the per-tuple memory context into the slot */
+#if PG_VERSION_NUM >= PG_VERSION_12
+	HeapTuple shardTuple = ExecFetchSlotHeapTuple(shardSlot, true, NULL);
+#else
+	HeapTuple shardTuple = ExecMaterializeSlot(shardSlot);
+#endif
+
+	MemoryContextSwitchTo(oldContext);
+	ResetPerTupleExprContext(executorState);
+
+	insertState->bufferedSlotCount++;
+	insertState->bufferedTupleBytes += shardTuple->t_len;
+
+	if (insertState->bufferedSlotCount == LOCAL_SHARD_INSERT_BATCH_SIZE ||
+		insertState->bufferedTupleBytes > LOCAL_COPY_FLUSH_THRESHOLD)
+	{
+		FlushLocalShardInsertBuffer(insertState);
+	}
+}
+
+
+/*
+ * FlushLocalShardInsertBuffer checks the constraints of the buffered tuples,
+ * inserts them into the shard relation and adds the corresponding index
+ * entries. Errors are reported with the shard and the line of the tuple in
+ * the batch, like the COPY into the shard would report them.
+ */
+static void
+FlushLocalShardInsertBuffer(LocalShardInsertState *insertState)
+{
+	Relation shardRelation = insertState->shardRelation;
+	EState *executorState = insertState->executorState;
+	ResultRelInfo *resultRelInfo = insertState->resultRelInfo;
+	TupleTableSlot **bufferedSlots = insertState->bufferedSlots;
+	int bufferedSlotCount = insertState->bufferedSlotCount;
+	CommandId commandId = GetCurrentCommandId(true);
+
+	if (bufferedSlotCount == 0)
+	{
+		return;
+	}
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = LocalShardInsertErrorCallback;
+	errorCallback.arg = (void *) insertState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	if (shardRelation->rd_att->constr != NULL)
+	{
+		for (int slotIndex = 0; slotIndex < bufferedSlotCount; slotIndex++)
+		{
+			insertState->currentLine = slotIndex + 1;
+
+			ExecConstraints(resultRelInfo, bufferedSlots[slotIndex], executorState);
+			ResetPerTupleExprContext(executorState);
+		}
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	table_multi_insert(shardRelation, bufferedSlots, bufferedSlotCount, commandId, 0,
+					   insertState->bulkInsertState);
+#else
+	HeapTuple *bufferedTuples = palloc(bufferedSlotCount * sizeof(HeapTuple));
+	for (int slotIndex = 0; slotIndex < bufferedSlotCount; slotIndex++)
+	{
+		bufferedTuples[slotIndex] = bufferedSlots[slotIndex]->tts_tuple;
+	}
+
+	heap_multi_insert(shardRelation, bufferedTuples, bufferedSlotCount, commandId, 0,
+					  insertState->bulkInsertState);
+#endif
+
+	for (int slotIndex = 0; slotIndex < bufferedSlotCount; slotIndex++)
+	{
+		TupleTableSlot *shardSlot = bufferedSlots[slotIndex];
+
+		insertState->currentLine = slotIndex + 1;
+
+		if (resultRelInfo->ri_NumIndices > 0)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(
+																 executorState));
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+			List *recheckIndexes = ExecInsertIndexTuples(shardSlot, executorState,
+														 false, NULL, NIL);
+#else
+			List *recheckIndexes = ExecInsertIndexTuples(shardSlot,
+														 &(bufferedTuples[slotIndex]->
+														   t_self),
+														 executorState, false, NULL,
+														 NIL);
+#endif
+			list_free(recheckIndexes);
+
+			MemoryContextSwitchTo(oldContext);
+			ResetPerTupleExprContext(executorState);
+		}
+
+		ExecClearTuple(shardSlot);
+	}
+
+	error_context_stack = errorCallback.previous;
+
+#if PG_VERSION_NUM < PG_VERSION_12
+	pfree(bufferedTuples);
+#endif
+
+	insertState->bufferedSlotCount = 0;
+	insertState->bufferedTupleBytes = 0;
+}
+
+
+/*
+ * LocalShardInsertErrorCallback adds the shard and the line of the tuple that
+ * is being inserted to the error context.
+ */
+static void
+LocalShardInsertErrorCallback(void *arg)
+{
+	LocalShardInsertState *insertState = (LocalShardInsertState *) arg;
+
+	errcontext("COPY %s, line %d", RelationGetRelationName(insertState->shardRelation),
+			   insertState->currentLine);
+}
+
+
+/*
+ * FinishLocalShardInsert inserts the remaining buffered tuples into the shard
+ * and releases the resources of the given insert state.
+ */
+void
+FinishLocalShardInsert(LocalShardInsertState *insertState)
+{
+	FlushLocalShardInsertBuffer(insertState);
+
+	for (int slotIndex = 0; slotIndex < insertState->createdSlotCount; slotIndex++)
+	{
+		ExecDropSingleTupleTableSlot(insertState->bufferedSlots[slotIndex]);
+	}
+
+	FreeBulkInsertState(insertState->bulkInsertState);
+	ExecCloseIndices(insertState->resultRelInfo);
+	FreeExecutorState(insertState->executorState);
+
+	heap_close(insertState->shardRelation, NoLock);
+
+	pfree(insertState->bufferedSlots);
+	pfree(insertState->shardAttributeNumbers);
+	pfree(insertState);
+}
+
+
 /*
  * ShouldAddBinaryHeaders returns true if the given buffer
  * is empty and the format is binary.
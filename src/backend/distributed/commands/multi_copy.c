@@ -63,11 +63,16 @@
 #include "access/sysattr.h"
 #include "access/xact.h"
 #include "catalog/namespace.h"
+#include "catalog/partition.h"
 #include "catalog/pg_attribute.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
+#include "common/pg_lzcompress.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/colocation_utils.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/intermediate_results.h"
@@ -80,25 +85,43 @@
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_executor.h"
 #include "distributed/placement_connection.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/subplan_result_cache.h"
+#include "distributed/transmit.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/local_multi_copy.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/listutils.h"
+#include "distributed/transaction_management.h"
 #include "executor/executor.h"
 #include "foreign/foreign.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "partitioning/partbounds.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "partitioning/partdesc.h"
+#endif
+#include "pgstat.h"
+#include "port/pg_bswap.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "tcop/tcopprot.h"
 #include "tsearch/ts_locale.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/rls.h"
 #include "utils/syscache.h"
 #include "utils/memutils.h"
 
@@ -115,6 +138,51 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
  */
 #define COPY_SWITCH_OVER_THRESHOLD (4 * 1024 * 1024)
 
+/*
+ * Data size threshold to put the buffered COPY data of the active placement of
+ * a connection on the wire. Sending tuples in batches rather than one by one
+ * avoids the overhead of a CopyData message and a libpq call per tuple.
+ */
+#define COPY_SEND_BATCH_SIZE (64 * 1024)
+
+/* maximum number of shards to stream at the same time in COPY table TO STDOUT */
+int CopyToParallelStreams = 1;
+
+/* whether binary COPY FROM STDIN only decodes the distribution column */
+bool EnableBinaryCopyPassthrough = true;
+
+/* whether COPY data sent to remote shard placements is compressed */
+bool CompressCopyData = false;
+
+/* whether COPY into a partitioned table sends rows to the shards of the partitions */
+bool EnableCopyPartitionRouting = true;
+
+/*
+ * When citus.compress_copy_data is enabled, the COPY data of a placement is
+ * sent in blocks of up to COMPRESSED_COPY_BLOCK_SIZE bytes, each in its own
+ * CopyData message that starts with the raw and compressed length of the
+ * block in network byte order. A compressed length of 0 means the block did
+ * not compress well and is sent as is.
+ */
+#define COMPRESSED_COPY_BLOCK_SIZE COPY_SEND_BATCH_SIZE
+#define COMPRESSED_COPY_BLOCK_HEADER_SIZE (2 * sizeof(uint32))
+#define COPY_COMPRESSION_OPTION "compression"
+#define COPY_COMPRESSION_METHOD "pglz"
+
+/* flag in the header of binary COPY data that indicates the rows have OIDs */
+#define BINARY_COPY_OIDS_FLAG (1 << 16)
+
+/*
+ * Constants used to check 8 bytes of a text value at once for characters that
+ * need escaping in COPY text format, see CopyAttributeOutTextSkipPlain().
+ */
+#define COPY_SCAN_WORD_ONES UINT64CONST(0x0101010101010101)
+#define COPY_SCAN_WORD_HIGH_BITS UINT64CONST(0x8080808080808080)
+#define COPY_SCAN_WORD_HAS_BYTE_LESS_THAN(word, n) \
+	((((word) - COPY_SCAN_WORD_ONES * (n)) & ~(word) & COPY_SCAN_WORD_HIGH_BITS) != 0)
+#define COPY_SCAN_WORD_HAS_BYTE(word, b) \
+	COPY_SCAN_WORD_HAS_BYTE_LESS_THAN((word) ^ (COPY_SCAN_WORD_ONES * (uint8) (b)), 1)
+
 typedef struct CopyShardState CopyShardState;
 typedef struct CopyPlacementState CopyPlacementState;
 
@@ -123,9 +191,9 @@ typedef struct CopyPlacementState CopyPlacementState;
  * of those placements as the activePlacementState, and others in the
  * bufferedPlacementList. When we want to send a tuple to a CopyPlacementState,
  * we check if it is the active one in its connectionState, and in this case we
- * directly put data on wire. Otherwise, we buffer it so we can put it on wire
- * later, when copy ends or a switch-over happens. See CitusSendTupleToPlacements()
- * for more details.
+ * put data on wire once a batch of tuples is buffered. Otherwise, we buffer it
+ * so we can put it on wire later, when copy ends or a switch-over happens. See
+ * CitusSendTupleToPlacements() for more details.
  *
  * This is done so we are compatible with adaptive_executor. If a previous command
  * in the current transaction has been executed using adaptive_executor.c, then
@@ -133,8 +201,9 @@ typedef struct CopyPlacementState CopyPlacementState;
  * placements. We support that case by the buffering mechanism described above.
  *
  * If no previous command in the current transaction has used adaptive_executor.c,
- * then CopyGetPlacementConnection() returns one connection per placement and no
- * buffering happens and we put the copy data directly on connection.
+ * then CopyGetPlacementConnection() returns one connection per placement and
+ * we only buffer up to COPY_SEND_BATCH_SIZE bytes before putting the copy data
+ * on connection.
  */
 typedef struct CopyConnectionState
 {
@@ -169,10 +238,14 @@ struct CopyPlacementState
 	/* node group ID of the placement */
 	int32 groupId;
 
+	/* whether the COPY data of the placement is sent in compressed blocks */
+	bool compressData;
+
 	/*
 	 * Buffered COPY data. When the placement is activePlacementState of
-	 * some connection, this is empty. Because in that case we directly
-	 * send the data over connection.
+	 * some connection, this holds less than COPY_SEND_BATCH_SIZE bytes.
+	 * Because in that case we send the data over connection once a batch
+	 * is complete.
 	 */
 	StringInfo data;
 
@@ -188,13 +261,56 @@ struct CopyShardState
 	/* used for doing local copy */
 	CopyOutState copyOutState;
 
+	/* used for inserting directly into the local shard, if possible */
+	LocalShardInsertState *localShardInsertState;
+
 	/* containsLocalPlacement is true if we have a local placement for the shard id of this state */
 	bool containsLocalPlacement;
 
+	/*
+	 * Partition to which the shard belongs, if rows are routed to the shards
+	 * of the partitions, or InvalidOid for the shards of the distributed table.
+	 */
+	Oid partitionRelationId;
+
 	/* List of CopyPlacementStates for all active placements of the shard. */
 	List *placementStateList;
 };
 
+/*
+ * CopyPartitionRouting holds what is needed to route the rows of a COPY into a
+ * partitioned distributed table to the shards of its partitions on the
+ * coordinator, such that the workers do not have to do tuple routing and each
+ * shard placement receives a stream of rows of a single partition. Only
+ * single-column range and list partitioning is supported; rows that cannot be
+ * routed go to the shard of the partitioned table as usual.
+ */
+struct CopyPartitionRouting
+{
+	/* index of the partition key in the incoming tuples */
+	int partitionKeyIndex;
+
+	char strategy;
+
+	/* comparison function and collation of the partition key */
+	FmgrInfo partitionSupportFunction;
+	Oid partitionCollation;
+
+	/* copy of the partition bounds, indexes point into partitionRelationIds */
+	PartitionBoundInfo boundInfo;
+
+	int partitionCount;
+	Oid *partitionRelationIds;
+
+	/* whether we checked the partition, and whether we can copy into it */
+	bool *partitionChecked;
+	bool *partitionRoutable;
+
+	/* shard ids of the partitions, by partition index and shard index */
+	int shardCount;
+	uint64 *partitionShardIds;
+};
+
 /* ShardConnections represents a set of connections for each placement of a shard */
 typedef struct ShardConnections
 {
@@ -205,8 +321,65 @@ typedef struct ShardConnections
 } ShardConnections;
 
 
+/*
+ * BinaryCopyInput holds the binary COPY data received from the client that
+ * has not been consumed yet when passing rows through to the shards.
+ */
+typedef struct BinaryCopyInput
+{
+	/* received data, of which the bytes before the cursor are consumed */
+	StringInfo buffer;
+
+	/* buffer for a single CopyData message */
+	StringInfo messageBuffer;
+
+	/* whether the client has sent CopyDone */
+	bool copyDone;
+
+	/* name of the table and number of the current row, for error messages */
+	char *relationName;
+	uint64 rowNumber;
+} BinaryCopyInput;
+
+
+/*
+ * CompressedCopyInput holds the decompressed block of COPY data received from
+ * the client that CopyFrom has not consumed yet, for COPY commands with the
+ * compression option.
+ */
+typedef struct CompressedCopyInput
+{
+	/* decompressed data, of which the bytes before the cursor are consumed */
+	StringInfo rawBlock;
+
+	/* buffer for a single CopyData message */
+	StringInfo messageBuffer;
+
+	/* whether the client has sent CopyDone */
+	bool copyDone;
+} CompressedCopyInput;
+
+
+/*
+ * The compressed COPY input that ReadCompressedCopyDataCallback reads from,
+ * since copy callbacks cannot be passed arguments.
+ */
+static CompressedCopyInput *CurrentCompressedCopyInput = NULL;
+
+
 /* Local functions forward declarations */
 static void CopyToExistingShards(CopyStmt *copyStatement, char *completionTag);
+static uint64 CopyParsedRows(CopyStmt *copyStatement, Relation distributedRelation,
+							 TupleTableSlot *tupleTableSlot, DestReceiver *dest);
+static bool CanPassThroughBinaryCopy(CopyStmt *copyStatement,
+									 CitusCopyDestReceiver *copyDest);
+static uint64 PassThroughBinaryCopyRows(CopyStmt *copyStatement,
+										CitusCopyDestReceiver *copyDest);
+static void ReadBinaryCopyHeader(BinaryCopyInput *copyInput);
+static bool ReceiveBinaryCopyInput(BinaryCopyInput *copyInput, int byteCount);
+static int32 BinaryCopyInputInt32(BinaryCopyInput *copyInput, int offset);
+static int16 BinaryCopyInputInt16(BinaryCopyInput *copyInput, int offset);
+static void BinaryCopyInputErrorCallback(void *arg);
 static void CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId);
 static void OpenCopyConnectionsForNewShards(CopyStmt *copyStatement,
 											ShardConnections *shardConnections, bool
@@ -222,6 +395,8 @@ static StringInfo ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId)
 static void SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList);
 static void SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId,
 									MultiConnection *connection);
+static void SendPlacementCopyData(CopyPlacementState *placementState,
+								  StringInfo dataBuffer);
 static void ReportCopyError(MultiConnection *connection, PGresult *result);
 static uint32 AvailableColumnCount(TupleDesc tupleDescriptor);
 static int64 StartCopyToNewShard(ShardConnections *shardConnections,
@@ -236,8 +411,26 @@ static CopyCoercionData * ColumnCoercionPaths(TupleDesc destTupleDescriptor,
 											  Oid *finalColumnTypeArray);
 static FmgrInfo * TypeOutputFunctions(uint32 columnCount, Oid *typeIdArray,
 									  bool binaryFormat);
+static CopySerializationPlan * CachedCopySerializationPlan(Relation distributedRelation,
+														   TupleDesc inputTupleDescriptor,
+														   List *columnNameList);
+static bool CopySerializationPlanMatches(CopySerializationPlan *serializationPlan,
+										 TupleDesc inputTupleDescriptor,
+										 List *columnNameList);
+static CopySerializationPlan * BuildCopySerializationPlan(Relation distributedRelation,
+														  TupleDesc inputTupleDescriptor,
+														  List *columnNameList);
+static bool AppendBinaryColumnFast(CopyOutState rowOutputState, Oid outputFunctionId,
+								   Datum value);
+static bool AppendTextColumnFast(CopyOutState rowOutputState, Oid outputFunctionId,
+								 Datum value);
 static List * CopyGetAttnums(TupleDesc tupDesc, Relation rel, List *attnamelist);
 static bool CopyStatementHasFormat(CopyStmt *copyStatement, char *formatName);
+static bool IsCompressedCopyStmt(CopyStmt *copyStatement);
+static void CopyCompressedDataFromFrontend(CopyStmt *copyStatement,
+										   char *completionTag);
+static int ReadCompressedCopyDataCallback(void *outBuf, int minRead, int maxRead);
+static bool ReceiveCompressedCopyBlock(CompressedCopyInput *copyInput);
 static void CitusCopyFrom(CopyStmt *copyStatement, char *completionTag);
 static HTAB * CreateConnectionStateHash(MemoryContext memoryContext);
 static HTAB * CreateShardStateHash(MemoryContext memoryContext);
@@ -268,6 +461,14 @@ static SelectStmt * CitusCopySelect(CopyStmt *copyStatement);
 static void CitusCopyTo(CopyStmt *copyStatement, char *completionTag);
 static int64 ForwardCopyDataFromConnection(CopyOutState copyOutState,
 										   MultiConnection *connection);
+static bool CopyStatementHasHeader(CopyStmt *copyStatement);
+static MultiConnection * StartCopyToOnShard(StringInfo copyCommand, uint64 shardId);
+static int64 ForwardCopyDataFromShardsInParallel(CopyOutState copyOutState,
+												 CopyStmt *copyStatement,
+												 List *shardIntervalList);
+static int64 ForwardAvailableCopyData(CopyOutState copyOutState,
+									  MultiConnection *connection, bool *copyDone);
+static void WaitForCopyData(List *connectionList);
 
 /* Private functions copied and adapted from copy.c in PostgreSQL */
 static void SendCopyBegin(CopyOutState cstate);
@@ -277,13 +478,33 @@ static void CopySendString(CopyOutState outputState, const char *str);
 static void CopySendChar(CopyOutState outputState, char c);
 static void CopySendInt32(CopyOutState outputState, int32 val);
 static void CopySendInt16(CopyOutState outputState, int16 val);
+static void CopySendInt64(CopyOutState outputState, int64 val);
 static void CopySendEndOfRow(CopyOutState cstate, bool includeEndOfLine);
 static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
+static inline char * CopyAttributeOutTextSkipPlain(char *pointer, char *end, char delimc);
+static void CitusSendCopyRowToPlacements(CitusCopyDestReceiver *copyDest,
+										 int64 shardId, const char *rowData,
+										 int rowLength);
+static CopyShardState * GetCopyShardState(CitusCopyDestReceiver *copyDest,
+										  int64 shardId, bool *firstTupleInShard);
+static void StartPlacementCopyCommands(CitusCopyDestReceiver *copyDest,
+									   CopyShardState *shardState);
+static void AppendCopyDataToPlacements(CopyShardState *shardState, const char *rowData,
+									   int rowLength);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
-static uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
-							  bool *columnNulls);
+static ShardInterval * ShardIntervalForTuple(CitusCopyDestReceiver *copyDest,
+											  Datum *columnValues, bool *columnNulls);
+static CopyPartitionRouting * BuildCopyPartitionRouting(CitusCopyDestReceiver *copyDest,
+														TupleDesc inputTupleDescriptor);
+static bool ColumnNameListCoversRelation(List *columnNameList, TupleDesc relationDesc,
+										 TupleDesc inputTupleDescriptor);
+static uint64 PartitionShardIdForTuple(CitusCopyDestReceiver *copyDest,
+									   int shardIndex, Datum *columnValues,
+									   bool *columnNulls, Oid *partitionRelationId);
+static int PartitionIndexForValue(CopyPartitionRouting *routing, Datum value);
+static bool CanCopyIntoPartition(CitusCopyDestReceiver *copyDest, int partitionIndex);
 
 /* CitusCopyDestReceiver functions */
 static void CitusCopyDestReceiverStartup(DestReceiver *copyDest, int operation,
@@ -372,23 +593,16 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	CitusCopyDestReceiver *copyDest = NULL;
 	DestReceiver *dest = NULL;
 
-	Relation copiedDistributedRelation = NULL;
-	Form_pg_class copiedDistributedRelationTuple = NULL;
 	List *columnNameList = NIL;
 	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
 
 	EState *executorState = NULL;
-	MemoryContext executorTupleContext = NULL;
-	ExprContext *executorExpressionContext = NULL;
 
 	char partitionMethod = 0;
 	bool stopOnFailure = false;
 
-	CopyState copyState = NULL;
 	uint64 processedRowCount = 0;
 
-	ErrorContextCallback errorCallback;
-
 	/* allocate column values and nulls arrays */
 	Relation distributedRelation = heap_open(tableId, RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
@@ -429,8 +643,6 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	}
 
 	executorState = CreateExecutorState();
-	executorTupleContext = GetPerTupleMemoryContext(executorState);
-	executorExpressionContext = GetPerTupleExprContext(executorState);
 
 	partitionMethod = PartitionMethod(tableId);
 	if (partitionMethod == DISTRIBUTE_BY_NONE)
@@ -444,13 +656,66 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	dest = (DestReceiver *) copyDest;
 	dest->rStartup(dest, 0, tupleDescriptor);
 
+	if (CanPassThroughBinaryCopy(copyStatement, copyDest))
+	{
+		processedRowCount = PassThroughBinaryCopyRows(copyStatement, copyDest);
+	}
+	else
+	{
+		processedRowCount = CopyParsedRows(copyStatement, distributedRelation,
+										   tupleTableSlot, dest);
+	}
+
+	/* finish the COPY commands */
+	dest->rShutdown(dest);
+	dest->rDestroy(dest);
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+	FreeExecutorState(executorState);
+	heap_close(distributedRelation, NoLock);
+
+	/* mark failed placements as inactive */
+	MarkFailedShardPlacements();
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (completionTag != NULL)
+	{
+		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+					 "COPY " UINT64_FORMAT, processedRowCount);
+	}
+}
+
+
+/*
+ * CopyParsedRows reads the rows of COPY table_name FROM ... through the
+ * regular COPY machinery of Postgres, and passes each of them to the given
+ * destination. It returns the number of rows copied.
+ */
+static uint64
+CopyParsedRows(CopyStmt *copyStatement, Relation distributedRelation,
+			   TupleTableSlot *tupleTableSlot, DestReceiver *dest)
+{
+	CitusCopyDestReceiver *copyDest = (CitusCopyDestReceiver *) dest;
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	Oid tableId = RelationGetRelid(distributedRelation);
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+	Datum *columnValues = tupleTableSlot->tts_values;
+	bool *columnNulls = tupleTableSlot->tts_isnull;
+	uint64 processedRowCount = 0;
+
+	ErrorContextCallback errorCallback;
+
 	/*
 	 * Below, we change a few fields in the Relation to control the behaviour
 	 * of BeginCopyFrom. However, we obviously should not do this in relcache
 	 * and therefore make a copy of the Relation.
 	 */
-	copiedDistributedRelation = (Relation) palloc(sizeof(RelationData));
-	copiedDistributedRelationTuple = (Form_pg_class) palloc(CLASS_TUPLE_SIZE);
+	Relation copiedDistributedRelation = (Relation) palloc(sizeof(RelationData));
+	Form_pg_class copiedDistributedRelationTuple =
+		(Form_pg_class) palloc(CLASS_TUPLE_SIZE);
 
 	/*
 	 * There is no need to deep copy everything. We will just deep copy of the fields
@@ -475,13 +740,13 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	}
 
 	/* initialize copy state to read from COPY data source */
-	copyState = BeginCopyFrom(NULL,
-							  copiedDistributedRelation,
-							  copyStatement->filename,
-							  copyStatement->is_program,
-							  NULL,
-							  copyStatement->attlist,
-							  copyStatement->options);
+	CopyState copyState = BeginCopyFrom(NULL,
+										copiedDistributedRelation,
+										copyStatement->filename,
+										copyStatement->is_program,
+										NULL,
+										copyStatement->attlist,
+										copyStatement->options);
 
 	/* set up callback to identify error line number */
 	errorCallback.callback = CopyFromErrorCallback;
@@ -519,127 +784,509 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	/* all lines have been copied, stop showing line number in errors */
 	error_context_stack = errorCallback.previous;
 
-	/* finish the COPY commands */
-	dest->rShutdown(dest);
-	dest->rDestroy(dest);
+	return processedRowCount;
+}
 
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
-	FreeExecutorState(executorState);
-	heap_close(distributedRelation, NoLock);
 
-	/* mark failed placements as inactive */
-	MarkFailedShardPlacements();
+/*
+ * CanPassThroughBinaryCopy returns whether the rows of the given COPY can be
+ * passed through to the shards as they were sent by the client. This is the
+ * case for COPY into a hash-distributed table FROM STDIN in binary format
+ * with all columns, when the workers also receive the binary format of the
+ * columns. Since the input tuple descriptor is the one of the table, the
+ * columns do not need to be coerced.
+ */
+static bool
+CanPassThroughBinaryCopy(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	if (!EnableBinaryCopyPassthrough)
+	{
+		return false;
+	}
 
-	CHECK_FOR_INTERRUPTS();
+	if (copyStatement->filename != NULL || whereToSendOutput != DestRemote ||
+		PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+	{
+		return false;
+	}
 
-	if (completionTag != NULL)
+	/* other options are validated by BeginCopyFrom */
+	if (list_length(copyStatement->options) != 1 ||
+		!CopyStatementHasFormat(copyStatement, "binary"))
 	{
-		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE,
-					 "COPY " UINT64_FORMAT, processedRowCount);
+		return false;
+	}
+
+	if (copyStatement->attlist != NIL)
+	{
+		return false;
+	}
+
+	if (PartitionMethod(copyDest->distributedRelationId) != DISTRIBUTE_BY_HASH ||
+		copyDest->partitionColumnIndex == INVALID_PARTITION_COLUMN_INDEX)
+	{
+		return false;
+	}
+
+	/* the binary format of some types cannot be sent to the workers as is */
+	if (!copyDest->copyOutState->binary)
+	{
+		return false;
+	}
+
+	/* rows for local placements are written as tuples */
+	if (copyDest->shouldUseLocalCopy)
+	{
+		return false;
 	}
+
+	return true;
 }
 
 
 /*
- * CopyToNewShards implements the COPY table_name FROM ... for append-partitioned
- * tables where we create new shards into which to copy rows.
+ * PassThroughBinaryCopyRows reads the binary COPY data of the client, decodes
+ * only the distribution column of each row to find its shard, and adds the
+ * row as it was received to the COPY data of the placements of the shard. It
+ * returns the number of rows copied.
  */
-static void
-CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
+static uint64
+PassThroughBinaryCopyRows(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
 {
-	/* allocate column values and nulls arrays */
-	Relation distributedRelation = heap_open(relationId, RowExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
-	uint32 columnCount = tupleDescriptor->natts;
-	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
-	bool *columnNulls = palloc0(columnCount * sizeof(bool));
-
-	EState *executorState = CreateExecutorState();
+	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
+	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
-	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
-
-	const char *delimiterCharacter = "\t";
-	const char *nullPrintCharacter = "\\N";
+	CitusTableCacheEntry *cacheEntry =
+		GetCitusTableCacheEntry(copyDest->distributedRelationId);
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	int fieldCount = 0;
+	int partitionFieldIndex = -1;
+	uint64 processedRowCount = 0;
 
 	ErrorContextCallback errorCallback;
 
-	int64 currentShardId = INVALID_SHARD_ID;
-	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
-	uint64 copiedDataSizeInBytes = 0;
-	uint64 processedRowCount = 0;
+	/* find the position of the distribution column among the sent columns */
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
 
-	ShardConnections *shardConnections =
-		(ShardConnections *) palloc0(sizeof(ShardConnections));
+		if (currentColumn->attisdropped
+#if PG_VERSION_NUM >= PG_VERSION_12
+			|| currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
 
-	/* initialize copy state to read from COPY data source */
-	CopyState copyState = BeginCopyFrom(NULL,
-										distributedRelation,
-										copyStatement->filename,
-										copyStatement->is_program,
-										NULL,
-										copyStatement->attlist,
-										copyStatement->options);
+		if (columnIndex == partitionColumnIndex)
+		{
+			partitionFieldIndex = fieldCount;
+		}
 
-	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
-	copyOutState->delim = (char *) delimiterCharacter;
-	copyOutState->null_print = (char *) nullPrintCharacter;
-	copyOutState->null_print_client = (char *) nullPrintCharacter;
-	copyOutState->binary = CanUseBinaryCopyFormat(tupleDescriptor);
-	copyOutState->fe_msgbuf = makeStringInfo();
-	copyOutState->rowcontext = executorTupleContext;
+		fieldCount++;
+	}
 
-	FmgrInfo *columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor,
-															copyOutState->binary);
+	Form_pg_attribute partitionAttribute =
+		TupleDescAttr(tupleDescriptor, partitionColumnIndex);
+	Oid receiveFunctionId = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+	FmgrInfo receiveFunction;
+
+	getTypeBinaryInputInfo(partitionAttribute->atttypid, &receiveFunctionId,
+						   &typeIoParam);
+	fmgr_info(receiveFunctionId, &receiveFunction);
+
+	BinaryCopyInput *copyInput = palloc0(sizeof(BinaryCopyInput));
+	copyInput->buffer = makeStringInfo();
+	copyInput->messageBuffer = makeStringInfo();
+	copyInput->relationName = copyStatement->relation->relname;
+
+	StringInfo fieldBuffer = makeStringInfo();
 
 	/* set up callback to identify error line number */
-	errorCallback.callback = CopyFromErrorCallback;
-	errorCallback.arg = (void *) copyState;
+	errorCallback.callback = BinaryCopyInputErrorCallback;
+	errorCallback.arg = (void *) copyInput;
 	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
 
-	/*
-	 * From here on we use copyStatement as the template for the command
-	 * that we send to workers. This command does not have an attribute
-	 * list since NextCopyFrom will generate a value for all columns.
-	 * We also strip options.
-	 */
-	copyStatement->attlist = NIL;
-	copyStatement->options = NIL;
+	SendCopyInStart();
+	ReadBinaryCopyHeader(copyInput);
 
-	if (copyOutState->binary)
+	while (true)
 	{
-		DefElem *binaryFormatOption =
-			makeDefElem("format", (Node *) makeString("binary"), -1);
+		StringInfo inputBuffer = copyInput->buffer;
+		int partitionFieldOffset = 0;
+		int partitionFieldLength = -1;
 
-		copyStatement->options = lappend(copyStatement->options, binaryFormatOption);
-	}
+		CHECK_FOR_INTERRUPTS();
 
-	while (true)
-	{
-		ResetPerTupleExprContext(executorState);
+		copyInput->rowNumber++;
 
-		/* switch to tuple memory context and start showing line number in errors */
-		error_context_stack = &errorCallback;
-		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+		if (!ReceiveBinaryCopyInput(copyInput, sizeof(int16)))
+		{
+			/* the client did not send the trailer, which Postgres allows */
+			if (inputBuffer->len > inputBuffer->cursor)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
 
-		/* parse a row from the input */
-		bool nextRowFound = NextCopyFromCompat(copyState, executorExpressionContext,
-											   columnValues, columnNulls);
+			break;
+		}
 
-		if (!nextRowFound)
+		int16 rowFieldCount = BinaryCopyInputInt16(copyInput, 0);
+		if (rowFieldCount == -1)
 		{
-			/* switch to regular memory context and stop showing line number in errors */
-			MemoryContextSwitchTo(oldContext);
-			error_context_stack = errorCallback.previous;
+			/* consume the trailer and anything the client sends after it */
+			inputBuffer->cursor += sizeof(int16);
+			if (ReceiveBinaryCopyInput(copyInput, 1))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("received copy data after EOF marker")));
+			}
+
 			break;
 		}
 
-		CHECK_FOR_INTERRUPTS();
+		if (rowFieldCount != fieldCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("row field count is %d, expected %d",
+								   (int) rowFieldCount, fieldCount)));
+		}
 
-		/* switch to regular memory context and stop showing line number in errors */
-		MemoryContextSwitchTo(oldContext);
-		error_context_stack = errorCallback.previous;
+		/* find the length of the row, the input may be extended meanwhile */
+		int rowLength = sizeof(int16);
+		for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+		{
+			if (!ReceiveBinaryCopyInput(copyInput, rowLength + sizeof(int32)))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
 
-		/*
+			int32 fieldLength = BinaryCopyInputInt32(copyInput, rowLength);
+			if (fieldLength < -1)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("invalid field size")));
+			}
+
+			rowLength += sizeof(int32);
+
+			if (fieldIndex == partitionFieldIndex)
+			{
+				partitionFieldOffset = rowLength;
+				partitionFieldLength = fieldLength;
+			}
+
+			if (fieldLength > 0)
+			{
+				if (!ReceiveBinaryCopyInput(copyInput, rowLength + fieldLength))
+				{
+					ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+									errmsg("unexpected EOF in COPY data")));
+				}
+
+				rowLength += fieldLength;
+			}
+		}
+
+		if (partitionFieldLength == -1)
+		{
+			Oid relationId = copyDest->distributedRelationId;
+			char *relationName = get_rel_name(relationId);
+			Oid schemaOid = get_rel_namespace(relationId);
+			char *schemaName = get_namespace_name(schemaOid);
+			char *qualifiedTableName = quote_qualified_identifier(schemaName,
+																  relationName);
+
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("the partition column of table %s cannot be NULL",
+								   qualifiedTableName)));
+		}
+
+		ResetPerTupleExprContext(executorState);
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		char *rowData = inputBuffer->data + inputBuffer->cursor;
+
+		/* the receive function expects a buffer that holds only the value */
+		resetStringInfo(fieldBuffer);
+		appendBinaryStringInfo(fieldBuffer, rowData + partitionFieldOffset,
+							   partitionFieldLength);
+
+		Datum partitionColumnValue = ReceiveFunctionCall(&receiveFunction, fieldBuffer,
+														 typeIoParam,
+														 partitionAttribute->atttypmod);
+		if (fieldBuffer->cursor != fieldBuffer->len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format")));
+		}
+
+		ShardInterval *shardInterval = FindShardInterval(partitionColumnValue,
+														 cacheEntry);
+		if (shardInterval == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find shard for partition column "
+								   "value")));
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		CitusSendCopyRowToPlacements(copyDest, shardInterval->shardId, rowData,
+									 rowLength);
+
+		inputBuffer->cursor += rowLength;
+		processedRowCount++;
+	}
+
+	/* Postgres waits for CopyDone even after the trailer */
+	while (!copyInput->copyDone)
+	{
+		resetStringInfo(copyInput->messageBuffer);
+		copyInput->copyDone = ReceiveCopyData(copyInput->messageBuffer);
+	}
+
+	/* all lines have been copied, stop showing line number in errors */
+	error_context_stack = errorCallback.previous;
+
+	return processedRowCount;
+}
+
+
+/*
+ * ReadBinaryCopyHeader consumes the header of binary COPY data, mirroring the
+ * checks of BeginCopyFrom.
+ */
+static void
+ReadBinaryCopyHeader(BinaryCopyInput *copyInput)
+{
+	int headerLength = sizeof(BinarySignature) + 2 * sizeof(int32);
+
+	if (!ReceiveBinaryCopyInput(copyInput, headerLength) ||
+		memcmp(copyInput->buffer->data + copyInput->buffer->cursor, BinarySignature,
+			   sizeof(BinarySignature)) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("COPY file signature not recognized")));
+	}
+
+	int32 flags = BinaryCopyInputInt32(copyInput, sizeof(BinarySignature));
+	if ((flags & BINARY_COPY_OIDS_FLAG) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (WITH OIDS)")));
+	}
+
+	if ((flags & 0xFFFF0000) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unrecognized critical flags in COPY file header")));
+	}
+
+	int32 extensionLength = BinaryCopyInputInt32(copyInput, sizeof(BinarySignature) +
+												 sizeof(int32));
+	if (extensionLength < 0 ||
+		!ReceiveBinaryCopyInput(copyInput, headerLength + extensionLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (wrong length)")));
+	}
+
+	copyInput->buffer->cursor += headerLength + extensionLength;
+}
+
+
+/*
+ * ReceiveBinaryCopyInput receives CopyData messages from the client until at
+ * least the given number of unconsumed bytes are buffered. It returns false
+ * if the client finished sending data before that. Consumed data is dropped
+ * from the buffer before receiving more, so offsets relative to the cursor
+ * remain valid, but pointers into the buffer do not.
+ */
+static bool
+ReceiveBinaryCopyInput(BinaryCopyInput *copyInput, int byteCount)
+{
+	StringInfo buffer = copyInput->buffer;
+
+	while (buffer->len - buffer->cursor < byteCount)
+	{
+		if (copyInput->copyDone)
+		{
+			return false;
+		}
+
+		if (buffer->cursor > 0)
+		{
+			int remainingLength = buffer->len - buffer->cursor;
+
+			memmove(buffer->data, buffer->data + buffer->cursor, remainingLength);
+			buffer->len = remainingLength;
+			buffer->data[buffer->len] = '\0';
+			buffer->cursor = 0;
+		}
+
+		resetStringInfo(copyInput->messageBuffer);
+		copyInput->copyDone = ReceiveCopyData(copyInput->messageBuffer);
+
+		appendBinaryStringInfo(buffer, copyInput->messageBuffer->data,
+							   copyInput->messageBuffer->len);
+	}
+
+	return true;
+}
+
+
+/*
+ * BinaryCopyInputInt32 returns the network byte order integer at the given
+ * offset from the cursor of the binary COPY input.
+ */
+static int32
+BinaryCopyInputInt32(BinaryCopyInput *copyInput, int offset)
+{
+	uint32 networkValue = 0;
+
+	memcpy(&networkValue, copyInput->buffer->data + copyInput->buffer->cursor + offset,
+		   sizeof(networkValue));
+
+	return (int32) ntohl(networkValue);
+}
+
+
+/*
+ * BinaryCopyInputInt16 returns the network byte order integer at the given
+ * offset from the cursor of the binary COPY input.
+ */
+static int16
+BinaryCopyInputInt16(BinaryCopyInput *copyInput, int offset)
+{
+	uint16 networkValue = 0;
+
+	memcpy(&networkValue, copyInput->buffer->data + copyInput->buffer->cursor + offset,
+		   sizeof(networkValue));
+
+	return (int16) ntohs(networkValue);
+}
+
+
+/*
+ * BinaryCopyInputErrorCallback adds the row number to errors that happen
+ * while passing binary COPY data through, like CopyFromErrorCallback does.
+ */
+static void
+BinaryCopyInputErrorCallback(void *arg)
+{
+	BinaryCopyInput *copyInput = (BinaryCopyInput *) arg;
+
+	errcontext("COPY %s, line " UINT64_FORMAT, copyInput->relationName,
+			   copyInput->rowNumber);
+}
+
+
+/*
+ * CopyToNewShards implements the COPY table_name FROM ... for append-partitioned
+ * tables where we create new shards into which to copy rows.
+ */
+static void
+CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
+{
+	/* allocate column values and nulls arrays */
+	Relation distributedRelation = heap_open(relationId, RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	const char *delimiterCharacter = "\t";
+	const char *nullPrintCharacter = "\\N";
+
+	ErrorContextCallback errorCallback;
+
+	int64 currentShardId = INVALID_SHARD_ID;
+	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
+	uint64 copiedDataSizeInBytes = 0;
+	uint64 processedRowCount = 0;
+
+	ShardConnections *shardConnections =
+		(ShardConnections *) palloc0(sizeof(ShardConnections));
+
+	/* initialize copy state to read from COPY data source */
+	CopyState copyState = BeginCopyFrom(NULL,
+										distributedRelation,
+										copyStatement->filename,
+										copyStatement->is_program,
+										NULL,
+										copyStatement->attlist,
+										copyStatement->options);
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) delimiterCharacter;
+	copyOutState->null_print = (char *) nullPrintCharacter;
+	copyOutState->null_print_client = (char *) nullPrintCharacter;
+	copyOutState->binary = CanUseBinaryCopyFormat(tupleDescriptor);
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = executorTupleContext;
+
+	FmgrInfo *columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor,
+															copyOutState->binary);
+
+	/* set up callback to identify error line number */
+	errorCallback.callback = CopyFromErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+
+	/*
+	 * From here on we use copyStatement as the template for the command
+	 * that we send to workers. This command does not have an attribute
+	 * list since NextCopyFrom will generate a value for all columns.
+	 * We also strip options.
+	 */
+	copyStatement->attlist = NIL;
+	copyStatement->options = NIL;
+
+	if (copyOutState->binary)
+	{
+		DefElem *binaryFormatOption =
+			makeDefElem("format", (Node *) makeString("binary"), -1);
+
+		copyStatement->options = lappend(copyStatement->options, binaryFormatOption);
+	}
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		/* switch to tuple memory context and start showing line number in errors */
+		error_context_stack = &errorCallback;
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		/* parse a row from the input */
+		bool nextRowFound = NextCopyFromCompat(copyState, executorExpressionContext,
+											   columnValues, columnNulls);
+
+		if (!nextRowFound)
+		{
+			/* switch to regular memory context and stop showing line number in errors */
+			MemoryContextSwitchTo(oldContext);
+			error_context_stack = errorCallback.previous;
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		/* switch to regular memory context and stop showing line number in errors */
+		MemoryContextSwitchTo(oldContext);
+		error_context_stack = errorCallback.previous;
+
+		/*
 		 * If copied data size is zero, this means either this is the first
 		 * line in the copy or we just filled the previous shard up to its
 		 * capacity. Either way, we need to create a new shard and
@@ -1134,6 +1781,68 @@ SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId, MultiConnection *c
 }
 
 
+/*
+ * SendPlacementCopyData sends serialized COPY data to the given placement, which
+ * has an active COPY. If the COPY was started with compression, the data is
+ * sent in compressed blocks of up to COMPRESSED_COPY_BLOCK_SIZE bytes.
+ */
+static void
+SendPlacementCopyData(CopyPlacementState *placementState, StringInfo dataBuffer)
+{
+	MultiConnection *connection = placementState->connectionState->connection;
+	uint64 shardId = placementState->shardState->shardId;
+
+	if (!placementState->compressData)
+	{
+		SendCopyDataToPlacement(dataBuffer, shardId, connection);
+		return;
+	}
+
+	int maxBlockLength = COMPRESSED_COPY_BLOCK_HEADER_SIZE +
+						 PGLZ_MAX_OUTPUT(COMPRESSED_COPY_BLOCK_SIZE);
+	char *compressedBlock = palloc(maxBlockLength);
+	char *compressedData = compressedBlock + COMPRESSED_COPY_BLOCK_HEADER_SIZE;
+	int dataOffset = 0;
+
+	while (dataOffset < dataBuffer->len)
+	{
+		char *rawData = dataBuffer->data + dataOffset;
+		int32 rawLength = Min(dataBuffer->len - dataOffset,
+							  COMPRESSED_COPY_BLOCK_SIZE);
+
+		int32 compressedLength = pglz_compress(rawData, rawLength, compressedData,
+											   PGLZ_strategy_default);
+		int blockLength = COMPRESSED_COPY_BLOCK_HEADER_SIZE + compressedLength;
+		if (compressedLength < 0)
+		{
+			/* data did not compress well, send it as is */
+			memcpy_s(compressedData, PGLZ_MAX_OUTPUT(COMPRESSED_COPY_BLOCK_SIZE),
+					 rawData, rawLength);
+			blockLength = COMPRESSED_COPY_BLOCK_HEADER_SIZE + rawLength;
+			compressedLength = 0;
+		}
+
+		uint32 blockHeader[2];
+		blockHeader[0] = pg_hton32((uint32) rawLength);
+		blockHeader[1] = pg_hton32((uint32) compressedLength);
+		memcpy_s(compressedBlock, COMPRESSED_COPY_BLOCK_HEADER_SIZE,
+				 blockHeader, COMPRESSED_COPY_BLOCK_HEADER_SIZE);
+
+		if (!PutRemoteCopyData(connection, compressedBlock, blockLength))
+		{
+			ereport(ERROR, (errcode(ERRCODE_IO_ERROR),
+							errmsg("failed to COPY to shard " INT64_FORMAT " on %s:%d",
+								   shardId, connection->hostname,
+								   connection->port)));
+		}
+
+		dataOffset += rawLength;
+	}
+
+	pfree(compressedBlock);
+}
+
+
 /*
  * EndRemoteCopy ends the COPY input on all connections, and unclaims connections.
  * This reports an error on failure.
@@ -1444,18 +2153,169 @@ ColumnOutputFunctions(TupleDesc rowDescriptor, bool binaryFormat)
 
 
 /*
- * citus_text_send_as_jsonb sends a text as if it was a JSONB. This should only
- * be used if the text is indeed valid JSON.
+ * CachedCopySerializationPlan returns the serialisation plan for copying rows
+ * with the given descriptor into the given columns of the distributed table.
+ * The plan is kept in the metadata cache entry of the table, such that
+ * repeated COPY and INSERT..SELECT commands do not have to look up the
+ * coercion paths and output functions of every column again. The plan goes
+ * away with the cache entry when the table is invalidated, and is replaced
+ * when the input types or the column list differ from the cached ones.
  */
-Datum
-citus_text_send_as_jsonb(PG_FUNCTION_ARGS)
+static CopySerializationPlan *
+CachedCopySerializationPlan(Relation distributedRelation, TupleDesc inputTupleDescriptor,
+							List *columnNameList)
 {
-	text *inputText = PG_GETARG_TEXT_PP(0);
-	StringInfoData buf;
-	int version = 1;
+	Oid relationId = RelationGetRelid(distributedRelation);
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	CopySerializationPlan *serializationPlan = cacheEntry->copySerializationPlan;
 
-	pq_begintypsend(&buf);
-	pq_sendint(&buf, version, 1);
+	if (serializationPlan != NULL &&
+		CopySerializationPlanMatches(serializationPlan, inputTupleDescriptor,
+									 columnNameList))
+	{
+		return serializationPlan;
+	}
+
+	serializationPlan = BuildCopySerializationPlan(distributedRelation,
+												   inputTupleDescriptor,
+												   columnNameList);
+
+	/* building the plan may have processed invalidations, look up the entry again */
+	cacheEntry = GetCitusTableCacheEntry(relationId);
+	if (cacheEntry->copySerializationPlan != NULL)
+	{
+		FreeCopySerializationPlan(cacheEntry->copySerializationPlan);
+	}
+
+	/* the plan is complete, so it can now outlive the current command */
+	MemoryContextSetParent(serializationPlan->context, CacheMemoryContext);
+	cacheEntry->copySerializationPlan = serializationPlan;
+
+	return serializationPlan;
+}
+
+
+/*
+ * CopySerializationPlanMatches returns whether the given plan was built for
+ * the input types of the given descriptor and the given column list.
+ */
+static bool
+CopySerializationPlanMatches(CopySerializationPlan *serializationPlan,
+							 TupleDesc inputTupleDescriptor, List *columnNameList)
+{
+	int columnCount = inputTupleDescriptor->natts;
+
+	if (serializationPlan->columnCount != columnCount ||
+		list_length(serializationPlan->columnNameList) != list_length(columnNameList))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(inputTupleDescriptor, columnIndex);
+		Oid inputType = attr->atttypid;
+
+		if (attr->attisdropped
+#if PG_VERSION_NUM >= PG_VERSION_12
+			|| attr->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			inputType = InvalidOid;
+		}
+
+		if (serializationPlan->inputTypeArray[columnIndex] != inputType)
+		{
+			return false;
+		}
+	}
+
+	ListCell *cachedNameCell = NULL;
+	ListCell *columnNameCell = NULL;
+	forboth(cachedNameCell, serializationPlan->columnNameList,
+			columnNameCell, columnNameList)
+	{
+		if (strcmp(lfirst(cachedNameCell), lfirst(columnNameCell)) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BuildCopySerializationPlan builds a serialisation plan in a new memory
+ * context, which is a child of the current memory context such that it is
+ * freed if we error out half-way. The caller reparents it when it caches the
+ * plan.
+ */
+static CopySerializationPlan *
+BuildCopySerializationPlan(Relation distributedRelation, TupleDesc inputTupleDescriptor,
+						   List *columnNameList)
+{
+	MemoryContext planContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "CopySerializationPlan",
+													  ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(planContext);
+
+	Oid relationId = RelationGetRelid(distributedRelation);
+	TupleDesc destTupleDescriptor = distributedRelation->rd_att;
+	int columnCount = inputTupleDescriptor->natts;
+	Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
+
+	CopySerializationPlan *serializationPlan = palloc0(sizeof(CopySerializationPlan));
+	serializationPlan->context = planContext;
+	serializationPlan->columnCount = columnCount;
+	serializationPlan->inputTypeArray =
+		TypeArrayFromTupleDescriptor(inputTupleDescriptor);
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, columnNameList)
+	{
+		serializationPlan->columnNameList =
+			lappend(serializationPlan->columnNameList, pstrdup(columnName));
+	}
+
+	serializationPlan->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
+	serializationPlan->columnCoercionPaths =
+		ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor, relationId,
+							columnNameList, finalTypeArray);
+	serializationPlan->columnOutputFunctions =
+		TypeOutputFunctions(columnCount, finalTypeArray, serializationPlan->binary);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return serializationPlan;
+}
+
+
+/*
+ * FreeCopySerializationPlan frees a serialisation plan and everything it
+ * points to.
+ */
+void
+FreeCopySerializationPlan(CopySerializationPlan *serializationPlan)
+{
+	MemoryContextDelete(serializationPlan->context);
+}
+
+
+/*
+ * citus_text_send_as_jsonb sends a text as if it was a JSONB. This should only
+ * be used if the text is indeed valid JSON.
+ */
+Datum
+citus_text_send_as_jsonb(PG_FUNCTION_ARGS)
+{
+	text *inputText = PG_GETARG_TEXT_PP(0);
+	StringInfoData buf;
+	int version = 1;
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, version, 1);
 	pq_sendtext(&buf, VARDATA_ANY(inputText), VARSIZE_ANY_EXHDR(inputText));
 
 	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
@@ -1510,11 +2370,16 @@ AppendCopyRowData(Datum *valueArray, bool *isNullArray, TupleDesc rowDescriptor,
 			if (!isNull)
 			{
 				FmgrInfo *outputFunctionPointer = &columnOutputFunctions[columnIndex];
-				bytea *outputBytes = SendFunctionCall(outputFunctionPointer, value);
 
-				CopySendInt32(rowOutputState, VARSIZE(outputBytes) - VARHDRSZ);
-				CopySendData(rowOutputState, VARDATA(outputBytes),
-							 VARSIZE(outputBytes) - VARHDRSZ);
+				if (!AppendBinaryColumnFast(rowOutputState,
+											outputFunctionPointer->fn_oid, value))
+				{
+					bytea *outputBytes = SendFunctionCall(outputFunctionPointer, value);
+
+					CopySendInt32(rowOutputState, VARSIZE(outputBytes) - VARHDRSZ);
+					CopySendData(rowOutputState, VARDATA(outputBytes),
+								 VARSIZE(outputBytes) - VARHDRSZ);
+				}
 			}
 			else
 			{
@@ -1526,9 +2391,14 @@ AppendCopyRowData(Datum *valueArray, bool *isNullArray, TupleDesc rowDescriptor,
 			if (!isNull)
 			{
 				FmgrInfo *outputFunctionPointer = &columnOutputFunctions[columnIndex];
-				char *columnText = OutputFunctionCall(outputFunctionPointer, value);
 
-				CopyAttributeOutText(rowOutputState, columnText);
+				if (!AppendTextColumnFast(rowOutputState,
+										  outputFunctionPointer->fn_oid, value))
+				{
+					char *columnText = OutputFunctionCall(outputFunctionPointer, value);
+
+					CopyAttributeOutText(rowOutputState, columnText);
+				}
 			}
 			else
 			{
@@ -1559,6 +2429,92 @@ AppendCopyRowData(Datum *valueArray, bool *isNullArray, TupleDesc rowDescriptor,
 }
 
 
+/*
+ * AppendBinaryColumnFast appends the binary representation of a value of one
+ * of the most common fixed-width types without going through the send
+ * function, and returns false for the other types. The bytes written are the
+ * ones the send functions of these types produce.
+ */
+static bool
+AppendBinaryColumnFast(CopyOutState rowOutputState, Oid outputFunctionId, Datum value)
+{
+	switch (outputFunctionId)
+	{
+		case F_INT4SEND:
+		{
+			CopySendInt32(rowOutputState, sizeof(int32));
+			CopySendInt32(rowOutputState, DatumGetInt32(value));
+			return true;
+		}
+
+		case F_INT8SEND:
+		case F_TIMESTAMP_SEND:
+		case F_TIMESTAMPTZ_SEND:
+		{
+			/* timestamps are int64 microseconds, and sent as such */
+			CopySendInt32(rowOutputState, sizeof(int64));
+			CopySendInt64(rowOutputState, DatumGetInt64(value));
+			return true;
+		}
+
+		case F_FLOAT8SEND:
+		{
+			union
+			{
+				float8 floatValue;
+				int64 intValue;
+			} swap;
+
+			swap.floatValue = DatumGetFloat8(value);
+
+			CopySendInt32(rowOutputState, sizeof(float8));
+			CopySendInt64(rowOutputState, swap.intValue);
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * AppendTextColumnFast appends the text representation of an integer value
+ * without going through the output function, and returns false for the other
+ * types. Integers never need escaping, so we append them as is.
+ */
+static bool
+AppendTextColumnFast(CopyOutState rowOutputState, Oid outputFunctionId, Datum value)
+{
+	char integerText[MAXINT8LEN + 1];
+
+	switch (outputFunctionId)
+	{
+		case F_INT4OUT:
+		{
+			pg_ltoa(DatumGetInt32(value), integerText);
+			break;
+		}
+
+		case F_INT8OUT:
+		{
+			pg_lltoa(DatumGetInt64(value), integerText);
+			break;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+
+	CopySendString(rowOutputState, integerText);
+	return true;
+}
+
+
 /*
  * CoerceColumnValue follows the instructions in *coercionPath and uses them to convert
  * inputValue into a Datum of the correct type.
@@ -1820,6 +2776,15 @@ CopySendInt16(CopyOutState outputState, int16 val)
 }
 
 
+/* Append an int64 to the copy buffer in outputState. */
+static void
+CopySendInt64(CopyOutState outputState, int64 val)
+{
+	uint64 buf = pg_hton64((uint64) val);
+	CopySendData(outputState, &buf, sizeof(buf));
+}
+
+
 /* Send the row to the appropriate destination */
 static void
 CopySendEndOfRow(CopyOutState cstate, bool includeEndOfLine)
@@ -1894,8 +2859,10 @@ CopyAttributeOutText(CopyOutState cstate, char *string)
 	 * extra bytes of a multibyte character never look like ASCII.
 	 */
 	char *start = pointer;
-	while ((c = *pointer) != '\0')
+	char *end = pointer + strlen(pointer);
+	while ((pointer = CopyAttributeOutTextSkipPlain(pointer, end, delimc)) < end)
 	{
+		c = *pointer;
 		if ((unsigned char) c < (unsigned char) 0x20)
 		{
 			/*
@@ -1956,6 +2923,54 @@ CopyAttributeOutText(CopyOutState cstate, char *string)
 
 
 /* *INDENT-ON* */
+
+
+/*
+ * CopyAttributeOutTextSkipPlain returns a pointer to the first character in
+ * [pointer, end) that CopyAttributeOutText needs to look at, that is a
+ * control character, a backslash or the delimiter, or end if there is none.
+ *
+ * Values are usually free of such characters, so we check 8 bytes at a time
+ * using the bit tricks from the COPY_SCAN_WORD_* macros. These only tell
+ * whether a word contains such a character at all; the character itself is
+ * then found by the byte-wise loop.
+ */
+static inline char *
+CopyAttributeOutTextSkipPlain(char *pointer, char *end, char delimc)
+{
+	while (end - pointer >= (ptrdiff_t) sizeof(uint64))
+	{
+		uint64 word = 0;
+
+		/* memcpy avoids unaligned loads and compiles to a single load */
+		memcpy(&word, pointer, sizeof(uint64));
+
+		if (COPY_SCAN_WORD_HAS_BYTE_LESS_THAN(word, 0x20) ||
+			COPY_SCAN_WORD_HAS_BYTE(word, '\\') ||
+			COPY_SCAN_WORD_HAS_BYTE(word, delimc))
+		{
+			break;
+		}
+
+		pointer += sizeof(uint64);
+	}
+
+	while (pointer < end)
+	{
+		unsigned char c = (unsigned char) *pointer;
+
+		if (c < (unsigned char) 0x20 || c == '\\' || c == (unsigned char) delimc)
+		{
+			break;
+		}
+
+		pointer++;
+	}
+
+	return pointer;
+}
+
+
 /* Helper function to send pending copy output */
 static inline void
 CopyFlushOutput(CopyOutState cstate, char *start, char *pointer)
@@ -2069,8 +3084,18 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 {
 	CitusCopyDestReceiver *copyDest = (CitusCopyDestReceiver *) dest;
 
+	/* the copy may need the connections of streaming executions */
+	FinishStreamingExecutions();
+
 	bool isIntermediateResult = copyDest->intermediateResultIdPrefix != NULL;
 	copyDest->shouldUseLocalCopy = ShouldExecuteCopyLocally(isIntermediateResult);
+
+	if (!isIntermediateResult)
+	{
+		/* cached subplan and query results may no longer be up to date */
+		RecordDistributedModification();
+		RecordRelationModification(copyDest->distributedRelationId);
+	}
 	Oid tableId = copyDest->distributedRelationId;
 
 	char *relationName = get_rel_name(tableId);
@@ -2151,24 +3176,46 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	copyOutState->delim = (char *) delimiterCharacter;
 	copyOutState->null_print = (char *) nullPrintCharacter;
 	copyOutState->null_print_client = (char *) nullPrintCharacter;
-	copyOutState->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
 	copyOutState->fe_msgbuf = makeStringInfo();
 	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
 	copyDest->copyOutState = copyOutState;
 	copyDest->multiShardCopy = false;
 
-	/* prepare functions to call on received tuples */
+	/*
+	 * Prepare functions to call on received tuples. We copy them out of the
+	 * cached plan, since the cache entry may be reset while we copy.
+	 */
 	{
-		TupleDesc destTupleDescriptor = distributedRelation->rd_att;
-		int columnCount = inputTupleDescriptor->natts;
-		Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
+		CopySerializationPlan *serializationPlan =
+			CachedCopySerializationPlan(distributedRelation, inputTupleDescriptor,
+										columnNameList);
+		int columnCount = serializationPlan->columnCount;
+
+		copyOutState->binary = serializationPlan->binary;
 
 		copyDest->columnCoercionPaths =
-			ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
-								tableId, columnNameList, finalTypeArray);
+			palloc0(columnCount * sizeof(CopyCoercionData));
+		copyDest->columnOutputFunctions = palloc0(columnCount * sizeof(FmgrInfo));
 
-		copyDest->columnOutputFunctions =
-			TypeOutputFunctions(columnCount, finalTypeArray, copyOutState->binary);
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			CopyCoercionData *cachedPath =
+				&serializationPlan->columnCoercionPaths[columnIndex];
+			CopyCoercionData *coercionPath = &copyDest->columnCoercionPaths[columnIndex];
+
+			coercionPath->coercionType = cachedPath->coercionType;
+			coercionPath->typioparam = cachedPath->typioparam;
+			fmgr_info_copy(&coercionPath->coerceFunction, &cachedPath->coerceFunction,
+						   CurrentMemoryContext);
+			fmgr_info_copy(&coercionPath->inputFunction, &cachedPath->inputFunction,
+						   CurrentMemoryContext);
+			fmgr_info_copy(&coercionPath->outputFunction, &cachedPath->outputFunction,
+						   CurrentMemoryContext);
+
+			fmgr_info_copy(&copyDest->columnOutputFunctions[columnIndex],
+						   &serializationPlan->columnOutputFunctions[columnIndex],
+						   CurrentMemoryContext);
+		}
 	}
 
 	/* wrap the column names as Values */
@@ -2224,6 +3271,8 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 
 	copyDest->shardStateHash = CreateShardStateHash(TopTransactionContext);
 	copyDest->connectionStateHash = CreateConnectionStateHash(TopTransactionContext);
+	copyDest->partitionRouting = BuildCopyPartitionRouting(copyDest,
+														   inputTupleDescriptor);
 
 	RecordRelationAccessIfReferenceTable(tableId, PLACEMENT_ACCESS_DML);
 }
@@ -2269,18 +3318,12 @@ static bool
 CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest)
 {
 	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
-	CopyStmt *copyStatement = copyDest->copyStatement;
 
 	CopyOutState copyOutState = copyDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
 	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	ListCell *placementStateCell = NULL;
-	bool cachedShardStateFound = false;
 	bool firstTupleInShard = false;
 
-	bool stopOnFailure = copyDest->stopOnFailure;
-
-
 	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
 	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
@@ -2290,119 +3333,77 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	Datum *columnValues = slot->tts_values;
 	bool *columnNulls = slot->tts_isnull;
 
-	int64 shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
-
-	/* connections hash is kept in memory context */
-	MemoryContextSwitchTo(copyDest->memoryContext);
-
-	bool isIntermediateResult = copyDest->intermediateResultIdPrefix != NULL;
-	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
-											   copyDest->connectionStateHash,
-											   stopOnFailure,
-											   &cachedShardStateFound,
-											   copyDest->shouldUseLocalCopy,
-											   copyDest->copyOutState,
-											   isIntermediateResult);
-	if (!cachedShardStateFound)
-	{
-		firstTupleInShard = true;
-	}
+	ShardInterval *shardInterval = ShardIntervalForTuple(copyDest, columnValues,
+														 columnNulls);
+	int64 shardId = shardInterval->shardId;
+	Oid partitionRelationId = InvalidOid;
 
-	if (firstTupleInShard && !copyDest->multiShardCopy &&
-		hash_get_num_entries(copyDest->shardStateHash) == 2)
+	if (copyDest->partitionRouting != NULL)
 	{
-		Oid relationId = copyDest->distributedRelationId;
-
-		/* mark as multi shard to skip doing the same thing over and over */
-		copyDest->multiShardCopy = true;
-
-		if (MultiShardConnectionType != SEQUENTIAL_CONNECTION)
+		uint64 partitionShardId =
+			PartitionShardIdForTuple(copyDest, shardInterval->shardIndex, columnValues,
+									 columnNulls, &partitionRelationId);
+		if (partitionShardId != INVALID_SHARD_ID)
 		{
-			/* when we see multiple shard connections, we mark COPY as parallel modify */
-			RecordParallelModifyAccess(relationId);
+			shardId = partitionShardId;
 		}
 	}
 
-	if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	/* connections hash is kept in memory context */
+	MemoryContextSwitchTo(copyDest->memoryContext);
+
+	CopyShardState *shardState = GetCopyShardState(copyDest, shardId,
+												   &firstTupleInShard);
+	if (firstTupleInShard)
 	{
-		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
+		shardState->partitionRelationId = partitionRelationId;
 	}
 
-
-	foreach(placementStateCell, shardState->placementStateList)
+	if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
 	{
-		CopyPlacementState *currentPlacementState = lfirst(placementStateCell);
-		CopyConnectionState *connectionState = currentPlacementState->connectionState;
-		CopyPlacementState *activePlacementState = connectionState->activePlacementState;
-		bool switchToCurrentPlacement = false;
-		bool sendTupleOverConnection = false;
-
-		if (activePlacementState == NULL)
+		if (firstTupleInShard && shardState->copyOutState != NULL)
 		{
-			switchToCurrentPlacement = true;
-		}
-		else if (currentPlacementState != activePlacementState &&
-				 currentPlacementState->data->len > COPY_SWITCH_OVER_THRESHOLD)
-		{
-			switchToCurrentPlacement = true;
-
-			/* before switching, make sure to finish the copy */
-			EndPlacementStateCopyCommand(activePlacementState, copyOutState);
-			dlist_push_head(&connectionState->bufferedPlacementList,
-							&activePlacementState->bufferedPlacementNode);
+			shardState->localShardInsertState = BeginLocalShardInsert(copyDest,
+																	  shardId);
 		}
 
-		if (switchToCurrentPlacement)
-		{
-			StartPlacementStateCopyCommand(currentPlacementState, copyStatement,
-										   copyOutState);
-
-			dlist_delete(&currentPlacementState->bufferedPlacementNode);
-			connectionState->activePlacementState = currentPlacementState;
-
-			/* send previously buffered tuples */
-			SendCopyDataToPlacement(currentPlacementState->data, shardId,
-									connectionState->connection);
-			resetStringInfo(currentPlacementState->data);
-
-			/* additionaly, we need to send the current tuple too */
-			sendTupleOverConnection = true;
-		}
-		else if (currentPlacementState != activePlacementState)
+		if (shardState->localShardInsertState != NULL)
 		{
-			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
+			InsertTupleIntoLocalShard(slot, copyDest, shardState->localShardInsertState);
 		}
 		else
 		{
-			Assert(currentPlacementState == activePlacementState);
-			sendTupleOverConnection = true;
-		}
-
-		if (sendTupleOverConnection)
-		{
-			resetStringInfo(copyOutState->fe_msgbuf);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
-									connectionState->connection);
+			WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
 		}
 	}
 
-	MemoryContextSwitchTo(oldContext);
-
-	copyDest->tuplesSent++;
+	StartPlacementCopyCommands(copyDest, shardState);
 
 	/*
-	 * Release per tuple memory allocated in this function. If we're writing
-	 * the results of an INSERT ... SELECT then the SELECT execution will use
-	 * its own executor state and reset the per tuple expression context
+	 * Serialize the tuple only once for all placements of the shard, and add
+	 * it to the buffer of each placement. Buffers of active placements are
+	 * put on the wire once they fill up a batch, such that we do not pay the
+	 * per-message overhead of COPY for every single tuple.
+	 */
+	StringInfo copyBuffer = copyOutState->fe_msgbuf;
+	resetStringInfo(copyBuffer);
+
+	if (shardState->placementStateList != NIL)
+	{
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, columnCoercionPaths);
+	}
+
+	AppendCopyDataToPlacements(shardState, copyBuffer->data, copyBuffer->len);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+
+	/*
+	 * Release per tuple memory allocated in this function. If we're writing
+	 * the results of an INSERT ... SELECT then the SELECT execution will use
+	 * its own executor state and reset the per tuple expression context
 	 * separately.
 	 */
 	ResetPerTupleExprContext(executorState);
@@ -2411,6 +3412,161 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 }
 
 
+/*
+ * CitusSendCopyRowToPlacements sends a row that is already in the COPY format
+ * of the placements to the placements of the given shard.
+ */
+static void
+CitusSendCopyRowToPlacements(CitusCopyDestReceiver *copyDest, int64 shardId,
+							 const char *rowData, int rowLength)
+{
+	bool firstTupleInShard = false;
+
+	/* connections hash is kept in memory context */
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+	PG_TRY();
+	{
+		CopyShardState *shardState = GetCopyShardState(copyDest, shardId,
+													   &firstTupleInShard);
+
+		StartPlacementCopyCommands(copyDest, shardState);
+		AppendCopyDataToPlacements(shardState, rowData, rowLength);
+	}
+	PG_CATCH();
+	{
+		/* see CitusCopyDestReceiverReceive */
+		List *connectionStateList = ConnectionStateList(copyDest->connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+}
+
+
+/*
+ * GetCopyShardState returns the state of the COPY into the given shard, and
+ * sets firstTupleInShard if it is the first tuple sent to the shard.
+ */
+static CopyShardState *
+GetCopyShardState(CitusCopyDestReceiver *copyDest, int64 shardId,
+				  bool *firstTupleInShard)
+{
+	bool cachedShardStateFound = false;
+	bool isIntermediateResult = copyDest->intermediateResultIdPrefix != NULL;
+
+	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
+											   copyDest->connectionStateHash,
+											   copyDest->stopOnFailure,
+											   &cachedShardStateFound,
+											   copyDest->shouldUseLocalCopy,
+											   copyDest->copyOutState,
+											   isIntermediateResult);
+
+	*firstTupleInShard = !cachedShardStateFound;
+
+	if (*firstTupleInShard && !copyDest->multiShardCopy &&
+		hash_get_num_entries(copyDest->shardStateHash) == 2)
+	{
+		Oid relationId = copyDest->distributedRelationId;
+
+		/* mark as multi shard to skip doing the same thing over and over */
+		copyDest->multiShardCopy = true;
+
+		if (MultiShardConnectionType != SEQUENTIAL_CONNECTION)
+		{
+			/* when we see multiple shard connections, we mark COPY as parallel modify */
+			RecordParallelModifyAccess(relationId);
+		}
+	}
+
+	return shardState;
+}
+
+
+/*
+ * StartPlacementCopyCommands makes sure each placement of the given shard has
+ * an active COPY if it can get one.
+ */
+static void
+StartPlacementCopyCommands(CitusCopyDestReceiver *copyDest, CopyShardState *shardState)
+{
+	CopyStmt *copyStatement = copyDest->copyStatement;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	ListCell *placementStateCell = NULL;
+
+	foreach(placementStateCell, shardState->placementStateList)
+	{
+		CopyPlacementState *currentPlacementState = lfirst(placementStateCell);
+		CopyConnectionState *connectionState = currentPlacementState->connectionState;
+		CopyPlacementState *activePlacementState = connectionState->activePlacementState;
+		bool switchToCurrentPlacement = false;
+
+		if (activePlacementState == NULL)
+		{
+			switchToCurrentPlacement = true;
+		}
+		else if (currentPlacementState != activePlacementState &&
+				 currentPlacementState->data->len > COPY_SWITCH_OVER_THRESHOLD)
+		{
+			switchToCurrentPlacement = true;
+
+			/* before switching, make sure to finish the copy */
+			EndPlacementStateCopyCommand(activePlacementState, copyOutState);
+			dlist_push_head(&connectionState->bufferedPlacementList,
+							&activePlacementState->bufferedPlacementNode);
+		}
+
+		if (switchToCurrentPlacement)
+		{
+			StartPlacementStateCopyCommand(currentPlacementState, copyStatement,
+										   copyOutState);
+
+			dlist_delete(&currentPlacementState->bufferedPlacementNode);
+			connectionState->activePlacementState = currentPlacementState;
+
+			/* send previously buffered tuples */
+			SendPlacementCopyData(currentPlacementState, currentPlacementState->data);
+			resetStringInfo(currentPlacementState->data);
+		}
+	}
+}
+
+
+/*
+ * AppendCopyDataToPlacements adds the given serialized row to the buffer of
+ * each placement of the given shard, and puts the buffers of the active
+ * placements on the wire once they fill up a batch.
+ */
+static void
+AppendCopyDataToPlacements(CopyShardState *shardState, const char *rowData,
+						   int rowLength)
+{
+	ListCell *placementStateCell = NULL;
+
+	foreach(placementStateCell, shardState->placementStateList)
+	{
+		CopyPlacementState *currentPlacementState = lfirst(placementStateCell);
+		CopyConnectionState *connectionState = currentPlacementState->connectionState;
+		StringInfo placementBuffer = currentPlacementState->data;
+
+		appendBinaryStringInfo(placementBuffer, rowData, rowLength);
+
+		if (currentPlacementState == connectionState->activePlacementState &&
+			placementBuffer->len >= COPY_SEND_BATCH_SIZE)
+		{
+			SendPlacementCopyData(currentPlacementState, placementBuffer);
+			resetStringInfo(placementBuffer);
+		}
+	}
+}
+
+
 /*
  * ContainsLocalPlacement returns true if the current node has
  * a local placement for the given shard id.
@@ -2436,10 +3592,12 @@ ContainsLocalPlacement(int64 shardId)
 
 
 /*
- * ShardIdForTuple returns id of the shard to which the given tuple belongs to.
+ * ShardIntervalForTuple returns the shard interval to which the given tuple
+ * belongs to.
  */
-static uint64
-ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *columnNulls)
+static ShardInterval *
+ShardIntervalForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+					  bool *columnNulls)
 {
 	int partitionColumnIndex = copyDest->partitionColumnIndex;
 	Datum partitionColumnValue = 0;
@@ -2494,7 +3652,284 @@ ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *colu
 							   "value")));
 	}
 
-	return shardInterval->shardId;
+	return shardInterval;
+}
+
+
+/*
+ * BuildCopyPartitionRouting returns the state for routing the rows of the COPY
+ * to the shards of the partitions of the distributed table, or NULL if rows
+ * should go to the shards of the distributed table itself.
+ */
+static CopyPartitionRouting *
+BuildCopyPartitionRouting(CitusCopyDestReceiver *copyDest, TupleDesc inputTupleDescriptor)
+{
+	Relation distributedRelation = copyDest->distributedRelation;
+	Oid relationId = copyDest->distributedRelationId;
+
+	/* local copy and intermediate results only know the distributed table */
+	if (!EnableCopyPartitionRouting || copyDest->intermediateResultIdPrefix != NULL ||
+		copyDest->shouldUseLocalCopy)
+	{
+		return NULL;
+	}
+
+	if (PartitionMethod(relationId) != DISTRIBUTE_BY_HASH ||
+		!PartitionedTable(relationId))
+	{
+		return NULL;
+	}
+
+	/* multi-column, expression and hash partitioning are left to the workers */
+	PartitionKey partitionKey = RelationGetPartitionKey(distributedRelation);
+	if (partitionKey->partnatts != 1 || partitionKey->partattrs[0] == 0 ||
+		(partitionKey->strategy != PARTITION_STRATEGY_RANGE &&
+		 partitionKey->strategy != PARTITION_STRATEGY_LIST))
+	{
+		return NULL;
+	}
+
+	/*
+	 * Defaults of omitted columns may differ between the partitions and the
+	 * partitioned table, so we only route rows that have all columns.
+	 */
+	if (!ColumnNameListCoversRelation(copyDest->columnNameList,
+									  RelationGetDescr(distributedRelation),
+									  inputTupleDescriptor))
+	{
+		return NULL;
+	}
+
+	PartitionDesc partitionDesc = RelationGetPartitionDesc(distributedRelation);
+	int partitionCount = partitionDesc->nparts;
+	if (partitionCount == 0)
+	{
+		return NULL;
+	}
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	CopyPartitionRouting *routing = palloc0(sizeof(CopyPartitionRouting));
+	routing->partitionKeyIndex = partitionKey->partattrs[0] - 1;
+	routing->strategy = partitionKey->strategy;
+	fmgr_info_copy(&routing->partitionSupportFunction, &partitionKey->partsupfunc[0],
+				   CurrentMemoryContext);
+	routing->partitionCollation = partitionKey->partcollation[0];
+	routing->boundInfo = partition_bounds_copy(partitionDesc->boundinfo, partitionKey);
+
+	routing->partitionCount = partitionCount;
+	routing->partitionRelationIds = palloc0(partitionCount * sizeof(Oid));
+	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
+	{
+		routing->partitionRelationIds[partitionIndex] =
+			partitionDesc->oids[partitionIndex];
+	}
+
+	routing->partitionChecked = palloc0(partitionCount * sizeof(bool));
+	routing->partitionRoutable = palloc0(partitionCount * sizeof(bool));
+
+	routing->shardCount = shardCount;
+	routing->partitionShardIds = palloc0(partitionCount * shardCount * sizeof(uint64));
+
+	return routing;
+}
+
+
+/*
+ * ColumnNameListCoversRelation returns whether the incoming tuples have the
+ * layout of the relation and the COPY sends all of its columns, such that the
+ * workers do not evaluate any defaults.
+ */
+static bool
+ColumnNameListCoversRelation(List *columnNameList, TupleDesc relationDesc,
+							 TupleDesc inputTupleDescriptor)
+{
+	ListCell *columnNameCell = list_head(columnNameList);
+
+	if (inputTupleDescriptor->natts != relationDesc->natts)
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < relationDesc->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(relationDesc, columnIndex);
+		Form_pg_attribute inputColumn = TupleDescAttr(inputTupleDescriptor, columnIndex);
+
+		if (column->attisdropped != inputColumn->attisdropped)
+		{
+			return false;
+		}
+
+		if (column->attisdropped)
+		{
+			continue;
+		}
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+		/* generation expressions may also differ between partitions */
+		if (column->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			return false;
+		}
+#endif
+
+		if (columnNameCell == NULL ||
+			strcmp((char *) lfirst(columnNameCell), NameStr(column->attname)) != 0)
+		{
+			return false;
+		}
+
+		columnNameCell = lnext(columnNameCell);
+	}
+
+	return columnNameCell == NULL;
+}
+
+
+/*
+ * PartitionShardIdForTuple returns the id of the shard that is co-located with
+ * the shard at shardIndex of the distributed table and belongs to the partition
+ * that accepts the given tuple, and sets partitionRelationId to that partition.
+ * If the tuple cannot be routed on the coordinator, it returns INVALID_SHARD_ID
+ * and the tuple goes to the shard of the distributed table.
+ */
+static uint64
+PartitionShardIdForTuple(CitusCopyDestReceiver *copyDest, int shardIndex,
+						 Datum *columnValues, bool *columnNulls,
+						 Oid *partitionRelationId)
+{
+	CopyPartitionRouting *routing = copyDest->partitionRouting;
+	int partitionKeyIndex = routing->partitionKeyIndex;
+
+	*partitionRelationId = InvalidOid;
+
+	/* NULL keys are rare, let the worker find the partition that accepts them */
+	if (columnNulls[partitionKeyIndex])
+	{
+		return INVALID_SHARD_ID;
+	}
+
+	CopyCoercionData *coercePath = &copyDest->columnCoercionPaths[partitionKeyIndex];
+	Datum partitionKeyValue = CoerceColumnValue(columnValues[partitionKeyIndex],
+												coercePath);
+
+	int partitionIndex = PartitionIndexForValue(routing, partitionKeyValue);
+	if (partitionIndex < 0 || !CanCopyIntoPartition(copyDest, partitionIndex))
+	{
+		return INVALID_SHARD_ID;
+	}
+
+	Oid partitionId = routing->partitionRelationIds[partitionIndex];
+	uint64 *partitionShardId =
+		&routing->partitionShardIds[partitionIndex * routing->shardCount + shardIndex];
+
+	if (*partitionShardId == INVALID_SHARD_ID)
+	{
+		*partitionShardId = ColocatedShardIdInRelation(partitionId, shardIndex);
+	}
+
+	*partitionRelationId = partitionId;
+
+	return *partitionShardId;
+}
+
+
+/*
+ * PartitionIndexForValue returns the index of the partition that accepts the
+ * given partition key value, or -1 if there is none. It follows
+ * get_partition_for_tuple() in PostgreSQL for a single non-NULL key.
+ */
+static int
+PartitionIndexForValue(CopyPartitionRouting *routing, Datum value)
+{
+	PartitionBoundInfo boundInfo = routing->boundInfo;
+	int partitionIndex = -1;
+	bool equal = false;
+
+	if (routing->strategy == PARTITION_STRATEGY_RANGE)
+	{
+		int boundOffset =
+			partition_range_datum_bsearch(&routing->partitionSupportFunction,
+										  &routing->partitionCollation,
+										  boundInfo, 1, &value, &equal);
+
+		/* the range that contains the value ends at the next bound */
+		partitionIndex = boundInfo->indexes[boundOffset + 1];
+	}
+	else
+	{
+		int boundOffset = partition_list_bsearch(&routing->partitionSupportFunction,
+												 &routing->partitionCollation,
+												 boundInfo, value, &equal);
+		if (boundOffset >= 0 && equal)
+		{
+			partitionIndex = boundInfo->indexes[boundOffset];
+		}
+	}
+
+	if (partitionIndex < 0)
+	{
+		partitionIndex = boundInfo->default_index;
+	}
+
+	return partitionIndex;
+}
+
+
+/*
+ * CanCopyIntoPartition returns whether rows can be sent directly to the shards
+ * of the partition at the given index. Each partition is checked once, when the
+ * first row for it arrives, after locking it as the executor would when routing
+ * rows into it.
+ */
+static bool
+CanCopyIntoPartition(CitusCopyDestReceiver *copyDest, int partitionIndex)
+{
+	CopyPartitionRouting *routing = copyDest->partitionRouting;
+	Oid partitionId = routing->partitionRelationIds[partitionIndex];
+	bool routable = false;
+
+	if (routing->partitionChecked[partitionIndex])
+	{
+		return routing->partitionRoutable[partitionIndex];
+	}
+
+	LockRelationOid(partitionId, RowExclusiveLock);
+
+	/*
+	 * The workers check the permissions of the partition rather than those of
+	 * the partitioned table, and do not allow COPY FROM under row level
+	 * security, so we leave such partitions to tuple routing on the workers.
+	 */
+	if (get_rel_relkind(partitionId) == RELKIND_RELATION &&
+		IsCitusTable(partitionId) &&
+		pg_class_aclcheck(partitionId, GetUserId(), ACL_INSERT) == ACLCHECK_OK &&
+		check_enable_rls(partitionId, InvalidOid, true) != RLS_ENABLED)
+	{
+		CitusTableCacheEntry *cacheEntry =
+			GetCitusTableCacheEntry(copyDest->distributedRelationId);
+		CitusTableCacheEntry *partitionEntry = GetCitusTableCacheEntry(partitionId);
+
+		routable = partitionEntry->colocationId == cacheEntry->colocationId &&
+				   partitionEntry->shardIntervalArrayLength == routing->shardCount;
+	}
+
+	if (routable)
+	{
+		/* cached results of queries on the partition may no longer be up to date */
+		RecordRelationModification(partitionId);
+
+		ereport(DEBUG1, (errmsg("copying the rows of partition %s directly into "
+								"its shards", get_rel_name(partitionId))));
+	}
+
+	routing->partitionChecked[partitionIndex] = true;
+	routing->partitionRoutable[partitionIndex] = routable;
+
+	return routable;
 }
 
 
@@ -2542,7 +3977,8 @@ CitusCopyDestReceiverShutdown(DestReceiver *destReceiver)
 
 
 /*
- * FinishLocalCopy sends the remaining copies for local placements.
+ * FinishLocalCopy sends the remaining copies for local placements, and
+ * inserts the remaining buffered tuples into local shards.
  */
 static void
 FinishLocalCopy(CitusCopyDestReceiver *copyDest)
@@ -2553,6 +3989,12 @@ FinishLocalCopy(CitusCopyDestReceiver *copyDest)
 
 	foreach_htab(copyShardState, &status, shardStateHash)
 	{
+		if (copyShardState->localShardInsertState != NULL)
+		{
+			FinishLocalShardInsert(copyShardState->localShardInsertState);
+			copyShardState->localShardInsertState = NULL;
+		}
+
 		if (copyShardState->copyOutState != NULL &&
 			copyShardState->copyOutState->fe_msgbuf->len > 0)
 		{
@@ -2586,12 +4028,10 @@ ShutdownCopyConnectionState(CopyConnectionState *connectionState,
 	{
 		CopyPlacementState *placementState =
 			dlist_container(CopyPlacementState, bufferedPlacementNode, iter.cur);
-		uint64 shardId = placementState->shardState->shardId;
 
+		/* EndPlacementStateCopyCommand sends the buffered data */
 		StartPlacementStateCopyCommand(placementState, copyStatement,
 									   copyOutState);
-		SendCopyDataToPlacement(placementState->data, shardId,
-								connectionState->connection);
 		EndPlacementStateCopyCommand(placementState, copyOutState);
 	}
 }
@@ -2627,49 +4067,273 @@ CitusCopyDestReceiverDestroy(DestReceiver *destReceiver)
 
 	if (copyDest->connectionStateHash)
 	{
-		hash_destroy(copyDest->connectionStateHash);
+		hash_destroy(copyDest->connectionStateHash);
+	}
+
+	pfree(copyDest);
+}
+
+
+/*
+ * IsCopyResultStmt determines whether the given copy statement is a
+ * COPY "resultkey" FROM STDIN WITH (format result) statement, which is used
+ * to copy query results from the coordinator into workers.
+ */
+bool
+IsCopyResultStmt(CopyStmt *copyStatement)
+{
+	return CopyStatementHasFormat(copyStatement, "result");
+}
+
+
+/*
+ * CopyStatementHasFormat checks whether the COPY statement has the given
+ * format.
+ */
+static bool
+CopyStatementHasFormat(CopyStmt *copyStatement, char *formatName)
+{
+	ListCell *optionCell = NULL;
+	bool hasFormat = false;
+
+	/* extract WITH (...) options from the COPY statement */
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(defel->defname, "format", NAMEDATALEN) == 0 &&
+			strncmp(defGetString(defel), formatName, NAMEDATALEN) == 0)
+		{
+			hasFormat = true;
+			break;
+		}
+	}
+
+	return hasFormat;
+}
+
+
+/*
+ * IsCompressedCopyStmt determines whether the given copy statement has the
+ * compression option, which the coordinator adds to COPY commands on shards
+ * when citus.compress_copy_data is enabled.
+ */
+static bool
+IsCompressedCopyStmt(CopyStmt *copyStatement)
+{
+	DefElem *option = NULL;
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strncmp(option->defname, COPY_COMPRESSION_OPTION, NAMEDATALEN) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CopyCompressedDataFromFrontend copies the compressed COPY data that the
+ * client sends into the relation of the given COPY ... FROM STDIN WITH
+ * (compression 'pglz') command. Each CopyData message holds one block in
+ * the format described at COMPRESSED_COPY_BLOCK_SIZE, which is decompressed
+ * before it is passed to CopyFrom. All other options are handled as usual.
+ */
+static void
+CopyCompressedDataFromFrontend(CopyStmt *copyStatement, char *completionTag)
+{
+	DefElem *compressionOption = NULL;
+	DefElem *option = NULL;
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strncmp(option->defname, COPY_COMPRESSION_OPTION, NAMEDATALEN) == 0)
+		{
+			compressionOption = option;
+		}
+	}
+
+	char *compressionMethod = defGetString(compressionOption);
+	if (strncmp(compressionMethod, COPY_COMPRESSION_METHOD, NAMEDATALEN) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY compression \"%s\" is not supported",
+							   compressionMethod)));
+	}
+
+	if (!copyStatement->is_from || copyStatement->relation == NULL ||
+		copyStatement->filename != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY compression is only supported for COPY "
+							   "table FROM STDIN")));
+	}
+
+	CheckCopyPermissions(copyStatement);
+
+	Relation relation = heap_openrv(copyStatement->relation, RowExclusiveLock);
+	Oid relationId = RelationGetRelid(relation);
+
+	if (IsCitusTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY compression is not supported for distributed "
+							   "tables")));
+	}
+
+	if (check_enable_rls(relationId, InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY FROM not supported with row-level security")));
+	}
+
+	List *copyOptions = RemoveOptionFromList(list_copy(copyStatement->options),
+											 COPY_COMPRESSION_OPTION);
+
+	ParseState *pState = make_parsestate(NULL);
+
+	/* p_rtable of pState is set so that we can check constraints */
+	pState->p_rtable = CreateRangeTable(relation, ACL_INSERT);
+
+	CompressedCopyInput copyInput = { 0 };
+	copyInput.rawBlock = makeStringInfo();
+	enlargeStringInfo(copyInput.rawBlock, COMPRESSED_COPY_BLOCK_SIZE);
+	copyInput.messageBuffer = makeStringInfo();
+	CurrentCompressedCopyInput = &copyInput;
+
+	SendCopyInStart();
+
+	CopyState copyState = BeginCopyFrom(pState, relation, NULL, false,
+										ReadCompressedCopyDataCallback,
+										copyStatement->attlist, copyOptions);
+	uint64 processedRowCount = CopyFrom(copyState);
+	EndCopyFrom(copyState);
+
+	/* consume the rest of the messages up to CopyDone */
+	while (!copyInput.copyDone)
+	{
+		resetStringInfo(copyInput.messageBuffer);
+		copyInput.copyDone = ReceiveCopyData(copyInput.messageBuffer);
+	}
+
+	CurrentCompressedCopyInput = NULL;
+
+	heap_close(relation, NoLock);
+	free_parsestate(pState);
+
+	if (completionTag != NULL)
+	{
+		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+					 "COPY " UINT64_FORMAT, processedRowCount);
 	}
-
-	pfree(copyDest);
 }
 
 
 /*
- * IsCopyResultStmt determines whether the given copy statement is a
- * COPY "resultkey" FROM STDIN WITH (format result) statement, which is used
- * to copy query results from the coordinator into workers.
+ * ReadCompressedCopyDataCallback is the copy callback for compressed COPY
+ * data from the client. It returns at least minRead bytes of decompressed
+ * data unless the client finished sending data.
  */
-bool
-IsCopyResultStmt(CopyStmt *copyStatement)
+static int
+ReadCompressedCopyDataCallback(void *outBuf, int minRead, int maxRead)
 {
-	return CopyStatementHasFormat(copyStatement, "result");
+	CompressedCopyInput *copyInput = CurrentCompressedCopyInput;
+	StringInfo rawBlock = copyInput->rawBlock;
+	int bytesCopied = 0;
+
+	while (bytesCopied < minRead)
+	{
+		int availableLength = rawBlock->len - rawBlock->cursor;
+		if (availableLength == 0)
+		{
+			if (!ReceiveCompressedCopyBlock(copyInput))
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		int copyLength = Min(availableLength, maxRead - bytesCopied);
+		memcpy_s((char *) outBuf + bytesCopied, maxRead - bytesCopied,
+				 rawBlock->data + rawBlock->cursor, copyLength);
+
+		rawBlock->cursor += copyLength;
+		bytesCopied += copyLength;
+	}
+
+	return bytesCopied;
 }
 
 
 /*
- * CopyStatementHasFormat checks whether the COPY statement has the given
- * format.
+ * ReceiveCompressedCopyBlock receives the next CopyData message from the
+ * client and decompresses the block in it into the raw block buffer. It
+ * returns false when the client sent CopyDone.
  */
 static bool
-CopyStatementHasFormat(CopyStmt *copyStatement, char *formatName)
+ReceiveCompressedCopyBlock(CompressedCopyInput *copyInput)
 {
-	ListCell *optionCell = NULL;
-	bool hasFormat = false;
+	StringInfo messageBuffer = copyInput->messageBuffer;
+	StringInfo rawBlock = copyInput->rawBlock;
+	uint32 blockHeader[2];
 
-	/* extract WITH (...) options from the COPY statement */
-	foreach(optionCell, copyStatement->options)
+	resetStringInfo(rawBlock);
+	resetStringInfo(messageBuffer);
+
+	/* skip empty messages, such as Flush and Sync */
+	while (messageBuffer->len == 0)
 	{
-		DefElem *defel = (DefElem *) lfirst(optionCell);
+		if (copyInput->copyDone)
+		{
+			return false;
+		}
 
-		if (strncmp(defel->defname, "format", NAMEDATALEN) == 0 &&
-			strncmp(defGetString(defel), formatName, NAMEDATALEN) == 0)
+		copyInput->copyDone = ReceiveCopyData(messageBuffer);
+	}
+
+	if (messageBuffer->len < COMPRESSED_COPY_BLOCK_HEADER_SIZE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION),
+						errmsg("invalid block in compressed COPY data")));
+	}
+
+	memcpy_s(blockHeader, sizeof(blockHeader), messageBuffer->data,
+			 COMPRESSED_COPY_BLOCK_HEADER_SIZE);
+
+	uint32 rawLength = pg_ntoh32(blockHeader[0]);
+	uint32 compressedLength = pg_ntoh32(blockHeader[1]);
+	uint32 payloadLength = messageBuffer->len - COMPRESSED_COPY_BLOCK_HEADER_SIZE;
+	char *payload = messageBuffer->data + COMPRESSED_COPY_BLOCK_HEADER_SIZE;
+
+	if (rawLength == 0 || rawLength > COMPRESSED_COPY_BLOCK_SIZE ||
+		payloadLength != (compressedLength == 0 ? rawLength : compressedLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_PROTOCOL_VIOLATION),
+						errmsg("invalid block in compressed COPY data")));
+	}
+
+	if (compressedLength == 0)
+	{
+		/* block is sent as is */
+		memcpy_s(rawBlock->data, rawBlock->maxlen, payload, rawLength);
+	}
+	else
+	{
+		int32 decompressedLength = pglz_decompress_compat(payload, compressedLength,
+														  rawBlock->data,
+														  rawLength);
+		if (decompressedLength != (int32) rawLength)
 		{
-			hasFormat = true;
-			break;
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("could not decompress COPY data")));
 		}
 	}
 
-	return hasFormat;
+	rawBlock->len = rawLength;
+
+	return true;
 }
 
 
@@ -2702,6 +4366,17 @@ ProcessCopyStmt(CopyStmt *copyStatement, char *completionTag, const char *queryS
 		return NULL;
 	}
 
+	/*
+	 * Handle COPY shard FROM STDIN WITH (compression 'pglz') commands for
+	 * sending compressed COPY data to shards.
+	 */
+	if (IsCompressedCopyStmt(copyStatement))
+	{
+		CopyCompressedDataFromFrontend(copyStatement, completionTag);
+
+		return NULL;
+	}
+
 	/*
 	 * We check whether a distributed relation is affected. For that, we need to open the
 	 * relation. To prevent race conditions with later lookups, lock the table, and modify
@@ -2874,7 +4549,8 @@ CitusCopySelect(CopyStmt *copyStatement)
 
 /*
  * CitusCopyTo runs a COPY .. TO STDOUT command on each shard to do a full
- * table dump.
+ * table dump. The CopyData messages of the workers are forwarded to the client
+ * as is, without parsing the rows on the coordinator.
  */
 static void
 CitusCopyTo(CopyStmt *copyStatement, char *completionTag)
@@ -2896,75 +4572,323 @@ CitusCopyTo(CopyStmt *copyStatement, char *completionTag)
 
 	List *shardIntervalList = LoadShardIntervalList(relationId);
 
-	foreach(shardIntervalCell, shardIntervalList)
+	/*
+	 * Rows of different shards can only be interleaved when there is no
+	 * header to send first, and when we do not need to reuse the connections
+	 * that accessed the placements earlier in the transaction.
+	 */
+	if (CopyToParallelStreams > 1 && !IsMultiStatementTransaction() &&
+		!CopyStatementHasHeader(copyStatement))
 	{
-		ShardInterval *shardInterval = lfirst(shardIntervalCell);
-		List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
-		ListCell *shardPlacementCell = NULL;
-		int placementIndex = 0;
-
-		StringInfo copyCommand = ConstructCopyStatement(copyStatement,
-														shardInterval->shardId);
-
-		foreach(shardPlacementCell, shardPlacementList)
+		tuplesSent = ForwardCopyDataFromShardsInParallel(copyOutState, copyStatement,
+														 shardIntervalList);
+	}
+	else
+	{
+		foreach(shardIntervalCell, shardIntervalList)
 		{
-			ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
-			int connectionFlags = 0;
-			char *userName = NULL;
-			const bool raiseErrors = true;
-
-			MultiConnection *connection = GetPlacementConnection(connectionFlags,
-																 shardPlacement,
-																 userName);
+			ShardInterval *shardInterval = lfirst(shardIntervalCell);
+			StringInfo copyCommand = ConstructCopyStatement(copyStatement,
+															shardInterval->shardId);
 
-			if (placementIndex == list_length(shardPlacementList) - 1)
+			MultiConnection *connection = StartCopyToOnShard(copyCommand,
+															 shardInterval->shardId);
+			if (connection != NULL)
 			{
-				/* last chance for this shard */
-				MarkRemoteTransactionCritical(connection);
+				tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
 			}
 
-			if (PQstatus(connection->pgConn) != CONNECTION_OK)
+			if (shardIntervalCell == list_head(shardIntervalList))
 			{
-				HandleRemoteTransactionConnectionError(connection, raiseErrors);
-				continue;
+				/* remove header after the first shard */
+				RemoveOptionFromList(copyStatement->options, "header");
 			}
+		}
+	}
 
-			RemoteTransactionBeginIfNecessary(connection);
+	SendCopyEnd(copyOutState);
+
+	heap_close(distributedRelation, AccessShareLock);
+
+	if (completionTag != NULL)
+	{
+		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
+					 tuplesSent);
+	}
+}
+
+
+/*
+ * CopyStatementHasHeader returns whether the COPY statement asks for a
+ * header line.
+ */
+static bool
+CopyStatementHasHeader(CopyStmt *copyStatement)
+{
+	DefElem *defel = NULL;
+	foreach_ptr(defel, copyStatement->options)
+	{
+		if (strncmp(defel->defname, "header", NAMEDATALEN) == 0 &&
+			defGetBoolean(defel))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * StartCopyToOnShard sends the given COPY .. TO STDOUT command to one of the
+ * active placements of the shard, and returns the connection once it is in
+ * COPY OUT state. Failed placements are skipped, and the function errors out
+ * if the last placement fails as well.
+ */
+static MultiConnection *
+StartCopyToOnShard(StringInfo copyCommand, uint64 shardId)
+{
+	List *shardPlacementList = ActiveShardPlacementList(shardId);
+	ListCell *shardPlacementCell = NULL;
+	int placementIndex = 0;
+
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
+		int connectionFlags = 0;
+		char *userName = NULL;
+		const bool raiseErrors = true;
+
+		MultiConnection *connection = GetPlacementConnection(connectionFlags,
+															 shardPlacement,
+															 userName);
+
+		if (placementIndex == list_length(shardPlacementList) - 1)
+		{
+			/* last chance for this shard */
+			MarkRemoteTransactionCritical(connection);
+		}
+
+		placementIndex++;
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			HandleRemoteTransactionConnectionError(connection, raiseErrors);
+			continue;
+		}
+
+		RemoteTransactionBeginIfNecessary(connection);
+
+		if (!SendRemoteCommand(connection, copyCommand->data))
+		{
+			HandleRemoteTransactionConnectionError(connection, raiseErrors);
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+		if (PQresultStatus(result) != PGRES_COPY_OUT)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+
+		return connection;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ForwardCopyDataFromShardsInParallel runs COPY .. TO STDOUT on up to
+ * citus.copy_to_parallel_streams shards at a time, each over its own
+ * connection, and forwards the CopyData messages to the client in the order
+ * in which they arrive. Rows are therefore not ordered by shard. The function
+ * returns the number of rows sent.
+ */
+static int64
+ForwardCopyDataFromShardsInParallel(CopyOutState copyOutState, CopyStmt *copyStatement,
+									List *shardIntervalList)
+{
+	int64 tuplesSent = 0;
+	List *activeConnectionList = NIL;
+	ListCell *nextShardIntervalCell = list_head(shardIntervalList);
+
+	while (nextShardIntervalCell != NULL || activeConnectionList != NIL)
+	{
+		/* keep the configured number of shards streaming */
+		while (nextShardIntervalCell != NULL &&
+			   list_length(activeConnectionList) < CopyToParallelStreams)
+		{
+			ShardInterval *shardInterval = lfirst(nextShardIntervalCell);
+			StringInfo copyCommand = ConstructCopyStatement(copyStatement,
+															shardInterval->shardId);
+
+			nextShardIntervalCell = lnext(nextShardIntervalCell);
 
-			if (!SendRemoteCommand(connection, copyCommand->data))
+			MultiConnection *connection = StartCopyToOnShard(copyCommand,
+															 shardInterval->shardId);
+			if (connection != NULL)
 			{
-				HandleRemoteTransactionConnectionError(connection, raiseErrors);
-				continue;
+				/* make sure the next shard on the same node gets its own connection */
+				ClaimConnectionExclusively(connection);
+
+				activeConnectionList = lappend(activeConnectionList, connection);
 			}
+		}
+
+		List *pendingConnectionList = NIL;
+		bool madeProgress = false;
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, activeConnectionList)
+		{
+			bool copyDone = false;
+			int64 rowCount = ForwardAvailableCopyData(copyOutState, connection,
+													  &copyDone);
+
+			tuplesSent += rowCount;
 
-			PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-			if (PQresultStatus(result) != PGRES_COPY_OUT)
+			if (copyDone)
 			{
-				ReportResultError(connection, result, ERROR);
+				UnclaimConnection(connection);
+				madeProgress = true;
 			}
+			else
+			{
+				pendingConnectionList = lappend(pendingConnectionList, connection);
+				madeProgress |= (rowCount > 0);
+			}
+		}
 
-			PQclear(result);
+		list_free(activeConnectionList);
+		activeConnectionList = pendingConnectionList;
 
-			tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
-			break;
+		if (!madeProgress && activeConnectionList != NIL)
+		{
+			WaitForCopyData(activeConnectionList);
+		}
+	}
+
+	return tuplesSent;
+}
+
+
+/*
+ * ForwardAvailableCopyData forwards the CopyData messages that libpq already
+ * received over the given connection to the client without blocking. It sets
+ * copyDone once the COPY finished on the connection, and returns the number
+ * of rows sent.
+ */
+static int64
+ForwardAvailableCopyData(CopyOutState copyOutState, MultiConnection *connection,
+						 bool *copyDone)
+{
+	char *receiveBuffer = NULL;
+	const int useAsync = 1;
+	bool raiseErrors = true;
+	int64 tuplesSent = 0;
+
+	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	while (receiveLength > 0)
+	{
+		bool includeEndOfLine = false;
+
+		CopySendData(copyOutState, receiveBuffer, receiveLength);
+		CopySendEndOfRow(copyOutState, includeEndOfLine);
+		tuplesSent++;
+
+		PQfreemem(receiveBuffer);
+
+		receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	}
+
+	if (receiveLength == 0)
+	{
+		/* no complete row available yet */
+		*copyDone = false;
+		return tuplesSent;
+	}
+	else if (receiveLength != -1)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	*copyDone = true;
+
+	return tuplesSent;
+}
+
+
+/*
+ * WaitForCopyData blocks until at least one of the given connections has
+ * received data, and reads that data into the libpq buffers of the connection.
+ */
+static void
+WaitForCopyData(List *connectionList)
+{
+	int eventSetSize = list_length(connectionList) + 2;
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	bool latchSet = false;
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE, PQsocket(connection->pgConn),
+						  NULL, (void *) connection);
+	}
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	int eventCount = WaitEventSetWait(waitEventSet, -1, events, eventSetSize,
+									  WAIT_EVENT_CLIENT_READ);
+
+	/* free the set before we can error out to not leak its file descriptor */
+	FreeWaitEventSet(waitEventSet);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
 		}
 
-		if (shardIntervalCell == list_head(shardIntervalList))
+		if (event->events & WL_LATCH_SET)
 		{
-			/* remove header after the first shard */
-			RemoveOptionFromList(copyStatement->options, "header");
+			latchSet = true;
+			continue;
 		}
-	}
 
-	SendCopyEnd(copyOutState);
+		connection = (MultiConnection *) event->user_data;
 
-	heap_close(distributedRelation, AccessShareLock);
+		if (PQconsumeInput(connection->pgConn) == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
 
-	if (completionTag != NULL)
+	if (latchSet)
 	{
-		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
-					 tuplesSent);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
 	}
+
+	pfree(events);
 }
 
 
@@ -3318,7 +5242,9 @@ InitializeCopyShardState(CopyShardState *shardState,
 	shardState->shardId = shardId;
 	shardState->placementStateList = NIL;
 	shardState->copyOutState = NULL;
+	shardState->localShardInsertState = NULL;
 	shardState->containsLocalPlacement = ContainsLocalPlacement(shardId);
+	shardState->partitionRelationId = InvalidOid;
 
 
 	foreach(placementCell, activePlacementList)
@@ -3521,8 +5447,33 @@ StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 	uint64 shardId = placementState->shardState->shardId;
 	bool raiseInterrupts = true;
 	bool binaryCopy = copyOutState->binary;
+	CopyStmt placementCopyStatement = *copyStatement;
+
+	/* intermediate results have their own compression, see intermediate_results.c */
+	placementState->compressData = CompressCopyData &&
+								   !IsCopyResultStmt(copyStatement);
+	if (placementState->compressData)
+	{
+		/* tell the worker to decompress, see CopyCompressedDataFromFrontend */
+		DefElem *compressionOption =
+			makeDefElem(COPY_COMPRESSION_OPTION,
+						(Node *) makeString(COPY_COMPRESSION_METHOD), -1);
+
+		placementCopyStatement.options = lappend(list_copy(copyStatement->options),
+												 compressionOption);
+	}
+
+	/* rows routed to a partition are copied into the shard of the partition */
+	Oid partitionRelationId = placementState->shardState->partitionRelationId;
+	if (OidIsValid(partitionRelationId))
+	{
+		char *partitionName = get_rel_name(partitionRelationId);
+		char *schemaName = get_namespace_name(get_rel_namespace(partitionRelationId));
+
+		placementCopyStatement.relation = makeRangeVar(schemaName, partitionName, -1);
+	}
 
-	StringInfo copyCommand = ConstructCopyStatement(copyStatement, shardId);
+	StringInfo copyCommand = ConstructCopyStatement(&placementCopyStatement, shardId);
 
 	if (!SendRemoteCommand(connection, copyCommand->data))
 	{
@@ -3539,14 +5490,17 @@ StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 
 	if (binaryCopy)
 	{
-		SendCopyBinaryHeaders(copyOutState, shardId, list_make1(connection));
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendCopyBinaryHeaders(copyOutState);
+		SendPlacementCopyData(placementState, copyOutState->fe_msgbuf);
 	}
 }
 
 
 /*
- * EndPlacementStateCopyCommand ends the COPY for the given placement. It also
- * sends binary footers if this is a binary COPY.
+ * EndPlacementStateCopyCommand ends the COPY for the given placement, after
+ * sending the data that is still buffered for it. It also sends binary footers
+ * if this is a binary COPY.
  */
 static void
 EndPlacementStateCopyCommand(CopyPlacementState *placementState,
@@ -3556,10 +5510,18 @@ EndPlacementStateCopyCommand(CopyPlacementState *placementState,
 	uint64 shardId = placementState->shardState->shardId;
 	bool binaryCopy = copyOutState->binary;
 
+	if (placementState->data->len > 0)
+	{
+		SendPlacementCopyData(placementState, placementState->data);
+		resetStringInfo(placementState->data);
+	}
+
 	/* send footers and end copy command */
 	if (binaryCopy)
 	{
-		SendCopyBinaryFooters(copyOutState, shardId, list_make1(connection));
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendCopyBinaryFooters(copyOutState);
+		SendPlacementCopyData(placementState, copyOutState->fe_msgbuf);
 	}
 
 	EndRemoteCopy(shardId, list_make1(connection));
@@ -27,11 +27,9 @@
 
 
 /* Local functions forward declarations */
-static void SendCopyInStart(void);
 static void SendCopyOutStart(void);
 static void SendCopyDone(void);
-static void SendCopyData(StringInfo fileBuffer);
-static bool ReceiveCopyData(StringInfo copyData);
+static void SendCopyData(const char *data, int dataLength);
 
 
 /*
@@ -83,7 +81,6 @@ RedirectCopyDataToRegularFile(const char *filename)
 void
 SendRegularFile(const char *filename)
 {
-	const uint32 fileBufferSize = 32768; /* 32 KB */
 	const int fileFlags = (O_RDONLY | PG_BINARY);
 	const int fileMode = 0;
 
@@ -91,31 +88,40 @@ SendRegularFile(const char *filename)
 	File fileDesc = FileOpenForTransmit(filename, fileFlags, fileMode);
 	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
 
+#ifdef USE_POSIX_FADVISE
+
+	/* we read the whole file front to back, so let the kernel read ahead */
+	(void) posix_fadvise(FileGetRawDesc(fileDesc), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
 	/*
-	 * We read file's contents into buffers of 32 KB. This buffer size is twice
-	 * as large as Hadoop's default buffer size, and may later be configurable.
+	 * We read file's contents into large buffers and send each buffer as one
+	 * copy data message straight from the read buffer. This keeps the number
+	 * of read calls and protocol messages per file low.
 	 */
-	StringInfo fileBuffer = makeStringInfo();
-	enlargeStringInfo(fileBuffer, fileBufferSize);
+	char *fileBuffer = palloc(TRANSMIT_BUFFER_SIZE);
 
 	SendCopyOutStart();
 
-	int readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
+	int readBytes = FileReadCompat(&fileCompat, fileBuffer, TRANSMIT_BUFFER_SIZE,
 								   PG_WAIT_IO);
 	while (readBytes > 0)
 	{
-		fileBuffer->len = readBytes;
+		SendCopyData(fileBuffer, readBytes);
 
-		SendCopyData(fileBuffer);
-
-		resetStringInfo(fileBuffer);
-		readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
+		readBytes = FileReadCompat(&fileCompat, fileBuffer, TRANSMIT_BUFFER_SIZE,
 								   PG_WAIT_IO);
 	}
 
+	if (readBytes < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", filename)));
+	}
+
 	SendCopyDone();
 
-	FreeStringInfo(fileBuffer);
+	pfree(fileBuffer);
 	FileClose(fileDesc);
 }
 
@@ -166,7 +172,7 @@ FileOpenForTransmit(const char *filename, int fileFlags, int fileMode)
  * SendCopyInStart sends the start copy in message to initiate receiving data
  * from stdin. The frontend should now send copy data.
  */
-static void
+void
 SendCopyInStart(void)
 {
 	StringInfoData copyInStart = { NULL, 0, 0, 0 };
@@ -221,15 +227,19 @@ SendCopyDone(void)
 }
 
 
-/* Sends the copy data message to stdout. */
+/*
+ * Sends the copy data message to stdout. We hand the data directly to the
+ * protocol layer, rather than first copying it into a message buffer.
+ */
 static void
-SendCopyData(StringInfo fileBuffer)
+SendCopyData(const char *data, int dataLength)
 {
-	StringInfoData copyData = { NULL, 0, 0, 0 };
-
-	pq_beginmessage(&copyData, 'd');
-	pq_sendbytes(&copyData, fileBuffer->data, fileBuffer->len);
-	pq_endmessage(&copyData);
+	int sent = pq_putmessage('d', data, dataLength);
+	if (sent != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not send copy data")));
+	}
 }
 
 
@@ -241,7 +251,7 @@ SendCopyData(StringInfo fileBuffer)
  * If the received message does not conform to the copy protocol, the function
  * mirrors copy.c's error behavior.
  */
-static bool
+bool
 ReceiveCopyData(StringInfo copyData)
 {
 	bool copyDone = true;
@@ -67,6 +67,7 @@
 
 bool EnableDDLPropagation = true; /* ddl propagation is enabled */
 PropSetCmdBehavior PropagateSetCommands = PROPSETCMD_NONE; /* SET prop off */
+int ShardDDLBatchSize = 1; /* shard DDL commands sent in one task */
 static bool shouldInvalidateForeignKeyGraph = false;
 static int activeAlterTables = 0;
 static int activeDropSchemaOrDBs = 0;
@@ -682,6 +683,12 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 	}
 
 	bool localExecutionSupported = true;
+	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+
+	if (ddlJob->targetPoolSize > 0)
+	{
+		targetPoolSize = ddlJob->targetPoolSize;
+	}
 
 	if (!ddlJob->concurrentIndexCmd)
 	{
@@ -703,7 +710,8 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 			SendCommandToWorkersWithMetadata((char *) ddlJob->commandString);
 		}
 
-		ExecuteUtilityTaskList(ddlJob->taskList, localExecutionSupported);
+		ExecuteUtilityTaskListExtended(ddlJob->taskList, targetPoolSize,
+									   localExecutionSupported);
 	}
 	else
 	{
@@ -714,7 +722,8 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 
 		PG_TRY();
 		{
-			ExecuteUtilityTaskList(ddlJob->taskList, localExecutionSupported);
+			ExecuteUtilityTaskListExtended(ddlJob->taskList, targetPoolSize,
+										   localExecutionSupported);
 
 			if (shouldSyncMetadata)
 			{
@@ -849,6 +858,12 @@ InvalidateForeignKeyGraphForDDL(void)
 /*
  * DDLTaskList builds a list of tasks to execute a DDL command on a
  * given list of shards.
+ *
+ * When citus.shard_ddl_batch_size is larger than 1, the commands for shards
+ * whose placements live on the same set of nodes are grouped into tasks of
+ * up to that many shards. Each such task sends its commands as a single
+ * multi-statement query, which saves a round trip per shard for cheap DDL
+ * commands on tables with many shards.
  */
 List *
 DDLTaskList(Oid relationId, const char *commandString)
@@ -862,6 +877,10 @@ DDLTaskList(Oid relationId, const char *commandString)
 	uint64 jobId = INVALID_JOB_ID;
 	int taskId = 1;
 
+	/* tasks that still accept shards, along with the nodes of their placements */
+	List *openTaskList = NIL;
+	List *openTaskKeyList = NIL;
+
 	/* lock metadata before getting placement lists */
 	LockShardListMetadata(shardIntervalList, ShareLock);
 
@@ -870,6 +889,7 @@ DDLTaskList(Oid relationId, const char *commandString)
 	{
 		uint64 shardId = shardInterval->shardId;
 		StringInfo applyCommand = makeStringInfo();
+		List *placementList = ActiveShardPlacementList(shardId);
 
 		/*
 		 * If rightRelationId is not InvalidOid, instead of worker_apply_shard_ddl_command
@@ -878,6 +898,63 @@ DDLTaskList(Oid relationId, const char *commandString)
 		appendStringInfo(applyCommand, WORKER_APPLY_SHARD_DDL_COMMAND, shardId,
 						 escapedSchemaName, escapedCommandString);
 
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = relationId;
+		relationShard->shardId = shardId;
+
+		if (ShardDDLBatchSize > 1)
+		{
+			char *placementListKey = ShardPlacementListKey(placementList);
+			ListCell *openTaskCell = NULL;
+			ListCell *openTaskKeyCell = NULL;
+			Task *openTask = NULL;
+
+			forboth(openTaskCell, openTaskList, openTaskKeyCell, openTaskKeyList)
+			{
+				if (strcmp((char *) lfirst(openTaskKeyCell), placementListKey) == 0)
+				{
+					openTask = (Task *) lfirst(openTaskCell);
+					break;
+				}
+			}
+
+			if (openTask != NULL)
+			{
+				List *queryStringList = openTask->taskQuery.data.queryStringList;
+
+				SetTaskQueryStringList(openTask, lappend(queryStringList,
+														 applyCommand->data));
+				openTask->relationShardList =
+					lappend(openTask->relationShardList, relationShard);
+
+				if (list_length(openTask->relationShardList) >= ShardDDLBatchSize)
+				{
+					openTaskList = list_delete_ptr(openTaskList, openTask);
+					openTaskKeyList = list_delete_ptr(openTaskKeyList,
+													  lfirst(openTaskKeyCell));
+				}
+
+				continue;
+			}
+
+			Task *task = CitusMakeNode(Task);
+			task->jobId = jobId;
+			task->taskId = taskId++;
+			task->taskType = DDL_TASK;
+			SetTaskQueryStringList(task, list_make1(applyCommand->data));
+			task->replicationModel = REPLICATION_MODEL_INVALID;
+			task->dependentTaskList = NULL;
+			task->anchorShardId = shardId;
+			task->relationShardList = list_make1(relationShard);
+			task->taskPlacementList = placementList;
+
+			taskList = lappend(taskList, task);
+			openTaskList = lappend(openTaskList, task);
+			openTaskKeyList = lappend(openTaskKeyList, placementListKey);
+
+			continue;
+		}
+
 		Task *task = CitusMakeNode(Task);
 		task->jobId = jobId;
 		task->taskId = taskId++;
@@ -886,7 +963,7 @@ DDLTaskList(Oid relationId, const char *commandString)
 		task->replicationModel = REPLICATION_MODEL_INVALID;
 		task->dependentTaskList = NULL;
 		task->anchorShardId = shardId;
-		task->taskPlacementList = ActiveShardPlacementList(shardId);
+		task->taskPlacementList = placementList;
 
 		taskList = lappend(taskList, task);
 	}
@@ -895,6 +972,27 @@ DDLTaskList(Oid relationId, const char *commandString)
 }
 
 
+/*
+ * ShardPlacementListKey returns a string that identifies the set of nodes
+ * the given placements are on, regardless of the order of the list.
+ */
+char *
+ShardPlacementListKey(List *placementList)
+{
+	StringInfo placementListKey = makeStringInfo();
+	List *sortedPlacementList = SortList(placementList, CompareShardPlacementsByWorker);
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, sortedPlacementList)
+	{
+		appendStringInfo(placementListKey, "%s:%d,", placement->nodeName,
+						 placement->nodePort);
+	}
+
+	return placementListKey->data;
+}
+
+
 /*
  * NodeDDLTaskList builds a list of tasks to execute a DDL command on a
  * given target set of nodes.
@@ -15,20 +15,33 @@
 #if PG_VERSION_NUM >= PG_VERSION_12
 #include "commands/defrem.h"
 #endif
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
 #include "commands/vacuum.h"
 #include "distributed/adaptive_executor.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/listutils.h"
+#include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
 #include "distributed/resource_lock.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
+#include "executor/tuptable.h"
 #include "storage/lmgr.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/tuplestore.h"
+
+
+/* config variable(s) managed via guc.c */
+int MaxVacuumPoolSize = 0;
+bool VacuumShardsByDeadTuples = false;
+bool UpdateShardStatisticsOnAnalyze = false;
 
 /*
  * Subset of VacuumParams we care about
@@ -43,6 +56,30 @@ typedef struct CitusVacuumParams
 } CitusVacuumParams;
 
 
+/* names of the shards of a table that have a placement on a node */
+typedef struct NodeShardNames
+{
+	ShardPlacement *placement;
+	StringInfo shardNameArray;
+} NodeShardNames;
+
+
+/* number of dead or modified tuples of a shard, keyed by shard ID */
+typedef struct ShardTupleCount
+{
+	uint64 shardId;
+	int64 tupleCount;
+} ShardTupleCount;
+
+
+/* vacuum task along with the tuple count it is ordered by */
+typedef struct OrderedVacuumTask
+{
+	Task *task;
+	int64 tupleCount;
+} OrderedVacuumTask;
+
+
 /* Local functions forward declarations for processing distributed table commands */
 static bool IsDistributedVacuumStmt(int vacuumOptions, List *vacuumRelationIdList);
 static List * VacuumTaskList(Oid relationId, CitusVacuumParams vacuumParams,
@@ -52,6 +89,12 @@ static char * DeparseVacuumColumnNames(List *columnNameList);
 static List * VacuumColumnList(VacuumStmt *vacuumStmt, int relationIndex);
 static List * ExtractVacuumTargetRels(VacuumStmt *vacuumStmt);
 static CitusVacuumParams VacuumStmtParams(VacuumStmt *vacstmt);
+static List * OrderVacuumTaskListByTupleCount(List *taskList, Oid relationId,
+											  bool analyzeOnly);
+static HTAB * ShardTupleCounts(Oid relationId, List *shardIntervalList,
+							   bool analyzeOnly);
+static int CompareOrderedVacuumTasks(const void *leftElement, const void *rightElement);
+static void UpdateTableShardStatistics(Oid relationId);
 
 /*
  * PostprocessVacuumStmt processes vacuum statements that may need propagation to
@@ -111,9 +154,28 @@ PostprocessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand)
 			List *vacuumColumnList = VacuumColumnList(vacuumStmt, relationIndex);
 			List *taskList = VacuumTaskList(relationId, vacuumParams, vacuumColumnList);
 
+			if (VacuumShardsByDeadTuples)
+			{
+				bool analyzeOnly = (vacuumParams.options & VACOPT_VACUUM) == 0;
+
+				taskList = OrderVacuumTaskListByTupleCount(taskList, relationId,
+														   analyzeOnly);
+			}
+
+			int targetPoolSize = MaxVacuumPoolSize > 0 ? MaxVacuumPoolSize :
+								 MaxAdaptiveExecutorPoolSize;
+
 			/* local execution is not implemented for VACUUM commands */
 			bool localExecutionSupported = false;
-			ExecuteUtilityTaskList(taskList, localExecutionSupported);
+			ExecuteUtilityTaskListExtended(taskList, targetPoolSize,
+										   localExecutionSupported);
+
+			if (UpdateShardStatisticsOnAnalyze &&
+				(vacuumParams.options & VACOPT_ANALYZE) != 0)
+			{
+				UpdateTableShardStatistics(relationId);
+			}
+
 			executedVacuumCount++;
 		}
 		relationIndex++;
@@ -247,6 +309,248 @@ VacuumTaskList(Oid relationId, CitusVacuumParams vacuumParams, List *vacuumColum
 }
 
 
+/*
+ * OrderVacuumTaskListByTupleCount sorts the given vacuum tasks of a distributed
+ * table such that the shards with the most dead tuples, or with the most
+ * modified tuples for ANALYZE, are processed first. Since the executor hands
+ * out the tasks of a node in list order, the most bloated shards are vacuumed
+ * first when the number of connections per node is limited.
+ */
+static List *
+OrderVacuumTaskListByTupleCount(List *taskList, Oid relationId, bool analyzeOnly)
+{
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	HTAB *shardTupleCounts = ShardTupleCounts(relationId, shardIntervalList,
+											  analyzeOnly);
+	List *orderedTaskList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		bool found = false;
+		OrderedVacuumTask *orderedTask = palloc0(sizeof(OrderedVacuumTask));
+		orderedTask->task = task;
+
+		ShardTupleCount *shardTupleCount = hash_search(shardTupleCounts,
+													   &task->anchorShardId,
+													   HASH_FIND, &found);
+		if (found)
+		{
+			orderedTask->tupleCount = shardTupleCount->tupleCount;
+		}
+
+		orderedTaskList = lappend(orderedTaskList, orderedTask);
+	}
+
+	orderedTaskList = SortList(orderedTaskList, CompareOrderedVacuumTasks);
+
+	List *sortedTaskList = NIL;
+	OrderedVacuumTask *orderedTask = NULL;
+	foreach_ptr(orderedTask, orderedTaskList)
+	{
+		sortedTaskList = lappend(sortedTaskList, orderedTask->task);
+	}
+
+	return sortedTaskList;
+}
+
+
+/*
+ * ShardTupleCounts fetches the number of dead tuples, or the number of tuples
+ * modified since the last analyze, of the given shards from the statistics
+ * collector of the nodes that have their placements, through one query per
+ * node. It returns a hash of ShardTupleCount with the largest count among the
+ * placements of each shard.
+ */
+static HTAB *
+ShardTupleCounts(Oid relationId, List *shardIntervalList, bool analyzeOnly)
+{
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *relationName = get_rel_name(relationId);
+	const char *countColumnName = analyzeOnly ? "n_mod_since_analyze" : "n_dead_tup";
+	List *nodeShardNamesList = NIL;
+	List *taskList = NIL;
+	int taskId = 1;
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(ShardTupleCount);
+	info.hcxt = CurrentMemoryContext;
+	HTAB *shardTupleCounts = hash_create("Shard Tuple Counts", 32, &info,
+										 HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+	/* group the shard names by the nodes that have a placement */
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		char *shardRelationName = pstrdup(relationName);
+		AppendShardIdToName(&shardRelationName, shardInterval->shardId);
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, ActiveShardPlacementList(shardInterval->shardId))
+		{
+			NodeShardNames *nodeShardNames = NULL;
+			NodeShardNames *currentShardNames = NULL;
+			foreach_ptr(currentShardNames, nodeShardNamesList)
+			{
+				if (currentShardNames->placement->nodeId == placement->nodeId)
+				{
+					nodeShardNames = currentShardNames;
+					break;
+				}
+			}
+
+			if (nodeShardNames == NULL)
+			{
+				nodeShardNames = palloc0(sizeof(NodeShardNames));
+				nodeShardNames->placement = placement;
+				nodeShardNames->shardNameArray = makeStringInfo();
+
+				nodeShardNamesList = lappend(nodeShardNamesList, nodeShardNames);
+			}
+			else
+			{
+				appendStringInfoString(nodeShardNames->shardNameArray, ",");
+			}
+
+			appendStringInfoString(nodeShardNames->shardNameArray,
+								   quote_literal_cstr(shardRelationName));
+		}
+	}
+
+	NodeShardNames *nodeShardNames = NULL;
+	foreach_ptr(nodeShardNames, nodeShardNamesList)
+	{
+		StringInfo queryString = makeStringInfo();
+		appendStringInfo(queryString,
+						 "SELECT relname::text, %s FROM pg_catalog.pg_stat_user_tables "
+						 "WHERE schemaname OPERATOR(pg_catalog.=) %s "
+						 "AND relname::text OPERATOR(pg_catalog.=) ANY (ARRAY[%s]::text[])",
+						 countColumnName, quote_literal_cstr(schemaName),
+						 nodeShardNames->shardNameArray->data);
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = INVALID_JOB_ID;
+		task->taskId = taskId++;
+		task->taskType = SELECT_TASK;
+		SetTaskQueryString(task, queryString->data);
+		task->anchorShardId = nodeShardNames->placement->shardId;
+		task->taskPlacementList = list_make1(nodeShardNames->placement);
+
+		taskList = lappend(taskList, task);
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "shard_name", TEXTOID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "tuple_count", INT8OID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	/*
+	 * VACUUM cannot run in a transaction block, so make sure that we do not
+	 * leave behind connections that are in one.
+	 */
+	bool localExecutionSupported = false;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		ROW_MODIFY_READONLY, taskList, MaxAdaptiveExecutorPoolSize,
+		localExecutionSupported);
+	executionParams->tupleDescriptor = tupleDescriptor;
+	executionParams->tupleStore = tupleStore;
+	executionParams->hasReturning = true;
+	executionParams->xactProperties.errorOnAnyFailure = true;
+	executionParams->xactProperties.useRemoteTransactionBlocks =
+		TRANSACTION_BLOCKS_DISALLOWED;
+	executionParams->xactProperties.requires2PC = false;
+
+	ExecuteTaskListExtended(executionParams);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		char *shardRelationName = TextDatumGetCString(slot_getattr(slot, 1, &isNull));
+		Datum tupleCountDatum = slot_getattr(slot, 2, &isNull);
+		int64 tupleCount = isNull ? 0 : DatumGetInt64(tupleCountDatum);
+		bool found = false;
+
+		/* the shard ID is the suffix that AppendShardIdToName added */
+		char *shardIdString = strrchr(shardRelationName, SHARD_NAME_SEPARATOR);
+		if (shardIdString == NULL)
+		{
+			ExecClearTuple(slot);
+			continue;
+		}
+
+		uint64 shardId = pg_strtouint64(shardIdString + 1, NULL, 10);
+
+		ShardTupleCount *shardTupleCount = hash_search(shardTupleCounts, &shardId,
+													   HASH_ENTER, &found);
+		if (!found || tupleCount > shardTupleCount->tupleCount)
+		{
+			shardTupleCount->tupleCount = tupleCount;
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return shardTupleCounts;
+}
+
+
+/*
+ * CompareOrderedVacuumTasks orders vacuum tasks by descending tuple count,
+ * and by task ID to keep the order of shards with equal counts.
+ */
+static int
+CompareOrderedVacuumTasks(const void *leftElement, const void *rightElement)
+{
+	OrderedVacuumTask *leftTask = *((OrderedVacuumTask **) leftElement);
+	OrderedVacuumTask *rightTask = *((OrderedVacuumTask **) rightElement);
+
+	if (leftTask->tupleCount != rightTask->tupleCount)
+	{
+		return (leftTask->tupleCount > rightTask->tupleCount) ? -1 : 1;
+	}
+
+	return (leftTask->task->taskId < rightTask->task->taskId) ? -1 :
+		   (leftTask->task->taskId > rightTask->task->taskId) ? 1 : 0;
+}
+
+
+/*
+ * UpdateTableShardStatistics refreshes the shard sizes in pg_dist_placement of
+ * the given distributed table after it has been analyzed, such that planning
+ * decisions that are based on the table size, such as the cost-based join
+ * order, see the current sizes. Reference tables are skipped, since their size
+ * does not affect planning.
+ */
+static void
+UpdateTableShardStatistics(Oid relationId)
+{
+	if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+	{
+		return;
+	}
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		UpdateShardStatistics(shardInterval->shardId);
+	}
+}
+
+
 /*
  * DeparseVacuumStmtPrefix returns a StringInfo appropriate for use as a prefix
  * during distributed execution of a VACUUM or ANALYZE statement. Callers may
@@ -24,6 +24,7 @@
 #include "lib/ilist.h"
 #include "utils/varlena.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
 
 
 static bool IsSettingSafeToPropagate(char *name);
@@ -144,7 +145,17 @@ PostprocessVariableSetStmt(VariableSetStmt *setStmt, const char *setStmtString)
 			continue;
 		}
 
-		if (!SendRemoteCommand(connection, setStmtString))
+		/* the SET has to happen within savepoints that were not sent yet */
+		int savepointCount = 0;
+		char *savepointCommand = RemoteTransactionSavepointCommand(connection,
+																   &savepointCount);
+		const char *commandString = setStmtString;
+		if (savepointCommand != NULL)
+		{
+			commandString = psprintf("%s%s", savepointCommand, setStmtString);
+		}
+
+		if (!SendRemoteCommand(connection, commandString))
 		{
 			const bool raiseErrors = true;
 			HandleRemoteTransactionConnectionError(connection, raiseErrors);
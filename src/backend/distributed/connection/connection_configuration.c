@@ -10,6 +10,7 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
 #include "distributed/metadata_cache.h"
@@ -18,10 +19,14 @@
 #include "postmaster/postmaster.h"
 #include "mb/pg_wchar.h"
 #include "utils/builtins.h"
+#include "utils/varlena.h"
 
 /* stores the string representation of our node connection GUC */
 char *NodeConninfo = "";
 
+/* whether to connect to the local node over a Unix-domain socket */
+bool UseUnixSocketForLocalNode = false;
+
 /* represents a list of libpq parameter settings */
 typedef struct ConnParamsInfo
 {
@@ -40,6 +45,8 @@ static ConnParamsInfo ConnParams;
 /* helper functions for processing connection info */
 static Size CalculateMaxSize(void);
 static int uri_prefix_length(const char *connstr);
+static bool ConnectionKeyTargetsLocalNode(ConnectionHashKey *key);
+static char * LocalUnixSocketDirectory(void);
 
 /*
  * InitConnParms initializes the ConnParams field to point to enough memory to
@@ -295,6 +302,21 @@ GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 
 	pg_ltoa(key->port, nodePortString); /* populate node port string with port */
 
+	/*
+	 * Connections to the local node do not need to go through the TCP stack
+	 * and TLS, point libpq to our own Unix-domain socket instead. libpq does
+	 * not use SSL over Unix-domain sockets, regardless of sslmode.
+	 */
+	if (UseUnixSocketForLocalNode && ConnectionKeyTargetsLocalNode(key))
+	{
+		char *socketDirectory = LocalUnixSocketDirectory();
+		if (socketDirectory != NULL)
+		{
+			runtimeValues[0] = socketDirectory;
+			pg_ltoa(PostPortNumber, nodePortString);
+		}
+	}
+
 	/* first step: copy global parameters to beginning of array */
 	for (Size paramIndex = 0; paramIndex < ConnParams.size; paramIndex++)
 	{
@@ -320,6 +342,67 @@ GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 }
 
 
+/*
+ * ConnectionKeyTargetsLocalNode returns true if the hostname and port of the
+ * given connection key belong to a node in the local group. The result ends
+ * up in ConnParamsHash, which is invalidated whenever the metadata changes.
+ */
+static bool
+ConnectionKeyTargetsLocalNode(ConnectionHashKey *key)
+{
+	if (key->port != PostPortNumber)
+	{
+		/* cheap check first, the local node always listens on our own port */
+		return false;
+	}
+
+	if (!IsTransactionState() || !CitusHasBeenLoaded())
+	{
+		/* metadata is not accessible */
+		return false;
+	}
+
+	WorkerNode *workerNode = FindWorkerNode(key->hostname, key->port);
+	if (workerNode == NULL)
+	{
+		return false;
+	}
+
+	return workerNode->groupId == GetLocalGroupId();
+}
+
+
+/*
+ * LocalUnixSocketDirectory returns the first directory listed in
+ * unix_socket_directories, or NULL if the server does not listen on a
+ * Unix-domain socket.
+ */
+static char *
+LocalUnixSocketDirectory(void)
+{
+#ifdef HAVE_UNIX_SOCKETS
+	List *directoryList = NIL;
+
+	if (Unix_socket_directories == NULL)
+	{
+		return NULL;
+	}
+
+	/* SplitDirectoriesString modifies its input, so give it a copy */
+	char *rawDirectories = pstrdup(Unix_socket_directories);
+	if (!SplitDirectoriesString(rawDirectories, ',', &directoryList) ||
+		directoryList == NIL)
+	{
+		return NULL;
+	}
+
+	return (char *) linitial(directoryList);
+#else
+	return NULL;
+#endif
+}
+
+
 /*
  * GetConnParam finds the keyword in the configured connection parameters and returns its
  * value.
@@ -19,6 +19,7 @@
 
 #include "access/hash.h"
 #include "commands/dbcommands.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/errormessage.h"
 #include "distributed/error_codes.h"
@@ -27,6 +28,7 @@
 #include "distributed/memutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/node_stats.h"
 #include "distributed/placement_connection.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/shared_connection_stats.h"
@@ -34,6 +36,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_log_messages.h"
+#include "distributed/worker_manager.h"
 #include "mb/pg_wchar.h"
 #include "portability/instr_time.h"
 #include "storage/ipc.h"
@@ -43,6 +46,10 @@
 
 int NodeConnectionTimeout = 30000;
 int MaxCachedConnectionsPerWorker = 1;
+int WarmConnectionsPerWorker = 0;
+
+/* whether WarmUpWorkerConnections() already ran in this session */
+static bool WorkerConnectionsWarmedUp = false;
 
 HTAB *ConnectionHash = NULL;
 HTAB *ConnParamsHash = NULL;
@@ -171,6 +178,84 @@ AfterXactConnectionHandling(bool isCommit)
 }
 
 
+/*
+ * GetMaxCachedConnectionsPerWorker returns the number of connections per
+ * worker that are kept open at the end of a transaction, which is the larger
+ * of citus.max_cached_conns_per_worker and citus.warm_connections_per_worker.
+ */
+int
+GetMaxCachedConnectionsPerWorker(void)
+{
+	return Max(MaxCachedConnectionsPerWorker, WarmConnectionsPerWorker);
+}
+
+
+/*
+ * WarmUpWorkerConnections opens citus.warm_connections_per_worker connections
+ * to each active primary worker the first time it is called in a session.
+ * The connections to all workers are established in parallel, and are kept
+ * open across transactions, such that subsequent queries in the session do
+ * not pay for connection establishment.
+ *
+ * The connections are optional in terms of citus.max_shared_pool_size, we
+ * rather skip warming up than wait for other backends to release slots.
+ * Workers added after the warm-up are not warmed up.
+ */
+void
+WarmUpWorkerConnections(void)
+{
+	List *connectionList = NIL;
+
+	if (WarmConnectionsPerWorker == 0 || WorkerConnectionsWarmedUp)
+	{
+		return;
+	}
+
+	WorkerConnectionsWarmedUp = true;
+
+	/* internal backends do not cache connections, so don't warm them up */
+	if (application_name != NULL && strcmp(application_name, CITUS_APPLICATION_NAME) == 0)
+	{
+		return;
+	}
+
+	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		for (int connectionIndex = 0; connectionIndex < WarmConnectionsPerWorker;
+			 connectionIndex++)
+		{
+			/* reuses already cached connections, if any */
+			MultiConnection *connection =
+				StartNodeUserDatabaseConnection(OPTIONAL_CONNECTION,
+												workerNode->workerName,
+												workerNode->workerPort,
+												NULL, NULL);
+			if (connection == NULL)
+			{
+				/* no connection slots left on this worker */
+				break;
+			}
+
+			/* make sure the next call returns a different connection */
+			ClaimConnectionExclusively(connection);
+
+			connectionList = lappend(connectionList, connection);
+		}
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		UnclaimConnection(connection);
+	}
+}
+
+
 /*
  * GetNodeConnection() establishes a connection to remote node, using default
  * user and database.
@@ -354,9 +439,12 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 	/* these two flags are by nature cannot happen at the same time */
 	Assert(!((flags & WAIT_FOR_CONNECTION) && (flags & OPTIONAL_CONNECTION)));
 
+	WorkloadClass workloadClass = ConnectionWorkloadClass(flags);
+	connection->workloadClass = workloadClass;
+
 	if (flags & WAIT_FOR_CONNECTION)
 	{
-		WaitLoopForSharedConnection(hostname, port);
+		WaitLoopForSharedConnection(hostname, port, workloadClass);
 	}
 	else if (flags & OPTIONAL_CONNECTION)
 	{
@@ -366,7 +454,7 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 		 * cannot reserve the right to establish a connection, we prefer to
 		 * error out.
 		 */
-		if (!TryToIncrementSharedConnectionCounter(hostname, port))
+		if (!TryToIncrementSharedConnectionCounter(hostname, port, workloadClass))
 		{
 			/* do not track the connection anymore */
 			dlist_delete(&connection->connectionNode);
@@ -386,7 +474,7 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 		 *
 		 * Still, we keep track of the connnection counter.
 		 */
-		IncrementSharedConnectionCounter(hostname, port);
+		IncrementSharedConnectionCounter(hostname, port, workloadClass);
 	}
 
 
@@ -548,6 +636,7 @@ CloseConnection(MultiConnection *connection)
 		/* same for transaction state and shard/placement machinery */
 		CloseRemoteTransaction(connection);
 		CloseShardPlacementAssociation(connection);
+		FreeWorkerPreparedStatements(connection);
 
 		/* we leave the per-host entry alive */
 		pfree(connection);
@@ -631,12 +720,14 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 
 	if (status == CONNECTION_OK)
 	{
+		MarkConnectionEstablished(connection);
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
 		return true;
 	}
 	else if (status == CONNECTION_BAD)
 	{
 		/* FIXME: retries? */
+		RecordNodeConnectionFailure(connection->hostname, connection->port);
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
 		return true;
 	}
@@ -652,11 +743,13 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 	 */
 	if (connectionState->pollmode == PGRES_POLLING_FAILED)
 	{
+		RecordNodeConnectionFailure(connection->hostname, connection->port);
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
 		return true;
 	}
 	else if (connectionState->pollmode == PGRES_POLLING_OK)
 	{
+		MarkConnectionEstablished(connection);
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
 		return true;
 	}
@@ -670,6 +763,42 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 }
 
 
+/*
+ * MarkConnectionEstablished records the time it took to establish the given
+ * connection, including the TLS handshake if any, in the shared connection
+ * statistics and the node statistics of its node and marks the node as
+ * healthy. It is a no-op for connections that were already recorded, such
+ * that callers can invoke it whenever they observe that the connection is
+ * ready.
+ */
+void
+MarkConnectionEstablished(MultiConnection *connection)
+{
+	if (connection->connectionEstablishmentRecorded)
+	{
+		return;
+	}
+
+	long connectionSeconds = 0;
+	int connectionMicroseconds = 0;
+
+	TimestampDifference(connection->connectionStart, GetCurrentTimestamp(),
+						&connectionSeconds, &connectionMicroseconds);
+
+	double establishmentTime =
+		connectionSeconds * 1000.0 + connectionMicroseconds / 1000.0;
+	bool usesSSL = PQsslInUse(connection->pgConn) != 0;
+
+	RecordSharedConnectionEstablishment(connection->hostname, connection->port,
+										establishmentTime, usesSSL);
+	RecordNodeConnectionSuccess(connection->hostname, connection->port);
+	RecordNodeConnectionAttempt(connection->hostname, connection->port,
+								establishmentTime, true);
+
+	connection->connectionEstablishmentRecorded = true;
+}
+
+
 /*
  * EventSetSizeForConnectionList calculates the space needed for a WaitEventSet based on a
  * list of connections.
@@ -839,7 +968,7 @@ FinishConnectionListEstablishment(List *multiConnectionList)
 		}
 
 		int eventCount = WaitEventSetWait(waitEventSet, timeout, events, waitCount,
-										  WAIT_EVENT_CLIENT_READ);
+										  WAIT_EVENT_CITUS_CONNECTION_ESTABLISHMENT);
 
 		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
 		{
@@ -975,6 +1104,9 @@ CloseNotReadyMultiConnectionStates(List *connectionStates)
 			continue;
 		}
 
+		/* the connection timed out, which counts as a failed attempt */
+		RecordNodeConnectionFailure(connection->hostname, connection->port);
+
 		/* close connection, otherwise we take up resource on the other side */
 		CitusPQFinish(connection);
 	}
@@ -997,7 +1129,8 @@ CitusPQFinish(MultiConnection *connection)
 	/* behave idempotently, there is no gurantee that CitusPQFinish() is called once */
 	if (connection->initilizationState >= POOL_STATE_COUNTER_INCREMENTED)
 	{
-		DecrementSharedConnectionCounter(connection->hostname, connection->port);
+		DecrementSharedConnectionCounter(connection->hostname, connection->port,
+										 (WorkloadClass) connection->workloadClass);
 		connection->initilizationState = POOL_STATE_NOT_INITIALIZED;
 	}
 }
@@ -1215,6 +1348,7 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 			/* unlink from list */
 			dlist_delete(iter.cur);
 
+			FreeWorkerPreparedStatements(connection);
 			pfree(connection);
 		}
 		else
@@ -1233,7 +1367,7 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 /*
  * ShouldShutdownConnection returns true if either one of the followings is true:
  * - The connection is citus initiated.
- * - Current cached connections is already at MaxCachedConnectionsPerWorker
+ * - Current cached connections is already at GetMaxCachedConnectionsPerWorker()
  * - Connection is forced to close at the end of transaction
  * - Connection is not in OK state
  * - A transaction is still in progress (usually because we are cancelling a distributed transaction)
@@ -1256,7 +1390,7 @@ ShouldShutdownConnection(MultiConnection *connection, const int cachedConnection
 
 	return isCitusInitiatedBackend ||
 		   connection->initilizationState != POOL_STATE_INITIALIZED ||
-		   cachedConnectionCount >= MaxCachedConnectionsPerWorker ||
+		   cachedConnectionCount >= GetMaxCachedConnectionsPerWorker() ||
 		   connection->forceCloseAtTransactionEnd ||
 		   PQstatus(connection->pgConn) != CONNECTION_OK ||
 		   !RemoteTransactionIdle(connection);
@@ -0,0 +1,608 @@
+/*-------------------------------------------------------------------------
+ *
+ * node_stats.c
+ *   Keeps cumulative statistics of the remote work this node does per
+ *   worker node, for capacity planning: histograms of task and connection
+ *   establishment latencies, the number of tasks, failures and retries, and
+ *   the bytes sent to and received from the node.
+ *
+ * Unlike the statistics in shared_connection_stats.c, which go away once
+ * there are no connections to a node, the entries in the shared hash are
+ * never removed, and citus_node_stats_reset() only zeroes the counters.
+ * Backends therefore keep a local cache of pointers to the entries, and all
+ * counters are updated with atomic operations, such that recording does not
+ * take any locks once a backend knows the entry of a node.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "catalog/pg_type.h"
+#include "distributed/connection_management.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/node_stats.h"
+#include "distributed/tuplestore.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+#define NODE_STATS_COLUMNS 14
+
+/* latencies above the last bound end up in the last bucket */
+#define NODE_STATS_LATENCY_BOUND_COUNT 16
+#define NODE_STATS_LATENCY_BUCKET_COUNT (NODE_STATS_LATENCY_BOUND_COUNT + 1)
+
+
+/* upper bounds of the latency histogram buckets, in milliseconds */
+static const double NodeStatsLatencyBounds[NODE_STATS_LATENCY_BOUND_COUNT] = {
+	0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000
+};
+
+
+/*
+ * The data structure used to store data in shared memory. The lock only
+ * protects the hash itself, the statistics are updated atomically.
+ */
+typedef struct NodeStatsSharedData
+{
+	int nodeStatsHashTrancheId;
+	char *nodeStatsHashTrancheName;
+
+	LWLock nodeStatsHashLock;
+} NodeStatsSharedData;
+
+typedef struct NodeStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} NodeStatsHashKey;
+
+/* hash entry for the statistics of a single node */
+struct NodeStatsHashEntry
+{
+	NodeStatsHashKey key;
+
+	/* tasks that finished on the node, and their total time in microseconds */
+	pg_atomic_uint64 taskCount;
+	pg_atomic_uint64 taskTime;
+	pg_atomic_uint64 taskLatencyHistogram[NODE_STATS_LATENCY_BUCKET_COUNT];
+
+	/* tasks that failed on the node, and those retried on another placement */
+	pg_atomic_uint64 taskFailureCount;
+	pg_atomic_uint64 taskRetryCount;
+
+	/* connections established to the node, in the same way as tasks */
+	pg_atomic_uint64 connectionCount;
+	pg_atomic_uint64 connectionTime;
+	pg_atomic_uint64 connectionLatencyHistogram[NODE_STATS_LATENCY_BUCKET_COUNT];
+	pg_atomic_uint64 connectionFailureCount;
+
+	/* size of the commands sent to and of the rows received from the node */
+	pg_atomic_uint64 bytesSent;
+	pg_atomic_uint64 bytesReceived;
+};
+
+/* backend-local hash entry that points to the shared entry of a node */
+typedef struct NodeStatsCacheEntry
+{
+	NodeStatsHashKey key;
+	NodeStatsHashEntry *nodeStats;
+} NodeStatsCacheEntry;
+
+
+/* GUC, maximum number of nodes tracked in shared memory */
+int NodeStatsMax = 1000;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *NodeStatsHash = NULL;
+static NodeStatsSharedData *NodeStatsSharedState = NULL;
+
+/* backend-local cache of the entries in NodeStatsHash */
+static HTAB *NodeStatsCache = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void StoreNodeStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
+static Datum LatencyHistogramDatum(pg_atomic_uint64 *histogram);
+static Datum LatencyBoundsDatum(void);
+static void RecordLatency(pg_atomic_uint64 *histogram, pg_atomic_uint64 *totalTime,
+						  double latency);
+static void ResetNodeStatsEntry(NodeStatsHashEntry *nodeStats);
+static void NodeStatsHashKeyFor(const char *hostname, int port, NodeStatsHashKey *key);
+static void NodeStatsShmemInit(void);
+static size_t NodeStatsShmemSize(void);
+
+
+PG_FUNCTION_INFO_V1(citus_node_stats);
+PG_FUNCTION_INFO_V1(citus_node_stats_reset);
+
+
+/*
+ * citus_node_stats returns the cumulative statistics of the remote work done
+ * by this node, per node.
+ */
+Datum
+citus_node_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreNodeStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_node_stats_reset zeroes the statistics of all nodes.
+ */
+Datum
+citus_node_stats_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	NodeStatsHashEntry *nodeStats = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (NodeStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	/* entries are not removed, such that backends can keep pointing to them */
+	LWLockAcquire(&NodeStatsSharedState->nodeStatsHashLock, LW_SHARED);
+
+	hash_seq_init(&status, NodeStatsHash);
+	while ((nodeStats = (NodeStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		ResetNodeStatsEntry(nodeStats);
+	}
+
+	LWLockRelease(&NodeStatsSharedState->nodeStatsHashLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreNodeStats inserts the statistics of all nodes into the given
+ * tuplestore. We don't need to enforce any access privileges, since like
+ * the connection statistics they do not reveal anything about other users.
+ */
+static void
+StoreNodeStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[NODE_STATS_COLUMNS];
+	bool isNulls[NODE_STATS_COLUMNS];
+
+	if (NodeStatsHash == NULL)
+	{
+		return;
+	}
+
+	Datum latencyBoundsDatum = LatencyBoundsDatum();
+
+	LWLockAcquire(&NodeStatsSharedState->nodeStatsHashLock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	NodeStatsHashEntry *nodeStats = NULL;
+
+	hash_seq_init(&status, NodeStatsHash);
+	while ((nodeStats = (NodeStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = CStringGetTextDatum(nodeStats->key.hostname);
+		values[1] = Int32GetDatum(nodeStats->key.port);
+		values[2] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->taskCount));
+		values[3] = Float8GetDatum(pg_atomic_read_u64(&nodeStats->taskTime) / 1000.0);
+		values[4] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->taskFailureCount));
+		values[5] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->taskRetryCount));
+		values[6] = LatencyHistogramDatum(nodeStats->taskLatencyHistogram);
+		values[7] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->connectionCount));
+		values[8] = Float8GetDatum(pg_atomic_read_u64(&nodeStats->connectionTime) /
+								   1000.0);
+		values[9] = Int64GetDatum(pg_atomic_read_u64(
+									  &nodeStats->connectionFailureCount));
+		values[10] = LatencyHistogramDatum(nodeStats->connectionLatencyHistogram);
+		values[11] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->bytesSent));
+		values[12] = Int64GetDatum(pg_atomic_read_u64(&nodeStats->bytesReceived));
+		values[13] = latencyBoundsDatum;
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&NodeStatsSharedState->nodeStatsHashLock);
+}
+
+
+/*
+ * LatencyHistogramDatum returns the bucket counts of the given histogram as
+ * a bigint array.
+ */
+static Datum
+LatencyHistogramDatum(pg_atomic_uint64 *histogram)
+{
+	Datum bucketCounts[NODE_STATS_LATENCY_BUCKET_COUNT];
+
+	for (int bucketIndex = 0; bucketIndex < NODE_STATS_LATENCY_BUCKET_COUNT;
+		 bucketIndex++)
+	{
+		bucketCounts[bucketIndex] =
+			Int64GetDatum(pg_atomic_read_u64(&histogram[bucketIndex]));
+	}
+
+	ArrayType *bucketArray = construct_array(bucketCounts,
+											 NODE_STATS_LATENCY_BUCKET_COUNT,
+											 INT8OID, sizeof(int64), FLOAT8PASSBYVAL,
+											 'd');
+
+	return PointerGetDatum(bucketArray);
+}
+
+
+/*
+ * LatencyBoundsDatum returns the upper bounds of the histogram buckets, in
+ * milliseconds, as a float8 array.
+ */
+static Datum
+LatencyBoundsDatum(void)
+{
+	Datum bounds[NODE_STATS_LATENCY_BOUND_COUNT];
+
+	for (int boundIndex = 0; boundIndex < NODE_STATS_LATENCY_BOUND_COUNT; boundIndex++)
+	{
+		bounds[boundIndex] = Float8GetDatum(NodeStatsLatencyBounds[boundIndex]);
+	}
+
+	ArrayType *boundArray = construct_array(bounds, NODE_STATS_LATENCY_BOUND_COUNT,
+											FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL,
+											'd');
+
+	return PointerGetDatum(boundArray);
+}
+
+
+/*
+ * GetNodeStats returns the shared statistics entry of the given node, or
+ * NULL if the statistics are disabled or the maximum number of nodes is
+ * tracked already. The entry can be kept by the caller, since entries are
+ * never removed.
+ */
+NodeStatsHashEntry *
+GetNodeStats(const char *hostname, int port)
+{
+	NodeStatsHashKey key;
+	bool found = false;
+
+	if (NodeStatsHash == NULL)
+	{
+		return NULL;
+	}
+
+	NodeStatsHashKeyFor(hostname, port, &key);
+
+	if (NodeStatsCache == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(NodeStatsHashKey);
+		info.entrysize = sizeof(NodeStatsCacheEntry);
+		info.hcxt = TopMemoryContext;
+
+		NodeStatsCache = hash_create("Node Stats Cache", 32, &info,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	NodeStatsCacheEntry *cacheEntry = hash_search(NodeStatsCache, &key, HASH_FIND,
+												  &found);
+	if (found)
+	{
+		return cacheEntry->nodeStats;
+	}
+
+	LWLockAcquire(&NodeStatsSharedState->nodeStatsHashLock, LW_SHARED);
+	NodeStatsHashEntry *nodeStats = hash_search(NodeStatsHash, &key, HASH_FIND, &found);
+	LWLockRelease(&NodeStatsSharedState->nodeStatsHashLock);
+
+	if (!found)
+	{
+		LWLockAcquire(&NodeStatsSharedState->nodeStatsHashLock, LW_EXCLUSIVE);
+
+		nodeStats = hash_search(NodeStatsHash, &key, HASH_ENTER_NULL, &found);
+		if (nodeStats != NULL && !found)
+		{
+			for (int bucketIndex = 0; bucketIndex < NODE_STATS_LATENCY_BUCKET_COUNT;
+				 bucketIndex++)
+			{
+				pg_atomic_init_u64(&nodeStats->taskLatencyHistogram[bucketIndex], 0);
+				pg_atomic_init_u64(&nodeStats->connectionLatencyHistogram[bucketIndex],
+								   0);
+			}
+
+			pg_atomic_init_u64(&nodeStats->taskCount, 0);
+			pg_atomic_init_u64(&nodeStats->taskTime, 0);
+			pg_atomic_init_u64(&nodeStats->taskFailureCount, 0);
+			pg_atomic_init_u64(&nodeStats->taskRetryCount, 0);
+			pg_atomic_init_u64(&nodeStats->connectionCount, 0);
+			pg_atomic_init_u64(&nodeStats->connectionTime, 0);
+			pg_atomic_init_u64(&nodeStats->connectionFailureCount, 0);
+			pg_atomic_init_u64(&nodeStats->bytesSent, 0);
+			pg_atomic_init_u64(&nodeStats->bytesReceived, 0);
+		}
+
+		LWLockRelease(&NodeStatsSharedState->nodeStatsHashLock);
+
+		if (nodeStats == NULL)
+		{
+			/* the hash is full, we cannot keep track of the node */
+			return NULL;
+		}
+	}
+
+	cacheEntry = hash_search(NodeStatsCache, &key, HASH_ENTER, NULL);
+	cacheEntry->nodeStats = nodeStats;
+
+	return nodeStats;
+}
+
+
+/*
+ * RecordNodeTaskExecution records that a task finished on the node after the
+ * given time in milliseconds, or failed.
+ */
+void
+RecordNodeTaskExecution(NodeStatsHashEntry *nodeStats, double taskTime, bool succeeded)
+{
+	if (nodeStats == NULL)
+	{
+		return;
+	}
+
+	if (!succeeded)
+	{
+		pg_atomic_fetch_add_u64(&nodeStats->taskFailureCount, 1);
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&nodeStats->taskCount, 1);
+	RecordLatency(nodeStats->taskLatencyHistogram, &nodeStats->taskTime, taskTime);
+}
+
+
+/*
+ * RecordNodeTaskRetry records that a task that failed on the node is retried
+ * on another placement.
+ */
+void
+RecordNodeTaskRetry(NodeStatsHashEntry *nodeStats)
+{
+	if (nodeStats == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&nodeStats->taskRetryCount, 1);
+}
+
+
+/*
+ * RecordNodeBytes adds the given number of bytes sent to and received from
+ * the node.
+ */
+void
+RecordNodeBytes(NodeStatsHashEntry *nodeStats, uint64 bytesSent, uint64 bytesReceived)
+{
+	if (nodeStats == NULL)
+	{
+		return;
+	}
+
+	if (bytesSent > 0)
+	{
+		pg_atomic_fetch_add_u64(&nodeStats->bytesSent, bytesSent);
+	}
+
+	if (bytesReceived > 0)
+	{
+		pg_atomic_fetch_add_u64(&nodeStats->bytesReceived, bytesReceived);
+	}
+}
+
+
+/*
+ * RecordNodeConnectionAttempt records that a connection to the given node
+ * was established in the given time in milliseconds, or failed.
+ */
+void
+RecordNodeConnectionAttempt(const char *hostname, int port, double establishmentTime,
+							bool succeeded)
+{
+	NodeStatsHashEntry *nodeStats = GetNodeStats(hostname, port);
+	if (nodeStats == NULL)
+	{
+		return;
+	}
+
+	if (!succeeded)
+	{
+		pg_atomic_fetch_add_u64(&nodeStats->connectionFailureCount, 1);
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&nodeStats->connectionCount, 1);
+	RecordLatency(nodeStats->connectionLatencyHistogram, &nodeStats->connectionTime,
+				  establishmentTime);
+}
+
+
+/*
+ * RecordLatency adds the given latency in milliseconds to the histogram and
+ * to the total time in microseconds.
+ */
+static void
+RecordLatency(pg_atomic_uint64 *histogram, pg_atomic_uint64 *totalTime, double latency)
+{
+	int bucketIndex = 0;
+
+	while (bucketIndex < NODE_STATS_LATENCY_BOUND_COUNT &&
+		   latency > NodeStatsLatencyBounds[bucketIndex])
+	{
+		bucketIndex++;
+	}
+
+	pg_atomic_fetch_add_u64(&histogram[bucketIndex], 1);
+	pg_atomic_fetch_add_u64(totalTime, (uint64) (latency * 1000.0));
+}
+
+
+/*
+ * ResetNodeStatsEntry zeroes all statistics of the given node.
+ */
+static void
+ResetNodeStatsEntry(NodeStatsHashEntry *nodeStats)
+{
+	for (int bucketIndex = 0; bucketIndex < NODE_STATS_LATENCY_BUCKET_COUNT;
+		 bucketIndex++)
+	{
+		pg_atomic_write_u64(&nodeStats->taskLatencyHistogram[bucketIndex], 0);
+		pg_atomic_write_u64(&nodeStats->connectionLatencyHistogram[bucketIndex], 0);
+	}
+
+	pg_atomic_write_u64(&nodeStats->taskCount, 0);
+	pg_atomic_write_u64(&nodeStats->taskTime, 0);
+	pg_atomic_write_u64(&nodeStats->taskFailureCount, 0);
+	pg_atomic_write_u64(&nodeStats->taskRetryCount, 0);
+	pg_atomic_write_u64(&nodeStats->connectionCount, 0);
+	pg_atomic_write_u64(&nodeStats->connectionTime, 0);
+	pg_atomic_write_u64(&nodeStats->connectionFailureCount, 0);
+	pg_atomic_write_u64(&nodeStats->bytesSent, 0);
+	pg_atomic_write_u64(&nodeStats->bytesReceived, 0);
+}
+
+
+/*
+ * NodeStatsHashKeyFor fills the hash key of the given node.
+ */
+static void
+NodeStatsHashKeyFor(const char *hostname, int port, NodeStatsHashKey *key)
+{
+	/* the key is hashed as a blob, so the padding should be zero */
+	memset(key, 0, sizeof(NodeStatsHashKey));
+	strlcpy(key->hostname, hostname, MAX_NODE_LENGTH);
+	key->port = port;
+}
+
+
+/*
+ * InitializeNodeStats requests the necessary shared memory from Postgres
+ * and sets up the shared memory startup hook.
+ */
+void
+InitializeNodeStats(void)
+{
+	if (NodeStatsMax == 0)
+	{
+		/* statistics are disabled */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(NodeStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = NodeStatsShmemInit;
+}
+
+
+/*
+ * NodeStatsShmemSize returns the size that should be allocated on the shared
+ * memory for the node statistics.
+ */
+static size_t
+NodeStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(NodeStatsSharedData));
+
+	Size hashSize = hash_estimate_size(NodeStatsMax, sizeof(NodeStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * NodeStatsShmemInit initializes the shared memory used for keeping track of
+ * the node statistics across backends.
+ */
+static void
+NodeStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (hostname, port) -> [statistics] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(NodeStatsHashKey);
+	info.entrysize = sizeof(NodeStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	NodeStatsSharedState =
+		(NodeStatsSharedData *) ShmemInitStruct("Node Stats Data",
+												sizeof(NodeStatsSharedData),
+												&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		NodeStatsSharedState->nodeStatsHashTrancheId = LWLockNewTrancheId();
+		NodeStatsSharedState->nodeStatsHashTrancheName = "Node Stats Hash Tranche";
+		LWLockRegisterTranche(NodeStatsSharedState->nodeStatsHashTrancheId,
+							  NodeStatsSharedState->nodeStatsHashTrancheName);
+
+		LWLockInitialize(&NodeStatsSharedState->nodeStatsHashLock,
+						 NodeStatsSharedState->nodeStatsHashTrancheId);
+	}
+
+	/* allocate hash table */
+	NodeStatsHash = ShmemInitHash("Node Stats Hash", NodeStatsMax, NodeStatsMax,
+								  &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(NodeStatsHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
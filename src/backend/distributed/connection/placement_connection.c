@@ -105,12 +105,22 @@ typedef struct ConnectionPlacementHashEntry
 	struct ColocatedPlacementsHashEntry *colocatedEntry;
 
 	/* membership in ConnectionShardHashEntry->placementConnections */
+	bool associatedWithShard;
 	dlist_node shardNode;
 } ConnectionPlacementHashEntry;
 
 /* hash table */
 static HTAB *ConnectionPlacementHash;
 
+/*
+ * The placement entry that was found or created last. A single-shard command
+ * looks up the same placement when finding and when assigning a connection,
+ * and transactions of such commands tend to access the same placement over
+ * and over, so this saves most hash lookups. Entries stay in place until
+ * ResetPlacementConnectionManagement() removes all of them.
+ */
+static ConnectionPlacementHashEntry *LastPlacementEntry = NULL;
+
 
 /*
  * A hash-table mapping colocated placements to connections. Colocated
@@ -449,9 +459,15 @@ AssignPlacementListToConnection(List *placementAccessList, MultiConnection *conn
 			placementConnection->hadDML = true;
 		}
 
-		/* record the relation access */
-		Oid relationId = RelationIdForShard(placement->shardId);
-		RecordRelationAccessIfReferenceTable(relationId, accessType);
+		/*
+		 * Record the relation access. Only accesses to reference tables are
+		 * recorded, which the placement tells without looking up the shard.
+		 */
+		if (placement->partitionMethod == DISTRIBUTE_BY_NONE)
+		{
+			Oid relationId = RelationIdForShard(placement->shardId);
+			RecordRelationAccessIfReferenceTable(relationId, accessType);
+		}
 	}
 }
 
@@ -645,6 +661,13 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 	ConnectionPlacementHashKey connKey;
 	bool found = false;
 
+	if (LastPlacementEntry != NULL &&
+		LastPlacementEntry->key.placementId == placement->placementId)
+	{
+		/* the entry is already associated with the shard */
+		return LastPlacementEntry;
+	}
+
 	connKey.placementId = placement->placementId;
 
 	ConnectionPlacementHashEntry *placementEntry = hash_search(ConnectionPlacementHash,
@@ -657,6 +680,7 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 		placementEntry->primaryConnection = NULL;
 		placementEntry->hasSecondaryConnections = false;
 		placementEntry->colocatedEntry = NULL;
+		placementEntry->associatedWithShard = false;
 
 		if (placement->partitionMethod == DISTRIBUTE_BY_HASH ||
 			placement->partitionMethod == DISTRIBUTE_BY_NONE)
@@ -714,6 +738,8 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 	/* record association with shard, for invalidation */
 	AssociatePlacementWithShard(placementEntry, placement);
 
+	LastPlacementEntry = placementEntry;
+
 	return placementEntry;
 }
 
@@ -852,7 +878,16 @@ AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 {
 	ConnectionShardHashKey shardKey;
 	bool found = false;
-	dlist_iter placementIter;
+
+	/*
+	 * Check if placement is already associated with shard (happens if the
+	 * placement is accessed again, or if there's multiple connections for a
+	 * placement).
+	 */
+	if (placementEntry->associatedWithShard)
+	{
+		return;
+	}
 
 	shardKey.shardId = placement->shardId;
 	ConnectionShardHashEntry *shardEntry = hash_search(ConnectionShardHash, &shardKey,
@@ -862,24 +897,8 @@ AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 		dlist_init(&shardEntry->placementConnections);
 	}
 
-	/*
-	 * Check if placement is already associated with shard (happens if there's
-	 * multiple connections for a placement).  There'll usually only be few
-	 * placement per shard, so the price of iterating isn't large.
-	 */
-	dlist_foreach(placementIter, &shardEntry->placementConnections)
-	{
-		ConnectionPlacementHashEntry *currPlacementEntry =
-			dlist_container(ConnectionPlacementHashEntry, shardNode, placementIter.cur);
-
-		if (currPlacementEntry->key.placementId == placement->placementId)
-		{
-			return;
-		}
-	}
-
-	/* otherwise add */
 	dlist_push_tail(&shardEntry->placementConnections, &placementEntry->shardNode);
+	placementEntry->associatedWithShard = true;
 }
 
 
@@ -939,6 +958,8 @@ ResetPlacementConnectionManagement(void)
 	hash_delete_all(ColocatedPlacementsHash);
 	ResetRelationAccessHash();
 
+	LastPlacementEntry = NULL;
+
 	/*
 	 * NB: memory for ConnectionReference structs and subordinate data is
 	 * deleted by virtue of being allocated in TopTransactionContext.
@@ -13,6 +13,8 @@
 
 #include "libpq-fe.h"
 
+#include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/errormessage.h"
 #include "distributed/listutils.h"
@@ -23,14 +25,27 @@
 #include "miscadmin.h"
 #include "storage/latch.h"
 #include "utils/palloc.h"
+#include "utils/timestamp.h"
 
 
 #define MAX_PUT_COPY_DATA_BUFFER_SIZE (8 * 1024 * 1024)
 
+/* maximum number of commands tracked for preparation per connection */
+#define MAX_PREPARED_STATEMENTS_PER_CONNECTION 256
+
 
 /* GUC, determining whether statements sent to remote nodes are logged */
 bool LogRemoteCommands = false;
 
+/* GUC, determining whether parameterized commands are prepared on the workers */
+bool EnableWorkerPreparedStatements = false;
+
+/*
+ * Incremented whenever the definition of a distributed table may have changed,
+ * which may change the result type of prepared statements on the shards.
+ */
+static uint64 WorkerPreparedStatementGeneration = 0;
+
 
 static bool ClearResultsInternal(MultiConnection *connection, bool raiseErrors,
 								 bool discardWarnings);
@@ -38,6 +53,11 @@ static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts
 static WaitEventSet * BuildWaitEventSet(MultiConnection **allConnections,
 										int totalConnectionCount,
 										int pendingConnectionsStartIndex);
+static bool WorkerPreparedStatementMatches(WorkerPreparedStatement *preparedStatement,
+										   const char *command, int parameterCount,
+										   const Oid *parameterTypes);
+static bool EvictUnpreparedStatement(MultiConnection *connection);
+static void FreeWorkerPreparedStatement(WorkerPreparedStatement *preparedStatement);
 
 
 /* simple helpers */
@@ -464,6 +484,49 @@ ExecuteOptionalRemoteCommand(MultiConnection *connection, const char *command,
 }
 
 
+/*
+ * ExecuteRemoteCommandBatch executes a query string that may consist of
+ * multiple statements. Unlike ExecuteOptionalRemoteCommand, it checks the
+ * result of every statement rather than only the first one. A failure is
+ * reported at the given elevel, and if that does not throw, the function
+ * returns QUERY_SEND_FAILED or RESPONSE_NOT_OKAY.
+ */
+int
+ExecuteRemoteCommandBatch(MultiConnection *connection, const char *commandBatch,
+						  int elevel)
+{
+	bool raiseInterrupts = true;
+	bool failed = false;
+
+	int querySent = SendRemoteCommand(connection, commandBatch);
+	if (querySent == 0)
+	{
+		ReportConnectionError(connection, elevel);
+		return QUERY_SEND_FAILED;
+	}
+
+	while (true)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (result == NULL)
+		{
+			break;
+		}
+
+		/* only report the first failure, later statements are skipped anyway */
+		if (!failed && !IsResponseOK(result))
+		{
+			ReportResultError(connection, result, elevel);
+			failed = true;
+		}
+
+		PQclear(result);
+	}
+
+	return failed ? RESPONSE_NOT_OKAY : RESPONSE_OKAY;
+}
+
+
 /*
  * SendRemoteCommandParams is a PQsendQueryParams wrapper that logs remote commands,
  * and accepts a MultiConnection instead of a plain PGconn. It makes sure it can
@@ -475,8 +538,31 @@ int
 SendRemoteCommandParams(MultiConnection *connection, const char *command,
 						int parameterCount, const Oid *parameterTypes,
 						const char *const *parameterValues)
+{
+	bool binaryResults = false;
+
+	return SendRemoteCommandParamsExtended(connection, command, parameterCount,
+										   parameterTypes, parameterValues, NULL, NULL,
+										   binaryResults);
+}
+
+
+/*
+ * SendRemoteCommandParamsExtended is the same as SendRemoteCommandParams, but
+ * additionally allows sending parameters and requesting the results in binary
+ * format, in which case every column is expected to be decoded with the receive
+ * function of its type. parameterLengths and parameterFormats follow the rules
+ * of PQsendQueryParams and may be NULL when all parameters are in text format.
+ */
+int
+SendRemoteCommandParamsExtended(MultiConnection *connection, const char *command,
+								int parameterCount, const Oid *parameterTypes,
+								const char *const *parameterValues,
+								const int *parameterLengths,
+								const int *parameterFormats, bool binaryResults)
 {
 	PGconn *pgConn = connection->pgConn;
+	int resultFormat = binaryResults ? 1 : 0;
 
 	LogRemoteCommand(connection, command);
 
@@ -492,12 +578,242 @@ SendRemoteCommandParams(MultiConnection *connection, const char *command,
 	Assert(PQisnonblocking(pgConn));
 
 	int rc = PQsendQueryParams(pgConn, command, parameterCount, parameterTypes,
-							   parameterValues, NULL, NULL, 0);
+							   parameterValues, parameterLengths, parameterFormats,
+							   resultFormat);
 
 	return rc;
 }
 
 
+/*
+ * GetWorkerPreparedStatement returns the entry for the given parameterized
+ * command in the prepared statements of the connection, after incrementing
+ * its use count. If the command has not been sent over the connection before,
+ * a new entry that is not prepared yet is added. NULL is returned if there is
+ * no room for a new entry.
+ *
+ * After a distributed table is invalidated, the connection is marked to be
+ * closed at the end of the transaction, since the statements prepared on
+ * the remote node may have become stale. Until then, new statements are
+ * prepared under new names.
+ */
+WorkerPreparedStatement *
+GetWorkerPreparedStatement(MultiConnection *connection, const char *command,
+						   int parameterCount, const Oid *parameterTypes)
+{
+	WorkerPreparedStatement *preparedStatement = NULL;
+
+	if (connection->preparedStatementGeneration != WorkerPreparedStatementGeneration)
+	{
+		if (connection->preparedStatementList != NIL)
+		{
+			FreeWorkerPreparedStatements(connection);
+			connection->forceCloseAtTransactionEnd = true;
+		}
+
+		connection->preparedStatementGeneration = WorkerPreparedStatementGeneration;
+	}
+
+	foreach_ptr(preparedStatement, connection->preparedStatementList)
+	{
+		if (WorkerPreparedStatementMatches(preparedStatement, command, parameterCount,
+										   parameterTypes))
+		{
+			preparedStatement->useCount++;
+			return preparedStatement;
+		}
+	}
+
+	if (list_length(connection->preparedStatementList) >=
+		MAX_PREPARED_STATEMENTS_PER_CONNECTION &&
+		!EvictUnpreparedStatement(connection))
+	{
+		/* all entries are prepared already, do not prepare more */
+		return NULL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(ConnectionContext);
+
+	preparedStatement = palloc0(sizeof(WorkerPreparedStatement));
+	preparedStatement->command = pstrdup(command);
+	preparedStatement->parameterCount = parameterCount;
+	preparedStatement->parameterTypes = palloc0(Max(parameterCount, 1) * sizeof(Oid));
+	if (parameterCount > 0)
+	{
+		memcpy_s(preparedStatement->parameterTypes, parameterCount * sizeof(Oid),
+				 parameterTypes, parameterCount * sizeof(Oid));
+	}
+	preparedStatement->useCount = 1;
+	preparedStatement->prepared = false;
+
+	connection->preparedStatementList =
+		lappend(connection->preparedStatementList, preparedStatement);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return preparedStatement;
+}
+
+
+/*
+ * WorkerPreparedStatementMatches returns whether the prepared statement is for
+ * the given command and parameter types.
+ */
+static bool
+WorkerPreparedStatementMatches(WorkerPreparedStatement *preparedStatement,
+							   const char *command, int parameterCount,
+							   const Oid *parameterTypes)
+{
+	if (preparedStatement->parameterCount != parameterCount)
+	{
+		return false;
+	}
+
+	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		if (preparedStatement->parameterTypes[parameterIndex] !=
+			parameterTypes[parameterIndex])
+		{
+			return false;
+		}
+	}
+
+	return strcmp(preparedStatement->command, command) == 0;
+}
+
+
+/*
+ * EvictUnpreparedStatement removes the least recently added entry that is
+ * not prepared from the prepared statements of the connection, and returns
+ * whether there was one.
+ */
+static bool
+EvictUnpreparedStatement(MultiConnection *connection)
+{
+	WorkerPreparedStatement *preparedStatement = NULL;
+
+	foreach_ptr(preparedStatement, connection->preparedStatementList)
+	{
+		if (!preparedStatement->prepared)
+		{
+			connection->preparedStatementList =
+				list_delete_ptr(connection->preparedStatementList, preparedStatement);
+			FreeWorkerPreparedStatement(preparedStatement);
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * SendRemotePrepare is a PQsendPrepare wrapper that prepares the command of
+ * the given entry on the remote node under a new statement name. The entry
+ * is only marked as prepared by the caller, once the result is received.
+ */
+int
+SendRemotePrepare(MultiConnection *connection,
+				  WorkerPreparedStatement *preparedStatement)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	LogRemoteCommand(connection, preparedStatement->command);
+
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQisnonblocking(pgConn));
+
+	/* use a new name, in case an earlier attempt was interrupted */
+	connection->preparedStatementCount++;
+	SafeSnprintf(preparedStatement->statementName, NAMEDATALEN,
+				 "citus_prepared_" UINT64_FORMAT, connection->preparedStatementCount);
+
+	return PQsendPrepare(pgConn, preparedStatement->statementName,
+						 preparedStatement->command,
+						 preparedStatement->parameterCount,
+						 preparedStatement->parameterTypes);
+}
+
+
+/*
+ * SendRemotePreparedCommand is a PQsendQueryPrepared wrapper that executes a
+ * command that was prepared on the remote node with the given parameters.
+ */
+int
+SendRemotePreparedCommand(MultiConnection *connection,
+						  WorkerPreparedStatement *preparedStatement,
+						  const char *const *parameterValues,
+						  const int *parameterLengths, const int *parameterFormats,
+						  bool binaryResults)
+{
+	PGconn *pgConn = connection->pgConn;
+	int resultFormat = binaryResults ? 1 : 0;
+
+	Assert(preparedStatement->prepared);
+
+	LogRemoteCommand(connection, preparedStatement->command);
+
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQisnonblocking(pgConn));
+
+	return PQsendQueryPrepared(pgConn, preparedStatement->statementName,
+							   preparedStatement->parameterCount, parameterValues,
+							   parameterLengths, parameterFormats, resultFormat);
+}
+
+
+/*
+ * FreeWorkerPreparedStatements forgets about the statements prepared over the
+ * connection. The statements themselves remain on the remote node until the
+ * connection is closed.
+ */
+void
+FreeWorkerPreparedStatements(MultiConnection *connection)
+{
+	WorkerPreparedStatement *preparedStatement = NULL;
+
+	foreach_ptr(preparedStatement, connection->preparedStatementList)
+	{
+		FreeWorkerPreparedStatement(preparedStatement);
+	}
+
+	list_free(connection->preparedStatementList);
+	connection->preparedStatementList = NIL;
+}
+
+
+/*
+ * FreeWorkerPreparedStatement frees the memory of a prepared statement entry.
+ */
+static void
+FreeWorkerPreparedStatement(WorkerPreparedStatement *preparedStatement)
+{
+	pfree(preparedStatement->command);
+	pfree(preparedStatement->parameterTypes);
+	pfree(preparedStatement);
+}
+
+
+/*
+ * InvalidateWorkerPreparedStatements marks the statements prepared over all
+ * connections as possibly stale.
+ */
+void
+InvalidateWorkerPreparedStatements(void)
+{
+	WorkerPreparedStatementGeneration++;
+}
+
+
 /*
  * SendRemoteCommand is a PQsendQuery wrapper that logs remote commands, and
  * accepts a MultiConnection instead of a plain PGconn. It makes sure it can
@@ -749,7 +1065,8 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 			return true;
 		}
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, PG_WAIT_EXTENSION);
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0,
+								   WAIT_EVENT_CITUS_REMOTE_COMMAND);
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -789,6 +1106,25 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 void
 WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 {
+	long timeout = -1;
+
+	WaitForAllConnectionsWithTimeout(connectionList, raiseInterrupts, timeout,
+									 WAIT_EVENT_CITUS_REMOTE_COMMAND);
+}
+
+
+/*
+ * WaitForAllConnectionsWithTimeout blocks until all connections in the list
+ * are no longer busy, or until timeout milliseconds have passed. A negative
+ * timeout waits indefinitely. Callers can find the connections that timed
+ * out by checking whether they are still busy. While blocked, the backend
+ * reports the given wait event.
+ */
+void
+WaitForAllConnectionsWithTimeout(List *connectionList, bool raiseInterrupts,
+								 long timeout, uint32 waitEventInfo)
+{
+	TimestampTz deadline = 0;
 	int totalConnectionCount = list_length(connectionList);
 	int pendingConnectionsStartIndex = 0;
 	int connectionIndex = 0;
@@ -823,6 +1159,11 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 		}
 	}
 
+	if (timeout >= 0)
+	{
+		deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout);
+	}
+
 	PG_TRY();
 	{
 		bool rebuildWaitEventSet = true;
@@ -831,7 +1172,7 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 		{
 			bool cancellationReceived = false;
 			int eventIndex = 0;
-			long timeout = -1;
+			long waitTimeout = -1;
 			int pendingConnectionCount = totalConnectionCount -
 										 pendingConnectionsStartIndex;
 
@@ -849,10 +1190,26 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 				rebuildWaitEventSet = false;
 			}
 
+			if (timeout >= 0)
+			{
+				long secs = 0;
+				int microsecs = 0;
+
+				TimestampDifference(GetCurrentTimestamp(), deadline, &secs, &microsecs);
+
+				if (secs == 0 && microsecs == 0)
+				{
+					/* deadline passed, leave the remaining connections busy */
+					break;
+				}
+
+				waitTimeout = secs * 1000 + microsecs / 1000;
+			}
+
 			/* wait for I/O events */
-			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
+			int eventCount = WaitEventSetWait(waitEventSet, waitTimeout, events,
 											  pendingConnectionCount,
-											  WAIT_EVENT_CLIENT_READ);
+											  waitEventInfo);
 
 			/* process I/O events */
 			for (; eventIndex < eventCount; eventIndex++)
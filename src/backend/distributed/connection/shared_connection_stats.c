@@ -22,36 +22,63 @@
 #include "catalog/pg_authid.h"
 #include "commands/dbcommands.h"
 #include "distributed/cancel_utils.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/node_stats.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/time_constants.h"
 #include "distributed/tuplestore.h"
 #include "utils/builtins.h"
 #include "utils/hashutils.h"
 #include "utils/hsearch.h"
+#include "utils/timestamp.h"
+#include "portability/instr_time.h"
+#include "port/atomics.h"
 #include "storage/ipc.h"
+#include "storage/spin.h"
 
 
-#define REMOTE_CONNECTION_STATS_COLUMNS 4
+#define REMOTE_CONNECTION_STATS_COLUMNS 13
 
 #define ADJUST_POOLSIZE_AUTOMATICALLY 0
 #define DISABLE_CONNECTION_THROTTLING -1
 
+/* weight of the latest executions in the moving average of the task duration */
+#define TASK_EXECUTION_TIME_WEIGHT 0.2
+
+/* number of partitions of the shared hash, must be a power of 2 */
+#define SHARED_CONN_STATS_PARTITIONS 16
+
 /*
  * The data structure used to store data in shared memory. This data structure is only
- * used for storing the lock. The actual statistics about the connections are stored
+ * used for storing the locks. The actual statistics about the connections are stored
  * in the hashmap, which is allocated separately, as Postgres provides different APIs
  * for allocating hashmaps in the shared memory.
+ *
+ * The hashmap is partitioned, each partition is protected by its own lock and has
+ * its own condition variable, such that backends opening and closing connections
+ * to different nodes rarely contend with each other. The partition of a node is
+ * derived from the hash value of its key.
  */
 typedef struct ConnectionStatsSharedData
 {
 	int sharedConnectionHashTrancheId;
 	char *sharedConnectionHashTrancheName;
 
-	LWLock sharedConnectionHashLock;
-	ConditionVariable waitersConditionVariable;
+	LWLockPadded partitionLocks[SHARED_CONN_STATS_PARTITIONS];
+	ConditionVariable waitersConditionVariables[SHARED_CONN_STATS_PARTITIONS];
+
+	/*
+	 * Number of backends of the interactive workload class that wait for a
+	 * connection slot to a node of the partition. Batch connections are not
+	 * admitted to the partition while there are any.
+	 */
+	pg_atomic_uint32 interactiveWaiterCounts[SHARED_CONN_STATS_PARTITIONS];
+
+	/* protects NodeHealthHash */
+	LWLockPadded nodeHealthLock;
 } ConnectionStatsSharedData;
 
 typedef struct SharedConnStatsHashKey
@@ -76,10 +103,78 @@ typedef struct SharedConnStatsHashEntry
 {
 	SharedConnStatsHashKey key;
 
-	int connectionCount;
+	/*
+	 * Number of connections to the node. It is only modified via atomic
+	 * operations, which only requires holding the partition lock in shared
+	 * mode to guarantee that the entry is not removed concurrently.
+	 */
+	pg_atomic_uint32 connectionCount;
+
+	/* number of the connections that were opened by the batch workload class */
+	pg_atomic_uint32 batchConnectionCount;
+
+	/* protects the statistics below, which are updated under a shared lock */
+	slock_t mutex;
+
+	/*
+	 * Number of times backends had to wait for a connection slot to the node
+	 * and the total time spent waiting, in milliseconds. Both are reset when
+	 * the entry is removed, that is when there are no connections to the node.
+	 */
+	int64 connectionWaitCount;
+	double connectionWaitTime;
+
+	/* the same, per workload class */
+	int64 classConnectionWaitCount[WORKLOAD_CLASS_COUNT];
+	double classConnectionWaitTime[WORKLOAD_CLASS_COUNT];
+
+	/*
+	 * Number of connections established to the node, the total time in
+	 * milliseconds spent establishing them (including the TLS handshake)
+	 * and how many of them use TLS.
+	 */
+	int64 connectionEstablishmentCount;
+	double connectionEstablishmentTime;
+	int64 sslConnectionCount;
+
+	/*
+	 * Number of tasks the adaptive executor ran on the node and a moving
+	 * average of their duration in milliseconds, from sending the task until
+	 * its results were received. Only recorded when adaptive pool sizing is
+	 * enabled.
+	 */
+	int64 taskExecutionCount;
+	double averageTaskExecutionTime;
 } SharedConnStatsHashEntry;
 
 
+/*
+ * NodeHealthHashKey identifies a node in NodeHealthHash. Unlike the connection
+ * statistics, the health of a node does not depend on the database.
+ */
+typedef struct NodeHealthHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} NodeHealthHashKey;
+
+/*
+ * NodeHealthHashEntry keeps track of consecutive failures to establish a
+ * connection to a node. Entries only exist for nodes whose last connection
+ * attempt failed, and are removed once a connection succeeds again.
+ */
+typedef struct NodeHealthHashEntry
+{
+	NodeHealthHashKey key;
+
+	/* number of connection attempts that failed since the last success */
+	int consecutiveFailureCount;
+
+	/* time of the last connection attempt to the node while it was suspect */
+	TimestampTz lastProbeTime;
+} NodeHealthHashEntry;
+
+
 /*
  * Controlled via a GUC, never access directly, use GetMaxSharedPoolSize().
  *  "0" means adjust MaxSharedPoolSize automatically by using MaxConnections.
@@ -88,9 +183,22 @@ typedef struct SharedConnStatsHashEntry
  */
 int MaxSharedPoolSize = 0;
 
+/* GUC, workload class of the connections this backend opens, or auto */
+int WorkloadClassSetting = WORKLOAD_CLASS_AUTO;
+
+/* GUC, percentage of citus.max_shared_pool_size that batch connections may use */
+int BatchWorkloadPoolShare = 100;
+
+/* GUC, number of consecutive connection failures after which a node is suspect */
+int NodeFailureThreshold = 0;
+
+/* GUC, time in ms after which a connection to a suspect node is attempted again */
+int NodeProbeInterval = 10000;
+
 
 /* the following two structs are used for accessing shared memory */
 static HTAB *SharedConnStatsHash = NULL;
+static HTAB *NodeHealthHash = NULL;
 static ConnectionStatsSharedData *ConnectionStatsSharedState = NULL;
 
 
@@ -100,8 +208,27 @@ static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 /* local function declarations */
 static void StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc
 										  tupleDescriptor);
-static void LockConnectionSharedMemory(LWLockMode lockMode);
-static void UnLockConnectionSharedMemory(void);
+static void RecordSharedConnectionWait(const char *hostname, int port,
+									   WorkloadClass workloadClass, double waitTime);
+static bool TryToReserveBatchConnectionSlot(SharedConnStatsHashEntry *connectionEntry,
+											int maxSharedPoolSize);
+static void ReleaseBatchConnectionSlot(SharedConnStatsHashEntry *connectionEntry);
+static pg_atomic_uint32 * PartitionInteractiveWaiterCount(uint32 hashCode);
+static void NodeHealthHashKeyFor(const char *hostname, int port,
+								 NodeHealthHashKey *healthKey);
+static uint32 SharedConnStatsHashCode(const char *hostname, int port,
+									  SharedConnStatsHashKey *connKey);
+static SharedConnStatsHashEntry * FindOrCreateSharedConnStatsEntry(
+	SharedConnStatsHashKey *connKey, uint32 hashCode);
+static void InitializeSharedConnStatsEntry(SharedConnStatsHashEntry *connectionEntry);
+static void RemoveSharedConnStatsEntryIfUnused(SharedConnStatsHashKey *connKey,
+											   uint32 hashCode);
+static void LockConnectionSharedMemory(uint32 hashCode, LWLockMode lockMode);
+static void UnLockConnectionSharedMemory(uint32 hashCode);
+static void LockAllConnectionSharedMemory(LWLockMode lockMode);
+static void UnLockAllConnectionSharedMemory(void);
+static void WakeupWaiterBackendsForPartition(uint32 hashCode);
+static void WaitForSharedConnection(uint32 hashCode);
 static void SharedConnectionStatsShmemInit(void);
 static size_t SharedConnectionStatsShmemSize(void);
 static int SharedConnectionHashCompare(const void *a, const void *b, Size keysize);
@@ -145,7 +272,7 @@ StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc tupleDescri
 	bool isNulls[REMOTE_CONNECTION_STATS_COLUMNS];
 
 	/* we're reading all shared connections, prevent any changes */
-	LockConnectionSharedMemory(LW_SHARED);
+	LockAllConnectionSharedMemory(LW_SHARED);
 
 	HASH_SEQ_STATUS status;
 	SharedConnStatsHashEntry *connectionEntry = NULL;
@@ -167,12 +294,28 @@ StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc tupleDescri
 		values[0] = PointerGetDatum(cstring_to_text(connectionEntry->key.hostname));
 		values[1] = Int32GetDatum(connectionEntry->key.port);
 		values[2] = PointerGetDatum(cstring_to_text(databaseName));
-		values[3] = Int32GetDatum(connectionEntry->connectionCount);
+		values[3] = Int32GetDatum(pg_atomic_read_u32(&connectionEntry->connectionCount));
+
+		SpinLockAcquire(&connectionEntry->mutex);
+		values[4] = Int64GetDatum(connectionEntry->connectionWaitCount);
+		values[5] = Float8GetDatum(connectionEntry->connectionWaitTime);
+		values[6] = Int64GetDatum(connectionEntry->connectionEstablishmentCount);
+		values[7] = Float8GetDatum(connectionEntry->connectionEstablishmentTime);
+		values[8] = Int64GetDatum(connectionEntry->sslConnectionCount);
+		values[9] = Int64GetDatum(
+			connectionEntry->classConnectionWaitCount[WORKLOAD_CLASS_INTERACTIVE]);
+		values[10] = Float8GetDatum(
+			connectionEntry->classConnectionWaitTime[WORKLOAD_CLASS_INTERACTIVE]);
+		values[11] = Int64GetDatum(
+			connectionEntry->classConnectionWaitCount[WORKLOAD_CLASS_BATCH]);
+		values[12] = Float8GetDatum(
+			connectionEntry->classConnectionWaitTime[WORKLOAD_CLASS_BATCH]);
+		SpinLockRelease(&connectionEntry->mutex);
 
 		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
 	}
 
-	UnLockConnectionSharedMemory();
+	UnLockAllConnectionSharedMemory();
 }
 
 
@@ -195,24 +338,431 @@ GetMaxSharedPoolSize(void)
 }
 
 
+/*
+ * ConnectionWorkloadClass returns the workload class of a connection that is
+ * opened with the given connection flags. Unless citus.workload_class says
+ * otherwise, connections for executions of multiple tasks are batch
+ * connections and all others are interactive.
+ */
+WorkloadClass
+ConnectionWorkloadClass(uint32 flags)
+{
+	if (WorkloadClassSetting != WORKLOAD_CLASS_AUTO)
+	{
+		return (WorkloadClass) WorkloadClassSetting;
+	}
+
+	if (flags & MULTI_SHARD_EXECUTION)
+	{
+		return WORKLOAD_CLASS_BATCH;
+	}
+
+	return WORKLOAD_CLASS_INTERACTIVE;
+}
+
+
 /*
  * WaitLoopForSharedConnection tries to increment the shared connection
  * counter for the given hostname/port and the current database in
  * SharedConnStatsHash.
  *
- * The function implements a retry mechanism via a condition variable.
+ * The function implements a retry mechanism via the condition variable of
+ * the node's partition. If the backend had to wait, the wait is recorded in
+ * the node's statistics.
+ *
+ * Interactive backends announce that they are waiting, such that batch
+ * backends leave the next free slots to them. Once an interactive backend
+ * got its slot, the waiters are woken up again since batch backends might
+ * have skipped a free slot on its behalf.
  */
 void
-WaitLoopForSharedConnection(const char *hostname, int port)
+WaitLoopForSharedConnection(const char *hostname, int port,
+							WorkloadClass workloadClass)
 {
-	while (!TryToIncrementSharedConnectionCounter(hostname, port))
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+	pg_atomic_uint32 *interactiveWaiterCount = PartitionInteractiveWaiterCount(hashCode);
+	instr_time waitStartTime;
+	bool waited = false;
+
+	while (!TryToIncrementSharedConnectionCounter(hostname, port, workloadClass))
 	{
-		CHECK_FOR_INTERRUPTS();
+		if (!waited)
+		{
+			INSTR_TIME_SET_CURRENT(waitStartTime);
+			waited = true;
+
+			if (workloadClass == WORKLOAD_CLASS_INTERACTIVE)
+			{
+				pg_atomic_fetch_add_u32(interactiveWaiterCount, 1);
+			}
+		}
+
+		PG_TRY();
+		{
+			CHECK_FOR_INTERRUPTS();
 
-		WaitForSharedConnection();
+			WaitForSharedConnection(hashCode);
+		}
+		PG_CATCH();
+		{
+			if (workloadClass == WORKLOAD_CLASS_INTERACTIVE)
+			{
+				pg_atomic_fetch_sub_u32(interactiveWaiterCount, 1);
+				WakeupWaiterBackendsForPartition(hashCode);
+			}
+
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
 	}
 
 	ConditionVariableCancelSleep();
+
+	if (waited)
+	{
+		instr_time waitDuration;
+
+		if (workloadClass == WORKLOAD_CLASS_INTERACTIVE)
+		{
+			pg_atomic_fetch_sub_u32(interactiveWaiterCount, 1);
+			WakeupWaiterBackendsForPartition(hashCode);
+		}
+
+		INSTR_TIME_SET_CURRENT(waitDuration);
+		INSTR_TIME_SUBTRACT(waitDuration, waitStartTime);
+
+		RecordSharedConnectionWait(hostname, port, workloadClass,
+								   INSTR_TIME_GET_MILLISEC(waitDuration));
+	}
+}
+
+
+/*
+ * RecordSharedConnectionWait adds a wait of the given duration, in
+ * milliseconds, for a connection slot of the given workload class to the
+ * statistics of the given hostname and port for the current database.
+ */
+static void
+RecordSharedConnectionWait(const char *hostname, int port,
+						   WorkloadClass workloadClass, double waitTime)
+{
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	/*
+	 * The entry normally exists since we've just incremented its counter, but
+	 * it might be missing if we by-passed the throttling due to lack of space.
+	 */
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		SpinLockAcquire(&connectionEntry->mutex);
+		connectionEntry->connectionWaitCount++;
+		connectionEntry->connectionWaitTime += waitTime;
+		connectionEntry->classConnectionWaitCount[workloadClass]++;
+		connectionEntry->classConnectionWaitTime[workloadClass] += waitTime;
+		SpinLockRelease(&connectionEntry->mutex);
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+}
+
+
+/*
+ * RecordSharedConnectionEstablishment adds a connection that took the given
+ * time, in milliseconds, to establish to the statistics of the given hostname
+ * and port for the current database.
+ */
+void
+RecordSharedConnectionEstablishment(const char *hostname, int port,
+									double establishmentTime, bool usesSSL)
+{
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	/*
+	 * Similar to RecordSharedConnectionWait, the entry might be missing when
+	 * connection throttling is disabled or was by-passed.
+	 */
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		SpinLockAcquire(&connectionEntry->mutex);
+		connectionEntry->connectionEstablishmentCount++;
+		connectionEntry->connectionEstablishmentTime += establishmentTime;
+
+		if (usesSSL)
+		{
+			connectionEntry->sslConnectionCount++;
+		}
+		SpinLockRelease(&connectionEntry->mutex);
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+}
+
+
+/*
+ * RecordSharedTaskExecutions adds the given number of tasks that took the
+ * given total time, in milliseconds, to the statistics of the given hostname
+ * and port for the current database. The executor records the tasks of an
+ * execution at once, such that each execution only takes the lock once per
+ * node.
+ */
+void
+RecordSharedTaskExecutions(const char *hostname, int port, int taskCount,
+						   double totalTaskTime)
+{
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+
+	Assert(taskCount > 0);
+
+	double averageTaskTime = totalTaskTime / taskCount;
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	/* the entry only exists while there are connections to the node */
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		SpinLockAcquire(&connectionEntry->mutex);
+		if (connectionEntry->taskExecutionCount == 0)
+		{
+			connectionEntry->averageTaskExecutionTime = averageTaskTime;
+		}
+		else
+		{
+			connectionEntry->averageTaskExecutionTime =
+				TASK_EXECUTION_TIME_WEIGHT * averageTaskTime +
+				(1.0 - TASK_EXECUTION_TIME_WEIGHT) *
+				connectionEntry->averageTaskExecutionTime;
+		}
+
+		connectionEntry->taskExecutionCount += taskCount;
+		SpinLockRelease(&connectionEntry->mutex);
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+}
+
+
+/*
+ * GetSharedNodeLatencies sets connectionTime and taskTime to the average
+ * time in milliseconds it took to establish a connection to the given hostname
+ * and port and to run a task on it, as recorded by all backends for the
+ * current database. It returns false if either is not known.
+ */
+bool
+GetSharedNodeLatencies(const char *hostname, int port, double *connectionTime,
+					   double *taskTime)
+{
+	bool latenciesFound = false;
+
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled, entries are not maintained */
+		return false;
+	}
+
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		SpinLockAcquire(&connectionEntry->mutex);
+		if (connectionEntry->connectionEstablishmentCount > 0 &&
+			connectionEntry->taskExecutionCount > 0)
+		{
+			*connectionTime = connectionEntry->connectionEstablishmentTime /
+							  connectionEntry->connectionEstablishmentCount;
+			*taskTime = connectionEntry->averageTaskExecutionTime;
+			latenciesFound = true;
+		}
+		SpinLockRelease(&connectionEntry->mutex);
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+
+	return latenciesFound;
+}
+
+
+/*
+ * RecordNodeConnectionFailure records that a connection attempt to the given
+ * node failed. Once citus.node_failure_threshold consecutive attempts failed,
+ * the node is considered suspect, see NodeIsSuspect. The failure is also
+ * counted in the node statistics.
+ */
+void
+RecordNodeConnectionFailure(const char *hostname, int port)
+{
+	NodeHealthHashKey healthKey;
+
+	RecordNodeConnectionAttempt(hostname, port, 0.0, false);
+
+	if (NodeFailureThreshold <= 0)
+	{
+		return;
+	}
+
+	NodeHealthHashKeyFor(hostname, port, &healthKey);
+
+	LWLockAcquire(&ConnectionStatsSharedState->nodeHealthLock.lock, LW_EXCLUSIVE);
+
+	bool entryFound = false;
+	NodeHealthHashEntry *healthEntry =
+		hash_search(NodeHealthHash, &healthKey, HASH_ENTER_NULL, &entryFound);
+
+	/* if the hash is full, we cannot keep track of the node */
+	if (healthEntry != NULL)
+	{
+		if (!entryFound)
+		{
+			healthEntry->consecutiveFailureCount = 0;
+		}
+
+		healthEntry->consecutiveFailureCount++;
+		healthEntry->lastProbeTime = GetCurrentTimestamp();
+
+		if (healthEntry->consecutiveFailureCount == NodeFailureThreshold)
+		{
+			ereport(LOG, (errmsg("marking node %s:%d as unreachable after %d "
+								 "failed connection attempts", hostname, port,
+								 NodeFailureThreshold)));
+		}
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->nodeHealthLock.lock);
+}
+
+
+/*
+ * RecordNodeConnectionSuccess records that a connection to the given node
+ * was established, which makes the node healthy again.
+ */
+void
+RecordNodeConnectionSuccess(const char *hostname, int port)
+{
+	NodeHealthHashKey healthKey;
+
+	if (NodeFailureThreshold <= 0)
+	{
+		return;
+	}
+
+	NodeHealthHashKeyFor(hostname, port, &healthKey);
+
+	LWLockAcquire(&ConnectionStatsSharedState->nodeHealthLock.lock, LW_SHARED);
+
+	bool entryFound = false;
+	hash_search(NodeHealthHash, &healthKey, HASH_FIND, &entryFound);
+
+	LWLockRelease(&ConnectionStatsSharedState->nodeHealthLock.lock);
+
+	if (!entryFound)
+	{
+		/* common case, the node was healthy already */
+		return;
+	}
+
+	LWLockAcquire(&ConnectionStatsSharedState->nodeHealthLock.lock, LW_EXCLUSIVE);
+	hash_search(NodeHealthHash, &healthKey, HASH_REMOVE, NULL);
+	LWLockRelease(&ConnectionStatsSharedState->nodeHealthLock.lock);
+}
+
+
+/*
+ * NodeIsSuspect returns whether the last citus.node_failure_threshold
+ * attempts to connect to the given node failed, in which case callers should
+ * not wait for another connection attempt to time out.
+ *
+ * Once every citus.node_probe_interval, the first caller is told that the
+ * node is fine, such that it probes whether the node is back by connecting
+ * to it. The outcome of that attempt is recorded as usual.
+ */
+bool
+NodeIsSuspect(const char *hostname, int port)
+{
+	NodeHealthHashKey healthKey;
+	bool nodeIsSuspect = false;
+
+	if (NodeFailureThreshold <= 0)
+	{
+		return false;
+	}
+
+	NodeHealthHashKeyFor(hostname, port, &healthKey);
+
+	LWLockAcquire(&ConnectionStatsSharedState->nodeHealthLock.lock, LW_SHARED);
+
+	bool entryFound = false;
+	NodeHealthHashEntry *healthEntry =
+		hash_search(NodeHealthHash, &healthKey, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		nodeIsSuspect = healthEntry->consecutiveFailureCount >= NodeFailureThreshold;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->nodeHealthLock.lock);
+
+	if (!nodeIsSuspect)
+	{
+		return false;
+	}
+
+	LWLockAcquire(&ConnectionStatsSharedState->nodeHealthLock.lock, LW_EXCLUSIVE);
+
+	healthEntry = hash_search(NodeHealthHash, &healthKey, HASH_FIND, &entryFound);
+	if (!entryFound)
+	{
+		/* another backend connected to the node in the meantime */
+		nodeIsSuspect = false;
+	}
+	else if (TimestampDifferenceExceeds(healthEntry->lastProbeTime,
+										GetCurrentTimestamp(), NodeProbeInterval))
+	{
+		/* we get to probe the node, others keep skipping it until we know */
+		healthEntry->lastProbeTime = GetCurrentTimestamp();
+		nodeIsSuspect = false;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->nodeHealthLock.lock);
+
+	return nodeIsSuspect;
+}
+
+
+/*
+ * NodeHealthHashKeyFor fills the given NodeHealthHash key for the given
+ * hostname and port.
+ */
+static void
+NodeHealthHashKeyFor(const char *hostname, int port, NodeHealthHashKey *healthKey)
+{
+	memset(healthKey, 0, sizeof(NodeHealthHashKey));
+	strlcpy(healthKey->hostname, hostname, MAX_NODE_LENGTH);
+	healthKey->port = port;
 }
 
 
@@ -224,11 +774,20 @@ WaitLoopForSharedConnection(const char *hostname, int port)
  * If the function returns true, the caller is allowed (and expected)
  * to establish a new connection to the given node. Else, the caller
  * is not allowed to establish a new connection.
+ *
+ * The counter is incremented via compare-and-swap, such that backends
+ * connecting to the same node only need the partition lock in shared mode.
+ *
+ * Connections of the batch workload class are additionally limited to their
+ * share of the pool, and are not admitted while interactive backends wait
+ * for a slot to a node of the same partition.
  */
 bool
-TryToIncrementSharedConnectionCounter(const char *hostname, int port)
+TryToIncrementSharedConnectionCounter(const char *hostname, int port,
+									  WorkloadClass workloadClass)
 {
-	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	int maxSharedPoolSize = GetMaxSharedPoolSize();
+	if (maxSharedPoolSize == DISABLE_CONNECTION_THROTTLING)
 	{
 		/* connection throttling disabled */
 		return true;
@@ -236,29 +795,10 @@ TryToIncrementSharedConnectionCounter(const char *hostname, int port)
 
 	bool counterIncremented = false;
 	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
 
-	strlcpy(connKey.hostname, hostname, MAX_NODE_LENGTH);
-	if (strlen(hostname) > MAX_NODE_LENGTH)
-	{
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						errmsg("hostname exceeds the maximum length of %d",
-							   MAX_NODE_LENGTH)));
-	}
-
-	connKey.port = port;
-	connKey.databaseOid = MyDatabaseId;
-
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
-
-	/*
-	 * As the hash map is  allocated in shared memory, it doesn't rely on palloc for
-	 * memory allocation, so we could get NULL via HASH_ENTER_NULL when there is no
-	 * space in the shared memory. That's why we prefer continuing the execution
-	 * instead of throwing an error.
-	 */
-	bool entryFound = false;
 	SharedConnStatsHashEntry *connectionEntry =
-		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+		FindOrCreateSharedConnStatsEntry(&connKey, hashCode);
 
 	/*
 	 * It is possible to throw an error at this point, but that doesn't help us in anyway.
@@ -267,70 +807,139 @@ TryToIncrementSharedConnectionCounter(const char *hostname, int port)
 	 */
 	if (!connectionEntry)
 	{
-		UnLockConnectionSharedMemory();
+		UnLockConnectionSharedMemory(hashCode);
 		return true;
 	}
 
-	if (!entryFound)
+	if (workloadClass == WORKLOAD_CLASS_BATCH)
 	{
-		/* we successfully allocated the entry for the first time, so initialize it */
-		connectionEntry->connectionCount = 1;
-
-		counterIncremented = true;
+		if (pg_atomic_read_u32(PartitionInteractiveWaiterCount(hashCode)) > 0 ||
+			!TryToReserveBatchConnectionSlot(connectionEntry, maxSharedPoolSize))
+		{
+			/* leave the slot to interactive backends, or the share is used up */
+			UnLockConnectionSharedMemory(hashCode);
+			return false;
+		}
 	}
-	else if (connectionEntry->connectionCount + 1 > GetMaxSharedPoolSize())
+
+	uint32 connectionCount = pg_atomic_read_u32(&connectionEntry->connectionCount);
+	while (true)
 	{
-		/* there is no space left for this connection */
-		counterIncremented = false;
+		if ((int) connectionCount + 1 > maxSharedPoolSize)
+		{
+			/* there is no space left for this connection */
+			counterIncremented = false;
+			break;
+		}
+
+		/* on failure, connectionCount is updated to the current value */
+		if (pg_atomic_compare_exchange_u32(&connectionEntry->connectionCount,
+										   &connectionCount, connectionCount + 1))
+		{
+			counterIncremented = true;
+			break;
+		}
 	}
-	else
+
+	if (!counterIncremented && workloadClass == WORKLOAD_CLASS_BATCH)
 	{
-		connectionEntry->connectionCount++;
-		counterIncremented = true;
+		ReleaseBatchConnectionSlot(connectionEntry);
 	}
 
-	UnLockConnectionSharedMemory();
+	UnLockConnectionSharedMemory(hashCode);
 
 	return counterIncremented;
 }
 
 
 /*
- * IncrementSharedConnectionCounter increments the shared counter
- * for the given hostname and port.
+ * TryToReserveBatchConnectionSlot increments the number of batch connections
+ * to the node of the given entry, unless that would exceed the share of the
+ * shared pool of the batch workload class. Batch connections are always
+ * allowed at least one connection per node, such that they make progress.
  */
-void
-IncrementSharedConnectionCounter(const char *hostname, int port)
+static bool
+TryToReserveBatchConnectionSlot(SharedConnStatsHashEntry *connectionEntry,
+								int maxSharedPoolSize)
 {
-	SharedConnStatsHashKey connKey;
+	uint32 maxBatchConnectionCount =
+		Max(1, (int64) maxSharedPoolSize * BatchWorkloadPoolShare / 100);
+	uint32 batchConnectionCount =
+		pg_atomic_read_u32(&connectionEntry->batchConnectionCount);
 
-	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	while (batchConnectionCount + 1 <= maxBatchConnectionCount)
 	{
-		/* connection throttling disabled */
-		return;
+		/* on failure, batchConnectionCount is updated to the current value */
+		if (pg_atomic_compare_exchange_u32(&connectionEntry->batchConnectionCount,
+										   &batchConnectionCount,
+										   batchConnectionCount + 1))
+		{
+			return true;
+		}
 	}
 
-	strlcpy(connKey.hostname, hostname, MAX_NODE_LENGTH);
-	if (strlen(hostname) > MAX_NODE_LENGTH)
+	return false;
+}
+
+
+/*
+ * ReleaseBatchConnectionSlot decrements the number of batch connections to the
+ * node of the given entry. The entry might have been recreated since the slot
+ * was reserved, so we never go below 0.
+ */
+static void
+ReleaseBatchConnectionSlot(SharedConnStatsHashEntry *connectionEntry)
+{
+	uint32 batchConnectionCount =
+		pg_atomic_read_u32(&connectionEntry->batchConnectionCount);
+
+	while (batchConnectionCount > 0)
 	{
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						errmsg("hostname exceeds the maximum length of %d",
-							   MAX_NODE_LENGTH)));
+		/* on failure, batchConnectionCount is updated to the current value */
+		if (pg_atomic_compare_exchange_u32(&connectionEntry->batchConnectionCount,
+										   &batchConnectionCount,
+										   batchConnectionCount - 1))
+		{
+			break;
+		}
 	}
+}
 
-	connKey.port = port;
-	connKey.databaseOid = MyDatabaseId;
 
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
+/*
+ * PartitionInteractiveWaiterCount returns the counter of interactive backends
+ * that wait for a connection slot to a node in the partition of the given
+ * hash value.
+ */
+static pg_atomic_uint32 *
+PartitionInteractiveWaiterCount(uint32 hashCode)
+{
+	uint32 partitionIndex = hashCode % SHARED_CONN_STATS_PARTITIONS;
+
+	return &ConnectionStatsSharedState->interactiveWaiterCounts[partitionIndex];
+}
+
+
+/*
+ * IncrementSharedConnectionCounter increments the shared counter
+ * for the given hostname and port, regardless of the share of the given
+ * workload class.
+ */
+void
+IncrementSharedConnectionCounter(const char *hostname, int port,
+								 WorkloadClass workloadClass)
+{
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled */
+		return;
+	}
+
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
 
-	/*
-	 * As the hash map is  allocated in shared memory, it doesn't rely on palloc for
-	 * memory allocation, so we could get NULL via HASH_ENTER_NULL. That's why we prefer
-	 * continuing the execution instead of throwing an error.
-	 */
-	bool entryFound = false;
 	SharedConnStatsHashEntry *connectionEntry =
-		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+		FindOrCreateSharedConnStatsEntry(&connKey, hashCode);
 
 	/*
 	 * It is possible to throw an error at this point, but that doesn't help us in anyway.
@@ -339,7 +948,7 @@ IncrementSharedConnectionCounter(const char *hostname, int port)
 	 */
 	if (!connectionEntry)
 	{
-		UnLockConnectionSharedMemory();
+		UnLockConnectionSharedMemory(hashCode);
 
 		ereport(DEBUG4, (errmsg("No entry found for node %s:%d while incrementing "
 								"connection counter", hostname, port)));
@@ -347,57 +956,49 @@ IncrementSharedConnectionCounter(const char *hostname, int port)
 		return;
 	}
 
-	if (!entryFound)
+	pg_atomic_fetch_add_u32(&connectionEntry->connectionCount, 1);
+
+	if (workloadClass == WORKLOAD_CLASS_BATCH)
 	{
-		/* we successfully allocated the entry for the first time, so initialize it */
-		connectionEntry->connectionCount = 0;
+		pg_atomic_fetch_add_u32(&connectionEntry->batchConnectionCount, 1);
 	}
 
-	connectionEntry->connectionCount += 1;
-
-	UnLockConnectionSharedMemory();
+	UnLockConnectionSharedMemory(hashCode);
 }
 
 
 /*
  * DecrementSharedConnectionCounter decrements the shared counter
- * for the given hostname and port.
+ * for the given hostname and port, as well as the counter of the workload
+ * class that opened the connection.
  */
 void
-DecrementSharedConnectionCounter(const char *hostname, int port)
+DecrementSharedConnectionCounter(const char *hostname, int port,
+								 WorkloadClass workloadClass)
 {
-	SharedConnStatsHashKey connKey;
-
 	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
 	{
 		/* connection throttling disabled */
 		return;
 	}
 
-	strlcpy(connKey.hostname, hostname, MAX_NODE_LENGTH);
-	if (strlen(hostname) > MAX_NODE_LENGTH)
-	{
-		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-						errmsg("hostname exceeds the maximum length of %d",
-							   MAX_NODE_LENGTH)));
-	}
-
-	connKey.port = port;
-	connKey.databaseOid = MyDatabaseId;
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
 
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
 
 	bool entryFound = false;
 	SharedConnStatsHashEntry *connectionEntry =
-		hash_search(SharedConnStatsHash, &connKey, HASH_FIND, &entryFound);
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
 
 	/* this worker node is removed or updated, no need to care */
 	if (!entryFound)
 	{
-		UnLockConnectionSharedMemory();
+		UnLockConnectionSharedMemory(hashCode);
 
 		/* wake up any waiters in case any backend is waiting for this node */
-		WakeupWaiterBackendsForSharedConnection();
+		WakeupWaiterBackendsForPartition(hashCode);
 
 		ereport(DEBUG4, (errmsg("No entry found for node %s:%d while decrementing "
 								"connection counter", hostname, port)));
@@ -406,11 +1007,19 @@ DecrementSharedConnectionCounter(const char *hostname, int port)
 	}
 
 	/* we should never go below 0 */
-	Assert(connectionEntry->connectionCount > 0);
+	Assert(pg_atomic_read_u32(&connectionEntry->connectionCount) > 0);
 
-	connectionEntry->connectionCount -= 1;
+	if (workloadClass == WORKLOAD_CLASS_BATCH)
+	{
+		ReleaseBatchConnectionSlot(connectionEntry);
+	}
 
-	if (connectionEntry->connectionCount == 0)
+	uint32 connectionCount =
+		pg_atomic_sub_fetch_u32(&connectionEntry->connectionCount, 1);
+
+	UnLockConnectionSharedMemory(hashCode);
+
+	if (connectionCount == 0)
 	{
 		/*
 		 * We don't have to remove at this point as the node might be still active
@@ -419,23 +1028,185 @@ DecrementSharedConnectionCounter(const char *hostname, int port)
 		 * not busy, and given the default value of MaxCachedConnectionsPerWorker = 1,
 		 * we're unlikely to trigger this often.
 		 */
-		hash_search(SharedConnStatsHash, &connKey, HASH_REMOVE, &entryFound);
+		RemoveSharedConnStatsEntryIfUnused(&connKey, hashCode);
+	}
+
+	WakeupWaiterBackendsForPartition(hashCode);
+}
+
+
+/*
+ * GetSharedConnectionCounter returns the number of connections that the
+ * backends on this node have to the given hostname and port for the current
+ * database. It returns 0 if connection throttling is disabled, since the
+ * counters are not maintained in that case.
+ */
+int
+GetSharedConnectionCounter(const char *hostname, int port)
+{
+	int connectionCount = 0;
+
+	if (GetMaxSharedPoolSize() == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled */
+		return 0;
+	}
+
+	SharedConnStatsHashKey connKey;
+	uint32 hashCode = SharedConnStatsHashCode(hostname, port, &connKey);
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, &connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		connectionCount = pg_atomic_read_u32(&connectionEntry->connectionCount);
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+
+	return connectionCount;
+}
+
+
+/*
+ * SharedConnStatsHashCode fills the given key for the given hostname and port
+ * and the current database, and returns its hash value, which also determines
+ * the partition of the key.
+ */
+static uint32
+SharedConnStatsHashCode(const char *hostname, int port, SharedConnStatsHashKey *connKey)
+{
+	if (strlen(hostname) > MAX_NODE_LENGTH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hostname exceeds the maximum length of %d",
+							   MAX_NODE_LENGTH)));
+	}
+
+	memset(connKey, 0, sizeof(SharedConnStatsHashKey));
+	strlcpy(connKey->hostname, hostname, MAX_NODE_LENGTH);
+	connKey->port = port;
+	connKey->databaseOid = MyDatabaseId;
+
+	return get_hash_value(SharedConnStatsHash, connKey);
+}
+
+
+/*
+ * FindOrCreateSharedConnStatsEntry returns the entry for the given key, or
+ * NULL if there is no space left in the shared memory for a new entry. In
+ * both cases, the function returns with the partition lock of the key held,
+ * which the caller should release via UnLockConnectionSharedMemory().
+ *
+ * The common case of an existing entry only takes the lock in shared mode,
+ * the exclusive lock is only taken when the entry needs to be created.
+ */
+static SharedConnStatsHashEntry *
+FindOrCreateSharedConnStatsEntry(SharedConnStatsHashKey *connKey, uint32 hashCode)
+{
+	bool entryFound = false;
+
+	LockConnectionSharedMemory(hashCode, LW_SHARED);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		return connectionEntry;
+	}
+
+	UnLockConnectionSharedMemory(hashCode);
+	LockConnectionSharedMemory(hashCode, LW_EXCLUSIVE);
+
+	/*
+	 * As the hash map is  allocated in shared memory, it doesn't rely on palloc for
+	 * memory allocation, so we could get NULL via HASH_ENTER_NULL when there is no
+	 * space in the shared memory. That's why we prefer continuing the execution
+	 * instead of throwing an error.
+	 */
+	connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, connKey, hashCode,
+									HASH_ENTER_NULL, &entryFound);
+	if (connectionEntry != NULL && !entryFound)
+	{
+		/* we successfully allocated the entry for the first time, so initialize it */
+		InitializeSharedConnStatsEntry(connectionEntry);
+	}
+
+	return connectionEntry;
+}
+
+
+/*
+ * InitializeSharedConnStatsEntry initializes a newly allocated entry.
+ */
+static void
+InitializeSharedConnStatsEntry(SharedConnStatsHashEntry *connectionEntry)
+{
+	pg_atomic_init_u32(&connectionEntry->connectionCount, 0);
+	pg_atomic_init_u32(&connectionEntry->batchConnectionCount, 0);
+	SpinLockInit(&connectionEntry->mutex);
+
+	connectionEntry->connectionWaitCount = 0;
+	connectionEntry->connectionWaitTime = 0.0;
+
+	for (int classIndex = 0; classIndex < WORKLOAD_CLASS_COUNT; classIndex++)
+	{
+		connectionEntry->classConnectionWaitCount[classIndex] = 0;
+		connectionEntry->classConnectionWaitTime[classIndex] = 0.0;
 	}
 
-	UnLockConnectionSharedMemory();
+	connectionEntry->connectionEstablishmentCount = 0;
+	connectionEntry->connectionEstablishmentTime = 0.0;
+	connectionEntry->sslConnectionCount = 0;
+	connectionEntry->taskExecutionCount = 0;
+	connectionEntry->averageTaskExecutionTime = 0.0;
+}
+
+
+/*
+ * RemoveSharedConnStatsEntryIfUnused removes the entry for the given key if
+ * there are no connections to the node. Since other backends might have
+ * incremented the counter after we decremented it to zero, the counter is
+ * re-checked while holding the partition lock in exclusive mode.
+ */
+static void
+RemoveSharedConnStatsEntryIfUnused(SharedConnStatsHashKey *connKey, uint32 hashCode)
+{
+	bool entryFound = false;
+
+	LockConnectionSharedMemory(hashCode, LW_EXCLUSIVE);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search_with_hash_value(SharedConnStatsHash, connKey, hashCode,
+									HASH_FIND, &entryFound);
+	if (entryFound && pg_atomic_read_u32(&connectionEntry->connectionCount) == 0)
+	{
+		hash_search_with_hash_value(SharedConnStatsHash, connKey, hashCode,
+									HASH_REMOVE, &entryFound);
+	}
 
-	WakeupWaiterBackendsForSharedConnection();
+	UnLockConnectionSharedMemory(hashCode);
 }
 
 
 /*
  * LockConnectionSharedMemory is a utility function that should be used when
- * accessing to the SharedConnStatsHash, which is in the shared memory.
+ * accessing to the partition of SharedConnStatsHash that the given hash value
+ * belongs to.
  */
 static void
-LockConnectionSharedMemory(LWLockMode lockMode)
+LockConnectionSharedMemory(uint32 hashCode, LWLockMode lockMode)
 {
-	LWLockAcquire(&ConnectionStatsSharedState->sharedConnectionHashLock, lockMode);
+	uint32 partitionIndex = hashCode % SHARED_CONN_STATS_PARTITIONS;
+
+	LWLockAcquire(&ConnectionStatsSharedState->partitionLocks[partitionIndex].lock,
+				  lockMode);
 }
 
 
@@ -444,46 +1215,102 @@ LockConnectionSharedMemory(LWLockMode lockMode)
  * LockConnectionSharedMemory().
  */
 static void
-UnLockConnectionSharedMemory(void)
+UnLockConnectionSharedMemory(uint32 hashCode)
+{
+	uint32 partitionIndex = hashCode % SHARED_CONN_STATS_PARTITIONS;
+
+	LWLockRelease(&ConnectionStatsSharedState->partitionLocks[partitionIndex].lock);
+}
+
+
+/*
+ * LockAllConnectionSharedMemory locks all partitions of SharedConnStatsHash,
+ * always in the same order to avoid deadlocks.
+ */
+static void
+LockAllConnectionSharedMemory(LWLockMode lockMode)
+{
+	for (int partitionIndex = 0; partitionIndex < SHARED_CONN_STATS_PARTITIONS;
+		 partitionIndex++)
+	{
+		LWLockAcquire(&ConnectionStatsSharedState->partitionLocks[partitionIndex].lock,
+					  lockMode);
+	}
+}
+
+
+/*
+ * UnLockAllConnectionSharedMemory is a utility function that should be used
+ * after LockAllConnectionSharedMemory().
+ */
+static void
+UnLockAllConnectionSharedMemory(void)
 {
-	LWLockRelease(&ConnectionStatsSharedState->sharedConnectionHashLock);
+	for (int partitionIndex = SHARED_CONN_STATS_PARTITIONS - 1; partitionIndex >= 0;
+		 partitionIndex--)
+	{
+		LWLockRelease(&ConnectionStatsSharedState->partitionLocks[partitionIndex].lock);
+	}
 }
 
 
 /*
- * WakeupWaiterBackendsForSharedConnection is a wrapper around the condition variable
- * broadcast operation.
+ * WakeupWaiterBackendsForSharedConnection wakes up the backends waiting for
+ * a connection slot to any node.
  *
- * We use a single condition variable, for all worker nodes, to implement the connection
- * throttling mechanism. Combination of all the backends are allowed to establish
- * MaxSharedPoolSize number of connections per worker node. If a backend requires a
- * non-optional connection (see WAIT_FOR_CONNECTION for details), it is not allowed
- * to establish it immediately if the total connections are equal to MaxSharedPoolSize.
- * Instead, the backend waits on the condition variable. When any other backend
- * terminates an existing connection to any remote node, this function is called.
- * The main goal is to trigger all waiting backends to try getting a connection slot
- * in MaxSharedPoolSize. The ones which can get connection slot are allowed to continue
- * with the connection establishments. Others should wait another backend to call
- * this function.
+ * We use one condition variable per partition of the worker nodes to implement
+ * the connection throttling mechanism. Combination of all the backends are
+ * allowed to establish MaxSharedPoolSize number of connections per worker node.
+ * If a backend requires a non-optional connection (see WAIT_FOR_CONNECTION for
+ * details), it is not allowed to establish it immediately if the total
+ * connections are equal to MaxSharedPoolSize. Instead, the backend waits on the
+ * condition variable of the node's partition. When any other backend terminates
+ * an existing connection to a remote node, only the waiters of that node's
+ * partition are woken up, see WakeupWaiterBackendsForPartition(). The ones which
+ * can get connection slot are allowed to continue with the connection
+ * establishments. Others should wait another backend to wake them up.
  */
 void
 WakeupWaiterBackendsForSharedConnection(void)
 {
-	ConditionVariableBroadcast(&ConnectionStatsSharedState->waitersConditionVariable);
+	for (int partitionIndex = 0; partitionIndex < SHARED_CONN_STATS_PARTITIONS;
+		 partitionIndex++)
+	{
+		ConditionVariableBroadcast(
+			&ConnectionStatsSharedState->waitersConditionVariables[partitionIndex]);
+	}
 }
 
 
 /*
- * WaitForSharedConnection is a wrapper around the condition variable sleep operation.
+ * WakeupWaiterBackendsForPartition is a wrapper around the condition variable
+ * broadcast operation for the partition that the given hash value belongs to.
+ */
+static void
+WakeupWaiterBackendsForPartition(uint32 hashCode)
+{
+	uint32 partitionIndex = hashCode % SHARED_CONN_STATS_PARTITIONS;
+
+	ConditionVariableBroadcast(
+		&ConnectionStatsSharedState->waitersConditionVariables[partitionIndex]);
+}
+
+
+/*
+ * WaitForSharedConnection is a wrapper around the condition variable sleep
+ * operation for the partition that the given hash value belongs to.
  *
- * For the details of the use of the condition variable, see
+ * For the details of the use of the condition variables, see
  * WakeupWaiterBackendsForSharedConnection().
  */
-void
-WaitForSharedConnection(void)
+static void
+WaitForSharedConnection(uint32 hashCode)
 {
-	ConditionVariableSleep(&ConnectionStatsSharedState->waitersConditionVariable,
-						   PG_WAIT_EXTENSION);
+	uint32 partitionIndex = hashCode % SHARED_CONN_STATS_PARTITIONS;
+
+	ConditionVariableSleep(
+		&ConnectionStatsSharedState->waitersConditionVariables[partitionIndex],
+		WAIT_EVENT_CITUS_SHARED_CONNECTION_SLOT);
 }
 
 
@@ -521,6 +1348,11 @@ SharedConnectionStatsShmemSize(void)
 
 	size = add_size(size, hashSize);
 
+	Size healthHashSize = hash_estimate_size(MaxWorkerNodesTracked,
+											 sizeof(NodeHealthHashEntry));
+
+	size = add_size(size, healthHashSize);
+
 	return size;
 }
 
@@ -541,7 +1373,8 @@ SharedConnectionStatsShmemInit(void)
 	info.entrysize = sizeof(SharedConnStatsHashEntry);
 	info.hash = SharedConnectionHashHash;
 	info.match = SharedConnectionHashCompare;
-	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
+	info.num_partitions = SHARED_CONN_STATS_PARTITIONS;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_PARTITION);
 
 	/*
 	 * Currently the lock isn't required because allocation only happens at
@@ -564,10 +1397,23 @@ SharedConnectionStatsShmemInit(void)
 		LWLockRegisterTranche(ConnectionStatsSharedState->sharedConnectionHashTrancheId,
 							  ConnectionStatsSharedState->sharedConnectionHashTrancheName);
 
-		LWLockInitialize(&ConnectionStatsSharedState->sharedConnectionHashLock,
-						 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
+		for (int partitionIndex = 0; partitionIndex < SHARED_CONN_STATS_PARTITIONS;
+			 partitionIndex++)
+		{
+			LWLock *partitionLock =
+				&ConnectionStatsSharedState->partitionLocks[partitionIndex].lock;
+
+			LWLockInitialize(partitionLock,
+							 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
+
+			ConditionVariableInit(
+				&ConnectionStatsSharedState->waitersConditionVariables[partitionIndex]);
+			pg_atomic_init_u32(
+				&ConnectionStatsSharedState->interactiveWaiterCounts[partitionIndex], 0);
+		}
 
-		ConditionVariableInit(&ConnectionStatsSharedState->waitersConditionVariable);
+		LWLockInitialize(&ConnectionStatsSharedState->nodeHealthLock.lock,
+						 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
 	}
 
 	/*  allocate hash table */
@@ -575,6 +1421,16 @@ SharedConnectionStatsShmemInit(void)
 		ShmemInitHash("Shared Conn. Stats Hash", MaxWorkerNodesTracked,
 					  MaxWorkerNodesTracked, &info, hashFlags);
 
+	/* create (hostname, port) -> [consecutive failures] */
+	HASHCTL healthInfo;
+	memset(&healthInfo, 0, sizeof(healthInfo));
+	healthInfo.keysize = sizeof(NodeHealthHashKey);
+	healthInfo.entrysize = sizeof(NodeHealthHashEntry);
+
+	NodeHealthHash =
+		ShmemInitHash("Citus Node Health Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &healthInfo, HASH_ELEM | HASH_BLOBS);
+
 	LWLockRelease(AddinShmemInitLock);
 
 	Assert(SharedConnStatsHash != NULL);
@@ -26,6 +26,7 @@
 #include "catalog/dependency.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_attribute.h"
 #include "catalog/pg_authid.h"
 #include "catalog/pg_class.h"
@@ -447,6 +448,17 @@ pg_get_tableschemadef_string(Oid tableRelationId, bool includeSequenceDefaults)
 		appendStringInfo(&buffer, " PARTITION BY %s ", partitioningInformation);
 	}
 
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+	/* add the access method of tables that do not use the default heap */
+	if (relationKind == RELKIND_RELATION &&
+		relation->rd_rel->relam != HEAP_TABLE_AM_OID)
+	{
+		char *accessMethodName = get_am_name(relation->rd_rel->relam);
+		appendStringInfo(&buffer, " USING %s", quote_identifier(accessMethodName));
+	}
+#endif
+
 	/*
 	 * Add any reloptions (storage parameters) defined on the table in a WITH
 	 * clause.
@@ -112,6 +112,49 @@
  * writes to a reference table that has foreign keys from a distributed
  * table.
  *
+ * When citus.executor_batch_size is larger than 1, a session that picks up
+ * a modification which does not return rows also picks up other ready
+ * modifications of the same kind and sends them as a single multi-statement
+ * query. This trades parallelism within a worker for fewer round trips,
+ * which pays off when there are many small tasks per worker. Since every
+ * statement produces exactly one command result, ReceiveResults can
+ * attribute the results to the placement executions in the batch in order.
+ *
+ * When citus.enable_streaming_execution is on, read-only executions do not
+ * run the event loop to completion in AdaptiveExecutor. Instead, the loop
+ * returns whenever new rows are in the tuple store and is resumed by
+ * ContinueStreamingExecution once the scan has returned those rows, such
+ * that the first rows reach the client while other tasks are still running.
+ * When citus.enable_streaming_returning is on, the same happens for the
+ * RETURNING rows of multi-shard modifications, unless citus.sort_returning
+ * requires all rows to be sorted first. es_processed is then only set once
+ * the last task is done.
+ * Streaming executions keep their connections, so they are run to completion
+ * as soon as another execution starts, see FinishStreamingExecutions.
+ *
+ * When citus.enable_adaptive_pool_sizing is on, the executor records how long
+ * tasks take per worker in shared memory, next to the connection establishment
+ * times. Worker pools for which both are known open connections based on them
+ * instead of the slow start interval, see LatencyBasedNewConnectionCount.
+ *
+ * When citus.hedged_read_delay is set, a read-only task on a replicated shard
+ * that has not started returning rows within that time is also started on
+ * the next placement. The rows of whichever placement returns them first are
+ * used, and the query on the other placement is cancelled. This only happens
+ * outside of coordinated transactions, since cancelling a query aborts the
+ * remote transaction block it runs in.
+ *
+ * When citus.enable_distributed_tracing is on, every placement execution
+ * gets a span id, which is sent to the worker in a traceparent comment in
+ * front of the command, and its span is recorded once it is done, see
+ * distributed_tracing.c.
+ *
+ * When citus.enable_limit_cancellation is on and the remote scan is read by
+ * a LIMIT without ORDER BY, the execution stops once it received enough rows.
+ * Tasks that were not sent yet are skipped, and running queries are cancelled
+ * outside of coordinated transactions, or otherwise read without storing
+ * their rows.
+ *
  * Execution finishes when all tasks are done, the query errors out, or
  * the user cancels the query.
  *
@@ -124,9 +167,11 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include <math.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "access/htup_details.h"
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
@@ -136,28 +181,50 @@
 #include "distributed/cancel_utils.h"
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/distributed_tracing.h"
+#include "distributed/inline_intermediate_results.h"
+#include "distributed/lag_aware_routing.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_explain.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_resowner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/node_stats.h"
 #include "distributed/placement_access.h"
 #include "distributed/placement_connection.h"
+#include "distributed/query_progress.h"
+#include "distributed/query_result_cache.h"
+#include "distributed/query_stats.h"
+#include "distributed/received_row_combiner.h"
+#include "distributed/received_row_merger.h"
+#include "distributed/received_row_top_n.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/subplan_result_cache.h"
+#include "distributed/task_coalescing.h"
+#include "distributed/transaction_identifier.h"
 #include "distributed/transaction_management.h"
+#include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "lib/ilist.h"
+#include "optimizer/paths.h"
 #include "portability/instr_time.h"
 #include "storage/fd.h"
 #include "storage/latch.h"
@@ -168,6 +235,12 @@
 
 #define SLOW_START_DISABLED 0
 
+/* waitEventSetIndex of sessions that are not part of the wait event set */
+#define WAIT_EVENT_SET_INDEX_NOT_INITIALIZED -1
+
+/* minimum number of sessions the wait event set has room for */
+#define MIN_WAIT_EVENT_SET_SESSIONS 8
+
 
 /*
  * DistributedExecution represents the execution of a distributed query
@@ -197,6 +270,18 @@ typedef struct DistributedExecution
 	TupleDesc tupleDescriptor;
 	Tuplestorestate *tupleStore;
 
+	/*
+	 * Combines received rows per group before they are stored in tupleStore.
+	 * NULL if received rows are stored directly.
+	 */
+	ReceivedRowCombiner *rowCombiner;
+
+	/* keeps only the first rows in sort order of the received rows, if any */
+	ReceivedRowTopN *rowTopN;
+
+	/* merges the sorted results of the tasks, if the plan requires it */
+	ReceivedRowMerger *rowMerger;
+
 
 	/* list of workers involved in the execution */
 	List *workerList;
@@ -211,15 +296,14 @@ typedef struct DistributedExecution
 	bool rebuildWaitEventSet;
 
 	/*
-	 * Flag to indiciate that the set of wait events we are interested
-	 * in might have changed and waitEventSet needs to be updated.
-	 *
-	 * Note that we set this flag whenever we assign a value to waitFlags,
-	 * but we don't check that the waitFlags is actually different from the
-	 * previous value. So we might have some false positives for this flag,
-	 * which is OK, because in this case ModifyWaitEvent() is noop.
+	 * Sessions that were added, or whose wait flags changed, since the
+	 * waitEventSet was last updated. Only these sessions are added to or
+	 * modified in the waitEventSet, unless it needs to be rebuilt anyway.
 	 */
-	bool waitFlagsChanged;
+	List *waitEventUpdateSessionList;
+
+	/* number of sessions that are part of the waitEventSet */
+	int waitEventSetSessionCount;
 
 	/*
 	 * WaitEventSet used for waiting for I/O events.
@@ -233,6 +317,44 @@ typedef struct DistributedExecution
 	 */
 	WaitEventSet *waitEventSet;
 
+	/*
+	 * Events returned by WaitEventSetWait and the size of the array, which is
+	 * also the capacity of the waitEventSet. These are kept here, rather than
+	 * being local to RunDistributedExecution(), since a streaming execution
+	 * leaves and re-enters the event loop several times.
+	 */
+	WaitEvent *events;
+	int eventSetSize;
+
+	/* whether the connection state machines were stepped for the first time */
+	bool eventLoopStarted;
+
+	/* whether all tasks are done and the sessions are cleaned up */
+	bool eventLoopFinished;
+
+	/*
+	 * Whether the event loop should only poll the connections without blocking,
+	 * and return once no more events are ready. This is used to send the remote
+	 * tasks before the local tasks are executed.
+	 */
+	bool dispatchOnly;
+
+	/*
+	 * For streaming executions, results that arrive after the scan has ended
+	 * are not stored, but we still need to read them from the connections.
+	 */
+	bool discardResults;
+
+	/* frees the wait event set if the execution is abandoned due to an error */
+	MemoryContextCallback waitEventSetCleanupCallback;
+
+	/*
+	 * Scan of a streaming execution that is not finished yet, and its node in
+	 * StreamingExecutionList. NULL for other executions.
+	 */
+	CitusScanState *streamingScanState;
+	dlist_node streamingExecutionNode;
+
 	/*
 	 * The number of connections we aim to open per worker.
 	 *
@@ -247,6 +369,34 @@ typedef struct DistributedExecution
 	/* number of tasks that still need to be executed */
 	int unfinishedTaskCount;
 
+	/* whether slow read-only tasks are also started on another placement */
+	bool hedgeReads;
+
+	/* whether task durations are recorded for adaptive pool sizing */
+	bool recordTaskTimes;
+
+	/* trace id of the spans of the placement executions, or NULL */
+	char *traceId;
+
+	/* query id that is recorded in the spans */
+	uint64 traceQueryId;
+
+	/*
+	 * Number of placement executions that lost the race against another
+	 * placement of the same task and were cancelled, but whose connections
+	 * still need to be read until the query ended.
+	 */
+	int cancelledPlacementExecutionCount;
+
+	/*
+	 * Number of received rows after which the remaining tasks are skipped,
+	 * since the remote scan is read by a LIMIT. 0 if all rows are needed.
+	 */
+	uint64 rowLimit;
+
+	/* all ShardCommandExecutions of the execution */
+	List *shardCommandExecutionList;
+
 	/*
 	 * Flag to indicate whether throwing errors on cancellation is
 	 * allowed.
@@ -270,6 +420,9 @@ typedef struct DistributedExecution
 	 */
 	uint64 rowsProcessed;
 
+	/* total size of the rows built from the results of the workers */
+	uint64 receivedRowBytes;
+
 	/* statistics on distributed execution */
 	DistributedExecutionStats *executionStats;
 
@@ -277,18 +430,49 @@ typedef struct DistributedExecution
 	 * The following fields are used while receiving results from remote nodes.
 	 * We store this information here to avoid re-allocating it every time.
 	 *
-	 * columnArray field is reset/calculated per row, so might be useless for other
-	 * contexts. The benefit of keeping it here is to avoid allocating the array
-	 * over and over again.
+	 * Each received row is decoded directly into the values and nulls arrays of
+	 * receivedRowSlot. Memory allocated by the input functions goes into
+	 * rowContext, which is reset after every row.
 	 */
 	AttInMetadata *attributeInputMetadata;
-	char **columnArray;
+	TupleTableSlot *receivedRowSlot;
+	MemoryContext rowContext;
+
+	/*
+	 * When citus.enable_binary_protocol is on and all columns can be sent in
+	 * binary, results are requested in binary format and decoded with the
+	 * receive functions of the column types. The arrays are indexed by column
+	 * and allocated once per execution. columnWireTypes holds the type that
+	 * workers report for each column, which is the base type for domains.
+	 */
+	bool binaryResults;
+	FmgrInfo *columnReceiveFunctions;
+	Oid *columnTypeIOParams;
+	Oid *columnWireTypes;
+	StringInfo columnBuffer;
 
 	/*
 	 * jobIdList contains all jobs in the job tree, this is used to
 	 * do cleanup for repartition queries.
 	 */
 	List *jobIdList;
+
+	/*
+	 * Whether WorkerPoolExecutionStats are collected for EXPLAIN ANALYZE or
+	 * citus_stat_statements, and the time at which the remote part of the
+	 * execution started.
+	 */
+	bool collectWorkerPoolStats;
+	instr_time workerPoolStatsStartTime;
+
+	/*
+	 * Whether the tasks return their EXPLAIN ANALYZE output after their rows,
+	 * see citus.explain_analyze_single_pass.
+	 */
+	bool explainAnalyzeTasks;
+
+	/* progress published for citus_stat_progress_query, NULL if none */
+	QueryProgress *queryProgress;
 } DistributedExecution;
 
 
@@ -377,11 +561,48 @@ typedef struct WorkerPool
 	/* maximum number of connections we are allowed to open at once */
 	uint32 maxNewConnectionsPerCycle;
 
+	/* number of tasks in the execution that start on this worker */
+	int assignedTaskCount;
+
+	/*
+	 * Average time in ms to establish a connection to the worker and to run a
+	 * task on it, as observed by previous executions, if known. Used instead
+	 * of slow start to decide how many connections to open.
+	 */
+	bool hasLatencyEstimates;
+	double expectedConnectionTime;
+	double expectedTaskTime;
+
+	/* tasks that finished on the worker and their total time, to be recorded */
+	int finishedTaskCount;
+	double finishedTaskTime;
+
+	/*
+	 * Number of connections of all backends to the worker when the pool was
+	 * created, only used by the adaptive task assignment policy.
+	 */
+	int sharedConnectionCount;
+
+	/*
+	 * Whether recent connection attempts to the worker failed, in which case
+	 * we fail the pool instead of waiting for the connection timeout.
+	 */
+	bool nodeIsSuspect;
+
 	/*
 	 * This is only set in WorkerPoolFailed() function. Once a pool fails, we do not
 	 * use it anymore.
 	 */
 	bool failed;
+
+	/* statistics for EXPLAIN ANALYZE, NULL unless they are collected */
+	WorkerPoolExecutionStats *poolStats;
+
+	/* cumulative statistics of the worker, NULL if they are not tracked */
+	NodeStatsHashEntry *nodeStats;
+
+	/* progress of the execution on the worker, NULL if it is not published */
+	QueryProgressWorker *progress;
 } WorkerPool;
 
 struct TaskPlacementExecution;
@@ -418,15 +639,45 @@ typedef struct WorkerSession
 	/* task the worker should work on or NULL */
 	struct TaskPlacementExecution *currentTask;
 
+	/*
+	 * Placement executions that were sent in the same command as currentTask
+	 * (see citus.executor_batch_size). Their results follow those of
+	 * currentTask, in the order of the list.
+	 */
+	List *batchedTaskList;
+
+	/*
+	 * Number of results of a transaction block start or of savepoints that
+	 * precede the results of currentTask, when both were sent in the same
+	 * command (see citus.enable_coalesced_begin).
+	 */
+	int pendingBeginResultCount;
+
+	/*
+	 * Whether the rows of currentTask are followed by its EXPLAIN ANALYZE
+	 * output, and whether that output is being received.
+	 */
+	bool explainAnalyzeResultPending;
+	bool receivingExplainAnalyzeResult;
+
+	/*
+	 * Statement that is being prepared on the worker for currentTask, which is
+	 * sent once the statement is prepared (see citus.enable_worker_prepared_statements).
+	 */
+	WorkerPreparedStatement *pendingPreparedStatement;
+
 	/*
 	 * The number of commands sent to the worker over the session. Excludes
 	 * distributed transaction related commands such as BEGIN/COMMIT etc.
 	 */
 	uint64 commandsSent;
 
-	/* index in the wait event set */
+	/* index in the wait event set, or -1 if not part of the wait event set */
 	int waitEventSetIndex;
 
+	/* whether the session is in the waitEventUpdateSessionList of the execution */
+	bool waitEventUpdatePending;
+
 	/* events reported by the latest call to WaitEventSetWait */
 	int latestUnconsumedWaitEvents;
 } WorkerSession;
@@ -441,6 +692,52 @@ int MaxAdaptiveExecutorPoolSize = 16;
 /* GUC, number of ms to wait between opening connections to the same worker */
 int ExecutorSlowStartInterval = 10;
 
+/* GUC, maximum number of shard commands sent in a single round trip */
+int ExecutorBatchSize = 1;
+
+/* GUC, determining whether results are requested from workers in binary format */
+bool EnableBinaryProtocol = false;
+
+/* GUC, determining whether read-only results are returned while tasks still run */
+bool EnableStreamingExecution = false;
+
+/* GUC, determining whether results are streamed when fetched incrementally */
+bool EnableCursorStreaming = false;
+
+/* GUC, determining whether RETURNING rows of modifications are streamed */
+bool EnableStreamingReturning = false;
+
+/* GUC, memory in kB the tuple store of a scan uses before spilling, -1 for work_mem */
+int ExecutorResultMemory = -1;
+
+/* GUC, time in ms after which slow reads are also started on another placement */
+int HedgedReadDelay = 0;
+
+/* GUC, determining whether tasks are skipped once a LIMIT has enough rows */
+bool EnableLimitCancellation = false;
+
+/* GUC, determining whether pool sizes are based on observed latencies */
+bool EnableAdaptivePoolSizing = false;
+
+/* GUC, determining whether BEGIN is sent in the same command as the first task */
+bool EnableCoalescedBegin = false;
+
+/* GUC, determining whether remote tasks are sent before local tasks are executed */
+bool EnableConcurrentLocalExecution = false;
+
+/* GUC, number of parallel workers the scans of large shards share per node */
+int ParallelWorkersPerNode = 0;
+
+/* streaming executions that still hold their connections, in start order */
+static dlist_head StreamingExecutionList = DLIST_STATIC_INIT(StreamingExecutionList);
+
+/*
+ * Number of results of the command returned by RemoteTransactionBeginCommand()
+ * when there are no savepoints or SET LOCALs to replay: one for BEGIN and one
+ * for assign_distributed_transaction_id().
+ */
+#define COALESCED_BEGIN_RESULT_COUNT 2
+
 
 /*
  * TaskExecutionState indicates whether or not a command on a shard
@@ -492,6 +789,15 @@ typedef struct ShardCommandExecution
 	bool gotResults;
 
 	TaskExecutionState executionState;
+
+	/* run of rows of the task when the results of the tasks are merged */
+	struct ReceivedRowRun *receivedRowRun;
+
+	/* whether the task was started on another placement because it was slow */
+	bool hedged;
+
+	/* placement execution whose rows are stored, if any were received */
+	struct TaskPlacementExecution *resultPlacementExecution;
 } ShardCommandExecution;
 
 /*
@@ -542,6 +848,24 @@ typedef struct TaskPlacementExecution
 
 	/* index in array of placement executions in a ShardCommandExecution */
 	int placementExecutionIndex;
+
+	/*
+	 * Time at which the command was sent, only set when hedging reads or
+	 * recording task times.
+	 */
+	instr_time startTime;
+
+	/* whether the command was cancelled since another placement finished first */
+	bool cancelled;
+
+	/* span id and times of the placement execution, only set when tracing */
+	uint64 spanId;
+	TimestampTz readyTime;
+	TimestampTz sendTime;
+	TimestampTz firstRowTime;
+
+	/* number of rows returned or modified by the command */
+	uint64 rowCount;
 } TaskPlacementExecution;
 
 
@@ -563,8 +887,25 @@ static TransactionProperties DecideTransactionPropertiesForTaskList(RowModifyLev
 																	exludeFromTransaction);
 static void StartDistributedExecution(DistributedExecution *execution);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
+static bool ShouldDispatchRemoteTasksBeforeLocalExecution(DistributedExecution *
+														   execution);
+static void DispatchDistributedExecution(DistributedExecution *execution);
 static void RunDistributedExecution(DistributedExecution *execution);
+static void RunDistributedExecutionEventLoop(DistributedExecution *execution,
+											 bool yieldWhenRowsAvailable);
+static bool ShouldStreamDistributedExecution(CitusScanState *scanState,
+											 DistributedExecution *execution);
+static bool ShouldStreamReturning(DistributedPlan *distributedPlan);
+static void StartStreamingExecution(CitusScanState *scanState,
+									DistributedExecution *execution);
+static void FreeExecutionWaitEventSet(void *arg);
+static void CleanUpStreamingExecution(void *arg);
 static bool ShouldRunTasksSequentially(List *taskList);
+static bool ShouldExplainAnalyzeTasksInSinglePass(CitusScanState *scanState,
+												  List *taskList,
+												  bool hasDependentJobs);
+static void SaveExplainAnalyzeResult(TaskPlacementExecution *placementExecution,
+									 PGresult *result);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
 
 static void FinishDistributedExecution(DistributedExecution *execution);
@@ -577,6 +918,7 @@ static void AdjustDistributedExecutionAfterLocalExecution(DistributedExecution *
 static bool DistributedExecutionModifiesDatabase(DistributedExecution *execution);
 static bool IsMultiShardModification(RowModifyLevel modLevel, List *taskList);
 static bool TaskListModifiesDatabase(RowModifyLevel modLevel, List *taskList);
+static bool CanReadFromSecondaries(RowModifyLevel modLevel, List *taskList);
 static bool DistributedExecutionRequiresRollback(List *taskList);
 static bool TaskListRequires2PC(List *taskList);
 static bool SelectForUpdateOnReferenceTable(RowModifyLevel modLevel, List *taskList);
@@ -584,6 +926,10 @@ static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution
 static void UnclaimAllSessionConnections(List *sessionList);
 static bool UseConnectionPerPlacement(void);
 static PlacementExecutionOrder ExecutionOrderForTask(RowModifyLevel modLevel, Task *task);
+static bool ShouldAssignTaskByWorkerLoad(ShardCommandExecution *shardCommandExecution);
+static List * OrderPlacementsByWorkerLoad(DistributedExecution *execution,
+										  Task *task);
+static int WorkerPoolLoad(WorkerPool *workerPool);
 static WorkerPool * FindOrCreateWorkerPool(DistributedExecution *execution,
 										   char *nodeName, int nodePort);
 static WorkerSession * FindOrCreateWorkerSession(WorkerPool *workerPool,
@@ -591,15 +937,44 @@ static WorkerSession * FindOrCreateWorkerSession(WorkerPool *workerPool,
 static void ManageWorkerPool(WorkerPool *workerPool);
 static bool ShouldWaitForConnection(WorkerPool *workerPool);
 static void CheckConnectionTimeout(WorkerPool *workerPool);
+static void FailSuspectWorkerPool(WorkerPool *workerPool);
 static int UsableConnectionCount(WorkerPool *workerPool);
 static long NextEventTimeout(DistributedExecution *execution);
+static bool ShouldHedgeReads(DistributedExecution *execution);
+static long StartHedgedPlacementExecutions(DistributedExecution *execution);
+static bool CanHedgePlacementExecution(TaskPlacementExecution *placementExecution);
+static void CancelHedgedPlacementExecutions(TaskPlacementExecution *placementExecution);
+static bool CanCancelReadPlacementExecutions(DistributedExecution *execution);
+static void SkipRemainingTasks(DistributedExecution *execution,
+							   ShardCommandExecution *currentShardCommandExecution);
+static void RemoveReadyPlacementExecution(TaskPlacementExecution *placementExecution);
+static WorkerSession * RunningPlacementExecutionSession(TaskPlacementExecution *
+														placementExecution);
 static WaitEventSet * BuildWaitEventSet(List *sessionList);
-static void RebuildWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList);
+static void UpdateWaitEventSet(DistributedExecution *execution);
+static void MarkSessionForWaitEventUpdate(WorkerSession *session);
 static TaskPlacementExecution * PopPlacementExecution(WorkerSession *session);
 static TaskPlacementExecution * PopAssignedPlacementExecution(WorkerSession *session);
 static TaskPlacementExecution * PopUnassignedPlacementExecution(WorkerPool *workerPool);
+static TaskPlacementExecution * PopBatchablePlacementExecution(WorkerSession *session);
+static bool UseBinaryResults(DistributedExecution *execution,
+							 ShardCommandExecution *shardCommandExecution);
+static bool ReceivePrepareResults(WorkerSession *session);
+static bool SendPreparedPlacementExecution(WorkerSession *session,
+										   WorkerPreparedStatement *preparedStatement);
+static bool CanBatchPlacementExecution(TaskPlacementExecution *placementExecution);
+static void StartBatchedPlacementExecution(TaskPlacementExecution *placementExecution,
+										   WorkerSession *session);
+static void BatchedPlacementExecutionDone(WorkerSession *session);
 static bool StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
-											 WorkerSession *session);
+											 WorkerSession *session,
+											 char *transactionCommand,
+											 int transactionCommandResultCount);
+static bool CanCoalesceTransactionBegin(DistributedExecution *execution);
+static bool CanCoalesceSavepoints(DistributedExecution *execution);
+static char * ParallelWorkersCommand(TaskPlacementExecution *placementExecution,
+									 WorkerPool *workerPool);
+static bool HasReadyPlacementExecution(WorkerSession *session);
 static void ConnectionStateMachine(WorkerSession *session);
 static void HandleMultiConnectionSuccess(WorkerSession *session);
 static void Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session);
@@ -608,8 +983,21 @@ static void TransactionStateMachine(WorkerSession *session);
 static void UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags);
 static bool CheckConnectionReady(WorkerSession *session);
 static bool ReceiveResults(WorkerSession *session, bool storeRows);
+static void DecodeTextResultRow(DistributedExecution *execution, PGresult *result,
+								int rowIndex);
+static void StoreReceivedRow(DistributedExecution *execution,
+							 ShardCommandExecution *shardCommandExecution);
+static Size ReceivedRowSize(TupleTableSlot *slot);
+static bool CanUseBinaryResultFormat(TupleDesc tupleDescriptor);
+static void SetupBinaryResultDecoding(DistributedExecution *execution);
+static void DecodeBinaryResultRow(DistributedExecution *execution, PGresult *result,
+								  int rowIndex);
 static void WorkerSessionFailed(WorkerSession *session);
 static void WorkerPoolFailed(WorkerPool *workerPool);
+static bool ShouldPropagateTraceParent(DistributedExecution *execution, Task *task);
+static void RecordPlacementExecutionSpan(TaskPlacementExecution *placementExecution,
+										 bool succeeded);
+static void UpdateWorkerPoolProgress(WorkerPool *workerPool);
 static void PlacementExecutionDone(TaskPlacementExecution *placementExecution,
 								   bool succeeded);
 static void ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution,
@@ -621,12 +1009,24 @@ static TaskExecutionState TaskExecutionStateMachine(ShardCommandExecution *
 static bool HasDependentJobs(Job *mainJob);
 static void ExtractParametersForRemoteExecution(ParamListInfo paramListInfo,
 												Oid **parameterTypes,
-												const char ***parameterValues);
+												const char ***parameterValues,
+												int **parameterLengths,
+												int **parameterFormats);
+static void ExtractParameters(ParamListInfo paramListInfo, Oid **parameterTypes,
+							  const char ***parameterValues, int **parameterLengths,
+							  int **parameterFormats, bool useOriginalCustomTypeOids);
+static bool CanSendParameterInBinaryFormat(Oid typeId);
 static int GetEventSetSize(List *sessionList);
 static int RebuildWaitEventSet(DistributedExecution *execution);
 static void ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int
 							  eventCount, bool *cancellationReceived);
 static long MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime);
+static int LatencyBasedNewConnectionCount(WorkerPool *workerPool);
+static void RecordWorkerPoolTaskTimes(DistributedExecution *execution);
+static void RecordPlacementExecutionStartForStats(WorkerPool *workerPool);
+static void RecordReceivedResultForStats(WorkerPool *workerPool, PGresult *result);
+static void StoreWorkerPoolExecutionStats(CitusScanState *scanState,
+										DistributedExecution *execution);
 
 /*
  * AdaptiveExecutorPreExecutorRun gets called right before postgres starts its executor
@@ -645,7 +1045,8 @@ AdaptiveExecutorPreExecutorRun(CitusScanState *scanState)
 	 */
 	LockPartitionsForDistributedPlan(distributedPlan);
 
-	ExecuteSubPlans(distributedPlan);
+	bool allowInlining = true;
+	ExecuteSubPlans(distributedPlan, allowInlining);
 }
 
 
@@ -666,6 +1067,7 @@ AdaptiveExecutor(CitusScanState *scanState)
 	bool randomAccess = true;
 	bool interTransactions = false;
 	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+	int resultMemory = (ExecutorResultMemory >= 0) ? ExecutorResultMemory : work_mem;
 	List *jobIdList = NIL;
 
 	Job *job = distributedPlan->workerJob;
@@ -674,12 +1076,18 @@ AdaptiveExecutor(CitusScanState *scanState)
 	/* we should only call this once before the scan finished */
 	Assert(!scanState->finishedRemoteScan);
 
+	/* open the connections to warm up on the first execution in the session */
+	WarmUpWorkerConnections();
+
 	bool hasDependentJobs = HasDependentJobs(job);
 	if (hasDependentJobs)
 	{
 		jobIdList = ExecuteDependentTasks(taskList, job);
 	}
 
+	/* send a single query per node for multi-shard reads, if enabled */
+	taskList = CoalesceTasksPerNode(distributedPlan, taskList);
+
 	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		/* defer decision after ExecuteSubPlans() */
@@ -687,12 +1095,24 @@ AdaptiveExecutor(CitusScanState *scanState)
 	}
 
 	scanState->tuplestorestate =
-		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+		tuplestore_begin_heap(randomAccess, interTransactions, resultMemory);
 
 	TransactionProperties xactProperties = DecideTransactionPropertiesForTaskList(
 		distributedPlan->modLevel, taskList,
 		hasDependentJobs);
 
+	/*
+	 * Intermediate results and repartitioned data only exist on primaries, the
+	 * rest of a read might go to secondaries if they are not lagging behind.
+	 */
+	if (ReadFromSecondaries == USE_SECONDARY_NODES_LAG_AWARE && !hasDependentJobs &&
+		distributedPlan->subPlanList == NIL &&
+		CanReadFromSecondaries(distributedPlan->modLevel, taskList))
+	{
+		/* secondaries are not part of the coordinated transaction */
+		xactProperties.readFromSecondaries = true;
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED;
+	}
 
 	DistributedExecution *execution = CreateDistributedExecution(
 		distributedPlan->modLevel,
@@ -705,22 +1125,107 @@ AdaptiveExecutor(CitusScanState *scanState)
 		&xactProperties,
 		jobIdList);
 
+	execution->traceQueryId = distributedPlan->queryId;
+
+	if (ShouldExplainAnalyzeTasksInSinglePass(scanState, taskList, hasDependentJobs))
+	{
+		/* the output is returned by a second query, which requires the text format */
+		execution->explainAnalyzeTasks = true;
+		execution->binaryResults = false;
+	}
+
 	/*
 	 * Make sure that we acquire the appropriate locks even if the local tasks
 	 * are going to be executed with local execution.
 	 */
 	StartDistributedExecution(execution);
 
-	/* execute tasks local to the node (if any) */
-	if (list_length(execution->localTaskList) > 0)
+	bool dispatchRemoteTasks = ShouldDispatchRemoteTasksBeforeLocalExecution(execution);
+
+	if (dispatchRemoteTasks)
 	{
+		/* the local tasks are executed below, while the remote tasks run */
+		AdjustDistributedExecutionAfterLocalExecution(execution);
+	}
+	else if (list_length(execution->localTaskList) > 0)
+	{
+		/* execute tasks local to the node */
 		RunLocalExecution(scanState, execution);
 
 		/* make sure that we only execute remoteTaskList afterwards */
 		AdjustDistributedExecutionAfterLocalExecution(execution);
 	}
 
-	if (ShouldRunTasksSequentially(execution->tasksToExecute))
+	bool explainAnalyze = scanState->customScanState.ss.ps.instrument != NULL;
+	if ((ExplainWorkerPools && explainAnalyze) ||
+		(CitusQueryStatsEnabled() && distributedPlan->queryId != 0))
+	{
+		/* describe the remote part of the execution per worker */
+		execution->collectWorkerPoolStats = true;
+		INSTR_TIME_SET_CURRENT(execution->workerPoolStatsStartTime);
+	}
+
+	if (distributedPlan->mergeSortColumnList != NIL && execution->tupleStore != NULL)
+	{
+		/* the planner removed the Sort above the remote scan */
+		execution->rowMerger = CreateReceivedRowMerger(distributedPlan, tupleDescriptor,
+													   execution->remoteTaskList);
+	}
+	else if (EnableCombineOnReceive && distributedPlan->combineFunctionList != NIL &&
+		execution->tupleStore != NULL && list_length(execution->remoteTaskList) > 1)
+	{
+		/* the coordinator aggregates the rows of each group anyway */
+		execution->rowCombiner =
+			CreateReceivedRowCombiner(distributedPlan, tupleDescriptor,
+									  &scanState->customScanState.ss.ps);
+	}
+	else if (EnableTopNOnReceive && distributedPlan->topNCount > 0 &&
+			 execution->tupleStore != NULL && list_length(execution->remoteTaskList) > 1)
+	{
+		/* the coordinator sorts and limits the rows anyway */
+		execution->rowTopN = CreateReceivedRowTopN(distributedPlan, tupleDescriptor);
+	}
+
+	if (EnableLimitCancellation && distributedPlan->remoteScanRowLimit > 0 &&
+		distributedPlan->modLevel == ROW_MODIFY_READONLY &&
+		execution->tupleStore != NULL && list_length(execution->localTaskList) == 0 &&
+		execution->rowMerger == NULL && execution->rowCombiner == NULL &&
+		execution->rowTopN == NULL)
+	{
+		/* the LIMIT above the remote scan takes any rows, skip tasks once we have them */
+		execution->rowLimit = distributedPlan->remoteScanRowLimit;
+	}
+
+	if (ShouldStreamDistributedExecution(scanState, execution))
+	{
+		/*
+		 * The remaining work happens in ContinueStreamingExecution() while
+		 * the tuples are read from the tuple store.
+		 */
+		StartStreamingExecution(scanState, execution);
+
+		return resultSlot;
+	}
+
+	if (dispatchRemoteTasks)
+	{
+		/*
+		 * Send the remote tasks to the workers, execute the local tasks while
+		 * the workers are busy, and only then wait for the remote results.
+		 */
+		DispatchDistributedExecution(execution);
+
+		RunLocalExecution(scanState, execution);
+
+		execution->dispatchOnly = false;
+
+		if (!execution->eventLoopFinished)
+		{
+			bool yieldWhenRowsAvailable = false;
+			RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+		}
+	}
+	else if (ShouldRunTasksSequentially(execution->tasksToExecute))
 	{
 		SequentialRunDistributedExecution(execution);
 	}
@@ -749,6 +1254,26 @@ AdaptiveExecutor(CitusScanState *scanState)
 		}
 	}
 
+	if (execution->rowCombiner != NULL)
+	{
+		FlushReceivedRowCombiner(execution->rowCombiner, execution->tupleStore);
+		execution->rowCombiner = NULL;
+	}
+
+	if (execution->rowTopN != NULL)
+	{
+		FlushReceivedRowTopN(execution->rowTopN, execution->tupleStore);
+		execution->rowTopN = NULL;
+	}
+
+	if (execution->rowMerger != NULL)
+	{
+		FlushReceivedRowMerger(execution->rowMerger, execution->tupleStore);
+		execution->rowMerger = NULL;
+	}
+
+	StoreWorkerPoolExecutionStats(scanState, execution);
+	scanState->receivedRowBytes = execution->receivedRowBytes;
 	FinishDistributedExecution(execution);
 
 	if (hasDependentJobs)
@@ -804,6 +1329,77 @@ RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
 }
 
 
+/*
+ * ShouldDispatchRemoteTasksBeforeLocalExecution returns true if the remote tasks
+ * of the execution should be sent to the workers before the local tasks are
+ * executed, such that local and remote execution overlap.
+ *
+ * We only do this for read-only executions. Their remote tasks do not access
+ * the local placements, hence the order in which local and remote tasks run
+ * does not affect what they see, and the local execution status transitions
+ * (see EnsureTransitionPossible()) are the same as when the local tasks run
+ * first. Modifications keep running the local tasks first.
+ */
+static bool
+ShouldDispatchRemoteTasksBeforeLocalExecution(DistributedExecution *execution)
+{
+	if (!EnableConcurrentLocalExecution)
+	{
+		return false;
+	}
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		list_length(execution->jobIdList) > 0)
+	{
+		return false;
+	}
+
+	if (list_length(execution->localTaskList) == 0 ||
+		list_length(execution->remoteTaskList) == 0)
+	{
+		return false;
+	}
+
+	if (ShouldRunTasksSequentially(execution->remoteTaskList))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * DispatchDistributedExecution assigns the tasks of the execution to connections
+ * and runs the event loop without blocking, which starts establishing the
+ * connections and sends the tasks over the connections that are ready. The
+ * remaining work happens when the event loop is run again after the local
+ * tasks are executed.
+ */
+static void
+DispatchDistributedExecution(DistributedExecution *execution)
+{
+	/*
+	 * When the local execution throws an error, we never get back to the event
+	 * loop. Make sure the wait event set does not leak its file descriptor in
+	 * that case by freeing it when the execution is freed.
+	 */
+	execution->waitEventSetCleanupCallback.func = FreeExecutionWaitEventSet;
+	execution->waitEventSetCleanupCallback.arg = execution;
+	MemoryContextRegisterResetCallback(GetMemoryChunkContext(execution),
+									   &execution->waitEventSetCleanupCallback);
+
+	AssignTasksToConnectionsOrWorkerPool(execution);
+
+	execution->eventLoopStarted = false;
+	execution->eventLoopFinished = false;
+	execution->dispatchOnly = true;
+
+	bool yieldWhenRowsAvailable = false;
+	RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+}
+
+
 /*
  * AdjustDistributedExecutionAfterLocalExecution simply updates the necessary fields of
  * the distributed execution.
@@ -825,10 +1421,23 @@ AdjustDistributedExecutionAfterLocalExecution(DistributedExecution *execution)
  */
 uint64
 ExecuteUtilityTaskList(List *utilityTaskList, bool localExecutionSupported)
+{
+	return ExecuteUtilityTaskListExtended(utilityTaskList, MaxAdaptiveExecutorPoolSize,
+										  localExecutionSupported);
+}
+
+
+/*
+ * ExecuteUtilityTaskListExtended executes the task list of a utility command
+ * using at most targetPoolSize connections per node.
+ */
+uint64
+ExecuteUtilityTaskListExtended(List *utilityTaskList, int targetPoolSize,
+							   bool localExecutionSupported)
 {
 	RowModifyLevel modLevel = ROW_MODIFY_NONE;
 	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, utilityTaskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
+		modLevel, utilityTaskList, targetPoolSize, localExecutionSupported
 		);
 	executionParams->xactProperties =
 		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList, false);
@@ -1010,11 +1619,22 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 						   Tuplestorestate *tupleStore, int targetPoolSize,
 						   TransactionProperties *xactProperties, List *jobIdList)
 {
+	/* the new execution may need the connections of streaming executions */
+	FinishStreamingExecutions();
+
 	DistributedExecution *execution =
 		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
 
 	execution->modLevel = modLevel;
 	execution->tasksToExecute = taskList;
+
+	if (modLevel != ROW_MODIFY_READONLY)
+	{
+		/* cached subplan and query results may no longer be up to date */
+		RecordDistributedModification();
+		RecordTaskListModification(taskList);
+	}
+
 	execution->hasReturning = hasReturning;
 	execution->transactionProperties = xactProperties;
 
@@ -1038,7 +1658,8 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 	execution->raiseInterrupts = true;
 
 	execution->rebuildWaitEventSet = false;
-	execution->waitFlagsChanged = false;
+	execution->waitEventUpdateSessionList = NIL;
+	execution->waitEventSetSessionCount = 0;
 
 	execution->jobIdList = jobIdList;
 
@@ -1046,13 +1667,23 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 	if (tupleDescriptor != NULL)
 	{
 		execution->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-		execution->columnArray =
-			(char **) palloc0(tupleDescriptor->natts * sizeof(char *));
+		execution->receivedRowSlot =
+			MakeSingleTupleTableSlotCompat(tupleDescriptor, &TTSOpsVirtual);
+		execution->rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "ReceivedRowContext",
+													  ALLOCSET_DEFAULT_SIZES);
 	}
 	else
 	{
 		execution->attributeInputMetadata = NULL;
-		execution->columnArray = NULL;
+		execution->receivedRowSlot = NULL;
+		execution->rowContext = NULL;
+	}
+
+	if (EnableBinaryProtocol && tupleDescriptor != NULL &&
+		CanUseBinaryResultFormat(tupleDescriptor))
+	{
+		SetupBinaryResultDecoding(execution);
 	}
 
 	if (ShouldExecuteTasksLocally(taskList))
@@ -1086,6 +1717,7 @@ DecideTransactionPropertiesForTaskList(RowModifyLevel modLevel, List *taskList,
 	xactProperties.errorOnAnyFailure = false;
 	xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_ALLOWED;
 	xactProperties.requires2PC = false;
+	xactProperties.readFromSecondaries = false;
 
 	if (taskList == NIL)
 	{
@@ -1162,11 +1794,54 @@ DecideTransactionPropertiesForTaskList(RowModifyLevel modLevel, List *taskList,
 		 */
 		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
 	}
+	else if (ReadFromSecondaries == USE_SECONDARY_NODES_LAG_AWARE &&
+			 TaskListModifiesDatabase(modLevel, taskList))
+	{
+		/*
+		 * Lag-aware reads need to know the WAL position of every write, which
+		 * we get along with the COMMIT of the remote transaction.
+		 */
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
+	}
 
 	return xactProperties;
 }
 
 
+/*
+ * CanReadFromSecondaries returns whether the given task list could run on
+ * secondaries: it needs to be a read without row locks, outside of
+ * transaction blocks, since those might read their own uncommitted writes
+ * or write later on.
+ */
+static bool
+CanReadFromSecondaries(RowModifyLevel modLevel, List *taskList)
+{
+	if (modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction() || InCoordinatedTransaction() ||
+		XactModificationLevel != XACT_MODIFICATION_NONE)
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->relationRowLockList != NIL)
+		{
+			/* SELECT .. FOR UPDATE needs to lock rows on the primary */
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * StartDistributedExecution sets up the coordinated transaction and 2PC for
  * the execution whenever necessary. It also keeps track of parallel relation
@@ -1213,22 +1888,51 @@ StartDistributedExecution(DistributedExecution *execution)
 	{
 		RecordParallelRelationAccessForTaskList(execution->tasksToExecute);
 	}
+
+	execution->hedgeReads = ShouldHedgeReads(execution);
+	execution->recordTaskTimes = EnableAdaptivePoolSizing;
+
+	if (EnableDistributedTracing)
+	{
+		/* all executions of the same statement belong to the same trace */
+		execution->traceId = pstrdup(CurrentTraceId());
+	}
+
+	execution->queryProgress = StartQueryProgress(execution->tasksToExecute);
 }
 
 
 /*
- *  DistributedExecutionModifiesDatabase returns true if the execution modifies the data
- *  or the schema.
+ * ShouldHedgeReads returns whether slow tasks of the execution may be started
+ * on a second placement. We only do this for reads, and only when no remote
+ * transaction blocks are in use, since we cancel the slower query and that
+ * would abort the transaction block on its connection.
  */
 static bool
-DistributedExecutionModifiesDatabase(DistributedExecution *execution)
+ShouldHedgeReads(DistributedExecution *execution)
 {
-	return TaskListModifiesDatabase(execution->modLevel, execution->tasksToExecute);
+	if (HedgedReadDelay <= 0)
+	{
+		return false;
+	}
+
+	return CanCancelReadPlacementExecutions(execution);
 }
 
 
 /*
- *  DistributedPlanModifiesDatabase returns true if the plan modifies the data
+ *  DistributedExecutionModifiesDatabase returns true if the execution modifies the data
+ *  or the schema.
+ */
+static bool
+DistributedExecutionModifiesDatabase(DistributedExecution *execution)
+{
+	return TaskListModifiesDatabase(execution->modLevel, execution->tasksToExecute);
+}
+
+
+/*
+ *  DistributedPlanModifiesDatabase returns true if the plan modifies the data
  *  or the schema.
  */
 bool
@@ -1569,6 +2273,9 @@ FinishDistributedExecution(DistributedExecution *execution)
 		/* prevent copying shards in same transaction */
 		XactModificationLevel = XACT_MODIFICATION_DATA;
 	}
+
+	FinishQueryProgress(execution->queryProgress);
+	execution->queryProgress = NULL;
 }
 
 
@@ -1687,15 +2394,30 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 	RowModifyLevel modLevel = execution->modLevel;
 	List *taskList = execution->tasksToExecute;
 	bool hasReturning = execution->hasReturning;
+	bool readFromSecondaries = execution->transactionProperties->readFromSecondaries;
+	List *secondaryNodeList = NIL;
 
 	int32 localGroupId = GetLocalGroupId();
 
+	if (readFromSecondaries)
+	{
+		secondaryNodeList = ActiveSecondaryNodeList();
+	}
+
 	Task *task = NULL;
 	foreach_ptr(task, taskList)
 	{
 		bool placementExecutionReady = true;
 		int placementExecutionIndex = 0;
-		int placementExecutionCount = list_length(task->taskPlacementList);
+		List *placementList = task->taskPlacementList;
+
+		if (secondaryNodeList != NIL)
+		{
+			/* try up-to-date secondaries first, and fall back to the primaries */
+			placementList = LagAwareReadPlacementList(placementList, secondaryNodeList);
+		}
+
+		int placementExecutionCount = list_length(placementList);
 
 		/*
 		 * Execution of a command on a shard, which may have multiple replicas.
@@ -1703,6 +2425,8 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 		ShardCommandExecution *shardCommandExecution =
 			(ShardCommandExecution *) palloc0(sizeof(ShardCommandExecution));
 		shardCommandExecution->task = task;
+		execution->shardCommandExecutionList =
+			lappend(execution->shardCommandExecutionList, shardCommandExecution);
 		shardCommandExecution->executionOrder = ExecutionOrderForTask(modLevel, task);
 		shardCommandExecution->executionState = TASK_EXECUTION_NOT_FINISHED;
 		shardCommandExecution->placementExecutions =
@@ -1714,8 +2438,18 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 			(hasReturning && !task->partiallyLocalOrRemote) ||
 			modLevel == ROW_MODIFY_READONLY;
 
+		/*
+		 * The placement that comes first is executed, the others are only used
+		 * when it fails. With the adaptive policy we start with the placement on
+		 * the least loaded worker rather than the one picked by the planner.
+		 */
+		if (!readFromSecondaries && ShouldAssignTaskByWorkerLoad(shardCommandExecution))
+		{
+			placementList = OrderPlacementsByWorkerLoad(execution, task);
+		}
+
 		ShardPlacement *taskPlacement = NULL;
-		foreach_ptr(taskPlacement, task->taskPlacementList)
+		foreach_ptr(taskPlacement, placementList)
 		{
 			int connectionFlags = 0;
 			char *nodeName = taskPlacement->nodeName;
@@ -1743,11 +2477,31 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 				placementExecution->executionState = PLACEMENT_EXECUTION_NOT_READY;
 			}
 
+			if (execution->traceId != NULL)
+			{
+				placementExecution->spanId = NextTraceSpanId();
+
+				if (placementExecutionReady)
+				{
+					placementExecution->readyTime = GetCurrentTimestamp();
+				}
+			}
+
 			shardCommandExecution->placementExecutions[placementExecutionIndex] =
 				placementExecution;
 
 			placementExecutionIndex++;
 
+			if (placementExecutionReady)
+			{
+				workerPool->assignedTaskCount++;
+
+				if (workerPool->progress != NULL)
+				{
+					workerPool->progress->taskCount++;
+				}
+			}
+
 			List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
 			MultiConnection *connection = NULL;
@@ -1889,9 +2643,10 @@ ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
 			 * there is no risk of deadlock and we can run them in parallel.
 			 * When the modification is commutative, we take no additional
 			 * locks, so we take a conservative approach and execute sequentially
-			 * to avoid deadlocks.
+			 * to avoid deadlocks, unless citus.enable_parallel_replica_writes
+			 * makes us take the aggressive locks for those as well.
 			 */
-			if (modLevel < ROW_MODIFY_NONCOMMUTATIVE)
+			if (modLevel < ROW_MODIFY_NONCOMMUTATIVE && !ParallelReplicaWritesEnabled())
 			{
 				return EXECUTION_ORDER_SEQUENTIAL;
 			}
@@ -1920,6 +2675,89 @@ ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
 }
 
 
+/*
+ * ShouldAssignTaskByWorkerLoad returns true if the adaptive task assignment
+ * policy should pick the placement on which the given shard command is
+ * executed. This only applies to read-only commands that run on one of
+ * several placements.
+ */
+static bool
+ShouldAssignTaskByWorkerLoad(ShardCommandExecution *shardCommandExecution)
+{
+	Task *task = shardCommandExecution->task;
+
+	if (TaskAssignmentPolicy != TASK_ASSIGNMENT_ADAPTIVE)
+	{
+		return false;
+	}
+
+	if (!ReadOnlyTask(task->taskType))
+	{
+		return false;
+	}
+
+	if (shardCommandExecution->executionOrder == EXECUTION_ORDER_PARALLEL)
+	{
+		/* command runs on all placements anyway */
+		return false;
+	}
+
+	return list_length(task->taskPlacementList) > 1;
+}
+
+
+/*
+ * OrderPlacementsByWorkerLoad returns a copy of the placement list of the task
+ * where the placement on the worker with the lowest load comes first. The remaining
+ * placements keep their order, such that failover happens as planned. Ties
+ * are broken in favour of the placement that comes first.
+ */
+static List *
+OrderPlacementsByWorkerLoad(DistributedExecution *execution, Task *task)
+{
+	List *placementList = task->taskPlacementList;
+	ShardPlacement *leastLoadedPlacement = NULL;
+	int leastLoad = 0;
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		WorkerPool *workerPool = FindOrCreateWorkerPool(execution, placement->nodeName,
+														placement->nodePort);
+		int load = WorkerPoolLoad(workerPool);
+
+		if (leastLoadedPlacement == NULL || load < leastLoad)
+		{
+			leastLoadedPlacement = placement;
+			leastLoad = load;
+		}
+	}
+
+	List *orderedPlacementList = list_copy(placementList);
+	orderedPlacementList = list_delete_ptr(orderedPlacementList, leastLoadedPlacement);
+	orderedPlacementList = lcons(leastLoadedPlacement, orderedPlacementList);
+
+	ereport(DEBUG4, (errmsg("assigned task %u to node %s:%u based on load",
+							task->taskId,
+							leastLoadedPlacement->nodeName,
+							leastLoadedPlacement->nodePort)));
+
+	return orderedPlacementList;
+}
+
+
+/*
+ * WorkerPoolLoad estimates the load on the worker of the given pool as the
+ * number of tasks this execution already started on it plus the number of
+ * connections that other backends have to it.
+ */
+static int
+WorkerPoolLoad(WorkerPool *workerPool)
+{
+	return workerPool->assignedTaskCount + workerPool->sharedConnectionCount;
+}
+
+
 /*
  * FindOrCreateWorkerPool gets the pool of connections for a particular worker.
  */
@@ -1941,14 +2779,40 @@ FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int node
 	workerPool->nodePort = nodePort;
 
 	/* "open" connections aggressively when there are cached connections */
-	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
+	int nodeConnectionCount = GetMaxCachedConnectionsPerWorker();
 	workerPool->maxNewConnectionsPerCycle = Max(1, nodeConnectionCount);
 
 	dlist_init(&workerPool->pendingTaskQueue);
 	dlist_init(&workerPool->readyTaskQueue);
 
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_ADAPTIVE)
+	{
+		/* take the load that other backends put on the worker into account */
+		workerPool->sharedConnectionCount = GetSharedConnectionCounter(nodeName,
+																	   nodePort);
+	}
+
+	if (EnableAdaptivePoolSizing)
+	{
+		workerPool->hasLatencyEstimates =
+			GetSharedNodeLatencies(nodeName, nodePort,
+								   &workerPool->expectedConnectionTime,
+								   &workerPool->expectedTaskTime);
+	}
+
+	workerPool->nodeIsSuspect = NodeIsSuspect(nodeName, nodePort);
+	workerPool->nodeStats = GetNodeStats(nodeName, nodePort);
+	workerPool->progress = QueryProgressForWorker(execution->queryProgress, nodeName,
+												  nodePort);
 	workerPool->distributedExecution = execution;
 
+	if (execution->collectWorkerPoolStats)
+	{
+		workerPool->poolStats = palloc0(sizeof(WorkerPoolExecutionStats));
+		workerPool->poolStats->nodeName = workerPool->nodeName;
+		workerPool->poolStats->nodePort = nodePort;
+	}
+
 	execution->workerList = lappend(execution->workerList, workerPool);
 
 	return workerPool;
@@ -1981,6 +2845,7 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 	session->connection = connection;
 	session->workerPool = workerPool;
 	session->commandsSent = 0;
+	session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
 
 	dlist_init(&session->pendingTaskQueue);
 	dlist_init(&session->readyTaskQueue);
@@ -2007,6 +2872,9 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 	workerPool->sessionList = lappend(workerPool->sessionList, session);
 	execution->sessionList = lappend(execution->sessionList, session);
 
+	/* add the session to the wait event set before the next wait */
+	MarkSessionForWaitEventUpdate(session);
+
 	return session;
 }
 
@@ -2098,75 +2966,158 @@ SequentialRunDistributedExecution(DistributedExecution *execution)
 void
 RunDistributedExecution(DistributedExecution *execution)
 {
-	WaitEvent *events = NULL;
-
 	AssignTasksToConnectionsOrWorkerPool(execution);
 
+	/* the execution may be re-run by SequentialRunDistributedExecution */
+	execution->eventLoopStarted = false;
+	execution->eventLoopFinished = false;
+
+	bool yieldWhenRowsAvailable = false;
+	RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+}
+
+
+/*
+ * RunDistributedExecutionEventLoop waits for events on the connections of the
+ * execution and runs the connection state machines until all tasks are done.
+ * If yieldWhenRowsAvailable is true, it returns as soon as new rows have been
+ * stored in the tuple store, such that they can be returned to the caller
+ * while the remaining tasks are still running. The loop can be resumed by
+ * calling the function again. Once the tasks are done, the wait event set is
+ * freed and the sessions are cleaned up, and eventLoopFinished is set.
+ */
+static void
+RunDistributedExecutionEventLoop(DistributedExecution *execution,
+								 bool yieldWhenRowsAvailable)
+{
+	uint64 rowsProcessedBefore = execution->rowsProcessed;
+
 	PG_TRY();
 	{
-		/* Preemptively step state machines in case of immediate errors */
-		WorkerSession *session = NULL;
-		foreach_ptr(session, execution->sessionList)
+		if (!execution->eventLoopStarted)
 		{
-			ConnectionStateMachine(session);
+			/* Preemptively step state machines in case of immediate errors */
+			WorkerSession *session = NULL;
+			foreach_ptr(session, execution->sessionList)
+			{
+				ConnectionStateMachine(session);
+			}
+
+			execution->eventSetSize = GetEventSetSize(execution->sessionList);
+
+			/* always (re)build the wait event set the first time */
+			execution->rebuildWaitEventSet = true;
+			execution->eventLoopStarted = true;
 		}
 
 		bool cancellationReceived = false;
 
-		int eventSetSize = GetEventSetSize(execution->sessionList);
+		while ((execution->unfinishedTaskCount > 0 ||
+				execution->cancelledPlacementExecutionCount > 0) &&
+			   !cancellationReceived)
+		{
+			long hedgeTimeout = -1;
 
-		/* always (re)build the wait event set the first time */
-		execution->rebuildWaitEventSet = true;
+			if (execution->hedgeReads)
+			{
+				/* start slow tasks on another placement, if they are due */
+				hedgeTimeout = StartHedgedPlacementExecutions(execution);
+			}
 
-		while (execution->unfinishedTaskCount > 0 && !cancellationReceived)
-		{
 			long timeout = NextEventTimeout(execution);
+			if (hedgeTimeout >= 0 && hedgeTimeout < timeout)
+			{
+				timeout = hedgeTimeout;
+			}
+
+			if (execution->dispatchOnly)
+			{
+				/* only handle the events that are already there */
+				timeout = 0;
+			}
 
 			WorkerPool *workerPool = NULL;
 			foreach_ptr(workerPool, execution->workerList)
 			{
 				ManageWorkerPool(workerPool);
+
+				if (workerPool->progress != NULL)
+				{
+					UpdateWorkerPoolProgress(workerPool);
+				}
+			}
+
+			if (!execution->rebuildWaitEventSet &&
+				execution->waitEventUpdateSessionList != NIL)
+			{
+				/* add new sessions and apply changed wait flags, if there is space */
+				UpdateWaitEventSet(execution);
 			}
 
 			if (execution->rebuildWaitEventSet)
 			{
-				if (events != NULL)
+				if (execution->events != NULL)
 				{
 					/*
 					 * The execution might take a while, so explicitly free at this point
 					 * because we don't need anymore.
 					 */
-					pfree(events);
-					events = NULL;
+					pfree(execution->events);
+					execution->events = NULL;
 				}
-				eventSetSize = RebuildWaitEventSet(execution);
+				execution->eventSetSize = RebuildWaitEventSet(execution);
 
-				events = palloc0(eventSetSize * sizeof(WaitEvent));
+				execution->events = palloc0(execution->eventSetSize * sizeof(WaitEvent));
 			}
-			else if (execution->waitFlagsChanged)
+
+			/* wait for I/O events */
+			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout,
+											  execution->events,
+											  execution->eventSetSize,
+											  WAIT_EVENT_CITUS_REMOTE_TASK_EXECUTION);
+			ProcessWaitEvents(execution, execution->events, eventCount,
+							  &cancellationReceived);
+
+			if (execution->dispatchOnly && eventCount == 0)
 			{
-				RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
-				execution->waitFlagsChanged = false;
+				/* nothing more to do without waiting */
+				break;
 			}
 
-			/* wait for I/O events */
-			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout, events,
-											  eventSetSize, WAIT_EVENT_CLIENT_READ);
-			ProcessWaitEvents(execution, events, eventCount, &cancellationReceived);
+			if (yieldWhenRowsAvailable &&
+				execution->rowsProcessed > rowsProcessedBefore &&
+				execution->unfinishedTaskCount > 0)
+			{
+				/* let the caller consume the new rows first */
+				break;
+			}
 		}
 
-		if (events != NULL)
+		if ((execution->unfinishedTaskCount == 0 &&
+			 execution->cancelledPlacementExecutionCount == 0) ||
+			cancellationReceived)
 		{
-			pfree(events);
-		}
+			if (execution->events != NULL)
+			{
+				pfree(execution->events);
+				execution->events = NULL;
+			}
 
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
+			if (execution->waitEventSet != NULL)
+			{
+				FreeWaitEventSet(execution->waitEventSet);
+				execution->waitEventSet = NULL;
+			}
+
+			if (execution->recordTaskTimes && !cancellationReceived)
+			{
+				RecordWorkerPoolTaskTimes(execution);
+			}
 
-		CleanUpSessions(execution);
+			CleanUpSessions(execution);
+
+			execution->eventLoopFinished = true;
+		}
 	}
 	PG_CATCH();
 	{
@@ -2195,89 +3146,531 @@ RunDistributedExecution(DistributedExecution *execution)
 
 
 /*
- * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
- * This happens when the connection set for the distributed execution is changed,
- * which means that we need to update which connections we wait on for events.
- * It returns the new event set size.
+ * ShouldStreamDistributedExecution returns true if the results of the given
+ * execution can be returned to the caller while the tasks are still running,
+ * instead of first materializing all results in the tuple store.
+ *
+ * We only do this for executions that need a single run of the event loop.
+ * Modifications are run to completion, unless they return rows and
+ * ShouldStreamReturning allows returning those as they are received.
+ *
+ * Besides citus.enable_streaming_execution, citus.enable_cursor_streaming
+ * enables streaming for queries whose rows are fetched in batches, such as
+ * FETCH from a cursor or protocol-level portals with a row limit. For
+ * modifications, only citus.enable_streaming_returning is considered.
  */
-static int
-RebuildWaitEventSet(DistributedExecution *execution)
+static bool
+ShouldStreamDistributedExecution(CitusScanState *scanState,
+								 DistributedExecution *execution)
 {
-	if (execution->waitEventSet != NULL)
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY)
 	{
-		FreeWaitEventSet(execution->waitEventSet);
-		execution->waitEventSet = NULL;
+		if (!ShouldStreamReturning(distributedPlan))
+		{
+			return false;
+		}
+	}
+	else if (!EnableStreamingExecution &&
+			 !(EnableCursorStreaming && scanState->incrementalFetch))
+	{
+		return false;
 	}
 
-	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
-	execution->rebuildWaitEventSet = false;
-	execution->waitFlagsChanged = false;
+	if (HasDependentJobs(distributedPlan->workerJob))
+	{
+		return false;
+	}
 
-	return GetEventSetSize(execution->sessionList);
+	if (execution->tupleStore == NULL || list_length(execution->localTaskList) > 0)
+	{
+		return false;
+	}
+
+	if (execution->rowCombiner != NULL || execution->rowTopN != NULL ||
+		execution->rowMerger != NULL)
+	{
+		/* combined, bounded or merged rows are only stored once all are received */
+		return false;
+	}
+
+	if (ShouldRunTasksSequentially(execution->tasksToExecute))
+	{
+		return false;
+	}
+
+	return true;
 }
 
 
 /*
- * ProcessWaitEvents processes the received events from connections.
+ * ShouldExplainAnalyzeTasksInSinglePass returns whether the tasks of the scan
+ * should return their EXPLAIN ANALYZE output along with their rows, such that
+ * the EXPLAIN ANALYZE command that is running does not need to run them again
+ * (see citus.explain_analyze_single_pass). That is only done for reads whose
+ * tasks are shown by EXPLAIN as they are, and do not need parameters, since
+ * the output is returned by a second query in the same command.
  */
-static void
-ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
-				  bool *cancellationReceived)
+static bool
+ShouldExplainAnalyzeTasksInSinglePass(CitusScanState *scanState, List *taskList,
+									  bool hasDependentJobs)
 {
-	int eventIndex = 0;
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
 
-	/* process I/O events */
-	for (; eventIndex < eventCount; eventIndex++)
+	if (scanState->customScanState.ss.ps.instrument == NULL ||
+		!CanExplainAnalyzeTasksInSinglePass())
 	{
-		WaitEvent *event = &events[eventIndex];
+		return false;
+	}
 
-		if (event->events & WL_POSTMASTER_DEATH)
+	if (hasDependentJobs || distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	if (tupleDescriptor == NULL || tupleDescriptor->natts == 0)
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (!list_member_ptr(distributedPlan->workerJob->taskList, task))
 		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+			/* tasks were coalesced per node, EXPLAIN shows the original tasks */
+			return false;
 		}
 
-		if (event->events & WL_LATCH_SET)
+		if (executorState->es_param_list_info != NULL &&
+			!task->parametersInQueryStringResolved)
 		{
-			ResetLatch(MyLatch);
-
-			if (execution->raiseInterrupts)
-			{
-				CHECK_FOR_INTERRUPTS();
-			}
-
-			if (IsHoldOffCancellationReceived())
-			{
-				/*
-				 * Break out of event loop immediately in case of cancellation.
-				 * We cannot use "return" here inside a PG_TRY() block since
-				 * then the exception stack won't be reset.
-				 */
-				*cancellationReceived = true;
-			}
-
-			continue;
+			return false;
 		}
+	}
 
-		WorkerSession *session = (WorkerSession *) event->user_data;
-		session->latestUnconsumedWaitEvents = event->events;
+	return true;
+}
 
-		ConnectionStateMachine(session);
+
+/*
+ * ShouldStreamReturning returns true if the RETURNING rows of the given
+ * modification can be returned while its tasks are still running. When
+ * citus.sort_returning is on, all rows are needed before the first one can be
+ * returned, so they are stored and sorted instead.
+ *
+ * Note that a task that fails after rows were returned still aborts the
+ * transaction, but the client may already have received some of the rows of
+ * the failed command, in the same way as for streamed read-only queries.
+ */
+static bool
+ShouldStreamReturning(DistributedPlan *distributedPlan)
+{
+	if (!EnableStreamingReturning || SortReturning)
+	{
+		return false;
 	}
+
+	return distributedPlan->hasReturning;
 }
 
 
 /*
- * ManageWorkerPool ensures the worker pool has the appropriate number of connections
- * based on the number of pending tasks.
+ * StartStreamingExecution assigns the tasks of the execution to connections
+ * and steps the connection state machines for the first time, but leaves the
+ * rest of the work to ContinueStreamingExecution(), which is called whenever
+ * the scan needs a tuple that is not yet in the tuple store.
  */
 static void
-ManageWorkerPool(WorkerPool *workerPool)
+StartStreamingExecution(CitusScanState *scanState, DistributedExecution *execution)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-	int targetPoolSize = execution->targetPoolSize;
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->activeConnectionCount;
+	/*
+	 * When the scan is abandoned due to an error, we never get back to the
+	 * event loop. Make sure the wait event set does not leak its file
+	 * descriptor in that case by freeing it when the execution is freed.
+	 */
+	execution->waitEventSetCleanupCallback.func = CleanUpStreamingExecution;
+	execution->waitEventSetCleanupCallback.arg = execution;
+	MemoryContextRegisterResetCallback(GetMemoryChunkContext(execution),
+									   &execution->waitEventSetCleanupCallback);
+
+	AssignTasksToConnectionsOrWorkerPool(execution);
+
+	scanState->distributedExecution = execution;
+	scanState->streamedTupleCount = 0;
+
+	execution->streamingScanState = scanState;
+	dlist_push_tail(&StreamingExecutionList, &execution->streamingExecutionNode);
+
+	if ((scanState->eflags & (EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD |
+							  EXEC_FLAG_MARK)) == 0)
+	{
+		/*
+		 * Rows are only read once, in forward direction. We can then remove
+		 * the rows that were returned before reading more from the workers,
+		 * such that the tuple store only holds the rows that were received
+		 * since the last call. This needs to happen before any row is stored.
+		 */
+		tuplestore_set_eflags(scanState->tuplestorestate, 0);
+		scanState->trimTupleStore = true;
+	}
+
+	bool yieldWhenRowsAvailable = true;
+	RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+
+	if (execution->eventLoopFinished)
+	{
+		bool discardResults = false;
+		FinishStreamingExecution(scanState, discardResults);
+	}
+}
+
+
+/*
+ * ContinueStreamingExecution makes sure that the next tuple the scan reads
+ * from the tuple store is available. For forward scans, it runs the event loop
+ * until the tuple store contains a row that was not read yet, or until all
+ * tasks are done. Backward scans require all rows, so in that case we run the
+ * execution to completion.
+ *
+ * We never read past the rows that are in the tuple store while the execution
+ * is still running, since the read pointer of the tuple store does not move
+ * once it reached the end.
+ *
+ * Since we only read from the connections when the scan needs more rows, the
+ * workers stop sending once the socket buffers are full. Together with
+ * trimming the tuple store, this keeps the memory and disk usage of scans
+ * that are read in batches, such as cursors, bounded by the batch size.
+ */
+void
+ContinueStreamingExecution(CitusScanState *scanState, bool forwardScanDirection)
+{
+	DistributedExecution *execution = scanState->distributedExecution;
+
+	if (execution == NULL)
+	{
+		return;
+	}
+
+	if (!forwardScanDirection)
+	{
+		bool discardResults = false;
+		FinishStreamingExecution(scanState, discardResults);
+		return;
+	}
+
+	while (!execution->eventLoopFinished &&
+		   scanState->streamedTupleCount >= execution->rowsProcessed)
+	{
+		if (scanState->trimTupleStore)
+		{
+			/* all rows in the tuple store were returned, except the current one */
+			tuplestore_trim(scanState->tuplestorestate);
+		}
+
+		bool yieldWhenRowsAvailable = true;
+		RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+	}
+
+	if (execution->eventLoopFinished)
+	{
+		bool discardResults = false;
+		FinishStreamingExecution(scanState, discardResults);
+	}
+}
+
+
+/*
+ * FinishStreamingExecution runs the streaming execution of the scan to
+ * completion, if there is one. It is used when all rows are needed at once,
+ * and when the scan ends before all rows were read. In the latter case the
+ * caller passes discardResults, such that the remaining results are read from
+ * the connections but not stored, and the connections can be used by
+ * subsequent commands in the transaction.
+ */
+void
+FinishStreamingExecution(CitusScanState *scanState, bool discardResults)
+{
+	DistributedExecution *execution = scanState->distributedExecution;
+
+	if (execution == NULL)
+	{
+		return;
+	}
+
+	execution->discardResults = discardResults;
+
+	if (execution->streamingScanState != NULL)
+	{
+		dlist_delete(&execution->streamingExecutionNode);
+		execution->streamingScanState = NULL;
+	}
+
+	if (!execution->eventLoopFinished)
+	{
+		bool yieldWhenRowsAvailable = false;
+		RunDistributedExecutionEventLoop(execution, yieldWhenRowsAvailable);
+	}
+
+	if (scanState->distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		/* streamed modifications never have local tasks */
+		EState *executorState = ScanStateGetExecutorState(scanState);
+		executorState->es_processed = execution->rowsProcessed;
+	}
+
+	StoreWorkerPoolExecutionStats(scanState, execution);
+	scanState->receivedRowBytes = execution->receivedRowBytes;
+	FinishDistributedExecution(execution);
+
+	scanState->distributedExecution = NULL;
+}
+
+
+/*
+ * FinishStreamingExecutions runs the streaming executions that did not finish
+ * yet to completion, such that the remaining rows of their scans are read from
+ * the tuple stores.
+ *
+ * A streaming execution keeps its connections claimed between fetches, so
+ * other executions in the same transaction cannot use them. That fails when
+ * a placement was modified over one of those connections, since it must then
+ * be accessed over the same connection, for instance when a cursor reads rows
+ * after an UPDATE, or when a PL/pgSQL loop modifies the rows that it reads.
+ * We therefore give up on streaming once another execution starts.
+ */
+void
+FinishStreamingExecutions(void)
+{
+	while (!dlist_is_empty(&StreamingExecutionList))
+	{
+		dlist_node *executionNode = dlist_head_node(&StreamingExecutionList);
+		DistributedExecution *execution =
+			dlist_container(DistributedExecution, streamingExecutionNode,
+							executionNode);
+
+		bool discardResults = false;
+		FinishStreamingExecution(execution->streamingScanState, discardResults);
+	}
+}
+
+
+/*
+ * CleanUpStreamingExecution is a memory context reset callback for streaming
+ * executions that are abandoned due to an error. It frees the wait event set
+ * and forgets about the execution.
+ */
+static void
+CleanUpStreamingExecution(void *arg)
+{
+	DistributedExecution *execution = (DistributedExecution *) arg;
+
+	if (execution->streamingScanState != NULL)
+	{
+		dlist_delete(&execution->streamingExecutionNode);
+		execution->streamingScanState = NULL;
+	}
+
+	FreeExecutionWaitEventSet(arg);
+}
+
+
+/*
+ * FreeExecutionWaitEventSet is a memory context reset callback that frees the
+ * wait event set of a distributed execution, if it is still around.
+ */
+static void
+FreeExecutionWaitEventSet(void *arg)
+{
+	DistributedExecution *execution = (DistributedExecution *) arg;
+
+	if (execution->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
+	}
+}
+
+
+/*
+ * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
+ * This happens when the connection set for the distributed execution is changed,
+ * which means that we need to update which connections we wait on for events.
+ * It returns the new event set size.
+ */
+static int
+RebuildWaitEventSet(DistributedExecution *execution)
+{
+	if (execution->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
+	}
+
+	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
+	execution->rebuildWaitEventSet = false;
+
+	/* all sessions are now up-to-date in the wait event set */
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->waitEventUpdateSessionList)
+	{
+		session->waitEventUpdatePending = false;
+	}
+
+	list_free(execution->waitEventUpdateSessionList);
+	execution->waitEventUpdateSessionList = NIL;
+
+	int waitEventSetSessionCount = 0;
+	foreach_ptr(session, execution->sessionList)
+	{
+		if (session->waitEventSetIndex != WAIT_EVENT_SET_INDEX_NOT_INITIALIZED)
+		{
+			waitEventSetSessionCount++;
+		}
+	}
+
+	execution->waitEventSetSessionCount = waitEventSetSessionCount;
+
+	return GetEventSetSize(execution->sessionList);
+}
+
+
+/*
+ * UpdateWaitEventSet adds the sessions that were created since the wait event
+ * set was built to the wait event set, and modifies the wait events of the
+ * sessions whose wait flags changed. Unlike RebuildWaitEventSet, this only
+ * touches the sessions in waitEventUpdateSessionList.
+ *
+ * Postgres does not allow removing events from, or growing, a WaitEventSet.
+ * Hence, if there is no space left for a new session, the function signals
+ * that the wait event set needs to be rebuilt instead.
+ */
+static void
+UpdateWaitEventSet(DistributedExecution *execution)
+{
+	/* postmaster and latch events take 2 slots */
+	int sessionCapacity = execution->eventSetSize - 2;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->waitEventUpdateSessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		session->waitEventUpdatePending = false;
+
+		if (execution->rebuildWaitEventSet)
+		{
+			/* the rebuild takes care of the remaining sessions */
+			continue;
+		}
+
+		if (connection->pgConn == NULL)
+		{
+			/* connection died earlier in the transaction */
+			continue;
+		}
+
+		if (connection->waitFlags == 0)
+		{
+			/* not currently waiting for this connection */
+			continue;
+		}
+
+		int sock = PQsocket(connection->pgConn);
+		if (sock == -1)
+		{
+			/* connection was closed */
+			continue;
+		}
+
+		if (session->waitEventSetIndex != WAIT_EVENT_SET_INDEX_NOT_INITIALIZED)
+		{
+			ModifyWaitEvent(execution->waitEventSet, session->waitEventSetIndex,
+							connection->waitFlags, NULL);
+		}
+		else if (execution->waitEventSetSessionCount < sessionCapacity)
+		{
+			session->waitEventSetIndex =
+				AddWaitEventToSet(execution->waitEventSet, connection->waitFlags,
+								  sock, NULL, (void *) session);
+			execution->waitEventSetSessionCount++;
+		}
+		else
+		{
+			/* no space left for the new session */
+			execution->rebuildWaitEventSet = true;
+		}
+	}
+
+	list_free(execution->waitEventUpdateSessionList);
+	execution->waitEventUpdateSessionList = NIL;
+}
+
+
+/*
+ * ProcessWaitEvents processes the received events from connections.
+ */
+static void
+ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
+				  bool *cancellationReceived)
+{
+	int eventIndex = 0;
+
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+
+			if (execution->raiseInterrupts)
+			{
+				CHECK_FOR_INTERRUPTS();
+			}
+
+			if (IsHoldOffCancellationReceived())
+			{
+				/*
+				 * Break out of event loop immediately in case of cancellation.
+				 * We cannot use "return" here inside a PG_TRY() block since
+				 * then the exception stack won't be reset.
+				 */
+				*cancellationReceived = true;
+			}
+
+			continue;
+		}
+
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
+
+		ConnectionStateMachine(session);
+	}
+}
+
+
+/*
+ * ManageWorkerPool ensures the worker pool has the appropriate number of connections
+ * based on the number of pending tasks.
+ */
+static void
+ManageWorkerPool(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	int targetPoolSize = execution->targetPoolSize;
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->activeConnectionCount;
 	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
 		workerPool->idleConnectionCount;
 	int failedConnectionCount = workerPool->failedConnectionCount;
@@ -2311,6 +3704,13 @@ ManageWorkerPool(WorkerPool *workerPool)
 		return;
 	}
 
+	if (workerPool->nodeIsSuspect && initiatedConnectionCount == 0)
+	{
+		/* do not wait for the connection timeout of a node that is likely down */
+		FailSuspectWorkerPool(workerPool);
+		return;
+	}
+
 	if (UseConnectionPerPlacement())
 	{
 		int unusedConnectionCount = workerPool->unusedConnectionCount;
@@ -2343,7 +3743,14 @@ ManageWorkerPool(WorkerPool *workerPool)
 		 */
 		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
 
-		if (newConnectionCount > 0 && ExecutorSlowStartInterval != SLOW_START_DISABLED)
+		if (workerPool->hasLatencyEstimates)
+		{
+			/* decide up front, based on how long tasks and connections take */
+			newConnectionCount = Min(LatencyBasedNewConnectionCount(workerPool),
+									 maxNewConnectionCount);
+		}
+		else if (newConnectionCount > 0 &&
+				 ExecutorSlowStartInterval != SLOW_START_DISABLED)
 		{
 			if (MillisecondsPassedSince(workerPool->lastConnectionOpenTime) >=
 				ExecutorSlowStartInterval)
@@ -2381,6 +3788,12 @@ ManageWorkerPool(WorkerPool *workerPool)
 			connectionFlags |= OUTSIDE_TRANSACTION;
 		}
 
+		if (execution->totalTaskCount > 1)
+		{
+			/* multi-shard executions yield to single-shard ones for slots */
+			connectionFlags |= MULTI_SHARD_EXECUTION;
+		}
+
 		if (UseConnectionPerPlacement())
 		{
 			/*
@@ -2456,7 +3869,6 @@ ManageWorkerPool(WorkerPool *workerPool)
 	}
 
 	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
-	execution->rebuildWaitEventSet = true;
 }
 
 
@@ -2478,7 +3890,7 @@ ShouldWaitForConnection(WorkerPool *workerPool)
 		return true;
 	}
 
-	if (list_length(workerPool->sessionList) < MaxCachedConnectionsPerWorker)
+	if (list_length(workerPool->sessionList) < GetMaxCachedConnectionsPerWorker())
 	{
 		/*
 		 * Until this session caches MaxCachedConnectionsPerWorker connections,
@@ -2545,6 +3957,8 @@ CheckConnectionTimeout(WorkerPool *workerPool)
 		{
 			int logLevel = WARNING;
 
+			RecordNodeConnectionFailure(workerPool->nodeName, workerPool->nodePort);
+
 			/*
 			 * First fail the pool and create an opportunity to execute tasks
 			 * over other pools when tasks have more than one placement to execute.
@@ -2577,8 +3991,43 @@ CheckConnectionTimeout(WorkerPool *workerPool)
 
 
 /*
- * UsableConnectionCount returns the number of connections in the worker pool
- * that are (soon to be) usable for sending commands, this includes both idle
+ * FailSuspectWorkerPool fails a worker pool whose node failed the last
+ * citus.node_failure_threshold connection attempts without trying to connect,
+ * such that reads can fail over to other placements right away. Modifications
+ * error out instead, since failing over would mark the placements on the node
+ * as inactive without ever trying to reach it.
+ */
+static void
+FailSuspectWorkerPool(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	if (execution->modLevel > ROW_MODIFY_READONLY ||
+		execution->transactionProperties->errorOnAnyFailure)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("node %s:%d is unreachable", workerPool->nodeName,
+							   workerPool->nodePort),
+						errdetail("The last %d attempts to connect to the node failed.",
+								  NodeFailureThreshold),
+						errhint("A connection to the node is attempted again every "
+								"citus.node_probe_interval.")));
+	}
+
+	WorkerPoolFailed(workerPool);
+
+	/* if some tasks have no other placement, the execution fails */
+	int logLevel = execution->failed ? ERROR : DEBUG1;
+
+	ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+					   errmsg("skipping unreachable node %s:%d",
+							  workerPool->nodeName, workerPool->nodePort)));
+}
+
+
+/*
+ * UsableConnectionCount returns the number of connections in the worker pool
+ * that are (soon to be) usable for sending commands, this includes both idle
  * connections and connections that are still establishing.
  */
 static int
@@ -2650,7 +4099,8 @@ NextEventTimeout(DistributedExecution *execution)
 		 * If there are connections to open we wait at most up to the end of the
 		 * current slow start interval.
 		 */
-		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
+		if (!workerPool->hasLatencyEstimates &&
+			workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
 			initiatedConnectionCount < execution->targetPoolSize)
 		{
 			long timeSinceLastConnectMs =
@@ -2669,6 +4119,71 @@ NextEventTimeout(DistributedExecution *execution)
 }
 
 
+/*
+ * LatencyBasedNewConnectionCount returns the number of connections to open
+ * to the worker of the given pool, based on how long it took to establish
+ * connections to the worker and to run tasks on it in the past.
+ *
+ * A new connection only pays off if it runs tasks for at least as long as it
+ * takes to establish it, so we aim for one connection per that many ready
+ * tasks. Short tasks are therefore run over few connections, while long
+ * tasks get a connection each right away instead of waiting for slow start.
+ */
+static int
+LatencyBasedNewConnectionCount(WorkerPool *workerPool)
+{
+	int readyTaskCount = workerPool->readyTaskCount;
+	double tasksPerConnection = 1.0;
+
+	if (workerPool->expectedTaskTime > 0.0)
+	{
+		tasksPerConnection = Max(1.0, workerPool->expectedConnectionTime /
+								 workerPool->expectedTaskTime);
+	}
+	else
+	{
+		/* tasks take no measurable time, a single connection will do */
+		tasksPerConnection = Max(1, readyTaskCount);
+	}
+
+	if (tasksPerConnection > readyTaskCount)
+	{
+		/* also covers huge ratios, which do not fit in an int */
+		tasksPerConnection = Max(1, readyTaskCount);
+	}
+
+	int neededConnectionCount = (int) ceil(readyTaskCount / tasksPerConnection);
+
+	return neededConnectionCount - UsableConnectionCount(workerPool);
+}
+
+
+/*
+ * RecordWorkerPoolTaskTimes records the durations of the tasks that finished
+ * on each worker in shared memory, for adaptive pool sizing of subsequent
+ * executions.
+ */
+static void
+RecordWorkerPoolTaskTimes(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->finishedTaskCount == 0)
+		{
+			continue;
+		}
+
+		RecordSharedTaskExecutions(workerPool->nodeName, workerPool->nodePort,
+								   workerPool->finishedTaskCount,
+								   workerPool->finishedTaskTime);
+
+		workerPool->finishedTaskCount = 0;
+		workerPool->finishedTaskTime = 0.0;
+	}
+}
+
+
 /*
  * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
  * between timestamps when it is expected to be small enough to fit in a
@@ -2721,6 +4236,7 @@ ConnectionStateMachine(WorkerSession *session)
 				}
 				else if (status == CONNECTION_BAD)
 				{
+					RecordNodeConnectionFailure(connection->hostname, connection->port);
 					connection->connectionState = MULTI_CONNECTION_FAILED;
 					break;
 				}
@@ -2736,6 +4252,7 @@ ConnectionStateMachine(WorkerSession *session)
 
 				if (pollMode == PGRES_POLLING_FAILED)
 				{
+					RecordNodeConnectionFailure(connection->hostname, connection->port);
 					connection->connectionState = MULTI_CONNECTION_FAILED;
 				}
 				else if (pollMode == PGRES_POLLING_READING)
@@ -2885,8 +4402,23 @@ HandleMultiConnectionSuccess(WorkerSession *session)
 							connection->hostname, connection->port,
 							session->sessionId)));
 
+	MarkConnectionEstablished(connection);
+
 	workerPool->activeConnectionCount++;
 	workerPool->idleConnectionCount++;
+
+	if (workerPool->poolStats != NULL)
+	{
+		long connectionSeconds = 0;
+		int connectionMicroseconds = 0;
+
+		TimestampDifference(connection->connectionStart, GetCurrentTimestamp(),
+							&connectionSeconds, &connectionMicroseconds);
+
+		workerPool->poolStats->connectionCount++;
+		workerPool->poolStats->connectionTime +=
+			connectionSeconds * 1000.0 + connectionMicroseconds / 1000.0;
+	}
 }
 
 
@@ -3000,6 +4532,42 @@ TransactionStateMachine(WorkerSession *session)
 					/* if we're expanding the nodes in a transaction, use 2PC */
 					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
 
+					if (CanCoalesceTransactionBegin(execution))
+					{
+						TaskPlacementExecution *placementExecution =
+							PopPlacementExecution(session);
+
+						if (placementExecution != NULL)
+						{
+							/* open the transaction block in the same command */
+							char *beginCommand = RemoteTransactionBeginCommand(connection);
+							int beginResultCount = COALESCED_BEGIN_RESULT_COUNT;
+
+							bool placementExecutionStarted =
+								StartPlacementExecutionOnSession(placementExecution,
+																 session, beginCommand,
+																 beginResultCount);
+
+							transaction->beginSent = true;
+
+							if (!placementExecutionStarted)
+							{
+								/* no need to continue, connection is lost */
+								Assert(session->connection->connectionState ==
+									   MULTI_CONNECTION_LOST);
+
+								return;
+							}
+
+							transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+
+							UpdateConnectionWaitFlags(session,
+													  WL_SOCKET_READABLE |
+													  WL_SOCKET_WRITEABLE);
+							break;
+						}
+					}
+
 					/* need to open a transaction block first */
 					StartRemoteTransactionBegin(connection);
 
@@ -3021,7 +4589,8 @@ TransactionStateMachine(WorkerSession *session)
 					}
 
 					bool placementExecutionStarted =
-						StartPlacementExecutionOnSession(placementExecution, session);
+						StartPlacementExecutionOnSession(placementExecution, session,
+														 NULL, 0);
 					if (!placementExecutionStarted)
 					{
 						/* no need to continue, connection is lost */
@@ -3096,6 +4665,23 @@ TransactionStateMachine(WorkerSession *session)
 
 			case REMOTE_TRANS_STARTED:
 			{
+				bool coalesceSavepoints = CanCoalesceSavepoints(execution);
+
+				/*
+				 * Savepoints that were created since the connection was last
+				 * used precede the next task. If they cannot be sent in the
+				 * same command, send them first.
+				 */
+				if (!coalesceSavepoints && HasReadyPlacementExecution(session) &&
+					StartRemoteTransactionSavepoints(connection))
+				{
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+
 				TaskPlacementExecution *placementExecution = PopPlacementExecution(
 					session);
 				if (placementExecution == NULL)
@@ -3105,8 +4691,18 @@ TransactionStateMachine(WorkerSession *session)
 					break;
 				}
 
+				char *savepointCommand = NULL;
+				int savepointCount = 0;
+
+				if (coalesceSavepoints)
+				{
+					savepointCommand = RemoteTransactionSavepointCommand(connection,
+																		 &savepointCount);
+				}
+
 				bool placementExecutionStarted =
-					StartPlacementExecutionOnSession(placementExecution, session);
+					StartPlacementExecutionOnSession(placementExecution, session,
+													 savepointCommand, savepointCount);
 				if (!placementExecutionStarted)
 				{
 					/* no need to continue, connection is lost */
@@ -3121,6 +4717,31 @@ TransactionStateMachine(WorkerSession *session)
 
 			case REMOTE_TRANS_SENT_COMMAND:
 			{
+				if (session->pendingPreparedStatement != NULL)
+				{
+					WorkerPreparedStatement *preparedStatement =
+						session->pendingPreparedStatement;
+
+					bool prepareDone = ReceivePrepareResults(session);
+					if (!prepareDone)
+					{
+						break;
+					}
+
+					if (!SendPreparedPlacementExecution(session, preparedStatement))
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
+
+						return;
+					}
+
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+
 				TaskPlacementExecution *placementExecution = session->currentTask;
 				ShardCommandExecution *shardCommandExecution =
 					placementExecution->shardCommandExecution;
@@ -3131,6 +4752,18 @@ TransactionStateMachine(WorkerSession *session)
 					/* already received results from another replica */
 					storeRows = false;
 				}
+				else if (execution->discardResults)
+				{
+					/* the scan ended before all results were read */
+					storeRows = false;
+				}
+				else if (shardCommandExecution->resultPlacementExecution != NULL &&
+						 shardCommandExecution->resultPlacementExecution !=
+						 placementExecution)
+				{
+					/* another placement of a hedged task already returns rows */
+					storeRows = false;
+				}
 
 				bool fetchDone = ReceiveResults(session, storeRows);
 				if (!fetchDone)
@@ -3156,17 +4789,13 @@ TransactionStateMachine(WorkerSession *session)
 
 /*
  * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
- *
- * This function might further improved in a sense that to use use ModifyWaitEvent on
- * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
- * Our initial benchmarks didn't show any significant performance improvements, but
- * good to keep in mind the potential improvements.
+ * If the flags changed, the session is marked such that only its wait event is
+ * modified before the next wait.
  */
 static void
 UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
 {
 	MultiConnection *connection = session->connection;
-	DistributedExecution *execution = session->workerPool->distributedExecution;
 
 	/* do not take any actions if the flags not changed */
 	if (connection->waitFlags == waitFlags)
@@ -3177,7 +4806,28 @@ UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
 	connection->waitFlags = waitFlags;
 
 	/* without signalling the execution, the flag changes won't be reflected */
-	execution->waitFlagsChanged = true;
+	MarkSessionForWaitEventUpdate(session);
+}
+
+
+/*
+ * MarkSessionForWaitEventUpdate adds the session to the list of sessions whose
+ * wait events should be added or modified before the next wait, unless it is
+ * already in the list.
+ */
+static void
+MarkSessionForWaitEventUpdate(WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+
+	if (session->waitEventUpdatePending)
+	{
+		return;
+	}
+
+	execution->waitEventUpdateSessionList =
+		lappend(execution->waitEventUpdateSessionList, session);
+	session->waitEventUpdatePending = true;
 }
 
 
@@ -3310,10 +4960,139 @@ PopUnassignedPlacementExecution(WorkerPool *workerPool)
 }
 
 
+/*
+ * CanCoalesceTransactionBegin returns whether the command that opens a remote
+ * transaction block can be sent in the same command as the first task of the
+ * execution on a connection, saving a round trip.
+ *
+ * That requires the simple query protocol, so we restrict it to executions
+ * without parameters and binary results. We also need to know how many results
+ * precede those of the task, so we skip transactions that need to replay
+ * savepoints or SET LOCAL commands.
+ */
+static bool
+CanCoalesceTransactionBegin(DistributedExecution *execution)
+{
+	if (!EnableCoalescedBegin)
+	{
+		return false;
+	}
+
+	if (execution->paramListInfo != NULL || execution->binaryResults)
+	{
+		return false;
+	}
+
+	return ActiveSubXactContexts() == NIL && activeSetStmts == NULL;
+}
+
+
+/*
+ * CanCoalesceSavepoints returns whether the savepoints that were created since
+ * a connection was last used can be sent in the same command as the next task
+ * on the connection, which requires the simple query protocol.
+ */
+static bool
+CanCoalesceSavepoints(DistributedExecution *execution)
+{
+	return execution->paramListInfo == NULL && !execution->binaryResults;
+}
+
+
+/*
+ * ParallelWorkersCommand returns a SET LOCAL command for the number of
+ * parallel workers that the worker may use for the given placement execution
+ * when citus.parallel_workers_per_node is set, or NULL if the worker should
+ * decide by itself.
+ *
+ * We only send the command for read-only tasks on shards that are large
+ * enough to be scanned in parallel, according to the shard size cache. When
+ * min_parallel_table_scan_size is 0, every shard is large enough and the
+ * cache is not needed. The tasks of the execution that run on the node at
+ * the same time share the parallel workers, such that a few tasks on large
+ * shards use all of them, while many concurrent tasks do not add parallel
+ * workers on top of the cores they already keep busy.
+ *
+ * The command is prepended to the task query, which runs in the same implicit
+ * transaction if there is no transaction block, so that requires the simple
+ * query protocol. In a transaction block, the setting also applies to later
+ * tasks on the connection that do not send the command.
+ */
+static char *
+ParallelWorkersCommand(TaskPlacementExecution *placementExecution,
+					   WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	Task *task = shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+	uint64 shardSize = 0;
+
+	if (ParallelWorkersPerNode <= 0 || task->taskType != SELECT_TASK)
+	{
+		return NULL;
+	}
+
+	if ((execution->paramListInfo != NULL && !task->parametersInQueryStringResolved) ||
+		UseBinaryResults(execution, shardCommandExecution))
+	{
+		return NULL;
+	}
+
+	if (task->anchorShardId == INVALID_SHARD_ID)
+	{
+		return NULL;
+	}
+
+	if (min_parallel_table_scan_size > 0 &&
+		(!CachedPlacementSize(task->anchorShardId, taskPlacement->groupId,
+							  SHARD_RELATION_SIZE, &shardSize) ||
+		 shardSize < (uint64) min_parallel_table_scan_size * BLCKSZ))
+	{
+		return NULL;
+	}
+
+	int concurrentTaskCount = Min(workerPool->assignedTaskCount,
+								  execution->targetPoolSize);
+	int parallelWorkerCount = ParallelWorkersPerNode / Max(concurrentTaskCount, 1);
+
+	return psprintf("SET LOCAL max_parallel_workers_per_gather TO %d;",
+					parallelWorkerCount);
+}
+
+
+/*
+ * HasReadyPlacementExecution returns whether PopPlacementExecution would
+ * return a placement execution for the session.
+ */
+static bool
+HasReadyPlacementExecution(WorkerSession *session)
+{
+	if (!dlist_is_empty(&session->readyTaskQueue))
+	{
+		return true;
+	}
+
+	if (session->commandsSent > 0 && UseConnectionPerPlacement())
+	{
+		return false;
+	}
+
+	return !dlist_is_empty(&session->workerPool->readyTaskQueue);
+}
+
+
 /*
  * StartPlacementExecutionOnSession gets a TaskPlacementExecition and
  * WorkerSession, the task's query is sent to the worker via the session.
  *
+ * If transactionCommand is not NULL, it is sent in front of the task's query
+ * in the same command, and its transactionCommandResultCount results are
+ * skipped in ReceiveResults. The caller should only pass a transaction block
+ * start if CanCoalesceTransactionBegin() is true, and savepoints if
+ * CanCoalesceSavepoints() is true.
+ *
  * The function does some bookkeeping such as associating the placement
  * accesses with the connection and updating session's local variables. For
  * details read the comments in the function.
@@ -3323,7 +5102,8 @@ PopUnassignedPlacementExecution(WorkerPool *workerPool)
  */
 static bool
 StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
-								 WorkerSession *session)
+								 WorkerSession *session, char *transactionCommand,
+								 int transactionCommandResultCount)
 {
 	WorkerPool *workerPool = session->workerPool;
 	DistributedExecution *execution = workerPool->distributedExecution;
@@ -3340,6 +5120,16 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 													placementExecution->
 													placementExecutionIndex);
 
+	/* replace reads of small intermediate results by their data */
+	queryString = InlineIntermediateResults(queryString);
+
+	if (execution->explainAnalyzeTasks)
+	{
+		/* the rows of the task are followed by its EXPLAIN ANALYZE output */
+		queryString = WrapQueryForExplainAnalyze(queryString,
+												 execution->tupleDescriptor);
+	}
+
 	if (execution->transactionProperties->useRemoteTransactionBlocks !=
 		TRANSACTION_BLOCKS_DISALLOWED)
 	{
@@ -3354,6 +5144,11 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 	/* one more command is sent over the session */
 	session->commandsSent++;
 
+	if (workerPool->poolStats != NULL)
+	{
+		RecordPlacementExecutionStartForStats(workerPool);
+	}
+
 	if (session->commandsSent == 1)
 	{
 		/* first time we send a command, consider the connection used (not unused) */
@@ -3363,21 +5158,158 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 	/* connection is going to be in use */
 	workerPool->idleConnectionCount--;
 	session->currentTask = placementExecution;
+	session->explainAnalyzeResultPending = execution->explainAnalyzeTasks;
+	session->receivingExplainAnalyzeResult = false;
 	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
 
+	if (execution->hedgeReads || execution->recordTaskTimes ||
+		workerPool->nodeStats != NULL)
+	{
+		INSTR_TIME_SET_CURRENT(placementExecution->startTime);
+	}
+
+	if (execution->traceId != NULL)
+	{
+		placementExecution->sendTime = GetCurrentTimestamp();
+	}
+
+	if (CanBatchPlacementExecution(placementExecution))
+	{
+		StringInfo batchedQueryString = makeStringInfo();
+		int batchSize = 1;
+
+		appendStringInfoString(batchedQueryString, queryString);
+
+		/*
+		 * Append more shard commands to the same query string, such that they
+		 * are all sent in a single round trip. The results are demultiplexed
+		 * in ReceiveResults.
+		 */
+		while (batchSize < ExecutorBatchSize)
+		{
+			TaskPlacementExecution *batchedExecution =
+				PopBatchablePlacementExecution(session);
+			if (batchedExecution == NULL)
+			{
+				break;
+			}
+
+			Task *batchedTask = batchedExecution->shardCommandExecution->task;
+			char *batchedQuery =
+				TaskQueryStringForPlacement(batchedTask,
+											batchedExecution->placementExecutionIndex);
+			batchedQuery = InlineIntermediateResults(batchedQuery);
+
+			appendStringInfo(batchedQueryString, ";%s", batchedQuery);
+
+			StartBatchedPlacementExecution(batchedExecution, session);
+
+			batchSize++;
+		}
+
+		if (batchSize > 1)
+		{
+			ereport(DEBUG1, (errmsg("sending %d shard commands in a single round trip",
+									batchSize)));
+		}
+
+		queryString = batchedQueryString->data;
+	}
+
+	char *parallelWorkersCommand = ParallelWorkersCommand(placementExecution,
+														  workerPool);
+	if (parallelWorkersCommand != NULL)
+	{
+		queryString = psprintf("%s%s", parallelWorkersCommand, queryString);
+	}
+
+	if (transactionCommand != NULL)
+	{
+		Assert(paramListInfo == NULL && !execution->binaryResults);
+
+		queryString = psprintf("%s%s", transactionCommand, queryString);
+		session->pendingBeginResultCount = transactionCommandResultCount;
+	}
+
+	if (parallelWorkersCommand != NULL)
+	{
+		/* skip the result of SET LOCAL like those of the transaction command */
+		session->pendingBeginResultCount++;
+	}
+
+	if (ShouldPropagateTraceParent(execution, task))
+	{
+		/* let the commands on the worker be found by the trace context */
+		queryString = psprintf("%s%s",
+							   TraceParentComment(execution->traceId,
+												  placementExecution->spanId),
+							   queryString);
+	}
+
+	bool binaryResults = UseBinaryResults(execution, shardCommandExecution);
+
 	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
 	{
 		int parameterCount = paramListInfo->numParams;
 		Oid *parameterTypes = NULL;
 		const char **parameterValues = NULL;
+		int *parameterLengths = NULL;
+		int *parameterFormats = NULL;
+		WorkerPreparedStatement *preparedStatement = NULL;
 
 		/* force evaluation of bound params */
 		paramListInfo = copyParamList(paramListInfo);
 
 		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
-											&parameterValues);
-		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
-											parameterTypes, parameterValues);
+											&parameterValues, &parameterLengths,
+											&parameterFormats);
+
+		if (EnableWorkerPreparedStatements)
+		{
+			preparedStatement = GetWorkerPreparedStatement(connection, queryString,
+														   parameterCount,
+														   parameterTypes);
+		}
+
+		if (preparedStatement != NULL && preparedStatement->prepared)
+		{
+			querySent = SendRemotePreparedCommand(connection, preparedStatement,
+												  parameterValues, parameterLengths,
+												  parameterFormats, binaryResults);
+		}
+		else if (preparedStatement != NULL && preparedStatement->useCount > 1)
+		{
+			/*
+			 * The command is sent repeatedly over this connection, so prepare it
+			 * first. The task is sent by SendPreparedPlacementExecution once the
+			 * statement is prepared.
+			 */
+			querySent = SendRemotePrepare(connection, preparedStatement);
+			if (querySent == 0)
+			{
+				connection->connectionState = MULTI_CONNECTION_LOST;
+				return false;
+			}
+
+			session->pendingPreparedStatement = preparedStatement;
+
+			return true;
+		}
+		else
+		{
+			querySent = SendRemoteCommandParamsExtended(connection, queryString,
+														parameterCount, parameterTypes,
+														parameterValues, parameterLengths,
+														parameterFormats, binaryResults);
+		}
+	}
+	else if (binaryResults)
+	{
+		int parameterCount = 0;
+
+		querySent = SendRemoteCommandParamsExtended(connection, queryString,
+													parameterCount, NULL, NULL, NULL,
+													NULL, binaryResults);
 	}
 	else
 	{
@@ -3390,6 +5322,8 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 		return false;
 	}
 
+	RecordNodeBytes(workerPool->nodeStats, strlen(queryString), 0);
+
 	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
 	if (singleRowMode == 0)
 	{
@@ -3401,6 +5335,254 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 }
 
 
+/*
+ * UseBinaryResults returns whether the results of the shard command should be
+ * requested in binary format.
+ *
+ * Binary results require the extended protocol, which only allows a single
+ * statement per command, so we restrict it to plain queries on shards.
+ */
+static bool
+UseBinaryResults(DistributedExecution *execution,
+				 ShardCommandExecution *shardCommandExecution)
+{
+	Task *task = shardCommandExecution->task;
+
+	return execution->binaryResults &&
+		   shardCommandExecution->expectResults &&
+		   (task->taskType == SELECT_TASK ||
+			task->taskType == MODIFY_TASK);
+}
+
+
+/*
+ * ReceivePrepareResults reads the results of preparing the statement for the
+ * current task of the session. It returns whether all results were read. On
+ * failure, it throws an error like a failure of the task itself would.
+ */
+static bool
+ReceivePrepareResults(WorkerSession *session)
+{
+	MultiConnection *connection = session->connection;
+
+	while (!PQisBusy(connection->pgConn))
+	{
+		PGresult *result = PQgetResult(connection->pgConn);
+		if (result == NULL)
+		{
+			session->pendingPreparedStatement->prepared = true;
+			session->pendingPreparedStatement = NULL;
+
+			return true;
+		}
+
+		if (!IsResponseOK(result))
+		{
+			/* query failures are always hard errors */
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+	}
+
+	return false;
+}
+
+
+/*
+ * SendPreparedPlacementExecution sends the current task of the session, for
+ * which a statement was just prepared on the worker. It returns whether the
+ * task was sent successfully.
+ */
+static bool
+SendPreparedPlacementExecution(WorkerSession *session,
+							   WorkerPreparedStatement *preparedStatement)
+{
+	MultiConnection *connection = session->connection;
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	ShardCommandExecution *shardCommandExecution =
+		session->currentTask->shardCommandExecution;
+	Oid *parameterTypes = NULL;
+	const char **parameterValues = NULL;
+	int *parameterLengths = NULL;
+	int *parameterFormats = NULL;
+
+	/* force evaluation of bound params */
+	ParamListInfo paramListInfo = copyParamList(execution->paramListInfo);
+
+	ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
+										&parameterValues, &parameterLengths,
+										&parameterFormats);
+
+	bool binaryResults = UseBinaryResults(execution, shardCommandExecution);
+	int querySent = SendRemotePreparedCommand(connection, preparedStatement,
+											  parameterValues, parameterLengths,
+											  parameterFormats, binaryResults);
+	if (querySent == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
+	if (singleRowMode == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CanBatchPlacementExecution returns whether the given placement execution can
+ * be sent to the worker in the same command as other placement executions.
+ *
+ * We only batch modifications that do not return rows and that run on a single
+ * placement, since in that case every command produces exactly one
+ * PGRES_COMMAND_OK result and does not depend on the outcome of another
+ * placement execution. Commands with parameters require the extended protocol,
+ * which does not allow multiple statements, so they are never batched.
+ */
+static bool
+CanBatchPlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	DistributedExecution *execution =
+		placementExecution->workerPool->distributedExecution;
+	Task *task = shardCommandExecution->task;
+
+	if (ExecutorBatchSize <= 1 || UseConnectionPerPlacement())
+	{
+		return false;
+	}
+
+	if (execution->modLevel <= ROW_MODIFY_READONLY || task->taskType != MODIFY_TASK)
+	{
+		return false;
+	}
+
+	if (shardCommandExecution->expectResults ||
+		shardCommandExecution->placementExecutionCount != 1)
+	{
+		return false;
+	}
+
+	if (execution->paramListInfo != NULL && !task->parametersInQueryStringResolved)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PopBatchablePlacementExecution returns the next placement execution for the
+ * session in the same order as PopPlacementExecution, but only if it can be
+ * batched. Otherwise, the placement execution is left in its queue and NULL
+ * is returned.
+ */
+static TaskPlacementExecution *
+PopBatchablePlacementExecution(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	TaskPlacementExecution *placementExecution = NULL;
+
+	if (!dlist_is_empty(&session->readyTaskQueue))
+	{
+		placementExecution = dlist_head_element(TaskPlacementExecution,
+												sessionReadyQueueNode,
+												&session->readyTaskQueue);
+		if (!CanBatchPlacementExecution(placementExecution))
+		{
+			return NULL;
+		}
+
+		return PopAssignedPlacementExecution(session);
+	}
+
+	if (!dlist_is_empty(&workerPool->readyTaskQueue))
+	{
+		placementExecution = dlist_head_element(TaskPlacementExecution,
+												workerReadyQueueNode,
+												&workerPool->readyTaskQueue);
+		if (!CanBatchPlacementExecution(placementExecution))
+		{
+			return NULL;
+		}
+
+		return PopUnassignedPlacementExecution(workerPool);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * StartBatchedPlacementExecution does the bookkeeping for a placement execution
+ * that is sent over the session along with the session's current task.
+ */
+static void
+StartBatchedPlacementExecution(TaskPlacementExecution *placementExecution,
+							   WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	Task *task = placementExecution->shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+
+	if (execution->transactionProperties->useRemoteTransactionBlocks !=
+		TRANSACTION_BLOCKS_DISALLOWED)
+	{
+		List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+
+		AssignPlacementListToConnection(placementAccessList, session->connection);
+	}
+
+	session->commandsSent++;
+	session->batchedTaskList = lappend(session->batchedTaskList, placementExecution);
+
+	if (session->workerPool->poolStats != NULL)
+	{
+		RecordPlacementExecutionStartForStats(session->workerPool);
+	}
+
+	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+
+	if (execution->traceId != NULL)
+	{
+		placementExecution->sendTime = GetCurrentTimestamp();
+	}
+}
+
+
+/*
+ * BatchedPlacementExecutionDone is called when the result of the current task of
+ * a session is received while more commands of the same batch are pending. It
+ * finishes the current task and makes the next command in the batch current.
+ */
+static void
+BatchedPlacementExecutionDone(WorkerSession *session)
+{
+	TaskPlacementExecution *placementExecution = session->currentTask;
+	bool succeeded = true;
+
+	Assert(session->batchedTaskList != NIL);
+
+	placementExecution->shardCommandExecution->gotResults = true;
+
+	/* same as for regular commands, the connection can no longer fail */
+	MarkRemoteTransactionCritical(session->connection);
+
+	session->currentTask = (TaskPlacementExecution *) linitial(session->batchedTaskList);
+	session->batchedTaskList = list_delete_first(session->batchedTaskList);
+
+	PlacementExecutionDone(placementExecution, succeeded);
+}
+
+
 /*
  * ReceiveResults reads the result of a command or query and writes returned
  * rows to the tuple store of the scan state. It returns whether fetching results
@@ -3415,42 +5597,59 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 	DistributedExecution *execution = workerPool->distributedExecution;
 	DistributedExecutionStats *executionStats = execution->executionStats;
 	TupleDesc tupleDescriptor = execution->tupleDescriptor;
-	AttInMetadata *attributeInputMetadata = execution->attributeInputMetadata;
 	uint32 expectedColumnCount = 0;
-	char **columnArray = execution->columnArray;
-	Tuplestorestate *tupleStore = execution->tupleStore;
+	uint64 receivedRowBytesBefore = execution->receivedRowBytes;
+	uint64 rowsProcessedBefore = execution->rowsProcessed;
 
 	if (tupleDescriptor != NULL)
 	{
 		expectedColumnCount = tupleDescriptor->natts;
 	}
 
-	/*
-	 * We use this context while converting each row fetched from remote node
-	 * into tuple. The context is reseted on every row, thus we create it at the
-	 * start of the loop and reset on every iteration.
-	 */
-	MemoryContext ioContext = AllocSetContextCreate(CurrentMemoryContext,
-													"IoContext",
-													ALLOCSET_DEFAULT_MINSIZE,
-													ALLOCSET_DEFAULT_INITSIZE,
-													ALLOCSET_DEFAULT_MAXSIZE);
-
 	while (!PQisBusy(connection->pgConn))
 	{
-		uint32 columnIndex = 0;
 		uint32 rowsProcessed = 0;
 
 		PGresult *result = PQgetResult(connection->pgConn);
 		if (result == NULL)
 		{
 			/* no more results, break out of loop and free allocated memory */
+			session->explainAnalyzeResultPending = false;
+			session->receivingExplainAnalyzeResult = false;
 			fetchDone = true;
 			break;
 		}
 
+		if (workerPool->poolStats != NULL && session->pendingBeginResultCount == 0)
+		{
+			RecordReceivedResultForStats(workerPool, result);
+		}
+
 		ExecStatusType resultStatus = PQresultStatus(result);
-		if (resultStatus == PGRES_COMMAND_OK)
+		if (session->pendingBeginResultCount > 0)
+		{
+			/*
+			 * The transaction block was opened, or savepoints were created, in
+			 * the same command as the task.
+			 */
+			if (resultStatus != PGRES_SINGLE_TUPLE &&
+				resultStatus != PGRES_TUPLES_OK &&
+				resultStatus != PGRES_COMMAND_OK)
+			{
+				/* failures to start the (sub)transaction are always hard errors */
+				ReportResultError(connection, result, ERROR);
+			}
+
+			/* the row of assign_distributed_transaction_id() precedes its result */
+			if (resultStatus != PGRES_SINGLE_TUPLE)
+			{
+				session->pendingBeginResultCount--;
+			}
+
+			PQclear(result);
+			continue;
+		}
+		else if (resultStatus == PGRES_COMMAND_OK)
 		{
 			char *currentAffectedTupleString = PQcmdTuples(result);
 			int64 currentAffectedTupleCount = 0;
@@ -3464,31 +5663,62 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 				Assert(currentAffectedTupleCount >= 0);
 
 				execution->rowsProcessed += currentAffectedTupleCount;
+				session->currentTask->rowCount += currentAffectedTupleCount;
 			}
 
 			PQclear(result);
 
+			if (session->batchedTaskList != NIL)
+			{
+				/* the next result belongs to the next command in the batch */
+				BatchedPlacementExecutionDone(session);
+				continue;
+			}
+
 			/* no more results, break out of loop and free allocated memory */
 			fetchDone = true;
 			break;
 		}
 		else if (resultStatus == PGRES_TUPLES_OK)
 		{
+			Assert(PQntuples(result) == 0);
+			PQclear(result);
+
+			if (session->explainAnalyzeResultPending)
+			{
+				/* the rows of the task are followed by its EXPLAIN ANALYZE output */
+				session->explainAnalyzeResultPending = false;
+				session->receivingExplainAnalyzeResult = true;
+				continue;
+			}
+
 			/*
 			 * We've already consumed all the tuples, no more results. Break out
 			 * of loop and free allocated memory before returning.
 			 */
-			Assert(PQntuples(result) == 0);
-			PQclear(result);
-
+			session->receivingExplainAnalyzeResult = false;
 			fetchDone = true;
 			break;
 		}
 		else if (resultStatus != PGRES_SINGLE_TUPLE)
 		{
+			if (session->currentTask->cancelled)
+			{
+				/* we cancelled the query, another placement returned the rows */
+				PQclear(result);
+				continue;
+			}
+
 			/* query failures are always hard errors */
 			ReportResultError(connection, result, ERROR);
 		}
+		else if (session->receivingExplainAnalyzeResult)
+		{
+			SaveExplainAnalyzeResult(session->currentTask, result);
+
+			PQclear(result);
+			continue;
+		}
 		else if (!storeRows)
 		{
 			/*
@@ -3499,9 +5729,20 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			continue;
 		}
 
+		/* rows of other placements of the task are discarded from now on */
+		session->currentTask->shardCommandExecution->resultPlacementExecution =
+			session->currentTask;
+
 		rowsProcessed = PQntuples(result);
 		uint32 columnCount = PQnfields(result);
 
+		if (execution->traceId != NULL && session->currentTask->firstRowTime == 0)
+		{
+			session->currentTask->firstRowTime = GetCurrentTimestamp();
+		}
+
+		session->currentTask->rowCount += rowsProcessed;
+
 		if (columnCount != expectedColumnCount)
 		{
 			ereport(ERROR, (errmsg("unexpected number of columns from worker: %d, "
@@ -3509,42 +5750,35 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 								   columnCount, expectedColumnCount)));
 		}
 
+		bool binaryResult = columnCount > 0 && PQfformat(result, 0) == 1;
+		TupleTableSlot *slot = execution->receivedRowSlot;
+
 		for (uint32 rowIndex = 0; rowIndex < rowsProcessed; rowIndex++)
 		{
-			memset(columnArray, 0, columnCount * sizeof(char *));
+			/*
+			 * Switch to a temporary memory context that we reset after each row.
+			 * This protects us from any memory leaks that might be present in the
+			 * input functions of the column types.
+			 */
+			MemoryContext oldContextPerRow = MemoryContextSwitchTo(execution->rowContext);
 
-			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			ExecClearTuple(slot);
+
+			if (binaryResult)
 			{
-				if (PQgetisnull(result, rowIndex, columnIndex))
-				{
-					columnArray[columnIndex] = NULL;
-				}
-				else
-				{
-					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
-					if (SubPlanLevel > 0 && executionStats != NULL)
-					{
-						executionStats->totalIntermediateResultSize += PQgetlength(result,
-																				   rowIndex,
-																				   columnIndex);
-					}
-				}
+				DecodeBinaryResultRow(execution, result, rowIndex);
+			}
+			else
+			{
+				DecodeTextResultRow(execution, result, rowIndex);
 			}
 
-			/*
-			 * Switch to a temporary memory context that we reset after each tuple. This
-			 * protects us from any memory leaks that might be present in I/O functions
-			 * called by BuildTupleFromCStrings.
-			 */
-			MemoryContext oldContextPerRow = MemoryContextSwitchTo(ioContext);
-
-			HeapTuple heapTuple = BuildTupleFromCStrings(attributeInputMetadata,
-														 columnArray);
+			ExecStoreVirtualTuple(slot);
 
 			MemoryContextSwitchTo(oldContextPerRow);
 
-			tuplestore_puttuple(tupleStore, heapTuple);
-			MemoryContextReset(ioContext);
+			StoreReceivedRow(execution, session->currentTask->shardCommandExecution);
+			MemoryContextReset(execution->rowContext);
 
 			execution->rowsProcessed++;
 		}
@@ -3555,15 +5789,418 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 		{
 			ErrorSizeLimitIsExceeded();
 		}
+
+		if (execution->rowLimit > 0 && execution->rowsProcessed >= execution->rowLimit)
+		{
+			/* the LIMIT is satisfied, the rows of other tasks are not needed */
+			SkipRemainingTasks(execution, session->currentTask->shardCommandExecution);
+			execution->rowLimit = 0;
+		}
 	}
 
-	/* the context is local to the function, so not needed anymore */
-	MemoryContextDelete(ioContext);
+	RecordNodeBytes(workerPool->nodeStats, 0,
+					execution->receivedRowBytes - receivedRowBytesBefore);
+
+	if (workerPool->progress != NULL)
+	{
+		workerPool->progress->rowsReceived +=
+			execution->rowsProcessed - rowsProcessedBefore;
+		workerPool->progress->bytesReceived +=
+			execution->receivedRowBytes - receivedRowBytesBefore;
+	}
 
 	return fetchDone;
 }
 
 
+/*
+ * SaveExplainAnalyzeResult stores the EXPLAIN ANALYZE output and execution
+ * duration in the given row of worker_last_saved_explain_analyze() in the task
+ * of the given placement execution, for EXPLAIN ANALYZE to show once the
+ * execution is done.
+ */
+static void
+SaveExplainAnalyzeResult(TaskPlacementExecution *placementExecution,
+						 PGresult *result)
+{
+	Task *task = placementExecution->shardCommandExecution->task;
+
+	if (placementExecution->cancelled || PQntuples(result) != 1 ||
+		PQnfields(result) != 2)
+	{
+		return;
+	}
+
+	task->fetchedExplainAnalyzePlan =
+		MemoryContextStrdup(GetMemoryChunkContext(task), PQgetvalue(result, 0, 0));
+	task->fetchedExplainAnalyzePlacementIndex =
+		placementExecution->placementExecutionIndex;
+	task->fetchedExplainAnalyzeExecutionDuration =
+		strtod(PQgetvalue(result, 0, 1), NULL);
+}
+
+
+/*
+ * DecodeTextResultRow decodes a row of a result that was received in text
+ * format into the received row slot of the execution, using the input
+ * functions of the column types on the values in the result.
+ */
+static void
+DecodeTextResultRow(DistributedExecution *execution, PGresult *result, int rowIndex)
+{
+	AttInMetadata *attributeInputMetadata = execution->attributeInputMetadata;
+	DistributedExecutionStats *executionStats = execution->executionStats;
+	TupleTableSlot *slot = execution->receivedRowSlot;
+	TupleDesc tupleDescriptor = slot->tts_tupleDescriptor;
+	Datum *columnValues = slot->tts_values;
+	bool *columnNulls = slot->tts_isnull;
+	int columnCount = tupleDescriptor->natts;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		char *columnValue = NULL;
+
+		if (TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			columnValues[columnIndex] = (Datum) 0;
+			columnNulls[columnIndex] = true;
+			continue;
+		}
+
+		if (!PQgetisnull(result, rowIndex, columnIndex))
+		{
+			columnValue = PQgetvalue(result, rowIndex, columnIndex);
+
+			if (SubPlanLevel > 0 && executionStats != NULL)
+			{
+				executionStats->totalIntermediateResultSize +=
+					PQgetlength(result, rowIndex, columnIndex);
+			}
+		}
+
+		/* like BuildTupleFromCStrings, call input functions on NULLs for domains */
+		columnValues[columnIndex] =
+			InputFunctionCall(&attributeInputMetadata->attinfuncs[columnIndex],
+							  columnValue,
+							  attributeInputMetadata->attioparams[columnIndex],
+							  attributeInputMetadata->atttypmods[columnIndex]);
+		columnNulls[columnIndex] = (columnValue == NULL);
+	}
+}
+
+
+/*
+ * StoreReceivedRow stores the row in the received row slot of the execution,
+ * which was received from a worker for the given shard command execution, in
+ * the tuple store of the execution, or hands it to the row merger, row
+ * combiner or bounded sort if there is one.
+ *
+ * The tuple store copies the values of the slot into a minimal tuple, so in
+ * the common case the row is copied only once. The other consumers work on
+ * heap tuples, which we form in the row context.
+ */
+static void
+StoreReceivedRow(DistributedExecution *execution,
+				 ShardCommandExecution *shardCommandExecution)
+{
+	TupleTableSlot *slot = execution->receivedRowSlot;
+
+	if (execution->rowMerger == NULL && execution->rowCombiner == NULL &&
+		execution->rowTopN == NULL)
+	{
+		execution->receivedRowBytes += ReceivedRowSize(slot);
+
+		/* the compressed values are freed along with the other values of the row */
+		MemoryContext oldContext = MemoryContextSwitchTo(execution->rowContext);
+		CompressValuesForTuplestore(execution->tupleStore, slot->tts_tupleDescriptor,
+									slot->tts_values, slot->tts_isnull);
+		MemoryContextSwitchTo(oldContext);
+
+		tuplestore_puttupleslot(execution->tupleStore, slot);
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(execution->rowContext);
+	HeapTuple heapTuple = heap_form_tuple(slot->tts_tupleDescriptor, slot->tts_values,
+										  slot->tts_isnull);
+	MemoryContextSwitchTo(oldContext);
+
+	execution->receivedRowBytes += heapTuple->t_len;
+
+	if (execution->rowMerger != NULL)
+	{
+		if (shardCommandExecution->receivedRowRun == NULL)
+		{
+			shardCommandExecution->receivedRowRun =
+				ReceivedRowMergerRun(execution->rowMerger, shardCommandExecution->task);
+		}
+
+		AddReceivedRowToRun(shardCommandExecution->receivedRowRun, heapTuple);
+	}
+	else if (execution->rowCombiner != NULL)
+	{
+		CombineReceivedRow(execution->rowCombiner, heapTuple);
+	}
+	else if (execution->rowTopN != NULL)
+	{
+		AddReceivedRowToTopN(execution->rowTopN, heapTuple);
+	}
+	else
+	{
+		tuplestore_puttuple(execution->tupleStore, heapTuple);
+	}
+}
+
+
+/*
+ * ReceivedRowSize returns the size of the heap tuple that heap_form_tuple
+ * would build from the values in the given slot, without building it.
+ */
+static Size
+ReceivedRowSize(TupleTableSlot *slot)
+{
+	TupleDesc tupleDescriptor = slot->tts_tupleDescriptor;
+	Size headerSize = SizeofHeapTupleHeader;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (slot->tts_isnull[columnIndex])
+		{
+			headerSize += BITMAPLEN(tupleDescriptor->natts);
+			break;
+		}
+	}
+
+	return MAXALIGN(headerSize) + heap_compute_data_size(tupleDescriptor,
+														 slot->tts_values,
+														 slot->tts_isnull);
+}
+
+
+/*
+ * RecordPlacementExecutionStartForStats is called when a placement execution
+ * is sent to the worker of the given pool while worker pool statistics are
+ * collected. Placement executions are queued when the execution starts, so the
+ * time they waited is the time since then.
+ */
+static void
+RecordPlacementExecutionStartForStats(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	WorkerPoolExecutionStats *poolStats = workerPool->poolStats;
+
+	poolStats->taskCount++;
+	poolStats->queueWaitTime += MillisecondsPassedSince(execution->workerPoolStatsStartTime);
+}
+
+
+/*
+ * RecordReceivedResultForStats is called for every result received from the
+ * worker of the given pool while worker pool statistics are collected. It
+ * keeps track of when results arrived and of the rows and bytes they contain.
+ */
+static void
+RecordReceivedResultForStats(WorkerPool *workerPool, PGresult *result)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	WorkerPoolExecutionStats *poolStats = workerPool->poolStats;
+	double elapsedTime = MillisecondsPassedSince(execution->workerPoolStatsStartTime);
+
+	if (!poolStats->receivedResults)
+	{
+		poolStats->receivedResults = true;
+		poolStats->firstByteTime = elapsedTime;
+	}
+
+	poolStats->lastByteTime = elapsedTime;
+
+	if (PQresultStatus(result) != PGRES_SINGLE_TUPLE)
+	{
+		return;
+	}
+
+	int rowCount = PQntuples(result);
+	int columnCount = PQnfields(result);
+
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			poolStats->byteCount += PQgetlength(result, rowIndex, columnIndex);
+		}
+	}
+
+	poolStats->rowCount += rowCount;
+}
+
+
+/*
+ * StoreWorkerPoolExecutionStats hands the statistics of the worker pools of the
+ * given execution to the scan, such that EXPLAIN ANALYZE can show them and
+ * citus_stat_statements can record them once the execution is done.
+ */
+static void
+StoreWorkerPoolExecutionStats(CitusScanState *scanState, DistributedExecution *execution)
+{
+	if (!execution->collectWorkerPoolStats)
+	{
+		return;
+	}
+
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		scanState->workerPoolStatsList =
+			lappend(scanState->workerPoolStatsList, workerPool->poolStats);
+	}
+}
+
+
+/*
+ * CanUseBinaryResultFormat returns whether all columns of the given tuple
+ * descriptor can be sent by the workers in binary format and decoded on this
+ * node. We rely on the same rules as for binary COPY to avoid type OIDs that
+ * differ across nodes, and additionally require a receive function.
+ */
+static bool
+CanUseBinaryResultFormat(TupleDesc tupleDescriptor)
+{
+	if (tupleDescriptor->natts == 0)
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid typeId = column->atttypid;
+		Oid receiveFunctionId = InvalidOid;
+		Oid typeIOParam = InvalidOid;
+		int16 typeLength = 0;
+		bool typeByVal = false;
+		char typeAlign = 0;
+		char typeDelim = 0;
+
+		if (column->attisdropped || !CanUseBinaryCopyFormatForType(typeId))
+		{
+			return false;
+		}
+
+		get_type_io_data(typeId, IOFunc_receive, &typeLength, &typeByVal,
+						 &typeAlign, &typeDelim, &typeIOParam, &receiveFunctionId);
+		if (!OidIsValid(receiveFunctionId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * SetupBinaryResultDecoding looks up the receive functions of the columns in the
+ * result and allocates the arrays that are used to decode rows in binary format.
+ */
+static void
+SetupBinaryResultDecoding(DistributedExecution *execution)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+
+	execution->binaryResults = true;
+	execution->columnReceiveFunctions =
+		(FmgrInfo *) palloc0(columnCount * sizeof(FmgrInfo));
+	execution->columnTypeIOParams = (Oid *) palloc0(columnCount * sizeof(Oid));
+	execution->columnWireTypes = (Oid *) palloc0(columnCount * sizeof(Oid));
+	execution->columnBuffer = makeStringInfo();
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(column->atttypid, &receiveFunctionId,
+							   &execution->columnTypeIOParams[columnIndex]);
+		fmgr_info(receiveFunctionId, &execution->columnReceiveFunctions[columnIndex]);
+
+		/* workers describe domain columns by their base type */
+		execution->columnWireTypes[columnIndex] = getBaseType(column->atttypid);
+	}
+}
+
+
+/*
+ * DecodeBinaryResultRow decodes a row of a result that was received in binary
+ * format into the received row slot of the execution, using the receive
+ * functions of the column types.
+ */
+static void
+DecodeBinaryResultRow(DistributedExecution *execution, PGresult *result, int rowIndex)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	DistributedExecutionStats *executionStats = execution->executionStats;
+	Datum *columnValues = execution->receivedRowSlot->tts_values;
+	bool *columnNulls = execution->receivedRowSlot->tts_isnull;
+	StringInfo columnBuffer = execution->columnBuffer;
+	int columnCount = tupleDescriptor->natts;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid typeId = execution->columnWireTypes[columnIndex];
+
+		/*
+		 * The binary representation depends on the type, so make sure the worker
+		 * sent the type we expect. Workers report the base type of domains, so we
+		 * compare against that. OIDs of user-defined types may differ across
+		 * nodes, but those are only allowed when their representation does not
+		 * contain type OIDs.
+		 */
+		if (typeId < FirstNormalObjectId && PQftype(result, columnIndex) != typeId)
+		{
+			ereport(ERROR, (errmsg("unexpected type %u for column %d from worker, "
+								   "expected %u", PQftype(result, columnIndex),
+								   columnIndex + 1, typeId),
+							errhint("Set citus.enable_binary_protocol to off to "
+									"receive results in text format.")));
+		}
+
+		if (PQgetisnull(result, rowIndex, columnIndex))
+		{
+			columnValues[columnIndex] = (Datum) 0;
+			columnNulls[columnIndex] = true;
+			continue;
+		}
+
+		int valueLength = PQgetlength(result, rowIndex, columnIndex);
+
+		resetStringInfo(columnBuffer);
+		appendBinaryStringInfo(columnBuffer, PQgetvalue(result, rowIndex, columnIndex),
+							   valueLength);
+
+		columnValues[columnIndex] =
+			ReceiveFunctionCall(&execution->columnReceiveFunctions[columnIndex],
+								columnBuffer, execution->columnTypeIOParams[columnIndex],
+								column->atttypmod);
+		columnNulls[columnIndex] = false;
+
+		/* the receive function should have consumed the whole value */
+		if (columnBuffer->cursor != columnBuffer->len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in column %d",
+								   columnIndex + 1)));
+		}
+
+		if (SubPlanLevel > 0 && executionStats != NULL)
+		{
+			executionStats->totalIntermediateResultSize += valueLength;
+		}
+	}
+}
+
+
 /*
  * WorkerPoolFailed marks a worker pool and all the placement executions scheduled
  * on it as failed.
@@ -3651,6 +6288,12 @@ WorkerSessionFailed(WorkerSession *session)
 		PlacementExecutionDone(placementExecution, succeeded);
 	}
 
+	/* commands that were sent in the same batch also failed */
+	foreach_ptr(placementExecution, session->batchedTaskList)
+	{
+		PlacementExecutionDone(placementExecution, succeeded);
+	}
+
 	dlist_foreach(iter, &session->pendingTaskQueue)
 	{
 		placementExecution =
@@ -3669,6 +6312,98 @@ WorkerSessionFailed(WorkerSession *session)
 }
 
 
+/*
+ * ShouldPropagateTraceParent returns whether the trace context should be
+ * prepended to the command of the given task. We skip commands that are sent
+ * as worker prepared statements, since those are cached by their text.
+ */
+static bool
+ShouldPropagateTraceParent(DistributedExecution *execution, Task *task)
+{
+	if (execution->traceId == NULL)
+	{
+		return false;
+	}
+
+	if (execution->paramListInfo != NULL && !task->parametersInQueryStringResolved &&
+		EnableWorkerPreparedStatements)
+	{
+		return false;
+	}
+
+	return task->taskType == SELECT_TASK || task->taskType == MODIFY_TASK;
+}
+
+
+/*
+ * RecordPlacementExecutionSpan records the span of the given placement
+ * execution, which is done, for distributed tracing.
+ */
+static void
+RecordPlacementExecutionSpan(TaskPlacementExecution *placementExecution,
+							 bool succeeded)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	Task *task = placementExecution->shardCommandExecution->task;
+	TaskSpan span;
+
+	memset(&span, 0, sizeof(span));
+	span.traceId = execution->traceId;
+	span.spanId = placementExecution->spanId;
+	span.queryId = execution->traceQueryId;
+	span.taskId = task->taskId;
+	span.shardId = task->anchorShardId;
+	span.nodeName = workerPool->nodeName;
+	span.nodePort = workerPool->nodePort;
+	span.readyTime = placementExecution->readyTime;
+	span.sendTime = placementExecution->sendTime;
+	span.firstRowTime = placementExecution->firstRowTime;
+	span.endTime = GetCurrentTimestamp();
+	span.rowCount = placementExecution->rowCount;
+	span.succeeded = succeeded;
+
+	RecordTaskSpan(&span);
+}
+
+
+/*
+ * UpdateWorkerPoolProgress publishes how many of the tasks of the worker pool
+ * are queued and running, along with the distributed transaction of the
+ * execution, which may have started since the progress was last updated.
+ */
+static void
+UpdateWorkerPoolProgress(WorkerPool *workerPool)
+{
+	QueryProgressWorker *progress = workerPool->progress;
+	DistributedTransactionId *transactionId = GetCurrentDistributedTransactionId();
+	uint64 runningTaskCount = 0;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		if (session->currentTask != NULL)
+		{
+			runningTaskCount += 1 + list_length(session->batchedTaskList);
+		}
+	}
+
+	progress->initiatorNodeIdentifier = transactionId->initiatorNodeIdentifier;
+	progress->transactionNumber = transactionId->transactionNumber;
+	progress->runningTaskCount = runningTaskCount;
+
+	if (progress->taskCount > progress->doneTaskCount + runningTaskCount)
+	{
+		progress->queuedTaskCount =
+			progress->taskCount - progress->doneTaskCount - runningTaskCount;
+	}
+	else
+	{
+		progress->queuedTaskCount = 0;
+	}
+}
+
+
 /*
  * PlacementExecutionDone marks the given placement execution as done when
  * the results have been received or a failure occurred and sets the succeeded
@@ -3685,6 +6420,29 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	TaskExecutionState executionState = shardCommandExecution->executionState;
 	bool failedPlacementExecutionIsOnPendingQueue = false;
 
+	if (execution->traceId != NULL &&
+		placementExecution->executionState != PLACEMENT_EXECUTION_FAILED)
+	{
+		/* placement executions that lost a race show up as failed */
+		RecordPlacementExecutionSpan(placementExecution,
+									 succeeded && !placementExecution->cancelled);
+	}
+
+	if (workerPool->progress != NULL &&
+		placementExecution->executionState != PLACEMENT_EXECUTION_FAILED)
+	{
+		workerPool->progress->doneTaskCount++;
+	}
+
+	if (placementExecution->cancelled)
+	{
+		/* the task already finished on another placement, nothing else to do */
+		placementExecution->cancelled = false;
+		placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+		execution->cancelledPlacementExecutionCount--;
+		return;
+	}
+
 	if (placementExecution->executionState == PLACEMENT_EXECUTION_FAILED)
 	{
 		/*
@@ -3698,9 +6456,28 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	if (succeeded)
 	{
 		placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+
+		if (!INSTR_TIME_IS_ZERO(placementExecution->startTime))
+		{
+			instr_time taskTime;
+
+			INSTR_TIME_SET_CURRENT(taskTime);
+			INSTR_TIME_SUBTRACT(taskTime, placementExecution->startTime);
+
+			if (execution->recordTaskTimes)
+			{
+				workerPool->finishedTaskCount++;
+				workerPool->finishedTaskTime += INSTR_TIME_GET_MILLISEC(taskTime);
+			}
+
+			RecordNodeTaskExecution(workerPool->nodeStats,
+									INSTR_TIME_GET_MILLISEC(taskTime), true);
+		}
 	}
 	else
 	{
+		RecordNodeTaskExecution(workerPool->nodeStats, 0.0, false);
+
 		if (ShouldMarkPlacementsInvalidOnFailure(execution))
 		{
 			ShardPlacement *shardPlacement = placementExecution->shardPlacement;
@@ -3727,6 +6504,12 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		}
 
 		placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+
+		if (shardCommandExecution->resultPlacementExecution == placementExecution)
+		{
+			/* same as without hedging, the next placement returns all rows */
+			shardCommandExecution->resultPlacementExecution = NULL;
+		}
 	}
 
 	if (executionState != TASK_EXECUTION_NOT_FINISHED)
@@ -3747,6 +6530,13 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	if (newExecutionState == TASK_EXECUTION_FINISHED)
 	{
 		execution->unfinishedTaskCount--;
+
+		if (shardCommandExecution->hedged)
+		{
+			/* the other placements lost the race */
+			CancelHedgedPlacementExecutions(placementExecution);
+		}
+
 		return;
 	}
 	else if (newExecutionState == TASK_EXECUTION_FAILED)
@@ -3762,6 +6552,12 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	}
 	else if (!failedPlacementExecutionIsOnPendingQueue)
 	{
+		if (!succeeded)
+		{
+			/* the task is retried on another placement */
+			RecordNodeTaskRetry(workerPool->nodeStats);
+		}
+
 		ScheduleNextPlacementExecution(placementExecution, succeeded);
 	}
 }
@@ -3780,6 +6576,26 @@ ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution, bool
 		placementExecution->shardCommandExecution;
 	PlacementExecutionOrder executionOrder = shardCommandExecution->executionOrder;
 
+	if (executionOrder == EXECUTION_ORDER_ANY && shardCommandExecution->hedged)
+	{
+		for (int placementExecutionIndex = 0;
+			 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+			 placementExecutionIndex++)
+		{
+			TaskPlacementExecution *otherPlacementExecution =
+				shardCommandExecution->placementExecutions[placementExecutionIndex];
+			TaskPlacementExecutionState otherState =
+				otherPlacementExecution->executionState;
+
+			if (otherState == PLACEMENT_EXECUTION_READY ||
+				otherState == PLACEMENT_EXECUTION_RUNNING)
+			{
+				/* the hedged placement execution may still succeed */
+				return;
+			}
+		}
+	}
+
 	if ((executionOrder == EXECUTION_ORDER_ANY && !succeeded) ||
 		executionOrder == EXECUTION_ORDER_SEQUENTIAL)
 	{
@@ -3809,6 +6625,294 @@ ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution, bool
 }
 
 
+/*
+ * StartHedgedPlacementExecutions starts the running read-only tasks that did
+ * not return any rows for citus.hedged_read_delay on their next placement as
+ * well. It returns the number of milliseconds until the next running task
+ * becomes due, or -1 if there is none.
+ */
+static long
+StartHedgedPlacementExecutions(DistributedExecution *execution)
+{
+	long nextHedgeTimeout = -1;
+	instr_time now;
+
+	INSTR_TIME_SET_CURRENT(now);
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		TaskPlacementExecution *placementExecution = session->currentTask;
+
+		if (placementExecution == NULL || !CanHedgePlacementExecution(placementExecution))
+		{
+			continue;
+		}
+
+		long runningTime = MillisecondsBetweenTimestamps(placementExecution->startTime,
+														 now);
+		if (runningTime < HedgedReadDelay)
+		{
+			long hedgeTimeout = HedgedReadDelay - runningTime;
+
+			if (nextHedgeTimeout < 0 || hedgeTimeout < nextHedgeTimeout)
+			{
+				nextHedgeTimeout = hedgeTimeout;
+			}
+
+			continue;
+		}
+
+		ShardCommandExecution *shardCommandExecution =
+			placementExecution->shardCommandExecution;
+
+		for (int placementExecutionIndex = 0;
+			 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+			 placementExecutionIndex++)
+		{
+			TaskPlacementExecution *otherPlacementExecution =
+				shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+			if (otherPlacementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY)
+			{
+				ereport(DEBUG4, (errmsg("starting task %u on another placement "
+										"after %ld ms",
+										shardCommandExecution->task->taskId,
+										runningTime)));
+
+				PlacementExecutionReady(otherPlacementExecution);
+				break;
+			}
+		}
+
+		/* only try once per task, even if there was no placement left */
+		shardCommandExecution->hedged = true;
+	}
+
+	return nextHedgeTimeout;
+}
+
+
+/*
+ * CanHedgePlacementExecution returns whether the task of the given running
+ * placement execution could be started on another placement. That requires
+ * the task to run on any of its placements, and no rows to have been received
+ * yet, since we cannot take them back.
+ */
+static bool
+CanHedgePlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	if (placementExecution->executionState != PLACEMENT_EXECUTION_RUNNING ||
+		placementExecution->cancelled)
+	{
+		return false;
+	}
+
+	if (shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		shardCommandExecution->placementExecutionCount < 2 ||
+		shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED)
+	{
+		return false;
+	}
+
+	return !shardCommandExecution->hedged &&
+		   shardCommandExecution->resultPlacementExecution == NULL;
+}
+
+
+/*
+ * CancelHedgedPlacementExecutions is called when the given placement execution
+ * finished a hedged task. Placement executions of the task that did not start
+ * yet are taken off the ready queues, and queries that are still running on
+ * other placements are cancelled. We keep reading from the connections of the
+ * latter until the queries ended, such that the connections can be reused.
+ */
+static void
+CancelHedgedPlacementExecutions(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	DistributedExecution *execution = placementExecution->workerPool->distributedExecution;
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *otherPlacementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (otherPlacementExecution == placementExecution)
+		{
+			continue;
+		}
+
+		if (otherPlacementExecution->executionState == PLACEMENT_EXECUTION_READY)
+		{
+			RemoveReadyPlacementExecution(otherPlacementExecution);
+			otherPlacementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+		}
+		else if (otherPlacementExecution->executionState ==
+				 PLACEMENT_EXECUTION_RUNNING)
+		{
+			WorkerSession *session =
+				RunningPlacementExecutionSession(otherPlacementExecution);
+
+			if (session != NULL)
+			{
+				SendCancelationRequest(session->connection);
+			}
+
+			otherPlacementExecution->cancelled = true;
+			execution->cancelledPlacementExecutionCount++;
+		}
+	}
+}
+
+
+/*
+ * CanCancelReadPlacementExecutions returns whether queries of the read-only
+ * execution that are no longer needed may be cancelled. That is not the case
+ * when they run in remote transaction blocks, since cancelling a query aborts
+ * the transaction block it runs in.
+ */
+static bool
+CanCancelReadPlacementExecutions(DistributedExecution *execution)
+{
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED)
+	{
+		return false;
+	}
+
+	return !InCoordinatedTransaction();
+}
+
+
+/*
+ * SkipRemainingTasks is called when a read-only execution received all rows
+ * it needs while executing the given task. The other unfinished tasks are
+ * marked as finished. Their placement executions that were not sent yet are
+ * taken off the queues, and running queries are cancelled if possible. Either
+ * way we keep reading from the connections of running queries until they
+ * ended, but no longer store their rows.
+ */
+static void
+SkipRemainingTasks(DistributedExecution *execution,
+				   ShardCommandExecution *currentShardCommandExecution)
+{
+	bool cancelRunningQueries = CanCancelReadPlacementExecutions(execution);
+	int skippedTaskCount = 0;
+
+	ShardCommandExecution *shardCommandExecution = NULL;
+	foreach_ptr(shardCommandExecution, execution->shardCommandExecutionList)
+	{
+		if (shardCommandExecution == currentShardCommandExecution ||
+			shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED)
+		{
+			continue;
+		}
+
+		for (int placementExecutionIndex = 0;
+			 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+			 placementExecutionIndex++)
+		{
+			TaskPlacementExecution *placementExecution =
+				shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+			if (placementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY)
+			{
+				if (placementExecution->assignedSession != NULL)
+				{
+					dlist_delete(&placementExecution->sessionPendingQueueNode);
+				}
+				else
+				{
+					dlist_delete(&placementExecution->workerPendingQueueNode);
+				}
+
+				placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+			}
+			else if (placementExecution->executionState == PLACEMENT_EXECUTION_READY)
+			{
+				RemoveReadyPlacementExecution(placementExecution);
+				placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+			}
+			else if (placementExecution->executionState ==
+					 PLACEMENT_EXECUTION_RUNNING && cancelRunningQueries &&
+					 !placementExecution->cancelled)
+			{
+				WorkerSession *session =
+					RunningPlacementExecutionSession(placementExecution);
+
+				if (session != NULL)
+				{
+					SendCancelationRequest(session->connection);
+				}
+
+				placementExecution->cancelled = true;
+				execution->cancelledPlacementExecutionCount++;
+			}
+		}
+
+		/* rows that still arrive for the task are not stored */
+		shardCommandExecution->gotResults = true;
+		shardCommandExecution->executionState = TASK_EXECUTION_FINISHED;
+		execution->unfinishedTaskCount--;
+		skippedTaskCount++;
+	}
+
+	if (skippedTaskCount > 0)
+	{
+		ereport(DEBUG4, (errmsg("skipping %d tasks after receiving " UINT64_FORMAT
+								" rows", skippedTaskCount, execution->rowsProcessed)));
+	}
+}
+
+
+/*
+ * RemoveReadyPlacementExecution takes a placement execution that is ready to
+ * start off the ready queue of its session or worker pool.
+ */
+static void
+RemoveReadyPlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	if (placementExecution->assignedSession != NULL)
+	{
+		dlist_delete(&placementExecution->sessionReadyQueueNode);
+	}
+	else
+	{
+		dlist_delete(&placementExecution->workerReadyQueueNode);
+		placementExecution->workerPool->readyTaskCount--;
+	}
+}
+
+
+/*
+ * RunningPlacementExecutionSession returns the session of the worker pool of
+ * the given placement execution on which it currently runs, or NULL if there
+ * is none.
+ */
+static WorkerSession *
+RunningPlacementExecutionSession(TaskPlacementExecution *placementExecution)
+{
+	WorkerSession *session = NULL;
+	foreach_ptr(session, placementExecution->workerPool->sessionList)
+	{
+		if (session->currentTask == placementExecution)
+		{
+			return session;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * ShouldMarkPlacementsInvalidOnFailure returns true if the failure
  * should trigger marking placements invalid.
@@ -3842,6 +6946,11 @@ PlacementExecutionReady(TaskPlacementExecution *placementExecution)
 {
 	WorkerPool *workerPool = placementExecution->workerPool;
 
+	if (workerPool->progress != NULL)
+	{
+		workerPool->progress->taskCount++;
+	}
+
 	if (placementExecution->assignedSession != NULL)
 	{
 		WorkerSession *session = placementExecution->assignedSession;
@@ -3904,6 +7013,11 @@ PlacementExecutionReady(TaskPlacementExecution *placementExecution)
 
 	/* update the state to ready for further processing */
 	placementExecution->executionState = PLACEMENT_EXECUTION_READY;
+
+	if (placementExecution->spanId != 0)
+	{
+		placementExecution->readyTime = GetCurrentTimestamp();
+	}
 }
 
 
@@ -3974,7 +7088,8 @@ TaskExecutionStateMachine(ShardCommandExecution *shardCommandExecution)
 /*
  * BuildWaitEventSet creates a WaitEventSet for the given array of connections
  * which can be used to wait for any of the sockets to become read-ready or
- * write-ready.
+ * write-ready. The set has room for sessions that are added later on, see
+ * GetEventSetSize().
  */
 static WaitEventSet *
 BuildWaitEventSet(List *sessionList)
@@ -3990,6 +7105,8 @@ BuildWaitEventSet(List *sessionList)
 	{
 		MultiConnection *connection = session->connection;
 
+		session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
+
 		if (connection->pgConn == NULL)
 		{
 			/* connection died earlier in the transaction */
@@ -4023,49 +7140,18 @@ BuildWaitEventSet(List *sessionList)
 
 /*
  * GetEventSetSize returns the event set size for a list of sessions.
+ *
+ * We leave room for as many new sessions as there are sessions already, such
+ * that the wait event set only needs to be rebuilt a logarithmic number of
+ * times while the worker pools are slowly opening connections.
  */
 static int
 GetEventSetSize(List *sessionList)
 {
-	/* additional 2 is for postmaster and latch */
-	return list_length(sessionList) + 2;
-}
-
-
-/*
- * RebuildWaitEventSetFlags modifies the given waitEventSet with the wait flags
- * for connections in the sessionList.
- */
-static void
-RebuildWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList)
-{
-	WorkerSession *session = NULL;
-	foreach_ptr(session, sessionList)
-	{
-		MultiConnection *connection = session->connection;
-		int waitEventSetIndex = session->waitEventSetIndex;
-
-		if (connection->pgConn == NULL)
-		{
-			/* connection died earlier in the transaction */
-			continue;
-		}
-
-		if (connection->waitFlags == 0)
-		{
-			/* not currently waiting for this connection */
-			continue;
-		}
+	int sessionCapacity = Max(2 * list_length(sessionList), MIN_WAIT_EVENT_SET_SESSIONS);
 
-		int sock = PQsocket(connection->pgConn);
-		if (sock == -1)
-		{
-			/* connection was closed */
-			continue;
-		}
-
-		ModifyWaitEvent(waitEventSet, waitEventSetIndex, connection->waitFlags, NULL);
-	}
+	/* additional 2 is for postmaster and latch */
+	return sessionCapacity + 2;
 }
 
 
@@ -4085,22 +7171,26 @@ SetLocalForceMaxQueryParallelization(void)
 
 /*
  * ExtractParametersForRemoteExecution extracts parameter types and values from
- * the given ParamListInfo structure, and fills parameter type and value arrays.
- * It changes oid of custom types to InvalidOid so that they are the same in workers
- * and coordinators.
+ * the given ParamListInfo structure, and fills parameter type, value, length and
+ * format arrays. It changes oid of custom types to InvalidOid so that they are
+ * the same in workers and coordinators. Parameters of types that have the same
+ * oid on all nodes are sent in binary format, to avoid converting them to text
+ * on the coordinator and parsing them again on the worker.
  */
 static void
 ExtractParametersForRemoteExecution(ParamListInfo paramListInfo, Oid **parameterTypes,
-									const char ***parameterValues)
+									const char ***parameterValues,
+									int **parameterLengths, int **parameterFormats)
 {
-	ExtractParametersFromParamList(paramListInfo, parameterTypes,
-								   parameterValues, false);
+	ExtractParameters(paramListInfo, parameterTypes, parameterValues,
+					  parameterLengths, parameterFormats, false);
 }
 
 
 /*
  * ExtractParametersFromParamList extracts parameter types and values from
  * the given ParamListInfo structure, and fills parameter type and value arrays.
+ * The values are always in text format.
  * If useOriginalCustomTypeOids is true, it uses the original oids for custom types.
  */
 void
@@ -4108,12 +7198,38 @@ ExtractParametersFromParamList(ParamListInfo paramListInfo,
 							   Oid **parameterTypes,
 							   const char ***parameterValues, bool
 							   useOriginalCustomTypeOids)
+{
+	ExtractParameters(paramListInfo, parameterTypes, parameterValues, NULL, NULL,
+					  useOriginalCustomTypeOids);
+}
+
+
+/*
+ * ExtractParameters extracts parameter types and values from the given
+ * ParamListInfo structure, and fills parameter type and value arrays. If
+ * parameterLengths and parameterFormats are given, the values of parameters
+ * that can be sent in binary format are the output of the send function of
+ * their type, and the length and format arrays are filled accordingly.
+ * Otherwise, all values are in text format.
+ */
+static void
+ExtractParameters(ParamListInfo paramListInfo, Oid **parameterTypes,
+				  const char ***parameterValues, int **parameterLengths,
+				  int **parameterFormats, bool useOriginalCustomTypeOids)
 {
 	int parameterCount = paramListInfo->numParams;
+	bool allowBinaryFormat = parameterLengths != NULL && parameterFormats != NULL;
 
 	*parameterTypes = (Oid *) palloc0(parameterCount * sizeof(Oid));
 	*parameterValues = (const char **) palloc0(parameterCount * sizeof(char *));
 
+	if (allowBinaryFormat)
+	{
+		/* all zeroes means text format, for which the lengths are ignored */
+		*parameterLengths = (int *) palloc0(parameterCount * sizeof(int));
+		*parameterFormats = (int *) palloc0(parameterCount * sizeof(int));
+	}
+
 	/* get parameter types and values */
 	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
 	{
@@ -4160,6 +7276,23 @@ ExtractParametersFromParamList(ParamListInfo paramListInfo,
 			continue;
 		}
 
+		if (allowBinaryFormat && CanSendParameterInBinaryFormat(parameterData->ptype))
+		{
+			Oid typeSendFunctionId = InvalidOid;
+
+			getTypeBinaryOutputInfo(parameterData->ptype, &typeSendFunctionId,
+									&variableLengthType);
+
+			bytea *parameterBytes = OidSendFunctionCall(typeSendFunctionId,
+														parameterData->value);
+
+			(*parameterValues)[parameterIndex] = VARDATA(parameterBytes);
+			(*parameterLengths)[parameterIndex] = VARSIZE(parameterBytes) - VARHDRSZ;
+			(*parameterFormats)[parameterIndex] = 1;
+
+			continue;
+		}
+
 		getTypeOutputInfo(parameterData->ptype, &typeOutputFunctionId,
 						  &variableLengthType);
 
@@ -4167,3 +7300,45 @@ ExtractParametersFromParamList(ParamListInfo paramListInfo,
 																   parameterData->value);
 	}
 }
+
+
+/*
+ * CanSendParameterInBinaryFormat returns whether a parameter of the given type
+ * can be sent to the workers in binary format. The type needs to have the same
+ * oid on all nodes, since the worker decodes the value with the receive function
+ * of the type that the coordinator sends along, and the binary format of arrays
+ * and composites embeds the oids of their element types. Custom types are
+ * therefore always sent in text format.
+ */
+static bool
+CanSendParameterInBinaryFormat(Oid typeId)
+{
+	if (typeId >= FirstNormalObjectId)
+	{
+		return false;
+	}
+
+	/* anonymous records cannot be received, and rows may contain custom types */
+	Oid elementTypeId = get_element_type(typeId);
+	if (type_is_rowtype(typeId) ||
+		(OidIsValid(elementTypeId) && type_is_rowtype(elementTypeId)))
+	{
+		return false;
+	}
+
+	Oid receiveFunctionId = InvalidOid;
+	Oid typeIOParam = InvalidOid;
+	int16 typeLength = 0;
+	bool typeByVal = false;
+	char typeAlign = 0;
+	char typeDelim = 0;
+
+	get_type_io_data(typeId, IOFunc_receive, &typeLength, &typeByVal,
+					 &typeAlign, &typeDelim, &typeIOParam, &receiveFunctionId);
+	if (!OidIsValid(receiveFunctionId))
+	{
+		return false;
+	}
+
+	return CanUseBinaryCopyFormatForType(typeId);
+}
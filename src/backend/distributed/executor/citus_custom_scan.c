@@ -19,18 +19,24 @@
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/columnar.h"
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/fast_path_plan_cache.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/local_plan_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/multi_row_insert_copy.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/query_stats.h"
+#include "distributed/shard_load_stats.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/worker_log_messages.h"
 #include "distributed/worker_protocol.h"
@@ -57,15 +63,34 @@ static void CitusBeginScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusBeginSelectScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusPreExecScan(CitusScanState *scanState);
+static void BindDistributionKeyValue(CustomScanState *node, EState *estate,
+									 Const *distributionKeyValue);
 static bool ModifyJobNeedsEvaluation(Job *workerJob);
+static bool CanUseParameterizedShardQuery(Job *workerJob, EState *estate, int eflags);
 static void RegenerateTaskForFasthPathQuery(Job *workerJob);
+static void RegenerateParameterizedTaskForFastPathQuery(Job *workerJob,
+														DistributedPlan *
+														originalDistributedPlan,
+														PlanState *planState);
+static List * FastPathQueryShardIntervalList(Query *query,
+											 Const **partitionKeyValue);
+static char * GetCachedShardQueryString(DistributedPlan *originalDistributedPlan,
+										uint64 shardId);
+static void CacheShardQueryString(DistributedPlan *originalDistributedPlan,
+								  uint64 shardId, char *queryString);
 static void RegenerateTaskListForInsert(Job *workerJob);
-static DistributedPlan * CopyDistributedPlanWithoutCache(
-	DistributedPlan *originalDistributedPlan);
+static DistributedPlan * CopyDistributedPlanForExecution(
+	DistributedPlan *originalDistributedPlan, bool evaluateJobQuery,
+	bool changeJobQuery);
+static bool CanEvaluateFlatQueryCopy(Query *query);
 static void CitusEndScan(CustomScanState *node);
 static void CitusReScan(CustomScanState *node);
 
 
+/* GUC, whether fast path queries keep their parameters in the shard query */
+bool EnableParameterizedShardQueries = false;
+
+
 /* create custom scan methods for all executors */
 CustomScanMethods AdaptiveExecutorCustomScanMethods = {
 	"Citus Adaptive",
@@ -152,6 +177,11 @@ RegisterCitusCustomScanMethods(void)
 	RegisterCustomScanMethods(&TaskTrackerCustomScanMethods);
 	RegisterCustomScanMethods(&CoordinatorInsertSelectCustomScanMethods);
 	RegisterCustomScanMethods(&DelayedErrorCustomScanMethods);
+	RegisterCustomScanMethods(&IntermediateResultScanMethods);
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	RegisterColumnarScanMethods();
+#endif
 }
 
 
@@ -168,6 +198,16 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	/* remember whether the scan may go backward or rewind */
+	scanState->eflags = eflags;
+
+	if ((CitusQueryStatsEnabled() || ShardLoadStatsEnabled()) &&
+		(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0)
+	{
+		/* the execution time is recorded in CitusEndScan */
+		INSTR_TIME_SET_CURRENT(scanState->executionStartTime);
+	}
+
 	/*
 	 * Make sure we can see notices during regular queries, which would typically
 	 * be the result of a function that raises a notices being called.
@@ -196,6 +236,12 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 #endif
 
 	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	if (distributedPlan->boundDistributionKeyValue != NULL)
+	{
+		BindDistributionKeyValue(node, estate,
+								 distributedPlan->boundDistributionKeyValue);
+	}
+
 	if (distributedPlan->insertSelectQuery != NULL)
 	{
 		/*
@@ -215,6 +261,38 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 }
 
 
+/*
+ * BindDistributionKeyValue binds the distribution key value of a plan that
+ * was taken from the fast-path plan cache to the parameter in its job query.
+ * The parameter is then evaluated or sent to the workers like the parameters
+ * of a prepared statement.
+ */
+static void
+BindDistributionKeyValue(CustomScanState *node, EState *estate,
+						 Const *distributionKeyValue)
+{
+	/* cached plans are only used for queries without parameters */
+	Assert(estate->es_param_list_info == NULL);
+
+	ParamListInfo paramListInfo = makeParamList(1);
+	ParamExternData *parameter = &paramListInfo->params[0];
+
+	parameter->value = distributionKeyValue->constvalue;
+	parameter->isnull = distributionKeyValue->constisnull;
+	parameter->pflags = PARAM_FLAG_CONST;
+	parameter->ptype = distributionKeyValue->consttype;
+
+	estate->es_param_list_info = paramListInfo;
+
+	/* the expression context was created before we got here */
+	ExprContext *expressionContext = node->ss.ps.ps_ExprContext;
+	if (expressionContext != NULL)
+	{
+		expressionContext->ecxt_param_list_info = paramListInfo;
+	}
+}
+
+
 /*
  * CitusPreExecScan is called right before postgres' executor starts pulling tuples.
  */
@@ -229,7 +307,8 @@ CitusPreExecScan(CitusScanState *scanState)
  * CitusExecScan is called when a tuple is pulled from a custom scan.
  * On the first call, it executes the distributed query and writes the
  * results to a tuple store. The postgres executor calls this function
- * repeatedly to read tuples from the tuple store.
+ * repeatedly to read tuples from the tuple store. For streaming executions,
+ * the tasks are still running while the first tuples are read.
  */
 TupleTableSlot *
 CitusExecScan(CustomScanState *node)
@@ -238,7 +317,19 @@ CitusExecScan(CustomScanState *node)
 
 	if (!scanState->finishedRemoteScan)
 	{
-		AdaptiveExecutor(scanState);
+		if (scanState->executeInsertAsCopy)
+		{
+			Job *workerJob = scanState->distributedPlan->workerJob;
+			EState *executorState = ScanStateGetExecutorState(scanState);
+
+			ExecuteMultiRowInsertAsCopy(workerJob->jobQuery, executorState);
+		}
+		else if (!ReadCachedQueryResult(scanState))
+		{
+			AdaptiveExecutor(scanState);
+
+			CacheQueryResult(scanState);
+		}
 
 		scanState->finishedRemoteScan = true;
 	}
@@ -265,14 +356,24 @@ CitusBeginSelectScan(CustomScanState *node, EState *estate, int eflags)
 		return;
 	}
 
+	bool useParameterizedShardQuery =
+		CanUseParameterizedShardQuery(originalDistributedPlan->workerJob, estate,
+									  eflags);
+
 	/*
-	 * Create a copy of the generic plan for the current execution, but make a shallow
-	 * copy of the plan cache. That means we'll be able to access the plan cache via
-	 * currentPlan->workerJob->localPlannedStatements, but it will be preserved across
-	 * executions by the prepared statement logic.
+	 * Create a copy of the generic plan for the current execution, which shares
+	 * the parts that we do not change with the original plan. That means we'll be
+	 * able to access the plan cache via currentPlan->workerJob->localPlannedStatements,
+	 * but it will be preserved across executions by the prepared statement logic.
+	 *
+	 * The parameterized shard query path leaves the job query unchanged unless
+	 * the shard query string is not yet cached, in which case it makes its own
+	 * copy.
 	 */
+	bool evaluateJobQuery = !useParameterizedShardQuery;
 	DistributedPlan *currentPlan =
-		CopyDistributedPlanWithoutCache(originalDistributedPlan);
+		CopyDistributedPlanForExecution(originalDistributedPlan, evaluateJobQuery,
+										evaluateJobQuery);
 	scanState->distributedPlan = currentPlan;
 
 	Job *workerJob = currentPlan->workerJob;
@@ -285,23 +386,35 @@ CitusBeginSelectScan(CustomScanState *node, EState *estate, int eflags)
 	 */
 	Assert(currentPlan->fastPathRouterPlan || !EnableFastPathRouterPlanner);
 
-	/*
-	 * Evaluate parameters, because the parameters are only available on the
-	 * coordinator and are required for pruning.
-	 *
-	 * We don't evaluate functions for read-only queries on the coordinator
-	 * at the moment. Most function calls would be in a context where they
-	 * should be re-evaluated for every row in case of volatile functions.
-	 *
-	 * TODO: evaluate stable functions
-	 */
-	ExecuteMasterEvaluableParameters(jobQuery, planState);
+	if (useParameterizedShardQuery)
+	{
+		/*
+		 * Only evaluate the parameters that are needed for pruning, and send the
+		 * rest of them along with the (cached) shard query string.
+		 */
+		RegenerateParameterizedTaskForFastPathQuery(workerJob, originalDistributedPlan,
+													planState);
+	}
+	else
+	{
+		/*
+		 * Evaluate parameters, because the parameters are only available on the
+		 * coordinator and are required for pruning.
+		 *
+		 * We don't evaluate functions for read-only queries on the coordinator
+		 * at the moment. Most function calls would be in a context where they
+		 * should be re-evaluated for every row in case of volatile functions.
+		 *
+		 * TODO: evaluate stable functions
+		 */
+		ExecuteMasterEvaluableParameters(jobQuery, planState);
 
-	/* job query no longer has parameters, so we should not send any */
-	workerJob->parametersInJobQueryResolved = true;
+		/* job query no longer has parameters, so we should not send any */
+		workerJob->parametersInJobQueryResolved = true;
 
-	/* parameters are filled in, so we can generate a task for this execution */
-	RegenerateTaskForFasthPathQuery(workerJob);
+		/* parameters are filled in, so we can generate a task for this execution */
+		RegenerateTaskForFasthPathQuery(workerJob);
+	}
 
 	if (IsLocalPlanCachingSupported(workerJob, originalDistributedPlan))
 	{
@@ -336,17 +449,43 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 	PlanState *planState = &(scanState->customScanState.ss.ps);
 	DistributedPlan *originalDistributedPlan = scanState->distributedPlan;
 
+	Job *originalWorkerJob = originalDistributedPlan->workerJob;
+	bool useParameterizedShardQuery =
+		CanUseParameterizedShardQuery(originalWorkerJob, estate, eflags);
+	bool evaluateJobQuery =
+		!useParameterizedShardQuery && ModifyJobNeedsEvaluation(originalWorkerJob);
+
+	/*
+	 * Deferred pruning changes the job query to point to the shards, except
+	 * for the parameterized shard query path, which makes its own copy when
+	 * needed. Without deferred pruning, the job query only changes when it
+	 * is evaluated.
+	 */
+	bool changeJobQuery = evaluateJobQuery ||
+						  (originalWorkerJob->deferredPruning &&
+						   !useParameterizedShardQuery);
+
 	DistributedPlan *currentPlan =
-		CopyDistributedPlanWithoutCache(originalDistributedPlan);
+		CopyDistributedPlanForExecution(originalDistributedPlan, evaluateJobQuery,
+										changeJobQuery);
 	scanState->distributedPlan = currentPlan;
 
 	Job *workerJob = currentPlan->workerJob;
 	Query *jobQuery = workerJob->jobQuery;
 
-	if (ModifyJobNeedsEvaluation(workerJob))
+	if (evaluateJobQuery)
 	{
-		/* evaluate both functions and parameters */
-		ExecuteMasterEvaluableFunctionsAndParameters(jobQuery, planState);
+		if (workerJob->evaluateSequencesOnWorkers)
+		{
+			/* evaluate both functions and parameters, except for nextval calls */
+			ExecuteMasterEvaluableFunctionsAndParametersExceptSequences(jobQuery,
+																		planState);
+		}
+		else
+		{
+			/* evaluate both functions and parameters */
+			ExecuteMasterEvaluableFunctionsAndParameters(jobQuery, planState);
+		}
 
 		/* job query no longer has parameters, so we should not send any */
 		workerJob->parametersInJobQueryResolved = true;
@@ -365,10 +504,29 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 		 * We can only now decide which shard to use, so we need to build a new task
 		 * list.
 		 */
-		if (jobQuery->commandType == CMD_INSERT)
+		if (jobQuery->commandType == CMD_INSERT &&
+			(eflags & EXEC_FLAG_EXPLAIN_ONLY) == 0 && estate->es_instrument == 0 &&
+			CanExecuteMultiRowInsertAsCopy(jobQuery))
+		{
+			/*
+			 * The rows are routed to the shards by the COPY, which also takes
+			 * the metadata locks, so we do not need a task list.
+			 */
+			scanState->executeInsertAsCopy = true;
+			workerJob->taskList = NIL;
+
+			return;
+		}
+		else if (jobQuery->commandType == CMD_INSERT)
 		{
 			RegenerateTaskListForInsert(workerJob);
 		}
+		else if (useParameterizedShardQuery)
+		{
+			RegenerateParameterizedTaskForFastPathQuery(workerJob,
+														originalDistributedPlan,
+														planState);
+		}
 		else
 		{
 			RegenerateTaskForFasthPathQuery(workerJob);
@@ -445,33 +603,143 @@ ModifyJobNeedsEvaluation(Job *workerJob)
 
 
 /*
- * CopyDistributedPlanWithoutCache is a helper function which copies the
+ * CanUseParameterizedShardQuery returns whether the shard for a fast path
+ * UPDATE/DELETE/SELECT with deferred pruning can be found by only evaluating
+ * the parameters in the WHERE clause, such that the shard query string keeps
+ * its parameters and can be cached across executions of a prepared statement.
+ */
+static bool
+CanUseParameterizedShardQuery(Job *workerJob, EState *estate, int eflags)
+{
+	if (!EnableParameterizedShardQueries)
+	{
+		return false;
+	}
+
+	if (!workerJob->deferredPruning || workerJob->requiresMasterEvaluation)
+	{
+		/* functions in the query are evaluated, so it differs across executions */
+		return false;
+	}
+
+	if (workerJob->jobQuery->commandType == CMD_INSERT)
+	{
+		/* INSERTs use their own task generation logic */
+		return false;
+	}
+
+	if (estate->es_param_list_info == NULL)
+	{
+		/* without parameters there is nothing to keep */
+		return false;
+	}
+
+	if ((eflags & (EXEC_FLAG_EXPLAIN_ONLY | EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD)) ||
+		estate->es_instrument != 0)
+	{
+		/*
+		 * EXPLAIN does not send parameters to the workers and rescans do
+		 * not support parameters, so we need a query without parameters.
+		 */
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyDistributedPlanForExecution is a helper function which copies the
  * distributedPlan into the current memory context.
  *
  * We must not change the distributed plan since it may be reused across multiple
- * executions of a prepared statement. Instead we create a deep copy that we only
- * use for the current execution.
+ * executions of a prepared statement. Instead of a deep copy, we only copy the
+ * parts of the plan that the current execution changes: the plan and worker job
+ * structs, the tasks in the task list, and the job query when the caller says
+ * it is going to be changed. The remaining fields, such as the subplans,
+ * localPlannedStatements and shardQueryStrings, are shared with the original
+ * plan.
  *
- * We also exclude localPlannedStatements from the copyObject call for performance
- * reasons, as they are immutable, so no need to have a deep copy.
+ * evaluateJobQuery indicates that functions or parameters in the job query are
+ * going to be evaluated, changeJobQuery that the job query is going to be
+ * changed in any way, for instance by UpdateRelationToShardNames.
  */
 static DistributedPlan *
-CopyDistributedPlanWithoutCache(DistributedPlan *originalDistributedPlan)
+CopyDistributedPlanForExecution(DistributedPlan *originalDistributedPlan,
+								bool evaluateJobQuery, bool changeJobQuery)
 {
-	List *localPlannedStatements =
-		originalDistributedPlan->workerJob->localPlannedStatements;
-	originalDistributedPlan->workerJob->localPlannedStatements = NIL;
+	Job *originalWorkerJob = originalDistributedPlan->workerJob;
 
-	DistributedPlan *distributedPlan = copyObject(originalDistributedPlan);
+	DistributedPlan *distributedPlan = palloc(sizeof(DistributedPlan));
+	*distributedPlan = *originalDistributedPlan;
 
-	/* set back the immutable field */
-	originalDistributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
-	distributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
+	Job *workerJob = palloc(sizeof(Job));
+	*workerJob = *originalWorkerJob;
+	distributedPlan->workerJob = workerJob;
+
+	/* tasks are changed in place when assigning placements and query strings */
+	List *taskList = NIL;
+	Task *originalTask = NULL;
+	foreach_ptr(originalTask, originalWorkerJob->taskList)
+	{
+		Task *task = palloc(sizeof(Task));
+		*task = *originalTask;
+
+		taskList = lappend(taskList, task);
+	}
+	workerJob->taskList = taskList;
+
+	if (!changeJobQuery)
+	{
+		/* the job query is only read, so we can share it */
+	}
+	else if (evaluateJobQuery && CanEvaluateFlatQueryCopy(originalWorkerJob->jobQuery))
+	{
+		/*
+		 * Evaluation builds new range table entries and expressions instead of
+		 * changing them in place, so we only need a copy of the Query struct.
+		 */
+		Query *jobQuery = makeNode(Query);
+		*jobQuery = *originalWorkerJob->jobQuery;
+
+		workerJob->jobQuery = jobQuery;
+	}
+	else
+	{
+		workerJob->jobQuery = copyObject(originalWorkerJob->jobQuery);
+	}
 
 	return distributedPlan;
 }
 
 
+/*
+ * CanEvaluateFlatQueryCopy returns whether evaluating the functions and
+ * parameters in a flat copy of the given query leaves the query itself
+ * unchanged. That is the case unless the query contains subqueries or CTEs,
+ * since query_tree_mutator changes the nested queries in place.
+ */
+static bool
+CanEvaluateFlatQueryCopy(Query *query)
+{
+	if (query->hasSubLinks || query->cteList != NIL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		if (rangeTableEntry->rtekind == RTE_SUBQUERY)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * RegenerateTaskListForInsert does the shard pruning for an INSERT query
  * queries and rebuilds the query strings.
@@ -513,12 +781,119 @@ RegenerateTaskListForInsert(Job *workerJob)
  */
 static void
 RegenerateTaskForFasthPathQuery(Job *workerJob)
+{
+	List *shardIntervalList =
+		FastPathQueryShardIntervalList(workerJob->jobQuery,
+									   &workerJob->partitionKeyValue);
+
+	bool shardsPresent = false;
+	List *relationShardList =
+		RelationShardListForShardIntervalList(shardIntervalList, &shardsPresent);
+
+	UpdateRelationToShardNames((Node *) workerJob->jobQuery, relationShardList);
+
+	List *placementList =
+		FindRouterWorkerList(shardIntervalList, shardsPresent, true);
+	uint64 shardId = INVALID_SHARD_ID;
+
+	if (shardsPresent)
+	{
+		shardId = GetAnchorShardId(shardIntervalList);
+	}
+
+	GenerateSingleShardRouterTaskList(workerJob,
+									  relationShardList,
+									  placementList, shardId);
+}
+
+
+/*
+ * RegenerateParameterizedTaskForFastPathQuery does the shard pruning for
+ * UPDATE/DELETE/SELECT fast path router queries, but unlike
+ * RegenerateTaskForFasthPathQuery keeps the parameters in the job query.
+ * The parameters are sent along with the query string, which therefore only
+ * depends on the shard and is deparsed only once per shard for a prepared
+ * statement.
+ */
+static void
+RegenerateParameterizedTaskForFastPathQuery(Job *workerJob,
+											DistributedPlan *originalDistributedPlan,
+											PlanState *planState)
+{
+	Query *jobQuery = workerJob->jobQuery;
+	MasterEvaluationContext masterEvaluationContext;
+
+	masterEvaluationContext.planState = planState;
+	masterEvaluationContext.evaluationMode = EVALUATE_PARAMS;
+
+	/*
+	 * Prune based on a shallow copy of the job query in which only the WHERE
+	 * clause has its parameters evaluated, the job query itself is not changed.
+	 */
+	Node *quals = copyObject(jobQuery->jointree->quals);
+	quals = PartiallyEvaluateExpression(quals, &masterEvaluationContext);
+
+	Query *pruningQuery = makeNode(Query);
+	*pruningQuery = *jobQuery;
+	pruningQuery->jointree = makeFromExpr(jobQuery->jointree->fromlist, quals);
+
+	List *shardIntervalList =
+		FastPathQueryShardIntervalList(pruningQuery, &workerJob->partitionKeyValue);
+
+	bool shardsPresent = false;
+	List *relationShardList =
+		RelationShardListForShardIntervalList(shardIntervalList, &shardsPresent);
+
+	List *placementList =
+		FindRouterWorkerList(shardIntervalList, shardsPresent, true);
+	uint64 shardId = INVALID_SHARD_ID;
+	char *queryString = NULL;
+
+	if (shardsPresent)
+	{
+		shardId = GetAnchorShardId(shardIntervalList);
+		queryString = GetCachedShardQueryString(originalDistributedPlan, shardId);
+	}
+
+	if (queryString != NULL)
+	{
+		GenerateSingleShardRouterTaskListWithQueryString(workerJob, relationShardList,
+														 placementList, shardId,
+														 queryString);
+		return;
+	}
+
+	/* the job query may be shared with the original plan, so change a copy */
+	jobQuery = copyObject(jobQuery);
+	workerJob->jobQuery = jobQuery;
+
+	UpdateRelationToShardNames((Node *) jobQuery, relationShardList);
+
+	GenerateSingleShardRouterTaskList(workerJob, relationShardList,
+									  placementList, shardId);
+
+	if (shardsPresent && list_length(workerJob->taskList) == 1)
+	{
+		Task *task = linitial(workerJob->taskList);
+
+		CacheShardQueryString(originalDistributedPlan, shardId,
+							  TaskQueryStringForAllPlacements(task));
+	}
+}
+
+
+/*
+ * FastPathQueryShardIntervalList returns the shard interval list for a fast
+ * path router query, and sets partitionKeyValue to the value of the
+ * distribution column in the query.
+ */
+static List *
+FastPathQueryShardIntervalList(Query *query, Const **partitionKeyValue)
 {
 	bool isMultiShardQuery = false;
 	List *shardIntervalList =
-		TargetShardIntervalForFastPathQuery(workerJob->jobQuery,
-											&isMultiShardQuery, NULL,
-											&workerJob->partitionKeyValue);
+		TargetShardIntervalForFastPathQuery(query, &isMultiShardQuery, NULL,
+											partitionKeyValue);
 
 	/*
 	 * A fast-path router query can only yield multiple shards when the parameter
@@ -534,24 +909,63 @@ RegenerateTaskForFasthPathQuery(Job *workerJob)
 						errhint("Consider using PL/pgSQL functions instead.")));
 	}
 
-	bool shardsPresent = false;
-	List *relationShardList =
-		RelationShardListForShardIntervalList(shardIntervalList, &shardsPresent);
+	return shardIntervalList;
+}
 
-	UpdateRelationToShardNames((Node *) workerJob->jobQuery, relationShardList);
 
-	List *placementList =
-		FindRouterWorkerList(shardIntervalList, shardsPresent, true);
-	uint64 shardId = INVALID_SHARD_ID;
+/*
+ * GetCachedShardQueryString returns the query string cached for the given
+ * shard in the distributed plan, or NULL if there is none.
+ */
+static char *
+GetCachedShardQueryString(DistributedPlan *originalDistributedPlan, uint64 shardId)
+{
+	List *shardQueryStrings = originalDistributedPlan->workerJob->shardQueryStrings;
+	ShardQueryString *shardQueryString = NULL;
 
-	if (shardsPresent)
+	foreach_ptr(shardQueryString, shardQueryStrings)
 	{
-		shardId = GetAnchorShardId(shardIntervalList);
+		if (shardQueryString->shardId == shardId)
+		{
+			return shardQueryString->queryString;
+		}
 	}
 
-	GenerateSingleShardRouterTaskList(workerJob,
-									  relationShardList,
-									  placementList, shardId);
+	return NULL;
+}
+
+
+/*
+ * CacheShardQueryString caches the query string for the given shard in the
+ * originalDistributedPlan, which may be preserved across executions.
+ */
+static void
+CacheShardQueryString(DistributedPlan *originalDistributedPlan, uint64 shardId,
+					  char *queryString)
+{
+	/*
+	 * All memory allocations should happen in the plan's context
+	 * since we'll cache the query string there.
+	 */
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetMemoryChunkContext(originalDistributedPlan));
+
+	ShardQueryString *shardQueryString = CitusMakeNode(ShardQueryString);
+	shardQueryString->shardId = shardId;
+	shardQueryString->queryString = pstrdup(queryString);
+
+	originalDistributedPlan->workerJob->shardQueryStrings =
+		lappend(originalDistributedPlan->workerJob->shardQueryStrings,
+				shardQueryString);
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (originalDistributedPlan->fastPathPlanCacheEntryId != 0)
+	{
+		/* the plan is a copy, so also keep the query string for later copies */
+		CacheFastPathShardQueryString(originalDistributedPlan->fastPathPlanCacheEntryId,
+									  shardId, queryString);
+	}
 }
 
 
@@ -643,8 +1057,10 @@ CitusEndScan(CustomScanState *node)
 	Job *workerJob = scanState->distributedPlan->workerJob;
 	uint64 queryId = scanState->distributedPlan->queryId;
 	MultiExecutorType executorType = scanState->executorType;
-	Const *partitionKeyConst = NULL;
-	char *partitionKeyString = NULL;
+
+	/* read (but do not store) any results that the scan did not need */
+	bool discardResults = true;
+	FinishStreamingExecution(scanState, discardResults);
 
 	/* stop propagating notices */
 	DisableWorkerMessagePropagation();
@@ -655,22 +1071,26 @@ CitusEndScan(CustomScanState *node)
 	 */
 	ErrorIfWorkerErrorIndicationReceived();
 
-	if (workerJob != NULL)
+	/* the start time is not set for EXPLAIN without ANALYZE */
+	if (!INSTR_TIME_IS_ZERO(scanState->executionStartTime))
 	{
-		partitionKeyConst = workerJob->partitionKeyValue;
-	}
+		EState *executorState = ScanStateGetExecutorState(scanState);
 
-	/* queryId is not set if pg_stat_statements is not installed */
-	if (queryId != 0)
-	{
-		if (partitionKeyConst != NULL && executorType == MULTI_EXECUTOR_ADAPTIVE)
+		instr_time executionTime;
+		INSTR_TIME_SET_CURRENT(executionTime);
+		INSTR_TIME_SUBTRACT(executionTime, scanState->executionStartTime);
+
+		/* queryId is not set if pg_stat_statements is not installed */
+		if (queryId != 0 && CitusQueryStatsEnabled())
 		{
-			partitionKeyString = DatumToString(partitionKeyConst->constvalue,
-											   partitionKeyConst->consttype);
+			/* queries without partition key are also recorded */
+			CitusQueryStatsExecutorsEntry(queryId, executorType, workerJob,
+										  INSTR_TIME_GET_MILLISEC(executionTime),
+										  executorState->es_processed,
+										  scanState->workerPoolStatsList);
 		}
 
-		/* queries without partition key are also recorded */
-		CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString);
+		RecordShardLoad(workerJob, INSTR_TIME_GET_MILLISEC(executionTime));
 	}
 
 	if (scanState->tuplestorestate)
@@ -699,6 +1119,10 @@ CitusReScan(CustomScanState *node)
 						errmsg("Cursors for queries on distributed tables with "
 							   "parameters are currently unsupported")));
 	}
+
+	/* rescanning reads the tuple store from the start, so we need all rows */
+	bool discardResults = false;
+	FinishStreamingExecution(scanState, discardResults);
 }
 
 
@@ -803,3 +1227,28 @@ IsCitusCustomScan(Plan *plan)
 
 	return true;
 }
+
+
+/*
+ * CitusCustomScanExecutorType returns the executor that the given Citus
+ * custom scan is going to use, or MULTI_EXECUTOR_INVALID_FIRST if the scan
+ * only raises a planning error.
+ */
+MultiExecutorType
+CitusCustomScanExecutorType(CustomScan *customScan)
+{
+	if (customScan->methods == &AdaptiveExecutorCustomScanMethods)
+	{
+		return MULTI_EXECUTOR_ADAPTIVE;
+	}
+	else if (customScan->methods == &TaskTrackerCustomScanMethods)
+	{
+		return MULTI_EXECUTOR_TASK_TRACKER;
+	}
+	else if (customScan->methods == &CoordinatorInsertSelectCustomScanMethods)
+	{
+		return MULTI_EXECUTOR_COORDINATOR_INSERT_SELECT;
+	}
+
+	return MULTI_EXECUTOR_INVALID_FIRST;
+}
@@ -0,0 +1,886 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_intermediate_results.c
+ *    Writing and reading intermediate results in a block-columnar format
+ *    with per-block min/max values.
+ *
+ * Intermediate results are normally stored as a stream of COPY rows, which
+ * means a reader has to parse every column of every row even when the query
+ * only uses a few of the columns, or only a small range of the rows. When
+ * citus.columnar_intermediate_results is enabled, results are instead
+ * stored in blocks of up to COLUMNAR_RESULT_BLOCK_ROW_COUNT rows. Within a
+ * block the binary representations of the values of each column are stored
+ * together, and the block starts with the null count and the smallest and
+ * largest value of each column. An intermediate result scan (see
+ * intermediate_result_scan.c) uses this to skip the columns that the query
+ * does not use, and to skip blocks for which the min/max values prove that
+ * none of their rows pass the quals of the scan.
+ *
+ * A columnar result file has the following layout, with all integers in
+ * network byte order:
+ *
+ *   signature   ColumnarResultSignature
+ *   uint32      column count
+ *   per column  uint32 type oid, uint32 collation oid
+ *   per block   uint32 row count
+ *               uint32 length of the column descriptors
+ *               per column: uint32 null count, uint32 length of the column
+ *               data, and the minimum and maximum value, each as an int32
+ *               length (-1 if there is none) followed by the value
+ *               per column: per row an int32 length (-1 for NULL) followed
+ *               by the value
+ *
+ * Values are stored in the binary send format of their types, so columnar
+ * results are only used if all columns can be sent in binary format.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "pgstat.h"
+
+#include "access/nbtree.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/columnar_intermediate_results.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "libpq/pqformat.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/predtest.h"
+#include "optimizer/var.h"
+#endif
+#include "storage/fd.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/typcache.h"
+
+
+/*
+ * Columnar intermediate results start with a signature that cannot occur at
+ * the start of a COPY stream or a compressed result.
+ */
+static const char ColumnarResultSignature[12] = "CITUSCOLS\n\377";
+
+/* maximum number of rows, and approximate maximum size of the values of a block */
+#define COLUMNAR_RESULT_BLOCK_ROW_COUNT 10000
+#define COLUMNAR_RESULT_BLOCK_MAX_SIZE (64 * 1024 * 1024)
+
+/* a block starts with its row count and the length of its column descriptors */
+#define COLUMNAR_RESULT_BLOCK_HEADER_SIZE (2 * sizeof(uint32))
+
+/* length that marks a NULL value or a missing minimum or maximum */
+#define COLUMNAR_RESULT_NULL_LENGTH -1
+
+
+/*
+ * ColumnarColumnBlock holds the values of a column in the block that is
+ * being written.
+ */
+typedef struct ColumnarColumnBlock
+{
+	/* values of the column, each preceded by its length */
+	StringInfo data;
+	uint32 nullCount;
+
+	/* smallest and largest non-NULL value, if the column can be ordered */
+	bool hasMinMax;
+	Datum minimum;
+	Datum maximum;
+} ColumnarColumnBlock;
+
+
+/*
+ * ColumnarResultWriter collects rows into a block of columns until the block
+ * is full.
+ */
+struct ColumnarResultWriter
+{
+	TupleDesc tupleDescriptor;
+	int columnCount;
+
+	FmgrInfo *sendFunctions;
+
+	/* btree comparison function per column, fn_oid is InvalidOid if there is none */
+	FmgrInfo *compareFunctions;
+
+	ColumnarColumnBlock *columnBlocks;
+	uint32 rowCount;
+	uint64 blockSize;
+
+	/* memory for the minimum and maximum values of the current block */
+	MemoryContext blockContext;
+};
+
+
+/*
+ * ColumnarResultReader reads rows from the blocks of a columnar result file,
+ * reading only the projected columns and skipping the blocks that do not
+ * contain rows passing the quals.
+ */
+struct ColumnarResultReader
+{
+	char *fileName;
+	FileCompat fileCompat;
+
+	TupleDesc tupleDescriptor;
+	int columnCount;
+
+	/* whether a column is read, other columns are returned as NULL */
+	bool *projectedColumns;
+
+	FmgrInfo *receiveFunctions;
+	Oid *typeIOParams;
+
+	/* quals of the query, and a column that refers to each attribute in them */
+	List *whereClauseList;
+	Var **whereColumns;
+
+	/* whether the min/max values of a column can be compared with the quals */
+	bool *useMinMax;
+	Oid *greaterEqualOperators;
+	Oid *lessEqualOperators;
+
+	/* data of the projected columns in the current block */
+	StringInfo *columnData;
+	uint32 blockRowCount;
+	uint32 blockRowIndex;
+
+	StringInfo blockDescriptors;
+	StringInfo attributeBuffer;
+
+	/* memory for the min/max values and constraints of the current block */
+	MemoryContext blockContext;
+};
+
+
+/* config variable managed via guc.c */
+bool ColumnarIntermediateResults = false;
+
+
+static void UpdateColumnMinMax(ColumnarResultWriter *writer, int columnIndex,
+							   Datum value);
+static void AppendColumnValue(ColumnarResultWriter *writer, int columnIndex,
+							  Datum value, StringInfo output);
+static bool ReadNextColumnarResultBlock(ColumnarResultReader *reader);
+static Node * ColumnBlockConstraint(ColumnarResultReader *reader, int columnIndex,
+									uint32 rowCount, uint32 nullCount,
+									StringInfo blockDescriptors);
+static Datum ReceiveColumnValue(ColumnarResultReader *reader, int columnIndex,
+								const char *valueData, int valueLength);
+static bool ReadColumnarResultData(ColumnarResultReader *reader, StringInfo buffer,
+								   int length, bool allowEnd);
+
+
+/*
+ * CanUseColumnarResultFormat returns whether rows of the given tuple
+ * descriptor can be written in the columnar format, which requires binary
+ * send and receive functions for all columns.
+ */
+bool
+CanUseColumnarResultFormat(TupleDesc tupleDescriptor)
+{
+	return CanUseBinaryCopyFormat(tupleDescriptor);
+}
+
+
+/*
+ * CreateColumnarResultWriter creates a writer for rows of the given tuple
+ * descriptor.
+ */
+ColumnarResultWriter *
+CreateColumnarResultWriter(TupleDesc tupleDescriptor)
+{
+	int columnCount = tupleDescriptor->natts;
+
+	ColumnarResultWriter *writer = palloc0(sizeof(ColumnarResultWriter));
+	writer->tupleDescriptor = tupleDescriptor;
+	writer->columnCount = columnCount;
+	writer->sendFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	writer->compareFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	writer->columnBlocks = palloc0(columnCount * sizeof(ColumnarColumnBlock));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid sendFunctionId = InvalidOid;
+		bool typeVarLength = false;
+
+		getTypeBinaryOutputInfo(attribute->atttypid, &sendFunctionId, &typeVarLength);
+		fmgr_info(sendFunctionId, &writer->sendFunctions[columnIndex]);
+
+		TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+													  TYPECACHE_CMP_PROC);
+		if (OidIsValid(typeEntry->cmp_proc))
+		{
+			fmgr_info(typeEntry->cmp_proc, &writer->compareFunctions[columnIndex]);
+		}
+
+		writer->columnBlocks[columnIndex].data = makeStringInfo();
+	}
+
+	writer->blockContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Columnar Result Block",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	return writer;
+}
+
+
+/*
+ * AppendColumnarResultHeader appends the signature and the column types of a
+ * columnar result to the given buffer. It should be sent before any block.
+ */
+void
+AppendColumnarResultHeader(ColumnarResultWriter *writer, StringInfo output)
+{
+	appendBinaryStringInfo(output, ColumnarResultSignature,
+						   sizeof(ColumnarResultSignature));
+
+	pq_sendint32(output, (uint32) writer->columnCount);
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(writer->tupleDescriptor,
+													columnIndex);
+
+		pq_sendint32(output, (uint32) attribute->atttypid);
+		pq_sendint32(output, (uint32) attribute->attcollation);
+	}
+}
+
+
+/*
+ * AppendColumnarResultRow adds a row to the current block, and returns
+ * whether the block is full and should be flushed.
+ */
+bool
+AppendColumnarResultRow(ColumnarResultWriter *writer, Datum *columnValues,
+						bool *columnNulls)
+{
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnarColumnBlock *columnBlock = &writer->columnBlocks[columnIndex];
+
+		if (columnNulls[columnIndex])
+		{
+			pq_sendint32(columnBlock->data, (uint32) COLUMNAR_RESULT_NULL_LENGTH);
+			columnBlock->nullCount++;
+			continue;
+		}
+
+		Datum value = columnValues[columnIndex];
+		bytea *outputBytes = SendFunctionCall(&writer->sendFunctions[columnIndex],
+											  value);
+		int outputLength = VARSIZE(outputBytes) - VARHDRSZ;
+
+		pq_sendint32(columnBlock->data, (uint32) outputLength);
+		pq_sendbytes(columnBlock->data, VARDATA(outputBytes), outputLength);
+
+		writer->blockSize += sizeof(uint32) + outputLength;
+
+		if (OidIsValid(writer->compareFunctions[columnIndex].fn_oid))
+		{
+			UpdateColumnMinMax(writer, columnIndex, value);
+		}
+	}
+
+	writer->rowCount++;
+
+	return writer->rowCount >= COLUMNAR_RESULT_BLOCK_ROW_COUNT ||
+		   writer->blockSize >= COLUMNAR_RESULT_BLOCK_MAX_SIZE;
+}
+
+
+/*
+ * UpdateColumnMinMax updates the minimum and maximum value of the given column
+ * in the current block with the given value.
+ */
+static void
+UpdateColumnMinMax(ColumnarResultWriter *writer, int columnIndex, Datum value)
+{
+	Form_pg_attribute attribute = TupleDescAttr(writer->tupleDescriptor, columnIndex);
+	ColumnarColumnBlock *columnBlock = &writer->columnBlocks[columnIndex];
+	FmgrInfo *compareFunction = &writer->compareFunctions[columnIndex];
+	Oid collationId = attribute->attcollation;
+	MemoryContext oldContext = NULL;
+
+	if (attribute->attlen == -1)
+	{
+		/* do not keep pointers to toasted values around */
+		value = PointerGetDatum(PG_DETOAST_DATUM(value));
+	}
+
+	if (!columnBlock->hasMinMax)
+	{
+		oldContext = MemoryContextSwitchTo(writer->blockContext);
+
+		Datum valueCopy = datumCopy(value, attribute->attbyval, attribute->attlen);
+		columnBlock->minimum = valueCopy;
+		columnBlock->maximum = valueCopy;
+		columnBlock->hasMinMax = true;
+
+		MemoryContextSwitchTo(oldContext);
+		return;
+	}
+
+	int minimumComparison = DatumGetInt32(FunctionCall2Coll(compareFunction,
+															collationId, value,
+															columnBlock->minimum));
+	int maximumComparison = DatumGetInt32(FunctionCall2Coll(compareFunction,
+															collationId, value,
+															columnBlock->maximum));
+
+	oldContext = MemoryContextSwitchTo(writer->blockContext);
+
+	if (minimumComparison < 0)
+	{
+		columnBlock->minimum = datumCopy(value, attribute->attbyval, attribute->attlen);
+	}
+	else if (maximumComparison > 0)
+	{
+		columnBlock->maximum = datumCopy(value, attribute->attbyval, attribute->attlen);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FlushColumnarResultBlock appends the current block to the given buffer, if
+ * it has any rows, and starts a new block.
+ */
+void
+FlushColumnarResultBlock(ColumnarResultWriter *writer, StringInfo output)
+{
+	StringInfoData columnDescriptors;
+
+	if (writer->rowCount == 0)
+	{
+		return;
+	}
+
+	initStringInfo(&columnDescriptors);
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnarColumnBlock *columnBlock = &writer->columnBlocks[columnIndex];
+
+		pq_sendint32(&columnDescriptors, columnBlock->nullCount);
+		pq_sendint32(&columnDescriptors, (uint32) columnBlock->data->len);
+
+		if (columnBlock->hasMinMax)
+		{
+			AppendColumnValue(writer, columnIndex, columnBlock->minimum,
+							  &columnDescriptors);
+			AppendColumnValue(writer, columnIndex, columnBlock->maximum,
+							  &columnDescriptors);
+		}
+		else
+		{
+			pq_sendint32(&columnDescriptors, (uint32) COLUMNAR_RESULT_NULL_LENGTH);
+			pq_sendint32(&columnDescriptors, (uint32) COLUMNAR_RESULT_NULL_LENGTH);
+		}
+	}
+
+	pq_sendint32(output, writer->rowCount);
+	pq_sendint32(output, (uint32) columnDescriptors.len);
+	pq_sendbytes(output, columnDescriptors.data, columnDescriptors.len);
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnarColumnBlock *columnBlock = &writer->columnBlocks[columnIndex];
+
+		pq_sendbytes(output, columnBlock->data->data, columnBlock->data->len);
+
+		resetStringInfo(columnBlock->data);
+		columnBlock->nullCount = 0;
+		columnBlock->hasMinMax = false;
+	}
+
+	pfree(columnDescriptors.data);
+
+	writer->rowCount = 0;
+	writer->blockSize = 0;
+	MemoryContextReset(writer->blockContext);
+}
+
+
+/*
+ * AppendColumnValue appends the length and binary representation of a value
+ * of the given column to the buffer.
+ */
+static void
+AppendColumnValue(ColumnarResultWriter *writer, int columnIndex, Datum value,
+				  StringInfo output)
+{
+	bytea *outputBytes = SendFunctionCall(&writer->sendFunctions[columnIndex], value);
+	int outputLength = VARSIZE(outputBytes) - VARHDRSZ;
+
+	pq_sendint32(output, (uint32) outputLength);
+	pq_sendbytes(output, VARDATA(outputBytes), outputLength);
+
+	pfree(outputBytes);
+}
+
+
+/*
+ * OpenColumnarResultReader opens the given result file for reading rows of
+ * the given tuple descriptor. Only the columns whose attribute numbers are in
+ * projectedColumns are read, the others are returned as NULL. Blocks whose
+ * min/max values prove that none of their rows pass the given quals are
+ * skipped. It returns NULL if the file is not a columnar result.
+ */
+ColumnarResultReader *
+OpenColumnarResultReader(char *fileName, TupleDesc tupleDescriptor,
+						 Bitmapset *projectedColumns, List *whereClauseList)
+{
+	const int fileFlags = (O_RDONLY | PG_BINARY);
+	const int fileMode = 0;
+	char signature[sizeof(ColumnarResultSignature)];
+	int columnCount = tupleDescriptor->natts;
+
+	File fileDesc = FileOpenForTransmit(fileName, fileFlags, fileMode);
+	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+	int bytesRead = FileReadCompat(&fileCompat, signature, sizeof(signature),
+								   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ);
+	if (bytesRead != sizeof(signature) ||
+		memcmp(signature, ColumnarResultSignature, sizeof(signature)) != 0)
+	{
+		FileClose(fileDesc);
+		return NULL;
+	}
+
+	ColumnarResultReader *reader = palloc0(sizeof(ColumnarResultReader));
+	reader->fileName = fileName;
+	reader->fileCompat = fileCompat;
+	reader->tupleDescriptor = tupleDescriptor;
+	reader->columnCount = columnCount;
+	reader->projectedColumns = palloc0(columnCount * sizeof(bool));
+	reader->receiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	reader->typeIOParams = palloc0(columnCount * sizeof(Oid));
+	reader->whereClauseList = whereClauseList;
+	reader->whereColumns = palloc0(columnCount * sizeof(Var *));
+	reader->useMinMax = palloc0(columnCount * sizeof(bool));
+	reader->greaterEqualOperators = palloc0(columnCount * sizeof(Oid));
+	reader->lessEqualOperators = palloc0(columnCount * sizeof(Oid));
+	reader->columnData = palloc0(columnCount * sizeof(StringInfo));
+	reader->blockDescriptors = makeStringInfo();
+	reader->attributeBuffer = makeStringInfo();
+	reader->blockContext = AllocSetContextCreate(CurrentMemoryContext,
+												 "Columnar Result Reader Block",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	StringInfo fileHeader = makeStringInfo();
+	ReadColumnarResultData(reader, fileHeader, sizeof(uint32), false);
+
+	int writerColumnCount = (int) pq_getmsgint(fileHeader, 4);
+	if (writerColumnCount != columnCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("intermediate result has %d columns, expected %d",
+							   writerColumnCount, columnCount)));
+	}
+
+	ReadColumnarResultData(reader, fileHeader, 2 * sizeof(uint32) * columnCount, false);
+
+	List *whereColumnList = pull_var_clause((Node *) whereClauseList,
+											PVC_RECURSE_PLACEHOLDERS);
+	Var *column = NULL;
+	foreach_ptr(column, whereColumnList)
+	{
+		if (column->varlevelsup == 0 && column->varattno > 0 &&
+			column->varattno <= columnCount &&
+			reader->whereColumns[column->varattno - 1] == NULL)
+		{
+			reader->whereColumns[column->varattno - 1] = column;
+		}
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid writerTypeId = (Oid) pq_getmsgint(fileHeader, 4);
+		Oid writerCollationId = (Oid) pq_getmsgint(fileHeader, 4);
+		Var *whereColumn = reader->whereColumns[columnIndex];
+
+		reader->projectedColumns[columnIndex] = bms_is_member(columnIndex + 1,
+															  projectedColumns);
+
+		/*
+		 * The min/max values can only be compared with the quals if the writer
+		 * ordered the values the same way as the column's btree operators.
+		 */
+		if (whereColumn != NULL && whereColumn->vartype == attribute->atttypid &&
+			writerTypeId == attribute->atttypid &&
+			writerCollationId == attribute->attcollation)
+		{
+			TypeCacheEntry *typeEntry = lookup_type_cache(attribute->atttypid,
+														  TYPECACHE_BTREE_OPFAMILY);
+
+			if (OidIsValid(typeEntry->btree_opf) &&
+				typeEntry->btree_opintype == attribute->atttypid)
+			{
+				reader->greaterEqualOperators[columnIndex] =
+					get_opfamily_member(typeEntry->btree_opf, attribute->atttypid,
+										attribute->atttypid,
+										BTGreaterEqualStrategyNumber);
+				reader->lessEqualOperators[columnIndex] =
+					get_opfamily_member(typeEntry->btree_opf, attribute->atttypid,
+										attribute->atttypid,
+										BTLessEqualStrategyNumber);
+
+				reader->useMinMax[columnIndex] =
+					OidIsValid(reader->greaterEqualOperators[columnIndex]) &&
+					OidIsValid(reader->lessEqualOperators[columnIndex]);
+			}
+		}
+
+		if (reader->projectedColumns[columnIndex] || reader->useMinMax[columnIndex])
+		{
+			Oid receiveFunctionId = InvalidOid;
+
+			getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+								   &reader->typeIOParams[columnIndex]);
+			fmgr_info(receiveFunctionId, &reader->receiveFunctions[columnIndex]);
+		}
+
+		if (reader->projectedColumns[columnIndex])
+		{
+			reader->columnData[columnIndex] = makeStringInfo();
+		}
+	}
+
+	FreeStringInfo(fileHeader);
+
+	return reader;
+}
+
+
+/*
+ * ReadNextColumnarResultRow reads the next row of the result into the given
+ * arrays, with values allocated in the current memory context. It returns
+ * false at the end of the result.
+ */
+bool
+ReadNextColumnarResultRow(ColumnarResultReader *reader, Datum *columnValues,
+						  bool *columnNulls)
+{
+	while (reader->blockRowIndex >= reader->blockRowCount)
+	{
+		if (!ReadNextColumnarResultBlock(reader))
+		{
+			return false;
+		}
+	}
+
+	for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+	{
+		if (!reader->projectedColumns[columnIndex])
+		{
+			columnValues[columnIndex] = (Datum) 0;
+			columnNulls[columnIndex] = true;
+			continue;
+		}
+
+		StringInfo columnData = reader->columnData[columnIndex];
+		int valueLength = (int32) pq_getmsgint(columnData, 4);
+
+		if (valueLength == COLUMNAR_RESULT_NULL_LENGTH)
+		{
+			columnValues[columnIndex] = (Datum) 0;
+			columnNulls[columnIndex] = true;
+		}
+		else
+		{
+			const char *valueData = pq_getmsgbytes(columnData, valueLength);
+
+			columnValues[columnIndex] = ReceiveColumnValue(reader, columnIndex,
+														   valueData, valueLength);
+			columnNulls[columnIndex] = false;
+		}
+	}
+
+	reader->blockRowIndex++;
+
+	return true;
+}
+
+
+/*
+ * ReadNextColumnarResultBlock reads the projected columns of the next block
+ * that may contain rows passing the quals. It returns false at the end of
+ * the file.
+ */
+static bool
+ReadNextColumnarResultBlock(ColumnarResultReader *reader)
+{
+	StringInfo blockDescriptors = reader->blockDescriptors;
+
+	while (true)
+	{
+		MemoryContextReset(reader->blockContext);
+
+		if (!ReadColumnarResultData(reader, blockDescriptors,
+									COLUMNAR_RESULT_BLOCK_HEADER_SIZE, true))
+		{
+			return false;
+		}
+
+		uint32 rowCount = pq_getmsgint(blockDescriptors, 4);
+		uint32 descriptorLength = pq_getmsgint(blockDescriptors, 4);
+
+		ReadColumnarResultData(reader, blockDescriptors, (int) descriptorLength, false);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(reader->blockContext);
+
+		uint32 *dataLengths = palloc0(reader->columnCount * sizeof(uint32));
+		uint64 blockDataLength = 0;
+		List *constraintList = NIL;
+
+		for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+		{
+			uint32 nullCount = pq_getmsgint(blockDescriptors, 4);
+
+			dataLengths[columnIndex] = pq_getmsgint(blockDescriptors, 4);
+			blockDataLength += dataLengths[columnIndex];
+
+			Node *constraint = ColumnBlockConstraint(reader, columnIndex, rowCount,
+													 nullCount, blockDescriptors);
+			if (constraint != NULL)
+			{
+				constraintList = lappend(constraintList, constraint);
+			}
+		}
+
+		/* skip the block if its rows cannot pass the quals */
+		bool skipBlock = constraintList != NIL &&
+						 predicate_refuted_by(reader->whereClauseList, constraintList,
+											  false);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (skipBlock)
+		{
+			FileSkipCompat(&reader->fileCompat, blockDataLength);
+			continue;
+		}
+
+		for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+		{
+			if (reader->projectedColumns[columnIndex])
+			{
+				ReadColumnarResultData(reader, reader->columnData[columnIndex],
+									   (int) dataLengths[columnIndex], false);
+			}
+			else
+			{
+				FileSkipCompat(&reader->fileCompat, dataLengths[columnIndex]);
+			}
+		}
+
+		reader->blockRowCount = rowCount;
+		reader->blockRowIndex = 0;
+
+		return true;
+	}
+}
+
+
+/*
+ * ColumnBlockConstraint reads the minimum and maximum value of a column from
+ * the block descriptors, and returns an expression that holds for all rows of
+ * the block, or NULL if the value range of the column cannot be used.
+ */
+static Node *
+ColumnBlockConstraint(ColumnarResultReader *reader, int columnIndex, uint32 rowCount,
+					  uint32 nullCount, StringInfo blockDescriptors)
+{
+	Form_pg_attribute attribute = TupleDescAttr(reader->tupleDescriptor, columnIndex);
+	Var *column = reader->whereColumns[columnIndex];
+	const char *minimumData = NULL;
+	const char *maximumData = NULL;
+
+	int minimumLength = (int32) pq_getmsgint(blockDescriptors, 4);
+	if (minimumLength != COLUMNAR_RESULT_NULL_LENGTH)
+	{
+		minimumData = pq_getmsgbytes(blockDescriptors, minimumLength);
+	}
+
+	int maximumLength = (int32) pq_getmsgint(blockDescriptors, 4);
+	if (maximumLength != COLUMNAR_RESULT_NULL_LENGTH)
+	{
+		maximumData = pq_getmsgbytes(blockDescriptors, maximumLength);
+	}
+
+	if (!reader->useMinMax[columnIndex])
+	{
+		return NULL;
+	}
+
+	NullTest *nullTest = makeNode(NullTest);
+	nullTest->arg = (Expr *) column;
+	nullTest->nulltesttype = IS_NULL;
+	nullTest->argisrow = false;
+	nullTest->location = -1;
+
+	if (nullCount == rowCount)
+	{
+		return (Node *) nullTest;
+	}
+	else if (minimumData == NULL || maximumData == NULL)
+	{
+		return NULL;
+	}
+
+	Datum minimumValue = ReceiveColumnValue(reader, columnIndex, minimumData,
+											minimumLength);
+	Datum maximumValue = ReceiveColumnValue(reader, columnIndex, maximumData,
+											maximumLength);
+
+	Const *minimumConst = makeConst(attribute->atttypid, attribute->atttypmod,
+									attribute->attcollation, attribute->attlen,
+									minimumValue, false, attribute->attbyval);
+	Const *maximumConst = makeConst(attribute->atttypid, attribute->atttypmod,
+									attribute->attcollation, attribute->attlen,
+									maximumValue, false, attribute->attbyval);
+
+	Oid greaterEqualOperator = reader->greaterEqualOperators[columnIndex];
+	OpExpr *lowerBound = (OpExpr *) make_opclause(greaterEqualOperator, BOOLOID, false,
+												  (Expr *) column,
+												  (Expr *) minimumConst,
+												  InvalidOid, attribute->attcollation);
+	lowerBound->opfuncid = get_opcode(greaterEqualOperator);
+
+	Oid lessEqualOperator = reader->lessEqualOperators[columnIndex];
+	OpExpr *upperBound = (OpExpr *) make_opclause(lessEqualOperator, BOOLOID, false,
+												  (Expr *) column,
+												  (Expr *) maximumConst,
+												  InvalidOid, attribute->attcollation);
+	upperBound->opfuncid = get_opcode(lessEqualOperator);
+
+	Node *constraint = (Node *) make_andclause(list_make2(lowerBound, upperBound));
+
+	if (nullCount > 0)
+	{
+		constraint = (Node *) make_orclause(list_make2(constraint, nullTest));
+	}
+
+	return constraint;
+}
+
+
+/*
+ * ReceiveColumnValue converts the binary representation of a value into a
+ * datum of the type of the given column.
+ */
+static Datum
+ReceiveColumnValue(ColumnarResultReader *reader, int columnIndex,
+				   const char *valueData, int valueLength)
+{
+	Form_pg_attribute attribute = TupleDescAttr(reader->tupleDescriptor, columnIndex);
+	StringInfo attributeBuffer = reader->attributeBuffer;
+
+	/* receive functions expect a terminated buffer of their own */
+	resetStringInfo(attributeBuffer);
+	appendBinaryStringInfo(attributeBuffer, valueData, valueLength);
+
+	Datum value = ReceiveFunctionCall(&reader->receiveFunctions[columnIndex],
+									  attributeBuffer,
+									  reader->typeIOParams[columnIndex],
+									  attribute->atttypmod);
+
+	if (attributeBuffer->cursor != attributeBuffer->len)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("incorrect binary data format in intermediate "
+							   "result file \"%s\"", reader->fileName)));
+	}
+
+	return value;
+}
+
+
+/*
+ * ReadColumnarResultData reads length bytes from the result file into the
+ * given buffer, replacing its contents. If allowEnd is set, it returns false
+ * when the end of the file is reached before any byte is read, otherwise it
+ * errors out when the file ends early.
+ */
+static bool
+ReadColumnarResultData(ColumnarResultReader *reader, StringInfo buffer, int length,
+					   bool allowEnd)
+{
+	int totalBytesRead = 0;
+
+	resetStringInfo(buffer);
+	enlargeStringInfo(buffer, length);
+
+	while (totalBytesRead < length)
+	{
+		int bytesRead = FileReadCompat(&reader->fileCompat,
+									   buffer->data + totalBytesRead,
+									   length - totalBytesRead,
+									   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ);
+		if (bytesRead < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read file \"%s\": %m",
+								   reader->fileName)));
+		}
+		else if (bytesRead == 0)
+		{
+			if (allowEnd && totalBytesRead == 0)
+			{
+				return false;
+			}
+
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("columnar intermediate result file \"%s\" is "
+								   "truncated", reader->fileName)));
+		}
+
+		totalBytesRead += bytesRead;
+	}
+
+	buffer->len = length;
+	buffer->data[length] = '\0';
+
+	return true;
+}
+
+
+/*
+ * CloseColumnarResultReader closes the result file of the given reader and
+ * frees its buffers.
+ */
+void
+CloseColumnarResultReader(ColumnarResultReader *reader)
+{
+	FileClose(reader->fileCompat.fd);
+
+	for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+	{
+		if (reader->columnData[columnIndex] != NULL)
+		{
+			FreeStringInfo(reader->columnData[columnIndex]);
+		}
+	}
+
+	FreeStringInfo(reader->blockDescriptors);
+	FreeStringInfo(reader->attributeBuffer);
+	MemoryContextDelete(reader->blockContext);
+	pfree(reader);
+}
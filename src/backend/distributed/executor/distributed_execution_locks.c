@@ -19,6 +19,8 @@
 
 
 static bool RequiresConsistentSnapshot(Task *task);
+static void AcquireEscalatedMultiShardLocks(List *taskList);
+static LOCKMODE MultiShardLockMode(Task *task);
 static void AcquireExecutorShardLockForRowModify(Task *task, RowModifyLevel modLevel);
 static void AcquireExecutorShardLocksForRelationRowLockList(List *relationRowLockList);
 
@@ -69,72 +71,32 @@ AcquireExecutorShardLocks(Task *task, RowModifyLevel modLevel)
  * a time. Otherwise, concurrent multi-shard commands may take row-level
  * locks on the shard placements in a different order and create a distributed
  * deadlock. This applies even when writes are commutative and/or there is
- * no replication.
+ * no replication. See MultiShardLockMode for the lock modes.
  *
- * 1. If citus.all_modifications_commutative is set to true, then all locks
- * are acquired as ShareUpdateExclusiveLock.
- *
- * 2. If citus.all_modifications_commutative is false, then only the shards
- * with 2 or more replicas are locked with ExclusiveLock. Otherwise, the
- * lock is acquired with ShareUpdateExclusiveLock.
- *
- * ShareUpdateExclusiveLock conflicts with itself such that only one
- * multi-shard modification at a time is allowed on a shard. It also conflicts
- * with ExclusiveLock, which ensures that updates/deletes/upserts are applied
- * in the same order on all placements. It does not conflict with
- * RowExclusiveLock, which is normally obtained by single-shard, commutative
- * writes.
+ * When the number of tasks reaches citus.shard_lock_escalation_threshold, the
+ * shard locks are escalated to locks on ranges of shards, such that a
+ * modification of thousands of shards does not take thousands of locks.
  */
 void
 AcquireExecutorMultiShardLocks(List *taskList)
 {
+	if (ShardLockEscalationThreshold > 0 &&
+		list_length(taskList) >= ShardLockEscalationThreshold)
+	{
+		AcquireEscalatedMultiShardLocks(taskList);
+		return;
+	}
+
 	Task *task = NULL;
 	foreach_ptr(task, taskList)
 	{
-		LOCKMODE lockMode = NoLock;
-
 		if (task->anchorShardId == INVALID_SHARD_ID)
 		{
 			/* no shard locks to take if the task is not anchored to a shard */
 			continue;
 		}
 
-		if (AllModificationsCommutative || list_length(task->taskPlacementList) == 1)
-		{
-			/*
-			 * When all writes are commutative then we only need to prevent multi-shard
-			 * commands from running concurrently with each other and with commands
-			 * that are explicitly non-commutative. When there is no replication then
-			 * we only need to prevent concurrent multi-shard commands.
-			 *
-			 * In either case, ShareUpdateExclusive has the desired effect, since
-			 * it conflicts with itself and ExclusiveLock (taken by non-commutative
-			 * writes).
-			 *
-			 * However, some users find this too restrictive, so we allow them to
-			 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
-			 * is enabled, which lets multi-shard modifications run in parallel as
-			 * long as they all disable the GUC.
-			 */
-
-			if (EnableDeadlockPrevention)
-			{
-				lockMode = ShareUpdateExclusiveLock;
-			}
-			else
-			{
-				lockMode = RowExclusiveLock;
-			}
-		}
-		else
-		{
-			/*
-			 * When there is replication, prevent all concurrent writes to the same
-			 * shards to ensure the writes are ordered.
-			 */
-
-			lockMode = ExclusiveLock;
-		}
+		LOCKMODE lockMode = MultiShardLockMode(task);
 
 		/*
 		 * If we are dealing with a partition we are also taking locks on parent table
@@ -163,6 +125,122 @@ AcquireExecutorMultiShardLocks(List *taskList)
 }
 
 
+/*
+ * AcquireEscalatedMultiShardLocks acquires the locks of a multi-shard write as
+ * locks on the ranges of shard IDs that the anchor shards (and the colocated
+ * shards of the parents of partitions) belong to. All ranges are locked in the
+ * strongest mode that any of the tasks requires.
+ */
+static void
+AcquireEscalatedMultiShardLocks(List *taskList)
+{
+	int taskCount = list_length(taskList);
+	uint64 *shardIdArray = palloc0(2 * taskCount * sizeof(uint64));
+	int shardIdCount = 0;
+	LOCKMODE lockMode = NoLock;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->anchorShardId == INVALID_SHARD_ID)
+		{
+			/* no shard locks to take if the task is not anchored to a shard */
+			continue;
+		}
+
+		lockMode = Max(lockMode, MultiShardLockMode(task));
+
+		shardIdArray[shardIdCount++] = task->anchorShardId;
+
+		uint64 parentShardId = ParentShardIdIfPartition(task->anchorShardId);
+		if (parentShardId != INVALID_SHARD_ID)
+		{
+			shardIdArray[shardIdCount++] = parentShardId;
+		}
+	}
+
+	if (shardIdCount > 0)
+	{
+		LockShardRangeResources(shardIdArray, shardIdCount, lockMode);
+	}
+
+	foreach_ptr(task, taskList)
+	{
+		/* same as in AcquireExecutorMultiShardLocks */
+		if (RequiresConsistentSnapshot(task))
+		{
+			LockRelationShardResources(task->relationShardList, ExclusiveLock);
+		}
+	}
+
+	pfree(shardIdArray);
+}
+
+
+/*
+ * MultiShardLockMode returns the mode of the shard lock that a task of a
+ * multi-shard write takes on its anchor shard.
+ *
+ * 1. If citus.all_modifications_commutative is set to true, then all locks
+ * are acquired as ShareUpdateExclusiveLock.
+ *
+ * 2. If citus.all_modifications_commutative is false, then only the shards
+ * with 2 or more replicas are locked with ExclusiveLock. Otherwise, the
+ * lock is acquired with ShareUpdateExclusiveLock.
+ *
+ * ShareUpdateExclusiveLock conflicts with itself such that only one
+ * multi-shard modification at a time is allowed on a shard. It also conflicts
+ * with ExclusiveLock, which ensures that updates/deletes/upserts are applied
+ * in the same order on all placements. It does not conflict with
+ * RowExclusiveLock, which is normally obtained by single-shard, commutative
+ * writes.
+ */
+static LOCKMODE
+MultiShardLockMode(Task *task)
+{
+	LOCKMODE lockMode = NoLock;
+
+	if (AllModificationsCommutative || list_length(task->taskPlacementList) == 1)
+	{
+		/*
+		 * When all writes are commutative then we only need to prevent multi-shard
+		 * commands from running concurrently with each other and with commands
+		 * that are explicitly non-commutative. When there is no replication then
+		 * we only need to prevent concurrent multi-shard commands.
+		 *
+		 * In either case, ShareUpdateExclusive has the desired effect, since
+		 * it conflicts with itself and ExclusiveLock (taken by non-commutative
+		 * writes).
+		 *
+		 * However, some users find this too restrictive, so we allow them to
+		 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
+		 * is enabled, which lets multi-shard modifications run in parallel as
+		 * long as they all disable the GUC.
+		 */
+
+		if (EnableDeadlockPrevention)
+		{
+			lockMode = ShareUpdateExclusiveLock;
+		}
+		else
+		{
+			lockMode = RowExclusiveLock;
+		}
+	}
+	else
+	{
+		/*
+		 * When there is replication, prevent all concurrent writes to the same
+		 * shards to ensure the writes are ordered.
+		 */
+
+		lockMode = ExclusiveLock;
+	}
+
+	return lockMode;
+}
+
+
 /*
  * RequiresConsistentSnapshot returns true if the given task need to take
  * the necessary locks to ensure that a subquery in the modify query
@@ -241,6 +319,21 @@ AcquireMetadataLocks(List *taskList)
 }
 
 
+/*
+ * ParallelReplicaWritesEnabled returns whether commutative writes to a shard
+ * with multiple placements run on all placements in parallel rather than on
+ * one placement after the other. Such writes take an ExclusiveLock on the
+ * shard, like non-commutative writes, such that concurrent writes cannot
+ * deadlock across placements. When citus.all_modifications_commutative is
+ * set, writes do not take that lock, so they keep running sequentially.
+ */
+bool
+ParallelReplicaWritesEnabled(void)
+{
+	return EnableParallelReplicaWrites && !AllModificationsCommutative;
+}
+
+
 static void
 AcquireExecutorShardLockForRowModify(Task *task, RowModifyLevel modLevel)
 {
@@ -299,7 +392,7 @@ AcquireExecutorShardLockForRowModify(Task *task, RowModifyLevel modLevel)
 
 		lockMode = RowExclusiveLock;
 	}
-	else if (modLevel < ROW_MODIFY_NONCOMMUTATIVE)
+	else if (modLevel < ROW_MODIFY_NONCOMMUTATIVE && !ParallelReplicaWritesEnabled())
 	{
 		/*
 		 * An INSERT commutes with other INSERT commands, since performing them
@@ -333,6 +426,10 @@ AcquireExecutorShardLockForRowModify(Task *task, RowModifyLevel modLevel)
 		 * ExclusiveLock conflicts with all lock types used by modifications
 		 * and therefore prevents other modifications from running
 		 * concurrently.
+		 *
+		 * INSERTs that run on all placements in parallel take the same lock,
+		 * since two concurrent INSERTs could otherwise wait for each other on
+		 * different placements, for instance on a unique index.
 		 */
 
 		lockMode = ExclusiveLock;
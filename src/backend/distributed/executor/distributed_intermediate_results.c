@@ -58,6 +58,10 @@ typedef struct NodeToNodeFragmentsTransfer
 } NodeToNodeFragmentsTransfer;
 
 
+/* config variable(s) managed via guc.c */
+int FragmentTransferParallelism = 1;
+
+
 /* forward declarations of local functions */
 static void WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 									 int partitionColumnIndex,
@@ -81,6 +85,7 @@ static List ** ColocateFragmentsWithRelation(List *fragmentList,
 static List * ColocationTransfers(List *fragmentList,
 								  CitusTableCacheEntry *targetRelation);
 static List * FragmentTransferTaskList(List *fragmentListTransfers);
+static List * SplitFragmentList(List *fragmentList, int partCount);
 static char * QueryStringForFragmentsTransfer(
 	NodeToNodeFragmentsTransfer *fragmentsTransfer);
 static void ExecuteFetchTaskList(List *fetchTaskList);
@@ -142,11 +147,23 @@ PartitionTasklistResults(const char *resultIdPrefix, List *selectTaskList,
 						 bool binaryFormat)
 {
 	if (targetRelation->partitionMethod != DISTRIBUTE_BY_HASH &&
-		targetRelation->partitionMethod != DISTRIBUTE_BY_RANGE)
+		targetRelation->partitionMethod != DISTRIBUTE_BY_RANGE &&
+		targetRelation->partitionMethod != DISTRIBUTE_BY_APPEND)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						errmsg("repartitioning results of a tasklist is only supported "
-							   "when target relation is hash or range partitioned.")));
+							   "when target relation is hash, range or append "
+							   "partitioned.")));
+	}
+
+	if (targetRelation->partitionMethod == DISTRIBUTE_BY_APPEND &&
+		(targetRelation->shardIntervalArrayLength == 0 ||
+		 targetRelation->hasOverlappingShardInterval))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("repartitioning results of a tasklist into an append "
+							   "partitioned relation requires shards with "
+							   "non-overlapping min/max values")));
 	}
 
 	/*
@@ -202,6 +219,7 @@ WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 	{
 		List *shardPlacementList = selectTask->taskPlacementList;
 		char *taskPrefix = SourceShardPrefix(resultIdPrefix, selectTask->anchorShardId);
+		/* append-distributed shards are partitioned into by their ranges */
 		char *partitionMethodString = targetRelation->partitionMethod == 'h' ?
 									  "hash" : "range";
 		const char *binaryFormatString = binaryFormat ? "true" : "false";
@@ -552,21 +570,84 @@ FragmentTransferTaskList(List *fragmentListTransfers)
 
 		WorkerNode *workerNode = ForceLookupNodeByNodeId(targetNodeId);
 
-		ShardPlacement *targetPlacement = CitusMakeNode(ShardPlacement);
-		SetPlacementNodeMetadata(targetPlacement, workerNode);
+		/*
+		 * fetch_intermediate_results() copies the fragments one after another,
+		 * so we split the fragments of a node pair over multiple tasks which
+		 * the executor can run over separate connections.
+		 */
+		List *fragmentListParts = SplitFragmentList(fragmentsTransfer->fragmentList,
+													FragmentTransferParallelism);
 
-		Task *task = CitusMakeNode(Task);
-		task->taskType = SELECT_TASK;
-		SetTaskQueryString(task, QueryStringForFragmentsTransfer(fragmentsTransfer));
-		task->taskPlacementList = list_make1(targetPlacement);
+		List *fragmentListPart = NIL;
+		foreach_ptr(fragmentListPart, fragmentListParts)
+		{
+			NodeToNodeFragmentsTransfer partTransfer = {
+				.nodes = fragmentsTransfer->nodes,
+				.fragmentList = fragmentListPart
+			};
 
-		fetchTaskList = lappend(fetchTaskList, task);
+			ShardPlacement *targetPlacement = CitusMakeNode(ShardPlacement);
+			SetPlacementNodeMetadata(targetPlacement, workerNode);
+
+			Task *task = CitusMakeNode(Task);
+			task->taskType = SELECT_TASK;
+			SetTaskQueryString(task, QueryStringForFragmentsTransfer(&partTransfer));
+			task->taskPlacementList = list_make1(targetPlacement);
+
+			fetchTaskList = lappend(fetchTaskList, task);
+		}
 	}
 
 	return fetchTaskList;
 }
 
 
+/*
+ * SplitFragmentList splits the given list of fragments into at most partCount
+ * lists with roughly the same number of rows, by adding each fragment to the
+ * list that has the fewest rows so far. It returns a list of these lists.
+ */
+static List *
+SplitFragmentList(List *fragmentList, int partCount)
+{
+	partCount = Min(partCount, list_length(fragmentList));
+	if (partCount <= 1)
+	{
+		return list_make1(fragmentList);
+	}
+
+	List **fragmentListParts = palloc0(partCount * sizeof(List *));
+	int64 *partRowCounts = palloc0(partCount * sizeof(int64));
+
+	DistributedResultFragment *fragment = NULL;
+	foreach_ptr(fragment, fragmentList)
+	{
+		int smallestPartIndex = 0;
+
+		for (int partIndex = 1; partIndex < partCount; partIndex++)
+		{
+			if (partRowCounts[partIndex] < partRowCounts[smallestPartIndex])
+			{
+				smallestPartIndex = partIndex;
+			}
+		}
+
+		fragmentListParts[smallestPartIndex] =
+			lappend(fragmentListParts[smallestPartIndex], fragment);
+		partRowCounts[smallestPartIndex] += fragment->rowCount;
+	}
+
+	List *fragmentListPartList = NIL;
+	for (int partIndex = 0; partIndex < partCount; partIndex++)
+	{
+		fragmentListPartList = lappend(fragmentListPartList,
+									   fragmentListParts[partIndex]);
+	}
+
+	return fragmentListPartList;
+}
+
+
 /*
  * QueryStringForFragmentsTransfer returns a query which fetches distributed
  * result fragments from source node to target node. See the structure of
@@ -0,0 +1,365 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_tracing.c
+ *   Connects distributed queries to the commands they run on the workers.
+ *
+ * When citus.enable_distributed_tracing is on, every client statement that
+ * runs distributed tasks gets a trace id, and every placement execution a
+ * span id. The commands sent to the workers start with a comment holding
+ * the W3C trace context, traceparent='00-<trace id>-<span id>-01', which
+ * shows up in pg_stat_activity and the logs of the workers. Once a
+ * placement execution is done, its span, with the times at which it became
+ * ready, was sent, received its first row and finished, is written into a
+ * ring buffer in shared memory, which citus_recent_spans() reads.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "catalog/pg_authid.h"
+#include "distributed/connection_management.h"
+#include "distributed/distributed_tracing.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+
+#define RECENT_SPANS_COLUMNS 15
+
+
+/* a span as stored in the ring buffer */
+typedef struct TaskSpanEntry
+{
+	char traceId[TRACE_ID_LENGTH + 1];
+	Oid userId;
+	int processId;
+	TaskSpan span;
+	char nodeName[MAX_NODE_LENGTH];
+} TaskSpanEntry;
+
+
+/*
+ * The data structure used to store data in shared memory. The spans follow
+ * the struct, nextSpanIndex counts all spans ever written such that the
+ * oldest span is overwritten once the buffer is full.
+ */
+typedef struct TracingSharedData
+{
+	int spanBufferTrancheId;
+	char *spanBufferTrancheName;
+
+	LWLock spanBufferLock;
+	uint64 nextSpanIndex;
+
+	TaskSpanEntry spans[FLEXIBLE_ARRAY_MEMBER];
+} TracingSharedData;
+
+
+/* GUC, whether distributed queries propagate a trace context and record spans */
+bool EnableDistributedTracing = false;
+
+/* GUC, number of spans kept in shared memory */
+int TraceSpanBufferSize = 1000;
+
+
+static TracingSharedData *TracingSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* trace id of the current statement and the start time of that statement */
+static char CurrentTraceIdString[TRACE_ID_LENGTH + 1];
+static TimestampTz CurrentTraceStatementStartTime = 0;
+
+/* number of spans started by this backend */
+static uint32 TraceSpanCounter = 0;
+
+
+/* local function declarations */
+static void StoreRecentSpans(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
+static Datum TimestampDatumOrNull(TimestampTz timestamp, bool *isNull);
+static void TracingShmemInit(void);
+static size_t TracingShmemSize(void);
+
+
+PG_FUNCTION_INFO_V1(citus_recent_spans);
+
+
+/*
+ * citus_recent_spans returns the spans of the most recent placement
+ * executions on this node.
+ */
+Datum
+citus_recent_spans(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreRecentSpans(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreRecentSpans inserts the spans in the ring buffer into the given
+ * tuplestore, oldest first. Like pg_stat_activity, only the spans of the
+ * current user are shown, unless the user is allowed to read all statistics.
+ */
+static void
+StoreRecentSpans(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[RECENT_SPANS_COLUMNS];
+	bool isNulls[RECENT_SPANS_COLUMNS];
+	Oid userId = GetUserId();
+	bool canReadAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	if (TracingSharedState == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&TracingSharedState->spanBufferLock, LW_SHARED);
+
+	uint64 nextSpanIndex = TracingSharedState->nextSpanIndex;
+	uint64 spanIndex = 0;
+
+	if (nextSpanIndex > (uint64) TraceSpanBufferSize)
+	{
+		spanIndex = nextSpanIndex - TraceSpanBufferSize;
+	}
+
+	for (; spanIndex < nextSpanIndex; spanIndex++)
+	{
+		TaskSpanEntry *spanEntry =
+			&TracingSharedState->spans[spanIndex % TraceSpanBufferSize];
+		TaskSpan *span = &spanEntry->span;
+
+		if (!canReadAllStats && spanEntry->userId != userId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = CStringGetTextDatum(spanEntry->traceId);
+		values[1] = CStringGetTextDatum(psprintf("%016" INT64_MODIFIER "x",
+												 span->spanId));
+		values[2] = Int32GetDatum(spanEntry->processId);
+		values[3] = Int64GetDatum((int64) span->queryId);
+		values[4] = UInt32GetDatum(span->taskId);
+		values[5] = Int64GetDatum((int64) span->shardId);
+		values[6] = CStringGetTextDatum(spanEntry->nodeName);
+		values[7] = Int32GetDatum(span->nodePort);
+		values[8] = TimestampDatumOrNull(span->readyTime, &isNulls[8]);
+		values[9] = TimestampDatumOrNull(span->sendTime, &isNulls[9]);
+		values[10] = TimestampDatumOrNull(span->firstRowTime, &isNulls[10]);
+		values[11] = TimestampDatumOrNull(span->endTime, &isNulls[11]);
+		values[12] = Int64GetDatum((int64) span->rowCount);
+		values[13] = BoolGetDatum(span->succeeded);
+		values[14] = ObjectIdGetDatum(spanEntry->userId);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&TracingSharedState->spanBufferLock);
+}
+
+
+/*
+ * TimestampDatumOrNull returns the given timestamp as a datum, and sets isNull
+ * if the timestamp was never set.
+ */
+static Datum
+TimestampDatumOrNull(TimestampTz timestamp, bool *isNull)
+{
+	*isNull = (timestamp == 0);
+
+	return TimestampTzGetDatum(timestamp);
+}
+
+
+/*
+ * CurrentTraceId returns the trace id of the current client statement in
+ * hexadecimal notation. A new random trace id is generated whenever a new
+ * statement starts, such that all tasks of a statement, including those of
+ * its subplans, belong to the same trace.
+ */
+const char *
+CurrentTraceId(void)
+{
+	TimestampTz statementStartTime = GetCurrentStatementStartTimestamp();
+
+	if (statementStartTime != CurrentTraceStatementStartTime)
+	{
+		uint8 traceId[TRACE_ID_LENGTH / 2];
+
+		/* same as citus_server_id(), fall back to random() */
+		if (!pg_strong_random((char *) traceId, sizeof(traceId)))
+		{
+			for (int byteIndex = 0; byteIndex < sizeof(traceId); byteIndex++)
+			{
+				traceId[byteIndex] = (uint8) (random() & 0xFF);
+			}
+		}
+
+		for (int byteIndex = 0; byteIndex < sizeof(traceId); byteIndex++)
+		{
+			sprintf(&CurrentTraceIdString[byteIndex * 2], "%02x", traceId[byteIndex]);
+		}
+
+		CurrentTraceStatementStartTime = statementStartTime;
+	}
+
+	return CurrentTraceIdString;
+}
+
+
+/*
+ * NextTraceSpanId returns a span id that is unique among the spans of this
+ * node, by combining the process id with a per-backend counter.
+ */
+uint64
+NextTraceSpanId(void)
+{
+	TraceSpanCounter++;
+
+	return ((uint64) MyProcPid << 32) | TraceSpanCounter;
+}
+
+
+/*
+ * TraceParentComment returns the comment that is prepended to the commands
+ * of the given span, in the format of the W3C traceparent header.
+ */
+char *
+TraceParentComment(const char *traceId, uint64 spanId)
+{
+	return psprintf("/*traceparent='00-%s-%016" INT64_MODIFIER "x-01'*/ ",
+					traceId, spanId);
+}
+
+
+/*
+ * RecordTaskSpan writes the given span into the ring buffer, overwriting
+ * the oldest span if the buffer is full.
+ */
+void
+RecordTaskSpan(TaskSpan *span)
+{
+	if (TracingSharedState == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&TracingSharedState->spanBufferLock, LW_EXCLUSIVE);
+
+	uint64 spanIndex = TracingSharedState->nextSpanIndex++;
+	TaskSpanEntry *spanEntry = &TracingSharedState->spans[spanIndex %
+														  TraceSpanBufferSize];
+
+	strlcpy(spanEntry->traceId, span->traceId, sizeof(spanEntry->traceId));
+	spanEntry->userId = GetUserId();
+	spanEntry->processId = MyProcPid;
+	spanEntry->span = *span;
+	spanEntry->span.traceId = NULL;
+	spanEntry->span.nodeName = NULL;
+	strlcpy(spanEntry->nodeName, span->nodeName, sizeof(spanEntry->nodeName));
+
+	LWLockRelease(&TracingSharedState->spanBufferLock);
+}
+
+
+/*
+ * InitializeDistributedTracing requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeDistributedTracing(void)
+{
+	if (TraceSpanBufferSize == 0)
+	{
+		/* trace context is still propagated, but spans are not kept */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(TracingShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = TracingShmemInit;
+}
+
+
+/*
+ * TracingShmemSize returns the size that should be allocated on the shared
+ * memory for the span ring buffer.
+ */
+static size_t
+TracingShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, offsetof(TracingSharedData, spans));
+	size = add_size(size, mul_size(TraceSpanBufferSize, sizeof(TaskSpanEntry)));
+
+	return size;
+}
+
+
+/*
+ * TracingShmemInit initializes the shared memory used for keeping the most
+ * recent spans across backends.
+ */
+static void
+TracingShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	TracingSharedState =
+		(TracingSharedData *) ShmemInitStruct("Distributed Tracing Data",
+											  TracingShmemSize(),
+											  &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		TracingSharedState->spanBufferTrancheId = LWLockNewTrancheId();
+		TracingSharedState->spanBufferTrancheName = "Distributed Tracing Tranche";
+		LWLockRegisterTranche(TracingSharedState->spanBufferTrancheId,
+							  TracingSharedState->spanBufferTrancheName);
+
+		LWLockInitialize(&TracingSharedState->spanBufferLock,
+						 TracingSharedState->spanBufferTrancheId);
+
+		TracingSharedState->nextSpanIndex = 0;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -0,0 +1,600 @@
+/*-------------------------------------------------------------------------
+ *
+ * inline_intermediate_results.c
+ *   Inlining small intermediate results into the queries that read them.
+ *
+ * The result of a subplan is normally sent to the nodes that need it, where
+ * it is stored in a file until read_intermediate_result() reads it back.
+ * For results of a few rows, the file round trip costs more than computing
+ * the result. When citus.max_inline_intermediate_result_size is set, the
+ * result of a subplan is buffered in COPY text format instead, and only
+ * sent to the nodes as a file once it grows beyond that size. If it stays
+ * small, the adaptive executor replaces the read_intermediate_result()
+ * calls for the result in the task queries by read_inline_intermediate_result()
+ * calls that contain the data as a literal.
+ *
+ * The coordinator still writes a local file if it reads the result itself,
+ * since the combine query and local execution do not go through the task
+ * query strings.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/commands/multi_copy.h"
+#include "distributed/inline_intermediate_results.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/tuplestore.h"
+#include "distributed/version_compat.h"
+#include "executor/tuptable.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+/* prefix of the calls to read_intermediate_result in deparsed task queries */
+#define READ_INTERMEDIATE_RESULT_PREFIX "read_intermediate_result('"
+
+
+/*
+ * InlineResultDestReceiver buffers the tuples of a subplan result as long as
+ * it is small enough to be inlined, and otherwise passes them on to a
+ * RemoteFileDestReceiver.
+ */
+typedef struct InlineResultDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	char *resultId;
+	EState *executorState;
+	List *initialNodeList;
+	bool writeLocalFile;
+	MemoryContext memoryContext;
+
+	int operation;
+	TupleDesc tupleDescriptor;
+
+	/* serialisation of the tuples in COPY text format */
+	CopyOutState copyOutState;
+	FmgrInfo *columnOutputFunctions;
+
+	/* tuples received so far, while the result is small enough to inline */
+	StringInfo inlineData;
+	Tuplestorestate *tupleStore;
+
+	/* receiver that writes the result files, once it is too large to inline */
+	DestReceiver *fileDest;
+} InlineResultDestReceiver;
+
+
+/*
+ * InlinedIntermediateResult is an intermediate result of the current
+ * transaction that is not stored in files on the workers.
+ */
+typedef struct InlinedIntermediateResult
+{
+	char *resultId;
+
+	/* call to read_inline_intermediate_result that returns the result */
+	char *functionCall;
+} InlinedIntermediateResult;
+
+
+/* config variable managed via guc.c */
+int MaxInlineIntermediateResultSize = 0;
+
+/* intermediate results of the current transaction that were inlined */
+static List *InlinedIntermediateResultList = NIL;
+
+/* data that read_inline_intermediate_result is currently reading */
+static char *InlineResultData = NULL;
+static int InlineResultLength = 0;
+static int InlineResultOffset = 0;
+
+
+static void InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+											TupleDesc inputTupleDescriptor);
+static bool InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void SpillInlineResult(InlineResultDestReceiver *resultDest);
+static void SendTupleStoreToDestReceiver(Tuplestorestate *tupleStore,
+										 TupleDesc tupleDescriptor,
+										 DestReceiver *dest);
+static void InlineResultDestReceiverShutdown(DestReceiver *dest);
+static void InlineResultDestReceiverDestroy(DestReceiver *dest);
+static void RecordInlinedIntermediateResult(char *resultId, StringInfo resultData);
+static InlinedIntermediateResult * FindInlinedIntermediateResult(char *resultId);
+static char * FindInlinedResultCall(char *callStart, char **callEnd);
+static int ReadInlineResultCallback(void *outBuf, int minRead, int maxRead);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(read_inline_intermediate_result);
+
+
+/*
+ * read_inline_intermediate_result returns the records in the given COPY text
+ * formatted data. The record format is given by the column definition list
+ * of the caller, as for read_intermediate_result.
+ */
+Datum
+read_inline_intermediate_result(PG_FUNCTION_ARGS)
+{
+	text *resultData = PG_GETARG_TEXT_PP(0);
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	/* ReadInlineResultCallback cannot take arguments, so we pass the data globally */
+	InlineResultData = VARDATA_ANY(resultData);
+	InlineResultLength = VARSIZE_ANY_EXHDR(resultData);
+	InlineResultOffset = 0;
+
+	ReadCopyDataIntoTupleStore(NULL, ReadInlineResultCallback, "text",
+							   tupleDescriptor, tupleStore);
+
+	InlineResultData = NULL;
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
+/*
+ * ReadInlineResultCallback is the copy callback for read_inline_intermediate_result.
+ */
+static int
+ReadInlineResultCallback(void *outBuf, int minRead, int maxRead)
+{
+	int bytesCopied = Min(InlineResultLength - InlineResultOffset, maxRead);
+
+	memcpy_s(outBuf, maxRead, InlineResultData + InlineResultOffset, bytesCopied);
+	InlineResultOffset += bytesCopied;
+
+	return bytesCopied;
+}
+
+
+/*
+ * CreateInlineResultDestReceiver creates a DestReceiver that inlines the
+ * result with the given ID if it does not exceed
+ * citus.max_inline_intermediate_result_size, and otherwise behaves like the
+ * RemoteFileDestReceiver with the given arguments.
+ */
+DestReceiver *
+CreateInlineResultDestReceiver(char *resultId, EState *executorState,
+							   List *initialNodeList, bool writeLocalFile)
+{
+	InlineResultDestReceiver *resultDest = (InlineResultDestReceiver *) palloc0(
+		sizeof(InlineResultDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	resultDest->pub.receiveSlot = InlineResultDestReceiverReceive;
+	resultDest->pub.rStartup = InlineResultDestReceiverStartup;
+	resultDest->pub.rShutdown = InlineResultDestReceiverShutdown;
+	resultDest->pub.rDestroy = InlineResultDestReceiverDestroy;
+	resultDest->pub.mydest = DestCopyOut;
+
+	/* set up output parameters */
+	resultDest->resultId = resultId;
+	resultDest->executorState = executorState;
+	resultDest->initialNodeList = initialNodeList;
+	resultDest->writeLocalFile = writeLocalFile;
+	resultDest->memoryContext = CurrentMemoryContext;
+
+	return (DestReceiver *) resultDest;
+}
+
+
+/*
+ * InlineResultDestReceiverStartup implements the rStartup interface of
+ * InlineResultDestReceiver.
+ */
+static void
+InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+								TupleDesc inputTupleDescriptor)
+{
+	InlineResultDestReceiver *resultDest = (InlineResultDestReceiver *) dest;
+
+	const char *delimiterCharacter = "\t";
+	const char *nullPrintCharacter = "\\N";
+
+	MemoryContext oldContext = MemoryContextSwitchTo(resultDest->memoryContext);
+
+	resultDest->operation = operation;
+	resultDest->tupleDescriptor = inputTupleDescriptor;
+
+	/* the data ends up in a query string, so it is always in text format */
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) delimiterCharacter;
+	copyOutState->null_print = (char *) nullPrintCharacter;
+	copyOutState->null_print_client = (char *) nullPrintCharacter;
+	copyOutState->binary = false;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = GetPerTupleMemoryContext(resultDest->executorState);
+	resultDest->copyOutState = copyOutState;
+
+	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
+															  copyOutState->binary);
+
+	resultDest->inlineData = makeStringInfo();
+	resultDest->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * InlineResultDestReceiverReceive implements the receiveSlot interface of
+ * InlineResultDestReceiver. It serialises the tuple and keeps it, until the
+ * result grows too large to inline, at which point it passes all tuples on
+ * to the file writer.
+ */
+static bool
+InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	InlineResultDestReceiver *resultDest = (InlineResultDestReceiver *) dest;
+
+	if (resultDest->fileDest != NULL)
+	{
+		return resultDest->fileDest->receiveSlot(slot, resultDest->fileDest);
+	}
+
+	CopyOutState copyOutState = resultDest->copyOutState;
+	StringInfo copyData = copyOutState->fe_msgbuf;
+
+	EState *executorState = resultDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+	slot_getallattrs(slot);
+
+	resetStringInfo(copyData);
+	AppendCopyRowData(slot->tts_values, slot->tts_isnull, resultDest->tupleDescriptor,
+					  copyOutState, resultDest->columnOutputFunctions, NULL);
+
+	MemoryContextSwitchTo(resultDest->memoryContext);
+
+	appendBinaryStringInfo(resultDest->inlineData, copyData->data, copyData->len);
+	tuplestore_puttupleslot(resultDest->tupleStore, slot);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ResetPerTupleExprContext(executorState);
+
+	if (resultDest->inlineData->len > MaxInlineIntermediateResultSize * 1024L)
+	{
+		SpillInlineResult(resultDest);
+	}
+
+	return true;
+}
+
+
+/*
+ * SpillInlineResult sends the tuples received so far to a new
+ * RemoteFileDestReceiver, which receives all subsequent tuples as well.
+ */
+static void
+SpillInlineResult(InlineResultDestReceiver *resultDest)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(resultDest->memoryContext);
+
+	DestReceiver *fileDest = CreateRemoteFileDestReceiver(resultDest->resultId,
+														  resultDest->executorState,
+														  resultDest->initialNodeList,
+														  resultDest->writeLocalFile);
+	fileDest->rStartup(fileDest, resultDest->operation, resultDest->tupleDescriptor);
+
+	SendTupleStoreToDestReceiver(resultDest->tupleStore, resultDest->tupleDescriptor,
+								 fileDest);
+
+	tuplestore_end(resultDest->tupleStore);
+	resultDest->tupleStore = NULL;
+
+	pfree(resultDest->inlineData->data);
+	resultDest->inlineData = NULL;
+
+	resultDest->fileDest = fileDest;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * SendTupleStoreToDestReceiver sends all tuples in the given tuple store to
+ * the given DestReceiver.
+ */
+static void
+SendTupleStoreToDestReceiver(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+							 DestReceiver *dest)
+{
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		dest->receiveSlot(slot, dest);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+
+/*
+ * InlineResultDestReceiverShutdown implements the rShutdown interface of
+ * InlineResultDestReceiver. If the result stayed small enough, it is
+ * recorded for inlining and only written to a local file if the coordinator
+ * needs it.
+ */
+static void
+InlineResultDestReceiverShutdown(DestReceiver *dest)
+{
+	InlineResultDestReceiver *resultDest = (InlineResultDestReceiver *) dest;
+
+	if (resultDest->fileDest != NULL)
+	{
+		resultDest->fileDest->rShutdown(resultDest->fileDest);
+		return;
+	}
+
+	if (resultDest->writeLocalFile)
+	{
+		List *noRemoteNodes = NIL;
+		DestReceiver *localFileDest =
+			CreateRemoteFileDestReceiver(resultDest->resultId,
+										 resultDest->executorState, noRemoteNodes,
+										 resultDest->writeLocalFile);
+
+		localFileDest->rStartup(localFileDest, resultDest->operation,
+								resultDest->tupleDescriptor);
+		SendTupleStoreToDestReceiver(resultDest->tupleStore,
+									 resultDest->tupleDescriptor, localFileDest);
+		localFileDest->rShutdown(localFileDest);
+		localFileDest->rDestroy(localFileDest);
+	}
+
+	RecordInlinedIntermediateResult(resultDest->resultId, resultDest->inlineData);
+
+	ereport(DEBUG1, (errmsg("inlining intermediate result %s into the worker queries",
+							resultDest->resultId)));
+}
+
+
+/*
+ * InlineResultDestReceiverDestroy frees memory allocated as part of the
+ * InlineResultDestReceiver and closes file descriptors.
+ */
+static void
+InlineResultDestReceiverDestroy(DestReceiver *dest)
+{
+	InlineResultDestReceiver *resultDest = (InlineResultDestReceiver *) dest;
+
+	if (resultDest->fileDest != NULL)
+	{
+		resultDest->fileDest->rDestroy(resultDest->fileDest);
+	}
+
+	if (resultDest->tupleStore != NULL)
+	{
+		tuplestore_end(resultDest->tupleStore);
+	}
+
+	pfree(resultDest);
+}
+
+
+/*
+ * RecordInlinedIntermediateResult records that the result with the given ID
+ * consists of the given COPY text data, such that InlineIntermediateResults
+ * replaces reads of the result by the data until the end of the transaction.
+ */
+static void
+RecordInlinedIntermediateResult(char *resultId, StringInfo resultData)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	InlinedIntermediateResult *inlinedResult = FindInlinedIntermediateResult(resultId);
+	if (inlinedResult == NULL)
+	{
+		inlinedResult = palloc0(sizeof(InlinedIntermediateResult));
+		inlinedResult->resultId = pstrdup(resultId);
+
+		InlinedIntermediateResultList = lappend(InlinedIntermediateResultList,
+												inlinedResult);
+	}
+	else
+	{
+		pfree(inlinedResult->functionCall);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	char *resultLiteral = quote_literal_cstr(resultData->data);
+	inlinedResult->functionCall =
+		MemoryContextStrdup(TopTransactionContext,
+							psprintf("read_inline_intermediate_result(%s::text)",
+									 resultLiteral));
+}
+
+
+/*
+ * IntermediateResultIsInlined returns whether the result with the given ID
+ * was inlined rather than written to files.
+ */
+bool
+IntermediateResultIsInlined(char *resultId)
+{
+	return FindInlinedIntermediateResult(resultId) != NULL;
+}
+
+
+/*
+ * ForgetInlinedIntermediateResult stops inlining the result with the given ID,
+ * which is called before the result is created again, since it might then be
+ * written to files instead.
+ */
+void
+ForgetInlinedIntermediateResult(char *resultId)
+{
+	InlinedIntermediateResult *inlinedResult = FindInlinedIntermediateResult(resultId);
+	if (inlinedResult == NULL)
+	{
+		return;
+	}
+
+	InlinedIntermediateResultList = list_delete_ptr(InlinedIntermediateResultList,
+													inlinedResult);
+
+	pfree(inlinedResult->functionCall);
+	pfree(inlinedResult->resultId);
+	pfree(inlinedResult);
+}
+
+
+/*
+ * FindInlinedIntermediateResult returns the inlined result with the given ID,
+ * or NULL if the result was not inlined.
+ */
+static InlinedIntermediateResult *
+FindInlinedIntermediateResult(char *resultId)
+{
+	InlinedIntermediateResult *inlinedResult = NULL;
+	foreach_ptr(inlinedResult, InlinedIntermediateResultList)
+	{
+		if (strcmp(inlinedResult->resultId, resultId) == 0)
+		{
+			return inlinedResult;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * InlineIntermediateResults returns the given query string with all
+ * read_intermediate_result() calls for inlined results replaced by
+ * read_inline_intermediate_result() calls, or the query string itself if
+ * it does not read any inlined results.
+ *
+ * Only calls that appear as deparsed by the planner are replaced. Calls in
+ * query strings that are nested in string literals, such as those of
+ * repartitioning tasks, are not, which is why results are only inlined for
+ * plans without such tasks.
+ */
+char *
+InlineIntermediateResults(char *queryString)
+{
+	if (InlinedIntermediateResultList == NIL)
+	{
+		return queryString;
+	}
+
+	StringInfo inlinedQueryString = NULL;
+	char *copyStart = queryString;
+	char *callStart = strstr(queryString, READ_INTERMEDIATE_RESULT_PREFIX);
+
+	while (callStart != NULL)
+	{
+		char *callEnd = NULL;
+		char *functionCall = FindInlinedResultCall(callStart, &callEnd);
+
+		if (functionCall == NULL)
+		{
+			callStart = strstr(callStart + 1, READ_INTERMEDIATE_RESULT_PREFIX);
+			continue;
+		}
+
+		if (inlinedQueryString == NULL)
+		{
+			inlinedQueryString = makeStringInfo();
+		}
+
+		appendBinaryStringInfo(inlinedQueryString, copyStart, callStart - copyStart);
+		appendStringInfoString(inlinedQueryString, functionCall);
+
+		copyStart = callEnd;
+		callStart = strstr(callEnd, READ_INTERMEDIATE_RESULT_PREFIX);
+	}
+
+	if (inlinedQueryString == NULL)
+	{
+		return queryString;
+	}
+
+	appendStringInfoString(inlinedQueryString, copyStart);
+
+	return inlinedQueryString->data;
+}
+
+
+/*
+ * FindInlinedResultCall returns the call to read_inline_intermediate_result
+ * that replaces the read_intermediate_result call at callStart, and sets
+ * callEnd to the end of that call. It returns NULL if the call does not
+ * read an inlined result.
+ */
+static char *
+FindInlinedResultCall(char *callStart, char **callEnd)
+{
+	char *resultIdStart = callStart + strlen(READ_INTERMEDIATE_RESULT_PREFIX);
+	char *resultIdEnd = strchr(resultIdStart, '\'');
+	if (resultIdEnd == NULL)
+	{
+		return NULL;
+	}
+
+	char *resultId = pnstrdup(resultIdStart, resultIdEnd - resultIdStart);
+	InlinedIntermediateResult *inlinedResult = FindInlinedIntermediateResult(resultId);
+	pfree(resultId);
+
+	if (inlinedResult == NULL)
+	{
+		return NULL;
+	}
+
+	/* the format of the file does not matter for inlined results */
+	const char *formatSuffixes[] = {
+		"'::text, 'binary'::citus_copy_format)",
+		"'::text, 'text'::citus_copy_format)"
+	};
+	int suffixCount = sizeof(formatSuffixes) / sizeof(formatSuffixes[0]);
+
+	for (int suffixIndex = 0; suffixIndex < suffixCount; suffixIndex++)
+	{
+		const char *formatSuffix = formatSuffixes[suffixIndex];
+		int suffixLength = strlen(formatSuffix);
+
+		if (strncmp(resultIdEnd, formatSuffix, suffixLength) == 0)
+		{
+			*callEnd = resultIdEnd + suffixLength;
+			return inlinedResult->functionCall;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ResetInlinedIntermediateResults forgets the inlined results at the end of
+ * the transaction.
+ */
+void
+ResetInlinedIntermediateResults(void)
+{
+	/* the entries are allocated in TopTransactionContext */
+	InlinedIntermediateResultList = NIL;
+}
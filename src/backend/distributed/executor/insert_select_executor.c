@@ -41,6 +41,7 @@
 #include "nodes/parsenodes.h"
 #include "nodes/plannodes.h"
 #include "parser/parse_coerce.h"
+#include "parser/parse_oper.h"
 #include "parser/parse_relation.h"
 #include "parser/parsetree.h"
 #include "tcop/pquery.h"
@@ -52,6 +53,7 @@
 
 /* Config variables managed via guc.c */
 bool EnableRepartitionedInsertSelect = true;
+bool SortInsertSelectUpserts = false;
 
 /* depth of current insert/select executor. */
 static int insertSelectExecutorLevel = 0;
@@ -78,6 +80,8 @@ static List * RedistributedInsertSelectTaskList(Query *insertSelectQuery,
 												List **redistributedResults,
 												bool useBinaryFormat);
 static int PartitionColumnIndex(List *insertTargetList, Var *partitionColumn);
+static void SortResultQueryOnConflictTarget(Query *resultQuery,
+											Query *insertSelectQuery);
 static Expr * CastExpr(Expr *expr, Oid sourceType, Oid targetType, Oid targetCollation,
 					   int targetTypeMod);
 static void WrapTaskListForProjection(List *taskList, List *projectedTargetEntries);
@@ -195,7 +199,9 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 			bool binaryFormat =
 				CanUseBinaryCopyFormatForTargetList(selectQuery->targetList);
 
-			ExecuteSubPlans(distSelectPlan);
+			/* the select tasks are wrapped in worker_partition_query_result calls */
+			bool allowInlining = false;
+			ExecuteSubPlans(distSelectPlan, allowInlining);
 
 			/*
 			 * We have a separate directory for each transaction, so choosing
@@ -242,6 +248,9 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 						cachedTargetRelation->sortedShardIntervalArray[shardIndex]);
 			}
 
+			/* do not point into the cache entry, which may be freed meanwhile */
+			BuildSortedShardBoundArrays(targetRelation);
+
 			int partitionColumnIndex =
 				PartitionColumnIndex(insertTargetList, targetRelation->partitionColumn);
 			if (partitionColumnIndex == -1)
@@ -525,6 +534,11 @@ TwoPhaseInsertSelectTaskList(Oid targetRelationId, Query *insertSelectQuery,
 														   columnAliasList,
 														   resultId->data);
 
+		if (SortInsertSelectUpserts)
+		{
+			SortResultQueryOnConflictTarget(resultSelectQuery, insertSelectQuery);
+		}
+
 		/* put the intermediate result query in the INSERT..SELECT */
 		selectRte->subquery = resultSelectQuery;
 
@@ -916,7 +930,18 @@ IsSupportedRedistributionTarget(Oid targetRelationId)
 {
 	CitusTableCacheEntry *tableEntry = GetCitusTableCacheEntry(targetRelationId);
 
-	/* only range and hash-distributed tables are currently supported */
+	/*
+	 * Shards of append-distributed tables are partitioned into by their
+	 * min/max values like range-distributed ones, which only works when
+	 * those do not overlap.
+	 */
+	if (tableEntry->partitionMethod == DISTRIBUTE_BY_APPEND)
+	{
+		return tableEntry->shardIntervalArrayLength > 0 &&
+			   !tableEntry->hasOverlappingShardInterval;
+	}
+
+	/* otherwise, only range and hash-distributed tables are currently supported */
 	if (tableEntry->partitionMethod != DISTRIBUTE_BY_HASH &&
 		tableEntry->partitionMethod != DISTRIBUTE_BY_RANGE)
 	{
@@ -981,6 +1006,11 @@ RedistributedInsertSelectTaskList(Query *insertSelectQuery,
 																		 sortedResultIds,
 																		 useBinaryFormat);
 
+		if (SortInsertSelectUpserts)
+		{
+			SortResultQueryOnConflictTarget(fragmentSetQuery, insertSelectQuery);
+		}
+
 		/* put the intermediate result query in the INSERT..SELECT */
 		selectRte->subquery = fragmentSetQuery;
 
@@ -1027,6 +1057,83 @@ RedistributedInsertSelectTaskList(Query *insertSelectQuery,
 }
 
 
+/*
+ * SortResultQueryOnConflictTarget adds an ORDER BY on the conflict target
+ * columns to the given query on intermediate results, such that the upserts
+ * of an INSERT .. SELECT .. ON CONFLICT (..) walk the arbiter index in key
+ * order rather than probing it at random for every row. The query is left
+ * unordered when the INSERT has no inferred conflict target, or when one of
+ * the target elements is not a plain column with a sort operator.
+ */
+static void
+SortResultQueryOnConflictTarget(Query *resultQuery, Query *insertSelectQuery)
+{
+	OnConflictExpr *onConflict = insertSelectQuery->onConflict;
+	List *sortClauseList = NIL;
+	Index sortGroupRef = 1;
+
+	if (onConflict == NULL || onConflict->arbiterElems == NIL)
+	{
+		return;
+	}
+
+	InferenceElem *inferenceElem = NULL;
+	foreach_ptr(inferenceElem, onConflict->arbiterElems)
+	{
+		Oid sortop = InvalidOid;
+		Oid eqop = InvalidOid;
+		bool hashable = false;
+
+		if (!IsA(inferenceElem->expr, Var))
+		{
+			return;
+		}
+
+		/* find the column of the result query that is inserted into the column */
+		AttrNumber targetColumn = ((Var *) inferenceElem->expr)->varattno;
+		TargetEntry *insertTargetEntry = get_tle_by_resno(insertSelectQuery->targetList,
+														  targetColumn);
+		if (insertTargetEntry == NULL || !IsA(insertTargetEntry->expr, Var))
+		{
+			return;
+		}
+
+		AttrNumber resultColumn = ((Var *) insertTargetEntry->expr)->varattno;
+		TargetEntry *resultTargetEntry = get_tle_by_resno(resultQuery->targetList,
+														  resultColumn);
+		if (resultTargetEntry == NULL)
+		{
+			return;
+		}
+
+		get_sort_group_operators(exprType((Node *) resultTargetEntry->expr),
+								 false, true, false,
+								 &sortop, &eqop, NULL,
+								 &hashable);
+		if (!OidIsValid(sortop))
+		{
+			return;
+		}
+
+		if (resultTargetEntry->ressortgroupref == 0)
+		{
+			resultTargetEntry->ressortgroupref = sortGroupRef++;
+		}
+
+		SortGroupClause *sortClause = makeNode(SortGroupClause);
+		sortClause->tleSortGroupRef = resultTargetEntry->ressortgroupref;
+		sortClause->eqop = eqop;
+		sortClause->sortop = sortop;
+		sortClause->nulls_first = false;
+		sortClause->hashable = hashable;
+
+		sortClauseList = lappend(sortClauseList, sortClause);
+	}
+
+	resultQuery->sortClause = sortClauseList;
+}
+
+
 /*
  * PartitionColumnIndex finds the index of given partition column in the
  * given target list.
@@ -0,0 +1,549 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.c
+ *    Custom scan that reads the records of intermediate result files as
+ *    the query asks for them.
+ *
+ * read_intermediate_result() and read_intermediate_results() are set
+ * returning functions, and a function scan stores all records returned by
+ * a set returning function in a tuple store before returning the first one.
+ * For a large result that means every record is parsed and written to a
+ * temporary file before the query sees it, even when the query only needs
+ * a few of them. When the result ids and format of the call are constants,
+ * which is the case for the queries that Citus sends to read the results
+ * of subplans, the function scan can be replaced by an intermediate result
+ * scan that parses the next record from the result files each time the
+ * query asks for one. For columnar results, the scan also passes the
+ * columns it needs and its quals to the reader, which skips the other
+ * columns and the blocks whose rows cannot pass the quals.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "catalog/pg_type.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "executor/executor.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/restrictinfo.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/var.h"
+#endif
+#include "parser/parsetree.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+/*
+ * IntermediateResultScanState is the execution state of an intermediate
+ * result scan, which reads the results one after the other.
+ */
+typedef struct IntermediateResultScanState
+{
+	CustomScanState customScanState;
+
+	/* list of result ids (as String values) and the COPY format of the results */
+	List *resultIdList;
+	char *copyFormat;
+
+	/* columns used by the query, and quals used to skip blocks of columnar results */
+	Bitmapset *projectedColumns;
+	List *whereClauseList;
+
+	/* index of the next result to read and the reader of the current one */
+	int nextResultIndex;
+	IntermediateResultReader *resultReader;
+} IntermediateResultScanState;
+
+
+/* config variable managed via guc.c */
+bool EnableIntermediateResultScan = false;
+
+
+static bool IntermediateResultScanSupported(PlannerInfo *root, RelOptInfo *relOptInfo,
+											RangeTblEntry *rangeTableEntry);
+static List * ConstResultIdList(FuncExpr *funcExpression);
+static List * ProjectedColumnList(RelOptInfo *relOptInfo);
+static Plan * PlanIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *rel,
+											 struct CustomPath *bestPath, List *tlist,
+											 List *clauses, List *customPlans);
+static List * IntermediateResultScanTargetList(RelOptInfo *rel,
+											   RangeTblFunction *rangeTableFunction);
+static Node * IntermediateResultCreateScan(CustomScan *scan);
+static void IntermediateResultBeginScan(CustomScanState *node, EState *estate,
+										int eflags);
+static TupleTableSlot * IntermediateResultExecScan(CustomScanState *node);
+static TupleTableSlot * IntermediateResultScanNext(ScanState *node);
+static bool IntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot);
+static void IntermediateResultEndScan(CustomScanState *node);
+static void IntermediateResultReScan(CustomScanState *node);
+
+
+static CustomPathMethods IntermediateResultScanPathMethods = {
+	.CustomName = "IntermediateResultScanPath",
+	.PlanCustomPath = PlanIntermediateResultScanPath,
+};
+
+CustomScanMethods IntermediateResultScanMethods = {
+	"Citus Intermediate Result",
+	IntermediateResultCreateScan
+};
+
+static CustomExecMethods IntermediateResultScanExecMethods = {
+	.CustomName = "IntermediateResultScan",
+	.BeginCustomScan = IntermediateResultBeginScan,
+	.ExecCustomScan = IntermediateResultExecScan,
+	.EndCustomScan = IntermediateResultEndScan,
+	.ReScanCustomScan = IntermediateResultReScan
+};
+
+
+/*
+ * AddIntermediateResultScanPath replaces the function scan path of a
+ * read_intermediate_result(s) call with constant arguments by an
+ * intermediate result scan path. It is called from the set_rel_pathlist
+ * hook after the cost of the function scan was adjusted to the size of
+ * the result files.
+ */
+void
+AddIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+							  RangeTblEntry *rangeTableEntry)
+{
+	if (!IntermediateResultScanSupported(root, relOptInfo, rangeTableEntry))
+	{
+		return;
+	}
+
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	Const *resultFormatConst = (Const *) lsecond(funcExpression->args);
+
+	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out,
+													 resultFormatConst->constvalue);
+	char *copyFormatLabel = DatumGetCString(copyFormatLabelDatum);
+
+	Path *functionScanPath = (Path *) linitial(relOptInfo->pathlist);
+
+	CustomPath *path = makeNode(CustomPath);
+	path->path.pathtype = T_CustomScan;
+	path->path.parent = relOptInfo;
+	path->path.pathtarget = relOptInfo->reltarget;
+	path->path.rows = functionScanPath->rows;
+
+	/* the records are parsed as they are read, but none before the first */
+	path->path.startup_cost = relOptInfo->baserestrictcost.startup;
+	path->path.total_cost = functionScanPath->total_cost;
+
+	path->methods = &IntermediateResultScanPathMethods;
+	path->custom_private = list_make3(ConstResultIdList(funcExpression),
+									  makeString(copyFormatLabel),
+									  ProjectedColumnList(relOptInfo));
+
+	/* replace the function scan, the scan reads the same records */
+	relOptInfo->pathlist = list_make1(path);
+}
+
+
+/*
+ * IntermediateResultScanSupported returns whether the given range table entry
+ * is a read_intermediate_result(s) call that an intermediate result scan can
+ * replace.
+ */
+static bool
+IntermediateResultScanSupported(PlannerInfo *root, RelOptInfo *relOptInfo,
+								RangeTblEntry *rangeTableEntry)
+{
+	if (rangeTableEntry->rtekind != RTE_FUNCTION ||
+		list_length(rangeTableEntry->functions) != 1 ||
+		rangeTableEntry->funcordinality)
+	{
+		return false;
+	}
+
+	if (!CitusHasBeenLoaded() || !CheckCitusVersion(DEBUG5))
+	{
+		/* read_intermediate_result may not exist */
+		return false;
+	}
+
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	if (!IsA(rangeTableFunction->funcexpr, FuncExpr) ||
+		rangeTableFunction->funccoltypes == NIL)
+	{
+		return false;
+	}
+
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	if (funcExpression->funcid != CitusReadIntermediateResultFuncId() &&
+		funcExpression->funcid != CitusReadIntermediateResultArrayFuncId())
+	{
+		return false;
+	}
+
+	Const *resultIdConst = (Const *) linitial(funcExpression->args);
+	Const *resultFormatConst = (Const *) lsecond(funcExpression->args);
+	if (!IsA(resultIdConst, Const) || resultIdConst->constisnull ||
+		!IsA(resultFormatConst, Const) || resultFormatConst->constisnull)
+	{
+		return false;
+	}
+
+	if (!bms_is_empty(relOptInfo->lateral_relids) || relOptInfo->pathlist == NIL)
+	{
+		return false;
+	}
+
+	/*
+	 * The scan only returns the columns of the records, so whole-row references
+	 * and expressions that need to be computed at the scan are left to the
+	 * function scan.
+	 */
+	Node *expression = NULL;
+	foreach_ptr(expression, relOptInfo->reltarget->exprs)
+	{
+		if (!IsA(expression, Var) || ((Var *) expression)->varattno <= 0)
+		{
+			return false;
+		}
+	}
+
+	RestrictInfo *restrictInfo = NULL;
+	foreach_ptr(restrictInfo, relOptInfo->baserestrictinfo)
+	{
+		List *varList = pull_var_clause((Node *) restrictInfo->clause,
+										PVC_RECURSE_PLACEHOLDERS);
+
+		Var *column = NULL;
+		foreach_ptr(column, varList)
+		{
+			if (column->varattno <= 0)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ConstResultIdList returns the result ids passed to the given
+ * read_intermediate_result(s) call as a list of String values.
+ */
+static List *
+ConstResultIdList(FuncExpr *funcExpression)
+{
+	Const *resultIdConst = (Const *) linitial(funcExpression->args);
+	List *resultIdList = NIL;
+
+	if (funcExpression->funcid == CitusReadIntermediateResultFuncId())
+	{
+		char *resultId = TextDatumGetCString(resultIdConst->constvalue);
+
+		return list_make1(makeString(resultId));
+	}
+
+	Datum *resultIdArray = NULL;
+	int resultIdCount = 0;
+
+	deconstruct_array(DatumGetArrayTypeP(resultIdConst->constvalue), TEXTOID, -1,
+					  false, 'i', &resultIdArray, NULL, &resultIdCount);
+
+	for (int resultIndex = 0; resultIndex < resultIdCount; resultIndex++)
+	{
+		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+
+		resultIdList = lappend(resultIdList, makeString(resultId));
+	}
+
+	return resultIdList;
+}
+
+
+/*
+ * ProjectedColumnList returns the attribute numbers of the columns of the
+ * relation that are used above the scan or in the quals of the scan.
+ */
+static List *
+ProjectedColumnList(RelOptInfo *relOptInfo)
+{
+	Bitmapset *projectedColumns = NULL;
+	List *projectedColumnList = NIL;
+	int attributeNumber = -1;
+
+	List *columnList = list_copy(relOptInfo->reltarget->exprs);
+
+	RestrictInfo *restrictInfo = NULL;
+	foreach_ptr(restrictInfo, relOptInfo->baserestrictinfo)
+	{
+		columnList = list_concat(columnList,
+								 pull_var_clause((Node *) restrictInfo->clause,
+												 PVC_RECURSE_PLACEHOLDERS));
+	}
+
+	Var *column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		projectedColumns = bms_add_member(projectedColumns, column->varattno);
+	}
+
+	while ((attributeNumber = bms_next_member(projectedColumns, attributeNumber)) >= 0)
+	{
+		projectedColumnList = lappend_int(projectedColumnList, attributeNumber);
+	}
+
+	return projectedColumnList;
+}
+
+
+/*
+ * PlanIntermediateResultScanPath creates the CustomScan plan of an
+ * intermediate result scan path.
+ *
+ * A function range table entry cannot be opened as a relation, so the scan
+ * does not set scanrelid. Instead, custom_scan_tlist describes the records
+ * of the results and the target list and quals are made to refer to it when
+ * the plan references are set. A copy of the quals that still refers to the
+ * function range table entry is kept in custom_private for the reader of
+ * columnar results.
+ */
+static Plan *
+PlanIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *rel,
+							   struct CustomPath *bestPath, List *tlist,
+							   List *clauses, List *customPlans)
+{
+	RangeTblEntry *rangeTableEntry = planner_rt_fetch(rel->relid, root);
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+
+	List *qualList = extract_actual_clauses(clauses, false);
+	List *whereClauseList = NIL;
+
+	Node *qual = NULL;
+	foreach_ptr(qual, qualList)
+	{
+		if (!contain_subplans(qual) && !contain_volatile_functions(qual))
+		{
+			whereClauseList = lappend(whereClauseList, copyObject(qual));
+		}
+	}
+
+	CustomScan *customScan = makeNode(CustomScan);
+	customScan->methods = &IntermediateResultScanMethods;
+	customScan->scan.plan.targetlist = tlist;
+	customScan->scan.plan.qual = qualList;
+	customScan->scan.scanrelid = 0;
+	customScan->custom_scan_tlist = IntermediateResultScanTargetList(rel,
+																	 rangeTableFunction);
+	customScan->custom_relids = bms_copy(rel->relids);
+	customScan->custom_private = lappend(list_copy(bestPath->custom_private),
+										 whereClauseList);
+
+	return (Plan *) customScan;
+}
+
+
+/*
+ * IntermediateResultScanTargetList returns a target list with a column of the
+ * given relation for each column of the records returned by the function.
+ */
+static List *
+IntermediateResultScanTargetList(RelOptInfo *rel, RangeTblFunction *rangeTableFunction)
+{
+	List *targetList = NIL;
+	int columnCount = list_length(rangeTableFunction->funccoltypes);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		AttrNumber attributeNumber = columnIndex + 1;
+		Var *column = makeVar(rel->relid, attributeNumber,
+							  list_nth_oid(rangeTableFunction->funccoltypes,
+										   columnIndex),
+							  list_nth_int(rangeTableFunction->funccoltypmods,
+										   columnIndex),
+							  list_nth_oid(rangeTableFunction->funccolcollations,
+										   columnIndex),
+							  0);
+
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) column, attributeNumber,
+												   NULL, false);
+
+		targetList = lappend(targetList, targetEntry);
+	}
+
+	return targetList;
+}
+
+
+/*
+ * IntermediateResultCreateScan creates the scan state of an intermediate
+ * result scan.
+ */
+static Node *
+IntermediateResultCreateScan(CustomScan *scan)
+{
+	IntermediateResultScanState *scanState =
+		palloc0(sizeof(IntermediateResultScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &IntermediateResultScanExecMethods;
+
+	scanState->resultIdList = (List *) linitial(scan->custom_private);
+	scanState->copyFormat = strVal(lsecond(scan->custom_private));
+	scanState->whereClauseList = (List *) lfourth(scan->custom_private);
+
+	int attributeNumber = 0;
+	foreach_int(attributeNumber, (List *) lthird(scan->custom_private))
+	{
+		scanState->projectedColumns = bms_add_member(scanState->projectedColumns,
+													 attributeNumber);
+	}
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * IntermediateResultBeginScan does nothing, the first result is opened when
+ * the first record is read.
+ */
+static void
+IntermediateResultBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	/* this comment is for indentation consistency */
+}
+
+
+/*
+ * IntermediateResultExecScan returns the next record of the results that
+ * passes the quals of the scan.
+ */
+static TupleTableSlot *
+IntermediateResultExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, (ExecScanAccessMtd) IntermediateResultScanNext,
+					(ExecScanRecheckMtd) IntermediateResultScanRecheck);
+}
+
+
+/*
+ * IntermediateResultScanNext reads the next record of the results into the
+ * scan tuple slot, opening the next result when the current one is exhausted.
+ * It returns an empty slot after the last record.
+ */
+static TupleTableSlot *
+IntermediateResultScanNext(ScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	TupleTableSlot *scanSlot = node->ss_ScanTupleSlot;
+	ExprContext *expressionContext = node->ps.ps_ExprContext;
+	EState *executorState = node->ps.state;
+
+	ExecClearTuple(scanSlot);
+
+	while (true)
+	{
+		if (scanState->resultReader == NULL)
+		{
+			if (scanState->nextResultIndex >= list_length(scanState->resultIdList))
+			{
+				return scanSlot;
+			}
+
+			char *resultId = strVal(list_nth(scanState->resultIdList,
+											 scanState->nextResultIndex));
+			scanState->nextResultIndex++;
+
+			/* the reader is used across records, and may be NULL for missing files */
+			MemoryContext oldContext =
+				MemoryContextSwitchTo(executorState->es_query_cxt);
+
+			scanState->resultReader =
+				BeginIntermediateResultRead(resultId, scanState->copyFormat,
+											scanSlot->tts_tupleDescriptor,
+											scanState->projectedColumns,
+											scanState->whereClauseList);
+
+			MemoryContextSwitchTo(oldContext);
+
+			continue;
+		}
+
+		/* the values of the record live until ExecScan resets the context */
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(expressionContext->ecxt_per_tuple_memory);
+
+		bool nextRowFound = ReadNextIntermediateResultRow(scanState->resultReader,
+														  expressionContext,
+														  scanSlot->tts_values,
+														  scanSlot->tts_isnull);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (nextRowFound)
+		{
+			ExecStoreVirtualTuple(scanSlot);
+			return scanSlot;
+		}
+
+		EndIntermediateResultRead(scanState->resultReader);
+		scanState->resultReader = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultScanRecheck is never called since the scan does not
+ * take part in EvalPlanQual rechecks of locked rows.
+ */
+static bool
+IntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * IntermediateResultEndScan closes the result that is currently being read.
+ */
+static void
+IntermediateResultEndScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	if (scanState->resultReader != NULL)
+	{
+		EndIntermediateResultRead(scanState->resultReader);
+		scanState->resultReader = NULL;
+	}
+}
+
+
+/*
+ * IntermediateResultReScan restarts the scan from the first record of the
+ * first result.
+ */
+static void
+IntermediateResultReScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	IntermediateResultEndScan(node);
+	scanState->nextResultIndex = 0;
+
+	ExecScanReScan(&node->ss);
+}
@@ -16,11 +16,16 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include "access/hash.h"
 #include "catalog/pg_enum.h"
 #include "commands/copy.h"
+#include "common/pg_lzcompress.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/columnar_intermediate_results.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/error_codes.h"
+#include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
@@ -36,16 +41,88 @@
 #include "nodes/makefuncs.h"
 #include "nodes/parsenodes.h"
 #include "nodes/primnodes.h"
+#include "port/pg_bswap.h"
+#include "storage/copydir.h"
 #include "storage/fd.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
+#include "utils/varlena.h"
 
 
 static bool CreatedResultsDirectory = false;
 
+/* GUC, whether to compress intermediate results that we broadcast */
+bool CompressIntermediateResults = false;
+
+/* GUC, scratch directories across which result files are striped */
+char *IntermediateResultDirectories = "";
+
+/* job cache directories in which results are stored, see JobCacheDirectoryList */
+static List *ResultJobCacheDirectoryList = NIL;
+
+/*
+ * Compressed intermediate results start with a signature that cannot occur at
+ * the start of a text, csv or binary COPY stream, since it contains a NUL byte
+ * and does not start with the binary COPY signature. This allows readers to
+ * handle compressed and uncompressed result files alike.
+ */
+static const char CompressedResultSignature[12] = "CITUSPGLZ\n\377";
+
+/*
+ * Compressed intermediate results consist of blocks of at most
+ * COMPRESSED_RESULT_BLOCK_SIZE bytes of COPY data. Each block is preceded by a
+ * header holding the raw length and the compressed length of the block in
+ * network byte order. A compressed length of 0 means that the block did not
+ * compress well and is stored as is.
+ */
+#define COMPRESSED_RESULT_BLOCK_SIZE (64 * 1024)
+#define COMPRESSED_RESULT_BLOCK_HEADER_SIZE (2 * sizeof(uint32))
+
+
+/*
+ * CompressedResultReader holds the state for decompressing a result file while
+ * COPY reads from it.
+ */
+typedef struct CompressedResultReader
+{
+	char *fileName;
+	FileCompat fileCompat;
+
+	/* decompressed data of the current block, and how much of it was consumed */
+	StringInfo rawBlock;
+	int rawBlockOffset;
+
+	/* compressed data of the current block */
+	StringInfo compressedBlock;
+} CompressedResultReader;
+
+
+/*
+ * IntermediateResultReader holds the state for reading the records of an
+ * intermediate result file one at a time.
+ */
+struct IntermediateResultReader
+{
+	/* NULL if the result file is in COPY format */
+	ColumnarResultReader *columnarReader;
+
+	CopyState copyState;
+
+	/* NULL if the result file is not compressed */
+	CompressedResultReader *compressedReader;
+};
+
+
+/*
+ * CurrentCompressedResultReader is used in the copy callback to read from a
+ * compressed result file. The reason this is a global variable is that we
+ * cannot pass an additional argument to the copy callback.
+ */
+static CompressedResultReader *CurrentCompressedResultReader = NULL;
+
 
 /* CopyDestReceiver can be used to stream results into a distributed table */
 typedef struct RemoteFileDestReceiver
@@ -76,6 +153,14 @@ typedef struct RemoteFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* writer of the blocks of a columnar result, or NULL for COPY data */
+	ColumnarResultWriter *columnarWriter;
+
+	/* whether to compress the results, and the COPY data not compressed yet */
+	bool compressResults;
+	StringInfo uncompressedData;
+	StringInfo compressedBlock;
+
 	/* number of tuples sent */
 	uint64 tuplesSent;
 } RemoteFileDestReceiver;
@@ -90,15 +175,34 @@ static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *de
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
 static void SendCopyDataOverConnection(StringInfo dataBuffer,
 									   MultiConnection *connection);
+static void EmitResultData(RemoteFileDestReceiver *resultDest, StringInfo copyData);
+static void ForwardResultData(RemoteFileDestReceiver *resultDest, StringInfo data);
+static void FlushCompressedResultBlocks(RemoteFileDestReceiver *resultDest,
+										bool flushAll);
 static void RemoteFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void RemoteFileDestReceiverDestroy(DestReceiver *destReceiver);
 
-static char * IntermediateResultsDirectory(void);
+static List * JobCacheDirectoryList(void);
+static char * IntermediateResultsDirectory(const char *jobCacheDirectory);
 static void ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo,
 												  char *copyFormat,
 												  Datum *resultIdArray,
 												  int resultCount);
+static void ReportMissingResultFile(char *resultId);
+static bool ReadColumnarFileIntoTupleStore(char *fileName, TupleDesc tupleDescriptor,
+										   Tuplestorestate *tupleStore);
+static bool ReadCompressedFileIntoTupleStore(char *fileName, char *copyFormat,
+											 TupleDesc tupleDescriptor,
+											 Tuplestorestate *tupleStore);
+static CompressedResultReader * OpenCompressedResultReader(char *fileName);
+static void CloseCompressedResultReader(CompressedResultReader *reader);
+static int ReadCompressedResultCallback(void *outBuf, int minRead, int maxRead);
+static bool ReadNextCompressedResultBlock(CompressedResultReader *reader);
+static void ReadFromResultFile(CompressedResultReader *reader, char *buffer,
+							   int length);
 static uint64 FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId);
+static void LinkLocalIntermediateResult(const char *sourceResultId,
+										const char *targetResultId);
 static CopyStatus CopyDataFromConnection(MultiConnection *connection,
 										 FileCompat *fileCompat,
 										 uint64 *bytesReceived);
@@ -109,6 +213,7 @@ PG_FUNCTION_INFO_V1(read_intermediate_result_array);
 PG_FUNCTION_INFO_V1(broadcast_intermediate_result);
 PG_FUNCTION_INFO_V1(create_intermediate_result);
 PG_FUNCTION_INFO_V1(fetch_intermediate_results);
+PG_FUNCTION_INFO_V1(link_intermediate_result);
 
 
 /*
@@ -252,6 +357,25 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
+
+	if (ColumnarIntermediateResults && CanUseColumnarResultFormat(inputTupleDescriptor))
+	{
+		resultDest->columnarWriter = CreateColumnarResultWriter(inputTupleDescriptor);
+	}
+
+	/* columnar results are not compressed */
+	resultDest->compressResults = CompressIntermediateResults &&
+								  resultDest->columnarWriter == NULL;
+	if (resultDest->compressResults)
+	{
+		resultDest->uncompressedData = makeStringInfo();
+		enlargeStringInfo(resultDest->uncompressedData, COMPRESSED_RESULT_BLOCK_SIZE);
+
+		resultDest->compressedBlock = makeStringInfo();
+		enlargeStringInfo(resultDest->compressedBlock,
+						  COMPRESSED_RESULT_BLOCK_HEADER_SIZE +
+						  PGLZ_MAX_OUTPUT(COMPRESSED_RESULT_BLOCK_SIZE));
+	}
 }
 
 
@@ -328,20 +452,37 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 		PQclear(result);
 	}
 
+	resultDest->connectionList = connectionList;
+
+	if (resultDest->columnarWriter != NULL)
+	{
+		/* mark the result as columnar, readers detect this on their own */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendColumnarResultHeader(resultDest->columnarWriter, copyOutState->fe_msgbuf);
+		ForwardResultData(resultDest, copyOutState->fe_msgbuf);
+		return;
+	}
+
+	if (resultDest->compressResults)
+	{
+		/* mark the result as compressed, readers detect this on their own */
+		StringInfoData signature;
+
+		initStringInfo(&signature);
+		appendBinaryStringInfo(&signature, CompressedResultSignature,
+							   sizeof(CompressedResultSignature));
+		ForwardResultData(resultDest, &signature);
+
+		pfree(signature.data);
+	}
+
 	if (copyOutState->binary)
 	{
 		/* send headers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryHeaders(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
-
-		if (resultDest->writeLocalFile)
-		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
-		}
+		EmitResultData(resultDest, copyOutState->fe_msgbuf);
 	}
-
-	resultDest->connectionList = connectionList;
 }
 
 
@@ -382,7 +523,6 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	TupleDesc tupleDescriptor = resultDest->tupleDescriptor;
 
-	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = resultDest->columnOutputFunctions;
 
@@ -399,17 +539,25 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	resetStringInfo(copyData);
 
-	/* construct row in COPY format */
-	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-					  copyOutState, columnOutputFunctions, NULL);
-
-	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
-
-	/* write to local file (if applicable) */
-	if (resultDest->writeLocalFile)
+	if (resultDest->columnarWriter != NULL)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		/* add row to the current block, and send the block once it is full */
+		bool blockFull = AppendColumnarResultRow(resultDest->columnarWriter,
+												 columnValues, columnNulls);
+		if (blockFull)
+		{
+			FlushColumnarResultBlock(resultDest->columnarWriter, copyData);
+			ForwardResultData(resultDest, copyData);
+		}
+	}
+	else
+	{
+		/* construct row in COPY format */
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, NULL);
+
+		/* send row to nodes and write to local file (if applicable) */
+		EmitResultData(resultDest, copyData);
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -430,7 +578,7 @@ WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat)
 {
 	int bytesWritten = FileWriteCompat(fileCompat, copyData->data,
 									   copyData->len,
-									   PG_WAIT_IO);
+									   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_WRITE);
 	if (bytesWritten < 0)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
@@ -463,18 +611,31 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 
-	if (copyOutState->binary)
+	if (resultDest->columnarWriter != NULL)
 	{
-		/* send footers when using binary encoding */
+		/* send the last block */
 		resetStringInfo(copyOutState->fe_msgbuf);
-		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		FlushColumnarResultBlock(resultDest->columnarWriter, copyOutState->fe_msgbuf);
 
-		if (resultDest->writeLocalFile)
+		if (copyOutState->fe_msgbuf->len > 0)
 		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			ForwardResultData(resultDest, copyOutState->fe_msgbuf);
 		}
 	}
+	else if (copyOutState->binary)
+	{
+		/* send footers when using binary encoding */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendCopyBinaryFooters(copyOutState);
+		EmitResultData(resultDest, copyOutState->fe_msgbuf);
+	}
+
+	if (resultDest->compressResults)
+	{
+		/* compress and send whatever is left */
+		bool flushAll = true;
+		FlushCompressedResultBlocks(resultDest, flushAll);
+	}
 
 	/* close the COPY input */
 	EndRemoteCopy(0, connectionList);
@@ -486,6 +647,108 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 }
 
 
+/*
+ * EmitResultData sends COPY data to the nodes and writes it to the local file
+ * (if applicable). When compressing results, the data is buffered until a
+ * full block can be compressed.
+ */
+static void
+EmitResultData(RemoteFileDestReceiver *resultDest, StringInfo copyData)
+{
+	if (!resultDest->compressResults)
+	{
+		ForwardResultData(resultDest, copyData);
+		return;
+	}
+
+	appendBinaryStringInfo(resultDest->uncompressedData, copyData->data,
+						   copyData->len);
+
+	if (resultDest->uncompressedData->len >= COMPRESSED_RESULT_BLOCK_SIZE)
+	{
+		bool flushAll = false;
+		FlushCompressedResultBlocks(resultDest, flushAll);
+	}
+}
+
+
+/*
+ * ForwardResultData sends the given bytes as is to the nodes and writes them
+ * to the local file (if applicable).
+ */
+static void
+ForwardResultData(RemoteFileDestReceiver *resultDest, StringInfo data)
+{
+	BroadcastCopyData(data, resultDest->connectionList);
+
+	if (resultDest->writeLocalFile)
+	{
+		WriteToLocalFile(data, &resultDest->fileCompat);
+	}
+}
+
+
+/*
+ * FlushCompressedResultBlocks compresses the buffered COPY data in blocks of
+ * COMPRESSED_RESULT_BLOCK_SIZE bytes and forwards the blocks. A trailing
+ * partial block is kept in the buffer, unless flushAll is set.
+ */
+static void
+FlushCompressedResultBlocks(RemoteFileDestReceiver *resultDest, bool flushAll)
+{
+	StringInfo uncompressedData = resultDest->uncompressedData;
+	StringInfo compressedBlock = resultDest->compressedBlock;
+	int dataOffset = 0;
+
+	while (uncompressedData->len - dataOffset >= COMPRESSED_RESULT_BLOCK_SIZE ||
+		   (flushAll && uncompressedData->len > dataOffset))
+	{
+		char *rawData = uncompressedData->data + dataOffset;
+		int32 rawLength = Min(uncompressedData->len - dataOffset,
+							  COMPRESSED_RESULT_BLOCK_SIZE);
+		char *compressedData = compressedBlock->data +
+							   COMPRESSED_RESULT_BLOCK_HEADER_SIZE;
+
+		int32 compressedLength = pglz_compress(rawData, rawLength, compressedData,
+											   PGLZ_strategy_default);
+		if (compressedLength < 0)
+		{
+			/* data did not compress well, store it as is */
+			memcpy_s(compressedData, PGLZ_MAX_OUTPUT(COMPRESSED_RESULT_BLOCK_SIZE),
+					 rawData, rawLength);
+			compressedBlock->len = COMPRESSED_RESULT_BLOCK_HEADER_SIZE + rawLength;
+			compressedLength = 0;
+		}
+		else
+		{
+			compressedBlock->len = COMPRESSED_RESULT_BLOCK_HEADER_SIZE +
+								   compressedLength;
+		}
+
+		uint32 blockHeader[2];
+		blockHeader[0] = pg_hton32((uint32) rawLength);
+		blockHeader[1] = pg_hton32((uint32) compressedLength);
+		memcpy_s(compressedBlock->data, COMPRESSED_RESULT_BLOCK_HEADER_SIZE,
+				 blockHeader, COMPRESSED_RESULT_BLOCK_HEADER_SIZE);
+
+		ForwardResultData(resultDest, compressedBlock);
+
+		dataOffset += rawLength;
+	}
+
+	/* keep the partial block at the start of the buffer */
+	int remainingLength = uncompressedData->len - dataOffset;
+	if (dataOffset > 0 && remainingLength > 0)
+	{
+		memmove_s(uncompressedData->data, uncompressedData->maxlen,
+				  uncompressedData->data + dataOffset, remainingLength);
+	}
+
+	uncompressedData->len = remainingLength;
+	uncompressedData->data[remainingLength] = '\0';
+}
+
+
 /*
  * BroadcastCopyData sends copy data to all connections in a list.
  */
@@ -533,10 +796,156 @@ RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
 		pfree(resultDest->columnOutputFunctions);
 	}
 
+	if (resultDest->uncompressedData)
+	{
+		FreeStringInfo(resultDest->uncompressedData);
+	}
+
+	if (resultDest->compressedBlock)
+	{
+		FreeStringInfo(resultDest->compressedBlock);
+	}
+
 	pfree(resultDest);
 }
 
 
+/*
+ * ForwardIntermediateResult lets worker nodes fetch an intermediate result
+ * from other worker nodes that already have it, as planned by
+ * PlanIntermediateResultForwarding. The forwards within a round run in
+ * parallel, and a round starts once all forwards of the previous round
+ * have finished.
+ */
+void
+ForwardIntermediateResult(const char *resultId, List *forwardRoundList)
+{
+	List *forwardList = NIL;
+	foreach_ptr(forwardList, forwardRoundList)
+	{
+		List *connectionList = NIL;
+
+		IntermediateResultForward *forward = NULL;
+		foreach_ptr(forward, forwardList)
+		{
+			int flags = 0;
+			WorkerNode *targetNode = forward->targetNode;
+
+			MultiConnection *connection = StartNodeConnection(flags,
+															  targetNode->workerName,
+															  targetNode->workerPort);
+			MarkRemoteTransactionCritical(connection);
+
+			connectionList = lappend(connectionList, connection);
+		}
+
+		FinishConnectionListEstablishment(connectionList);
+
+		/* the fetched result is stored in the directory of the transaction */
+		RemoteTransactionsBeginIfNecessary(connectionList);
+
+		ListCell *forwardCell = NULL;
+		ListCell *connectionCell = NULL;
+		forboth(forwardCell, forwardList, connectionCell, connectionList)
+		{
+			forward = (IntermediateResultForward *) lfirst(forwardCell);
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+			WorkerNode *sourceNode = forward->sourceNode;
+			StringInfo fetchCommand = makeStringInfo();
+
+			appendStringInfo(fetchCommand,
+							 "SELECT fetch_intermediate_results(ARRAY[%s]::text[], %s, %d)",
+							 quote_literal_cstr(resultId),
+							 quote_literal_cstr(sourceNode->workerName),
+							 sourceNode->workerPort);
+
+			if (!SendRemoteCommand(connection, fetchCommand->data))
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+		}
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, connectionList)
+		{
+			bool raiseInterrupts = true;
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+		}
+	}
+}
+
+
+/*
+ * LinkIntermediateResult makes an intermediate result that was created in the
+ * current distributed transaction available under another result ID on the
+ * given nodes, and locally if linkLocalFile is set. The nodes should already
+ * have the source result.
+ */
+void
+LinkIntermediateResult(const char *sourceResultId, const char *targetResultId,
+					   List *nodeList, bool linkLocalFile)
+{
+	List *connectionList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		int flags = 0;
+
+		MultiConnection *connection = StartNodeConnection(flags, workerNode->workerName,
+														  workerNode->workerPort);
+		MarkRemoteTransactionCritical(connection);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* the results are stored in the directory of the transaction */
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	StringInfo linkCommand = makeStringInfo();
+	appendStringInfo(linkCommand, "SELECT pg_catalog.link_intermediate_result(%s, %s)",
+					 quote_literal_cstr(sourceResultId),
+					 quote_literal_cstr(targetResultId));
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		if (!SendRemoteCommand(connection, linkCommand->data))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		bool raiseInterrupts = true;
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	if (linkLocalFile)
+	{
+		LinkLocalIntermediateResult(sourceResultId, targetResultId);
+	}
+}
+
 /*
  * SendQueryResultViaCopy is called when a COPY "resultid" TO STDOUT
  * WITH (format result) command is received from the client. The
@@ -573,23 +982,41 @@ ReceiveQueryResultViaCopy(const char *resultId)
 
 /*
  * CreateIntermediateResultsDirectory creates the intermediate result
- * directory for the current transaction if it does not exist and ensures
- * that the directory is removed at the end of the transaction.
+ * directories for the current transaction if they do not exist and ensures
+ * that the directories are removed at the end of the transaction.
  */
-char *
+void
 CreateIntermediateResultsDirectory(void)
 {
-	char *resultDirectory = IntermediateResultsDirectory();
+	if (CreatedResultsDirectory)
+	{
+		return;
+	}
 
-	if (!CreatedResultsDirectory)
+	bool createdDirectory = false;
+
+	const char *jobCacheDirectory = NULL;
+	foreach_ptr(jobCacheDirectory, JobCacheDirectoryList())
 	{
+		char *resultDirectory = IntermediateResultsDirectory(jobCacheDirectory);
+
+		/* the job cache directory in the data directory is created on start */
+		if (IntermediateResultDirectories[0] != '\0' &&
+			mkdir(jobCacheDirectory, S_IRWXU) != 0 && errno != EEXIST)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not create intermediate results directory "
+								   "\"%s\": %m",
+								   jobCacheDirectory)));
+		}
+
 		int makeOK = mkdir(resultDirectory, S_IRWXU);
 		if (makeOK != 0)
 		{
 			if (errno == EEXIST)
 			{
 				/* someone else beat us to it, that's ok */
-				return resultDirectory;
+				continue;
 			}
 
 			ereport(ERROR, (errcode_for_file_access(),
@@ -598,10 +1025,10 @@ CreateIntermediateResultsDirectory(void)
 								   resultDirectory)));
 		}
 
-		CreatedResultsDirectory = true;
+		createdDirectory = true;
 	}
 
-	return resultDirectory;
+	CreatedResultsDirectory = createdDirectory;
 }
 
 
@@ -609,12 +1036,16 @@ CreateIntermediateResultsDirectory(void)
  * QueryResultFileName returns the file name in which to store
  * an intermediate result with the given key in the per transaction
  * result directory.
+ *
+ * When citus.intermediate_result_directories lists several directories, the
+ * result files are striped across them by the hash of the result key, such
+ * that all backends find the file of a result in the same directory.
  */
 char *
 QueryResultFileName(const char *resultId)
 {
 	StringInfo resultFileName = makeStringInfo();
-	const char *resultDirectory = IntermediateResultsDirectory();
+	List *jobCacheDirectoryList = JobCacheDirectoryList();
 	char *checkChar = (char *) resultId;
 
 	for (; *checkChar; checkChar++)
@@ -632,31 +1063,84 @@ QueryResultFileName(const char *resultId)
 		}
 	}
 
+	uint32 resultIdHash = DatumGetUInt32(hash_any((unsigned char *) resultId,
+												  strlen(resultId)));
+	int directoryIndex = resultIdHash % list_length(jobCacheDirectoryList);
+	char *jobCacheDirectory = (char *) list_nth(jobCacheDirectoryList, directoryIndex);
+
 	appendStringInfo(resultFileName, "%s/%s.data",
-					 resultDirectory, resultId);
+					 IntermediateResultsDirectory(jobCacheDirectory), resultId);
 
 	return resultFileName->data;
 }
 
 
 /*
- * IntermediateResultsDirectory returns the directory to use for a query result
- * file with a particular key. The filename includes the user OID, such
- * that users can never read each other's files.
+ * JobCacheDirectoryList returns the job cache directories in which the
+ * intermediate result directories are created: the pgsql_job_cache directory
+ * in each of the directories in citus.intermediate_result_directories, or
+ * base/pgsql_job_cache in the data directory if the setting is empty.
+ *
+ * The setting can only change on restart, so we build the list once.
+ */
+static List *
+JobCacheDirectoryList(void)
+{
+	if (ResultJobCacheDirectoryList != NIL)
+	{
+		return ResultJobCacheDirectoryList;
+	}
+
+	List *directoryList = NIL;
+	List *jobCacheDirectoryList = NIL;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	/* SplitDirectoriesString modifies its input, so give it a copy */
+	char *rawDirectories = pstrdup(IntermediateResultDirectories);
+	if (!SplitDirectoriesString(rawDirectories, ',', &directoryList) ||
+		directoryList == NIL)
+	{
+		jobCacheDirectoryList = list_make1(pstrdup("base/" PG_JOB_CACHE_DIR));
+	}
+	else
+	{
+		char *directory = NULL;
+		foreach_ptr(directory, directoryList)
+		{
+			jobCacheDirectoryList = lappend(jobCacheDirectoryList,
+											psprintf("%s/" PG_JOB_CACHE_DIR,
+													 directory));
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	ResultJobCacheDirectoryList = jobCacheDirectoryList;
+
+	return ResultJobCacheDirectoryList;
+}
+
+
+/*
+ * IntermediateResultsDirectory returns the directory in the given job cache
+ * directory to use for a query result file with a particular key. The
+ * filename includes the user OID, such that users can never read each
+ * other's files.
  *
  * In a distributed transaction, the directory has the form:
- * base/pgsql_job_cache/<user id>_<coordinator node id>_<transaction number>/
+ * <job cache directory>/<user id>_<coordinator node id>_<transaction number>/
  *
  * In a non-distributed transaction, the directory has the form:
- * base/pgsql_job_cache/<user id>_<process id>/
+ * <job cache directory>/<user id>_<process id>/
  *
  * The latter form can be used for testing COPY ... WITH (format result) without
  * assigning a distributed transaction ID.
  *
- * The pgsql_job_cache directory is emptied on restart in case of failure.
+ * The job cache directories are emptied on restart in case of failure.
  */
 static char *
-IntermediateResultsDirectory(void)
+IntermediateResultsDirectory(const char *jobCacheDirectory)
 {
 	StringInfo resultFileName = makeStringInfo();
 	Oid userId = GetUserId();
@@ -666,12 +1150,12 @@ IntermediateResultsDirectory(void)
 
 	if (transactionNumber > 0)
 	{
-		appendStringInfo(resultFileName, "base/" PG_JOB_CACHE_DIR "/%u_%u_%lu",
+		appendStringInfo(resultFileName, "%s/%u_%u_%lu", jobCacheDirectory,
 						 userId, initiatorNodeIdentifier, transactionNumber);
 	}
 	else
 	{
-		appendStringInfo(resultFileName, "base/" PG_JOB_CACHE_DIR "/%u_%u",
+		appendStringInfo(resultFileName, "%s/%u_%u", jobCacheDirectory,
 						 userId, MyProcPid);
 	}
 
@@ -680,21 +1164,47 @@ IntermediateResultsDirectory(void)
 
 
 /*
- * RemoveIntermediateResultsDirectory removes the intermediate result directory
- * for the current distributed transaction, if any was created.
+ * RemoveIntermediateResultsDirectory removes the intermediate result
+ * directories for the current distributed transaction, if any were created.
  */
 void
 RemoveIntermediateResultsDirectory(void)
 {
 	if (CreatedResultsDirectory)
 	{
-		CitusRemoveDirectory(IntermediateResultsDirectory());
+		const char *jobCacheDirectory = NULL;
+		foreach_ptr(jobCacheDirectory, JobCacheDirectoryList())
+		{
+			CitusRemoveDirectoryDeferred(IntermediateResultsDirectory(jobCacheDirectory));
+		}
 
 		CreatedResultsDirectory = false;
 	}
 }
 
 
+/*
+ * RemoveIntermediateResultScratchDirectories removes the job cache directories
+ * in citus.intermediate_result_directories, including the results that were
+ * left behind when the server stopped.
+ */
+void
+RemoveIntermediateResultScratchDirectories(void)
+{
+	if (IntermediateResultDirectories[0] == '\0')
+	{
+		/* base/pgsql_job_cache is emptied by the task tracker */
+		return;
+	}
+
+	const char *jobCacheDirectory = NULL;
+	foreach_ptr(jobCacheDirectory, JobCacheDirectoryList())
+	{
+		CitusRemoveDirectory(jobCacheDirectory);
+	}
+}
+
+
 /*
  * IntermediateResultSize returns the file size of the intermediate result
  * or -1 if the file does not exist.
@@ -796,28 +1306,12 @@ ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
 		int statOK = stat(resultFileName, &fileStat);
 		if (statOK != 0)
 		{
-			/*
-			 * When the file does not exist, it could mean two different things.
-			 * First -- and a lot more common -- case is that a failure happened
-			 * in a concurrent backend on the same distributed transaction. And,
-			 * one of the backends in that transaction has already been roll
-			 * backed, which has already removed the file. If we throw an error
-			 * here, the user might see this error instead of the actual error
-			 * message. Instead, we prefer to WARN the user and pretend that the
-			 * file has no data in it. In the end, the user would see the actual
-			 * error message for the failure.
-			 *
-			 * Second, in case of any bugs in intermediate result broadcasts,
-			 * we could try to read a non-existing file. That is most likely
-			 * to happen during development.
-			 */
-			ereport(WARNING, (errcode(ERRCODE_CITUS_INTERMEDIATE_RESULT_NOT_FOUND),
-							  errmsg("Query could not find the intermediate result file "
-									 "\"%s\", it was mostly likely deleted due to an "
-									 "error in a parallel process within the same "
-									 "distributed transaction", resultId)));
+			ReportMissingResultFile(resultId);
 		}
-		else
+		else if (!ReadColumnarFileIntoTupleStore(resultFileName, tupleDescriptor,
+												  tupleStore) &&
+				 !ReadCompressedFileIntoTupleStore(resultFileName, copyFormat,
+												   tupleDescriptor, tupleStore))
 		{
 			ReadFileIntoTupleStore(resultFileName, copyFormat, tupleDescriptor,
 								   tupleStore);
@@ -828,6 +1322,430 @@ ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
 }
 
 
+/*
+ * BeginIntermediateResultRead opens the file of the given intermediate result
+ * for reading its records one at a time with ReadNextIntermediateResultRow,
+ * rather than reading all of them into a tuple store. It returns NULL after
+ * warning if the file does not exist, in which case the result should be
+ * treated as empty.
+ *
+ * For columnar results, only the columns whose attribute numbers are in
+ * projectedColumns are read and the others are returned as NULL, and blocks
+ * of records that cannot pass the given quals are skipped. Records in COPY
+ * format are always read in full, and the caller still needs to apply the
+ * quals in either case.
+ */
+IntermediateResultReader *
+BeginIntermediateResultRead(char *resultId, char *copyFormat, TupleDesc tupleDescriptor,
+							Bitmapset *projectedColumns, List *whereClauseList)
+{
+	char *resultFileName = QueryResultFileName(resultId);
+	struct stat fileStat;
+
+	int statOK = stat(resultFileName, &fileStat);
+	if (statOK != 0)
+	{
+		ReportMissingResultFile(resultId);
+		return NULL;
+	}
+
+	IntermediateResultReader *reader = palloc0(sizeof(IntermediateResultReader));
+
+	reader->columnarReader = OpenColumnarResultReader(resultFileName, tupleDescriptor,
+													  projectedColumns,
+													  whereClauseList);
+	if (reader->columnarReader != NULL)
+	{
+		return reader;
+	}
+
+	/* trick BeginCopyFrom into using our tuple descriptor, see StubRelation() */
+	Relation stubRelation = StubRelation(tupleDescriptor);
+
+	int location = -1; /* "unknown" token location */
+	DefElem *copyOption = makeDefElem("format", (Node *) makeString(copyFormat),
+									  location);
+	List *copyOptions = list_make1(copyOption);
+
+	reader->compressedReader = OpenCompressedResultReader(resultFileName);
+
+	if (reader->compressedReader != NULL)
+	{
+		/* BeginCopyFrom already reads the header of binary COPY data */
+		CompressedResultReader *previousReader = CurrentCompressedResultReader;
+		CurrentCompressedResultReader = reader->compressedReader;
+
+		reader->copyState = BeginCopyFrom(NULL, stubRelation, NULL, false,
+										  ReadCompressedResultCallback, NULL,
+										  copyOptions);
+
+		CurrentCompressedResultReader = previousReader;
+	}
+	else
+	{
+		reader->copyState = BeginCopyFrom(NULL, stubRelation, resultFileName, false,
+										  NULL, NULL, copyOptions);
+	}
+
+	return reader;
+}
+
+
+/*
+ * ReadNextIntermediateResultRow parses the next record of the intermediate
+ * result into the given values and nulls arrays, which are allocated in the
+ * current memory context. It returns false at the end of the result.
+ */
+bool
+ReadNextIntermediateResultRow(IntermediateResultReader *reader, ExprContext *econtext,
+							  Datum *columnValues, bool *columnNulls)
+{
+	if (reader->columnarReader != NULL)
+	{
+		return ReadNextColumnarResultRow(reader->columnarReader, columnValues,
+										 columnNulls);
+	}
+
+	/* readers of other results may be interleaved with this one */
+	CompressedResultReader *previousReader = CurrentCompressedResultReader;
+	CurrentCompressedResultReader = reader->compressedReader;
+
+	bool nextRowFound = NextCopyFromCompat(reader->copyState, econtext, columnValues,
+										   columnNulls);
+
+	CurrentCompressedResultReader = previousReader;
+
+	return nextRowFound;
+}
+
+
+/*
+ * EndIntermediateResultRead closes the result file of the given reader.
+ */
+void
+EndIntermediateResultRead(IntermediateResultReader *reader)
+{
+	if (reader->columnarReader != NULL)
+	{
+		CloseColumnarResultReader(reader->columnarReader);
+		pfree(reader);
+		return;
+	}
+
+	EndCopyFrom(reader->copyState);
+
+	if (reader->compressedReader != NULL)
+	{
+		CloseCompressedResultReader(reader->compressedReader);
+	}
+
+	pfree(reader);
+}
+
+
+/*
+ * ReportMissingResultFile warns that the file of the given intermediate result
+ * does not exist.
+ *
+ * When the file does not exist, it could mean two different things. First --
+ * and a lot more common -- case is that a failure happened in a concurrent
+ * backend on the same distributed transaction. And, one of the backends in
+ * that transaction has already been roll backed, which has already removed the
+ * file. If we throw an error here, the user might see this error instead of the
+ * actual error message. Instead, we prefer to WARN the user and pretend that
+ * the file has no data in it. In the end, the user would see the actual error
+ * message for the failure.
+ *
+ * Second, in case of any bugs in intermediate result broadcasts, we could try
+ * to read a non-existing file. That is most likely to happen during
+ * development.
+ */
+static void
+ReportMissingResultFile(char *resultId)
+{
+	ereport(WARNING, (errcode(ERRCODE_CITUS_INTERMEDIATE_RESULT_NOT_FOUND),
+					  errmsg("Query could not find the intermediate result file "
+							 "\"%s\", it was mostly likely deleted due to an "
+							 "error in a parallel process within the same "
+							 "distributed transaction", resultId)));
+}
+
+
+/*
+ * ReadColumnarFileIntoTupleStore reads all rows of a columnar result file into
+ * the tuple store. It returns false without reading any rows if the file is
+ * not a columnar result.
+ */
+static bool
+ReadColumnarFileIntoTupleStore(char *fileName, TupleDesc tupleDescriptor,
+							   Tuplestorestate *tupleStore)
+{
+	int columnCount = tupleDescriptor->natts;
+	Bitmapset *projectedColumns = bms_add_range(NULL, 1, columnCount);
+	List *whereClauseList = NIL;
+
+	ColumnarResultReader *reader = OpenColumnarResultReader(fileName, tupleDescriptor,
+															projectedColumns,
+															whereClauseList);
+	if (reader == NULL)
+	{
+		return false;
+	}
+
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	MemoryContext rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Columnar Result Row",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	while (true)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(rowContext);
+
+		bool nextRowFound = ReadNextColumnarResultRow(reader, columnValues,
+													  columnNulls);
+		if (nextRowFound)
+		{
+			CompressValuesForTuplestore(tupleStore, tupleDescriptor, columnValues,
+										columnNulls);
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (!nextRowFound)
+		{
+			break;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, columnValues, columnNulls);
+		MemoryContextReset(rowContext);
+	}
+
+	CloseColumnarResultReader(reader);
+	MemoryContextDelete(rowContext);
+	pfree(columnValues);
+	pfree(columnNulls);
+
+	return true;
+}
+
+
+/*
+ * ReadCompressedFileIntoTupleStore reads the records in a compressed result
+ * file into the tuple store, decompressing one block at a time while COPY
+ * parses the records. It returns false without reading any records if the
+ * file is not compressed.
+ */
+static bool
+ReadCompressedFileIntoTupleStore(char *fileName, char *copyFormat,
+								 TupleDesc tupleDescriptor, Tuplestorestate *tupleStore)
+{
+	CompressedResultReader *reader = OpenCompressedResultReader(fileName);
+	if (reader == NULL)
+	{
+		return false;
+	}
+
+	CurrentCompressedResultReader = reader;
+
+	ReadCopyDataIntoTupleStore(NULL, ReadCompressedResultCallback, copyFormat,
+							   tupleDescriptor, tupleStore);
+
+	CurrentCompressedResultReader = NULL;
+
+	CloseCompressedResultReader(reader);
+
+	return true;
+}
+
+
+/*
+ * OpenCompressedResultReader opens the given result file for decompression.
+ * It returns NULL if the file is not compressed.
+ */
+static CompressedResultReader *
+OpenCompressedResultReader(char *fileName)
+{
+	const int fileFlags = (O_RDONLY | PG_BINARY);
+	const int fileMode = 0;
+	char signature[sizeof(CompressedResultSignature)];
+
+	File fileDesc = FileOpenForTransmit(fileName, fileFlags, fileMode);
+	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+	int bytesRead = FileReadCompat(&fileCompat, signature, sizeof(signature),
+								   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ);
+	if (bytesRead != sizeof(signature) ||
+		memcmp(signature, CompressedResultSignature, sizeof(signature)) != 0)
+	{
+		FileClose(fileDesc);
+		return NULL;
+	}
+
+	CompressedResultReader *reader = palloc0(sizeof(CompressedResultReader));
+	reader->fileName = fileName;
+	reader->fileCompat = fileCompat;
+	reader->rawBlock = makeStringInfo();
+	enlargeStringInfo(reader->rawBlock, COMPRESSED_RESULT_BLOCK_SIZE);
+	reader->compressedBlock = makeStringInfo();
+	enlargeStringInfo(reader->compressedBlock,
+					  PGLZ_MAX_OUTPUT(COMPRESSED_RESULT_BLOCK_SIZE));
+
+	return reader;
+}
+
+
+/*
+ * CloseCompressedResultReader closes the file of the given reader and frees
+ * its buffers.
+ */
+static void
+CloseCompressedResultReader(CompressedResultReader *reader)
+{
+	FileClose(reader->fileCompat.fd);
+	FreeStringInfo(reader->rawBlock);
+	FreeStringInfo(reader->compressedBlock);
+	pfree(reader);
+}
+
+
+/*
+ * ReadCompressedResultCallback is the copy callback for compressed result
+ * files. It returns at least minRead bytes of decompressed data unless the
+ * end of the file is reached.
+ */
+static int
+ReadCompressedResultCallback(void *outBuf, int minRead, int maxRead)
+{
+	CompressedResultReader *reader = CurrentCompressedResultReader;
+	int bytesCopied = 0;
+
+	while (bytesCopied < minRead)
+	{
+		int availableLength = reader->rawBlock->len - reader->rawBlockOffset;
+		if (availableLength == 0)
+		{
+			if (!ReadNextCompressedResultBlock(reader))
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		int copyLength = Min(availableLength, maxRead - bytesCopied);
+		memcpy_s((char *) outBuf + bytesCopied, maxRead - bytesCopied,
+				 reader->rawBlock->data + reader->rawBlockOffset, copyLength);
+
+		reader->rawBlockOffset += copyLength;
+		bytesCopied += copyLength;
+	}
+
+	return bytesCopied;
+}
+
+
+/*
+ * ReadNextCompressedResultBlock reads the next block of the result file and
+ * decompresses it into the raw block buffer of the reader. It returns false
+ * when the end of the file is reached.
+ */
+static bool
+ReadNextCompressedResultBlock(CompressedResultReader *reader)
+{
+	uint32 blockHeader[2];
+
+	int bytesRead = FileReadCompat(&reader->fileCompat, (char *) blockHeader,
+								   COMPRESSED_RESULT_BLOCK_HEADER_SIZE,
+								   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ);
+	if (bytesRead == 0)
+	{
+		return false;
+	}
+	else if (bytesRead != COMPRESSED_RESULT_BLOCK_HEADER_SIZE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("compressed intermediate result file \"%s\" is "
+							   "truncated", reader->fileName)));
+	}
+
+	uint32 rawLength = pg_ntoh32(blockHeader[0]);
+	uint32 compressedLength = pg_ntoh32(blockHeader[1]);
+
+	if (rawLength == 0 || rawLength > COMPRESSED_RESULT_BLOCK_SIZE ||
+		compressedLength > PGLZ_MAX_OUTPUT(COMPRESSED_RESULT_BLOCK_SIZE))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("invalid block in compressed intermediate result "
+							   "file \"%s\"", reader->fileName)));
+	}
+
+	StringInfo rawBlock = reader->rawBlock;
+	resetStringInfo(rawBlock);
+	reader->rawBlockOffset = 0;
+
+	if (compressedLength == 0)
+	{
+		/* block is stored as is */
+		ReadFromResultFile(reader, rawBlock->data, rawLength);
+	}
+	else
+	{
+		StringInfo compressedBlock = reader->compressedBlock;
+
+		ReadFromResultFile(reader, compressedBlock->data, compressedLength);
+
+		int32 decompressedLength = pglz_decompress_compat(compressedBlock->data,
+														  compressedLength,
+														  rawBlock->data,
+														  rawLength);
+		if (decompressedLength != (int32) rawLength)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("could not decompress intermediate result "
+								   "file \"%s\"", reader->fileName)));
+		}
+	}
+
+	rawBlock->len = rawLength;
+
+	return true;
+}
+
+
+/*
+ * ReadFromResultFile reads exactly length bytes from the result file of the
+ * reader, and errors out if there are fewer bytes left in the file.
+ */
+static void
+ReadFromResultFile(CompressedResultReader *reader, char *buffer, int length)
+{
+	int totalBytesRead = 0;
+
+	while (totalBytesRead < length)
+	{
+		int bytesRead = FileReadCompat(&reader->fileCompat, buffer + totalBytesRead,
+									   length - totalBytesRead,
+									   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ);
+		if (bytesRead < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read file \"%s\": %m",
+								   reader->fileName)));
+		}
+		else if (bytesRead == 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("compressed intermediate result file \"%s\" is "
+								   "truncated", reader->fileName)));
+		}
+
+		totalBytesRead += bytesRead;
+	}
+}
+
+
 /*
  * fetch_intermediate_results fetches a set of intermediate results defined in an
  * array of result IDs from a remote node and writes them to a local intermediate
@@ -952,7 +1870,8 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 
 		Assert(copyStatus == CLIENT_COPY_MORE);
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0, PG_WAIT_EXTENSION);
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0,
+								   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_FETCH);
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -1001,7 +1920,8 @@ CopyDataFromConnection(MultiConnection *connection, FileCompat *fileCompat,
 		errno = 0;
 
 		int bytesWritten = FileWriteCompat(fileCompat, receiveBuffer,
-										   receiveLength, PG_WAIT_IO);
+										   receiveLength,
+										   WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_WRITE);
 		if (bytesWritten != receiveLength)
 		{
 			ereport(ERROR, (errcode_for_file_access(),
@@ -1050,3 +1970,49 @@ CopyDataFromConnection(MultiConnection *connection, FileCompat *fileCompat,
 		return CLIENT_COPY_FAILED;
 	}
 }
+
+
+/*
+ * link_intermediate_result makes an intermediate result that was created in
+ * the current distributed transaction available under another result ID,
+ * without copying it where the file system supports hard links.
+ */
+Datum
+link_intermediate_result(PG_FUNCTION_ARGS)
+{
+	text *sourceResultIdText = PG_GETARG_TEXT_P(0);
+	char *sourceResultId = text_to_cstring(sourceResultIdText);
+	text *targetResultIdText = PG_GETARG_TEXT_P(1);
+	char *targetResultId = text_to_cstring(targetResultIdText);
+
+	CheckCitusVersion(ERROR);
+
+	LinkLocalIntermediateResult(sourceResultId, targetResultId);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * LinkLocalIntermediateResult creates the local result file for the target
+ * result ID as a hard link to the file of the source result ID, or as a copy
+ * if the link cannot be created.
+ */
+static void
+LinkLocalIntermediateResult(const char *sourceResultId, const char *targetResultId)
+{
+	char *sourceFileName = QueryResultFileName(sourceResultId);
+	char *targetFileName = QueryResultFileName(targetResultId);
+
+	if (unlink(targetFileName) != 0 && errno != ENOENT)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not remove intermediate result file \"%s\": %m",
+							   targetFileName)));
+	}
+
+	if (link(sourceFileName, targetFileName) != 0)
+	{
+		copy_file(sourceFileName, targetFileName);
+	}
+}
@@ -0,0 +1,540 @@
+/*-------------------------------------------------------------------------
+ *
+ * lag_aware_routing.c
+ *   Routes reads to secondary nodes when citus.use_secondary_nodes is
+ *   'lag_aware', as long as the secondary has replayed the writes that the
+ *   current session committed on the primary of its group.
+ *
+ *   The maintenance daemon periodically reads the replay LSN of every
+ *   secondary and keeps it in shared memory. When a session commits a
+ *   remote transaction that modified a worker, we ask the worker for its
+ *   WAL position in the same round trip as the COMMIT and remember it for
+ *   the session. A read can go to a secondary if the secondary replayed
+ *   up to that position, otherwise it goes to the primary.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "access/xlogdefs.h"
+#include "distributed/connection_management.h"
+#include "distributed/lag_aware_routing.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/placement_connection.h"
+#include "distributed/remote_commands.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+
+/* query that is sent to secondaries to find out how far they replayed */
+#define REPLAY_LSN_QUERY "SELECT pg_last_wal_replay_lsn()"
+
+/*
+ * A replay LSN that was not refreshed for this many refresh intervals is not
+ * trusted anymore, since the secondary might be gone.
+ */
+#define REPLAY_LSN_MAX_AGE_INTERVALS 3
+
+/* commit LSN of writes whose position is unknown, no secondary is ahead of it */
+#define UNKNOWN_COMMIT_LSN PG_UINT64_MAX
+
+
+/*
+ * The data structure used to store data in shared memory. It only holds the
+ * lock, the replay LSNs are kept in a separately allocated hash.
+ */
+typedef struct SecondaryLsnSharedData
+{
+	int secondaryLsnHashTrancheId;
+	char *secondaryLsnHashTrancheName;
+
+	LWLock secondaryLsnHashLock;
+} SecondaryLsnSharedData;
+
+typedef struct SecondaryLsnHashKey
+{
+	Oid databaseId;
+	uint32 nodeId;
+} SecondaryLsnHashKey;
+
+/* hash entry for the replay position of a single secondary */
+typedef struct SecondaryLsnHashEntry
+{
+	SecondaryLsnHashKey key;
+
+	XLogRecPtr replayLsn;
+	TimestampTz refreshTime;
+} SecondaryLsnHashEntry;
+
+/*
+ * CommitLsnHashKey identifies a primary node for which the current session
+ * committed writes.
+ */
+typedef struct CommitLsnHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} CommitLsnHashKey;
+
+/* WAL position of the primary after the last commit of a write of the session */
+typedef struct CommitLsnHashEntry
+{
+	CommitLsnHashKey key;
+
+	XLogRecPtr commitLsn;
+} CommitLsnHashEntry;
+
+
+/* GUC, time between refreshes of the replay LSNs of secondaries, in milliseconds */
+int SecondaryLsnRefreshInterval = 1000;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *SecondaryLsnHash = NULL;
+static SecondaryLsnSharedData *SecondaryLsnSharedState = NULL;
+
+/* commit LSNs of the writes of the current session, created on first use */
+static HTAB *CommitLsnHash = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static bool ParseLsn(const char *lsnString, XLogRecPtr *lsn);
+static void StoreReplayLsn(uint32 nodeId, XLogRecPtr replayLsn);
+static bool SecondaryReplayedUpTo(uint32 nodeId, XLogRecPtr requiredLsn);
+static XLogRecPtr SessionCommitLsn(const char *hostname, int port);
+static void InitializeCommitLsnHash(void);
+static void SecondaryLsnShmemInit(void);
+static size_t SecondaryLsnShmemSize(void);
+
+
+/*
+ * InitializeSecondaryLsnCache requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeSecondaryLsnCache(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SecondaryLsnShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SecondaryLsnShmemInit;
+}
+
+
+/*
+ * RefreshSecondaryReplayLsns reads the replay LSN of all active secondaries
+ * of the current cluster and stores them in shared memory. Each secondary
+ * gets a single query, and the queries run in parallel. The LSNs of
+ * secondaries that cannot be reached age out.
+ *
+ * The function returns whether all secondaries could be reached.
+ */
+bool
+RefreshSecondaryReplayLsns(void)
+{
+	List *connectionList = NIL;
+	List *queriedNodeList = NIL;
+	List *queriedConnectionList = NIL;
+	ListCell *workerNodeCell = NULL;
+	ListCell *connectionCell = NULL;
+	bool allNodesRefreshed = true;
+
+	List *secondaryNodeList = ActiveSecondaryNodeList();
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, secondaryNodeList)
+	{
+		MultiConnection *connection = StartNodeConnection(0, workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	forboth(workerNodeCell, secondaryNodeList, connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			SendRemoteCommand(connection, REPLAY_LSN_QUERY) == 0)
+		{
+			/* the secondary is probably restarting, its LSN ages out */
+			ReportConnectionError(connection, DEBUG1);
+			allNodesRefreshed = false;
+			continue;
+		}
+
+		queriedNodeList = lappend(queriedNodeList, lfirst(workerNodeCell));
+		queriedConnectionList = lappend(queriedConnectionList, connection);
+	}
+
+	forboth(workerNodeCell, queriedNodeList, connectionCell, queriedConnectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		bool raiseInterrupts = true;
+		XLogRecPtr replayLsn = InvalidXLogRecPtr;
+
+		workerNode = (WorkerNode *) lfirst(workerNodeCell);
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, DEBUG1);
+			allNodesRefreshed = false;
+		}
+		else if (PQntuples(result) == 1 && !PQgetisnull(result, 0, 0) &&
+				 ParseLsn(PQgetvalue(result, 0, 0), &replayLsn))
+		{
+			StoreReplayLsn(workerNode->nodeId, replayLsn);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	return allNodesRefreshed;
+}
+
+
+/*
+ * ShouldRequestCommitLsn returns whether the WAL position of the worker should
+ * be requested along with the COMMIT of the remote transaction on the given
+ * connection, which is the case when we route reads based on replication lag
+ * and the transaction modified data.
+ */
+bool
+ShouldRequestCommitLsn(MultiConnection *connection)
+{
+	return ReadFromSecondaries == USE_SECONDARY_NODES_LAG_AWARE &&
+		   ConnectionModifiedPlacement(connection);
+}
+
+
+/*
+ * RecordCommitLsn remembers the WAL position in the given result of the
+ * query that was sent along with the COMMIT over the given connection, such
+ * that subsequent reads of the session only go to secondaries that replayed
+ * it. If the position could not be read, reads go to the primary until a
+ * later commit tells us where it is. The function is called after the
+ * remote commit, so it should not throw errors.
+ */
+void
+RecordCommitLsn(MultiConnection *connection, PGresult *result)
+{
+	XLogRecPtr commitLsn = InvalidXLogRecPtr;
+	CommitLsnHashKey key;
+	bool found = false;
+
+	if (!IsResponseOK(result) || PQntuples(result) != 1 ||
+		PQgetisnull(result, 0, 0) || !ParseLsn(PQgetvalue(result, 0, 0), &commitLsn))
+	{
+		commitLsn = UNKNOWN_COMMIT_LSN;
+	}
+
+	if (CommitLsnHash == NULL)
+	{
+		InitializeCommitLsnHash();
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, connection->hostname, MAX_NODE_LENGTH);
+	key.port = connection->port;
+
+	CommitLsnHashEntry *commitLsnEntry = hash_search(CommitLsnHash, &key, HASH_ENTER,
+													 &found);
+
+	/* a later commit also covers the ones whose position we did not get */
+	if (!found || commitLsnEntry->commitLsn == UNKNOWN_COMMIT_LSN ||
+		commitLsnEntry->commitLsn < commitLsn)
+	{
+		commitLsnEntry->commitLsn = commitLsn;
+	}
+}
+
+
+/*
+ * LagAwareReadPlacementList returns the placement list of a read-only task
+ * with placements on secondaries from the given list in front of the
+ * placements on primaries. A secondary is only used for a placement if it
+ * recently replayed all writes that the session committed on the primary.
+ * The primary placements are kept as fallbacks in case the secondaries
+ * fail. Placements on the local group are left alone, since writes to them
+ * may have been executed locally.
+ */
+List *
+LagAwareReadPlacementList(List *placementList, List *secondaryNodeList)
+{
+	List *secondaryPlacementList = NIL;
+	int32 localGroupId = GetLocalGroupId();
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		List *candidateNodeList = NIL;
+
+		if (placement->groupId == localGroupId)
+		{
+			continue;
+		}
+
+		XLogRecPtr requiredLsn = SessionCommitLsn(placement->nodeName,
+												  placement->nodePort);
+
+		WorkerNode *secondaryNode = NULL;
+		foreach_ptr(secondaryNode, secondaryNodeList)
+		{
+			if (secondaryNode->groupId == placement->groupId &&
+				SecondaryReplayedUpTo(secondaryNode->nodeId, requiredLsn))
+			{
+				candidateNodeList = lappend(candidateNodeList, secondaryNode);
+			}
+		}
+
+		if (candidateNodeList == NIL)
+		{
+			continue;
+		}
+
+		/* spread the shards of a group over its secondaries */
+		int candidateIndex = placement->shardId % list_length(candidateNodeList);
+		secondaryNode = (WorkerNode *) list_nth(candidateNodeList, candidateIndex);
+
+		ShardPlacement *secondaryPlacement = CitusMakeNode(ShardPlacement);
+		CopyShardPlacement(placement, secondaryPlacement);
+		secondaryPlacement->nodeName = pstrdup(secondaryNode->workerName);
+		secondaryPlacement->nodePort = secondaryNode->workerPort;
+		secondaryPlacement->nodeId = secondaryNode->nodeId;
+
+		secondaryPlacementList = lappend(secondaryPlacementList, secondaryPlacement);
+	}
+
+	return list_concat(secondaryPlacementList, list_copy(placementList));
+}
+
+
+/*
+ * ParseLsn parses the text representation of a pg_lsn and returns whether it
+ * is valid. Unlike pg_lsn_in it does not throw errors.
+ */
+static bool
+ParseLsn(const char *lsnString, XLogRecPtr *lsn)
+{
+	uint32 highBits = 0;
+	uint32 lowBits = 0;
+
+	if (sscanf(lsnString, "%X/%X", &highBits, &lowBits) != 2)
+	{
+		return false;
+	}
+
+	*lsn = ((uint64) highBits << 32) | lowBits;
+
+	return true;
+}
+
+
+/*
+ * StoreReplayLsn stores the given replay LSN of the given secondary in the
+ * current database in shared memory. LSNs that do not fit are left out,
+ * such that reads go to the primary.
+ */
+static void
+StoreReplayLsn(uint32 nodeId, XLogRecPtr replayLsn)
+{
+	SecondaryLsnHashKey key;
+	bool found = false;
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.nodeId = nodeId;
+
+	LWLockAcquire(&SecondaryLsnSharedState->secondaryLsnHashLock, LW_EXCLUSIVE);
+
+	SecondaryLsnHashEntry *lsnEntry =
+		(SecondaryLsnHashEntry *) hash_search(SecondaryLsnHash, &key, HASH_ENTER_NULL,
+											  &found);
+	if (lsnEntry != NULL)
+	{
+		lsnEntry->replayLsn = replayLsn;
+		lsnEntry->refreshTime = GetCurrentTimestamp();
+	}
+
+	LWLockRelease(&SecondaryLsnSharedState->secondaryLsnHashLock);
+}
+
+
+/*
+ * SecondaryReplayedUpTo returns whether the given secondary recently reported
+ * a replay LSN of at least the given LSN.
+ */
+static bool
+SecondaryReplayedUpTo(uint32 nodeId, XLogRecPtr requiredLsn)
+{
+	SecondaryLsnHashKey key;
+	bool found = false;
+	bool replayedUpTo = false;
+
+	if (SecondaryLsnRefreshInterval <= 0)
+	{
+		/* replay LSNs are not refreshed, so we do not know whether they are behind */
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.nodeId = nodeId;
+
+	LWLockAcquire(&SecondaryLsnSharedState->secondaryLsnHashLock, LW_SHARED);
+
+	SecondaryLsnHashEntry *lsnEntry =
+		(SecondaryLsnHashEntry *) hash_search(SecondaryLsnHash, &key, HASH_FIND,
+											  &found);
+	if (found)
+	{
+		int maxAge = SecondaryLsnRefreshInterval * REPLAY_LSN_MAX_AGE_INTERVALS;
+
+		replayedUpTo = lsnEntry->replayLsn >= requiredLsn &&
+					   !TimestampDifferenceExceeds(lsnEntry->refreshTime,
+												   GetCurrentTimestamp(), maxAge);
+	}
+
+	LWLockRelease(&SecondaryLsnSharedState->secondaryLsnHashLock);
+
+	return replayedUpTo;
+}
+
+
+/*
+ * SessionCommitLsn returns the WAL position of the given primary after the
+ * last write that the current session committed on it, or InvalidXLogRecPtr
+ * if the session did not write to it.
+ */
+static XLogRecPtr
+SessionCommitLsn(const char *hostname, int port)
+{
+	CommitLsnHashKey key;
+	bool found = false;
+
+	if (CommitLsnHash == NULL)
+	{
+		return InvalidXLogRecPtr;
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+
+	CommitLsnHashEntry *commitLsnEntry = hash_search(CommitLsnHash, &key, HASH_FIND,
+													 &found);
+
+	return found ? commitLsnEntry->commitLsn : InvalidXLogRecPtr;
+}
+
+
+/*
+ * InitializeCommitLsnHash creates the hash that keeps the commit LSNs of the
+ * current session.
+ */
+static void
+InitializeCommitLsnHash(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(CommitLsnHashKey);
+	info.entrysize = sizeof(CommitLsnHashEntry);
+	info.hcxt = TopMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CommitLsnHash = hash_create("Citus Commit LSN Hash", 32, &info, hashFlags);
+}
+
+
+/*
+ * SecondaryLsnShmemSize returns the size that should be allocated on the
+ * shared memory for the replay LSNs of secondaries.
+ */
+static size_t
+SecondaryLsnShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(SecondaryLsnSharedData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(SecondaryLsnHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * SecondaryLsnShmemInit initializes the shared memory used for keeping the
+ * replay LSNs of secondaries across backends.
+ */
+static void
+SecondaryLsnShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (dbid, nodeid) -> [replay lsn] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SecondaryLsnHashKey);
+	info.entrysize = sizeof(SecondaryLsnHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SecondaryLsnSharedState =
+		(SecondaryLsnSharedData *) ShmemInitStruct("Secondary LSN Data",
+												   sizeof(SecondaryLsnSharedData),
+												   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		SecondaryLsnSharedState->secondaryLsnHashTrancheId = LWLockNewTrancheId();
+		SecondaryLsnSharedState->secondaryLsnHashTrancheName =
+			"Secondary LSN Hash Tranche";
+		LWLockRegisterTranche(SecondaryLsnSharedState->secondaryLsnHashTrancheId,
+							  SecondaryLsnSharedState->secondaryLsnHashTrancheName);
+
+		LWLockInitialize(&SecondaryLsnSharedState->secondaryLsnHashLock,
+						 SecondaryLsnSharedState->secondaryLsnHashTrancheId);
+	}
+
+	/* allocate hash table */
+	SecondaryLsnHash = ShmemInitHash("Secondary LSN Hash", MaxWorkerNodesTracked,
+									 MaxWorkerNodesTracked, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(SecondaryLsnHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -95,6 +95,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h" /* to access LogRemoteCommands */
+#include "distributed/shard_utils.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_protocol.h"
 #include "executor/tstoreReceiver.h"
@@ -120,6 +121,7 @@ static uint64 ExecuteLocalTaskPlan(PlannedStmt *taskPlan, char *queryString,
 								   Tuplestorestate *tupleStoreState, ParamListInfo
 								   paramListInfo);
 static void LogLocalCommand(Task *task);
+static Query * LocalShardQueryFromTaskQueryObject(Task *task);
 static uint64 LocallyPlanAndExecuteMultipleQueries(List *queryStrings,
 												   Tuplestorestate *tupleStoreState);
 static void ExtractParametersForLocalExecution(ParamListInfo paramListInfo,
@@ -282,9 +284,17 @@ ExecuteLocalTaskListExtended(List *taskList,
 				continue;
 			}
 
-			Query *shardQuery = ParseQueryString(TaskQueryStringForAllPlacements(task),
-												 taskParameterTypes,
-												 taskNumParams);
+			/*
+			 * When the query of the task has not been deparsed yet, plan the
+			 * query tree directly instead of deparsing and parsing it again.
+			 */
+			Query *shardQuery = LocalShardQueryFromTaskQueryObject(task);
+			if (shardQuery == NULL)
+			{
+				shardQuery = ParseQueryString(TaskQueryStringForAllPlacements(task),
+											  taskParameterTypes,
+											  taskNumParams);
+			}
 
 
 			int cursorOptions = CURSOR_OPT_PARALLEL_OK;
@@ -320,6 +330,69 @@ ExecuteLocalTaskListExtended(List *taskList,
 }
 
 
+/*
+ * LocalShardQueryFromTaskQueryObject returns a copy of the query of a lazily
+ * deparsed task in which the distributed tables are replaced by their local
+ * shard relations, and locks those shard relations the same way parse analysis
+ * of the deparsed query would.
+ *
+ * The function returns NULL if the task does not have a query object, or if
+ * the query cannot be mapped to local shard relations. In that case, the caller
+ * should fall back to deparsing the query.
+ */
+static Query *
+LocalShardQueryFromTaskQueryObject(Task *task)
+{
+	if (GetTaskQueryType(task) != TASK_QUERY_OBJECT)
+	{
+		return NULL;
+	}
+
+	Query *jobQuery = task->taskQuery.data.jobQueryReferenceForLazyDeparsing;
+
+	/*
+	 * INSERTs rely on deparse_shard_query() to inject the row values of the
+	 * task and to rename the target relation, and tasks without relation
+	 * shards (e.g., delegated function calls) do not access any shards.
+	 */
+	if (jobQuery->commandType == CMD_INSERT || task->relationShardList == NIL)
+	{
+		return NULL;
+	}
+
+	Query *shardQuery = copyObject(jobQuery);
+
+	bool unmappedRelation =
+		UpdateRelationsToLocalShardTables((Node *) shardQuery, task->relationShardList);
+	if (unmappedRelation)
+	{
+		return NULL;
+	}
+
+	LOCKMODE lockMode =
+		IsModifyCommand(shardQuery) ? RowExclusiveLock : (shardQuery->hasForUpdate ?
+														  RowShareLock : AccessShareLock);
+
+	RelationShard *relationShard = NULL;
+	foreach_ptr(relationShard, task->relationShardList)
+	{
+		if (relationShard->shardId == INVALID_SHARD_ID)
+		{
+			continue;
+		}
+
+		Oid shardOid = GetTableLocalShardOid(relationShard->relationId,
+											 relationShard->shardId);
+		if (OidIsValid(shardOid))
+		{
+			LockRelationOid(shardOid, lockMode);
+		}
+	}
+
+	return shardQuery;
+}
+
+
 /*
  * LocallyPlanAndExecuteMultipleQueries plans and executes the given query strings
  * one by one.
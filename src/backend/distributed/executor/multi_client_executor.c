@@ -16,6 +16,7 @@
 #include "fmgr.h"
 #include "libpq-fe.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 
 #include "commands/dbcommands.h"
 #include "distributed/metadata_cache.h"
@@ -26,6 +27,7 @@
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
 #include "distributed/subplan_execution.h"
+#include "storage/latch.h"
 
 #include <errno.h>
 #include <unistd.h>
@@ -611,6 +613,40 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnByte
 }
 
 
+/*
+ * MultiClientWaitForInput sleeps until the given connection's socket becomes
+ * readable, so that callers looping over MultiClientResultStatus() or
+ * MultiClientCopyData() do not spin while the remote node is still sending.
+ */
+void
+MultiClientWaitForInput(int32 connectionId)
+{
+	Assert(connectionId != INVALID_CONNECTION_ID);
+	MultiConnection *connection = ClientConnectionArray[connectionId];
+	Assert(connection != NULL);
+
+	int socket = PQsocket(connection->pgConn);
+	if (socket < 0)
+	{
+		return;
+	}
+
+	int waitFlags = WL_SOCKET_READABLE | WL_LATCH_SET | WL_POSTMASTER_DEATH;
+	int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, -1L, PG_WAIT_EXTENSION);
+
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+	}
+
+	if (rc & WL_LATCH_SET)
+	{
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
 /*
  * ClientConnectionReady checks if the given connection is ready for non-blocking
  * reads or writes. This function is loosely based on pqSocketCheck() at fe-misc.c
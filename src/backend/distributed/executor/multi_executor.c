@@ -33,6 +33,7 @@
 #include "distributed/multi_server_executor.h"
 #include "distributed/resource_lock.h"
 #include "distributed/transaction_management.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_shard_visibility.h"
 #include "distributed/worker_protocol.h"
 #include "executor/execdebug.h"
@@ -70,9 +71,11 @@ int ExecutorLevel = 0;
 
 
 /* local function forward declarations */
-static Relation StubRelation(TupleDesc tupleDescriptor);
 static bool AlterTableConstraintCheck(QueryDesc *queryDesc);
 static List * FindCitusCustomScanStates(PlanState *planState);
+static void ReadNextTupleFromTuplestore(CitusScanState *scanState,
+										bool forwardScanDirection,
+										TupleTableSlot *slot);
 static bool CitusCustomScanStateWalker(PlanState *planState,
 									   List **citusCustomScanStates);
 
@@ -191,6 +194,12 @@ CitusExecutorRun(QueryDesc *queryDesc,
 			CitusScanState *citusScanState = NULL;
 			foreach_ptr(citusScanState, citusCustomScanStates)
 			{
+				if (!citusScanState->finishedRemoteScan)
+				{
+					/* rows are fetched in batches, e.g. by FETCH from a cursor */
+					citusScanState->incrementalFetch = count > 0;
+				}
+
 				if (citusScanState->PreExecScan)
 				{
 					citusScanState->PreExecScan(citusScanState);
@@ -258,6 +267,29 @@ CitusCustomScanStateWalker(PlanState *planState, List **citusCustomScanStates)
 }
 
 
+/*
+ * ReadNextTupleFromTuplestore reads the next tuple from the tuple store of the
+ * given Citus scan node into the slot. If the distributed execution of the scan
+ * is still running, it first makes sure that the tuple is in the tuple store.
+ */
+static void
+ReadNextTupleFromTuplestore(CitusScanState *scanState, bool forwardScanDirection,
+							TupleTableSlot *slot)
+{
+	if (scanState->distributedExecution != NULL)
+	{
+		ContinueStreamingExecution(scanState, forwardScanDirection);
+	}
+
+	bool foundTuple = tuplestore_gettupleslot(scanState->tuplestorestate,
+											  forwardScanDirection, false, slot);
+	if (foundTuple && forwardScanDirection)
+	{
+		scanState->streamedTupleCount++;
+	}
+}
+
+
 /*
  * ReturnTupleFromTuplestore reads the next tuple from the tuple store of the
  * given Citus scan node and returns it. It returns null if all tuples are read
@@ -291,7 +323,7 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
 	{
 		/* no quals, nor projections return directly from the tuple store. */
 		TupleTableSlot *slot = scanState->customScanState.ss.ss_ScanTupleSlot;
-		tuplestore_gettupleslot(tupleStore, forwardScanDirection, false, slot);
+		ReadNextTupleFromTuplestore(scanState, forwardScanDirection, slot);
 		return slot;
 	}
 
@@ -310,7 +342,7 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
 		ResetExprContext(econtext);
 
 		TupleTableSlot *slot = scanState->customScanState.ss.ss_ScanTupleSlot;
-		tuplestore_gettupleslot(tupleStore, forwardScanDirection, false, slot);
+		ReadNextTupleFromTuplestore(scanState, forwardScanDirection, slot);
 
 		if (TupIsNull(slot))
 		{
@@ -406,6 +438,20 @@ LoadTuplesIntoTupleStore(CitusScanState *citusScanState, Job *workerJob)
 void
 ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescriptor,
 					   Tuplestorestate *tupstore)
+{
+	ReadCopyDataIntoTupleStore(fileName, NULL, copyFormat, tupleDescriptor, tupstore);
+}
+
+
+/*
+ * ReadCopyDataIntoTupleStore parses COPY-formatted records according to the
+ * given tuple descriptor and stores the records in a tuple store. The records
+ * are read from fileName, or from dataSourceCallback when it is not NULL.
+ */
+void
+ReadCopyDataIntoTupleStore(char *fileName, copy_data_source_cb dataSourceCallback,
+						   char *copyFormat, TupleDesc tupleDescriptor,
+						   Tuplestorestate *tupstore)
 {
 	/*
 	 * Trick BeginCopyFrom into using our tuple descriptor by pretending it belongs
@@ -428,8 +474,8 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 									  location);
 	copyOptions = lappend(copyOptions, copyOption);
 
-	CopyState copyState = BeginCopyFrom(NULL, stubRelation, fileName, false, NULL,
-										NULL, copyOptions);
+	CopyState copyState = BeginCopyFrom(NULL, stubRelation, fileName, false,
+										dataSourceCallback, NULL, copyOptions);
 
 	while (true)
 	{
@@ -444,6 +490,8 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 			break;
 		}
 
+		CompressValuesForTuplestore(tupstore, tupleDescriptor, columnValues,
+									columnNulls);
 		tuplestore_putvalues(tupstore, tupleDescriptor, columnValues, columnNulls);
 		MemoryContextSwitchTo(oldContext);
 	}
@@ -459,7 +507,8 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
  * entries in the target entry list, starting from the first one and
  * ending with the last entry.
  *
- * The sorting is done in ASC order.
+ * The sorting is done in ASC order. Rows that do not fit in work_mem are
+ * sorted on disk.
  */
 void
 SortTupleStore(CitusScanState *scanState)
@@ -519,21 +568,25 @@ SortTupleStore(CitusScanState *scanState)
 		tuplesort_puttupleslot(tuplesortstate, slot);
 	}
 
-	/* perform the actual sort operation */
-	tuplesort_performsort(tuplesortstate);
-
 	/*
 	 * Truncate the existing tupleStore, because we'll fill it back
-	 * from the sorted tuplestore.
+	 * from the sorted tuplestore. We do this before sorting, such that
+	 * the files of the tuple store are removed before the sort writes
+	 * its runs when the rows do not fit in work_mem.
 	 */
 	tuplestore_clear(tupleStore);
 
+	/* perform the actual sort operation */
+	tuplesort_performsort(tuplesortstate);
+
+	TupleTableSlot *sortedSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+																&TTSOpsMinimalTuple);
+
 	/* iterate over all the sorted tuples, add them to original tuplestore */
 	while (true)
 	{
-		TupleTableSlot *newSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
-																 &TTSOpsMinimalTuple);
-		bool found = tuplesort_gettupleslot(tuplesortstate, true, false, newSlot, NULL);
+		bool found = tuplesort_gettupleslot(tuplesortstate, true, false, sortedSlot,
+											NULL);
 
 		if (!found)
 		{
@@ -541,11 +594,13 @@ SortTupleStore(CitusScanState *scanState)
 		}
 
 		/* tuplesort_puttupleslot copies the slot into the tupleStore context */
-		tuplestore_puttupleslot(tupleStore, newSlot);
+		tuplestore_puttupleslot(tupleStore, sortedSlot);
 	}
 
 	tuplestore_rescan(scanState->tuplestorestate);
 
+	ExecDropSingleTupleTableSlot(sortedSlot);
+
 	/* terminate the sort, clear unnecessary resources */
 	tuplesort_end(tuplesortstate);
 }
@@ -557,7 +612,7 @@ SortTupleStore(CitusScanState *scanState)
  * relation corresponding to the data loaded from workers, we need to fake one.
  * We just need the bare minimal set of fields accessed by BeginCopyFrom().
  */
-static Relation
+Relation
 StubRelation(TupleDesc tupleDescriptor)
 {
 	Relation stubRelation = palloc0(sizeof(RelationData));
@@ -0,0 +1,227 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_row_insert_copy.c
+ *    Executing large multi-row INSERTs through COPY.
+ *
+ * A multi-row INSERT is normally executed by grouping its VALUES lists by
+ * shard and deparsing a multi-row INSERT per shard, which the workers then
+ * parse and plan. Both the deparsing on the coordinator and the parsing on
+ * the workers grow with the number of rows, which makes the large INSERTs
+ * that ORMs tend to generate expensive.
+ *
+ * When the number of rows reaches citus.multi_row_insert_copy_threshold, we
+ * instead send the rows to the shards through the CitusCopyDestReceiver, in
+ * the same way as COPY and INSERT ... SELECT via the coordinator do. This is
+ * only done once all functions and parameters in the VALUES lists have been
+ * evaluated to constants, and for INSERTs without RETURNING and ON CONFLICT,
+ * which COPY cannot express.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/tupdesc.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_row_insert_copy.h"
+#include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
+#include "executor/tuptable.h"
+#include "parser/parsetree.h"
+
+
+/* config variable managed via guc.c */
+int MultiRowInsertCopyThreshold = 0;
+
+
+static Index InsertValuesRangeTableIndex(Query *jobQuery);
+
+
+/*
+ * CanExecuteMultiRowInsertAsCopy returns whether the given multi-row INSERT,
+ * whose functions and parameters have been evaluated, can be executed through
+ * COPY and has enough rows for that to be worthwhile. That requires every
+ * column of every row to be a constant, which also rules out volatile
+ * defaults such as nextval calls that are left to the workers.
+ */
+bool
+CanExecuteMultiRowInsertAsCopy(Query *jobQuery)
+{
+	if (MultiRowInsertCopyThreshold <= 0)
+	{
+		return false;
+	}
+
+	if (jobQuery->returningList != NIL || jobQuery->onConflict != NULL ||
+		jobQuery->cteList != NIL)
+	{
+		return false;
+	}
+
+	Index valuesRangeTableIndex = InsertValuesRangeTableIndex(jobQuery);
+	if (valuesRangeTableIndex == 0)
+	{
+		return false;
+	}
+
+	RangeTblEntry *valuesRangeTableEntry = rt_fetch(valuesRangeTableIndex,
+													jobQuery->rtable);
+	if (list_length(valuesRangeTableEntry->values_lists) < MultiRowInsertCopyThreshold)
+	{
+		return false;
+	}
+
+	Oid relationId = rt_fetch(jobQuery->resultRelation, jobQuery->rtable)->relid;
+	if (PartitionMethod(relationId) == DISTRIBUTE_BY_APPEND)
+	{
+		return false;
+	}
+
+	/* each column should directly refer to the VALUES lists */
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, jobQuery->targetList)
+	{
+		Var *column = (Var *) targetEntry->expr;
+
+		if (targetEntry->resjunk || !IsA(column, Var) ||
+			column->varno != valuesRangeTableIndex)
+		{
+			return false;
+		}
+	}
+
+	List *valuesList = NIL;
+	foreach_ptr(valuesList, valuesRangeTableEntry->values_lists)
+	{
+		Node *value = NULL;
+		foreach_ptr(value, valuesList)
+		{
+			if (!IsA(value, Const))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ExecuteMultiRowInsertAsCopy sends the rows of the given multi-row INSERT to
+ * the shards of the target table over COPY.
+ */
+void
+ExecuteMultiRowInsertAsCopy(Query *jobQuery, EState *executorState)
+{
+	Oid relationId = rt_fetch(jobQuery->resultRelation, jobQuery->rtable)->relid;
+	Index valuesRangeTableIndex = InsertValuesRangeTableIndex(jobQuery);
+	RangeTblEntry *valuesRangeTableEntry = rt_fetch(valuesRangeTableIndex,
+													jobQuery->rtable);
+	Var *partitionColumn = PartitionColumn(relationId, 0);
+	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
+	int columnCount = list_length(jobQuery->targetList);
+	AttrNumber *valuesColumnNumbers = palloc0(columnCount * sizeof(AttrNumber));
+	List *columnNameList = NIL;
+	int columnIndex = 0;
+	bool stopOnFailure = false;
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(columnCount);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(columnCount, false);
+#endif
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, jobQuery->targetList)
+	{
+		Var *column = (Var *) targetEntry->expr;
+
+		TupleDescInitEntry(tupleDescriptor, (AttrNumber) (columnIndex + 1),
+						   targetEntry->resname, column->vartype, column->vartypmod, 0);
+
+		columnNameList = lappend(columnNameList, targetEntry->resname);
+		valuesColumnNumbers[columnIndex] = column->varattno;
+
+		if (partitionColumn != NULL && targetEntry->resno == partitionColumn->varattno)
+		{
+			partitionColumnIndex = columnIndex;
+		}
+
+		columnIndex++;
+	}
+
+	if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+	{
+		stopOnFailure = true;
+	}
+
+	CitusCopyDestReceiver *copyDest = CreateCitusCopyDestReceiver(relationId,
+																  columnNameList,
+																  partitionColumnIndex,
+																  executorState,
+																  stopOnFailure, NULL);
+	DestReceiver *dest = (DestReceiver *) copyDest;
+
+	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+																	&TTSOpsVirtual);
+
+	dest->rStartup(dest, 0, tupleDescriptor);
+
+	List *valuesList = NIL;
+	foreach_ptr(valuesList, valuesRangeTableEntry->values_lists)
+	{
+		ExecClearTuple(tupleTableSlot);
+
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			AttrNumber valuesColumnNumber = valuesColumnNumbers[columnIndex];
+			Const *value = (Const *) list_nth(valuesList, valuesColumnNumber - 1);
+
+			tupleTableSlot->tts_values[columnIndex] = value->constvalue;
+			tupleTableSlot->tts_isnull[columnIndex] = value->constisnull;
+		}
+
+		ExecStoreVirtualTuple(tupleTableSlot);
+
+		dest->receiveSlot(tupleTableSlot, dest);
+	}
+
+	dest->rShutdown(dest);
+	dest->rDestroy(dest);
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+
+	executorState->es_processed = copyDest->tuplesSent;
+
+	XactModificationLevel = XACT_MODIFICATION_DATA;
+}
+
+
+/*
+ * InsertValuesRangeTableIndex returns the range table index of the VALUES
+ * lists of the given multi-row INSERT, or 0 if it has none.
+ */
+static Index
+InsertValuesRangeTableIndex(Query *jobQuery)
+{
+	Index rangeTableIndex = 1;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, jobQuery->rtable)
+	{
+		if (rangeTableEntry->rtekind == RTE_VALUES)
+		{
+			return rangeTableIndex;
+		}
+
+		rangeTableIndex++;
+	}
+
+	return 0;
+}
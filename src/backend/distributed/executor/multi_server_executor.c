@@ -38,6 +38,7 @@ bool EnableRepartitionJoins = false;
 
 
 static bool HasReplicatedDistributedTable(List *relationOids);
+static bool HasRepartitionJoin(Job *job);
 
 /*
  * JobExecutorType selects the executor type for the given distributedPlan using the task
@@ -102,7 +103,7 @@ JobExecutorType(DistributedPlan *distributedPlan)
 		int dependentJobCount = list_length(job->dependentJobList);
 		if (dependentJobCount > 0)
 		{
-			if (!EnableRepartitionJoins)
+			if (!EnableRepartitionJoins && HasRepartitionJoin(job))
 			{
 				ereport(ERROR, (errmsg(
 									"the query contains a join that requires repartitioning"),
@@ -135,6 +136,32 @@ JobExecutorType(DistributedPlan *distributedPlan)
 }
 
 
+/*
+ * HasRepartitionJoin returns whether the given job depends on repartition jobs
+ * for joins. The other repartition jobs are those of subqueries that we plan
+ * for citus.enable_repartitioned_aggregation, which combine the aggregates of
+ * the subquery in their reduce query, or for
+ * citus.enable_repartitioned_window_functions, which compute the window
+ * functions of the subquery in their reduce query.
+ */
+static bool
+HasRepartitionJoin(Job *job)
+{
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		MapMergeJob *mapMergeJob = (MapMergeJob *) dependentJob;
+
+		if (mapMergeJob->reduceQuery == NULL || HasRepartitionJoin(dependentJob))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * HasReplicatedDistributedTable returns true if there is any
  * table in the given list that is:
@@ -186,7 +213,7 @@ void
 RemoveJobDirectory(uint64 jobId)
 {
 	StringInfo jobDirectoryName = MasterJobDirectoryName(jobId);
-	CitusRemoveDirectory(jobDirectoryName->data);
+	CitusRemoveDirectoryDeferred(jobDirectoryName->data);
 
 	ResourceOwnerForgetJobDirectory(CurrentResourceOwner, jobId);
 }
@@ -209,6 +236,7 @@ InitTaskExecution(Task *task, TaskExecStatus initialTaskExecStatus)
 	taskExecution->nodeCount = nodeCount;
 	taskExecution->currentNodeIndex = 0;
 	taskExecution->failureCount = 0;
+	taskExecution->priority = 0;
 
 	taskExecution->taskStatusArray = palloc0(nodeCount * sizeof(TaskExecStatus));
 	taskExecution->transmitStatusArray = palloc0(nodeCount * sizeof(TransmitExecStatus));
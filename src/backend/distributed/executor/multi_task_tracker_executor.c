@@ -52,6 +52,7 @@
 
 int MaxAssignTaskBatchSize = 64; /* maximum number of tasks to assign per round */
 int MaxTaskStatusBatchSize = 64; /* maximum number of tasks status checks per round */
+int TaskStatusWaitTimeout = 100; /* how long trackers hold status checks, in ms */
 
 
 /* TaskMapKey is used as a key in task hash */
@@ -80,6 +81,7 @@ static HTAB * TaskHashCreate(uint32 taskHashSize);
 static Task * TaskHashEnter(HTAB *taskHash, Task *task);
 static Task * TaskHashLookup(HTAB *trackerHash, TaskType taskType, uint64 jobId,
 							 uint32 taskId);
+static void AssignTaskPriorities(List *taskAndExecutionList);
 static bool TopLevelTask(Task *task);
 static bool TransmitExecutionCompleted(TaskExecution *taskExecution);
 static HTAB * TrackerHash(const char *taskTrackerHashName, List *workerNodeList,
@@ -94,6 +96,8 @@ static TaskTracker * ResolveTaskTracker(HTAB *trackerHash, Task *task,
 										TaskExecution *taskExecution);
 static TaskTracker * ResolveMapTaskTracker(HTAB *trackerHash, Task *task,
 										   TaskExecution *taskExecution);
+static void BalanceTaskExecution(HTAB *trackerHash, Task *task,
+								 TaskExecution *taskExecution);
 static TaskTracker * TrackerHashLookup(HTAB *trackerHash, const char *nodeName,
 									   uint32 nodePort);
 static void PrepareMasterJobDirectory(Job *workerJob);
@@ -115,6 +119,7 @@ static StringInfo TaskAssignmentQuery(Task *task, char *queryString);
 static TaskStatus TrackerTaskStatus(TaskTracker *taskTracker, Task *task);
 static TrackerTaskState * TrackerTaskStateHashLookup(HTAB *taskStateHash, Task *task);
 static bool TrackerHealthy(TaskTracker *taskTracker);
+static uint32 TrackerPendingTaskCount(TaskTracker *taskTracker);
 static void TrackerQueueFileTransmit(TaskTracker *transmitTracker, Task *task);
 static TrackerTaskState * TaskStateHashEnter(HTAB *taskStateHash, uint64 jobId,
 											 uint32 taskId);
@@ -134,8 +139,12 @@ static void ManageTaskTracker(TaskTracker *taskTracker);
 static bool TrackerConnectionUp(TaskTracker *taskTracker);
 static void TrackerReconnectPoll(TaskTracker *taskTracker);
 static List * AssignQueuedTasks(TaskTracker *taskTracker);
+static int CompareTrackerTaskStatesByPriority(const void *leftElement,
+											  const void *rightElement);
 static List * TaskStatusBatchList(TaskTracker *taskTracker);
-static StringInfo TaskStatusBatchQuery(List *taskList);
+static bool TrackerCanWaitForTaskStatus(TaskTracker *taskTracker,
+										List *taskStatusBatchList);
+static StringInfo TaskStatusBatchQuery(List *taskList, bool waitForTaskStatus);
 static void ReceiveTaskStatusBatchQueryResponse(TaskTracker *taskTracker);
 static void ManageTransmitTracker(TaskTracker *transmitTracker);
 static TrackerTaskState * NextQueuedFileTransmit(HTAB *taskStateHash);
@@ -238,6 +247,9 @@ MultiTaskTrackerExecute(Job *job)
 		{
 			TaskExecution *taskExecution = task->taskExecution;
 
+			/* move the task to an idle replica if its tracker is backed up */
+			BalanceTaskExecution(taskTrackerHash, task, taskExecution);
+
 			TaskTracker *execTaskTracker = ResolveTaskTracker(taskTrackerHash,
 															  task, taskExecution);
 			TaskTracker *mapTaskTracker = ResolveMapTaskTracker(taskTrackerHash,
@@ -376,6 +388,8 @@ MultiTaskTrackerExecute(Job *job)
 
 			ManageTaskTracker(taskTracker);
 
+			taskTracker->pendingTaskCount = TrackerPendingTaskCount(taskTracker);
+
 			taskTracker = (TaskTracker *) hash_seq_search(&taskStatus);
 		}
 
@@ -520,10 +534,53 @@ TaskAndExecutionList(List *jobTaskList)
 		}
 	}
 
+	AssignTaskPriorities(taskAndExecutionList);
+
 	return taskAndExecutionList;
 }
 
 
+/*
+ * AssignTaskPriorities sets each task's priority to the length of the longest
+ * chain of tasks that wait on it, so that top level tasks get zero and tasks on
+ * the job's critical path get the highest values. Task trackers run assigned
+ * tasks with higher priorities first, which keeps long dependency chains from
+ * waiting behind tasks that nothing else depends on.
+ */
+static void
+AssignTaskPriorities(List *taskAndExecutionList)
+{
+	bool priorityChanged = true;
+
+	/*
+	 * The breadth-first order of the list puts most tasks after the tasks that
+	 * depend on them, so this usually settles after two passes. Dependencies
+	 * form a DAG, so the loop always terminates.
+	 */
+	while (priorityChanged)
+	{
+		priorityChanged = false;
+
+		Task *task = NULL;
+		foreach_ptr(task, taskAndExecutionList)
+		{
+			uint32 dependentPriority = task->taskExecution->priority + 1;
+
+			Task *dependentTask = NULL;
+			foreach_ptr(dependentTask, task->dependentTaskList)
+			{
+				TaskExecution *dependentExecution = dependentTask->taskExecution;
+				if (dependentExecution->priority < dependentPriority)
+				{
+					dependentExecution->priority = dependentPriority;
+					priorityChanged = true;
+				}
+			}
+		}
+	}
+}
+
+
 /*
  * TaskHashCreate allocates memory for a task hash, initializes an
  * empty hash, and returns this hash.
@@ -948,6 +1005,90 @@ ResolveTaskTracker(HTAB *trackerHash, Task *task, TaskExecution *taskExecution)
 }
 
 
+/*
+ * BalanceTaskExecution moves the given task to the least loaded healthy task
+ * tracker that holds one of its placements, before the task is sent to its
+ * current tracker. Tasks that were queued but not yet assigned remotely are
+ * also stolen by replicas that ran out of work. Only SQL tasks without any
+ * dependencies are moved: they form a constraint group of their own, and the
+ * task tracker protocol offers no way to withdraw a task once it is assigned.
+ */
+static void
+BalanceTaskExecution(HTAB *trackerHash, Task *task, TaskExecution *taskExecution)
+{
+	TaskExecStatus *taskStatusArray = taskExecution->taskStatusArray;
+	uint32 currentNodeIndex = taskExecution->currentNodeIndex;
+	TrackerTaskState *queuedTaskState = NULL;
+
+	if (task->taskType != SELECT_TASK || task->dependentTaskList != NIL ||
+		taskExecution->nodeCount < 2 || taskExecution->failureCount > 0)
+	{
+		return;
+	}
+
+	TaskTracker *currentTracker = ResolveTaskTracker(trackerHash, task, taskExecution);
+
+	TaskExecStatus currentExecutionStatus = taskStatusArray[currentNodeIndex];
+	if (currentExecutionStatus == EXEC_TASK_QUEUED)
+	{
+		queuedTaskState = TrackerTaskStateHashLookup(currentTracker->taskStateHash,
+													 task);
+		if (queuedTaskState == NULL ||
+			queuedTaskState->status != TASK_CLIENT_SIDE_QUEUED)
+		{
+			return;
+		}
+	}
+	else if (currentExecutionStatus != EXEC_TASK_UNASSIGNED)
+	{
+		return;
+	}
+
+	/* queued tasks are only stolen by idle trackers, to avoid ping-ponging */
+	uint32 targetPendingTaskCount = currentTracker->pendingTaskCount;
+	if (queuedTaskState != NULL)
+	{
+		targetPendingTaskCount = 1;
+	}
+
+	uint32 targetNodeIndex = currentNodeIndex;
+	for (uint32 nodeIndex = 0; nodeIndex < taskExecution->nodeCount; nodeIndex++)
+	{
+		ShardPlacement *taskPlacement = list_nth(task->taskPlacementList, nodeIndex);
+		TaskTracker *taskTracker = TrackerHashLookup(trackerHash,
+													 taskPlacement->nodeName,
+													 taskPlacement->nodePort);
+
+		if (nodeIndex == currentNodeIndex || !TrackerHealthy(taskTracker) ||
+			!TrackerConnectionUp(taskTracker))
+		{
+			continue;
+		}
+
+		if (taskTracker->pendingTaskCount < targetPendingTaskCount)
+		{
+			targetPendingTaskCount = taskTracker->pendingTaskCount;
+			targetNodeIndex = nodeIndex;
+		}
+	}
+
+	if (targetNodeIndex == currentNodeIndex)
+	{
+		return;
+	}
+
+	if (queuedTaskState != NULL)
+	{
+		hash_search(currentTracker->taskStateHash, queuedTaskState, HASH_REMOVE, NULL);
+		currentTracker->pendingTaskCount--;
+
+		taskStatusArray[currentNodeIndex] = EXEC_TASK_UNASSIGNED;
+	}
+
+	taskExecution->currentNodeIndex = targetNodeIndex;
+}
+
+
 /*
  * ResolveMapTaskTracker is a helper function that finds the downstream map task
  * dependency from the given task, and then resolves the task tracker for this
@@ -1590,7 +1731,10 @@ TrackerQueueSqlTask(TaskTracker *taskTracker, Task *task)
 	TrackerTaskState *taskState = TaskStateHashEnter(taskStateHash, task->jobId,
 													 task->taskId);
 	taskState->status = TASK_CLIENT_SIDE_QUEUED;
+	taskState->priority = task->taskExecution->priority;
 	taskState->taskAssignmentQuery = taskAssignmentQuery;
+
+	taskTracker->pendingTaskCount++;
 }
 
 
@@ -1612,24 +1756,36 @@ TrackerQueueTask(TaskTracker *taskTracker, Task *task)
 	TrackerTaskState *taskState = TaskStateHashEnter(taskStateHash, task->jobId,
 													 task->taskId);
 	taskState->status = TASK_CLIENT_SIDE_QUEUED;
+	taskState->priority = task->taskExecution->priority;
 	taskState->taskAssignmentQuery = taskAssignmentQuery;
+
+	taskTracker->pendingTaskCount++;
 }
 
 
 /*
  * TaskAssignmentQuery escapes the given query string with quotes, and wraps
  * this escaped query string inside a task assignment command. This way, the
- * query can be assigned to the remote task tracker.
+ * query can be assigned to the remote task tracker. The task's priority is
+ * passed along so that the task tracker can schedule by it.
  */
 static StringInfo
 TaskAssignmentQuery(Task *task, char *queryString)
 {
+	uint32 priority = 0;
+
 	/* quote the original query as a string literal */
 	char *escapedQueryString = quote_literal_cstr(queryString);
 
+	/* job cleanup tasks have no execution, the task tracker prioritizes them */
+	if (task->taskExecution != NULL)
+	{
+		priority = task->taskExecution->priority;
+	}
+
 	StringInfo taskAssignmentQuery = makeStringInfo();
 	appendStringInfo(taskAssignmentQuery, TASK_ASSIGNMENT_QUERY,
-					 task->jobId, task->taskId, escapedQueryString);
+					 task->jobId, task->taskId, escapedQueryString, priority);
 
 	return taskAssignmentQuery;
 }
@@ -1699,6 +1855,36 @@ TrackerHealthy(TaskTracker *taskTracker)
 }
 
 
+/*
+ * TrackerPendingTaskCount returns the number of tasks that are queued on or
+ * assigned to the given task tracker and have not finished yet.
+ */
+static uint32
+TrackerPendingTaskCount(TaskTracker *taskTracker)
+{
+	uint32 pendingTaskCount = 0;
+	HASH_SEQ_STATUS status;
+
+	hash_seq_init(&status, taskTracker->taskStateHash);
+
+	TrackerTaskState *taskState = (TrackerTaskState *) hash_seq_search(&status);
+	while (taskState != NULL)
+	{
+		TaskStatus taskStatus = taskState->status;
+		if (taskStatus == TASK_CLIENT_SIDE_QUEUED || taskStatus == TASK_ASSIGNED ||
+			taskStatus == TASK_SCHEDULED || taskStatus == TASK_RUNNING ||
+			taskStatus == TASK_FAILED)
+		{
+			pendingTaskCount++;
+		}
+
+		taskState = (TrackerTaskState *) hash_seq_search(&status);
+	}
+
+	return pendingTaskCount;
+}
+
+
 /*
  * TrackerQueueFileTransmit queues a file transmit request in the given task
  * tracker's internal hash. The queued request will be served at a later time.
@@ -1741,6 +1927,7 @@ TaskStateHashEnter(HTAB *taskStateHash, uint64 jobId, uint32 taskId)
 
 	/* init task state object */
 	taskState->status = TASK_STATUS_INVALID_FIRST;
+	taskState->priority = 0;
 	taskState->taskAssignmentQuery = NULL;
 
 	return taskState;
@@ -2110,7 +2297,11 @@ ManageTaskTracker(TaskTracker *taskTracker)
 		{
 			int32 connectionId = taskTracker->connectionId;
 
-			StringInfo taskStatusBatchQuery = TaskStatusBatchQuery(taskStatusBatchList);
+			/* with nothing left to assign, let the tracker tell us what finished */
+			bool waitForTaskStatus = TrackerCanWaitForTaskStatus(taskTracker,
+																 taskStatusBatchList);
+			StringInfo taskStatusBatchQuery = TaskStatusBatchQuery(taskStatusBatchList,
+																   waitForTaskStatus);
 
 			bool querySent = MultiClientSendQuery(connectionId,
 												  taskStatusBatchQuery->data);
@@ -2118,6 +2309,7 @@ ManageTaskTracker(TaskTracker *taskTracker)
 			{
 				taskTracker->connectionBusy = true;
 				taskTracker->connectionBusyOnTaskList = taskStatusBatchList;
+				taskTracker->connectionBusyOnWait = waitForTaskStatus;
 			}
 			else
 			{
@@ -2130,6 +2322,7 @@ ManageTaskTracker(TaskTracker *taskTracker)
 
 				taskTracker->connectionBusy = false;
 				taskTracker->connectionBusyOnTaskList = NIL;
+				taskTracker->connectionBusyOnWait = false;
 			}
 
 			pfree(taskStatusBatchQuery);
@@ -2164,6 +2357,7 @@ ManageTaskTracker(TaskTracker *taskTracker)
 
 			taskTracker->connectionBusy = false;
 			taskTracker->connectionBusyOnTaskList = NIL;
+			taskTracker->connectionBusyOnWait = false;
 		}
 	}
 }
@@ -2232,7 +2426,8 @@ TrackerReconnectPoll(TaskTracker *taskTracker)
 /*
  * AssignQueuedTasks walks over the given task tracker's task state hash, finds
  * queued tasks in this hash, and synchronously assigns them to the given task
- * tracker. The function then returns the list of newly assigned tasks.
+ * tracker. Tasks with higher priorities are assigned first. The function then
+ * returns the list of newly assigned tasks.
  */
 static List *
 AssignQueuedTasks(TaskTracker *taskTracker)
@@ -2240,6 +2435,7 @@ AssignQueuedTasks(TaskTracker *taskTracker)
 	HTAB *taskStateHash = taskTracker->taskStateHash;
 	List *assignedTaskList = NIL;
 	uint32 taskAssignmentCount = 0;
+	List *queuedTaskList = NIL;
 	List *tasksToAssignList = NIL;
 	StringInfo assignTaskBatchQuery = makeStringInfo();
 	int32 connectionId = taskTracker->connectionId;
@@ -2252,22 +2448,30 @@ AssignQueuedTasks(TaskTracker *taskTracker)
 	{
 		if (taskState->status == TASK_CLIENT_SIDE_QUEUED)
 		{
-			StringInfo taskAssignmentQuery = taskState->taskAssignmentQuery;
-
-			appendStringInfo(assignTaskBatchQuery, "%s", taskAssignmentQuery->data);
-
-			tasksToAssignList = lappend(tasksToAssignList, taskState);
-			taskAssignmentCount++;
-			if (taskAssignmentCount >= MaxAssignTaskBatchSize)
-			{
-				hash_seq_term(&status);
-				break;
-			}
+			queuedTaskList = lappend(queuedTaskList, taskState);
 		}
 
 		taskState = (TrackerTaskState *) hash_seq_search(&status);
 	}
 
+	queuedTaskList = SortList(queuedTaskList, CompareTrackerTaskStatesByPriority);
+
+	foreach_ptr(taskState, queuedTaskList)
+	{
+		StringInfo taskAssignmentQuery = taskState->taskAssignmentQuery;
+
+		appendStringInfo(assignTaskBatchQuery, "%s", taskAssignmentQuery->data);
+
+		tasksToAssignList = lappend(tasksToAssignList, taskState);
+		taskAssignmentCount++;
+		if (taskAssignmentCount >= MaxAssignTaskBatchSize)
+		{
+			break;
+		}
+	}
+
+	list_free(queuedTaskList);
+
 	if (taskAssignmentCount > 0)
 	{
 		void *queryResult = NULL;
@@ -2315,6 +2519,30 @@ AssignQueuedTasks(TaskTracker *taskTracker)
 }
 
 
+/*
+ * CompareTrackerTaskStatesByPriority orders task states by descending priority,
+ * and then by task id to keep the assignment order deterministic.
+ */
+static int
+CompareTrackerTaskStatesByPriority(const void *leftElement, const void *rightElement)
+{
+	TrackerTaskState *leftTaskState = *((TrackerTaskState **) leftElement);
+	TrackerTaskState *rightTaskState = *((TrackerTaskState **) rightElement);
+
+	if (leftTaskState->priority != rightTaskState->priority)
+	{
+		return (leftTaskState->priority > rightTaskState->priority) ? -1 : 1;
+	}
+
+	if (leftTaskState->taskId != rightTaskState->taskId)
+	{
+		return (leftTaskState->taskId < rightTaskState->taskId) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
 /*
  * TaskStatusBatchList returns a list containing up to MaxTaskStatusBatchSize
  * tasks from the list of assigned tasks. When the number of tasks is greater
@@ -2376,16 +2604,87 @@ TaskStatusBatchList(TaskTracker *taskTracker)
 }
 
 
+/*
+ * TrackerCanWaitForTaskStatus returns whether the given status check can ask
+ * the task tracker to wait for a task to finish before answering. We only do
+ * so when no task waits to be assigned to the tracker, since the wait holds
+ * on to the connection, and when the batch covers all of the tracker's running
+ * tasks, so that we don't miss the completion of any other task.
+ */
+static bool
+TrackerCanWaitForTaskStatus(TaskTracker *taskTracker, List *taskStatusBatchList)
+{
+	HASH_SEQ_STATUS status;
+	int runningTaskCount = 0;
+
+	if (TaskStatusWaitTimeout <= 0)
+	{
+		return false;
+	}
+
+	hash_seq_init(&status, taskTracker->taskStateHash);
+
+	TrackerTaskState *taskState = (TrackerTaskState *) hash_seq_search(&status);
+	while (taskState != NULL)
+	{
+		TaskStatus taskStatus = taskState->status;
+		if (taskStatus == TASK_CLIENT_SIDE_QUEUED)
+		{
+			hash_seq_term(&status);
+			return false;
+		}
+
+		if (taskStatus == TASK_ASSIGNED || taskStatus == TASK_SCHEDULED ||
+			taskStatus == TASK_RUNNING || taskStatus == TASK_FAILED)
+		{
+			runningTaskCount++;
+		}
+
+		taskState = (TrackerTaskState *) hash_seq_search(&status);
+	}
+
+	return list_length(taskStatusBatchList) == runningTaskCount;
+}
+
+
 /*
  * TaskStatusBatchQuery builds a command string containing multiple
- * task_tracker_task_status queries from a TrackerTaskState list.
+ * task_tracker_task_status queries from a TrackerTaskState list. If asked to,
+ * the function prefixes these queries with a task_tracker_wait_for_any call
+ * that returns once one of the tasks finishes.
  */
 static StringInfo
-TaskStatusBatchQuery(List *taskList)
+TaskStatusBatchQuery(List *taskList, bool waitForTaskStatus)
 {
 	StringInfo taskStatusBatchQuery = makeStringInfo();
-
 	TrackerTaskState *taskState = NULL;
+
+	if (waitForTaskStatus)
+	{
+		StringInfo jobIdArray = makeStringInfo();
+		StringInfo taskIdArray = makeStringInfo();
+
+		const char *separator = "";
+
+		appendStringInfoString(jobIdArray, "ARRAY[");
+		appendStringInfoString(taskIdArray, "ARRAY[");
+
+		foreach_ptr(taskState, taskList)
+		{
+			appendStringInfo(jobIdArray, "%s" UINT64_FORMAT, separator,
+							 taskState->jobId);
+			appendStringInfo(taskIdArray, "%s%u", separator, taskState->taskId);
+
+			separator = ",";
+		}
+
+		appendStringInfoString(jobIdArray, "]::bigint[]");
+		appendStringInfoString(taskIdArray, "]::integer[]");
+
+		appendStringInfo(taskStatusBatchQuery, TASK_STATUS_WAIT_QUERY,
+						 jobIdArray->data, taskIdArray->data, TaskStatusWaitTimeout);
+	}
+
 	foreach_ptr(taskState, taskList)
 	{
 		appendStringInfo(taskStatusBatchQuery, TASK_STATUS_QUERY,
@@ -2412,6 +2711,23 @@ ReceiveTaskStatusBatchQueryResponse(TaskTracker *taskTracker)
 	int columnCount = 0;
 	void *queryResult = NULL;
 
+	/* skip over the result of the wait, the status queries tell us the rest */
+	if (taskTracker->connectionBusyOnWait)
+	{
+		BatchQueryStatus queryStatus = MultiClientBatchResult(connectionId, &queryResult,
+															  &rowCount, &columnCount);
+		MultiClientClearResult(queryResult);
+
+		if (queryStatus != CLIENT_BATCH_QUERY_CONTINUE)
+		{
+			/* remaining queries were not executed */
+			TrackerTaskState *firstTask = (TrackerTaskState *) linitial(checkedTaskList);
+			firstTask->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+
+			checkedTaskList = NIL;
+		}
+	}
+
 	TrackerTaskState *checkedTask = NULL;
 	foreach_ptr(checkedTask, checkedTaskList)
 	{
@@ -20,12 +20,14 @@
 #include "catalog/pg_am.h"
 #include "catalog/pg_type.h"
 #include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
 #include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "nodes/makefuncs.h"
 #include "nodes/primnodes.h"
@@ -68,6 +70,18 @@ typedef struct PartitionedResultDestReceiver
 	 * writes it to a result file.
 	 */
 	DestReceiver **partitionDestReceivers;
+
+	/*
+	 * Partition index of each shard, or NULL if every shard is a partition on
+	 * its own. Shards with a negative partition index are not sent anywhere.
+	 */
+	int *shardPartitionIndexes;
+
+	/*
+	 * Whether to skip tuples that do not belong to any partition, rather than
+	 * to error out.
+	 */
+	bool skipUnmatchedTuples;
 } PartitionedResultDestReceiver;
 
 static Portal StartPortalForQueryExecution(const char *queryString);
@@ -88,6 +102,8 @@ static PartitionedResultDestReceiver * CreatePartitionedResultDestReceiver(char
 																		   shardSearchInfo,
 																		   MemoryContext
 																		   perTupleContext);
+static int PartitionIndexForValue(PartitionedResultDestReceiver *partitionedDest,
+								  Datum partitionColumnValue);
 static void PartitionedResultDestReceiverStartup(DestReceiver *dest, int operation,
 												 TupleDesc inputTupleDescriptor);
 static bool PartitionedResultDestReceiverReceive(TupleTableSlot *slot,
@@ -354,6 +370,21 @@ QueryTupleShardSearchInfo(ArrayType *minValuesArray, ArrayType *maxValuesArray,
 
 	result->shardIntervalArrayLength = partitionCount;
 
+	/*
+	 * Hash partitioned intermediate results usually follow the hash ranges of
+	 * a distributed table, in which case we can find the partition of a tuple
+	 * by division rather than by binary search.
+	 */
+	if (partitionMethod == DISTRIBUTE_BY_HASH && !result->hasUninitializedShardInterval)
+	{
+		result->hasUniformHashDistribution =
+			HasUniformHashDistribution(result->sortedShardIntervalArray,
+									   partitionCount);
+		result->uniformHashShardIndexShift = UniformHashShardIndexShift(partitionCount);
+	}
+
+	BuildSortedShardBoundArrays(result);
+
 	return result;
 }
 
@@ -393,6 +424,87 @@ CreatePartitionedResultDestReceiver(char *resultIdPrefix, int partitionColumnInd
 }
 
 
+/*
+ * CreateNodePartitionedResultDestReceiver returns a DestReceiver that sends
+ * each tuple of an intermediate result only to the node in nodeList that has
+ * the shard of the given relation that the value in the partition column of
+ * the tuple belongs to. Tuples that belong to shards on other nodes, or that
+ * have a NULL partition column value, are not sent anywhere. Every node in
+ * nodeList gets a result file, also if no tuples belong to it.
+ *
+ * The function returns NULL if a shard of the relation does not have exactly
+ * one active placement, in which case the caller should send the whole result
+ * to all nodes.
+ */
+DestReceiver *
+CreateNodePartitionedResultDestReceiver(const char *resultId, EState *executorState,
+										List *nodeList, Oid relationId,
+										int partitionColumnIndex)
+{
+	CitusTableCacheEntry *shardSearchInfo = GetCitusTableCacheEntry(relationId);
+	int shardCount = shardSearchInfo->shardIntervalArrayLength;
+	int nodeCount = list_length(nodeList);
+
+	if (shardSearchInfo->partitionMethod != DISTRIBUTE_BY_HASH &&
+		shardSearchInfo->partitionMethod != DISTRIBUTE_BY_RANGE)
+	{
+		return NULL;
+	}
+
+	int *shardPartitionIndexes = palloc0(shardCount * sizeof(int));
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval =
+			shardSearchInfo->sortedShardIntervalArray[shardIndex];
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+
+		if (list_length(placementList) != 1)
+		{
+			pfree(shardPartitionIndexes);
+			return NULL;
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+		int nodeIndex = 0;
+
+		shardPartitionIndexes[shardIndex] = -1;
+
+		WorkerNode *workerNode = NULL;
+		foreach_ptr(workerNode, nodeList)
+		{
+			if (workerNode->nodeId == placement->nodeId)
+			{
+				shardPartitionIndexes[shardIndex] = nodeIndex;
+				break;
+			}
+
+			nodeIndex++;
+		}
+	}
+
+	bool binaryCopy = false;
+	PartitionedResultDestReceiver *resultDest =
+		CreatePartitionedResultDestReceiver(NULL, partitionColumnIndex, nodeCount,
+											NULL, binaryCopy, shardSearchInfo, NULL);
+	resultDest->shardPartitionIndexes = shardPartitionIndexes;
+	resultDest->skipUnmatchedTuples = true;
+
+	int nodeIndex = 0;
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		bool writeLocalFile = false;
+
+		resultDest->partitionDestReceivers[nodeIndex] =
+			CreateRemoteFileDestReceiver(resultId, executorState,
+										 list_make1(workerNode), writeLocalFile);
+		nodeIndex++;
+	}
+
+	return (DestReceiver *) resultDest;
+}
+
+
 /*
  * PartitionedResultDestReceiverStartup implements the rStartup interface of
  * PartitionedResultDestReceiver.
@@ -408,6 +520,12 @@ PartitionedResultDestReceiverStartup(DestReceiver *copyDest, int operation,
 	PartitionedResultDestReceiver *partitionedDest =
 		(PartitionedResultDestReceiver *) copyDest;
 	int partitionCount = partitionedDest->partitionCount;
+
+	if (partitionedDest->tupleDescriptor == NULL)
+	{
+		partitionedDest->tupleDescriptor = inputTupleDescriptor;
+	}
+
 	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
 	{
 		DestReceiver *partitionDest =
@@ -437,21 +555,23 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *copyDes
 
 	if (columnNulls[partitionedDest->partitionColumnIndex])
 	{
+		if (partitionedDest->skipUnmatchedTuples)
+		{
+			return true;
+		}
+
 		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
 						errmsg("the partition column value cannot be NULL")));
 	}
 
 	Datum partitionColumnValue = columnValues[partitionedDest->partitionColumnIndex];
-	ShardInterval *shardInterval = FindShardInterval(partitionColumnValue,
-													 partitionedDest->shardSearchInfo);
-	if (shardInterval == NULL)
+	int partitionIndex = PartitionIndexForValue(partitionedDest, partitionColumnValue);
+	if (partitionIndex < 0)
 	{
-		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-						errmsg("could not find shard for partition column "
-							   "value")));
+		/* only happens when skipping unmatched tuples */
+		return true;
 	}
 
-	int partitionIndex = shardInterval->shardIndex;
 	DestReceiver *partitionDest = partitionedDest->partitionDestReceivers[partitionIndex];
 	if (partitionDest == NULL)
 	{
@@ -472,6 +592,60 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *copyDes
 }
 
 
+/*
+ * PartitionIndexForValue returns the index of the partition that the given
+ * partition column value belongs to, or -1 if the value does not belong to
+ * any partition and unmatched tuples are skipped.
+ *
+ * This is called for every tuple, so for uniformly distributed hash ranges
+ * we skip the generic shard interval search and compute the index directly.
+ */
+static int
+PartitionIndexForValue(PartitionedResultDestReceiver *partitionedDest,
+					   Datum partitionColumnValue)
+{
+	CitusTableCacheEntry *shardSearchInfo = partitionedDest->shardSearchInfo;
+	int shardIndex = INVALID_SHARD_INDEX;
+
+	if (shardSearchInfo->partitionMethod == DISTRIBUTE_BY_HASH &&
+		shardSearchInfo->hasUniformHashDistribution)
+	{
+		Datum hashedValue =
+			HashPartitionColumnValue(shardSearchInfo->hashFunction,
+									 shardSearchInfo->partitionColumn->varcollid,
+									 partitionColumnValue);
+		int searchIndex = FindShardIntervalIndex(hashedValue, shardSearchInfo);
+
+		shardIndex = shardSearchInfo->sortedShardIntervalArray[searchIndex]->shardIndex;
+	}
+	else
+	{
+		ShardInterval *shardInterval = FindShardInterval(partitionColumnValue,
+														 shardSearchInfo);
+		if (shardInterval == NULL)
+		{
+			if (partitionedDest->skipUnmatchedTuples)
+			{
+				return -1;
+			}
+
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find shard for partition column "
+								   "value")));
+		}
+
+		shardIndex = shardInterval->shardIndex;
+	}
+
+	if (partitionedDest->shardPartitionIndexes != NULL)
+	{
+		return partitionedDest->shardPartitionIndexes[shardIndex];
+	}
+
+	return shardIndex;
+}
+
+
 /*
  * PartitionedResultDestReceiverShutdown implements the rShutdown interface of
  * PartitionedResultDestReceiver.
@@ -515,6 +689,11 @@ PartitionedResultDestReceiverDestroy(DestReceiver *copyDest)
 		}
 	}
 
+	if (partitionedDest->shardPartitionIndexes != NULL)
+	{
+		pfree(partitionedDest->shardPartitionIndexes);
+	}
+
 	pfree(partitionedDest->partitionDestReceivers);
 	pfree(partitionedDest);
 }
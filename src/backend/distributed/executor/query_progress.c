@@ -0,0 +1,219 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_progress.c
+ *    Progress of long-running distributed executions per worker.
+ *
+ * Distributed executions with at least citus.query_progress_min_task_count
+ * tasks publish how many of their tasks are queued, running and done on
+ * each worker, and how many rows and bytes they received so far, through a
+ * progress monitor in dynamic shared memory. citus_stat_progress_query()
+ * reads the monitors of all backends.
+ *
+ * A backend can only report the progress of one command at a time, so an
+ * execution that starts while another progress monitor is active, such as
+ * the one of a rebalance or of an outer execution, does not publish its
+ * progress.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_progress.h"
+#include "distributed/query_progress.h"
+#include "distributed/tuplestore.h"
+#include "utils/builtins.h"
+
+
+#define QUERY_PROGRESS_MAGIC_NUMBER 0x51554552
+#define CITUS_STAT_PROGRESS_QUERY_COLUMNS 11
+
+
+/* GUC, minimum number of tasks of executions that publish their progress */
+int QueryProgressMinTaskCount = 32;
+
+
+PG_FUNCTION_INFO_V1(citus_stat_progress_query);
+
+
+/*
+ * citus_stat_progress_query returns a row for each worker of the distributed
+ * executions that are running in any backend and publish their progress.
+ */
+Datum
+citus_stat_progress_query(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegments = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(QUERY_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegments);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		QueryProgressWorker *steps = (QueryProgressWorker *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			QueryProgressWorker *progress = &steps[stepIndex];
+			Datum values[CITUS_STAT_PROGRESS_QUERY_COLUMNS];
+			bool isNulls[CITUS_STAT_PROGRESS_QUERY_COLUMNS];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = Int32GetDatum(progress->initiatorNodeIdentifier);
+			values[2] = Int64GetDatum(progress->transactionNumber);
+			values[3] = CStringGetTextDatum(progress->nodeName);
+			values[4] = Int32GetDatum(progress->nodePort);
+			values[5] = Int64GetDatum(progress->taskCount);
+			values[6] = Int64GetDatum(progress->queuedTaskCount);
+			values[7] = Int64GetDatum(progress->runningTaskCount);
+			values[8] = Int64GetDatum(progress->doneTaskCount);
+			values[9] = Int64GetDatum(progress->rowsReceived);
+			values[10] = Int64GetDatum(progress->bytesReceived);
+
+			/* the transaction is only known once the execution started it */
+			isNulls[1] = isNulls[2] = (progress->transactionNumber == 0);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegments);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * StartQueryProgress creates a progress monitor with a step for every worker
+ * on which the given tasks have placements, if the execution is large enough
+ * and no other progress monitor is active. Otherwise, it returns NULL.
+ */
+QueryProgress *
+StartQueryProgress(List *taskList)
+{
+	List *nodeList = NIL;
+
+	if (QueryProgressMinTaskCount <= 0 ||
+		list_length(taskList) < QueryProgressMinTaskCount ||
+		HasCurrentProgressMonitor())
+	{
+		return NULL;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardPlacement *taskPlacement = NULL;
+		foreach_ptr(taskPlacement, task->taskPlacementList)
+		{
+			bool nodeFound = false;
+
+			ShardPlacement *nodePlacement = NULL;
+			foreach_ptr(nodePlacement, nodeList)
+			{
+				if (nodePlacement->nodePort == taskPlacement->nodePort &&
+					strncmp(nodePlacement->nodeName, taskPlacement->nodeName,
+							MAX_NODE_LENGTH) == 0)
+				{
+					nodeFound = true;
+					break;
+				}
+			}
+
+			if (!nodeFound)
+			{
+				nodeList = lappend(nodeList, taskPlacement);
+			}
+		}
+	}
+
+	if (nodeList == NIL)
+	{
+		return NULL;
+	}
+
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(QUERY_PROGRESS_MAGIC_NUMBER, list_length(nodeList),
+							  sizeof(QueryProgressWorker), InvalidOid);
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	QueryProgress *queryProgress = palloc0(sizeof(QueryProgress));
+	queryProgress->workerCount = list_length(nodeList);
+	queryProgress->workers = (QueryProgressWorker *) monitor->steps;
+
+	int workerIndex = 0;
+
+	ShardPlacement *nodePlacement = NULL;
+	foreach_ptr(nodePlacement, nodeList)
+	{
+		QueryProgressWorker *progress = &queryProgress->workers[workerIndex++];
+
+		memset(progress, 0, sizeof(QueryProgressWorker));
+		strlcpy(progress->nodeName, nodePlacement->nodeName, MAX_NODE_LENGTH + 1);
+		progress->nodePort = nodePlacement->nodePort;
+	}
+
+	return queryProgress;
+}
+
+
+/*
+ * QueryProgressForWorker returns the progress of the given worker, or NULL
+ * if there is none.
+ */
+QueryProgressWorker *
+QueryProgressForWorker(QueryProgress *queryProgress, char *nodeName, int nodePort)
+{
+	if (queryProgress == NULL)
+	{
+		return NULL;
+	}
+
+	for (int workerIndex = 0; workerIndex < queryProgress->workerCount; workerIndex++)
+	{
+		QueryProgressWorker *progress = &queryProgress->workers[workerIndex];
+
+		if (progress->nodePort == nodePort &&
+			strncmp(progress->nodeName, nodeName, MAX_NODE_LENGTH) == 0)
+		{
+			return progress;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * FinishQueryProgress removes the progress monitor of the execution, if it
+ * has one.
+ */
+void
+FinishQueryProgress(QueryProgress *queryProgress)
+{
+	if (queryProgress == NULL)
+	{
+		return;
+	}
+
+	FinalizeCurrentProgressMonitor();
+}
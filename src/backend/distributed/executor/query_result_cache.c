@@ -0,0 +1,1109 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_result_cache.c
+ *    Caching the results of read-only distributed queries in shared memory.
+ *
+ * Dashboards tend to run the same multi-shard query every few seconds. When
+ * citus.query_result_cache_ttl is set, the rows that the adaptive executor
+ * collected from the workers are kept in shared memory, keyed by the
+ * database, the user, the query ID, and a hash of the result column types,
+ * the task query strings and the bound parameters. The query ID alone is not
+ * enough, since pg_stat_statements ignores constants when computing it. A
+ * later execution of the same query that starts within the TTL returns the
+ * cached rows instead of querying the workers. The coordinator part of the
+ * plan, such as the final aggregation and sorting, still runs on top of the
+ * cached rows.
+ *
+ * Each distributed table has a modification counter in shared memory, which
+ * is incremented when the executors of this node send a command that may
+ * modify the table, and again when the transaction that did so ends. A
+ * cached result remembers the counters of its tables from before it was
+ * computed, and is only used while none of them changed. Modifications that
+ * do not go through this node, for instance from workers with metadata, are
+ * not seen, which is why the cache is opt-in and entries expire after the
+ * TTL.
+ *
+ * The rows are stored in a dynamic shared memory area that is created in
+ * place in the main shared memory segment, such that its size is fixed by
+ * citus.query_result_cache_size. Once it is full, the oldest results are
+ * removed.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/query_result_cache.h"
+#include "distributed/relay_utility.h"
+#include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#endif
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+
+/* maximum number of cached results */
+#define QUERY_RESULT_CACHE_MAX_ENTRIES 1024
+
+/* maximum number of tables whose modifications are tracked */
+#define QUERY_RESULT_CACHE_MAX_RELATIONS 4096
+
+/* results of queries on more tables are not cached */
+#define MAX_CACHED_QUERY_RELATIONS 8
+
+/* a single result may take at most this fraction of the cache */
+#define MAX_RESULT_FRACTION 4
+
+
+/*
+ * The data structure used to store data in shared memory. The lock protects
+ * both hashes and the allocations in the result area.
+ */
+typedef struct QueryResultCacheSharedData
+{
+	int queryResultCacheTrancheId;
+	char *queryResultCacheTrancheName;
+
+	LWLock queryResultCacheLock;
+
+	/* incremented when modifications cannot be attributed to a table */
+	uint64 globalGeneration;
+
+	/* offset of the result area from the start of this struct */
+	Size resultAreaOffset;
+} QueryResultCacheSharedData;
+
+typedef struct QueryResultCacheKey
+{
+	Oid databaseId;
+	Oid userId;
+	uint64 queryId;
+
+	/* hash of the parameters and the result columns */
+	uint64 executionHash;
+} QueryResultCacheKey;
+
+/* hash entry for a single cached result */
+typedef struct QueryResultCacheEntry
+{
+	QueryResultCacheKey key;
+
+	TimestampTz storeTime;
+
+	/* modification counters of the tables when the result was computed */
+	uint64 globalGeneration;
+	int relationCount;
+	Oid relationIds[MAX_CACHED_QUERY_RELATIONS];
+	uint64 relationGenerations[MAX_CACHED_QUERY_RELATIONS];
+
+	/* the execution key, followed by the rows */
+	dsa_pointer result;
+	Size executionKeyLength;
+	Size resultLength;
+} QueryResultCacheEntry;
+
+typedef struct RelationGenerationKey
+{
+	Oid databaseId;
+	Oid relationId;
+} RelationGenerationKey;
+
+/* hash entry for the modification counter of a single table */
+typedef struct RelationGenerationEntry
+{
+	RelationGenerationKey key;
+
+	uint64 generation;
+} RelationGenerationEntry;
+
+/*
+ * QueryResultCacheRequest describes a result that may be cached, as seen
+ * before the query was executed.
+ */
+typedef struct QueryResultCacheRequest
+{
+	QueryResultCacheKey key;
+	StringInfo executionKey;
+
+	uint64 globalGeneration;
+	int relationCount;
+	Oid relationIds[MAX_CACHED_QUERY_RELATIONS];
+	uint64 relationGenerations[MAX_CACHED_QUERY_RELATIONS];
+} QueryResultCacheRequest;
+
+
+/* GUC, size of the shared memory for cached results in kilobytes */
+int QueryResultCacheSize = 0;
+
+/* GUC, time for which cached results are used in milliseconds, 0 to disable */
+int QueryResultCacheTTL = 0;
+
+
+/* the following are used for accessing shared memory */
+static HTAB *QueryResultCacheHash = NULL;
+static HTAB *RelationGenerationHash = NULL;
+static QueryResultCacheSharedData *QueryResultCacheSharedState = NULL;
+
+/* the result area as attached by this backend */
+static dsa_area *QueryResultArea = NULL;
+
+/* tables that the current transaction may have modified */
+static List *ModifiedRelationList = NIL;
+
+/* whether the current transaction may have modified tables we do not know of */
+static bool TransactionHasUnknownModifications = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static QueryResultCacheRequest * CreateQueryResultCacheRequest(CitusScanState *
+															   scanState);
+static bool CanCacheQueryResult(CitusScanState *scanState);
+static StringInfo ExecutionKey(CitusScanState *scanState);
+static void ReadRelationGenerations(QueryResultCacheRequest *request);
+static bool CachedResultIsValid(QueryResultCacheEntry *entry,
+								QueryResultCacheRequest *request);
+static StringInfo SerializeTupleStore(Tuplestorestate *tupleStore,
+									  TupleDesc tupleDescriptor, Size maxSize);
+static Tuplestorestate * DeserializeTupleStore(char *rowData, Size rowDataLength);
+static dsa_pointer AllocateResult(Size size);
+static bool RemoveOldestResult(void);
+static void RemoveResult(QueryResultCacheEntry *entry);
+static void IncrementRelationGenerations(List *relationIdList);
+static dsa_area * AttachQueryResultArea(void);
+static void QueryResultCacheShmemInit(void);
+static size_t QueryResultCacheShmemSize(void);
+
+
+/*
+ * InitializeQueryResultCache requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeQueryResultCache(void)
+{
+	if (QueryResultCacheSize == 0)
+	{
+		/* the cache is disabled, queries are always executed */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(QueryResultCacheShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = QueryResultCacheShmemInit;
+}
+
+
+/*
+ * ReadCachedQueryResult fills the tuple store of the given scan with a cached
+ * result of an earlier execution of the same query, and returns whether it
+ * did. If it did not, but the result of the execution may be cached, the
+ * scan remembers that for CacheQueryResult().
+ */
+bool
+ReadCachedQueryResult(CitusScanState *scanState)
+{
+	bool found = false;
+	char *resultData = NULL;
+	Size resultLength = 0;
+	Size executionKeyLength = 0;
+
+	if (QueryResultCacheHash == NULL || QueryResultCacheTTL == 0 ||
+		!CanCacheQueryResult(scanState))
+	{
+		return false;
+	}
+
+	QueryResultCacheRequest *request = CreateQueryResultCacheRequest(scanState);
+	if (request == NULL)
+	{
+		return false;
+	}
+
+	dsa_area *resultArea = AttachQueryResultArea();
+
+	LWLockAcquire(&QueryResultCacheSharedState->queryResultCacheLock, LW_SHARED);
+
+	ReadRelationGenerations(request);
+
+	QueryResultCacheEntry *entry =
+		(QueryResultCacheEntry *) hash_search(QueryResultCacheHash, &request->key,
+											  HASH_FIND, &found);
+	if (found && CachedResultIsValid(entry, request))
+	{
+		char *cachedData = dsa_get_address(resultArea, entry->result);
+
+		if (entry->executionKeyLength == request->executionKey->len &&
+			memcmp(cachedData, request->executionKey->data,
+				   entry->executionKeyLength) == 0)
+		{
+			/* copy the rows, such that we do not hold the lock while reading them */
+			executionKeyLength = entry->executionKeyLength;
+			resultLength = entry->resultLength;
+			resultData = palloc(resultLength);
+			memcpy(resultData, cachedData, resultLength);
+		}
+	}
+
+	LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+
+	if (resultData == NULL)
+	{
+		scanState->resultCacheRequest = request;
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("using cached result of distributed query")));
+
+	Size rowDataOffset = MAXALIGN(executionKeyLength);
+	scanState->tuplestorestate =
+		DeserializeTupleStore(resultData + rowDataOffset,
+							  resultLength - rowDataOffset);
+
+	pfree(resultData);
+
+	return true;
+}
+
+
+/*
+ * CacheQueryResult stores the rows in the tuple store of the given scan in
+ * the cache, if ReadCachedQueryResult() decided that they may be cached.
+ */
+void
+CacheQueryResult(CitusScanState *scanState)
+{
+	QueryResultCacheRequest *request = scanState->resultCacheRequest;
+	bool found = false;
+
+	if (request == NULL || scanState->tuplestorestate == NULL ||
+		scanState->distributedExecution != NULL)
+	{
+		/* not cacheable, or rows are still being received */
+		return;
+	}
+
+	Size executionKeyLength = request->executionKey->len;
+	Size maxResultSize = (Size) QueryResultCacheSize * 1024L / MAX_RESULT_FRACTION;
+	if (MAXALIGN(executionKeyLength) >= maxResultSize)
+	{
+		return;
+	}
+
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+	StringInfo rowData = SerializeTupleStore(scanState->tuplestorestate,
+											 tupleDescriptor,
+											 maxResultSize -
+											 MAXALIGN(executionKeyLength));
+	if (rowData == NULL)
+	{
+		ereport(DEBUG1, (errmsg("result of distributed query is too large to be "
+								"cached")));
+		return;
+	}
+
+	Size resultLength = MAXALIGN(executionKeyLength) + rowData->len;
+
+	dsa_area *resultArea = AttachQueryResultArea();
+
+	LWLockAcquire(&QueryResultCacheSharedState->queryResultCacheLock, LW_EXCLUSIVE);
+
+	/* a modification since the execution started makes the result stale */
+	QueryResultCacheRequest currentState = *request;
+	ReadRelationGenerations(&currentState);
+
+	if (currentState.globalGeneration != request->globalGeneration ||
+		memcmp(currentState.relationGenerations, request->relationGenerations,
+			   sizeof(request->relationGenerations)) != 0)
+	{
+		LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+		return;
+	}
+
+	QueryResultCacheEntry *entry =
+		(QueryResultCacheEntry *) hash_search(QueryResultCacheHash, &request->key,
+											  HASH_FIND, &found);
+	if (found)
+	{
+		/* replace the result of an earlier execution */
+		RemoveResult(entry);
+	}
+
+	dsa_pointer result = AllocateResult(resultLength);
+	if (DsaPointerIsValid(result))
+	{
+		entry = (QueryResultCacheEntry *) hash_search(QueryResultCacheHash,
+													  &request->key, HASH_ENTER_NULL,
+													  &found);
+		while (entry == NULL && RemoveOldestResult())
+		{
+			entry = (QueryResultCacheEntry *) hash_search(QueryResultCacheHash,
+														  &request->key,
+														  HASH_ENTER_NULL, &found);
+		}
+
+		if (entry == NULL)
+		{
+			dsa_free(resultArea, result);
+		}
+		else
+		{
+			char *cachedData = dsa_get_address(resultArea, result);
+
+			memcpy(cachedData, request->executionKey->data, executionKeyLength);
+			memcpy(cachedData + MAXALIGN(executionKeyLength), rowData->data,
+				   rowData->len);
+
+			entry->storeTime = GetCurrentTimestamp();
+			entry->globalGeneration = request->globalGeneration;
+			entry->relationCount = request->relationCount;
+			memcpy(entry->relationIds, request->relationIds,
+				   sizeof(entry->relationIds));
+			memcpy(entry->relationGenerations, request->relationGenerations,
+				   sizeof(entry->relationGenerations));
+			entry->result = result;
+			entry->executionKeyLength = executionKeyLength;
+			entry->resultLength = resultLength;
+		}
+	}
+
+	LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+}
+
+
+/*
+ * CanCacheQueryResult returns whether the result of the given scan would be
+ * the same on a later execution in which none of its tables are modified.
+ */
+static bool
+CanCacheQueryResult(CitusScanState *scanState)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *workerJob = distributedPlan->workerJob;
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	ParamListInfo paramListInfo = executorState->es_param_list_info;
+
+	/* pg_stat_statements assigns the query IDs */
+	if (distributedPlan->queryId == 0 ||
+		distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	/* intermediate results and repartitioned data are not tracked */
+	if (distributedPlan->subPlanList != NIL || workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	/* EXPLAIN ANALYZE wants to see the execution */
+	if (scanState->customScanState.ss.ps.instrument != NULL)
+	{
+		return false;
+	}
+
+	/* the transaction sees its own modifications, or an older snapshot */
+	if (XactModificationLevel != XACT_MODIFICATION_NONE ||
+		IsolationUsesXactSnapshot())
+	{
+		return false;
+	}
+
+	/* parameters that are fetched on demand might not all be known */
+	if (paramListInfo != NULL && paramListInfo->paramFetch != NULL)
+	{
+		return false;
+	}
+
+	Query *jobQuery = workerJob->jobQuery;
+	if (jobQuery == NULL || jobQuery->rowMarks != NIL ||
+		contain_volatile_functions((Node *) jobQuery))
+	{
+		return false;
+	}
+
+	/* modifications are only tracked for distributed tables */
+	List *relationIdList = distributedPlan->relationIdList;
+	if (relationIdList == NIL ||
+		list_length(relationIdList) > MAX_CACHED_QUERY_RELATIONS)
+	{
+		return false;
+	}
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		if (!IsCitusTable(relationId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateQueryResultCacheRequest returns the key under which the result of the
+ * given scan is cached, or NULL if the parameters cannot be part of a key.
+ */
+static QueryResultCacheRequest *
+CreateQueryResultCacheRequest(CitusScanState *scanState)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+
+	StringInfo executionKey = ExecutionKey(scanState);
+	if (executionKey == NULL)
+	{
+		return NULL;
+	}
+
+	QueryResultCacheRequest *request = palloc0(sizeof(QueryResultCacheRequest));
+	request->key.databaseId = MyDatabaseId;
+	request->key.userId = GetUserId();
+	request->key.queryId = distributedPlan->queryId;
+	request->key.executionHash =
+		DatumGetUInt64(hash_any_extended((unsigned char *) executionKey->data,
+										 executionKey->len, 0));
+	request->executionKey = executionKey;
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, distributedPlan->relationIdList)
+	{
+		request->relationIds[request->relationCount++] = relationId;
+	}
+
+	return request;
+}
+
+
+/*
+ * ExecutionKey returns the types of the result columns, the query strings of
+ * the tasks, and the types and binary values of the bound parameters of the
+ * given scan, which together identify the result. The query ID alone does not,
+ * since pg_stat_statements ignores constants when computing it. Returns NULL
+ * if a parameter type has no binary representation.
+ */
+static StringInfo
+ExecutionKey(CitusScanState *scanState)
+{
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	ParamListInfo paramListInfo = executorState->es_param_list_info;
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+
+	StringInfo executionKey = makeStringInfo();
+
+	appendBinaryStringInfo(executionKey, (char *) &tupleDescriptor->natts,
+						   sizeof(int));
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		appendBinaryStringInfo(executionKey, (char *) &attribute->atttypid,
+							   sizeof(Oid));
+		appendBinaryStringInfo(executionKey, (char *) &attribute->atttypmod,
+							   sizeof(int32));
+	}
+
+	/* the task queries contain the constants of the query */
+	List *taskList = scanState->distributedPlan->workerJob->taskList;
+	int taskCount = list_length(taskList);
+
+	appendBinaryStringInfo(executionKey, (char *) &taskCount, sizeof(int));
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		char *taskQueryString = TaskQueryStringForPlacement(task, 0);
+		int queryLength = strlen(taskQueryString);
+
+		appendBinaryStringInfo(executionKey, (char *) &queryLength, sizeof(int));
+		appendBinaryStringInfo(executionKey, taskQueryString, queryLength);
+	}
+
+	int parameterCount = (paramListInfo != NULL) ? paramListInfo->numParams : 0;
+
+	appendBinaryStringInfo(executionKey, (char *) &parameterCount, sizeof(int));
+
+	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		ParamExternData *parameter = &paramListInfo->params[parameterIndex];
+		Oid sendFunctionId = InvalidOid;
+		bool typeVarLength = false;
+
+		appendBinaryStringInfo(executionKey, (char *) &parameter->ptype,
+							   sizeof(Oid));
+		appendBinaryStringInfo(executionKey, (char *) &parameter->isnull,
+							   sizeof(bool));
+
+		if (parameter->isnull || parameter->ptype == InvalidOid)
+		{
+			continue;
+		}
+
+		HeapTuple typeTuple = SearchSysCache1(TYPEOID,
+											  ObjectIdGetDatum(parameter->ptype));
+		if (!HeapTupleIsValid(typeTuple))
+		{
+			return NULL;
+		}
+
+		bool hasSendFunction = OidIsValid(((Form_pg_type) GETSTRUCT(typeTuple))->typsend);
+		ReleaseSysCache(typeTuple);
+
+		if (!hasSendFunction)
+		{
+			return NULL;
+		}
+
+		getTypeBinaryOutputInfo(parameter->ptype, &sendFunctionId, &typeVarLength);
+
+		bytea *parameterValue = OidSendFunctionCall(sendFunctionId, parameter->value);
+		int32 valueLength = VARSIZE(parameterValue) - VARHDRSZ;
+
+		appendBinaryStringInfo(executionKey, (char *) &valueLength, sizeof(int32));
+		appendBinaryStringInfo(executionKey, VARDATA(parameterValue), valueLength);
+	}
+
+	return executionKey;
+}
+
+
+/*
+ * ReadRelationGenerations reads the current modification counters of the
+ * tables of the given request. The caller should hold the lock.
+ */
+static void
+ReadRelationGenerations(QueryResultCacheRequest *request)
+{
+	RelationGenerationKey key;
+	bool found = false;
+
+	request->globalGeneration = QueryResultCacheSharedState->globalGeneration;
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+
+	for (int relationIndex = 0; relationIndex < request->relationCount; relationIndex++)
+	{
+		key.relationId = request->relationIds[relationIndex];
+
+		RelationGenerationEntry *generationEntry =
+			(RelationGenerationEntry *) hash_search(RelationGenerationHash, &key,
+													HASH_FIND, &found);
+
+		request->relationGenerations[relationIndex] =
+			found ? generationEntry->generation : 0;
+	}
+}
+
+
+/*
+ * CachedResultIsValid returns whether the given cached result was computed
+ * within the TTL, and none of its tables were modified since.
+ */
+static bool
+CachedResultIsValid(QueryResultCacheEntry *entry, QueryResultCacheRequest *request)
+{
+	if (entry->globalGeneration != request->globalGeneration ||
+		entry->relationCount != request->relationCount ||
+		memcmp(entry->relationIds, request->relationIds,
+			   sizeof(entry->relationIds)) != 0 ||
+		memcmp(entry->relationGenerations, request->relationGenerations,
+			   sizeof(entry->relationGenerations)) != 0)
+	{
+		return false;
+	}
+
+	return !TimestampDifferenceExceeds(entry->storeTime, GetCurrentTimestamp(),
+									   QueryResultCacheTTL);
+}
+
+
+/*
+ * SerializeTupleStore returns the rows in the given tuple store as a series
+ * of heap tuples, each preceded by its length and aligned, or NULL if they
+ * take more than maxSize bytes. The tuple store is rewound afterwards.
+ */
+static StringInfo
+SerializeTupleStore(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+					Size maxSize)
+{
+	StringInfo rowData = makeStringInfo();
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	bool tooLarge = false;
+
+	tuplestore_rescan(tupleStore);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		slot_getallattrs(slot);
+
+		HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, slot->tts_values,
+											  slot->tts_isnull);
+		uint32 tupleLength = heapTuple->t_len;
+
+		if (rowData->len + MAXALIGN(sizeof(uint32)) + MAXALIGN(tupleLength) >
+			maxSize)
+		{
+			tooLarge = true;
+			break;
+		}
+
+		appendBinaryStringInfo(rowData, (char *) &tupleLength, sizeof(uint32));
+		appendStringInfoSpaces(rowData, MAXALIGN(sizeof(uint32)) - sizeof(uint32));
+		appendBinaryStringInfo(rowData, (char *) heapTuple->t_data, tupleLength);
+		appendStringInfoSpaces(rowData, MAXALIGN(tupleLength) - tupleLength);
+
+		heap_freetuple(heapTuple);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_rescan(tupleStore);
+
+	return tooLarge ? NULL : rowData;
+}
+
+
+/*
+ * DeserializeTupleStore returns a tuple store with the rows that were
+ * serialized by SerializeTupleStore(). The row data should be aligned.
+ */
+static Tuplestorestate *
+DeserializeTupleStore(char *rowData, Size rowDataLength)
+{
+	bool randomAccess = true;
+	bool interTransactions = false;
+	int resultMemory = (ExecutorResultMemory >= 0) ? ExecutorResultMemory : work_mem;
+	Size offset = 0;
+
+	Tuplestorestate *tupleStore =
+		tuplestore_begin_heap(randomAccess, interTransactions, resultMemory);
+
+	while (offset < rowDataLength)
+	{
+		HeapTupleData heapTuple;
+		uint32 tupleLength = *(uint32 *) (rowData + offset);
+
+		offset += MAXALIGN(sizeof(uint32));
+
+		heapTuple.t_len = tupleLength;
+		ItemPointerSetInvalid(&heapTuple.t_self);
+		heapTuple.t_tableOid = InvalidOid;
+		heapTuple.t_data = (HeapTupleHeader) (rowData + offset);
+
+		tuplestore_puttuple(tupleStore, &heapTuple);
+
+		offset += MAXALIGN(tupleLength);
+	}
+
+	return tupleStore;
+}
+
+
+/*
+ * AllocateResult allocates the given number of bytes in the result area,
+ * removing the oldest results until they fit. Returns InvalidDsaPointer if
+ * the result does not fit in an empty cache. The caller should hold the lock
+ * in exclusive mode.
+ */
+static dsa_pointer
+AllocateResult(Size size)
+{
+	dsa_pointer result = dsa_allocate_extended(QueryResultArea, size,
+											   DSA_ALLOC_NO_OOM);
+
+	while (!DsaPointerIsValid(result) && RemoveOldestResult())
+	{
+		result = dsa_allocate_extended(QueryResultArea, size, DSA_ALLOC_NO_OOM);
+	}
+
+	return result;
+}
+
+
+/*
+ * RemoveOldestResult removes the result that was stored first from the
+ * cache, and returns false if the cache is empty. The caller should hold the
+ * lock in exclusive mode.
+ */
+static bool
+RemoveOldestResult(void)
+{
+	HASH_SEQ_STATUS status;
+	QueryResultCacheEntry *oldestEntry = NULL;
+
+	hash_seq_init(&status, QueryResultCacheHash);
+
+	QueryResultCacheEntry *entry = NULL;
+	while ((entry = (QueryResultCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (oldestEntry == NULL || entry->storeTime < oldestEntry->storeTime)
+		{
+			oldestEntry = entry;
+		}
+	}
+
+	if (oldestEntry == NULL)
+	{
+		return false;
+	}
+
+	RemoveResult(oldestEntry);
+
+	return true;
+}
+
+
+/*
+ * RemoveResult removes the given result from the cache. The caller should
+ * hold the lock in exclusive mode.
+ */
+static void
+RemoveResult(QueryResultCacheEntry *entry)
+{
+	bool found = false;
+
+	dsa_free(QueryResultArea, entry->result);
+	hash_search(QueryResultCacheHash, &entry->key, HASH_REMOVE, &found);
+}
+
+
+/*
+ * RecordTaskListModification is called by the executors before they run the
+ * given tasks, when these may modify data, to invalidate the cached results
+ * of queries on the tables of the tasks.
+ */
+void
+RecordTaskListModification(List *taskList)
+{
+	List *relationIdList = NIL;
+
+	if (QueryResultCacheHash == NULL)
+	{
+		return;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->relationShardList != NIL)
+		{
+			RelationShard *relationShard = NULL;
+			foreach_ptr(relationShard, task->relationShardList)
+			{
+				relationIdList = list_append_unique_oid(relationIdList,
+														relationShard->relationId);
+			}
+		}
+		else if (task->anchorShardId != INVALID_SHARD_ID)
+		{
+			relationIdList =
+				list_append_unique_oid(relationIdList,
+									   RelationIdForShard(task->anchorShardId));
+		}
+		else
+		{
+			/* we do not know what the task modifies */
+			InvalidateQueryResultCache();
+			return;
+		}
+	}
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		RecordRelationModification(relationId);
+	}
+}
+
+
+/*
+ * RecordRelationModification is called before data in the given table may be
+ * modified, to invalidate the cached results of queries on the table. The
+ * results are invalidated again when the transaction ends, since results
+ * computed in between do not see the modification yet.
+ */
+void
+RecordRelationModification(Oid relationId)
+{
+	if (QueryResultCacheHash == NULL)
+	{
+		return;
+	}
+
+	List *relationIdList = list_make1_oid(relationId);
+
+	/* queries on the parent table read the partitions */
+	if (PartitionTableNoLock(relationId))
+	{
+		relationIdList = lappend_oid(relationIdList, PartitionParentOid(relationId));
+	}
+
+	IncrementRelationGenerations(relationIdList);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	ModifiedRelationList = list_concat_unique_oid(ModifiedRelationList,
+												  relationIdList);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * InvalidateQueryResultCache is called before a command that may modify any
+ * data, such as a delegated function call, and invalidates all cached
+ * results, now and when the transaction ends.
+ */
+void
+InvalidateQueryResultCache(void)
+{
+	if (QueryResultCacheHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&QueryResultCacheSharedState->queryResultCacheLock, LW_EXCLUSIVE);
+	QueryResultCacheSharedState->globalGeneration++;
+	LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+
+	TransactionHasUnknownModifications = true;
+}
+
+
+/*
+ * QueryResultCacheTransactionEnd invalidates the cached results of queries on
+ * the tables that the transaction modified, now that the modifications are
+ * visible or rolled back.
+ */
+void
+QueryResultCacheTransactionEnd(void)
+{
+	if (QueryResultCacheHash == NULL)
+	{
+		return;
+	}
+
+	if (TransactionHasUnknownModifications)
+	{
+		LWLockAcquire(&QueryResultCacheSharedState->queryResultCacheLock,
+					  LW_EXCLUSIVE);
+		QueryResultCacheSharedState->globalGeneration++;
+		LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+	}
+	else if (ModifiedRelationList != NIL)
+	{
+		IncrementRelationGenerations(ModifiedRelationList);
+	}
+
+	/* the list is allocated in TopTransactionContext */
+	ModifiedRelationList = NIL;
+	TransactionHasUnknownModifications = false;
+}
+
+
+/*
+ * IncrementRelationGenerations increments the modification counters of the
+ * given tables. If a counter cannot be added, all cached results are
+ * invalidated instead.
+ */
+static void
+IncrementRelationGenerations(List *relationIdList)
+{
+	RelationGenerationKey key;
+	bool found = false;
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+
+	LWLockAcquire(&QueryResultCacheSharedState->queryResultCacheLock, LW_EXCLUSIVE);
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		key.relationId = relationId;
+
+		RelationGenerationEntry *generationEntry =
+			(RelationGenerationEntry *) hash_search(RelationGenerationHash, &key,
+													HASH_ENTER_NULL, &found);
+		if (generationEntry == NULL)
+		{
+			QueryResultCacheSharedState->globalGeneration++;
+			continue;
+		}
+
+		if (!found)
+		{
+			generationEntry->generation = 0;
+		}
+
+		generationEntry->generation++;
+	}
+
+	LWLockRelease(&QueryResultCacheSharedState->queryResultCacheLock);
+}
+
+
+/*
+ * AttachQueryResultArea attaches to the result area on first use in this
+ * backend, and returns it.
+ */
+static dsa_area *
+AttachQueryResultArea(void)
+{
+	if (QueryResultArea == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		char *resultAreaPlace = ((char *) QueryResultCacheSharedState) +
+								QueryResultCacheSharedState->resultAreaOffset;
+
+		QueryResultArea = dsa_attach_in_place(resultAreaPlace, NULL);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	return QueryResultArea;
+}
+
+
+/*
+ * QueryResultCacheShmemSize returns the size that should be allocated on the
+ * shared memory for the query result cache.
+ */
+static size_t
+QueryResultCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, MAXALIGN(sizeof(QueryResultCacheSharedData)));
+	size = add_size(size, Max((Size) QueryResultCacheSize * 1024L,
+							  dsa_minimum_size()));
+
+	Size hashSize = hash_estimate_size(QUERY_RESULT_CACHE_MAX_ENTRIES,
+									   sizeof(QueryResultCacheEntry));
+	size = add_size(size, hashSize);
+
+	hashSize = hash_estimate_size(QUERY_RESULT_CACHE_MAX_RELATIONS,
+								  sizeof(RelationGenerationEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * QueryResultCacheShmemInit initializes the shared memory used for caching
+ * query results across backends.
+ */
+static void
+QueryResultCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	Size resultAreaOffset = MAXALIGN(sizeof(QueryResultCacheSharedData));
+	Size resultAreaSize = Max((Size) QueryResultCacheSize * 1024L, dsa_minimum_size());
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	QueryResultCacheSharedState =
+		(QueryResultCacheSharedData *) ShmemInitStruct("Query Result Cache Data",
+													   resultAreaOffset +
+													   resultAreaSize,
+													   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		QueryResultCacheSharedState->queryResultCacheTrancheId = LWLockNewTrancheId();
+		QueryResultCacheSharedState->queryResultCacheTrancheName =
+			"Query Result Cache Tranche";
+		LWLockRegisterTranche(QueryResultCacheSharedState->queryResultCacheTrancheId,
+							  QueryResultCacheSharedState->queryResultCacheTrancheName);
+
+		LWLockInitialize(&QueryResultCacheSharedState->queryResultCacheLock,
+						 QueryResultCacheSharedState->queryResultCacheTrancheId);
+
+		QueryResultCacheSharedState->globalGeneration = 0;
+		QueryResultCacheSharedState->resultAreaOffset = resultAreaOffset;
+
+		/* the area never grows beyond the memory we reserved for it */
+		char *resultAreaPlace = ((char *) QueryResultCacheSharedState) +
+								resultAreaOffset;
+		dsa_area *resultArea =
+			dsa_create_in_place(resultAreaPlace, resultAreaSize,
+								QueryResultCacheSharedState->queryResultCacheTrancheId,
+								NULL);
+		dsa_set_size_limit(resultArea, resultAreaSize);
+		dsa_detach(resultArea);
+	}
+
+	/* create (dbid, userid, queryid, executionhash) -> [result] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(QueryResultCacheKey);
+	info.entrysize = sizeof(QueryResultCacheEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	QueryResultCacheHash = ShmemInitHash("Query Result Cache Hash",
+										 QUERY_RESULT_CACHE_MAX_ENTRIES,
+										 QUERY_RESULT_CACHE_MAX_ENTRIES,
+										 &info, hashFlags);
+
+	/* create (dbid, relationid) -> [generation] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(RelationGenerationKey);
+	info.entrysize = sizeof(RelationGenerationEntry);
+
+	RelationGenerationHash = ShmemInitHash("Query Result Cache Relation Hash",
+										   QUERY_RESULT_CACHE_MAX_RELATIONS,
+										   QUERY_RESULT_CACHE_MAX_RELATIONS,
+										   &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(QueryResultCacheHash != NULL);
+	Assert(RelationGenerationHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
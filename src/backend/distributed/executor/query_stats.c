@@ -3,6 +3,16 @@
  * query_stats.c
  *    Statement-level statistics for distributed queries.
  *
+ * The statistics are kept in shared memory per query, executor and
+ * partition key value, such that skew across partition key values can be
+ * spotted, and per query and worker, such that slow workers can be spotted.
+ * pg_stat_statements provides the query ids and the query texts, which are
+ * joined in by the citus_stat_statements view.
+ *
+ * Counters are updated using atomic operations while holding the lock in
+ * shared mode, the lock is only taken in exclusive mode to add or remove
+ * entries.
+ *
  * Copyright (c) Citus Data, Inc.
  *-------------------------------------------------------------------------
  */
@@ -10,61 +20,887 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "miscadmin.h"
 
+#include "access/hash.h"
+#include "catalog/pg_authid.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/query_stats.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+
+#define CITUS_QUERY_STATS_COLUMNS 11
+#define CITUS_QUERY_STATS_PER_WORKER_COLUMNS 9
+
+/* percentage of the least used entries that is removed once a hash is full */
+#define STATS_DEALLOC_PERCENT 5
+
+
+/*
+ * The data structure used to store data in shared memory. Both statistics
+ * hashes are protected by the same lock.
+ */
+typedef struct QueryStatsSharedData
+{
+	int queryStatsHashTrancheId;
+	char *queryStatsHashTrancheName;
+
+	LWLock queryStatsHashLock;
+} QueryStatsSharedData;
+
+
+/* counters kept per query, executor and partition key value */
+typedef enum QueryStatsCounter
+{
+	QUERY_STATS_CALLS = 0,
+	QUERY_STATS_PLANS,
+	QUERY_STATS_PLAN_TIME,
+	QUERY_STATS_EXEC_TIME,
+	QUERY_STATS_ROWS,
+	QUERY_STATS_REMOTE_BYTES,
+
+	/* must be last */
+	QUERY_STATS_COUNTER_COUNT
+} QueryStatsCounter;
+
+typedef struct QueryStatsHashKey
+{
+	Oid userId;
+	Oid databaseId;
+	uint64 queryId;
+	MultiExecutorType executorType;
+
+	/* partition key value, possibly truncated, if the call was sampled */
+	bool hasPartitionKey;
+	char partitionKey[NAMEDATALEN];
+} QueryStatsHashKey;
+
+/* hash entry for the statistics of a single query and partition key value */
+typedef struct QueryStatsHashEntry
+{
+	QueryStatsHashKey key;
+
+	/* times are kept in microseconds */
+	pg_atomic_uint64 counters[QUERY_STATS_COUNTER_COUNT];
+} QueryStatsHashEntry;
+
+
+/* counters kept per query and worker */
+typedef enum QueryWorkerStatsCounter
+{
+	QUERY_WORKER_STATS_CALLS = 0,
+	QUERY_WORKER_STATS_TASKS,
+	QUERY_WORKER_STATS_ROWS,
+	QUERY_WORKER_STATS_REMOTE_BYTES,
+	QUERY_WORKER_STATS_TIME,
+
+	/* must be last */
+	QUERY_WORKER_STATS_COUNTER_COUNT
+} QueryWorkerStatsCounter;
+
+typedef struct QueryWorkerStatsHashKey
+{
+	Oid userId;
+	Oid databaseId;
+	uint64 queryId;
+	int32 nodeId;
+} QueryWorkerStatsHashKey;
+
+/* hash entry for the statistics of a single query on a single worker */
+typedef struct QueryWorkerStatsHashEntry
+{
+	QueryWorkerStatsHashKey key;
+
+	/* times are kept in microseconds */
+	pg_atomic_uint64 counters[QUERY_WORKER_STATS_COUNTER_COUNT];
+} QueryWorkerStatsHashEntry;
+
+
+/*
+ * StatsUsage is used to sort hash entries by how often they were used when
+ * the least used entries are removed.
+ */
+typedef struct StatsUsage
+{
+	void *entry;
+	uint64 usage;
+} StatsUsage;
+
+
+/* GUC, which statements are tracked in citus_stat_statements */
+int StatStatementsTrack = STAT_STATEMENTS_TRACK_NONE;
+
+/* GUC, maximum number of entries in each of the statistics hashes */
+int StatStatementsMax = 50000;
+
+/* GUC, fraction of the partition key values that is tracked separately */
+double StatStatementsPartitionKeySampleRate = 1.0;
+
+
+/* the following three are used for accessing shared memory */
+static HTAB *QueryStatsHash = NULL;
+static HTAB *QueryWorkerStatsHash = NULL;
+static QueryStatsSharedData *QueryStatsSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void SetQueryStatsHashKey(QueryStatsHashKey *key, uint64 queryId,
+								 MultiExecutorType executorType, Job *workerJob);
+static void AddQueryStats(QueryStatsHashKey *key,
+						  uint64 counterValues[QUERY_STATS_COUNTER_COUNT]);
+static void AddQueryWorkerStats(QueryWorkerStatsHashKey *key,
+								uint64 counterValues[QUERY_WORKER_STATS_COUNTER_COUNT]);
+static QueryStatsHashEntry * QueryStatsEntryAlloc(QueryStatsHashKey *key);
+static QueryWorkerStatsHashEntry * QueryWorkerStatsEntryAlloc(
+	QueryWorkerStatsHashKey *key);
+static void QueryStatsEntryDealloc(void);
+static void QueryWorkerStatsEntryDealloc(void);
+static int CompareStatsUsage(const void *leftElement, const void *rightElement);
+static uint64 MillisecondsToMicroseconds(double milliseconds);
+static double MicrosecondsToMilliseconds(uint64 microseconds);
+static void StoreQueryStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
+static void StoreQueryWorkerStats(Tuplestorestate *tupleStore,
+								  TupleDesc tupleDescriptor);
+static void QueryStatsShmemInit(void);
+static size_t QueryStatsShmemSize(void);
+static char * CitusExecutorName(MultiExecutorType executorType);
+
 
 PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
 PG_FUNCTION_INFO_V1(citus_query_stats);
+PG_FUNCTION_INFO_V1(citus_query_stats_per_worker);
 PG_FUNCTION_INFO_V1(citus_executor_name);
 
 
-static char * CitusExecutorName(MultiExecutorType executorType);
+/*
+ * InitializeCitusQueryStats requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeCitusQueryStats(void)
+{
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(QueryStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = QueryStatsShmemInit;
+}
+
+
+/*
+ * CitusQueryStatsEnabled returns whether statistics are currently collected
+ * for citus_stat_statements.
+ */
+bool
+CitusQueryStatsEnabled(void)
+{
+	return StatStatementsTrack != STAT_STATEMENTS_TRACK_NONE && QueryStatsHash != NULL;
+}
 
 
-/* placeholder for InitializeCitusQueryStats */
+/*
+ * CitusQueryStatsPlanningEntry adds a top-level planning of the given query
+ * to its statistics. Plans that are pruned at execution time do not know
+ * their partition key value yet, and are recorded without one.
+ */
 void
-InitializeCitusQueryStats(void)
+CitusQueryStatsPlanningEntry(uint64 queryId, MultiExecutorType executorType,
+							 Job *workerJob, double planningTime)
 {
-	/* placeholder for future implementation */
+	QueryStatsHashKey key;
+	uint64 counterValues[QUERY_STATS_COUNTER_COUNT];
+
+	if (!CitusQueryStatsEnabled() || queryId == 0 ||
+		executorType == MULTI_EXECUTOR_INVALID_FIRST)
+	{
+		return;
+	}
+
+	SetQueryStatsHashKey(&key, queryId, executorType, workerJob);
+
+	memset(counterValues, 0, sizeof(counterValues));
+	counterValues[QUERY_STATS_PLANS] = 1;
+	counterValues[QUERY_STATS_PLAN_TIME] = MillisecondsToMicroseconds(planningTime);
+
+	AddQueryStats(&key, counterValues);
 }
 
 
-/* placeholder for CitusQueryStatsExecutorsEntry */
+/*
+ * CitusQueryStatsExecutorsEntry adds an execution of the given query to its
+ * statistics, and the parts of the execution that happened on each worker
+ * to the per-worker statistics of the query.
+ */
 void
 CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-							  char *partitionKey)
+							  Job *workerJob, double executionTime, uint64 rowCount,
+							  List *workerPoolStatsList)
+{
+	QueryStatsHashKey key;
+	uint64 counterValues[QUERY_STATS_COUNTER_COUNT];
+	uint64 remoteBytes = 0;
+
+	if (!CitusQueryStatsEnabled())
+	{
+		return;
+	}
+
+	WorkerPoolExecutionStats *poolStats = NULL;
+	foreach_ptr(poolStats, workerPoolStatsList)
+	{
+		QueryWorkerStatsHashKey workerKey;
+		uint64 workerCounterValues[QUERY_WORKER_STATS_COUNTER_COUNT];
+
+		WorkerNode *workerNode = FindWorkerNode(poolStats->nodeName,
+												poolStats->nodePort);
+		if (workerNode == NULL)
+		{
+			/* the node was removed in the meantime */
+			continue;
+		}
+
+		memset(&workerKey, 0, sizeof(workerKey));
+		workerKey.userId = GetUserId();
+		workerKey.databaseId = MyDatabaseId;
+		workerKey.queryId = queryId;
+		workerKey.nodeId = workerNode->nodeId;
+
+		workerCounterValues[QUERY_WORKER_STATS_CALLS] = 1;
+		workerCounterValues[QUERY_WORKER_STATS_TASKS] = poolStats->taskCount;
+		workerCounterValues[QUERY_WORKER_STATS_ROWS] = poolStats->rowCount;
+		workerCounterValues[QUERY_WORKER_STATS_REMOTE_BYTES] = poolStats->byteCount;
+		workerCounterValues[QUERY_WORKER_STATS_TIME] =
+			MillisecondsToMicroseconds(poolStats->lastByteTime);
+
+		AddQueryWorkerStats(&workerKey, workerCounterValues);
+
+		remoteBytes += poolStats->byteCount;
+	}
+
+	SetQueryStatsHashKey(&key, queryId, executorType, workerJob);
+
+	memset(counterValues, 0, sizeof(counterValues));
+	counterValues[QUERY_STATS_CALLS] = 1;
+	counterValues[QUERY_STATS_EXEC_TIME] = MillisecondsToMicroseconds(executionTime);
+	counterValues[QUERY_STATS_ROWS] = rowCount;
+	counterValues[QUERY_STATS_REMOTE_BYTES] = remoteBytes;
+
+	AddQueryStats(&key, counterValues);
+}
+
+
+/*
+ * SetQueryStatsHashKey fills the hash key for the given query. The partition
+ * key value is only included for router queries of the adaptive executor,
+ * and only for the fraction of the values given by
+ * citus.stat_statements_partition_key_sample_rate. The sample is based on
+ * a hash of the value, such that every call with a sampled value is
+ * recorded under that value and the skew between values remains visible.
+ */
+static void
+SetQueryStatsHashKey(QueryStatsHashKey *key, uint64 queryId,
+					 MultiExecutorType executorType, Job *workerJob)
+{
+	memset(key, 0, sizeof(QueryStatsHashKey));
+	key->userId = GetUserId();
+	key->databaseId = MyDatabaseId;
+	key->queryId = queryId;
+	key->executorType = executorType;
+
+	if (workerJob == NULL || executorType != MULTI_EXECUTOR_ADAPTIVE)
+	{
+		return;
+	}
+
+	Const *partitionKeyConst = workerJob->partitionKeyValue;
+	if (partitionKeyConst == NULL || partitionKeyConst->constisnull)
+	{
+		return;
+	}
+
+	char *partitionKeyString = DatumToString(partitionKeyConst->constvalue,
+											 partitionKeyConst->consttype);
+
+	if (StatStatementsPartitionKeySampleRate < 1.0)
+	{
+		uint32 valueHash = DatumGetUInt32(hash_any((unsigned char *) partitionKeyString,
+												   strlen(partitionKeyString)));
+
+		if ((double) valueHash >=
+			StatStatementsPartitionKeySampleRate * (double) PG_UINT32_MAX)
+		{
+			return;
+		}
+	}
+
+	key->hasPartitionKey = true;
+	strlcpy(key->partitionKey, partitionKeyString, NAMEDATALEN);
+}
+
+
+/*
+ * AddQueryStats adds the given counter values to the entry of the given key,
+ * creating the entry if it does not exist yet.
+ */
+static void
+AddQueryStats(QueryStatsHashKey *key, uint64 counterValues[QUERY_STATS_COUNTER_COUNT])
+{
+	LWLock *lock = &QueryStatsSharedState->queryStatsHashLock;
+
+	LWLockAcquire(lock, LW_SHARED);
+
+	QueryStatsHashEntry *statsEntry =
+		(QueryStatsHashEntry *) hash_search(QueryStatsHash, key, HASH_FIND, NULL);
+	if (statsEntry == NULL)
+	{
+		/* adding an entry requires an exclusive lock */
+		LWLockRelease(lock);
+		LWLockAcquire(lock, LW_EXCLUSIVE);
+
+		statsEntry = QueryStatsEntryAlloc(key);
+	}
+
+	for (int counter = 0; counter < QUERY_STATS_COUNTER_COUNT; counter++)
+	{
+		if (counterValues[counter] != 0)
+		{
+			pg_atomic_fetch_add_u64(&statsEntry->counters[counter],
+									counterValues[counter]);
+		}
+	}
+
+	LWLockRelease(lock);
+}
+
+
+/*
+ * AddQueryWorkerStats adds the given counter values to the entry of the given
+ * key, creating the entry if it does not exist yet.
+ */
+static void
+AddQueryWorkerStats(QueryWorkerStatsHashKey *key,
+					uint64 counterValues[QUERY_WORKER_STATS_COUNTER_COUNT])
+{
+	LWLock *lock = &QueryStatsSharedState->queryStatsHashLock;
+
+	LWLockAcquire(lock, LW_SHARED);
+
+	QueryWorkerStatsHashEntry *statsEntry =
+		(QueryWorkerStatsHashEntry *) hash_search(QueryWorkerStatsHash, key,
+												  HASH_FIND, NULL);
+	if (statsEntry == NULL)
+	{
+		/* adding an entry requires an exclusive lock */
+		LWLockRelease(lock);
+		LWLockAcquire(lock, LW_EXCLUSIVE);
+
+		statsEntry = QueryWorkerStatsEntryAlloc(key);
+	}
+
+	for (int counter = 0; counter < QUERY_WORKER_STATS_COUNTER_COUNT; counter++)
+	{
+		if (counterValues[counter] != 0)
+		{
+			pg_atomic_fetch_add_u64(&statsEntry->counters[counter],
+									counterValues[counter]);
+		}
+	}
+
+	LWLockRelease(lock);
+}
+
+
+/*
+ * QueryStatsEntryAlloc returns the entry of the given key, and creates it if
+ * another backend did not do so in the meantime. The least used entries are
+ * removed first if the hash is full. The caller should hold the lock in
+ * exclusive mode.
+ */
+static QueryStatsHashEntry *
+QueryStatsEntryAlloc(QueryStatsHashKey *key)
+{
+	bool found = false;
+
+	if (hash_get_num_entries(QueryStatsHash) >= StatStatementsMax &&
+		hash_search(QueryStatsHash, key, HASH_FIND, NULL) == NULL)
+	{
+		QueryStatsEntryDealloc();
+	}
+
+	QueryStatsHashEntry *statsEntry =
+		(QueryStatsHashEntry *) hash_search(QueryStatsHash, key, HASH_ENTER, &found);
+	if (!found)
+	{
+		for (int counter = 0; counter < QUERY_STATS_COUNTER_COUNT; counter++)
+		{
+			pg_atomic_init_u64(&statsEntry->counters[counter], 0);
+		}
+	}
+
+	return statsEntry;
+}
+
+
+/*
+ * QueryWorkerStatsEntryAlloc is the equivalent of QueryStatsEntryAlloc for
+ * the per-worker statistics.
+ */
+static QueryWorkerStatsHashEntry *
+QueryWorkerStatsEntryAlloc(QueryWorkerStatsHashKey *key)
+{
+	bool found = false;
+
+	if (hash_get_num_entries(QueryWorkerStatsHash) >= StatStatementsMax &&
+		hash_search(QueryWorkerStatsHash, key, HASH_FIND, NULL) == NULL)
+	{
+		QueryWorkerStatsEntryDealloc();
+	}
+
+	QueryWorkerStatsHashEntry *statsEntry =
+		(QueryWorkerStatsHashEntry *) hash_search(QueryWorkerStatsHash, key,
+												  HASH_ENTER, &found);
+	if (!found)
+	{
+		for (int counter = 0; counter < QUERY_WORKER_STATS_COUNTER_COUNT; counter++)
+		{
+			pg_atomic_init_u64(&statsEntry->counters[counter], 0);
+		}
+	}
+
+	return statsEntry;
+}
+
+
+/*
+ * QueryStatsEntryDealloc removes the STATS_DEALLOC_PERCENT least used entries
+ * from the statistics hash, where the usage of an entry is the number of
+ * times the query was planned or executed. The caller should hold the lock
+ * in exclusive mode.
+ */
+static void
+QueryStatsEntryDealloc(void)
 {
-	/* placeholder for future implementation */
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *statsEntry = NULL;
+	long entryCount = hash_get_num_entries(QueryStatsHash);
+	int usageIndex = 0;
+
+	StatsUsage *usageArray = palloc(entryCount * sizeof(StatsUsage));
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((statsEntry = (QueryStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		usageArray[usageIndex].entry = statsEntry;
+		usageArray[usageIndex].usage =
+			pg_atomic_read_u64(&statsEntry->counters[QUERY_STATS_CALLS]) +
+			pg_atomic_read_u64(&statsEntry->counters[QUERY_STATS_PLANS]);
+		usageIndex++;
+	}
+
+	qsort(usageArray, usageIndex, sizeof(StatsUsage), CompareStatsUsage);
+
+	int deallocCount = Max(10, usageIndex * STATS_DEALLOC_PERCENT / 100);
+	deallocCount = Min(deallocCount, usageIndex);
+
+	for (int entryIndex = 0; entryIndex < deallocCount; entryIndex++)
+	{
+		statsEntry = (QueryStatsHashEntry *) usageArray[entryIndex].entry;
+		hash_search(QueryStatsHash, &statsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	pfree(usageArray);
 }
 
 
 /*
- * placeholder function for citus_stat_statements_reset
+ * QueryWorkerStatsEntryDealloc is the equivalent of QueryStatsEntryDealloc
+ * for the per-worker statistics, where the usage of an entry is the number
+ * of executions that reached the worker.
+ */
+static void
+QueryWorkerStatsEntryDealloc(void)
+{
+	HASH_SEQ_STATUS status;
+	QueryWorkerStatsHashEntry *statsEntry = NULL;
+	long entryCount = hash_get_num_entries(QueryWorkerStatsHash);
+	int usageIndex = 0;
+
+	StatsUsage *usageArray = palloc(entryCount * sizeof(StatsUsage));
+
+	hash_seq_init(&status, QueryWorkerStatsHash);
+	while ((statsEntry = (QueryWorkerStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		usageArray[usageIndex].entry = statsEntry;
+		usageArray[usageIndex].usage =
+			pg_atomic_read_u64(&statsEntry->counters[QUERY_WORKER_STATS_CALLS]);
+		usageIndex++;
+	}
+
+	qsort(usageArray, usageIndex, sizeof(StatsUsage), CompareStatsUsage);
+
+	int deallocCount = Max(10, usageIndex * STATS_DEALLOC_PERCENT / 100);
+	deallocCount = Min(deallocCount, usageIndex);
+
+	for (int entryIndex = 0; entryIndex < deallocCount; entryIndex++)
+	{
+		statsEntry = (QueryWorkerStatsHashEntry *) usageArray[entryIndex].entry;
+		hash_search(QueryWorkerStatsHash, &statsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	pfree(usageArray);
+}
+
+
+/*
+ * CompareStatsUsage orders StatsUsage elements by ascending usage.
+ */
+static int
+CompareStatsUsage(const void *leftElement, const void *rightElement)
+{
+	const StatsUsage *leftUsage = (const StatsUsage *) leftElement;
+	const StatsUsage *rightUsage = (const StatsUsage *) rightElement;
+
+	if (leftUsage->usage < rightUsage->usage)
+	{
+		return -1;
+	}
+	else if (leftUsage->usage > rightUsage->usage)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * MillisecondsToMicroseconds converts a time in milliseconds to the
+ * microseconds that are kept in the counters.
+ */
+static uint64
+MillisecondsToMicroseconds(double milliseconds)
+{
+	if (milliseconds <= 0.0)
+	{
+		return 0;
+	}
+
+	return (uint64) (milliseconds * 1000.0 + 0.5);
+}
+
+
+/*
+ * MicrosecondsToMilliseconds converts a counter in microseconds back to the
+ * milliseconds that are shown to the user.
+ */
+static double
+MicrosecondsToMilliseconds(uint64 microseconds)
+{
+	return (double) microseconds / 1000.0;
+}
+
+
+/*
+ * citus_stat_statements_reset removes all the statistics that were collected
+ * so far.
  */
 Datum
 citus_stat_statements_reset(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_stat_statements_reset() is only supported on "
-						   "Citus Enterprise")));
+	HASH_SEQ_STATUS status;
+
+	CheckCitusVersion(ERROR);
+
+	if (QueryStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_EXCLUSIVE);
+
+	QueryStatsHashEntry *statsEntry = NULL;
+	hash_seq_init(&status, QueryStatsHash);
+	while ((statsEntry = (QueryStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		hash_search(QueryStatsHash, &statsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	QueryWorkerStatsHashEntry *workerStatsEntry = NULL;
+	hash_seq_init(&status, QueryWorkerStatsHash);
+	while ((workerStatsEntry =
+				(QueryWorkerStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		hash_search(QueryWorkerStatsHash, &workerStatsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+
 	PG_RETURN_VOID();
 }
 
 
 /*
- * placeholder function for citus_query_stats
+ * citus_query_stats returns the statistics of the distributed queries per
+ * executor and partition key value.
  */
 Datum
 citus_query_stats(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_query_stats() is only supported on "
-						   "Citus Enterprise")));
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreQueryStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
 	PG_RETURN_VOID();
 }
 
 
+/*
+ * citus_query_stats_per_worker returns the statistics of the distributed
+ * queries per worker.
+ */
+Datum
+citus_query_stats_per_worker(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreQueryWorkerStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreQueryStats inserts the query statistics into the given tuplestore.
+ * Like pg_stat_statements, only the statistics of the current user are
+ * shown, unless the user is allowed to read all statistics.
+ */
+static void
+StoreQueryStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_QUERY_STATS_COLUMNS];
+	bool isNulls[CITUS_QUERY_STATS_COLUMNS];
+	Oid userId = GetUserId();
+	bool canReadAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	if (QueryStatsHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *statsEntry = NULL;
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((statsEntry = (QueryStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		pg_atomic_uint64 *counters = statsEntry->counters;
+
+		if (!canReadAllStats && statsEntry->key.userId != userId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum((int64) statsEntry->key.queryId);
+		values[1] = ObjectIdGetDatum(statsEntry->key.userId);
+		values[2] = ObjectIdGetDatum(statsEntry->key.databaseId);
+		values[3] = Int64GetDatum((int64) statsEntry->key.executorType);
+
+		if (statsEntry->key.hasPartitionKey)
+		{
+			values[4] = CStringGetTextDatum(statsEntry->key.partitionKey);
+		}
+		else
+		{
+			isNulls[4] = true;
+		}
+
+		values[5] = Int64GetDatum(pg_atomic_read_u64(&counters[QUERY_STATS_CALLS]));
+		values[6] = Int64GetDatum(pg_atomic_read_u64(&counters[QUERY_STATS_PLANS]));
+		values[7] = Float8GetDatum(MicrosecondsToMilliseconds(
+									   pg_atomic_read_u64(&counters[QUERY_STATS_PLAN_TIME])));
+		values[8] = Float8GetDatum(MicrosecondsToMilliseconds(
+									   pg_atomic_read_u64(&counters[QUERY_STATS_EXEC_TIME])));
+		values[9] = Int64GetDatum(pg_atomic_read_u64(&counters[QUERY_STATS_ROWS]));
+		values[10] = Int64GetDatum(
+			pg_atomic_read_u64(&counters[QUERY_STATS_REMOTE_BYTES]));
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+}
+
+
+/*
+ * StoreQueryWorkerStats inserts the per-worker query statistics into the
+ * given tuplestore, with the same visibility rules as StoreQueryStats.
+ */
+static void
+StoreQueryWorkerStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_QUERY_STATS_PER_WORKER_COLUMNS];
+	bool isNulls[CITUS_QUERY_STATS_PER_WORKER_COLUMNS];
+	Oid userId = GetUserId();
+	bool canReadAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	if (QueryWorkerStatsHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->queryStatsHashLock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	QueryWorkerStatsHashEntry *statsEntry = NULL;
+
+	hash_seq_init(&status, QueryWorkerStatsHash);
+	while ((statsEntry = (QueryWorkerStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		pg_atomic_uint64 *counters = statsEntry->counters;
+
+		if (!canReadAllStats && statsEntry->key.userId != userId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum((int64) statsEntry->key.queryId);
+		values[1] = ObjectIdGetDatum(statsEntry->key.userId);
+		values[2] = ObjectIdGetDatum(statsEntry->key.databaseId);
+		values[3] = Int32GetDatum(statsEntry->key.nodeId);
+		values[4] = Int64GetDatum(
+			pg_atomic_read_u64(&counters[QUERY_WORKER_STATS_CALLS]));
+		values[5] = Int64GetDatum(
+			pg_atomic_read_u64(&counters[QUERY_WORKER_STATS_TASKS]));
+		values[6] = Int64GetDatum(
+			pg_atomic_read_u64(&counters[QUERY_WORKER_STATS_ROWS]));
+		values[7] = Int64GetDatum(
+			pg_atomic_read_u64(&counters[QUERY_WORKER_STATS_REMOTE_BYTES]));
+		values[8] = Float8GetDatum(MicrosecondsToMilliseconds(
+									   pg_atomic_read_u64(&counters[QUERY_WORKER_STATS_TIME])));
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->queryStatsHashLock);
+}
+
+
+/*
+ * QueryStatsShmemSize returns the size that should be allocated on the
+ * shared memory for the query statistics.
+ */
+static size_t
+QueryStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(QueryStatsSharedData));
+	size = add_size(size, hash_estimate_size(StatStatementsMax,
+											 sizeof(QueryStatsHashEntry)));
+	size = add_size(size, hash_estimate_size(StatStatementsMax,
+											 sizeof(QueryWorkerStatsHashEntry)));
+
+	return size;
+}
+
+
+/*
+ * QueryStatsShmemInit initializes the shared memory used for keeping track
+ * of query statistics across backends.
+ */
+static void
+QueryStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	HASHCTL workerInfo;
+
+	/* create (userid, dbid, queryid, executor, partition key) -> [counters] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(QueryStatsHashKey);
+	info.entrysize = sizeof(QueryStatsHashEntry);
+
+	/* create (userid, dbid, queryid, nodeid) -> [counters] */
+	memset(&workerInfo, 0, sizeof(workerInfo));
+	workerInfo.keysize = sizeof(QueryWorkerStatsHashKey);
+	workerInfo.entrysize = sizeof(QueryWorkerStatsHashEntry);
+
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	QueryStatsSharedState =
+		(QueryStatsSharedData *) ShmemInitStruct("Query Stats Data",
+												 sizeof(QueryStatsSharedData),
+												 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		QueryStatsSharedState->queryStatsHashTrancheId = LWLockNewTrancheId();
+		QueryStatsSharedState->queryStatsHashTrancheName = "Query Stats Hash Tranche";
+		LWLockRegisterTranche(QueryStatsSharedState->queryStatsHashTrancheId,
+							  QueryStatsSharedState->queryStatsHashTrancheName);
+
+		LWLockInitialize(&QueryStatsSharedState->queryStatsHashLock,
+						 QueryStatsSharedState->queryStatsHashTrancheId);
+	}
+
+	/* allocate hash tables */
+	QueryStatsHash = ShmemInitHash("Query Stats Hash", StatStatementsMax,
+								   StatStatementsMax, &info, hashFlags);
+	QueryWorkerStatsHash = ShmemInitHash("Query Worker Stats Hash", StatStatementsMax,
+										 StatStatementsMax, &workerInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(QueryStatsHash != NULL);
+	Assert(QueryWorkerStatsHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
 /*
  * citus_executor_name is a UDF that returns the name of the executor
  * given the internal enum value.
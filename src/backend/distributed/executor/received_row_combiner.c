@@ -0,0 +1,300 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_combiner.c
+ *    Combining rows received from the workers per group before they are
+ *    stored in the tuple store of the remote scan.
+ *
+ * When the coordinator groups the results of a remote scan, each worker
+ * sends a row per group for each of its shards, and all of these rows used
+ * to be stored in the tuple store before the coordinator aggregated them.
+ * If the planner determined that the aggregates can be applied to their
+ * own results (see SetCombineOnReceive()), received rows are instead
+ * combined into a hash table with one entry per group, and only the
+ * combined rows are stored once all results are received. The coordinator
+ * still aggregates the combined rows, so rows that bypass the combiner
+ * (e.g. from local execution) do not affect the result.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "distributed/listutils.h"
+#include "distributed/received_row_combiner.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "utils/datum.h"
+#include "utils/memutils.h"
+
+
+/* number of buckets the hash table starts with */
+#define RECEIVED_ROW_COMBINER_BUCKETS 1024
+
+
+/*
+ * ReceivedRowCombiner keeps a hash table with one entry per group of received
+ * rows, whose additional data holds the combined values of the group.
+ */
+struct ReceivedRowCombiner
+{
+	TupleDesc tupleDescriptor;
+	int columnCount;
+
+	TupleHashTable hashTable;
+	TupleTableSlot *inputSlot;
+
+	/* transition function per column, or fn_oid InvalidOid to keep the first value */
+	FmgrInfo *combineFunctions;
+
+	/* memory for the hash table and the combined values */
+	MemoryContext tableContext;
+
+	/* memory that is reset after each received row */
+	MemoryContext tempContext;
+};
+
+
+/* combined values of a group, stored in the additional data of the entry */
+typedef struct CombinedRow
+{
+	Datum *values;
+	bool *nulls;
+} CombinedRow;
+
+
+/* config variable managed via guc.c */
+bool EnableCombineOnReceive = false;
+
+
+static void CombineColumnValue(ReceivedRowCombiner *combiner, CombinedRow *combinedRow,
+							   int columnIndex, Datum value);
+
+
+/*
+ * CreateReceivedRowCombiner creates a combiner for rows of the given tuple
+ * descriptor, as described by the combine fields of the given distributed
+ * plan. The parent is the plan state of the remote scan receiving the rows.
+ */
+ReceivedRowCombiner *
+CreateReceivedRowCombiner(DistributedPlan *distributedPlan, TupleDesc tupleDescriptor,
+						  PlanState *parent)
+{
+	List *groupColumnList = distributedPlan->combineGroupColumnList;
+	int groupColumnCount = list_length(groupColumnList);
+	Oid *groupOperators = palloc0(groupColumnCount * sizeof(Oid));
+	Oid *groupCollations = palloc0(groupColumnCount * sizeof(Oid));
+	AttrNumber *groupColumns = palloc0(groupColumnCount * sizeof(AttrNumber));
+	Oid *equalityFunctions = NULL;
+	FmgrInfo *hashFunctions = NULL;
+	int groupIndex = 0;
+
+	Assert(list_length(distributedPlan->combineFunctionList) == tupleDescriptor->natts);
+
+	ReceivedRowCombiner *combiner = palloc0(sizeof(ReceivedRowCombiner));
+	combiner->tupleDescriptor = tupleDescriptor;
+	combiner->columnCount = tupleDescriptor->natts;
+
+	for (groupIndex = 0; groupIndex < groupColumnCount; groupIndex++)
+	{
+		groupColumns[groupIndex] = list_nth_int(groupColumnList, groupIndex);
+		groupOperators[groupIndex] =
+			list_nth_oid(distributedPlan->combineGroupOperatorList, groupIndex);
+		groupCollations[groupIndex] =
+			list_nth_oid(distributedPlan->combineGroupCollationList, groupIndex);
+	}
+
+	combiner->combineFunctions = palloc0(combiner->columnCount * sizeof(FmgrInfo));
+
+	int columnIndex = 0;
+	Oid combineFunctionId = InvalidOid;
+	foreach_oid(combineFunctionId, distributedPlan->combineFunctionList)
+	{
+		if (OidIsValid(combineFunctionId))
+		{
+			fmgr_info(combineFunctionId, &combiner->combineFunctions[columnIndex]);
+		}
+
+		columnIndex++;
+	}
+
+	combiner->tableContext = AllocSetContextCreate(CurrentMemoryContext,
+												   "Received Row Combiner",
+												   ALLOCSET_DEFAULT_SIZES);
+	combiner->tempContext = AllocSetContextCreate(CurrentMemoryContext,
+												  "Received Row Combiner Temporary",
+												  ALLOCSET_SMALL_SIZES);
+
+	execTuplesHashPrepare(groupColumnCount, groupOperators, &equalityFunctions,
+						  &hashFunctions);
+
+	combiner->hashTable = BuildTupleHashTableCompat(parent, tupleDescriptor,
+													groupColumnCount, groupColumns,
+													equalityFunctions, hashFunctions,
+													groupCollations,
+													RECEIVED_ROW_COMBINER_BUCKETS,
+													sizeof(CombinedRow),
+													combiner->tableContext,
+													combiner->tempContext, false);
+
+	combiner->inputSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														 &TTSOpsMinimalTuple);
+
+	return combiner;
+}
+
+
+/*
+ * CombineReceivedRow combines the given row with the previously received
+ * rows of its group. The row itself may be freed afterwards.
+ */
+void
+CombineReceivedRow(ReceivedRowCombiner *combiner, HeapTuple heapTuple)
+{
+	bool isNew = false;
+	MemoryContext oldContext = MemoryContextSwitchTo(combiner->tempContext);
+
+	MinimalTuple minimalTuple = minimal_tuple_from_heap_tuple(heapTuple);
+	ExecStoreMinimalTuple(minimalTuple, combiner->inputSlot, false);
+
+	MemoryContextSwitchTo(oldContext);
+
+	TupleHashEntry entry = LookupTupleHashEntry(combiner->hashTable,
+												combiner->inputSlot, &isNew);
+
+	slot_getallattrs(combiner->inputSlot);
+
+	Datum *values = combiner->inputSlot->tts_values;
+	bool *nulls = combiner->inputSlot->tts_isnull;
+
+	if (isNew)
+	{
+		oldContext = MemoryContextSwitchTo(combiner->tableContext);
+
+		CombinedRow *combinedRow = palloc0(sizeof(CombinedRow));
+		combinedRow->values = palloc0(combiner->columnCount * sizeof(Datum));
+		combinedRow->nulls = palloc0(combiner->columnCount * sizeof(bool));
+
+		for (int columnIndex = 0; columnIndex < combiner->columnCount; columnIndex++)
+		{
+			Form_pg_attribute attribute =
+				TupleDescAttr(combiner->tupleDescriptor, columnIndex);
+
+			combinedRow->nulls[columnIndex] = nulls[columnIndex];
+			if (!nulls[columnIndex])
+			{
+				combinedRow->values[columnIndex] =
+					datumCopy(values[columnIndex], attribute->attbyval,
+							  attribute->attlen);
+			}
+		}
+
+		MemoryContextSwitchTo(oldContext);
+
+		entry->additional = combinedRow;
+	}
+	else
+	{
+		CombinedRow *combinedRow = (CombinedRow *) entry->additional;
+
+		for (int columnIndex = 0; columnIndex < combiner->columnCount; columnIndex++)
+		{
+			if (!OidIsValid(combiner->combineFunctions[columnIndex].fn_oid) ||
+				nulls[columnIndex])
+			{
+				/* strict transition functions ignore NULL input */
+				continue;
+			}
+
+			CombineColumnValue(combiner, combinedRow, columnIndex, values[columnIndex]);
+		}
+	}
+
+	ExecClearTuple(combiner->inputSlot);
+	MemoryContextReset(combiner->tempContext);
+}
+
+
+/*
+ * CombineColumnValue applies the transition function of the given column to
+ * the combined value of the column and the given value.
+ */
+static void
+CombineColumnValue(ReceivedRowCombiner *combiner, CombinedRow *combinedRow,
+				   int columnIndex, Datum value)
+{
+	Form_pg_attribute attribute = TupleDescAttr(combiner->tupleDescriptor, columnIndex);
+
+	MemoryContext oldContext = NULL;
+
+	if (combinedRow->nulls[columnIndex])
+	{
+		/* the first non-NULL input of a strict transition function becomes the state */
+		oldContext = MemoryContextSwitchTo(combiner->tableContext);
+		combinedRow->values[columnIndex] =
+			datumCopy(value, attribute->attbyval, attribute->attlen);
+		combinedRow->nulls[columnIndex] = false;
+		MemoryContextSwitchTo(oldContext);
+		return;
+	}
+
+	Datum oldValue = combinedRow->values[columnIndex];
+
+	oldContext = MemoryContextSwitchTo(combiner->tempContext);
+
+	Datum newValue = FunctionCall2(&combiner->combineFunctions[columnIndex],
+								   oldValue, value);
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (!attribute->attbyval && DatumGetPointer(newValue) != DatumGetPointer(oldValue))
+	{
+		/* the result lives in the temporary context, or in the received row */
+		oldContext = MemoryContextSwitchTo(combiner->tableContext);
+		combinedRow->values[columnIndex] =
+			datumCopy(newValue, attribute->attbyval, attribute->attlen);
+		MemoryContextSwitchTo(oldContext);
+
+		pfree(DatumGetPointer(oldValue));
+	}
+	else
+	{
+		combinedRow->values[columnIndex] = newValue;
+	}
+}
+
+
+/*
+ * FlushReceivedRowCombiner stores a row per group in the given tuple store,
+ * and releases the memory of the combiner.
+ */
+void
+FlushReceivedRowCombiner(ReceivedRowCombiner *combiner, Tuplestorestate *tupleStore)
+{
+	TupleHashIterator hashIterator;
+	TupleHashEntry entry = NULL;
+
+	InitTupleHashIterator(combiner->hashTable, &hashIterator);
+
+	while ((entry = ScanTupleHashTable(combiner->hashTable, &hashIterator)) != NULL)
+	{
+		CombinedRow *combinedRow = (CombinedRow *) entry->additional;
+
+		MemoryContext oldContext = MemoryContextSwitchTo(combiner->tempContext);
+
+		HeapTuple heapTuple = heap_form_tuple(combiner->tupleDescriptor,
+											  combinedRow->values, combinedRow->nulls);
+		tuplestore_puttuple(tupleStore, heapTuple);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(combiner->tempContext);
+	}
+
+	TermTupleHashIterator(&hashIterator);
+
+	ExecDropSingleTupleTableSlot(combiner->inputSlot);
+	MemoryContextDelete(combiner->tableContext);
+	MemoryContextDelete(combiner->tempContext);
+}
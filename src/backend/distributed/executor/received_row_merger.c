@@ -0,0 +1,349 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_merger.c
+ *    Merging the sorted results that the tasks of a remote scan return,
+ *    instead of sorting all received rows on the coordinator.
+ *
+ * When the worker queries are ordered the same way as the coordinator
+ * query, the planner removes the Sort above the remote scan (see
+ * SetSortedMerge()), and the executor is responsible for storing the rows
+ * in sort order. The rows of each task are kept in a run of their own as
+ * they are received, and once all results are received the runs are merged
+ * into the tuple store of the remote scan using a binary heap, which takes
+ * O(N log k) comparisons for N rows from k tasks. Rows that are stored in
+ * the tuple store directly, such as the results of local execution, are
+ * sorted and merged as one more run.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "distributed/listutils.h"
+#include "distributed/received_row_merger.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "lib/binaryheap.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/sortsupport.h"
+#include "utils/tuplesort.h"
+
+
+/* each run may use at least this much memory (in kB) before spilling to disk */
+#define MINIMUM_RUN_WORK_MEM 64
+
+
+/*
+ * ReceivedRowRun holds the sorted rows received for a single task.
+ */
+struct ReceivedRowRun
+{
+	Tuplestorestate *tupleStore;
+};
+
+
+/* maps a task to its run */
+typedef struct ReceivedRowRunEntry
+{
+	Task *task;
+	ReceivedRowRun *run;
+} ReceivedRowRunEntry;
+
+
+/*
+ * ReceivedRowMerger keeps a run per task, and how to compare rows.
+ */
+struct ReceivedRowMerger
+{
+	TupleDesc tupleDescriptor;
+
+	/* sort keys of the remote scan columns */
+	int sortKeyCount;
+	AttrNumber *sortColumns;
+	Oid *sortOperators;
+	Oid *sortCollations;
+	bool *nullsFirst;
+	SortSupport sortKeys;
+
+	/* one run per task, and a sorted run of the other stored rows */
+	int runCount;
+	ReceivedRowRun *runs;
+	HTAB *runHash;
+	Tuplesortstate *otherRowsSort;
+
+	/* current row of each run while merging */
+	TupleTableSlot **runSlots;
+};
+
+
+/* config variable managed via guc.c */
+bool EnableSortedMerge = false;
+
+
+static void SortStoredRows(ReceivedRowMerger *merger, Tuplestorestate *tupleStore);
+static bool FetchRunRow(ReceivedRowMerger *merger, int runIndex);
+static int CompareRunRows(Datum left, Datum right, void *arg);
+
+
+/*
+ * CreateReceivedRowMerger creates a merger for rows of the given tuple
+ * descriptor, with a run for each of the given tasks, as described by the
+ * merge fields of the given distributed plan.
+ */
+ReceivedRowMerger *
+CreateReceivedRowMerger(DistributedPlan *distributedPlan, TupleDesc tupleDescriptor,
+						List *taskList)
+{
+	HASHCTL info;
+
+	ReceivedRowMerger *merger = palloc0(sizeof(ReceivedRowMerger));
+	merger->tupleDescriptor = tupleDescriptor;
+
+	int sortKeyCount = list_length(distributedPlan->mergeSortColumnList);
+	merger->sortKeyCount = sortKeyCount;
+	merger->sortColumns = palloc0(sortKeyCount * sizeof(AttrNumber));
+	merger->sortOperators = palloc0(sortKeyCount * sizeof(Oid));
+	merger->sortCollations = palloc0(sortKeyCount * sizeof(Oid));
+	merger->nullsFirst = palloc0(sortKeyCount * sizeof(bool));
+	merger->sortKeys = palloc0(sortKeyCount * sizeof(SortSupportData));
+
+	for (int sortIndex = 0; sortIndex < sortKeyCount; sortIndex++)
+	{
+		SortSupport sortKey = &merger->sortKeys[sortIndex];
+
+		merger->sortColumns[sortIndex] =
+			list_nth_int(distributedPlan->mergeSortColumnList, sortIndex);
+		merger->sortOperators[sortIndex] =
+			list_nth_oid(distributedPlan->mergeSortOperatorList, sortIndex);
+		merger->sortCollations[sortIndex] =
+			list_nth_oid(distributedPlan->mergeSortCollationList, sortIndex);
+		merger->nullsFirst[sortIndex] =
+			list_nth_int(distributedPlan->mergeNullsFirstList, sortIndex) != 0;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = merger->sortCollations[sortIndex];
+		sortKey->ssup_nulls_first = merger->nullsFirst[sortIndex];
+		sortKey->ssup_attno = merger->sortColumns[sortIndex];
+
+		PrepareSortSupportFromOrderingOp(merger->sortOperators[sortIndex], sortKey);
+	}
+
+	merger->runCount = list_length(taskList);
+	merger->runs = palloc0(merger->runCount * sizeof(ReceivedRowRun));
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Task *);
+	info.entrysize = sizeof(ReceivedRowRunEntry);
+	info.hcxt = CurrentMemoryContext;
+
+	merger->runHash = hash_create("Received Row Runs", Max(merger->runCount, 16), &info,
+								  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	/* the runs share work_mem */
+	int runWorkMem = Max(work_mem / Max(merger->runCount, 1), MINIMUM_RUN_WORK_MEM);
+
+	int runIndex = 0;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		bool found = false;
+		ReceivedRowRun *run = &merger->runs[runIndex];
+
+		run->tupleStore = tuplestore_begin_heap(false, false, runWorkMem);
+
+		ReceivedRowRunEntry *entry = hash_search(merger->runHash, &task, HASH_ENTER,
+												 &found);
+		entry->run = run;
+
+		runIndex++;
+	}
+
+	return merger;
+}
+
+
+/*
+ * ReceivedRowMergerRun returns the run for the rows of the given task.
+ */
+ReceivedRowRun *
+ReceivedRowMergerRun(ReceivedRowMerger *merger, Task *task)
+{
+	bool found = false;
+
+	ReceivedRowRunEntry *entry = hash_search(merger->runHash, &task, HASH_FIND,
+											 &found);
+	if (!found)
+	{
+		ereport(ERROR, (errmsg("received rows for a task that is not merged")));
+	}
+
+	return entry->run;
+}
+
+
+/*
+ * AddReceivedRowToRun adds the given row to the end of the given run. The
+ * row itself may be freed afterwards.
+ */
+void
+AddReceivedRowToRun(ReceivedRowRun *run, HeapTuple heapTuple)
+{
+	tuplestore_puttuple(run->tupleStore, heapTuple);
+}
+
+
+/*
+ * FlushReceivedRowMerger replaces the rows in the given tuple store by all
+ * rows in sort order, and releases the memory of the merger.
+ */
+void
+FlushReceivedRowMerger(ReceivedRowMerger *merger, Tuplestorestate *tupleStore)
+{
+	/* the last run holds the rows that were stored directly */
+	int mergedRunCount = merger->runCount + 1;
+
+	SortStoredRows(merger, tupleStore);
+
+	merger->runSlots = palloc0(mergedRunCount * sizeof(TupleTableSlot *));
+
+	binaryheap *heap = binaryheap_allocate(mergedRunCount, CompareRunRows, merger);
+
+	for (int runIndex = 0; runIndex < mergedRunCount; runIndex++)
+	{
+		merger->runSlots[runIndex] =
+			MakeSingleTupleTableSlotCompat(merger->tupleDescriptor,
+										   &TTSOpsMinimalTuple);
+
+		if (FetchRunRow(merger, runIndex))
+		{
+			binaryheap_add_unordered(heap, Int32GetDatum(runIndex));
+		}
+	}
+
+	binaryheap_build(heap);
+
+	while (!binaryheap_empty(heap))
+	{
+		int runIndex = DatumGetInt32(binaryheap_first(heap));
+
+		tuplestore_puttupleslot(tupleStore, merger->runSlots[runIndex]);
+
+		if (FetchRunRow(merger, runIndex))
+		{
+			binaryheap_replace_first(heap, Int32GetDatum(runIndex));
+		}
+		else
+		{
+			binaryheap_remove_first(heap);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	binaryheap_free(heap);
+
+	for (int runIndex = 0; runIndex < mergedRunCount; runIndex++)
+	{
+		ExecDropSingleTupleTableSlot(merger->runSlots[runIndex]);
+	}
+
+	for (int runIndex = 0; runIndex < merger->runCount; runIndex++)
+	{
+		tuplestore_end(merger->runs[runIndex].tupleStore);
+	}
+
+	tuplesort_end(merger->otherRowsSort);
+	hash_destroy(merger->runHash);
+}
+
+
+/*
+ * SortStoredRows moves the rows that were stored in the given tuple store
+ * directly into a sort, which becomes the last run to merge.
+ */
+static void
+SortStoredRows(ReceivedRowMerger *merger, Tuplestorestate *tupleStore)
+{
+	merger->otherRowsSort = tuplesort_begin_heap(merger->tupleDescriptor,
+												 merger->sortKeyCount,
+												 merger->sortColumns,
+												 merger->sortOperators,
+												 merger->sortCollations,
+												 merger->nullsFirst,
+												 work_mem, NULL, false);
+
+	if (tuplestore_tuple_count(tupleStore) > 0)
+	{
+		TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(merger->tupleDescriptor,
+															  &TTSOpsMinimalTuple);
+
+		tuplestore_rescan(tupleStore);
+
+		while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+		{
+			tuplesort_puttupleslot(merger->otherRowsSort, slot);
+		}
+
+		ExecDropSingleTupleTableSlot(slot);
+		tuplestore_clear(tupleStore);
+	}
+
+	tuplesort_performsort(merger->otherRowsSort);
+}
+
+
+/*
+ * FetchRunRow reads the next row of the given run into its slot, and returns
+ * whether there was one.
+ */
+static bool
+FetchRunRow(ReceivedRowMerger *merger, int runIndex)
+{
+	TupleTableSlot *slot = merger->runSlots[runIndex];
+
+	if (runIndex == merger->runCount)
+	{
+		return tuplesort_gettupleslot(merger->otherRowsSort, true, false, slot, NULL);
+	}
+
+	return tuplestore_gettupleslot(merger->runs[runIndex].tupleStore, true, false, slot);
+}
+
+
+/*
+ * CompareRunRows compares the current rows of two runs. The binary heap keeps
+ * the largest element first, so the result is inverted to merge in ascending
+ * sort order.
+ */
+static int
+CompareRunRows(Datum left, Datum right, void *arg)
+{
+	ReceivedRowMerger *merger = (ReceivedRowMerger *) arg;
+	TupleTableSlot *leftSlot = merger->runSlots[DatumGetInt32(left)];
+	TupleTableSlot *rightSlot = merger->runSlots[DatumGetInt32(right)];
+
+	for (int sortIndex = 0; sortIndex < merger->sortKeyCount; sortIndex++)
+	{
+		SortSupport sortKey = &merger->sortKeys[sortIndex];
+		AttrNumber attributeNumber = sortKey->ssup_attno;
+		bool leftIsNull = false;
+		bool rightIsNull = false;
+
+		Datum leftValue = slot_getattr(leftSlot, attributeNumber, &leftIsNull);
+		Datum rightValue = slot_getattr(rightSlot, attributeNumber, &rightIsNull);
+
+		int compare = ApplySortComparator(leftValue, leftIsNull, rightValue,
+										  rightIsNull, sortKey);
+		if (compare != 0)
+		{
+			return -compare;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_top_n.c
+ *    Keeping only the first rows in sort order of the rows received from
+ *    the workers when the coordinator applies ORDER BY ... LIMIT.
+ *
+ * The LIMIT of such queries is pushed down to the workers, but each shard
+ * still returns up to LIMIT rows, all of which used to be stored in the
+ * tuple store of the remote scan before the coordinator sorted them. If the
+ * planner found a Limit directly above a Sort of the remote scan (see
+ * SetTopNOnReceive()), received rows are instead fed into a bounded sort
+ * that only keeps the first LIMIT (plus OFFSET) rows, and only those are
+ * stored once all results are received. The coordinator still sorts and
+ * limits the stored rows, so rows that bypass the bounded sort (e.g. from
+ * local execution) do not affect the result.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "distributed/listutils.h"
+#include "distributed/received_row_top_n.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "utils/memutils.h"
+#include "utils/tuplesort.h"
+
+
+/*
+ * ReceivedRowTopN wraps a bounded tuple sort of the received rows.
+ */
+struct ReceivedRowTopN
+{
+	Tuplesortstate *sortState;
+	TupleTableSlot *inputSlot;
+
+	/* memory that is reset after each received row */
+	MemoryContext tempContext;
+};
+
+
+/* config variable managed via guc.c */
+bool EnableTopNOnReceive = false;
+
+
+/*
+ * CreateReceivedRowTopN creates a bounded sort for rows of the given tuple
+ * descriptor, as described by the top-N fields of the given distributed plan.
+ */
+ReceivedRowTopN *
+CreateReceivedRowTopN(DistributedPlan *distributedPlan, TupleDesc tupleDescriptor)
+{
+	List *sortColumnList = distributedPlan->topNSortColumnList;
+	int sortColumnCount = list_length(sortColumnList);
+	AttrNumber *sortColumns = palloc0(sortColumnCount * sizeof(AttrNumber));
+	Oid *sortOperators = palloc0(sortColumnCount * sizeof(Oid));
+	Oid *sortCollations = palloc0(sortColumnCount * sizeof(Oid));
+	bool *nullsFirst = palloc0(sortColumnCount * sizeof(bool));
+
+	Assert(distributedPlan->topNCount > 0);
+
+	for (int sortIndex = 0; sortIndex < sortColumnCount; sortIndex++)
+	{
+		sortColumns[sortIndex] = list_nth_int(sortColumnList, sortIndex);
+		sortOperators[sortIndex] =
+			list_nth_oid(distributedPlan->topNSortOperatorList, sortIndex);
+		sortCollations[sortIndex] =
+			list_nth_oid(distributedPlan->topNSortCollationList, sortIndex);
+		nullsFirst[sortIndex] =
+			list_nth_int(distributedPlan->topNNullsFirstList, sortIndex) != 0;
+	}
+
+	ReceivedRowTopN *topN = palloc0(sizeof(ReceivedRowTopN));
+
+	topN->sortState = tuplesort_begin_heap(tupleDescriptor, sortColumnCount,
+										   sortColumns, sortOperators, sortCollations,
+										   nullsFirst, work_mem, NULL, false);
+	tuplesort_set_bound(topN->sortState, distributedPlan->topNCount);
+
+	topN->inputSlot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+													 &TTSOpsMinimalTuple);
+	topN->tempContext = AllocSetContextCreate(CurrentMemoryContext,
+											  "Received Row Top-N Temporary",
+											  ALLOCSET_SMALL_SIZES);
+
+	return topN;
+}
+
+
+/*
+ * AddReceivedRowToTopN adds the given row to the bounded sort, which discards
+ * it right away if it sorts after the rows that are kept. The row itself may
+ * be freed afterwards.
+ */
+void
+AddReceivedRowToTopN(ReceivedRowTopN *topN, HeapTuple heapTuple)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(topN->tempContext);
+
+	MinimalTuple minimalTuple = minimal_tuple_from_heap_tuple(heapTuple);
+	ExecStoreMinimalTuple(minimalTuple, topN->inputSlot, false);
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* the sort copies the tuple into its own memory */
+	tuplesort_puttupleslot(topN->sortState, topN->inputSlot);
+
+	ExecClearTuple(topN->inputSlot);
+	MemoryContextReset(topN->tempContext);
+}
+
+
+/*
+ * FlushReceivedRowTopN stores the kept rows in the given tuple store, and
+ * releases the memory of the bounded sort.
+ */
+void
+FlushReceivedRowTopN(ReceivedRowTopN *topN, Tuplestorestate *tupleStore)
+{
+	tuplesort_performsort(topN->sortState);
+
+	while (tuplesort_gettupleslot(topN->sortState, true, false, topN->inputSlot, NULL))
+	{
+		tuplestore_puttupleslot(tupleStore, topN->inputSlot);
+	}
+
+	ExecDropSingleTupleTableSlot(topN->inputSlot);
+	tuplesort_end(topN->sortState);
+	MemoryContextDelete(topN->tempContext);
+}
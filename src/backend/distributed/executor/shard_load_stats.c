@@ -0,0 +1,438 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_load_stats.c
+ *    Sampled statistics of the most loaded shards and partition key values.
+ *
+ * The router and fast-path planners know the single shard, and usually the
+ * partition key value, that a query targets. A sample of those queries is
+ * counted per shard and per shard and partition key value, such that hot
+ * shards and hot tenants can be found before they cause trouble.
+ *
+ * Since there can be far more partition key values than we can keep in
+ * shared memory, the entries form a space-saving summary: once the hash is
+ * full, the entry with the fewest calls is replaced by the new one, which
+ * inherits its calls. The calls of every entry are therefore overestimated
+ * by at most its max_error, and every value with more calls than the
+ * smallest count in the summary is guaranteed to be in it. Calls and times
+ * are scaled by the sample rate, such that they estimate the actual load.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/relay_utility.h"
+#include "distributed/shard_load_stats.h"
+#include "distributed/tuplestore.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+
+#define CITUS_SHARD_LOAD_COLUMNS 5
+
+
+/*
+ * The data structure used to store data in shared memory. Finding the entry
+ * to replace requires a consistent view of the summary, so all changes are
+ * made while holding the lock in exclusive mode.
+ */
+typedef struct ShardLoadSharedData
+{
+	int shardLoadHashTrancheId;
+	char *shardLoadHashTrancheName;
+
+	LWLock shardLoadHashLock;
+} ShardLoadSharedData;
+
+typedef struct ShardLoadHashKey
+{
+	Oid databaseId;
+	uint64 shardId;
+
+	/* partition key value, possibly truncated, unset for the shard as a whole */
+	bool hasPartitionKey;
+	char partitionKey[NAMEDATALEN];
+} ShardLoadHashKey;
+
+/* hash entry for the load of a single shard or partition key value */
+typedef struct ShardLoadHashEntry
+{
+	ShardLoadHashKey key;
+
+	/* estimated calls and execution time in milliseconds */
+	double calls;
+	double totalTime;
+
+	/* calls inherited from the entry that this entry replaced */
+	double maxError;
+} ShardLoadHashEntry;
+
+
+/* GUC, maximum number of shards and partition key values tracked */
+int ShardLoadStatsMax = 1000;
+
+/* GUC, fraction of the router queries that are counted */
+double ShardLoadStatsSampleRate = 0.1;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *ShardLoadHash = NULL;
+static ShardLoadSharedData *ShardLoadSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static void AddShardLoad(ShardLoadHashKey *key, double weight, double executionTime);
+static ShardLoadHashEntry * ReplaceLeastLoadedEntry(ShardLoadHashKey *key);
+static void StoreShardLoad(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
+static void ShardLoadShmemInit(void);
+static size_t ShardLoadShmemSize(void);
+
+
+PG_FUNCTION_INFO_V1(citus_shard_load);
+PG_FUNCTION_INFO_V1(citus_shard_load_reset);
+
+
+/*
+ * citus_shard_load returns the estimated load of the most loaded shards and
+ * partition key values in the current database.
+ */
+Datum
+citus_shard_load(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreShardLoad(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_load_reset removes all the statistics of the current database.
+ */
+Datum
+citus_shard_load_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	ShardLoadHashEntry *loadEntry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (ShardLoadHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&ShardLoadSharedState->shardLoadHashLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ShardLoadHash);
+	while ((loadEntry = (ShardLoadHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (loadEntry->key.databaseId == MyDatabaseId)
+		{
+			hash_search(ShardLoadHash, &loadEntry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	LWLockRelease(&ShardLoadSharedState->shardLoadHashLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ShardLoadStatsEnabled returns whether the load of router queries is
+ * counted.
+ */
+bool
+ShardLoadStatsEnabled(void)
+{
+	return ShardLoadHash != NULL && ShardLoadStatsSampleRate > 0.0;
+}
+
+
+/*
+ * RecordShardLoad counts an execution of the given job that took the given
+ * time in milliseconds against its shard and partition key value, if the job
+ * targets a single shard and the execution is sampled.
+ */
+void
+RecordShardLoad(Job *workerJob, double executionTime)
+{
+	ShardLoadHashKey key;
+
+	if (!ShardLoadStatsEnabled() || workerJob == NULL ||
+		list_length(workerJob->taskList) != 1)
+	{
+		return;
+	}
+
+	Task *task = (Task *) linitial(workerJob->taskList);
+	if (task->anchorShardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	if (ShardLoadStatsSampleRate < 1.0 &&
+		random() >= ShardLoadStatsSampleRate * (double) MAX_RANDOM_VALUE)
+	{
+		return;
+	}
+
+	/* each sampled call stands for the calls that were not sampled */
+	double weight = 1.0 / ShardLoadStatsSampleRate;
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = task->anchorShardId;
+
+	AddShardLoad(&key, weight, executionTime);
+
+	Const *partitionKeyConst = workerJob->partitionKeyValue;
+	if (partitionKeyConst == NULL || partitionKeyConst->constisnull)
+	{
+		return;
+	}
+
+	char *partitionKeyString = DatumToString(partitionKeyConst->constvalue,
+											 partitionKeyConst->consttype);
+
+	key.hasPartitionKey = true;
+	strlcpy(key.partitionKey, partitionKeyString, NAMEDATALEN);
+
+	AddShardLoad(&key, weight, executionTime);
+}
+
+
+/*
+ * AddShardLoad adds a call with the given weight and execution time to the
+ * entry of the given key, replacing the least loaded entry if the key is not
+ * in the summary yet and the summary is full.
+ */
+static void
+AddShardLoad(ShardLoadHashKey *key, double weight, double executionTime)
+{
+	bool found = false;
+
+	LWLockAcquire(&ShardLoadSharedState->shardLoadHashLock, LW_EXCLUSIVE);
+
+	ShardLoadHashEntry *loadEntry = hash_search(ShardLoadHash, key, HASH_FIND, &found);
+	if (loadEntry == NULL)
+	{
+		if (hash_get_num_entries(ShardLoadHash) >= ShardLoadStatsMax)
+		{
+			loadEntry = ReplaceLeastLoadedEntry(key);
+		}
+		else
+		{
+			loadEntry = hash_search(ShardLoadHash, key, HASH_ENTER, &found);
+			loadEntry->calls = 0.0;
+			loadEntry->totalTime = 0.0;
+			loadEntry->maxError = 0.0;
+		}
+	}
+
+	loadEntry->calls += weight;
+	loadEntry->totalTime += weight * executionTime;
+
+	LWLockRelease(&ShardLoadSharedState->shardLoadHashLock);
+}
+
+
+/*
+ * ReplaceLeastLoadedEntry removes the entry with the fewest calls from the
+ * full summary and adds an entry for the given key that inherits its calls
+ * as the maximum error of its own calls.
+ */
+static ShardLoadHashEntry *
+ReplaceLeastLoadedEntry(ShardLoadHashKey *key)
+{
+	HASH_SEQ_STATUS status;
+	ShardLoadHashEntry *loadEntry = NULL;
+	ShardLoadHashEntry *leastLoadedEntry = NULL;
+
+	hash_seq_init(&status, ShardLoadHash);
+	while ((loadEntry = (ShardLoadHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (leastLoadedEntry == NULL || loadEntry->calls < leastLoadedEntry->calls)
+		{
+			leastLoadedEntry = loadEntry;
+		}
+	}
+
+	Assert(leastLoadedEntry != NULL);
+
+	double inheritedCalls = leastLoadedEntry->calls;
+
+	hash_search(ShardLoadHash, &leastLoadedEntry->key, HASH_REMOVE, NULL);
+
+	/* the removed entry leaves room for the new one */
+	loadEntry = hash_search(ShardLoadHash, key, HASH_ENTER, NULL);
+	loadEntry->calls = inheritedCalls;
+	loadEntry->totalTime = 0.0;
+	loadEntry->maxError = inheritedCalls;
+
+	return loadEntry;
+}
+
+
+/*
+ * StoreShardLoad inserts the statistics of the current database into the
+ * given tuplestore.
+ */
+static void
+StoreShardLoad(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[CITUS_SHARD_LOAD_COLUMNS];
+	bool isNulls[CITUS_SHARD_LOAD_COLUMNS];
+	HASH_SEQ_STATUS status;
+	ShardLoadHashEntry *loadEntry = NULL;
+
+	if (ShardLoadHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ShardLoadSharedState->shardLoadHashLock, LW_SHARED);
+
+	hash_seq_init(&status, ShardLoadHash);
+	while ((loadEntry = (ShardLoadHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (loadEntry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum(loadEntry->key.shardId);
+
+		if (loadEntry->key.hasPartitionKey)
+		{
+			values[1] = CStringGetTextDatum(loadEntry->key.partitionKey);
+		}
+		else
+		{
+			isNulls[1] = true;
+		}
+
+		values[2] = Int64GetDatum((int64) (loadEntry->calls + 0.5));
+		values[3] = Float8GetDatum(loadEntry->totalTime);
+		values[4] = Int64GetDatum((int64) (loadEntry->maxError + 0.5));
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&ShardLoadSharedState->shardLoadHashLock);
+}
+
+
+/*
+ * InitializeShardLoadStats requests the necessary shared memory from Postgres
+ * and sets up the shared memory startup hook.
+ */
+void
+InitializeShardLoadStats(void)
+{
+	if (ShardLoadStatsMax == 0)
+	{
+		/* statistics are disabled */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardLoadShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardLoadShmemInit;
+}
+
+
+/*
+ * ShardLoadShmemSize returns the size that should be allocated on the shared
+ * memory for the shard load statistics.
+ */
+static size_t
+ShardLoadShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardLoadSharedData));
+
+	Size hashSize = hash_estimate_size(ShardLoadStatsMax, sizeof(ShardLoadHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * ShardLoadShmemInit initializes the shared memory used for keeping track of
+ * the shard load across backends.
+ */
+static void
+ShardLoadShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (database, shard, partition key) -> [load] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ShardLoadHashKey);
+	info.entrysize = sizeof(ShardLoadHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardLoadSharedState =
+		(ShardLoadSharedData *) ShmemInitStruct("Shard Load Data",
+												sizeof(ShardLoadSharedData),
+												&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ShardLoadSharedState->shardLoadHashTrancheId = LWLockNewTrancheId();
+		ShardLoadSharedState->shardLoadHashTrancheName = "Shard Load Hash Tranche";
+		LWLockRegisterTranche(ShardLoadSharedState->shardLoadHashTrancheId,
+							  ShardLoadSharedState->shardLoadHashTrancheName);
+
+		LWLockInitialize(&ShardLoadSharedState->shardLoadHashLock,
+						 ShardLoadSharedState->shardLoadHashTrancheId);
+	}
+
+	/* allocate hash table */
+	ShardLoadHash = ShmemInitHash("Shard Load Hash", ShardLoadStatsMax,
+								  ShardLoadStatsMax, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ShardLoadHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -10,6 +10,9 @@
 
 #include "postgres.h"
 
+#include "distributed/citus_custom_scan.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/inline_intermediate_results.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
@@ -17,6 +20,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/subplan_result_cache.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_manager.h"
 #include "executor/executor.h"
@@ -27,12 +31,21 @@ int MaxIntermediateResult = 1048576; /* maximum size in KB the intermediate resu
 int SubPlanLevel = 0;
 
 
+static bool CanInlineSubPlanResults(DistributedPlan *distributedPlan);
+static bool CanPartitionSubPlanResult(IntermediateResultsHashEntry *entry,
+									  List *remoteWorkerNodeList);
+
+
 /*
  * ExecuteSubPlans executes a list of subplans from a distributed plan
  * by sequentially executing each plan from the top.
+ *
+ * If allowInlining is set, the caller sends the task queries of the plan
+ * through the adaptive executor, which inlines small results into them (see
+ * inline_intermediate_results.c).
  */
 void
-ExecuteSubPlans(DistributedPlan *distributedPlan)
+ExecuteSubPlans(DistributedPlan *distributedPlan, bool allowInlining)
 {
 	uint64 planId = distributedPlan->planId;
 	List *subPlanList = distributedPlan->subPlanList;
@@ -54,6 +67,8 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	 */
 	UseCoordinatedTransaction();
 
+	bool inlineResults = allowInlining && CanInlineSubPlanResults(distributedPlan);
+
 	DistributedSubPlan *subPlan = NULL;
 	foreach_ptr(subPlan, subPlanList)
 	{
@@ -63,19 +78,137 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 		char *resultId = GenerateResultId(planId, subPlanId);
 		List *remoteWorkerNodeList =
 			FindAllWorkerNodesUsingSubplan(intermediateResultsHash, resultId);
+		List *forwardRoundList = NIL;
 
 		IntermediateResultsHashEntry *entry =
 			SearchIntermediateResult(intermediateResultsHash, resultId);
 
+		/* an earlier execution of the same plan might have inlined the result */
+		ForgetInlinedIntermediateResult(resultId);
+
+		if (ReuseCachedSubPlanResult(subPlan, resultId, remoteWorkerNodeList,
+									 entry->writeLocalFile))
+		{
+			/* an identical subplan already ran in this transaction */
+			continue;
+		}
+
 		SubPlanLevel++;
 		EState *estate = CreateExecutorState();
-		DestReceiver *copyDest =
-			CreateRemoteFileDestReceiver(resultId, estate, remoteWorkerNodeList,
-										 entry->writeLocalFile);
+		DestReceiver *copyDest = NULL;
+		bool partitionedResult = false;
+
+		if (!inlineResults && CanPartitionSubPlanResult(entry, remoteWorkerNodeList))
+		{
+			Oid partitionRelationId = entry->partitionRelationId;
+			int partitionColumnIndex = entry->partitionColumnIndex;
+
+			/* NULL if the shards of the relation cannot be mapped to single nodes */
+			copyDest = CreateNodePartitionedResultDestReceiver(resultId, estate,
+															   remoteWorkerNodeList,
+															   partitionRelationId,
+															   partitionColumnIndex);
+			partitionedResult = (copyDest != NULL);
+		}
+
+		if (copyDest == NULL)
+		{
+			List *seedNodeList = PlanIntermediateResultForwarding(resultId,
+																  remoteWorkerNodeList,
+																  &forwardRoundList);
+
+			if (inlineResults && remoteWorkerNodeList != NIL)
+			{
+				copyDest = CreateInlineResultDestReceiver(resultId, estate,
+														  seedNodeList,
+														  entry->writeLocalFile);
+			}
+			else
+			{
+				copyDest = CreateRemoteFileDestReceiver(resultId, estate, seedNodeList,
+														entry->writeLocalFile);
+			}
+		}
 
 		ExecutePlanIntoDestReceiver(plannedStmt, params, copyDest);
 
 		SubPlanLevel--;
 		FreeExecutorState(estate);
+
+		if (IntermediateResultIsInlined(resultId) || partitionedResult)
+		{
+			/* the workers do not have the whole result, so it cannot be reused */
+			continue;
+		}
+
+		/* let the seed nodes pass the result on to the other nodes */
+		ForwardIntermediateResult(resultId, forwardRoundList);
+
+		CacheSubPlanResult(subPlan, resultId, remoteWorkerNodeList,
+						   entry->writeLocalFile);
+	}
+}
+
+
+/*
+ * CanInlineSubPlanResults returns whether the results of the subplans of the
+ * given plan can be inlined into the queries that read them. That is not the
+ * case when the plan, or one of its subplans, has repartitioning tasks, since
+ * their queries are nested in string literals that InlineIntermediateResults
+ * does not rewrite.
+ */
+static bool
+CanInlineSubPlanResults(DistributedPlan *distributedPlan)
+{
+	if (MaxInlineIntermediateResultSize <= 0)
+	{
+		return false;
 	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	DistributedSubPlan *subPlan = NULL;
+	foreach_ptr(subPlan, distributedPlan->subPlanList)
+	{
+		CustomScan *customScan = FetchCitusCustomScanIfExists(subPlan->plan->planTree);
+		if (customScan != NULL &&
+			!CanInlineSubPlanResults(GetDistributedPlan(customScan)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CanPartitionSubPlanResult returns whether each of the given worker nodes
+ * only needs the rows of the intermediate result that belong to its own
+ * shards, in which case the coordinator sends every node its own subset of
+ * the result rather than the whole result. That requires the result to be
+ * used only once, in tasks that join it with a distributed table on the
+ * distribution key (see FindPartitionedSubPlanUsages). Local execution reads
+ * the whole result from the local file, so we do not partition results that
+ * are also written locally.
+ */
+static bool
+CanPartitionSubPlanResult(IntermediateResultsHashEntry *entry,
+						  List *remoteWorkerNodeList)
+{
+	if (!EnablePartitionedIntermediateResults)
+	{
+		return false;
+	}
+
+	if (remoteWorkerNodeList == NIL || entry->writeLocalFile)
+	{
+		return false;
+	}
+
+	return entry->usageCount == 1 && OidIsValid(entry->partitionRelationId);
 }
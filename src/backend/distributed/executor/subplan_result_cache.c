@@ -0,0 +1,285 @@
+/*-------------------------------------------------------------------------
+ *
+ * subplan_result_cache.c
+ *    Reusing the intermediate results of identical subplans within a
+ *    transaction.
+ *
+ * Intermediate results live until the end of the distributed transaction,
+ * so a transaction that runs the same CTE or subquery repeatedly can reuse
+ * the result of an earlier execution instead of computing it again. A
+ * result is only reused when the deparsed subplan query, the user and the
+ * search_path are the same, and the transaction did not modify any data in
+ * between, either locally (the command counter did not advance) or through
+ * the distributed executors (see RecordDistributedModification()). The
+ * cached result is made available under the result ID of the new subplan
+ * on the nodes that need it using link_intermediate_result, which requires
+ * all of these nodes to already have the cached result.
+ *
+ * Worker transactions run in READ COMMITTED, so a reused result does not
+ * reflect changes that other transactions committed since it was computed.
+ * That is why the cache is opt-in.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/subplan_result_cache.h"
+#include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
+#include "lib/stringinfo.h"
+#include "optimizer/clauses.h"
+#include "utils/memutils.h"
+
+
+/*
+ * SubPlanResultCacheEntry describes an intermediate result that was created
+ * earlier in the transaction, and what it depends on.
+ */
+typedef struct SubPlanResultCacheEntry
+{
+	char *cacheKey;
+	Oid userId;
+	char *searchPath;
+
+	char *resultId;
+	List *nodeIdList;
+	bool hasLocalFile;
+
+	/* state of the transaction when the result was created */
+	CommandId commandId;
+	uint64 modificationCount;
+} SubPlanResultCacheEntry;
+
+
+/* config variable managed via guc.c */
+bool EnableSubPlanResultCache = false;
+
+/* intermediate results created in the current transaction */
+static List *SubPlanResultCache = NIL;
+
+/* number of distributed executions that may have modified data */
+static uint64 DistributedModificationCount = 0;
+
+
+static bool PreventsSubPlanResultCaching(Node *node);
+static SubPlanResultCacheEntry * FindSubPlanResultCacheEntry(char *cacheKey);
+static bool NodeListContainedIn(List *nodeList, List *nodeIdList);
+
+
+/*
+ * SubPlanResultCacheKey returns the key under which the result of a subplan
+ * for the given query is cached, or NULL if its result cannot be reused. It is
+ * called before the subplan query is planned.
+ */
+char *
+SubPlanResultCacheKey(Query *subPlanQuery)
+{
+	if (!EnableSubPlanResultCache)
+	{
+		return NULL;
+	}
+
+	/* only the results of queries that compute the same rows every time */
+	if (subPlanQuery->commandType != CMD_SELECT || subPlanQuery->hasModifyingCTE ||
+		subPlanQuery->rowMarks != NIL ||
+		contain_volatile_functions((Node *) subPlanQuery) ||
+		FindNodeCheck((Node *) subPlanQuery, PreventsSubPlanResultCaching))
+	{
+		return NULL;
+	}
+
+	StringInfo queryString = makeStringInfo();
+	pg_get_query_def(subPlanQuery, queryString);
+
+	return queryString->data;
+}
+
+
+/*
+ * PreventsSubPlanResultCaching returns whether the given node makes the
+ * deparsed query insufficient to identify its result: parameters are
+ * deparsed without their values, and references to CTEs of outer queries
+ * without their definitions.
+ */
+static bool
+PreventsSubPlanResultCaching(Node *node)
+{
+	if (IsA(node, Param))
+	{
+		return true;
+	}
+
+	if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+
+		return rangeTableEntry->rtekind == RTE_CTE && rangeTableEntry->ctelevelsup > 0;
+	}
+
+	return false;
+}
+
+
+/*
+ * ReuseCachedSubPlanResult makes an earlier result of an identical subplan
+ * available as the result with the given ID on the given nodes, and locally
+ * if writeLocalFile is set. Returns false if there is no such result that
+ * can still be used, in which case the subplan should be executed.
+ */
+bool
+ReuseCachedSubPlanResult(DistributedSubPlan *subPlan, char *resultId,
+						 List *nodeList, bool writeLocalFile)
+{
+	if (!EnableSubPlanResultCache || subPlan->cacheKey == NULL)
+	{
+		return false;
+	}
+
+	SubPlanResultCacheEntry *entry = FindSubPlanResultCacheEntry(subPlan->cacheKey);
+	if (entry == NULL)
+	{
+		return false;
+	}
+
+	if (entry->commandId != GetCurrentCommandId(false) ||
+		entry->modificationCount != DistributedModificationCount)
+	{
+		/* the transaction modified data since the result was created */
+		return false;
+	}
+
+	if (!NodeListContainedIn(nodeList, entry->nodeIdList) ||
+		(writeLocalFile && !entry->hasLocalFile))
+	{
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("reusing intermediate result %s as %s", entry->resultId,
+							resultId)));
+
+	LinkIntermediateResult(entry->resultId, resultId, nodeList, writeLocalFile);
+
+	return true;
+}
+
+
+/*
+ * CacheSubPlanResult records that the result with the given ID was created
+ * for the given subplan on the given nodes, and locally if writeLocalFile is
+ * set.
+ */
+void
+CacheSubPlanResult(DistributedSubPlan *subPlan, char *resultId, List *nodeList,
+				   bool writeLocalFile)
+{
+	if (!EnableSubPlanResultCache || subPlan->cacheKey == NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	SubPlanResultCacheEntry *entry = FindSubPlanResultCacheEntry(subPlan->cacheKey);
+	if (entry == NULL)
+	{
+		entry = palloc0(sizeof(SubPlanResultCacheEntry));
+		entry->cacheKey = pstrdup(subPlan->cacheKey);
+		entry->userId = GetUserId();
+		entry->searchPath = pstrdup(namespace_search_path);
+
+		SubPlanResultCache = lappend(SubPlanResultCache, entry);
+	}
+
+	/* a newer result replaces one that could no longer be used */
+	entry->resultId = pstrdup(resultId);
+	entry->nodeIdList = NIL;
+	entry->hasLocalFile = writeLocalFile;
+	entry->commandId = GetCurrentCommandId(false);
+	entry->modificationCount = DistributedModificationCount;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		entry->nodeIdList = lappend_int(entry->nodeIdList, workerNode->nodeId);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FindSubPlanResultCacheEntry returns the cached result for the given key that
+ * was created by the current user with the current search_path, or NULL if
+ * there is none.
+ */
+static SubPlanResultCacheEntry *
+FindSubPlanResultCacheEntry(char *cacheKey)
+{
+	Oid userId = GetUserId();
+
+	SubPlanResultCacheEntry *entry = NULL;
+	foreach_ptr(entry, SubPlanResultCache)
+	{
+		if (entry->userId == userId && strcmp(entry->cacheKey, cacheKey) == 0 &&
+			strcmp(entry->searchPath, namespace_search_path) == 0)
+		{
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NodeListContainedIn returns whether all nodes in the given list of worker
+ * nodes appear in the given list of node IDs.
+ */
+static bool
+NodeListContainedIn(List *nodeList, List *nodeIdList)
+{
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		if (!list_member_int(nodeIdList, workerNode->nodeId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RecordDistributedModification is called by the distributed executors
+ * before they run commands that may modify data, which invalidates the
+ * cached results of the transaction.
+ */
+void
+RecordDistributedModification(void)
+{
+	DistributedModificationCount++;
+}
+
+
+/*
+ * ResetSubPlanResultCache forgets the cached results at the end of the
+ * transaction, since the intermediate results are removed.
+ */
+void
+ResetSubPlanResultCache(void)
+{
+	/* the entries are allocated in TopTransactionContext */
+	SubPlanResultCache = NIL;
+}
@@ -0,0 +1,591 @@
+/*-------------------------------------------------------------------------
+ *
+ * task_coalescing.c
+ *    Merging the tasks of a multi-shard read that go to the same node into
+ *    a single UNION ALL query.
+ *
+ * A multi-shard SELECT has a task per shard, and each of them is parsed,
+ * planned and started separately on the worker, and tracked separately by
+ * the adaptive executor. When citus.enable_task_coalescing is on, the tasks
+ * of a read-only query that go to the same node are instead sent as a single
+ * query that appends the results of the shard queries. Since the coordinator
+ * combines the results of all tasks anyway, it does not matter which task a
+ * row came from. The worker can run the UNION ALL with a parallel append, so
+ * a node uses its cores through its own parallelism rather than through
+ * many connections from the coordinator.
+ *
+ * Only tasks with a single placement are coalesced, since a coalesced task
+ * cannot fail over to other placements shard by shard. Tasks that run on the
+ * local node are left to the local executor.
+ *
+ * When citus.enable_node_preaggregation is on and the coordinator combines
+ * partial aggregates, the UNION ALL is additionally wrapped in a query that
+ * combines the partial aggregates of the shards of the node per group, in the
+ * same way as the coordinator does. Each node then sends a single partial
+ * result per group, rather than one per shard.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_nodes.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_logical_optimizer.h"
+#include "distributed/task_coalescing.h"
+#include "distributed/transaction_management.h"
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+
+/* range table index of the worker results in the coordinator query */
+#define WORKER_RESULT_RANGE_TABLE_INDEX 1
+
+/* name of the columns of the UNION ALL in a pre-aggregating query */
+#define PARTIAL_COLUMN_NAME_PREFIX "partial_"
+
+
+/*
+ * NodeTaskGroup is the list of tasks that go to the same node.
+ */
+typedef struct NodeTaskGroup
+{
+	int32 groupId;
+	List *taskList;
+} NodeTaskGroup;
+
+
+/*
+ * NodeAggregationColumns describes how the coordinator uses the columns of
+ * the worker results: for each column, the aggregate that combines it, or
+ * InvalidOid if the rows are only grouped on it.
+ */
+typedef struct NodeAggregationColumns
+{
+	int columnCount;
+	Oid *combineAggregateIds;
+
+	/* aggregate whose partial states coord_combine_agg combines */
+	Oid *partialAggregateIds;
+
+	bool *usedOutsideAggregate;
+	bool supported;
+} NodeAggregationColumns;
+
+
+/*
+ * NodeAggregation holds the text that wraps the UNION ALL of the shard queries
+ * of a node to combine their partial aggregates.
+ */
+typedef struct NodeAggregation
+{
+	char *selectClause;
+	char *columnAliases;
+	char *groupByClause;
+} NodeAggregation;
+
+
+/* config variables managed via guc.c */
+bool EnableTaskCoalescing = false;
+bool EnableNodePreAggregation = false;
+
+
+static bool CanCoalesceTasksOfPlan(DistributedPlan *distributedPlan);
+static bool CanCoalesceTask(Task *task);
+static NodeAggregation * BuildNodeAggregation(DistributedPlan *distributedPlan);
+static bool NodeAggregationColumnWalker(Node *node, NodeAggregationColumns *columns);
+static bool CanCombineOnNode(Oid aggregateId);
+static Task * CoalesceTaskList(List *taskList, NodeAggregation *nodeAggregation);
+
+
+/*
+ * CoalesceTasksPerNode returns the task list to execute for the given task
+ * list of the distributed plan, in which the tasks that go to the same node
+ * are merged into a single task, if task coalescing is enabled and possible.
+ * The given tasks are not modified, since they may belong to a cached plan.
+ */
+List *
+CoalesceTasksPerNode(DistributedPlan *distributedPlan, List *taskList)
+{
+	List *nodeTaskGroupList = NIL;
+	List *coalescedTaskList = NIL;
+	NodeAggregation *nodeAggregation = NULL;
+
+	if ((!EnableTaskCoalescing && !EnableNodePreAggregation) ||
+		list_length(taskList) < 2 || !CanCoalesceTasksOfPlan(distributedPlan))
+	{
+		return taskList;
+	}
+
+	if (EnableNodePreAggregation)
+	{
+		nodeAggregation = BuildNodeAggregation(distributedPlan);
+	}
+
+	if (!EnableTaskCoalescing && nodeAggregation == NULL)
+	{
+		/* pre-aggregation alone only merges the tasks of aggregating queries */
+		return taskList;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (!CanCoalesceTask(task))
+		{
+			coalescedTaskList = lappend(coalescedTaskList, task);
+			continue;
+		}
+
+		ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+		NodeTaskGroup *nodeTaskGroup = NULL;
+
+		NodeTaskGroup *existingGroup = NULL;
+		foreach_ptr(existingGroup, nodeTaskGroupList)
+		{
+			if (existingGroup->groupId == taskPlacement->groupId)
+			{
+				nodeTaskGroup = existingGroup;
+				break;
+			}
+		}
+
+		if (nodeTaskGroup == NULL)
+		{
+			nodeTaskGroup = palloc0(sizeof(NodeTaskGroup));
+			nodeTaskGroup->groupId = taskPlacement->groupId;
+
+			nodeTaskGroupList = lappend(nodeTaskGroupList, nodeTaskGroup);
+		}
+
+		nodeTaskGroup->taskList = lappend(nodeTaskGroup->taskList, task);
+	}
+
+	NodeTaskGroup *nodeTaskGroup = NULL;
+	foreach_ptr(nodeTaskGroup, nodeTaskGroupList)
+	{
+		if (list_length(nodeTaskGroup->taskList) == 1)
+		{
+			coalescedTaskList = list_concat(coalescedTaskList, nodeTaskGroup->taskList);
+			continue;
+		}
+
+		Task *coalescedTask = CoalesceTaskList(nodeTaskGroup->taskList,
+											   nodeAggregation);
+		coalescedTaskList = lappend(coalescedTaskList, coalescedTask);
+	}
+
+	return coalescedTaskList;
+}
+
+
+/*
+ * CanCoalesceTasksOfPlan returns whether the tasks of the given distributed
+ * plan may be merged. We only merge the tasks of read-only queries outside of
+ * transaction blocks, since placements that were modified or accessed by DDL
+ * earlier in the transaction have to be accessed over the same connection,
+ * which a merged task might not be able to honour for all of its shards.
+ */
+static bool
+CanCoalesceTasksOfPlan(DistributedPlan *distributedPlan)
+{
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	if (workerJob == NULL || workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	/* the row merger relies on the results of each task being sorted */
+	if (distributedPlan->mergeSortColumnList != NIL)
+	{
+		return false;
+	}
+
+	/* FOR UPDATE is not allowed in a UNION */
+	if (workerJob->jobQuery != NULL && workerJob->jobQuery->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction())
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CanCoalesceTask returns whether the given task can be merged with other
+ * tasks that go to the same node.
+ */
+static bool
+CanCoalesceTask(Task *task)
+{
+	if (task->taskType != SELECT_TASK)
+	{
+		return false;
+	}
+
+	if (list_length(task->taskPlacementList) != 1 || task->relationRowLockList != NIL)
+	{
+		return false;
+	}
+
+	int taskQueryType = GetTaskQueryType(task);
+	if (taskQueryType != TASK_QUERY_TEXT && taskQueryType != TASK_QUERY_OBJECT)
+	{
+		return false;
+	}
+
+	if (TaskAccessesLocalNode(task))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * BuildNodeAggregation returns the text that wraps the merged query of the
+ * tasks of a node to combine the partial aggregates of its shards, or NULL if
+ * the coordinator does not combine partial aggregates, or combines them in a
+ * way that cannot be applied on the nodes first.
+ *
+ * The coordinator query groups on some of the columns of the worker results
+ * and aggregates the others. We apply the same aggregates to the same columns
+ * on the node, as long as applying them twice gives the same result, such as
+ * sum(sum(count)) or worker_combine_partial_agg() for coord_combine_agg(),
+ * and group on all other columns.
+ */
+static NodeAggregation *
+BuildNodeAggregation(DistributedPlan *distributedPlan)
+{
+	Query *masterQuery = distributedPlan->masterQuery;
+	Query *workerQuery = distributedPlan->workerJob->jobQuery;
+	StringInfo selectClause = makeStringInfo();
+	StringInfo columnAliases = makeStringInfo();
+	StringInfo groupByClause = makeStringInfo();
+
+	if (masterQuery == NULL || workerQuery == NULL)
+	{
+		return NULL;
+	}
+
+	if (!masterQuery->hasAggs && masterQuery->groupClause == NIL)
+	{
+		return NULL;
+	}
+
+	if (masterQuery->hasSubLinks || masterQuery->groupingSets != NIL)
+	{
+		return NULL;
+	}
+
+	TargetEntry *workerTargetEntry = NULL;
+	foreach_ptr(workerTargetEntry, workerQuery->targetList)
+	{
+		if (workerTargetEntry->resjunk)
+		{
+			return NULL;
+		}
+	}
+
+	int columnCount = list_length(workerQuery->targetList);
+
+	NodeAggregationColumns columns;
+	memset(&columns, 0, sizeof(columns));
+	columns.columnCount = columnCount;
+	columns.combineAggregateIds = palloc0(columnCount * sizeof(Oid));
+	columns.partialAggregateIds = palloc0(columnCount * sizeof(Oid));
+	columns.usedOutsideAggregate = palloc0(columnCount * sizeof(bool));
+	columns.supported = true;
+
+	NodeAggregationColumnWalker((Node *) masterQuery->targetList, &columns);
+	NodeAggregationColumnWalker(masterQuery->havingQual, &columns);
+
+	if (!columns.supported)
+	{
+		return NULL;
+	}
+
+	int columnIndex = 0;
+	foreach_ptr(workerTargetEntry, workerQuery->targetList)
+	{
+		Oid combineAggregateId = columns.combineAggregateIds[columnIndex];
+		Oid columnType = exprType((Node *) workerTargetEntry->expr);
+		int32 columnTypeMod = exprTypmod((Node *) workerTargetEntry->expr);
+		int columnNumber = columnIndex + 1;
+
+		if (columnIndex > 0)
+		{
+			appendStringInfoString(selectClause, ", ");
+			appendStringInfoString(columnAliases, ", ");
+		}
+
+		appendStringInfo(columnAliases, PARTIAL_COLUMN_NAME_PREFIX "%d", columnNumber);
+
+		if (!OidIsValid(combineAggregateId))
+		{
+			appendStringInfo(selectClause, PARTIAL_COLUMN_NAME_PREFIX "%d",
+							 columnNumber);
+
+			appendStringInfo(groupByClause, "%s" PARTIAL_COLUMN_NAME_PREFIX "%d",
+							 groupByClause->len > 0 ? ", " : " GROUP BY ",
+							 columnNumber);
+		}
+		else if (columns.usedOutsideAggregate[columnIndex])
+		{
+			/* we cannot both group on a column and combine it */
+			return NULL;
+		}
+		else if (OidIsValid(columns.partialAggregateIds[columnIndex]))
+		{
+			appendStringInfo(selectClause,
+							 "pg_catalog.worker_combine_partial_agg(%u, "
+							 PARTIAL_COLUMN_NAME_PREFIX "%d)",
+							 columns.partialAggregateIds[columnIndex], columnNumber);
+		}
+		else
+		{
+			char *aggregateName = get_func_name(combineAggregateId);
+			char *schemaName =
+				get_namespace_name(get_func_namespace(combineAggregateId));
+			char *typeName = format_type_extended(columnType, columnTypeMod,
+												  FORMAT_TYPE_TYPEMOD_GIVEN |
+												  FORMAT_TYPE_FORCE_QUALIFY);
+
+			/* sum() may return a wider type than the one of the worker column */
+			appendStringInfo(selectClause, "%s(" PARTIAL_COLUMN_NAME_PREFIX "%d)::%s",
+							 quote_qualified_identifier(schemaName, aggregateName),
+							 columnNumber, typeName);
+		}
+
+		columnIndex++;
+	}
+
+	NodeAggregation *nodeAggregation = palloc0(sizeof(NodeAggregation));
+	nodeAggregation->selectClause = selectClause->data;
+	nodeAggregation->columnAliases = columnAliases->data;
+	nodeAggregation->groupByClause = groupByClause->data;
+
+	return nodeAggregation;
+}
+
+
+/*
+ * NodeAggregationColumnWalker records in columns how the coordinator uses the
+ * columns of the worker results in the given expression, and clears supported
+ * when it uses them in a way that cannot be combined on the nodes.
+ */
+static bool
+NodeAggregationColumnWalker(Node *node, NodeAggregationColumns *columns)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggref = (Aggref *) node;
+		Oid partialAggregateId = InvalidOid;
+		Var *column = NULL;
+
+		if (aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+			aggref->aggfilter != NULL || aggref->aggdirectargs != NIL ||
+			aggref->agglevelsup != 0)
+		{
+			columns->supported = false;
+			return true;
+		}
+
+		if (aggref->aggfnoid == CoordCombineAggOid() &&
+			list_length(aggref->args) == 3)
+		{
+			/* coord_combine_agg(aggregate, column, NULL::result type) */
+			TargetEntry *aggregateArg = linitial(aggref->args);
+			TargetEntry *columnArg = lsecond(aggref->args);
+
+			if (IsA(aggregateArg->expr, Const) && IsA(columnArg->expr, Var))
+			{
+				Const *aggregateConst = (Const *) aggregateArg->expr;
+
+				partialAggregateId = DatumGetObjectId(aggregateConst->constvalue);
+				column = (Var *) columnArg->expr;
+			}
+		}
+		else if (CanCombineOnNode(aggref->aggfnoid) && list_length(aggref->args) == 1)
+		{
+			TargetEntry *columnArg = linitial(aggref->args);
+
+			if (IsA(columnArg->expr, Var))
+			{
+				column = (Var *) columnArg->expr;
+			}
+		}
+
+		if (column == NULL || column->varno != WORKER_RESULT_RANGE_TABLE_INDEX ||
+			column->varlevelsup != 0 || column->varattno < 1 ||
+			column->varattno > columns->columnCount)
+		{
+			columns->supported = false;
+			return true;
+		}
+
+		int columnIndex = column->varattno - 1;
+		Oid existingAggregateId = columns->combineAggregateIds[columnIndex];
+
+		if ((OidIsValid(existingAggregateId) &&
+			 existingAggregateId != aggref->aggfnoid) ||
+			(OidIsValid(columns->partialAggregateIds[columnIndex]) &&
+			 columns->partialAggregateIds[columnIndex] != partialAggregateId))
+		{
+			/* the same column is combined in different ways */
+			columns->supported = false;
+			return true;
+		}
+
+		columns->combineAggregateIds[columnIndex] = aggref->aggfnoid;
+		columns->partialAggregateIds[columnIndex] = partialAggregateId;
+
+		return false;
+	}
+
+	if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+
+		if (column->varno == WORKER_RESULT_RANGE_TABLE_INDEX &&
+			column->varlevelsup == 0 && column->varattno >= 1 &&
+			column->varattno <= columns->columnCount)
+		{
+			columns->usedOutsideAggregate[column->varattno - 1] = true;
+		}
+
+		return false;
+	}
+
+	return expression_tree_walker(node, NodeAggregationColumnWalker, columns);
+}
+
+
+/*
+ * CanCombineOnNode returns whether applying the given aggregate of the
+ * coordinator query to its own results gives the same result as applying it
+ * once, such that the nodes can apply it to the results of their shards first.
+ */
+static bool
+CanCombineOnNode(Oid aggregateId)
+{
+	static const char *const catalogAggregateNames[] = {
+		"sum", "min", "max", "bit_and", "bit_or", "bool_and", "bool_or", "every",
+		ARRAY_CAT_AGGREGATE_NAME, JSONB_CAT_AGGREGATE_NAME, JSON_CAT_AGGREGATE_NAME,
+		CITUS_HLL_UNION_AGGREGATE_NAME, CITUS_TDIGEST_UNION_AGGREGATE_NAME
+	};
+	char *aggregateName = get_func_name(aggregateId);
+
+	if (aggregateName == NULL)
+	{
+		return false;
+	}
+
+	/* the hll and topn extensions may be installed in any schema */
+	if (strcmp(aggregateName, HLL_UNION_AGGREGATE_NAME) == 0 ||
+		strcmp(aggregateName, TOPN_UNION_AGGREGATE_NAME) == 0)
+	{
+		return true;
+	}
+
+	if (get_func_namespace(aggregateId) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	int nameCount = lengthof(catalogAggregateNames);
+	for (int nameIndex = 0; nameIndex < nameCount; nameIndex++)
+	{
+		if (strcmp(aggregateName, catalogAggregateNames[nameIndex]) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CoalesceTaskList returns a new task that appends the results of the queries
+ * of the given tasks, which all have a single placement on the same node. If
+ * nodeAggregation is given, the new task also combines the partial aggregates
+ * of the tasks.
+ */
+static Task *
+CoalesceTaskList(List *taskList, NodeAggregation *nodeAggregation)
+{
+	Task *firstTask = linitial(taskList);
+	StringInfo queryString = makeStringInfo();
+	bool parametersInQueryStringResolved = true;
+	List *relationShardList = NIL;
+
+	Task *coalescedTask = CitusMakeNode(Task);
+	coalescedTask->taskType = SELECT_TASK;
+	coalescedTask->jobId = firstTask->jobId;
+	coalescedTask->taskId = firstTask->taskId;
+	coalescedTask->anchorShardId = firstTask->anchorShardId;
+	coalescedTask->taskPlacementList = firstTask->taskPlacementList;
+	coalescedTask->replicationModel = firstTask->replicationModel;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (queryString->len > 0)
+		{
+			appendStringInfoString(queryString, " UNION ALL ");
+		}
+
+		/* parentheses keep the ORDER BY and LIMIT of each shard query */
+		appendStringInfo(queryString, "(%s)", TaskQueryStringForAllPlacements(task));
+
+		relationShardList = list_concat(relationShardList,
+										list_copy(task->relationShardList));
+		parametersInQueryStringResolved = parametersInQueryStringResolved &&
+										  task->parametersInQueryStringResolved;
+	}
+
+	if (nodeAggregation != NULL)
+	{
+		StringInfo aggregateQueryString = makeStringInfo();
+
+		appendStringInfo(aggregateQueryString,
+						 "SELECT %s FROM (%s) node_partials (%s)%s",
+						 nodeAggregation->selectClause, queryString->data,
+						 nodeAggregation->columnAliases,
+						 nodeAggregation->groupByClause);
+
+		queryString = aggregateQueryString;
+	}
+
+	coalescedTask->relationShardList = relationShardList;
+	coalescedTask->parametersInQueryStringResolved = parametersInQueryStringResolved;
+	SetTaskQueryString(coalescedTask, queryString->data);
+
+	return coalescedTask;
+}
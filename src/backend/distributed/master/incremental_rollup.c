@@ -0,0 +1,504 @@
+/*-------------------------------------------------------------------------
+ *
+ * incremental_rollup.c
+ *
+ * Rollups of distributed tables that are refreshed incrementally. A rollup
+ * consists of a source table with an identity or serial column, and an
+ * aggregation command, usually an INSERT .. SELECT .. ON CONFLICT DO UPDATE
+ * into a rollup table that is colocated with the source table, which takes
+ * the range of ids to aggregate as its $1 (exclusive) and $2 (inclusive)
+ * parameters. Each refresh only aggregates the rows that were added since
+ * the previous refresh, in parallel across the shards, and the maintenance
+ * daemon refreshes all rollups every citus.rollup_refresh_interval.
+ *
+ * Rather than capturing new rows in a change log, which would double the
+ * cost of every write, the rollups keep a watermark on the id column in
+ * pg_dist_rollup. Ids are handed out in increasing order by the sequence of
+ * the column, but they can become visible out of order, since the writes
+ * commit in a different order. A refresh therefore reads the last value of
+ * the sequence and then waits for the writes that are in progress, after
+ * which all rows up to that value are visible. Only writes that go through
+ * the coordinator are taken into account this way.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "catalog/dependency.h"
+#include "catalog/pg_sequence.h"
+#include "catalog/pg_type.h"
+#include "distributed/incremental_rollup.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
+#include "executor/spi.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+
+/*
+ * DistributedRollup is the definition of a rollup as stored in
+ * pg_dist_rollup.
+ */
+typedef struct DistributedRollup
+{
+	char *rollupName;
+	Oid sourceTableId;
+	char *idColumnName;
+	char *aggregationCommand;
+	Oid ownerId;
+	int64 lastAggregatedId;
+} DistributedRollup;
+
+
+/* GUC, time between refreshes of the rollups, in milliseconds */
+int RollupRefreshInterval = 60000;
+
+
+/* local function declarations */
+static DistributedRollup * LockRollup(char *rollupName, MemoryContext rollupContext);
+static void EnsureRollupOwner(DistributedRollup *rollup);
+static Oid IdColumnSequence(Oid relationId, char *idColumnName);
+static bool SequenceLastValue(Oid sequenceId, Oid userId, int64 *lastValue);
+static void WaitForInProgressWrites(Oid relationId);
+static void ExecuteRollupQuery(const char *query, int paramCount, Oid *paramTypes,
+							   Datum *paramValues, Oid userId, bool readOnly);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(citus_create_rollup);
+PG_FUNCTION_INFO_V1(citus_refresh_rollup);
+PG_FUNCTION_INFO_V1(citus_drop_rollup);
+
+
+/*
+ * citus_create_rollup creates a rollup of the given distributed table, which
+ * is refreshed by running the given aggregation command for the ids in the
+ * given column that were added since the previous refresh. The aggregation
+ * command runs as the user that created the rollup.
+ */
+Datum
+citus_create_rollup(PG_FUNCTION_ARGS)
+{
+	Name rollupName = PG_GETARG_NAME(0);
+	Oid sourceTableId = PG_GETARG_OID(1);
+	Name idColumnName = PG_GETARG_NAME(2);
+	text *aggregationCommandText = PG_GETARG_TEXT_P(3);
+	char *aggregationCommand = text_to_cstring(aggregationCommandText);
+	Oid paramTypes[2] = { INT8OID, INT8OID };
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(sourceTableId);
+
+	if (!IsCitusTable(sourceTableId))
+	{
+		ereport(ERROR, (errmsg("cannot create rollup of \"%s\"",
+							   get_rel_name(sourceTableId)),
+						errdetail("Only rollups of distributed tables are "
+								  "supported.")));
+	}
+
+	Oid sequenceId = IdColumnSequence(sourceTableId, NameStr(*idColumnName));
+
+	HeapTuple sequenceTuple = SearchSysCache1(SEQRELID, ObjectIdGetDatum(sequenceId));
+	if (!HeapTupleIsValid(sequenceTuple))
+	{
+		ereport(ERROR, (errmsg("cache lookup failed for sequence %u", sequenceId)));
+	}
+
+	Form_pg_sequence sequenceForm = (Form_pg_sequence) GETSTRUCT(sequenceTuple);
+	bool sequenceIncreases = sequenceForm->seqincrement > 0;
+	int64 sequenceCache = sequenceForm->seqcache;
+
+	ReleaseSysCache(sequenceTuple);
+
+	/*
+	 * Backends hand out cached sequence values after other backends handed
+	 * out higher values, which would end up behind the watermark.
+	 */
+	if (!sequenceIncreases || sequenceCache != 1)
+	{
+		ereport(ERROR, (errmsg("cannot create rollup on column \"%s\"",
+							   NameStr(*idColumnName)),
+						errdetail("The sequence of the column needs to be "
+								  "increasing and not cache values.")));
+	}
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	/* check the aggregation command before we store it */
+	SPIPlanPtr aggregationPlan = SPI_prepare(aggregationCommand, 2, paramTypes);
+	if (aggregationPlan == NULL)
+	{
+		ereport(ERROR, (errmsg("could not prepare aggregation command: %s",
+							   SPI_result_code_string(SPI_result))));
+	}
+
+	Oid insertParamTypes[5] = { NAMEOID, REGCLASSOID, NAMEOID, TEXTOID, OIDOID };
+	Datum insertParamValues[5] = {
+		NameGetDatum(rollupName),
+		ObjectIdGetDatum(sourceTableId),
+		NameGetDatum(idColumnName),
+		PointerGetDatum(aggregationCommandText),
+		ObjectIdGetDatum(GetUserId())
+	};
+
+	ExecuteRollupQuery("INSERT INTO pg_catalog.pg_dist_rollup "
+					   "(rollup_name, source_table, id_column, "
+					   "aggregation_command, rollup_owner) "
+					   "VALUES ($1, $2, $3, $4, $5)",
+					   5, insertParamTypes, insertParamValues,
+					   CitusExtensionOwner(), false);
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_refresh_rollup aggregates the rows that were added to the source
+ * table of the given rollup since its previous refresh, and returns the id
+ * up to which the rollup is now aggregated.
+ */
+Datum
+citus_refresh_rollup(PG_FUNCTION_ARGS)
+{
+	Name rollupName = PG_GETARG_NAME(0);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	int64 lastAggregatedId = RefreshRollup(NameStr(*rollupName));
+
+	PG_RETURN_INT64(lastAggregatedId);
+}
+
+
+/*
+ * citus_drop_rollup removes the given rollup, such that it is no longer
+ * refreshed. The rollup table itself is left as is.
+ */
+Datum
+citus_drop_rollup(PG_FUNCTION_ARGS)
+{
+	Name rollupName = PG_GETARG_NAME(0);
+	Oid paramTypes[1] = { NAMEOID };
+	Datum paramValues[1] = { NameGetDatum(rollupName) };
+	MemoryContext callerContext = CurrentMemoryContext;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	DistributedRollup *rollup = LockRollup(NameStr(*rollupName), callerContext);
+	EnsureRollupOwner(rollup);
+
+	ExecuteRollupQuery("DELETE FROM pg_catalog.pg_dist_rollup WHERE rollup_name = $1",
+					   1, paramTypes, paramValues, CitusExtensionOwner(), false);
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * RollupNameList returns the names of all rollups in pg_dist_rollup.
+ */
+List *
+RollupNameList(void)
+{
+	List *rollupNameList = NIL;
+	MemoryContext callerContext = CurrentMemoryContext;
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	ExecuteRollupQuery("SELECT rollup_name FROM pg_catalog.pg_dist_rollup "
+					   "ORDER BY rollup_name",
+					   0, NULL, NULL, CitusExtensionOwner(), true);
+
+	for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		char *rollupName = SPI_getvalue(SPI_tuptable->vals[rowIndex],
+										SPI_tuptable->tupdesc, 1);
+
+		MemoryContext spiContext = MemoryContextSwitchTo(callerContext);
+		rollupNameList = lappend(rollupNameList, pstrdup(rollupName));
+		MemoryContextSwitchTo(spiContext);
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return rollupNameList;
+}
+
+
+/*
+ * RefreshRollup runs the aggregation command of the given rollup for the ids
+ * that were added since the previous refresh and advances its watermark in
+ * the same transaction. It returns the new watermark.
+ */
+int64
+RefreshRollup(char *rollupName)
+{
+	MemoryContext callerContext = CurrentMemoryContext;
+	int64 lastValue = 0;
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	/* concurrent refreshes of the same rollup wait for each other */
+	DistributedRollup *rollup = LockRollup(rollupName, callerContext);
+	EnsureRollupOwner(rollup);
+
+	/* prevent the source table from being dropped while we refresh */
+	LockRelationOid(rollup->sourceTableId, AccessShareLock);
+	if (!IsCitusTable(rollup->sourceTableId))
+	{
+		ereport(ERROR, (errmsg("source table of rollup \"%s\" no longer exists",
+							   rollupName),
+						errhint("Use citus_drop_rollup to remove the rollup.")));
+	}
+
+	Oid sequenceId = IdColumnSequence(rollup->sourceTableId, rollup->idColumnName);
+
+	/*
+	 * Read the last value of the sequence before waiting for the writes, such
+	 * that every write that got an id up to that value is waited for.
+	 */
+	if (SequenceLastValue(sequenceId, rollup->ownerId, &lastValue) &&
+		lastValue > rollup->lastAggregatedId)
+	{
+		WaitForInProgressWrites(rollup->sourceTableId);
+
+		Oid aggregationParamTypes[2] = { INT8OID, INT8OID };
+		Datum aggregationParamValues[2] = {
+			Int64GetDatum(rollup->lastAggregatedId),
+			Int64GetDatum(lastValue)
+		};
+
+		ExecuteRollupQuery(rollup->aggregationCommand, 2, aggregationParamTypes,
+						   aggregationParamValues, rollup->ownerId, false);
+
+		Oid updateParamTypes[2] = { TEXTOID, INT8OID };
+		Datum updateParamValues[2] = {
+			CStringGetTextDatum(rollupName),
+			Int64GetDatum(lastValue)
+		};
+
+		ExecuteRollupQuery("UPDATE pg_catalog.pg_dist_rollup "
+						   "SET last_aggregated_id = $2 WHERE rollup_name = $1",
+						   2, updateParamTypes, updateParamValues,
+						   CitusExtensionOwner(), false);
+
+		rollup->lastAggregatedId = lastValue;
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return rollup->lastAggregatedId;
+}
+
+
+/*
+ * LockRollup reads the definition of the given rollup from pg_dist_rollup into
+ * the given memory context and locks its row until the end of the transaction.
+ * The caller should be connected to SPI.
+ */
+static DistributedRollup *
+LockRollup(char *rollupName, MemoryContext rollupContext)
+{
+	Oid paramTypes[1] = { TEXTOID };
+	Datum paramValues[1] = { CStringGetTextDatum(rollupName) };
+	bool isNull = false;
+
+	ExecuteRollupQuery("SELECT source_table, id_column, aggregation_command, "
+					   "rollup_owner, last_aggregated_id "
+					   "FROM pg_catalog.pg_dist_rollup "
+					   "WHERE rollup_name = $1 FOR UPDATE",
+					   1, paramTypes, paramValues, CitusExtensionOwner(), false);
+
+	if (SPI_processed == 0)
+	{
+		ereport(ERROR, (errmsg("rollup \"%s\" does not exist", rollupName)));
+	}
+
+	HeapTuple rollupTuple = SPI_tuptable->vals[0];
+	TupleDesc rollupDescriptor = SPI_tuptable->tupdesc;
+	char *idColumnName = SPI_getvalue(rollupTuple, rollupDescriptor, 2);
+	char *aggregationCommand = SPI_getvalue(rollupTuple, rollupDescriptor, 3);
+
+	MemoryContext spiContext = MemoryContextSwitchTo(rollupContext);
+
+	DistributedRollup *rollup = palloc0(sizeof(DistributedRollup));
+	rollup->rollupName = pstrdup(rollupName);
+	rollup->sourceTableId =
+		DatumGetObjectId(SPI_getbinval(rollupTuple, rollupDescriptor, 1, &isNull));
+	rollup->idColumnName = pstrdup(idColumnName);
+	rollup->aggregationCommand = pstrdup(aggregationCommand);
+	rollup->ownerId =
+		DatumGetObjectId(SPI_getbinval(rollupTuple, rollupDescriptor, 4, &isNull));
+	rollup->lastAggregatedId =
+		DatumGetInt64(SPI_getbinval(rollupTuple, rollupDescriptor, 5, &isNull));
+
+	MemoryContextSwitchTo(spiContext);
+
+	return rollup;
+}
+
+
+/*
+ * EnsureRollupOwner errors out if the current user does not have the
+ * privileges of the user that created the given rollup.
+ */
+static void
+EnsureRollupOwner(DistributedRollup *rollup)
+{
+	if (!has_privs_of_role(GetUserId(), rollup->ownerId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be owner of rollup %s", rollup->rollupName)));
+	}
+}
+
+
+/*
+ * IdColumnSequence returns the sequence that hands out the values of the given
+ * column of the given relation, or errors out if there is none.
+ */
+static Oid
+IdColumnSequence(Oid relationId, char *idColumnName)
+{
+	AttrNumber idColumnNumber = get_attnum(relationId, idColumnName);
+	if (idColumnNumber == InvalidAttrNumber)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not exist",
+							   idColumnName, get_rel_name(relationId))));
+	}
+
+	List *sequenceIdList = getOwnedSequences(relationId, idColumnNumber);
+	if (list_length(sequenceIdList) != 1)
+	{
+		ereport(ERROR, (errmsg("column \"%s\" of relation \"%s\" is not a serial or "
+							   "identity column", idColumnName,
+							   get_rel_name(relationId))));
+	}
+
+	return linitial_oid(sequenceIdList);
+}
+
+
+/*
+ * SequenceLastValue sets lastValue to the last value that the given sequence
+ * handed out, read as the given user, and returns false if it did not hand
+ * out any values yet. The caller should be connected to SPI.
+ */
+static bool
+SequenceLastValue(Oid sequenceId, Oid userId, int64 *lastValue)
+{
+	Oid paramTypes[1] = { REGCLASSOID };
+	Datum paramValues[1] = { ObjectIdGetDatum(sequenceId) };
+	bool isNull = false;
+
+	ExecuteRollupQuery("SELECT pg_catalog.pg_sequence_last_value($1)",
+					   1, paramTypes, paramValues, userId, true);
+
+	Datum lastValueDatum = SPI_getbinval(SPI_tuptable->vals[0],
+										 SPI_tuptable->tupdesc, 1, &isNull);
+	if (isNull)
+	{
+		return false;
+	}
+
+	*lastValue = DatumGetInt64(lastValueDatum);
+
+	return true;
+}
+
+
+/*
+ * WaitForInProgressWrites waits for the transactions that are writing to the
+ * given relation to finish, without blocking new writes.
+ */
+static void
+WaitForInProgressWrites(Oid relationId)
+{
+	LOCKTAG relationLockTag;
+	bool reportProgress = false;
+
+	SET_LOCKTAG_RELATION(relationLockTag, MyDatabaseId, relationId);
+
+	/* ShareLock conflicts with the RowExclusiveLock that writes take */
+	WaitForLockersCompat(relationLockTag, ShareLock, reportProgress);
+}
+
+
+/*
+ * ExecuteRollupQuery executes the given query via SPI as the given user and
+ * leaves its result in SPI_tuptable. The caller should be connected to SPI.
+ */
+static void
+ExecuteRollupQuery(const char *query, int paramCount, Oid *paramTypes,
+				   Datum *paramValues, Oid userId, bool readOnly)
+{
+	Oid savedUserId = InvalidOid;
+	int savedSecurityContext = 0;
+
+	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+	SetUserIdAndSecContext(userId, SECURITY_LOCAL_USERID_CHANGE);
+
+	int spiStatus = SPI_execute_with_args(query, paramCount, paramTypes, paramValues,
+										  NULL, readOnly, 0);
+
+	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("could not execute query: %s",
+							   SPI_result_code_string(spiStatus))));
+	}
+}
@@ -25,6 +25,7 @@
 
 #include "catalog/namespace.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
@@ -53,6 +54,20 @@
 #include "utils/palloc.h"
 
 
+/* config variable managed via guc.c */
+bool CapacityAwareShardPlacement = false;
+
+
+/* local function forward declarations */
+static ShardInterval * HashShardInterval(Oid relationId, uint64 shardId,
+										 char storageType, int32 shardMinHashToken,
+										 int32 shardMaxHashToken);
+static List * RoundRobinShardPlacementNodes(int32 shardCount, List *workerNodeList,
+										   int32 replicationFactor);
+static GroupShardPlacement * NewShardPlacementRow(uint64 shardId, int32 groupId);
+static List * LoadInsertedShardPlacements(List *groupShardPlacementList);
+
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_create_worker_shards);
 
@@ -103,6 +118,10 @@ master_create_worker_shards(PG_FUNCTION_ARGS)
  * calculates the min/max hash token ranges for each shard, giving them an equal
  * split of the hash space. Finally, function creates empty shard placements on
  * worker nodes.
+ *
+ * When citus.capacity_aware_shard_placement is on, the placements are spread
+ * over the worker nodes by their capacity rather than in round robin order
+ * (see CapacityAwareShardPlacementNodes).
  */
 void
 CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
@@ -195,10 +214,16 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 	/* set shard storage type according to relation type */
 	char shardStorageType = ShardStorageType(distributedTableId);
 
+	/*
+	 * We first build the shard and placement rows of all shards, and then insert
+	 * them with one call each. This keeps us from rebuilding the table's metadata
+	 * cache entry after every single shard.
+	 */
+	List *shardIntervalList = NIL;
+	List *groupShardPlacementList = NIL;
+
 	for (int64 shardIndex = 0; shardIndex < shardCount; shardIndex++)
 	{
-		uint32 roundRobinNodeIndex = shardIndex % workerNodeCount;
-
 		/* initialize the hash token space for this shard */
 		int32 shardMinHashToken = INT32_MIN + (shardIndex * hashTokenIncrement);
 		int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
@@ -210,28 +235,89 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 			shardMaxHashToken = INT32_MAX;
 		}
 
-		/* insert the shard metadata row along with its min/max values */
-		text *minHashTokenText = IntegerToText(shardMinHashToken);
-		text *maxHashTokenText = IntegerToText(shardMaxHashToken);
-
-		InsertShardRow(distributedTableId, shardId, shardStorageType,
-					   minHashTokenText, maxHashTokenText);
-
-		List *currentInsertedShardPlacements = InsertShardPlacementRows(
-			distributedTableId,
-			shardId,
-			workerNodeList,
-			roundRobinNodeIndex,
-			replicationFactor);
-		insertedShardPlacements = list_concat(insertedShardPlacements,
-											  currentInsertedShardPlacements);
+		/* build the shard metadata row along with its min/max values */
+		ShardInterval *shardInterval = HashShardInterval(distributedTableId, shardId,
+														 shardStorageType,
+														 shardMinHashToken,
+														 shardMaxHashToken);
+		shardIntervalList = lappend(shardIntervalList, shardInterval);
+	}
+
+	InsertShardRowList(shardIntervalList);
+
+	List *placementNodeLists = NIL;
+	if (CapacityAwareShardPlacement)
+	{
+		placementNodeLists = CapacityAwareShardPlacementNodes(shardIntervalList,
+															  workerNodeList,
+															  replicationFactor);
 	}
+	else
+	{
+		placementNodeLists = RoundRobinShardPlacementNodes(shardCount, workerNodeList,
+														   replicationFactor);
+	}
+
+	ListCell *shardIntervalCell = NULL;
+	ListCell *placementNodeListCell = NULL;
+	forboth(shardIntervalCell, shardIntervalList,
+			placementNodeListCell, placementNodeLists)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *placementNodeList = (List *) lfirst(placementNodeListCell);
+
+		WorkerNode *workerNode = NULL;
+		foreach_ptr(workerNode, placementNodeList)
+		{
+			GroupShardPlacement *placement =
+				NewShardPlacementRow(shardInterval->shardId, workerNode->groupId);
+			groupShardPlacementList = lappend(groupShardPlacementList, placement);
+		}
+	}
+
+	InsertShardPlacementRowList(groupShardPlacementList);
+
+	insertedShardPlacements = LoadInsertedShardPlacements(groupShardPlacementList);
 
 	CreateShardsOnWorkers(distributedTableId, insertedShardPlacements,
 						  useExclusiveConnections, colocatedShard);
 }
 
 
+/*
+ * RoundRobinShardPlacementNodes returns, for each of the given number of new
+ * shards, the list of worker nodes to place its replicas on. The first replica
+ * of each shard goes to the next node of the given list, and the other
+ * replicas to the nodes that follow it.
+ */
+static List *
+RoundRobinShardPlacementNodes(int32 shardCount, List *workerNodeList,
+							  int32 replicationFactor)
+{
+	int32 workerNodeCount = list_length(workerNodeList);
+	List *placementNodeLists = NIL;
+
+	for (int64 shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		uint32 roundRobinNodeIndex = shardIndex % workerNodeCount;
+		List *placementNodeList = NIL;
+
+		for (int attemptNumber = 0; attemptNumber < replicationFactor; attemptNumber++)
+		{
+			int workerNodeIndex = (roundRobinNodeIndex + attemptNumber) % workerNodeCount;
+			WorkerNode *workerNode = (WorkerNode *) list_nth(workerNodeList,
+															 workerNodeIndex);
+
+			placementNodeList = lappend(placementNodeList, workerNode);
+		}
+
+		placementNodeLists = lappend(placementNodeLists, placementNodeList);
+	}
+
+	return placementNodeLists;
+}
+
+
 /*
  * CreateColocatedShards creates shards for the target relation colocated with
  * the source relation.
@@ -277,6 +363,9 @@ CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId, bool
 
 	char targetShardStorageType = ShardStorageType(targetRelationId);
 
+	List *shardIntervalList = NIL;
+	List *groupShardPlacementList = NIL;
+
 	ShardInterval *sourceShardInterval = NULL;
 	foreach_ptr(sourceShardInterval, sourceShardIntervalList)
 	{
@@ -285,12 +374,12 @@ CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId, bool
 
 		int32 shardMinValue = DatumGetInt32(sourceShardInterval->minValue);
 		int32 shardMaxValue = DatumGetInt32(sourceShardInterval->maxValue);
-		text *shardMinValueText = IntegerToText(shardMinValue);
-		text *shardMaxValueText = IntegerToText(shardMaxValue);
 		List *sourceShardPlacementList = ShardPlacementList(sourceShardId);
 
-		InsertShardRow(targetRelationId, newShardId, targetShardStorageType,
-					   shardMinValueText, shardMaxValueText);
+		ShardInterval *shardInterval = HashShardInterval(targetRelationId, newShardId,
+														 targetShardStorageType,
+														 shardMinValue, shardMaxValue);
+		shardIntervalList = lappend(shardIntervalList, shardInterval);
 
 		ShardPlacement *sourcePlacement = NULL;
 		foreach_ptr(sourcePlacement, sourceShardPlacementList)
@@ -300,25 +389,21 @@ CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId, bool
 				continue;
 			}
 
-			int32 groupId = sourcePlacement->groupId;
-			const ShardState shardState = SHARD_STATE_ACTIVE;
-			const uint64 shardSize = 0;
-
-			/*
-			 * Optimistically add shard placement row the pg_dist_shard_placement, in case
-			 * of any error it will be roll-backed.
-			 */
-			uint64 shardPlacementId = InsertShardPlacementRow(newShardId,
-															  INVALID_PLACEMENT_ID,
-															  shardState, shardSize,
-															  groupId);
-
-			ShardPlacement *shardPlacement = LoadShardPlacement(newShardId,
-																shardPlacementId);
-			insertedShardPlacements = lappend(insertedShardPlacements, shardPlacement);
+			GroupShardPlacement *placement =
+				NewShardPlacementRow(newShardId, sourcePlacement->groupId);
+			groupShardPlacementList = lappend(groupShardPlacementList, placement);
 		}
 	}
 
+	/*
+	 * Optimistically add the shard and shard placement rows, in case of any
+	 * error they will be rolled back.
+	 */
+	InsertShardRowList(shardIntervalList);
+	InsertShardPlacementRowList(groupShardPlacementList);
+
+	insertedShardPlacements = LoadInsertedShardPlacements(groupShardPlacementList);
+
 	CreateShardsOnWorkers(targetRelationId, insertedShardPlacements,
 						  useExclusiveConnections, colocatedShard);
 }
@@ -386,6 +471,69 @@ CreateReferenceTableShard(Oid distributedTableId)
 }
 
 
+/*
+ * HashShardInterval returns a shard interval for a new shard of the given hash
+ * distributed table, to be inserted with InsertShardRowList().
+ */
+static ShardInterval *
+HashShardInterval(Oid relationId, uint64 shardId, char storageType,
+				  int32 shardMinHashToken, int32 shardMaxHashToken)
+{
+	ShardInterval *shardInterval = CitusMakeNode(ShardInterval);
+	shardInterval->relationId = relationId;
+	shardInterval->shardId = shardId;
+	shardInterval->storageType = storageType;
+	shardInterval->valueTypeId = INT4OID;
+	shardInterval->valueTypeLen = sizeof(int32);
+	shardInterval->valueByVal = true;
+	shardInterval->minValueExists = true;
+	shardInterval->maxValueExists = true;
+	shardInterval->minValue = Int32GetDatum(shardMinHashToken);
+	shardInterval->maxValue = Int32GetDatum(shardMaxHashToken);
+
+	return shardInterval;
+}
+
+
+/*
+ * NewShardPlacementRow returns an active and empty placement of the given
+ * shard on the given group, to be inserted with InsertShardPlacementRowList().
+ */
+static GroupShardPlacement *
+NewShardPlacementRow(uint64 shardId, int32 groupId)
+{
+	GroupShardPlacement *placement = CitusMakeNode(GroupShardPlacement);
+	placement->placementId = INVALID_PLACEMENT_ID;
+	placement->shardId = shardId;
+	placement->shardLength = 0;
+	placement->shardState = SHARD_STATE_ACTIVE;
+	placement->groupId = groupId;
+
+	return placement;
+}
+
+
+/*
+ * LoadInsertedShardPlacements returns the shard placements for the given
+ * placement rows, which have been inserted with InsertShardPlacementRowList().
+ */
+static List *
+LoadInsertedShardPlacements(List *groupShardPlacementList)
+{
+	List *shardPlacementList = NIL;
+
+	GroupShardPlacement *placement = NULL;
+	foreach_ptr(placement, groupShardPlacementList)
+	{
+		ShardPlacement *shardPlacement = LoadShardPlacement(placement->shardId,
+															placement->placementId);
+		shardPlacementList = lappend(shardPlacementList, shardPlacement);
+	}
+
+	return shardPlacementList;
+}
+
+
 /*
  * CheckHashPartitionedTable looks up the partition information for the given
  * tableId and checks if the table is hash partitioned. If not, the function
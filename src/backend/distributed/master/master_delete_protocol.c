@@ -75,19 +75,39 @@
 #include "utils/varlena.h"
 
 
+/*
+ * DropShardBatch holds the DROP commands for the shard placements that are
+ * dropped over a single connection.
+ */
+typedef struct DropShardBatch
+{
+	MultiConnection *connection;
+
+	/* DROP commands that are ready to be sent */
+	List *commandList;
+
+	/* quoted names of shards that are not yet part of a command */
+	List *tableNameList;
+	List *foreignTableNameList;
+} DropShardBatch;
+
+
 /* Local functions forward declarations */
 static void CheckTableCount(Query *deleteQuery);
 static void CheckDeleteCriteria(Node *deleteCriteria);
 static void CheckPartitionColumn(Oid relationId, Node *whereClause);
 static List * ShardsMatchingDeleteCriteria(Oid relationId, List *shardList,
 										   Node *deleteCriteria);
-static int DropShards(Oid relationId, char *schemaName, char *relationName,
-					  List *deletableShardIntervalList);
 static List * DropTaskList(Oid relationId, char *schemaName, char *relationName,
 						   List *deletableShardIntervalList);
-static void ExecuteDropShardPlacementCommandRemotely(ShardPlacement *shardPlacement,
-													 const char *shardRelationName,
-													 const char *dropShardPlacementCommand);
+static MultiConnection * DropShardPlacementConnection(ShardPlacement *shardPlacement,
+													  const char *relationName);
+static void AddShardToDropBatch(List **dropShardBatchList, MultiConnection *connection,
+								char *schemaName, char *relationName,
+								ShardInterval *shardInterval);
+static void FlushDropShardBatch(DropShardBatch *dropShardBatch);
+static char * CreateDropShardListCommand(List *quotedShardNameList, char storageType);
+static void ExecuteDropShardBatchList(List *dropShardBatchList);
 static char * CreateDropShardPlacementCommand(const char *schemaName,
 											  const char *shardRelationName,
 											  char storageType);
@@ -368,7 +388,7 @@ CheckTableSchemaNameForDrop(Oid relationId, char **schemaName, char **tableName)
  * We mark shard placements that we couldn't drop as to be deleted later, but
  * we do delete the shard metadadata.
  */
-static int
+int
 DropShards(Oid relationId, char *schemaName, char *relationName,
 		   List *deletableShardIntervalList)
 {
@@ -400,19 +420,29 @@ DropShards(Oid relationId, char *schemaName, char *relationName,
 									  deletableShardIntervalList);
 	bool shouldExecuteTasksLocally = ShouldExecuteTasksLocally(dropTaskList);
 
-	Task *task = NULL;
-	foreach_ptr(task, dropTaskList)
+	/* placements whose metadata we delete once all shards are dropped */
+	List *droppedPlacementList = NIL;
+
+	/* with batching, DROP commands are collected per connection */
+	bool batchDropCommands = ShardDDLBatchSize > 1;
+	List *dropShardBatchList = NIL;
+
+	ListCell *taskCell = NULL;
+	ListCell *shardIntervalCell = NULL;
+	forboth(taskCell, dropTaskList, shardIntervalCell, deletableShardIntervalList)
 	{
-		uint64 shardId = task->anchorShardId;
+		Task *task = (Task *) lfirst(taskCell);
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
 
 		ShardPlacement *shardPlacement = NULL;
 		foreach_ptr(shardPlacement, task->taskPlacementList)
 		{
-			uint64 shardPlacementId = shardPlacement->placementId;
 			int32 shardPlacementGroupId = shardPlacement->groupId;
 
 			bool isLocalShardPlacement = (shardPlacementGroupId == localGroupId);
 
+			droppedPlacementList = lappend(droppedPlacementList, shardPlacement);
+
 			if (isLocalShardPlacement && DropSchemaOrDBInProgress() &&
 				localGroupId == COORDINATOR_GROUP_ID)
 			{
@@ -422,7 +452,6 @@ DropShards(Oid relationId, char *schemaName, char *relationName,
 				 * get into a distributed deadlock. Hence, just delete the shard
 				 * placement metadata and skip it for now.
 				 */
-				DeleteShardPlacementRow(shardPlacementId);
 				continue;
 			}
 
@@ -450,28 +479,43 @@ DropShards(Oid relationId, char *schemaName, char *relationName,
 				 * connect to that node to drop the shard placement over that
 				 * remote connection.
 				 */
-				const char *dropShardPlacementCommand = TaskQueryStringForAllPlacements(
-					task);
-				ExecuteDropShardPlacementCommandRemotely(shardPlacement,
-														 relationName,
-														 dropShardPlacementCommand);
+				MultiConnection *connection =
+					DropShardPlacementConnection(shardPlacement, relationName);
+
+				if (connection == NULL)
+				{
+					/* placement is marked for deletion */
+				}
+				else if (batchDropCommands)
+				{
+					AddShardToDropBatch(&dropShardBatchList, connection, schemaName,
+										relationName, shardInterval);
+				}
+				else
+				{
+					const char *dropShardPlacementCommand =
+						TaskQueryStringForAllPlacements(task);
+
+					ExecuteCriticalRemoteCommand(connection, dropShardPlacementCommand);
+				}
 
 				if (isLocalShardPlacement)
 				{
 					SetLocalExecutionStatus(LOCAL_EXECUTION_DISABLED);
 				}
 			}
-
-			DeleteShardPlacementRow(shardPlacementId);
 		}
-
-		/*
-		 * Now that we deleted all placements of the shard (or their metadata),
-		 * delete the shard metadata as well.
-		 */
-		DeleteShardRow(shardId);
 	}
 
+	ExecuteDropShardBatchList(dropShardBatchList);
+
+	/*
+	 * Now that we deleted all placements of the shards (or their metadata),
+	 * delete the placement and shard metadata.
+	 */
+	DeleteShardPlacementRowList(droppedPlacementList);
+	DeleteShardRowList(deletableShardIntervalList);
+
 	int droppedShardCount = list_length(deletableShardIntervalList);
 
 	return droppedShardCount;
@@ -529,17 +573,16 @@ DropTaskList(Oid relationId, char *schemaName, char *relationName,
 
 
 /*
- * ExecuteDropShardPlacementCommandRemotely executes the given DROP shard command
- * via remote critical connection.
+ * DropShardPlacementConnection returns the connection over which to drop the
+ * given shard placement, inside a critical remote transaction. If we cannot
+ * connect to the node, the placement is marked for deletion and NULL is
+ * returned.
  */
-static void
-ExecuteDropShardPlacementCommandRemotely(ShardPlacement *shardPlacement,
-										 const char *relationName,
-										 const char *dropShardPlacementCommand)
+static MultiConnection *
+DropShardPlacementConnection(ShardPlacement *shardPlacement, const char *relationName)
 {
 	Assert(shardPlacement != NULL);
 	Assert(relationName != NULL);
-	Assert(dropShardPlacementCommand != NULL);
 
 	uint32 connectionFlags = FOR_DDL;
 	MultiConnection *connection = GetPlacementConnection(connectionFlags,
@@ -569,12 +612,180 @@ ExecuteDropShardPlacementCommandRemotely(ShardPlacement *shardPlacement,
 
 		UpdateShardPlacementState(placementId, SHARD_STATE_TO_DELETE);
 
-		return;
+		return NULL;
 	}
 
 	MarkRemoteTransactionCritical(connection);
 
-	ExecuteCriticalRemoteCommand(connection, dropShardPlacementCommand);
+	return connection;
+}
+
+
+/*
+ * AddShardToDropBatch adds the given shard to the batch of DROP commands for
+ * the given connection, creating the batch if needed. Shards of the same
+ * storage type are dropped in a single DROP command, up to
+ * citus.shard_ddl_batch_size shards at a time.
+ */
+static void
+AddShardToDropBatch(List **dropShardBatchList, MultiConnection *connection,
+					char *schemaName, char *relationName, ShardInterval *shardInterval)
+{
+	DropShardBatch *dropShardBatch = NULL;
+
+	DropShardBatch *existingBatch = NULL;
+	foreach_ptr(existingBatch, *dropShardBatchList)
+	{
+		if (existingBatch->connection == connection)
+		{
+			dropShardBatch = existingBatch;
+			break;
+		}
+	}
+
+	if (dropShardBatch == NULL)
+	{
+		dropShardBatch = palloc0(sizeof(DropShardBatch));
+		dropShardBatch->connection = connection;
+
+		*dropShardBatchList = lappend(*dropShardBatchList, dropShardBatch);
+	}
+
+	char *shardRelationName = pstrdup(relationName);
+	AppendShardIdToName(&shardRelationName, shardInterval->shardId);
+
+	const char *quotedShardName = quote_qualified_identifier(schemaName,
+															 shardRelationName);
+
+	bool isRegularTable = shardInterval->storageType == SHARD_STORAGE_TABLE;
+	List **shardNameList = isRegularTable ? &dropShardBatch->tableNameList :
+						   &dropShardBatch->foreignTableNameList;
+
+	*shardNameList = lappend(*shardNameList, (char *) quotedShardName);
+
+	if (list_length(*shardNameList) >= ShardDDLBatchSize)
+	{
+		FlushDropShardBatch(dropShardBatch);
+	}
+}
+
+
+/*
+ * FlushDropShardBatch turns the pending shard names of the given batch into
+ * DROP commands.
+ */
+static void
+FlushDropShardBatch(DropShardBatch *dropShardBatch)
+{
+	if (dropShardBatch->tableNameList != NIL)
+	{
+		char *command = CreateDropShardListCommand(dropShardBatch->tableNameList,
+												   SHARD_STORAGE_TABLE);
+
+		dropShardBatch->commandList = lappend(dropShardBatch->commandList, command);
+		dropShardBatch->tableNameList = NIL;
+	}
+
+	if (dropShardBatch->foreignTableNameList != NIL)
+	{
+		char *command = CreateDropShardListCommand(dropShardBatch->foreignTableNameList,
+												   SHARD_STORAGE_FOREIGN);
+
+		dropShardBatch->commandList = lappend(dropShardBatch->commandList, command);
+		dropShardBatch->foreignTableNameList = NIL;
+	}
+}
+
+
+/*
+ * CreateDropShardListCommand builds a single DROP command for the given shard
+ * names, which are all of the given storage type.
+ */
+static char *
+CreateDropShardListCommand(List *quotedShardNameList, char storageType)
+{
+	StringInfo shardNames = makeStringInfo();
+	StringInfo dropCommand = makeStringInfo();
+
+	char *quotedShardName = NULL;
+	foreach_ptr(quotedShardName, quotedShardNameList)
+	{
+		if (shardNames->len > 0)
+		{
+			appendStringInfoString(shardNames, ", ");
+		}
+
+		appendStringInfoString(shardNames, quotedShardName);
+	}
+
+	if (storageType == SHARD_STORAGE_TABLE)
+	{
+		appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND, shardNames->data);
+	}
+	else
+	{
+		appendStringInfo(dropCommand, DROP_FOREIGN_TABLE_COMMAND, shardNames->data);
+	}
+
+	return dropCommand->data;
+}
+
+
+/*
+ * ExecuteDropShardBatchList sends the DROP commands of the given batches. The
+ * commands of a batch run one after the other over its connection, while the
+ * batches for different connections run in parallel.
+ */
+static void
+ExecuteDropShardBatchList(List *dropShardBatchList)
+{
+	bool raiseInterrupts = true;
+	bool commandsRemaining = true;
+
+	DropShardBatch *dropShardBatch = NULL;
+	foreach_ptr(dropShardBatch, dropShardBatchList)
+	{
+		FlushDropShardBatch(dropShardBatch);
+	}
+
+	for (int commandIndex = 0; commandsRemaining; commandIndex++)
+	{
+		List *sentConnectionList = NIL;
+
+		foreach_ptr(dropShardBatch, dropShardBatchList)
+		{
+			if (commandIndex >= list_length(dropShardBatch->commandList))
+			{
+				continue;
+			}
+
+			MultiConnection *connection = dropShardBatch->connection;
+			char *command = list_nth(dropShardBatch->commandList, commandIndex);
+
+			int querySent = SendRemoteCommand(connection, command);
+			if (querySent == 0)
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+
+			sentConnectionList = lappend(sentConnectionList, connection);
+		}
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, sentConnectionList)
+		{
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+		}
+
+		commandsRemaining = sentConnectionList != NIL;
+	}
 }
 
 
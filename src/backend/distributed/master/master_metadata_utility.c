@@ -50,6 +50,7 @@
 #include "distributed/relay_utility.h"
 #include "distributed/resource_lock.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -72,28 +73,45 @@ static void RecordDistributedRelationDependencies(Oid distributedRelationId,
 												  Node *distributionKey);
 static GroupShardPlacement * TupleToGroupShardPlacement(TupleDesc tupleDesc,
 														HeapTuple heapTuple);
-static uint64 DistributedTableSize(Oid relationId, char *sizeQuery);
+static uint64 DistributedTableSize(Oid relationId, char *sizeQuery,
+								   ShardSizeType sizeType, bool exact);
+static bool CachedDistributedTableSize(Oid relationId, List *workerNodeList,
+									   ShardSizeType sizeType, uint64 *tableSize);
 static uint64 DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId,
 										   char *sizeQuery);
+static uint64 SumShardSizesOnWorker(WorkerNode *workerNode, List *shardIntervalList,
+									char *sizeQuery);
+static List * ShardIntervalsPerReadableNode(Oid relationId, List *workerNodeList);
 static List * ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId);
 static void ErrorIfNotSuitableToGetSize(Oid relationId);
 static ShardPlacement * ShardPlacementOnGroup(uint64 shardId, int groupId);
+static HeapTuple ShardRowTuple(TupleDesc tupleDescriptor, Oid relationId,
+							   uint64 shardId, char storageType,
+							   text *shardMinValue, text *shardMaxValue);
+static HeapTuple ShardPlacementRowTuple(TupleDesc tupleDescriptor, uint64 shardId,
+										uint64 placementId, char shardState,
+										uint64 shardLength, int32 groupId);
+static Oid DeleteShardTuple(Relation pgDistShard, uint64 shardId);
+static uint64 DeleteShardPlacementTuple(Relation pgDistPlacement, uint64 placementId);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(citus_table_size);
 PG_FUNCTION_INFO_V1(citus_total_relation_size);
 PG_FUNCTION_INFO_V1(citus_relation_size);
+PG_FUNCTION_INFO_V1(citus_approximate_count);
 
 
 /*
  * citus_total_relation_size accepts a table name and returns a distributed table
- * and its indexes' total relation size.
+ * and its indexes' total relation size. The optional exact argument skips the
+ * shard size cache and always asks the workers.
  */
 Datum
 citus_total_relation_size(PG_FUNCTION_ARGS)
 {
 	Oid relationId = PG_GETARG_OID(0);
+	bool exact = PG_NARGS() > 1 ? PG_GETARG_BOOL(1) : false;
 	char *tableSizeFunction = PG_TOTAL_RELATION_SIZE_FUNCTION;
 
 	CheckCitusVersion(ERROR);
@@ -103,7 +121,8 @@ citus_total_relation_size(PG_FUNCTION_ARGS)
 		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
 	}
 
-	uint64 totalRelationSize = DistributedTableSize(relationId, tableSizeFunction);
+	uint64 totalRelationSize = DistributedTableSize(relationId, tableSizeFunction,
+													SHARD_TOTAL_RELATION_SIZE, exact);
 
 	PG_RETURN_INT64(totalRelationSize);
 }
@@ -111,12 +130,13 @@ citus_total_relation_size(PG_FUNCTION_ARGS)
 
 /*
  * citus_table_size accepts a table name and returns a distributed table's total
- * relation size.
+ * relation size. The optional exact argument skips the shard size cache.
  */
 Datum
 citus_table_size(PG_FUNCTION_ARGS)
 {
 	Oid relationId = PG_GETARG_OID(0);
+	bool exact = PG_NARGS() > 1 ? PG_GETARG_BOOL(1) : false;
 	char *tableSizeFunction = PG_TABLE_SIZE_FUNCTION;
 
 	CheckCitusVersion(ERROR);
@@ -126,7 +146,8 @@ citus_table_size(PG_FUNCTION_ARGS)
 		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
 	}
 
-	uint64 tableSize = DistributedTableSize(relationId, tableSizeFunction);
+	uint64 tableSize = DistributedTableSize(relationId, tableSizeFunction,
+											SHARD_TABLE_SIZE, exact);
 
 	PG_RETURN_INT64(tableSize);
 }
@@ -134,12 +155,13 @@ citus_table_size(PG_FUNCTION_ARGS)
 
 /*
  * citus_relation_size accept a table name and returns a relation's 'main'
- * fork's size.
+ * fork's size. The optional exact argument skips the shard size cache.
  */
 Datum
 citus_relation_size(PG_FUNCTION_ARGS)
 {
 	Oid relationId = PG_GETARG_OID(0);
+	bool exact = PG_NARGS() > 1 ? PG_GETARG_BOOL(1) : false;
 	char *tableSizeFunction = PG_RELATION_SIZE_FUNCTION;
 
 	CheckCitusVersion(ERROR);
@@ -149,19 +171,168 @@ citus_relation_size(PG_FUNCTION_ARGS)
 		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
 	}
 
-	uint64 relationSize = DistributedTableSize(relationId, tableSizeFunction);
+	uint64 relationSize = DistributedTableSize(relationId, tableSizeFunction,
+											   SHARD_RELATION_SIZE, exact);
 
 	PG_RETURN_INT64(relationSize);
 }
 
 
+/*
+ * citus_approximate_count accepts a table name and returns an estimate of the
+ * number of rows in a distributed table, based on the statistics of its shards
+ * that VACUUM and ANALYZE keep, scaled to the current size of the shards. The
+ * estimate takes a single catalog query per node rather than a scan of all
+ * shards, but it is 0 for shards that were never vacuumed or analyzed.
+ */
+Datum
+citus_approximate_count(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	CheckCitusVersion(ERROR);
+
+	Relation relation = try_relation_open(relationId, AccessShareLock);
+	if (relation == NULL)
+	{
+		ereport(ERROR, (errmsg("could not estimate the row count: relation does not "
+							   "exist")));
+	}
+
+	AclResult aclResult = pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, get_rel_name(relationId));
+	}
+
+	if (!IsCitusTable(relationId))
+	{
+		char *relationName = get_rel_name(relationId);
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+						errmsg("cannot estimate the row count because relation %s is "
+							   "not distributed", quote_literal_cstr(relationName))));
+	}
+
+	uint64 rowCount = DistributedTableRowCountEstimate(relationId);
+
+	heap_close(relation, AccessShareLock);
+
+	PG_RETURN_INT64(rowCount);
+}
+
+
+/*
+ * DistributedTableRowCountEstimate returns the estimated number of rows in the
+ * given distributed table, summed over one placement of each shard, or over
+ * the partitions of a partitioned table. Each node that has shards is asked
+ * for the estimates of all of them in a single query.
+ */
+uint64
+DistributedTableRowCountEstimate(Oid relationId)
+{
+	uint64 rowCount = 0;
+
+	if (PartitionedTable(relationId))
+	{
+		Oid partitionId = InvalidOid;
+		foreach_oid(partitionId, PartitionList(relationId))
+		{
+			rowCount += DistributedTableRowCountEstimate(partitionId);
+		}
+
+		return rowCount;
+	}
+
+	List *workerNodeList = ActiveReadableNodeList();
+	List *shardIntervalListPerNode = ShardIntervalsPerReadableNode(relationId,
+																	workerNodeList);
+
+	ListCell *workerNodeCell = NULL;
+	ListCell *shardIntervalListCell = NULL;
+	forboth(workerNodeCell, workerNodeList, shardIntervalListCell,
+			shardIntervalListPerNode)
+	{
+		WorkerNode *workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		List *shardIntervalList = (List *) lfirst(shardIntervalListCell);
+
+		if (shardIntervalList == NIL)
+		{
+			continue;
+		}
+
+		rowCount += SumShardSizesOnWorker(workerNode, shardIntervalList,
+										  SHARD_ROW_COUNT_ESTIMATE_FUNCTION);
+	}
+
+	return rowCount;
+}
+
+
+/*
+ * ShardIntervalsPerReadableNode returns a list with the shard intervals of the
+ * given table for each of the given nodes, such that every shard is assigned
+ * to a single node that has an active placement of it. Shards without an
+ * active placement on any of the nodes are left out.
+ */
+static List *
+ShardIntervalsPerReadableNode(Oid relationId, List *workerNodeList)
+{
+	int nodeCount = list_length(workerNodeList);
+	List **shardIntervalLists = palloc0(nodeCount * sizeof(List *));
+	List *shardIntervalListPerNode = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, LoadShardIntervalList(relationId))
+	{
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		bool assigned = false;
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			int nodeIndex = 0;
+
+			WorkerNode *workerNode = NULL;
+			foreach_ptr(workerNode, workerNodeList)
+			{
+				if (workerNode->groupId == placement->groupId)
+				{
+					shardIntervalLists[nodeIndex] =
+						lappend(shardIntervalLists[nodeIndex], shardInterval);
+					assigned = true;
+					break;
+				}
+
+				nodeIndex++;
+			}
+
+			if (assigned)
+			{
+				break;
+			}
+		}
+	}
+
+	for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+	{
+		shardIntervalListPerNode = lappend(shardIntervalListPerNode,
+										   shardIntervalLists[nodeIndex]);
+	}
+
+	return shardIntervalListPerNode;
+}
+
+
 /*
  * DistributedTableSize is helper function for each kind of citus size functions.
  * It first checks whether the table is distributed and size query can be run on
- * it. Connection to each node has to be established to get the size of the table.
+ * it. Unless an exact size is requested, the size is taken from the shard size
+ * cache when all placements of the table are in there. Otherwise, connection to
+ * each node has to be established to get the size of the table.
  */
 static uint64
-DistributedTableSize(Oid relationId, char *sizeQuery)
+DistributedTableSize(Oid relationId, char *sizeQuery, ShardSizeType sizeType,
+					 bool exact)
 {
 	uint64 totalRelationSize = 0;
 
@@ -183,12 +354,18 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
 	ErrorIfNotSuitableToGetSize(relationId);
 
 	List *workerNodeList = ActiveReadableNodeList();
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
+
+	if (exact || !CachedDistributedTableSize(relationId, workerNodeList, sizeType,
+											 &totalRelationSize))
 	{
-		uint64 relationSizeOnNode = DistributedTableSizeOnWorker(workerNode, relationId,
-																 sizeQuery);
-		totalRelationSize += relationSizeOnNode;
+		WorkerNode *workerNode = NULL;
+		foreach_ptr(workerNode, workerNodeList)
+		{
+			uint64 relationSizeOnNode = DistributedTableSizeOnWorker(workerNode,
+																	 relationId,
+																	 sizeQuery);
+			totalRelationSize += relationSizeOnNode;
+		}
 	}
 
 	heap_close(relation, AccessShareLock);
@@ -197,6 +374,49 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
 }
 
 
+/*
+ * CachedDistributedTableSize sums up the cached sizes of the placements of the
+ * given table on the given nodes and returns whether all of them were cached.
+ * The size is only written to tableSize if they were.
+ */
+static bool
+CachedDistributedTableSize(Oid relationId, List *workerNodeList,
+						   ShardSizeType sizeType, uint64 *tableSize)
+{
+	uint64 cachedTableSize = 0;
+
+	if (!ShardSizeCacheEnabled())
+	{
+		return false;
+	}
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		List *placementList = GroupShardPlacementsForTableOnGroup(relationId,
+																  workerNode->groupId);
+
+		GroupShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			uint64 placementSize = 0;
+
+			if (!CachedPlacementSize(placement->shardId, placement->groupId, sizeType,
+									 &placementSize))
+			{
+				return false;
+			}
+
+			cachedTableSize += placementSize;
+		}
+	}
+
+	*tableSize = cachedTableSize;
+
+	return true;
+}
+
+
 /*
  * DistributedTableSizeOnWorker gets the workerNode and relationId to calculate
  * size of that relation on the given workerNode by summing up the size of each
@@ -204,6 +424,21 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
  */
 static uint64
 DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId, char *sizeQuery)
+{
+	List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode, relationId);
+
+	return SumShardSizesOnWorker(workerNode, shardIntervalsOnNode, sizeQuery);
+}
+
+
+/*
+ * SumShardSizesOnWorker applies the given size query to each of the given
+ * shards on the given worker node in a single query, and returns the sum of
+ * the results.
+ */
+static uint64
+SumShardSizesOnWorker(WorkerNode *workerNode, List *shardIntervalList,
+					  char *sizeQuery)
 {
 	char *workerNodeName = workerNode->workerName;
 	uint32 workerNodePort = workerNode->workerPort;
@@ -211,10 +446,8 @@ DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId, char *sizeQ
 	PGresult *result = NULL;
 	bool raiseErrors = true;
 
-	List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode, relationId);
-
 	StringInfo tableSizeQuery = GenerateSizeQueryOnMultiplePlacements(
-		shardIntervalsOnNode,
+		shardIntervalList,
 		sizeQuery);
 
 	MultiConnection *connection = GetNodeConnection(connectionFlag, workerNodeName,
@@ -769,6 +1002,56 @@ BuildShardPlacementList(ShardInterval *shardInterval)
 }
 
 
+/*
+ * BuildShardPlacementListForShardIdRange finds shard placements for all shards
+ * with an id between minShardId and maxShardId (inclusive) from system catalogs
+ * using a single index scan, converts these placements to their in-memory
+ * representation, and returns the converted shard placements in a new list
+ * ordered by shard id.
+ *
+ * This probably only should be called from metadata_cache.c.  Resides here
+ * because it shares code with other routines in this file.
+ */
+List *
+BuildShardPlacementListForShardIdRange(uint64 minShardId, uint64 maxShardId)
+{
+	List *shardPlacementList = NIL;
+	ScanKeyData scanKey[2];
+	int scanKeyCount = 2;
+	bool indexOK = true;
+
+	Relation pgPlacement = heap_open(DistPlacementRelationId(), AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_placement_shardid,
+				BTGreaterEqualStrategyNumber, F_INT8GE, Int64GetDatum(minShardId));
+	ScanKeyInit(&scanKey[1], Anum_pg_dist_placement_shardid,
+				BTLessEqualStrategyNumber, F_INT8LE, Int64GetDatum(maxShardId));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgPlacement,
+													DistPlacementShardidIndexId(),
+													indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	while (HeapTupleIsValid(heapTuple))
+	{
+		TupleDesc tupleDescriptor = RelationGetDescr(pgPlacement);
+
+		GroupShardPlacement *placement =
+			TupleToGroupShardPlacement(tupleDescriptor, heapTuple);
+
+		shardPlacementList = lappend(shardPlacementList, placement);
+
+		heapTuple = systable_getnext(scanDescriptor);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgPlacement, NoLock);
+
+	return shardPlacementList;
+}
+
+
 /*
  * BuildShardPlacementListForGroup finds shard placements for the given groupId
  * from system catalogs, converts these placements to their in-memory
@@ -859,6 +1142,87 @@ TupleToGroupShardPlacement(TupleDesc tupleDescriptor, HeapTuple heapTuple)
 void
 InsertShardRow(Oid relationId, uint64 shardId, char storageType,
 			   text *shardMinValue, text *shardMaxValue)
+{
+	/* open shard relation and insert new tuple */
+	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
+
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistShard);
+	HeapTuple heapTuple = ShardRowTuple(tupleDescriptor, relationId, shardId,
+										storageType, shardMinValue, shardMaxValue);
+
+	CatalogTupleInsert(pgDistShard, heapTuple);
+
+	/* invalidate previous cache entry and close relation */
+	CitusInvalidateRelcacheByRelid(relationId);
+
+	CommandCounterIncrement();
+	heap_close(pgDistShard, NoLock);
+}
+
+
+/*
+ * InsertShardRowList inserts a row into the shard system catalog for each of
+ * the given shard intervals. Unlike calling InsertShardRow() for each shard,
+ * it opens the catalog and its indexes once, and invalidates the metadata
+ * cache of each relation only once, which matters when creating thousands of
+ * shards at a time.
+ */
+void
+InsertShardRowList(List *shardIntervalList)
+{
+	Oid lastRelationId = InvalidOid;
+
+	if (shardIntervalList == NIL)
+	{
+		return;
+	}
+
+	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistShard);
+	CatalogIndexState indexState = CatalogOpenIndexes(pgDistShard);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		text *shardMinValue = NULL;
+		text *shardMaxValue = NULL;
+
+		if (shardInterval->minValueExists && shardInterval->maxValueExists)
+		{
+			shardMinValue = cstring_to_text(DatumToString(shardInterval->minValue,
+														  shardInterval->valueTypeId));
+			shardMaxValue = cstring_to_text(DatumToString(shardInterval->maxValue,
+														  shardInterval->valueTypeId));
+		}
+
+		HeapTuple heapTuple = ShardRowTuple(tupleDescriptor, shardInterval->relationId,
+											shardInterval->shardId,
+											shardInterval->storageType,
+											shardMinValue, shardMaxValue);
+
+		CatalogTupleInsertWithInfo(pgDistShard, heapTuple, indexState);
+		heap_freetuple(heapTuple);
+
+		if (shardInterval->relationId != lastRelationId)
+		{
+			CitusInvalidateRelcacheByRelid(shardInterval->relationId);
+			lastRelationId = shardInterval->relationId;
+		}
+	}
+
+	CatalogCloseIndexes(indexState);
+
+	CommandCounterIncrement();
+	heap_close(pgDistShard, NoLock);
+}
+
+
+/*
+ * ShardRowTuple forms a pg_dist_shard tuple from the given values.
+ */
+static HeapTuple
+ShardRowTuple(TupleDesc tupleDescriptor, Oid relationId, uint64 shardId,
+			  char storageType, text *shardMinValue, text *shardMaxValue)
 {
 	Datum values[Natts_pg_dist_shard];
 	bool isNulls[Natts_pg_dist_shard];
@@ -886,19 +1250,7 @@ InsertShardRow(Oid relationId, uint64 shardId, char storageType,
 		isNulls[Anum_pg_dist_shard_shardmaxvalue - 1] = true;
 	}
 
-	/* open shard relation and insert new tuple */
-	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
-
-	TupleDesc tupleDescriptor = RelationGetDescr(pgDistShard);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
-
-	CatalogTupleInsert(pgDistShard, heapTuple);
-
-	/* invalidate previous cache entry and close relation */
-	CitusInvalidateRelcacheByRelid(relationId);
-
-	CommandCounterIncrement();
-	heap_close(pgDistShard, NoLock);
+	return heap_form_tuple(tupleDescriptor, values, isNulls);
 }
 
 
@@ -913,28 +1265,17 @@ InsertShardPlacementRow(uint64 shardId, uint64 placementId,
 						char shardState, uint64 shardLength,
 						int32 groupId)
 {
-	Datum values[Natts_pg_dist_placement];
-	bool isNulls[Natts_pg_dist_placement];
-
-	/* form new shard placement tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
-
 	if (placementId == INVALID_PLACEMENT_ID)
 	{
 		placementId = master_get_new_placementid(NULL);
 	}
-	values[Anum_pg_dist_placement_placementid - 1] = Int64GetDatum(placementId);
-	values[Anum_pg_dist_placement_shardid - 1] = Int64GetDatum(shardId);
-	values[Anum_pg_dist_placement_shardstate - 1] = CharGetDatum(shardState);
-	values[Anum_pg_dist_placement_shardlength - 1] = Int64GetDatum(shardLength);
-	values[Anum_pg_dist_placement_groupid - 1] = Int32GetDatum(groupId);
 
 	/* open shard placement relation and insert new tuple */
 	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
 
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPlacement);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+	HeapTuple heapTuple = ShardPlacementRowTuple(tupleDescriptor, shardId, placementId,
+												 shardState, shardLength, groupId);
 
 	CatalogTupleInsert(pgDistPlacement, heapTuple);
 
@@ -947,6 +1288,83 @@ InsertShardPlacementRow(uint64 shardId, uint64 placementId,
 }
 
 
+/*
+ * InsertShardPlacementRowList inserts a row into the shard placement system
+ * catalog for each of the given placements, opening the catalog and its
+ * indexes only once. Placements with an invalid placement id are assigned a
+ * new one, which is stored in the given placement.
+ */
+void
+InsertShardPlacementRowList(List *groupShardPlacementList)
+{
+	uint64 lastShardId = INVALID_SHARD_ID;
+
+	if (groupShardPlacementList == NIL)
+	{
+		return;
+	}
+
+	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPlacement);
+	CatalogIndexState indexState = CatalogOpenIndexes(pgDistPlacement);
+
+	GroupShardPlacement *placement = NULL;
+	foreach_ptr(placement, groupShardPlacementList)
+	{
+		if (placement->placementId == INVALID_PLACEMENT_ID)
+		{
+			placement->placementId = master_get_new_placementid(NULL);
+		}
+
+		HeapTuple heapTuple = ShardPlacementRowTuple(tupleDescriptor,
+													 placement->shardId,
+													 placement->placementId,
+													 placement->shardState,
+													 placement->shardLength,
+													 placement->groupId);
+
+		CatalogTupleInsertWithInfo(pgDistPlacement, heapTuple, indexState);
+		heap_freetuple(heapTuple);
+
+		/* placements of a shard are usually adjacent, invalidate once for them */
+		if (placement->shardId != lastShardId)
+		{
+			CitusInvalidateRelcacheByShardId(placement->shardId);
+			lastShardId = placement->shardId;
+		}
+	}
+
+	CatalogCloseIndexes(indexState);
+
+	CommandCounterIncrement();
+	heap_close(pgDistPlacement, NoLock);
+}
+
+
+/*
+ * ShardPlacementRowTuple forms a pg_dist_placement tuple from the given values.
+ */
+static HeapTuple
+ShardPlacementRowTuple(TupleDesc tupleDescriptor, uint64 shardId, uint64 placementId,
+					   char shardState, uint64 shardLength, int32 groupId)
+{
+	Datum values[Natts_pg_dist_placement];
+	bool isNulls[Natts_pg_dist_placement];
+
+	/* form new shard placement tuple */
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[Anum_pg_dist_placement_placementid - 1] = Int64GetDatum(placementId);
+	values[Anum_pg_dist_placement_shardid - 1] = Int64GetDatum(shardId);
+	values[Anum_pg_dist_placement_shardstate - 1] = CharGetDatum(shardState);
+	values[Anum_pg_dist_placement_shardlength - 1] = Int64GetDatum(shardLength);
+	values[Anum_pg_dist_placement_groupid - 1] = Int32GetDatum(groupId);
+
+	return heap_form_tuple(tupleDescriptor, values, isNulls);
+}
+
+
 /*
  * InsertIntoPgDistPartition inserts a new tuple into pg_dist_partition.
  */
@@ -1082,13 +1500,66 @@ DeletePartitionRow(Oid distributedRelationId)
  */
 void
 DeleteShardRow(uint64 shardId)
+{
+	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
+
+	Oid distributedRelationId = DeleteShardTuple(pgDistShard, shardId);
+
+	/* invalidate previous cache entry */
+	CitusInvalidateRelcacheByRelid(distributedRelationId);
+
+	CommandCounterIncrement();
+	heap_close(pgDistShard, NoLock);
+}
+
+
+/*
+ * DeleteShardRowList deletes the rows of the given shards from the shard
+ * system catalog. Compared to calling DeleteShardRow for each shard, it opens
+ * the catalog, invalidates each distributed table and increments the command
+ * counter only once, which matters when dropping tables with many shards.
+ */
+void
+DeleteShardRowList(List *shardIntervalList)
+{
+	List *distributedRelationIdList = NIL;
+
+	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		Oid distributedRelationId = DeleteShardTuple(pgDistShard,
+													 shardInterval->shardId);
+
+		distributedRelationIdList = list_append_unique_oid(distributedRelationIdList,
+														   distributedRelationId);
+	}
+
+	/* invalidate previous cache entries */
+	Oid distributedRelationId = InvalidOid;
+	foreach_oid(distributedRelationId, distributedRelationIdList)
+	{
+		CitusInvalidateRelcacheByRelid(distributedRelationId);
+	}
+
+	CommandCounterIncrement();
+	heap_close(pgDistShard, NoLock);
+}
+
+
+/*
+ * DeleteShardTuple finds the unique row that has the given shardId in the given
+ * shard system catalog, deletes it, and returns the distributed table it
+ * belongs to.
+ */
+static Oid
+DeleteShardTuple(Relation pgDistShard, uint64 shardId)
 {
 	ScanKeyData scanKey[1];
 	int scanKeyCount = 1;
 	bool indexOK = true;
 
-	Relation pgDistShard = heap_open(DistShardRelationId(), RowExclusiveLock);
-
 	ScanKeyInit(&scanKey[0], Anum_pg_dist_shard_shardid,
 				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(shardId));
 
@@ -1110,11 +1581,7 @@ DeleteShardRow(uint64 shardId)
 
 	systable_endscan(scanDescriptor);
 
-	/* invalidate previous cache entry */
-	CitusInvalidateRelcacheByRelid(distributedRelationId);
-
-	CommandCounterIncrement();
-	heap_close(pgDistShard, NoLock);
+	return distributedRelationId;
 }
 
 
@@ -1124,13 +1591,60 @@ DeleteShardRow(uint64 shardId)
  */
 void
 DeleteShardPlacementRow(uint64 placementId)
+{
+	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
+
+	uint64 shardId = DeleteShardPlacementTuple(pgDistPlacement, placementId);
+
+	CitusInvalidateRelcacheByShardId(shardId);
+
+	CommandCounterIncrement();
+	heap_close(pgDistPlacement, NoLock);
+}
+
+
+/*
+ * DeleteShardPlacementRowList deletes the rows of the given placements from the
+ * shard placement system catalog. Like DeleteShardRowList, it opens the catalog
+ * and increments the command counter only once. The placements are expected to
+ * be grouped by shard, such that we invalidate the cache once per shard.
+ */
+void
+DeleteShardPlacementRowList(List *placementList)
+{
+	uint64 lastShardId = INVALID_SHARD_ID;
+
+	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		uint64 shardId = DeleteShardPlacementTuple(pgDistPlacement,
+												   placement->placementId);
+		if (shardId != lastShardId)
+		{
+			CitusInvalidateRelcacheByShardId(shardId);
+			lastShardId = shardId;
+		}
+	}
+
+	CommandCounterIncrement();
+	heap_close(pgDistPlacement, NoLock);
+}
+
+
+/*
+ * DeleteShardPlacementTuple finds the placement with the given placementId in
+ * the given shard placement system catalog, deletes it, and returns its shard.
+ */
+static uint64
+DeleteShardPlacementTuple(Relation pgDistPlacement, uint64 placementId)
 {
 	const int scanKeyCount = 1;
 	ScanKeyData scanKey[1];
 	bool indexOK = true;
 	bool isNull = false;
 
-	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPlacement);
 
 	ScanKeyInit(&scanKey[0], Anum_pg_dist_placement_placementid,
@@ -1159,10 +1673,7 @@ DeleteShardPlacementRow(uint64 placementId)
 	simple_heap_delete(pgDistPlacement, &heapTuple->t_self);
 	systable_endscan(scanDescriptor);
 
-	CitusInvalidateRelcacheByShardId(shardId);
-
-	CommandCounterIncrement();
-	heap_close(pgDistPlacement, NoLock);
+	return shardId;
 }
 
 
@@ -13,7 +13,9 @@
 #include "postgres.h"
 #include "c.h"
 #include "fmgr.h"
+#include "funcapi.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 
 #include <string.h>
 
@@ -27,14 +29,19 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_replication.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_progress.h"
 #include "distributed/reference_table_utils.h"
+#include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
 #include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
+#include "storage/latch.h"
 #include "storage/lock.h"
 #include "storage/lmgr.h"
 #include "utils/builtins.h"
@@ -43,6 +50,63 @@
 #include "utils/lsyscache.h"
 #include "utils/palloc.h"
 
+/* magic number identifying shard copy progress monitors */
+#define SHARD_COPY_PROGRESS_MAGIC_NUMBER 0x53484344
+
+/*
+ * ShardCopyStatus describes how far the copy of a single shard has come, in
+ * the order in which a copy goes through them.
+ */
+typedef enum ShardCopyStatus
+{
+	SHARD_COPY_WAITING = 0,
+	SHARD_COPY_COPYING_DATA = 1,
+	SHARD_COPY_CREATING_INDEXES = 2,
+	SHARD_COPY_DONE = 3
+} ShardCopyStatus;
+
+/*
+ * ShardCopyProgress is a progress monitor step that describes the copy of a
+ * single shard, as shown by citus_shard_copy_progress().
+ */
+typedef struct ShardCopyProgress
+{
+	uint64 shardId;
+	Oid relationId;
+	ShardCopyStatus status;
+	char sourceNodeName[MAX_NODE_LENGTH + 1];
+	int32 sourceNodePort;
+	char targetNodeName[MAX_NODE_LENGTH + 1];
+	int32 targetNodePort;
+} ShardCopyProgress;
+
+/*
+ * ShardCopyTask keeps the state of copying a single shard to the target node
+ * over its own connection.
+ */
+typedef struct ShardCopyTask
+{
+	char *tableOwner;
+	List *commandList;
+
+	/* number of commands in commandList that precede the index commands */
+	int dataCommandCount;
+
+	/* index of the next command to send, the previous one is in flight */
+	int nextCommandIndex;
+
+	MultiConnection *connection;
+	ShardCopyProgress *progress;
+} ShardCopyTask;
+
+
+/* GUC, maximum number of shards that are copied to a node concurrently */
+int MaxParallelShardCopies = 1;
+
+/* GUC, whether to load moved shards into the buffer cache of the target node */
+bool PrewarmMovedShards = false;
+
+
 /* local function forward declarations */
 static char LookupShardTransferMode(Oid shardReplicationModeOid);
 static void ErrorIfTableCannotBeReplicated(Oid relationId);
@@ -53,9 +117,27 @@ static void ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName
 											 int32 sourceNodePort, char *targetNodeName,
 											 int32 targetNodePort,
 											 char shardReplicationMode);
+static void MoveColocatedShardPlacement(int64 shardId, char *sourceNodeName,
+										int32 sourceNodePort, char *targetNodeName,
+										int32 targetNodePort,
+										char shardReplicationMode);
+static void DropColocatedShardPlacement(List *colocatedShardList, char *nodeName,
+										int32 nodePort);
+static void PrewarmShardPlacements(List *shardIntervalList, char *sourceNodeName,
+								   int32 sourceNodePort, char *targetNodeName,
+								   int32 targetNodePort);
 static void CopyShardTables(List *shardIntervalList, char *sourceNodeName,
 							int32 sourceNodePort, char *targetNodeName,
 							int32 targetNodePort);
+static void ExecuteShardCopyTaskList(List *copyTaskList, char *targetNodeName,
+									 int32 targetNodePort);
+static int ActiveShardCopyCount(List *activeTaskList, ShardCopyProgress *progress);
+static void StartShardCopyTask(ShardCopyTask *copyTask, char *targetNodeName,
+							   int32 targetNodePort);
+static bool AdvanceShardCopyTask(ShardCopyTask *copyTask);
+static int ShardCopyTaskWaitFlags(ShardCopyTask *copyTask);
+static void WaitForShardCopyTaskList(List *copyTaskList);
+static const char * ShardCopyStatusName(ShardCopyStatus status);
 static List * CopyPartitionShardsCommandList(ShardInterval *shardInterval,
 											 const char *sourceNodeName,
 											 int32 sourceNodePort);
@@ -66,13 +148,13 @@ static void EnsureShardCanBeCopied(int64 shardId, const char *sourceNodeName,
 								   int32 sourceNodePort, const char *targetNodeName,
 								   int32 targetNodePort);
 static List * RecreateTableDDLCommandList(Oid relationId);
-static List * WorkerApplyShardDDLCommandList(List *ddlCommandList, int64 shardId);
 static void EnsureTableListOwner(List *tableIdList);
 static void EnsureTableListSuitableForReplication(List *tableIdList);
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_copy_shard_placement);
 PG_FUNCTION_INFO_V1(master_move_shard_placement);
+PG_FUNCTION_INFO_V1(citus_shard_copy_progress);
 
 
 /*
@@ -103,12 +185,11 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 	EnsureCoordinator();
 
 	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
-	if (shardReplicationMode == TRANSFER_MODE_FORCE_LOGICAL)
+	if (doRepair && shardReplicationMode == TRANSFER_MODE_FORCE_LOGICAL)
 	{
 		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("using logical replication in "
-							   "master_copy_shard_placement() requires Citus "
-							   "Enterprise")));
+						errmsg("using logical replication with repair functionality "
+							   "is currently not supported")));
 	}
 
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
@@ -132,14 +213,123 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 
 /*
  * master_move_shard_placement moves given shard (and its co-located shards) from one
- * node to the other node.
+ * node to the other node. The shards are replicated logically to the target node
+ * when the transfer mode allows it, such that modifications are only paused
+ * while switching over to the new placements. Otherwise modifications are paused
+ * while the shards are copied. Afterwards the placements on the source node are
+ * dropped.
  */
 Datum
 master_move_shard_placement(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("master_move_shard_placement() is only supported on "
-						   "Citus Enterprise")));
+	int64 shardId = PG_GETARG_INT64(0);
+	text *sourceNodeNameText = PG_GETARG_TEXT_P(1);
+	int32 sourceNodePort = PG_GETARG_INT32(2);
+	text *targetNodeNameText = PG_GETARG_TEXT_P(3);
+	int32 targetNodePort = PG_GETARG_INT32(4);
+	Oid shardReplicationModeOid = PG_GETARG_OID(5);
+
+	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
+	char *targetNodeName = text_to_cstring(targetNodeNameText);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
+
+	MoveColocatedShardPlacement(shardId, sourceNodeName, sourceNodePort,
+								targetNodeName, targetNodePort, shardReplicationMode);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_copy_progress returns a row for each shard that is being copied
+ * by a master_copy_shard_placement() call in any backend, showing where the
+ * copy of the shard currently is.
+ */
+Datum
+citus_shard_copy_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegments = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(SHARD_COPY_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegments);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		ShardCopyProgress *steps = (ShardCopyProgress *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			ShardCopyProgress *progress = &steps[stepIndex];
+			Datum values[8];
+			bool isNulls[8];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = ObjectIdGetDatum(progress->relationId);
+			values[2] = Int64GetDatum(progress->shardId);
+			values[3] = CStringGetTextDatum(progress->sourceNodeName);
+			values[4] = Int32GetDatum(progress->sourceNodePort);
+			values[5] = CStringGetTextDatum(progress->targetNodeName);
+			values[6] = Int32GetDatum(progress->targetNodePort);
+			values[7] = CStringGetTextDatum(ShardCopyStatusName(progress->status));
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegments);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * ShardCopyStatusName returns the name of the given shard copy status as
+ * shown by citus_shard_copy_progress().
+ */
+static const char *
+ShardCopyStatusName(ShardCopyStatus status)
+{
+	switch (status)
+	{
+		case SHARD_COPY_WAITING:
+		{
+			return "waiting";
+		}
+
+		case SHARD_COPY_COPYING_DATA:
+		{
+			return "copying data";
+		}
+
+		case SHARD_COPY_CREATING_INDEXES:
+		{
+			return "creating indexes";
+		}
+
+		case SHARD_COPY_DONE:
+		{
+			return "done";
+		}
+
+		default:
+		{
+			return "unknown";
+		}
+	}
 }
 
 
@@ -395,7 +585,18 @@ ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName,
 	 */
 	colocatedShardList = SortList(colocatedShardList, CompareShardIntervalsById);
 
-	BlockWritesToShardList(colocatedShardList);
+	bool useLogicalReplication =
+		ShouldUseLogicalReplication(colocatedShardList, shardReplicationMode,
+									sourceNodeName, sourceNodePort);
+	if (useLogicalReplication)
+	{
+		/* writes are only blocked once the new placements have caught up */
+		LockShardListForLogicalReplication(colocatedShardList);
+	}
+	else
+	{
+		BlockWritesToShardList(colocatedShardList);
+	}
 
 	ShardInterval *colocatedShard = NULL;
 	foreach_ptr(colocatedShard, colocatedShardList)
@@ -423,8 +624,16 @@ ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName,
 		EnsureReferenceTablesExistOnAllNodes();
 	}
 
-	CopyShardTables(colocatedShardList, sourceNodeName, sourceNodePort,
-					targetNodeName, targetNodePort);
+	if (useLogicalReplication)
+	{
+		LogicallyReplicateShards(colocatedShardList, sourceNodeName, sourceNodePort,
+								 targetNodeName, targetNodePort);
+	}
+	else
+	{
+		CopyShardTables(colocatedShardList, sourceNodeName, sourceNodePort,
+						targetNodeName, targetNodePort);
+	}
 
 	/*
 	 * Finally insert the placements to pg_dist_placement and sync it to the
@@ -452,6 +661,249 @@ ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName,
 }
 
 
+/*
+ * MoveColocatedShardPlacement moves the given shard and its colocated shards
+ * from a source node to target node.
+ */
+static void
+MoveColocatedShardPlacement(int64 shardId, char *sourceNodeName, int32 sourceNodePort,
+							char *targetNodeName, int32 targetNodePort,
+							char shardReplicationMode)
+{
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+
+	if (PartitionMethod(distributedTableId) == DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot move shard " INT64_FORMAT, shardId),
+						errdetail("Reference tables have a placement on every node.")));
+	}
+
+	List *colocatedTableList = ColocatedTableList(distributedTableId);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	EnsureTableListOwner(colocatedTableList);
+
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, colocatedTableList)
+	{
+		if (get_rel_relkind(colocatedTableId) == RELKIND_FOREIGN_TABLE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot move shard " INT64_FORMAT, shardId),
+							errdetail("Table %s is a foreign table. Moving shards "
+									  "backed by foreign tables is not supported.",
+									  get_rel_name(colocatedTableId))));
+		}
+	}
+
+	/*
+	 * We sort shardIntervalList so that lock operations will not cause any
+	 * deadlocks.
+	 */
+	colocatedShardList = SortList(colocatedShardList, CompareShardIntervalsById);
+
+	bool useLogicalReplication =
+		ShouldUseLogicalReplication(colocatedShardList, shardReplicationMode,
+									sourceNodeName, sourceNodePort);
+	if (useLogicalReplication)
+	{
+		/* writes are only blocked once the new placements have caught up */
+		LockShardListForLogicalReplication(colocatedShardList);
+	}
+	else
+	{
+		BlockWritesToShardList(colocatedShardList);
+	}
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		EnsureShardCanBeCopied(colocatedShard->shardId, sourceNodeName, sourceNodePort,
+							   targetNodeName, targetNodePort);
+	}
+
+	/* the shards may be joined with reference tables on the target node */
+	EnsureReferenceTablesExistOnAllNodes();
+
+	if (useLogicalReplication)
+	{
+		LogicallyReplicateShards(colocatedShardList, sourceNodeName, sourceNodePort,
+								 targetNodeName, targetNodePort);
+	}
+	else
+	{
+		CopyShardTables(colocatedShardList, sourceNodeName, sourceNodePort,
+						targetNodeName, targetNodePort);
+	}
+
+	if (PrewarmMovedShards)
+	{
+		PrewarmShardPlacements(colocatedShardList, sourceNodeName, sourceNodePort,
+							   targetNodeName, targetNodePort);
+	}
+
+	/* add the placements on the target node to the metadata */
+	uint32 targetGroupId = GroupForNode(targetNodeName, targetNodePort);
+
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		uint64 colocatedShardId = colocatedShard->shardId;
+		uint64 placementId = GetNextPlacementId();
+
+		InsertShardPlacementRow(colocatedShardId, placementId,
+								SHARD_STATE_ACTIVE, ShardLength(colocatedShardId),
+								targetGroupId);
+
+		if (ShouldSyncTableMetadata(colocatedShard->relationId))
+		{
+			char *placementCommand = PlacementUpsertCommand(colocatedShardId, placementId,
+															SHARD_STATE_ACTIVE, 0,
+															targetGroupId);
+
+			SendCommandToWorkersWithMetadata(placementCommand);
+		}
+	}
+
+	DropColocatedShardPlacement(colocatedShardList, sourceNodeName, sourceNodePort);
+}
+
+
+/*
+ * DropColocatedShardPlacement removes the placements of the given colocated
+ * shards on the given node from the metadata and drops them, as part of the
+ * current transaction.
+ */
+static void
+DropColocatedShardPlacement(List *colocatedShardList, char *nodeName, int32 nodePort)
+{
+	StringInfo dropCommand = makeStringInfo();
+	StringInfo deletePlacementCommand = makeStringInfo();
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		List *shardPlacementList = ShardPlacementList(colocatedShard->shardId);
+		ShardPlacement *placement = ForceSearchShardPlacementInList(shardPlacementList,
+																	nodeName, nodePort);
+		uint64 placementId = placement->placementId;
+
+		DeleteShardPlacementRow(placementId);
+
+		if (ShouldSyncTableMetadata(colocatedShard->relationId))
+		{
+			resetStringInfo(deletePlacementCommand);
+			appendStringInfo(deletePlacementCommand,
+							 "DELETE FROM pg_dist_placement WHERE placementid = "
+							 UINT64_FORMAT, placementId);
+
+			SendCommandToWorkersWithMetadata(deletePlacementCommand->data);
+		}
+
+		resetStringInfo(dropCommand);
+		appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND,
+						 ConstructQualifiedShardName(colocatedShard));
+
+		SendCommandToWorker(nodeName, nodePort, dropCommand->data);
+	}
+}
+
+
+/*
+ * PrewarmShardPlacements loads the given shards and their indexes into the
+ * buffer cache of the target node before queries are routed to it, such that
+ * moving a frequently used shard does not leave its queries with a cold cache.
+ *
+ * The new placements are built from scratch, so their blocks do not match the
+ * blocks that are cached on the source node. Instead, we load as many blocks
+ * of each relation on the target node as the source node has in its cache.
+ * Warming up is best-effort: failures are reported as warnings and do not
+ * fail the move.
+ */
+static void
+PrewarmShardPlacements(List *shardIntervalList, char *sourceNodeName,
+					   int32 sourceNodePort, char *targetNodeName, int32 targetNodePort)
+{
+	StringInfo shardNameList = makeStringInfo();
+	StringInfo cachedBlocksQuery = makeStringInfo();
+	StringInfo prewarmValues = makeStringInfo();
+	StringInfo prewarmQuery = makeStringInfo();
+	char *superUser = CitusExtensionOwnerName();
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	PGresult *result = NULL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		char *shardName = ConstructQualifiedShardName(shardInterval);
+
+		appendStringInfo(shardNameList, "%s%s::regclass",
+						 shardNameList->len > 0 ? ", " : "",
+						 quote_literal_cstr(shardName));
+	}
+
+	appendStringInfo(cachedBlocksQuery,
+					 "SELECT oid::regclass, pg_catalog.worker_cached_block_count(oid) "
+					 "FROM pg_catalog.pg_class WHERE oid IN (%s) OR oid IN "
+					 "(SELECT indexrelid FROM pg_catalog.pg_index "
+					 "WHERE indrelid IN (%s))",
+					 shardNameList->data, shardNameList->data);
+
+	MultiConnection *sourceConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, sourceNodeName, sourceNodePort,
+									  superUser, NULL);
+
+	int queryResult = ExecuteOptionalRemoteCommand(sourceConnection,
+												   cachedBlocksQuery->data, &result);
+	if (queryResult != RESPONSE_OKAY)
+	{
+		CloseConnection(sourceConnection);
+		return;
+	}
+
+	int rowCount = PQntuples(result);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		char *relationName = PQgetvalue(result, rowIndex, 0);
+		char *cachedBlockCount = PQgetvalue(result, rowIndex, 1);
+
+		if (strcmp(cachedBlockCount, "0") == 0)
+		{
+			continue;
+		}
+
+		appendStringInfo(prewarmValues, "%s(%s, %s::bigint)",
+						 prewarmValues->len > 0 ? ", " : "",
+						 quote_literal_cstr(relationName), cachedBlockCount);
+	}
+
+	PQclear(result);
+	ForgetResults(sourceConnection);
+	CloseConnection(sourceConnection);
+
+	if (prewarmValues->len == 0)
+	{
+		/* none of the shards are cached on the source node */
+		return;
+	}
+
+	appendStringInfo(prewarmQuery,
+					 "SELECT sum(pg_catalog.worker_prewarm_relation("
+					 "relation::regclass, block_count)) "
+					 "FROM (VALUES %s) AS prewarm (relation, block_count)",
+					 prewarmValues->data);
+
+	MultiConnection *targetConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, targetNodeName, targetNodePort,
+									  superUser, NULL);
+
+	ExecuteOptionalRemoteCommand(targetConnection, prewarmQuery->data, NULL);
+
+	CloseConnection(targetConnection);
+}
+
+
 /*
  * EnsureTableListOwner ensures current user owns given tables. Superusers
  * are regarded as owners.
@@ -510,20 +962,81 @@ EnsureTableListSuitableForReplication(List *tableIdList)
 
 
 /*
- * CopyColocatedShardPlacement copies a shard along with its co-located shards from a
- * source node to target node. CopyShardPlacement does not make any checks about state
- * of the shards. It is caller's responsibility to make those checks if they are
- * necessary.
+ * CopyShardTables copies a shard along with its co-located shards from a
+ * source node to target node, and then recreates the relationships between
+ * them. CopyShardTables does not make any checks about state of the shards.
+ * It is caller's responsibility to make those checks if they are necessary.
  */
 static void
 CopyShardTables(List *shardIntervalList, char *sourceNodeName, int32 sourceNodePort,
 				char *targetNodeName, int32 targetNodePort)
 {
+	List *sourcePlacementList = NIL;
+
 	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementList = ShardPlacementList(shardInterval->shardId);
+		ShardPlacement *sourcePlacement =
+			ForceSearchShardPlacementInList(placementList, sourceNodeName,
+											sourceNodePort);
 
-	/* iterate through the colocated shards and copy each */
+		sourcePlacementList = lappend(sourcePlacementList, sourcePlacement);
+	}
+
+	CopyShardListToNode(shardIntervalList, sourcePlacementList, targetNodeName,
+						targetNodePort);
+
+	/* once all shards are created, recreate the relationships between them */
+	CopyShardRelationships(shardIntervalList, targetNodeName, targetNodePort);
+}
+
+
+/*
+ * CopyShardListToNode creates each of the given shards on the target node and
+ * copies its data from the placement at the same position in
+ * sourcePlacementList. Shards are copied in parallel, see
+ * ExecuteShardCopyTaskList. Relationships between the shards are not created.
+ */
+void
+CopyShardListToNode(List *shardIntervalList, List *sourcePlacementList,
+					char *targetNodeName, int32 targetNodePort)
+{
+	List *copyTaskList = NIL;
+	int shardCount = list_length(shardIntervalList);
+	int shardIndex = 0;
+
+	Assert(list_length(sourcePlacementList) == shardCount);
+
+	/*
+	 * Keep track of the progress of each shard in a progress monitor, such
+	 * that citus_shard_copy_progress() can show it. If we cannot get shared
+	 * memory for it we still track progress locally to keep things simple.
+	 */
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(shardIntervalList);
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(SHARD_COPY_PROGRESS_MAGIC_NUMBER, shardCount,
+							  sizeof(ShardCopyProgress),
+							  firstShardInterval->relationId);
+	ShardCopyProgress *progressArray = NULL;
+	if (monitor != NULL)
+	{
+		progressArray = (ShardCopyProgress *) monitor->steps;
+	}
+	else
+	{
+		progressArray = palloc0(shardCount * sizeof(ShardCopyProgress));
+	}
+
+	/* build a copy task for each of the shards */
+	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
+		ShardPlacement *sourcePlacement = list_nth(sourcePlacementList, shardIndex);
+		char *sourceNodeName = sourcePlacement->nodeName;
+		int32 sourceNodePort = sourcePlacement->nodePort;
+		ShardCopyTask *copyTask = palloc0(sizeof(ShardCopyTask));
+		ShardCopyProgress *progress = &progressArray[shardIndex];
 		bool includeDataCopy = true;
 
 		if (PartitionedTable(shardInterval->relationId))
@@ -532,31 +1045,52 @@ CopyShardTables(List *shardIntervalList, char *sourceNodeName, int32 sourceNodeP
 			includeDataCopy = false;
 		}
 
-		List *ddlCommandList = CopyShardCommandList(shardInterval, sourceNodeName,
-													sourceNodePort, includeDataCopy);
-		char *tableOwner = TableOwner(shardInterval->relationId);
+		List *dataCommandList = CopyShardDataCommandList(shardInterval, sourceNodeName,
+														 sourceNodePort, includeDataCopy);
+		List *indexCommandList = CopyShardIndexCommandList(shardInterval);
+
+		copyTask->tableOwner = TableOwner(shardInterval->relationId);
+		copyTask->dataCommandCount = list_length(dataCommandList);
+		copyTask->commandList = list_concat(dataCommandList, indexCommandList);
+		copyTask->progress = progress;
+
+		progress->shardId = shardInterval->shardId;
+		progress->relationId = shardInterval->relationId;
+		progress->status = SHARD_COPY_WAITING;
+		strlcpy(progress->sourceNodeName, sourceNodeName, MAX_NODE_LENGTH + 1);
+		progress->sourceNodePort = sourceNodePort;
+		strlcpy(progress->targetNodeName, targetNodeName, MAX_NODE_LENGTH + 1);
+		progress->targetNodePort = targetNodePort;
+
+		copyTaskList = lappend(copyTaskList, copyTask);
+		shardIndex++;
+	}
 
-		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
-												   tableOwner, ddlCommandList);
+	ExecuteShardCopyTaskList(copyTaskList, targetNodeName, targetNodePort);
+
+	if (monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
 	}
+}
 
 
-	/*
-	 * Once all shards are created, we can recreate relationships between shards.
-	 *
-	 * Iterate through the colocated shards and create the foreign constraints and
-	 * attach child tables to their parents in a partitioning hierarchy.
-	 *
-	 * Note: After implementing foreign constraints from distributed to reference
-	 * tables, we have decided to not create foreign constraints from hash
-	 * distributed to reference tables at this stage for nonblocking rebalancer.
-	 * We just create the co-located ones here. We add the foreign constraints
-	 * from hash distributed to reference tables after being completely done with
-	 * the copy procedure inside LogicallyReplicateShards. The reason is that,
-	 * the reference tables have placements in both source and target workers and
-	 * the copied shard would get updated twice because of a cascading DML coming
-	 * from both of the placements.
-	 */
+/*
+ * CopyShardRelationships recreates the relationships of the given colocated
+ * shards on the target node, once all of them exist there. It creates the
+ * foreign constraints of each shard, both to its colocated shards and to
+ * reference tables, and attaches partitions to their parents.
+ *
+ * Callers that replicate the shards logically only call this after the
+ * replication is done, since the reference tables have placements on both
+ * the source and the target node and cascading changes from both would
+ * otherwise be applied to the new shards twice.
+ */
+void
+CopyShardRelationships(List *shardIntervalList, char *targetNodeName,
+					   int32 targetNodePort)
+{
+	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
 		List *shardForeignConstraintCommandList = NIL;
@@ -584,6 +1118,284 @@ CopyShardTables(List *shardIntervalList, char *sourceNodeName, int32 sourceNodeP
 }
 
 
+/*
+ * ExecuteShardCopyTaskList runs the given shard copy tasks on the target node,
+ * each in its own connection and transaction, with at most
+ * citus.max_parallel_shard_copies of them pulling from the same source node at
+ * the same time. Each task creates the indexes of its shard right after copying
+ * its data, such that index builds of one shard overlap with data copies of
+ * other shards.
+ */
+static void
+ExecuteShardCopyTaskList(List *copyTaskList, char *targetNodeName,
+						 int32 targetNodePort)
+{
+	List *pendingTaskList = list_copy(copyTaskList);
+	List *activeTaskList = NIL;
+
+	while (pendingTaskList != NIL || activeTaskList != NIL)
+	{
+		List *remainingTaskList = NIL;
+		bool madeProgress = false;
+
+		/* start new copies from source nodes that are below the parallelism limit */
+		List *waitingTaskList = NIL;
+		ShardCopyTask *copyTask = NULL;
+		foreach_ptr(copyTask, pendingTaskList)
+		{
+			if (ActiveShardCopyCount(activeTaskList, copyTask->progress) >=
+				MaxParallelShardCopies)
+			{
+				waitingTaskList = lappend(waitingTaskList, copyTask);
+				continue;
+			}
+
+			StartShardCopyTask(copyTask, targetNodeName, targetNodePort);
+
+			activeTaskList = lappend(activeTaskList, copyTask);
+		}
+
+		pendingTaskList = waitingTaskList;
+
+		/* move each copy whose current command is done to its next command */
+		foreach_ptr(copyTask, activeTaskList)
+		{
+			if (ShardCopyTaskWaitFlags(copyTask) != 0)
+			{
+				remainingTaskList = lappend(remainingTaskList, copyTask);
+				continue;
+			}
+
+			madeProgress = true;
+
+			bool copyFinished = AdvanceShardCopyTask(copyTask);
+			if (!copyFinished)
+			{
+				remainingTaskList = lappend(remainingTaskList, copyTask);
+			}
+		}
+
+		activeTaskList = remainingTaskList;
+
+		if (!madeProgress && activeTaskList != NIL)
+		{
+			WaitForShardCopyTaskList(activeTaskList);
+		}
+	}
+}
+
+
+/*
+ * ActiveShardCopyCount returns the number of the given active copy tasks that
+ * copy from the same source node as the given progress.
+ */
+static int
+ActiveShardCopyCount(List *activeTaskList, ShardCopyProgress *progress)
+{
+	int activeCopyCount = 0;
+
+	ShardCopyTask *copyTask = NULL;
+	foreach_ptr(copyTask, activeTaskList)
+	{
+		if (strncmp(copyTask->progress->sourceNodeName, progress->sourceNodeName,
+					MAX_NODE_LENGTH) == 0 &&
+			copyTask->progress->sourceNodePort == progress->sourceNodePort)
+		{
+			activeCopyCount++;
+		}
+	}
+
+	return activeCopyCount;
+}
+
+
+/*
+ * StartShardCopyTask opens a new connection to the target node for the given
+ * copy task, begins a transaction on it, and sends the first command.
+ */
+static void
+StartShardCopyTask(ShardCopyTask *copyTask, char *targetNodeName,
+				   int32 targetNodePort)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	MultiConnection *connection = GetNodeUserDatabaseConnection(connectionFlags,
+																targetNodeName,
+																targetNodePort,
+																copyTask->tableOwner,
+																NULL);
+
+	MarkRemoteTransactionCritical(connection);
+	RemoteTransactionBegin(connection);
+
+	copyTask->connection = connection;
+	copyTask->progress->status = SHARD_COPY_COPYING_DATA;
+
+	AdvanceShardCopyTask(copyTask);
+}
+
+
+/*
+ * AdvanceShardCopyTask checks the result of the command the given copy task
+ * sent last, if any, and sends the next command. Once all commands are done,
+ * it commits the transaction, closes the connection, and returns true.
+ */
+static bool
+AdvanceShardCopyTask(ShardCopyTask *copyTask)
+{
+	MultiConnection *connection = copyTask->connection;
+
+	if (copyTask->nextCommandIndex > 0)
+	{
+		bool raiseInterrupts = true;
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	if (copyTask->nextCommandIndex < list_length(copyTask->commandList))
+	{
+		char *command = list_nth(copyTask->commandList, copyTask->nextCommandIndex);
+
+		if (copyTask->nextCommandIndex == copyTask->dataCommandCount)
+		{
+			copyTask->progress->status = SHARD_COPY_CREATING_INDEXES;
+		}
+
+		int querySent = SendRemoteCommand(connection, command);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		copyTask->nextCommandIndex++;
+
+		return false;
+	}
+
+	RemoteTransactionCommit(connection);
+	CloseConnection(connection);
+
+	copyTask->connection = NULL;
+	copyTask->progress->status = SHARD_COPY_DONE;
+
+	return true;
+}
+
+
+/*
+ * ShardCopyTaskWaitFlags performs the pending IO on the connection of the given
+ * copy task and returns the socket events it needs to wait for, or 0 if its
+ * current command is done.
+ */
+static int
+ShardCopyTaskWaitFlags(ShardCopyTask *copyTask)
+{
+	MultiConnection *connection = copyTask->connection;
+	PGconn *pgConn = connection->pgConn;
+	int waitFlags = 0;
+
+	int sendStatus = PQflush(pgConn);
+	if (sendStatus == -1)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+	else if (sendStatus == 1)
+	{
+		waitFlags |= WL_SOCKET_WRITEABLE;
+	}
+
+	if (PQconsumeInput(pgConn) == 0)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	if (PQisBusy(pgConn))
+	{
+		waitFlags |= WL_SOCKET_READABLE;
+	}
+
+	return waitFlags;
+}
+
+
+/*
+ * WaitForShardCopyTaskList blocks until the connection of at least one of the
+ * given copy tasks has IO to perform, or until an interrupt arrives.
+ */
+static void
+WaitForShardCopyTaskList(List *copyTaskList)
+{
+	int taskCount = list_length(copyTaskList);
+	int eventSetSize = taskCount + 2;
+	int *waitFlagsArray = palloc0(taskCount * sizeof(int));
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	int taskIndex = 0;
+
+	/* do the IO that may raise errors before we create the wait event set */
+	ShardCopyTask *copyTask = NULL;
+	foreach_ptr(copyTask, copyTaskList)
+	{
+		int waitFlags = ShardCopyTaskWaitFlags(copyTask);
+		if (waitFlags == 0)
+		{
+			/* a command finished in the meantime, no need to wait */
+			pfree(waitFlagsArray);
+			pfree(events);
+			return;
+		}
+
+		waitFlagsArray[taskIndex++] = waitFlags;
+	}
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+
+	taskIndex = 0;
+	foreach_ptr(copyTask, copyTaskList)
+	{
+		int sock = PQsocket(copyTask->connection->pgConn);
+
+		AddWaitEventToSet(waitEventSet, waitFlagsArray[taskIndex++], sock, NULL,
+						  (void *) copyTask);
+	}
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	int eventCount = WaitEventSetWait(waitEventSet, -1, events, eventSetSize,
+									  WAIT_EVENT_CLIENT_READ);
+
+	/* free the wait event set before we raise any errors below */
+	FreeWaitEventSet(waitEventSet);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+
+	pfree(waitFlagsArray);
+	pfree(events);
+}
+
+
 /*
  * CopyPartitionShardsCommandList gets a shardInterval which is a shard that
  * belongs to partitioned table (this is asserted).
@@ -739,6 +1551,28 @@ ForceSearchShardPlacementInList(List *shardPlacementList, const char *nodeName,
 List *
 CopyShardCommandList(ShardInterval *shardInterval, const char *sourceNodeName,
 					 int32 sourceNodePort, bool includeDataCopy)
+{
+	List *copyShardToNodeCommandsList = CopyShardDataCommandList(shardInterval,
+																 sourceNodeName,
+																 sourceNodePort,
+																 includeDataCopy);
+	List *indexCommandList = CopyShardIndexCommandList(shardInterval);
+
+	copyShardToNodeCommandsList = list_concat(copyShardToNodeCommandsList,
+											  indexCommandList);
+
+	return copyShardToNodeCommandsList;
+}
+
+
+/*
+ * CopyShardDataCommandList generates the part of CopyShardCommandList that
+ * recreates the given shard on the target node and, unless includeDataCopy
+ * is false, copies its data from the source node.
+ */
+List *
+CopyShardDataCommandList(ShardInterval *shardInterval, const char *sourceNodeName,
+						 int32 sourceNodePort, bool includeDataCopy)
 {
 	int64 shardId = shardInterval->shardId;
 	char *shardName = ConstructQualifiedShardName(shardInterval);
@@ -765,13 +1599,24 @@ CopyShardCommandList(ShardInterval *shardInterval, const char *sourceNodeName,
 											  copyShardDataCommand->data);
 	}
 
-	List *indexCommandList = GetTableIndexAndConstraintCommands(relationId);
-	indexCommandList = WorkerApplyShardDDLCommandList(indexCommandList, shardId);
+	return copyShardToNodeCommandsList;
+}
 
-	copyShardToNodeCommandsList = list_concat(copyShardToNodeCommandsList,
-											  indexCommandList);
 
-	return copyShardToNodeCommandsList;
+/*
+ * CopyShardIndexCommandList generates the part of CopyShardCommandList that
+ * creates the indexes and constraints of the given shard once its data has
+ * been copied.
+ */
+List *
+CopyShardIndexCommandList(ShardInterval *shardInterval)
+{
+	List *indexCommandList =
+		GetTableIndexAndConstraintCommands(shardInterval->relationId);
+	indexCommandList = WorkerApplyShardDDLCommandList(indexCommandList,
+													  shardInterval->shardId);
+
+	return indexCommandList;
 }
 
 
@@ -963,7 +1808,7 @@ RecreateTableDDLCommandList(Oid relationId)
  * in a call to worker_apply_shard_ddl_command to apply the DDL command to
  * the shard specified by shardId.
  */
-static List *
+List *
 WorkerApplyShardDDLCommandList(List *ddlCommandList, int64 shardId)
 {
 	List *applyDdlCommandList = NIL;
@@ -14,44 +14,865 @@
 #include "c.h"
 #include "fmgr.h"
 
+#include "distributed/pg_version_constants.h"
+
 #include "catalog/pg_class.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_nodefuncs.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_join_order.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shared_library_init.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
+#include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "storage/lock.h"
+#include "storage/lmgr.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
 #include "utils/lsyscache.h"
+#include "utils/rel.h"
 #include "utils/typcache.h"
 
 
+/*
+ * ShardSplitRange is the hash range of one of the shards that a shard is
+ * split into.
+ */
+typedef struct ShardSplitRange
+{
+	int32 minValue;
+	int32 maxValue;
+} ShardSplitRange;
+
+
+/* local function forward declarations */
+static List * SplitShard(ShardInterval *sourceShard, List *splitRangeList);
+static List * SplitShardList(List *sourceShardList, List *splitRangeListList);
+static List * ReshardSplitRangeListList(Oid relationId, List *sourceShardList,
+										int shardCount);
+static void ErrorIfCannotSplitShardList(List *colocatedShardList);
+static ShardSplitRange * MakeShardSplitRange(int32 minValue, int32 maxValue);
+static List * SplitShardIntervalList(ShardInterval *sourceShard, List *splitRangeList);
+static List * SplitCopyTaskList(ShardInterval *sourceShard, List *splitShardList,
+								List *sourcePlacementList);
+static char * SplitCopyCommand(ShardInterval *sourceShard, ShardInterval *splitShard);
+static char * CopyableColumnNameListString(Oid relationId);
+static List * InsertSplitShardMetadata(List *splitShardList, List *sourcePlacementList);
+static List * SplitShardRelationshipTaskList(List *splitShardList);
+static void DropSplitSourceShard(ShardInterval *sourceShard);
+
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(isolate_tenant_to_new_shard);
+PG_FUNCTION_INFO_V1(master_split_shard);
+PG_FUNCTION_INFO_V1(master_reshard_table);
 PG_FUNCTION_INFO_V1(worker_hash);
 
 
 /*
  * isolate_tenant_to_new_shard isolates a tenant to its own shard by spliting
- * the current matching shard.
+ * the current matching shard into the hash range below the hash value of the
+ * tenant, the hash value of the tenant, and the hash range above it. Shards
+ * that are colocated with the matching shard are split in the same way when
+ * the CASCADE option is given. The function returns the id of the new shard
+ * of the given table that contains the tenant.
  */
 Datum
 isolate_tenant_to_new_shard(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("isolate_tenant_to_new_shard() is only supported on "
-						   "Citus Enterprise")));
+	Oid relationId = PG_GETARG_OID(0);
+	Datum inputDatum = PG_GETARG_DATUM(1);
+	text *cascadeOptionText = PG_GETARG_TEXT_P(2);
+	char *cascadeOption = text_to_cstring(cascadeOptionText);
+	List *splitRangeList = NIL;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(relationId);
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	char *relationName = get_rel_name(relationId);
+
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant because tenant isolation "
+							   "is only supported for hash distributed tables")));
+	}
+
+	if (PartitionTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant of partition table %s",
+							   quote_literal_cstr(relationName)),
+						errhint("Isolate the tenant of the parent table with the "
+								"CASCADE option instead.")));
+	}
+
+	List *colocatedTableList = ColocatedTableList(relationId);
+	if (list_length(colocatedTableList) > 1 &&
+		pg_strncasecmp(cascadeOption, "CASCADE", NAMEDATALEN) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant because %s has colocated "
+							   "tables", quote_literal_cstr(relationName)),
+						errhint("Use CASCADE option to isolate tenants for the "
+								"colocated tables too. Example usage: "
+								"isolate_tenant_to_new_shard(%s, <tenant_id>, "
+								"'CASCADE')", quote_literal_cstr(relationName))));
+	}
+
+	/* convert the tenant value to the type of the distribution column */
+	Oid inputDataType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	char *tenantIdString = DatumToString(inputDatum, inputDataType);
+	Var *distributionColumn = cacheEntry->partitionColumn;
+	Datum tenantIdDatum = StringToDatum(tenantIdString, distributionColumn->vartype);
+
+	ShardInterval *sourceShard = FindShardInterval(tenantIdDatum, cacheEntry);
+	if (sourceShard == NULL)
+	{
+		ereport(ERROR, (errmsg("tenant does not have a shard")));
+	}
+
+	sourceShard = CopyShardInterval(sourceShard);
+
+	Datum hashedValueDatum = HashPartitionColumnValue(cacheEntry->hashFunction,
+													  distributionColumn->varcollid,
+													  tenantIdDatum);
+	int32 hashedValue = DatumGetInt32(hashedValueDatum);
+	int32 shardMinValue = DatumGetInt32(sourceShard->minValue);
+	int32 shardMaxValue = DatumGetInt32(sourceShard->maxValue);
+
+	if (shardMinValue == hashedValue && shardMaxValue == hashedValue)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("table %s has already been isolated for the given "
+							   "value", quote_literal_cstr(relationName))));
+	}
+
+	if (shardMinValue < hashedValue)
+	{
+		splitRangeList = lappend(splitRangeList,
+								 MakeShardSplitRange(shardMinValue, hashedValue - 1));
+	}
+
+	int tenantRangeIndex = list_length(splitRangeList);
+	splitRangeList = lappend(splitRangeList,
+							 MakeShardSplitRange(hashedValue, hashedValue));
+
+	if (hashedValue < shardMaxValue)
+	{
+		splitRangeList = lappend(splitRangeList,
+								 MakeShardSplitRange(hashedValue + 1, shardMaxValue));
+	}
+
+	List *splitShardList = SplitShard(sourceShard, splitRangeList);
+	ShardInterval *tenantShard = list_nth(splitShardList, tenantRangeIndex);
+
+	PG_RETURN_INT64(tenantShard->shardId);
+}
+
+
+/*
+ * master_split_shard splits the given shard of a hash distributed table into
+ * a shard for the hash values up to and including the given split point and a
+ * shard for the hash values above it. Shards that are colocated with the given
+ * shard are always split in the same way, to preserve colocation.
+ */
+Datum
+master_split_shard(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	int32 splitPoint = PG_GETARG_INT32(1);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	ShardInterval *sourceShard = LoadShardInterval(shardId);
+	Oid relationId = sourceShard->relationId;
+
+	EnsureTableOwner(relationId);
+
+	if (PartitionMethod(relationId) != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard " UINT64_FORMAT, shardId),
+						errdetail("Splitting shards is only supported for hash "
+								  "distributed tables.")));
+	}
+
+	int32 shardMinValue = DatumGetInt32(sourceShard->minValue);
+	int32 shardMaxValue = DatumGetInt32(sourceShard->maxValue);
+
+	if (splitPoint < shardMinValue || splitPoint >= shardMaxValue)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("split point %d is not within the range of shard "
+							   UINT64_FORMAT, splitPoint, shardId),
+						errdetail("The split point must be at least %d and less "
+								  "than %d.", shardMinValue, shardMaxValue)));
+	}
+
+	List *splitRangeList = list_make2(MakeShardSplitRange(shardMinValue, splitPoint),
+									  MakeShardSplitRange(splitPoint + 1,
+														  shardMaxValue));
+
+	SplitShard(sourceShard, splitRangeList);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * master_reshard_table changes the number of shards of the given hash
+ * distributed table and of all tables colocated with it, by splitting every
+ * shard into the new shards whose hash ranges it covers. The new hash ranges
+ * are the ones create_distributed_table would have given the tables for the
+ * new shard count, so each of them has to fall within a single existing shard.
+ * In practice that means the new shard count is a multiple of the current one.
+ *
+ * All shards are split at once, see SplitShardList for how that affects writes
+ * and reads on the tables.
+ */
+Datum
+master_reshard_table(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int32 shardCount = PG_GETARG_INT32(1);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureTableOwner(relationId);
+
+	char *relationName = get_rel_name(relationId);
+
+	if (PartitionMethod(relationId) != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot reshard table %s",
+							   quote_literal_cstr(relationName)),
+						errdetail("Resharding is only supported for hash distributed "
+								  "tables.")));
+	}
+
+	if (PartitionTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot reshard partition table %s",
+							   quote_literal_cstr(relationName)),
+						errhint("Reshard the parent table instead.")));
+	}
+
+	if (shardCount <= 0 || shardCount > MAX_SHARD_COUNT)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("%d is outside the valid range for shard count",
+							   shardCount),
+						errdetail("The shard count must be between 1 and %d.",
+								  MAX_SHARD_COUNT)));
+	}
+
+	List *sourceShardList = LoadShardIntervalList(relationId);
+	int currentShardCount = list_length(sourceShardList);
+
+	if (shardCount == currentShardCount)
+	{
+		ereport(NOTICE, (errmsg("table %s already has %d shards",
+								quote_literal_cstr(relationName), shardCount)));
+		PG_RETURN_VOID();
+	}
+	else if (shardCount < currentShardCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot reshard table %s into fewer shards",
+							   quote_literal_cstr(relationName)),
+						errdetail("The table has %d shards and merging shards is not "
+								  "supported.", currentShardCount)));
+	}
+
+	List *splitRangeListList = ReshardSplitRangeListList(relationId, sourceShardList,
+														 shardCount);
+
+	/* shards whose range does not change are not split */
+	List *splitSourceShardList = NIL;
+	List *splitSourceRangeListList = NIL;
+
+	ListCell *sourceShardCell = NULL;
+	ListCell *splitRangeListCell = NULL;
+	forboth(sourceShardCell, sourceShardList, splitRangeListCell, splitRangeListList)
+	{
+		ShardInterval *sourceShard = (ShardInterval *) lfirst(sourceShardCell);
+		List *splitRangeList = (List *) lfirst(splitRangeListCell);
+
+		if (list_length(splitRangeList) > 1)
+		{
+			splitSourceShardList = lappend(splitSourceShardList, sourceShard);
+			splitSourceRangeListList = lappend(splitSourceRangeListList,
+											   splitRangeList);
+		}
+	}
+
+	SplitShardList(splitSourceShardList, splitSourceRangeListList);
+
+	uint32 colocationId = TableColocationId(relationId);
+	if (colocationId != INVALID_COLOCATION_ID)
+	{
+		UpdateColocationGroupShardCount(colocationId, shardCount);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ReshardSplitRangeListList returns for each of the given shards of the given
+ * table the list of ranges it is split into when the table gets the given
+ * number of shards, and errors out if one of the new ranges spans multiple
+ * existing shards.
+ */
+static List *
+ReshardSplitRangeListList(Oid relationId, List *sourceShardList, int shardCount)
+{
+	uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
+	List *splitRangeListList = NIL;
+	int shardIndex = 0;
+
+	ShardInterval *sourceShard = NULL;
+	foreach_ptr(sourceShard, sourceShardList)
+	{
+		int32 sourceMinValue = DatumGetInt32(sourceShard->minValue);
+		int32 sourceMaxValue = DatumGetInt32(sourceShard->maxValue);
+		List *splitRangeList = NIL;
+
+		while (shardIndex < shardCount)
+		{
+			/* same ranges as in CreateShardsWithRoundRobinPolicy */
+			int32 minValue = INT32_MIN + (shardIndex * hashTokenIncrement);
+			int32 maxValue = minValue + (hashTokenIncrement - 1);
+
+			if (shardIndex == shardCount - 1)
+			{
+				maxValue = INT32_MAX;
+			}
+
+			if (minValue > sourceMaxValue)
+			{
+				break;
+			}
+
+			if (minValue < sourceMinValue || maxValue > sourceMaxValue)
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("cannot reshard table %s into %d shards",
+									   quote_literal_cstr(get_rel_name(relationId)),
+									   shardCount),
+								errdetail("The hash range of new shard %d spans "
+										  "multiple existing shards.", shardIndex + 1),
+								errhint("Use a multiple of the current shard count "
+										"%d.", list_length(sourceShardList))));
+			}
+
+			splitRangeList = lappend(splitRangeList,
+									 MakeShardSplitRange(minValue, maxValue));
+			shardIndex++;
+		}
+
+		splitRangeListList = lappend(splitRangeListList, splitRangeList);
+	}
+
+	return splitRangeListList;
+}
+
+
+/*
+ * SplitShard splits the given shard and the shards colocated with it into new
+ * shards for the given hash ranges, and returns the new shards of the given
+ * shard in the order of the ranges.
+ */
+static List *
+SplitShard(ShardInterval *sourceShard, List *splitRangeList)
+{
+	List *splitShardListList = SplitShardList(list_make1(sourceShard),
+											  list_make1(splitRangeList));
+
+	return (List *) linitial(splitShardListList);
+}
+
+
+/*
+ * SplitShardList splits each of the given shards and the shards colocated
+ * with them into new shards for the corresponding list of hash ranges, and
+ * returns for each given shard the list of its new shards in the order of the
+ * ranges.
+ *
+ * The new shards are created next to each placement of the shard they are
+ * split from. Writes to the shards are blocked while the data is split, but
+ * reads continue until the old shards are dropped. The new shards are created
+ * and filled in parallel, each over its own connection and in its own
+ * transaction, such that the copies do not keep locks on the old shards that
+ * would conflict with dropping them. The old shards are dropped and the
+ * metadata is changed in the current transaction, so a failure before commit
+ * leaves at most some unused tables behind on the workers.
+ */
+static List *
+SplitShardList(List *sourceShardList, List *splitRangeListList)
+{
+	List *colocatedShardList = NIL;
+	List *colocatedSplitRangeListList = NIL;
+	List *splitShardListList = NIL;
+	List *sourcePlacementListList = NIL;
+	List *splitCopyTaskList = NIL;
+	List *sourceSplitShardListList = NIL;
+	List *allSplitShardList = NIL;
+
+	ListCell *sourceShardCell = NULL;
+	ListCell *splitRangeListCell = NULL;
+	forboth(sourceShardCell, sourceShardList, splitRangeListCell, splitRangeListList)
+	{
+		ShardInterval *sourceShard = (ShardInterval *) lfirst(sourceShardCell);
+		List *splitRangeList = (List *) lfirst(splitRangeListCell);
+		ShardInterval *colocatedShard = NULL;
+		foreach_ptr(colocatedShard, ColocatedShardIntervalList(sourceShard))
+		{
+			colocatedShardList = lappend(colocatedShardList, colocatedShard);
+			colocatedSplitRangeListList = lappend(colocatedSplitRangeListList,
+												  splitRangeList);
+		}
+	}
+
+	if (colocatedShardList == NIL)
+	{
+		return NIL;
+	}
+
+	/*
+	 * We sort the shard list so that lock operations will not cause any
+	 * deadlocks.
+	 */
+	List *sortedShardList = SortList(list_copy(colocatedShardList),
+									 CompareShardIntervalsById);
+
+	ErrorIfCannotSplitShardList(sortedShardList);
+
+	BlockWritesToShardList(sortedShardList);
+
+	ListCell *colocatedShardCell = NULL;
+	forboth(colocatedShardCell, colocatedShardList,
+			splitRangeListCell, colocatedSplitRangeListList)
+	{
+		ShardInterval *colocatedShard = (ShardInterval *) lfirst(colocatedShardCell);
+		List *splitRangeList = (List *) lfirst(splitRangeListCell);
+		List *splitShardList = SplitShardIntervalList(colocatedShard, splitRangeList);
+		List *sourcePlacementList = ActiveShardPlacementList(colocatedShard->shardId);
+
+		List *copyTaskList = SplitCopyTaskList(colocatedShard, splitShardList,
+											   sourcePlacementList);
+		splitCopyTaskList = list_concat(splitCopyTaskList, copyTaskList);
+
+		splitShardListList = lappend(splitShardListList, splitShardList);
+		sourcePlacementListList = lappend(sourcePlacementListList, sourcePlacementList);
+	}
+
+	/* create the new shards and copy their data */
+	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, splitCopyTaskList,
+									  MaxAdaptiveExecutorPoolSize, NIL);
+
+	/* replace the old shards with the new ones */
+	int shardIndex = 0;
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		List *splitShardList = list_nth(splitShardListList, shardIndex);
+		List *sourcePlacementList = list_nth(sourcePlacementListList, shardIndex);
+
+		DropSplitSourceShard(colocatedShard);
+
+		List *loadedSplitShardList = InsertSplitShardMetadata(splitShardList,
+															  sourcePlacementList);
+		allSplitShardList = list_concat(allSplitShardList, loadedSplitShardList);
+
+		shardIndex++;
+	}
+
+	/*
+	 * Foreign keys and partition hierarchies refer to other new shards, so we
+	 * create them once all new shards are in the metadata. We use a single
+	 * connection per node since the commands lock the referenced shards.
+	 */
+	List *relationshipTaskList = SplitShardRelationshipTaskList(allSplitShardList);
+	if (relationshipTaskList != NIL)
+	{
+		int poolSize = 1;
+		bool localExecutionSupported = true;
+
+		ExecuteUtilityTaskListExtended(relationshipTaskList, poolSize,
+									   localExecutionSupported);
+	}
+
+	ShardInterval *firstShard = (ShardInterval *) linitial(colocatedShardList);
+	if (ShouldSyncTableMetadata(firstShard->relationId))
+	{
+		List *metadataCommandList = NIL;
+
+		foreach_ptr(colocatedShard, colocatedShardList)
+		{
+			metadataCommandList = list_concat(metadataCommandList,
+											  ShardDeleteCommandList(colocatedShard));
+		}
+
+		metadataCommandList = list_concat(metadataCommandList,
+										  ShardListInsertCommand(allSplitShardList));
+
+		char *command = NULL;
+		foreach_ptr(command, metadataCommandList)
+		{
+			SendCommandToWorkersWithMetadata(command);
+		}
+	}
+
+	/* the new shards of the given shards, in the order of the given shards */
+	ShardInterval *sourceShard = NULL;
+	foreach_ptr(sourceShard, sourceShardList)
+	{
+		shardIndex = 0;
+		foreach_ptr(colocatedShard, colocatedShardList)
+		{
+			if (colocatedShard->shardId == sourceShard->shardId)
+			{
+				sourceSplitShardListList =
+					lappend(sourceSplitShardListList,
+							list_nth(splitShardListList, shardIndex));
+				break;
+			}
+
+			shardIndex++;
+		}
+	}
+
+	return sourceSplitShardListList;
+}
+
+
+/*
+ * ErrorIfCannotSplitShardList errors out if the given colocated shards cannot
+ * be split, either because the user does not own their tables or because not
+ * all of their placements are healthy.
+ */
+static void
+ErrorIfCannotSplitShardList(List *colocatedShardList)
+{
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		Oid relationId = colocatedShard->relationId;
+		uint64 shardId = colocatedShard->shardId;
+
+		EnsureTableOwner(relationId);
+
+		if (get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot split shard " UINT64_FORMAT, shardId),
+							errdetail("Table %s is a foreign table. Splitting shards "
+									  "backed by foreign tables is not supported.",
+									  get_rel_name(relationId))));
+		}
+
+		List *placementList = ShardPlacementList(shardId);
+		List *activePlacementList = ActiveShardPlacementList(shardId);
+
+		if (list_length(activePlacementList) != list_length(placementList))
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot split shard " UINT64_FORMAT, shardId),
+							errdetail("Not all placements of the shard are healthy."),
+							errhint("Repair the placements with "
+									"master_copy_shard_placement() first.")));
+		}
+	}
+}
+
+
+/*
+ * MakeShardSplitRange returns a ShardSplitRange for the given hash range.
+ */
+static ShardSplitRange *
+MakeShardSplitRange(int32 minValue, int32 maxValue)
+{
+	ShardSplitRange *splitRange = palloc0(sizeof(ShardSplitRange));
+	splitRange->minValue = minValue;
+	splitRange->maxValue = maxValue;
+
+	return splitRange;
+}
+
+
+/*
+ * SplitShardIntervalList returns a new shard interval with a new shard id for
+ * each of the given hash ranges of the given shard.
+ */
+static List *
+SplitShardIntervalList(ShardInterval *sourceShard, List *splitRangeList)
+{
+	List *splitShardList = NIL;
+
+	ShardSplitRange *splitRange = NULL;
+	foreach_ptr(splitRange, splitRangeList)
+	{
+		ShardInterval *splitShard = CopyShardInterval(sourceShard);
+
+		splitShard->shardId = GetNextShardId();
+		splitShard->minValue = Int32GetDatum(splitRange->minValue);
+		splitShard->maxValue = Int32GetDatum(splitRange->maxValue);
+		splitShard->shardIndex = INVALID_SHARD_INDEX;
+
+		splitShardList = lappend(splitShardList, splitShard);
+	}
+
+	return splitShardList;
+}
+
+
+/*
+ * SplitCopyTaskList returns a task for each new shard and placement of the
+ * given source shard that creates the new shard next to the placement, copies
+ * the rows in its hash range from the placement, and then creates its indexes.
+ */
+static List *
+SplitCopyTaskList(ShardInterval *sourceShard, List *splitShardList,
+				  List *sourcePlacementList)
+{
+	Oid relationId = sourceShard->relationId;
+	bool includeSequenceDefaults = false;
+	List *tableCreationCommandList = GetTableCreationCommands(relationId,
+															  includeSequenceDefaults);
+	List *taskList = NIL;
+	int taskId = 1;
+
+	ShardInterval *splitShard = NULL;
+	foreach_ptr(splitShard, splitShardList)
+	{
+		List *commandList = WorkerCreateShardCommandList(relationId,
+														 INVALID_SHARD_INDEX,
+														 splitShard->shardId,
+														 tableCreationCommandList,
+														 NIL);
+
+		/* partitioned tables contain no data */
+		if (!PartitionedTable(relationId))
+		{
+			commandList = lappend(commandList, SplitCopyCommand(sourceShard,
+																splitShard));
+		}
+
+		commandList = list_concat(commandList, CopyShardIndexCommandList(splitShard));
+
+		ShardPlacement *sourcePlacement = NULL;
+		foreach_ptr(sourcePlacement, sourcePlacementList)
+		{
+			Task *task = CitusMakeNode(Task);
+			task->jobId = INVALID_JOB_ID;
+			task->taskId = taskId++;
+			task->taskType = DDL_TASK;
+			SetTaskQueryStringList(task, commandList);
+			task->replicationModel = REPLICATION_MODEL_INVALID;
+			task->dependentTaskList = NIL;
+			task->anchorShardId = sourceShard->shardId;
+			task->taskPlacementList = list_make1(sourcePlacement);
+
+			taskList = lappend(taskList, task);
+		}
+	}
+
+	return taskList;
+}
+
+
+/*
+ * SplitCopyCommand returns the command that copies the rows in the hash range
+ * of the given new shard from the given source shard, on the node that has
+ * both.
+ */
+static char *
+SplitCopyCommand(ShardInterval *sourceShard, ShardInterval *splitShard)
+{
+	Oid relationId = sourceShard->relationId;
+	char *columnNameListString = CopyableColumnNameListString(relationId);
+	Var *distributionColumn = ForceDistPartitionKey(relationId);
+	char *distributionColumnName = get_attname(relationId,
+											   distributionColumn->varattno, false);
+	StringInfo copyCommand = makeStringInfo();
+
+	appendStringInfo(copyCommand,
+					 "INSERT INTO %s (%s) SELECT %s FROM %s "
+					 "WHERE pg_catalog.worker_hash(%s) BETWEEN %d AND %d",
+					 ConstructQualifiedShardName(splitShard), columnNameListString,
+					 columnNameListString, ConstructQualifiedShardName(sourceShard),
+					 quote_identifier(distributionColumnName),
+					 DatumGetInt32(splitShard->minValue),
+					 DatumGetInt32(splitShard->maxValue));
+
+	return copyCommand->data;
+}
+
+
+/*
+ * CopyableColumnNameListString returns the comma-separated, quoted names of
+ * the columns of the given relation that can be copied by INSERT .. SELECT,
+ * which are the columns that are neither dropped nor generated.
+ */
+static char *
+CopyableColumnNameListString(Oid relationId)
+{
+	Relation relation = relation_open(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	StringInfo columnNameListString = makeStringInfo();
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (currentColumn->attisdropped
+#if PG_VERSION_NUM >= PG_VERSION_12
+			|| currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		if (columnNameListString->len > 0)
+		{
+			appendStringInfoString(columnNameListString, ", ");
+		}
+
+		appendStringInfoString(columnNameListString,
+							   quote_identifier(NameStr(currentColumn->attname)));
+	}
+
+	relation_close(relation, NoLock);
+
+	return columnNameListString->data;
+}
+
+
+/*
+ * DropSplitSourceShard drops the placements of the given shard that has been
+ * split, and removes the shard from the metadata.
+ */
+static void
+DropSplitSourceShard(ShardInterval *sourceShard)
+{
+	Oid relationId = sourceShard->relationId;
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *relationName = get_rel_name(relationId);
+
+	DropShards(relationId, schemaName, relationName, list_make1(sourceShard));
+}
+
+
+/*
+ * InsertSplitShardMetadata inserts the given new shards into the metadata,
+ * with a placement in each node group of the given source placements, and
+ * returns the new shards as loaded from the metadata.
+ */
+static List *
+InsertSplitShardMetadata(List *splitShardList, List *sourcePlacementList)
+{
+	List *loadedSplitShardList = NIL;
+
+	ShardInterval *splitShard = NULL;
+	foreach_ptr(splitShard, splitShardList)
+	{
+		text *minValueText = IntegerToText(DatumGetInt32(splitShard->minValue));
+		text *maxValueText = IntegerToText(DatumGetInt32(splitShard->maxValue));
+
+		InsertShardRow(splitShard->relationId, splitShard->shardId,
+					   splitShard->storageType, minValueText, maxValueText);
+
+		ShardPlacement *sourcePlacement = NULL;
+		foreach_ptr(sourcePlacement, sourcePlacementList)
+		{
+			InsertShardPlacementRow(splitShard->shardId, INVALID_PLACEMENT_ID,
+									SHARD_STATE_ACTIVE, 0, sourcePlacement->groupId);
+		}
+	}
+
+	foreach_ptr(splitShard, splitShardList)
+	{
+		loadedSplitShardList = lappend(loadedSplitShardList,
+									   LoadShardInterval(splitShard->shardId));
+	}
+
+	return loadedSplitShardList;
+}
+
+
+/*
+ * SplitShardRelationshipTaskList returns a task for each placement of the
+ * given new shards that creates the foreign keys of the shard and attaches it
+ * to its parent shard if it belongs to a partition.
+ */
+static List *
+SplitShardRelationshipTaskList(List *splitShardList)
+{
+	List *taskList = NIL;
+	int taskId = 1;
+
+	ShardInterval *splitShard = NULL;
+	foreach_ptr(splitShard, splitShardList)
+	{
+		List *commandList = CopyShardForeignConstraintCommandList(splitShard);
+
+		if (PartitionTable(splitShard->relationId))
+		{
+			char *attachPartitionCommand =
+				GenerateAttachShardPartitionCommand(splitShard);
+
+			commandList = lappend(commandList, attachPartitionCommand);
+		}
+
+		if (commandList == NIL)
+		{
+			continue;
+		}
+
+		ShardPlacement *splitPlacement = NULL;
+		foreach_ptr(splitPlacement, ActiveShardPlacementList(splitShard->shardId))
+		{
+			Task *task = CitusMakeNode(Task);
+			task->jobId = INVALID_JOB_ID;
+			task->taskId = taskId++;
+			task->taskType = DDL_TASK;
+			SetTaskQueryStringList(task, commandList);
+			task->replicationModel = REPLICATION_MODEL_INVALID;
+			task->dependentTaskList = NIL;
+			task->anchorShardId = splitShard->shardId;
+			task->taskPlacementList = list_make1(splitPlacement);
+
+			taskList = lappend(taskList, task);
+		}
+	}
+
+	return taskList;
 }
 
 
@@ -56,19 +56,62 @@
 #include "utils/fmgroids.h"
 #include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/regproc.h"
 #include "utils/syscache.h"
 #include "utils/rel.h"
 
 
+/* maximum number of shards whose placements we create on a worker in one task */
+#define SHARD_CREATION_BATCH_SIZE 128
+
+
+/*
+ * ShardCreationBatch is the task that creates the placements of a batch of
+ * shards on one node group, along with the number of shards in the batch.
+ */
+typedef struct ShardCreationBatch
+{
+	int32 groupId;
+	Task *task;
+	int shardCount;
+} ShardCreationBatch;
+
+
+/*
+ * AppendSource is a table on a node whose contents are appended to a shard.
+ */
+typedef struct AppendSource
+{
+	char *tableName;
+	char *nodeName;
+	uint32 nodePort;
+
+	/* connection over which the range of the appended data is fetched */
+	MultiConnection *rangeConnection;
+} AppendSource;
+
+
 /* Local functions forward declarations */
 static List * RelationShardListForShardCreate(ShardInterval *shardInterval);
+static List * BatchShardCreationTasks(List *taskList, int shardsPerBatch);
+static float4 AppendTablesToShard(uint64 shardId, List *appendSourceList);
+static void SendAppendedRangeQueries(Oid relationId, List *appendSourceList);
+static bool ReceiveAppendedShardRange(ShardInterval *shardInterval,
+									  List *appendSourceList, text **minValue,
+									  text **maxValue);
+static uint64 UpdateShardStatisticsWithRange(int64 shardId, text *minValue,
+											 text *maxValue);
+static uint64 UpdateShardStatisticsInternal(int64 shardId, bool shardRangeKnown,
+											text *knownMinValue, text *knownMaxValue);
 static bool WorkerShardStats(ShardPlacement *placement, Oid relationId,
-							 const char *shardName, uint64 *shardSize,
-							 text **shardMinValue, text **shardMaxValue);
+							 const char *shardName, bool fetchShardRange,
+							 uint64 *shardSize, text **shardMinValue,
+							 text **shardMaxValue);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(master_create_empty_shard);
 PG_FUNCTION_INFO_V1(master_append_table_to_shard);
+PG_FUNCTION_INFO_V1(master_append_tables_to_shard);
 PG_FUNCTION_INFO_V1(master_update_shard_statistics);
 
 
@@ -229,13 +272,79 @@ master_append_table_to_shard(PG_FUNCTION_ARGS)
 	text *sourceNodeNameText = PG_GETARG_TEXT_P(2);
 	uint32 sourceNodePort = PG_GETARG_UINT32(3);
 
-	char *sourceTableName = text_to_cstring(sourceTableNameText);
-	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
+	CheckCitusVersion(ERROR);
+
+	AppendSource *appendSource = palloc0(sizeof(AppendSource));
+	appendSource->tableName = text_to_cstring(sourceTableNameText);
+	appendSource->nodeName = text_to_cstring(sourceNodeNameText);
+	appendSource->nodePort = sourceNodePort;
+
+	float4 shardFillLevel = AppendTablesToShard(shardId, list_make1(appendSource));
 
-	float4 shardFillLevel = 0.0;
+	PG_RETURN_FLOAT4(shardFillLevel);
+}
+
+
+/*
+ * master_append_tables_to_shard appends the contents of the given tables, which
+ * may be on different nodes, to the given shard in one go. It otherwise behaves
+ * like master_append_table_to_shard.
+ */
+Datum
+master_append_tables_to_shard(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	ArrayType *sourceTableNameArray = PG_GETARG_ARRAYTYPE_P(1);
+	ArrayType *sourceNodeNameArray = PG_GETARG_ARRAYTYPE_P(2);
+	ArrayType *sourceNodePortArray = PG_GETARG_ARRAYTYPE_P(3);
+	List *appendSourceList = NIL;
 
 	CheckCitusVersion(ERROR);
 
+	int32 sourceCount = ArrayObjectCount(sourceTableNameArray);
+	if (ArrayObjectCount(sourceNodeNameArray) != sourceCount ||
+		ArrayObjectCount(sourceNodePortArray) != sourceCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("source table names, node names and node ports "
+							   "should have the same length")));
+	}
+
+	if (sourceCount == 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("no source tables to append to shard " UINT64_FORMAT,
+							   shardId)));
+	}
+
+	Datum *sourceTableNameDatums = DeconstructArrayObject(sourceTableNameArray);
+	Datum *sourceNodeNameDatums = DeconstructArrayObject(sourceNodeNameArray);
+	Datum *sourceNodePortDatums = DeconstructArrayObject(sourceNodePortArray);
+
+	for (int sourceIndex = 0; sourceIndex < sourceCount; sourceIndex++)
+	{
+		AppendSource *appendSource = palloc0(sizeof(AppendSource));
+		appendSource->tableName = TextDatumGetCString(sourceTableNameDatums[sourceIndex]);
+		appendSource->nodeName = TextDatumGetCString(sourceNodeNameDatums[sourceIndex]);
+		appendSource->nodePort = DatumGetInt32(sourceNodePortDatums[sourceIndex]);
+
+		appendSourceList = lappend(appendSourceList, appendSource);
+	}
+
+	float4 shardFillLevel = AppendTablesToShard(shardId, appendSourceList);
+
+	PG_RETURN_FLOAT4(shardFillLevel);
+}
+
+
+/*
+ * AppendTablesToShard appends the contents of the given source tables to all
+ * placements of the given shard at the same time, updates the shard metadata,
+ * and returns the ratio of the new shard size to citus.shard_max_size.
+ */
+static float4
+AppendTablesToShard(uint64 shardId, List *appendSourceList)
+{
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
 
@@ -286,46 +395,217 @@ master_append_table_to_shard(PG_FUNCTION_ARGS)
 						errhint("Try running master_create_empty_shard() first")));
 	}
 
+	/*
+	 * If the shard already has min/max values, we extend them with the range
+	 * of the appended data instead of scanning the whole shard once the data
+	 * is appended. We get that range from the source tables while they are
+	 * being appended. Like the append itself, which reads the source tables
+	 * once for each placement, this assumes the source tables do not change
+	 * during the append.
+	 */
+	bool extendShardRange = partitionMethod == DISTRIBUTE_BY_APPEND &&
+							shardInterval->minValueExists &&
+							shardInterval->maxValueExists;
+	if (extendShardRange)
+	{
+		SendAppendedRangeQueries(relationId, appendSourceList);
+	}
+
 	UseCoordinatedTransaction();
 
-	/* issue command to append table to each shard placement */
+	StringInfo workerAppendQuery = makeStringInfo();
+	appendStringInfoString(workerAppendQuery, "SELECT ");
+
+	AppendSource *appendSource = NULL;
+	foreach_ptr(appendSource, appendSourceList)
+	{
+		if (appendSource != linitial(appendSourceList))
+		{
+			appendStringInfoString(workerAppendQuery, ", ");
+		}
+
+		appendStringInfo(workerAppendQuery, WORKER_APPEND_TABLE_TO_SHARD_CALL,
+						 quote_literal_cstr(shardQualifiedName),
+						 quote_literal_cstr(appendSource->tableName),
+						 quote_literal_cstr(appendSource->nodeName),
+						 appendSource->nodePort);
+	}
+
+	/* issue command to append the tables to all shard placements at once */
+	List *connectionList = NIL;
 	ShardPlacement *shardPlacement = NULL;
 	foreach_ptr(shardPlacement, shardPlacementList)
 	{
 		MultiConnection *connection = GetPlacementConnection(FOR_DML, shardPlacement,
 															 NULL);
-		PGresult *queryResult = NULL;
-
-		StringInfo workerAppendQuery = makeStringInfo();
-		appendStringInfo(workerAppendQuery, WORKER_APPEND_TABLE_TO_SHARD,
-						 quote_literal_cstr(shardQualifiedName),
-						 quote_literal_cstr(sourceTableName),
-						 quote_literal_cstr(sourceNodeName), sourceNodePort);
 
 		RemoteTransactionBeginIfNecessary(connection);
 
-		int executeResult = ExecuteOptionalRemoteCommand(connection,
-														 workerAppendQuery->data,
-														 &queryResult);
-		PQclear(queryResult);
-		ForgetResults(connection);
+		int querySent = SendRemoteCommand(connection, workerAppendQuery->data);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			MarkRemoteTransactionFailed(connection, false);
+			continue;
+		}
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		bool raiseInterrupts = true;
 
-		if (executeResult != 0)
+		PGresult *queryResult = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(queryResult))
 		{
+			ReportResultError(connection, queryResult, WARNING);
 			MarkRemoteTransactionFailed(connection, false);
 		}
+
+		PQclear(queryResult);
+		ForgetResults(connection);
 	}
 
 	MarkFailedShardPlacements();
 
 	/* update shard statistics and get new shard size */
-	uint64 newShardSize = UpdateShardStatistics(shardId);
+	uint64 newShardSize = 0;
+	text *minValue = NULL;
+	text *maxValue = NULL;
+
+	if (extendShardRange &&
+		ReceiveAppendedShardRange(shardInterval, appendSourceList, &minValue,
+								  &maxValue))
+	{
+		newShardSize = UpdateShardStatisticsWithRange(shardId, minValue, maxValue);
+	}
+	else
+	{
+		newShardSize = UpdateShardStatistics(shardId);
+	}
 
 	/* calculate ratio of current shard size compared to shard max size */
 	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
-	shardFillLevel = ((float4) newShardSize / (float4) shardMaxSizeInBytes);
+	float4 shardFillLevel = ((float4) newShardSize / (float4) shardMaxSizeInBytes);
 
-	PG_RETURN_FLOAT4(shardFillLevel);
+	return shardFillLevel;
+}
+
+
+/*
+ * SendAppendedRangeQueries sends a query for the minimum and maximum value of
+ * the partition column to each of the given source tables, over a separate
+ * connection such that they run while the tables are appended.
+ */
+static void
+SendAppendedRangeQueries(Oid relationId, List *appendSourceList)
+{
+	const uint32 unusedTableId = 1;
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	Var *partitionColumn = PartitionColumn(relationId, unusedTableId);
+	char *partitionColumnName = get_attname(relationId, partitionColumn->varattno,
+											false);
+	char *quotedColumnName = (char *) quote_identifier(partitionColumnName);
+
+	AppendSource *appendSource = NULL;
+	foreach_ptr(appendSource, appendSourceList)
+	{
+		StringInfo rangeQuery = makeStringInfo();
+		List *sourceNameList = stringToQualifiedNameList(appendSource->tableName);
+		char *sourceQualifiedName = NameListToQuotedString(sourceNameList);
+
+		appendStringInfo(rangeQuery, SHARD_RANGE_QUERY, quotedColumnName,
+						 quotedColumnName, sourceQualifiedName);
+
+		MultiConnection *connection = GetNodeConnection(connectionFlags,
+														appendSource->nodeName,
+														appendSource->nodePort);
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			SendRemoteCommand(connection, rangeQuery->data) == 0)
+		{
+			/* we fall back to scanning the shard */
+			CloseConnection(connection);
+			continue;
+		}
+
+		appendSource->rangeConnection = connection;
+	}
+}
+
+
+/*
+ * ReceiveAppendedShardRange extends the min/max values of the given shard with
+ * the results of the queries sent by SendAppendedRangeQueries and returns them
+ * in minValue and maxValue. It returns false if any of the queries failed.
+ */
+static bool
+ReceiveAppendedShardRange(ShardInterval *shardInterval, List *appendSourceList,
+						  text **minValue, text **maxValue)
+{
+	CitusTableCacheEntry *cacheEntry =
+		GetCitusTableCacheEntry(shardInterval->relationId);
+	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
+	Oid collation = cacheEntry->partitionColumn->varcollid;
+	Oid valueTypeId = shardInterval->valueTypeId;
+	Datum shardMinValue = shardInterval->minValue;
+	Datum shardMaxValue = shardInterval->maxValue;
+	bool rangeReceived = (compareFunction != NULL);
+
+	AppendSource *appendSource = NULL;
+	foreach_ptr(appendSource, appendSourceList)
+	{
+		MultiConnection *connection = appendSource->rangeConnection;
+		bool raiseInterrupts = true;
+
+		if (connection == NULL)
+		{
+			rangeReceived = false;
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result) || PQntuples(result) != 1)
+		{
+			rangeReceived = false;
+		}
+		else if (rangeReceived && !PQgetisnull(result, 0, 0) &&
+				 !PQgetisnull(result, 0, 1))
+		{
+			Datum sourceMinValue = StringToDatum(PQgetvalue(result, 0, 0), valueTypeId);
+			Datum sourceMaxValue = StringToDatum(PQgetvalue(result, 0, 1), valueTypeId);
+
+			if (DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+												sourceMinValue, shardMinValue)) < 0)
+			{
+				shardMinValue = sourceMinValue;
+			}
+
+			if (DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+												sourceMaxValue, shardMaxValue)) > 0)
+			{
+				shardMaxValue = sourceMaxValue;
+			}
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+		CloseConnection(connection);
+
+		appendSource->rangeConnection = NULL;
+	}
+
+	if (!rangeReceived)
+	{
+		return false;
+	}
+
+	*minValue = cstring_to_text(DatumToString(shardMinValue, valueTypeId));
+	*maxValue = cstring_to_text(DatumToString(shardMaxValue, valueTypeId));
+
+	return true;
 }
 
 
@@ -526,6 +806,17 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 		taskList = lappend(taskList, task);
 	}
 
+	/*
+	 * Without exclusive connections, the placements on a worker are created over
+	 * a single connection anyway, so we send the commands of several shards in
+	 * one task to avoid a round trip per shard. With exclusive connections, each
+	 * placement needs a task of its own to get its own connection.
+	 */
+	if (!useExclusiveConnection)
+	{
+		taskList = BatchShardCreationTasks(taskList, SHARD_CREATION_BATCH_SIZE);
+	}
+
 	if (useExclusiveConnection)
 	{
 		/*
@@ -553,6 +844,69 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 }
 
 
+/*
+ * BatchShardCreationTasks combines the given shard creation tasks, which each
+ * create one placement, into tasks that each create the placements of up to
+ * shardsPerBatch shards on the same node group. The commands of the combined
+ * tasks are kept in their original order.
+ */
+static List *
+BatchShardCreationTasks(List *taskList, int shardsPerBatch)
+{
+	List *batchTaskList = NIL;
+	List *openBatchList = NIL;
+	int taskId = 1;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+		ShardCreationBatch *batch = NULL;
+		ListCell *openBatchCell = NULL;
+
+		foreach(openBatchCell, openBatchList)
+		{
+			ShardCreationBatch *openBatch = lfirst(openBatchCell);
+			if (openBatch->groupId == taskPlacement->groupId)
+			{
+				batch = openBatch;
+				break;
+			}
+		}
+
+		if (batch == NULL || batch->shardCount >= shardsPerBatch)
+		{
+			if (batch == NULL)
+			{
+				batch = palloc0(sizeof(ShardCreationBatch));
+				batch->groupId = taskPlacement->groupId;
+				openBatchList = lappend(openBatchList, batch);
+			}
+
+			/* the task of the first shard in the batch becomes the batch's task */
+			task->taskId = taskId++;
+			batch->task = task;
+			batch->shardCount = 1;
+
+			batchTaskList = lappend(batchTaskList, task);
+			continue;
+		}
+
+		Task *batchTask = batch->task;
+		List *batchQueryStringList = batchTask->taskQuery.data.queryStringList;
+		List *queryStringList = task->taskQuery.data.queryStringList;
+
+		SetTaskQueryStringList(batchTask, list_concat(batchQueryStringList,
+													  queryStringList));
+		batchTask->relationShardList = list_concat(batchTask->relationShardList,
+												   task->relationShardList);
+		batch->shardCount++;
+	}
+
+	return batchTaskList;
+}
+
+
 /*
  * RelationShardListForShardCreate gets a shard interval and returns the placement
  * accesses that would happen when a placement of the shard interval is created.
@@ -756,6 +1110,35 @@ WorkerCreateShardCommandList(Oid relationId, int shardIndex, uint64 shardId,
  */
 uint64
 UpdateShardStatistics(int64 shardId)
+{
+	bool shardRangeKnown = false;
+
+	return UpdateShardStatisticsInternal(shardId, shardRangeKnown, NULL, NULL);
+}
+
+
+/*
+ * UpdateShardStatisticsWithRange updates the metadata of the given shard like
+ * UpdateShardStatistics, but sets its min/max values to the given ones instead
+ * of computing them on a shard placement.
+ */
+static uint64
+UpdateShardStatisticsWithRange(int64 shardId, text *minValue, text *maxValue)
+{
+	bool shardRangeKnown = true;
+
+	return UpdateShardStatisticsInternal(shardId, shardRangeKnown, minValue, maxValue);
+}
+
+
+/*
+ * UpdateShardStatisticsInternal updates the shard size and, unless
+ * shardRangeKnown is true, the shard min/max values of the given shard from a
+ * shard placement, and returns the updated shard size.
+ */
+static uint64
+UpdateShardStatisticsInternal(int64 shardId, bool shardRangeKnown,
+							  text *knownMinValue, text *knownMaxValue)
 {
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
@@ -782,13 +1165,20 @@ UpdateShardStatistics(int64 shardId)
 	foreach_ptr(placement, shardPlacementList)
 	{
 		statsOK = WorkerShardStats(placement, relationId, shardQualifiedName,
-								   &shardSize, &minValue, &maxValue);
+								   !shardRangeKnown, &shardSize, &minValue,
+								   &maxValue);
 		if (statsOK)
 		{
 			break;
 		}
 	}
 
+	if (shardRangeKnown)
+	{
+		minValue = knownMinValue;
+		maxValue = knownMaxValue;
+	}
+
 	/*
 	 * If for some reason we appended data to a shard, but failed to retrieve
 	 * statistics we just WARN here to avoid losing shard-state updates. Note
@@ -839,10 +1229,12 @@ UpdateShardStatistics(int64 shardId)
 /*
  * WorkerShardStats queries the worker node, and retrieves shard statistics that
  * we assume have changed after new table data have been appended to the shard.
+ * The shard min/max values are only retrieved if fetchShardRange is true.
  */
 static bool
 WorkerShardStats(ShardPlacement *placement, Oid relationId, const char *shardName,
-				 uint64 *shardSize, text **shardMinValue, text **shardMaxValue)
+				 bool fetchShardRange, uint64 *shardSize, text **shardMinValue,
+				 text **shardMaxValue)
 {
 	StringInfo tableSizeQuery = makeStringInfo();
 
@@ -906,7 +1298,7 @@ WorkerShardStats(ShardPlacement *placement, Oid relationId, const char *shardNam
 	PQclear(queryResult);
 	ForgetResults(connection);
 
-	if (partitionType != DISTRIBUTE_BY_APPEND)
+	if (partitionType != DISTRIBUTE_BY_APPEND || !fetchShardRange)
 	{
 		/* we don't need min/max for non-append distributed tables */
 		return true;
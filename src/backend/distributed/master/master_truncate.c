@@ -98,6 +98,10 @@ citus_truncate_trigger(PG_FUNCTION_ARGS)
  * distributed table. This is handled separately from other DDL commands
  * because we handle it via the TRUNCATE trigger, which is called whenever
  * a truncate cascades.
+ *
+ * As in DDLTaskList, when citus.shard_ddl_batch_size is larger than 1, shards
+ * whose placements live on the same set of nodes are truncated by a single
+ * TRUNCATE command of up to that many shards.
  */
 static List *
 TruncateTaskList(Oid relationId)
@@ -105,6 +109,10 @@ TruncateTaskList(Oid relationId)
 	/* resulting task list */
 	List *taskList = NIL;
 
+	/* tasks that still accept shards, along with the nodes of their placements */
+	List *openTaskList = NIL;
+	List *openTaskKeyList = NIL;
+
 	/* enumerate the tasks when putting them to the taskList */
 	int taskId = 1;
 
@@ -121,29 +129,95 @@ TruncateTaskList(Oid relationId)
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
 		uint64 shardId = shardInterval->shardId;
-		char *shardRelationName = pstrdup(relationName);
-
-		/* build shard relation name */
-		AppendShardIdToName(&shardRelationName, shardId);
+		List *placementList = ActiveShardPlacementList(shardId);
 
-		char *quotedShardName = quote_qualified_identifier(schemaName, shardRelationName);
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = relationId;
+		relationShard->shardId = shardId;
 
-		StringInfo shardQueryString = makeStringInfo();
-		appendStringInfo(shardQueryString, "TRUNCATE TABLE %s CASCADE", quotedShardName);
+		char *placementListKey = NULL;
+		if (ShardDDLBatchSize > 1)
+		{
+			ListCell *openTaskCell = NULL;
+			ListCell *openTaskKeyCell = NULL;
+			Task *openTask = NULL;
+
+			placementListKey = ShardPlacementListKey(placementList);
+
+			forboth(openTaskCell, openTaskList, openTaskKeyCell, openTaskKeyList)
+			{
+				if (strcmp((char *) lfirst(openTaskKeyCell), placementListKey) == 0)
+				{
+					openTask = (Task *) lfirst(openTaskCell);
+					break;
+				}
+			}
+
+			if (openTask != NULL)
+			{
+				openTask->relationShardList =
+					lappend(openTask->relationShardList, relationShard);
+
+				if (list_length(openTask->relationShardList) >= ShardDDLBatchSize)
+				{
+					openTaskList = list_delete_ptr(openTaskList, openTask);
+					openTaskKeyList = list_delete_ptr(openTaskKeyList,
+													  lfirst(openTaskKeyCell));
+				}
+
+				continue;
+			}
+		}
 
 		Task *task = CitusMakeNode(Task);
 		task->jobId = INVALID_JOB_ID;
 		task->taskId = taskId++;
 		task->taskType = DDL_TASK;
-		SetTaskQueryString(task, shardQueryString->data);
 		task->dependentTaskList = NULL;
 		task->replicationModel = REPLICATION_MODEL_INVALID;
 		task->anchorShardId = shardId;
-		task->taskPlacementList = ActiveShardPlacementList(shardId);
+		task->relationShardList = list_make1(relationShard);
+		task->taskPlacementList = placementList;
+
+		if (placementListKey != NULL)
+		{
+			openTaskList = lappend(openTaskList, task);
+			openTaskKeyList = lappend(openTaskKeyList, placementListKey);
+		}
 
 		taskList = lappend(taskList, task);
 	}
 
+	/* now that the shards of each task are known, build the TRUNCATE commands */
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		StringInfo shardQueryString = makeStringInfo();
+		appendStringInfoString(shardQueryString, "TRUNCATE TABLE ");
+
+		RelationShard *relationShard = NULL;
+		foreach_ptr(relationShard, task->relationShardList)
+		{
+			char *shardRelationName = pstrdup(relationName);
+
+			/* build shard relation name */
+			AppendShardIdToName(&shardRelationName, relationShard->shardId);
+
+			if (relationShard != linitial(task->relationShardList))
+			{
+				appendStringInfoString(shardQueryString, ", ");
+			}
+
+			appendStringInfoString(shardQueryString,
+								   quote_qualified_identifier(schemaName,
+															  shardRelationName));
+		}
+
+		appendStringInfoString(shardQueryString, " CASCADE");
+
+		SetTaskQueryString(task, shardQueryString->data);
+	}
+
 	return taskList;
 }
 
@@ -199,6 +273,7 @@ EnsureLocalTableCanBeTruncated(Oid relationId)
 	}
 
 	/* make sure there are no foreign key references from a local table */
+	InvalidateSharedForeignConstraintRelationshipGraph();
 	SetForeignConstraintRelationshipGraphInvalid();
 	List *referencingRelationList = ReferencingRelationIdList(relationId);
 
@@ -0,0 +1,584 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_logical_replication.c
+ *
+ * This file contains functions to transfer shards between nodes using
+ * logical replication. The shards are first copied and kept up to date
+ * through a subscription on the target node while writes to them continue,
+ * writes are only blocked for the short time it takes the target node to
+ * apply the last changes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "libpq-fe.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "catalog/pg_class.h"
+#include "commands/dbcommands.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_logical_replication.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/reference_table_utils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/resource_lock.h"
+#include "distributed/worker_transaction.h"
+#include "lib/stringinfo.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+
+/* time to wait between checks of the state of a subscription */
+#define SUBSCRIPTION_POLL_INTERVAL_MS 1000
+
+
+static bool RelationCanPublishAllModifications(Oid relationId);
+static bool LogicalReplicationEnabledOnNode(char *nodeName, int32 nodePort);
+static void CreateShardMoveTables(List *shardIntervalList, char *targetNodeName,
+								  int32 targetNodePort);
+static char * CreateShardMovePublicationCommand(char *publicationName,
+												List *shardIntervalList);
+static char * CreateShardMoveSubscriptionCommand(char *subscriptionName,
+												 char *publicationName,
+												 char *sourceNodeName,
+												 int32 sourceNodePort,
+												 char *userName);
+static void WaitForShardMoveInitialCopy(MultiConnection *targetConnection,
+										char *subscriptionName);
+static void WaitForShardMoveCatchUp(MultiConnection *sourceConnection,
+									MultiConnection *targetConnection,
+									char *subscriptionName);
+static void WaitForRemoteCondition(MultiConnection *connection, char *query);
+static char * ExecuteRemoteQueryReturningValue(MultiConnection *connection,
+											   char *query);
+static MultiConnection * GetShardMoveConnection(char *nodeName, int32 nodePort);
+static void DropShardMoveReplication(char *sourceNodeName, int32 sourceNodePort,
+									 char *targetNodeName, int32 targetNodePort,
+									 char *publicationName, char *subscriptionName,
+									 bool raiseErrors);
+
+
+/*
+ * ShouldUseLogicalReplication returns whether the given colocated shards are
+ * transferred using logical replication. That is the case in the auto and
+ * force_logical transfer modes, when all modifications of the shards can be
+ * replicated and the source node has wal_level = logical. In force_logical
+ * mode we error out when that is not the case, in auto mode we fall back to
+ * blocking writes during the transfer.
+ */
+bool
+ShouldUseLogicalReplication(List *shardIntervalList, char shardReplicationMode,
+							char *sourceNodeName, int32 sourceNodePort)
+{
+	bool forceLogical = (shardReplicationMode == TRANSFER_MODE_FORCE_LOGICAL);
+
+	if (shardReplicationMode == TRANSFER_MODE_BLOCK_WRITES)
+	{
+		return false;
+	}
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		Oid relationId = shardInterval->relationId;
+		char *relationName = get_rel_name(relationId);
+
+		if (IsReferenceTable(relationId) ||
+			get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+		{
+			if (forceLogical)
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("cannot use logical replication to transfer "
+									   "shards of the relation %s", relationName),
+								errdetail("Only shards of regular distributed tables "
+										  "can be replicated logically.")));
+			}
+
+			return false;
+		}
+
+		if (!RelationCanPublishAllModifications(relationId))
+		{
+			if (forceLogical)
+			{
+				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+								errmsg("cannot use logical replication to transfer "
+									   "shards of the relation %s since it doesn't "
+									   "have a REPLICA IDENTITY or PRIMARY KEY",
+									   relationName),
+								errdetail("UPDATE and DELETE commands on the shard "
+										  "will error out during logical replication "
+										  "unless there is a REPLICA IDENTITY or "
+										  "PRIMARY KEY."),
+								errhint("If you wish to continue without a replica "
+										"identity set the shard_transfer_mode to "
+										"'block_writes'.")));
+			}
+
+			return false;
+		}
+	}
+
+	if (!LogicalReplicationEnabledOnNode(sourceNodeName, sourceNodePort))
+	{
+		if (forceLogical)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot use logical replication to transfer shards "
+								   "from %s:%d", sourceNodeName, sourceNodePort),
+							errdetail("wal_level on the node is not logical."),
+							errhint("If you wish to continue without logical "
+									"replication set the shard_transfer_mode to "
+									"'block_writes'.")));
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * RelationCanPublishAllModifications returns whether updates and deletes on
+ * the given relation can be replicated logically, which requires a replica
+ * identity. Partitioned tables hold no data themselves, only their partitions
+ * are replicated.
+ */
+static bool
+RelationCanPublishAllModifications(Oid relationId)
+{
+	if (PartitionedTable(relationId))
+	{
+		return true;
+	}
+
+	Relation relation = RelationIdGetRelation(relationId);
+	bool canPublish = relation->rd_rel->relreplident == REPLICA_IDENTITY_FULL ||
+					  OidIsValid(RelationGetReplicaIndex(relation));
+	RelationClose(relation);
+
+	return canPublish;
+}
+
+
+/*
+ * LogicalReplicationEnabledOnNode returns whether the given node has
+ * wal_level = logical, which is needed to publish changes.
+ */
+static bool
+LogicalReplicationEnabledOnNode(char *nodeName, int32 nodePort)
+{
+	MultiConnection *connection = GetNodeConnection(0, nodeName, nodePort);
+	char *walLevel = ExecuteRemoteQueryReturningValue(connection, "SHOW wal_level");
+
+	return walLevel != NULL && strcmp(walLevel, "logical") == 0;
+}
+
+
+/*
+ * LockShardListForLogicalReplication takes the locks that are held while the
+ * given colocated shards are replicated logically. Unlike BlockWritesToShardList
+ * these do not conflict with writes to the shards, but they do conflict with
+ * other transfers of the shards and with DDL on their tables.
+ */
+void
+LockShardListForLogicalReplication(List *shardIntervalList)
+{
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		/* RowExclusiveLock conflicts with DDL, but not with writes */
+		LockRelationOid(shardInterval->relationId, RowExclusiveLock);
+
+		/* only one logical transfer of a shard can run at a time */
+		LockShardMove(shardInterval->shardId, ExclusiveLock);
+
+		/* conflicts with transfers that block writes */
+		LockShardDistributionMetadata(shardInterval->shardId, RowShareLock);
+	}
+}
+
+
+/*
+ * LogicallyReplicateShards replicates the given colocated shards from the
+ * source node to the target node. It creates the shards on the target node,
+ * publishes them on the source node and subscribes to that publication on the
+ * target node. The subscription copies the existing data of the shards, in
+ * parallel for up to max_sync_workers_per_subscription shards, and then
+ * applies the changes made since.
+ *
+ * Writes to the shards continue until the subscription is close to caught up.
+ * Then writes are blocked until the end of the transaction, the last changes
+ * are applied and the subscription is dropped. Callers are expected to update
+ * the metadata in the same transaction, such that writes continue on the new
+ * placements.
+ */
+void
+LogicallyReplicateShards(List *shardIntervalList, char *sourceNodeName,
+						 int32 sourceNodePort, char *targetNodeName,
+						 int32 targetNodePort)
+{
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(shardIntervalList);
+	uint64 firstShardId = firstShardInterval->shardId;
+	bool raiseErrors = true;
+
+	char *publicationName = psprintf(SHARD_MOVE_PUBLICATION_PREFIX UINT64_FORMAT,
+									 firstShardId);
+	char *subscriptionName = psprintf(SHARD_MOVE_SUBSCRIPTION_PREFIX UINT64_FORMAT,
+									  firstShardId);
+
+	/* clean up after an earlier transfer of the shards that failed */
+	DropShardMoveReplication(sourceNodeName, sourceNodePort, targetNodeName,
+							 targetNodePort, publicationName, subscriptionName,
+							 raiseErrors);
+
+	CreateShardMoveTables(shardIntervalList, targetNodeName, targetNodePort);
+
+	MultiConnection *sourceConnection = GetShardMoveConnection(sourceNodeName,
+															   sourceNodePort);
+	MultiConnection *targetConnection = GetShardMoveConnection(targetNodeName,
+															   targetNodePort);
+
+	PG_TRY();
+	{
+		ExecuteCriticalRemoteCommand(sourceConnection,
+									 CreateShardMovePublicationCommand(
+										 publicationName, shardIntervalList));
+		ExecuteCriticalRemoteCommand(targetConnection,
+									 CreateShardMoveSubscriptionCommand(
+										 subscriptionName, publicationName,
+										 sourceNodeName, sourceNodePort,
+										 CitusExtensionOwnerName()));
+
+		/* copy the data and catch up on most changes while writes continue */
+		WaitForShardMoveInitialCopy(targetConnection, subscriptionName);
+		WaitForShardMoveCatchUp(sourceConnection, targetConnection, subscriptionName);
+
+		/* block writes until the metadata points to the new placements */
+		BlockWritesToShardList(shardIntervalList);
+
+		WaitForShardMoveCatchUp(sourceConnection, targetConnection, subscriptionName);
+	}
+	PG_CATCH();
+	{
+		/* do not leave a replication slot behind that retains WAL on the source */
+		DropShardMoveReplication(sourceNodeName, sourceNodePort, targetNodeName,
+								 targetNodePort, publicationName, subscriptionName,
+								 !raiseErrors);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	CloseConnection(sourceConnection);
+	CloseConnection(targetConnection);
+
+	DropShardMoveReplication(sourceNodeName, sourceNodePort, targetNodeName,
+							 targetNodePort, publicationName, subscriptionName,
+							 raiseErrors);
+
+	CopyShardRelationships(shardIntervalList, targetNodeName, targetNodePort);
+}
+
+
+/*
+ * CreateShardMoveTables creates the given shards on the target node, along
+ * with their indexes and replica identity, which the subscription needs to
+ * apply updates and deletes. Relationships between the shards are created
+ * once the replication is done.
+ */
+static void
+CreateShardMoveTables(List *shardIntervalList, char *targetNodeName,
+					  int32 targetNodePort)
+{
+	bool includeDataCopy = false;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		Oid relationId = shardInterval->relationId;
+		char *tableOwner = TableOwner(relationId);
+
+		List *commandList = CopyShardCommandList(shardInterval, NULL, 0,
+												 includeDataCopy);
+
+		char *replicaIdentityCommand = pg_get_replica_identity_command(relationId);
+		if (replicaIdentityCommand != NULL)
+		{
+			List *replicaIdentityCommandList =
+				WorkerApplyShardDDLCommandList(list_make1(replicaIdentityCommand),
+											   shardInterval->shardId);
+
+			commandList = list_concat(commandList, replicaIdentityCommandList);
+		}
+
+		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+												   tableOwner, commandList);
+	}
+}
+
+
+/*
+ * CreateShardMovePublicationCommand returns the command that publishes the
+ * given shards. Partitioned tables cannot be published, their partitions are
+ * published instead.
+ */
+static char *
+CreateShardMovePublicationCommand(char *publicationName, List *shardIntervalList)
+{
+	StringInfo command = makeStringInfo();
+	bool addedTable = false;
+
+	appendStringInfo(command, "CREATE PUBLICATION %s",
+					 quote_identifier(publicationName));
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		if (PartitionedTable(shardInterval->relationId))
+		{
+			continue;
+		}
+
+		appendStringInfoString(command, addedTable ? ", " : " FOR TABLE ");
+		appendStringInfoString(command, ConstructQualifiedShardName(shardInterval));
+
+		addedTable = true;
+	}
+
+	return command->data;
+}
+
+
+/*
+ * CreateShardMoveSubscriptionCommand returns the command that subscribes the
+ * target node to the publication on the source node.
+ */
+static char *
+CreateShardMoveSubscriptionCommand(char *subscriptionName, char *publicationName,
+								   char *sourceNodeName, int32 sourceNodePort,
+								   char *userName)
+{
+	StringInfo connectionString = makeStringInfo();
+	StringInfo command = makeStringInfo();
+
+	appendStringInfo(connectionString, "host=%s port=%d user=%s dbname=%s",
+					 quote_literal_cstr(sourceNodeName), sourceNodePort,
+					 quote_literal_cstr(userName),
+					 quote_literal_cstr(get_database_name(MyDatabaseId)));
+
+	if (NodeConninfo != NULL && NodeConninfo[0] != '\0')
+	{
+		appendStringInfo(connectionString, " %s", NodeConninfo);
+	}
+
+	appendStringInfo(command, "CREATE SUBSCRIPTION %s CONNECTION %s PUBLICATION %s",
+					 quote_identifier(subscriptionName),
+					 quote_literal_cstr(connectionString->data),
+					 quote_identifier(publicationName));
+
+	return command->data;
+}
+
+
+/*
+ * WaitForShardMoveInitialCopy waits until the subscription has copied the
+ * existing data of all shards.
+ */
+static void
+WaitForShardMoveInitialCopy(MultiConnection *targetConnection, char *subscriptionName)
+{
+	StringInfo query = makeStringInfo();
+
+	appendStringInfo(query,
+					 "SELECT count(*) = 0 "
+					 "FROM pg_catalog.pg_subscription_rel r "
+					 "JOIN pg_catalog.pg_subscription s ON (r.srsubid = s.oid) "
+					 "WHERE s.subname = %s AND r.srsubstate <> 'r'",
+					 quote_literal_cstr(subscriptionName));
+
+	WaitForRemoteCondition(targetConnection, query->data);
+}
+
+
+/*
+ * WaitForShardMoveCatchUp waits until the subscription has applied all changes
+ * that were made on the source node before this function was called.
+ */
+static void
+WaitForShardMoveCatchUp(MultiConnection *sourceConnection,
+						MultiConnection *targetConnection, char *subscriptionName)
+{
+	StringInfo query = makeStringInfo();
+
+	char *sourcePosition =
+		ExecuteRemoteQueryReturningValue(sourceConnection,
+										 "SELECT pg_catalog.pg_current_wal_lsn()");
+
+	appendStringInfo(query,
+					 "SELECT coalesce(bool_and(latest_end_lsn >= %s::pg_lsn), false) "
+					 "FROM pg_catalog.pg_stat_subscription "
+					 "WHERE subname = %s AND relid IS NULL",
+					 quote_literal_cstr(sourcePosition),
+					 quote_literal_cstr(subscriptionName));
+
+	WaitForRemoteCondition(targetConnection, query->data);
+}
+
+
+/*
+ * WaitForRemoteCondition runs the given query, which returns a boolean, on
+ * the connection until it returns true.
+ */
+static void
+WaitForRemoteCondition(MultiConnection *connection, char *query)
+{
+	while (true)
+	{
+		char *value = ExecuteRemoteQueryReturningValue(connection, query);
+		if (value != NULL && strcmp(value, "t") == 0)
+		{
+			break;
+		}
+
+		int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   SUBSCRIPTION_POLL_INTERVAL_MS, PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * ExecuteRemoteQueryReturningValue runs the given query on the connection and
+ * returns the first value of its result, or NULL if there is none.
+ */
+static char *
+ExecuteRemoteQueryReturningValue(MultiConnection *connection, char *query)
+{
+	bool raiseInterrupts = true;
+	char *value = NULL;
+
+	if (!SendRemoteCommand(connection, query))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	if (PQntuples(result) > 0 && !PQgetisnull(result, 0, 0))
+	{
+		value = pstrdup(PQgetvalue(result, 0, 0));
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return value;
+}
+
+
+/*
+ * GetShardMoveConnection opens a new connection to the given node as the
+ * extension owner, since creating publications and subscriptions requires
+ * superuser privileges. Commands on it run outside the distributed
+ * transaction, as CREATE SUBSCRIPTION and DROP SUBSCRIPTION cannot run in a
+ * transaction block.
+ */
+static MultiConnection *
+GetShardMoveConnection(char *nodeName, int32 nodePort)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION | OUTSIDE_TRANSACTION;
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, nodeName, nodePort,
+									  CitusExtensionOwnerName(), NULL);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	return connection;
+}
+
+
+/*
+ * DropShardMoveReplication drops the subscription and the publication of a
+ * logical transfer of shards, if they exist. Dropping the subscription also
+ * drops its replication slot on the source node. When raiseErrors is false,
+ * failures are reported as warnings, which is used to clean up after an error.
+ */
+static void
+DropShardMoveReplication(char *sourceNodeName, int32 sourceNodePort,
+						 char *targetNodeName, int32 targetNodePort,
+						 char *publicationName, char *subscriptionName,
+						 bool raiseErrors)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION | OUTSIDE_TRANSACTION;
+	char *userName = CitusExtensionOwnerName();
+	PGresult *result = NULL;
+
+	char *dropSubscriptionCommand = psprintf("DROP SUBSCRIPTION IF EXISTS %s",
+											 quote_identifier(subscriptionName));
+	char *dropPublicationCommand = psprintf("DROP PUBLICATION IF EXISTS %s",
+											quote_identifier(publicationName));
+
+	MultiConnection *targetConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, targetNodeName, targetNodePort,
+									  userName, NULL);
+	MultiConnection *sourceConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, sourceNodeName, sourceNodePort,
+									  userName, NULL);
+
+	if (raiseErrors)
+	{
+		ExecuteCriticalRemoteCommand(targetConnection, dropSubscriptionCommand);
+		ExecuteCriticalRemoteCommand(sourceConnection, dropPublicationCommand);
+	}
+	else
+	{
+		if (ExecuteOptionalRemoteCommand(targetConnection, dropSubscriptionCommand,
+										 &result) == 0)
+		{
+			PQclear(result);
+			ForgetResults(targetConnection);
+		}
+
+		if (ExecuteOptionalRemoteCommand(sourceConnection, dropPublicationCommand,
+										 &result) == 0)
+		{
+			PQclear(result);
+			ForgetResults(sourceConnection);
+		}
+	}
+
+	CloseConnection(targetConnection);
+	CloseConnection(sourceConnection);
+}
@@ -13,30 +13,1455 @@
 
 #include "postgres.h"
 
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "access/genam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_proc.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/colocation_utils.h"
+#include "distributed/connection_management.h"
 #include "distributed/enterprise.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_progress.h"
+#include "distributed/pg_dist_rebalance_strategy.h"
+#include "distributed/remote_commands.h"
+#include "distributed/resource_lock.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/task_tracker.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_protocol.h"
+#include "lib/stringinfo.h"
+#include "postmaster/postmaster.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
+/* magic number identifying rebalance progress monitors */
+#define REBALANCE_PROGRESS_MAGIC_NUMBER 0x52454241
+
+/* default for the max_shard_moves argument of the rebalance functions */
+#define DEFAULT_MAX_SHARD_MOVES 1000000
+
+/*
+ * RebalanceOptions holds the arguments of a rebalance, shared by the
+ * functions that plan it.
+ */
+typedef struct RebalanceOptions
+{
+	List *relationIdList;
+	float4 threshold;
+	int32 maxShardMoves;
+	ArrayType *excludedShardArray;
+	bool drainOnly;
+	Form_pg_dist_rebalance_strategy rebalanceStrategy;
+
+	/* when set, only shards on this node are moved (by master_drain_node) */
+	WorkerNode *drainNode;
+} RebalanceOptions;
+
+/*
+ * ShardCost describes a shard group, represented by one of its shards, as
+ * seen by the rebalance strategy. The same ShardCost is in the shardCostList
+ * of every node that has a placement of the shard.
+ */
+typedef struct ShardCost
+{
+	uint64 shardId;
+	uint64 shardSize;
+	float4 cost;
+
+	/* whether any shard in the group is in the excluded shard list */
+	bool excluded;
+
+	/* whether the shard is allowed on a node, indexed by NodeFillState index */
+	bool *allowedOnNode;
+} ShardCost;
+
+/*
+ * NodeFillState tracks how full a node is, while moves are planned.
+ */
+typedef struct NodeFillState
+{
+	WorkerNode *node;
+	int index;
+	float4 capacity;
+	float4 totalCost;
+	float4 utilization;
+	List *shardCostList;
+} NodeFillState;
+
+/*
+ * PlacementMove is a planned move of a shard group from one node to another.
+ */
+typedef struct PlacementMove
+{
+	Oid relationId;
+	uint64 shardId;
+	uint64 shardSize;
+	WorkerNode *sourceNode;
+	WorkerNode *targetNode;
+} PlacementMove;
+
+/*
+ * RebalanceMoveStatus is shown as the progress column of
+ * get_rebalance_progress().
+ */
+typedef enum RebalanceMoveStatus
+{
+	REBALANCE_MOVE_WAITING = 0,
+	REBALANCE_MOVE_MOVING = 1,
+	REBALANCE_MOVE_DONE = 2
+} RebalanceMoveStatus;
+
+/*
+ * RebalanceMoveProgress is a progress monitor step that describes a single
+ * move of a rebalance.
+ */
+typedef struct RebalanceMoveProgress
+{
+	uint64 shardId;
+	Oid relationId;
+	uint64 shardSize;
+	char sourceNodeName[MAX_NODE_LENGTH + 1];
+	int32 sourceNodePort;
+	char targetNodeName[MAX_NODE_LENGTH + 1];
+	int32 targetNodePort;
+	RebalanceMoveStatus status;
+} RebalanceMoveProgress;
+
+/*
+ * RunningMove pairs a move that was sent to a local backend with the
+ * connection it runs over.
+ */
+typedef struct RunningMove
+{
+	PlacementMove *move;
+	RebalanceMoveProgress *progress;
+	MultiConnection *connection;
+} RunningMove;
+
+
+/* GUC, maximum number of shard moves that a rebalance runs at the same time */
+int MaxParallelShardMoves = 4;
 
+
+static Form_pg_dist_rebalance_strategy GetRebalanceStrategy(Name strategyName);
+static float4 RebalanceThreshold(Form_pg_dist_rebalance_strategy strategy,
+								 bool thresholdIsNull, float4 threshold);
+static List * RebalanceRelationIdList(Oid relationId);
+static List * RebalancePlacementMoves(RebalanceOptions *options);
+static List * ColocationGroupPlacementMoves(Oid relationId, List *workerNodeList,
+											RebalanceOptions *options,
+											int maxMoveCount);
+static List * NodeFillStateList(List *workerNodeList,
+								Form_pg_dist_rebalance_strategy strategy);
+static NodeFillState * FindFillStateForGroup(List *fillStateList, int32 groupId);
+static float4 * NodeSizeUtilization(List *fillStateList);
+static bool ShardGroupExcluded(ShardInterval *shardInterval,
+							   ArrayType *excludedShardArray);
+static PlacementMove * NextDrainMove(List *fillStateList, RebalanceOptions *options);
+static PlacementMove * NextBalanceMove(List *fillStateList, RebalanceOptions *options);
+static float4 AverageUtilization(List *fillStateList);
+static int CompareFillStatesByUtilization(const void *leftElement,
+										  const void *rightElement);
+static PlacementMove * ApplyPlacementMove(Oid relationId, NodeFillState *source,
+										  NodeFillState *target, ShardCost *shardCost);
+static void ExecutePlacementMoveList(List *moveList, char *shardTransferModeLabel);
+static RunningMove * StartPlacementMove(PlacementMove *move,
+										RebalanceMoveProgress *progress,
+										char *shardTransferModeLabel);
+static void RebalanceTableShards(RebalanceOptions *options,
+								 char *shardTransferModeLabel);
+static bool CachedShardGroupSize(List *shardIntervalList, int32 groupId,
+								 uint64 *shardGroupSize);
+static char * ShardTransferModeLabel(FunctionCallInfo fcinfo, int argumentIndex);
 static void EnsureShardCostUDF(Oid functionOid);
 static void EnsureNodeCapacityUDF(Oid functionOid);
 static void EnsureShardAllowedOnNodeUDF(Oid functionOid);
 
-NOT_SUPPORTED_IN_COMMUNITY(rebalance_table_shards);
 NOT_SUPPORTED_IN_COMMUNITY(replicate_table_shards);
-NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_table_shards_plan);
-NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_progress);
-NOT_SUPPORTED_IN_COMMUNITY(master_drain_node);
-NOT_SUPPORTED_IN_COMMUNITY(citus_shard_cost_by_disk_size);
+PG_FUNCTION_INFO_V1(rebalance_table_shards);
+PG_FUNCTION_INFO_V1(get_rebalance_table_shards_plan);
+PG_FUNCTION_INFO_V1(get_rebalance_progress);
+PG_FUNCTION_INFO_V1(master_drain_node);
+PG_FUNCTION_INFO_V1(citus_shard_cost_by_disk_size);
 PG_FUNCTION_INFO_V1(pg_dist_rebalance_strategy_enterprise_check);
 PG_FUNCTION_INFO_V1(citus_validate_rebalance_strategy_functions);
 
 
 /*
- * citus_rebalance_strategy_enterprise_check is trigger function, intended for
- * use in prohibiting writes to pg_dist_rebalance_strategy in Citus Community.
+ * rebalance_table_shards moves shard groups between the worker nodes until
+ * the utilization of every node, as defined by the rebalance strategy, is
+ * within the threshold of the average. Nodes that should not have shards
+ * are drained first.
+ *
+ * SQL signature:
+ *
+ * rebalance_table_shards(
+ *     relation regclass,
+ *     threshold float4,
+ *     max_shard_moves int,
+ *     excluded_shard_list bigint[],
+ *     shard_transfer_mode citus.shard_transfer_mode,
+ *     drain_only boolean,
+ *     rebalance_strategy name
+ * ) RETURNS VOID
+ */
+Datum
+rebalance_table_shards(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	/* the moves commit on their own and cannot be rolled back with the caller */
+	PreventInTransactionBlock(true, "rebalance_table_shards");
+
+	Form_pg_dist_rebalance_strategy strategy =
+		GetRebalanceStrategy(PG_ARGISNULL(6) ? NULL : PG_GETARG_NAME(6));
+
+	RebalanceOptions options;
+	memset(&options, 0, sizeof(options));
+
+	options.relationIdList = RebalanceRelationIdList(PG_ARGISNULL(0) ? InvalidOid :
+													 PG_GETARG_OID(0));
+	options.threshold = RebalanceThreshold(strategy, PG_ARGISNULL(1),
+										   PG_ARGISNULL(1) ? 0 : PG_GETARG_FLOAT4(1));
+	options.maxShardMoves = PG_ARGISNULL(2) ? DEFAULT_MAX_SHARD_MOVES :
+							PG_GETARG_INT32(2);
+	options.excludedShardArray = PG_ARGISNULL(3) ? NULL : PG_GETARG_ARRAYTYPE_P(3);
+	options.drainOnly = PG_ARGISNULL(5) ? false : PG_GETARG_BOOL(5);
+	options.rebalanceStrategy = strategy;
+
+	RebalanceTableShards(&options, ShardTransferModeLabel(fcinfo, 4));
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * get_rebalance_table_shards_plan returns the moves that rebalance_table_shards
+ * would do when called with the same arguments, without doing them.
+ */
+Datum
+get_rebalance_table_shards_plan(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	Form_pg_dist_rebalance_strategy strategy =
+		GetRebalanceStrategy(PG_ARGISNULL(5) ? NULL : PG_GETARG_NAME(5));
+
+	RebalanceOptions options;
+	memset(&options, 0, sizeof(options));
+
+	options.relationIdList = RebalanceRelationIdList(PG_ARGISNULL(0) ? InvalidOid :
+													 PG_GETARG_OID(0));
+	options.threshold = RebalanceThreshold(strategy, PG_ARGISNULL(1),
+										   PG_ARGISNULL(1) ? 0 : PG_GETARG_FLOAT4(1));
+	options.maxShardMoves = PG_ARGISNULL(2) ? DEFAULT_MAX_SHARD_MOVES :
+							PG_GETARG_INT32(2);
+	options.excludedShardArray = PG_ARGISNULL(3) ? NULL : PG_GETARG_ARRAYTYPE_P(3);
+	options.drainOnly = PG_ARGISNULL(4) ? false : PG_GETARG_BOOL(4);
+	options.rebalanceStrategy = strategy;
+
+	List *moveList = RebalancePlacementMoves(&options);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	PlacementMove *move = NULL;
+	foreach_ptr(move, moveList)
+	{
+		Datum values[7];
+		bool isNulls[7];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = ObjectIdGetDatum(move->relationId);
+		values[1] = Int64GetDatum(move->shardId);
+		values[2] = Int64GetDatum(move->shardSize);
+		values[3] = CStringGetTextDatum(move->sourceNode->workerName);
+		values[4] = Int32GetDatum(move->sourceNode->workerPort);
+		values[5] = CStringGetTextDatum(move->targetNode->workerName);
+		values[6] = Int32GetDatum(move->targetNode->workerPort);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * get_rebalance_progress returns a row for each move of the rebalances that
+ * are running in any backend, with the status of the move as progress:
+ * 0 when it is waiting, 1 while it is moving and 2 once it is done.
+ */
+Datum
+get_rebalance_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegments = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	List *monitorList = ProgressMonitorList(REBALANCE_PROGRESS_MAGIC_NUMBER,
+											&attachedDSMSegments);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		RebalanceMoveProgress *steps = (RebalanceMoveProgress *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			RebalanceMoveProgress *progress = &steps[stepIndex];
+			Datum values[9];
+			bool isNulls[9];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = ObjectIdGetDatum(progress->relationId);
+			values[2] = Int64GetDatum(progress->shardId);
+			values[3] = Int64GetDatum(progress->shardSize);
+			values[4] = CStringGetTextDatum(progress->sourceNodeName);
+			values[5] = Int32GetDatum(progress->sourceNodePort);
+			values[6] = CStringGetTextDatum(progress->targetNodeName);
+			values[7] = Int32GetDatum(progress->targetNodePort);
+			values[8] = Int64GetDatum(progress->status);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegments);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * master_drain_node marks the given node as one that should not have shards
+ * and then moves all shards of the node to the other nodes.
+ *
+ * SQL signature:
+ *
+ * master_drain_node(
+ *     nodename text,
+ *     nodeport int,
+ *     shard_transfer_mode citus.shard_transfer_mode,
+ *     rebalance_strategy name
+ * ) RETURNS VOID
+ */
+Datum
+master_drain_node(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	/* the moves commit on their own and cannot be rolled back with the caller */
+	PreventInTransactionBlock(true, "master_drain_node");
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+	{
+		ereport(ERROR, (errmsg("nodename and nodeport cannot be NULL")));
+	}
+
+	char *nodeName = text_to_cstring(PG_GETARG_TEXT_P(0));
+	int32 nodePort = PG_GETARG_INT32(1);
+	WorkerNode *workerNode = ForceFindWorkerNode(nodeName, nodePort);
+
+	Form_pg_dist_rebalance_strategy strategy =
+		GetRebalanceStrategy(PG_ARGISNULL(3) ? NULL : PG_GETARG_NAME(3));
+
+	/*
+	 * Mark the node in a separate transaction, the moves run in their own
+	 * transactions as well and should not wait for ours.
+	 */
+	StringInfo setPropertyCommand = makeStringInfo();
+	appendStringInfo(setPropertyCommand,
+					 "SELECT pg_catalog.master_set_node_property(%s, %d, "
+					 "'shouldhaveshards', false)",
+					 quote_literal_cstr(nodeName), nodePort);
+
+	int connectionFlags = FORCE_NEW_CONNECTION | OUTSIDE_TRANSACTION;
+	MultiConnection *connection = GetNodeUserDatabaseConnection(connectionFlags,
+																LOCAL_HOST_NAME,
+																PostPortNumber,
+																NULL, NULL);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	ExecuteCriticalRemoteCommand(connection, setPropertyCommand->data);
+	CloseConnection(connection);
+
+	RebalanceOptions options;
+	memset(&options, 0, sizeof(options));
+
+	options.relationIdList = RebalanceRelationIdList(InvalidOid);
+	options.threshold = strategy->defaultThreshold;
+	options.maxShardMoves = DEFAULT_MAX_SHARD_MOVES;
+	options.drainOnly = true;
+	options.rebalanceStrategy = strategy;
+	options.drainNode = workerNode;
+
+	RebalanceTableShards(&options, ShardTransferModeLabel(fcinfo, 2));
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_cost_by_disk_size returns the disk size of the given shard and
+ * the shards that are colocated with it, as found on one of the active
+ * placements of the shard. The sizes come from the shard size cache when it
+ * has all of them.
+ */
+Datum
+citus_shard_cost_by_disk_size(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	PGresult *result = NULL;
+	bool raiseErrors = true;
+
+	CheckCitusVersion(ERROR);
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	List *placementList = ActiveShardPlacementList(shardId);
+	if (placementList == NIL)
+	{
+		ereport(ERROR, (errmsg("could not find an active placement of shard "
+							   UINT64_FORMAT, shardId)));
+	}
+
+	ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+
+	uint64 cachedShardGroupSize = 0;
+	if (CachedShardGroupSize(colocatedShardList, placement->groupId,
+							 &cachedShardGroupSize))
+	{
+		PG_RETURN_FLOAT4((float4) cachedShardGroupSize);
+	}
+
+	StringInfo sizeQuery = GenerateSizeQueryOnMultiplePlacements(
+		colocatedShardList, PG_TOTAL_RELATION_SIZE_FUNCTION);
+
+	MultiConnection *connection = GetNodeConnection(0, placement->nodeName,
+													placement->nodePort);
+	int queryResult = ExecuteOptionalRemoteCommand(connection, sizeQuery->data,
+												   &result);
+	if (queryResult != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("cannot get the size because of a connection error")));
+	}
+
+	List *sizeList = ReadFirstColumnAsText(result);
+	StringInfo sizeStringInfo = (StringInfo) linitial(sizeList);
+	uint64 shardGroupSize = SafeStringToUint64(sizeStringInfo->data);
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	PG_RETURN_FLOAT4((float4) shardGroupSize);
+}
+
+
+/*
+ * CachedShardGroupSize sums up the cached total sizes of the placements of the
+ * given shards on the given group and returns whether all of them were cached.
+ */
+static bool
+CachedShardGroupSize(List *shardIntervalList, int32 groupId, uint64 *shardGroupSize)
+{
+	uint64 cachedShardGroupSize = 0;
+
+	if (!ShardSizeCacheEnabled())
+	{
+		return false;
+	}
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 placementSize = 0;
+
+		if (!CachedPlacementSize(shardInterval->shardId, groupId,
+								 SHARD_TOTAL_RELATION_SIZE, &placementSize))
+		{
+			return false;
+		}
+
+		cachedShardGroupSize += placementSize;
+	}
+
+	*shardGroupSize = cachedShardGroupSize;
+
+	return true;
+}
+
+
+/*
+ * ShardTransferModeLabel returns the label of the citus.shard_transfer_mode
+ * argument at the given index, defaulting to auto.
+ */
+static char *
+ShardTransferModeLabel(FunctionCallInfo fcinfo, int argumentIndex)
+{
+	if (PG_ARGISNULL(argumentIndex))
+	{
+		return "auto";
+	}
+
+	Datum labelDatum = DirectFunctionCall1(enum_out,
+										   PG_GETARG_DATUM(argumentIndex));
+
+	return DatumGetCString(labelDatum);
+}
+
+
+/*
+ * GetRebalanceStrategy returns the rebalance strategy with the given name, or
+ * the default strategy when the name is NULL.
+ */
+static Form_pg_dist_rebalance_strategy
+GetRebalanceStrategy(Name strategyName)
+{
+	ScanKeyData scanKey[1];
+
+	Relation pgDistRebalanceStrategy = heap_open(DistRebalanceStrategyRelationId(),
+												 AccessShareLock);
+
+	if (strategyName == NULL)
+	{
+		ScanKeyInit(&scanKey[0], Anum_pg_dist_rebalance_strategy_default_strategy,
+					BTEqualStrategyNumber, F_BOOLEQ, BoolGetDatum(true));
+	}
+	else
+	{
+		ScanKeyInit(&scanKey[0], Anum_pg_dist_rebalance_strategy_name,
+					BTEqualStrategyNumber, F_NAMEEQ, NameGetDatum(strategyName));
+	}
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistRebalanceStrategy,
+													InvalidOid, false,
+													NULL, 1, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	if (!HeapTupleIsValid(heapTuple))
+	{
+		if (strategyName == NULL)
+		{
+			ereport(ERROR, (errmsg("no rebalance_strategy was provided, but there "
+								   "is also no default strategy set")));
+		}
+
+		ereport(ERROR, (errmsg("could not find rebalance strategy with name %s",
+							   NameStr(*strategyName))));
+	}
+
+	Form_pg_dist_rebalance_strategy strategy =
+		palloc0(sizeof(FormData_pg_dist_rebalance_strategy));
+	memcpy(strategy, GETSTRUCT(heapTuple), sizeof(FormData_pg_dist_rebalance_strategy));
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgDistRebalanceStrategy, NoLock);
+
+	return strategy;
+}
+
+
+/*
+ * RebalanceThreshold returns the threshold to use with the given strategy,
+ * which is the strategy's default when no threshold was given. Thresholds
+ * below the minimum of the strategy are raised to the minimum.
+ */
+static float4
+RebalanceThreshold(Form_pg_dist_rebalance_strategy strategy, bool thresholdIsNull,
+				   float4 threshold)
+{
+	if (thresholdIsNull)
+	{
+		return strategy->defaultThreshold;
+	}
+
+	if (threshold < strategy->minimumThreshold)
+	{
+		ereport(WARNING, (errmsg("the given threshold is lower than the minimum "
+								 "threshold allowed by the rebalance strategy, "
+								 "using the minimum allowed threshold instead"),
+						  errdetail("Using threshold of %.2f",
+									strategy->minimumThreshold)));
+
+		return strategy->minimumThreshold;
+	}
+
+	return threshold;
+}
+
+
+/*
+ * RebalanceRelationIdList returns the tables to rebalance: the given table,
+ * or all distributed tables that are not reference tables when no table is
+ * given.
+ */
+static List *
+RebalanceRelationIdList(Oid relationId)
+{
+	if (OidIsValid(relationId))
+	{
+		if (!IsCitusTable(relationId))
+		{
+			ereport(ERROR, (errmsg("relation %s is not distributed",
+								   get_rel_name(relationId))));
+		}
+
+		if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+		{
+			ereport(ERROR, (errmsg("cannot rebalance reference table %s",
+								   get_rel_name(relationId)),
+							errdetail("Reference tables have a placement on "
+									  "every node.")));
+		}
+
+		EnsureTableOwner(relationId);
+
+		return list_make1_oid(relationId);
+	}
+
+	List *relationIdList = NIL;
+	Oid distributedTableId = InvalidOid;
+	foreach_oid(distributedTableId, DistTableOidList())
+	{
+		if (PartitionMethod(distributedTableId) == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		relationIdList = lappend_oid(relationIdList, distributedTableId);
+	}
+
+	return relationIdList;
+}
+
+
+/*
+ * RebalanceTableShards plans the moves of a rebalance and runs them. Only one
+ * rebalance can run at a time for a colocation group.
+ */
+static void
+RebalanceTableShards(RebalanceOptions *options, char *shardTransferModeLabel)
+{
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, options->relationIdList)
+	{
+		uint32 colocationId = TableColocationId(relationId);
+		if (colocationId == INVALID_COLOCATION_ID)
+		{
+			colocationId = relationId;
+		}
+
+		LockColocationId(colocationId, ExclusiveLock);
+	}
+
+	List *moveList = RebalancePlacementMoves(options);
+
+	ExecutePlacementMoveList(moveList, shardTransferModeLabel);
+}
+
+
+/*
+ * RebalancePlacementMoves plans the moves of a rebalance for each colocation
+ * group of the tables in the options, within the maximum number of moves.
+ */
+static List *
+RebalancePlacementMoves(RebalanceOptions *options)
+{
+	List *workerNodeList = SortList(ActivePrimaryNodeList(NoLock), CompareWorkerNodes);
+	List *colocationIdList = NIL;
+	List *moveList = NIL;
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, options->relationIdList)
+	{
+		uint32 colocationId = TableColocationId(relationId);
+		if (colocationId != INVALID_COLOCATION_ID)
+		{
+			/* colocated tables move together, plan each group once */
+			if (list_member_int(colocationIdList, colocationId))
+			{
+				continue;
+			}
+
+			colocationIdList = lappend_int(colocationIdList, colocationId);
+		}
+
+		int maxMoveCount = options->maxShardMoves - list_length(moveList);
+		if (maxMoveCount <= 0)
+		{
+			break;
+		}
+
+		List *groupMoveList = ColocationGroupPlacementMoves(relationId, workerNodeList,
+															options, maxMoveCount);
+		moveList = list_concat(moveList, groupMoveList);
+	}
+
+	return moveList;
+}
+
+
+/*
+ * ColocationGroupPlacementMoves plans the moves of the shard groups of the
+ * colocation group of the given table. Nodes that should not have shards are
+ * drained first, after which shards are moved from the most utilized to the
+ * least utilized nodes for as long as that brings a node back within the
+ * threshold of the average utilization.
+ */
+static List *
+ColocationGroupPlacementMoves(Oid relationId, List *workerNodeList,
+							  RebalanceOptions *options, int maxMoveCount)
+{
+	Form_pg_dist_rebalance_strategy strategy = options->rebalanceStrategy;
+	List *fillStateList = NodeFillStateList(workerNodeList, strategy);
+	int nodeCount = list_length(fillStateList);
+	List *moveList = NIL;
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		ShardCost *shardCost = palloc0(sizeof(ShardCost));
+
+		shardCost->shardId = shardId;
+		shardCost->cost = DatumGetFloat4(OidFunctionCall1(strategy->shardCostFunction,
+														  Int64GetDatum(shardId)));
+		shardCost->excluded = ShardGroupExcluded(shardInterval,
+												 options->excludedShardArray);
+		shardCost->allowedOnNode = palloc0(nodeCount * sizeof(bool));
+
+		NodeFillState *fillState = NULL;
+		foreach_ptr(fillState, fillStateList)
+		{
+			Datum allowedDatum = OidFunctionCall2(strategy->shardAllowedOnNodeFunction,
+												  Int64GetDatum(shardId),
+												  Int32GetDatum(fillState->node->nodeId));
+
+			shardCost->allowedOnNode[fillState->index] = DatumGetBool(allowedDatum);
+		}
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, ActiveShardPlacementList(shardId))
+		{
+			fillState = FindFillStateForGroup(fillStateList, placement->groupId);
+			if (fillState == NULL)
+			{
+				/* placements on inactive nodes cannot be moved */
+				continue;
+			}
+
+			shardCost->shardSize = placement->shardLength;
+
+			fillState->shardCostList = lappend(fillState->shardCostList, shardCost);
+			fillState->totalCost += shardCost->cost;
+			fillState->utilization = fillState->totalCost / fillState->capacity;
+		}
+	}
+
+	while (list_length(moveList) < maxMoveCount)
+	{
+		PlacementMove *move = NextDrainMove(fillStateList, options);
+		if (move == NULL && !options->drainOnly)
+		{
+			move = NextBalanceMove(fillStateList, options);
+		}
+
+		if (move == NULL)
+		{
+			break;
+		}
+
+		move->relationId = relationId;
+		moveList = lappend(moveList, move);
+	}
+
+	return moveList;
+}
+
+
+/*
+ * NodeFillStateList returns an empty fill state for each of the given nodes,
+ * with the capacity that the rebalance strategy gives the node.
+ */
+static List *
+NodeFillStateList(List *workerNodeList, Form_pg_dist_rebalance_strategy strategy)
+{
+	List *fillStateList = NIL;
+	int nodeIndex = 0;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		Datum capacityDatum = OidFunctionCall1(strategy->nodeCapacityFunction,
+											   Int32GetDatum(workerNode->nodeId));
+		float4 capacity = DatumGetFloat4(capacityDatum);
+
+		if (capacity <= 0)
+		{
+			ereport(ERROR, (errmsg("capacity of node %s:%d is not positive",
+								   workerNode->workerName, workerNode->workerPort),
+							errdetail("The node_capacity_function of the rebalance "
+									  "strategy should return a positive number.")));
+		}
+
+		NodeFillState *fillState = palloc0(sizeof(NodeFillState));
+		fillState->node = workerNode;
+		fillState->index = nodeIndex++;
+		fillState->capacity = capacity;
+
+		fillStateList = lappend(fillStateList, fillState);
+	}
+
+	return fillStateList;
+}
+
+
+/*
+ * FindFillStateForGroup returns the fill state of the node in the given group,
+ * or NULL if the group has no node in the list.
+ */
+static NodeFillState *
+FindFillStateForGroup(List *fillStateList, int32 groupId)
+{
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, fillStateList)
+	{
+		if (fillState->node->groupId == groupId)
+		{
+			return fillState;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CapacityAwareShardPlacementNodes returns, for each of the given new shards,
+ * the list of worker nodes to place its replicas on. The shards are spread
+ * over the nodes in proportion to the node capacities of the default
+ * rebalance strategy, which is the distribution that rebalance_table_shards
+ * aims for, such that the new colocation group does not need a rebalance
+ * right away. New shards are empty, so each of them costs the same. When
+ * placing a shard on several nodes would be equally good, we prefer the node
+ * whose existing placements are smallest relative to its capacity.
+ *
+ * The shard rows should already be in pg_dist_shard, since the
+ * shard_allowed_on_node_function of the strategy is called for every node.
+ */
+List *
+CapacityAwareShardPlacementNodes(List *shardIntervalList, List *workerNodeList,
+								 int replicationFactor)
+{
+	Form_pg_dist_rebalance_strategy strategy = GetRebalanceStrategy(NULL);
+	List *fillStateList = NodeFillStateList(workerNodeList, strategy);
+	float4 *sizeUtilization = NodeSizeUtilization(fillStateList);
+	List *placementNodeLists = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementNodeList = NIL;
+		List *candidateList = NIL;
+
+		NodeFillState *fillState = NULL;
+		foreach_ptr(fillState, fillStateList)
+		{
+			Datum allowedDatum = OidFunctionCall2(strategy->shardAllowedOnNodeFunction,
+												  Int64GetDatum(shardInterval->shardId),
+												  Int32GetDatum(fillState->node->nodeId));
+			if (DatumGetBool(allowedDatum))
+			{
+				candidateList = lappend(candidateList, fillState);
+			}
+		}
+
+		if (list_length(candidateList) < replicationFactor)
+		{
+			ereport(ERROR, (errmsg("shard " UINT64_FORMAT " is allowed on %d "
+								   "nodes, but needs %d placements",
+								   shardInterval->shardId,
+								   list_length(candidateList), replicationFactor),
+							errdetail("The shard_allowed_on_node_function of the "
+									  "default rebalance strategy does not allow "
+									  "enough nodes.")));
+		}
+
+		for (int replicaIndex = 0; replicaIndex < replicationFactor; replicaIndex++)
+		{
+			NodeFillState *bestFillState = NULL;
+			float4 bestUtilization = 0;
+
+			foreach_ptr(fillState, candidateList)
+			{
+				float4 utilization = (fillState->totalCost + 1) / fillState->capacity;
+
+				if (bestFillState == NULL || utilization < bestUtilization ||
+					(utilization == bestUtilization &&
+					 sizeUtilization[fillState->index] <
+					 sizeUtilization[bestFillState->index]))
+				{
+					bestFillState = fillState;
+					bestUtilization = utilization;
+				}
+			}
+
+			bestFillState->totalCost += 1;
+			bestFillState->utilization = bestUtilization;
+
+			/* a shard has at most one placement per node */
+			candidateList = list_delete_ptr(candidateList, bestFillState);
+			placementNodeList = lappend(placementNodeList, bestFillState->node);
+		}
+
+		placementNodeLists = lappend(placementNodeLists, placementNodeList);
+	}
+
+	return placementNodeLists;
+}
+
+
+/*
+ * NodeSizeUtilization returns the total size of the active placements of the
+ * distributed tables on each of the nodes of the given fill states, divided
+ * by the capacity of the node, indexed by NodeFillState index. We use the
+ * cached sizes of the placements when they are available.
+ */
+static float4 *
+NodeSizeUtilization(List *fillStateList)
+{
+	float4 *sizeUtilization = palloc0(list_length(fillStateList) * sizeof(float4));
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, DistTableOidList())
+	{
+		/* reference tables are on every node */
+		if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, LoadShardIntervalList(relationId))
+		{
+			ShardPlacement *placement = NULL;
+			foreach_ptr(placement, ActiveShardPlacementList(shardInterval->shardId))
+			{
+				NodeFillState *fillState = FindFillStateForGroup(fillStateList,
+																 placement->groupId);
+				uint64 placementSize = placement->shardLength;
+
+				if (fillState == NULL)
+				{
+					continue;
+				}
+
+				/* keeps the shard length if the size of the placement is not cached */
+				CachedPlacementSize(shardInterval->shardId, placement->groupId,
+									SHARD_TOTAL_RELATION_SIZE, &placementSize);
+
+				sizeUtilization[fillState->index] +=
+					(float4) placementSize / fillState->capacity;
+			}
+		}
+	}
+
+	return sizeUtilization;
+}
+
+
+/*
+ * ShardGroupExcluded returns whether the given shard or any of the shards
+ * colocated with it is in the excluded shard array.
+ */
+static bool
+ShardGroupExcluded(ShardInterval *shardInterval, ArrayType *excludedShardArray)
+{
+	if (excludedShardArray == NULL)
+	{
+		return false;
+	}
+
+	int excludedShardCount = ArrayObjectCount(excludedShardArray);
+	if (excludedShardCount == 0)
+	{
+		return false;
+	}
+
+	Datum *excludedShardDatums = DeconstructArrayObject(excludedShardArray);
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, ColocatedShardIntervalList(shardInterval))
+	{
+		for (int shardIndex = 0; shardIndex < excludedShardCount; shardIndex++)
+		{
+			if (DatumGetInt64(excludedShardDatums[shardIndex]) ==
+				colocatedShard->shardId)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * NextDrainMove returns a move of a shard from a node that should not have
+ * shards to the least utilized node it is allowed on, or NULL if there is no
+ * such move.
+ */
+static PlacementMove *
+NextDrainMove(List *fillStateList, RebalanceOptions *options)
+{
+	NodeFillState *source = NULL;
+	foreach_ptr(source, fillStateList)
+	{
+		if (source->node->shouldHaveShards)
+		{
+			continue;
+		}
+
+		if (options->drainNode != NULL &&
+			source->node->nodeId != options->drainNode->nodeId)
+		{
+			continue;
+		}
+
+		ShardCost *shardCost = NULL;
+		foreach_ptr(shardCost, source->shardCostList)
+		{
+			NodeFillState *bestTarget = NULL;
+			float4 bestUtilization = 0;
+
+			if (shardCost->excluded)
+			{
+				continue;
+			}
+
+			NodeFillState *target = NULL;
+			foreach_ptr(target, fillStateList)
+			{
+				if (!target->node->shouldHaveShards ||
+					!shardCost->allowedOnNode[target->index] ||
+					list_member_ptr(target->shardCostList, shardCost))
+				{
+					continue;
+				}
+
+				float4 newUtilization = (target->totalCost + shardCost->cost) /
+										target->capacity;
+				if (bestTarget == NULL || newUtilization < bestUtilization)
+				{
+					bestTarget = target;
+					bestUtilization = newUtilization;
+				}
+			}
+
+			if (bestTarget != NULL)
+			{
+				return ApplyPlacementMove(InvalidOid, source, bestTarget, shardCost);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NextBalanceMove returns the move that takes the most utilized node that
+ * can give away a shard closest to the average, or NULL when all nodes are
+ * within the threshold or no move would lower the utilization of the most
+ * utilized node of the move.
+ */
+static PlacementMove *
+NextBalanceMove(List *fillStateList, RebalanceOptions *options)
+{
+	List *nodeFillStateList = NIL;
+
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, fillStateList)
+	{
+		if (fillState->node->shouldHaveShards)
+		{
+			nodeFillStateList = lappend(nodeFillStateList, fillState);
+		}
+	}
+
+	if (list_length(nodeFillStateList) < 2)
+	{
+		return NULL;
+	}
+
+	float4 averageUtilization = AverageUtilization(fillStateList);
+	float4 upperBound = averageUtilization * (1 + options->threshold);
+	float4 lowerBound = averageUtilization * (1 - options->threshold);
+
+	/* sorted from least to most utilized */
+	List *sortedFillStateList = SortList(nodeFillStateList,
+										 CompareFillStatesByUtilization);
+	int nodeCount = list_length(sortedFillStateList);
+
+	for (int sourceIndex = nodeCount - 1; sourceIndex > 0; sourceIndex--)
+	{
+		NodeFillState *source = list_nth(sortedFillStateList, sourceIndex);
+		NodeFillState *bestTarget = NULL;
+		ShardCost *bestShardCost = NULL;
+		float4 bestUtilization = 0;
+
+		for (int targetIndex = 0; targetIndex < sourceIndex; targetIndex++)
+		{
+			NodeFillState *target = list_nth(sortedFillStateList, targetIndex);
+
+			/* only move when it brings either node closer to the average */
+			if (source->utilization <= upperBound && target->utilization >= lowerBound)
+			{
+				continue;
+			}
+
+			ShardCost *shardCost = NULL;
+			foreach_ptr(shardCost, source->shardCostList)
+			{
+				if (shardCost->excluded ||
+					!shardCost->allowedOnNode[target->index] ||
+					list_member_ptr(target->shardCostList, shardCost))
+				{
+					continue;
+				}
+
+				float4 newSourceUtilization = (source->totalCost - shardCost->cost) /
+											  source->capacity;
+				float4 newTargetUtilization = (target->totalCost + shardCost->cost) /
+											  target->capacity;
+
+				/* a move should not leave the target fuller than the source was */
+				if (newTargetUtilization >= source->utilization)
+				{
+					continue;
+				}
+
+				float4 newUtilization = Max(newSourceUtilization, newTargetUtilization);
+				if (bestTarget == NULL || newUtilization < bestUtilization)
+				{
+					bestTarget = target;
+					bestShardCost = shardCost;
+					bestUtilization = newUtilization;
+				}
+			}
+		}
+
+		if (bestTarget != NULL)
+		{
+			return ApplyPlacementMove(InvalidOid, source, bestTarget, bestShardCost);
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * AverageUtilization returns the utilization that each node that should have
+ * shards would have if the shards were spread perfectly over them.
+ */
+static float4
+AverageUtilization(List *fillStateList)
+{
+	float4 totalCost = 0;
+	float4 totalCapacity = 0;
+
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, fillStateList)
+	{
+		totalCost += fillState->totalCost;
+
+		if (fillState->node->shouldHaveShards)
+		{
+			totalCapacity += fillState->capacity;
+		}
+	}
+
+	if (totalCapacity <= 0)
+	{
+		return 0;
+	}
+
+	return totalCost / totalCapacity;
+}
+
+
+/*
+ * CompareFillStatesByUtilization orders fill states from least to most
+ * utilized, and by node order for equal utilizations.
+ */
+static int
+CompareFillStatesByUtilization(const void *leftElement, const void *rightElement)
+{
+	NodeFillState *leftFillState = *((NodeFillState **) leftElement);
+	NodeFillState *rightFillState = *((NodeFillState **) rightElement);
+
+	if (leftFillState->utilization < rightFillState->utilization)
+	{
+		return -1;
+	}
+	else if (leftFillState->utilization > rightFillState->utilization)
+	{
+		return 1;
+	}
+
+	return leftFillState->index - rightFillState->index;
+}
+
+
+/*
+ * ApplyPlacementMove moves the shard between the fill states and returns the
+ * move.
+ */
+static PlacementMove *
+ApplyPlacementMove(Oid relationId, NodeFillState *source, NodeFillState *target,
+				   ShardCost *shardCost)
+{
+	source->shardCostList = list_delete_ptr(source->shardCostList, shardCost);
+	source->totalCost -= shardCost->cost;
+	source->utilization = source->totalCost / source->capacity;
+
+	target->shardCostList = lappend(target->shardCostList, shardCost);
+	target->totalCost += shardCost->cost;
+	target->utilization = target->totalCost / target->capacity;
+
+	PlacementMove *move = palloc0(sizeof(PlacementMove));
+	move->relationId = relationId;
+	move->shardId = shardCost->shardId;
+	move->shardSize = shardCost->shardSize;
+	move->sourceNode = source->node;
+	move->targetNode = target->node;
+
+	return move;
+}
+
+
+/*
+ * ExecutePlacementMoveList runs the given moves, each in its own transaction
+ * through master_move_shard_placement() over a new connection to the local
+ * node, so that every finished move stays done even if a later one fails.
+ *
+ * Moves run in rounds of up to citus.max_parallel_shard_moves moves that do
+ * not share a node, which keeps a single node from having to copy several
+ * shards at once. A move never overtakes an earlier move on the same node,
+ * since it may depend on it.
+ */
+static void
+ExecutePlacementMoveList(List *moveList, char *shardTransferModeLabel)
+{
+	int moveCount = list_length(moveList);
+	if (moveCount == 0)
+	{
+		return;
+	}
+
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(REBALANCE_PROGRESS_MAGIC_NUMBER, moveCount,
+							  sizeof(RebalanceMoveProgress), InvalidOid);
+	RebalanceMoveProgress *steps = (RebalanceMoveProgress *) monitor->steps;
+	List *pendingMoveList = NIL;
+	int moveIndex = 0;
+
+	PlacementMove *move = NULL;
+	foreach_ptr(move, moveList)
+	{
+		RebalanceMoveProgress *progress = &steps[moveIndex++];
+
+		progress->shardId = move->shardId;
+		progress->relationId = move->relationId;
+		progress->shardSize = move->shardSize;
+		strlcpy(progress->sourceNodeName, move->sourceNode->workerName,
+				MAX_NODE_LENGTH + 1);
+		progress->sourceNodePort = move->sourceNode->workerPort;
+		strlcpy(progress->targetNodeName, move->targetNode->workerName,
+				MAX_NODE_LENGTH + 1);
+		progress->targetNodePort = move->targetNode->workerPort;
+		progress->status = REBALANCE_MOVE_WAITING;
+
+		RunningMove *pendingMove = palloc0(sizeof(RunningMove));
+		pendingMove->move = move;
+		pendingMove->progress = progress;
+
+		pendingMoveList = lappend(pendingMoveList, pendingMove);
+	}
+
+	while (pendingMoveList != NIL)
+	{
+		List *roundMoveList = NIL;
+		List *remainingMoveList = NIL;
+		List *connectionList = NIL;
+		List *busyNodeIdList = NIL;
+
+		RunningMove *pendingMove = NULL;
+		foreach_ptr(pendingMove, pendingMoveList)
+		{
+			uint32 sourceNodeId = pendingMove->move->sourceNode->nodeId;
+			uint32 targetNodeId = pendingMove->move->targetNode->nodeId;
+
+			if (list_length(roundMoveList) < MaxParallelShardMoves &&
+				!list_member_int(busyNodeIdList, sourceNodeId) &&
+				!list_member_int(busyNodeIdList, targetNodeId))
+			{
+				RunningMove *runningMove = StartPlacementMove(pendingMove->move,
+															  pendingMove->progress,
+															  shardTransferModeLabel);
+
+				roundMoveList = lappend(roundMoveList, runningMove);
+				connectionList = lappend(connectionList, runningMove->connection);
+			}
+			else
+			{
+				remainingMoveList = lappend(remainingMoveList, pendingMove);
+			}
+
+			busyNodeIdList = lappend_int(busyNodeIdList, sourceNodeId);
+			busyNodeIdList = lappend_int(busyNodeIdList, targetNodeId);
+		}
+
+		WaitForAllConnections(connectionList, true);
+
+		MultiConnection *failedConnection = NULL;
+		PGresult *failedResult = NULL;
+
+		RunningMove *runningMove = NULL;
+		foreach_ptr(runningMove, roundMoveList)
+		{
+			MultiConnection *connection = runningMove->connection;
+			PGresult *result = GetRemoteCommandResult(connection, true);
+
+			if (!IsResponseOK(result))
+			{
+				if (failedConnection == NULL)
+				{
+					failedConnection = connection;
+					failedResult = result;
+				}
+				else
+				{
+					PQclear(result);
+				}
+
+				continue;
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+			CloseConnection(connection);
+
+			runningMove->progress->status = REBALANCE_MOVE_DONE;
+		}
+
+		if (failedConnection != NULL)
+		{
+			ReportResultError(failedConnection, failedResult, ERROR);
+		}
+
+		pendingMoveList = remainingMoveList;
+	}
+
+	FinalizeCurrentProgressMonitor();
+}
+
+
+/*
+ * StartPlacementMove sends the command for the given move over a new
+ * connection to the local node and returns the running move.
+ */
+static RunningMove *
+StartPlacementMove(PlacementMove *move, RebalanceMoveProgress *progress,
+				   char *shardTransferModeLabel)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION | OUTSIDE_TRANSACTION;
+	StringInfo moveCommand = makeStringInfo();
+
+	appendStringInfo(moveCommand,
+					 "SELECT pg_catalog.master_move_shard_placement("
+					 UINT64_FORMAT ", %s, %d, %s, %d, %s)",
+					 move->shardId,
+					 quote_literal_cstr(move->sourceNode->workerName),
+					 move->sourceNode->workerPort,
+					 quote_literal_cstr(move->targetNode->workerName),
+					 move->targetNode->workerPort,
+					 quote_literal_cstr(shardTransferModeLabel));
+
+	ereport(NOTICE, (errmsg("moving shard " UINT64_FORMAT " from %s:%d to %s:%d ...",
+							move->shardId,
+							move->sourceNode->workerName,
+							move->sourceNode->workerPort,
+							move->targetNode->workerName,
+							move->targetNode->workerPort)));
+
+	MultiConnection *connection = GetNodeUserDatabaseConnection(connectionFlags,
+																LOCAL_HOST_NAME,
+																PostPortNumber,
+																NULL, NULL);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	if (!SendRemoteCommand(connection, moveCommand->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	progress->status = REBALANCE_MOVE_MOVING;
+
+	RunningMove *runningMove = palloc0(sizeof(RunningMove));
+	runningMove->move = move;
+	runningMove->progress = progress;
+	runningMove->connection = connection;
+
+	return runningMove;
+}
+
+
+/*
+ * pg_dist_rebalance_strategy_enterprise_check is the trigger function that
+ * prohibited writes to pg_dist_rebalance_strategy before custom rebalance
+ * strategies were supported. Citus 9.4-1 drops the trigger, the function is
+ * kept for the extension scripts of earlier versions.
  */
 Datum
 pg_dist_rebalance_strategy_enterprise_check(PG_FUNCTION_ARGS)
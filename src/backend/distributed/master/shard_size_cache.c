@@ -0,0 +1,512 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_size_cache.c
+ *   Keeps the on-disk sizes of shard placements in shared memory, such that
+ *   citus_table_size() and friends, the rebalancer and the planner do not
+ *   need to query every worker each time they need a size. The cache is
+ *   refreshed by the maintenance daemon, which sends a single query per
+ *   worker for all the placements on that worker.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/relay_utility.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+
+
+/*
+ * SHARD_SIZE_CACHE_QUERY gets the sizes of the shards in the VALUES list
+ * that exist on a worker. Shards that are dropped concurrently are skipped.
+ */
+#define SHARD_SIZE_CACHE_QUERY \
+	"SELECT shard_id, pg_relation_size(shard_relid), pg_table_size(shard_relid), " \
+	"pg_total_relation_size(shard_relid) FROM (SELECT shard_id, " \
+	"to_regclass(shard_name) AS shard_relid FROM (VALUES %s) " \
+	"AS shards(shard_id, shard_name)) AS shards WHERE shard_relid IS NOT NULL"
+
+
+/*
+ * The data structure used to store data in shared memory. Like the planning
+ * statistics, it only holds the lock, the sizes are kept in a separately
+ * allocated hash.
+ */
+typedef struct ShardSizeCacheSharedData
+{
+	int shardSizeCacheHashTrancheId;
+	char *shardSizeCacheHashTrancheName;
+
+	LWLock shardSizeCacheHashLock;
+} ShardSizeCacheSharedData;
+
+typedef struct ShardSizeCacheHashKey
+{
+	Oid databaseId;
+	int32 groupId;
+	uint64 shardId;
+} ShardSizeCacheHashKey;
+
+/* hash entry for the sizes of a single shard placement */
+typedef struct ShardSizeCacheHashEntry
+{
+	ShardSizeCacheHashKey key;
+
+	uint64 sizes[SHARD_SIZE_TYPE_COUNT];
+} ShardSizeCacheHashEntry;
+
+/* size query that is sent to a node while refreshing the cache */
+typedef struct ShardSizeRequest
+{
+	int32 groupId;
+	StringInfo sizeQuery;
+	MultiConnection *connection;
+	bool querySent;
+} ShardSizeRequest;
+
+/* sizes of a shard placement as read from a worker, before they are stored */
+typedef struct PlacementSize
+{
+	uint64 shardId;
+	int32 groupId;
+	uint64 sizes[SHARD_SIZE_TYPE_COUNT];
+} PlacementSize;
+
+
+/* GUC, maximum number of shard placements whose sizes are cached */
+int ShardSizeCacheMaxShards = 0;
+
+/* GUC, time between refreshes of the shard size cache, in milliseconds */
+int ShardSizeCacheRefreshInterval = 60000;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *ShardSizeCacheHash = NULL;
+static ShardSizeCacheSharedData *ShardSizeCacheSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+
+/* local function declarations */
+static StringInfo ShardSizeQueryForGroup(List *citusTableList, int32 groupId);
+static List * ReadPlacementSizes(PGresult *result, int32 groupId);
+static void StorePlacementSizes(List *placementSizeList, List *refreshedGroupList);
+static void ShardSizeCacheShmemInit(void);
+static size_t ShardSizeCacheShmemSize(void);
+
+
+/*
+ * InitializeShardSizeCache requests the necessary shared memory from Postgres
+ * and sets up the shared memory startup hook.
+ */
+void
+InitializeShardSizeCache(void)
+{
+	if (ShardSizeCacheMaxShards == 0)
+	{
+		/* the cache is disabled, size functions always query the workers */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardSizeCacheShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardSizeCacheShmemInit;
+}
+
+
+/*
+ * ShardSizeCacheEnabled returns whether the shard size cache was allocated.
+ */
+bool
+ShardSizeCacheEnabled(void)
+{
+	return ShardSizeCacheHash != NULL;
+}
+
+
+/*
+ * CachedPlacementSize looks up the given size of the placement of the given
+ * shard on the given group and returns whether it was found. The size is
+ * only written to placementSize if it was found.
+ */
+bool
+CachedPlacementSize(uint64 shardId, int32 groupId, ShardSizeType sizeType,
+					uint64 *placementSize)
+{
+	ShardSizeCacheHashKey key;
+	bool found = false;
+
+	if (ShardSizeCacheHash == NULL)
+	{
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.groupId = groupId;
+	key.shardId = shardId;
+
+	LWLockAcquire(&ShardSizeCacheSharedState->shardSizeCacheHashLock, LW_SHARED);
+
+	ShardSizeCacheHashEntry *cacheEntry =
+		(ShardSizeCacheHashEntry *) hash_search(ShardSizeCacheHash, &key, HASH_FIND,
+												&found);
+	if (found)
+	{
+		*placementSize = cacheEntry->sizes[sizeType];
+	}
+
+	LWLockRelease(&ShardSizeCacheSharedState->shardSizeCacheHashLock);
+
+	return found;
+}
+
+
+/*
+ * RefreshShardSizeCache reads the sizes of all shard placements of the Citus
+ * tables in the current database from the workers and replaces the cached
+ * sizes with them. Each worker gets a single query, and the queries run in
+ * parallel. The cached sizes of workers that cannot be reached are kept.
+ *
+ * The function returns whether the sizes of all workers were refreshed.
+ */
+bool
+RefreshShardSizeCache(void)
+{
+	List *sizeRequestList = NIL;
+	List *connectionList = NIL;
+	List *placementSizeList = NIL;
+	List *refreshedGroupList = NIL;
+	bool allGroupsRefreshed = true;
+
+	if (ShardSizeCacheHash == NULL)
+	{
+		return true;
+	}
+
+	List *citusTableList = CitusTableList();
+	List *workerNodeList = ActiveReadableNodeList();
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		StringInfo sizeQuery = ShardSizeQueryForGroup(citusTableList,
+													  workerNode->groupId);
+		if (sizeQuery == NULL)
+		{
+			/* no placements on the node, drop the sizes that we still have */
+			refreshedGroupList = lappend_int(refreshedGroupList, workerNode->groupId);
+			continue;
+		}
+
+		ShardSizeRequest *sizeRequest = palloc0(sizeof(ShardSizeRequest));
+		sizeRequest->groupId = workerNode->groupId;
+		sizeRequest->sizeQuery = sizeQuery;
+		sizeRequest->connection = StartNodeConnection(0, workerNode->workerName,
+													  workerNode->workerPort);
+
+		sizeRequestList = lappend(sizeRequestList, sizeRequest);
+		connectionList = lappend(connectionList, sizeRequest->connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	ShardSizeRequest *sizeRequest = NULL;
+	foreach_ptr(sizeRequest, sizeRequestList)
+	{
+		MultiConnection *connection = sizeRequest->connection;
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+			SendRemoteCommand(connection, sizeRequest->sizeQuery->data) == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			allGroupsRefreshed = false;
+			continue;
+		}
+
+		sizeRequest->querySent = true;
+	}
+
+	foreach_ptr(sizeRequest, sizeRequestList)
+	{
+		MultiConnection *connection = sizeRequest->connection;
+		bool raiseInterrupts = true;
+
+		if (!sizeRequest->querySent)
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, WARNING);
+			allGroupsRefreshed = false;
+		}
+		else
+		{
+			List *groupSizeList = ReadPlacementSizes(result, sizeRequest->groupId);
+
+			placementSizeList = list_concat(placementSizeList, groupSizeList);
+			refreshedGroupList = lappend_int(refreshedGroupList, sizeRequest->groupId);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	StorePlacementSizes(placementSizeList, refreshedGroupList);
+
+	return allGroupsRefreshed;
+}
+
+
+/*
+ * ShardSizeQueryForGroup returns the query that gets the sizes of all the
+ * placements of the given tables on the given group, or NULL if the group
+ * has no placements of them.
+ */
+static StringInfo
+ShardSizeQueryForGroup(List *citusTableList, int32 groupId)
+{
+	StringInfo shardValues = makeStringInfo();
+
+	CitusTableCacheEntry *cacheEntry = NULL;
+	foreach_ptr(cacheEntry, citusTableList)
+	{
+		Oid relationId = cacheEntry->relationId;
+
+		/* the Postgres size functions do not know about cstore tables */
+		if (CStoreTable(relationId))
+		{
+			continue;
+		}
+
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+		char *relationName = get_rel_name(relationId);
+		if (schemaName == NULL || relationName == NULL)
+		{
+			/* the table was dropped concurrently */
+			continue;
+		}
+
+		for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+			 shardIndex++)
+		{
+			GroupShardPlacement *placementArray =
+				cacheEntry->arrayOfPlacementArrays[shardIndex];
+			int placementCount = cacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+
+			for (int placementIndex = 0; placementIndex < placementCount;
+				 placementIndex++)
+			{
+				GroupShardPlacement *placement = &placementArray[placementIndex];
+				if (placement->groupId != groupId)
+				{
+					continue;
+				}
+
+				char *shardName = pstrdup(relationName);
+				AppendShardIdToName(&shardName, placement->shardId);
+
+				char *qualifiedShardName = quote_qualified_identifier(schemaName,
+																	  shardName);
+
+				appendStringInfo(shardValues, "%s(" UINT64_FORMAT ", %s)",
+								 shardValues->len > 0 ? ", " : "",
+								 placement->shardId,
+								 quote_literal_cstr(qualifiedShardName));
+			}
+		}
+	}
+
+	if (shardValues->len == 0)
+	{
+		return NULL;
+	}
+
+	StringInfo sizeQuery = makeStringInfo();
+	appendStringInfo(sizeQuery, SHARD_SIZE_CACHE_QUERY, shardValues->data);
+
+	return sizeQuery;
+}
+
+
+/*
+ * ReadPlacementSizes converts the result of a SHARD_SIZE_CACHE_QUERY sent to
+ * a node of the given group into a list of PlacementSize.
+ */
+static List *
+ReadPlacementSizes(PGresult *result, int32 groupId)
+{
+	List *placementSizeList = NIL;
+	int rowCount = PQntuples(result);
+
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		PlacementSize *placementSize = palloc0(sizeof(PlacementSize));
+		placementSize->shardId = SafeStringToUint64(PQgetvalue(result, rowIndex, 0));
+		placementSize->groupId = groupId;
+
+		for (int sizeType = 0; sizeType < SHARD_SIZE_TYPE_COUNT; sizeType++)
+		{
+			char *sizeString = PQgetvalue(result, rowIndex, sizeType + 1);
+			placementSize->sizes[sizeType] = SafeStringToUint64(sizeString);
+		}
+
+		placementSizeList = lappend(placementSizeList, placementSize);
+	}
+
+	return placementSizeList;
+}
+
+
+/*
+ * StorePlacementSizes replaces the cached sizes of the placements of the
+ * current database on the given groups with the given sizes. Sizes that do
+ * not fit into the cache anymore are left out, such that callers fall back
+ * to asking the workers.
+ */
+static void
+StorePlacementSizes(List *placementSizeList, List *refreshedGroupList)
+{
+	HASH_SEQ_STATUS status;
+	ShardSizeCacheHashEntry *cacheEntry = NULL;
+	bool cacheFull = false;
+
+	LWLockAcquire(&ShardSizeCacheSharedState->shardSizeCacheHashLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ShardSizeCacheHash);
+	while ((cacheEntry = (ShardSizeCacheHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (cacheEntry->key.databaseId == MyDatabaseId &&
+			list_member_int(refreshedGroupList, cacheEntry->key.groupId))
+		{
+			hash_search(ShardSizeCacheHash, &cacheEntry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	PlacementSize *placementSize = NULL;
+	foreach_ptr(placementSize, placementSizeList)
+	{
+		ShardSizeCacheHashKey key;
+		bool found = false;
+
+		memset(&key, 0, sizeof(key));
+		key.databaseId = MyDatabaseId;
+		key.groupId = placementSize->groupId;
+		key.shardId = placementSize->shardId;
+
+		cacheEntry = (ShardSizeCacheHashEntry *) hash_search(ShardSizeCacheHash, &key,
+															 HASH_ENTER_NULL, &found);
+		if (cacheEntry == NULL)
+		{
+			cacheFull = true;
+			break;
+		}
+
+		memcpy_s(cacheEntry->sizes, sizeof(cacheEntry->sizes),
+				 placementSize->sizes, sizeof(placementSize->sizes));
+	}
+
+	LWLockRelease(&ShardSizeCacheSharedState->shardSizeCacheHashLock);
+
+	if (cacheFull)
+	{
+		ereport(DEBUG1, (errmsg("shard size cache is full, consider increasing "
+								"citus.shard_size_cache_max_shards")));
+	}
+}
+
+
+/*
+ * ShardSizeCacheShmemSize returns the size that should be allocated on the
+ * shared memory for the shard size cache.
+ */
+static size_t
+ShardSizeCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardSizeCacheSharedData));
+
+	Size hashSize = hash_estimate_size(ShardSizeCacheMaxShards,
+									   sizeof(ShardSizeCacheHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * ShardSizeCacheShmemInit initializes the shared memory used for caching the
+ * shard sizes across backends.
+ */
+static void
+ShardSizeCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (dbid, groupid, shardid) -> [sizes] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ShardSizeCacheHashKey);
+	info.entrysize = sizeof(ShardSizeCacheHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardSizeCacheSharedState =
+		(ShardSizeCacheSharedData *) ShmemInitStruct("Shard Size Cache Data",
+													 sizeof(ShardSizeCacheSharedData),
+													 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ShardSizeCacheSharedState->shardSizeCacheHashTrancheId = LWLockNewTrancheId();
+		ShardSizeCacheSharedState->shardSizeCacheHashTrancheName =
+			"Shard Size Cache Hash Tranche";
+		LWLockRegisterTranche(ShardSizeCacheSharedState->shardSizeCacheHashTrancheId,
+							  ShardSizeCacheSharedState->shardSizeCacheHashTrancheName);
+
+		LWLockInitialize(&ShardSizeCacheSharedState->shardSizeCacheHashLock,
+						 ShardSizeCacheSharedState->shardSizeCacheHashTrancheId);
+	}
+
+	/* allocate hash table */
+	ShardSizeCacheHash = ShmemInitHash("Shard Size Cache Hash", ShardSizeCacheMaxShards,
+									   ShardSizeCacheMaxShards, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(ShardSizeCacheHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -464,6 +464,17 @@ ActiveReadableNodeList(void)
 }
 
 
+/*
+ * ActiveSecondaryNodeList returns a list of all secondary nodes in
+ * workerNodeHash, regardless of citus.use_secondary_nodes.
+ */
+List *
+ActiveSecondaryNodeList(void)
+{
+	return FilterActiveNodeListFunc(NoLock, NodeIsSecondary);
+}
+
+
 /*
  * NodeIsReadableWorker returns true if the given node is a readable worker node.
  */
@@ -591,28 +602,3 @@ WorkerNodeCompare(const void *lhsKey, const void *rhsKey, Size keySize)
 	int portCompare = workerLhs->workerPort - workerRhs->workerPort;
 	return portCompare;
 }
-
-
-/*
- * GetFirstPrimaryWorkerNode returns the primary worker node with the
- * lowest rank based on CompareWorkerNodes.
- *
- * The ranking is arbitrary, but needs to be kept consistent with IsFirstWorkerNode.
- */
-WorkerNode *
-GetFirstPrimaryWorkerNode(void)
-{
-	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
-	WorkerNode *firstWorkerNode = NULL;
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		if (firstWorkerNode == NULL ||
-			CompareWorkerNodes(&workerNode, &firstWorkerNode) < 0)
-		{
-			firstWorkerNode = workerNode;
-		}
-	}
-
-	return firstWorkerNode;
-}
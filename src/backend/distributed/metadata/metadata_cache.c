@@ -11,6 +11,7 @@
 
 #include "stdint.h"
 #include "postgres.h"
+#include <sys/stat.h>
 #include "libpq-fe.h"
 #include "miscadmin.h"
 
@@ -21,6 +22,7 @@
 #include "access/xact.h"
 #include "access/sysattr.h"
 #include "catalog/indexing.h"
+#include "catalog/namespace.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_enum.h"
@@ -32,8 +34,10 @@
 #include "commands/extension.h"
 #include "commands/trigger.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/fast_path_plan_cache.h"
 #include "distributed/function_utils.h"
 #include "distributed/foreign_key_relationship.h"
 #include "distributed/listutils.h"
@@ -42,17 +46,22 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_shard_plan_cache.h"
 #include "distributed/pg_dist_local_group.h"
 #include "distributed/pg_dist_node_metadata.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/pg_dist_placement.h"
+#include "distributed/relation_access_tracking.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shard_map.h"
 #include "distributed/shared_library_init.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
+#include "distributed/worker_shard_visibility.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
 #include "nodes/memnodes.h"
@@ -70,6 +79,7 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/regproc.h"
 #include "utils/rel.h"
 #include "utils/relfilenodemap.h"
 #include "utils/relmapper.h"
@@ -77,9 +87,18 @@
 #include "utils/typcache.h"
 
 
+/*
+ * We read the placements of a table's shards with a single range scan if the
+ * range of its shard ids is at most this many times its shard count.
+ */
+#define PLACEMENT_RANGE_SCAN_MAX_SPREAD 4
+
 /* user configuration */
 int ReadFromSecondaries = USE_SECONDARY_NODES_NEVER;
 
+/* config variable managed via guc.c */
+char *MetadataCachePreloadTables = "";
+
 
 /*
  * ShardCacheEntry represents an entry in the shardId -> ShardInterval cache.
@@ -113,6 +132,18 @@ typedef struct ShardCacheEntry
  * changes, e.g. because the extension is dropped, these summarily get set to
  * 0.
  */
+/*
+ * WorkerNodeGroupEntry contains the worker nodes of a node group, in the order
+ * in which they appear in WorkerNodeArray.
+ */
+typedef struct WorkerNodeGroupEntry
+{
+	int32 groupId;
+	int nodeCount;
+	WorkerNode **nodeArray;
+} WorkerNodeGroupEntry;
+
+
 typedef struct MetadataCacheData
 {
 	bool extensionLoaded;
@@ -166,6 +197,18 @@ bool EnableVersionChecks = true; /* version checks are enabled */
 
 static bool citusVersionKnownCompatible = false;
 
+/*
+ * The installed version of the extension, as of the pg_extension row with the
+ * given OID and xmin, and the available version, as of the given modification
+ * time of the control file. Both are cached to avoid reading and copying them
+ * again as long as they did not change.
+ */
+static char *installedExtensionVersion = NULL;
+static Oid installedExtensionOid = InvalidOid;
+static TransactionId installedExtensionXmin = InvalidTransactionId;
+static char *availableExtensionVersion = NULL;
+static time_t availableExtensionControlFileTime = 0;
+
 /* Hash table for informations about each partition */
 static HTAB *DistTableCacheHash = NULL;
 
@@ -182,6 +225,10 @@ static WorkerNode **WorkerNodeArray = NULL;
 static int WorkerNodeCount = 0;
 static bool workerNodeHashValid = false;
 
+/* Hash table for the worker nodes of each group, built along with WorkerNodeHash */
+static HTAB *WorkerNodeGroupHash = NULL;
+static WorkerNode **WorkerNodeGroupArray = NULL;
+
 /* default value is -1, for coordinator it's 0 and for worker nodes > 0 */
 static int32 LocalGroupId = -1;
 
@@ -197,10 +244,22 @@ static ShardCacheEntry * LookupShardCacheEntry(int64 shardId);
 static CitusTableCacheEntry * LookupCitusTableCacheEntry(Oid relationId);
 static void BuildCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
 static void BuildCachedShardList(CitusTableCacheEntry *cacheEntry);
+static void BuildCachedPlacementArrays(CitusTableCacheEntry *cacheEntry);
+static void BuildMaxValuePrefixArray(CitusTableCacheEntry *cacheEntry);
+static bool RefreshCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
+static bool DistPartitionTupleMatchesCacheEntry(CitusTableCacheEntry *cacheEntry,
+												HeapTuple distPartitionTuple,
+												TupleDesc tupleDescriptor);
+static bool ShardIntervalsMatchCacheEntry(CitusTableCacheEntry *cacheEntry);
+static bool ShardIntervalBoundsEqual(ShardInterval *leftInterval,
+									 ShardInterval *rightInterval);
+static void BuildCachedForeignKeyLists(CitusTableCacheEntry *cacheEntry);
 static void PrepareWorkerNodeCache(void);
 static bool CheckInstalledVersion(int elevel);
 static char * AvailableExtensionVersion(void);
 static char * InstalledExtensionVersion(void);
+static bool ExtensionControlFileTime(time_t *modificationTime);
+static List * PreloadRelationIdList(void);
 static bool CitusHasBeenLoadedInternal(void);
 static void InitializeCaches(void);
 static void InitializeDistCache(void);
@@ -210,6 +269,9 @@ static void RegisterForeignKeyGraphCacheCallbacks(void);
 static void RegisterWorkerNodeCacheCallbacks(void);
 static void RegisterLocalGroupIdCacheCallbacks(void);
 static uint32 WorkerNodeHashCode(const void *key, Size keySize);
+static HTAB * CreateWorkerNodeGroupHash(WorkerNode **workerNodeArray, int workerNodeCount,
+										WorkerNode ***groupNodeArray);
+static WorkerNode * ReadableNodeForGroup(int32 groupId);
 static void ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
 static void CreateDistTableCache(void);
 static void CreateDistObjectCache(void);
@@ -247,6 +309,7 @@ PG_FUNCTION_INFO_V1(master_dist_object_cache_invalidate);
 PG_FUNCTION_INFO_V1(role_exists);
 PG_FUNCTION_INFO_V1(authinfo_valid);
 PG_FUNCTION_INFO_V1(poolinfo_valid);
+PG_FUNCTION_INFO_V1(citus_preload_metadata_cache);
 
 
 /*
@@ -459,6 +522,9 @@ LoadShardPlacement(uint64 shardId, uint64 placementId)
 {
 	ShardCacheEntry *shardEntry = LookupShardCacheEntry(shardId);
 	GroupShardPlacement *groupPlacement = LoadGroupShardPlacement(shardId, placementId);
+
+	PrepareWorkerNodeCache();
+
 	ShardPlacement *nodePlacement = ResolveGroupShardPlacement(groupPlacement,
 															   shardEntry);
 
@@ -483,6 +549,8 @@ FindShardPlacementOnGroup(int32 groupId, uint64 shardId)
 	int numberOfPlacements =
 		tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
 
+	PrepareWorkerNodeCache();
+
 	for (int placementIndex = 0; placementIndex < numberOfPlacements; placementIndex++)
 	{
 		GroupShardPlacement *placement = &placementArray[placementIndex];
@@ -500,7 +568,9 @@ FindShardPlacementOnGroup(int32 groupId, uint64 shardId)
 
 /*
  * ResolveGroupShardPlacement takes a GroupShardPlacement and adds additional data to it,
- * such as the node we should consider it to be on.
+ * such as the node we should consider it to be on. The caller is expected to have
+ * called PrepareWorkerNodeCache, such that resolving the placements of a shard does
+ * not lock pg_dist_node and accept invalidation messages for every placement.
  */
 static ShardPlacement *
 ResolveGroupShardPlacement(GroupShardPlacement *groupShardPlacement,
@@ -512,7 +582,7 @@ ResolveGroupShardPlacement(GroupShardPlacement *groupShardPlacement,
 
 	ShardPlacement *shardPlacement = CitusMakeNode(ShardPlacement);
 	int32 groupId = groupShardPlacement->groupId;
-	WorkerNode *workerNode = LookupNodeForGroup(groupId);
+	WorkerNode *workerNode = ReadableNodeForGroup(groupId);
 
 	/* copy everything into shardPlacement but preserve the header */
 	CitusNode header = shardPlacement->type;
@@ -598,24 +668,34 @@ ForceLookupNodeByNodeId(uint32 nodeId)
 WorkerNode *
 LookupNodeForGroup(int32 groupId)
 {
-	bool foundAnyNodes = false;
-
 	PrepareWorkerNodeCache();
 
-	for (int workerNodeIndex = 0; workerNodeIndex < WorkerNodeCount; workerNodeIndex++)
-	{
-		WorkerNode *workerNode = WorkerNodeArray[workerNodeIndex];
-		int32 workerNodeGroupId = workerNode->groupId;
-		if (workerNodeGroupId != groupId)
-		{
-			continue;
-		}
+	return ReadableNodeForGroup(groupId);
+}
 
-		foundAnyNodes = true;
 
-		if (NodeIsReadable(workerNode))
+/*
+ * ReadableNodeForGroup is the part of LookupNodeForGroup that does not prepare the
+ * worker node cache. It finds the nodes of the group in WorkerNodeGroupHash, such
+ * that resolving a placement does not require scanning all worker nodes.
+ */
+static WorkerNode *
+ReadableNodeForGroup(int32 groupId)
+{
+	bool foundAnyNodes = false;
+
+	WorkerNodeGroupEntry *groupEntry = hash_search(WorkerNodeGroupHash, &groupId,
+												   HASH_FIND, &foundAnyNodes);
+	if (foundAnyNodes)
+	{
+		for (int nodeIndex = 0; nodeIndex < groupEntry->nodeCount; nodeIndex++)
 		{
-			return workerNode;
+			WorkerNode *workerNode = groupEntry->nodeArray[nodeIndex];
+
+			if (NodeIsReadable(workerNode))
+			{
+				return workerNode;
+			}
 		}
 	}
 
@@ -628,6 +708,7 @@ LookupNodeForGroup(int32 groupId)
 	switch (ReadFromSecondaries)
 	{
 		case USE_SECONDARY_NODES_NEVER:
+		case USE_SECONDARY_NODES_LAG_AWARE:
 		{
 			ereport(ERROR, (errmsg("node group %d does not have a primary node",
 								   groupId)));
@@ -672,6 +753,8 @@ ShardPlacementList(uint64 shardId)
 	int numberOfPlacements =
 		tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
 
+	PrepareWorkerNodeCache();
+
 	for (int i = 0; i < numberOfPlacements; i++)
 	{
 		GroupShardPlacement *groupShardPlacement = &placementArray[i];
@@ -872,6 +955,23 @@ LookupCitusTableCacheEntry(Oid relationId)
 			return cacheEntry;
 		}
 
+		/*
+		 * Most invalidations are caused by placement changes, which leave the
+		 * table's shard intervals intact. In that case we only reload the
+		 * placements and keep the sorted shard interval array.
+		 */
+		HOLD_INTERRUPTS();
+
+		bool refreshed = RefreshCitusTableCacheEntry(cacheEntry);
+
+		RESUME_INTERRUPTS();
+
+		if (refreshed)
+		{
+			cacheEntry->isValid = true;
+			return cacheEntry;
+		}
+
 		/* free the content of old, invalid, entries */
 		ResetCitusTableCacheEntry(cacheEntry);
 	}
@@ -1099,13 +1199,253 @@ BuildCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		cacheEntry->hasUniformHashDistribution =
 			HasUniformHashDistribution(cacheEntry->sortedShardIntervalArray,
 									   cacheEntry->shardIntervalArrayLength);
+		cacheEntry->uniformHashShardIndexShift =
+			UniformHashShardIndexShift(cacheEntry->shardIntervalArrayLength);
 	}
 	else
 	{
 		cacheEntry->hashFunction = NULL;
 	}
 
-	oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+	BuildCachedForeignKeyLists(cacheEntry);
+
+	heap_close(pgDistPartition, NoLock);
+}
+
+
+/*
+ * RefreshCitusTableCacheEntry is a helper routine for
+ * LookupCitusTableCacheEntry() which tries to bring an invalidated cache entry
+ * up to date without rebuilding it from scratch. If the table's
+ * pg_dist_partition row and the bounds of all its shards are unchanged, only
+ * the placement arrays and foreign key lists are reloaded, while the shard
+ * intervals, their sort order and the shard cache entries are kept.
+ *
+ * The function returns false if the entry cannot be refreshed this way, in
+ * which case the caller needs to rebuild the entry. The entry stays
+ * consistent for ResetCitusTableCacheEntry() in either case.
+ */
+static bool
+RefreshCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
+{
+	if (!cacheEntry->isCitusTable)
+	{
+		return false;
+	}
+
+	Relation pgDistPartition = heap_open(DistPartitionRelationId(), AccessShareLock);
+	HeapTuple distPartitionTuple =
+		LookupDistPartitionTuple(pgDistPartition, cacheEntry->relationId);
+
+	if (distPartitionTuple == NULL)
+	{
+		heap_close(pgDistPartition, NoLock);
+		return false;
+	}
+
+	bool partitionMatches =
+		DistPartitionTupleMatchesCacheEntry(cacheEntry, distPartitionTuple,
+											RelationGetDescr(pgDistPartition));
+
+	heap_freetuple(distPartitionTuple);
+
+	if (!partitionMatches || !ShardIntervalsMatchCacheEntry(cacheEntry))
+	{
+		heap_close(pgDistPartition, NoLock);
+		return false;
+	}
+
+	BuildCachedPlacementArrays(cacheEntry);
+
+	if (cacheEntry->referencedRelationsViaForeignKey)
+	{
+		list_free(cacheEntry->referencedRelationsViaForeignKey);
+		cacheEntry->referencedRelationsViaForeignKey = NIL;
+	}
+	if (cacheEntry->referencingRelationsViaForeignKey)
+	{
+		list_free(cacheEntry->referencingRelationsViaForeignKey);
+		cacheEntry->referencingRelationsViaForeignKey = NIL;
+	}
+
+	/* the column types of the table might have changed */
+	if (cacheEntry->copySerializationPlan != NULL)
+	{
+		FreeCopySerializationPlan(cacheEntry->copySerializationPlan);
+		cacheEntry->copySerializationPlan = NULL;
+	}
+
+	BuildCachedForeignKeyLists(cacheEntry);
+
+	heap_close(pgDistPartition, NoLock);
+
+	return true;
+}
+
+
+/*
+ * DistPartitionTupleMatchesCacheEntry returns true if the given
+ * pg_dist_partition tuple describes the same distribution as the cache entry.
+ */
+static bool
+DistPartitionTupleMatchesCacheEntry(CitusTableCacheEntry *cacheEntry,
+									HeapTuple distPartitionTuple,
+									TupleDesc tupleDescriptor)
+{
+	Datum datumArray[Natts_pg_dist_partition];
+	bool isNullArray[Natts_pg_dist_partition];
+	char replicationModel = 'c';
+	uint32 colocationId = INVALID_COLOCATION_ID;
+
+	heap_deform_tuple(distPartitionTuple, tupleDescriptor, datumArray, isNullArray);
+
+	char partitionMethod =
+		DatumGetChar(datumArray[Anum_pg_dist_partition_partmethod - 1]);
+	if (partitionMethod != cacheEntry->partitionMethod)
+	{
+		return false;
+	}
+
+	if (!isNullArray[Anum_pg_dist_partition_colocationid - 1])
+	{
+		colocationId =
+			DatumGetUInt32(datumArray[Anum_pg_dist_partition_colocationid - 1]);
+	}
+	if (colocationId != cacheEntry->colocationId)
+	{
+		return false;
+	}
+
+	if (!isNullArray[Anum_pg_dist_partition_repmodel - 1])
+	{
+		replicationModel =
+			DatumGetChar(datumArray[Anum_pg_dist_partition_repmodel - 1]);
+	}
+	if (replicationModel != cacheEntry->replicationModel)
+	{
+		return false;
+	}
+
+	bool partitionKeyIsNull = isNullArray[Anum_pg_dist_partition_partkey - 1];
+	if (partitionKeyIsNull || cacheEntry->partitionKeyString == NULL)
+	{
+		return partitionKeyIsNull && cacheEntry->partitionKeyString == NULL;
+	}
+
+	char *partitionKeyString =
+		TextDatumGetCString(datumArray[Anum_pg_dist_partition_partkey - 1]);
+
+	return strcmp(partitionKeyString, cacheEntry->partitionKeyString) == 0;
+}
+
+
+/*
+ * ShardIntervalsMatchCacheEntry returns true if pg_dist_shard contains exactly
+ * the shards of the cache entry, with the same bounds and storage types.
+ */
+static bool
+ShardIntervalsMatchCacheEntry(CitusTableCacheEntry *cacheEntry)
+{
+	Oid columnTypeId = InvalidOid;
+	int32 columnTypeMod = -1;
+	Oid intervalTypeId = InvalidOid;
+	int32 intervalTypeMod = -1;
+	bool intervalsMatch = true;
+
+	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+	if (list_length(distShardTupleList) != cacheEntry->shardIntervalArrayLength)
+	{
+		return false;
+	}
+
+	if (distShardTupleList == NIL)
+	{
+		return true;
+	}
+
+	GetPartitionTypeInputInfo(cacheEntry->partitionKeyString,
+							  cacheEntry->partitionMethod,
+							  &columnTypeId,
+							  &columnTypeMod,
+							  &intervalTypeId,
+							  &intervalTypeMod);
+
+	Relation distShardRelation = heap_open(DistShardRelationId(), AccessShareLock);
+	TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
+
+	HeapTuple shardTuple = NULL;
+	foreach_ptr(shardTuple, distShardTupleList)
+	{
+		ShardInterval *shardInterval = TupleToShardInterval(shardTuple,
+															distShardTupleDesc,
+															intervalTypeId,
+															intervalTypeMod);
+		bool foundInCache = false;
+
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+												  &shardInterval->shardId, HASH_FIND,
+												  &foundInCache);
+		if (!foundInCache || shardEntry->tableEntry != cacheEntry)
+		{
+			intervalsMatch = false;
+			break;
+		}
+
+		ShardInterval *cachedInterval =
+			cacheEntry->sortedShardIntervalArray[shardEntry->shardIndex];
+		if (!ShardIntervalBoundsEqual(shardInterval, cachedInterval))
+		{
+			intervalsMatch = false;
+			break;
+		}
+	}
+
+	heap_close(distShardRelation, AccessShareLock);
+
+	return intervalsMatch;
+}
+
+
+/*
+ * ShardIntervalBoundsEqual returns true if both shard intervals have the same
+ * storage type and the same min and max values.
+ */
+static bool
+ShardIntervalBoundsEqual(ShardInterval *leftInterval, ShardInterval *rightInterval)
+{
+	if (leftInterval->storageType != rightInterval->storageType ||
+		leftInterval->minValueExists != rightInterval->minValueExists ||
+		leftInterval->maxValueExists != rightInterval->maxValueExists)
+	{
+		return false;
+	}
+
+	if (leftInterval->minValueExists &&
+		!datumIsEqual(leftInterval->minValue, rightInterval->minValue,
+					  rightInterval->valueByVal, rightInterval->valueTypeLen))
+	{
+		return false;
+	}
+
+	if (leftInterval->maxValueExists &&
+		!datumIsEqual(leftInterval->maxValue, rightInterval->maxValue,
+					  rightInterval->valueByVal, rightInterval->valueTypeLen))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * BuildCachedForeignKeyLists builds the lists of relations which the cache
+ * entry's relation has foreign keys to, or which have foreign keys to it.
+ */
+static void
+BuildCachedForeignKeyLists(CitusTableCacheEntry *cacheEntry)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
 
 	cacheEntry->referencedRelationsViaForeignKey = ReferencedRelationIdList(
 		cacheEntry->relationId);
@@ -1113,8 +1453,6 @@ BuildCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		cacheEntry->relationId);
 
 	MemoryContextSwitchTo(oldContext);
-
-	heap_close(pgDistPartition, NoLock);
 }
 
 
@@ -1297,7 +1635,6 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 	{
 		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
 		bool foundInCache = false;
-		int placementOffset = 0;
 
 		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
 												  &shardInterval->shardId, HASH_ENTER,
@@ -1320,11 +1657,172 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		shardEntry->shardIndex = shardIndex;
 		shardEntry->tableEntry = cacheEntry;
 
-		/* build list of shard placements */
-		List *placementList = BuildShardPlacementList(shardInterval);
+		/* store the shard index in the ShardInterval */
+		shardInterval->shardIndex = shardIndex;
+	}
+
+	/* build the placement arrays of all shards */
+	BuildCachedPlacementArrays(cacheEntry);
+
+	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
+	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+
+	BuildMaxValuePrefixArray(cacheEntry);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+	BuildSortedShardBoundArrays(cacheEntry);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * BuildMaxValuePrefixArray() is a helper routine for BuildCachedShardList()
+ * building the running maximum of the max values of the sorted shard intervals
+ * of append and range distributed tables with overlapping shard intervals.
+ *
+ * The shard intervals are sorted by their min values, so the shards whose min
+ * value is at most a given value form a prefix of the array. Since the running
+ * maximum does not decrease, the shards before the first one whose running
+ * maximum reaches a given value all have smaller max values. Together, that
+ * lets the pruning code binary search for the window of shards that can
+ * intersect a range, instead of comparing against every shard.
+ */
+static void
+BuildMaxValuePrefixArray(CitusTableCacheEntry *cacheEntry)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int shardIntervalArrayLength = cacheEntry->shardIntervalArrayLength;
+	int initializedShardCount = 0;
+	int maxValueShardIndex = 0;
+
+	cacheEntry->maxValuePrefixShardIndexArray = NULL;
+	cacheEntry->initializedShardIntervalCount = 0;
+
+	if (!cacheEntry->hasOverlappingShardInterval ||
+		(cacheEntry->partitionMethod != DISTRIBUTE_BY_APPEND &&
+		 cacheEntry->partitionMethod != DISTRIBUTE_BY_RANGE))
+	{
+		return;
+	}
+
+	/* shard intervals without min/max values are sorted to the end */
+	while (initializedShardCount < shardIntervalArrayLength &&
+		   sortedShardIntervalArray[initializedShardCount]->minValueExists &&
+		   sortedShardIntervalArray[initializedShardCount]->maxValueExists)
+	{
+		initializedShardCount++;
+	}
+
+	if (initializedShardCount == 0)
+	{
+		return;
+	}
+
+	int *maxValuePrefixShardIndexArray =
+		MemoryContextAlloc(MetadataCacheMemoryContext,
+						   initializedShardCount * sizeof(int));
+
+	for (int shardIndex = 0; shardIndex < initializedShardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+		ShardInterval *maxValueShardInterval =
+			sortedShardIntervalArray[maxValueShardIndex];
+
+		Datum comparisonDatum =
+			FunctionCall2Coll(cacheEntry->shardIntervalCompareFunction,
+							  cacheEntry->partitionColumn->varcollid,
+							  shardInterval->maxValue,
+							  maxValueShardInterval->maxValue);
+
+		if (DatumGetInt32(comparisonDatum) > 0)
+		{
+			maxValueShardIndex = shardIndex;
+		}
+
+		maxValuePrefixShardIndexArray[shardIndex] = maxValueShardIndex;
+	}
+
+	cacheEntry->maxValuePrefixShardIndexArray = maxValuePrefixShardIndexArray;
+	cacheEntry->initializedShardIntervalCount = initializedShardCount;
+}
+
+
+/*
+ * BuildCachedPlacementArrays() is a helper routine for BuildCachedShardList()
+ * and RefreshCitusTableCacheEntry() building up the placement arrays of the
+ * shards in the cache entry, replacing any placement arrays built before.
+ *
+ * The shards of a table usually have consecutive shard ids, in which case we
+ * read the placements of all shards with a single index scan over the range of
+ * their shard ids, instead of one index scan per shard. For tables with many
+ * shards, that is what makes rebuilding the cache entry after an invalidation
+ * fast. If the shard ids are spread over a much wider range, most of the range
+ * would belong to other tables, and we fall back to one scan per shard.
+ */
+static void
+BuildCachedPlacementArrays(CitusTableCacheEntry *cacheEntry)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int shardIntervalArrayLength = cacheEntry->shardIntervalArrayLength;
+	uint64 minShardId = PG_UINT64_MAX;
+	uint64 maxShardId = 0;
+
+	if (shardIntervalArrayLength == 0)
+	{
+		return;
+	}
+
+	List **placementListArray = palloc0(shardIntervalArrayLength * sizeof(List *));
+
+	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+	{
+		uint64 shardId = sortedShardIntervalArray[shardIndex]->shardId;
+
+		minShardId = Min(minShardId, shardId);
+		maxShardId = Max(maxShardId, shardId);
+	}
+
+	if (maxShardId - minShardId <
+		(uint64) shardIntervalArrayLength * PLACEMENT_RANGE_SCAN_MAX_SPREAD)
+	{
+		List *placementList = BuildShardPlacementListForShardIdRange(minShardId,
+																	 maxShardId);
+
+		GroupShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			bool foundInCache = false;
+			ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+													  &placement->shardId, HASH_FIND,
+													  &foundInCache);
+
+			/* skip placements of other tables' shards in the same range */
+			if (!foundInCache || shardEntry->tableEntry != cacheEntry)
+			{
+				continue;
+			}
+
+			placementListArray[shardEntry->shardIndex] =
+				lappend(placementListArray[shardEntry->shardIndex], placement);
+		}
+	}
+	else
+	{
+		for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+		{
+			ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+
+			placementListArray[shardIndex] = BuildShardPlacementList(shardInterval);
+		}
+	}
+
+	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+	{
+		List *placementList = placementListArray[shardIndex];
 		int numberOfPlacements = list_length(placementList);
+		int placementOffset = 0;
 
-		/* and copy that list into the cache entry */
+		/* copy the list of shard placements into the cache entry */
 		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
 		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
 													  sizeof(GroupShardPlacement));
@@ -1336,15 +1834,16 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		}
 		MemoryContextSwitchTo(oldContext);
 
+		if (cacheEntry->arrayOfPlacementArrays[shardIndex] != NULL)
+		{
+			pfree(cacheEntry->arrayOfPlacementArrays[shardIndex]);
+		}
+
 		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
 		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
-
-		/* store the shard index in the ShardInterval */
-		shardInterval->shardIndex = shardIndex;
 	}
 
-	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
-	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+	pfree(placementListArray);
 }
 
 
@@ -1740,7 +2239,7 @@ MajorVersionsCompatible(char *leftVersion, char *rightVersion)
 /*
  * AvailableExtensionVersion returns the Citus version from citus.control file. It also
  * saves the result, thus consecutive calls to CitusExtensionAvailableVersion will
- * not read the citus.control file again.
+ * not read the citus.control file again, unless the file has been modified since.
  */
 static char *
 AvailableExtensionVersion(void)
@@ -1750,10 +2249,18 @@ AvailableExtensionVersion(void)
 
 	bool goForward = true;
 	bool doCopy = false;
-	char *availableExtensionVersion;
+	time_t controlFileTime = 0;
 
 	InitializeCaches();
 
+	/* pg_available_extensions reads all control files, so avoid calling it */
+	bool controlFileTimeKnown = ExtensionControlFileTime(&controlFileTime);
+	if (availableExtensionVersion != NULL && controlFileTimeKnown &&
+		controlFileTime == availableExtensionControlFileTime)
+	{
+		return availableExtensionVersion;
+	}
+
 	EState *estate = CreateExecutorState();
 	ReturnSetInfo *extensionsResultSet = makeNode(ReturnSetInfo);
 	extensionsResultSet->econtext = GetPerTupleExprContext(estate);
@@ -1786,7 +2293,13 @@ AvailableExtensionVersion(void)
 			MemoryContext oldMemoryContext = MemoryContextSwitchTo(
 				MetadataCacheMemoryContext);
 
+			if (availableExtensionVersion != NULL)
+			{
+				pfree(availableExtensionVersion);
+			}
+
 			availableExtensionVersion = text_to_cstring(DatumGetTextPP(availableVersion));
+			availableExtensionControlFileTime = controlFileTime;
 
 			MemoryContextSwitchTo(oldMemoryContext);
 
@@ -1808,14 +2321,39 @@ AvailableExtensionVersion(void)
 }
 
 
+/*
+ * ExtensionControlFileTime sets modificationTime to the time at which the
+ * citus.control file was last modified, and returns whether that succeeded.
+ */
+static bool
+ExtensionControlFileTime(time_t *modificationTime)
+{
+	char sharePath[MAXPGPATH];
+	char controlFilePath[MAXPGPATH];
+	struct stat controlFileStat;
+
+	get_share_path(my_exec_path, sharePath);
+	snprintf(controlFilePath, MAXPGPATH, "%s/extension/citus.control", sharePath);
+
+	if (stat(controlFilePath, &controlFileStat) != 0)
+	{
+		return false;
+	}
+
+	*modificationTime = controlFileStat.st_mtime;
+
+	return true;
+}
+
+
 /*
  * InstalledExtensionVersion returns the Citus version in PostgreSQL pg_extension table.
+ * The version is only copied into the cache again if the pg_extension row changed.
  */
 static char *
 InstalledExtensionVersion(void)
 {
 	ScanKeyData entry[1];
-	char *installedExtensionVersion = NULL;
 
 	InitializeCaches();
 
@@ -1834,8 +2372,26 @@ InstalledExtensionVersion(void)
 	{
 		int extensionIndex = Anum_pg_extension_extversion;
 		TupleDesc tupleDescriptor = RelationGetDescr(relation);
+		TransactionId extensionXmin = HeapTupleHeaderGetXmin(extensionTuple->t_data);
 		bool isNull = false;
 
+#if PG_VERSION_NUM >= PG_VERSION_12
+		Oid extensionOid = ((Form_pg_extension) GETSTRUCT(extensionTuple))->oid;
+#else
+		Oid extensionOid = HeapTupleGetOid(extensionTuple);
+#endif
+
+		if (installedExtensionVersion != NULL &&
+			extensionOid == installedExtensionOid &&
+			TransactionIdEquals(extensionXmin, installedExtensionXmin))
+		{
+			/* the row did not change since we cached the version */
+			systable_endscan(scandesc);
+			heap_close(relation, AccessShareLock);
+
+			return installedExtensionVersion;
+		}
+
 		Datum installedVersion = heap_getattr(extensionTuple, extensionIndex,
 											  tupleDescriptor, &isNull);
 
@@ -1849,7 +2405,14 @@ InstalledExtensionVersion(void)
 		MemoryContext oldMemoryContext = MemoryContextSwitchTo(
 			MetadataCacheMemoryContext);
 
+		if (installedExtensionVersion != NULL)
+		{
+			pfree(installedExtensionVersion);
+		}
+
 		installedExtensionVersion = text_to_cstring(DatumGetTextPP(installedVersion));
+		installedExtensionOid = extensionOid;
+		installedExtensionXmin = extensionXmin;
 
 		MemoryContextSwitchTo(oldMemoryContext);
 	}
@@ -2844,6 +3407,104 @@ master_dist_object_cache_invalidate(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_preload_metadata_cache fills the metadata caches of the current backend,
+ * such that the first queries it runs do not pay for building them. It checks
+ * the extension version, builds the worker node cache, and builds the cache
+ * entries of the tables listed in citus.metadata_cache_preload_tables. It is
+ * meant to be run by connection poolers when they open a server connection.
+ * Returns the number of Citus tables whose cache entries were built.
+ */
+Datum
+citus_preload_metadata_cache(PG_FUNCTION_ARGS)
+{
+	int preloadedTableCount = 0;
+
+	CheckCitusVersion(ERROR);
+
+	PrepareWorkerNodeCache();
+	GetLocalGroupId();
+
+	List *relationIdList = PreloadRelationIdList();
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		CitusTableCacheEntry *cacheEntry = LookupCitusTableCacheEntry(relationId);
+		if (cacheEntry == NULL || !cacheEntry->isCitusTable)
+		{
+			continue;
+		}
+
+		preloadedTableCount++;
+	}
+
+	PG_RETURN_INT32(preloadedTableCount);
+}
+
+
+/*
+ * PreloadRelationIdList returns the OIDs of the relations in the comma-separated
+ * list of citus.metadata_cache_preload_tables, or of all Citus tables if the
+ * list is '*'. Relations that do not exist are skipped, since the setting
+ * usually applies to all databases.
+ */
+static List *
+PreloadRelationIdList(void)
+{
+	List *relationIdList = NIL;
+	bool inQuotes = false;
+
+	if (strcmp(MetadataCachePreloadTables, "*") == 0)
+	{
+		return DistTableOidList();
+	}
+
+	char *tableNames = pstrdup(MetadataCachePreloadTables);
+	char *tableName = tableNames;
+
+	for (char *character = tableNames; ; character++)
+	{
+		if (*character == '"')
+		{
+			inQuotes = !inQuotes;
+			continue;
+		}
+
+		if (*character != '\0' && (*character != ',' || inQuotes))
+		{
+			continue;
+		}
+
+		bool isLastTable = (*character == '\0');
+		*character = '\0';
+
+		/* stringToQualifiedNameList handles whitespace around the names */
+		if (strspn(tableName, " \t\n\r") < strlen(tableName))
+		{
+			List *qualifiedName = stringToQualifiedNameList(tableName);
+			RangeVar *rangeVar = makeRangeVarFromNameList(qualifiedName);
+			bool missingOK = true;
+
+			Oid relationId = RangeVarGetRelid(rangeVar, NoLock, missingOK);
+			if (OidIsValid(relationId))
+			{
+				relationIdList = lappend_oid(relationIdList, relationId);
+			}
+		}
+
+		if (isLastTable)
+		{
+			break;
+		}
+
+		tableName = character + 1;
+	}
+
+	return relationIdList;
+}
+
+
 /*
  * InitializeCaches() registers invalidation handlers for metadata_cache.c's
  * caches.
@@ -3110,6 +3771,11 @@ InitializeWorkerNodeCache(void)
 		pfree(currentNode);
 	}
 
+	WorkerNode **newWorkerNodeGroupArray = NULL;
+	HTAB *newWorkerNodeGroupHash = CreateWorkerNodeGroupHash(newWorkerNodeArray,
+															 newWorkerNodeCount,
+															 &newWorkerNodeGroupArray);
+
 	/* now, safe to destroy the old hash */
 	hash_destroy(WorkerNodeHash);
 
@@ -3118,9 +3784,88 @@ InitializeWorkerNodeCache(void)
 		pfree(WorkerNodeArray);
 	}
 
+	hash_destroy(WorkerNodeGroupHash);
+
+	if (WorkerNodeGroupArray != NULL)
+	{
+		pfree(WorkerNodeGroupArray);
+	}
+
 	WorkerNodeCount = newWorkerNodeCount;
 	WorkerNodeArray = newWorkerNodeArray;
 	WorkerNodeHash = newWorkerNodeHash;
+	WorkerNodeGroupArray = newWorkerNodeGroupArray;
+	WorkerNodeGroupHash = newWorkerNodeGroupHash;
+}
+
+
+/*
+ * CreateWorkerNodeGroupHash creates a hash that maps each group ID to the nodes
+ * of that group in the given worker node array. The nodes of all groups are
+ * stored in a single array, which is returned in groupNodeArray and in which
+ * each hash entry points to the range of its group.
+ */
+static HTAB *
+CreateWorkerNodeGroupHash(WorkerNode **workerNodeArray, int workerNodeCount,
+						  WorkerNode ***groupNodeArray)
+{
+	HASHCTL info;
+	HASH_SEQ_STATUS status;
+	int groupNodeIndex = 0;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int32);
+	info.entrysize = sizeof(WorkerNodeGroupEntry);
+	info.hcxt = MetadataCacheMemoryContext;
+	int hashFlags = HASH_ELEM | HASH_BLOBS | HASH_CONTEXT;
+
+	HTAB *groupHash = hash_create("Worker Node Group Hash", 32, &info, hashFlags);
+
+	/* first count the nodes in each group */
+	for (int workerNodeIndex = 0; workerNodeIndex < workerNodeCount; workerNodeIndex++)
+	{
+		WorkerNode *workerNode = workerNodeArray[workerNodeIndex];
+		bool found = false;
+
+		WorkerNodeGroupEntry *groupEntry = hash_search(groupHash, &workerNode->groupId,
+													   HASH_ENTER, &found);
+		if (!found)
+		{
+			groupEntry->nodeCount = 0;
+		}
+
+		groupEntry->nodeCount++;
+	}
+
+	WorkerNode **nodeArray = MemoryContextAlloc(MetadataCacheMemoryContext,
+												sizeof(WorkerNode *) * workerNodeCount);
+
+	/* then give each group its range of the array */
+	hash_seq_init(&status, groupHash);
+
+	WorkerNodeGroupEntry *groupEntry = NULL;
+	while ((groupEntry = hash_seq_search(&status)) != NULL)
+	{
+		groupEntry->nodeArray = &nodeArray[groupNodeIndex];
+		groupNodeIndex += groupEntry->nodeCount;
+		groupEntry->nodeCount = 0;
+	}
+
+	/* finally fill the ranges, keeping the order of the worker node array */
+	for (int workerNodeIndex = 0; workerNodeIndex < workerNodeCount; workerNodeIndex++)
+	{
+		WorkerNode *workerNode = workerNodeArray[workerNodeIndex];
+		bool found = false;
+
+		groupEntry = hash_search(groupHash, &workerNode->groupId, HASH_FIND, &found);
+		Assert(found);
+
+		groupEntry->nodeArray[groupEntry->nodeCount++] = workerNode;
+	}
+
+	*groupNodeArray = nodeArray;
+
+	return groupHash;
 }
 
 
@@ -3284,6 +4029,12 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		cacheEntry->partitionColumn = NULL;
 	}
 
+	if (cacheEntry->copySerializationPlan != NULL)
+	{
+		FreeCopySerializationPlan(cacheEntry->copySerializationPlan);
+		cacheEntry->copySerializationPlan = NULL;
+	}
+
 	if (cacheEntry->shardIntervalArrayLength == 0)
 	{
 		return;
@@ -3332,6 +4083,21 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		pfree(cacheEntry->sortedShardIntervalArray);
 		cacheEntry->sortedShardIntervalArray = NULL;
 	}
+	if (cacheEntry->maxValuePrefixShardIndexArray)
+	{
+		pfree(cacheEntry->maxValuePrefixShardIndexArray);
+		cacheEntry->maxValuePrefixShardIndexArray = NULL;
+	}
+	if (cacheEntry->sortedShardMinValues)
+	{
+		pfree(cacheEntry->sortedShardMinValues);
+		cacheEntry->sortedShardMinValues = NULL;
+	}
+	if (cacheEntry->sortedShardMaxValues)
+	{
+		pfree(cacheEntry->sortedShardMaxValues);
+		cacheEntry->sortedShardMaxValues = NULL;
+	}
 	if (cacheEntry->arrayOfPlacementArrayLengths)
 	{
 		pfree(cacheEntry->arrayOfPlacementArrayLengths);
@@ -3356,7 +4122,9 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 	cacheEntry->shardIntervalArrayLength = 0;
 	cacheEntry->hasUninitializedShardInterval = false;
 	cacheEntry->hasUniformHashDistribution = false;
+	cacheEntry->uniformHashShardIndexShift = -1;
 	cacheEntry->hasOverlappingShardInterval = false;
+	cacheEntry->initializedShardIntervalCount = 0;
 }
 
 
@@ -3392,6 +4160,9 @@ InvalidateForeignRelationGraphCacheCallback(Datum argument, Oid relationId)
 void
 InvalidateForeignKeyGraph(void)
 {
+	/* other backends can use the shared graph again once we commit */
+	MarkForeignConstraintRelationshipGraphChanged();
+
 	CitusInvalidateRelcacheByRelid(DistColocationRelationId());
 
 	/* bump command counter to force invalidation to take effect */
@@ -3406,11 +4177,22 @@ InvalidateForeignKeyGraph(void)
 static void
 InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 {
+	/* cached fast-path and multi-shard plans depend on the relation as well */
+	InvalidateFastPathPlanCache(relationId);
+	InvalidateMultiShardPlanCache(relationId);
+
+	/* so do the recorded parallel accesses to partitions */
+	InvalidateParallelRelationAccessCache(relationId);
+
+	/* and whether relations are shards, which depends on their names */
+	InvalidateKnownShardCache(relationId);
+
 	/* invalidate either entire cache or a specific entry */
 	if (relationId == InvalidOid)
 	{
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
+		InvalidateWorkerPreparedStatements();
 	}
 	else
 	{
@@ -3423,6 +4205,9 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (foundInCache)
 		{
 			cacheEntry->isValid = false;
+
+			/* statements prepared on the shards may depend on the definition */
+			InvalidateWorkerPreparedStatements();
 		}
 
 		/*
@@ -4046,6 +4831,9 @@ CitusInvalidateRelcacheByRelid(Oid relationId)
 		CacheInvalidateRelcacheByTuple(classTuple);
 		ReleaseSysCache(classTuple);
 	}
+
+	/* metadata changed, so tell drivers to refresh their cached shard map */
+	NotifyShardMapChanged();
 }
 
 
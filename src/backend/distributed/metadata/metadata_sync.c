@@ -43,6 +43,7 @@
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
 #include "distributed/version_compat.h"
+#include "executor/spi.h"
 #include "foreign/foreign.h"
 #include "miscadmin.h"
 #include "nodes/pg_list.h"
@@ -54,6 +55,10 @@
 #include "utils/syscache.h"
 
 
+/* size above which a batch of metadata commands is sent to the worker */
+#define METADATA_COMMAND_BATCH_SIZE (1024 * 1024)
+
+
 static char * LocalGroupIdUpdateCommand(int32 groupId);
 static void UpdateDistNodeBoolAttr(const char *nodeName, int32 nodePort,
 								   int attrNum, bool value);
@@ -63,6 +68,11 @@ static char * SchemaOwnerName(Oid objectId);
 static bool HasMetadataWorkers(void);
 static List * DetachPartitionCommandList(void);
 static bool SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError);
+static List * MetadataCommandBatchList(List *commandList);
+static bool SyncMetadataDeltaToNode(WorkerNode *workerNode, List *deltaCommandList);
+static List * MetadataDeltaCommandList(int32 nodeId);
+static void ExecuteMetadataDeltaQuery(char *query, int paramCount, Oid *paramTypes,
+									  Datum *paramValues, bool readOnly);
 static List * GenerateGrantOnSchemaQueriesFromAclItem(Oid schemaOid,
 													  AclItem *aclItem);
 static GrantStmt * GenerateGrantOnSchemaStmtForRights(Oid roleOid,
@@ -269,6 +279,10 @@ SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 	recreateMetadataSnapshotCommandList = list_concat(recreateMetadataSnapshotCommandList,
 													  createMetadataCommandList);
 
+	/* save a round trip per command, syncing thousands of tables */
+	recreateMetadataSnapshotCommandList =
+		MetadataCommandBatchList(recreateMetadataSnapshotCommandList);
+
 	/*
 	 * Send the snapshot recreation commands in a single remote transaction and
 	 * if requested, error out in any kind of failure. Note that it is not
@@ -295,6 +309,62 @@ SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 }
 
 
+/*
+ * SyncMetadataDeltaToNode applies the metadata changes that were recorded for
+ * the given node while it was out of sync, instead of recreating its whole
+ * metadata snapshot. It returns false if the changes could not be applied.
+ */
+static bool
+SyncMetadataDeltaToNode(WorkerNode *workerNode, List *deltaCommandList)
+{
+	char *extensionOwner = CitusExtensionOwnerName();
+
+	return SendOptionalCommandListToWorkerInTransaction(workerNode->workerName,
+														workerNode->workerPort,
+														extensionOwner,
+														MetadataCommandBatchList(
+															deltaCommandList));
+}
+
+
+/*
+ * MetadataCommandBatchList concatenates the given commands into multi-statement
+ * query strings of around METADATA_COMMAND_BATCH_SIZE bytes, keeping their
+ * order. Sending a metadata snapshot one command at a time costs a round trip
+ * for each of them, which adds up to minutes with many distributed tables.
+ */
+static List *
+MetadataCommandBatchList(List *commandList)
+{
+	List *commandBatchList = NIL;
+	StringInfo commandBatch = makeStringInfo();
+
+	const char *command = NULL;
+	foreach_ptr(command, commandList)
+	{
+		if (commandBatch->len > 0)
+		{
+			appendStringInfoChar(commandBatch, ';');
+		}
+
+		appendStringInfoString(commandBatch, command);
+
+		if (commandBatch->len >= METADATA_COMMAND_BATCH_SIZE)
+		{
+			commandBatchList = lappend(commandBatchList, commandBatch->data);
+			commandBatch = makeStringInfo();
+		}
+	}
+
+	if (commandBatch->len > 0)
+	{
+		commandBatchList = lappend(commandBatchList, commandBatch->data);
+	}
+
+	return commandBatchList;
+}
+
+
 /*
  * SendOptionalCommandListToWorkerInTransaction sends the given command list to
  * the given worker in a single transaction. If any of the commands fail, it
@@ -313,11 +383,14 @@ SendOptionalCommandListToWorkerInTransaction(const char *nodeName, int32 nodePor
 
 	RemoteTransactionBegin(workerConnection);
 
-	/* iterate over the commands and execute them in the same connection */
+	/*
+	 * Iterate over the commands and execute them in the same connection. A
+	 * command may consist of multiple statements, so check all their results.
+	 */
 	const char *commandString = NULL;
 	foreach_ptr(commandString, commandList)
 	{
-		if (ExecuteOptionalRemoteCommand(workerConnection, commandString, NULL) != 0)
+		if (ExecuteRemoteCommandBatch(workerConnection, commandString, WARNING) != 0)
 		{
 			failed = true;
 			break;
@@ -877,6 +950,24 @@ NodeStateUpdateCommand(uint32 nodeId, bool isActive)
 }
 
 
+/*
+ * NodeLocationUpdateCommand generates a command that can be executed to update
+ * the name and port of the given node in pg_dist_node.
+ */
+char *
+NodeLocationUpdateCommand(uint32 nodeId, const char *nodeName, int32 nodePort)
+{
+	StringInfo nodeLocationUpdateCommand = makeStringInfo();
+
+	appendStringInfo(nodeLocationUpdateCommand,
+					 "UPDATE pg_dist_node SET nodename = %s, nodeport = %d "
+					 "WHERE nodeid = %u", quote_literal_cstr(nodeName), nodePort,
+					 nodeId);
+
+	return nodeLocationUpdateCommand->data;
+}
+
+
 /*
  * ShouldHaveShardsUpdateCommand generates a command that can be executed to
  * update the shouldhaveshards column of a node in pg_dist_node table.
@@ -971,6 +1062,16 @@ MarkNodeMetadataSynced(const char *nodeName, int32 nodePort, bool synced)
 	UpdateDistNodeBoolAttr(nodeName, nodePort,
 						   Anum_pg_dist_node_metadatasynced,
 						   synced);
+
+	/*
+	 * Recorded changes are obsolete once the node is synced, and must not be
+	 * applied on their own once it stops receiving metadata changes.
+	 */
+	WorkerNode *workerNode = FindWorkerNodeAnyCluster(nodeName, nodePort);
+	if (workerNode != NULL)
+	{
+		DeleteMetadataDeltas(workerNode->nodeId);
+	}
 }
 
 
@@ -1379,8 +1480,20 @@ SyncMetadataToNodes(void)
 		if (workerNode->hasMetadata && !workerNode->metadataSynced)
 		{
 			bool raiseInterrupts = false;
+			bool synced = false;
+
+			/* fall back to a full snapshot if no changes were recorded */
+			List *deltaCommandList = MetadataDeltaCommandList(workerNode->nodeId);
+			if (deltaCommandList != NIL)
+			{
+				synced = SyncMetadataDeltaToNode(workerNode, deltaCommandList);
+			}
+			else
+			{
+				synced = SyncMetadataSnapshotToNode(workerNode, raiseInterrupts);
+			}
 
-			if (!SyncMetadataSnapshotToNode(workerNode, raiseInterrupts))
+			if (!synced)
 			{
 				result = METADATA_SYNC_FAILED_SYNC;
 			}
@@ -1394,3 +1507,146 @@ SyncMetadataToNodes(void)
 
 	return result;
 }
+
+
+/*
+ * RecordMetadataDelta records the given metadata change for the metadata nodes
+ * that have fallen behind, such that the maintenance daemon can sync them by
+ * only applying their recorded changes rather than a full metadata snapshot.
+ *
+ * unsyncedNodeIdList contains the nodes that were in sync until this change.
+ * Nodes that were already out of sync get the change only if they have changes
+ * recorded, otherwise they need a full snapshot anyway. changedNodeId is the
+ * node the change is about, or 0. Its metadata might be in a different state
+ * after the change, so it always falls back to a full snapshot.
+ */
+void
+RecordMetadataDelta(List *unsyncedNodeIdList, int32 changedNodeId, char *command)
+{
+	Oid appendParamTypes[2] = { INT4OID, TEXTOID };
+	Datum appendParamValues[2] = {
+		Int32GetDatum(changedNodeId),
+		CStringGetTextDatum(command)
+	};
+	bool readOnly = false;
+
+	ExecuteMetadataDeltaQuery("INSERT INTO pg_catalog.pg_dist_metadata_delta "
+							  "(nodeid, command) "
+							  "SELECT DISTINCT nodeid, $2 "
+							  "FROM pg_catalog.pg_dist_metadata_delta "
+							  "WHERE nodeid <> $1",
+							  2, appendParamTypes, appendParamValues, readOnly);
+
+	if (changedNodeId != 0)
+	{
+		DeleteMetadataDeltas(changedNodeId);
+	}
+
+	int32 nodeId = 0;
+	foreach_int(nodeId, unsyncedNodeIdList)
+	{
+		if (nodeId == changedNodeId)
+		{
+			continue;
+		}
+
+		appendParamValues[0] = Int32GetDatum(nodeId);
+
+		ExecuteMetadataDeltaQuery("INSERT INTO pg_catalog.pg_dist_metadata_delta "
+								  "(nodeid, command) VALUES ($1, $2)",
+								  2, appendParamTypes, appendParamValues, readOnly);
+	}
+}
+
+
+/*
+ * MetadataDeltaCommandList returns the metadata changes recorded for the given
+ * node in the order they were made, or NIL if there are none.
+ */
+static List *
+MetadataDeltaCommandList(int32 nodeId)
+{
+	List *deltaCommandList = NIL;
+	Oid paramTypes[1] = { INT4OID };
+	Datum paramValues[1] = { Int32GetDatum(nodeId) };
+	MemoryContext callerContext = CurrentMemoryContext;
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	int spiStatus = SPI_execute_with_args("SELECT command "
+										  "FROM pg_catalog.pg_dist_metadata_delta "
+										  "WHERE nodeid = $1 ORDER BY deltaid",
+										  1, paramTypes, paramValues, NULL, true, 0);
+	if (spiStatus != SPI_OK_SELECT)
+	{
+		ereport(ERROR, (errmsg("could not read the metadata changes of node %d",
+							   nodeId)));
+	}
+
+	for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
+	{
+		char *command = SPI_getvalue(SPI_tuptable->vals[rowIndex],
+									 SPI_tuptable->tupdesc, 1);
+
+		MemoryContext spiContext = MemoryContextSwitchTo(callerContext);
+		deltaCommandList = lappend(deltaCommandList, pstrdup(command));
+		MemoryContextSwitchTo(spiContext);
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	return deltaCommandList;
+}
+
+
+/*
+ * DeleteMetadataDeltas removes the metadata changes recorded for the given node.
+ */
+void
+DeleteMetadataDeltas(int32 nodeId)
+{
+	Oid paramTypes[1] = { INT4OID };
+	Datum paramValues[1] = { Int32GetDatum(nodeId) };
+	bool readOnly = false;
+
+	ExecuteMetadataDeltaQuery("DELETE FROM pg_catalog.pg_dist_metadata_delta "
+							  "WHERE nodeid = $1",
+							  1, paramTypes, paramValues, readOnly);
+}
+
+
+/*
+ * ExecuteMetadataDeltaQuery executes a query that modifies pg_dist_metadata_delta
+ * via SPI.
+ */
+static void
+ExecuteMetadataDeltaQuery(char *query, int paramCount, Oid *paramTypes,
+						  Datum *paramValues, bool readOnly)
+{
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	int spiStatus = SPI_execute_with_args(query, paramCount, paramTypes, paramValues,
+										  NULL, readOnly, 0);
+	if (spiStatus < 0)
+	{
+		ereport(ERROR, (errmsg("could not update pg_dist_metadata_delta")));
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+}
@@ -97,16 +97,18 @@ static void InsertNodeRow(int nodeid, char *nodename, int32 nodeport, NodeMetada
 static void DeleteNodeRow(char *nodename, int32 nodeport);
 static void SetUpDistributedTableDependencies(WorkerNode *workerNode);
 static WorkerNode * TupleToWorkerNode(TupleDesc tupleDescriptor, HeapTuple heapTuple);
-static void PropagateNodeWideObjects(WorkerNode *newWorkerNode);
+static void PropagateObjectsToNode(WorkerNode *newWorkerNode);
+static List * NodeWideObjectCommandList(void);
 static WorkerNode * ModifiableWorkerNode(const char *nodeName, int32 nodePort);
 static void UpdateNodeLocation(int32 nodeId, char *newNodeName, int32 newNodePort);
-static bool UnsetMetadataSyncedForAll(void);
+static bool UnsetMetadataSyncedForAll(int32 changedNodeId, char *deltaCommand);
 static WorkerNode * SetShouldHaveShards(WorkerNode *workerNode, bool shouldHaveShards);
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_add_node);
 PG_FUNCTION_INFO_V1(master_add_inactive_node);
 PG_FUNCTION_INFO_V1(master_add_secondary_node);
+PG_FUNCTION_INFO_V1(master_set_coordinator_host);
 PG_FUNCTION_INFO_V1(master_set_node_property);
 PG_FUNCTION_INFO_V1(master_remove_node);
 PG_FUNCTION_INFO_V1(master_disable_node);
@@ -249,6 +251,86 @@ master_add_secondary_node(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * master_set_coordinator_host adds the coordinator to pg_dist_node under the
+ * given address, or moves its existing entry to that address. Once the
+ * coordinator is in the metadata, it gets a placement of every reference
+ * table, and queries on the coordinator that join reference tables with
+ * local tables use the local placements through local execution rather
+ * than fetching the reference tables from the workers.
+ *
+ * The coordinator does not get shards of distributed tables, unless they are
+ * enabled using master_set_node_property.
+ */
+Datum
+master_set_coordinator_host(PG_FUNCTION_ARGS)
+{
+	text *nodeName = PG_GETARG_TEXT_P(0);
+	int32 nodePort = PG_GETARG_INT32(1);
+	char *nodeNameString = text_to_cstring(nodeName);
+	Name nodeClusterName = PG_GETARG_NAME(3);
+
+	NodeMetadata nodeMetadata = DefaultNodeMetadata();
+	nodeMetadata.groupId = COORDINATOR_GROUP_ID;
+	nodeMetadata.nodeRole = PG_GETARG_OID(2);
+	nodeMetadata.nodeCluster = NameStr(*nodeClusterName);
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	/* take an exclusive lock on pg_dist_node to serialize pg_dist_node changes */
+	LockRelationOid(DistNodeRelationId(), ExclusiveLock);
+
+	WorkerNode *coordinatorNode = PrimaryNodeForGroup(COORDINATOR_GROUP_ID, NULL);
+	if (coordinatorNode == NULL)
+	{
+		bool nodeAlreadyExists = false;
+
+		AddNodeMetadata(nodeNameString, nodePort, &nodeMetadata, &nodeAlreadyExists);
+		if (nodeAlreadyExists)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("there is already a worker node with the "
+								   "specified hostname and port")));
+		}
+
+		TransactionModifiedNodeMetadata = true;
+
+		/* replicates the reference tables to the coordinator */
+		ActivateNode(nodeNameString, nodePort);
+	}
+	else if (strcmp(coordinatorNode->workerName, nodeNameString) != 0 ||
+			 coordinatorNode->workerPort != nodePort)
+	{
+		int32 nodeId = coordinatorNode->nodeId;
+
+		if (FindWorkerNodeAnyCluster(nodeNameString, nodePort) != NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("there is already another node with the "
+								   "specified hostname and port")));
+		}
+
+		/* cached plans may point at the old location of the placements */
+		ResetPlanCache();
+
+		UpdateNodeLocation(nodeId, nodeNameString, nodePort);
+
+		char *nodeLocationUpdateCommand = NodeLocationUpdateCommand(nodeId,
+																	nodeNameString,
+																	nodePort);
+		if (UnsetMetadataSyncedForAll(nodeId, nodeLocationUpdateCommand))
+		{
+			TriggerMetadataSync(MyDatabaseId);
+		}
+
+		TransactionModifiedNodeMetadata = true;
+	}
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * master_remove_node function removes the provided node from the pg_dist_node table of
  * the master node and all nodes with metadata.
@@ -393,9 +475,7 @@ SetUpDistributedTableDependencies(WorkerNode *newWorkerNode)
 
 		if (ShouldPropagate() && !NodeIsCoordinator(newWorkerNode))
 		{
-			PropagateNodeWideObjects(newWorkerNode);
-			ReplicateAllDependenciesToNode(newWorkerNode->workerName,
-										   newWorkerNode->workerPort);
+			PropagateObjectsToNode(newWorkerNode);
 		}
 		else if (!NodeIsCoordinator(newWorkerNode))
 		{
@@ -429,12 +509,43 @@ SetUpDistributedTableDependencies(WorkerNode *newWorkerNode)
 
 
 /*
- * PropagateNodeWideObjects is called during node activation to propagate any object that
- * should be propagated for every node. These are generally not linked to any distributed
- * object but change system wide behaviour.
+ * PropagateObjectsToNode creates the node wide objects and the distributed
+ * objects on a newly activated node. The commands are in dependency order, so
+ * we send all of them as a single batch in one transaction, rather than one
+ * command at a time, which makes activation much faster when there are many
+ * objects.
  */
 static void
-PropagateNodeWideObjects(WorkerNode *newWorkerNode)
+PropagateObjectsToNode(WorkerNode *newWorkerNode)
+{
+	List *ddlCommands = NodeWideObjectCommandList();
+	List *dependencyCommands =
+		DependencyCreateCommandListForNode(newWorkerNode->workerName,
+										   newWorkerNode->workerPort);
+
+	ddlCommands = list_concat(ddlCommands, dependencyCommands);
+	if (list_length(ddlCommands) <= 0)
+	{
+		/* no commands to replicate to the new worker */
+		return;
+	}
+
+	/* since we are executing ddl commands lets disable propagation, primarily for mx */
+	ddlCommands = lcons(DISABLE_DDL_PROPAGATION, ddlCommands);
+
+	SendCommandListToWorkerInSingleBatch(newWorkerNode->workerName,
+										 newWorkerNode->workerPort,
+										 CitusExtensionOwnerName(), ddlCommands);
+}
+
+
+/*
+ * NodeWideObjectCommandList returns the commands to propagate any object that
+ * should be propagated for every node. These are generally not linked to any
+ * distributed object but change system wide behaviour.
+ */
+static List *
+NodeWideObjectCommandList(void)
 {
 	/* collect all commands */
 	List *ddlCommands = NIL;
@@ -449,18 +560,7 @@ PropagateNodeWideObjects(WorkerNode *newWorkerNode)
 		ddlCommands = list_concat(ddlCommands, alterRoleSetCommands);
 	}
 
-	if (list_length(ddlCommands) > 0)
-	{
-		/* if there are command wrap them in enable_ddl_propagation off */
-		ddlCommands = lcons(DISABLE_DDL_PROPAGATION, ddlCommands);
-		ddlCommands = lappend(ddlCommands, ENABLE_DDL_PROPAGATION);
-
-		/* send commands to new workers*/
-		SendCommandListToWorkerInSingleTransaction(newWorkerNode->workerName,
-												   newWorkerNode->workerPort,
-												   CitusExtensionOwnerName(),
-												   ddlCommands);
-	}
+	return ddlCommands;
 }
 
 
@@ -565,12 +665,14 @@ NodeIsSecondary(WorkerNode *worker)
 
 /*
  * NodeIsReadable returns whether we're allowed to send SELECT queries to this
- * node.
+ * node. In lag-aware mode, placements resolve to primaries and the executor
+ * picks secondaries for reads itself.
  */
 bool
 NodeIsReadable(WorkerNode *workerNode)
 {
-	if (ReadFromSecondaries == USE_SECONDARY_NODES_NEVER &&
+	if ((ReadFromSecondaries == USE_SECONDARY_NODES_NEVER ||
+		 ReadFromSecondaries == USE_SECONDARY_NODES_LAG_AWARE) &&
 		NodeIsPrimary(workerNode))
 	{
 		return true;
@@ -767,8 +869,14 @@ master_update_node(PG_FUNCTION_ARGS)
 	 * It is possible that maintenance daemon does the first resync too
 	 * early, but that's fine, since this will start a retry loop with
 	 * 5 second intervals until sync is complete.
+	 *
+	 * The other metadata nodes only need the new location, so we record
+	 * it as a delta for them instead of having them resync all metadata.
 	 */
-	if (UnsetMetadataSyncedForAll())
+	char *nodeLocationUpdateCommand = NodeLocationUpdateCommand(nodeId,
+																newNodeNameString,
+																newNodePort);
+	if (UnsetMetadataSyncedForAll(nodeId, nodeLocationUpdateCommand))
 	{
 		TriggerMetadataSync(MyDatabaseId);
 	}
@@ -1070,6 +1178,7 @@ RemoveNodeFromCluster(char *nodeName, int32 nodePort)
 	}
 
 	DeleteNodeRow(workerNode->workerName, nodePort);
+	DeleteMetadataDeltas(workerNode->nodeId);
 
 	char *nodeDeleteCommand = NodeDeleteCommand(workerNode->nodeId);
 
@@ -1613,12 +1722,14 @@ DatumToString(Datum datum, Oid dataType)
 
 /*
  * UnsetMetadataSyncedForAll sets the metadatasynced column of all metadata
- * nodes to false. It returns true if it updated at least a node.
+ * nodes to false, and records deltaCommand as the change they need to apply
+ * to get back in sync. It returns true if it updated at least a node.
  */
 static bool
-UnsetMetadataSyncedForAll(void)
+UnsetMetadataSyncedForAll(int32 changedNodeId, char *deltaCommand)
 {
 	bool updatedAtLeastOne = false;
+	List *unsyncedNodeIdList = NIL;
 	ScanKeyData scanKey[2];
 	int scanKeyCount = 2;
 	bool indexOK = false;
@@ -1660,6 +1771,9 @@ UnsetMetadataSyncedForAll(void)
 		values[Anum_pg_dist_node_metadatasynced - 1] = BoolGetDatum(false);
 		replace[Anum_pg_dist_node_metadatasynced - 1] = true;
 
+		WorkerNode *workerNode = TupleToWorkerNode(tupleDescriptor, heapTuple);
+		unsyncedNodeIdList = lappend_int(unsyncedNodeIdList, workerNode->nodeId);
+
 		HeapTuple newHeapTuple = heap_modify_tuple(heapTuple, tupleDescriptor, values,
 												   isnull,
 												   replace);
@@ -1678,5 +1792,7 @@ UnsetMetadataSyncedForAll(void)
 	CatalogCloseIndexes(indstate);
 	heap_close(relation, NoLock);
 
+	RecordMetadataDelta(unsyncedNodeIdList, changedNodeId, deltaCommand);
+
 	return updatedAtLeastOne;
 }
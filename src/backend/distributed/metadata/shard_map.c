@@ -0,0 +1,364 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_map.c
+ *   Exports the mapping of hash-distributed shards to the nodes that hold
+ *   them, such that client drivers can cache it and send single-shard
+ *   queries straight to a worker with metadata instead of going through the
+ *   coordinator.
+ *
+ *   Drivers fetch the map with citus_shard_map() and check whether their
+ *   copy is current with citus_shard_map_version(), or LISTEN on the
+ *   citus_shard_map channel, which is notified whenever the metadata
+ *   changes. citus_shard_map_lookup() maps many distribution values to
+ *   nodes in one call, for drivers that do not hash values themselves.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "commands/async.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/shard_map.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/tuplestore.h"
+#include "utils/array.h"
+#include "utils/hashutils.h"
+#include "utils/lsyscache.h"
+
+
+/* channel that is notified when the shard map may have changed */
+#define SHARD_MAP_CHANNEL "citus_shard_map"
+
+#define SHARD_MAP_COLUMNS 6
+#define SHARD_MAP_LOOKUP_COLUMNS 3
+
+
+/* a shard of a hash-distributed table and the node that serves it */
+typedef struct ShardMapEntry
+{
+	Oid relationId;
+	uint32 colocationId;
+	uint64 shardId;
+	int32 minValue;
+	int32 maxValue;
+
+	/* node of the first active placement, 0 if there is none */
+	int32 nodeId;
+} ShardMapEntry;
+
+
+static List * ShardMapEntryList(void);
+static int32 ShardMapNodeId(uint64 shardId);
+static uint64 ShardMapEntryHash(ShardMapEntry *entry);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(citus_shard_map);
+PG_FUNCTION_INFO_V1(citus_shard_map_version);
+PG_FUNCTION_INFO_V1(citus_shard_map_lookup);
+
+
+/*
+ * citus_shard_map returns a row for every shard of every hash-distributed
+ * table, with its hash range and the node of its first active placement.
+ * Reference tables are left out, since any node can serve them.
+ */
+Datum
+citus_shard_map(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	List *shardMapEntryList = ShardMapEntryList();
+
+	ShardMapEntry *entry = NULL;
+	foreach_ptr(entry, shardMapEntryList)
+	{
+		Datum values[SHARD_MAP_COLUMNS];
+		bool isNulls[SHARD_MAP_COLUMNS];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = ObjectIdGetDatum(entry->relationId);
+		values[1] = UInt32GetDatum(entry->colocationId);
+		values[2] = UInt64GetDatum(entry->shardId);
+		values[3] = Int32GetDatum(entry->minValue);
+		values[4] = Int32GetDatum(entry->maxValue);
+
+		if (entry->nodeId != 0)
+		{
+			values[5] = Int32GetDatum(entry->nodeId);
+		}
+		else
+		{
+			isNulls[5] = true;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_map_version returns a version of the shard map that changes
+ * whenever citus_shard_map() would return a different map. The version does
+ * not depend on table OIDs, so all nodes with metadata return the same one.
+ */
+Datum
+citus_shard_map_version(PG_FUNCTION_ARGS)
+{
+	uint64 mapVersion = 0;
+
+	CheckCitusVersion(ERROR);
+
+	List *shardMapEntryList = ShardMapEntryList();
+
+	/* sum up the hashes of the entries, such that their order does not matter */
+	ShardMapEntry *entry = NULL;
+	foreach_ptr(entry, shardMapEntryList)
+	{
+		mapVersion += ShardMapEntryHash(entry);
+	}
+
+	PG_RETURN_INT64((int64) mapVersion);
+}
+
+
+/*
+ * citus_shard_map_lookup maps each of the given distribution values of the
+ * given table to its shard and the node of the first active placement of
+ * that shard. Values are identified by their position in the array, rows
+ * with NULL values or without a matching shard have NULL shard and node.
+ * For reference tables, the node is NULL as well, since any node can serve
+ * them.
+ */
+Datum
+citus_shard_map_lookup(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum *valueArray = NULL;
+	bool *valueNullArray = NULL;
+	int valueCount = 0;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+
+	CheckCitusVersion(ERROR);
+
+	Oid relationId = PG_GETARG_OID(0);
+	ArrayType *distributionValues = PG_GETARG_ARRAYTYPE_P(1);
+
+	EnsureTablePermissions(relationId, ACL_SELECT);
+
+	if (!IsCitusTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+						errmsg("relation is not distributed")));
+	}
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	char distributionMethod = cacheEntry->partitionMethod;
+	if (distributionMethod != DISTRIBUTE_BY_HASH &&
+		distributionMethod != DISTRIBUTE_BY_RANGE &&
+		distributionMethod != DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("finding shard id of given distribution value is only "
+							   "supported for hash partitioned tables, range partitioned "
+							   "tables and reference tables.")));
+	}
+
+	Oid valueType = ARR_ELEMTYPE(distributionValues);
+	get_typlenbyvalalign(valueType, &typeLength, &typeByValue, &typeAlignment);
+	deconstruct_array(distributionValues, valueType, typeLength, typeByValue,
+					  typeAlignment, &valueArray, &valueNullArray, &valueCount);
+
+	Oid distributionType = InvalidOid;
+	if (distributionMethod != DISTRIBUTE_BY_NONE)
+	{
+		distributionType = cacheEntry->partitionColumn->vartype;
+	}
+
+	/* node IDs of the shards that we looked up so far, 0 if not looked up yet */
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	int32 *shardNodeIdArray = palloc0(Max(shardCount, 1) * sizeof(int32));
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	for (int valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		Datum values[SHARD_MAP_LOOKUP_COLUMNS];
+		bool isNulls[SHARD_MAP_LOOKUP_COLUMNS];
+		ShardInterval *shardInterval = NULL;
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, true, sizeof(isNulls));
+
+		/* array positions start at 1 in SQL */
+		values[0] = Int32GetDatum(valueIndex + 1);
+		isNulls[0] = false;
+
+		if (distributionMethod == DISTRIBUTE_BY_NONE)
+		{
+			if (shardCount > 0)
+			{
+				shardInterval = cacheEntry->sortedShardIntervalArray[0];
+			}
+		}
+		else if (!valueNullArray[valueIndex])
+		{
+			Datum distributionValue = valueArray[valueIndex];
+
+			if (valueType != distributionType)
+			{
+				char *valueString = DatumToString(distributionValue, valueType);
+				distributionValue = StringToDatum(valueString, distributionType);
+			}
+
+			shardInterval = FindShardInterval(distributionValue, cacheEntry);
+		}
+
+		if (shardInterval != NULL)
+		{
+			values[1] = Int64GetDatum(shardInterval->shardId);
+			isNulls[1] = false;
+
+			if (distributionMethod != DISTRIBUTE_BY_NONE)
+			{
+				int shardIndex = shardInterval->shardIndex;
+
+				if (shardNodeIdArray[shardIndex] == 0)
+				{
+					shardNodeIdArray[shardIndex] = ShardMapNodeId(shardInterval->shardId);
+				}
+
+				if (shardNodeIdArray[shardIndex] != 0)
+				{
+					values[2] = Int32GetDatum(shardNodeIdArray[shardIndex]);
+					isNulls[2] = false;
+				}
+			}
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * NotifyShardMapChanged notifies the citus_shard_map channel at commit, to
+ * tell drivers that the shard map they cached might be stale. Postgres sends
+ * a single notification per transaction, however often this is called.
+ */
+void
+NotifyShardMapChanged(void)
+{
+	Async_Notify(SHARD_MAP_CHANNEL, NULL);
+}
+
+
+/*
+ * ShardMapEntryList returns the entries of the shard map, ordered by table
+ * and hash range.
+ */
+static List *
+ShardMapEntryList(void)
+{
+	List *shardMapEntryList = NIL;
+
+	List *citusTableList = CitusTableList();
+
+	CitusTableCacheEntry *cacheEntry = NULL;
+	foreach_ptr(cacheEntry, citusTableList)
+	{
+		if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH)
+		{
+			continue;
+		}
+
+		for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+			 shardIndex++)
+		{
+			ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+			ShardMapEntry *entry = palloc0(sizeof(ShardMapEntry));
+			entry->relationId = cacheEntry->relationId;
+			entry->colocationId = cacheEntry->colocationId;
+			entry->shardId = shardInterval->shardId;
+			entry->minValue = DatumGetInt32(shardInterval->minValue);
+			entry->maxValue = DatumGetInt32(shardInterval->maxValue);
+			entry->nodeId = ShardMapNodeId(shardInterval->shardId);
+
+			shardMapEntryList = lappend(shardMapEntryList, entry);
+		}
+	}
+
+	return shardMapEntryList;
+}
+
+
+/*
+ * ShardMapNodeId returns the ID of the node of the first active placement of
+ * the given shard, or 0 if the shard has no active placement.
+ */
+static int32
+ShardMapNodeId(uint64 shardId)
+{
+	bool missingOk = true;
+	ShardPlacement *placement = ActiveShardPlacement(shardId, missingOk);
+
+	if (placement == NULL)
+	{
+		return 0;
+	}
+
+	return placement->nodeId;
+}
+
+
+/*
+ * ShardMapEntryHash returns a hash of the fields of the given shard map entry
+ * that are the same on all nodes, that is everything but the table OID.
+ */
+static uint64
+ShardMapEntryHash(ShardMapEntry *entry)
+{
+	uint64 entryHash = DatumGetUInt64(hash_any_extended((unsigned char *) &entry->shardId,
+														sizeof(uint64), 0));
+
+	entryHash = hash_combine64(entryHash,
+							   DatumGetUInt64(hash_uint32_extended(entry->colocationId,
+																   0)));
+	entryHash = hash_combine64(entryHash,
+							   DatumGetUInt64(hash_uint32_extended(entry->minValue, 0)));
+	entryHash = hash_combine64(entryHash,
+							   DatumGetUInt64(hash_uint32_extended(entry->maxValue, 0)));
+	entryHash = hash_combine64(entryHash,
+							   DatumGetUInt64(hash_uint32_extended(entry->nodeId, 0)));
+
+	return entryHash;
+}
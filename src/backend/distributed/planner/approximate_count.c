@@ -0,0 +1,175 @@
+/*-------------------------------------------------------------------------
+ *
+ * approximate_count.c
+ *	  Planning SELECT count(*) FROM distributed_table as a call to
+ *	  citus_approximate_count().
+ *
+ * A count of all rows of a distributed table scans every shard, while user
+ * interfaces often only need to know roughly how large the table is. When
+ * citus.enable_approximate_count is on, such queries are rewritten into a
+ * call to citus_approximate_count(), which sums up the row estimates that
+ * the workers keep in pg_class for the shards, with a single catalog query
+ * per node.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "distributed/approximate_count.h"
+#include "distributed/function_utils.h"
+#include "distributed/metadata_cache.h"
+#include "nodes/makefuncs.h"
+#include "utils/lsyscache.h"
+#include "utils/rls.h"
+
+
+#define APPROXIMATE_COUNT_FUNCTION_NAME "citus_approximate_count"
+
+
+/* config variable managed via guc.c */
+bool EnableApproximateCount = false;
+
+
+static bool IsCountOfDistributedTable(Query *query, Oid *relationId);
+static bool IsCountStar(Expr *expression);
+
+
+/*
+ * RewriteCountToApproximateCount replaces the count(*) in the given query by
+ * a call to citus_approximate_count() and removes the distributed table from
+ * the query, if citus.enable_approximate_count is on and the query counts all
+ * rows of a single distributed table. It returns whether the query was
+ * rewritten, in which case it no longer needs distributed planning.
+ *
+ * Permissions on the table are checked by citus_approximate_count() when the
+ * query runs. We do not rewrite queries on tables with row level security,
+ * whose count depends on the policies.
+ */
+bool
+RewriteCountToApproximateCount(Query *query)
+{
+	Oid relationId = InvalidOid;
+
+	if (!EnableApproximateCount || !IsCountOfDistributedTable(query, &relationId))
+	{
+		return false;
+	}
+
+	if (check_enable_rls(relationId, InvalidOid, true) == RLS_ENABLED)
+	{
+		return false;
+	}
+
+	const int argumentCount = 1;
+	Oid functionId = FunctionOid("pg_catalog", APPROXIMATE_COUNT_FUNCTION_NAME,
+								 argumentCount);
+
+	Const *relationIdConst = makeConst(REGCLASSOID, -1, InvalidOid, sizeof(Oid),
+									   ObjectIdGetDatum(relationId), false, true);
+	FuncExpr *approximateCount = makeFuncExpr(functionId, INT8OID,
+											  list_make1(relationIdConst),
+											  InvalidOid, InvalidOid,
+											  COERCE_EXPLICIT_CALL);
+
+	TargetEntry *targetEntry = linitial(query->targetList);
+	targetEntry->expr = (Expr *) approximateCount;
+
+	query->hasAggs = false;
+	query->rtable = NIL;
+	query->jointree = makeFromExpr(NIL, NULL);
+
+	return true;
+}
+
+
+/*
+ * IsCountOfDistributedTable returns whether the given query is a plain
+ * SELECT count(*) FROM distributed_table without any other clauses, and
+ * sets relationId to the table if so.
+ */
+static bool
+IsCountOfDistributedTable(Query *query, Oid *relationId)
+{
+	if (query->commandType != CMD_SELECT || query->utilityStmt != NULL)
+	{
+		return false;
+	}
+
+	if (query->hasSubLinks || query->hasWindowFuncs || query->hasTargetSRFs ||
+		query->hasForUpdate || query->cteList != NIL || query->setOperations != NULL)
+	{
+		return false;
+	}
+
+	if (query->groupClause != NIL || query->groupingSets != NIL ||
+		query->havingQual != NULL || query->distinctClause != NIL ||
+		query->sortClause != NIL || query->limitCount != NULL ||
+		query->limitOffset != NULL)
+	{
+		return false;
+	}
+
+	if (list_length(query->targetList) != 1 ||
+		!IsCountStar(((TargetEntry *) linitial(query->targetList))->expr))
+	{
+		return false;
+	}
+
+	if (list_length(query->rtable) != 1 || query->jointree == NULL ||
+		query->jointree->quals != NULL || list_length(query->jointree->fromlist) != 1 ||
+		!IsA(linitial(query->jointree->fromlist), RangeTblRef))
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = linitial(query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		rangeTableEntry->tablesample != NULL ||
+		!IsCitusTable(rangeTableEntry->relid))
+	{
+		return false;
+	}
+
+	/* FROM ONLY on a partitioned table returns no rows */
+	char relationKind = get_rel_relkind(rangeTableEntry->relid);
+	if (relationKind != RELKIND_RELATION &&
+		(relationKind != RELKIND_PARTITIONED_TABLE || !rangeTableEntry->inh))
+	{
+		return false;
+	}
+
+	*relationId = rangeTableEntry->relid;
+
+	return true;
+}
+
+
+/*
+ * IsCountStar returns whether the given expression is a plain count(*).
+ */
+static bool
+IsCountStar(Expr *expression)
+{
+	if (!IsA(expression, Aggref))
+	{
+		return false;
+	}
+
+	Aggref *aggregate = (Aggref *) expression;
+	if (!aggregate->aggstar || aggregate->aggfilter != NULL ||
+		aggregate->agglevelsup != 0 || aggregate->aggkind != AGGKIND_NORMAL)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggregate->aggfnoid);
+
+	return aggregateName != NULL && strcmp(aggregateName, "count") == 0 &&
+		   get_func_namespace(aggregate->aggfnoid) == PG_CATALOG_NAMESPACE;
+}
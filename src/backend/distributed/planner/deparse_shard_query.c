@@ -32,6 +32,7 @@
 #include "nodes/pg_list.h"
 #include "parser/parsetree.h"
 #include "storage/lock.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
@@ -39,14 +40,18 @@
 static void UpdateTaskQueryString(Query *query, Oid distributedTableId,
 								  RangeTblEntry *valuesRTE, Task *task);
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
-static bool ShouldLazyDeparseQuery(Task *task);
 static char * DeparseTaskQuery(Task *task, Query *query);
 static bool IsEachPlacementQueryStringDifferent(Task *task);
+static bool ReplaceRelationsWithTemplateSlots(Node *node, List **slotRelationIdList);
 
 
 /*
  * RebuildQueryStrings deparses the job query for each task to
  * include execution-time changes such as function evaluation.
+ *
+ * For UPDATE and DELETE queries with many tasks, the query is only deparsed
+ * for the first task, and the query strings of the other tasks are built
+ * from a ShardQueryTemplate, which saves copying the query for every task.
  */
 void
 RebuildQueryStrings(Job *workerJob)
@@ -55,16 +60,31 @@ RebuildQueryStrings(Job *workerJob)
 	List *taskList = workerJob->taskList;
 	Oid relationId = ((RangeTblEntry *) linitial(originalQuery->rtable))->relid;
 	RangeTblEntry *valuesRTE = ExtractDistributedInsertValuesRTE(originalQuery);
+	bool multiShardUpdateOrDelete = UpdateOrDeleteQuery(originalQuery) &&
+									list_length(taskList) > 1;
+	ShardQueryTemplate *queryTemplate = NULL;
+	bool queryTemplateBuilt = false;
 
 	Task *task = NULL;
 
 	foreach_ptr(task, taskList)
 	{
 		Query *query = originalQuery;
+		char *templateQueryString = NULL;
 
-		if (UpdateOrDeleteQuery(query) && list_length(taskList) > 1)
+		if (multiShardUpdateOrDelete)
 		{
-			query = copyObject(originalQuery);
+			/* tasks that might be executed locally keep the query tree instead */
+			if (queryTemplate != NULL && !ShouldLazyDeparseQuery(task))
+			{
+				templateQueryString =
+					ShardQueryStringFromTemplate(queryTemplate, task->relationShardList);
+			}
+
+			if (templateQueryString == NULL)
+			{
+				query = copyObject(originalQuery);
+			}
 		}
 		else if (query->commandType == CMD_INSERT && task->modifyWithSubquery)
 		{
@@ -120,7 +140,21 @@ RebuildQueryStrings(Job *workerJob)
 								: ApplyLogRedaction(TaskQueryStringForAllPlacements(
 														task)))));
 
-		UpdateTaskQueryString(query, relationId, valuesRTE, task);
+		if (templateQueryString != NULL)
+		{
+			SetTaskQueryString(task, templateQueryString);
+		}
+		else
+		{
+			UpdateTaskQueryString(query, relationId, valuesRTE, task);
+
+			if (multiShardUpdateOrDelete && !queryTemplateBuilt &&
+				GetTaskQueryType(task) == TASK_QUERY_TEXT)
+			{
+				queryTemplate = BuildShardQueryTemplate(originalQuery, task);
+				queryTemplateBuilt = true;
+			}
+		}
 
 		/*
 		 * If parameters were resolved in the job query, then they are now also
@@ -282,6 +316,11 @@ UpdateRelationToShardNames(Node *node, List *relationShardList)
  * UpdateRelationsToLocalShardTables walks over the query tree and appends shard ids to
  * relations. The caller is responsible for ensuring that the resulting Query can
  * be executed locally.
+ *
+ * Shard RTEs that were previously converted to citus_extradata_container calls
+ * by UpdateRelationToShardNames are turned back into relation RTEs, such that
+ * the query of a task that is lazily deparsed can be planned as is. The function
+ * returns true if a relation could not be mapped to a local shard relation.
  */
 bool
 UpdateRelationsToLocalShardTables(Node *node, List *relationShardList)
@@ -306,6 +345,13 @@ UpdateRelationsToLocalShardTables(Node *node, List *relationShardList)
 
 	RangeTblEntry *newRte = (RangeTblEntry *) node;
 
+	if (GetRangeTblKind(newRte) == CITUS_RTE_SHARD)
+	{
+		/* the relation id of the distributed table is retained in shard RTEs */
+		newRte->rtekind = RTE_RELATION;
+		newRte->functions = NIL;
+	}
+
 	if (newRte->rtekind != RTE_RELATION)
 	{
 		return false;
@@ -344,7 +390,7 @@ UpdateRelationsToLocalShardTables(Node *node, List *relationShardList)
 
 	newRte->relid = shardOid;
 
-	return false;
+	return shardOid == InvalidOid;
 }
 
 
@@ -408,7 +454,7 @@ ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte)
  * when adding it to the task. Right now it simply checks if any shards on the
  * local node can be used for the task.
  */
-static bool
+bool
 ShouldLazyDeparseQuery(Task *task)
 {
 	return TaskAccessesLocalNode(task);
@@ -602,3 +648,177 @@ IsEachPlacementQueryStringDifferent(Task *task)
 {
 	return GetTaskQueryType(task) == TASK_QUERY_TEXT_PER_PLACEMENT;
 }
+
+
+/*
+ * BuildShardQueryTemplate deparses the given query once, with placeholders in
+ * place of the shard names of the relations in the query, and splits the
+ * resulting query string at the placeholders.
+ *
+ * The template is checked against the query string of referenceTask, which
+ * must have been deparsed from the same query. The function returns NULL if
+ * they do not match, for instance when a placeholder also appears elsewhere
+ * in the query string.
+ */
+ShardQueryTemplate *
+BuildShardQueryTemplate(Query *query, Task *referenceTask)
+{
+	List *slotRelationIdList = NIL;
+
+	if (GetTaskQueryType(referenceTask) != TASK_QUERY_TEXT)
+	{
+		return NULL;
+	}
+
+	Query *templateQuery = copyObject(query);
+	ReplaceRelationsWithTemplateSlots((Node *) templateQuery, &slotRelationIdList);
+
+	StringInfo templateString = makeStringInfo();
+	pg_get_query_def(templateQuery, templateString);
+
+	ShardQueryTemplate *queryTemplate = palloc0(sizeof(ShardQueryTemplate));
+	int slotPrefixLength = strlen(SHARD_QUERY_TEMPLATE_SLOT_PREFIX);
+	char *fragmentStart = templateString->data;
+	char *slotStart = strstr(fragmentStart, SHARD_QUERY_TEMPLATE_SLOT_PREFIX);
+
+	while (slotStart != NULL)
+	{
+		char *slotIndexEnd = NULL;
+		long slotIndex = strtol(slotStart + slotPrefixLength, &slotIndexEnd, 10);
+
+		/* the placeholder should be followed by its slot index and a separator */
+		if (slotIndexEnd == slotStart + slotPrefixLength || *slotIndexEnd != '_' ||
+			slotIndex < 0 || slotIndex >= list_length(slotRelationIdList))
+		{
+			return NULL;
+		}
+
+		Oid relationId = list_nth_oid(slotRelationIdList, (int) slotIndex);
+
+		queryTemplate->queryStringFragmentList =
+			lappend(queryTemplate->queryStringFragmentList,
+					pnstrdup(fragmentStart, slotStart - fragmentStart));
+		queryTemplate->slotRelationIdList =
+			lappend_oid(queryTemplate->slotRelationIdList, relationId);
+		queryTemplate->slotRelationNameList =
+			lappend(queryTemplate->slotRelationNameList, get_rel_name(relationId));
+
+		fragmentStart = slotIndexEnd + 1;
+		slotStart = strstr(fragmentStart, SHARD_QUERY_TEMPLATE_SLOT_PREFIX);
+	}
+
+	queryTemplate->queryStringFragmentList =
+		lappend(queryTemplate->queryStringFragmentList, pstrdup(fragmentStart));
+
+	char *referenceQueryString = TaskQueryStringForAllPlacements(referenceTask);
+	char *templateQueryString =
+		ShardQueryStringFromTemplate(queryTemplate, referenceTask->relationShardList);
+	if (templateQueryString == NULL ||
+		strcmp(templateQueryString, referenceQueryString) != 0)
+	{
+		return NULL;
+	}
+
+	return queryTemplate;
+}
+
+
+/*
+ * ReplaceRelationsWithTemplateSlots replaces the relations in the query with
+ * shard RTEs that have a placeholder as their name, in the same way that
+ * UpdateRelationToShardNames replaces them with shard names. The relation
+ * of each placeholder is appended to slotRelationIdList.
+ */
+static bool
+ReplaceRelationsWithTemplateSlots(Node *node, List **slotRelationIdList)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ReplaceRelationsWithTemplateSlots,
+								 slotRelationIdList, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, ReplaceRelationsWithTemplateSlots,
+									  slotRelationIdList);
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	if (rangeTableEntry->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
+
+	Oid relationId = rangeTableEntry->relid;
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *slotName = psprintf("%s%d_", SHARD_QUERY_TEMPLATE_SLOT_PREFIX,
+							  list_length(*slotRelationIdList));
+
+	*slotRelationIdList = lappend_oid(*slotRelationIdList, relationId);
+
+	ModifyRangeTblExtraData(rangeTableEntry, CITUS_RTE_SHARD, schemaName, slotName,
+							NIL);
+
+	return false;
+}
+
+
+/*
+ * ShardQueryStringFromTemplate builds the query string for the given relation
+ * shards from the template. The function returns NULL if any relation in the
+ * template does not have a shard in relationShardList, since those relations
+ * are replaced with empty subqueries by UpdateRelationToShardNames instead.
+ */
+char *
+ShardQueryStringFromTemplate(ShardQueryTemplate *queryTemplate,
+							 List *relationShardList)
+{
+	StringInfo queryString = makeStringInfo();
+	ListCell *fragmentCell = NULL;
+	ListCell *slotRelationIdCell = list_head(queryTemplate->slotRelationIdList);
+	ListCell *slotRelationNameCell = list_head(queryTemplate->slotRelationNameList);
+
+	foreach(fragmentCell, queryTemplate->queryStringFragmentList)
+	{
+		appendStringInfoString(queryString, (char *) lfirst(fragmentCell));
+
+		if (slotRelationIdCell == NULL)
+		{
+			/* the last fragment is not followed by a shard name */
+			break;
+		}
+
+		Oid relationId = lfirst_oid(slotRelationIdCell);
+		RelationShard *relationShard = NULL;
+		uint64 shardId = INVALID_SHARD_ID;
+
+		foreach_ptr(relationShard, relationShardList)
+		{
+			if (relationShard->relationId == relationId)
+			{
+				shardId = relationShard->shardId;
+				break;
+			}
+		}
+
+		if (shardId == INVALID_SHARD_ID)
+		{
+			return NULL;
+		}
+
+		char *shardName = pstrdup((char *) lfirst(slotRelationNameCell));
+		AppendShardIdToName(&shardName, shardId);
+		appendStringInfoString(queryString, quote_identifier(shardName));
+
+		slotRelationIdCell = lnext(slotRelationIdCell);
+		slotRelationNameCell = lnext(slotRelationNameCell);
+	}
+
+	return queryString->data;
+}
@@ -20,12 +20,16 @@
 #include "catalog/pg_class.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "distributed/approximate_count.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/columnar.h"
 #include "distributed/cte_inline.h"
+#include "distributed/fast_path_plan_cache.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
@@ -40,8 +44,12 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/multi_shard_plan_cache.h"
+#include "distributed/partition_pruning.h"
+#include "distributed/planning_stats.h"
 #include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
+#include "distributed/repartitioned_aggregation.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_utils.h"
 #include "distributed/version_compat.h"
@@ -92,6 +100,8 @@ static DistributedPlan * CreateDistributedPlan(uint64 planId, Query *originalQue
 											   bool hasUnresolvedParams,
 											   PlannerRestrictionContext *
 											   plannerRestrictionContext);
+static void ReplanOriginalQuery(Query *originalQuery, Query *query,
+								ParamListInfo boundParams);
 static DeferredErrorMessage * DeferErrorIfPartitionTableNotSingleReplicated(Oid
 																			relationId);
 
@@ -166,13 +176,55 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		else
 		{
 			needsDistributedPlanning = ListContainsDistributedTableRTE(rangeTableList);
-			if (needsDistributedPlanning)
+			if (needsDistributedPlanning && RewriteCountToApproximateCount(parse))
+			{
+				/* the count is now computed by citus_approximate_count() */
+				needsDistributedPlanning = false;
+			}
+			else if (needsDistributedPlanning)
 			{
+				PruneDistributedPartitionedTables(parse);
+
 				fastPathRouterQuery = FastPathRouterQuery(parse, &distributionKeyValue);
 			}
 		}
 	}
 
+	if (fastPathRouterQuery &&
+		FastPathQueryIsCacheable(parse, cursorOptions, boundParams, distributionKeyValue))
+	{
+		PlannedStmt *cachedPlan = PlanFastPathQueryViaCache(parse, cursorOptions,
+															(Const *)
+															distributionKeyValue);
+		if (cachedPlan != NULL)
+		{
+			return cachedPlan;
+		}
+	}
+
+	if (needsDistributedPlanning && !fastPathRouterQuery &&
+		MultiShardQueryIsCacheable(parse, cursorOptions, boundParams))
+	{
+		PlannedStmt *cachedPlan = PlanMultiShardQueryViaCache(parse, cursorOptions,
+															  boundParams);
+		if (cachedPlan != NULL)
+		{
+			return cachedPlan;
+		}
+	}
+
+	/*
+	 * Nested planner calls, e.g. for recursively planned subqueries, are
+	 * charged to the phases of the top-level planner call. Plans taken from
+	 * the fast-path and multi-shard plan caches skip planning and are not
+	 * tracked.
+	 */
+	bool topLevelPlannerCall = PlannerLevel == 0;
+	if (topLevelPlannerCall)
+	{
+		StartPlanningPhaseTracking();
+	}
+
 	int rteIdCounter = 1;
 
 	DistributedPlanningContext planContext = {
@@ -254,9 +306,12 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 			 * restriction information per table and parse tree transformations made by
 			 * postgres' planner.
 			 */
+			PlanningPhase previousPhase =
+				BeginPlanningPhase(PLANNING_PHASE_STANDARD_PLANNER);
 			planContext.plan = standard_planner(planContext.query,
 												planContext.cursorOptions,
 												planContext.boundParams);
+			EndPlanningPhase(previousPhase);
 			if (needsDistributedPlanning)
 			{
 				result = PlanDistributedStmt(&planContext, rteIdCounter);
@@ -298,6 +353,11 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 						errhint("Consider using PL/pgSQL functions instead.")));
 	}
 
+	if (topLevelPlannerCall)
+	{
+		FinishPlanningPhaseTracking(result, parse->queryId);
+	}
+
 	return result;
 }
 
@@ -612,8 +672,10 @@ PlanFastPathDistributedStmt(DistributedPlanningContext *planContext,
 		fastPathContext->distributionKeyHasParam = true;
 	}
 
+	PlanningPhase previousPhase = BeginPlanningPhase(PLANNING_PHASE_FAST_PATH);
 	planContext->plan = FastPathPlanner(planContext->originalQuery, planContext->query,
 										planContext->boundParams);
+	EndPlanningPhase(previousPhase);
 
 	return CreateDistributedPlannedStmt(planContext);
 }
@@ -857,6 +919,7 @@ TryCreateDistributedPlannedStmt(PlannedStmt *localPlan,
 								PlannerRestrictionContext *plannerRestrictionContext)
 {
 	MemoryContext savedContext = CurrentMemoryContext;
+	PlanningPhase savedPlanningPhase = CurrentPlanningPhase();
 	PlannedStmt *result = NULL;
 
 	DistributedPlanningContext *planContext = palloc0(sizeof(DistributedPlanningContext));
@@ -884,6 +947,9 @@ TryCreateDistributedPlannedStmt(PlannedStmt *localPlan,
 			PG_RE_THROW();
 		}
 
+		/* the error may have been thrown in the middle of any planning phase */
+		EndPlanningPhase(savedPlanningPhase);
+
 		ereport(DEBUG4, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 						 errmsg("Planning after CTEs inlined failed with "
 								"\nmessage: %s\ndetail: %s\nhint: %s",
@@ -919,6 +985,8 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	DistributedPlan *distributedPlan = NULL;
 	bool hasCtes = originalQuery->cteList != NIL;
 
+	PlanningPhase previousPhase = BeginPlanningPhase(PLANNING_PHASE_ROUTER);
+
 	if (IsModifyCommand(originalQuery))
 	{
 		EnsureModificationsCanRun();
@@ -935,6 +1003,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 				 * INSERT...SELECT when the partition column is a parameter
 				 * because we don't perform any additional pruning in the executor.
 				 */
+				EndPlanningPhase(previousPhase);
 				return NULL;
 			}
 
@@ -953,6 +1022,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 
 		if (distributedPlan->planningError == NULL)
 		{
+			EndPlanningPhase(previousPhase);
 			return distributedPlan;
 		}
 		else
@@ -973,6 +1043,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 										   plannerRestrictionContext);
 		if (distributedPlan->planningError == NULL)
 		{
+			EndPlanningPhase(previousPhase);
 			return distributedPlan;
 		}
 		else
@@ -985,7 +1056,9 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		}
 	}
 
-	if (hasUnresolvedParams)
+	EndPlanningPhase(previousPhase);
+
+	if (hasUnresolvedParams && !PlanningMultiShardPlanTemplate())
 	{
 		/*
 		 * There are parameters that don't have a value in boundParams.
@@ -994,6 +1067,10 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		 * parameters. We return a NULL plan, which will have an
 		 * extremely high cost, such that postgres will replan with
 		 * bound parameters.
+		 *
+		 * The multi-shard plan cache does plan the query further, and
+		 * sends the parameters to the workers without pruning on them,
+		 * see multi_shard_plan_cache.c.
 		 */
 		return NULL;
 	}
@@ -1015,8 +1092,10 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	 * Plan subqueries and CTEs that cannot be pushed down by recursively
 	 * calling the planner and return the resulting plans to subPlanList.
 	 */
+	previousPhase = BeginPlanningPhase(PLANNING_PHASE_RECURSIVE_PLANNING);
 	List *subPlanList = GenerateSubplansForSubqueriesAndCTEs(planId, originalQuery,
 															 plannerRestrictionContext);
+	EndPlanningPhase(previousPhase);
 
 	/*
 	 * If subqueries were recursively planned then we need to replan the query
@@ -1033,33 +1112,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	 */
 	if (list_length(subPlanList) > 0 || hasCtes)
 	{
-		Query *newQuery = copyObject(originalQuery);
-		bool setPartitionedTablesInherited = false;
-		PlannerRestrictionContext *currentPlannerRestrictionContext =
-			CurrentPlannerRestrictionContext();
-
-		/* reset the current planner restrictions context */
-		ResetPlannerRestrictionContext(currentPlannerRestrictionContext);
-
-		/*
-		 * We force standard_planner to treat partitioned tables as regular tables
-		 * by clearing the inh flag on RTEs. We already did this at the start of
-		 * distributed_planner, but on a copy of the original query, so we need
-		 * to do it again here.
-		 */
-		AdjustPartitioningForDistributedPlanning(ExtractRangeTableEntryList(newQuery),
-												 setPartitionedTablesInherited);
-
-		/*
-		 * Some relations may have been removed from the query, but we can skip
-		 * AssignRTEIdentities since we currently do not rely on RTE identities
-		 * being contiguous.
-		 */
-
-		standard_planner(newQuery, 0, boundParams);
-
-		/* overwrite the old transformed query with the new transformed query */
-		*query = *newQuery;
+		ReplanOriginalQuery(originalQuery, query, boundParams);
 
 		/* recurse into CreateDistributedPlan with subqueries/CTEs replaced */
 		distributedPlan = CreateDistributedPlan(planId, originalQuery, query, NULL, false,
@@ -1090,9 +1143,27 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	query->cteList = NIL;
 	Assert(originalQuery->cteList == NIL);
 
+	/*
+	 * A query that does not group by the distribution column might combine its
+	 * partial aggregates on the workers rather than on the coordinator, in which
+	 * case the grouping moves into a subquery and we need to plan it again.
+	 * Likewise, window functions that are not partitioned by the distribution
+	 * column might be computed on the workers after repartitioning the rows.
+	 */
+	if (WrapGroupingForRepartitionedAggregation(originalQuery) ||
+		WrapWindowFunctionsForRepartitioning(originalQuery))
+	{
+		ReplanOriginalQuery(originalQuery, query, boundParams);
+	}
+
+	/* the multi-shard plan cache prunes shards with these restrictions later */
+	RecordMultiShardPlanRestrictions(plannerRestrictionContext);
+
+	previousPhase = BeginPlanningPhase(PLANNING_PHASE_LOGICAL_PLANNING);
 	MultiTreeRoot *logicalPlan = MultiLogicalPlanCreate(originalQuery, query,
 														plannerRestrictionContext);
 	MultiLogicalPlanOptimize(logicalPlan);
+	EndPlanningPhase(previousPhase);
 
 	/*
 	 * This check is here to make it likely that all node types used in
@@ -1104,8 +1175,10 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	CheckNodeIsDumpable((Node *) logicalPlan);
 
 	/* Create the physical plan */
+	previousPhase = BeginPlanningPhase(PLANNING_PHASE_PHYSICAL_PLANNING);
 	distributedPlan = CreatePhysicalDistributedPlan(logicalPlan,
 													plannerRestrictionContext);
+	EndPlanningPhase(previousPhase);
 
 	/* distributed plan currently should always succeed or error out */
 	Assert(distributedPlan && distributedPlan->planningError == NULL);
@@ -1114,6 +1187,47 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 }
 
 
+/*
+ * ReplanOriginalQuery runs standard_planner on a copy of the original query
+ * after the distributed planner changed it, and overwrites the given query
+ * with the result, such that the planner restriction context matches the
+ * original query again.
+ */
+static void
+ReplanOriginalQuery(Query *originalQuery, Query *query, ParamListInfo boundParams)
+{
+	Query *newQuery = copyObject(originalQuery);
+	bool setPartitionedTablesInherited = false;
+	PlannerRestrictionContext *currentPlannerRestrictionContext =
+		CurrentPlannerRestrictionContext();
+
+	/* reset the current planner restrictions context */
+	ResetPlannerRestrictionContext(currentPlannerRestrictionContext);
+
+	/*
+	 * We force standard_planner to treat partitioned tables as regular tables
+	 * by clearing the inh flag on RTEs. We already did this at the start of
+	 * distributed_planner, but on a copy of the original query, so we need
+	 * to do it again here.
+	 */
+	AdjustPartitioningForDistributedPlanning(ExtractRangeTableEntryList(newQuery),
+											 setPartitionedTablesInherited);
+
+	/*
+	 * Some relations may have been removed from the query, but we can skip
+	 * AssignRTEIdentities since we currently do not rely on RTE identities
+	 * being contiguous.
+	 */
+
+	PlanningPhase previousPhase = BeginPlanningPhase(PLANNING_PHASE_STANDARD_PLANNER);
+	standard_planner(newQuery, 0, boundParams);
+	EndPlanningPhase(previousPhase);
+
+	/* overwrite the old transformed query with the new transformed query */
+	*query = *newQuery;
+}
+
+
 /*
  * EnsurePartitionTableNotReplicated errors out if the infput relation is
  * a partition table and the table has a replication factor greater than
@@ -1821,11 +1935,20 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 	AdjustReadIntermediateResultCost(rte, relOptInfo);
 	AdjustReadIntermediateResultArrayCost(rte, relOptInfo);
 
+	if (EnableIntermediateResultScan)
+	{
+		AddIntermediateResultScanPath(root, relOptInfo, rte);
+	}
+
 	if (rte->rtekind != RTE_RELATION)
 	{
 		return;
 	}
 
+#if PG_VERSION_NUM >= PG_VERSION_12
+	AddColumnarScanPath(root, relOptInfo, rte);
+#endif
+
 	/*
 	 * Use a memory context that's guaranteed to live long enough, could be
 	 * called in a more shortly lived one (e.g. with GEQO).
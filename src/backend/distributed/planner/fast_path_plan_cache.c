@@ -0,0 +1,700 @@
+/*-------------------------------------------------------------------------
+ *
+ * fast_path_plan_cache.c
+ *
+ * Backend-wide cache of distributed plans for fast-path router queries.
+ *
+ * Prepared statements already avoid re-planning fast-path router queries, but
+ * applications that go through a transaction pooler typically send the same
+ * single-key lookups as plain queries with a literal distribution key value.
+ * Such queries are planned from scratch every time, even though the plans only
+ * differ in the distribution key value.
+ *
+ * When citus.fast_path_plan_cache_size is larger than 0, we plan these queries
+ * as if the distribution key value was a parameter, which means that the plan
+ * defers shard pruning and deparsing to the executor, just like the generic
+ * plan of a prepared statement. The plan is cached under a normalized form of
+ * the query tree, and subsequent queries of the same shape only need to copy
+ * the cached plan and put their own distribution key value in the job query.
+ *
+ * When citus.enable_parameterized_shard_queries is on as well, the distribution
+ * key value is not put in the job query, but bound to the parameter when the
+ * plan is executed. The shard query strings then only depend on the shard, so
+ * they are deparsed once per shard and kept in the cache entry, and the worker
+ * can reuse the statement it prepared for an earlier distribution key value
+ * (see citus.enable_worker_prepared_statements).
+ *
+ * Plan trees refer to backend-local state and are invalidated through the
+ * backend's relcache and syscache invalidations, so the cache is kept per
+ * backend. Pooled backends are long-lived, so they still see the same
+ * shapes over and over.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/citus_custom_scan.h"
+#include "distributed/citus_nodes.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/fast_path_plan_cache.h"
+#include "distributed/listutils.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/multi_physical_planner.h"
+#include "lib/ilist.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+
+/* parameter number that takes the place of the distribution key value */
+#define FAST_PATH_PLAN_CACHE_PARAM_ID 1
+
+
+/*
+ * FastPathPlanCacheKey identifies a query shape. The query hash is computed
+ * over the normalized query tree, in which the distribution key value is
+ * replaced by a parameter.
+ */
+typedef struct FastPathPlanCacheKey
+{
+	uint32 queryHash;
+	Oid userId;
+	int cursorOptions;
+} FastPathPlanCacheKey;
+
+
+/*
+ * FastPathPlanCacheEntry holds a cached plan along with the normalized query
+ * tree that was used to compute the hash, which we compare to rule out hash
+ * collisions.
+ */
+typedef struct FastPathPlanCacheEntry
+{
+	FastPathPlanCacheKey key;
+
+	/* normalized query tree */
+	char *queryString;
+
+	/* distributed table that the query accesses */
+	Oid relationId;
+
+	/* unique identifier of the entry, which plans taken from it refer to */
+	uint64 entryId;
+
+	/* plan in which the distribution key value is a parameter */
+	PlannedStmt *plan;
+
+	/* memory context that holds the query string and the plan */
+	MemoryContext context;
+
+	/* position in the list of entries, most recently used first */
+	dlist_node lruNode;
+} FastPathPlanCacheEntry;
+
+
+/*
+ * DistributionKeyValueContext is used when replacing the distribution key
+ * value by a parameter and vice versa.
+ */
+typedef struct DistributionKeyValueContext
+{
+	Const *distributionKeyValue;
+	bool replaced;
+} DistributionKeyValueContext;
+
+
+/* GUC, maximum number of plans in the fast-path plan cache */
+int FastPathPlanCacheSize = 0;
+
+static HTAB *FastPathPlanCacheHash = NULL;
+static dlist_head FastPathPlanCacheList = DLIST_STATIC_INIT(FastPathPlanCacheList);
+static MemoryContext FastPathPlanCacheContext = NULL;
+static uint64 NextFastPathPlanCacheEntryId = 1;
+
+
+static void InitializeFastPathPlanCache(void);
+static bool IsParam(Node *node);
+static Node * ReplaceDistributionKeyValueWithParam(Node *node,
+												   DistributionKeyValueContext *context);
+static Node * ReplaceParamWithDistributionKeyValue(Node *node,
+												   DistributionKeyValueContext *context);
+static bool IsLocationField(const char *fieldName, size_t nameLength);
+static bool PlanIsCacheable(PlannedStmt *plan);
+static FastPathPlanCacheEntry * AddFastPathPlanCacheEntry(FastPathPlanCacheKey *key,
+														   char *queryString,
+														   Oid relationId,
+														   PlannedStmt *plan);
+static void RemoveFastPathPlanCacheEntry(FastPathPlanCacheEntry *entry);
+static PlannedStmt * InstantiateCachedPlan(FastPathPlanCacheEntry *entry, Query *query,
+										   Const *distributionKeyValue);
+static void InvalidateFastPathPlanCacheSyscacheCallback(Datum argument, int cacheId,
+														uint32 hashValue);
+
+
+/*
+ * FastPathQueryIsCacheable returns true if the given fast-path router query
+ * can be planned via the fast-path plan cache. That is the case for top-level
+ * SELECT, UPDATE and DELETE queries without parameters, which filter on a
+ * constant distribution key value.
+ */
+bool
+FastPathQueryIsCacheable(Query *query, int cursorOptions, ParamListInfo boundParams,
+						 Node *distributionKeyValue)
+{
+	if (FastPathPlanCacheSize <= 0)
+	{
+		return false;
+	}
+
+	if (PlannerLevel > 0)
+	{
+		/* queries in functions are already cached by the function language */
+		return false;
+	}
+
+	if (distributionKeyValue == NULL || !IsA(distributionKeyValue, Const))
+	{
+		/* INSERTs, reference tables and prepared statements are not cached */
+		return false;
+	}
+
+	if (((Const *) distributionKeyValue)->location < 0)
+	{
+		/* we rely on the location to find the value in the query tree */
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT && query->commandType != CMD_UPDATE &&
+		query->commandType != CMD_DELETE)
+	{
+		return false;
+	}
+
+	if (boundParams != NULL || FindNodeCheck((Node *) query, IsParam))
+	{
+		/* the parameter number we use for the distribution key could be taken */
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PlanFastPathQueryViaCache returns a plan for the given fast-path router
+ * query, which is taken from the cache if a query of the same shape was
+ * planned before. Otherwise, the query is planned with the distribution key
+ * value replaced by a parameter and the plan is added to the cache.
+ *
+ * The function returns NULL if the query cannot be planned this way, in which
+ * case the caller should plan the query regularly.
+ */
+PlannedStmt *
+PlanFastPathQueryViaCache(Query *query, int cursorOptions, Const *distributionKeyValue)
+{
+	Query *templateQuery = copyObject(query);
+
+	DistributionKeyValueContext context = {
+		.distributionKeyValue = distributionKeyValue,
+		.replaced = false
+	};
+
+	ReplaceDistributionKeyValueWithParam((Node *) templateQuery, &context);
+	if (!context.replaced)
+	{
+		return NULL;
+	}
+
+	InitializeFastPathPlanCache();
+
+	char *queryString = NormalizedQueryString(templateQuery);
+
+	FastPathPlanCacheKey key;
+	memset(&key, 0, sizeof(key));
+	key.queryHash = string_hash(queryString, strlen(queryString) + 1);
+	key.userId = GetUserId();
+	key.cursorOptions = cursorOptions;
+
+	bool found = false;
+	FastPathPlanCacheEntry *entry = hash_search(FastPathPlanCacheHash, &key,
+												HASH_FIND, &found);
+	if (found && strcmp(entry->queryString, queryString) == 0)
+	{
+		dlist_move_head(&FastPathPlanCacheList, &entry->lruNode);
+
+		ereport(DEBUG1, (errmsg("using cached fast-path router plan")));
+
+		return InstantiateCachedPlan(entry, query, distributionKeyValue);
+	}
+
+	/*
+	 * Plan the query with the distribution key as a parameter, such that pruning
+	 * is deferred to the executor. Note that planning may process invalidations,
+	 * so we should not hold on to any cache entries at this point.
+	 */
+	PlannedStmt *templatePlan = distributed_planner(templateQuery, cursorOptions, NULL);
+	if (!PlanIsCacheable(templatePlan))
+	{
+		return NULL;
+	}
+
+	/* fast-path router queries have a single range table entry */
+	RangeTblEntry *rangeTableEntry = linitial(templateQuery->rtable);
+
+	entry = AddFastPathPlanCacheEntry(&key, queryString, rangeTableEntry->relid,
+									  templatePlan);
+
+	ereport(DEBUG1, (errmsg("caching fast-path router plan")));
+
+	return InstantiateCachedPlan(entry, query, distributionKeyValue);
+}
+
+
+/*
+ * InitializeFastPathPlanCache creates the hash table for the cache and
+ * registers the invalidation callbacks the first time it is called.
+ */
+static void
+InitializeFastPathPlanCache(void)
+{
+	if (FastPathPlanCacheHash != NULL)
+	{
+		return;
+	}
+
+	FastPathPlanCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													 "Fast Path Plan Cache",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(FastPathPlanCacheKey);
+	info.entrysize = sizeof(FastPathPlanCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = FastPathPlanCacheContext;
+
+	FastPathPlanCacheHash = hash_create("Fast Path Plan Cache Hash", 64, &info,
+										HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	/*
+	 * Relation invalidations reach us via InvalidateDistRelationCacheCallback,
+	 * which calls InvalidateFastPathPlanCache. Functions used in the query may
+	 * change the plan as well, for instance when their volatility changes.
+	 */
+	CacheRegisterSyscacheCallback(PROCOID, InvalidateFastPathPlanCacheSyscacheCallback,
+								  (Datum) 0);
+}
+
+
+/*
+ * IsParam returns true if the given node is a Param.
+ */
+static bool
+IsParam(Node *node)
+{
+	return IsA(node, Param);
+}
+
+
+/*
+ * ReplaceDistributionKeyValueWithParam replaces the constant distribution key
+ * value in the given query tree by an external parameter of the same type.
+ * The constant is identified by its value and location, since the value we
+ * get from FastPathRouterQuery is a copy.
+ */
+static Node *
+ReplaceDistributionKeyValueWithParam(Node *node, DistributionKeyValueContext *context)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Const))
+	{
+		Const *constant = (Const *) node;
+		Const *distributionKeyValue = context->distributionKeyValue;
+
+		if (!context->replaced &&
+			constant->location == distributionKeyValue->location &&
+			equal(constant, distributionKeyValue))
+		{
+			Param *param = makeNode(Param);
+			param->paramkind = PARAM_EXTERN;
+			param->paramid = FAST_PATH_PLAN_CACHE_PARAM_ID;
+			param->paramtype = constant->consttype;
+			param->paramtypmod = constant->consttypmod;
+			param->paramcollid = constant->constcollid;
+			param->location = constant->location;
+
+			context->replaced = true;
+
+			return (Node *) param;
+		}
+
+		return node;
+	}
+	else if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		/* fast-path router queries have no sublinks, so we only need the quals */
+		query->jointree = (FromExpr *) ReplaceDistributionKeyValueWithParam(
+			(Node *) query->jointree, context);
+
+		return node;
+	}
+
+	return expression_tree_mutator(node, ReplaceDistributionKeyValueWithParam,
+								   (void *) context);
+}
+
+
+/*
+ * ReplaceParamWithDistributionKeyValue replaces the parameter that was put
+ * in place of the distribution key value by the given constant.
+ */
+static Node *
+ReplaceParamWithDistributionKeyValue(Node *node, DistributionKeyValueContext *context)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Param))
+	{
+		Param *param = (Param *) node;
+
+		if (param->paramkind == PARAM_EXTERN &&
+			param->paramid == FAST_PATH_PLAN_CACHE_PARAM_ID)
+		{
+			context->replaced = true;
+
+			return (Node *) copyObject(context->distributionKeyValue);
+		}
+
+		return node;
+	}
+	else if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		query->jointree = (FromExpr *) ReplaceParamWithDistributionKeyValue(
+			(Node *) query->jointree, context);
+
+		return node;
+	}
+
+	return expression_tree_mutator(node, ReplaceParamWithDistributionKeyValue,
+								   (void *) context);
+}
+
+
+/*
+ * NormalizedQueryString returns the serialized form of the given query tree
+ * without location fields. The locations only refer to the query text, and
+ * differ between queries that only differ in the length of a literal.
+ */
+char *
+NormalizedQueryString(Query *query)
+{
+	char *queryString = nodeToString(query);
+	StringInfo normalizedString = makeStringInfo();
+	const char *cursor = queryString;
+	const char *fieldStart = NULL;
+
+	while ((fieldStart = strstr(cursor, " :")) != NULL)
+	{
+		const char *fieldName = fieldStart + 2;
+		size_t nameLength = strcspn(fieldName, " ");
+
+		/* an escaped space is part of a token rather than a field separator */
+		bool isFieldSeparator = fieldStart == queryString || fieldStart[-1] != '\\';
+
+		if (isFieldSeparator && IsLocationField(fieldName, nameLength))
+		{
+			appendBinaryStringInfo(normalizedString, cursor, fieldStart - cursor);
+
+			/* skip the field name and its integer value */
+			cursor = fieldName + nameLength;
+			cursor += strspn(cursor, " -0123456789");
+		}
+		else
+		{
+			appendBinaryStringInfo(normalizedString, cursor, fieldName - cursor);
+			cursor = fieldName;
+		}
+	}
+
+	appendStringInfoString(normalizedString, cursor);
+	pfree(queryString);
+
+	return normalizedString->data;
+}
+
+
+/*
+ * IsLocationField returns true if the given field name of a serialized node
+ * refers to a location in the query text.
+ */
+static bool
+IsLocationField(const char *fieldName, size_t nameLength)
+{
+	const char *locationFields[] = { "location", "stmt_location", "stmt_len" };
+	int fieldCount = lengthof(locationFields);
+
+	for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		const char *locationField = locationFields[fieldIndex];
+
+		if (strlen(locationField) == nameLength &&
+			strncmp(fieldName, locationField, nameLength) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * PlanIsCacheable returns true if the given plan is a fast-path router plan
+ * that defers pruning to the executor, in which case the only reference to
+ * the distribution key parameter is in the job query.
+ */
+static bool
+PlanIsCacheable(PlannedStmt *plan)
+{
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	if (customScan == NULL)
+	{
+		return false;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	if (distributedPlan->planningError != NULL || !distributedPlan->fastPathRouterPlan)
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || !workerJob->deferredPruning)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * AddFastPathPlanCacheEntry adds a copy of the given plan to the cache,
+ * evicting the least recently used entries if the cache is full, and returns
+ * the new entry.
+ */
+static FastPathPlanCacheEntry *
+AddFastPathPlanCacheEntry(FastPathPlanCacheKey *key, char *queryString,
+						  Oid relationId, PlannedStmt *plan)
+{
+	bool found = false;
+	FastPathPlanCacheEntry *entry = hash_search(FastPathPlanCacheHash, key,
+												HASH_FIND, &found);
+	if (found)
+	{
+		/* hash collision, replace the existing entry */
+		RemoveFastPathPlanCacheEntry(entry);
+	}
+
+	while (!dlist_is_empty(&FastPathPlanCacheList) &&
+		   hash_get_num_entries(FastPathPlanCacheHash) >= FastPathPlanCacheSize)
+	{
+		dlist_node *oldestNode = dlist_tail_node(&FastPathPlanCacheList);
+
+		RemoveFastPathPlanCacheEntry(dlist_container(FastPathPlanCacheEntry, lruNode,
+													 oldestNode));
+	}
+
+	MemoryContext entryContext = AllocSetContextCreate(FastPathPlanCacheContext,
+													   "Fast Path Plan Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	char *cachedQueryString = pstrdup(queryString);
+	PlannedStmt *cachedPlan = copyObject(plan);
+
+	/* plans taken from the cache were not planned, so don't show planning phases */
+	CustomScan *customScan = FetchCitusCustomScanIfExists(cachedPlan->planTree);
+	GetDistributedPlan(customScan)->hasPlanningPhaseTimes = false;
+
+	MemoryContextSwitchTo(oldContext);
+
+	entry = hash_search(FastPathPlanCacheHash, key, HASH_ENTER, &found);
+	entry->queryString = cachedQueryString;
+	entry->relationId = relationId;
+	entry->entryId = NextFastPathPlanCacheEntryId++;
+	entry->plan = cachedPlan;
+	entry->context = entryContext;
+
+	dlist_push_head(&FastPathPlanCacheList, &entry->lruNode);
+
+	return entry;
+}
+
+
+/*
+ * RemoveFastPathPlanCacheEntry removes the given entry from the cache and
+ * frees its memory.
+ */
+static void
+RemoveFastPathPlanCacheEntry(FastPathPlanCacheEntry *entry)
+{
+	MemoryContext entryContext = entry->context;
+
+	dlist_delete(&entry->lruNode);
+	hash_search(FastPathPlanCacheHash, &entry->key, HASH_REMOVE, NULL);
+
+	MemoryContextDelete(entryContext);
+}
+
+
+/*
+ * InstantiateCachedPlan returns a copy of the plan of the given cache entry,
+ * in which the distribution key parameter is replaced by the distribution key
+ * value of the current query. With parameterized shard queries, the parameter
+ * is kept and the value is bound to it when the plan is executed instead.
+ */
+static PlannedStmt *
+InstantiateCachedPlan(FastPathPlanCacheEntry *entry, Query *query,
+					  Const *distributionKeyValue)
+{
+	PlannedStmt *plan = copyObject(entry->plan);
+
+	/* statistics are tracked for the current query */
+	plan->queryId = query->queryId;
+	plan->stmt_location = query->stmt_location;
+	plan->stmt_len = query->stmt_len;
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	distributedPlan->queryId = query->queryId;
+
+	if (EnableParameterizedShardQueries)
+	{
+		distributedPlan->boundDistributionKeyValue = copyObject(distributionKeyValue);
+		distributedPlan->fastPathPlanCacheEntryId = entry->entryId;
+
+		return plan;
+	}
+
+	DistributionKeyValueContext context = {
+		.distributionKeyValue = distributionKeyValue,
+		.replaced = false
+	};
+
+	Job *workerJob = distributedPlan->workerJob;
+	ReplaceParamWithDistributionKeyValue((Node *) workerJob->jobQuery, &context);
+
+	Assert(context.replaced);
+
+	return plan;
+}
+
+
+/*
+ * CacheFastPathShardQueryString keeps the query string for the given shard in
+ * the plan of the given cache entry, such that later copies of the plan do
+ * not need to deparse it again. Nothing happens if the entry was removed in
+ * the meantime.
+ */
+void
+CacheFastPathShardQueryString(uint64 entryId, uint64 shardId, char *queryString)
+{
+	dlist_iter iter;
+
+	if (FastPathPlanCacheHash == NULL)
+	{
+		return;
+	}
+
+	dlist_foreach(iter, &FastPathPlanCacheList)
+	{
+		FastPathPlanCacheEntry *entry =
+			dlist_container(FastPathPlanCacheEntry, lruNode, iter.cur);
+
+		if (entry->entryId != entryId)
+		{
+			continue;
+		}
+
+		CustomScan *customScan = FetchCitusCustomScanIfExists(entry->plan->planTree);
+		Job *workerJob = GetDistributedPlan(customScan)->workerJob;
+
+		ShardQueryString *shardQueryString = NULL;
+		foreach_ptr(shardQueryString, workerJob->shardQueryStrings)
+		{
+			if (shardQueryString->shardId == shardId)
+			{
+				return;
+			}
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(entry->context);
+
+		shardQueryString = CitusMakeNode(ShardQueryString);
+		shardQueryString->shardId = shardId;
+		shardQueryString->queryString = pstrdup(queryString);
+
+		workerJob->shardQueryStrings = lappend(workerJob->shardQueryStrings,
+											   shardQueryString);
+
+		MemoryContextSwitchTo(oldContext);
+
+		return;
+	}
+}
+
+
+/*
+ * InvalidateFastPathPlanCache removes the cached plans for the given relation,
+ * or all cached plans if relationId is InvalidOid.
+ */
+void
+InvalidateFastPathPlanCache(Oid relationId)
+{
+	dlist_mutable_iter iter;
+
+	if (FastPathPlanCacheHash == NULL)
+	{
+		return;
+	}
+
+	dlist_foreach_modify(iter, &FastPathPlanCacheList)
+	{
+		FastPathPlanCacheEntry *entry =
+			dlist_container(FastPathPlanCacheEntry, lruNode, iter.cur);
+
+		if (relationId == InvalidOid || entry->relationId == relationId)
+		{
+			RemoveFastPathPlanCacheEntry(entry);
+		}
+	}
+}
+
+
+/*
+ * InvalidateFastPathPlanCacheSyscacheCallback removes all cached plans when
+ * a function changes.
+ */
+static void
+InvalidateFastPathPlanCacheSyscacheCallback(Datum argument, int cacheId,
+											uint32 hashValue)
+{
+	InvalidateFastPathPlanCache(InvalidOid);
+}
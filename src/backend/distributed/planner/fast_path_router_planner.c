@@ -38,15 +38,14 @@
 
 #include "distributed/distributed_planner.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/listutils.h"
 #include "distributed/multi_physical_planner.h" /* only to use some utility functions */
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
-#if PG_VERSION_NUM >= PG_VERSION_12
 #include "nodes/makefuncs.h"
-#endif
 #include "nodes/nodeFuncs.h"
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
@@ -56,14 +55,22 @@
 #include "optimizer/clauses.h"
 #endif
 #include "tcop/pquery.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
 
 bool EnableFastPathRouterPlanner = true;
 
-static bool ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey);
+static bool ColumnAppearsOutsideIdenticalFilters(Node *quals, Var *distributionKey);
+static void ColumnFilterValues(Node *node, Var *column, List **filterValueList);
 static bool ConjunctionContainsColumnFilter(Node *node, Var *column,
 											Node **distributionKeyValue);
 static bool DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn,
 										Node **distributionKeyValue);
+static bool DistKeyInSingleElementArrayExpression(ScalarArrayOpExpr *arrayOpExpr,
+												  Var *distColumn,
+												  Node **distributionKeyValue);
+static Node * SingleElementArrayFilterValue(ScalarArrayOpExpr *arrayOpExpr,
+											Var *column);
 
 
 /*
@@ -151,8 +158,10 @@ GeneratePlaceHolderPlannedStmt(Query *parse)
  *   - The query should touch only a single hash distributed or reference table
  *   - The distribution with equality operator should be in the WHERE clause
  *      and it should be ANDed with any other filters. Also, the distribution
- *      key should only exists once in the WHERE clause. So basically,
+ *      key should only exists once in the WHERE clause, unless it appears in
+ *      several such filters on the same value. So basically,
  *          SELECT ... FROM dist_table WHERE dist_key = X
+ *      A filter of the form dist_key = ANY('{X}') is treated the same way.
  *      If the filter is a const, distributionKeyValue is set
  *   - All INSERT statements (including multi-row INSERTs) as long as the commands
  *     don't have any sublinks/CTEs etc
@@ -241,13 +250,13 @@ FastPathRouterQuery(Query *query, Node **distributionKeyValue)
 	 *
 	 *	Overall the logic is might sound fuzzy since it involves two individual checks:
 	 *	    (a) Check for top level AND operator with one side being "dist_key = const"
-	 *	    (b) Only allow single appearance of "dist_key" in the quals
+	 *	    (b) Only allow appearances of "dist_key" in such filters on the same value
 	 *
 	 *	This is to simplify both of the individual checks and omit various edge cases
 	 *	that might arise with multiple distribution keys in the quals.
 	 */
 	if (ConjunctionContainsColumnFilter(quals, distributionKey, distributionKeyValue) &&
-		!ColumnAppearsMultipleTimes(quals, distributionKey))
+		!ColumnAppearsOutsideIdenticalFilters(quals, distributionKey))
 	{
 		return true;
 	}
@@ -257,16 +266,19 @@ FastPathRouterQuery(Query *query, Node **distributionKeyValue)
 
 
 /*
- * ColumnAppearsMultipleTimes returns true if the given input
- * appears more than once in the quals.
+ * ColumnAppearsOutsideIdenticalFilters returns true if the given column appears
+ * in the quals other than in the equality filters that ConjunctionContainsColumnFilter
+ * accepts, or if those filters do not all compare the column to the same value.
+ * Repeating the same filter (e.g., when it is added by a view and by the query)
+ * does not change which shard the query goes to.
  */
 static bool
-ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey)
+ColumnAppearsOutsideIdenticalFilters(Node *quals, Var *distributionKey)
 {
 	ListCell *varClauseCell = NULL;
 	int partitionColumnReferenceCount = 0;
+	List *filterValueList = NIL;
 
-	/* make sure partition column is used only once in the quals */
 	List *varClauseList = pull_var_clause_default(quals);
 	foreach(varClauseCell, varClauseList)
 	{
@@ -274,11 +286,27 @@ ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey)
 		if (equal(column, distributionKey))
 		{
 			partitionColumnReferenceCount++;
+		}
+	}
 
-			if (partitionColumnReferenceCount > 1)
-			{
-				return true;
-			}
+	if (partitionColumnReferenceCount <= 1)
+	{
+		return false;
+	}
+
+	ColumnFilterValues(quals, distributionKey, &filterValueList);
+	if (list_length(filterValueList) != partitionColumnReferenceCount)
+	{
+		return true;
+	}
+
+	Node *firstFilterValue = linitial(filterValueList);
+	Node *filterValue = NULL;
+	foreach_ptr(filterValue, filterValueList)
+	{
+		if (!equal(filterValue, firstFilterValue))
+		{
+			return true;
 		}
 	}
 
@@ -286,6 +314,70 @@ ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey)
 }
 
 
+/*
+ * ColumnFilterValues appends the values of the equality filters on the given
+ * column that are ANDed at the top level of the given expression to
+ * filterValueList. Locations are ignored when comparing the values later on,
+ * so the values are copied without them.
+ */
+static void
+ColumnFilterValues(Node *node, Var *column, List **filterValueList)
+{
+	Node *filterValue = NULL;
+
+	if (node == NULL)
+	{
+		return;
+	}
+
+	if (IsA(node, OpExpr))
+	{
+		OpExpr *opExpr = (OpExpr *) node;
+		Node *distributionKeyValue = NULL;
+		Node *leftOperand = NULL;
+		Node *rightOperand = NULL;
+
+		if (!DistKeyInSimpleOpExpression((Expr *) opExpr, column,
+										 &distributionKeyValue) ||
+			!OperatorImplementsEquality(opExpr->opno))
+		{
+			return;
+		}
+
+		BinaryOpExpression((Expr *) opExpr, &leftOperand, &rightOperand);
+		filterValue = IsA(leftOperand, Var) ? rightOperand : leftOperand;
+	}
+	else if (IsA(node, ScalarArrayOpExpr))
+	{
+		filterValue = SingleElementArrayFilterValue((ScalarArrayOpExpr *) node, column);
+	}
+	else if (IsA(node, BoolExpr) && ((BoolExpr *) node)->boolop == AND_EXPR)
+	{
+		Node *argumentNode = NULL;
+		foreach_ptr(argumentNode, ((BoolExpr *) node)->args)
+		{
+			ColumnFilterValues(argumentNode, column, filterValueList);
+		}
+	}
+
+	if (filterValue != NULL)
+	{
+		Node *filterValueCopy = copyObject(filterValue);
+
+		if (IsA(filterValueCopy, Const))
+		{
+			((Const *) filterValueCopy)->location = -1;
+		}
+		else if (IsA(filterValueCopy, Param))
+		{
+			((Param *) filterValueCopy)->location = -1;
+		}
+
+		*filterValueList = lappend(*filterValueList, filterValueCopy);
+	}
+}
+
+
 /*
  * ConjunctionContainsColumnFilter returns true if the query contains an exact
  * match (equal) expression on the provided column. The function returns true only
@@ -314,6 +406,11 @@ ConjunctionContainsColumnFilter(Node *node, Var *column, Node **distributionKeyV
 
 		return OperatorImplementsEquality(opExpr->opno);
 	}
+	else if (IsA(node, ScalarArrayOpExpr))
+	{
+		return DistKeyInSingleElementArrayExpression((ScalarArrayOpExpr *) node, column,
+													 distributionKeyValue);
+	}
 	else if (IsA(node, BoolExpr))
 	{
 		BoolExpr *boolExpr = (BoolExpr *) node;
@@ -423,3 +520,87 @@ DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn, Node **distributionKe
 
 	return distColumnExists;
 }
+
+
+/*
+ * DistKeyInSingleElementArrayExpression checks whether the given expression is
+ * of the form dist_key = ANY(const_array), where the array has exactly one
+ * non-null element. Such a filter is equivalent to dist_key = const, and
+ * typically comes from a prepared statement with an array parameter that is
+ * executed with a single value.
+ *
+ * When the element has the type of the distribution key, distributionKeyValue
+ * is set. Since the element is not part of the query tree, the value has no
+ * location, which keeps the fast-path plan cache from trying to replace it.
+ */
+static bool
+DistKeyInSingleElementArrayExpression(ScalarArrayOpExpr *arrayOpExpr, Var *distColumn,
+									  Node **distributionKeyValue)
+{
+	Const *arrayConst = (Const *) SingleElementArrayFilterValue(arrayOpExpr, distColumn);
+	if (arrayConst == NULL)
+	{
+		return false;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	Oid elementType = ARR_ELEMTYPE(array);
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	Datum *elementValues = NULL;
+	bool *elementNulls = NULL;
+	int elementCount = 0;
+
+	get_typlenbyvalalign(elementType, &typeLength, &typeByValue, &typeAlignment);
+	deconstruct_array(array, elementType, typeLength, typeByValue, typeAlignment,
+					  &elementValues, &elementNulls, &elementCount);
+
+	if (elementType == distColumn->vartype && *distributionKeyValue == NULL)
+	{
+		*distributionKeyValue =
+			(Node *) makeConst(elementType, -1, distColumn->varcollid, typeLength,
+							   elementValues[0], false, typeByValue);
+	}
+
+	return true;
+}
+
+
+/*
+ * SingleElementArrayFilterValue returns the array constant of the given
+ * expression if it is of the form column = ANY(const_array), where the array
+ * has exactly one non-null element, and NULL otherwise.
+ */
+static Node *
+SingleElementArrayFilterValue(ScalarArrayOpExpr *arrayOpExpr, Var *column)
+{
+	if (!arrayOpExpr->useOr || list_length(arrayOpExpr->args) != 2 ||
+		!OperatorImplementsEquality(arrayOpExpr->opno))
+	{
+		return NULL;
+	}
+
+	Node *leftOperand = strip_implicit_coercions(linitial(arrayOpExpr->args));
+	Node *rightOperand = strip_implicit_coercions(lsecond(arrayOpExpr->args));
+
+	if (!IsA(leftOperand, Var) || !equal(leftOperand, column) ||
+		!IsA(rightOperand, Const))
+	{
+		return NULL;
+	}
+
+	Const *arrayConst = (Const *) rightOperand;
+	if (arrayConst->constisnull)
+	{
+		return NULL;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	if (ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)) != 1 || ARR_HASNULL(array))
+	{
+		return NULL;
+	}
+
+	return (Node *) arrayConst;
+}
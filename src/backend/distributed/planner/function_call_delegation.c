@@ -27,13 +27,16 @@
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/insert_select_executor.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/remote_commands.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/subplan_result_cache.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
@@ -43,11 +46,11 @@
 #include "nodes/primnodes.h"
 #include "optimizer/clauses.h"
 #include "parser/parse_coerce.h"
-#if PG_VERSION_NUM >= PG_VERSION_12
 #include "parser/parsetree.h"
-#endif
 #include "miscadmin.h"
 #include "tcop/dest.h"
+#include "utils/array.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
@@ -57,7 +60,32 @@ struct ParamWalkerContext
 	ParamKind paramKind;
 };
 
+/*
+ * BatchedCallTask holds the rows of a batched function call that are sent
+ * to the same worker node.
+ */
+typedef struct BatchedCallTask
+{
+	int32 groupId;
+	ShardPlacement *placement;
+	uint64 anchorShardId;
+	List *rowList;
+} BatchedCallTask;
+
 static bool contain_param_walker(Node *node, void *context);
+static RangeTblRef * BatchedCallReference(Query *query);
+static PlannedStmt * TryToDelegateBatchedFunctionCall(
+	DistributedPlanningContext *planContext, FuncExpr *funcExpr,
+	int distributionArgIndex, CitusTableCacheEntry *distTable,
+	RangeTblRef *batchReference);
+static List * BatchedCallRowList(RangeTblEntry *rangeTableEntry, bool *hasExternParam);
+static List * UnnestedArrayRowList(RangeTblEntry *rangeTableEntry,
+								   bool *hasExternParam);
+static BatchedCallTask * BatchedCallTaskForRow(List *batchedCallTaskList,
+											   Const *partitionValue,
+											   CitusTableCacheEntry *distTable);
+static Query * BatchedCallTaskQuery(Query *query, Index batchRangeTableIndex,
+									List *rowList);
 
 /*
  * contain_param_walker scans node for Param nodes.
@@ -97,6 +125,10 @@ contain_param_walker(Node *node, void *context)
  * functions colocated by distributed tables, and not more complicated
  * forms involving multiple function calls, FROM clauses, WHERE clauses,
  * ... Those complex forms are handled in the coordinator.
+ *
+ * The exception are batches of calls in the SELECT func(...) FROM (VALUES
+ * ...) and SELECT func(...) FROM unnest(...) forms, which are sent to the
+ * workers as one batch per worker.
  */
 PlannedStmt *
 TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
@@ -112,6 +144,7 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	List *placementList = NIL;
 	CitusTableCacheEntry *distTable = NULL;
 	Var *partitionColumn = NULL;
+	RangeTblRef *batchReference = NULL;
 	ShardPlacement *placement = NULL;
 	WorkerNode *workerNode = NULL;
 	Task *task = NULL;
@@ -158,6 +191,12 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	}
 
 	if (joinTree->fromlist != NIL)
+	{
+		/* a batch of calls over a list of constant rows */
+		batchReference = BatchedCallReference(planContext->query);
+	}
+
+	if (joinTree->fromlist != NIL && batchReference == NULL)
 	{
 #if PG_VERSION_NUM >= PG_VERSION_12
 
@@ -279,6 +318,13 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 		return NULL;
 	}
 
+	if (batchReference != NULL)
+	{
+		return TryToDelegateBatchedFunctionCall(planContext, funcExpr,
+												procedure->distributionArgIndex,
+												distTable, batchReference);
+	}
+
 	partitionValue = (Const *) list_nth(funcExpr->args, procedure->distributionArgIndex);
 
 	if (IsA(partitionValue, Param))
@@ -387,5 +433,450 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	/* worker will take care of any necessary locking, treat query as read-only */
 	distributedPlan->modLevel = ROW_MODIFY_READONLY;
 
+	/* the function may still modify data, so cached subplan results are stale */
+	RecordDistributedModification();
+	InvalidateQueryResultCache();
+
 	return FinalizePlan(planContext->plan, distributedPlan);
 }
+
+
+/*
+ * BatchedCallReference returns the reference to the range table entry of a
+ * SELECT func(...) FROM (VALUES ...) or SELECT func(...) FROM unnest(...)
+ * query, or NULL if the query has a different form or any other clauses.
+ */
+static RangeTblRef *
+BatchedCallReference(Query *query)
+{
+	FromExpr *joinTree = query->jointree;
+
+	if (list_length(joinTree->fromlist) != 1 || joinTree->quals != NULL)
+	{
+		return NULL;
+	}
+
+	if (query->groupClause != NIL || query->groupingSets != NIL ||
+		query->havingQual != NULL || query->distinctClause != NIL ||
+		query->sortClause != NIL || query->limitCount != NULL ||
+		query->limitOffset != NULL || query->cteList != NIL ||
+		query->setOperations != NULL || query->rowMarks != NIL ||
+		query->hasAggs || query->hasWindowFuncs || query->hasTargetSRFs ||
+		query->hasSubLinks)
+	{
+		return NULL;
+	}
+
+	RangeTblRef *reference = linitial(joinTree->fromlist);
+	if (!IsA(reference, RangeTblRef))
+	{
+		return NULL;
+	}
+
+	RangeTblEntry *rangeTableEntry = rt_fetch(reference->rtindex, query->rtable);
+	if (rangeTableEntry->rtekind == RTE_VALUES)
+	{
+		return reference;
+	}
+
+	if (rangeTableEntry->rtekind != RTE_FUNCTION || rangeTableEntry->funcordinality)
+	{
+		return NULL;
+	}
+
+	/* unnest(a, b) is expanded into ROWS FROM (unnest(a), unnest(b)) */
+	RangeTblFunction *rangeTableFunction = NULL;
+	foreach_ptr(rangeTableFunction, rangeTableEntry->functions)
+	{
+		FuncExpr *unnestExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+
+		if (!IsA(unnestExpr, FuncExpr) || unnestExpr->funcid != F_ARRAY_UNNEST)
+		{
+			return NULL;
+		}
+	}
+
+	return reference;
+}
+
+
+/*
+ * TryToDelegateBatchedFunctionCall groups the constant rows that the given
+ * function is called for by the worker that has the shard for their
+ * distribution argument, and returns a plan that sends each group to its
+ * worker as a single SELECT func(...) FROM (VALUES ...) query. The result
+ * of every call is returned, in no particular order.
+ *
+ * The batch is only delegated when all of its calls can be delegated,
+ * otherwise the function returns NULL and the calls run on the coordinator.
+ */
+static PlannedStmt *
+TryToDelegateBatchedFunctionCall(DistributedPlanningContext *planContext,
+								 FuncExpr *funcExpr, int distributionArgIndex,
+								 CitusTableCacheEntry *distTable,
+								 RangeTblRef *batchReference)
+{
+	Query *query = planContext->query;
+	Index batchRangeTableIndex = batchReference->rtindex;
+	RangeTblEntry *batchRangeTableEntry = rt_fetch(batchRangeTableIndex, query->rtable);
+	List *batchedCallTaskList = NIL;
+	List *taskList = NIL;
+	bool hasExternParam = false;
+	struct ParamWalkerContext walkerParamContext = { 0 };
+
+	/* see TryToDelegateFunctionCall */
+	if (GeneratingSubplans())
+	{
+		ereport(DEBUG1, (errmsg(
+							 "not pushing down function calls in CTEs or Subqueries")));
+		return NULL;
+	}
+
+	(void) expression_tree_walker((Node *) funcExpr->args, contain_param_walker,
+								  &walkerParamContext);
+	if (walkerParamContext.hasParam && walkerParamContext.paramKind != PARAM_EXTERN)
+	{
+		ereport(DEBUG1, (errmsg("arguments in a distributed function must "
+								"not contain subqueries")));
+		return NULL;
+	}
+
+	List *rowList = BatchedCallRowList(batchRangeTableEntry, &hasExternParam);
+	if (hasExternParam || walkerParamContext.hasParam)
+	{
+		/* Don't log a message, we should end up here again without a parameter */
+		DissuadePlannerFromUsingPlan(planContext->plan);
+		return NULL;
+	}
+
+	if (rowList == NIL)
+	{
+		ereport(DEBUG1, (errmsg("function calls in a batch must be over a list of "
+								"constants")));
+		return NULL;
+	}
+
+	Node *distributionArg = strip_implicit_coercions(
+		(Node *) list_nth(funcExpr->args, distributionArgIndex));
+
+	List *row = NIL;
+	foreach_ptr(row, rowList)
+	{
+		Const *partitionValue = NULL;
+
+		if (IsA(distributionArg, Const))
+		{
+			partitionValue = (Const *) distributionArg;
+		}
+		else if (IsA(distributionArg, Var) &&
+				 ((Var *) distributionArg)->varno == batchRangeTableIndex &&
+				 ((Var *) distributionArg)->varlevelsup == 0)
+		{
+			AttrNumber columnNumber = ((Var *) distributionArg)->varattno;
+			partitionValue = (Const *) list_nth(row, columnNumber - 1);
+		}
+		else
+		{
+			ereport(DEBUG1, (errmsg("distribution argument value must be a constant")));
+			return NULL;
+		}
+
+		if (partitionValue->constisnull)
+		{
+			ereport(DEBUG1, (errmsg("distribution argument value must not be null")));
+			return NULL;
+		}
+
+		BatchedCallTask *batchedCallTask = BatchedCallTaskForRow(batchedCallTaskList,
+																 partitionValue,
+																 distTable);
+		if (batchedCallTask == NULL)
+		{
+			/* BatchedCallTaskForRow logs the reason */
+			return NULL;
+		}
+
+		if (batchedCallTask->rowList == NIL)
+		{
+			batchedCallTaskList = lappend(batchedCallTaskList, batchedCallTask);
+		}
+
+		batchedCallTask->rowList = lappend(batchedCallTask->rowList, row);
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down the function calls in batches")));
+
+	BatchedCallTask *batchedCallTask = NULL;
+	foreach_ptr(batchedCallTask, batchedCallTaskList)
+	{
+		Query *taskQuery = BatchedCallTaskQuery(query, batchRangeTableIndex,
+												batchedCallTask->rowList);
+
+		Task *task = CitusMakeNode(Task);
+		task->taskId = list_length(taskList) + 1;
+		task->taskType = SELECT_TASK;
+		task->taskPlacementList = list_make1(batchedCallTask->placement);
+		SetTaskQueryIfShouldLazyDeparse(task, taskQuery);
+		task->anchorShardId = batchedCallTask->anchorShardId;
+		task->replicationModel = distTable->replicationModel;
+
+		taskList = lappend(taskList, task);
+	}
+
+	Job *job = CitusMakeNode(Job);
+	job->jobId = UniqueJobId();
+	job->jobQuery = query;
+	job->taskList = taskList;
+
+	DistributedPlan *distributedPlan = CitusMakeNode(DistributedPlan);
+	distributedPlan->workerJob = job;
+	distributedPlan->masterQuery = NULL;
+	distributedPlan->routerExecutable = true;
+	distributedPlan->hasReturning = false;
+
+	/* worker will take care of any necessary locking, treat query as read-only */
+	distributedPlan->modLevel = ROW_MODIFY_READONLY;
+
+	/* the function may still modify data, so cached subplan results are stale */
+	RecordDistributedModification();
+	InvalidateQueryResultCache();
+
+	return FinalizePlan(planContext->plan, distributedPlan);
+}
+
+
+/*
+ * BatchedCallRowList returns the rows of the VALUES list or the unnested
+ * arrays of a batched function call as lists of Const. It returns NIL if any
+ * of the values is not a constant, and sets hasExternParam when that is
+ * because of a parameter, which will be a constant in a custom plan.
+ */
+static List *
+BatchedCallRowList(RangeTblEntry *rangeTableEntry, bool *hasExternParam)
+{
+	List *rowList = NIL;
+
+	if (rangeTableEntry->rtekind == RTE_FUNCTION)
+	{
+		return UnnestedArrayRowList(rangeTableEntry, hasExternParam);
+	}
+
+	List *valuesList = NIL;
+	foreach_ptr(valuesList, rangeTableEntry->values_lists)
+	{
+		Node *value = NULL;
+		foreach_ptr(value, valuesList)
+		{
+			if (IsA(value, Param) && ((Param *) value)->paramkind == PARAM_EXTERN)
+			{
+				*hasExternParam = true;
+				return NIL;
+			}
+
+			if (!IsA(value, Const))
+			{
+				return NIL;
+			}
+		}
+
+		rowList = lappend(rowList, valuesList);
+	}
+
+	return rowList;
+}
+
+
+/*
+ * UnnestedArrayRowList returns the rows of ROWS FROM (unnest(a), unnest(b))
+ * as lists of Const. Like unnest, shorter arrays are padded with NULLs.
+ */
+static List *
+UnnestedArrayRowList(RangeTblEntry *rangeTableEntry, bool *hasExternParam)
+{
+	List *rowList = NIL;
+	int functionCount = list_length(rangeTableEntry->functions);
+	Oid *elementTypes = palloc0(functionCount * sizeof(Oid));
+	int16 *elementLengths = palloc0(functionCount * sizeof(int16));
+	bool *elementByValues = palloc0(functionCount * sizeof(bool));
+	Datum **elementValues = palloc0(functionCount * sizeof(Datum *));
+	bool **elementNulls = palloc0(functionCount * sizeof(bool *));
+	int *elementCounts = palloc0(functionCount * sizeof(int));
+	int rowCount = 0;
+	int functionIndex = 0;
+
+	RangeTblFunction *rangeTableFunction = NULL;
+	foreach_ptr(rangeTableFunction, rangeTableEntry->functions)
+	{
+		FuncExpr *unnestExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+		Node *arrayArg = (Node *) linitial(unnestExpr->args);
+		char elementAlignment = 0;
+
+		if (IsA(arrayArg, Param) && ((Param *) arrayArg)->paramkind == PARAM_EXTERN)
+		{
+			*hasExternParam = true;
+			return NIL;
+		}
+
+		if (!IsA(arrayArg, Const))
+		{
+			return NIL;
+		}
+
+		Const *arrayConst = (Const *) arrayArg;
+		Oid elementType = get_element_type(arrayConst->consttype);
+		if (!OidIsValid(elementType))
+		{
+			return NIL;
+		}
+
+		get_typlenbyvalalign(elementType, &elementLengths[functionIndex],
+							 &elementByValues[functionIndex], &elementAlignment);
+		elementTypes[functionIndex] = elementType;
+
+		if (!arrayConst->constisnull)
+		{
+			ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+
+			deconstruct_array(array, elementType, elementLengths[functionIndex],
+							  elementByValues[functionIndex], elementAlignment,
+							  &elementValues[functionIndex], &elementNulls[functionIndex],
+							  &elementCounts[functionIndex]);
+		}
+
+		rowCount = Max(rowCount, elementCounts[functionIndex]);
+		functionIndex++;
+	}
+
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		List *row = NIL;
+
+		for (functionIndex = 0; functionIndex < functionCount; functionIndex++)
+		{
+			Oid elementType = elementTypes[functionIndex];
+			bool isNull = true;
+			Datum value = 0;
+
+			if (rowIndex < elementCounts[functionIndex])
+			{
+				isNull = elementNulls[functionIndex][rowIndex];
+				value = elementValues[functionIndex][rowIndex];
+			}
+
+			Const *valueConst = makeConst(elementType, -1, get_typcollation(elementType),
+										  elementLengths[functionIndex], value, isNull,
+										  elementByValues[functionIndex]);
+
+			row = lappend(row, valueConst);
+		}
+
+		rowList = lappend(rowList, row);
+	}
+
+	return rowList;
+}
+
+
+/*
+ * BatchedCallTaskForRow returns the task in the list that the call for the
+ * given distribution argument value goes to, or a new task when there is
+ * none yet. It returns NULL when the call cannot be delegated.
+ */
+static BatchedCallTask *
+BatchedCallTaskForRow(List *batchedCallTaskList, Const *partitionValue,
+					  CitusTableCacheEntry *distTable)
+{
+	Var *partitionColumn = distTable->partitionColumn;
+	Datum partitionValueDatum = partitionValue->constvalue;
+
+	if (partitionValue->consttype != partitionColumn->vartype)
+	{
+		CopyCoercionData coercionData;
+
+		ConversionPathForTypes(partitionValue->consttype, partitionColumn->vartype,
+							   &coercionData);
+
+		partitionValueDatum = CoerceColumnValue(partitionValueDatum, &coercionData);
+	}
+
+	ShardInterval *shardInterval = FindShardInterval(partitionValueDatum, distTable);
+	if (shardInterval == NULL)
+	{
+		ereport(DEBUG1, (errmsg("cannot push down call, failed to find shard interval")));
+		return NULL;
+	}
+
+	List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+	if (list_length(placementList) != 1)
+	{
+		/* punt on this for now */
+		ereport(DEBUG1, (errmsg(
+							 "cannot push down function call for replicated distributed tables")));
+		return NULL;
+	}
+
+	ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+
+	BatchedCallTask *batchedCallTask = NULL;
+	foreach_ptr(batchedCallTask, batchedCallTaskList)
+	{
+		if (batchedCallTask->groupId == placement->groupId)
+		{
+			return batchedCallTask;
+		}
+	}
+
+	WorkerNode *workerNode = FindWorkerNode(placement->nodeName, placement->nodePort);
+	if (workerNode == NULL || !workerNode->hasMetadata || !workerNode->metadataSynced)
+	{
+		ereport(DEBUG1, (errmsg("the worker node does not have metadata")));
+		return NULL;
+	}
+
+	batchedCallTask = palloc0(sizeof(BatchedCallTask));
+	batchedCallTask->groupId = placement->groupId;
+	batchedCallTask->placement = placement;
+	batchedCallTask->anchorShardId = shardInterval->shardId;
+
+	return batchedCallTask;
+}
+
+
+/*
+ * BatchedCallTaskQuery returns a copy of the given batched call query in
+ * which the range table entry at the given index is a VALUES list of the
+ * given rows.
+ */
+static Query *
+BatchedCallTaskQuery(Query *query, Index batchRangeTableIndex, List *rowList)
+{
+	Query *taskQuery = copyObject(query);
+	RangeTblEntry *rangeTableEntry = rt_fetch(batchRangeTableIndex, taskQuery->rtable);
+
+	if (rangeTableEntry->rtekind == RTE_FUNCTION)
+	{
+		List *firstRow = (List *) linitial(rowList);
+
+		rangeTableEntry->coltypes = NIL;
+		rangeTableEntry->coltypmods = NIL;
+		rangeTableEntry->colcollations = NIL;
+
+		Const *value = NULL;
+		foreach_ptr(value, firstRow)
+		{
+			rangeTableEntry->coltypes = lappend_oid(rangeTableEntry->coltypes,
+													value->consttype);
+			rangeTableEntry->coltypmods = lappend_int(rangeTableEntry->coltypmods,
+													  value->consttypmod);
+			rangeTableEntry->colcollations =
+				lappend_oid(rangeTableEntry->colcollations, value->constcollid);
+		}
+
+		rangeTableEntry->rtekind = RTE_VALUES;
+		rangeTableEntry->functions = NIL;
+	}
+
+	rangeTableEntry->values_lists = rowList;
+
+	return taskQuery;
+}
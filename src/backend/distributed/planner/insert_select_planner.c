@@ -1147,7 +1147,8 @@ CreateCoordinatorInsertSelectPlan(uint64 planId, Query *parse)
  * CoordinatorInsertSelectSupported returns an error if executing an
  * INSERT ... SELECT command by pulling results of the SELECT to the coordinator
  * is unsupported because it needs to generate sequence values or insert into an
- * append-distributed table.
+ * append-distributed table whose shards do not have non-overlapping min/max
+ * values to route the rows by.
  */
 static DeferredErrorMessage *
 CoordinatorInsertSelectSupported(Query *insertSelectQuery)
@@ -1160,11 +1161,16 @@ CoordinatorInsertSelectSupported(Query *insertSelectQuery)
 	}
 
 	RangeTblEntry *insertRte = ExtractResultRelationRTE(insertSelectQuery);
-	if (PartitionMethod(insertRte->relid) == DISTRIBUTE_BY_APPEND)
+	CitusTableCacheEntry *targetCacheEntry = GetCitusTableCacheEntry(insertRte->relid);
+	if (targetCacheEntry->partitionMethod == DISTRIBUTE_BY_APPEND &&
+		(targetCacheEntry->shardIntervalArrayLength == 0 ||
+		 targetCacheEntry->hasOverlappingShardInterval))
 	{
 		return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 							 "INSERT ... SELECT into an append-distributed table is "
-							 "not supported", NULL, NULL);
+							 "not supported",
+							 "The shards of the target table should have "
+							 "non-overlapping shard min/max values.", NULL);
 	}
 
 	return NULL;
@@ -18,15 +18,35 @@
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/query_utils.h"
 #include "distributed/worker_manager.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parse_relation.h"
+#include "parser/parsetree.h"
 #include "utils/builtins.h"
+#include "utils/typcache.h"
 
 /* controlled via GUC, used mostly for testing */
 bool LogIntermediateResults = false;
 
+/* controlled via GUC, number of nodes the coordinator sends a result to directly */
+int IntermediateResultSeedNodeCount = 0;
+
+/* controlled via GUC, whether to only send nodes the rows of their own shards */
+bool EnablePartitionedIntermediateResults = true;
+
 
 static List * FindSubPlansUsedInNode(Node *node, SubPlanAccessType accessType);
+static bool FindPartitionedSubPlanUsages(Node *node, List *usedSubPlanList);
+static void FindPartitionedSubPlanUsagesInQuery(Query *query, List *usedSubPlanList);
+static void InnerJoinQuals(Node *joinNode, List **qualList,
+						   List **rangeTableIndexList);
+static char * IntermediateResultColumn(Query *query, Var *column,
+									   int *resultColumnIndex);
 static void AppendAllAccessedWorkerNodes(IntermediateResultsHashEntry *entry,
 										 DistributedPlan *distributedPlan,
 										 int workerNodeCount);
@@ -35,6 +55,7 @@ static List * FindAllRemoteWorkerNodesUsingSubplan(IntermediateResultsHashEntry
 static List * RemoveLocalNodeFromWorkerList(List *workerNodeList);
 static void LogIntermediateResultMulticastSummary(IntermediateResultsHashEntry *entry,
 												  List *workerNodeList);
+static int IntermediateResultLogLevel(void);
 
 
 /*
@@ -66,6 +87,16 @@ FindSubPlanUsages(DistributedPlan *plan)
 		 */
 		remoteSubPlans = FindSubPlansUsedInNode((Node *) plan->workerJob->jobQuery,
 												SUBPLAN_ACCESS_REMOTE);
+
+		/*
+		 * The tasks of repartition joins do not correspond to the shards of
+		 * the tables in the query, so their results cannot be partitioned.
+		 */
+		if (plan->workerJob->dependentJobList == NIL)
+		{
+			FindPartitionedSubPlanUsages((Node *) plan->workerJob->jobQuery,
+										 remoteSubPlans);
+		}
 	}
 
 	if (plan->insertSelectQuery != NULL)
@@ -122,6 +153,7 @@ FindSubPlansUsedInNode(Node *node, SubPlanAccessType accessType)
 
 			usedPlan->subPlanId = pstrdup(resultId);
 			usedPlan->accessType = accessType;
+			usedPlan->partitionRelationId = InvalidOid;
 
 			usedSubPlanList = lappend(usedSubPlanList, usedPlan);
 		}
@@ -131,6 +163,248 @@ FindSubPlansUsedInNode(Node *node, SubPlanAccessType accessType)
 }
 
 
+/*
+ * FindPartitionedSubPlanUsages walks the given job query and, for each of the
+ * given remote subplan usages whose result is joined with a distributed table
+ * on its distribution key, records that table and the result column it is
+ * joined on.
+ *
+ * Every row of the result that ends up in the output of a task then belongs to
+ * the shard of that table that the task reads, so a node only needs the rows
+ * that belong to its own shards. We only follow inner joins, since rows of the
+ * result that do not match any row of the table can otherwise still appear in
+ * the output.
+ */
+static bool
+FindPartitionedSubPlanUsages(Node *node, List *usedSubPlanList)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		FindPartitionedSubPlanUsagesInQuery(query, usedSubPlanList);
+
+		return query_tree_walker(query, FindPartitionedSubPlanUsages,
+								 usedSubPlanList, 0);
+	}
+
+	return expression_tree_walker(node, FindPartitionedSubPlanUsages,
+								  usedSubPlanList);
+}
+
+
+/*
+ * FindPartitionedSubPlanUsagesInQuery looks for equality clauses in the inner
+ * joins of the given query that compare a column of an intermediate result
+ * with the distribution key of a distributed table, and records them in the
+ * corresponding subplan usages.
+ */
+static void
+FindPartitionedSubPlanUsagesInQuery(Query *query, List *usedSubPlanList)
+{
+	List *qualList = NIL;
+	List *rangeTableIndexList = NIL;
+
+	InnerJoinQuals((Node *) query->jointree, &qualList, &rangeTableIndexList);
+
+	Node *qual = NULL;
+	foreach_ptr(qual, qualList)
+	{
+		if (!IsA(qual, OpExpr) || list_length(((OpExpr *) qual)->args) != 2)
+		{
+			continue;
+		}
+
+		OpExpr *opExpr = (OpExpr *) qual;
+		Node *leftArg = (Node *) linitial(opExpr->args);
+		Node *rightArg = (Node *) lsecond(opExpr->args);
+
+		if (!IsA(leftArg, Var) || !IsA(rightArg, Var))
+		{
+			continue;
+		}
+
+		/* try the result column on either side of the clause */
+		for (int sideIndex = 0; sideIndex < 2; sideIndex++)
+		{
+			Var *resultColumn = (Var *) (sideIndex == 0 ? leftArg : rightArg);
+			Var *relationColumn = (Var *) (sideIndex == 0 ? rightArg : leftArg);
+			int resultColumnIndex = 0;
+
+			if (resultColumn->varlevelsup != 0 || relationColumn->varlevelsup != 0 ||
+				!list_member_int(rangeTableIndexList, resultColumn->varno) ||
+				!list_member_int(rangeTableIndexList, relationColumn->varno))
+			{
+				continue;
+			}
+
+			RangeTblEntry *relationEntry = rt_fetch(relationColumn->varno,
+													query->rtable);
+			if (relationEntry->rtekind != RTE_RELATION ||
+				!IsCitusTable(relationEntry->relid))
+			{
+				continue;
+			}
+
+			char partitionMethod = PartitionMethod(relationEntry->relid);
+			if (partitionMethod != DISTRIBUTE_BY_HASH &&
+				partitionMethod != DISTRIBUTE_BY_RANGE)
+			{
+				continue;
+			}
+
+			/* the values must hash the same way as the distribution key */
+			Var *partitionColumn = DistPartitionKey(relationEntry->relid);
+			if (partitionColumn->varattno != relationColumn->varattno ||
+				partitionColumn->vartype != resultColumn->vartype ||
+				partitionColumn->varcollid != resultColumn->varcollid)
+			{
+				continue;
+			}
+
+			TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+														  TYPECACHE_EQ_OPR);
+			if (opExpr->opno != typeEntry->eq_opr)
+			{
+				continue;
+			}
+
+			char *resultId = IntermediateResultColumn(query, resultColumn,
+													  &resultColumnIndex);
+			if (resultId == NULL)
+			{
+				continue;
+			}
+
+			UsedDistributedSubPlan *usedPlan = NULL;
+			foreach_ptr(usedPlan, usedSubPlanList)
+			{
+				if (strcmp(usedPlan->subPlanId, resultId) == 0)
+				{
+					usedPlan->partitionRelationId = relationEntry->relid;
+					usedPlan->partitionColumnIndex = resultColumnIndex;
+				}
+			}
+		}
+	}
+}
+
+
+/*
+ * InnerJoinQuals appends the quals of the join tree that are evaluated without
+ * passing through an outer join to qualList, and the range table indexes that
+ * are reached that way to rangeTableIndexList.
+ */
+static void
+InnerJoinQuals(Node *joinNode, List **qualList, List **rangeTableIndexList)
+{
+	if (joinNode == NULL)
+	{
+		return;
+	}
+	else if (IsA(joinNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinNode;
+		ListCell *fromExprCell = NULL;
+
+		*qualList = list_concat(*qualList,
+								make_ands_implicit((Expr *) fromExpr->quals));
+
+		foreach(fromExprCell, fromExpr->fromlist)
+		{
+			InnerJoinQuals((Node *) lfirst(fromExprCell), qualList,
+						   rangeTableIndexList);
+		}
+	}
+	else if (IsA(joinNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			*qualList = list_concat(*qualList,
+									make_ands_implicit((Expr *) joinExpr->quals));
+
+			InnerJoinQuals(joinExpr->larg, qualList, rangeTableIndexList);
+			InnerJoinQuals(joinExpr->rarg, qualList, rangeTableIndexList);
+		}
+	}
+	else if (IsA(joinNode, RangeTblRef))
+	{
+		int rangeTableIndex = ((RangeTblRef *) joinNode)->rtindex;
+
+		*rangeTableIndexList = lappend_int(*rangeTableIndexList, rangeTableIndex);
+	}
+}
+
+
+/*
+ * IntermediateResultColumn returns the ID of the intermediate result if the
+ * given column refers to a subquery that reads all rows of an intermediate
+ * result, as built by BuildSubPlanResultQuery, and sets resultColumnIndex to
+ * the index of the corresponding column in the result. Otherwise, it returns
+ * NULL.
+ */
+static char *
+IntermediateResultColumn(Query *query, Var *column, int *resultColumnIndex)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY)
+	{
+		return NULL;
+	}
+
+	Query *subquery = rangeTableEntry->subquery;
+	if (list_length(subquery->rtable) != 1 || subquery->jointree->quals != NULL ||
+		subquery->hasAggs || subquery->groupClause != NIL ||
+		subquery->groupingSets != NIL || subquery->havingQual != NULL ||
+		subquery->hasWindowFuncs || subquery->hasTargetSRFs ||
+		subquery->distinctClause != NIL || subquery->setOperations != NULL ||
+		subquery->limitCount != NULL || subquery->limitOffset != NULL)
+	{
+		return NULL;
+	}
+
+	RangeTblEntry *functionEntry = (RangeTblEntry *) linitial(subquery->rtable);
+	if (functionEntry->rtekind != RTE_FUNCTION ||
+		list_length(functionEntry->functions) != 1)
+	{
+		return NULL;
+	}
+
+	RangeTblFunction *rangeTableFunction = linitial(functionEntry->functions);
+	FuncExpr *funcExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+	if (!IsA(funcExpr, FuncExpr) ||
+		funcExpr->funcid != CitusReadIntermediateResultFuncId())
+	{
+		return NULL;
+	}
+
+	TargetEntry *targetEntry = get_tle_by_resno(subquery->targetList,
+												column->varattno);
+	if (targetEntry == NULL || targetEntry->resjunk ||
+		!IsA(targetEntry->expr, Var))
+	{
+		return NULL;
+	}
+
+	Var *resultColumn = (Var *) targetEntry->expr;
+	if (resultColumn->varno != 1 || resultColumn->varlevelsup != 0)
+	{
+		return NULL;
+	}
+
+	*resultColumnIndex = resultColumn->varattno - 1;
+
+	return FindIntermediateResultIdIfExists(functionEntry);
+}
+
+
 /*
  * RecordSubplanExecutionsOnNodes iterates over the usedSubPlanNodeList,
  * and for each entry, record the workerNodes that are accessed by
@@ -162,6 +436,10 @@ RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 		IntermediateResultsHashEntry *entry = SearchIntermediateResult(
 			intermediateResultsHash, resultId);
 
+		entry->usageCount++;
+		entry->partitionRelationId = usedPlan->partitionRelationId;
+		entry->partitionColumnIndex = usedPlan->partitionColumnIndex;
+
 		/*
 		 * There is no need to traverse the subplan if the intermediate result
 		 * will be written to a local file and sent to all nodes. Note that the
@@ -397,19 +675,7 @@ LogIntermediateResultMulticastSummary(IntermediateResultsHashEntry *entry,
 									  List *workerNodeList)
 {
 	char *resultId = entry->key;
-
-	/*
-	 * Log a summary of decisions made for intermediate result multicast. By default
-	 * we log at level DEBUG4. When the user has set citus.log_intermediate_results
-	 * we change the log level to DEBUG1. This is mostly useful in regression tests
-	 * where we specifically want to debug this decisions, but not all DEBUG4 messages.
-	 */
-	int logLevel = DEBUG4;
-
-	if (LogIntermediateResults)
-	{
-		logLevel = DEBUG1;
-	}
+	int logLevel = IntermediateResultLogLevel();
 
 	if (IsLoggableLevel(logLevel))
 	{
@@ -428,6 +694,98 @@ LogIntermediateResultMulticastSummary(IntermediateResultsHashEntry *entry,
 }
 
 
+/*
+ * PlanIntermediateResultForwarding decides how an intermediate result reaches
+ * the given worker nodes. By default, the coordinator sends the result to all
+ * of them. When citus.intermediate_result_seed_node_count is set and there are
+ * more nodes than that, the coordinator only sends the result to that many seed
+ * nodes and the other nodes fetch it from the nodes that already have it. This
+ * keeps the outgoing traffic of the coordinator constant as the cluster grows.
+ *
+ * The function returns the nodes the coordinator should send the result to and
+ * sets forwardRoundList to a list of rounds, each of which is a list of
+ * IntermediateResultForward. Every node that has the result serves at most one
+ * other node per round, such that the number of nodes having the result doubles
+ * with every round.
+ */
+List *
+PlanIntermediateResultForwarding(char *resultId, List *workerNodeList,
+								 List **forwardRoundList)
+{
+	int workerNodeCount = list_length(workerNodeList);
+	int seedNodeCount = IntermediateResultSeedNodeCount;
+	int logLevel = IntermediateResultLogLevel();
+
+	*forwardRoundList = NIL;
+
+	if (seedNodeCount <= 0 || workerNodeCount <= seedNodeCount)
+	{
+		return workerNodeList;
+	}
+
+	List *seedNodeList = list_truncate(list_copy(workerNodeList), seedNodeCount);
+	List *sourceNodeList = list_copy(seedNodeList);
+	int targetNodeIndex = seedNodeCount;
+
+	while (targetNodeIndex < workerNodeCount)
+	{
+		List *forwardList = NIL;
+		List *newSourceNodeList = NIL;
+
+		WorkerNode *sourceNode = NULL;
+		foreach_ptr(sourceNode, sourceNodeList)
+		{
+			if (targetNodeIndex >= workerNodeCount)
+			{
+				break;
+			}
+
+			WorkerNode *targetNode = list_nth(workerNodeList, targetNodeIndex);
+			targetNodeIndex++;
+
+			IntermediateResultForward *forward =
+				palloc0(sizeof(IntermediateResultForward));
+			forward->sourceNode = sourceNode;
+			forward->targetNode = targetNode;
+
+			forwardList = lappend(forwardList, forward);
+			newSourceNodeList = lappend(newSourceNodeList, targetNode);
+
+			if (IsLoggableLevel(logLevel))
+			{
+				elog(logLevel, "Subplan %s will be forwarded from %s:%d to %s:%d",
+					 resultId, sourceNode->workerName, sourceNode->workerPort,
+					 targetNode->workerName, targetNode->workerPort);
+			}
+		}
+
+		sourceNodeList = list_concat(sourceNodeList, newSourceNodeList);
+		*forwardRoundList = lappend(*forwardRoundList, forwardList);
+	}
+
+	return seedNodeList;
+}
+
+
+/*
+ * IntermediateResultLogLevel returns the level at which we log the decisions
+ * made for intermediate result multicast. By default we log at level DEBUG4.
+ * When the user has set citus.log_intermediate_results we change the log level
+ * to DEBUG1. This is mostly useful in regression tests where we specifically
+ * want to debug this decisions, but not all DEBUG4 messages.
+ */
+static int
+IntermediateResultLogLevel(void)
+{
+	if (LogIntermediateResults)
+	{
+		return DEBUG1;
+	}
+
+	return DEBUG4;
+}
+
+
 /*
  * SearchIntermediateResult searches through intermediateResultsHash for a given
  * intermediate result id.
@@ -447,6 +805,9 @@ SearchIntermediateResult(HTAB *intermediateResultsHash, char *resultId)
 	{
 		entry->nodeIdList = NIL;
 		entry->writeLocalFile = false;
+		entry->usageCount = 0;
+		entry->partitionRelationId = InvalidOid;
+		entry->partitionColumnIndex = 0;
 	}
 
 	return entry;
@@ -20,9 +20,11 @@
 #include "commands/explain.h"
 #include "commands/tablecmds.h"
 #include "optimizer/cost.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/inline_intermediate_results.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/listutils.h"
@@ -34,13 +36,17 @@
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/planning_stats.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/placement_connection.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
+#include "executor/tstoreReceiver.h"
 #include "lib/stringinfo.h"
 #include "nodes/plannodes.h"
 #include "nodes/primnodes.h"
@@ -54,7 +60,9 @@
 #include "utils/builtins.h"
 #include "utils/json.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
 
 
 /* OR-able flags for ExplainXMLTag() (explain.c) */
@@ -67,6 +75,8 @@
 /* Config variables that enable printing distributed query plans */
 bool ExplainDistributedQueries = true;
 bool ExplainAllTasks = false;
+bool ExplainWorkerPools = false;
+bool ExplainAnalyzeSinglePass = false;
 
 
 /* Result for a single remote EXPLAIN command */
@@ -77,9 +87,40 @@ typedef struct RemoteExplainPlan
 } RemoteExplainPlan;
 
 
+/*
+ * ExplainAnalyzeOptions holds the options of the EXPLAIN ANALYZE command that
+ * is running, with which the tasks report their EXPLAIN ANALYZE output when
+ * citus.explain_analyze_single_pass is on.
+ */
+typedef struct ExplainAnalyzeOptions
+{
+	bool verbose;
+	bool costs;
+	bool buffers;
+	bool timing;
+	bool summary;
+	ExplainFormat format;
+} ExplainAnalyzeOptions;
+
+
+/* options of the innermost running EXPLAIN ANALYZE, or NULL if there is none */
+static ExplainAnalyzeOptions *CurrentExplainAnalyzeOptions = NULL;
+
+/* output of the last query run by worker_save_query_explain_analyze */
+static char *SavedExplainAnalyzeOutput = NULL;
+static double SavedExecutionDurationMillisec = 0.0;
+
+
 /* Explain functions for distributed queries */
 static void ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es);
+static void ExplainDistributedPlanningPhases(DistributedPlan *distributedPlan,
+											 ExplainState *es);
 static void ExplainJob(Job *job, ExplainState *es);
+static void ExplainResultStorage(CitusScanState *scanState, ExplainState *es);
+static void ExplainWorkerPoolStatsList(List *workerPoolStatsList,
+									   ExplainState *es);
+static int CompareWorkerPoolExecutionStats(const void *leftElement,
+										 const void *rightElement);
 static void ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es);
 static void ExplainTaskList(List *taskList, ExplainState *es);
 static RemoteExplainPlan * RemoteExplain(Task *task, ExplainState *es);
@@ -87,13 +128,33 @@ static void ExplainTask(Task *task, int placementIndex, List *explainOutputList,
 						ExplainState *es);
 static void ExplainTaskPlacement(ShardPlacement *taskPlacement, List *explainOutputList,
 								 ExplainState *es);
+static RemoteExplainPlan * FetchedExplainAnalyzePlan(Task *task);
+static Task * SlowestExplainAnalyzedTask(List *taskList);
 static StringInfo BuildRemoteExplainQuery(char *queryString, ExplainState *es);
+static const char * ExplainFormatName(ExplainFormat format);
+static ExplainFormat ExplainFormatFromName(char *formatName);
+static void SaveExplainAnalyzeOutput(const char *explainOutput,
+									 double executionDurationMillisec);
+static void EnsureMatchingTupleDescriptors(TupleDesc queryDescriptor,
+										   TupleDesc expectedDescriptor);
 
 /* Static Explain functions copied from explain.c */
 static void ExplainOneQuery(Query *query, int cursorOptions,
 							IntoClause *into, ExplainState *es,
 							const char *queryString, ParamListInfo params,
 							QueryEnvironment *queryEnv);
+static void ExplainWorkerPlan(PlannedStmt *plannedStmt, DestReceiver *dest,
+							  ExplainState *es, const char *queryString,
+							  ParamListInfo params, QueryEnvironment *queryEnv,
+							  const instr_time *planDuration,
+							  TupleDesc expectedDescriptor,
+							  double *executionDurationMillisec);
+static double elapsed_time(instr_time *starttime);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_save_query_explain_analyze);
+PG_FUNCTION_INFO_V1(worker_last_saved_explain_analyze);
 
 
 /*
@@ -124,6 +185,19 @@ CitusExplainScan(CustomScanState *node, List *ancestors, struct ExplainState *es
 
 	ExplainJob(distributedPlan->workerJob, es);
 
+	/* also collected for citus_stat_statements, only shown on request */
+	if (ExplainWorkerPools && es->analyze && scanState->workerPoolStatsList != NIL)
+	{
+		ExplainWorkerPoolStatsList(scanState->workerPoolStatsList, es);
+		ExplainResultStorage(scanState, es);
+	}
+
+	/* like the planning time, the phases are only shown in the summary */
+	if (ExplainPlanningPhases && es->summary && distributedPlan->hasPlanningPhaseTimes)
+	{
+		ExplainDistributedPlanningPhases(distributedPlan, es);
+	}
+
 	ExplainCloseGroup("Distributed Query", "Distributed Query", true, es);
 }
 
@@ -226,6 +300,148 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 }
 
 
+/*
+ * ExplainDistributedPlanningPhases shows the time distributed planning spent
+ * in each of its phases. Phases that took no time at all are omitted.
+ */
+static void
+ExplainDistributedPlanningPhases(DistributedPlan *distributedPlan, ExplainState *es)
+{
+	ExplainOpenGroup("Planning Phases", "Planning Phases", true, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfo(es->str, "Planning Phases:\n");
+		es->indent += 1;
+	}
+
+	for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+	{
+		double phaseTime = distributedPlan->planningPhaseTimes[phase];
+
+		if (phaseTime > 0.0)
+		{
+			ExplainPropertyFloat(PlanningPhaseName(phase), "ms", phaseTime, 3, es);
+		}
+	}
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		es->indent -= 1;
+	}
+
+	ExplainCloseGroup("Planning Phases", "Planning Phases", true, es);
+}
+
+
+/*
+ * ExplainWorkerPoolStatsList shows how the execution went on each of the
+ * workers, ordered by node. Times are only shown when TIMING is on, such that
+ * the output can be made stable.
+ */
+static void
+ExplainWorkerPoolStatsList(List *workerPoolStatsList, ExplainState *es)
+{
+	List *sortedStatsList = SortList(workerPoolStatsList,
+									 CompareWorkerPoolExecutionStats);
+
+	ExplainOpenGroup("Worker Pools", "Worker Pools", false, es);
+
+	WorkerPoolExecutionStats *poolStats = NULL;
+	foreach_ptr(poolStats, sortedStatsList)
+	{
+		StringInfo nodeAddress = makeStringInfo();
+
+		ExplainOpenGroup("Worker Pool", NULL, true, es);
+
+		if (es->format == EXPLAIN_FORMAT_TEXT)
+		{
+			appendStringInfoSpaces(es->str, es->indent * 2);
+			appendStringInfo(es->str, "->  Worker Pool\n");
+			es->indent += 3;
+		}
+
+		appendStringInfo(nodeAddress, "host=%s port=%d", poolStats->nodeName,
+						 poolStats->nodePort);
+		ExplainPropertyText("Node", nodeAddress->data, es);
+		ExplainPropertyInteger("Tasks", NULL, poolStats->taskCount, es);
+		ExplainPropertyInteger("Rows Received", NULL, poolStats->rowCount, es);
+		ExplainPropertyInteger("Bytes Received", "bytes", poolStats->byteCount, es);
+
+		if (es->timing)
+		{
+			ExplainPropertyInteger("Connections Established", NULL,
+								   poolStats->connectionCount, es);
+			ExplainPropertyFloat("Connection Time", "ms",
+								 poolStats->connectionTime, 3, es);
+			ExplainPropertyFloat("Queue Wait Time", "ms",
+								 poolStats->queueWaitTime, 3, es);
+
+			if (poolStats->receivedResults)
+			{
+				ExplainPropertyFloat("First Byte Time", "ms",
+									 poolStats->firstByteTime, 3, es);
+				ExplainPropertyFloat("Last Byte Time", "ms",
+									 poolStats->lastByteTime, 3, es);
+			}
+		}
+
+		if (es->format == EXPLAIN_FORMAT_TEXT)
+		{
+			es->indent -= 3;
+		}
+
+		ExplainCloseGroup("Worker Pool", NULL, true, es);
+	}
+
+	ExplainCloseGroup("Worker Pools", "Worker Pools", false, es);
+}
+
+
+/*
+ * ExplainResultStorage shows the size of the rows the coordinator built from
+ * the results of the workers, and whether the tuple store that holds them
+ * spilled to disk.
+ */
+static void
+ExplainResultStorage(CitusScanState *scanState, ExplainState *es)
+{
+	Tuplestorestate *tupleStore = scanState->tuplestorestate;
+
+	ExplainPropertyInteger("Result Size", "bytes", scanState->receivedRowBytes, es);
+
+	if (tupleStore != NULL)
+	{
+		ExplainPropertyText("Result Storage",
+							tuplestore_in_memory(tupleStore) ? "Memory" : "Disk", es);
+	}
+}
+
+
+/*
+ * CompareWorkerPoolExecutionStats orders WorkerPoolExecutionStats by node name
+ * and port.
+ */
+static int
+CompareWorkerPoolExecutionStats(const void *leftElement, const void *rightElement)
+{
+	const WorkerPoolExecutionStats *leftStats =
+		*((const WorkerPoolExecutionStats **) leftElement);
+	const WorkerPoolExecutionStats *rightStats =
+		*((const WorkerPoolExecutionStats **) rightElement);
+
+	int nodeNameCompare = strncmp(leftStats->nodeName, rightStats->nodeName,
+								  WORKER_LENGTH);
+	if (nodeNameCompare != 0)
+	{
+		return nodeNameCompare;
+	}
+
+	return leftStats->nodePort - rightStats->nodePort;
+}
+
+
 /*
  * ExplainJob shows the EXPLAIN output for a Job in the physical plan of
  * a distributed query by showing the remote EXPLAIN for the first task,
@@ -253,6 +469,13 @@ ExplainJob(Job *job, ExplainState *es)
 	{
 		ExplainPropertyText("Tasks Shown", "All", es);
 	}
+	else if (SlowestExplainAnalyzedTask(taskList) != NULL)
+	{
+		StringInfo tasksShownText = makeStringInfo();
+		appendStringInfo(tasksShownText, "Slowest of %d", taskCount);
+
+		ExplainPropertyText("Tasks Shown", tasksShownText->data, es);
+	}
 	else
 	{
 		StringInfo tasksShownText = makeStringInfo();
@@ -349,7 +572,10 @@ ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es)
 
 /*
  * ExplainTaskList shows the remote EXPLAIN for the first task in taskList,
- * or all tasks if citus.explain_all_tasks is on.
+ * or all tasks if citus.explain_all_tasks is on. If tasks returned their
+ * EXPLAIN ANALYZE output during the execution, the slowest of them is shown
+ * instead of the first task, and their output is used instead of running
+ * EXPLAIN ANALYZE again.
  */
 static void
 ExplainTaskList(List *taskList, ExplainState *es)
@@ -361,11 +587,26 @@ ExplainTaskList(List *taskList, ExplainState *es)
 	/* make sure that the output is consistent */
 	taskList = SortList(taskList, CompareTasksByTaskId);
 
+	Task *slowestTask = SlowestExplainAnalyzedTask(taskList);
+	if (!ExplainAllTasks && slowestTask != NULL)
+	{
+		taskList = list_make1(slowestTask);
+	}
+
 	foreach(taskCell, taskList)
 	{
 		Task *task = (Task *) lfirst(taskCell);
+		RemoteExplainPlan *remoteExplain = NULL;
+
+		if (task->fetchedExplainAnalyzePlan != NULL)
+		{
+			remoteExplain = FetchedExplainAnalyzePlan(task);
+		}
+		else
+		{
+			remoteExplain = RemoteExplain(task, es);
+		}
 
-		RemoteExplainPlan *remoteExplain = RemoteExplain(task, es);
 		remoteExplainList = lappend(remoteExplainList, remoteExplain);
 
 		if (!ExplainAllTasks)
@@ -399,9 +640,8 @@ RemoteExplain(Task *task, ExplainState *es)
 
 	RemoteExplainPlan *remotePlan = (RemoteExplainPlan *) palloc0(
 		sizeof(RemoteExplainPlan));
-	StringInfo explainQuery = BuildRemoteExplainQuery(TaskQueryStringForAllPlacements(
-														  task),
-													  es);
+	char *queryString = InlineIntermediateResults(TaskQueryStringForAllPlacements(task));
+	StringInfo explainQuery = BuildRemoteExplainQuery(queryString, es);
 
 	/*
 	 * Use a coordinated transaction to ensure that we open a transaction block
@@ -466,6 +706,76 @@ RemoteExplain(Task *task, ExplainState *es)
 }
 
 
+/*
+ * FetchedExplainAnalyzePlan returns the EXPLAIN ANALYZE output that the given
+ * task returned along with its rows, with a row per line like the output of a
+ * remote EXPLAIN in text format.
+ */
+static RemoteExplainPlan *
+FetchedExplainAnalyzePlan(Task *task)
+{
+	RemoteExplainPlan *remotePlan = (RemoteExplainPlan *) palloc0(
+		sizeof(RemoteExplainPlan));
+	char *explainOutput = pstrdup(task->fetchedExplainAnalyzePlan);
+	char *lineStart = explainOutput;
+
+	remotePlan->placementIndex = task->fetchedExplainAnalyzePlacementIndex;
+
+	while (*lineStart != '\0')
+	{
+		char *lineEnd = strchr(lineStart, '\n');
+		if (lineEnd != NULL)
+		{
+			*lineEnd = '\0';
+		}
+
+		StringInfo rowString = makeStringInfo();
+		appendStringInfoString(rowString, lineStart);
+		remotePlan->explainOutputList = lappend(remotePlan->explainOutputList,
+												rowString);
+
+		if (lineEnd == NULL)
+		{
+			break;
+		}
+
+		lineStart = lineEnd + 1;
+	}
+
+	return remotePlan;
+}
+
+
+/*
+ * SlowestExplainAnalyzedTask returns the task in the given list that took the
+ * longest to execute among those that returned their EXPLAIN ANALYZE output
+ * during the execution, or NULL if there are no such tasks.
+ */
+static Task *
+SlowestExplainAnalyzedTask(List *taskList)
+{
+	Task *slowestTask = NULL;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->fetchedExplainAnalyzePlan == NULL)
+		{
+			continue;
+		}
+
+		if (slowestTask == NULL ||
+			task->fetchedExplainAnalyzeExecutionDuration >
+			slowestTask->fetchedExplainAnalyzeExecutionDuration)
+		{
+			slowestTask = task;
+		}
+	}
+
+	return slowestTask;
+}
+
+
 /*
  * ExplainTask shows the EXPLAIN output for an single task. The output has been
  * fetched from the placement at index placementIndex. If explainOutputList is NIL,
@@ -593,49 +903,352 @@ static StringInfo
 BuildRemoteExplainQuery(char *queryString, ExplainState *es)
 {
 	StringInfo explainQuery = makeStringInfo();
-	char *formatStr = NULL;
+	const char *formatStr = ExplainFormatName(es->format);
+
+	appendStringInfo(explainQuery,
+					 "EXPLAIN (ANALYZE %s, VERBOSE %s, "
+					 "COSTS %s, BUFFERS %s, TIMING %s, SUMMARY %s, "
+					 "FORMAT %s) %s",
+					 es->analyze ? "TRUE" : "FALSE",
+					 es->verbose ? "TRUE" : "FALSE",
+					 es->costs ? "TRUE" : "FALSE",
+					 es->buffers ? "TRUE" : "FALSE",
+					 es->timing ? "TRUE" : "FALSE",
+					 es->summary ? "TRUE" : "FALSE",
+					 formatStr,
+					 queryString);
 
-	switch (es->format)
+	return explainQuery;
+}
+
+
+/*
+ * ExplainFormatName returns the name of the given EXPLAIN format, as used in
+ * the FORMAT option of EXPLAIN.
+ */
+static const char *
+ExplainFormatName(ExplainFormat format)
+{
+	switch (format)
 	{
 		case EXPLAIN_FORMAT_XML:
 		{
-			formatStr = "XML";
-			break;
+			return "XML";
 		}
 
 		case EXPLAIN_FORMAT_JSON:
 		{
-			formatStr = "JSON";
-			break;
+			return "JSON";
 		}
 
 		case EXPLAIN_FORMAT_YAML:
 		{
-			formatStr = "YAML";
-			break;
+			return "YAML";
 		}
 
 		default:
 		{
-			formatStr = "TEXT";
-			break;
+			return "TEXT";
 		}
 	}
+}
 
-	appendStringInfo(explainQuery,
-					 "EXPLAIN (ANALYZE %s, VERBOSE %s, "
-					 "COSTS %s, BUFFERS %s, TIMING %s, SUMMARY %s, "
-					 "FORMAT %s) %s",
-					 es->analyze ? "TRUE" : "FALSE",
-					 es->verbose ? "TRUE" : "FALSE",
-					 es->costs ? "TRUE" : "FALSE",
-					 es->buffers ? "TRUE" : "FALSE",
-					 es->timing ? "TRUE" : "FALSE",
-					 es->summary ? "TRUE" : "FALSE",
-					 formatStr,
-					 queryString);
 
-	return explainQuery;
+/*
+ * ExplainFormatFromName returns the EXPLAIN format with the given name, and
+ * errors out if there is no such format.
+ */
+static ExplainFormat
+ExplainFormatFromName(char *formatName)
+{
+	if (pg_strcasecmp(formatName, "TEXT") == 0)
+	{
+		return EXPLAIN_FORMAT_TEXT;
+	}
+	else if (pg_strcasecmp(formatName, "XML") == 0)
+	{
+		return EXPLAIN_FORMAT_XML;
+	}
+	else if (pg_strcasecmp(formatName, "JSON") == 0)
+	{
+		return EXPLAIN_FORMAT_JSON;
+	}
+	else if (pg_strcasecmp(formatName, "YAML") == 0)
+	{
+		return EXPLAIN_FORMAT_YAML;
+	}
+
+	ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("unrecognized EXPLAIN format \"%s\"", formatName)));
+}
+
+
+/*
+ * CitusExplainOneQuery is the ExplainOneQuery_hook. It does what PostgreSQL
+ * does without the hook, but keeps the options of EXPLAIN ANALYZE commands
+ * around while they run, such that the executor can ask the workers for the
+ * EXPLAIN ANALYZE output of the tasks in the same format (see
+ * WrapQueryForExplainAnalyze).
+ */
+void
+CitusExplainOneQuery(Query *query, int cursorOptions, IntoClause *into,
+					 ExplainState *es, const char *queryString, ParamListInfo params,
+					 QueryEnvironment *queryEnv)
+{
+	ExplainAnalyzeOptions *previousOptions = CurrentExplainAnalyzeOptions;
+	ExplainAnalyzeOptions options = {
+		.verbose = es->verbose,
+		.costs = es->costs,
+		.buffers = es->buffers,
+		.timing = es->timing,
+		.summary = es->summary,
+		.format = es->format
+	};
+
+	CurrentExplainAnalyzeOptions = es->analyze ? &options : NULL;
+
+	PG_TRY();
+	{
+		instr_time planStart;
+		instr_time planDuration;
+
+		/* rest is copied from ExplainOneQuery() in explain.c */
+		INSTR_TIME_SET_CURRENT(planStart);
+
+		PlannedStmt *plan = pg_plan_query(query, cursorOptions, params);
+
+		INSTR_TIME_SET_CURRENT(planDuration);
+		INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+		ExplainOnePlan(plan, into, es, queryString, params, queryEnv, &planDuration);
+	}
+	PG_CATCH();
+	{
+		CurrentExplainAnalyzeOptions = previousOptions;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	CurrentExplainAnalyzeOptions = previousOptions;
+}
+
+
+/*
+ * CanExplainAnalyzeTasksInSinglePass returns whether the tasks that are being
+ * executed can return their EXPLAIN ANALYZE output along with their rows, which
+ * requires citus.explain_analyze_single_pass and an EXPLAIN ANALYZE command
+ * that is running.
+ */
+bool
+CanExplainAnalyzeTasksInSinglePass(void)
+{
+	return ExplainAnalyzeSinglePass && CurrentExplainAnalyzeOptions != NULL;
+}
+
+
+/*
+ * WrapQueryForExplainAnalyze wraps the given task query such that the worker
+ * runs it with EXPLAIN ANALYZE and the options of the running EXPLAIN ANALYZE
+ * command. The wrapped query returns the rows of the task query, which have
+ * the columns of the given tuple descriptor, followed by a second result with
+ * the EXPLAIN ANALYZE output and the execution duration of the query.
+ */
+char *
+WrapQueryForExplainAnalyze(const char *queryString, TupleDesc tupleDescriptor)
+{
+	ExplainAnalyzeOptions *options = CurrentExplainAnalyzeOptions;
+	StringInfo columnDefinitions = makeStringInfo();
+	StringInfo wrappedQuery = makeStringInfo();
+
+	Assert(options != NULL);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		appendStringInfo(columnDefinitions, "%sfield_%d %s",
+						 columnIndex > 0 ? ", " : "", columnIndex,
+						 format_type_be_qualified(attribute->atttypid));
+	}
+
+	appendStringInfo(wrappedQuery,
+					 "SELECT * FROM worker_save_query_explain_analyze(%s, "
+					 "%s, %s, %s, %s, %s, %s) AS (%s);"
+					 "SELECT explain_analyze_output, execution_duration "
+					 "FROM worker_last_saved_explain_analyze()",
+					 quote_literal_cstr(queryString),
+					 options->verbose ? "true" : "false",
+					 options->costs ? "true" : "false",
+					 options->buffers ? "true" : "false",
+					 options->timing ? "true" : "false",
+					 options->summary ? "true" : "false",
+					 quote_literal_cstr(ExplainFormatName(options->format)),
+					 columnDefinitions->data);
+
+	return wrappedQuery->data;
+}
+
+
+/*
+ * worker_save_query_explain_analyze runs the given query with EXPLAIN ANALYZE
+ * and the given options, and returns the rows of the query. The EXPLAIN ANALYZE
+ * output is saved for worker_last_saved_explain_analyze, which the coordinator
+ * calls in the same command.
+ */
+Datum
+worker_save_query_explain_analyze(PG_FUNCTION_ARGS)
+{
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(0));
+	ExplainState *es = NewExplainState();
+	ParamListInfo params = NULL;
+	QueryEnvironment *queryEnv = NULL;
+	int cursorOptions = CURSOR_OPT_PARALLEL_OK;
+	double executionDurationMillisec = 0.0;
+	instr_time planStart;
+	instr_time planDuration;
+
+	CheckCitusVersion(ERROR);
+
+	es->analyze = true;
+	es->verbose = PG_GETARG_BOOL(1);
+	es->costs = PG_GETARG_BOOL(2);
+	es->buffers = PG_GETARG_BOOL(3);
+	es->timing = PG_GETARG_BOOL(4);
+	es->summary = PG_GETARG_BOOL(5);
+	es->format = ExplainFormatFromName(text_to_cstring(PG_GETARG_TEXT_P(6)));
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	DestReceiver *tupleStoreDest = CreateTuplestoreDestReceiver();
+	SetTuplestoreDestReceiverParams(tupleStoreDest, tupleStore, CurrentMemoryContext,
+									false);
+
+	List *parseTreeList = pg_parse_query(queryString);
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("cannot EXPLAIN ANALYZE multiple queries")));
+	}
+
+	RawStmt *parseTree = linitial(parseTreeList);
+	List *queryList = pg_analyze_and_rewrite(parseTree, queryString, NULL, 0,
+											 queryEnv);
+	if (list_length(queryList) != 1)
+	{
+		ereport(ERROR, (errmsg("cannot EXPLAIN ANALYZE a query rewritten into "
+							   "multiple queries")));
+	}
+
+	Query *query = linitial(queryList);
+	if (query->commandType == CMD_UTILITY)
+	{
+		ereport(ERROR, (errmsg("cannot EXPLAIN ANALYZE a utility command")));
+	}
+
+	ExplainBeginOutput(es);
+
+	INSTR_TIME_SET_CURRENT(planStart);
+
+	PlannedStmt *plan = pg_plan_query(query, cursorOptions, params);
+
+	INSTR_TIME_SET_CURRENT(planDuration);
+	INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+	ExplainWorkerPlan(plan, tupleStoreDest, es, queryString, params, queryEnv,
+					  &planDuration, tupleDescriptor, &executionDurationMillisec);
+
+	ExplainEndOutput(es);
+
+	/* like EXPLAIN, remove the last line break of the text format */
+	if (es->format == EXPLAIN_FORMAT_TEXT && es->str->len > 0 &&
+		es->str->data[es->str->len - 1] == '\n')
+	{
+		es->str->data[--es->str->len] = '\0';
+	}
+
+	SaveExplainAnalyzeOutput(es->str->data, executionDurationMillisec);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
+/*
+ * worker_last_saved_explain_analyze returns the EXPLAIN ANALYZE output and the
+ * execution duration in milliseconds of the last query that was run by
+ * worker_save_query_explain_analyze, or no rows if there is none.
+ */
+Datum
+worker_last_saved_explain_analyze(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (SavedExplainAnalyzeOutput != NULL)
+	{
+		Datum values[2];
+		bool nulls[2];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(SavedExplainAnalyzeOutput);
+		values[1] = Float8GetDatum(SavedExecutionDurationMillisec);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
+/*
+ * SaveExplainAnalyzeOutput keeps the given EXPLAIN ANALYZE output and execution
+ * duration for worker_last_saved_explain_analyze, replacing the ones that were
+ * saved before.
+ */
+static void
+SaveExplainAnalyzeOutput(const char *explainOutput, double executionDurationMillisec)
+{
+	if (SavedExplainAnalyzeOutput != NULL)
+	{
+		pfree(SavedExplainAnalyzeOutput);
+	}
+
+	SavedExplainAnalyzeOutput = MemoryContextStrdup(TopMemoryContext, explainOutput);
+	SavedExecutionDurationMillisec = executionDurationMillisec;
+}
+
+
+/*
+ * EnsureMatchingTupleDescriptors errors out if the rows of a query, which have
+ * the first tuple descriptor, cannot be returned as rows with the second tuple
+ * descriptor.
+ */
+static void
+EnsureMatchingTupleDescriptors(TupleDesc queryDescriptor, TupleDesc expectedDescriptor)
+{
+	if (queryDescriptor->natts != expectedDescriptor->natts)
+	{
+		ereport(ERROR, (errmsg("query returns %d columns, but %d are expected",
+							   queryDescriptor->natts, expectedDescriptor->natts)));
+	}
+
+	for (int columnIndex = 0; columnIndex < queryDescriptor->natts; columnIndex++)
+	{
+		Oid queryTypeId = TupleDescAttr(queryDescriptor, columnIndex)->atttypid;
+		Oid expectedTypeId = TupleDescAttr(expectedDescriptor, columnIndex)->atttypid;
+
+		if (queryTypeId != expectedTypeId)
+		{
+			ereport(ERROR, (errmsg("query returns type %s at column %d, but %s is "
+								   "expected", format_type_be(queryTypeId),
+								   columnIndex + 1, format_type_be(expectedTypeId))));
+		}
+	}
 }
 
 
@@ -679,3 +1292,149 @@ ExplainOneQuery(Query *query, int cursorOptions,
 					   &planduration);
 	}
 }
+
+
+/*
+ * ExplainWorkerPlan produces explain output into es. If es->analyze, it also
+ * executes the given plannedStmt and sends the results to dest. It puts the
+ * total time to execute in executionDurationMillisec.
+ *
+ * This is based on postgres' ExplainOnePlan(). We couldn't use an IntoClause to
+ * store the results into a tuplestore, so we copied the same functionality with
+ * some minor changes.
+ *
+ * Keeping the formatting to make comparing with the ExplainOnePlan() easier.
+ */
+static void
+ExplainWorkerPlan(PlannedStmt *plannedstmt, DestReceiver *dest, ExplainState *es,
+				  const char *queryString, ParamListInfo params,
+				  QueryEnvironment *queryEnv, const instr_time *planduration,
+				  TupleDesc expectedDescriptor,
+				  double *executionDurationMillisec)
+{
+	QueryDesc  *queryDesc;
+	instr_time	starttime;
+	double		totaltime = 0;
+	int			eflags;
+	int			instrument_option = 0;
+
+	Assert(plannedstmt->commandType != CMD_UTILITY);
+
+	if (es->analyze && es->timing)
+		instrument_option |= INSTRUMENT_TIMER;
+	else if (es->analyze)
+		instrument_option |= INSTRUMENT_ROWS;
+
+	if (es->buffers)
+		instrument_option |= INSTRUMENT_BUFFERS;
+
+	/*
+	 * We always collect timing for the entire statement, even when node-level
+	 * timing is off, so we don't look at es->timing here.  (We could skip
+	 * this if !es->summary, but it's hardly worth the complication.)
+	 */
+	INSTR_TIME_SET_CURRENT(starttime);
+
+	/*
+	 * Use a snapshot with an updated command ID to ensure this query sees
+	 * results of any previously executed queries.
+	 */
+	PushCopiedSnapshot(GetActiveSnapshot());
+	UpdateActiveSnapshotCommandId();
+
+	/* Create a QueryDesc for the query */
+	queryDesc = CreateQueryDesc(plannedstmt, queryString,
+								GetActiveSnapshot(), InvalidSnapshot,
+								dest, params, queryEnv, instrument_option);
+
+	/* Select execution options */
+	if (es->analyze)
+		eflags = 0;				/* default run-to-completion flags */
+	else
+		eflags = EXEC_FLAG_EXPLAIN_ONLY;
+
+	/* call ExecutorStart to prepare the plan for execution */
+	ExecutorStart(queryDesc, eflags);
+
+	/* the rows are returned as rows of the calling function */
+	EnsureMatchingTupleDescriptors(queryDesc->tupDesc, expectedDescriptor);
+
+	/* Execute the plan for statistics if asked for */
+	if (es->analyze)
+	{
+		ScanDirection dir = ForwardScanDirection;
+
+		/* run the plan */
+		ExecutorRun(queryDesc, dir, 0L, true);
+
+		/* run cleanup too */
+		ExecutorFinish(queryDesc);
+
+		/* We can't run ExecutorEnd 'till we're done printing the stats... */
+		totaltime += elapsed_time(&starttime);
+	}
+
+	ExplainOpenGroup("Query", NULL, true, es);
+
+	/* Create textual dump of plan tree */
+	ExplainPrintPlan(es, queryDesc);
+
+	if (es->summary && planduration)
+	{
+		double		plantime = INSTR_TIME_GET_DOUBLE(*planduration);
+
+		ExplainPropertyFloat("Planning Time", "ms", 1000.0 * plantime, 3, es);
+	}
+
+	/* Print info about runtime of triggers */
+	if (es->analyze)
+		ExplainPrintTriggers(es, queryDesc);
+
+	/*
+	 * Close down the query and free resources.  Include time for this in the
+	 * total execution time (although it should be pretty minimal).
+	 */
+	INSTR_TIME_SET_CURRENT(starttime);
+
+	ExecutorEnd(queryDesc);
+
+	FreeQueryDesc(queryDesc);
+
+	PopActiveSnapshot();
+
+	/* We need a CCI just in case query expanded to multiple plans */
+	if (es->analyze)
+		CommandCounterIncrement();
+
+	totaltime += elapsed_time(&starttime);
+
+	/*
+	 * We only report execution time if we actually ran the query (that is,
+	 * the user specified ANALYZE), and if summary reporting is enabled (the
+	 * user can set SUMMARY OFF to not have the timing information included in
+	 * the output).  By default, ANALYZE sets SUMMARY to true.
+	 */
+	if (es->summary && es->analyze)
+		ExplainPropertyFloat("Execution Time", "ms", 1000.0 * totaltime, 3,
+							 es);
+
+	*executionDurationMillisec = totaltime * 1000;
+
+	ExplainCloseGroup("Query", NULL, true, es);
+}
+
+
+/*
+ * Compute elapsed time in seconds since given timestamp.
+ *
+ * Copied from explain.c.
+ */
+static double
+elapsed_time(instr_time *starttime)
+{
+	instr_time	endtime;
+
+	INSTR_TIME_SET_CURRENT(endtime);
+	INSTR_TIME_SUBTRACT(endtime, *starttime);
+	return INSTR_TIME_GET_DOUBLE(endtime);
+}
@@ -26,6 +26,7 @@
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/worker_protocol.h"
 #include "lib/stringinfo.h"
 #if PG_VERSION_NUM >= PG_VERSION_12
@@ -45,6 +46,7 @@
 /* Config variables managed via guc.c */
 bool LogMultiJoinOrder = false; /* print join order as a debugging aid */
 bool EnableSingleHashRepartitioning = false;
+bool EnableCostBasedJoinOrder = false;
 
 /* Function pointer type definition for join rule evaluation functions */
 typedef JoinOrderNode *(*RuleEvalFunction) (JoinOrderNode *currentJoinNode,
@@ -60,8 +62,16 @@ static RuleEvalFunction RuleEvalFunctionArray[JOIN_RULE_LAST] = { 0 }; /* join r
 static bool JoinExprListWalker(Node *node, List **joinList);
 static bool ExtractLeftMostRangeTableIndex(Node *node, int *rangeTableIndex);
 static List * JoinOrderForTable(TableEntry *firstTable, List *tableEntryList,
-								List *joinClauseList);
-static List * BestJoinOrder(List *candidateJoinOrders);
+								List *joinClauseList, bool useCostModel);
+static bool BetterJoinOrderNode(JoinOrderNode *joinNode, JoinOrderNode *bestJoinNode,
+								uint64 joinedTableSize, bool useCostModel);
+static List * BestJoinOrder(List *candidateJoinOrders, bool useCostModel);
+static List * LowestTransferSize(List *candidateJoinOrders);
+static uint64 JoinOrderTransferSize(List *joinOrder);
+static uint64 JoinOrderNodeTransferSize(JoinOrderNode *joinNode,
+										uint64 joinedTableSize);
+static bool TableSizesKnown(List *tableEntryList);
+static uint64 TableEntrySize(TableEntry *tableEntry);
 static List * FewestOfJoinRuleType(List *candidateJoinOrders, JoinRuleType ruleType);
 static uint32 JoinRuleTypeCount(List *joinOrder, JoinRuleType ruleTypeToCount);
 static List * LatestLargeDataTransfer(List *candidateJoinOrders);
@@ -294,13 +304,16 @@ JoinOrderList(List *tableEntryList, List *joinClauseList)
 	List *candidateJoinOrderList = NIL;
 	ListCell *tableEntryCell = NULL;
 
+	/* we can only compare data transfers if we know how large the tables are */
+	bool useCostModel = EnableCostBasedJoinOrder && TableSizesKnown(tableEntryList);
+
 	foreach(tableEntryCell, tableEntryList)
 	{
 		TableEntry *startingTable = (TableEntry *) lfirst(tableEntryCell);
 
 		/* each candidate join order starts with a different table */
 		List *candidateJoinOrder = JoinOrderForTable(startingTable, tableEntryList,
-													 joinClauseList);
+													 joinClauseList, useCostModel);
 
 		if (candidateJoinOrder != NULL)
 		{
@@ -317,7 +330,7 @@ JoinOrderList(List *tableEntryList, List *joinClauseList)
 							   "equal operator")));
 	}
 
-	List *bestJoinOrder = BestJoinOrder(candidateJoinOrderList);
+	List *bestJoinOrder = BestJoinOrder(candidateJoinOrderList, useCostModel);
 
 	/* if logging is enabled, print join order */
 	if (LogMultiJoinOrder)
@@ -335,10 +348,12 @@ JoinOrderList(List *tableEntryList, List *joinClauseList)
  * then chooses the table that has the lowest ranking join rule, and with which
  * it can join the table to the previous table in the join order. The function
  * repeats this until it determines all elements in the join order list, and
- * returns this list.
+ * returns this list. If useCostModel is true, the function instead chooses the
+ * table whose join moves the fewest bytes across the network.
  */
 static List *
-JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClauseList)
+JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClauseList,
+				  bool useCostModel)
 {
 	JoinRuleType firstJoinRule = JOIN_RULE_INVALID_FIRST;
 	int joinedTableCount = 1;
@@ -359,13 +374,13 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 	List *joinOrderList = list_make1(firstJoinNode);
 	List *joinedTableList = list_make1(firstTable);
 	JoinOrderNode *currentJoinNode = firstJoinNode;
+	uint64 joinedTableSize = useCostModel ? TableEntrySize(firstTable) : 0;
 
 	/* loop until we join all remaining tables */
 	while (joinedTableCount < totalTableCount)
 	{
 		ListCell *pendingTableCell = NULL;
 		JoinOrderNode *nextJoinNode = NULL;
-		JoinRuleType nextJoinRuleType = JOIN_RULE_LAST;
 
 		List *pendingTableList = TableEntryListDifference(tableEntryList,
 														  joinedTableList);
@@ -393,11 +408,10 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 			}
 
 			/* if this rule is better than previous ones, keep it */
-			JoinRuleType pendingJoinRuleType = pendingJoinNode->joinRuleType;
-			if (pendingJoinRuleType < nextJoinRuleType)
+			if (BetterJoinOrderNode(pendingJoinNode, nextJoinNode, joinedTableSize,
+									useCostModel))
 			{
 				nextJoinNode = pendingJoinNode;
-				nextJoinRuleType = pendingJoinRuleType;
 			}
 		}
 
@@ -418,6 +432,11 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 		joinedTableList = lappend(joinedTableList, nextJoinedTable);
 		currentJoinNode = nextJoinNode;
 
+		if (useCostModel)
+		{
+			joinedTableSize += TableEntrySize(nextJoinedTable);
+		}
+
 		joinedTableCount++;
 	}
 
@@ -425,19 +444,66 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 }
 
 
+/*
+ * BetterJoinOrderNode returns true if the given join order node is a better
+ * next step for a join order than the best join order node found so far. By
+ * default, a join node is better if its join rule ranks lower. With the cost
+ * model, a join node is better if it moves fewer bytes, where we still avoid
+ * cartesian products whenever we can and fall back to rule ranks on ties.
+ */
+static bool
+BetterJoinOrderNode(JoinOrderNode *joinNode, JoinOrderNode *bestJoinNode,
+					uint64 joinedTableSize, bool useCostModel)
+{
+	if (bestJoinNode == NULL)
+	{
+		return true;
+	}
+
+	JoinRuleType ruleType = joinNode->joinRuleType;
+	JoinRuleType bestRuleType = bestJoinNode->joinRuleType;
+
+	if (!useCostModel || ruleType == CARTESIAN_PRODUCT ||
+		bestRuleType == CARTESIAN_PRODUCT)
+	{
+		return ruleType < bestRuleType;
+	}
+
+	uint64 transferSize = JoinOrderNodeTransferSize(joinNode, joinedTableSize);
+	uint64 bestTransferSize = JoinOrderNodeTransferSize(bestJoinNode, joinedTableSize);
+
+	if (transferSize != bestTransferSize)
+	{
+		return transferSize < bestTransferSize;
+	}
+
+	return ruleType < bestRuleType;
+}
+
+
 /*
  * BestJoinOrder takes in a list of candidate join orders, and determines the
  * best join order among these candidates. The function uses two heuristics for
  * this. First, the function chooses join orders that have the fewest number of
  * join operators that cause large data transfers. Second, the function chooses
- * join orders where large data transfers occur later in the execution.
+ * join orders where large data transfers occur later in the execution. If
+ * useCostModel is true, the function first keeps the join orders with the
+ * fewest cartesian products that move the fewest bytes across the network, and
+ * only uses the heuristics above to break ties.
  */
 static List *
-BestJoinOrder(List *candidateJoinOrders)
+BestJoinOrder(List *candidateJoinOrders, bool useCostModel)
 {
 	uint32 highestValidIndex = JOIN_RULE_LAST - 1;
 	uint32 candidateCount PG_USED_FOR_ASSERTS_ONLY = 0;
 
+	if (useCostModel)
+	{
+		candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders,
+												   CARTESIAN_PRODUCT);
+		candidateJoinOrders = LowestTransferSize(candidateJoinOrders);
+	}
+
 	/*
 	 * We start with the highest ranking rule type (cartesian product), and walk
 	 * over these rules in reverse order. For each rule type, we then keep join
@@ -479,6 +545,181 @@ BestJoinOrder(List *candidateJoinOrders)
 }
 
 
+/*
+ * LowestTransferSize finds the join orders that are estimated to move the fewest
+ * bytes across the network, and filters all other join orders.
+ */
+static List *
+LowestTransferSize(List *candidateJoinOrders)
+{
+	List *lowestJoinOrders = NIL;
+	uint64 lowestTransferSize = PG_UINT64_MAX;
+	List *joinOrder = NIL;
+
+	foreach_ptr(joinOrder, candidateJoinOrders)
+	{
+		uint64 transferSize = JoinOrderTransferSize(joinOrder);
+
+		if (lowestJoinOrders != NIL && transferSize == lowestTransferSize)
+		{
+			lowestJoinOrders = lappend(lowestJoinOrders, joinOrder);
+		}
+		else if (lowestJoinOrders == NIL || transferSize < lowestTransferSize)
+		{
+			lowestJoinOrders = list_make1(joinOrder);
+			lowestTransferSize = transferSize;
+		}
+	}
+
+	return lowestJoinOrders;
+}
+
+
+/*
+ * JoinOrderTransferSize returns the estimated number of bytes that the given
+ * join order moves across the network.
+ */
+static uint64
+JoinOrderTransferSize(List *joinOrder)
+{
+	uint64 transferSize = 0;
+	uint64 joinedTableSize = 0;
+	JoinOrderNode *joinOrderNode = NULL;
+
+	foreach_ptr(joinOrderNode, joinOrder)
+	{
+		/* the first node has an invalid join rule and does not move any data */
+		transferSize += JoinOrderNodeTransferSize(joinOrderNode, joinedTableSize);
+		joinedTableSize += TableEntrySize(joinOrderNode->tableEntry);
+	}
+
+	return transferSize;
+}
+
+
+/*
+ * JoinOrderNodeTransferSize returns the estimated number of bytes that joining
+ * the given join order node to the tables before it moves across the network,
+ * given the total size of those tables. We do not estimate the selectivity of
+ * joins and filters, so the size of the joined tables is an upper bound for
+ * the size of their join.
+ */
+static uint64
+JoinOrderNodeTransferSize(JoinOrderNode *joinNode, uint64 joinedTableSize)
+{
+	uint64 candidateTableSize = TableEntrySize(joinNode->tableEntry);
+
+	switch (joinNode->joinRuleType)
+	{
+		case SINGLE_HASH_PARTITION_JOIN:
+		case SINGLE_RANGE_PARTITION_JOIN:
+		{
+			/*
+			 * If the candidate table became the anchor table, the tables joined
+			 * so far are repartitioned to match it. Otherwise the candidate table
+			 * is repartitioned.
+			 */
+			if (joinNode->anchorTable == joinNode->tableEntry)
+			{
+				return joinedTableSize;
+			}
+
+			return candidateTableSize;
+		}
+
+		case DUAL_PARTITION_JOIN:
+		{
+			return joinedTableSize + candidateTableSize;
+		}
+
+		case CARTESIAN_PRODUCT:
+		{
+			/* the candidate table is broadcast, we only use this as a last resort */
+			return joinedTableSize + candidateTableSize;
+		}
+
+		default:
+		{
+			/* the remaining joins happen locally on the workers */
+			return 0;
+		}
+	}
+}
+
+
+/*
+ * TableSizesKnown returns true if we know the size of all distributed tables
+ * in the given list. Shard sizes are kept in pg_dist_placement.shardlength,
+ * which master_update_shard_statistics() refreshes for any kind of table. We
+ * do not need the size of reference tables, since they are never moved.
+ */
+static bool
+TableSizesKnown(List *tableEntryList)
+{
+	TableEntry *tableEntry = NULL;
+	foreach_ptr(tableEntry, tableEntryList)
+	{
+		if (PartitionMethod(tableEntry->relationId) == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		if (TableEntrySize(tableEntry) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * TableEntrySize returns the estimated size of the table in the given table
+ * entry.
+ */
+static uint64
+TableEntrySize(TableEntry *tableEntry)
+{
+	return EstimatedTableSize(tableEntry->relationId);
+}
+
+
+/*
+ * EstimatedTableSize returns the size of the given Citus table, based on the
+ * shard sizes in the shard size cache or, for shards that are not in there,
+ * the shard sizes in the metadata cache. The function returns 0 if the size
+ * of the table is not known.
+ */
+uint64
+EstimatedTableSize(Oid relationId)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	uint64 tableSize = 0;
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		GroupShardPlacement *placementArray =
+			cacheEntry->arrayOfPlacementArrays[shardIndex];
+		int placementCount = cacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+
+		if (placementCount > 0)
+		{
+			GroupShardPlacement *placement = &placementArray[0];
+			uint64 shardSize = placement->shardLength;
+
+			CachedPlacementSize(placement->shardId, placement->groupId,
+								SHARD_TABLE_SIZE, &shardSize);
+
+			tableSize += shardSize;
+		}
+	}
+
+	return tableSize;
+}
+
+
 /*
  * FewestOfJoinRuleType finds join orders that have the fewest number of times
  * the given join rule occurs in the candidate join orders, and filters all
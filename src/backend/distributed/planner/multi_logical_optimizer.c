@@ -24,6 +24,7 @@
 #include "catalog/indexing.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/extension.h"
@@ -39,6 +40,8 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/received_row_merger.h"
+#include "distributed/repartitioned_aggregation.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -65,6 +68,8 @@
 /* Config variable managed via guc.c */
 int LimitClauseRowFetchCount = -1; /* number of rows to fetch from each task */
 double CountDistinctErrorRate = 0.0; /* precision of count(distinct) approximate */
+int CountDistinctApproximationMethod = COUNT_DISTINCT_APPROXIMATION_HLL_EXTENSION;
+bool EnableApproximatePercentiles = false; /* approximate percentile_cont using t-digests */
 int CoordinatorAggregationStrategy = COORDINATOR_AGGREGATION_ROW_GATHER;
 
 /* Constant used throughout file */
@@ -281,7 +286,6 @@ static Expr * FirstAggregateArgument(Aggref *aggregate);
 static bool AggregateEnabledCustom(Aggref *aggregateExpression);
 static Oid CitusFunctionOidWithSignature(char *functionName, int numargs, Oid *argtypes);
 static Oid WorkerPartialAggOid(void);
-static Oid CoordCombineAggOid(void);
 static Oid AggregateFunctionOid(const char *functionName, Oid inputType);
 static Oid TypeOid(Oid schemaId, const char *typeName);
 static SortGroupClause * CreateSortGroupClause(Var *column);
@@ -328,6 +332,7 @@ static bool HasOrderByAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByNonCommutativeAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByComplexExpression(List *sortClauseList, List *targetList);
 static bool HasOrderByHllType(List *sortClauseList, List *targetList);
+static bool CanApproximatePercentile(Aggref *aggregateExpression);
 static bool ShouldProcessDistinctOrderAndLimitForWorker(
 	ExtendedOpNodeProperties *extendedOpNodeProperties,
 	bool pushingDownOriginalGrouping,
@@ -1319,7 +1324,8 @@ ApplyExtendedOpNodes(MultiExtendedOp *originalNode, MultiExtendedOp *masterNode,
  * we transform aggregate functions accordingly for the master and worker
  * operator nodes. We create a partition node based on the first group by
  * column of the extended operator node and set it as the child of the master
- * operator node.
+ * operator node. Subqueries with window functions rather than a group by are
+ * partitioned by a column that appears in the PARTITION BY of all windows.
  */
 static void
 TransformSubqueryNode(MultiTable *subqueryNode,
@@ -1347,9 +1353,22 @@ TransformSubqueryNode(MultiTable *subqueryNode,
 
 	List *groupClauseList = extendedOpNode->groupClauseList;
 	List *targetEntryList = extendedOpNode->targetList;
-	List *groupTargetEntryList = GroupTargetEntryList(groupClauseList, targetEntryList);
-	TargetEntry *groupByTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
-	Expr *groupByExpression = groupByTargetEntry->expr;
+	Expr *groupByExpression = NULL;
+
+	if (groupClauseList == NIL && extendedOpNode->hasWindowFuncs)
+	{
+		groupByExpression = (Expr *) WindowPartitionColumn(extendedOpNode->windowClause,
+														   targetEntryList);
+		Assert(groupByExpression != NULL);
+	}
+	else
+	{
+		List *groupTargetEntryList = GroupTargetEntryList(groupClauseList,
+														  targetEntryList);
+		TargetEntry *groupByTargetEntry =
+			(TargetEntry *) linitial(groupTargetEntryList);
+		groupByExpression = groupByTargetEntry->expr;
+	}
 
 	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
 
@@ -1693,19 +1712,29 @@ MasterAggregateExpression(Aggref *originalAggregate,
 		const int argCount = 1;
 		const int defaultTypeMod = -1;
 
+		/* the built-in sketches are bytea values in pg_catalog */
+		const char *hllSchemaName = "pg_catalog";
+		const char *unionAggregateName = CITUS_HLL_UNION_AGGREGATE_NAME;
+		const char *cardinalityFunctionName = CITUS_HLL_CARDINALITY_FUNC_NAME;
+		Oid hllType = BYTEAOID;
 
-		/* extract schema name of hll */
-		Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, false);
-		Oid hllSchemaOid = get_extension_schema(hllId);
-		const char *hllSchemaName = get_namespace_name(hllSchemaOid);
+		if (CountDistinctApproximationMethod == COUNT_DISTINCT_APPROXIMATION_HLL_EXTENSION)
+		{
+			/* extract schema name of hll */
+			Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, false);
+			Oid hllSchemaOid = get_extension_schema(hllId);
+
+			hllSchemaName = get_namespace_name(hllSchemaOid);
+			unionAggregateName = HLL_UNION_AGGREGATE_NAME;
+			cardinalityFunctionName = HLL_CARDINALITY_FUNC_NAME;
+			hllType = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
+		}
 
-		Oid unionFunctionId = FunctionOid(hllSchemaName, HLL_UNION_AGGREGATE_NAME,
-										  argCount);
-		Oid cardinalityFunctionId = FunctionOid(hllSchemaName, HLL_CARDINALITY_FUNC_NAME,
+		Oid unionFunctionId = FunctionOid(hllSchemaName, unionAggregateName, argCount);
+		Oid cardinalityFunctionId = FunctionOid(hllSchemaName, cardinalityFunctionName,
 												argCount);
 		Oid cardinalityReturnType = get_func_rettype(cardinalityFunctionId);
 
-		Oid hllType = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
 		Oid hllTypeCollationId = get_typcollation(hllType);
 		Var *hllColumn = makeVar(masterTableId, walkerContext->columnId, hllType,
 								 defaultTypeMod,
@@ -1732,6 +1761,50 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) cardinalityExpression;
 	}
+	else if (aggregateType == AGGREGATE_PERCENTILE_CONT)
+	{
+		/*
+		 * Approximate percentiles are computed by building t-digests on the
+		 * worker nodes using citus_tdigest_add_agg(column). We then merge them on
+		 * the master node, and compute the percentile of the merged t-digest with
+		 * citus_tdigest_percentile(citus_tdigest_union_agg(digest), fraction).
+		 */
+		const int unionArgCount = 1;
+		const int percentileArgCount = 2;
+		const int defaultTypeMod = -1;
+
+		Oid unionFunctionId = FunctionOid("pg_catalog", CITUS_TDIGEST_UNION_AGGREGATE_NAME,
+										  unionArgCount);
+		Oid percentileFunctionId = FunctionOid("pg_catalog",
+											   CITUS_TDIGEST_PERCENTILE_FUNC_NAME,
+											   percentileArgCount);
+
+		Var *digestColumn = makeVar(masterTableId, walkerContext->columnId, BYTEAOID,
+									defaultTypeMod, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *digestTargetEntry = makeTargetEntry((Expr *) digestColumn,
+														 argumentId, NULL, false);
+
+		Aggref *unionAggregate = makeNode(Aggref);
+		unionAggregate->aggfnoid = unionFunctionId;
+		unionAggregate->aggtype = BYTEAOID;
+		unionAggregate->args = list_make1(digestTargetEntry);
+		unionAggregate->aggkind = AGGKIND_NORMAL;
+		unionAggregate->aggfilter = NULL;
+		unionAggregate->aggtranstype = InvalidOid;
+		unionAggregate->aggargtypes = list_make1_oid(BYTEAOID);
+		unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		Expr *fraction = copyObject(linitial(originalAggregate->aggdirectargs));
+
+		FuncExpr *percentileExpression = makeNode(FuncExpr);
+		percentileExpression->funcid = percentileFunctionId;
+		percentileExpression->funcresulttype = FLOAT8OID;
+		percentileExpression->args = list_make2(unionAggregate, fraction);
+
+		newMasterExpression = (Expr *) percentileExpression;
+	}
 	else if (aggregateType == AGGREGATE_AVERAGE)
 	{
 		/*
@@ -2988,7 +3061,8 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 	{
 		/*
 		 * If the original aggregate is a count(distinct) approximation, we want
-		 * to compute hll_add_agg(hll_hash(var), storageSize) on worker nodes.
+		 * to compute hll_add_agg(hll_hash(var), storageSize) on worker nodes. The
+		 * built-in citus_hll_add_agg(var, storageSize) hashes values itself.
 		 */
 		const AttrNumber firstArgumentId = 1;
 		const AttrNumber secondArgumentId = 2;
@@ -3000,32 +3074,46 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		Oid argumentType = AggregateArgumentType(originalAggregate);
 		TargetEntry *argument = (TargetEntry *) linitial(originalAggregate->args);
 		Expr *argumentExpression = copyObject(argument->expr);
+		Expr *addArgumentExpression = argumentExpression;
+		Oid addFunctionId = InvalidOid;
+		Oid hllType = BYTEAOID;
 
-		/* extract schema name of hll */
-		Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, false);
-		Oid hllSchemaOid = get_extension_schema(hllId);
-		const char *hllSchemaName = get_namespace_name(hllSchemaOid);
+		if (CountDistinctApproximationMethod == COUNT_DISTINCT_APPROXIMATION_BUILTIN)
+		{
+			addFunctionId = FunctionOid("pg_catalog", CITUS_HLL_ADD_AGGREGATE_NAME,
+										addArgumentCount);
+		}
+		else
+		{
+			/* extract schema name of hll */
+			Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, false);
+			Oid hllSchemaOid = get_extension_schema(hllId);
+			const char *hllSchemaName = get_namespace_name(hllSchemaOid);
+
+			const char *hashFunctionName = CountDistinctHashFunctionName(argumentType);
+			Oid hashFunctionId = FunctionOid(hllSchemaName, hashFunctionName,
+											 hashArgumentCount);
+			Oid hashFunctionReturnType = get_func_rettype(hashFunctionId);
+
+			/* init hll_add_agg() related variables */
+			addFunctionId = FunctionOid(hllSchemaName, HLL_ADD_AGGREGATE_NAME,
+										addArgumentCount);
+			hllType = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
 
-		const char *hashFunctionName = CountDistinctHashFunctionName(argumentType);
-		Oid hashFunctionId = FunctionOid(hllSchemaName, hashFunctionName,
-										 hashArgumentCount);
-		Oid hashFunctionReturnType = get_func_rettype(hashFunctionId);
+			/* construct hll_hash() expression */
+			FuncExpr *hashFunction = makeNode(FuncExpr);
+			hashFunction->funcid = hashFunctionId;
+			hashFunction->funcresulttype = hashFunctionReturnType;
+			hashFunction->args = list_make1(argumentExpression);
+
+			addArgumentExpression = (Expr *) hashFunction;
+		}
 
-		/* init hll_add_agg() related variables */
-		Oid addFunctionId = FunctionOid(hllSchemaName, HLL_ADD_AGGREGATE_NAME,
-										addArgumentCount);
-		Oid hllType = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
 		int logOfStorageSize = CountDistinctStorageSize(CountDistinctErrorRate);
 		Const *logOfStorageSizeConst = MakeIntegerConst(logOfStorageSize);
 
-		/* construct hll_hash() expression */
-		FuncExpr *hashFunction = makeNode(FuncExpr);
-		hashFunction->funcid = hashFunctionId;
-		hashFunction->funcresulttype = hashFunctionReturnType;
-		hashFunction->args = list_make1(argumentExpression);
-
 		/* construct hll_add_agg() expression */
-		TargetEntry *hashedColumnArgument = makeTargetEntry((Expr *) hashFunction,
+		TargetEntry *hashedColumnArgument = makeTargetEntry(addArgumentExpression,
 															firstArgumentId, NULL, false);
 		TargetEntry *storageSizeArgument = makeTargetEntry((Expr *) logOfStorageSizeConst,
 														   secondArgumentId, NULL, false);
@@ -3042,6 +3130,33 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 
 		workerAggregateList = lappend(workerAggregateList, addAggregateFunction);
 	}
+	else if (aggregateType == AGGREGATE_PERCENTILE_CONT)
+	{
+		/*
+		 * If the original aggregate is an approximated percentile_cont, we want
+		 * to compute citus_tdigest_add_agg(var) on worker nodes.
+		 */
+		const AttrNumber firstArgumentId = 1;
+		const int addArgumentCount = 1;
+
+		TargetEntry *argument = (TargetEntry *) linitial(originalAggregate->args);
+		TargetEntry *addArgument = makeTargetEntry(copyObject(argument->expr),
+												   firstArgumentId, NULL, false);
+
+		Aggref *addAggregateFunction = makeNode(Aggref);
+		addAggregateFunction->aggfnoid = FunctionOid("pg_catalog",
+													 CITUS_TDIGEST_ADD_AGGREGATE_NAME,
+													 addArgumentCount);
+		addAggregateFunction->aggtype = BYTEAOID;
+		addAggregateFunction->args = list_make1(addArgument);
+		addAggregateFunction->aggkind = AGGKIND_NORMAL;
+		addAggregateFunction->aggargtypes = list_make1_oid(FLOAT8OID);
+		addAggregateFunction->aggsplit = AGGSPLIT_SIMPLE;
+		addAggregateFunction->aggfilter = (Expr *) copyObject(
+			originalAggregate->aggfilter);
+
+		workerAggregateList = lappend(workerAggregateList, addAggregateFunction);
+	}
 	else if (aggregateType == AGGREGATE_AVERAGE)
 	{
 		/*
@@ -3174,6 +3289,13 @@ GetAggregateType(Aggref *aggregateExpression)
 		const char *aggregateName = AggregateNames[aggregateIndex];
 		if (strncmp(aggregateName, aggregateProcName, NAMEDATALEN) == 0)
 		{
+			if (aggregateIndex == AGGREGATE_PERCENTILE_CONT &&
+				!CanApproximatePercentile(aggregateExpression))
+			{
+				/* exact percentiles need all rows on the coordinator */
+				break;
+			}
+
 			return aggregateIndex;
 		}
 	}
@@ -3370,7 +3492,7 @@ WorkerPartialAggOid()
 /*
  * CoordCombineAggOid looks up oid of pg_catalog.coord_combine_agg
  */
-static Oid
+Oid
 CoordCombineAggOid()
 {
 	Oid argtypes[] = {
@@ -3815,6 +3937,13 @@ DeferErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
 		CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
 		bool missingOK = true;
+
+		/* the built-in sketches are always available */
+		if (CountDistinctApproximationMethod == COUNT_DISTINCT_APPROXIMATION_BUILTIN)
+		{
+			return NULL;
+		}
+
 		Oid distinctExtensionId = get_extension_oid(HLL_EXTENSION_NAME, missingOK);
 
 		/* if extension for distinct approximation is loaded, we are good */
@@ -3827,7 +3956,9 @@ DeferErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
 			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 								 "cannot compute count (distinct) approximation",
 								 NULL,
-								 "You need to have the hll extension loaded.");
+								 "You need to have the hll extension loaded, or set "
+								 "citus.count_distinct_approximation_method to "
+								 "'builtin'.");
 		}
 	}
 
@@ -4421,10 +4552,23 @@ WorkerSortClauseList(Node *limitCount, List *groupClauseList, List *sortClauseLi
 {
 	List *workerSortClauseList = NIL;
 
-	/* if no limit node and no hasDistinctOn, no need to push down sort clauses */
+	/*
+	 * If no limit node and no hasDistinctOn, no need to push down sort clauses,
+	 * unless the coordinator can merge the sorted results of the workers
+	 * instead of sorting them. That requires the coordinator to only sort, so
+	 * not when the workers return partial aggregates.
+	 */
 	if (limitCount == NULL && !orderByLimitReference.hasDistinctOn)
 	{
-		return NIL;
+		bool onlySortedOnCoordinator =
+			(orderByLimitReference.groupClauseIsEmpty &&
+			 !orderByLimitReference.hasOrderByAggregate) ||
+			orderByLimitReference.groupedByDisjointPartitionColumn;
+
+		if (!EnableSortedMerge || !onlySortedOnCoordinator)
+		{
+			return NIL;
+		}
 	}
 
 	/* If window functions are computed on coordinator, we cannot push down sorting. */
@@ -4689,6 +4833,27 @@ HasOrderByHllType(List *sortClauseList, List *targetList)
 {
 	bool hasOrderByHllType = false;
 
+	if (CountDistinctApproximationMethod == COUNT_DISTINCT_APPROXIMATION_BUILTIN)
+	{
+		/* built-in sketches are bytea, so look for the aggregate that builds them */
+		SortGroupClause *sortClause = NULL;
+		foreach_ptr(sortClause, sortClauseList)
+		{
+			Node *sortExpression = get_sortgroupclause_expr(sortClause, targetList);
+			if (IsA(sortExpression, Aggref))
+			{
+				char *aggregateName = get_func_name(((Aggref *) sortExpression)->aggfnoid);
+				if (aggregateName != NULL &&
+					strcmp(aggregateName, CITUS_HLL_ADD_AGGREGATE_NAME) == 0)
+				{
+					return true;
+				}
+			}
+		}
+
+		return hasOrderByHllType;
+	}
+
 	/* check whether HLL is loaded */
 	Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, true);
 	if (!OidIsValid(hllId))
@@ -4716,6 +4881,51 @@ HasOrderByHllType(List *sortClauseList, List *targetList)
 }
 
 
+/*
+ * CanApproximatePercentile returns whether the given percentile_cont aggregate
+ * can be approximated using t-digests, which requires approximate percentiles
+ * to be enabled, and a single percentile of a double precision expression.
+ */
+static bool
+CanApproximatePercentile(Aggref *aggregateExpression)
+{
+	if (!EnableApproximatePercentiles)
+	{
+		return false;
+	}
+
+	if (aggregateExpression->aggkind != AGGKIND_ORDERED_SET ||
+		aggregateExpression->aggtype != FLOAT8OID ||
+		list_length(aggregateExpression->args) != 1 ||
+		list_length(aggregateExpression->aggdirectargs) != 1)
+	{
+		return false;
+	}
+
+	if (get_func_namespace(aggregateExpression->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	TargetEntry *argument = (TargetEntry *) linitial(aggregateExpression->args);
+	if (exprType((Node *) argument->expr) != FLOAT8OID)
+	{
+		/* percentile_cont of intervals */
+		return false;
+	}
+
+	/* the fraction is evaluated on the coordinator, so it cannot refer to columns */
+	Node *fraction = (Node *) linitial(aggregateExpression->aggdirectargs);
+	if (exprType(fraction) != FLOAT8OID || contain_var_clause(fraction) ||
+		contain_volatile_functions(fraction))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
 /*
  * ShouldProcessDistinctOrderAndLimitForWorker returns whether
  * ProcessDistinctClauseForWorkerQuery should be called. If not,
@@ -32,6 +32,7 @@
 #include "distributed/relation_restriction_equivalence.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/query_utils.h"
+#include "distributed/repartitioned_aggregation.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -209,7 +210,8 @@ FindNodeCheck(Node *node, bool (*check)(Node *))
  *   - Only a single RTE_RELATION exists, which means only a single table
  *     name is specified on the whole query
  *   - No sublinks exists in the subquery
- *   - No window functions exists in the subquery
+ *   - No window functions exists in the subquery, unless they can be computed
+ *     after repartitioning the rows (see CanRepartitionWindowFunctions)
  *
  * Note that the caller should still call DeferErrorIfUnsupportedSubqueryRepartition()
  * to ensure that Citus supports the subquery. Also, this function is designed to run
@@ -227,8 +229,8 @@ SingleRelationRepartitionSubquery(Query *queryTree)
 		return false;
 	}
 
-	/* we don't support window functions */
-	if (queryTree->hasWindowFuncs)
+	/* we only support window functions that we can repartition for */
+	if (queryTree->hasWindowFuncs && !CanRepartitionWindowFunctions(queryTree))
 	{
 		return false;
 	}
@@ -1157,13 +1159,17 @@ DeferErrorIfUnsupportedSubqueryRepartition(Query *subqueryTree)
 	bool preconditionsSatisfied = true;
 	List *joinTreeTableIndexList = NIL;
 
-	if (!subqueryTree->hasAggs)
+	/* window functions are computed over the repartitioned rows instead */
+	bool repartitionWindowFunctions = subqueryTree->hasWindowFuncs &&
+									  CanRepartitionWindowFunctions(subqueryTree);
+
+	if (!subqueryTree->hasAggs && !repartitionWindowFunctions)
 	{
 		preconditionsSatisfied = false;
 		errorDetail = "Subqueries without aggregates are not supported yet";
 	}
 
-	if (subqueryTree->groupClause == NIL)
+	if (subqueryTree->groupClause == NIL && !repartitionWindowFunctions)
 	{
 		preconditionsSatisfied = false;
 		errorDetail = "Subqueries without group by clause are not supported yet";
@@ -15,17 +15,50 @@
 
 #include "distributed/pg_version_constants.h"
 
+#include "access/htup_details.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_namespace.h"
 #include "catalog/pg_type.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/received_row_combiner.h"
+#include "distributed/received_row_merger.h"
+#include "distributed/received_row_top_n.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
+#include "optimizer/tlist.h"
 #include "rewrite/rewriteManip.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+
+/*
+ * CombineOnReceiveContext is used to check whether the expressions of the
+ * aggregate above the remote scan allow received rows to be combined.
+ */
+typedef struct CombineOnReceiveContext
+{
+	/* plan below the aggregate, to resolve its columns to remote scan columns */
+	Plan *aggregateChildPlan;
+
+	/* non-junk worker target entries, one per remote scan column */
+	List *workerTargetList;
+
+	/* per remote scan column, whether it is grouped on or how it is combined */
+	int columnCount;
+	bool *groupColumns;
+	Oid *combineFunctions;
+
+	bool combinable;
+} CombineOnReceiveContext;
 
 static List * MasterTargetList(List *workerTargetList);
 static PlannedStmt * BuildSelectStatementViaStdPlanner(Query *masterQuery,
@@ -36,6 +69,20 @@ static bool FindCitusExtradataContainerRTE(Node *node, RangeTblEntry **result);
 static Plan * CitusCustomScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
 									  struct CustomPath *best_path, List *tlist,
 									  List *clauses, List *custom_plans);
+static void SetCombineOnReceive(DistributedPlan *distributedPlan, Plan *plan,
+								List *workerTargetList);
+static Agg * FindRemoteScanAggregate(Plan *plan);
+static AttrNumber RemoteScanColumn(Plan *plan, AttrNumber attributeNumber);
+static bool CombineOnReceiveWalker(Node *node, CombineOnReceiveContext *context);
+static Oid AggregateCombineOnReceiveFunction(Aggref *aggregate,
+											 TargetEntry *workerTargetEntry);
+static bool IsPgCatalogFunction(Oid functionId, const char *functionName);
+static void SetTopNOnReceive(DistributedPlan *distributedPlan, Plan *plan);
+static void SetRemoteScanRowLimit(DistributedPlan *distributedPlan, Plan *plan);
+static void SetSortedMerge(DistributedPlan *distributedPlan, PlannedStmt *plannedStmt,
+						   Query *workerQuery);
+static AttrNumber WorkerQueryColumn(Query *workerQuery, TargetEntry *targetEntry);
+static bool GetConstInt64(Node *node, int64 *value);
 
 bool ReplaceCitusExtraDataContainer = false;
 CustomScan *ReplaceCitusExtraDataContainerWithCustomScan = NULL;
@@ -66,7 +113,639 @@ MasterNodeSelectPlan(DistributedPlan *distributedPlan, CustomScan *remoteScan)
 	Job *workerJob = distributedPlan->workerJob;
 	List *workerTargetList = workerJob->jobQuery->targetList;
 	List *masterTargetList = MasterTargetList(workerTargetList);
-	return BuildSelectStatementViaStdPlanner(masterQuery, masterTargetList, remoteScan);
+	PlannedStmt *masterSelectPlan =
+		BuildSelectStatementViaStdPlanner(masterQuery, masterTargetList, remoteScan);
+
+	if (EnableCombineOnReceive)
+	{
+		SetCombineOnReceive(distributedPlan, masterSelectPlan->planTree,
+							workerTargetList);
+	}
+
+	/* needs to happen before a Sort below a Limit is removed */
+	if (EnableLimitCancellation)
+	{
+		SetRemoteScanRowLimit(distributedPlan, masterSelectPlan->planTree);
+	}
+
+	if (EnableSortedMerge)
+	{
+		SetSortedMerge(distributedPlan, masterSelectPlan, workerJob->jobQuery);
+	}
+
+	if (EnableTopNOnReceive)
+	{
+		SetTopNOnReceive(distributedPlan, masterSelectPlan->planTree);
+	}
+
+	return masterSelectPlan;
+}
+
+
+/*
+ * SetCombineOnReceive checks whether the rows that the remote scan receives
+ * from the workers can be combined per group before they are stored, and if
+ * so records how to do that in the distributed plan.
+ *
+ * That is the case when the remote scan is read (possibly via a Sort) by a
+ * grouped Agg node, and each remote scan column is either grouped on, or
+ * only used as the argument of an aggregate that can be applied to its own
+ * results. The Agg node still aggregates the combined rows, so combining is
+ * an optimization that may also be skipped during execution.
+ */
+static void
+SetCombineOnReceive(DistributedPlan *distributedPlan, Plan *plan,
+					List *workerTargetList)
+{
+	CombineOnReceiveContext context;
+
+	Agg *aggregatePlan = FindRemoteScanAggregate(plan);
+	if (aggregatePlan == NULL || aggregatePlan->numCols == 0 ||
+		aggregatePlan->groupingSets != NIL || aggregatePlan->aggsplit != AGGSPLIT_SIMPLE ||
+		(aggregatePlan->aggstrategy != AGG_HASHED &&
+		 aggregatePlan->aggstrategy != AGG_SORTED))
+	{
+		return;
+	}
+
+	Plan *aggregateChildPlan = aggregatePlan->plan.lefttree;
+	Plan *remoteScanPlan = IsA(aggregateChildPlan, Sort) ?
+						   aggregateChildPlan->lefttree : aggregateChildPlan;
+	if (remoteScanPlan->qual != NIL)
+	{
+		/* filtering has to happen before rows are combined */
+		return;
+	}
+
+	memset(&context, 0, sizeof(context));
+	context.aggregateChildPlan = aggregateChildPlan;
+	context.columnCount = list_length(((CustomScan *) remoteScanPlan)->custom_scan_tlist);
+	context.groupColumns = palloc0(context.columnCount * sizeof(bool));
+	context.combineFunctions = palloc0(context.columnCount * sizeof(Oid));
+	context.combinable = true;
+
+	TargetEntry *workerTargetEntry = NULL;
+	foreach_ptr(workerTargetEntry, workerTargetList)
+	{
+		if (!workerTargetEntry->resjunk)
+		{
+			context.workerTargetList = lappend(context.workerTargetList,
+											   workerTargetEntry);
+		}
+	}
+
+	List *groupColumnList = NIL;
+	List *groupOperatorList = NIL;
+	List *groupCollationList = NIL;
+
+	for (int groupIndex = 0; groupIndex < aggregatePlan->numCols; groupIndex++)
+	{
+		AttrNumber groupColumn = RemoteScanColumn(aggregateChildPlan,
+												  aggregatePlan->grpColIdx[groupIndex]);
+		Oid groupOperator = aggregatePlan->grpOperators[groupIndex];
+		Oid leftHashFunction = InvalidOid;
+		Oid rightHashFunction = InvalidOid;
+
+		if (groupColumn == InvalidAttrNumber ||
+			!get_op_hash_functions(groupOperator, &leftHashFunction,
+								   &rightHashFunction))
+		{
+			return;
+		}
+
+		context.groupColumns[groupColumn - 1] = true;
+
+		groupColumnList = lappend_int(groupColumnList, groupColumn);
+		groupOperatorList = lappend_oid(groupOperatorList, groupOperator);
+#if PG_VERSION_NUM >= PG_VERSION_12
+		groupCollationList = lappend_oid(groupCollationList,
+										 aggregatePlan->grpCollations[groupIndex]);
+#else
+		groupCollationList = lappend_oid(groupCollationList, InvalidOid);
+#endif
+	}
+
+	CombineOnReceiveWalker((Node *) aggregatePlan->plan.targetlist, &context);
+	CombineOnReceiveWalker((Node *) aggregatePlan->plan.qual, &context);
+
+	if (!context.combinable)
+	{
+		return;
+	}
+
+	List *combineFunctionList = NIL;
+	for (int columnIndex = 0; columnIndex < context.columnCount; columnIndex++)
+	{
+		combineFunctionList = lappend_oid(combineFunctionList,
+										  context.combineFunctions[columnIndex]);
+	}
+
+	distributedPlan->combineGroupColumnList = groupColumnList;
+	distributedPlan->combineGroupOperatorList = groupOperatorList;
+	distributedPlan->combineGroupCollationList = groupCollationList;
+	distributedPlan->combineFunctionList = combineFunctionList;
+}
+
+
+/*
+ * FindRemoteScanAggregate returns the Agg node in the given plan that reads
+ * the remote scan, either directly or via a Sort node, or NULL if there is
+ * none.
+ */
+static Agg *
+FindRemoteScanAggregate(Plan *plan)
+{
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(plan, Agg))
+	{
+		Plan *childPlan = plan->lefttree;
+		if (childPlan != NULL && IsA(childPlan, Sort))
+		{
+			childPlan = childPlan->lefttree;
+		}
+
+		if (IsCitusCustomScan(childPlan))
+		{
+			return (Agg *) plan;
+		}
+	}
+
+	Agg *aggregatePlan = FindRemoteScanAggregate(plan->lefttree);
+	if (aggregatePlan == NULL)
+	{
+		aggregatePlan = FindRemoteScanAggregate(plan->righttree);
+	}
+
+	return aggregatePlan;
+}
+
+
+/*
+ * RemoteScanColumn returns the remote scan column that the given output
+ * column of a remote scan, or of a Sort above it, passes through. Returns
+ * InvalidAttrNumber for computed columns.
+ */
+static AttrNumber
+RemoteScanColumn(Plan *plan, AttrNumber attributeNumber)
+{
+	if (attributeNumber <= 0 || attributeNumber > list_length(plan->targetlist))
+	{
+		return InvalidAttrNumber;
+	}
+
+	TargetEntry *targetEntry = list_nth(plan->targetlist, attributeNumber - 1);
+	if (!IsA(targetEntry->expr, Var))
+	{
+		return InvalidAttrNumber;
+	}
+
+	Var *column = (Var *) targetEntry->expr;
+
+	if (IsA(plan, Sort) && column->varno == OUTER_VAR)
+	{
+		return RemoteScanColumn(plan->lefttree, column->varattno);
+	}
+	else if (IsA(plan, CustomScan) && column->varno == INDEX_VAR)
+	{
+		return column->varattno;
+	}
+
+	return InvalidAttrNumber;
+}
+
+
+/*
+ * CombineOnReceiveWalker walks the target list and qual of the aggregate above
+ * the remote scan, and records the combine function of each aggregated remote
+ * scan column. Columns used outside of aggregates should be grouped on. The
+ * combinable field is cleared if any of the expressions prevents combining.
+ */
+static bool
+CombineOnReceiveWalker(Node *node, CombineOnReceiveContext *context)
+{
+	if (node == NULL || !context->combinable)
+	{
+		return false;
+	}
+
+	if (IsA(node, Aggref))
+	{
+		Aggref *aggregate = (Aggref *) node;
+
+		if (aggregate->aggdistinct != NIL || aggregate->aggorder != NIL ||
+			aggregate->aggfilter != NULL || aggregate->aggdirectargs != NIL ||
+			aggregate->aggkind != AGGKIND_NORMAL || aggregate->agglevelsup != 0 ||
+			aggregate->aggsplit != AGGSPLIT_SIMPLE || list_length(aggregate->args) != 1)
+		{
+			context->combinable = false;
+			return false;
+		}
+
+		TargetEntry *argument = linitial(aggregate->args);
+		if (!IsA(argument->expr, Var) || ((Var *) argument->expr)->varno != OUTER_VAR)
+		{
+			context->combinable = false;
+			return false;
+		}
+
+		Var *argumentColumn = (Var *) argument->expr;
+		AttrNumber remoteScanColumn = RemoteScanColumn(context->aggregateChildPlan,
+													   argumentColumn->varattno);
+		if (remoteScanColumn == InvalidAttrNumber ||
+			remoteScanColumn > list_length(context->workerTargetList) ||
+			context->groupColumns[remoteScanColumn - 1])
+		{
+			context->combinable = false;
+			return false;
+		}
+
+		TargetEntry *workerTargetEntry = list_nth(context->workerTargetList,
+												  remoteScanColumn - 1);
+		Oid combineFunction = AggregateCombineOnReceiveFunction(aggregate,
+																workerTargetEntry);
+		Oid *columnCombineFunction = &context->combineFunctions[remoteScanColumn - 1];
+
+		if (combineFunction == InvalidOid ||
+			(*columnCombineFunction != InvalidOid &&
+			 *columnCombineFunction != combineFunction))
+		{
+			context->combinable = false;
+			return false;
+		}
+
+		*columnCombineFunction = combineFunction;
+
+		return false;
+	}
+	else if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+		AttrNumber remoteScanColumn = InvalidAttrNumber;
+
+		if (column->varno == OUTER_VAR)
+		{
+			remoteScanColumn = RemoteScanColumn(context->aggregateChildPlan,
+												column->varattno);
+		}
+
+		/* columns outside of aggregates keep the value of the first row */
+		if (remoteScanColumn == InvalidAttrNumber ||
+			!context->groupColumns[remoteScanColumn - 1])
+		{
+			context->combinable = false;
+		}
+
+		return false;
+	}
+	else if (IsA(node, GroupingFunc) || IsA(node, WindowFunc))
+	{
+		context->combinable = false;
+		return false;
+	}
+
+	return expression_tree_walker(node, CombineOnReceiveWalker, (void *) context);
+}
+
+
+/*
+ * AggregateCombineOnReceiveFunction returns the function with which values of
+ * the argument of the given aggregate, computed on the workers by the given
+ * worker target entry, can be combined such that the aggregate over the
+ * combined values returns the same result. Returns InvalidOid if there is
+ * no such function.
+ */
+static Oid
+AggregateCombineOnReceiveFunction(Aggref *aggregate, TargetEntry *workerTargetEntry)
+{
+	Oid argumentType = exprType((Node *) ((TargetEntry *) linitial(aggregate->args))->expr);
+	Oid combineFunction = InvalidOid;
+	bool initValueIsNull = false;
+
+	/*
+	 * The coordinator sums up the counts of the workers. Partial sums of
+	 * counts cannot exceed the final count, which has to fit a bigint, so
+	 * they can be summed up in bigints before they are stored.
+	 */
+	if (argumentType == INT8OID && IsPgCatalogFunction(aggregate->aggfnoid, "sum") &&
+		IsA(workerTargetEntry->expr, Aggref) &&
+		IsPgCatalogFunction(((Aggref *) workerTargetEntry->expr)->aggfnoid, "count"))
+	{
+		return F_INT8PL;
+	}
+
+	HeapTuple aggregateTuple = SearchSysCache1(AGGFNOID,
+											   ObjectIdGetDatum(aggregate->aggfnoid));
+	if (!HeapTupleIsValid(aggregateTuple))
+	{
+		return InvalidOid;
+	}
+
+	Form_pg_aggregate aggregateForm = (Form_pg_aggregate) GETSTRUCT(aggregateTuple);
+	SysCacheGetAttr(AGGFNOID, aggregateTuple, Anum_pg_aggregate_agginitval,
+					&initValueIsNull);
+
+	/*
+	 * For aggregates such as min, max, bool_and and bit_or the state is a
+	 * value of the argument type, and the transition function also combines
+	 * states. Applying the transition function to received values then gives
+	 * the same state as aggregating them. We skip collatable inputs, since the
+	 * combiner calls the function without a collation.
+	 */
+	if (aggregateForm->aggcombinefn == aggregateForm->aggtransfn &&
+		aggregate->inputcollid == InvalidOid &&
+		aggregateForm->aggtransfn != InvalidOid &&
+		aggregateForm->aggfinalfn == InvalidOid &&
+		aggregateForm->aggtranstype == argumentType &&
+		initValueIsNull && func_strict(aggregateForm->aggtransfn))
+	{
+		combineFunction = aggregateForm->aggtransfn;
+	}
+
+	ReleaseSysCache(aggregateTuple);
+
+	return combineFunction;
+}
+
+
+/*
+ * IsPgCatalogFunction returns whether the given function is the built-in
+ * function with the given name.
+ */
+static bool
+IsPgCatalogFunction(Oid functionId, const char *functionName)
+{
+	char *name = get_func_name(functionId);
+
+	return name != NULL && strcmp(name, functionName) == 0 &&
+		   get_func_namespace(functionId) == PG_CATALOG_NAMESPACE;
+}
+
+
+/*
+ * SetTopNOnReceive checks whether only the first rows in sort order of the
+ * rows that the remote scan receives from the workers need to be stored, and
+ * if so records how to find them in the distributed plan.
+ *
+ * That is the case when the top of the plan is a Limit with a constant count
+ * directly above a Sort on columns of the remote scan. The Sort and Limit
+ * nodes still run on the stored rows, so bounding the received rows is an
+ * optimization that may also be skipped during execution.
+ */
+static void
+SetTopNOnReceive(DistributedPlan *distributedPlan, Plan *plan)
+{
+	int64 limitCount = 0;
+	int64 limitOffset = 0;
+
+	if (plan == NULL || !IsA(plan, Limit))
+	{
+		return;
+	}
+
+	Limit *limitPlan = (Limit *) plan;
+	Plan *sortPlan = limitPlan->plan.lefttree;
+	if (sortPlan == NULL || !IsA(sortPlan, Sort) ||
+		!IsCitusCustomScan(sortPlan->lefttree) || sortPlan->lefttree->qual != NIL)
+	{
+		return;
+	}
+
+	if (!GetConstInt64(limitPlan->limitCount, &limitCount) || limitCount <= 0)
+	{
+		return;
+	}
+
+	if (limitPlan->limitOffset != NULL &&
+		!GetConstInt64(limitPlan->limitOffset, &limitOffset))
+	{
+		return;
+	}
+
+	/* the sort ignores bounds that do not fit, so keep to sensible ones */
+	if (limitOffset < 0 || limitCount > PG_INT32_MAX / 2 ||
+		limitOffset > PG_INT32_MAX / 2 - limitCount)
+	{
+		return;
+	}
+
+	Sort *sort = (Sort *) sortPlan;
+	List *sortColumnList = NIL;
+	List *sortOperatorList = NIL;
+	List *sortCollationList = NIL;
+	List *nullsFirstList = NIL;
+
+	for (int sortIndex = 0; sortIndex < sort->numCols; sortIndex++)
+	{
+		AttrNumber sortColumn = RemoteScanColumn(sortPlan, sort->sortColIdx[sortIndex]);
+		if (sortColumn == InvalidAttrNumber)
+		{
+			return;
+		}
+
+		sortColumnList = lappend_int(sortColumnList, sortColumn);
+		sortOperatorList = lappend_oid(sortOperatorList, sort->sortOperators[sortIndex]);
+		sortCollationList = lappend_oid(sortCollationList, sort->collations[sortIndex]);
+		nullsFirstList = lappend_int(nullsFirstList, sort->nullsFirst[sortIndex]);
+	}
+
+	distributedPlan->topNSortColumnList = sortColumnList;
+	distributedPlan->topNSortOperatorList = sortOperatorList;
+	distributedPlan->topNSortCollationList = sortCollationList;
+	distributedPlan->topNNullsFirstList = nullsFirstList;
+	distributedPlan->topNCount = limitCount + limitOffset;
+}
+
+
+/*
+ * SetRemoteScanRowLimit checks whether the coordinator only needs a fixed
+ * number of rows of the remote scan, regardless of which ones, and if so
+ * records that number in the distributed plan.
+ *
+ * That is the case when the top of the plan is a Limit with a constant count
+ * directly above the remote scan, i.e. without an ORDER BY or aggregate that
+ * needs all rows first. The executor can then stop executing tasks once that
+ * many rows were received.
+ */
+static void
+SetRemoteScanRowLimit(DistributedPlan *distributedPlan, Plan *plan)
+{
+	int64 limitCount = 0;
+	int64 limitOffset = 0;
+
+	if (plan == NULL || !IsA(plan, Limit))
+	{
+		return;
+	}
+
+	Limit *limitPlan = (Limit *) plan;
+	Plan *scanPlan = limitPlan->plan.lefttree;
+	if (!IsCitusCustomScan(scanPlan) || scanPlan->qual != NIL)
+	{
+		return;
+	}
+
+	if (!GetConstInt64(limitPlan->limitCount, &limitCount) || limitCount <= 0)
+	{
+		return;
+	}
+
+	if (limitPlan->limitOffset != NULL &&
+		(!GetConstInt64(limitPlan->limitOffset, &limitOffset) || limitOffset < 0))
+	{
+		return;
+	}
+
+	if (limitOffset > PG_INT64_MAX - limitCount)
+	{
+		return;
+	}
+
+	distributedPlan->remoteScanRowLimit = limitCount + limitOffset;
+}
+
+
+/*
+ * SetSortedMerge checks whether the worker queries return their rows in the
+ * order in which the coordinator sorts the remote scan, and if so removes the
+ * Sort above the remote scan and records in the distributed plan how the
+ * executor should merge the results of the tasks instead.
+ *
+ * That is the case when the top of the plan is a Sort of the remote scan,
+ * possibly below a Limit, and the sort keys are a prefix of the ORDER BY of
+ * the worker query, with the same operators, collations and NULLs order.
+ * Since the Sort is removed, the executor has to merge the results.
+ */
+static void
+SetSortedMerge(DistributedPlan *distributedPlan, PlannedStmt *plannedStmt,
+			   Query *workerQuery)
+{
+	Plan *parentPlan = NULL;
+	Plan *sortPlan = plannedStmt->planTree;
+
+	if (sortPlan != NULL && IsA(sortPlan, Limit))
+	{
+		parentPlan = sortPlan;
+		sortPlan = sortPlan->lefttree;
+	}
+
+	if (sortPlan == NULL || !IsA(sortPlan, Sort) || !IsCitusCustomScan(sortPlan->lefttree))
+	{
+		return;
+	}
+
+	Sort *sort = (Sort *) sortPlan;
+	List *workerSortClauseList = workerQuery->sortClause;
+	if (list_length(workerSortClauseList) < sort->numCols)
+	{
+		return;
+	}
+
+	List *sortColumnList = NIL;
+	List *sortOperatorList = NIL;
+	List *sortCollationList = NIL;
+	List *nullsFirstList = NIL;
+
+	for (int sortIndex = 0; sortIndex < sort->numCols; sortIndex++)
+	{
+		AttrNumber sortColumn = RemoteScanColumn(sortPlan, sort->sortColIdx[sortIndex]);
+		SortGroupClause *workerSortClause = list_nth(workerSortClauseList, sortIndex);
+		TargetEntry *workerTargetEntry =
+			get_sortgroupclause_tle(workerSortClause, workerQuery->targetList);
+
+		if (sortColumn == InvalidAttrNumber ||
+			WorkerQueryColumn(workerQuery, workerTargetEntry) != sortColumn ||
+			workerSortClause->sortop != sort->sortOperators[sortIndex] ||
+			workerSortClause->nulls_first != sort->nullsFirst[sortIndex] ||
+			exprCollation((Node *) workerTargetEntry->expr) != sort->collations[sortIndex])
+		{
+			return;
+		}
+
+		sortColumnList = lappend_int(sortColumnList, sortColumn);
+		sortOperatorList = lappend_oid(sortOperatorList, sort->sortOperators[sortIndex]);
+		sortCollationList = lappend_oid(sortCollationList, sort->collations[sortIndex]);
+		nullsFirstList = lappend_int(nullsFirstList, sort->nullsFirst[sortIndex]);
+	}
+
+	Plan *remoteScanPlan = sortPlan->lefttree;
+
+	/* the remote scan takes the place of the Sort, including its column names */
+	apply_tlist_labeling(remoteScanPlan->targetlist, sortPlan->targetlist);
+
+	if (parentPlan != NULL)
+	{
+		parentPlan->lefttree = remoteScanPlan;
+	}
+	else
+	{
+		plannedStmt->planTree = remoteScanPlan;
+	}
+
+	distributedPlan->mergeSortColumnList = sortColumnList;
+	distributedPlan->mergeSortOperatorList = sortOperatorList;
+	distributedPlan->mergeSortCollationList = sortCollationList;
+	distributedPlan->mergeNullsFirstList = nullsFirstList;
+}
+
+
+/*
+ * WorkerQueryColumn returns the remote scan column of the given target entry
+ * of the worker query, or InvalidAttrNumber if it is not returned.
+ */
+static AttrNumber
+WorkerQueryColumn(Query *workerQuery, TargetEntry *targetEntry)
+{
+	AttrNumber columnNumber = 0;
+
+	if (targetEntry->resjunk)
+	{
+		return InvalidAttrNumber;
+	}
+
+	TargetEntry *workerTargetEntry = NULL;
+	foreach_ptr(workerTargetEntry, workerQuery->targetList)
+	{
+		if (workerTargetEntry->resjunk)
+		{
+			continue;
+		}
+
+		columnNumber++;
+
+		if (workerTargetEntry == targetEntry)
+		{
+			return columnNumber;
+		}
+	}
+
+	return InvalidAttrNumber;
+}
+
+/*
+ * GetConstInt64 sets value to the given expression if it is a non-NULL int8
+ * constant, and returns whether it is.
+ */
+static bool
+GetConstInt64(Node *node, int64 *value)
+{
+	if (node == NULL || !IsA(node, Const))
+	{
+		return false;
+	}
+
+	Const *constant = (Const *) node;
+	if (constant->constisnull || constant->consttype != INT8OID)
+	{
+		return false;
+	}
+
+	*value = DatumGetInt64(constant->constvalue);
+
+	return true;
 }
 
 
@@ -52,6 +52,7 @@
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/skewed_repartition_join.h"
 #include "distributed/task_tracker.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -166,13 +167,14 @@ static ArrayType * SplitPointObject(ShardInterval **shardIntervalArray,
 static bool DistributedPlanRouterExecutable(DistributedPlan *distributedPlan);
 static Job * BuildJobTreeTaskList(Job *jobTree,
 								  PlannerRestrictionContext *plannerRestrictionContext);
-static bool IsInnerTableOfOuterJoin(RelationRestriction *relationRestriction);
 static void ErrorIfUnsupportedShardDistribution(Query *query);
 static Task * QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 									  RelationRestrictionContext *restrictionContext,
 									  uint32 taskId,
 									  TaskType taskType,
-									  bool modifyRequiresMasterEvaluation);
+									  bool modifyRequiresMasterEvaluation,
+									  ShardQueryTemplate *queryTemplate);
+static void MakeJoinTreeQualsExplicit(Query *query);
 static bool ShardIntervalsEqual(FmgrInfo *comparisonFunction,
 								Oid collation,
 								ShardInterval *firstInterval,
@@ -224,6 +226,7 @@ static List * AssignDualHashTaskList(List *taskList);
 static void AssignDataFetchDependencies(List *taskList);
 static uint32 TaskListHighestTaskId(List *taskList);
 static List * MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList);
+static StringInfo IntegerListArrayString(List *integerList);
 static StringInfo CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 									   char *partitionColumnName);
 static char * ColumnName(Var *column, List *rangeTableList);
@@ -399,6 +402,9 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				partitionType = DUAL_HASH_PARTITION_TYPE;
 			}
 
+			MapMergeJob *leftMapMergeJob = NULL;
+			MapMergeJob *rightMapMergeJob = NULL;
+
 			if (CitusIsA(leftChildNode, MultiPartition))
 			{
 				MultiPartition *partitionNode = (MultiPartition *) leftChildNode;
@@ -417,6 +423,8 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				/* reset dependent job list */
 				loopDependentJobList = NIL;
 				loopDependentJobList = list_make1(mapMergeJob);
+
+				leftMapMergeJob = mapMergeJob;
 			}
 
 			if (CitusIsA(rightChildNode, MultiPartition))
@@ -437,6 +445,18 @@ BuildJobTree(MultiTreeRoot *multiTree)
 
 				/* append to the dependent job list for on-going dependencies */
 				loopDependentJobList = lappend(loopDependentJobList, mapMergeJob);
+
+				rightMapMergeJob = mapMergeJob;
+			}
+
+			/* spread the rows of frequent join values over several partitions */
+			if (leftMapMergeJob != NULL && rightMapMergeJob != NULL &&
+				partitionType == DUAL_HASH_PARTITION_TYPE)
+			{
+				AssignSkewedJoinValues(joinNode->joinType,
+									   (MultiPartition *) leftChildNode, leftMapMergeJob,
+									   (MultiPartition *) rightChildNode,
+									   rightMapMergeJob);
 			}
 		}
 		else if (boundaryNodeJobType == SUBQUERY_MAP_MERGE_JOB)
@@ -836,6 +856,8 @@ BuildReduceQuery(MultiExtendedOp *extendedOpNode, List *dependentJobList)
 	reduceQuery->limitCount = extendedOpNode->limitCount;
 	reduceQuery->havingQual = extendedOpNode->havingQual;
 	reduceQuery->hasAggs = contain_aggs_of_level((Node *) targetList, 0);
+	reduceQuery->windowClause = extendedOpNode->windowClause;
+	reduceQuery->hasWindowFuncs = extendedOpNode->hasWindowFuncs;
 
 	return reduceQuery;
 }
@@ -2209,8 +2231,7 @@ BuildJobTreeTaskList(Job *jobTree, PlannerRestrictionContext *plannerRestriction
 		{
 			bool isMultiShardQuery = false;
 			List *prunedRelationShardList =
-				TargetShardIntervalsForRestrictInfo(plannerRestrictionContext->
-													relationRestrictionContext,
+				TargetShardIntervalsForRestrictInfo(plannerRestrictionContext,
 													&isMultiShardQuery, NULL);
 
 			sqlTaskList = QueryPushdownSqlTaskList(job->jobQuery, job->jobId,
@@ -2387,6 +2408,9 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	 * given that hash-distributed tables typically only have a few shards the
 	 * iteration is still very fast.
 	 */
+	ShardQueryTemplate *queryTemplate = NULL;
+	bool queryTemplateBuilt = false;
+
 	for (int shardOffset = minShardOffset; shardOffset <= maxShardOffset; shardOffset++)
 	{
 		if (taskRequiredForShardIndex != NULL && !taskRequiredForShardIndex[shardOffset])
@@ -2399,10 +2423,26 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 													 relationRestrictionContext,
 													 taskIdIndex,
 													 taskType,
-													 modifyRequiresMasterEvaluation);
+													 modifyRequiresMasterEvaluation,
+													 queryTemplate);
 		subqueryTask->jobId = jobId;
 		sqlTaskList = lappend(sqlTaskList, subqueryTask);
 
+		/*
+		 * Once we have deparsed the query for a task, build a template such that
+		 * the query strings of the remaining tasks only require replacing the
+		 * shard names, rather than deparsing the query again.
+		 */
+		if (!queryTemplateBuilt && shardOffset < maxShardOffset &&
+			GetTaskQueryType(subqueryTask) == TASK_QUERY_TEXT)
+		{
+			Query *templateQuery = copyObject(query);
+			MakeJoinTreeQualsExplicit(templateQuery);
+
+			queryTemplate = BuildShardQueryTemplate(templateQuery, subqueryTask);
+			queryTemplateBuilt = true;
+		}
+
 		++taskIdIndex;
 	}
 
@@ -2430,7 +2470,7 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
  *
  * The function returns true only if both conditions above hold true
  */
-static bool
+bool
 IsInnerTableOfOuterJoin(RelationRestriction *relationRestriction)
 {
 	RestrictInfo *joinInfo = NULL;
@@ -2576,13 +2616,10 @@ ErrorIfUnsupportedShardDistribution(Query *query)
 static Task *
 QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 						RelationRestrictionContext *restrictionContext, uint32 taskId,
-						TaskType taskType, bool modifyRequiresMasterEvaluation)
+						TaskType taskType, bool modifyRequiresMasterEvaluation,
+						ShardQueryTemplate *queryTemplate)
 {
-	Query *taskQuery = copyObject(originalQuery);
-
-	StringInfo queryString = makeStringInfo();
 	ListCell *restrictionCell = NULL;
-	List *taskShardList = NIL;
 	List *relationShardList = NIL;
 	uint64 jobId = INVALID_JOB_ID;
 	uint64 anchorShardId = INVALID_SHARD_ID;
@@ -2639,63 +2676,95 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 			anchorShardId = shardInterval->shardId;
 		}
 
-		ShardInterval *copiedShardInterval = CopyShardInterval(shardInterval);
-
-		taskShardList = lappend(taskShardList, list_make1(copiedShardInterval));
-
+		/*
+		 * We only keep the shard ID rather than a copy of the shard interval,
+		 * since copying the min and max values of every shard of every relation
+		 * adds up for queries on tables with many shards.
+		 */
 		RelationShard *relationShard = CitusMakeNode(RelationShard);
-		relationShard->relationId = copiedShardInterval->relationId;
-		relationShard->shardId = copiedShardInterval->shardId;
+		relationShard->relationId = shardInterval->relationId;
+		relationShard->shardId = shardInterval->shardId;
 
 		relationShardList = lappend(relationShardList, relationShard);
 	}
 
 	Assert(anchorShardId != INVALID_SHARD_ID);
 
-	List *selectPlacementList = WorkersContainingAllShards(taskShardList);
+	List *selectPlacementList = WorkersContainingAllRelationShards(relationShardList);
 	if (list_length(selectPlacementList) == 0)
 	{
 		ereport(ERROR, (errmsg("cannot find a worker that has active placements for all "
 							   "shards in the query")));
 	}
 
-	/*
-	 * Augment the relations in the query with the shard IDs.
-	 */
-	UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
-
-	/*
-	 * Ands are made implicit during shard pruning, as predicate comparison and
-	 * refutation depend on it being so. We need to make them explicit again so
-	 * that the query string is generated as (...) AND (...) as opposed to
-	 * (...), (...).
-	 */
-	if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
-	{
-		taskQuery->jointree->quals = (Node *) make_ands_explicit(
-			(List *) taskQuery->jointree->quals);
-	}
-
 	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
 
-	if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
-		taskType == SELECT_TASK)
-	{
-		pg_get_query_def(taskQuery, queryString);
-		ereport(DEBUG4, (errmsg("distributed statement: %s",
-								ApplyLogRedaction(queryString->data))));
-		SetTaskQueryString(subqueryTask, queryString->data);
-	}
-
 	subqueryTask->dependentTaskList = NULL;
 	subqueryTask->anchorShardId = anchorShardId;
 	subqueryTask->taskPlacementList = selectPlacementList;
 	subqueryTask->relationShardList = relationShardList;
 
+	if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
+		taskType == SELECT_TASK)
+	{
+		char *queryString = NULL;
+
+		/* tasks that might be executed locally keep the query tree instead */
+		if (queryTemplate != NULL && !ShouldLazyDeparseQuery(subqueryTask))
+		{
+			queryString = ShardQueryStringFromTemplate(queryTemplate,
+													   relationShardList);
+		}
+
+		if (queryString != NULL)
+		{
+			SetTaskQueryString(subqueryTask, queryString);
+		}
+		else
+		{
+			Query *taskQuery = copyObject(originalQuery);
+
+			/*
+			 * Augment the relations in the query with the shard IDs.
+			 */
+			UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+			MakeJoinTreeQualsExplicit(taskQuery);
+
+			SetTaskQueryIfShouldLazyDeparse(subqueryTask, taskQuery);
+		}
+
+		if (IsLoggableLevel(DEBUG4))
+		{
+			ereport(DEBUG4, (errmsg("distributed statement: %s",
+									ApplyLogRedaction(TaskQueryStringForAllPlacements(
+														  subqueryTask)))));
+		}
+	}
+
 	return subqueryTask;
 }
 
 
+/*
+ * MakeJoinTreeQualsExplicit turns the implicitly ANDed list of quals of the
+ * given query into an explicit AND expression.
+ *
+ * Ands are made implicit during shard pruning, as predicate comparison and
+ * refutation depend on it being so. We need to make them explicit again so
+ * that the query string is generated as (...) AND (...) as opposed to
+ * (...), (...).
+ */
+static void
+MakeJoinTreeQualsExplicit(Query *query)
+{
+	if (query->jointree->quals != NULL && IsA(query->jointree->quals, List))
+	{
+		query->jointree->quals = (Node *) make_ands_explicit(
+			(List *) query->jointree->quals);
+	}
+}
+
+
 /*
  * CoPartitionedTables checks if given two distributed tables have 1-to-1 shard
  * placement matching. It first checks for the shard count, if tables don't have
@@ -4574,6 +4643,19 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 	{
 		partitionCommand = RANGE_PARTITION_COMMAND;
 	}
+	else if (mapMergeJob->skewedHashList != NIL)
+	{
+		StringInfo skewedHashString =
+			IntegerListArrayString(mapMergeJob->skewedHashList);
+		StringInfo skewPartitionCountString =
+			IntegerListArrayString(mapMergeJob->skewPartitionCountList);
+
+		appendStringInfo(mapQueryString, SKEWED_HASH_PARTITION_COMMAND, jobId, taskId,
+						 filterQueryEscapedText, partitionColumnName,
+						 partitionColumnTypeFullName, splitPointString->data,
+						 skewedHashString->data, skewPartitionCountString->data);
+		return mapQueryString;
+	}
 	else
 	{
 		partitionCommand = HASH_PARTITION_COMMAND;
@@ -4586,6 +4668,31 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 }
 
 
+/*
+ * IntegerListArrayString returns an integer array literal with the integers in
+ * the given list.
+ */
+static StringInfo
+IntegerListArrayString(List *integerList)
+{
+	StringInfo arrayString = makeStringInfo();
+	const char *separator = "";
+	int integer = 0;
+
+	appendStringInfoString(arrayString, "ARRAY[");
+
+	foreach_int(integer, integerList)
+	{
+		appendStringInfo(arrayString, "%s%d", separator, integer);
+		separator = ",";
+	}
+
+	appendStringInfoString(arrayString, "]::integer[]");
+
+	return arrayString;
+}
+
+
 /*
  * GenerateSyntheticShardIntervalArray returns a shard interval pointer array
  * which has a uniform hash distribution for the given input partitionCount.
@@ -5225,8 +5332,13 @@ AssignAnchorShardTaskList(List *taskList)
 {
 	List *assignedTaskList = NIL;
 
-	/* choose task assignment policy based on config value */
-	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_GREEDY)
+	/*
+	 * Choose task assignment policy based on config value. The adaptive policy
+	 * starts from the greedy assignment, and the executor may still pick another
+	 * placement depending on the load of the worker nodes.
+	 */
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_GREEDY ||
+		TaskAssignmentPolicy == TASK_ASSIGNMENT_ADAPTIVE)
 	{
 		assignedTaskList = GreedyAssignTaskList(taskList);
 	}
@@ -18,6 +18,7 @@
 
 #include "access/stratnum.h"
 #include "access/xact.h"
+#include "catalog/dependency.h"
 #include "catalog/pg_opfamily.h"
 #include "catalog/pg_type.h"
 #include "distributed/colocation_utils.h"
@@ -50,6 +51,7 @@
 #include "distributed/resource_lock.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/worker_manager.h"
 #include "executor/execdesc.h"
 #include "lib/stringinfo.h"
 #include "nodes/makefuncs.h"
@@ -76,6 +78,7 @@
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/typcache.h"
@@ -115,6 +118,7 @@ typedef struct WalkerState
 } WalkerState;
 
 bool EnableRouterExecution = true;
+bool EnableSequenceEvaluationOnWorkers = false;
 
 
 /* planner functions forward declarations */
@@ -136,6 +140,9 @@ static bool MasterIrreducibleExpressionFunctionChecker(Oid func_id, void *contex
 static bool TargetEntryChangesValue(TargetEntry *targetEntry, Var *column,
 									FromExpr *joinTree);
 static Job * RouterInsertJob(Query *originalQuery);
+static bool CanEvaluateSequencesOnWorkers(Query *query);
+static bool PartitionValueContainsNextval(Query *query, TargetEntry *targetEntry);
+static bool ExtractNextvalCallsWalker(Node *node, List **nextvalCallList);
 static void ErrorIfNoShardsExist(CitusTableCacheEntry *cacheEntry);
 static DeferredErrorMessage * DeferErrorIfModifyView(Query *queryTree);
 static Job * CreateJob(Query *query);
@@ -144,6 +151,10 @@ static Job * RouterJob(Query *originalQuery,
 					   PlannerRestrictionContext *plannerRestrictionContext,
 					   DeferredErrorMessage **planningError);
 static bool RelationPrunesToMultipleShards(List *relationShardList);
+static bool CanPruneWithEquivalentRestrictions(RelationRestriction *relationRestriction);
+static PlannerRestrictionContext * EnclosingPlannerRestrictionContext(
+	PlannerRestrictionContext *plannerRestrictionContext,
+	RelationRestriction *relationRestriction);
 static void NormalizeMultiRowInsertTargetList(Query *query);
 static List * BuildRoutesForInsert(Query *query, DeferredErrorMessage **planningError);
 static List * GroupInsertValuesByShardId(List *insertValuesList);
@@ -158,11 +169,14 @@ static int CompareInsertValuesByShardId(const void *leftElement,
 										const void *rightElement);
 static List * SingleShardSelectTaskList(Query *query, uint64 jobId,
 										List *relationShardList, List *placementList,
-										uint64 shardId, bool parametersInQueryResolved);
+										uint64 shardId, bool parametersInQueryResolved,
+										char *queryString);
 static bool RowLocksOnRelations(Node *node, List **rtiLockList);
 static List * SingleShardModifyTaskList(Query *query, uint64 jobId,
 										List *relationShardList, List *placementList,
-										uint64 shardId, bool parametersInQueryResolved);
+										uint64 shardId, bool parametersInQueryResolved,
+										char *queryString);
+static void SetSingleShardTaskQuery(Task *task, Query *query, char *queryString);
 static List * RemoveCoordinatorPlacement(List *placementList);
 static void ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 														TaskAssignmentPolicyType
@@ -1422,7 +1436,17 @@ RouterInsertJob(Query *originalQuery)
 	}
 
 	Job *job = CreateJob(originalQuery);
-	job->requiresMasterEvaluation = RequiresMasterEvaluation(originalQuery);
+	job->evaluateSequencesOnWorkers = CanEvaluateSequencesOnWorkers(originalQuery);
+	if (job->evaluateSequencesOnWorkers)
+	{
+		job->requiresMasterEvaluation =
+			RequiresMasterEvaluationExceptSequences(originalQuery);
+	}
+	else
+	{
+		job->requiresMasterEvaluation = RequiresMasterEvaluation(originalQuery);
+	}
+
 	job->deferredPruning = true;
 	job->partitionKeyValue = ExtractInsertPartitionKeyValue(originalQuery);
 
@@ -1430,6 +1454,153 @@ RouterInsertJob(Query *originalQuery)
 }
 
 
+/*
+ * CanEvaluateSequencesOnWorkers returns whether the nextval calls in the given
+ * INSERT can be sent to the workers instead of being evaluated row by row on
+ * the coordinator. That is the case for bigint sequences of MX tables: the
+ * metadata sync creates them on the workers, and each node generates values
+ * from its own range. Since nextval gives a different value on each node, we
+ * require a single replica per shard and no nextval in the distribution
+ * column, which we need to route the rows.
+ */
+static bool
+CanEvaluateSequencesOnWorkers(Query *query)
+{
+	List *nextvalCallList = NIL;
+
+	if (!EnableSequenceEvaluationOnWorkers)
+	{
+		return false;
+	}
+
+	ExtractNextvalCallsWalker((Node *) query, &nextvalCallList);
+	if (nextvalCallList == NIL)
+	{
+		return false;
+	}
+
+	Oid distributedTableId = ResultRelationOidForQuery(query);
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(distributedTableId);
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		cacheEntry->replicationModel != REPLICATION_MODEL_STREAMING)
+	{
+		return false;
+	}
+
+	/* the sequences only exist on workers that have the metadata */
+	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		if (!workerNode->hasMetadata)
+		{
+			return false;
+		}
+	}
+
+	Var *partitionColumn = PartitionColumn(distributedTableId, query->resultRelation);
+	TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+												partitionColumn->varattno);
+	if (targetEntry != NULL && PartitionValueContainsNextval(query, targetEntry))
+	{
+		return false;
+	}
+
+	FuncExpr *nextvalCall = NULL;
+	foreach_ptr(nextvalCall, nextvalCallList)
+	{
+		Node *sequenceArgument = (Node *) linitial(nextvalCall->args);
+		Oid ownerTableId = InvalidOid;
+		int32 ownerColumnId = 0;
+
+		if (!IsA(sequenceArgument, Const) || ((Const *) sequenceArgument)->constisnull)
+		{
+			return false;
+		}
+
+		Oid sequenceId = DatumGetObjectId(((Const *) sequenceArgument)->constvalue);
+
+		/* the metadata sync only creates the sequences owned by the table */
+		if (!sequenceIsOwned(sequenceId, DEPENDENCY_AUTO, &ownerTableId,
+							 &ownerColumnId) ||
+			ownerTableId != distributedTableId)
+		{
+			return false;
+		}
+
+		/* smaller types leave too few values per node to avoid collisions */
+		if (pg_get_sequencedef(sequenceId)->seqtypid != INT8OID)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * PartitionValueContainsNextval returns whether the given target entry for the
+ * partition column contains a nextval call, in any of the rows in case of a
+ * multi-row INSERT.
+ */
+static bool
+PartitionValueContainsNextval(Query *query, TargetEntry *targetEntry)
+{
+	Node *targetExpression = strip_implicit_coercions((Node *) targetEntry->expr);
+
+	if (IsA(targetExpression, Var))
+	{
+		Var *partitionVar = (Var *) targetExpression;
+		RangeTblEntry *referencedRTE = rt_fetch(partitionVar->varno, query->rtable);
+
+		if (referencedRTE->rtekind == RTE_VALUES)
+		{
+			List *rowValues = NIL;
+			foreach_ptr(rowValues, referencedRTE->values_lists)
+			{
+				Node *partitionValueNode = list_nth(rowValues,
+													partitionVar->varattno - 1);
+				if (contain_nextval_expression_walker(partitionValueNode, NULL))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+	}
+
+	return contain_nextval_expression_walker(targetExpression, NULL);
+}
+
+
+/*
+ * ExtractNextvalCallsWalker walks over a query tree and adds the nextval calls
+ * to nextvalCallList.
+ */
+static bool
+ExtractNextvalCallsWalker(Node *node, List **nextvalCallList)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, FuncExpr) && ((FuncExpr *) node)->funcid == F_NEXTVAL_OID)
+	{
+		*nextvalCallList = lappend(*nextvalCallList, node);
+	}
+	else if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ExtractNextvalCallsWalker,
+								 nextvalCallList, 0);
+	}
+
+	return expression_tree_walker(node, ExtractNextvalCallsWalker, nextvalCallList);
+}
+
+
 /*
  * CreateJob returns a new Job for the given query.
  */
@@ -1443,6 +1614,7 @@ CreateJob(Query *query)
 	job->dependentJobList = NIL;
 	job->subqueryPushdown = false;
 	job->requiresMasterEvaluation = false;
+	job->evaluateSequencesOnWorkers = false;
 	job->deferredPruning = false;
 
 	return job;
@@ -1678,6 +1850,26 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 void
 GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 								  List *placementList, uint64 shardId)
+{
+	char *queryString = NULL;
+
+	GenerateSingleShardRouterTaskListWithQueryString(job, relationShardList,
+													 placementList, shardId,
+													 queryString);
+}
+
+
+/*
+ * GenerateSingleShardRouterTaskListWithQueryString is the same as
+ * GenerateSingleShardRouterTaskList, except that the task uses the given
+ * query string when it is not NULL, instead of deparsing the job query.
+ * The caller is responsible for passing a query string that is equivalent
+ * to the job query on the given shard.
+ */
+void
+GenerateSingleShardRouterTaskListWithQueryString(Job *job, List *relationShardList,
+												 List *placementList, uint64 shardId,
+												 char *queryString)
 {
 	Query *originalQuery = job->jobQuery;
 
@@ -1687,7 +1879,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 		job->taskList = SingleShardSelectTaskList(originalQuery, job->jobId,
 												  relationShardList, placementList,
 												  shardId,
-												  job->parametersInJobQueryResolved);
+												  job->parametersInJobQueryResolved,
+												  queryString);
 
 		/*
 		 * Queries to reference tables, or distributed tables with multiple replica's have
@@ -1714,7 +1907,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 		job->taskList = SingleShardModifyTaskList(originalQuery, job->jobId,
 												  relationShardList, placementList,
 												  shardId,
-												  job->parametersInJobQueryResolved);
+												  job->parametersInJobQueryResolved,
+												  queryString);
 	}
 }
 
@@ -1725,6 +1919,7 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
  *
  * Supported Types
  * - TASK_ASSIGNMENT_ROUND_ROBIN round robin schedule queries among placements
+ * - TASK_ASSIGNMENT_ADAPTIVE leaves the choice among placements to the executor
  *
  * By default it does not reorder the task list, implying a first-replica strategy.
  */
@@ -1766,6 +1961,19 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 								primaryPlacement->nodeName,
 								primaryPlacement->nodePort)));
 	}
+	else if (taskAssignmentPolicy == TASK_ASSIGNMENT_ADAPTIVE)
+	{
+		Assert(list_length(job->taskList) == 1);
+		Task *task = (Task *) linitial(job->taskList);
+
+		/*
+		 * The executor picks the placement on the least loaded node. Similar to
+		 * round-robin, we do not want local execution on the coordinator to take
+		 * precedence over distributing the load across the worker nodes.
+		 */
+		Assert(ReadOnlyTask(task->taskType));
+		task->taskPlacementList = RemoveCoordinatorPlacement(placementList);
+	}
 }
 
 
@@ -1807,7 +2015,7 @@ RemoveCoordinatorPlacement(List *placementList)
 static List *
 SingleShardSelectTaskList(Query *query, uint64 jobId, List *relationShardList,
 						  List *placementList, uint64 shardId,
-						  bool parametersInQueryResolved)
+						  bool parametersInQueryResolved, char *queryString)
 {
 	Task *task = CreateTask(SELECT_TASK);
 	List *relationRowLockList = NIL;
@@ -1820,7 +2028,7 @@ SingleShardSelectTaskList(Query *query, uint64 jobId, List *relationShardList,
 	 * that the query cannot be executed locally.
 	 */
 	task->taskPlacementList = placementList;
-	SetTaskQueryIfShouldLazyDeparse(task, query);
+	SetSingleShardTaskQuery(task, query, queryString);
 	task->anchorShardId = shardId;
 	task->jobId = jobId;
 	task->relationShardList = relationShardList;
@@ -1879,7 +2087,7 @@ RowLocksOnRelations(Node *node, List **relationRowLockList)
 static List *
 SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 						  List *placementList, uint64 shardId,
-						  bool parametersInQueryResolved)
+						  bool parametersInQueryResolved, char *queryString)
 {
 	Task *task = CreateTask(MODIFY_TASK);
 	List *rangeTableList = NIL;
@@ -1901,7 +2109,7 @@ SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 	}
 
 	task->taskPlacementList = placementList;
-	SetTaskQueryIfShouldLazyDeparse(task, query);
+	SetSingleShardTaskQuery(task, query, queryString);
 	task->anchorShardId = shardId;
 	task->jobId = jobId;
 	task->relationShardList = relationShardList;
@@ -1912,6 +2120,24 @@ SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 }
 
 
+/*
+ * SetSingleShardTaskQuery sets the query of a single shard task to the
+ * given query string if there is one, or to the query otherwise.
+ */
+static void
+SetSingleShardTaskQuery(Task *task, Query *query, char *queryString)
+{
+	if (queryString != NULL)
+	{
+		SetTaskQueryString(task, queryString);
+	}
+	else
+	{
+		SetTaskQueryIfShouldLazyDeparse(task, query);
+	}
+}
+
+
 /*
  * GetUpdateOrDeleteRTE checks query if it has an UPDATE or DELETE RTE.
  * Returns that RTE if found.
@@ -2044,8 +2270,7 @@ PlanRouterQuery(Query *originalQuery,
 	else
 	{
 		*prunedShardIntervalListList =
-			TargetShardIntervalsForRestrictInfo(plannerRestrictionContext->
-												relationRestrictionContext,
+			TargetShardIntervalsForRestrictInfo(plannerRestrictionContext,
 												&isMultiShardQuery,
 												partitionValueConst);
 	}
@@ -2385,14 +2610,22 @@ TargetShardIntervalForFastPathQuery(Query *query, bool *isMultiShardQuery,
  * restriction context to be used later on. Some queries may have contradiction
  * clauses like 'and false' or 'and 1=0', such queries are treated as if all of
  * the shards of joining relations are pruned out.
+ *
+ * Relations that are joined on their distribution key with a relation that has
+ * a filter on its distribution key are also pruned using that filter, such that
+ * the filter does not need to be repeated for each relation in the query.
  */
 List *
-TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *restrictionContext,
+TargetShardIntervalsForRestrictInfo(PlannerRestrictionContext *plannerRestrictionContext,
 									bool *multiShardQuery, Const **partitionValueConst)
 {
+	RelationRestrictionContext *restrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
 	List *prunedShardIntervalListList = NIL;
 	ListCell *restrictionCell = NULL;
 	bool multiplePartitionValuesExist = false;
+	bool multiShardRelationExists = false;
+	bool filteredRelationExists = false;
 	Const *queryPartitionValueConst = NULL;
 
 	Assert(restrictionContext != NULL);
@@ -2428,7 +2661,11 @@ TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *restrictionConte
 
 			if (list_length(prunedShardIntervalList) > 1)
 			{
-				(*multiShardQuery) = true;
+				multiShardRelationExists = true;
+			}
+			if (list_length(prunedShardIntervalList) < shardCount)
+			{
+				filteredRelationExists = true;
 			}
 			if (restrictionPartitionValueConst != NULL &&
 				queryPartitionValueConst == NULL)
@@ -2443,6 +2680,69 @@ TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *restrictionConte
 		}
 
 		relationRestriction->prunedShardIntervalList = prunedShardIntervalList;
+	}
+
+	/*
+	 * If some relation is filtered on its distribution key, be it by a single
+	 * value or an IN list, relations joined with it on the distribution key
+	 * might prune to fewer shards using that filter.
+	 */
+	if (multiShardRelationExists && filteredRelationExists)
+	{
+		foreach(restrictionCell, restrictionContext->relationRestrictionList)
+		{
+			RelationRestriction *relationRestriction =
+				(RelationRestriction *) lfirst(restrictionCell);
+
+			if (list_length(relationRestriction->prunedShardIntervalList) <= 1 ||
+				!CanPruneWithEquivalentRestrictions(relationRestriction))
+			{
+				continue;
+			}
+
+			PlannerRestrictionContext *enclosingRestrictionContext =
+				EnclosingPlannerRestrictionContext(plannerRestrictionContext,
+												   relationRestriction);
+			List *restrictClauseList =
+				RestrictionClausesForRelation(relationRestriction->rte,
+											  relationRestriction->index,
+											  enclosingRestrictionContext, true);
+
+			Const *restrictionPartitionValueConst = NULL;
+			List *prunedShardIntervalList =
+				PruneShards(relationRestriction->relationId, relationRestriction->index,
+							restrictClauseList, &restrictionPartitionValueConst);
+
+			if (list_length(prunedShardIntervalList) <
+				list_length(relationRestriction->prunedShardIntervalList))
+			{
+				relationRestriction->prunedShardIntervalList = prunedShardIntervalList;
+			}
+
+			if (restrictionPartitionValueConst != NULL &&
+				queryPartitionValueConst == NULL)
+			{
+				queryPartitionValueConst = restrictionPartitionValueConst;
+			}
+			else if (restrictionPartitionValueConst != NULL &&
+					 !equal(queryPartitionValueConst, restrictionPartitionValueConst))
+			{
+				multiplePartitionValuesExist = true;
+			}
+		}
+	}
+
+	foreach(restrictionCell, restrictionContext->relationRestrictionList)
+	{
+		RelationRestriction *relationRestriction =
+			(RelationRestriction *) lfirst(restrictionCell);
+		List *prunedShardIntervalList = relationRestriction->prunedShardIntervalList;
+
+		if (list_length(prunedShardIntervalList) > 1)
+		{
+			(*multiShardQuery) = true;
+		}
+
 		prunedShardIntervalListList = lappend(prunedShardIntervalListList,
 											  prunedShardIntervalList);
 	}
@@ -2466,6 +2766,95 @@ TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *restrictionConte
 }
 
 
+/*
+ * CanPruneWithEquivalentRestrictions returns whether the shards of the given
+ * relation can be pruned using the filters on the distribution keys of the
+ * relations that it is joined with on its distribution key.
+ *
+ * That is only the case if no query level between the relation and the
+ * outermost query computes something over all rows of the relation, such as
+ * an aggregate, a window function or a LIMIT, since rows that are removed by
+ * the join afterwards could still affect the result of such a query level.
+ */
+static bool
+CanPruneWithEquivalentRestrictions(RelationRestriction *relationRestriction)
+{
+	PlannerInfo *plannerInfo = relationRestriction->plannerInfo;
+
+	while (plannerInfo->parent_root != NULL)
+	{
+		Query *query = plannerInfo->parse;
+
+		if (query->hasAggs || query->groupClause != NIL ||
+			query->groupingSets != NIL || query->havingQual != NULL ||
+			query->hasWindowFuncs || query->hasTargetSRFs ||
+			query->distinctClause != NIL || query->setOperations != NULL ||
+			query->limitCount != NULL || query->limitOffset != NULL)
+		{
+			return false;
+		}
+
+		plannerInfo = plannerInfo->parent_root;
+	}
+
+	return true;
+}
+
+
+/*
+ * EnclosingPlannerRestrictionContext returns a copy of the given planner
+ * restriction context that only contains the restrictions of the relations
+ * that are planned in the same query level as the given relation or in a query
+ * level that encloses it.
+ *
+ * A filter in a correlated subquery only restricts the rows that the subquery
+ * returns, not the rows of the outer relations that it is correlated with, so
+ * the filters of relations in deeper query levels cannot be used for pruning.
+ */
+static PlannerRestrictionContext *
+EnclosingPlannerRestrictionContext(PlannerRestrictionContext *plannerRestrictionContext,
+								   RelationRestriction *relationRestriction)
+{
+	RelationRestrictionContext *relationRestrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
+	ListCell *restrictionCell = NULL;
+
+	RelationRestrictionContext *enclosingRelationRestrictionContext =
+		palloc0(sizeof(RelationRestrictionContext));
+	*enclosingRelationRestrictionContext = *relationRestrictionContext;
+	enclosingRelationRestrictionContext->relationRestrictionList = NIL;
+
+	foreach(restrictionCell, relationRestrictionContext->relationRestrictionList)
+	{
+		RelationRestriction *otherRestriction =
+			(RelationRestriction *) lfirst(restrictionCell);
+		PlannerInfo *plannerInfo = relationRestriction->plannerInfo;
+
+		while (plannerInfo != NULL && plannerInfo != otherRestriction->plannerInfo)
+		{
+			plannerInfo = plannerInfo->parent_root;
+		}
+
+		if (plannerInfo == NULL)
+		{
+			continue;
+		}
+
+		enclosingRelationRestrictionContext->relationRestrictionList =
+			lappend(enclosingRelationRestrictionContext->relationRestrictionList,
+					otherRestriction);
+	}
+
+	PlannerRestrictionContext *enclosingRestrictionContext =
+		palloc0(sizeof(PlannerRestrictionContext));
+	*enclosingRestrictionContext = *plannerRestrictionContext;
+	enclosingRestrictionContext->relationRestrictionContext =
+		enclosingRelationRestrictionContext;
+
+	return enclosingRestrictionContext;
+}
+
+
 /*
  * RelationPrunesToMultipleShards returns true if the given list of
  * relation-to-shard mappings contains at least two mappings with
@@ -2554,6 +2943,45 @@ WorkersContainingAllShards(List *prunedShardIntervalsList)
 }
 
 
+/*
+ * WorkersContainingAllRelationShards returns the list of shard placements that
+ * contain all shards in the given relation shard list. It is the same as
+ * WorkersContainingAllShards, for callers that only know the shard IDs and do
+ * not need to copy the shard intervals.
+ */
+List *
+WorkersContainingAllRelationShards(List *relationShardList)
+{
+	bool firstShard = true;
+	List *currentPlacementList = NIL;
+
+	RelationShard *relationShard = NULL;
+	foreach_ptr(relationShard, relationShardList)
+	{
+		List *newPlacementList = ActiveShardPlacementList(relationShard->shardId);
+
+		if (firstShard)
+		{
+			firstShard = false;
+			currentPlacementList = newPlacementList;
+		}
+		else
+		{
+			currentPlacementList = IntersectPlacementList(currentPlacementList,
+														  newPlacementList);
+		}
+
+		/* no worker contains all shards */
+		if (currentPlacementList == NIL)
+		{
+			break;
+		}
+	}
+
+	return currentPlacementList;
+}
+
+
 /*
  * BuildRoutesForInsert returns a list of ModifyRoute objects for an INSERT
  * query or an empty list if the partition column value is defined as an ex-
@@ -2640,7 +3068,6 @@ BuildRoutesForInsert(Query *query, DeferredErrorMessage **planningError)
 		{
 			Datum partitionValue = partitionValueConst->constvalue;
 
-			cacheEntry = GetCitusTableCacheEntry(distributedTableId);
 			ShardInterval *shardInterval = FindShardInterval(partitionValue, cacheEntry);
 			if (shardInterval != NULL)
 			{
@@ -0,0 +1,741 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_shard_plan_cache.c
+ *
+ * Backend-wide cache of distributed plans for multi-shard prepared SELECT
+ * queries.
+ *
+ * The regular distributed planner cannot prune shards on parameters that it
+ * does not know the value of, so prepared SELECT queries that touch multiple
+ * shards always get a custom plan, and the whole planning process runs again
+ * on every execution just to prune shards and deparse the shard queries with
+ * the new parameter values.
+ *
+ * When citus.multi_shard_plan_cache_size is larger than 0, we instead plan
+ * such a query once with its parameters left in place. The resulting plan
+ * has a task for every shard that the query may need, with shard queries that
+ * refer to the parameters, which are sent to the workers along with the shard
+ * queries when the plan is executed. We also keep the restrictions on the
+ * distributed tables in the query. On every execution, we only resolve the
+ * parameters in those restrictions, prune the shards again and copy the
+ * cached plan with the tasks for the remaining shards.
+ *
+ * Plans that need recursive planning or repartitioning cannot keep their
+ * parameters, and are planned regularly. So are queries for which the router
+ * planner finds a plan, since it already defers pruning to the executor.
+ *
+ * Like the fast-path plan cache, the cache is kept per backend, since plan
+ * trees refer to backend-local state and are invalidated through the
+ * backend's relcache and syscache invalidations.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "distributed/citus_custom_scan.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/fast_path_plan_cache.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_shard_plan_cache.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/shardinterval_utils.h"
+#include "lib/ilist.h"
+#include "nodes/bitmapset.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/restrictinfo.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#endif
+
+
+/*
+ * MultiShardPlanCacheKey identifies a query shape. The query hash is computed
+ * over the normalized query tree, which still contains the parameters.
+ */
+typedef struct MultiShardPlanCacheKey
+{
+	uint32 queryHash;
+	Oid userId;
+	int cursorOptions;
+} MultiShardPlanCacheKey;
+
+
+/*
+ * MultiShardPlanRestriction holds the restrictions on a distributed table in
+ * a cached plan, which are used to prune its shards for every execution.
+ */
+typedef struct MultiShardPlanRestriction
+{
+	Oid relationId;
+	Index rangeTableId;
+	List *clauseList;
+} MultiShardPlanRestriction;
+
+
+/*
+ * MultiShardPlanCacheEntry holds a cached plan along with the normalized query
+ * tree that was used to compute the hash, which we compare to rule out hash
+ * collisions. Queries that cannot be planned via the cache get an entry
+ * without a plan, such that we do not try again on every execution.
+ */
+typedef struct MultiShardPlanCacheEntry
+{
+	MultiShardPlanCacheKey key;
+
+	/* normalized query tree */
+	char *queryString;
+
+	/* relations that the query accesses */
+	List *relationIdList;
+
+	/* plan in which the parameters are sent to the workers, or NULL */
+	PlannedStmt *plan;
+
+	/* restrictions that determine which shards the query needs */
+	List *restrictionList;
+
+	/* shard index of each task of the plan */
+	List *taskShardIndexList;
+
+	/* memory context that holds the query string and the plan */
+	MemoryContext context;
+
+	/* position in the list of entries, most recently used first */
+	dlist_node lruNode;
+} MultiShardPlanCacheEntry;
+
+
+/* GUC, maximum number of plans in the multi-shard plan cache */
+int MultiShardPlanCacheSize = 0;
+
+static HTAB *MultiShardPlanCacheHash = NULL;
+static dlist_head MultiShardPlanCacheList = DLIST_STATIC_INIT(MultiShardPlanCacheList);
+static MemoryContext MultiShardPlanCacheContext = NULL;
+
+/* whether we are planning a query with its parameters left in place */
+static bool PlanningTemplate = false;
+
+/* restrictions recorded while planning a query with its parameters */
+static List *TemplateRestrictionList = NIL;
+static bool TemplateRestrictionsRecorded = false;
+
+
+static void InitializeMultiShardPlanCache(void);
+static PlannedStmt * TryPlanMultiShardPlanTemplate(Query *query, int cursorOptions);
+static bool PlanIsCacheable(PlannedStmt *plan);
+static bool TaskShardIndexList(List *taskList, List **taskShardIndexList);
+static List * CopyRestrictionList(List *restrictionList);
+static MultiShardPlanCacheEntry * AddMultiShardPlanCacheEntry(
+	MultiShardPlanCacheKey *key, char *queryString, List *relationIdList);
+static void RemoveMultiShardPlanCacheEntry(MultiShardPlanCacheEntry *entry);
+static PlannedStmt * InstantiateCachedPlan(MultiShardPlanCacheEntry *entry, Query *query,
+										   ParamListInfo boundParams);
+static Bitmapset * RequiredShardIndexes(List *restrictionList,
+										ParamListInfo boundParams);
+static void InvalidateMultiShardPlanCacheSyscacheCallback(Datum argument, int cacheId,
+														  uint32 hashValue);
+
+
+/*
+ * MultiShardQueryIsCacheable returns true if the given query can be planned
+ * via the multi-shard plan cache. That is the case for top-level SELECT
+ * queries with bound parameters and without CTEs.
+ */
+bool
+MultiShardQueryIsCacheable(Query *query, int cursorOptions, ParamListInfo boundParams)
+{
+	if (MultiShardPlanCacheSize <= 0)
+	{
+		return false;
+	}
+
+	if (PlannerLevel > 0)
+	{
+		/* queries in functions are already cached by the function language */
+		return false;
+	}
+
+	if (boundParams == NULL || boundParams->numParams == 0)
+	{
+		/* without parameters, there is nothing to defer */
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || query->hasForUpdate ||
+		query->cteList != NIL)
+	{
+		/* CTEs are planned recursively, which needs the parameter values */
+		return false;
+	}
+
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN)
+	{
+		/* placements are picked during planning, so every plan should be new */
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PlanMultiShardQueryViaCache returns a plan for the given prepared query,
+ * which is taken from the cache if a query of the same shape was planned
+ * before. Otherwise, the query is planned with its parameters left in place
+ * and the plan is added to the cache.
+ *
+ * The function returns NULL if the query cannot be planned this way, in which
+ * case the caller should plan the query regularly.
+ */
+PlannedStmt *
+PlanMultiShardQueryViaCache(Query *query, int cursorOptions, ParamListInfo boundParams)
+{
+	InitializeMultiShardPlanCache();
+
+	char *queryString = NormalizedQueryString(query);
+
+	MultiShardPlanCacheKey key;
+	memset(&key, 0, sizeof(key));
+	key.queryHash = string_hash(queryString, strlen(queryString) + 1);
+	key.userId = GetUserId();
+	key.cursorOptions = cursorOptions;
+
+	bool found = false;
+	MultiShardPlanCacheEntry *entry = hash_search(MultiShardPlanCacheHash, &key,
+												  HASH_FIND, &found);
+	if (found && strcmp(entry->queryString, queryString) == 0)
+	{
+		dlist_move_head(&MultiShardPlanCacheList, &entry->lruNode);
+
+		if (entry->plan == NULL)
+		{
+			return NULL;
+		}
+
+		return InstantiateCachedPlan(entry, query, boundParams);
+	}
+
+	List *relationIdList = NIL;
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, ExtractRangeTableEntryList(query))
+	{
+		if (rangeTableEntry->rtekind == RTE_RELATION)
+		{
+			relationIdList = list_append_unique_oid(relationIdList,
+													rangeTableEntry->relid);
+		}
+	}
+
+	/*
+	 * Plan the query without parameter values. Note that planning may process
+	 * invalidations, so we should not hold on to any cache entries at this
+	 * point.
+	 */
+	PlannedStmt *templatePlan = TryPlanMultiShardPlanTemplate(copyObject(query),
+															   cursorOptions);
+	List *taskShardIndexList = NIL;
+
+	if (templatePlan == NULL || !TemplateRestrictionsRecorded ||
+		!PlanIsCacheable(templatePlan))
+	{
+		templatePlan = NULL;
+	}
+	else
+	{
+		CustomScan *customScan = FetchCitusCustomScanIfExists(templatePlan->planTree);
+		Job *workerJob = GetDistributedPlan(customScan)->workerJob;
+
+		if (!TaskShardIndexList(workerJob->taskList, &taskShardIndexList))
+		{
+			templatePlan = NULL;
+		}
+	}
+
+	entry = AddMultiShardPlanCacheEntry(&key, queryString, relationIdList);
+	if (templatePlan == NULL)
+	{
+		/* remember that the query should be planned regularly */
+		TemplateRestrictionList = NIL;
+
+		return NULL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(entry->context);
+
+	entry->plan = copyObject(templatePlan);
+	entry->restrictionList = CopyRestrictionList(TemplateRestrictionList);
+	entry->taskShardIndexList = list_copy(taskShardIndexList);
+
+	/* plans taken from the cache were not planned, so don't show planning phases */
+	CustomScan *customScan = FetchCitusCustomScanIfExists(entry->plan->planTree);
+	GetDistributedPlan(customScan)->hasPlanningPhaseTimes = false;
+
+	MemoryContextSwitchTo(oldContext);
+
+	TemplateRestrictionList = NIL;
+
+	return InstantiateCachedPlan(entry, query, boundParams);
+}
+
+
+/*
+ * InitializeMultiShardPlanCache creates the hash table for the cache and
+ * registers the invalidation callbacks the first time it is called.
+ */
+static void
+InitializeMultiShardPlanCache(void)
+{
+	if (MultiShardPlanCacheHash != NULL)
+	{
+		return;
+	}
+
+	MultiShardPlanCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													   "Multi Shard Plan Cache",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(MultiShardPlanCacheKey);
+	info.entrysize = sizeof(MultiShardPlanCacheEntry);
+	info.hash = tag_hash;
+	info.hcxt = MultiShardPlanCacheContext;
+
+	MultiShardPlanCacheHash = hash_create("Multi Shard Plan Cache Hash", 64, &info,
+										  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	/*
+	 * Relation invalidations reach us via InvalidateDistRelationCacheCallback,
+	 * which calls InvalidateMultiShardPlanCache.
+	 */
+	CacheRegisterSyscacheCallback(PROCOID,
+								  InvalidateMultiShardPlanCacheSyscacheCallback,
+								  (Datum) 0);
+}
+
+
+/*
+ * TryPlanMultiShardPlanTemplate plans the given query with its parameters
+ * left in place and records the restrictions on its distributed tables. The
+ * function returns NULL if planning fails, which may be due to the missing
+ * parameter values, in which case the query is planned regularly instead.
+ */
+static PlannedStmt *
+TryPlanMultiShardPlanTemplate(Query *query, int cursorOptions)
+{
+	MemoryContext savedContext = CurrentMemoryContext;
+	PlannedStmt *result = NULL;
+
+	TemplateRestrictionList = NIL;
+	TemplateRestrictionsRecorded = false;
+	PlanningTemplate = true;
+
+	PG_TRY();
+	{
+		result = distributed_planner(query, cursorOptions, NULL);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+
+		PlanningTemplate = false;
+
+		/* don't try to intercept PANIC or FATAL, let those breeze past us */
+		if (edata->elevel != ERROR)
+		{
+			PG_RE_THROW();
+		}
+
+		ereport(DEBUG4, (errmsg("could not plan query without parameter values: %s",
+								edata->message ? edata->message : "")));
+
+		FreeErrorData(edata);
+
+		result = NULL;
+	}
+	PG_END_TRY();
+
+	PlanningTemplate = false;
+
+	return result;
+}
+
+
+/*
+ * PlanningMultiShardPlanTemplate returns whether we are planning a query with
+ * its parameters left in place, in which case the distributed planner should
+ * continue past the router planner even though the parameters have no values.
+ */
+bool
+PlanningMultiShardPlanTemplate(void)
+{
+	return PlanningTemplate;
+}
+
+
+/*
+ * RecordMultiShardPlanRestrictions records the restrictions on the hash and
+ * range distributed tables in the query that is being planned with its
+ * parameters left in place. Tables on the inner side of outer joins are
+ * skipped, since their shards are needed regardless of their restrictions,
+ * as in QueryPushdownSqlTaskList.
+ */
+void
+RecordMultiShardPlanRestrictions(PlannerRestrictionContext *plannerRestrictionContext)
+{
+	RelationRestrictionContext *relationRestrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
+	List *restrictionList = NIL;
+
+	if (!PlanningTemplate)
+	{
+		return;
+	}
+
+	RelationRestriction *relationRestriction = NULL;
+	foreach_ptr(relationRestriction, relationRestrictionContext->relationRestrictionList)
+	{
+		Oid relationId = relationRestriction->relationId;
+
+		if (!IsCitusTable(relationId) ||
+			PartitionMethod(relationId) == DISTRIBUTE_BY_NONE ||
+			IsInnerTableOfOuterJoin(relationRestriction))
+		{
+			continue;
+		}
+
+		List *baseRestrictionList = relationRestriction->relOptInfo->baserestrictinfo;
+
+		MultiShardPlanRestriction *restriction =
+			palloc0(sizeof(MultiShardPlanRestriction));
+		restriction->relationId = relationId;
+		restriction->rangeTableId = relationRestriction->index;
+		restriction->clauseList = get_all_actual_clauses(baseRestrictionList);
+
+		restrictionList = lappend(restrictionList, restriction);
+	}
+
+	TemplateRestrictionList = restrictionList;
+	TemplateRestrictionsRecorded = true;
+}
+
+
+/*
+ * PlanIsCacheable returns true if the given plan is a multi-shard SELECT plan
+ * without subplans or repartitioning, whose tasks only differ in the shards
+ * they access.
+ */
+static bool
+PlanIsCacheable(PlannedStmt *plan)
+{
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	if (customScan == NULL)
+	{
+		return false;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	if (distributedPlan->planningError != NULL ||
+		distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->subPlanList != NIL)
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->deferredPruning ||
+		workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, workerJob->taskList)
+	{
+		if (task->taskType != SELECT_TASK)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * TaskShardIndexList finds the index of the shards that each of the given
+ * tasks accesses. The function returns false if a task accesses shards with
+ * different indexes, in which case we cannot tell which tasks to skip.
+ */
+static bool
+TaskShardIndexList(List *taskList, List **taskShardIndexList)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		int taskShardIndex = INVALID_SHARD_INDEX;
+
+		RelationShard *relationShard = NULL;
+		foreach_ptr(relationShard, task->relationShardList)
+		{
+			if (relationShard->shardId == INVALID_SHARD_ID ||
+				PartitionMethod(relationShard->relationId) == DISTRIBUTE_BY_NONE)
+			{
+				continue;
+			}
+
+			ShardInterval *shardInterval = LoadShardInterval(relationShard->shardId);
+
+			if (taskShardIndex == INVALID_SHARD_INDEX)
+			{
+				taskShardIndex = shardInterval->shardIndex;
+			}
+			else if (taskShardIndex != shardInterval->shardIndex)
+			{
+				return false;
+			}
+		}
+
+		*taskShardIndexList = lappend_int(*taskShardIndexList, taskShardIndex);
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyRestrictionList returns a copy of the given restrictions in the current
+ * memory context.
+ */
+static List *
+CopyRestrictionList(List *restrictionList)
+{
+	List *restrictionListCopy = NIL;
+
+	MultiShardPlanRestriction *restriction = NULL;
+	foreach_ptr(restriction, restrictionList)
+	{
+		MultiShardPlanRestriction *restrictionCopy =
+			palloc0(sizeof(MultiShardPlanRestriction));
+		restrictionCopy->relationId = restriction->relationId;
+		restrictionCopy->rangeTableId = restriction->rangeTableId;
+		restrictionCopy->clauseList = copyObject(restriction->clauseList);
+
+		restrictionListCopy = lappend(restrictionListCopy, restrictionCopy);
+	}
+
+	return restrictionListCopy;
+}
+
+
+/*
+ * AddMultiShardPlanCacheEntry adds an entry without a plan to the cache,
+ * evicting the least recently used entries if the cache is full, and returns
+ * the new entry.
+ */
+static MultiShardPlanCacheEntry *
+AddMultiShardPlanCacheEntry(MultiShardPlanCacheKey *key, char *queryString,
+							List *relationIdList)
+{
+	bool found = false;
+	MultiShardPlanCacheEntry *entry = hash_search(MultiShardPlanCacheHash, key,
+												  HASH_FIND, &found);
+	if (found)
+	{
+		/* hash collision, replace the existing entry */
+		RemoveMultiShardPlanCacheEntry(entry);
+	}
+
+	while (!dlist_is_empty(&MultiShardPlanCacheList) &&
+		   hash_get_num_entries(MultiShardPlanCacheHash) >= MultiShardPlanCacheSize)
+	{
+		dlist_node *oldestNode = dlist_tail_node(&MultiShardPlanCacheList);
+
+		RemoveMultiShardPlanCacheEntry(dlist_container(MultiShardPlanCacheEntry,
+													   lruNode, oldestNode));
+	}
+
+	MemoryContext entryContext = AllocSetContextCreate(MultiShardPlanCacheContext,
+													   "Multi Shard Plan Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	char *cachedQueryString = pstrdup(queryString);
+	List *cachedRelationIdList = list_copy(relationIdList);
+
+	MemoryContextSwitchTo(oldContext);
+
+	entry = hash_search(MultiShardPlanCacheHash, key, HASH_ENTER, &found);
+	entry->queryString = cachedQueryString;
+	entry->relationIdList = cachedRelationIdList;
+	entry->plan = NULL;
+	entry->restrictionList = NIL;
+	entry->taskShardIndexList = NIL;
+	entry->context = entryContext;
+
+	dlist_push_head(&MultiShardPlanCacheList, &entry->lruNode);
+
+	return entry;
+}
+
+
+/*
+ * RemoveMultiShardPlanCacheEntry removes the given entry from the cache and
+ * frees its memory.
+ */
+static void
+RemoveMultiShardPlanCacheEntry(MultiShardPlanCacheEntry *entry)
+{
+	MemoryContext entryContext = entry->context;
+
+	dlist_delete(&entry->lruNode);
+	hash_search(MultiShardPlanCacheHash, &entry->key, HASH_REMOVE, NULL);
+
+	MemoryContextDelete(entryContext);
+}
+
+
+/*
+ * InstantiateCachedPlan returns a copy of the plan of the given cache entry
+ * with only the tasks for the shards that are needed for the given parameter
+ * values. The parameters stay in the shard queries and are sent to the
+ * workers when the plan is executed.
+ */
+static PlannedStmt *
+InstantiateCachedPlan(MultiShardPlanCacheEntry *entry, Query *query,
+					  ParamListInfo boundParams)
+{
+	Bitmapset *requiredShardIndexes =
+		RequiredShardIndexes(entry->restrictionList, boundParams);
+
+	PlannedStmt *plan = copyObject(entry->plan);
+
+	/* statistics are tracked for the current query */
+	plan->queryId = query->queryId;
+	plan->stmt_location = query->stmt_location;
+	plan->stmt_len = query->stmt_len;
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	distributedPlan->queryId = query->queryId;
+
+	if (entry->restrictionList == NIL)
+	{
+		/* there are no distributed tables whose shards could be skipped */
+		return plan;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	List *requiredTaskList = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *taskShardIndexCell = NULL;
+
+	forboth(taskCell, workerJob->taskList, taskShardIndexCell, entry->taskShardIndexList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		int taskShardIndex = lfirst_int(taskShardIndexCell);
+
+		if (taskShardIndex == INVALID_SHARD_INDEX ||
+			bms_is_member(taskShardIndex, requiredShardIndexes))
+		{
+			requiredTaskList = lappend(requiredTaskList, task);
+		}
+	}
+
+	workerJob->taskList = requiredTaskList;
+
+	return plan;
+}
+
+
+/*
+ * RequiredShardIndexes returns the indexes of the shards that are needed for
+ * the given parameter values, which are the shards of any of the distributed
+ * tables that remain after pruning them with their restrictions.
+ */
+static Bitmapset *
+RequiredShardIndexes(List *restrictionList, ParamListInfo boundParams)
+{
+	Bitmapset *requiredShardIndexes = NULL;
+
+	/* force evaluation of bound params */
+	boundParams = copyParamList(boundParams);
+
+	MultiShardPlanRestriction *restriction = NULL;
+	foreach_ptr(restriction, restrictionList)
+	{
+		Node *clauses = ResolveExternalParams((Node *) restriction->clauseList,
+											  boundParams);
+
+		/* fold casts of the parameter values, as the planner would */
+		clauses = eval_const_expressions(NULL, clauses);
+
+		List *prunedShardIntervalList = PruneShards(restriction->relationId,
+													restriction->rangeTableId,
+													(List *) clauses, NULL);
+
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, prunedShardIntervalList)
+		{
+			requiredShardIndexes = bms_add_member(requiredShardIndexes,
+												  shardInterval->shardIndex);
+		}
+	}
+
+	return requiredShardIndexes;
+}
+
+
+/*
+ * InvalidateMultiShardPlanCache removes the cached plans for queries on the
+ * given relation, or all cached plans if relationId is InvalidOid.
+ */
+void
+InvalidateMultiShardPlanCache(Oid relationId)
+{
+	dlist_mutable_iter iter;
+
+	if (MultiShardPlanCacheHash == NULL)
+	{
+		return;
+	}
+
+	dlist_foreach_modify(iter, &MultiShardPlanCacheList)
+	{
+		MultiShardPlanCacheEntry *entry =
+			dlist_container(MultiShardPlanCacheEntry, lruNode, iter.cur);
+
+		if (relationId == InvalidOid ||
+			list_member_oid(entry->relationIdList, relationId))
+		{
+			RemoveMultiShardPlanCacheEntry(entry);
+		}
+	}
+}
+
+
+/*
+ * InvalidateMultiShardPlanCacheSyscacheCallback removes all cached plans when
+ * a function changes.
+ */
+static void
+InvalidateMultiShardPlanCacheSyscacheCallback(Datum argument, int cacheId,
+											  uint32 hashValue)
+{
+	InvalidateMultiShardPlanCache(InvalidOid);
+}
@@ -0,0 +1,325 @@
+/*-------------------------------------------------------------------------
+ *
+ * partition_pruning.c
+ *
+ * Functions for pruning the partitions of distributed partitioned tables on
+ * the coordinator. Shard pruning only looks at the distribution column, so
+ * a query on a partitioned table is sent to the shards of the parent table,
+ * and every worker plans the query for all of the partitions of those shards.
+ *
+ * When the WHERE clause of a SELECT restricts a partitioned table such that
+ * only one of its partitions can contain matching rows, we replace the
+ * partitioned table with that partition in the query before planning it.
+ * Since the partitions of a distributed partitioned table are distributed
+ * and co-located with it, the tasks then target the shards of the partition.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "miscadmin.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/partition.h"
+#include "catalog/pg_class.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/partition_pruning.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#include "optimizer/predtest.h"
+#include "optimizer/var.h"
+#endif
+#include "parser/parsetree.h"
+#include "partitioning/partbounds.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "partitioning/partdesc.h"
+#endif
+#include "rewrite/rewriteManip.h"
+#include "storage/lmgr.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+
+/* GUC, whether partitioned tables are pruned to a single partition */
+bool EnableCoordinatorPartitionPruning = false;
+
+
+static List * RelationRestrictionList(List *qualList, Index rangeTableIndex);
+static Oid SingleMatchingPartition(Oid parentRelationId, Index rangeTableIndex,
+								   List *restrictionList);
+static List * PartitionConstraint(Relation parentRelation, Oid partitionId);
+static bool CanReplaceWithPartition(RangeTblEntry *rangeTableEntry, Oid partitionId,
+									LOCKMODE lockMode);
+
+
+/*
+ * PruneDistributedPartitionedTables replaces the distributed partitioned tables
+ * in the FROM clause of a SELECT query with their partition if the WHERE clause
+ * refutes the partition constraints of all other partitions. For multi-level
+ * partitioning, we descend as long as a single partition matches.
+ *
+ * Tables that are part of a JOIN expression are left alone, since the WHERE
+ * clause does not necessarily restrict the rows of the nullable side of an
+ * outer join. Parameters are not evaluated, so prepared statements with the
+ * partition column in a parameter are not pruned.
+ */
+void
+PruneDistributedPartitionedTables(Query *query)
+{
+	if (!EnableCoordinatorPartitionPruning || query->commandType != CMD_SELECT ||
+		query->jointree == NULL || query->jointree->quals == NULL)
+	{
+		return;
+	}
+
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+	LOCKMODE lockMode = query->hasForUpdate ? RowShareLock : AccessShareLock;
+
+	Node *fromNode = NULL;
+	foreach_ptr(fromNode, query->jointree->fromlist)
+	{
+		if (!IsA(fromNode, RangeTblRef))
+		{
+			continue;
+		}
+
+		Index rangeTableIndex = ((RangeTblRef *) fromNode)->rtindex;
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			rangeTableEntry->relkind != RELKIND_PARTITIONED_TABLE ||
+			rangeTableEntry->tablesample != NULL ||
+			!IsCitusTable(rangeTableEntry->relid))
+		{
+			continue;
+		}
+
+		List *restrictionList = RelationRestrictionList(qualList, rangeTableIndex);
+		if (restrictionList == NIL)
+		{
+			continue;
+		}
+
+		while (rangeTableEntry->relkind == RELKIND_PARTITIONED_TABLE)
+		{
+			Oid parentRelationId = rangeTableEntry->relid;
+			Oid partitionId = SingleMatchingPartition(parentRelationId,
+													  rangeTableIndex,
+													  restrictionList);
+			if (partitionId == InvalidOid ||
+				!CanReplaceWithPartition(rangeTableEntry, partitionId, lockMode))
+			{
+				break;
+			}
+
+			ereport(DEBUG1, (errmsg("pruning partitioned table %s to partition %s",
+									get_rel_name(parentRelationId),
+									get_rel_name(partitionId))));
+
+			rangeTableEntry->relid = partitionId;
+			rangeTableEntry->relkind = get_rel_relkind(partitionId);
+		}
+	}
+}
+
+
+/*
+ * RelationRestrictionList returns the clauses in the given list that only
+ * reference the relation at the given range table index and can be used to
+ * refute partition constraints.
+ */
+static List *
+RelationRestrictionList(List *qualList, Index rangeTableIndex)
+{
+	List *restrictionList = NIL;
+
+	Node *qual = NULL;
+	foreach_ptr(qual, qualList)
+	{
+		Relids relids = pull_varnos(qual);
+
+		if (bms_membership(relids) != BMS_SINGLETON ||
+			!bms_is_member(rangeTableIndex, relids))
+		{
+			continue;
+		}
+
+		if (contain_volatile_functions(qual) || checkExprHasSubLink(qual))
+		{
+			continue;
+		}
+
+		restrictionList = lappend(restrictionList, qual);
+	}
+
+	return restrictionList;
+}
+
+
+/*
+ * SingleMatchingPartition returns the partition of the given partitioned table
+ * if the restrictions refute the partition constraints of all other partitions,
+ * and InvalidOid otherwise.
+ *
+ * The partition constraints are built from the partition bounds in the catalog,
+ * such that we do not need to open, and thereby lock, all the partitions.
+ */
+static Oid
+SingleMatchingPartition(Oid parentRelationId, Index rangeTableIndex,
+						List *restrictionList)
+{
+	Oid matchingPartitionId = InvalidOid;
+	int matchingPartitionCount = 0;
+
+	/* the parent table is already locked during parse analysis */
+	Relation parentRelation = relation_open(parentRelationId, NoLock);
+	PartitionDesc partitionDesc = RelationGetPartitionDesc(parentRelation);
+
+	for (int partitionIndex = 0;
+		 partitionIndex < partitionDesc->nparts && matchingPartitionCount < 2;
+		 partitionIndex++)
+	{
+		Oid partitionId = partitionDesc->oids[partitionIndex];
+		List *partitionConstraint = PartitionConstraint(parentRelation, partitionId);
+
+		/* partition constraints reference the parent as the first relation */
+		ChangeVarNodes((Node *) partitionConstraint, 1, rangeTableIndex, 0);
+
+		if (!predicate_refuted_by(partitionConstraint, restrictionList, false))
+		{
+			matchingPartitionId = partitionId;
+			matchingPartitionCount++;
+		}
+	}
+
+	relation_close(parentRelation, NoLock);
+
+	if (matchingPartitionCount != 1)
+	{
+		return InvalidOid;
+	}
+
+	return matchingPartitionId;
+}
+
+
+/*
+ * PartitionConstraint returns the implicitly AND'ed partition constraint of
+ * the given partition, in terms of the columns of its parent.
+ */
+static List *
+PartitionConstraint(Relation parentRelation, Oid partitionId)
+{
+	bool isNull = false;
+
+	HeapTuple tuple = SearchSysCache1(RELOID, ObjectIdGetDatum(partitionId));
+	if (!HeapTupleIsValid(tuple))
+	{
+		elog(ERROR, "cache lookup failed for relation %u", partitionId);
+	}
+
+	Datum boundDatum = SysCacheGetAttr(RELOID, tuple, Anum_pg_class_relpartbound,
+									   &isNull);
+	if (isNull)
+	{
+		/* partition is being attached, consider it a match */
+		ReleaseSysCache(tuple);
+		return NIL;
+	}
+
+	PartitionBoundSpec *boundSpec =
+		(PartitionBoundSpec *) stringToNode(TextDatumGetCString(boundDatum));
+
+	ReleaseSysCache(tuple);
+
+	/* the constraint only depends on the parent, which we pass for the partition */
+	return get_qual_from_partbound(parentRelation, parentRelation, boundSpec);
+}
+
+
+/*
+ * CanReplaceWithPartition locks the given partition and checks whether a query
+ * on the partition is equivalent to the query on its parent, given that only
+ * the partition can contain matching rows. That requires the partition to have
+ * the same columns at the same positions, since the Vars in the query reference
+ * the columns of the parent, and the user to have the same privileges on the
+ * partition.
+ */
+static bool
+CanReplaceWithPartition(RangeTblEntry *rangeTableEntry, Oid partitionId,
+						LOCKMODE lockMode)
+{
+	Oid userId = rangeTableEntry->checkAsUser != InvalidOid ?
+				 rangeTableEntry->checkAsUser : GetUserId();
+	AclMode requiredPerms = rangeTableEntry->requiredPerms;
+	bool canReplace = true;
+
+	if (!IsCitusTable(partitionId))
+	{
+		return false;
+	}
+
+	if (pg_class_aclmask(partitionId, userId, requiredPerms, ACLMASK_ALL) !=
+		requiredPerms)
+	{
+		return false;
+	}
+
+	/* lock the partition as the planner would when expanding the parent */
+	LockRelationOid(partitionId, lockMode);
+
+	Relation parentRelation = relation_open(rangeTableEntry->relid, NoLock);
+	Relation partitionRelation = relation_open(partitionId, NoLock);
+	TupleDesc parentDescriptor = RelationGetDescr(parentRelation);
+	TupleDesc partitionDescriptor = RelationGetDescr(partitionRelation);
+
+	if (parentRelation->rd_rel->relrowsecurity ||
+		partitionRelation->rd_rel->relrowsecurity ||
+		parentDescriptor->natts != partitionDescriptor->natts)
+	{
+		canReplace = false;
+	}
+
+	for (int attributeIndex = 0;
+		 canReplace && attributeIndex < parentDescriptor->natts;
+		 attributeIndex++)
+	{
+		Form_pg_attribute parentAttribute =
+			TupleDescAttr(parentDescriptor, attributeIndex);
+		Form_pg_attribute partitionAttribute =
+			TupleDescAttr(partitionDescriptor, attributeIndex);
+
+		if (parentAttribute->attisdropped != partitionAttribute->attisdropped)
+		{
+			canReplace = false;
+		}
+		else if (!parentAttribute->attisdropped &&
+				 (parentAttribute->atttypid != partitionAttribute->atttypid ||
+				  parentAttribute->atttypmod != partitionAttribute->atttypmod ||
+				  parentAttribute->attcollation != partitionAttribute->attcollation ||
+				  strcmp(NameStr(parentAttribute->attname),
+						 NameStr(partitionAttribute->attname)) != 0))
+		{
+			canReplace = false;
+		}
+	}
+
+	relation_close(partitionRelation, NoLock);
+	relation_close(parentRelation, NoLock);
+
+	return canReplace;
+}
@@ -0,0 +1,553 @@
+/*-------------------------------------------------------------------------
+ *
+ * planning_stats.c
+ *   Keeps track of the time distributed_planner spends in each of its
+ *   phases. The per-phase times of a query are attached to its distributed
+ *   plan, such that EXPLAIN can show them, and are accumulated per query
+ *   in shared memory, such that expensive planning paths can be found
+ *   across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "catalog/pg_authid.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/planning_stats.h"
+#include "distributed/query_stats.h"
+#include "distributed/tuplestore.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/hsearch.h"
+
+
+/* queryid, userid, dbid, calls and total_time precede the per-phase times */
+#define PLANNING_STATS_FIXED_COLUMNS 5
+#define PLANNING_STATS_COLUMNS (PLANNING_STATS_FIXED_COLUMNS + PLANNING_PHASE_COUNT)
+
+
+/*
+ * The data structure used to store data in shared memory. Similar to the
+ * shared connection stats, it only holds the lock, the statistics are kept
+ * in a separately allocated hash.
+ */
+typedef struct PlanningStatsSharedData
+{
+	int planningStatsHashTrancheId;
+	char *planningStatsHashTrancheName;
+
+	LWLock planningStatsHashLock;
+} PlanningStatsSharedData;
+
+typedef struct PlanningStatsHashKey
+{
+	Oid userId;
+	Oid databaseId;
+	uint64 queryId;
+} PlanningStatsHashKey;
+
+/* hash entry for the planning statistics of a single query */
+typedef struct PlanningStatsHashEntry
+{
+	PlanningStatsHashKey key;
+
+	/* number of times the query was planned by a top-level planner call */
+	int64 calls;
+
+	/* total and per-phase planning time, in milliseconds */
+	double totalTime;
+	double phaseTimes[PLANNING_PHASE_COUNT];
+} PlanningStatsHashEntry;
+
+
+/* GUC, whether to accumulate planning times in shared memory */
+bool TrackPlanningStats = false;
+
+/* GUC, whether EXPLAIN shows the time spent in each planning phase */
+bool ExplainPlanningPhases = false;
+
+/* GUC, maximum number of queries tracked in shared memory */
+int PlanningStatsMax = 1000;
+
+
+/* the following two structs are used for accessing shared memory */
+static HTAB *PlanningStatsHash = NULL;
+static PlanningStatsSharedData *PlanningStatsSharedState = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* state of the phase tracking of the ongoing top-level planner call */
+static bool PlanningPhaseTrackingActive = false;
+static PlanningPhase ActivePlanningPhase = PLANNING_PHASE_OTHER;
+static instr_time ActivePlanningPhaseStartTime;
+static double PlanningPhaseTimes[PLANNING_PHASE_COUNT];
+
+
+/* local function declarations */
+static void ChargeActivePlanningPhase(void);
+static void RecordPlanningStats(uint64 queryId, double totalTime);
+static void StorePlanningStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor);
+static void PlanningStatsShmemInit(void);
+static size_t PlanningStatsShmemSize(void);
+
+
+PG_FUNCTION_INFO_V1(citus_planning_stats);
+PG_FUNCTION_INFO_V1(citus_planning_stats_reset);
+
+
+/*
+ * citus_planning_stats returns the cumulative per-phase planning times of
+ * the queries that were planned on this node.
+ */
+Datum
+citus_planning_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StorePlanningStats(tupleStore, tupleDescriptor);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_planning_stats_reset removes all the planning statistics that were
+ * collected so far.
+ */
+Datum
+citus_planning_stats_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	PlanningStatsHashEntry *statsEntry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (PlanningStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&PlanningStatsSharedState->planningStatsHashLock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, PlanningStatsHash);
+	while ((statsEntry = (PlanningStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		hash_search(PlanningStatsHash, &statsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&PlanningStatsSharedState->planningStatsHashLock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StorePlanningStats inserts the planning statistics into the given
+ * tuplestore. Like pg_stat_statements, only the statistics of the current
+ * user are shown, unless the user is allowed to read all statistics.
+ */
+static void
+StorePlanningStats(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	Datum values[PLANNING_STATS_COLUMNS];
+	bool isNulls[PLANNING_STATS_COLUMNS];
+	Oid userId = GetUserId();
+	bool canReadAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	if (PlanningStatsHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&PlanningStatsSharedState->planningStatsHashLock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	PlanningStatsHashEntry *statsEntry = NULL;
+
+	hash_seq_init(&status, PlanningStatsHash);
+	while ((statsEntry = (PlanningStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (!canReadAllStats && statsEntry->key.userId != userId)
+		{
+			continue;
+		}
+
+		/* get ready for the next tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum((int64) statsEntry->key.queryId);
+		values[1] = ObjectIdGetDatum(statsEntry->key.userId);
+		values[2] = ObjectIdGetDatum(statsEntry->key.databaseId);
+		values[3] = Int64GetDatum(statsEntry->calls);
+		values[4] = Float8GetDatum(statsEntry->totalTime);
+
+		for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+		{
+			values[PLANNING_STATS_FIXED_COLUMNS + phase] =
+				Float8GetDatum(statsEntry->phaseTimes[phase]);
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&PlanningStatsSharedState->planningStatsHashLock);
+}
+
+
+/*
+ * StartPlanningPhaseTracking starts timing the phases of a top-level
+ * planner call, if any of the GUCs that consume the timings is enabled.
+ * Any state left behind by an earlier planner call that errored out is
+ * discarded.
+ */
+void
+StartPlanningPhaseTracking(void)
+{
+	PlanningPhaseTrackingActive = TrackPlanningStats || ExplainPlanningPhases ||
+								  CitusQueryStatsEnabled();
+	if (!PlanningPhaseTrackingActive)
+	{
+		return;
+	}
+
+	memset(PlanningPhaseTimes, 0, sizeof(PlanningPhaseTimes));
+	ActivePlanningPhase = PLANNING_PHASE_OTHER;
+	INSTR_TIME_SET_CURRENT(ActivePlanningPhaseStartTime);
+}
+
+
+/*
+ * FinishPlanningPhaseTracking stops timing the phases of the top-level
+ * planner call that produced the given plan. If the plan is a distributed
+ * plan, the per-phase times are attached to it for EXPLAIN and added to
+ * the planning statistics and citus_stat_statements of the query.
+ */
+void
+FinishPlanningPhaseTracking(PlannedStmt *plan, uint64 queryId)
+{
+	if (!PlanningPhaseTrackingActive)
+	{
+		return;
+	}
+
+	ChargeActivePlanningPhase();
+	PlanningPhaseTrackingActive = false;
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	if (customScan == NULL)
+	{
+		/* we only track queries that went through distributed planning */
+		return;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	double totalTime = 0.0;
+
+	for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+	{
+		distributedPlan->planningPhaseTimes[phase] = PlanningPhaseTimes[phase];
+		totalTime += PlanningPhaseTimes[phase];
+	}
+
+	distributedPlan->hasPlanningPhaseTimes = true;
+
+	if (TrackPlanningStats)
+	{
+		RecordPlanningStats(queryId, totalTime);
+	}
+
+	CitusQueryStatsPlanningEntry(queryId, CitusCustomScanExecutorType(customScan),
+								 distributedPlan->workerJob, totalTime);
+}
+
+
+/*
+ * BeginPlanningPhase charges the time elapsed so far to the active planning
+ * phase and makes the given phase the active one. The previously active
+ * phase is returned, and should be passed to EndPlanningPhase.
+ */
+PlanningPhase
+BeginPlanningPhase(PlanningPhase phase)
+{
+	PlanningPhase previousPhase = ActivePlanningPhase;
+
+	if (!PlanningPhaseTrackingActive)
+	{
+		return previousPhase;
+	}
+
+	ChargeActivePlanningPhase();
+	ActivePlanningPhase = phase;
+
+	return previousPhase;
+}
+
+
+/*
+ * EndPlanningPhase charges the time elapsed so far to the active planning
+ * phase and reactivates the given phase, typically the one returned by
+ * BeginPlanningPhase.
+ */
+void
+EndPlanningPhase(PlanningPhase previousPhase)
+{
+	if (!PlanningPhaseTrackingActive)
+	{
+		return;
+	}
+
+	ChargeActivePlanningPhase();
+	ActivePlanningPhase = previousPhase;
+}
+
+
+/*
+ * CurrentPlanningPhase returns the active planning phase, such that callers
+ * that catch errors thrown during planning can restore it.
+ */
+PlanningPhase
+CurrentPlanningPhase(void)
+{
+	return ActivePlanningPhase;
+}
+
+
+/*
+ * PlanningPhaseName returns the name under which the given phase is shown
+ * in EXPLAIN.
+ */
+const char *
+PlanningPhaseName(PlanningPhase phase)
+{
+	switch (phase)
+	{
+		case PLANNING_PHASE_OTHER:
+		{
+			return "Other";
+		}
+
+		case PLANNING_PHASE_STANDARD_PLANNER:
+		{
+			return "Standard Planner";
+		}
+
+		case PLANNING_PHASE_FAST_PATH:
+		{
+			return "Fast Path Planner";
+		}
+
+		case PLANNING_PHASE_ROUTER:
+		{
+			return "Router Planner";
+		}
+
+		case PLANNING_PHASE_RECURSIVE_PLANNING:
+		{
+			return "Recursive Planning";
+		}
+
+		case PLANNING_PHASE_RESTRICTION_EQUIVALENCE:
+		{
+			return "Restriction Equivalence";
+		}
+
+		case PLANNING_PHASE_LOGICAL_PLANNING:
+		{
+			return "Logical Planner";
+		}
+
+		case PLANNING_PHASE_PHYSICAL_PLANNING:
+		{
+			return "Physical Planner";
+		}
+
+		default:
+		{
+			return "Unknown";
+		}
+	}
+}
+
+
+/*
+ * ChargeActivePlanningPhase adds the time elapsed since the active phase
+ * was last charged to that phase.
+ */
+static void
+ChargeActivePlanningPhase(void)
+{
+	instr_time now;
+
+	INSTR_TIME_SET_CURRENT(now);
+
+	instr_time elapsed = now;
+	INSTR_TIME_SUBTRACT(elapsed, ActivePlanningPhaseStartTime);
+
+	PlanningPhaseTimes[ActivePlanningPhase] += INSTR_TIME_GET_MILLISEC(elapsed);
+	ActivePlanningPhaseStartTime = now;
+}
+
+
+/*
+ * RecordPlanningStats adds the per-phase times of the current planner call
+ * to the statistics of the given query. Once citus.planning_stats_max
+ * queries are tracked, queries that are not tracked yet are skipped until
+ * the statistics are reset.
+ */
+static void
+RecordPlanningStats(uint64 queryId, double totalTime)
+{
+	PlanningStatsHashKey key;
+	bool found = false;
+
+	if (PlanningStatsHash == NULL)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.userId = GetUserId();
+	key.databaseId = MyDatabaseId;
+	key.queryId = queryId;
+
+	LWLockAcquire(&PlanningStatsSharedState->planningStatsHashLock, LW_EXCLUSIVE);
+
+	PlanningStatsHashEntry *statsEntry =
+		(PlanningStatsHashEntry *) hash_search(PlanningStatsHash, &key, HASH_FIND,
+											   &found);
+	if (!found && hash_get_num_entries(PlanningStatsHash) < PlanningStatsMax)
+	{
+		statsEntry = (PlanningStatsHashEntry *) hash_search(PlanningStatsHash, &key,
+															HASH_ENTER_NULL, &found);
+		if (statsEntry != NULL)
+		{
+			statsEntry->calls = 0;
+			statsEntry->totalTime = 0.0;
+			memset(statsEntry->phaseTimes, 0, sizeof(statsEntry->phaseTimes));
+		}
+	}
+
+	if (statsEntry != NULL)
+	{
+		statsEntry->calls++;
+		statsEntry->totalTime += totalTime;
+
+		for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+		{
+			statsEntry->phaseTimes[phase] += PlanningPhaseTimes[phase];
+		}
+	}
+
+	LWLockRelease(&PlanningStatsSharedState->planningStatsHashLock);
+}
+
+
+/*
+ * InitializePlanningStats requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializePlanningStats(void)
+{
+	if (PlanningStatsMax == 0)
+	{
+		/* statistics are disabled, citus.track_planning_stats is a no-op */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(PlanningStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = PlanningStatsShmemInit;
+}
+
+
+/*
+ * PlanningStatsShmemSize returns the size that should be allocated on the
+ * shared memory for the planning statistics.
+ */
+static size_t
+PlanningStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(PlanningStatsSharedData));
+
+	Size hashSize = hash_estimate_size(PlanningStatsMax, sizeof(PlanningStatsHashEntry));
+
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * PlanningStatsShmemInit initializes the shared memory used for keeping
+ * track of planning statistics across backends.
+ */
+static void
+PlanningStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	/* create (userid, dbid, queryid) -> [planning times] */
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(PlanningStatsHashKey);
+	info.entrysize = sizeof(PlanningStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	PlanningStatsSharedState =
+		(PlanningStatsSharedData *) ShmemInitStruct("Planning Stats Data",
+													sizeof(PlanningStatsSharedData),
+													&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		PlanningStatsSharedState->planningStatsHashTrancheId = LWLockNewTrancheId();
+		PlanningStatsSharedState->planningStatsHashTrancheName =
+			"Planning Stats Hash Tranche";
+		LWLockRegisterTranche(PlanningStatsSharedState->planningStatsHashTrancheId,
+							  PlanningStatsSharedState->planningStatsHashTrancheName);
+
+		LWLockInitialize(&PlanningStatsSharedState->planningStatsHashLock,
+						 PlanningStatsSharedState->planningStatsHashTrancheId);
+	}
+
+	/* allocate hash table */
+	PlanningStatsHash = ShmemInitHash("Planning Stats Hash", PlanningStatsMax,
+									  PlanningStatsMax, &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(PlanningStatsHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
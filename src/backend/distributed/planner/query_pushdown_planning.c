@@ -46,6 +46,7 @@
 #include "nodes/pg_list.h"
 #include "optimizer/clauses.h"
 #include "parser/parsetree.h"
+#include "utils/hsearch.h"
 
 
 /*
@@ -64,6 +65,40 @@ typedef enum RecurringTuplesType
 } RecurringTuplesType;
 
 
+/*
+ * QueryRecurrenceEntry caches properties of a query that the pushdown checks
+ * ask for repeatedly. Each check of a query also walks the queries nested in
+ * it, so without caching, deeply nested queries are walked once per level of
+ * nesting and once per join.
+ *
+ * Entries only live for the duration of a single pushdown check, since
+ * recursive planning rewrites queries in place between checks.
+ */
+typedef struct QueryRecurrenceEntry
+{
+	Query *query;
+
+	/* result of HasRecurringTuples for the query */
+	bool recurringTuplesChecked;
+	bool hasRecurringTuples;
+	RecurringTuplesType recurType;
+
+	/* whether there is a distributed table anywhere in the query */
+	bool distributedTableChecked;
+	bool containsDistributedTable;
+} QueryRecurrenceEntry;
+
+
+/*
+ * RecurringTuplesContext is the walker context of HasRecurringTuples.
+ */
+typedef struct RecurringTuplesContext
+{
+	RecurringTuplesType recurType;
+	HTAB *recurrenceCache;
+} RecurringTuplesContext;
+
+
 /* Config variable managed via guc.c */
 bool SubqueryPushdown = false; /* is subquery pushdown enabled */
 
@@ -73,20 +108,35 @@ static bool JoinTreeContainsSubqueryWalker(Node *joinTreeNode, void *context);
 static bool IsFunctionRTE(Node *node);
 static bool IsOuterJoinExpr(Node *node);
 static bool WindowPartitionOnDistributionColumn(Query *query);
-static DeferredErrorMessage * DeferErrorIfFromClauseRecurs(Query *queryTree);
-static RecurringTuplesType FromClauseRecurringTupleType(Query *queryTree);
+static DeferredErrorMessage * DeferErrorIfCannotPushdownSubqueryInternal(
+	Query *subqueryTree, bool outerMostQueryHasLimit, HTAB *recurrenceCache);
+static DeferredErrorMessage * DeferErrorIfUnsupportedUnionQueryInternal(
+	Query *subqueryTree, HTAB *recurrenceCache);
+static DeferredErrorMessage * DeferErrorIfFromClauseRecurs(Query *queryTree,
+														   HTAB *recurrenceCache);
+static RecurringTuplesType FromClauseRecurringTupleType(Query *queryTree,
+														HTAB *recurrenceCache);
 static DeferredErrorMessage * DeferredErrorIfUnsupportedRecurringTuplesJoin(
-	PlannerRestrictionContext *plannerRestrictionContext);
+	PlannerRestrictionContext *plannerRestrictionContext, HTAB *recurrenceCache);
 static DeferredErrorMessage * DeferErrorIfUnsupportedTableCombination(Query *queryTree);
 static bool ExtractSetOperationStatmentWalker(Node *node, List **setOperationList);
 static bool ShouldRecurseForRecurringTuplesJoinChecks(RelOptInfo *relOptInfo);
 static bool RelationInfoContainsRecurringTuples(PlannerInfo *plannerInfo,
 												RelOptInfo *relationInfo,
-												RecurringTuplesType *recurType);
+												RecurringTuplesType *recurType,
+												HTAB *recurrenceCache);
 static bool ContainsRecurringRTE(RangeTblEntry *rangeTableEntry,
-								 RecurringTuplesType *recurType);
-static bool ContainsRecurringRangeTable(List *rangeTable, RecurringTuplesType *recurType);
-static bool HasRecurringTuples(Node *node, RecurringTuplesType *recurType);
+								 RecurringTuplesType *recurType,
+								 HTAB *recurrenceCache);
+static bool ContainsRecurringRangeTable(List *rangeTable, RecurringTuplesType *recurType,
+										HTAB *recurrenceCache);
+static bool HasRecurringTuples(Node *node, RecurringTuplesContext *context);
+static HTAB * CreateQueryRecurrenceCache(void);
+static QueryRecurrenceEntry * LookupQueryRecurrenceEntry(HTAB *recurrenceCache,
+														 Query *query);
+static bool RangeTableContainsDistributedTable(List *rangeTable,
+											   HTAB *recurrenceCache);
+static bool ContainsDistributedTableWalker(Node *node, HTAB *recurrenceCache);
 static MultiNode * SubqueryPushdownMultiNodeTree(Query *queryTree);
 static List * FlattenJoinVars(List *columnList, Query *queryTree);
 static Node * FlattenJoinVarsMutator(Node *node, Query *queryTree);
@@ -98,7 +148,8 @@ static void UpdateColumnToMatchingTargetEntry(Var *column, Node *flattenedExpr,
 static MultiTable * MultiSubqueryPushdownTable(Query *subquery);
 static List * CreateSubqueryTargetEntryList(List *columnList);
 static bool RelationInfoContainsOnlyRecurringTuples(PlannerInfo *plannerInfo,
-													RelOptInfo *relationInfo);
+													RelOptInfo *relationInfo,
+													HTAB *recurrenceCache);
 
 /*
  * ShouldUseSubqueryPushDown determines whether it's desirable to use
@@ -575,6 +626,9 @@ DeferErrorIfUnsupportedSubqueryPushdown(Query *originalQuery,
 	ListCell *subqueryCell = NULL;
 	List *subqueryList = NIL;
 
+	/* each query is only walked once for all the checks below */
+	HTAB *recurrenceCache = CreateQueryRecurrenceCache();
+
 	if (originalQuery->limitCount != NULL)
 	{
 		outerMostQueryHasLimit = true;
@@ -609,14 +663,16 @@ DeferErrorIfUnsupportedSubqueryPushdown(Query *originalQuery,
 	}
 
 	/* we shouldn't allow reference tables in the FROM clause when the query has sublinks */
-	DeferredErrorMessage *error = DeferErrorIfFromClauseRecurs(originalQuery);
+	DeferredErrorMessage *error = DeferErrorIfFromClauseRecurs(originalQuery,
+															   recurrenceCache);
 	if (error)
 	{
 		return error;
 	}
 
 	/* we shouldn't allow reference tables in the outer part of outer joins */
-	error = DeferredErrorIfUnsupportedRecurringTuplesJoin(plannerRestrictionContext);
+	error = DeferredErrorIfUnsupportedRecurringTuplesJoin(plannerRestrictionContext,
+														  recurrenceCache);
 	if (error)
 	{
 		return error;
@@ -635,8 +691,9 @@ DeferErrorIfUnsupportedSubqueryPushdown(Query *originalQuery,
 	foreach(subqueryCell, subqueryList)
 	{
 		Query *subquery = lfirst(subqueryCell);
-		error = DeferErrorIfCannotPushdownSubquery(subquery,
-												   outerMostQueryHasLimit);
+		error = DeferErrorIfCannotPushdownSubqueryInternal(subquery,
+														   outerMostQueryHasLimit,
+														   recurrenceCache);
 		if (error)
 		{
 			return error;
@@ -663,14 +720,15 @@ DeferErrorIfUnsupportedSubqueryPushdown(Query *originalQuery,
  * Otherwise, the result would include duplicate rows.
  */
 static DeferredErrorMessage *
-DeferErrorIfFromClauseRecurs(Query *queryTree)
+DeferErrorIfFromClauseRecurs(Query *queryTree, HTAB *recurrenceCache)
 {
 	if (!queryTree->hasSubLinks)
 	{
 		return NULL;
 	}
 
-	RecurringTuplesType recurType = FromClauseRecurringTupleType(queryTree);
+	RecurringTuplesType recurType = FromClauseRecurringTupleType(queryTree,
+																 recurrenceCache);
 	if (recurType == RECURRING_TUPLES_REFERENCE_TABLE)
 	{
 		return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
@@ -727,7 +785,7 @@ DeferErrorIfFromClauseRecurs(Query *queryTree)
  * message for subquery pushdown checks.
  */
 static RecurringTuplesType
-FromClauseRecurringTupleType(Query *queryTree)
+FromClauseRecurringTupleType(Query *queryTree, HTAB *recurrenceCache)
 {
 	RecurringTuplesType recurType = RECURRING_TUPLES_INVALID;
 
@@ -736,7 +794,7 @@ FromClauseRecurringTupleType(Query *queryTree)
 		return RECURRING_TUPLES_EMPTY_JOIN_TREE;
 	}
 
-	if (FindNodeCheckInRangeTableList(queryTree->rtable, IsDistributedTableRTE))
+	if (RangeTableContainsDistributedTable(queryTree->rtable, recurrenceCache))
 	{
 		/*
 		 * There is a distributed table somewhere in the FROM clause.
@@ -757,7 +815,7 @@ FromClauseRecurringTupleType(Query *queryTree)
 	 * Try to figure out which type of recurring tuples we have to produce a
 	 * relevant error message. If there are several we'll pick the first one.
 	 */
-	ContainsRecurringRangeTable(queryTree->rtable, &recurType);
+	ContainsRecurringRangeTable(queryTree->rtable, &recurType, recurrenceCache);
 
 	return recurType;
 }
@@ -781,7 +839,7 @@ FromClauseRecurringTupleType(Query *queryTree)
  */
 static DeferredErrorMessage *
 DeferredErrorIfUnsupportedRecurringTuplesJoin(
-	PlannerRestrictionContext *plannerRestrictionContext)
+	PlannerRestrictionContext *plannerRestrictionContext, HTAB *recurrenceCache)
 {
 	List *joinRestrictionList =
 		plannerRestrictionContext->joinRestrictionContext->joinRestrictionList;
@@ -805,13 +863,15 @@ DeferredErrorIfUnsupportedRecurringTuplesJoin(
 			 * recurring or not. Otherwise, we check the outer side for recurring
 			 * tuples.
 			 */
-			if (RelationInfoContainsOnlyRecurringTuples(plannerInfo, innerrel))
+			if (RelationInfoContainsOnlyRecurringTuples(plannerInfo, innerrel,
+														recurrenceCache))
 			{
 				continue;
 			}
 
 			if (ShouldRecurseForRecurringTuplesJoinChecks(outerrel) &&
-				RelationInfoContainsRecurringTuples(plannerInfo, outerrel, &recurType))
+				RelationInfoContainsRecurringTuples(plannerInfo, outerrel, &recurType,
+													recurrenceCache))
 			{
 				break;
 			}
@@ -820,9 +880,10 @@ DeferredErrorIfUnsupportedRecurringTuplesJoin(
 		{
 			if ((ShouldRecurseForRecurringTuplesJoinChecks(innerrel) &&
 				 RelationInfoContainsRecurringTuples(plannerInfo, innerrel,
-													 &recurType)) ||
+													 &recurType, recurrenceCache)) ||
 				(ShouldRecurseForRecurringTuplesJoinChecks(outerrel) &&
-				 RelationInfoContainsRecurringTuples(plannerInfo, outerrel, &recurType)))
+				 RelationInfoContainsRecurringTuples(plannerInfo, outerrel,
+													 &recurType, recurrenceCache)))
 			{
 				break;
 			}
@@ -885,6 +946,27 @@ DeferredErrorIfUnsupportedRecurringTuplesJoin(
  */
 DeferredErrorMessage *
 DeferErrorIfCannotPushdownSubquery(Query *subqueryTree, bool outerMostQueryHasLimit)
+{
+	HTAB *recurrenceCache = CreateQueryRecurrenceCache();
+
+	DeferredErrorMessage *deferredError =
+		DeferErrorIfCannotPushdownSubqueryInternal(subqueryTree, outerMostQueryHasLimit,
+												   recurrenceCache);
+
+	hash_destroy(recurrenceCache);
+
+	return deferredError;
+}
+
+
+/*
+ * DeferErrorIfCannotPushdownSubqueryInternal implements
+ * DeferErrorIfCannotPushdownSubquery using the given cache of query properties.
+ */
+static DeferredErrorMessage *
+DeferErrorIfCannotPushdownSubqueryInternal(Query *subqueryTree,
+										   bool outerMostQueryHasLimit,
+										   HTAB *recurrenceCache)
 {
 	bool preconditionsSatisfied = true;
 	char *errorDetail = NULL;
@@ -933,7 +1015,8 @@ DeferErrorIfCannotPushdownSubquery(Query *subqueryTree, bool outerMostQueryHasLi
 
 	if (subqueryTree->setOperations)
 	{
-		deferredError = DeferErrorIfUnsupportedUnionQuery(subqueryTree);
+		deferredError = DeferErrorIfUnsupportedUnionQueryInternal(subqueryTree,
+																  recurrenceCache);
 		if (deferredError)
 		{
 			return deferredError;
@@ -1029,7 +1112,7 @@ DeferErrorIfCannotPushdownSubquery(Query *subqueryTree, bool outerMostQueryHasLi
 		}
 	}
 
-	deferredError = DeferErrorIfFromClauseRecurs(subqueryTree);
+	deferredError = DeferErrorIfFromClauseRecurs(subqueryTree, recurrenceCache);
 	if (deferredError)
 	{
 		preconditionsSatisfied = false;
@@ -1159,6 +1242,24 @@ DeferErrorIfUnsupportedTableCombination(Query *queryTree)
  */
 DeferredErrorMessage *
 DeferErrorIfUnsupportedUnionQuery(Query *subqueryTree)
+{
+	HTAB *recurrenceCache = CreateQueryRecurrenceCache();
+
+	DeferredErrorMessage *deferredError =
+		DeferErrorIfUnsupportedUnionQueryInternal(subqueryTree, recurrenceCache);
+
+	hash_destroy(recurrenceCache);
+
+	return deferredError;
+}
+
+
+/*
+ * DeferErrorIfUnsupportedUnionQueryInternal implements
+ * DeferErrorIfUnsupportedUnionQuery using the given cache of query properties.
+ */
+static DeferredErrorMessage *
+DeferErrorIfUnsupportedUnionQueryInternal(Query *subqueryTree, HTAB *recurrenceCache)
 {
 	List *setOperationStatementList = NIL;
 	ListCell *setOperationStatmentCell = NULL;
@@ -1186,7 +1287,7 @@ DeferErrorIfUnsupportedUnionQuery(Query *subqueryTree)
 		{
 			leftArgRTI = ((RangeTblRef *) leftArg)->rtindex;
 			Query *leftArgSubquery = rt_fetch(leftArgRTI, subqueryTree->rtable)->subquery;
-			recurType = FromClauseRecurringTupleType(leftArgSubquery);
+			recurType = FromClauseRecurringTupleType(leftArgSubquery, recurrenceCache);
 			if (recurType != RECURRING_TUPLES_INVALID)
 			{
 				break;
@@ -1198,7 +1299,8 @@ DeferErrorIfUnsupportedUnionQuery(Query *subqueryTree)
 			rightArgRTI = ((RangeTblRef *) rightArg)->rtindex;
 			Query *rightArgSubquery = rt_fetch(rightArgRTI,
 											   subqueryTree->rtable)->subquery;
-			recurType = FromClauseRecurringTupleType(rightArgSubquery);
+			recurType = FromClauseRecurringTupleType(rightArgSubquery,
+													 recurrenceCache);
 			if (recurType != RECURRING_TUPLES_INVALID)
 			{
 				break;
@@ -1340,7 +1442,8 @@ ShouldRecurseForRecurringTuplesJoinChecks(RelOptInfo *relOptInfo)
  */
 static bool
 RelationInfoContainsOnlyRecurringTuples(PlannerInfo *plannerInfo,
-										RelOptInfo *relationInfo)
+										RelOptInfo *relationInfo,
+										HTAB *recurrenceCache)
 {
 	Relids relids = bms_copy(relationInfo->relids);
 	int relationId = -1;
@@ -1349,8 +1452,8 @@ RelationInfoContainsOnlyRecurringTuples(PlannerInfo *plannerInfo,
 	{
 		RangeTblEntry *rangeTableEntry = plannerInfo->simple_rte_array[relationId];
 
-		if (FindNodeCheckInRangeTableList(list_make1(rangeTableEntry),
-										  IsDistributedTableRTE))
+		if (RangeTableContainsDistributedTable(list_make1(rangeTableEntry),
+											   recurrenceCache))
 		{
 			/* we already found a distributed table, no need to check further */
 			return false;
@@ -1360,8 +1463,8 @@ RelationInfoContainsOnlyRecurringTuples(PlannerInfo *plannerInfo,
 		 * If there are no distributed tables, there should be at least
 		 * one recurring rte.
 		 */
-		RecurringTuplesType recurType PG_USED_FOR_ASSERTS_ONLY;
-		Assert(ContainsRecurringRTE(rangeTableEntry, &recurType));
+		RecurringTuplesType recurType PG_USED_FOR_ASSERTS_ONLY = RECURRING_TUPLES_INVALID;
+		Assert(ContainsRecurringRTE(rangeTableEntry, &recurType, recurrenceCache));
 	}
 
 	return true;
@@ -1379,7 +1482,8 @@ RelationInfoContainsOnlyRecurringTuples(PlannerInfo *plannerInfo,
  */
 static bool
 RelationInfoContainsRecurringTuples(PlannerInfo *plannerInfo, RelOptInfo *relationInfo,
-									RecurringTuplesType *recurType)
+									RecurringTuplesType *recurType,
+									HTAB *recurrenceCache)
 {
 	Relids relids = bms_copy(relationInfo->relids);
 	int relationId = -1;
@@ -1389,7 +1493,7 @@ RelationInfoContainsRecurringTuples(PlannerInfo *plannerInfo, RelOptInfo *relati
 		RangeTblEntry *rangeTableEntry = plannerInfo->simple_rte_array[relationId];
 
 		/* relationInfo has this range table entry */
-		if (ContainsRecurringRTE(rangeTableEntry, recurType))
+		if (ContainsRecurringRTE(rangeTableEntry, recurType, recurrenceCache))
 		{
 			return true;
 		}
@@ -1405,9 +1509,11 @@ RelationInfoContainsRecurringTuples(PlannerInfo *plannerInfo, RelOptInfo *relati
  * a query on different shards.
  */
 static bool
-ContainsRecurringRTE(RangeTblEntry *rangeTableEntry, RecurringTuplesType *recurType)
+ContainsRecurringRTE(RangeTblEntry *rangeTableEntry, RecurringTuplesType *recurType,
+					 HTAB *recurrenceCache)
 {
-	return ContainsRecurringRangeTable(list_make1(rangeTableEntry), recurType);
+	return ContainsRecurringRangeTable(list_make1(rangeTableEntry), recurType,
+									   recurrenceCache);
 }
 
 
@@ -1417,10 +1523,20 @@ ContainsRecurringRTE(RangeTblEntry *rangeTableEntry, RecurringTuplesType *recurT
  * a query on different shards.
  */
 static bool
-ContainsRecurringRangeTable(List *rangeTable, RecurringTuplesType *recurType)
+ContainsRecurringRangeTable(List *rangeTable, RecurringTuplesType *recurType,
+							HTAB *recurrenceCache)
 {
-	return range_table_walker(rangeTable, HasRecurringTuples, recurType,
-							  QTW_EXAMINE_RTES_BEFORE);
+	RecurringTuplesContext context = { 0 };
+	context.recurType = *recurType;
+	context.recurrenceCache = recurrenceCache;
+
+	bool containsRecurringTuples = range_table_walker(rangeTable, HasRecurringTuples,
+													  &context,
+													  QTW_EXAMINE_RTES_BEFORE);
+
+	*recurType = context.recurType;
+
+	return containsRecurringTuples;
 }
 
 
@@ -1430,7 +1546,7 @@ ContainsRecurringRangeTable(List *rangeTable, RecurringTuplesType *recurType)
  * query.
  */
 static bool
-HasRecurringTuples(Node *node, RecurringTuplesType *recurType)
+HasRecurringTuples(Node *node, RecurringTuplesContext *context)
 {
 	if (node == NULL)
 	{
@@ -1447,7 +1563,7 @@ HasRecurringTuples(Node *node, RecurringTuplesType *recurType)
 			if (IsCitusTable(relationId) &&
 				PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
 			{
-				*recurType = RECURRING_TUPLES_REFERENCE_TABLE;
+				context->recurType = RECURRING_TUPLES_REFERENCE_TABLE;
 
 				/*
 				 * Tuples from reference tables will recur in every query on shards
@@ -1463,11 +1579,11 @@ HasRecurringTuples(Node *node, RecurringTuplesType *recurType)
 			if (list_length(functionList) == 1 &&
 				ContainsReadIntermediateResultFunction((Node *) functionList))
 			{
-				*recurType = RECURRING_TUPLES_RESULT_FUNCTION;
+				context->recurType = RECURRING_TUPLES_RESULT_FUNCTION;
 			}
 			else
 			{
-				*recurType = RECURRING_TUPLES_FUNCTION;
+				context->recurType = RECURRING_TUPLES_FUNCTION;
 			}
 
 			/*
@@ -1479,7 +1595,7 @@ HasRecurringTuples(Node *node, RecurringTuplesType *recurType)
 #if PG_VERSION_NUM >= PG_VERSION_12
 		else if (rangeTableEntry->rtekind == RTE_RESULT)
 		{
-			*recurType = RECURRING_TUPLES_EMPTY_JOIN_TREE;
+			context->recurType = RECURRING_TUPLES_EMPTY_JOIN_TREE;
 			return true;
 		}
 #endif
@@ -1489,23 +1605,144 @@ HasRecurringTuples(Node *node, RecurringTuplesType *recurType)
 	else if (IsA(node, Query))
 	{
 		Query *query = (Query *) node;
+		QueryRecurrenceEntry *cacheEntry =
+			LookupQueryRecurrenceEntry(context->recurrenceCache, query);
 
-		if (HasEmptyJoinTree(query))
+		if (!cacheEntry->recurringTuplesChecked)
 		{
-			*recurType = RECURRING_TUPLES_EMPTY_JOIN_TREE;
+			RecurringTuplesContext queryContext = { 0 };
+			queryContext.recurType = RECURRING_TUPLES_INVALID;
+			queryContext.recurrenceCache = context->recurrenceCache;
 
-			/*
-			 * Queries with empty join trees will recur in every query on shards
-			 * that includes it.
-			 */
-			return true;
+			if (HasEmptyJoinTree(query))
+			{
+				/*
+				 * Queries with empty join trees will recur in every query on shards
+				 * that includes it.
+				 */
+				cacheEntry->hasRecurringTuples = true;
+				cacheEntry->recurType = RECURRING_TUPLES_EMPTY_JOIN_TREE;
+			}
+			else
+			{
+				cacheEntry->hasRecurringTuples =
+					query_tree_walker(query, HasRecurringTuples, &queryContext,
+									  QTW_EXAMINE_RTES_BEFORE);
+				cacheEntry->recurType = queryContext.recurType;
+			}
+
+			cacheEntry->recurringTuplesChecked = true;
+		}
+
+		if (cacheEntry->hasRecurringTuples)
+		{
+			context->recurType = cacheEntry->recurType;
+		}
+
+		return cacheEntry->hasRecurringTuples;
+	}
+
+	return expression_tree_walker(node, HasRecurringTuples, context);
+}
+
+
+/*
+ * CreateQueryRecurrenceCache creates a hash table for caching properties of
+ * queries during a single pushdown check, see QueryRecurrenceEntry.
+ */
+static HTAB *
+CreateQueryRecurrenceCache(void)
+{
+	HASHCTL info = { 0 };
+
+	info.keysize = sizeof(Query *);
+	info.entrysize = sizeof(QueryRecurrenceEntry);
+	info.hcxt = CurrentMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	return hash_create("Query Recurrence Cache", 32, &info, hashFlags);
+}
+
+
+/*
+ * LookupQueryRecurrenceEntry returns the cache entry of the given query, and
+ * creates one in which no properties are computed yet if there is none.
+ */
+static QueryRecurrenceEntry *
+LookupQueryRecurrenceEntry(HTAB *recurrenceCache, Query *query)
+{
+	bool found = false;
+
+	QueryRecurrenceEntry *cacheEntry = hash_search(recurrenceCache, &query,
+												   HASH_ENTER, &found);
+	if (!found)
+	{
+		cacheEntry->recurringTuplesChecked = false;
+		cacheEntry->hasRecurringTuples = false;
+		cacheEntry->recurType = RECURRING_TUPLES_INVALID;
+		cacheEntry->distributedTableChecked = false;
+		cacheEntry->containsDistributedTable = false;
+	}
+
+	return cacheEntry;
+}
+
+
+/*
+ * RangeTableContainsDistributedTable returns whether there is a distributed
+ * table anywhere in the given range table. It is equivalent to calling
+ * FindNodeCheckInRangeTableList with IsDistributedTableRTE, but each nested
+ * query is only walked once per cache.
+ */
+static bool
+RangeTableContainsDistributedTable(List *rangeTable, HTAB *recurrenceCache)
+{
+	return range_table_walker(rangeTable, ContainsDistributedTableWalker,
+							  recurrenceCache, QTW_EXAMINE_RTES_BEFORE);
+}
+
+
+/*
+ * ContainsDistributedTableWalker is the walker of
+ * RangeTableContainsDistributedTable.
+ */
+static bool
+ContainsDistributedTableWalker(Node *node, HTAB *recurrenceCache)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsDistributedTableRTE(node))
+	{
+		return true;
+	}
+
+	if (IsA(node, RangeTblEntry))
+	{
+		/* query_tree_walker descends into RTEs */
+		return false;
+	}
+	else if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+		QueryRecurrenceEntry *cacheEntry =
+			LookupQueryRecurrenceEntry(recurrenceCache, query);
+
+		if (!cacheEntry->distributedTableChecked)
+		{
+			cacheEntry->containsDistributedTable =
+				query_tree_walker(query, ContainsDistributedTableWalker,
+								  recurrenceCache, QTW_EXAMINE_RTES_BEFORE);
+			cacheEntry->distributedTableChecked = true;
 		}
 
-		return query_tree_walker((Query *) node, HasRecurringTuples,
-								 recurType, QTW_EXAMINE_RTES_BEFORE);
+		return cacheEntry->containsDistributedTable;
 	}
 
-	return expression_tree_walker(node, HasRecurringTuples, recurType);
+	return expression_tree_walker(node, ContainsDistributedTableWalker,
+								  recurrenceCache);
 }
 
 
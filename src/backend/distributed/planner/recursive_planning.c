@@ -55,6 +55,8 @@
 
 #include "funcapi.h"
 
+#include "access/heapam.h"
+
 #include "catalog/pg_type.h"
 #include "catalog/pg_class.h"
 #include "distributed/citus_nodes.h"
@@ -65,6 +67,7 @@
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_physical_planner.h"
@@ -73,11 +76,14 @@
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/relation_restriction_equivalence.h"
+#include "distributed/subplan_result_cache.h"
 #include "distributed/log_utils.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
+#include "optimizer/clauses.h"
 #include "optimizer/planner.h"
 #include "optimizer/prep.h"
+#include "optimizer/tlist.h"
 #include "parser/parsetree.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
@@ -91,11 +97,19 @@
 #endif
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
 
 
 /* track depth of current recursive planner query */
 static int recursivePlanningDepth = 0;
 
+/* config variables managed via guc.c */
+bool EnableSubPlanRestrictionPushdown = false;
+bool EnableSemiJoinReduction = false;
+int BroadcastJoinThreshold = 0;
+bool EnableLocalTableJoinPushdown = true;
+
 /*
  * RecursivePlanningContext is used to recursively plan subqueries
  * and CTEs, pull results to the coordinator, and push it back into
@@ -171,6 +185,31 @@ static void RecursivelyPlanSetOperations(Query *query, Node *node,
 static bool IsLocalTableRTE(Node *node);
 static void RecursivelyPlanSubquery(Query *subquery,
 									RecursivePlanningContext *planningContext);
+static void PushDownRestrictionsIntoSubquery(Query *subquery,
+											 PlannerRestrictionContext *
+											 plannerRestrictionContext);
+static void InnerJoinedRangeTableIndexes(Node *joinNode, List **rangeTableIndexList);
+static bool SafeToPushDownEquivalentRestrictions(Query *subquery, Index rangeTableIndex,
+												 RangeTblEntry *rangeTableEntry);
+static bool SafeToFilterSubqueryOnColumn(Query *subquery, Index rangeTableIndex,
+										 AttrNumber attributeNumber);
+static bool ShouldRecursivelyPlanLocalTables(Query *query);
+static void RecursivelyPlanLocalTables(Query *query, RecursivePlanningContext *context);
+static bool ShouldBroadcastSmallTables(Query *query, RecursivePlanningContext *context);
+static void RecursivelyPlanSmallTables(Query *query, RecursivePlanningContext *context);
+static Query * BuildRelationSubquery(RangeTblEntry *rangeTableEntry,
+									 PlannerRestrictionContext *
+									 plannerRestrictionContext);
+static void ReplaceRelationWithSubquery(RangeTblEntry *rangeTableEntry,
+										Query *subquery);
+static void AddSemiJoinReductionFilters(Query *query);
+static void InnerJoinQualList(Node *joinNode, List **qualList);
+static bool IsIntermediateResultRte(Query *query, Index rangeTableIndex);
+static void AddSemiJoinReductionFilter(Query *query, Var *filteredColumn,
+									   Var *resultColumn, Oid operatorId,
+									   Oid inputCollationId);
+static bool ColumnInSortGroupClauseList(List *sortGroupClauseList, List *targetList,
+										Index rangeTableIndex, AttrNumber attributeNumber);
 static DistributedSubPlan * CreateDistributedSubPlan(uint32 subPlanId,
 													 Query *subPlanQuery);
 static bool CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context);
@@ -293,6 +332,16 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 	/* descend into subqueries */
 	query_tree_walker(query, RecursivelyPlanSubqueryWalker, context, 0);
 
+	/*
+	 * If the query joins local tables with distributed tables, send the rows
+	 * of the local tables that pass their filters to the workers instead of
+	 * pulling the distributed tables to the coordinator.
+	 */
+	if (ShouldRecursivelyPlanLocalTables(query))
+	{
+		RecursivelyPlanLocalTables(query, context);
+	}
+
 	/*
 	 * At this point, all CTEs, leaf subqueries containing local tables and
 	 * non-pushdownable subqueries have been replaced. We now check for
@@ -331,6 +380,15 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 		RecursivelyPlanAllSubqueries(query->havingQual, context);
 	}
 
+	/*
+	 * If the query joins small distributed tables on columns other than their
+	 * distribution keys, broadcast them instead of repartitioning the join.
+	 */
+	if (ShouldBroadcastSmallTables(query, context))
+	{
+		RecursivelyPlanSmallTables(query, context);
+	}
+
 	/*
 	 * If the query doesn't have distribution key equality,
 	 * recursively plan some of its subqueries.
@@ -340,6 +398,11 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 		RecursivelyPlanNonColocatedSubqueries(query, context);
 	}
 
+	if (EnableSemiJoinReduction)
+	{
+		AddSemiJoinReductionFilters(query);
+	}
+
 	return NULL;
 }
 
@@ -397,6 +460,299 @@ ShouldRecursivelyPlanNonColocatedSubqueries(Query *subquery,
 }
 
 
+/*
+ * ShouldRecursivelyPlanLocalTables returns true if the input query is a
+ * SELECT that directly joins local tables with distributed tables, which
+ * none of the Citus planners can plan as is.
+ */
+static bool
+ShouldRecursivelyPlanLocalTables(Query *query)
+{
+	List *rangeTableIndexList = NIL;
+	bool hasLocalTable = false;
+	bool hasDistributedTable = false;
+	int rangeTableIndex = 0;
+
+	if (!EnableLocalTableJoinPushdown)
+	{
+		return false;
+	}
+
+	/* row locks on local tables cannot be taken through intermediate results */
+	if (query->commandType != CMD_SELECT || query->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	foreach_int(rangeTableIndex, rangeTableIndexList)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (IsLocalTableRTE((Node *) rangeTableEntry))
+		{
+			hasLocalTable = true;
+		}
+		else if (IsDistributedTableRTE((Node *) rangeTableEntry))
+		{
+			hasDistributedTable = true;
+		}
+	}
+
+	return hasLocalTable && hasDistributedTable;
+}
+
+
+/*
+ * RecursivelyPlanLocalTables replaces the local tables in the join tree of the
+ * query by a recursively planned subquery on the table that applies the
+ * filters of the query to it. The join itself is then pushed down to the
+ * shards of the distributed tables, which read the filtered rows of the local
+ * tables from the intermediate results, such that a small or highly filtered
+ * local table can be joined with a large distributed table without pulling
+ * the distributed table to the coordinator.
+ */
+static void
+RecursivelyPlanLocalTables(Query *query, RecursivePlanningContext *context)
+{
+	List *rangeTableIndexList = NIL;
+	int rangeTableIndex = 0;
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	foreach_int(rangeTableIndex, rangeTableIndexList)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (!IsLocalTableRTE((Node *) rangeTableEntry))
+		{
+			continue;
+		}
+
+		Query *subquery = BuildRelationSubquery(rangeTableEntry,
+												context->plannerRestrictionContext);
+
+		ReplaceRelationWithSubquery(rangeTableEntry, subquery);
+		RecursivelyPlanSubquery(rangeTableEntry->subquery, context);
+	}
+}
+
+
+/*
+ * ShouldBroadcastSmallTables returns true if broadcast joins are enabled and
+ * the input query directly joins distributed tables that are not all joined
+ * on their distribution keys, which would otherwise require repartitioning.
+ */
+static bool
+ShouldBroadcastSmallTables(Query *query, RecursivePlanningContext *context)
+{
+	List *rangeTableIndexList = NIL;
+	int distributedTableCount = 0;
+	int rangeTableIndex = 0;
+
+	if (BroadcastJoinThreshold <= 0 || context->allDistributionKeysInQueryAreEqual)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || query->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	/* direct joins with local tables are not supported by any of Citus planners */
+	if (FindNodeCheckInRangeTableList(query->rtable, IsLocalTableRTE))
+	{
+		return false;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	foreach_int(rangeTableIndex, rangeTableIndexList)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (IsDistributedTableRTE((Node *) rangeTableEntry))
+		{
+			distributedTableCount++;
+		}
+	}
+
+	if (distributedTableCount < 2)
+	{
+		return false;
+	}
+
+	return !AllDistributionKeysInSubqueryAreEqual(query,
+												  context->plannerRestrictionContext);
+}
+
+
+/*
+ * RecursivelyPlanSmallTables replaces the distributed tables of the query
+ * whose size does not exceed citus.broadcast_join_threshold by a recursively
+ * planned subquery on the table. The intermediate result of the subquery is
+ * sent to every node that runs a task of the query, such that each shard of
+ * the remaining tables is joined with a full copy of the small table, without
+ * moving the large tables across the network.
+ *
+ * The largest table is never broadcast, and neither are tables whose size is
+ * not known or that are on either side of an outer join.
+ */
+static void
+RecursivelyPlanSmallTables(Query *query, RecursivePlanningContext *context)
+{
+	List *rangeTableIndexList = NIL;
+	List *innerRangeTableIndexList = NIL;
+	List *smallTableIndexList = NIL;
+	uint64 broadcastSizeLimit = (uint64) BroadcastJoinThreshold * 1024;
+	int anchorRangeTableIndex = 0;
+	uint64 anchorTableSize = 0;
+	int rangeTableIndex = 0;
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	InnerJoinedRangeTableIndexes((Node *) query->jointree, &innerRangeTableIndexList);
+
+	foreach_int(rangeTableIndex, rangeTableIndexList)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+		if (!IsDistributedTableRTE((Node *) rangeTableEntry))
+		{
+			continue;
+		}
+
+		/* tables of unknown size might be large */
+		uint64 tableSize = EstimatedTableSize(rangeTableEntry->relid);
+		if (tableSize == 0)
+		{
+			tableSize = PG_UINT64_MAX;
+		}
+
+		if (anchorRangeTableIndex == 0 || tableSize > anchorTableSize)
+		{
+			anchorRangeTableIndex = rangeTableIndex;
+			anchorTableSize = tableSize;
+		}
+
+		if (tableSize <= broadcastSizeLimit &&
+			list_member_int(innerRangeTableIndexList, rangeTableIndex))
+		{
+			smallTableIndexList = lappend_int(smallTableIndexList, rangeTableIndex);
+		}
+	}
+
+	foreach_int(rangeTableIndex, smallTableIndexList)
+	{
+		if (rangeTableIndex == anchorRangeTableIndex)
+		{
+			continue;
+		}
+
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+		Query *subquery = BuildRelationSubquery(rangeTableEntry,
+												context->plannerRestrictionContext);
+
+		ReplaceRelationWithSubquery(rangeTableEntry, subquery);
+		RecursivelyPlanSubquery(rangeTableEntry->subquery, context);
+	}
+}
+
+
+/*
+ * BuildRelationSubquery returns a query that selects the columns of the
+ * relation in the given range table entry in the order of their attribute
+ * numbers, such that the columns keep their attribute numbers when the
+ * relation is replaced by the subquery. Dropped columns are replaced by
+ * NULL. The relation is filtered by the restrictions that the planner
+ * applies to it in the rest of the query.
+ */
+static Query *
+BuildRelationSubquery(RangeTblEntry *rangeTableEntry,
+					  PlannerRestrictionContext *plannerRestrictionContext)
+{
+	Index subqueryRangeTableIndex = 1;
+	List *targetList = NIL;
+
+	Relation relation = heap_open(rangeTableEntry->relid, NoLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		FormData_pg_attribute *attributeForm = TupleDescAttr(tupleDescriptor,
+															 columnIndex);
+		AttrNumber attributeNumber = columnIndex + 1;
+		Expr *column = NULL;
+		char *columnName = NULL;
+
+		if (attributeForm->attisdropped)
+		{
+			column = (Expr *) makeNullConst(INT4OID, -1, InvalidOid);
+			columnName = psprintf("dropped_column_%d", attributeNumber);
+		}
+		else
+		{
+			column = (Expr *) makeVar(subqueryRangeTableIndex, attributeNumber,
+									  attributeForm->atttypid,
+									  attributeForm->atttypmod,
+									  attributeForm->attcollation, 0);
+			columnName = pstrdup(NameStr(attributeForm->attname));
+		}
+
+		TargetEntry *targetEntry = makeTargetEntry(column, attributeNumber,
+												   columnName, false);
+		targetList = lappend(targetList, targetEntry);
+	}
+
+	heap_close(relation, NoLock);
+
+	Node *quals = NULL;
+	if (plannerRestrictionContext != NULL)
+	{
+		List *restrictionList =
+			RestrictionClausesForRelation(rangeTableEntry, subqueryRangeTableIndex,
+										  plannerRestrictionContext, false);
+		if (restrictionList != NIL)
+		{
+			quals = (Node *) make_ands_explicit(restrictionList);
+		}
+	}
+
+	RangeTblRef *rangeTableRef = makeNode(RangeTblRef);
+	rangeTableRef->rtindex = subqueryRangeTableIndex;
+
+	Query *subquery = makeNode(Query);
+	subquery->commandType = CMD_SELECT;
+	subquery->rtable = list_make1(copyObject(rangeTableEntry));
+	subquery->jointree = makeFromExpr(list_make1(rangeTableRef), quals);
+	subquery->targetList = targetList;
+
+	return subquery;
+}
+
+
+/*
+ * ReplaceRelationWithSubquery turns the given relation range table entry into
+ * a subquery range table entry for the given subquery.
+ */
+static void
+ReplaceRelationWithSubquery(RangeTblEntry *rangeTableEntry, Query *subquery)
+{
+	/* a subquery in FROM needs an alias */
+	if (rangeTableEntry->alias == NULL)
+	{
+		rangeTableEntry->alias = makeAlias(rangeTableEntry->eref->aliasname, NIL);
+	}
+
+	rangeTableEntry->rtekind = RTE_SUBQUERY;
+	rangeTableEntry->subquery = subquery;
+	rangeTableEntry->relid = InvalidOid;
+	rangeTableEntry->relkind = 0;
+	rangeTableEntry->inh = false;
+	rangeTableEntry->tablesample = NULL;
+	rangeTableEntry->values_lists = NIL;
+	rangeTableEntry->requiredPerms = 0;
+}
+
+
 /*
  * ContainsSubquery returns true if the input query contains any subqueries
  * in the FROM or WHERE clauses.
@@ -1120,6 +1476,12 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 		return;
 	}
 
+	if (EnableSubPlanRestrictionPushdown)
+	{
+		PushDownRestrictionsIntoSubquery(subquery,
+										 planningContext->plannerRestrictionContext);
+	}
+
 	/*
 	 * Subquery will go through the standard planner, thus to properly deparse it
 	 * we keep its copy: debugQuery.
@@ -1162,6 +1524,455 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 }
 
 
+/*
+ * PushDownRestrictionsIntoSubquery adds the restrictions that the planner
+ * applies to the relations of the subquery within the whole query to the
+ * WHERE clause of the subquery, such that the intermediate result of the
+ * subquery only contains the rows that the rest of the query needs.
+ *
+ * Apart from the filters of the subquery itself, these are the filters of the
+ * outer query that the planner pushed down into the subquery, and the filters
+ * on the distribution keys of other relations that are joined to the
+ * distribution keys of the relations in the subquery. The latter helps when,
+ * for instance, a non-colocated subquery is joined with a table on the
+ * distribution key and the query filters the table with user_id IN (...),
+ * since the planner does not derive such filters for the subquery itself.
+ */
+static void
+PushDownRestrictionsIntoSubquery(Query *subquery,
+								 PlannerRestrictionContext *plannerRestrictionContext)
+{
+	List *rangeTableIndexList = NIL;
+	bool addedRestriction = false;
+	int rangeTableIndex = 0;
+
+	if (plannerRestrictionContext == NULL || subquery->setOperations != NULL)
+	{
+		return;
+	}
+
+	/*
+	 * Only the relations that are not on the nullable side of an outer join
+	 * can be filtered in the WHERE clause.
+	 */
+	InnerJoinedRangeTableIndexes((Node *) subquery->jointree, &rangeTableIndexList);
+
+	List *qualList = make_ands_implicit((Expr *) subquery->jointree->quals);
+
+	foreach_int(rangeTableIndex, rangeTableIndexList)
+	{
+		RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, subquery->rtable);
+		ListCell *restrictionCell = NULL;
+
+		if (rangeTableEntry->rtekind != RTE_RELATION)
+		{
+			continue;
+		}
+
+		bool includeEquivalentRestrictions =
+			SafeToPushDownEquivalentRestrictions(subquery, rangeTableIndex,
+												 rangeTableEntry);
+		List *restrictionList =
+			RestrictionClausesForRelation(rangeTableEntry, rangeTableIndex,
+										  plannerRestrictionContext,
+										  includeEquivalentRestrictions);
+
+		foreach(restrictionCell, restrictionList)
+		{
+			Expr *restriction = (Expr *) lfirst(restrictionCell);
+
+			if (list_member(qualList, restriction))
+			{
+				continue;
+			}
+
+			qualList = lappend(qualList, restriction);
+			addedRestriction = true;
+		}
+	}
+
+	if (addedRestriction)
+	{
+		subquery->jointree->quals = (Node *) make_ands_explicit(qualList);
+	}
+}
+
+
+/*
+ * InnerJoinedRangeTableIndexes appends the range table indexes in the join
+ * tree that are reached without passing through an outer join to the list.
+ */
+static void
+InnerJoinedRangeTableIndexes(Node *joinNode, List **rangeTableIndexList)
+{
+	if (joinNode == NULL)
+	{
+		return;
+	}
+	else if (IsA(joinNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinNode;
+		ListCell *fromExprCell = NULL;
+
+		foreach(fromExprCell, fromExpr->fromlist)
+		{
+			InnerJoinedRangeTableIndexes((Node *) lfirst(fromExprCell),
+										 rangeTableIndexList);
+		}
+	}
+	else if (IsA(joinNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			InnerJoinedRangeTableIndexes(joinExpr->larg, rangeTableIndexList);
+			InnerJoinedRangeTableIndexes(joinExpr->rarg, rangeTableIndexList);
+		}
+	}
+	else if (IsA(joinNode, RangeTblRef))
+	{
+		int rangeTableIndex = ((RangeTblRef *) joinNode)->rtindex;
+
+		*rangeTableIndexList = lappend_int(*rangeTableIndexList, rangeTableIndex);
+	}
+}
+
+
+/*
+ * SafeToPushDownEquivalentRestrictions returns true if the relation can be
+ * filtered on its distribution key. See SafeToFilterSubqueryOnColumn().
+ */
+static bool
+SafeToPushDownEquivalentRestrictions(Query *subquery, Index rangeTableIndex,
+									 RangeTblEntry *rangeTableEntry)
+{
+	if (!IsCitusTable(rangeTableEntry->relid))
+	{
+		return false;
+	}
+
+	Var *partitionColumn = DistPartitionKey(rangeTableEntry->relid);
+	if (partitionColumn == NULL)
+	{
+		return false;
+	}
+
+	return SafeToFilterSubqueryOnColumn(subquery, rangeTableIndex,
+										partitionColumn->varattno);
+}
+
+
+/*
+ * SafeToFilterSubqueryOnColumn returns true if filtering the rows of the
+ * relation at the given range table index on the given column does not
+ * change the rows of the subquery for the remaining values of the column.
+ * That does not hold when the subquery applies a LIMIT, window functions or
+ * set-returning functions, or when it groups or deduplicates rows without
+ * the column.
+ */
+static bool
+SafeToFilterSubqueryOnColumn(Query *subquery, Index rangeTableIndex,
+							 AttrNumber attributeNumber)
+{
+	if (subquery->limitCount != NULL || subquery->limitOffset != NULL ||
+		subquery->hasWindowFuncs || subquery->hasTargetSRFs ||
+		subquery->groupingSets != NIL || subquery->setOperations != NULL)
+	{
+		return false;
+	}
+
+	if ((subquery->hasAggs || subquery->groupClause != NIL ||
+		 subquery->havingQual != NULL) &&
+		!ColumnInSortGroupClauseList(subquery->groupClause, subquery->targetList,
+									 rangeTableIndex, attributeNumber))
+	{
+		return false;
+	}
+
+	if (subquery->distinctClause != NIL &&
+		!ColumnInSortGroupClauseList(subquery->distinctClause, subquery->targetList,
+									 rangeTableIndex, attributeNumber))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ColumnInSortGroupClauseList returns true if one of the GROUP BY or DISTINCT
+ * clauses in the list is the given column.
+ */
+static bool
+ColumnInSortGroupClauseList(List *sortGroupClauseList, List *targetList,
+							Index rangeTableIndex, AttrNumber attributeNumber)
+{
+	ListCell *sortGroupClauseCell = NULL;
+
+	foreach(sortGroupClauseCell, sortGroupClauseList)
+	{
+		SortGroupClause *sortGroupClause =
+			(SortGroupClause *) lfirst(sortGroupClauseCell);
+		TargetEntry *targetEntry = get_sortgroupclause_tle(sortGroupClause,
+														   targetList);
+		Var *column = (Var *) targetEntry->expr;
+
+		if (IsA(column, Var) && column->varlevelsup == 0 &&
+			column->varno == rangeTableIndex && column->varattno == attributeNumber)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * AddSemiJoinReductionFilters looks for joins between the subqueries of the
+ * query and the intermediate results of recursively planned subqueries. For
+ * each such join, it filters the relation of the subquery on the join keys
+ * in the intermediate result, using col = ANY (SELECT ... FROM
+ * read_intermediate_result(...)).
+ *
+ * The intermediate result is sent to the workers for the join anyway, but
+ * the join only happens after the workers compute the subquery on the whole
+ * shard, for instance after grouping all of its rows. With the filter, the
+ * workers only compute the subquery for the keys that the join needs.
+ */
+static void
+AddSemiJoinReductionFilters(Query *query)
+{
+	ListCell *qualCell = NULL;
+
+	if (query->jointree == NULL)
+	{
+		return;
+	}
+
+	/* joins of the WHERE clause and of inner joins eliminate unmatched rows */
+	List *qualList = make_ands_implicit((Expr *) query->jointree->quals);
+	InnerJoinQualList((Node *) query->jointree, &qualList);
+
+	foreach(qualCell, qualList)
+	{
+		Node *qual = (Node *) lfirst(qualCell);
+
+		if (!IsA(qual, OpExpr))
+		{
+			continue;
+		}
+
+		OpExpr *joinClause = (OpExpr *) qual;
+		if (list_length(joinClause->args) != 2 ||
+			!OperatorImplementsEquality(joinClause->opno))
+		{
+			continue;
+		}
+
+		Node *leftArgument = linitial(joinClause->args);
+		Node *rightArgument = lsecond(joinClause->args);
+		if (!IsA(leftArgument, Var) || !IsA(rightArgument, Var))
+		{
+			continue;
+		}
+
+		Var *leftColumn = (Var *) leftArgument;
+		Var *rightColumn = (Var *) rightArgument;
+		if (leftColumn->varlevelsup != 0 || rightColumn->varlevelsup != 0)
+		{
+			continue;
+		}
+
+		if (IsIntermediateResultRte(query, rightColumn->varno))
+		{
+			AddSemiJoinReductionFilter(query, leftColumn, rightColumn,
+									   joinClause->opno, joinClause->inputcollid);
+		}
+		else if (IsIntermediateResultRte(query, leftColumn->varno))
+		{
+			/* the filtered column should be on the left side of the operator */
+			Oid commutatorId = get_commutator(joinClause->opno);
+			if (commutatorId != InvalidOid)
+			{
+				AddSemiJoinReductionFilter(query, rightColumn, leftColumn,
+										   commutatorId, joinClause->inputcollid);
+			}
+		}
+	}
+}
+
+
+/*
+ * InnerJoinQualList appends the ON clauses of the joins in the join tree that
+ * are reached without passing through an outer join to the list.
+ */
+static void
+InnerJoinQualList(Node *joinNode, List **qualList)
+{
+	if (joinNode == NULL)
+	{
+		return;
+	}
+	else if (IsA(joinNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinNode;
+		ListCell *fromExprCell = NULL;
+
+		foreach(fromExprCell, fromExpr->fromlist)
+		{
+			InnerJoinQualList((Node *) lfirst(fromExprCell), qualList);
+		}
+	}
+	else if (IsA(joinNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			*qualList = list_concat(*qualList,
+									make_ands_implicit((Expr *) joinExpr->quals));
+
+			InnerJoinQualList(joinExpr->larg, qualList);
+			InnerJoinQualList(joinExpr->rarg, qualList);
+		}
+	}
+}
+
+
+/*
+ * IsIntermediateResultRte returns true if the range table entry at the given
+ * index is a subquery that only reads intermediate results, which is what
+ * recursively planned subqueries are replaced with.
+ */
+static bool
+IsIntermediateResultRte(Query *query, Index rangeTableIndex)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY)
+	{
+		return false;
+	}
+
+	Query *subquery = rangeTableEntry->subquery;
+	if (list_length(subquery->rtable) != 1 || subquery->jointree->quals != NULL ||
+		subquery->setOperations != NULL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *functionRte = (RangeTblEntry *) linitial(subquery->rtable);
+	if (functionRte->rtekind != RTE_FUNCTION)
+	{
+		return false;
+	}
+
+	return ContainsReadIntermediateResultFunction((Node *) functionRte->functions) ||
+		   ContainsReadIntermediateResultArrayFunction((Node *) functionRte->functions);
+}
+
+
+/*
+ * AddSemiJoinReductionFilter filters the subquery that the filtered column
+ * belongs to on the values of the result column, if the filtered column is
+ * a column of a distributed table in the subquery and filtering the table on
+ * it does not change the rows of the subquery for the remaining values.
+ */
+static void
+AddSemiJoinReductionFilter(Query *query, Var *filteredColumn, Var *resultColumn,
+						   Oid operatorId, Oid inputCollationId)
+{
+	RangeTblEntry *filteredRte = rt_fetch(filteredColumn->varno, query->rtable);
+	List *rangeTableIndexList = NIL;
+
+	if (filteredRte->rtekind != RTE_SUBQUERY ||
+		IsIntermediateResultRte(query, filteredColumn->varno))
+	{
+		return;
+	}
+
+	Query *filteredSubquery = filteredRte->subquery;
+	TargetEntry *filteredEntry = get_tle_by_resno(filteredSubquery->targetList,
+												  filteredColumn->varattno);
+	if (filteredEntry == NULL || !IsA(filteredEntry->expr, Var))
+	{
+		return;
+	}
+
+	Var *relationColumn = (Var *) filteredEntry->expr;
+	if (relationColumn->varlevelsup != 0)
+	{
+		return;
+	}
+
+	InnerJoinedRangeTableIndexes((Node *) filteredSubquery->jointree,
+								 &rangeTableIndexList);
+	if (!list_member_int(rangeTableIndexList, relationColumn->varno))
+	{
+		return;
+	}
+
+	RangeTblEntry *relationRte = rt_fetch(relationColumn->varno,
+										  filteredSubquery->rtable);
+	if (relationRte->rtekind != RTE_RELATION || !IsCitusTable(relationRte->relid) ||
+		PartitionMethod(relationRte->relid) == DISTRIBUTE_BY_NONE)
+	{
+		return;
+	}
+
+	if (!SafeToFilterSubqueryOnColumn(filteredSubquery, relationColumn->varno,
+									  relationColumn->varattno))
+	{
+		return;
+	}
+
+	/* read only the join keys from the intermediate result */
+	RangeTblEntry *resultRte = rt_fetch(resultColumn->varno, query->rtable);
+	Query *keyQuery = copyObject(resultRte->subquery);
+	TargetEntry *keyEntry = get_tle_by_resno(keyQuery->targetList,
+											 resultColumn->varattno);
+	if (keyEntry == NULL)
+	{
+		return;
+	}
+
+	keyEntry->resno = 1;
+	keyQuery->targetList = list_make1(keyEntry);
+
+	Param *keyParam = makeNode(Param);
+	keyParam->paramkind = PARAM_SUBLINK;
+	keyParam->paramid = 1;
+	keyParam->paramtype = exprType((Node *) keyEntry->expr);
+	keyParam->paramtypmod = exprTypmod((Node *) keyEntry->expr);
+	keyParam->paramcollid = exprCollation((Node *) keyEntry->expr);
+	keyParam->location = -1;
+
+	SubLink *semiJoinFilter = makeNode(SubLink);
+	semiJoinFilter->subLinkType = ANY_SUBLINK;
+	semiJoinFilter->subLinkId = 0;
+	semiJoinFilter->testexpr = (Node *) make_opclause(operatorId, BOOLOID, false,
+													  (Expr *) copyObject(relationColumn),
+													  (Expr *) keyParam, InvalidOid,
+													  inputCollationId);
+	semiJoinFilter->operName = list_make1(makeString(get_opname(operatorId)));
+	semiJoinFilter->subselect = (Node *) keyQuery;
+	semiJoinFilter->location = -1;
+
+	List *qualList = make_ands_implicit((Expr *) filteredSubquery->jointree->quals);
+	if (list_member(qualList, semiJoinFilter))
+	{
+		return;
+	}
+
+	qualList = lappend(qualList, semiJoinFilter);
+	filteredSubquery->jointree->quals = (Node *) make_ands_explicit(qualList);
+	filteredSubquery->hasSubLinks = true;
+}
+
+
 /*
  * CreateDistributedSubPlan creates a distributed subplan by recursively calling
  * the planner from the top, which may either generate a local plan or another
@@ -1186,6 +1997,9 @@ CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 	}
 
 	DistributedSubPlan *subPlan = CitusMakeNode(DistributedSubPlan);
+
+	/* deparse before planning, which modifies the query */
+	subPlan->cacheKey = SubPlanResultCacheKey(subPlanQuery);
 	subPlan->plan = planner(subPlanQuery, cursorOptions, NULL);
 	subPlan->subPlanId = subPlanId;
 
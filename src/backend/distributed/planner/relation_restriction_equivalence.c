@@ -19,6 +19,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/planning_stats.h"
 #include "distributed/query_utils.h"
 #include "distributed/relation_restriction_equivalence.h"
 #include "nodes/nodeFuncs.h"
@@ -30,10 +31,14 @@
 #include "nodes/relation.h"
 #endif
 #include "parser/parsetree.h"
+#include "optimizer/clauses.h"
 #include "optimizer/pathnode.h"
-
-static uint32 attributeEquivalenceId = 1;
-
+#include "utils/hsearch.h"
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/var.h"
+#endif
 
 /*
  * AttributeEquivalenceClass
@@ -49,7 +54,6 @@ static uint32 attributeEquivalenceId = 1;
  */
 typedef struct AttributeEquivalenceClass
 {
-	uint32 equivalenceId;
 	List *equivalentAttributes;
 } AttributeEquivalenceClass;
 
@@ -71,6 +75,38 @@ typedef struct AttributeEquivalenceClassMember
 	AttrNumber varattno;
 } AttributeEquivalenceClassMember;
 
+/*
+ * AttributeEquivalenceMemberKey identifies an AttributeEquivalenceClassMember
+ * in the hash of an AttributeEquivalenceSet. Both fields are ints such that
+ * the key does not have padding.
+ */
+typedef struct AttributeEquivalenceMemberKey
+{
+	int rteIdentity;
+	int varattno;
+} AttributeEquivalenceMemberKey;
+
+typedef struct AttributeEquivalenceMemberEntry
+{
+	AttributeEquivalenceMemberKey key;
+	int memberIndex;
+} AttributeEquivalenceMemberEntry;
+
+/*
+ * AttributeEquivalenceSet is a disjoint-set forest (union-find) over
+ * AttributeEquivalenceClassMembers, which we use to merge the equivalence
+ * classes that share members. Each distinct member gets an index into the
+ * members and parentIndex arrays, and the members whose roots are the same
+ * are in the same merged class.
+ */
+typedef struct AttributeEquivalenceSet
+{
+	HTAB *memberIndexHash;
+	AttributeEquivalenceClassMember **members;
+	int *parentIndex;
+	int memberCount;
+} AttributeEquivalenceSet;
+
 
 static bool ContextContainsLocalRelation(RelationRestrictionContext *restrictionContext);
 static Var * FindTranslatedVar(List *appendRelList, Oid relationOid,
@@ -112,17 +148,19 @@ static Var * GetVarFromAssignedParam(List *outerPlanParamsList, Param *plannerPa
 static Var * SearchPlannerParamList(List *plannerParamList, Param *plannerParam);
 static List * GenerateAttributeEquivalencesForJoinRestrictions(JoinRestrictionContext
 															   *joinRestrictionContext);
-static bool AttributeClassContainsAttributeClassMember(AttributeEquivalenceClassMember *
-													   inputMember,
-													   AttributeEquivalenceClass *
-													   attributeEquivalenceClass);
 static List * AddAttributeClassToAttributeClassList(List *attributeEquivalenceList,
 													AttributeEquivalenceClass *
 													attributeEquivalence);
-static bool AttributeEquivalencesAreEqual(AttributeEquivalenceClass *
-										  firstAttributeEquivalence,
-										  AttributeEquivalenceClass *
-										  secondAttributeEquivalence);
+static void AddTransitiveEquivalences(AttributeEquivalenceClass *commonEquivalenceClass,
+									  List *attributeEquivalenceList);
+static AttributeEquivalenceSet * CreateAttributeEquivalenceSet(int maxMemberCount);
+static int AddClassToAttributeEquivalenceSet(AttributeEquivalenceSet *equivalenceSet,
+											 AttributeEquivalenceClass *
+											 attributeEquivalence);
+static int AttributeEquivalenceSetMemberIndex(AttributeEquivalenceSet *equivalenceSet,
+											  AttributeEquivalenceClassMember *member);
+static int AttributeEquivalenceSetRoot(AttributeEquivalenceSet *equivalenceSet,
+									   int memberIndex);
 static AttributeEquivalenceClass * GenerateCommonEquivalence(List *
 															 attributeEquivalenceList,
 															 RelationRestrictionContext *
@@ -131,10 +169,6 @@ static AttributeEquivalenceClass * GenerateEquivalenceClassForRelationRestrictio
 	RelationRestrictionContext
 	*
 	relationRestrictionContext);
-static void ListConcatUniqueAttributeClassMemberLists(AttributeEquivalenceClass **
-													  firstClass,
-													  AttributeEquivalenceClass *
-													  secondClass);
 static Index RelationRestrictionPartitionKeyIndex(RelationRestriction *
 												  relationRestriction);
 static bool AllRelationsInRestrictionContextColocated(RelationRestrictionContext *
@@ -153,6 +187,16 @@ static Relids QueryRteIdentities(Query *queryTree);
 static bool JoinRestrictionListExistsInContext(JoinRestriction *joinRestrictionInput,
 											   JoinRestrictionContext *
 											   joinRestrictionContext);
+static RelationRestriction * RelationRestrictionForRteIdentity(
+	RelationRestrictionContext *relationRestrictionContext, int rteIdentity);
+static JoinRestrictionContext * InnerJoinRestrictionContext(JoinRestrictionContext *
+															joinRestrictionContext);
+static List * AddRelationRestrictionClauses(List *restrictionList,
+											RelationRestriction *relationRestriction,
+											AttrNumber sourceAttributeNumber,
+											Index targetRangeTableIndex,
+											AttrNumber targetAttributeNumber);
+static bool IsParam(Node *node);
 
 
 /*
@@ -250,8 +294,6 @@ SafeToPushdownUnionSubquery(PlannerRestrictionContext *plannerRestrictionContext
 		palloc0(sizeof(AttributeEquivalenceClass));
 	ListCell *relationRestrictionCell = NULL;
 
-	attributeEquivalence->equivalenceId = attributeEquivalenceId++;
-
 	/*
 	 * Ensure that the partition column is in the same place across all
 	 * leaf queries in the UNION and construct an equivalence class for
@@ -481,10 +523,18 @@ RestrictionEquivalenceForPartitionKeys(PlannerRestrictionContext *restrictionCon
 		return true;
 	}
 
+	PlanningPhase previousPhase =
+		BeginPlanningPhase(PLANNING_PHASE_RESTRICTION_EQUIVALENCE);
+
 	List *attributeEquivalenceList = GenerateAllAttributeEquivalences(restrictionContext);
 
-	return RestrictionEquivalenceForPartitionKeysViaEquivalences(restrictionContext,
-																 attributeEquivalenceList);
+	bool restrictionEquivalence =
+		RestrictionEquivalenceForPartitionKeysViaEquivalences(restrictionContext,
+															  attributeEquivalenceList);
+
+	EndPlanningPhase(previousPhase);
+
+	return restrictionEquivalence;
 }
 
 
@@ -563,10 +613,6 @@ GenerateAllAttributeEquivalences(PlannerRestrictionContext *plannerRestrictionCo
 	JoinRestrictionContext *joinRestrictionContext =
 		plannerRestrictionContext->joinRestrictionContext;
 
-
-	/* reset the equivalence id counter per call to prevent overflows */
-	attributeEquivalenceId = 1;
-
 	List *relationRestrictionAttributeEquivalenceList =
 		GenerateAttributeEquivalencesForRelationRestrictions(relationRestrictionContext);
 	List *joinRestrictionAttributeEquivalenceList =
@@ -736,8 +782,6 @@ AttributeEquivalenceClassForEquivalenceClass(EquivalenceClass *plannerEqClass,
 	ListCell *equivilanceMemberCell = NULL;
 	PlannerInfo *plannerInfo = relationRestriction->plannerInfo;
 
-	attributeEquivalence->equivalenceId = attributeEquivalenceId++;
-
 	foreach(equivilanceMemberCell, plannerEqClass->ec_members)
 	{
 		EquivalenceMember *equivalenceMember =
@@ -877,28 +921,21 @@ SearchPlannerParamList(List *plannerParamList, Param *plannerParam)
  * With the equivalence classes, the function follows the algorithm
  * outlined below:
  *
- *     - Add the first equivalence class to the common equivalence class
- *     - Then, iterate on the remaining equivalence classes
- *          - If any of the members equal to the common equivalence class
- *            add all the members of the equivalence class to the common
- *            class
- *          - Start the iteration from the beginning. The reason is that
- *            in case any of the classes we've passed is equivalent to the
- *            newly added one. To optimize the algorithm, we utilze the
- *            equivalence class ids and skip the ones that are already added.
- *      - Finally, return the common equivalence class.
+ *     - Seed the common equivalence class with the partition key of the
+ *       first distributed table
+ *     - Then, merge the equivalence classes that share members, and add
+ *       the members that end up in the same class as the seed to the
+ *       common class (see AddTransitiveEquivalences)
+ *     - Finally, return the common equivalence class.
  */
 static AttributeEquivalenceClass *
 GenerateCommonEquivalence(List *attributeEquivalenceList,
 						  RelationRestrictionContext *relationRestrictionContext)
 {
-	Bitmapset *addedEquivalenceIds = NULL;
 	uint32 equivalenceListSize = list_length(attributeEquivalenceList);
-	uint32 equivalenceClassIndex = 0;
 
 	AttributeEquivalenceClass *commonEquivalenceClass = palloc0(
 		sizeof(AttributeEquivalenceClass));
-	commonEquivalenceClass->equivalenceId = 0;
 
 	/*
 	 * We seed the common equivalence class with a the first distributed
@@ -916,67 +953,181 @@ GenerateCommonEquivalence(List *attributeEquivalenceList,
 
 	commonEquivalenceClass->equivalentAttributes =
 		firstEquivalenceClass->equivalentAttributes;
-	addedEquivalenceIds = bms_add_member(addedEquivalenceIds,
-										 firstEquivalenceClass->equivalenceId);
 
-	while (equivalenceClassIndex < equivalenceListSize)
+	AddTransitiveEquivalences(commonEquivalenceClass, attributeEquivalenceList);
+
+	return commonEquivalenceClass;
+}
+
+
+/*
+ * AddTransitiveEquivalences adds the members of all equivalence classes in the
+ * list that share a member with the given class, directly or through other
+ * classes in the list, to the given class.
+ *
+ * Rather than repeatedly scanning the list for classes that overlap with the
+ * members found so far, we merge all classes in a single pass using a
+ * union-find structure, such that the cost is close to linear in the total
+ * number of members.
+ */
+static void
+AddTransitiveEquivalences(AttributeEquivalenceClass *commonEquivalenceClass,
+						  List *attributeEquivalenceList)
+{
+	if (commonEquivalenceClass->equivalentAttributes == NIL)
 	{
-		ListCell *equivalenceMemberCell = NULL;
-		bool restartLoop = false;
+		return;
+	}
 
-		AttributeEquivalenceClass *currentEquivalenceClass = list_nth(
-			attributeEquivalenceList,
-			equivalenceClassIndex);
+	int maxMemberCount = list_length(commonEquivalenceClass->equivalentAttributes);
 
-		/*
-		 * This is an optimization. If we already added the same equivalence class,
-		 * we could skip it since we've already added all the relevant equivalence
-		 * members.
-		 */
-		if (bms_is_member(currentEquivalenceClass->equivalenceId, addedEquivalenceIds))
-		{
-			equivalenceClassIndex++;
+	AttributeEquivalenceClass *attributeEquivalence = NULL;
+	foreach_ptr(attributeEquivalence, attributeEquivalenceList)
+	{
+		maxMemberCount += list_length(attributeEquivalence->equivalentAttributes);
+	}
+
+	AttributeEquivalenceSet *equivalenceSet =
+		CreateAttributeEquivalenceSet(maxMemberCount);
+
+	/* the members of the common class come first, the others are added after */
+	int commonMemberIndex = AddClassToAttributeEquivalenceSet(equivalenceSet,
+															  commonEquivalenceClass);
+	int commonMemberCount = equivalenceSet->memberCount;
+
+	foreach_ptr(attributeEquivalence, attributeEquivalenceList)
+	{
+		AddClassToAttributeEquivalenceSet(equivalenceSet, attributeEquivalence);
+	}
 
+	int commonRootIndex = AttributeEquivalenceSetRoot(equivalenceSet,
+													  commonMemberIndex);
+
+	for (int memberIndex = commonMemberCount; memberIndex < equivalenceSet->memberCount;
+		 memberIndex++)
+	{
+		if (AttributeEquivalenceSetRoot(equivalenceSet, memberIndex) != commonRootIndex)
+		{
 			continue;
 		}
 
-		foreach(equivalenceMemberCell, currentEquivalenceClass->equivalentAttributes)
-		{
-			AttributeEquivalenceClassMember *attributeEquialanceMember =
-				(AttributeEquivalenceClassMember *) lfirst(equivalenceMemberCell);
+		commonEquivalenceClass->equivalentAttributes =
+			lappend(commonEquivalenceClass->equivalentAttributes,
+					equivalenceSet->members[memberIndex]);
+	}
 
-			if (AttributeClassContainsAttributeClassMember(attributeEquialanceMember,
-														   commonEquivalenceClass))
-			{
-				ListConcatUniqueAttributeClassMemberLists(&commonEquivalenceClass,
-														  currentEquivalenceClass);
+	hash_destroy(equivalenceSet->memberIndexHash);
+}
+
+
+/*
+ * CreateAttributeEquivalenceSet returns an empty AttributeEquivalenceSet that
+ * can hold up to the given number of distinct members.
+ */
+static AttributeEquivalenceSet *
+CreateAttributeEquivalenceSet(int maxMemberCount)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(AttributeEquivalenceMemberKey);
+	info.entrysize = sizeof(AttributeEquivalenceMemberEntry);
+	info.hcxt = CurrentMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	AttributeEquivalenceSet *equivalenceSet = palloc0(sizeof(AttributeEquivalenceSet));
+	equivalenceSet->memberIndexHash = hash_create("Attribute Equivalence Member Hash",
+												  maxMemberCount, &info, hashFlags);
+	equivalenceSet->members =
+		palloc0(maxMemberCount * sizeof(AttributeEquivalenceClassMember *));
+	equivalenceSet->parentIndex = palloc0(maxMemberCount * sizeof(int));
+	equivalenceSet->memberCount = 0;
+
+	return equivalenceSet;
+}
 
-				addedEquivalenceIds = bms_add_member(addedEquivalenceIds,
-													 currentEquivalenceClass->
-													 equivalenceId);
 
-				/*
-				 * It seems inefficient to start from the beginning.
-				 * But, we should somehow restart from the beginning to test that
-				 * whether the already skipped ones are equal or not.
-				 */
-				restartLoop = true;
+/*
+ * AddClassToAttributeEquivalenceSet adds the members of the given class to
+ * the set and merges them into a single class, together with the classes that
+ * the members were already in. The function returns the index of one of the
+ * members, or -1 if the class does not have any members.
+ */
+static int
+AddClassToAttributeEquivalenceSet(AttributeEquivalenceSet *equivalenceSet,
+								  AttributeEquivalenceClass *attributeEquivalence)
+{
+	int firstRootIndex = -1;
 
-				break;
-			}
-		}
+	AttributeEquivalenceClassMember *member = NULL;
+	foreach_ptr(member, attributeEquivalence->equivalentAttributes)
+	{
+		int memberIndex = AttributeEquivalenceSetMemberIndex(equivalenceSet, member);
+		int rootIndex = AttributeEquivalenceSetRoot(equivalenceSet, memberIndex);
 
-		if (restartLoop)
+		if (firstRootIndex == -1)
 		{
-			equivalenceClassIndex = 0;
+			firstRootIndex = rootIndex;
 		}
-		else
+		else if (rootIndex != firstRootIndex)
 		{
-			++equivalenceClassIndex;
+			equivalenceSet->parentIndex[rootIndex] = firstRootIndex;
 		}
 	}
 
-	return commonEquivalenceClass;
+	return firstRootIndex;
+}
+
+
+/*
+ * AttributeEquivalenceSetMemberIndex returns the index of the given member in
+ * the set. Members are identified by their rteIdentity and varattno, and a
+ * member that is not yet in the set is added as a class of its own.
+ */
+static int
+AttributeEquivalenceSetMemberIndex(AttributeEquivalenceSet *equivalenceSet,
+								   AttributeEquivalenceClassMember *member)
+{
+	AttributeEquivalenceMemberKey key;
+	bool found = false;
+
+	memset(&key, 0, sizeof(key));
+	key.rteIdentity = member->rteIdentity;
+	key.varattno = member->varattno;
+
+	AttributeEquivalenceMemberEntry *memberEntry =
+		hash_search(equivalenceSet->memberIndexHash, &key, HASH_ENTER, &found);
+	if (!found)
+	{
+		int memberIndex = equivalenceSet->memberCount++;
+
+		equivalenceSet->members[memberIndex] = member;
+		equivalenceSet->parentIndex[memberIndex] = memberIndex;
+		memberEntry->memberIndex = memberIndex;
+	}
+
+	return memberEntry->memberIndex;
+}
+
+
+/*
+ * AttributeEquivalenceSetRoot returns the index of the root of the class that
+ * the member with the given index is in. Along the way, it makes every other
+ * member on the path point to its grandparent (path halving), which keeps the
+ * trees shallow.
+ */
+static int
+AttributeEquivalenceSetRoot(AttributeEquivalenceSet *equivalenceSet, int memberIndex)
+{
+	int *parentIndex = equivalenceSet->parentIndex;
+
+	while (parentIndex[memberIndex] != memberIndex)
+	{
+		parentIndex[memberIndex] = parentIndex[parentIndex[memberIndex]];
+		memberIndex = parentIndex[memberIndex];
+	}
+
+	return memberIndex;
 }
 
 
@@ -1018,38 +1169,6 @@ GenerateEquivalenceClassForRelationRestriction(
 }
 
 
-/*
- * ListConcatUniqueAttributeClassMemberLists gets two attribute equivalence classes. It
- * basically concatenates attribute equivalence member lists uniquely and updates the
- * firstClass' member list with the list.
- *
- * Basically, the function iterates over the secondClass' member list and checks whether
- * it already exists in the firstClass' member list. If not, the member is added to the
- * firstClass.
- */
-static void
-ListConcatUniqueAttributeClassMemberLists(AttributeEquivalenceClass **firstClass,
-										  AttributeEquivalenceClass *secondClass)
-{
-	ListCell *equivalenceClassMemberCell = NULL;
-	List *equivalenceMemberList = secondClass->equivalentAttributes;
-
-	foreach(equivalenceClassMemberCell, equivalenceMemberList)
-	{
-		AttributeEquivalenceClassMember *newEqMember =
-			(AttributeEquivalenceClassMember *) lfirst(equivalenceClassMemberCell);
-
-		if (AttributeClassContainsAttributeClassMember(newEqMember, *firstClass))
-		{
-			continue;
-		}
-
-		(*firstClass)->equivalentAttributes = lappend((*firstClass)->equivalentAttributes,
-													  newEqMember);
-	}
-}
-
-
 /*
  * GenerateAttributeEquivalencesForJoinRestrictions gets a join restriction
  * context and returns a list of AttrributeEquivalenceClass.
@@ -1118,7 +1237,6 @@ GenerateAttributeEquivalencesForJoinRestrictions(JoinRestrictionContext *
 
 			AttributeEquivalenceClass *attributeEquivalence = palloc0(
 				sizeof(AttributeEquivalenceClass));
-			attributeEquivalence->equivalenceId = attributeEquivalenceId++;
 
 			AddToAttributeEquivalenceClass(&attributeEquivalence,
 										   joinRestriction->plannerInfo, leftVar);
@@ -1437,32 +1555,6 @@ AddRteRelationToAttributeEquivalenceClass(AttributeEquivalenceClass **
 }
 
 
-/*
- * AttributeClassContainsAttributeClassMember returns true if it the input class member
- * is already exists in the attributeEquivalenceClass. An equality is identified by the
- * varattno and rteIdentity.
- */
-static bool
-AttributeClassContainsAttributeClassMember(AttributeEquivalenceClassMember *inputMember,
-										   AttributeEquivalenceClass *
-										   attributeEquivalenceClass)
-{
-	ListCell *classCell = NULL;
-	foreach(classCell, attributeEquivalenceClass->equivalentAttributes)
-	{
-		AttributeEquivalenceClassMember *memberOfClass =
-			(AttributeEquivalenceClassMember *) lfirst(classCell);
-		if (memberOfClass->rteIdentity == inputMember->rteIdentity &&
-			memberOfClass->varattno == inputMember->varattno)
-		{
-			return true;
-		}
-	}
-
-	return false;
-}
-
-
 /*
  * AddAttributeClassToAttributeClassList checks for certain properties of the
  * input attributeEquivalence before adding it to the attributeEquivalenceList.
@@ -1470,15 +1562,14 @@ AttributeClassContainsAttributeClassMember(AttributeEquivalenceClassMember *inpu
  * Firstly, the function skips adding NULL attributeEquivalence to the list.
  * Secondly, since an attribute equivalence class with a single member does
  * not contribute to our purposes, we skip such classed adding to the list.
- * Finally, we don't want to add an equivalence class whose exact equivalent
- * already exists in the list.
+ * We do not check whether an equivalent class already exists in the list,
+ * since that takes quadratic time and merging duplicate classes in
+ * AddTransitiveEquivalences is cheap.
  */
 static List *
 AddAttributeClassToAttributeClassList(List *attributeEquivalenceList,
 									  AttributeEquivalenceClass *attributeEquivalence)
 {
-	ListCell *attributeEquivalenceCell = NULL;
-
 	if (attributeEquivalence == NULL)
 	{
 		return attributeEquivalenceList;
@@ -1494,19 +1585,6 @@ AddAttributeClassToAttributeClassList(List *attributeEquivalenceList,
 		return attributeEquivalenceList;
 	}
 
-	/* we don't want to add an attributeEquivalence which already exists */
-	foreach(attributeEquivalenceCell, attributeEquivalenceList)
-	{
-		AttributeEquivalenceClass *currentAttributeEquivalence =
-			(AttributeEquivalenceClass *) lfirst(attributeEquivalenceCell);
-
-		if (AttributeEquivalencesAreEqual(currentAttributeEquivalence,
-										  attributeEquivalence))
-		{
-			return attributeEquivalenceList;
-		}
-	}
-
 	attributeEquivalenceList = lappend(attributeEquivalenceList,
 									   attributeEquivalence);
 
@@ -1514,58 +1592,6 @@ AddAttributeClassToAttributeClassList(List *attributeEquivalenceList,
 }
 
 
-/*
- *  AttributeEquivalencesAreEqual returns true if both input attribute equivalence
- *  classes contains exactly the same members.
- */
-static bool
-AttributeEquivalencesAreEqual(AttributeEquivalenceClass *firstAttributeEquivalence,
-							  AttributeEquivalenceClass *secondAttributeEquivalence)
-{
-	List *firstEquivalenceMemberList =
-		firstAttributeEquivalence->equivalentAttributes;
-	List *secondEquivalenceMemberList =
-		secondAttributeEquivalence->equivalentAttributes;
-	ListCell *firstAttributeEquivalenceCell = NULL;
-	ListCell *secondAttributeEquivalenceCell = NULL;
-
-	if (list_length(firstEquivalenceMemberList) != list_length(
-			secondEquivalenceMemberList))
-	{
-		return false;
-	}
-
-	foreach(firstAttributeEquivalenceCell, firstEquivalenceMemberList)
-	{
-		AttributeEquivalenceClassMember *firstEqMember =
-			(AttributeEquivalenceClassMember *) lfirst(firstAttributeEquivalenceCell);
-		bool foundAnEquivalentMember = false;
-
-		foreach(secondAttributeEquivalenceCell, secondEquivalenceMemberList)
-		{
-			AttributeEquivalenceClassMember *secondEqMember =
-				(AttributeEquivalenceClassMember *) lfirst(
-					secondAttributeEquivalenceCell);
-
-			if (firstEqMember->rteIdentity == secondEqMember->rteIdentity &&
-				firstEqMember->varattno == secondEqMember->varattno)
-			{
-				foundAnEquivalentMember = true;
-				break;
-			}
-		}
-
-		/* we couldn't find an equivalent member */
-		if (!foundAnEquivalentMember)
-		{
-			return false;
-		}
-	}
-
-	return true;
-}
-
-
 /*
  * ContainsUnionSubquery gets a queryTree and returns true if the query
  * contains
@@ -2033,3 +2059,275 @@ JoinRestrictionListExistsInContext(JoinRestriction *joinRestrictionInput,
 
 	return false;
 }
+
+
+/*
+ * RestrictionClausesForRelation returns the clauses that the planner applied
+ * when scanning the given relation of the query that is being planned, such
+ * that their columns refer to the given range table index. The clauses include
+ * the ones that the planner derived from its own equivalence classes or pushed
+ * down from outer query levels.
+ *
+ * When includeEquivalentRestrictions is set, the function also returns the
+ * clauses on the distribution key of any other relation whose distribution key
+ * is equal to the distribution key of the given relation through inner joins,
+ * rewritten to refer to the distribution key of the given relation. For
+ * instance, for t1.key = t2.key AND t2.key IN (1, 2), it returns t1.key IN (1, 2)
+ * for t1, which the planner itself does not derive.
+ *
+ * Clauses that contain parameters, subqueries or volatile functions are skipped,
+ * so the returned clauses can be evaluated on their own.
+ */
+List *
+RestrictionClausesForRelation(RangeTblEntry *rangeTableEntry, Index rangeTableIndex,
+							  PlannerRestrictionContext *plannerRestrictionContext,
+							  bool includeEquivalentRestrictions)
+{
+	RelationRestrictionContext *relationRestrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
+	List *restrictionList = NIL;
+	ListCell *attributeEquivalenceCell = NULL;
+
+	if (relationRestrictionContext == NULL)
+	{
+		return NIL;
+	}
+
+	int rteIdentity = GetRTEIdentity(rangeTableEntry);
+	RelationRestriction *relationRestriction =
+		RelationRestrictionForRteIdentity(relationRestrictionContext, rteIdentity);
+	if (relationRestriction == NULL)
+	{
+		return NIL;
+	}
+
+	restrictionList = AddRelationRestrictionClauses(restrictionList, relationRestriction,
+													InvalidAttrNumber, rangeTableIndex,
+													InvalidAttrNumber);
+
+	if (!includeEquivalentRestrictions || !IsCitusTable(rangeTableEntry->relid))
+	{
+		return restrictionList;
+	}
+
+	Var *partitionColumn = DistPartitionKey(rangeTableEntry->relid);
+	if (partitionColumn == NULL)
+	{
+		return restrictionList;
+	}
+
+	/*
+	 * A restriction on one side of an outer join does not restrict the rows of
+	 * the other side, so we only follow the equalities of inner joins.
+	 */
+	PlannerRestrictionContext *innerJoinRestrictionContext =
+		palloc0(sizeof(PlannerRestrictionContext));
+	*innerJoinRestrictionContext = *plannerRestrictionContext;
+	innerJoinRestrictionContext->joinRestrictionContext =
+		InnerJoinRestrictionContext(plannerRestrictionContext->joinRestrictionContext);
+
+	List *attributeEquivalenceList =
+		GenerateAllAttributeEquivalences(innerJoinRestrictionContext);
+
+	AttributeEquivalenceClassMember *relationMember =
+		palloc0(sizeof(AttributeEquivalenceClassMember));
+	relationMember->relationId = rangeTableEntry->relid;
+	relationMember->rteIdentity = rteIdentity;
+	relationMember->varno = rangeTableIndex;
+	relationMember->varattno = partitionColumn->varattno;
+
+	AttributeEquivalenceClass *relationEquivalenceClass =
+		palloc0(sizeof(AttributeEquivalenceClass));
+	relationEquivalenceClass->equivalentAttributes = list_make1(relationMember);
+
+	AddTransitiveEquivalences(relationEquivalenceClass, attributeEquivalenceList);
+
+	foreach(attributeEquivalenceCell, relationEquivalenceClass->equivalentAttributes)
+	{
+		AttributeEquivalenceClassMember *equivalentMember =
+			(AttributeEquivalenceClassMember *) lfirst(attributeEquivalenceCell);
+
+		if (equivalentMember->rteIdentity == rteIdentity)
+		{
+			continue;
+		}
+
+		/* only rewrite the clauses when the columns are interchangeable */
+		Var *equivalentColumn = DistPartitionKey(equivalentMember->relationId);
+		if (equivalentColumn == NULL ||
+			equivalentColumn->vartype != partitionColumn->vartype ||
+			equivalentColumn->vartypmod != partitionColumn->vartypmod ||
+			equivalentColumn->varcollid != partitionColumn->varcollid)
+		{
+			continue;
+		}
+
+		RelationRestriction *equivalentRestriction =
+			RelationRestrictionForRteIdentity(relationRestrictionContext,
+											  equivalentMember->rteIdentity);
+		if (equivalentRestriction == NULL)
+		{
+			continue;
+		}
+
+		restrictionList = AddRelationRestrictionClauses(restrictionList,
+														equivalentRestriction,
+														equivalentMember->varattno,
+														rangeTableIndex,
+														partitionColumn->varattno);
+	}
+
+	return restrictionList;
+}
+
+
+/*
+ * RelationRestrictionForRteIdentity returns the restriction of the relation
+ * with the given rteIdentity. Inheritance children of a relation share the
+ * rteIdentity of their parent, so we only consider the restriction of the
+ * parent. If the relation is planned more than once, for instance since it
+ * appears in a UNION ALL that the planner flattened, we cannot tell which
+ * restriction applies and return NULL.
+ */
+static RelationRestriction *
+RelationRestrictionForRteIdentity(RelationRestrictionContext *relationRestrictionContext,
+								  int rteIdentity)
+{
+	RelationRestriction *foundRestriction = NULL;
+	ListCell *relationRestrictionCell = NULL;
+
+	foreach(relationRestrictionCell, relationRestrictionContext->relationRestrictionList)
+	{
+		RelationRestriction *relationRestriction =
+			(RelationRestriction *) lfirst(relationRestrictionCell);
+
+		if (GetRTEIdentity(relationRestriction->rte) != rteIdentity ||
+			relationRestriction->relOptInfo->reloptkind != RELOPT_BASEREL)
+		{
+			continue;
+		}
+
+		if (foundRestriction != NULL)
+		{
+			return NULL;
+		}
+
+		foundRestriction = relationRestriction;
+	}
+
+	return foundRestriction;
+}
+
+
+/*
+ * InnerJoinRestrictionContext returns a join restriction context that only
+ * contains the inner join restrictions of the given context.
+ */
+static JoinRestrictionContext *
+InnerJoinRestrictionContext(JoinRestrictionContext *joinRestrictionContext)
+{
+	JoinRestrictionContext *innerJoinRestrictionContext =
+		palloc0(sizeof(JoinRestrictionContext));
+	ListCell *joinRestrictionCell = NULL;
+
+	if (joinRestrictionContext == NULL)
+	{
+		return innerJoinRestrictionContext;
+	}
+
+	foreach(joinRestrictionCell, joinRestrictionContext->joinRestrictionList)
+	{
+		JoinRestriction *joinRestriction = lfirst(joinRestrictionCell);
+
+		if (joinRestriction->joinType == JOIN_INNER)
+		{
+			innerJoinRestrictionContext->joinRestrictionList =
+				lappend(innerJoinRestrictionContext->joinRestrictionList,
+						joinRestriction);
+		}
+	}
+
+	return innerJoinRestrictionContext;
+}
+
+
+/*
+ * AddRelationRestrictionClauses appends copies of the base restriction clauses
+ * of the given relation restriction to the list, unless an equal clause is
+ * already in the list. The columns of the copies refer to the target range
+ * table index.
+ *
+ * If sourceAttributeNumber is set, only the clauses that reference no other
+ * column are added, and their column is replaced by the target attribute.
+ */
+static List *
+AddRelationRestrictionClauses(List *restrictionList,
+							  RelationRestriction *relationRestriction,
+							  AttrNumber sourceAttributeNumber,
+							  Index targetRangeTableIndex,
+							  AttrNumber targetAttributeNumber)
+{
+	List *baseRestrictInfoList = relationRestriction->relOptInfo->baserestrictinfo;
+	ListCell *restrictInfoCell = NULL;
+
+	foreach(restrictInfoCell, baseRestrictInfoList)
+	{
+		RestrictInfo *restrictInfo = (RestrictInfo *) lfirst(restrictInfoCell);
+		Node *restrictionClause = (Node *) restrictInfo->clause;
+		bool pushableClause = true;
+		ListCell *columnCell = NULL;
+
+		if (restrictInfo->pseudoconstant ||
+			contain_subplans(restrictionClause) ||
+			contain_volatile_functions(restrictionClause) ||
+			FindNodeCheck(restrictionClause, IsParam))
+		{
+			continue;
+		}
+
+		Node *copiedClause = copyObject(restrictionClause);
+		List *columnList = pull_var_clause(copiedClause, PVC_INCLUDE_PLACEHOLDERS);
+
+		foreach(columnCell, columnList)
+		{
+			Var *column = (Var *) lfirst(columnCell);
+
+			if (!IsA(column, Var) || column->varno != relationRestriction->index ||
+				column->varattno <= InvalidAttrNumber ||
+				(sourceAttributeNumber != InvalidAttrNumber &&
+				 column->varattno != sourceAttributeNumber))
+			{
+				pushableClause = false;
+				break;
+			}
+
+			column->varno = targetRangeTableIndex;
+			column->varnoold = targetRangeTableIndex;
+
+			if (targetAttributeNumber != InvalidAttrNumber)
+			{
+				column->varattno = targetAttributeNumber;
+				column->varoattno = targetAttributeNumber;
+			}
+		}
+
+		if (!pushableClause || columnList == NIL)
+		{
+			continue;
+		}
+
+		restrictionList = list_append_unique(restrictionList, copiedClause);
+	}
+
+	return restrictionList;
+}
+
+
+/*
+ * IsParam returns true if the given node is a Param.
+ */
+static bool
+IsParam(Node *node)
+{
+	return IsA(node, Param);
+}
@@ -0,0 +1,379 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartitioned_aggregation.c
+ *    Planning GROUP BY queries and window functions that are not partitioned
+ *    by the distribution column by repartitioning their input across the
+ *    workers.
+ *
+ * When a query on a distributed table groups by columns other than the
+ * distribution column, the workers compute partial aggregates per shard and
+ * the coordinator combines the partial aggregates of all shards. With many
+ * distinct groups, the coordinator becomes the bottleneck for both memory and
+ * CPU.
+ *
+ * When citus.enable_repartitioned_aggregation is on, we instead move the
+ * grouping into a subquery in the FROM clause, which the logical planner
+ * plans as a repartition job (see TransformSubqueryNode): the workers
+ * partition their partial aggregates by the first GROUP BY expression, the
+ * partial aggregates of each partition are combined on a worker, and only
+ * the final groups are sent to the coordinator, which applies the ORDER BY
+ * and LIMIT of the original query. Since all rows of a group end up in the
+ * same partition, this also distributes the work of count(DISTINCT) on
+ * columns other than the distribution column.
+ *
+ * Similarly, when citus.enable_repartitioned_window_functions is on, window
+ * functions that are not partitioned by the distribution column move into a
+ * subquery. The workers then partition the rows of the table by a column
+ * that appears in the PARTITION BY of all windows, so that every window
+ * partition ends up on a single worker. The window functions are computed in
+ * the reduce query on the workers, rather than on the coordinator over all
+ * rows of the table.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_optimizer.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/query_pushdown_planning.h"
+#include "distributed/query_utils.h"
+#include "distributed/repartitioned_aggregation.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "parser/parsetree.h"
+
+
+/* alias of the subquery that contains the grouping of the original query */
+#define REPARTITIONED_AGGREGATION_ALIAS "repartitioned_aggregation"
+
+/* alias of the subquery that contains the window functions of the original query */
+#define REPARTITIONED_WINDOW_ALIAS "repartitioned_window"
+
+
+/* config variables managed via guc.c */
+bool EnableRepartitionedAggregation = false;
+bool EnableRepartitionedWindowFunctions = false;
+
+
+static void WrapQueryForRepartitioning(Query *query, char *aliasName,
+									   char *columnNameFormat);
+static bool ShouldRepartitionAggregation(Query *query);
+static bool ShouldRepartitionWindowFunctions(Query *query);
+static Index SingleDistributedTableIndex(Query *query);
+
+
+/*
+ * WrapGroupingForRepartitionedAggregation moves the grouping of the given
+ * query into a subquery if the aggregation should be repartitioned, such that
+ * the query is planned as a repartitioned subquery. The ORDER BY, LIMIT and
+ * OFFSET clauses stay in the outer query. The query is modified in place,
+ * and the function returns whether it did so.
+ */
+bool
+WrapGroupingForRepartitionedAggregation(Query *query)
+{
+	if (!ShouldRepartitionAggregation(query))
+	{
+		return false;
+	}
+
+	WrapQueryForRepartitioning(query, REPARTITIONED_AGGREGATION_ALIAS,
+							   "grouping_column_%d");
+
+	return true;
+}
+
+
+/*
+ * WrapWindowFunctionsForRepartitioning moves the window functions of the
+ * given query into a subquery if the input of the window functions should be
+ * repartitioned, such that the query is planned as a repartitioned subquery.
+ * The ORDER BY, LIMIT and OFFSET clauses stay in the outer query. The query
+ * is modified in place, and the function returns whether it did so.
+ */
+bool
+WrapWindowFunctionsForRepartitioning(Query *query)
+{
+	if (!ShouldRepartitionWindowFunctions(query))
+	{
+		return false;
+	}
+
+	WrapQueryForRepartitioning(query, REPARTITIONED_WINDOW_ALIAS, "window_column_%d");
+
+	return true;
+}
+
+
+/*
+ * WrapQueryForRepartitioning replaces the given query by a query that selects
+ * from the original query without its ORDER BY, LIMIT and OFFSET clauses, and
+ * applies those clauses instead. Columns without a name are named using the
+ * given format and their position in the target list.
+ */
+static void
+WrapQueryForRepartitioning(Query *query, char *aliasName, char *columnNameFormat)
+{
+	List *innerTargetList = NIL;
+	List *outerTargetList = NIL;
+	List *columnNameList = NIL;
+	Index subqueryRangeTableIndex = 1;
+
+	Query *innerQuery = palloc(sizeof(Query));
+	*innerQuery = *query;
+	innerQuery->sortClause = NIL;
+	innerQuery->limitOffset = NULL;
+	innerQuery->limitCount = NULL;
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, query->targetList)
+	{
+		/* columns that only appear in the ORDER BY are needed by the outer query */
+		TargetEntry *innerTargetEntry = flatCopyTargetEntry(targetEntry);
+		innerTargetEntry->resjunk = false;
+
+		if (innerTargetEntry->resname == NULL)
+		{
+			innerTargetEntry->resname = psprintf(columnNameFormat,
+													innerTargetEntry->resno);
+		}
+
+		innerTargetList = lappend(innerTargetList, innerTargetEntry);
+		columnNameList = lappend(columnNameList,
+								 makeString(innerTargetEntry->resname));
+
+		Var *column = makeVarFromTargetEntry(subqueryRangeTableIndex,
+											 innerTargetEntry);
+		TargetEntry *outerTargetEntry = makeTargetEntry((Expr *) column,
+														targetEntry->resno,
+														targetEntry->resname,
+														targetEntry->resjunk);
+		outerTargetEntry->ressortgroupref = targetEntry->ressortgroupref;
+
+		outerTargetList = lappend(outerTargetList, outerTargetEntry);
+	}
+
+	innerQuery->targetList = innerTargetList;
+
+	RangeTblEntry *subqueryRangeTableEntry = makeNode(RangeTblEntry);
+	subqueryRangeTableEntry->rtekind = RTE_SUBQUERY;
+	subqueryRangeTableEntry->subquery = innerQuery;
+	subqueryRangeTableEntry->eref = makeAlias(aliasName, columnNameList);
+	subqueryRangeTableEntry->inh = false;
+	subqueryRangeTableEntry->inFromCl = true;
+
+	RangeTblRef *subqueryRangeTableRef = makeNode(RangeTblRef);
+	subqueryRangeTableRef->rtindex = subqueryRangeTableIndex;
+
+	Query *outerQuery = makeNode(Query);
+	outerQuery->commandType = CMD_SELECT;
+	outerQuery->querySource = query->querySource;
+	outerQuery->queryId = query->queryId;
+	outerQuery->canSetTag = query->canSetTag;
+	outerQuery->rtable = list_make1(subqueryRangeTableEntry);
+	outerQuery->jointree = makeFromExpr(list_make1(subqueryRangeTableRef), NULL);
+	outerQuery->targetList = outerTargetList;
+	outerQuery->sortClause = query->sortClause;
+	outerQuery->limitOffset = query->limitOffset;
+	outerQuery->limitCount = query->limitCount;
+	outerQuery->stmt_location = query->stmt_location;
+	outerQuery->stmt_len = query->stmt_len;
+
+	*query = *outerQuery;
+}
+
+
+/*
+ * ShouldRepartitionAggregation returns whether the given query groups a single
+ * distributed table by something other than its distribution column, in a way
+ * that the grouping can be planned as a repartitioned subquery.
+ */
+static bool
+ShouldRepartitionAggregation(Query *query)
+{
+	if (!EnableRepartitionedAggregation)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || !query->hasAggs ||
+		query->groupClause == NIL)
+	{
+		return false;
+	}
+
+	Index rangeTableIndex = SingleDistributedTableIndex(query);
+	if (rangeTableIndex == 0)
+	{
+		return false;
+	}
+
+	/* groups on the distribution column can be pushed down as a whole */
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+	Var *partitionColumn = PartitionColumn(rangeTableEntry->relid, rangeTableIndex);
+	if (GroupedByColumn(query->groupClause, query->targetList, partitionColumn))
+	{
+		return false;
+	}
+
+	/* the partial aggregates are partitioned by the first GROUP BY expression */
+	List *groupTargetEntryList = GroupTargetEntryList(query->groupClause,
+													  query->targetList);
+	TargetEntry *groupTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
+	if (!IsA(groupTargetEntry->expr, Var) && !IsA(groupTargetEntry->expr, FuncExpr))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldRepartitionWindowFunctions returns whether the given query computes
+ * window functions over the rows of a single distributed table that cannot be
+ * pushed down, in a way that they can be planned as a repartitioned subquery.
+ */
+static bool
+ShouldRepartitionWindowFunctions(Query *query)
+{
+	if (query->commandType != CMD_SELECT || !query->hasWindowFuncs)
+	{
+		return false;
+	}
+
+	/* windows partitioned by the distribution column can be pushed down as a whole */
+	if (SafeToPushdownWindowFunction(query, NULL))
+	{
+		return false;
+	}
+
+	/* also checks citus.enable_repartitioned_window_functions */
+	if (!CanRepartitionWindowFunctions(query))
+	{
+		return false;
+	}
+
+	return SingleDistributedTableIndex(query) != 0;
+}
+
+
+/*
+ * CanRepartitionWindowFunctions returns whether the window functions of the
+ * given query can be computed in the reduce query of a repartitioned subquery,
+ * which requires a column to partition the rows by that appears in the
+ * PARTITION BY of all windows. We do not combine repartitioning the rows with
+ * aggregation, since the windows are then computed over the groups.
+ */
+bool
+CanRepartitionWindowFunctions(Query *query)
+{
+	if (!EnableRepartitionedWindowFunctions)
+	{
+		return false;
+	}
+
+	if (query->hasAggs || query->groupClause != NIL || query->havingQual != NULL)
+	{
+		return false;
+	}
+
+	return WindowPartitionColumn(query->windowClause, query->targetList) != NULL;
+}
+
+
+/*
+ * WindowPartitionColumn returns a column that appears in the PARTITION BY of
+ * all of the given windows, such that each window partition consists of rows
+ * that have the same value for the column. If there is no such column, the
+ * function returns NULL.
+ */
+Var *
+WindowPartitionColumn(List *windowClauseList, List *targetList)
+{
+	if (windowClauseList == NIL)
+	{
+		return NULL;
+	}
+
+	WindowClause *firstWindowClause = (WindowClause *) linitial(windowClauseList);
+	List *partitionTargetEntryList =
+		GroupTargetEntryList(firstWindowClause->partitionClause, targetList);
+
+	TargetEntry *partitionTargetEntry = NULL;
+	foreach_ptr(partitionTargetEntry, partitionTargetEntryList)
+	{
+		bool inAllWindows = true;
+
+		if (!IsA(partitionTargetEntry->expr, Var))
+		{
+			continue;
+		}
+
+		WindowClause *windowClause = NULL;
+		foreach_ptr(windowClause, windowClauseList)
+		{
+			List *windowTargetEntryList =
+				GroupTargetEntryList(windowClause->partitionClause, targetList);
+
+			if (!list_member_ptr(windowTargetEntryList, partitionTargetEntry))
+			{
+				inAllWindows = false;
+				break;
+			}
+		}
+
+		if (inAllWindows)
+		{
+			return (Var *) partitionTargetEntry->expr;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * SingleDistributedTableIndex returns the range table index of the distributed
+ * table if the given query selects from a single distributed table in a way
+ * that the query can be planned as a repartitioned subquery, and 0 otherwise.
+ */
+static Index
+SingleDistributedTableIndex(Query *query)
+{
+	List *rangeTableIndexList = NIL;
+
+	/* the inner query should pass DeferErrorIfUnsupportedSubqueryRepartition */
+	if (query->groupingSets != NIL || query->distinctClause != NIL ||
+		query->hasTargetSRFs || query->cteList != NIL || query->rowMarks != NIL ||
+		query->setOperations != NULL)
+	{
+		return 0;
+	}
+
+	if (!SingleRelationRepartitionSubquery(query))
+	{
+		return 0;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) query->jointree, &rangeTableIndexList);
+	int rangeTableIndex = linitial_int(rangeTableIndexList);
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTable(rangeTableEntry->relid))
+	{
+		return 0;
+	}
+
+	if (PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+	{
+		return 0;
+	}
+
+	return rangeTableIndex;
+}
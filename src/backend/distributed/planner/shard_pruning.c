@@ -57,6 +57,16 @@
  * 4) If there are overlapping shards, exhaustively search all shards that are
  *    not excluded by constraints
  *
+ * A WHERE clause whose only restriction on the partition column of a hash
+ * distributed table is partcol = ANY(<constant array>) skips all of the above.
+ * Instead of creating a pruning instance per array element, the elements are
+ * hashed and mapped to their shards in a single pass over the array.
+ *
+ * For hash distributed tables, a pruning instance without an equality
+ * constraint normally matches all shards. If the partition column has an
+ * integer or date type and the instance restricts it to a short range of
+ * values, the values in the range are hashed instead.
+ *
  * Finally, the union of the shards found by each pruning instance is
  * returned.
  *
@@ -93,11 +103,17 @@
 #include "parser/parse_coerce.h"
 #include "utils/arrayaccess.h"
 #include "utils/catcache.h"
+#include "utils/date.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/ruleutils.h"
 
 
+/* GUC, maximum number of values in a range that are hashed for pruning */
+int MaxRangePruningValues = 0;
+
+
 /*
  * Tree node for compact representation of the given query logical tree.
  * Represent a single boolean operator node and its associated
@@ -260,6 +276,13 @@ static Const * TransformPartitionRestrictionValue(Var *partitionColumn,
 static void AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 													ScalarArrayOpExpr *
 													arrayOperatorExpression);
+static ScalarArrayOpExpr * SingleArrayRestriction(List *whereClauseList,
+												  Var *partitionColumn);
+static bool IsArrayRestriction(Node *clause, Var *partitionColumn);
+static bool ReferencesPartitionColumnWalker(Node *node, Var *partitionColumn);
+static List * PruneShardsForArrayRestriction(CitusTableCacheEntry *cacheEntry,
+											 ScalarArrayOpExpr *arrayRestriction,
+											 Const **partitionValueConst);
 static bool SAORestrictions(ScalarArrayOpExpr *arrayOperatorExpression,
 							Var *partitionColumn,
 							List **requestedRestrictions);
@@ -274,11 +297,24 @@ static int PerformValueCompare(FunctionCallInfo compareFunctionCall, Datum a,
 							   Datum b);
 static int PerformCompare(FunctionCallInfo compareFunctionCall);
 
+static bool PruneHashRange(CitusTableCacheEntry *cacheEntry, PruningInstance *prune,
+						   List **prunedList);
+static bool RangeBoundaryValue(Const *boundaryConst, int64 *value);
+static Datum RangeValueDatum(Oid typeId, int64 value);
 static List * PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 					   PruningInstance *prune);
 static List * PruneWithBoundaries(CitusTableCacheEntry *cacheEntry,
 								  ClauseWalkerContext *context,
 								  PruningInstance *prune);
+static List * PruneOverlappingWithBoundaries(CitusTableCacheEntry *cacheEntry,
+											 ClauseWalkerContext *context,
+											 PruningInstance *prune);
+static int CountShardsWithMinValueAtMost(Datum value,
+										 ShardInterval **sortedShardIntervalArray,
+										 int shardCount,
+										 FunctionCallInfo compareFunction);
+static int FirstShardWithMaxValueAtLeast(Datum value, CitusTableCacheEntry *cacheEntry,
+										 FunctionCallInfo compareFunction);
 static List * ExhaustivePrune(CitusTableCacheEntry *cacheEntry,
 							  ClauseWalkerContext *context,
 							  PruningInstance *prune);
@@ -286,13 +322,11 @@ static bool ExhaustivePruneOne(ShardInterval *curInterval,
 							   ClauseWalkerContext *context,
 							   PruningInstance *prune);
 static int UpperShardBoundary(Datum partitionColumnValue,
-							  ShardInterval **shardIntervalCache,
-							  int shardCount, FunctionCallInfo compareFunction,
-							  bool includeMin);
+							  CitusTableCacheEntry *cacheEntry,
+							  FunctionCallInfo compareFunction, bool includeMin);
 static int LowerShardBoundary(Datum partitionColumnValue,
-							  ShardInterval **shardIntervalCache,
-							  int shardCount, FunctionCallInfo compareFunction,
-							  bool includeMax);
+							  CitusTableCacheEntry *cacheEntry,
+							  FunctionCallInfo compareFunction, bool includeMax);
 static PruningTreeNode * CreatePruningNode(BoolExprType boolop);
 static OpExpr * SAORestrictionArrayEqualityOp(ScalarArrayOpExpr *arrayOperatorExpression,
 											  Var *partitionColumn);
@@ -350,6 +384,30 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	context.partitionColumn = PartitionColumn(relationId, rangeTableId);
 	context.currentPruningInstance = palloc0(sizeof(PruningInstance));
 
+	/*
+	 * Large IN lists on the distribution column are common, and pruning them
+	 * as one pruning instance per element is slow. Use a single pass over the
+	 * array instead, unless we want to log the individual pruning instances.
+	 */
+	if (partitionMethod == DISTRIBUTE_BY_HASH &&
+		!cacheEntry->hasOverlappingShardInterval &&
+		!IsLoggableLevel(DEBUG3))
+	{
+		ScalarArrayOpExpr *arrayRestriction =
+			SingleArrayRestriction(whereClauseList, context.partitionColumn);
+		if (arrayRestriction != NULL)
+		{
+			prunedList = PruneShardsForArrayRestriction(cacheEntry, arrayRestriction,
+														partitionValueConst);
+
+			/*
+			 * Deep copy list, so it's independent of the CitusTableCacheEntry
+			 * contents.
+			 */
+			return DeepCopyShardIntervalList(prunedList);
+		}
+	}
+
 	if (cacheEntry->shardIntervalCompareFunction)
 	{
 		/* initiate function call info once (allows comparators to cache metadata) */
@@ -422,14 +480,25 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 			break;
 		}
 
+		List *pruneOneList = NIL;
+		bool prunedHashRange = false;
+
 		if (context.partitionMethod == DISTRIBUTE_BY_HASH)
 		{
 			if (!prune->evaluatesToFalse && !prune->equalConsts &&
 				!prune->hashedEqualConsts)
 			{
-				/* if hash-partitioned and no equals constraints, return all shards */
-				foundRestriction = false;
-				break;
+				prunedHashRange = PruneHashRange(cacheEntry, prune, &pruneOneList);
+				if (!prunedHashRange)
+				{
+					/* if hash-partitioned and no equals constraints, return all shards */
+					foundRestriction = false;
+					break;
+				}
+
+				/* the range may contain multiple partition column values */
+				singlePartitionValueConst = NULL;
+				foundPartitionColumnValue = true;
 			}
 			else if (partitionValueConst != NULL && prune->equalConsts != NULL)
 			{
@@ -451,7 +520,10 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 			}
 		}
 
-		List *pruneOneList = PruneOne(cacheEntry, &context, prune);
+		if (!prunedHashRange)
+		{
+			pruneOneList = PruneOne(cacheEntry, &context, prune);
+		}
 
 		if (prunedList)
 		{
@@ -523,6 +595,207 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 }
 
 
+/*
+ * PruneHashRange finds the shards of a hash distributed table that match a
+ * pruning instance that restricts the partition column to a range of values,
+ * by hashing each value in the range. It returns false if the partition
+ * column type is not an integer or date type, if the range is not bounded on
+ * both sides, or if it has more than citus.max_range_pruning_values values.
+ */
+static bool
+PruneHashRange(CitusTableCacheEntry *cacheEntry, PruningInstance *prune,
+			   List **prunedList)
+{
+	int64 lowerValue = 0;
+	int64 upperValue = 0;
+	int64 boundaryValue = 0;
+	bool hasLowerBound = false;
+	bool hasUpperBound = false;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	int includedShardCount = 0;
+
+	if (MaxRangePruningValues <= 0)
+	{
+		return false;
+	}
+
+	if (RangeBoundaryValue(prune->greaterEqualConsts, &boundaryValue))
+	{
+		lowerValue = boundaryValue;
+		hasLowerBound = true;
+	}
+
+	if (RangeBoundaryValue(prune->greaterConsts, &boundaryValue))
+	{
+		if (boundaryValue == PG_INT64_MAX)
+		{
+			/* nothing is greater, we keep it simple and do not prune */
+			return false;
+		}
+
+		if (!hasLowerBound || boundaryValue + 1 > lowerValue)
+		{
+			lowerValue = boundaryValue + 1;
+			hasLowerBound = true;
+		}
+	}
+
+	if (RangeBoundaryValue(prune->lessEqualConsts, &boundaryValue))
+	{
+		upperValue = boundaryValue;
+		hasUpperBound = true;
+	}
+
+	if (RangeBoundaryValue(prune->lessConsts, &boundaryValue))
+	{
+		if (boundaryValue == PG_INT64_MIN)
+		{
+			return false;
+		}
+
+		if (!hasUpperBound || boundaryValue - 1 < upperValue)
+		{
+			upperValue = boundaryValue - 1;
+			hasUpperBound = true;
+		}
+	}
+
+	if (!hasLowerBound || !hasUpperBound)
+	{
+		return false;
+	}
+
+	if (upperValue < lowerValue)
+	{
+		/* the range is empty */
+		*prunedList = NIL;
+		return true;
+	}
+
+	/* unsigned subtraction cannot overflow for the full bigint range */
+	if ((uint64) upperValue - (uint64) lowerValue >= (uint64) MaxRangePruningValues)
+	{
+		return false;
+	}
+
+	Oid partitionTypeId = cacheEntry->partitionColumn->vartype;
+	bool *shardIncluded = palloc0(shardCount * sizeof(bool));
+
+	for (int64 value = lowerValue; includedShardCount < shardCount; value++)
+	{
+		Datum valueDatum = RangeValueDatum(partitionTypeId, value);
+		ShardInterval *shardInterval = FindShardInterval(valueDatum, cacheEntry);
+
+		if (shardInterval != NULL && !shardIncluded[shardInterval->shardIndex])
+		{
+			shardIncluded[shardInterval->shardIndex] = true;
+			includedShardCount++;
+		}
+
+		/* checked here, since upperValue + 1 could overflow */
+		if (value == upperValue)
+		{
+			break;
+		}
+	}
+
+	*prunedList = NIL;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		if (shardIncluded[shardIndex])
+		{
+			*prunedList = lappend(*prunedList,
+								  cacheEntry->sortedShardIntervalArray[shardIndex]);
+		}
+	}
+
+	pfree(shardIncluded);
+
+	return true;
+}
+
+
+/*
+ * RangeBoundaryValue writes the value of the given range boundary to value
+ * and returns true if the boundary is set and has an integer or date type.
+ * The boundaries of a pruning instance have the type of the partition column.
+ */
+static bool
+RangeBoundaryValue(Const *boundaryConst, int64 *value)
+{
+	if (boundaryConst == NULL)
+	{
+		return false;
+	}
+
+	switch (boundaryConst->consttype)
+	{
+		case INT2OID:
+		{
+			*value = DatumGetInt16(boundaryConst->constvalue);
+			return true;
+		}
+
+		case INT4OID:
+		{
+			*value = DatumGetInt32(boundaryConst->constvalue);
+			return true;
+		}
+
+		case INT8OID:
+		{
+			*value = DatumGetInt64(boundaryConst->constvalue);
+			return true;
+		}
+
+		case DATEOID:
+		{
+			*value = DatumGetDateADT(boundaryConst->constvalue);
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * RangeValueDatum returns the datum of the given type, one of the types
+ * accepted by RangeBoundaryValue, for a value in a range.
+ */
+static Datum
+RangeValueDatum(Oid typeId, int64 value)
+{
+	switch (typeId)
+	{
+		case INT2OID:
+		{
+			return Int16GetDatum((int16) value);
+		}
+
+		case INT4OID:
+		{
+			return Int32GetDatum((int32) value);
+		}
+
+		case DATEOID:
+		{
+			return DateADTGetDatum((DateADT) value);
+		}
+
+		default:
+		{
+			Assert(typeId == INT8OID);
+			return Int64GetDatum(value);
+		}
+	}
+}
+
+
 /*
  * IsValidConditionNode checks whether node is a valid constraint for pruning.
  */
@@ -956,6 +1229,190 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 }
 
 
+/*
+ * SingleArrayRestriction returns the partcol = ANY(<constant array>) clause
+ * in whereClauseList if it is the only clause that restricts the partition
+ * column, directly or via its hashed value. Otherwise it returns NULL.
+ */
+static ScalarArrayOpExpr *
+SingleArrayRestriction(List *whereClauseList, Var *partitionColumn)
+{
+	ScalarArrayOpExpr *arrayRestriction = NULL;
+
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		if (arrayRestriction == NULL && IsArrayRestriction(clause, partitionColumn))
+		{
+			arrayRestriction = (ScalarArrayOpExpr *) clause;
+		}
+		else if (ReferencesPartitionColumnWalker(clause, partitionColumn))
+		{
+			/* other restrictions on the partition column need the general path */
+			return NULL;
+		}
+	}
+
+	return arrayRestriction;
+}
+
+
+/*
+ * IsArrayRestriction returns whether the clause is of the form
+ * partcol = ANY(<non-NULL constant array>), with an array of the type of the
+ * partition column.
+ */
+static bool
+IsArrayRestriction(Node *clause, Var *partitionColumn)
+{
+	if (!IsA(clause, ScalarArrayOpExpr))
+	{
+		return false;
+	}
+
+	ScalarArrayOpExpr *arrayOperatorExpression = (ScalarArrayOpExpr *) clause;
+	Node *leftOpExpression = linitial(arrayOperatorExpression->args);
+	Node *strippedLeftOpExpression = strip_implicit_coercions(leftOpExpression);
+	Node *arrayArgument = lsecond(arrayOperatorExpression->args);
+
+	if (!arrayOperatorExpression->useOr ||
+		!OperatorImplementsEquality(arrayOperatorExpression->opno) ||
+		!equal(strippedLeftOpExpression, partitionColumn) ||
+		!IsA(arrayArgument, Const))
+	{
+		return false;
+	}
+
+	Const *arrayConst = (Const *) arrayArgument;
+	if (arrayConst->constisnull)
+	{
+		return false;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+
+	return ARR_ELEMTYPE(array) == partitionColumn->vartype;
+}
+
+
+/*
+ * ReferencesPartitionColumnWalker returns whether the expression references the
+ * partition column, or the hashed value of the partition column. Subqueries
+ * are not searched, since they cannot restrict the partition column.
+ */
+static bool
+ReferencesPartitionColumnWalker(Node *node, Var *partitionColumn)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Var))
+	{
+		Var *var = (Var *) node;
+
+		return var->varno == partitionColumn->varno &&
+			   var->varlevelsup == 0 &&
+			   (var->varattno == partitionColumn->varattno ||
+				var->varattno == RESERVED_HASHED_COLUMN_ID);
+	}
+
+	if (IsA(node, Query))
+	{
+		return false;
+	}
+
+	return expression_tree_walker(node, ReferencesPartitionColumnWalker,
+								  partitionColumn);
+}
+
+
+/*
+ * PruneShardsForArrayRestriction returns the shards that contain any of the
+ * elements of the constant array in the partcol = ANY(array) restriction of a
+ * hash distributed table, in the order in which the elements first map to
+ * them. The elements are hashed and mapped to a shard index in a single pass.
+ *
+ * When the array contains a single distinct non-NULL value, the value is
+ * written to the partitionValueConst pointer, as PruneShards() does for
+ * equality restrictions.
+ */
+static List *
+PruneShardsForArrayRestriction(CitusTableCacheEntry *cacheEntry,
+							   ScalarArrayOpExpr *arrayRestriction,
+							   Const **partitionValueConst)
+{
+	Const *arrayConst = (Const *) lsecond(arrayRestriction->args);
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	Oid elementType = ARR_ELEMTYPE(array);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	int16 typlen = 0;
+	bool typbyval = false;
+	char typalign = ' ';
+	Datum arrayElement = 0;
+	bool isNull = false;
+	Datum firstValue = 0;
+	bool foundValue = false;
+	bool singleValue = true;
+	List *prunedList = NIL;
+
+	get_typlenbyvalalign(elementType, &typlen, &typbyval, &typalign);
+
+	bool *shardIncluded = palloc0(shardCount * sizeof(bool));
+
+	ArrayIterator arrayIterator = array_create_iterator(array, 0, NULL);
+	while (array_iterate(arrayIterator, &arrayElement, &isNull))
+	{
+		/* a value is never equal to NULL */
+		if (isNull)
+		{
+			continue;
+		}
+
+		if (!foundValue)
+		{
+			firstValue = arrayElement;
+			foundValue = true;
+		}
+		else if (singleValue &&
+				 !datumIsEqual(arrayElement, firstValue, typbyval, typlen))
+		{
+			singleValue = false;
+		}
+
+		ShardInterval *shardInterval = FindShardInterval(arrayElement, cacheEntry);
+		if (shardInterval == NULL || shardIncluded[shardInterval->shardIndex])
+		{
+			continue;
+		}
+
+		shardIncluded[shardInterval->shardIndex] = true;
+		prunedList = lappend(prunedList, shardInterval);
+	}
+
+	array_free_iterator(arrayIterator);
+	pfree(shardIncluded);
+
+	if (partitionValueConst != NULL)
+	{
+		if (foundValue && singleValue)
+		{
+			*partitionValueConst = makeConst(elementType, -1, arrayConst->constcollid,
+											 typlen, datumCopy(firstValue, typbyval,
+															   typlen),
+											 false, typbyval);
+		}
+		else
+		{
+			*partitionValueConst = NULL;
+		}
+	}
+
+	return prunedList;
+}
+
+
 /*
  * SAORestrictions checks whether an SAO constraint is valid.
  * Also obtains equality restrictions.
@@ -1476,9 +1933,6 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 	/*
 	 * Next method: binary search with fuzzy boundaries. Can't trivially do so
 	 * if shards have overlapping boundaries.
-	 *
-	 * TODO: If we kept shard intervals separately sorted by both upper and
-	 * lower boundaries, this should be possible?
 	 */
 	if (!cacheEntry->hasOverlappingShardInterval && (
 			prune->greaterConsts || prune->greaterEqualConsts ||
@@ -1487,6 +1941,18 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 		return PruneWithBoundaries(cacheEntry, context, prune);
 	}
 
+	/*
+	 * If shards overlap, binary search for the window of shards that can
+	 * intersect the range using the running maximum of the max values.
+	 */
+	if (cacheEntry->maxValuePrefixShardIndexArray != NULL && (
+			prune->equalConsts ||
+			prune->greaterConsts || prune->greaterEqualConsts ||
+			prune->lessConsts || prune->lessEqualConsts))
+	{
+		return PruneOverlappingWithBoundaries(cacheEntry, context, prune);
+	}
+
 	/*
 	 * Brute force: Check each shard.
 	 */
@@ -1531,14 +1997,36 @@ PerformValueCompare(FunctionCallInfo compareFunctionCall, Datum a, Datum b)
  * (if includeMax) or > partitionColumnValue.
  */
 static int
-LowerShardBoundary(Datum partitionColumnValue, ShardInterval **shardIntervalCache,
-				   int shardCount, FunctionCallInfo compareFunction, bool includeMax)
+LowerShardBoundary(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry,
+				   FunctionCallInfo compareFunction, bool includeMax)
 {
+	ShardInterval **shardIntervalCache = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
 	int lowerBoundIndex = 0;
 	int upperBoundIndex = shardCount;
 
 	Assert(shardCount != 0);
 
+	if (cacheEntry->sortedShardMinValues != NULL)
+	{
+		int64 searchedBound = ShardBoundValue(partitionColumnValue,
+											  cacheEntry->shardBoundTypeId);
+
+		/* the first interval that does not end before partitionValue */
+		lowerBoundIndex = ShardBoundIndex(cacheEntry->sortedShardMaxValues, shardCount,
+										  searchedBound, includeMax);
+
+		if (lowerBoundIndex < shardCount &&
+			cacheEntry->sortedShardMinValues[lowerBoundIndex] <= searchedBound)
+		{
+			/* found interval containing partitionValue */
+			return lowerBoundIndex;
+		}
+
+		/* skip the search below */
+		upperBoundIndex = lowerBoundIndex;
+	}
+
 	/* setup partitionColumnValue argument once */
 	fcSetArg(compareFunction, 0, partitionColumnValue);
 
@@ -1607,14 +2095,31 @@ LowerShardBoundary(Datum partitionColumnValue, ShardInterval **shardIntervalCach
  * (if includeMin) or < partitionColumnValue.
  */
 static int
-UpperShardBoundary(Datum partitionColumnValue, ShardInterval **shardIntervalCache,
-				   int shardCount, FunctionCallInfo compareFunction, bool includeMin)
+UpperShardBoundary(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry,
+				   FunctionCallInfo compareFunction, bool includeMin)
 {
+	ShardInterval **shardIntervalCache = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
 	int lowerBoundIndex = 0;
 	int upperBoundIndex = shardCount;
 
 	Assert(shardCount != 0);
 
+	if (cacheEntry->sortedShardMinValues != NULL)
+	{
+		int64 searchedBound = ShardBoundValue(partitionColumnValue,
+											  cacheEntry->shardBoundTypeId);
+
+		/*
+		 * The first interval that starts after partitionValue, the interval
+		 * before it is the one we are looking for, whether or not it contains
+		 * partitionValue. Skip the search below.
+		 */
+		upperBoundIndex = ShardBoundIndex(cacheEntry->sortedShardMinValues, shardCount,
+										  searchedBound, !includeMin);
+		lowerBoundIndex = upperBoundIndex;
+	}
+
 	/* setup partitionColumnValue argument once */
 	fcSetArg(compareFunction, 0, partitionColumnValue);
 
@@ -1751,8 +2256,7 @@ PruneWithBoundaries(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *conte
 	/* find lower bound */
 	if (hasLowerBound)
 	{
-		lowerBoundIdx = LowerShardBoundary(lowerBound, sortedShardIntervalArray,
-										   shardCount, compareFunctionCall,
+		lowerBoundIdx = LowerShardBoundary(lowerBound, cacheEntry, compareFunctionCall,
 										   lowerBoundInclusive);
 	}
 	else
@@ -1763,8 +2267,7 @@ PruneWithBoundaries(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *conte
 	/* find upper bound */
 	if (hasUpperBound)
 	{
-		upperBoundIdx = UpperShardBoundary(upperBound, sortedShardIntervalArray,
-										   shardCount, compareFunctionCall,
+		upperBoundIdx = UpperShardBoundary(upperBound, cacheEntry, compareFunctionCall,
 										   upperBoundInclusive);
 	}
 	else
@@ -1794,6 +2297,155 @@ PruneWithBoundaries(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *conte
 }
 
 
+/*
+ * PruneOverlappingWithBoundaries returns a list of shards matching the
+ * constraints of a PruningInstance for a table with overlapping shards. It
+ * only checks the shards whose min value is not above the upper bound of the
+ * constraints, starting from the first shard before which all max values are
+ * below the lower bound. Both are found with a binary search, since shards are
+ * sorted by min value and the running maximum of their max values is cached.
+ * Shards without min/max values can't be pruned and are always included.
+ */
+static List *
+PruneOverlappingWithBoundaries(CitusTableCacheEntry *cacheEntry,
+							   ClauseWalkerContext *context,
+							   PruningInstance *prune)
+{
+	List *remainingShardList = NIL;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	int initializedShardCount = cacheEntry->initializedShardIntervalCount;
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	Const *lowerBoundConst = NULL;
+	Const *upperBoundConst = NULL;
+	int lowerBoundIdx = 0;
+	int upperBoundIdx = initializedShardCount;
+	FunctionCallInfo compareFunctionCall = (FunctionCallInfo) &
+										   context->compareIntervalFunctionCall;
+
+	/*
+	 * Any of the constraints works for finding the window, since each shard in
+	 * the window is checked against all of them. Exclusive bounds are treated
+	 * as inclusive, which might only make the window one shard larger.
+	 */
+	if (prune->equalConsts)
+	{
+		lowerBoundConst = prune->equalConsts;
+		upperBoundConst = prune->equalConsts;
+	}
+	else
+	{
+		lowerBoundConst = prune->greaterEqualConsts ? prune->greaterEqualConsts :
+						  prune->greaterConsts;
+		upperBoundConst = prune->lessEqualConsts ? prune->lessEqualConsts :
+						  prune->lessConsts;
+	}
+
+	if (upperBoundConst != NULL)
+	{
+		upperBoundIdx = CountShardsWithMinValueAtMost(upperBoundConst->constvalue,
+													 sortedShardIntervalArray,
+													 initializedShardCount,
+													 compareFunctionCall);
+	}
+
+	if (lowerBoundConst != NULL)
+	{
+		lowerBoundIdx = FirstShardWithMaxValueAtLeast(lowerBoundConst->constvalue,
+													cacheEntry, compareFunctionCall);
+	}
+
+	for (int curIdx = lowerBoundIdx; curIdx < upperBoundIdx; curIdx++)
+	{
+		ShardInterval *curInterval = sortedShardIntervalArray[curIdx];
+
+		if (!ExhaustivePruneOne(curInterval, context, prune))
+		{
+			remainingShardList = lappend(remainingShardList, curInterval);
+		}
+	}
+
+	for (int curIdx = initializedShardCount; curIdx < shardCount; curIdx++)
+	{
+		ShardInterval *curInterval = sortedShardIntervalArray[curIdx];
+
+		if (!ExhaustivePruneOne(curInterval, context, prune))
+		{
+			remainingShardList = lappend(remainingShardList, curInterval);
+		}
+	}
+
+	return remainingShardList;
+}
+
+
+/*
+ * CountShardsWithMinValueAtMost returns the number of shards in the array,
+ * which is sorted by min value, whose min value is smaller than or equal to
+ * the given value.
+ */
+static int
+CountShardsWithMinValueAtMost(Datum value, ShardInterval **sortedShardIntervalArray,
+							  int shardCount, FunctionCallInfo compareFunction)
+{
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = shardCount;
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = lowerBoundIndex + ((upperBoundIndex - lowerBoundIndex) / 2);
+
+		if (PerformValueCompare(compareFunction,
+								sortedShardIntervalArray[middleIndex]->minValue,
+								value) <= 0)
+		{
+			lowerBoundIndex = middleIndex + 1;
+		}
+		else
+		{
+			upperBoundIndex = middleIndex;
+		}
+	}
+
+	return lowerBoundIndex;
+}
+
+
+/*
+ * FirstShardWithMaxValueAtLeast returns the index of the first shard for which
+ * the running maximum of the max values is larger than or equal to the given
+ * value, or the number of initialized shards if there is none. All shards
+ * before it have a max value that is smaller than the given value.
+ */
+static int
+FirstShardWithMaxValueAtLeast(Datum value, CitusTableCacheEntry *cacheEntry,
+							  FunctionCallInfo compareFunction)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int *maxValuePrefixShardIndexArray = cacheEntry->maxValuePrefixShardIndexArray;
+	int lowerBoundIndex = 0;
+	int upperBoundIndex = cacheEntry->initializedShardIntervalCount;
+
+	while (lowerBoundIndex < upperBoundIndex)
+	{
+		int middleIndex = lowerBoundIndex + ((upperBoundIndex - lowerBoundIndex) / 2);
+		int maxValueShardIndex = maxValuePrefixShardIndexArray[middleIndex];
+
+		if (PerformValueCompare(compareFunction,
+								sortedShardIntervalArray[maxValueShardIndex]->maxValue,
+								value) < 0)
+		{
+			lowerBoundIndex = middleIndex + 1;
+		}
+		else
+		{
+			upperBoundIndex = middleIndex;
+		}
+	}
+
+	return lowerBoundIndex;
+}
+
+
 /*
  * ExhaustivePrune returns a list of shards matching PruningInstances
  * constraints, by simply checking them for each individual shard.
@@ -0,0 +1,358 @@
+/*-------------------------------------------------------------------------
+ *
+ * skewed_repartition_join.c
+ *    Spreading the rows of frequent join values over several partitions in
+ *    dual hash partition joins.
+ *
+ * A dual hash partition join sends all rows with the same join value to the
+ * same partition, so a single frequent value makes one merge task do most of
+ * the work of the join. When citus.repartition_join_skew_threshold is set,
+ * we look up the join values that make up at least that fraction of the rows
+ * of either side in the statistics of one of its shards. The rows of such a
+ * value on the side where it is frequent are spread round-robin over several
+ * consecutive partitions, starting at the partition the value hashes to, and
+ * the rows of the value on the other side are copied to all of them, such
+ * that every pair of matching rows still meets in exactly one partition.
+ *
+ * Values are identified by their hash, which is what the map tasks compute
+ * anyway. Values that happen to collide with a frequent value are treated
+ * the same way, which costs a few copies but does not change the result.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "libpq-fe.h"
+
+#include "access/hash.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/skewed_repartition_join.h"
+#include "distributed/worker_protocol.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/lsyscache.h"
+
+
+/* query to look up the most common values of a column of a shard */
+#define FREQUENT_VALUES_QUERY \
+	"SELECT most_common_vals::text, most_common_freqs::text " \
+	"FROM pg_catalog.pg_stats " \
+	"WHERE schemaname = %s AND tablename = %s AND attname = %s " \
+	"ORDER BY inherited DESC LIMIT 1"
+
+
+/*
+ * FrequentJoinValue is the hash of a join value and the fraction of the rows
+ * of a table that have the value.
+ */
+typedef struct FrequentJoinValue
+{
+	int32 hashValue;
+	double frequency;
+} FrequentJoinValue;
+
+
+/* config variable managed via guc.c */
+double RepartitionJoinSkewThreshold = 0.0;
+
+
+static List * FrequentPartitionColumnValues(MultiPartition *partitionNode);
+static List * FrequentColumnValues(Oid relationId, Var *column);
+static double JoinValueFrequency(List *frequentValueList, int32 hashValue);
+static int SkewPartitionCount(double frequency, uint32 partitionCount);
+static void AddSkewedJoinValue(MapMergeJob *spreadMapMergeJob,
+							   MapMergeJob *copyMapMergeJob,
+							   int32 hashValue, int partitionCount);
+
+
+/*
+ * AssignSkewedJoinValues sets up the map merge jobs of both sides of a dual
+ * hash partition join to spread the rows of the frequent join values over
+ * several partitions. The outer side of an outer join can only be spread,
+ * since copies of an unmatched row would each be emitted with NULLs.
+ */
+void
+AssignSkewedJoinValues(JoinType joinType,
+					   MultiPartition *leftPartitionNode, MapMergeJob *leftMapMergeJob,
+					   MultiPartition *rightPartitionNode, MapMergeJob *rightMapMergeJob)
+{
+	uint32 partitionCount = leftMapMergeJob->partitionCount;
+	int skewedValueCount = 0;
+
+	if (RepartitionJoinSkewThreshold <= 0.0 || partitionCount < 2)
+	{
+		return;
+	}
+
+	bool leftMaySpread = (joinType == JOIN_INNER || joinType == JOIN_LEFT);
+	bool rightMaySpread = (joinType == JOIN_INNER || joinType == JOIN_RIGHT);
+	if (!leftMaySpread && !rightMaySpread)
+	{
+		return;
+	}
+
+	/* both sides have to hash the join values the same way */
+	Var *leftColumn = leftPartitionNode->partitionColumn;
+	Var *rightColumn = rightPartitionNode->partitionColumn;
+	if (leftColumn->vartype != rightColumn->vartype)
+	{
+		return;
+	}
+
+	List *leftFrequentValueList = FrequentPartitionColumnValues(leftPartitionNode);
+	List *rightFrequentValueList = FrequentPartitionColumnValues(rightPartitionNode);
+
+	FrequentJoinValue *frequentValue = NULL;
+	foreach_ptr(frequentValue, leftFrequentValueList)
+	{
+		double rightFrequency = JoinValueFrequency(rightFrequentValueList,
+												   frequentValue->hashValue);
+		if (!leftMaySpread || rightFrequency > frequentValue->frequency)
+		{
+			continue;
+		}
+
+		int spreadCount = SkewPartitionCount(frequentValue->frequency, partitionCount);
+		if (spreadCount < 2)
+		{
+			continue;
+		}
+
+		AddSkewedJoinValue(leftMapMergeJob, rightMapMergeJob,
+						   frequentValue->hashValue, spreadCount);
+		skewedValueCount++;
+	}
+
+	foreach_ptr(frequentValue, rightFrequentValueList)
+	{
+		/* values that are at least as frequent on the left are handled above */
+		double leftFrequency = JoinValueFrequency(leftFrequentValueList,
+												  frequentValue->hashValue);
+		if (!rightMaySpread || leftFrequency >= frequentValue->frequency)
+		{
+			continue;
+		}
+
+		int spreadCount = SkewPartitionCount(frequentValue->frequency, partitionCount);
+		if (spreadCount < 2)
+		{
+			continue;
+		}
+
+		AddSkewedJoinValue(rightMapMergeJob, leftMapMergeJob,
+						   frequentValue->hashValue, spreadCount);
+		skewedValueCount++;
+	}
+
+	if (skewedValueCount > 0)
+	{
+		ereport(DEBUG2, (errmsg("spreading the rows of %d frequent join values "
+								"over multiple partitions", skewedValueCount)));
+	}
+}
+
+
+/*
+ * FrequentPartitionColumnValues returns the frequent values of the column by
+ * which the given partition node partitions its child, if the column comes
+ * directly from a distributed table.
+ */
+static List *
+FrequentPartitionColumnValues(MultiPartition *partitionNode)
+{
+	Var *partitionColumn = partitionNode->partitionColumn;
+	MultiNode *childNode = ChildNode((MultiUnaryNode *) partitionNode);
+	List *tableNodeList = FindNodesOfType(childNode, T_MultiTable);
+
+	MultiTable *tableNode = NULL;
+	foreach_ptr(tableNode, tableNodeList)
+	{
+		if (tableNode->rangeTableId != partitionColumn->varnoold)
+		{
+			continue;
+		}
+
+		Oid relationId = tableNode->relationId;
+		if (relationId == SUBQUERY_RELATION_ID || !IsCitusTable(relationId))
+		{
+			return NIL;
+		}
+
+		return FrequentColumnValues(relationId, partitionColumn);
+	}
+
+	return NIL;
+}
+
+
+/*
+ * FrequentColumnValues returns the hashes of the values of the given column
+ * of the given table that occur at least as often as the skew threshold,
+ * according to the statistics of the first shard of the table. We assume the
+ * distribution of the column does not differ much between the shards, since
+ * the column is not the distribution column.
+ */
+static List *
+FrequentColumnValues(Oid relationId, Var *column)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	PGresult *result = NULL;
+	List *frequentValueList = NIL;
+
+	if (cacheEntry->shardIntervalArrayLength == 0)
+	{
+		return NIL;
+	}
+
+	ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[0];
+	ShardPlacement *placement = ActiveShardPlacement(shardInterval->shardId, true);
+	if (placement == NULL)
+	{
+		return NIL;
+	}
+
+	char *shardName = get_rel_name(relationId);
+	AppendShardIdToName(&shardName, shardInterval->shardId);
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *columnName = get_attname(relationId, column->varoattno, false);
+
+	StringInfo frequentValuesQuery = makeStringInfo();
+	appendStringInfo(frequentValuesQuery, FREQUENT_VALUES_QUERY,
+					 quote_literal_cstr(schemaName), quote_literal_cstr(shardName),
+					 quote_literal_cstr(columnName));
+
+	MultiConnection *connection = GetNodeConnection(0, placement->nodeName,
+													placement->nodePort);
+	int queryResult = ExecuteOptionalRemoteCommand(connection,
+												   frequentValuesQuery->data, &result);
+	if (queryResult != 0)
+	{
+		return NIL;
+	}
+
+	if (PQntuples(result) != 1 || PQgetisnull(result, 0, 0) ||
+		PQgetisnull(result, 0, 1))
+	{
+		PQclear(result);
+		ClearResults(connection, false);
+
+		return NIL;
+	}
+
+	char *valueArrayString = pstrdup(PQgetvalue(result, 0, 0));
+	char *frequencyArrayString = pstrdup(PQgetvalue(result, 0, 1));
+
+	PQclear(result);
+	ClearResults(connection, false);
+
+	Datum valueArrayDatum = OidInputFunctionCall(F_ARRAY_IN, valueArrayString,
+												 column->vartype, column->vartypmod);
+	Datum frequencyArrayDatum = OidInputFunctionCall(F_ARRAY_IN, frequencyArrayString,
+													 FLOAT4OID, -1);
+
+	Datum *valueArray = NULL;
+	int valueCount = 0;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlign = 0;
+	get_typlenbyvalalign(column->vartype, &typeLength, &typeByValue, &typeAlign);
+	deconstruct_array(DatumGetArrayTypeP(valueArrayDatum), column->vartype,
+					  typeLength, typeByValue, typeAlign, &valueArray, NULL, &valueCount);
+
+	Datum *frequencyArray = NULL;
+	int frequencyCount = 0;
+	deconstruct_array(DatumGetArrayTypeP(frequencyArrayDatum), FLOAT4OID,
+					  sizeof(float4), FLOAT4PASSBYVAL, 'i', &frequencyArray, NULL,
+					  &frequencyCount);
+
+	FmgrInfo *hashFunction = GetFunctionInfo(column->vartype, HASH_AM_OID,
+											 HASHSTANDARD_PROC);
+
+	for (int valueIndex = 0; valueIndex < valueCount && valueIndex < frequencyCount;
+		 valueIndex++)
+	{
+		double frequency = DatumGetFloat4(frequencyArray[valueIndex]);
+		if (frequency < RepartitionJoinSkewThreshold)
+		{
+			continue;
+		}
+
+		Datum hashDatum = HashPartitionColumnValue(hashFunction, DEFAULT_COLLATION_OID,
+												   valueArray[valueIndex]);
+
+		FrequentJoinValue *frequentValue = palloc0(sizeof(FrequentJoinValue));
+		frequentValue->hashValue = DatumGetInt32(hashDatum);
+		frequentValue->frequency = frequency;
+
+		frequentValueList = lappend(frequentValueList, frequentValue);
+	}
+
+	return frequentValueList;
+}
+
+
+/*
+ * JoinValueFrequency returns the frequency of the value with the given hash
+ * in the given list of frequent values, or 0 if it is not in the list.
+ */
+static double
+JoinValueFrequency(List *frequentValueList, int32 hashValue)
+{
+	FrequentJoinValue *frequentValue = NULL;
+	foreach_ptr(frequentValue, frequentValueList)
+	{
+		if (frequentValue->hashValue == hashValue)
+		{
+			return frequentValue->frequency;
+		}
+	}
+
+	return 0.0;
+}
+
+
+/*
+ * SkewPartitionCount returns the number of partitions over which to spread a
+ * value with the given frequency, such that each of them gets about as many
+ * rows of the value as a partition gets on average.
+ */
+static int
+SkewPartitionCount(double frequency, uint32 partitionCount)
+{
+	int skewPartitionCount = (int) ceil(frequency * partitionCount);
+
+	return Min(skewPartitionCount, (int) partitionCount);
+}
+
+
+/*
+ * AddSkewedJoinValue makes the map tasks of the first job spread the rows with
+ * the given hash over the given number of partitions, and the map tasks of the
+ * second job copy their rows with the hash to all of them.
+ */
+static void
+AddSkewedJoinValue(MapMergeJob *spreadMapMergeJob, MapMergeJob *copyMapMergeJob,
+				   int32 hashValue, int partitionCount)
+{
+	spreadMapMergeJob->skewedHashList = lappend_int(spreadMapMergeJob->skewedHashList,
+													hashValue);
+	spreadMapMergeJob->skewPartitionCountList =
+		lappend_int(spreadMapMergeJob->skewPartitionCountList, partitionCount);
+
+	copyMapMergeJob->skewedHashList = lappend_int(copyMapMergeJob->skewedHashList,
+												  hashValue);
+	copyMapMergeJob->skewPartitionCountList =
+		lappend_int(copyMapMergeJob->skewPartitionCountList, -partitionCount);
+}
@@ -91,6 +91,24 @@ GetCurrentProgressMonitor(void)
 }
 
 
+/*
+ * HasCurrentProgressMonitor returns whether this backend currently reports
+ * progress through a progress monitor. The segment of a monitor is detached
+ * when the (sub)transaction that created it aborts, in which case the monitor
+ * is no longer considered current.
+ */
+bool
+HasCurrentProgressMonitor(void)
+{
+	if (currentProgressDSMHandle == DSM_HANDLE_INVALID)
+	{
+		return false;
+	}
+
+	return dsm_find_mapping(currentProgressDSMHandle) != NULL;
+}
+
+
 /*
  * FinalizeCurrentProgressMonitor releases the dynamic memory segment of the current
  * progress monitoring data structure and removes the process from
@@ -26,18 +26,32 @@
 #include "citus_version.h"
 #include "commands/explain.h"
 #include "executor/executor.h"
+#include "distributed/approximate_count.h"
 #include "distributed/backend_data.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/columnar.h"
+#include "distributed/columnar_intermediate_results.h"
 #include "distributed/commands.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/connection_management.h"
 #include "distributed/cte_inline.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/distributed_tracing.h"
+#include "distributed/fast_path_plan_cache.h"
+#include "distributed/foreign_key_relationship.h"
+#include "distributed/incremental_rollup.h"
 #include "distributed/insert_select_executor.h"
+#include "distributed/inline_intermediate_results.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/lag_aware_routing.h"
+#include "distributed/listutils.h"
 #include "distributed/local_executor.h"
+#include "distributed/lock_graph.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
@@ -50,27 +64,47 @@
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/multi_row_insert_copy.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/multi_shard_plan_cache.h"
+#include "distributed/node_stats.h"
+#include "distributed/partition_pruning.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
+#include "distributed/planning_stats.h"
+#include "distributed/received_row_combiner.h"
+#include "distributed/received_row_merger.h"
+#include "distributed/received_row_top_n.h"
+#include "distributed/recursive_planning.h"
 #include "distributed/reference_table_utils.h"
+#include "distributed/repartitioned_aggregation.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/run_from_same_connection.h"
+#include "distributed/shard_pruning.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/time_constants.h"
+#include "distributed/query_progress.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/query_stats.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shard_load_stats.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/skewed_repartition_join.h"
 #include "distributed/statistics_collection.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/subplan_result_cache.h"
+#include "distributed/task_coalescing.h"
 #include "distributed/task_tracker.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_log_messages.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_shard_visibility.h"
+#include "distributed/worker_transaction.h"
 #include "distributed/adaptive_executor.h"
 #include "port/atomics.h"
 #include "postmaster/postmaster.h"
@@ -101,7 +135,10 @@ static bool ErrorIfNotASuitableDeadlockFactor(double *newval, void **extra,
 											  GucSource source);
 static bool WarnIfDeprecatedExecutorUsed(int *newval, void **extra, GucSource source);
 static bool NodeConninfoGucCheckHook(char **newval, void **extra, GucSource source);
+static bool IntermediateResultDirectoriesGucCheckHook(char **newval, void **extra,
+													  GucSource source);
 static void NodeConninfoGucAssignHook(const char *newval, void *extra);
+static void UseUnixSocketForLocalNodeAssignHook(bool newval, void *extra);
 static const char * MaxSharedPoolSizeGucShowHook(void);
 static bool StatisticsCollectionGucCheckHook(bool *newval, void **extra, GucSource
 											 source);
@@ -113,6 +150,14 @@ static int CitusSSLMode = 0;
 
 /* *INDENT-OFF* */
 /* GUC enum definitions */
+#if PG_VERSION_NUM >= PG_VERSION_12
+static const struct config_enum_entry columnar_compression_options[] = {
+	{ "none", COLUMNAR_COMPRESSION_NONE, false },
+	{ "pglz", COLUMNAR_COMPRESSION_PGLZ, false },
+	{ NULL, 0, false }
+};
+#endif
+
 static const struct config_enum_entry propagate_set_commands_options[] = {
 	{"none", PROPSETCMD_NONE, false},
 	{"local", PROPSETCMD_LOCAL, false},
@@ -124,6 +169,14 @@ static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "adaptive", TASK_ASSIGNMENT_ADAPTIVE, false },
+	{ NULL, 0, false }
+};
+
+static const struct config_enum_entry workload_class_options[] = {
+	{ "auto", WORKLOAD_CLASS_AUTO, false },
+	{ "interactive", WORKLOAD_CLASS_INTERACTIVE, false },
+	{ "batch", WORKLOAD_CLASS_BATCH, false },
 	{ NULL, 0, false }
 };
 
@@ -150,6 +203,7 @@ static const struct config_enum_entry shard_placement_policy_options[] = {
 static const struct config_enum_entry use_secondary_nodes_options[] = {
 	{ "never", USE_SECONDARY_NODES_NEVER, false },
 	{ "always", USE_SECONDARY_NODES_ALWAYS, false },
+	{ "lag_aware", USE_SECONDARY_NODES_LAG_AWARE, false },
 	{ NULL, 0, false }
 };
 
@@ -159,6 +213,12 @@ static const struct config_enum_entry coordinator_aggregation_options[] = {
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry count_distinct_approximation_method_options[] = {
+	{ "hll", COUNT_DISTINCT_APPROXIMATION_HLL_EXTENSION, false },
+	{ "builtin", COUNT_DISTINCT_APPROXIMATION_BUILTIN, false },
+	{ NULL, 0, false }
+};
+
 static const struct config_enum_entry shard_commit_protocol_options[] = {
 	{ "1pc", COMMIT_PROTOCOL_1PC, false },
 	{ "2pc", COMMIT_PROTOCOL_2PC, false },
@@ -187,6 +247,12 @@ static const struct config_enum_entry multi_shard_modify_connection_options[] =
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry stat_statements_track_options[] = {
+	{ "none", STAT_STATEMENTS_TRACK_NONE, false },
+	{ "all", STAT_STATEMENTS_TRACK_ALL, false },
+	{ NULL, 0, false }
+};
+
 /* *INDENT-ON* */
 
 
@@ -267,6 +333,7 @@ _PG_init(void)
 	set_join_pathlist_hook = multi_join_restriction_hook;
 	ExecutorStart_hook = CitusExecutorStart;
 	ExecutorRun_hook = CitusExecutorRun;
+	ExplainOneQuery_hook = CitusExplainOneQuery;
 
 	/* register hook for error messages */
 	emit_log_hook = multi_log_hook;
@@ -283,6 +350,14 @@ _PG_init(void)
 	InitPlacementConnectionManagement();
 	InitializeCitusQueryStats();
 	InitializeSharedConnectionStats();
+	InitializePlanningStats();
+	InitializeShardSizeCache();
+	InitializeSecondaryLsnCache();
+	InitializeDistributedTracing();
+	InitializeNodeStats();
+	InitializeShardLoadStats();
+	InitializeQueryResultCache();
+	InitializeSharedForeignKeyGraph();
 
 	/* enable modification of pg_catalog tables during pg_upgrade */
 	if (IsBinaryUpgrade)
@@ -455,6 +530,31 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.node_failure_threshold",
+		gettext_noop("Sets the number of consecutive failed connection attempts "
+					 "after which a node is considered unreachable."),
+		gettext_noop("Queries skip unreachable nodes instead of waiting for "
+					 "citus.node_connection_timeout: reads fail over to other "
+					 "placements and modifications error out right away. "
+					 "0 disables this behaviour."),
+		&NodeFailureThreshold,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.node_probe_interval",
+		gettext_noop("Sets how often a connection to an unreachable node is "
+					 "attempted to check whether it is back."),
+		NULL,
+		&NodeProbeInterval,
+		10 * MS_PER_SECOND, 10 * MS, MS_PER_HOUR,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.sslmode",
 		gettext_noop("This variable has been deprecated. Use the citus.node_conninfo "
@@ -477,6 +577,146 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_approximate_percentiles",
+		gettext_noop("Enables approximating percentile_cont using t-digests"),
+		gettext_noop("When enabled, percentile_cont of a double precision expression "
+					 "is approximated by building a t-digest on each worker and "
+					 "merging them on the coordinator, instead of pulling all rows "
+					 "to the coordinator. The approximation is exact for the minimum "
+					 "and maximum, and most accurate near the tails."),
+		&EnableApproximatePercentiles,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_binary_protocol",
+		gettext_noop("Enables communication between nodes using binary protocol "
+					 "when possible"),
+		gettext_noop("When enabled, the adaptive executor requests the results of "
+					 "queries on shards in PostgreSQL's binary format if all result "
+					 "columns support it. This avoids the cost of running the type "
+					 "input functions on the coordinator for large result sets."),
+		&EnableBinaryProtocol,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_combine_on_receive",
+		gettext_noop("Combines rows per group while receiving them from the workers"),
+		gettext_noop("When the coordinator groups the results of the workers and all "
+					 "aggregates can be applied to their own results, such as count, "
+					 "min and max, the rows of each group are combined as they are "
+					 "received instead of storing all of them before aggregating. "
+					 "This reduces the memory and disk use of the coordinator when "
+					 "there are many shards."),
+		&EnableCombineOnReceive,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	DefineCustomBoolVariable(
+		"citus.enable_columnar_scan",
+		gettext_noop("Enables reading columnar tables with a columnar scan"),
+		gettext_noop("A columnar scan only reads the columns that the query uses, "
+					 "and skips chunk groups whose smallest and largest values show "
+					 "that none of their rows pass the filters of the query. When "
+					 "disabled, columnar tables are read with a sequential scan."),
+		&EnableColumnarScan,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+#endif
+
+	DefineCustomBoolVariable(
+		"citus.enable_coordinator_partition_pruning",
+		gettext_noop("Prunes the partitions of distributed partitioned tables on "
+					 "the coordinator"),
+		gettext_noop("When the WHERE clause of a SELECT query on a distributed "
+					 "partitioned table only matches a single partition, the "
+					 "query is planned on the shards of that partition instead of "
+					 "the shards of the partitioned table. This saves the workers "
+					 "from planning the query for all partitions."),
+		&EnableCoordinatorPartitionPruning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_range_pruning_values",
+		gettext_noop("Sets the maximum number of values in a range restriction on "
+					 "the distribution column of a hash distributed table that "
+					 "are hashed to prune shards."),
+		gettext_noop("Hash distributed tables can normally only be pruned on "
+					 "equality restrictions. When the distribution column is of "
+					 "type smallint, integer, bigint or date, and a query restricts "
+					 "it to a range of at most this many values, for instance "
+					 "with BETWEEN, each value in the range is hashed and only "
+					 "the shards of those values are queried. 0 disables this."),
+		&MaxRangePruningValues,
+		0, 0, 100000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_coalesced_begin",
+		gettext_noop("Sends BEGIN to workers in the same command as the first query "
+					 "of a transaction"),
+		gettext_noop("When enabled, the adaptive executor opens the transaction block "
+					 "on a worker and assigns the distributed transaction id in the "
+					 "same multi-statement command as the first query it sends over "
+					 "the connection, instead of waiting for the result of BEGIN "
+					 "first. This saves a network round trip per worker in "
+					 "multi-statement transactions. Queries with parameters, and "
+					 "transactions with savepoints or SET LOCAL commands, still "
+					 "send BEGIN separately."),
+		&EnableCoalescedBegin,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_concurrent_local_execution",
+		gettext_noop("Sends the remote tasks of read-only queries before executing "
+					 "their local tasks"),
+		gettext_noop("By default, when some of the shards of a query are on the local "
+					 "node, the adaptive executor runs the local tasks first and only "
+					 "then sends the remaining tasks to the workers. When enabled, "
+					 "read-only queries send their remote tasks first, such that the "
+					 "workers run them while the local tasks are executed."),
+		&EnableConcurrentLocalExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_deferred_directory_cleanup",
+		gettext_noop("Removes the files of intermediate results and repartition jobs "
+					 "in the background."),
+		gettext_noop("By default, the directories with the intermediate results of "
+					 "a transaction and the files of repartition jobs are removed "
+					 "when the transaction or job ends, which can take a while when "
+					 "there are many files. When enabled, the directories are moved "
+					 "to a trash directory instead, from which the task tracker "
+					 "removes the files at the rate set by "
+					 "citus.deferred_cleanup_files_per_second."),
+		&EnableDeferredDirectoryCleanup,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.binary_worker_copy_format",
 		gettext_noop("Use the binary worker copy format."),
@@ -489,6 +729,98 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.columnar_intermediate_results",
+		gettext_noop("Stores intermediate results of subqueries and CTEs in a "
+					 "columnar format."),
+		gettext_noop("When enabled, intermediate results are stored in blocks of "
+					 "rows in which the values of each column are stored together, "
+					 "along with the smallest and largest value of each column. When "
+					 "citus.enable_intermediate_result_scan is also enabled, queries "
+					 "reading the results only read the columns they use and skip "
+					 "blocks that cannot contain rows passing their filters. Columnar "
+					 "results are not compressed. Columnar and COPY result files can "
+					 "be read regardless of this setting."),
+		&ColumnarIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+	DefineCustomEnumVariable(
+		"citus.columnar_compression",
+		gettext_noop("Sets the compression of column chunks that are written to "
+					 "columnar tables."),
+		gettext_noop("Chunks that do not get smaller by compressing them are "
+					 "stored uncompressed."),
+		&ColumnarCompression,
+		COLUMNAR_COMPRESSION_PGLZ,
+		columnar_compression_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.columnar_stripe_row_count",
+		gettext_noop("Sets the maximum number of rows in a stripe of a columnar "
+					 "table."),
+		gettext_noop("Rows that are inserted into a columnar table are buffered in "
+					 "memory until a stripe is full or the transaction commits. "
+					 "Larger stripes are compressed better, but use more memory "
+					 "while writing."),
+		&ColumnarStripeRowCount,
+		150000, 1000, 10000000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.columnar_chunk_group_row_count",
+		gettext_noop("Sets the number of rows in a chunk group of a columnar table."),
+		gettext_noop("The smallest and largest value of each column is stored for "
+					 "every chunk group, such that scans can skip chunk groups that "
+					 "do not contain rows passing their filters."),
+		&ColumnarChunkGroupRowCount,
+		10000, 1000, 100000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+#endif
+
+	DefineCustomBoolVariable(
+		"citus.compress_intermediate_results",
+		gettext_noop("Compresses intermediate results of subqueries and CTEs."),
+		gettext_noop("When enabled, intermediate results are compressed in blocks "
+					 "using PostgreSQL's built-in pglz compression before they are "
+					 "sent to the workers and written to the result files. This "
+					 "lowers network traffic and disk usage for large results at "
+					 "the cost of CPU time. Compressed and uncompressed result "
+					 "files can be read regardless of this setting."),
+		&CompressIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomStringVariable(
+		"citus.intermediate_result_directories",
+		gettext_noop("Sets the directories in which intermediate results are "
+					 "stored."),
+		gettext_noop("A comma-separated list of absolute paths, for instance of "
+					 "local NVMe drives or tmpfs mounts. Intermediate result files "
+					 "are striped across the directories by the hash of their "
+					 "result ID, such that large results use the bandwidth of "
+					 "several disks and do not compete with I/O on the data "
+					 "directory. Each server needs directories of its own, since "
+					 "their contents are removed on restart. When empty, results "
+					 "are stored in the data directory."),
+		&IntermediateResultDirectories,
+		"",
+		PGC_POSTMASTER,
+		GUC_LIST_INPUT | GUC_STANDARD,
+		IntermediateResultDirectoriesGucCheckHook, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.expire_cached_shards",
 		gettext_noop("This GUC variable has been deprecated."),
@@ -499,6 +831,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_scan",
+		gettext_noop("Reads intermediate results one record at a time instead of "
+					 "storing them before the query reads them"),
+		gettext_noop("Queries that read intermediate results with constant result "
+					 "ids use a function scan on read_intermediate_result(), which "
+					 "parses and stores all records of the result before returning "
+					 "the first one. When enabled, the function scan is replaced by "
+					 "a scan that parses the records from the result files as the "
+					 "query asks for them."),
+		&EnableIntermediateResultScan,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_local_execution",
 		gettext_noop("Enables queries on shards that are local to the current node "
@@ -510,6 +858,49 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_merge_file_scan",
+		gettext_noop("Lets merge tasks read fetched partition files directly"),
+		gettext_noop("Merge tasks of repartitioned queries normally create a table "
+					 "and copy every fetched partition file into it before the data "
+					 "is queried. When enabled, the task table is instead a view "
+					 "that parses the partition files when it is read, so the data "
+					 "is not written to heap pages or WAL on the worker."),
+		&EnableMergeFileScan,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_local_table_join_pushdown",
+		gettext_noop("Enables joining local tables with distributed tables by "
+					 "sending the filtered local rows to the workers."),
+		gettext_noop("When a query joins local tables with distributed tables, "
+					 "the rows of each local table that pass the filters of the "
+					 "query are read into an intermediate result, and the join "
+					 "is pushed down to the shards of the distributed tables."),
+		&EnableLocalTableJoinPushdown,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_semi_join_reduction",
+		gettext_noop("Filters subqueries on the join keys of recursively planned "
+					 "subqueries"),
+		gettext_noop("When a subquery is joined with the intermediate result of a "
+					 "recursively planned subquery, the tables of the subquery are "
+					 "filtered on the join keys in the intermediate result. This "
+					 "lets the workers skip the rows that the join would discard "
+					 "before grouping or otherwise processing them."),
+		&EnableSemiJoinReduction,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_single_hash_repartition_joins",
 		gettext_noop("Enables single hash repartitioning between hash "
@@ -521,6 +912,68 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_cost_based_join_order",
+		gettext_noop("Enables choosing the join order of repartition joins by "
+					 "the amount of data they move."),
+		gettext_noop("By default, the join order of queries that need repartition "
+					 "joins is chosen by the types of joins it uses. When enabled, "
+					 "and the sizes of all shards are known from "
+					 "pg_dist_placement.shardlength, Citus instead picks the join "
+					 "order that repartitions the smallest amount of data."),
+		&EnableCostBasedJoinOrder,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.broadcast_join_threshold",
+		gettext_noop("Sets the maximum size of distributed tables that are "
+					 "broadcast rather than repartitioned in joins."),
+		gettext_noop("When a query joins distributed tables on columns other than "
+					 "their distribution columns, tables whose size is known from "
+					 "pg_dist_placement.shardlength and does not exceed this limit "
+					 "are read into an intermediate result that is sent to all "
+					 "nodes, such that the other tables are joined with it on each "
+					 "shard without being repartitioned. The largest table in the "
+					 "join is never broadcast. 0 disables broadcast joins."),
+		&BroadcastJoinThreshold,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomRealVariable(
+		"citus.repartition_join_skew_threshold",
+		gettext_noop("Sets the fraction of rows above which a join value is "
+					 "spread over several partitions in repartition joins."),
+		gettext_noop("In a join that repartitions both tables by hash, join values "
+					 "that make up at least this fraction of the rows of one side, "
+					 "according to the column statistics of one of its shards, are "
+					 "spread over several partitions, and the matching rows of the "
+					 "other side are copied to each of them. 0 disables this."),
+		&RepartitionJoinSkewThreshold,
+		0.0, 0.0, 1.0,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.update_shard_statistics_on_analyze",
+		gettext_noop("Refreshes the shard sizes in pg_dist_placement when a "
+					 "distributed table is analyzed."),
+		gettext_noop("When enabled, ANALYZE of a distributed table also fetches the "
+					 "size of each of its shards from the workers and stores it in "
+					 "pg_dist_placement.shardlength, like "
+					 "master_update_shard_statistics() does. The cost-based join "
+					 "order relies on these sizes."),
+		&UpdateShardStatisticsOnAnalyze,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_repartitioned_insert_select",
 		gettext_noop("Enables repartitioned INSERT/SELECTs"),
@@ -531,6 +984,179 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_sorted_merge",
+		gettext_noop("Merges the sorted results of the workers instead of sorting "
+					 "them on the coordinator"),
+		gettext_noop("When enabled, ORDER BY is also pushed down to the workers for "
+					 "queries without a LIMIT whose results the coordinator only "
+					 "sorts. The coordinator then merges the sorted results of the "
+					 "tasks, which is cheaper than sorting all rows and avoids "
+					 "spilling a large sort to disk."),
+		&EnableSortedMerge,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_execution",
+		gettext_noop("Enables returning the results of read-only queries while "
+					 "tasks are still running"),
+		gettext_noop("By default, the adaptive executor stores the results of all "
+					 "tasks before the first row is returned. When enabled, rows are "
+					 "returned as soon as they are received from the workers, which "
+					 "reduces the time to the first row for large results. Any "
+					 "remaining results are still read from the workers when the "
+					 "query ends early."),
+		&EnableStreamingExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_cursor_streaming",
+		gettext_noop("Enables returning the results of read-only queries while "
+					 "tasks are still running when rows are fetched in batches"),
+		gettext_noop("When a cursor or a portal with a row limit reads the results "
+					 "of a distributed query in batches, results are read from the "
+					 "workers only when more rows are fetched. For NO SCROLL cursors "
+					 "and portals, rows that were already fetched are not kept on the "
+					 "coordinator, such that large results do not need to be stored "
+					 "in full."),
+		&EnableCursorStreaming,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_returning",
+		gettext_noop("Enables returning the RETURNING rows of modifications while "
+					 "tasks are still running"),
+		gettext_noop("By default, the RETURNING rows of a multi-shard modification "
+					 "are all stored on the coordinator before the first row is "
+					 "returned. When enabled, rows are returned as soon as they are "
+					 "received from the workers, such that they do not need to be "
+					 "stored in full. This is not done when citus.sort_returning "
+					 "is enabled, since the rows are then sorted first."),
+		&EnableStreamingReturning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_partitioned_intermediate_results",
+		gettext_noop("Sends each node only the rows of an intermediate result that "
+					 "belong to its shards"),
+		gettext_noop("When a CTE or subquery result is only joined with a "
+					 "distributed table on its distribution column, each worker "
+					 "node only receives the rows that can match its own shards, "
+					 "rather than the whole result. This requires the shards of "
+					 "the table to have a single placement."),
+		&EnablePartitionedIntermediateResults,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_subplan_restriction_pushdown",
+		gettext_noop("Adds the filters of the outer query to subqueries that are "
+					 "planned recursively"),
+		gettext_noop("When a subquery is turned into an intermediate result, the "
+					 "filters that apply to its relations in the rest of the query "
+					 "are added to the subquery, including the filters on "
+					 "distribution keys of other tables that are joined to the "
+					 "distribution keys of the subquery. This reduces the size of "
+					 "the intermediate result."),
+		&EnableSubPlanRestrictionPushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_subplan_result_cache",
+		gettext_noop("Reuses intermediate results of identical subplans within a "
+					 "transaction"),
+		gettext_noop("When enabled, a CTE or subquery that is planned recursively "
+					 "reuses the intermediate result of an identical earlier subplan "
+					 "in the same transaction block, as long as the transaction did "
+					 "not modify any data in between. Since worker transactions use "
+					 "READ COMMITTED, a reused result does not reflect changes that "
+					 "other transactions committed since it was computed."),
+		&EnableSubPlanResultCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_top_n_on_receive",
+		gettext_noop("Keeps only the first rows in sort order while receiving them "
+					 "from the workers"),
+		gettext_noop("When the coordinator applies ORDER BY ... LIMIT to the results "
+					 "of the workers, each shard returns up to LIMIT rows. When "
+					 "enabled, rows that sort after the first LIMIT rows received so "
+					 "far are discarded as they are received instead of storing all "
+					 "of them before sorting. This reduces the memory and disk use of "
+					 "the coordinator when there are many shards."),
+		&EnableTopNOnReceive,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_task_coalescing",
+		gettext_noop("Sends the tasks of a multi-shard read that go to the same node "
+					 "as a single query"),
+		gettext_noop("A multi-shard SELECT has a task per shard, each of which is "
+					 "parsed, planned and started separately on the worker. When "
+					 "enabled, the tasks of a read-only query outside of a transaction "
+					 "block that go to the same node are merged into a single UNION ALL "
+					 "query, which the worker can run with parallel query. Tasks with "
+					 "multiple placements and local tasks are not merged."),
+		&EnableTaskCoalescing,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_node_preaggregation",
+		gettext_noop("Combines the partial aggregates of the shards of a node on the "
+					 "node."),
+		gettext_noop("When enabled, the tasks of a multi-shard aggregate query that "
+					 "go to the same node are merged into a single query that "
+					 "combines the partial aggregates of the shards per group, such "
+					 "that the coordinator receives one partial result per node "
+					 "rather than one per shard. This applies to the same tasks as "
+					 "citus.enable_task_coalescing."),
+		&EnableNodePreAggregation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_limit_cancellation",
+		gettext_noop("Stops executing tasks once a LIMIT without ORDER BY has "
+					 "enough rows"),
+		gettext_noop("When the coordinator applies a LIMIT without ORDER BY to the "
+					 "results of the workers, any rows will do. When enabled, tasks "
+					 "that were not started yet are skipped once enough rows were "
+					 "received, and queries that are still running are cancelled "
+					 "unless they are part of a transaction block on the workers."),
+		&EnableLimitCancellation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_fast_path_router_planner",
 		gettext_noop("Enables fast path router planner"),
@@ -541,6 +1167,70 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parameterized_shard_queries",
+		gettext_noop("Keeps the parameters of prepared fast path queries in the "
+					 "queries sent to the workers"),
+		gettext_noop("When enabled, executing a prepared UPDATE, DELETE or SELECT "
+					 "that filters on a parameter in the distribution column only "
+					 "evaluates the parameters in the WHERE clause to find the "
+					 "shard, and sends the parameters along with the shard query. "
+					 "The shard query is then deparsed once per shard instead of "
+					 "on every execution. Plans from the fast-path plan cache "
+					 "keep the distribution key value as a parameter as well."),
+		&EnableParameterizedShardQueries,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_worker_prepared_statements",
+		gettext_noop("Prepares parameterized queries that are sent repeatedly over "
+					 "a worker connection"),
+		gettext_noop("When enabled, the second time the same query with parameters "
+					 "is sent over a connection, the adaptive executor prepares it "
+					 "on the worker, and executes the prepared statement from then "
+					 "on. This saves parsing and planning the query on the worker. "
+					 "Connections with prepared statements are closed at the end of "
+					 "the transaction after DDL on a distributed table."),
+		&EnableWorkerPreparedStatements,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.fast_path_plan_cache_size",
+		gettext_noop("Sets the maximum number of fast-path router plans cached "
+					 "by each backend"),
+		gettext_noop("Fast-path router queries that filter on a constant "
+					 "distribution key value are planned once per query shape "
+					 "and the plan is reused for other distribution key values. "
+					 "This avoids planning the same lookups over and over when "
+					 "they are not sent as prepared statements. Set to 0 to "
+					 "disable the cache."),
+		&FastPathPlanCacheSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.multi_shard_plan_cache_size",
+		gettext_noop("Sets the maximum number of multi-shard prepared SELECT plans "
+					 "cached by each backend"),
+		gettext_noop("Prepared SELECT queries that access multiple shards are "
+					 "planned once per query shape with their parameters sent "
+					 "to the workers, and only shard pruning is repeated for "
+					 "the parameter values of each execution. Set to 0 to "
+					 "disable the cache."),
+		&MultiShardPlanCacheSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.override_table_visibility",
 		gettext_noop("Enables replacing occurencens of pg_catalog.pg_table_visible() "
@@ -668,6 +1358,207 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.explain_worker_pools",
+		gettext_noop("Shows per worker execution statistics in EXPLAIN ANALYZE."),
+		gettext_noop("When enabled, EXPLAIN ANALYZE for distributed queries shows "
+					 "the number of tasks, rows and bytes received for each worker, "
+					 "as well as how long it took to establish connections, how "
+					 "long the tasks were queued and when the first and the last "
+					 "results arrived."),
+		&ExplainWorkerPools,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.explain_analyze_single_pass",
+		gettext_noop("Captures the worker plans while EXPLAIN ANALYZE runs the tasks."),
+		gettext_noop("When enabled, EXPLAIN ANALYZE of a distributed read asks the "
+					 "workers to return the plan of each task along with its rows, "
+					 "instead of running the task a second time to show its plan. "
+					 "The slowest task is shown, unless citus.explain_all_tasks "
+					 "is enabled."),
+		&ExplainAnalyzeSinglePass,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.explain_planning_phases",
+		gettext_noop("Shows the time spent in each distributed planning phase in "
+					 "Explain."),
+		gettext_noop("When enabled, the summary of Explain for distributed queries, "
+					 "which is shown by default for EXPLAIN ANALYZE, includes how "
+					 "long the router, recursive, logical and physical planners "
+					 "took to plan the query."),
+		&ExplainPlanningPhases,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.track_planning_stats",
+		gettext_noop("Collects the time spent in each distributed planning phase "
+					 "per query."),
+		gettext_noop("When enabled, the planning times of distributed queries are "
+					 "accumulated per query identifier in shared memory, and can "
+					 "be inspected via citus_planning_stats(). Query identifiers "
+					 "are only computed when pg_stat_statements is loaded."),
+		&TrackPlanningStats,
+		false,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.planning_stats_max",
+		gettext_noop("Sets the maximum number of queries tracked by "
+					 "citus.track_planning_stats."),
+		gettext_noop("Planning statistics are kept in a shared hash table of "
+					 "this size. Queries that are planned once the table is full "
+					 "are not tracked until citus_planning_stats_reset() is called. "
+					 "Setting to 0 disables the planning statistics."),
+		&PlanningStatsMax,
+		1000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_distributed_tracing",
+		gettext_noop("Propagates a trace context to the workers and records a span "
+					 "per task"),
+		gettext_noop("When enabled, each statement that runs distributed tasks gets "
+					 "a trace id, and the commands sent to the workers start with a "
+					 "traceparent comment that holds the trace id and the span id of "
+					 "the task, such that they can be found in pg_stat_activity and "
+					 "the logs of the workers. The times at which each task became "
+					 "ready, was sent, returned its first row and finished are shown "
+					 "in citus_recent_spans."),
+		&EnableDistributedTracing,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.trace_span_buffer_size",
+		gettext_noop("Sets the number of spans kept for citus_recent_spans."),
+		gettext_noop("Spans are kept in a ring buffer in shared memory, in which "
+					 "the most recent spans overwrite the oldest ones. Setting to 0 "
+					 "disables recording spans, the trace context is still sent to "
+					 "the workers when citus.enable_distributed_tracing is on."),
+		&TraceSpanBufferSize,
+		1000, 0, 1000000,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.node_stats_max",
+		gettext_noop("Sets the maximum number of nodes tracked by citus_node_stats."),
+		gettext_noop("Task and connection latency histograms, task failures and "
+					 "retries, and the bytes sent and received are accumulated per "
+					 "node in shared memory. Nodes beyond this number are not "
+					 "tracked. Setting to 0 disables the node statistics."),
+		&NodeStatsMax,
+		1000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.query_progress_min_task_count",
+		gettext_noop("Sets the minimum number of tasks of distributed executions "
+					 "that are shown in citus_stat_progress_query."),
+		gettext_noop("Executions with at least this many tasks publish how many of "
+					 "their tasks are queued, running and done on each worker, and "
+					 "how many rows and bytes they received so far, through dynamic "
+					 "shared memory. Setting to 0 disables publishing progress."),
+		&QueryProgressMinTaskCount,
+		32, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.stat_statements_track",
+		gettext_noop("Enables/Disables the stats collection for citus_stat_statements."),
+		gettext_noop("When enabled, the number of calls, the planning and execution "
+					 "times, the rows and the bytes received from the workers of "
+					 "distributed queries are accumulated per query, executor and "
+					 "partition key value, as well as per worker, and can be "
+					 "inspected via the citus_stat_statements and "
+					 "citus_stat_statements_workers views. Query identifiers are "
+					 "only computed when pg_stat_statements is loaded."),
+		&StatStatementsTrack,
+		STAT_STATEMENTS_TRACK_NONE,
+		stat_statements_track_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_statements_max",
+		gettext_noop("Determines maximum number of statements tracked by "
+					 "citus_stat_statements."),
+		gettext_noop("The statistics are kept in shared hash tables of this size, "
+					 "one per query and partition key value and one per query and "
+					 "worker. Once a table is full, its least used entries are "
+					 "removed."),
+		&StatStatementsMax,
+		50000, 1000, 10000000,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomRealVariable(
+		"citus.stat_statements_partition_key_sample_rate",
+		gettext_noop("Sets the fraction of partition key values that "
+					 "citus_stat_statements tracks separately."),
+		gettext_noop("Calls of router queries are tracked per partition key value "
+					 "for the given fraction of the values, which is chosen based "
+					 "on a hash of the value. Calls with the other values are "
+					 "tracked under a NULL partition key. Lowering the fraction "
+					 "reduces the number of entries when there are many distinct "
+					 "partition key values."),
+		&StatStatementsPartitionKeySampleRate,
+		1.0, 0.0, 1.0,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_load_stats_max",
+		gettext_noop("Sets the maximum number of shards and partition key values "
+					 "tracked by citus_shard_load."),
+		gettext_noop("The calls and execution time of queries that target a single "
+					 "shard are counted per shard and per partition key value. Once "
+					 "this many entries exist, the least loaded entry is replaced, "
+					 "such that the most loaded ones remain. Setting to 0 disables "
+					 "the statistics."),
+		&ShardLoadStatsMax,
+		1000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomRealVariable(
+		"citus.shard_load_stats_sample_rate",
+		gettext_noop("Sets the fraction of single shard queries that are counted "
+					 "by citus_shard_load."),
+		gettext_noop("The counted calls and times are scaled up by the inverse of "
+					 "the fraction, such that they estimate the actual load."),
+		&ShardLoadStatsSampleRate,
+		0.1, 0.0, 1.0,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.all_modifications_commutative",
 		gettext_noop("Bypasses commutativity checks when enabled"),
@@ -678,6 +1569,25 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_replica_writes",
+		gettext_noop("Runs INSERTs on all placements of a replicated shard in "
+					 "parallel."),
+		gettext_noop("INSERTs into shards with multiple placements normally run on "
+					 "one placement after the other, such that concurrent INSERTs "
+					 "cannot deadlock across placements. When enabled, they run on "
+					 "all placements in parallel, so their latency is that of the "
+					 "slowest placement rather than the sum of all placements. In "
+					 "exchange, they take an exclusive lock on the shard like "
+					 "UPDATE and DELETE do, so concurrent writes to the same shard "
+					 "are serialized. Has no effect when "
+					 "citus.all_modifications_commutative is enabled."),
+		&EnableParallelReplicaWrites,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomRealVariable(
 		"citus.distributed_deadlock_detection_factor",
 		gettext_noop("Sets the time to wait before checking for distributed "
@@ -691,6 +1601,23 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		ErrorIfNotASuitableDeadlockFactor, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.distributed_deadlock_detection_min_age",
+		gettext_noop("Sets the minimum age of a waiting distributed transaction "
+					 "for its wait edges to be collected."),
+		gettext_noop("Distributed deadlock detection collects the wait edges of "
+					 "all waiting distributed transactions on every node. With many "
+					 "briefly waiting transactions, this can make every detection "
+					 "round expensive. Transactions that started less than this "
+					 "long ago are skipped as starting points. A deadlock among "
+					 "them is found once they are old enough. The default of 0 "
+					 "collects the wait edges of all transactions."),
+		&DistributedDeadlockDetectionMinAge,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.recover_2pc_interval",
 		gettext_noop("Sets the time to wait between recovering 2PCs."),
@@ -705,6 +1632,20 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.rollup_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the rollups."),
+		gettext_noop("The maintenance daemon aggregates the rows that were added "
+					 "to the source tables of the rollups created with "
+					 "citus_create_rollup every so often. This setting "
+					 "determines how often, use -1 to only refresh rollups "
+					 "with citus_refresh_rollup."),
+		&RollupRefreshInterval,
+		60 * MS_PER_SECOND, -1, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.metadata_sync_interval",
 		gettext_noop("Sets the time to wait between metadata syncs."),
@@ -729,6 +1670,27 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.maintenance_daemon_idle_timeout",
+		gettext_noop("Stops the maintenance daemon of a database that has been "
+					 "idle for the given time."),
+		gettext_noop("Every database in which Citus is used has its own "
+					 "maintenance daemon. On servers with many databases that "
+					 "are rarely used, this setting lets the daemon of a "
+					 "database exit once no other process has been connected "
+					 "to the database for the given time, and pending 2PC "
+					 "recovery and metadata sync are done. The next session "
+					 "that uses Citus in the database starts the daemon again. "
+					 "Daemons that check nodes with metadata for distributed "
+					 "deadlocks keep running unless "
+					 "citus.distributed_deadlock_detection_factor is -1. "
+					 "0 keeps the daemons running."),
+		&MaintenanceDaemonIdleTimeout,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.select_opens_transaction_block",
 		gettext_noop("Open transaction blocks for SELECT commands"),
@@ -776,6 +1738,24 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_adaptive_pool_sizing",
+		gettext_noop("Decides how many connections to open to a worker based on "
+					 "how long tasks and connections took before"),
+		gettext_noop("When enabled, the adaptive executor records in shared memory "
+					 "how long tasks take on each worker. When both that and the "
+					 "time it takes to establish a connection to the worker are "
+					 "known, the executor opens one connection per as many ready "
+					 "tasks as fit in the connection establishment time, instead of "
+					 "opening connections gradually as per "
+					 "citus.executor_slow_start_interval. The number of connections "
+					 "is still limited by citus.max_adaptive_executor_pool_size."),
+		&EnableAdaptivePoolSizing,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.executor_slow_start_interval",
 		gettext_noop("Time to wait between opening connections to the same worker node"),
@@ -789,7 +1769,58 @@ RegisterCitusConfigVariables(void)
 		&ExecutorSlowStartInterval,
 		10, 0, INT_MAX,
 		PGC_USERSET,
-		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
+		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.executor_batch_size",
+		gettext_noop("Sets the maximum number of shard modifications the adaptive "
+					 "executor sends over a connection in a single round trip"),
+		gettext_noop("When a multi-shard modification consists of many small tasks "
+					 "per worker node, the executor spends most of its time waiting for "
+					 "network round trips. When set to a value larger than 1, the "
+					 "executor concatenates up to this many shard modifications that "
+					 "do not return rows into a single multi-statement command. This "
+					 "reduces the number of round trips, but also reduces parallelism "
+					 "within a worker node."),
+		&ExecutorBatchSize,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.fragment_transfer_parallelism",
+		gettext_noop("Sets the number of tasks over which the result fragments of a "
+					 "repartitioned query are fetched between two nodes"),
+		gettext_noop("When results are repartitioned between workers, all fragments "
+					 "that a node needs from another node are fetched one after "
+					 "another by a single fetch_intermediate_results() call. When set "
+					 "to a value larger than 1, the fragments are split into up to "
+					 "this many calls with similar row counts, which the executor can "
+					 "run over separate connections."),
+		&FragmentTransferParallelism,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_lock_escalation_threshold",
+		gettext_noop("Sets the number of shards from which a multi-shard modification "
+					 "locks ranges of shards instead of individual shards"),
+		gettext_noop("Multi-shard modifications take a lock per shard to serialize "
+					 "them with other modifications of the same shards. When a "
+					 "modification has at least this many tasks, it instead locks the "
+					 "ranges of shard IDs that its shards belong to, in which case all "
+					 "shard locks also take a weak lock on their range. The setting "
+					 "should be changed while there are no concurrent modifications, "
+					 "since transactions that started before the change do not hold "
+					 "the locks on ranges. 0 disables escalation."),
+		&ShardLockEscalationThreshold,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomBoolVariable(
@@ -877,6 +1908,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_approximate_count",
+		gettext_noop("Answers count(*) of all rows of a distributed table from the "
+					 "statistics of its shards."),
+		gettext_noop("When enabled, a SELECT count(*) FROM a distributed table "
+					 "without any other clauses is planned as a call to "
+					 "citus_approximate_count(), which sums up the row estimates "
+					 "of the shards in pg_class on the workers instead of scanning "
+					 "the shards. The result is only as accurate as the statistics "
+					 "of the last VACUUM or ANALYZE."),
+		&EnableApproximateCount,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.propagate_set_commands",
 		gettext_noop("Sets which SET commands are propagated to workers."),
@@ -898,6 +1945,42 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_sequence_evaluation_on_workers",
+		gettext_noop("Lets the workers evaluate nextval calls in INSERTs into "
+					 "MX tables"),
+		gettext_noop("By default, the coordinator evaluates nextval for every row "
+					 "of an INSERT before sending it to the workers. When enabled, "
+					 "nextval calls on bigint sequences owned by an MX table are "
+					 "sent to the workers, which generate values from their own "
+					 "sequence ranges. This does not apply to the distribution "
+					 "column, which is needed to route the rows."),
+		&EnableSequenceEvaluationOnWorkers,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_ddl_batch_size",
+		gettext_noop("Sets the maximum number of shards whose DDL commands are sent "
+					 "to a worker in a single query"),
+		gettext_noop("By default, each shard of a distributed table gets its own "
+					 "DDL task, and the tasks on a worker run in parallel over "
+					 "multiple connections. For cheap commands such as ALTER TABLE "
+					 "ADD COLUMN on tables with many shards, the round trips "
+					 "dominate the execution time. Setting this to a higher value "
+					 "sends the commands of up to this many shards that are on "
+					 "the same nodes as one multi-statement query. TRUNCATE and "
+					 "DROP TABLE similarly truncate or drop up to this many shards "
+					 "in a single command, and DROP TABLE sends the commands to "
+					 "different nodes in parallel."),
+		&ShardDDLBatchSize,
+		1, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_count",
 		gettext_noop("Sets the number of shards for a new hash-partitioned table"
@@ -937,6 +2020,201 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.compress_copy_data",
+		gettext_noop("Compresses the COPY data that is sent to shards on other "
+					 "nodes."),
+		gettext_noop("When enabled, COPY and INSERT ... SELECT send the rows for "
+					 "shard placements on other nodes in pglz-compressed blocks, "
+					 "which the receiving node decompresses. This lowers network "
+					 "traffic between nodes at the cost of CPU time on both ends, "
+					 "and requires all nodes to run a Citus version that supports "
+					 "it."),
+		&CompressCopyData,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_copy_partition_routing",
+		gettext_noop("Routes the rows of a COPY into a partitioned table to the "
+					 "shards of its partitions."),
+		gettext_noop("When enabled, COPY and INSERT ... SELECT into a distributed "
+					 "table that is range or list partitioned on a single column "
+					 "find the partition of each row on the coordinator, and send "
+					 "it directly to the co-located shard of the partition. The "
+					 "workers then receive rows of a single partition per COPY "
+					 "and skip tuple routing. Rows that cannot be routed on the "
+					 "coordinator are sent to the shard of the partitioned table."),
+		&EnableCopyPartitionRouting,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.copy_to_parallel_streams",
+		gettext_noop("Sets the maximum number of shards that COPY table TO STDOUT "
+					 "reads at the same time."),
+		gettext_noop("COPY of a distributed table to the client forwards the output "
+					 "of COPY commands on the shards. When set higher than 1, up to "
+					 "this many shards are read at the same time over separate "
+					 "connections, and their rows are sent in the order in which "
+					 "they arrive. This only applies outside of transaction blocks "
+					 "and when no HEADER is requested."),
+		&CopyToParallelStreams,
+		1, 1, 128,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_binary_copy_passthrough",
+		gettext_noop("Enables passing the rows of binary COPY FROM STDIN through "
+					 "to the shards without decoding them."),
+		gettext_noop("When copying into a hash-distributed table from STDIN in "
+					 "binary format without a column list, only the distribution "
+					 "column of each row is decoded on the coordinator to find its "
+					 "shard, and the row is forwarded to the shard as it was sent. "
+					 "The other columns are validated by the workers."),
+		&EnableBinaryCopyPassthrough,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.multi_row_insert_copy_threshold",
+		gettext_noop("Sets the number of rows from which multi-row INSERTs are "
+					 "executed through COPY."),
+		gettext_noop("Multi-row INSERTs without RETURNING and ON CONFLICT with at "
+					 "least this many rows are sent to the shards over COPY once "
+					 "their functions and parameters are evaluated, rather than "
+					 "as a multi-row INSERT per shard that the workers have to "
+					 "parse and plan. 0 disables this."),
+		&MultiRowInsertCopyThreshold,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_parallel_shard_copies",
+		gettext_noop("Sets the maximum number of shards that are copied from a "
+					 "single node to another node at the same time."),
+		gettext_noop("When master_copy_shard_placement() copies a shard along with "
+					 "its co-located shards, or reference tables are replicated to "
+					 "a new node, each shard is copied and indexed over its own "
+					 "connection to the target node. This setting limits how many "
+					 "of those copies pull from the same source node at the same "
+					 "time."),
+		&MaxParallelShardCopies,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.prewarm_moved_shards",
+		gettext_noop("Loads moved shards into the buffer cache of the target node."),
+		gettext_noop("When enabled, master_move_shard_placement() loads as many "
+					 "blocks of each moved shard and its indexes into the buffer "
+					 "cache of the target node as the source node has cached, "
+					 "before queries are routed to the new placements."),
+		&PrewarmMovedShards,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_parallel_shard_moves",
+		gettext_noop("Sets the maximum number of shard moves that a rebalance "
+					 "runs at the same time."),
+		gettext_noop("The shard rebalancer runs each move in its own transaction "
+					 "over a separate connection to the coordinator. Moves that "
+					 "do not share a node run at the same time, up to this "
+					 "number of moves."),
+		&MaxParallelShardMoves,
+		4, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.capacity_aware_shard_placement",
+		gettext_noop("Places the shards of new distributed tables by the capacity "
+					 "of the worker nodes."),
+		gettext_noop("By default, the shards of a new distributed table are placed "
+					 "on the worker nodes in round robin order. When enabled, the "
+					 "shards are spread over the nodes in proportion to the "
+					 "node_capacity_function of the default rebalance strategy, "
+					 "preferring nodes that store less data relative to their "
+					 "capacity. Tables that are colocated with an existing table "
+					 "keep following its placements."),
+		&CapacityAwareShardPlacement,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_size_cache_max_shards",
+		gettext_noop("Sets the maximum number of shard placements whose sizes are "
+					 "cached in shared memory."),
+		gettext_noop("When set, the maintenance daemon periodically reads the sizes "
+					 "of all shard placements with a single query per worker, and "
+					 "citus_table_size(), citus_relation_size(), "
+					 "citus_total_relation_size(), the shard rebalancer and the "
+					 "planner use the cached sizes instead of asking the workers. "
+					 "Setting to 0 disables the cache."),
+		&ShardSizeCacheMaxShards,
+		0, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_size_cache_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the shard size "
+					 "cache."),
+		gettext_noop("Only has an effect when citus.shard_size_cache_max_shards is "
+					 "set. Use -1 to stop refreshing the cache."),
+		&ShardSizeCacheRefreshInterval,
+		60 * MS_PER_SECOND, -1, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shared_foreign_key_graph_max_edges",
+		gettext_noop("Sets the maximum number of foreign keys in the foreign key "
+					 "graph that is kept in shared memory."),
+		gettext_noop("When set, the foreign key graph between relations is built by "
+					 "a single backend after it is invalidated, and other backends "
+					 "read it from shared memory instead of scanning pg_constraint "
+					 "themselves. Setting to 0 disables the shared graph."),
+		&SharedForeignKeyGraphMaxEdges,
+		0, 0, INT_MAX / 2,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.sort_insert_select_upserts",
+		gettext_noop("Sorts the rows of INSERT .. SELECT .. ON CONFLICT on the "
+					 "conflict target before inserting them into the shards"),
+		gettext_noop("When an INSERT .. SELECT with ON CONFLICT is executed via "
+					 "intermediate results, the rows of each shard are read in "
+					 "the order of the conflict target columns, such that the "
+					 "arbiter index is accessed in key order."),
+		&SortInsertSelectUpserts,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.sort_returning",
 		gettext_noop("Sorts the RETURNING clause to get consistent test output"),
@@ -951,6 +2229,69 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.vacuum_shards_by_dead_tuples",
+		gettext_noop("Vacuums the shards with the most dead tuples first"),
+		gettext_noop("When enabled, VACUUM of a distributed table first fetches the "
+					 "number of dead tuples of each shard from the statistics of "
+					 "the workers, and of modified tuples for ANALYZE, and "
+					 "processes the shards in descending order of that number. "
+					 "Combined with citus.max_vacuum_pool_size, this makes sure "
+					 "that the most bloated shards are vacuumed first."),
+		&VacuumShardsByDeadTuples,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.hedged_read_delay",
+		gettext_noop("Sets the time after which a slow read on a replicated shard "
+					 "is also started on another placement."),
+		gettext_noop("When a read-only task has not returned any rows within this "
+					 "time, the adaptive executor also runs it on the next placement "
+					 "of the shard, uses the rows of whichever placement returns them "
+					 "first, and cancels the other query. This reduces the latency "
+					 "of queries on reference tables and replicated shards when a "
+					 "node is temporarily slow. Hedging only happens outside of "
+					 "transactions that opened transaction blocks on the workers. "
+					 "0 disables hedging."),
+		&HedgedReadDelay,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.executor_result_memory",
+		gettext_noop("Sets the memory used to store the results of a distributed "
+					 "query on the coordinator before spilling them to disk."),
+		gettext_noop("The adaptive executor stores the results received from the "
+					 "workers in a tuple store, which writes them to a temporary "
+					 "file once this limit is exceeded. The default of -1 uses "
+					 "work_mem. EXPLAIN ANALYZE shows whether results spilled when "
+					 "citus.explain_worker_pools is enabled."),
+		&ExecutorResultMemory,
+		-1, -1, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.compress_spilled_results",
+		gettext_noop("Compresses large values of results that spill to disk on the "
+					 "coordinator."),
+		gettext_noop("When enabled, large text and other variable-length values are "
+					 "compressed with pglz before they are added to a tuple store "
+					 "of the adaptive executor or of read_intermediate_result that "
+					 "already spilled to a temporary file. This reduces temporary "
+					 "file I/O for wide results at the cost of CPU time."),
+		&CompressSpilledResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_intermediate_result_size",
 		gettext_noop("Sets the maximum size of the intermediate results in KB for "
@@ -962,6 +2303,68 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_inline_intermediate_result_size",
+		gettext_noop("Sets the maximum size in KB of intermediate results that are "
+					 "inlined into the worker queries."),
+		gettext_noop("Results of CTEs and complex subqueries that do not exceed this "
+					 "size are sent to the workers as part of the queries that read "
+					 "them, rather than as files. 0 disables inlining."),
+		&MaxInlineIntermediateResultSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.query_result_cache_size",
+		gettext_noop("Sets the amount of shared memory used for caching the results "
+					 "of read-only distributed queries."),
+		gettext_noop("Results are only cached in sessions that set "
+					 "citus.query_result_cache_ttl. Once the cache is full, the "
+					 "oldest results are removed. Setting to 0 disables the cache."),
+		&QueryResultCacheSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.query_result_cache_ttl",
+		gettext_noop("Sets the time for which the cached result of a read-only "
+					 "distributed query is used."),
+		gettext_noop("When set, the rows that a read-only query on distributed "
+					 "tables gets from the workers are cached in shared memory per "
+					 "query, user and parameter values, and executions of the same "
+					 "query return the cached rows until they are older than this, "
+					 "or a table of the query is modified through this node. "
+					 "Modifications through other nodes are not seen. Requires "
+					 "pg_stat_statements and citus.query_result_cache_size. "
+					 "Setting to 0 disables reading and caching results."),
+		&QueryResultCacheTTL,
+		0, 0, MS_PER_HOUR,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.intermediate_result_seed_node_count",
+		gettext_noop("Sets the number of worker nodes the coordinator sends an "
+					 "intermediate result to directly."),
+		gettext_noop("When an intermediate result of a CTE or complex subquery is "
+					 "needed on more worker nodes than this, the coordinator only "
+					 "sends it to this many nodes, and the remaining nodes fetch "
+					 "it from the nodes that already have it. This keeps the "
+					 "outgoing traffic of the coordinator constant as the cluster "
+					 "grows, but requires the worker nodes to be able to connect "
+					 "to each other. 0 means the coordinator sends the result to "
+					 "all nodes."),
+		&IntermediateResultSeedNodeCount,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_adaptive_executor_pool_size",
 		gettext_noop("Sets the maximum number of connections per worker node used by "
@@ -980,6 +2383,58 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.parallel_workers_per_node",
+		gettext_noop("Sets the number of parallel workers that the tasks of a query "
+					 "that scan large shards share on each worker node"),
+		gettext_noop("Whether a worker scans a shard with parallel workers depends "
+					 "on its max_parallel_workers_per_gather, which does not take "
+					 "into account how many tasks of the query run on the node at "
+					 "the same time. When set, the adaptive executor sets "
+					 "max_parallel_workers_per_gather for read-only tasks on shards "
+					 "larger than min_parallel_table_scan_size to this number "
+					 "divided by the number of tasks it runs on the node at once, "
+					 "such that a few tasks on large shards use the cores that the "
+					 "other tasks leave idle. Shard sizes are taken from the shard "
+					 "size cache, see citus.shard_size_cache_max_shards, unless "
+					 "min_parallel_table_scan_size is 0. "
+					 "0 leaves the setting to the workers."),
+		&ParallelWorkersPerNode,
+		0, 0, 1024,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_index_build_pool_size",
+		gettext_noop("Sets the maximum number of connections per worker node used to "
+					 "build the shard indexes of a CREATE INDEX or REINDEX command"),
+		gettext_noop("Each connection builds the index of one shard at a time, and "
+					 "each build can use up to maintenance_work_mem and "
+					 "max_parallel_maintenance_workers on the worker. This setting "
+					 "can be used to size the number of concurrent index builds to "
+					 "the cores and memory of the workers. When set to 0, "
+					 "citus.max_adaptive_executor_pool_size is used."),
+		&MaxIndexBuildPoolSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_vacuum_pool_size",
+		gettext_noop("Sets the maximum number of connections per worker node used to "
+					 "vacuum or analyze the shards of a distributed table"),
+		gettext_noop("Each connection processes one shard at a time. Lowering this "
+					 "setting limits the I/O that VACUUM and ANALYZE of a distributed "
+					 "table cause on the workers. When set to 0, "
+					 "citus.max_adaptive_executor_pool_size is used."),
+		&MaxVacuumPoolSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_shared_pool_size",
 		gettext_noop("Sets the maximum number of connections allowed per worker node "
@@ -994,6 +2449,39 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, MaxSharedPoolSizeGucShowHook);
 
+	DefineCustomIntVariable(
+		"citus.batch_pool_share",
+		gettext_noop("Sets the percentage of citus.max_shared_pool_size that "
+					 "connections of the batch workload class may use per worker node."),
+		gettext_noop("Connections of multi-shard executions belong to the batch "
+					 "workload class, unless citus.workload_class says otherwise. "
+					 "Limiting their share of the shared pool keeps slots available "
+					 "for interactive queries under load."),
+		&BatchWorkloadPoolShare,
+		100, 1, 100,
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.workload_class",
+		gettext_noop("Sets the workload class of the connections that the session "
+					 "opens to worker nodes."),
+		gettext_noop("When connections to a worker node are limited by "
+					 "citus.max_shared_pool_size, backends of the interactive class "
+					 "that wait for a connection are admitted before backends of the "
+					 "batch class, and batch connections are limited to "
+					 "citus.batch_pool_share of the pool. With auto, connections "
+					 "opened for multi-shard executions are batch connections and "
+					 "all others are interactive. The class can be set per role "
+					 "with ALTER ROLE ... SET."),
+		&WorkloadClassSetting,
+		WORKLOAD_CLASS_AUTO,
+		workload_class_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -1013,6 +2501,20 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.remote_monitoring_timeout",
+		gettext_noop("Sets the time to wait for each node in cluster-wide "
+					 "monitoring functions."),
+		gettext_noop("Functions such as citus_dist_stat_activity query all "
+					 "nodes in parallel. Nodes that do not respond within this "
+					 "time are skipped with a warning, so that a single slow "
+					 "node does not stall the function. 0 waits indefinitely."),
+		&RemoteMonitoringTimeout,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.remote_task_check_interval",
 		gettext_noop("Sets the frequency at which we check job statuses."),
@@ -1026,6 +2528,20 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.task_status_wait_timeout",
+		gettext_noop("Sets how long task trackers hold on to a task status check."),
+		gettext_noop("When all tasks on a task tracker have been assigned, the "
+					 "master node asks the task tracker to answer its next status "
+					 "check only once one of the tasks finishes, or once this "
+					 "timeout passes. This avoids repeatedly polling task "
+					 "statuses. Setting this value to 0 disables waiting."),
+		&TaskStatusWaitTimeout,
+		100, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.task_tracker_delay",
 		gettext_noop("Task tracker sleep time between task management rounds."),
@@ -1040,6 +2556,20 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.deferred_cleanup_files_per_second",
+		gettext_noop("Sets the maximum number of files per second that the task "
+					 "tracker removes from the trash directory."),
+		gettext_noop("Directories are moved to the trash directory when "
+					 "citus.enable_deferred_directory_cleanup is set. Removing their "
+					 "files slowly avoids bursts of file system activity that slow "
+					 "down other queries."),
+		&DeferredCleanupFilesPerSecond,
+		1000, 1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_cached_conns_per_worker",
 		gettext_noop("Sets the maximum number of connections to cache per worker."),
@@ -1054,6 +2584,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.warm_connections_per_worker",
+		gettext_noop("Sets the number of connections to open per worker on the first "
+					 "distributed query of a session."),
+		gettext_noop("When set, the first distributed query of a session opens this "
+					 "many connections to each worker in parallel, and they are kept "
+					 "open at the end of transactions, as if they were counted in "
+					 "citus.max_cached_conns_per_worker. This reduces the latency of "
+					 "the first multi-shard queries in short-lived sessions. 0 disables "
+					 "warming up connections."),
+		&WarmConnectionsPerWorker,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_assign_task_batch_size",
 		gettext_noop("Sets the maximum number of tasks to assign per round."),
@@ -1137,7 +2683,7 @@ RegisterCitusConfigVariables(void)
 	DefineCustomRealVariable(
 		"citus.count_distinct_error_rate",
 		gettext_noop("Desired error rate when calculating count(distinct) "
-					 "approximates using the postgresql-hll extension. "
+					 "approximates using HyperLogLog sketches. "
 					 "0.0 disables approximations for count(distinct); 1.0 "
 					 "provides no guarantees about the accuracy of results."),
 		NULL,
@@ -1147,6 +2693,19 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomEnumVariable(
+		"citus.count_distinct_approximation_method",
+		gettext_noop("Sets how count(distinct) approximations are computed"),
+		gettext_noop("'hll' uses the sketches of the postgresql-hll extension, which "
+					 "needs to be installed on all nodes. 'builtin' uses the "
+					 "HyperLogLog sketches that come with Citus."),
+		&CountDistinctApproximationMethod,
+		COUNT_DISTINCT_APPROXIMATION_HLL_EXTENSION,
+		count_distinct_approximation_method_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.coordinator_aggregation_strategy",
 		gettext_noop("Sets the strategy for when an aggregate cannot be pushed down. "
@@ -1197,8 +2756,10 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the adaptive policy sends read-only "
+					 "tasks to the replica on the least loaded worker node at "
+					 "execution time."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
@@ -1247,6 +2808,40 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_aggregation",
+		gettext_noop("Combines the partial aggregates of GROUP BY queries on the "
+					 "workers by repartitioning them."),
+		gettext_noop("When a query does not group by the distribution column, "
+					 "the coordinator combines the partial aggregates of all "
+					 "shards, which makes it a bottleneck for queries with many "
+					 "groups. When enabled, the workers instead repartition the "
+					 "partial aggregates by the GROUP BY expression and combine "
+					 "them, such that only the final groups are sent to the "
+					 "coordinator."),
+		&EnableRepartitionedAggregation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_window_functions",
+		gettext_noop("Computes window functions that are not partitioned by the "
+					 "distribution column on the workers by repartitioning the "
+					 "rows."),
+		gettext_noop("Window functions whose PARTITION BY does not contain the "
+					 "distribution column are computed on the coordinator over "
+					 "all rows of the table. When enabled, the workers instead "
+					 "repartition the rows by a column that appears in the "
+					 "PARTITION BY of all windows and compute the window "
+					 "functions in parallel."),
+		&EnableRepartitionedWindowFunctions,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.shard_placement_policy",
 		gettext_noop("Sets the policy to use when choosing nodes for shard placement."),
@@ -1266,13 +2861,29 @@ RegisterCitusConfigVariables(void)
 	DefineCustomEnumVariable(
 		"citus.use_secondary_nodes",
 		gettext_noop("Sets the policy to use when choosing nodes for SELECT queries."),
-		NULL,
+		gettext_noop("With lag_aware, reads outside of transaction blocks go to a "
+					 "secondary that replayed the writes the session committed on "
+					 "the primary of its group, and to the primary otherwise."),
 		&ReadFromSecondaries,
 		USE_SECONDARY_NODES_NEVER, use_secondary_nodes_options,
 		PGC_SU_BACKEND,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.secondary_lsn_refresh_interval",
+		gettext_noop("Sets the time to wait between reading the replay positions of "
+					 "secondary nodes."),
+		gettext_noop("The maintenance daemon keeps the replay positions of secondaries "
+					 "in shared memory for citus.use_secondary_nodes = lag_aware. "
+					 "Setting to 0 stops refreshing them, which sends all reads "
+					 "to primaries."),
+		&SecondaryLsnRefreshInterval,
+		1 * MS_PER_SECOND, 0, MS_PER_HOUR,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_task_query_log_level",
 		gettext_noop("Sets the level of multi task query execution log messages"),
@@ -1303,6 +2914,21 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomStringVariable(
+		"citus.metadata_cache_preload_tables",
+		gettext_noop("Sets the tables whose metadata citus_preload_metadata_cache() "
+					 "loads into the cache of a backend."),
+		gettext_noop("A comma-separated list of table names, or * for all Citus "
+					 "tables. Connection poolers can call "
+					 "citus_preload_metadata_cache() when they open a server "
+					 "connection, such that the first queries of a client do not "
+					 "pay for building the metadata cache."),
+		&MetadataCachePreloadTables,
+		"",
+		PGC_SUSET,
+		GUC_LIST_INPUT | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomStringVariable(
 		"citus.cluster_name",
 		gettext_noop("Which cluster this node is a part of"),
@@ -1422,6 +3048,20 @@ RegisterCitusConfigVariables(void)
 		NodeConninfoGucAssignHook,
 		NULL);
 
+	DefineCustomBoolVariable(
+		"citus.use_unix_socket_for_local_node",
+		gettext_noop("Connects to the local node over a Unix-domain socket."),
+		gettext_noop("When local execution cannot be used, Citus opens connections "
+					 "to the node it runs on. When enabled, these connections use "
+					 "the first directory in unix_socket_directories instead of "
+					 "TCP, which also skips TLS. Make sure pg_hba.conf allows "
+					 "local connections for the relevant users."),
+		&UseUnixSocketForLocalNode,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, UseUnixSocketForLocalNodeAssignHook, NULL);
+
 	DefineCustomIntVariable(
 		"citus.isolation_test_session_remote_process_id",
 		NULL,
@@ -1539,6 +3179,54 @@ NodeConninfoGucCheckHook(char **newval, void **extra, GucSource source)
 }
 
 
+/*
+ * IntermediateResultDirectoriesGucCheckHook ensures that
+ * citus.intermediate_result_directories is a list of absolute paths, since
+ * relative paths would point into the data directory.
+ */
+static bool
+IntermediateResultDirectoriesGucCheckHook(char **newval, void **extra,
+										  GucSource source)
+{
+	List *directoryList = NIL;
+
+	/* SplitDirectoriesString modifies its input, so give it a copy */
+	char *rawDirectories = pstrdup(*newval);
+	if (!SplitDirectoriesString(rawDirectories, ',', &directoryList))
+	{
+		GUC_check_errdetail("List syntax is invalid.");
+		return false;
+	}
+
+	char *directory = NULL;
+	foreach_ptr(directory, directoryList)
+	{
+		if (!is_absolute_path(directory))
+		{
+			GUC_check_errdetail("Directory \"%s\" is not an absolute path.",
+								directory);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * UseUnixSocketForLocalNodeAssignHook invalidates the cached connection
+ * parameters, since they contain the host and port to connect to.
+ */
+static void
+UseUnixSocketForLocalNodeAssignHook(bool newval, void *extra)
+{
+	if (newval != UseUnixSocketForLocalNode)
+	{
+		InvalidateConnParamsHashEntries();
+	}
+}
+
+
 /*
  * NodeConninfoGucAssignHook is the assignment hook for the node_conninfo GUC
  * variable. Though this GUC is a "string", we actually parse it as a non-URI
@@ -1,3 +1,77 @@
 -- citus--9.3-2--9.4-1
 
 -- bump version to 9.4-1
+
+#include "udfs/citus_shard_copy_progress/9.4-1.sql"
+#include "udfs/citus_remote_connection_stats/9.4-1.sql"
+#include "udfs/citus_planning_stats/9.4-1.sql"
+#include "udfs/citus_planning_stats_reset/9.4-1.sql"
+#include "udfs/citus_query_stats/9.4-1.sql"
+#include "udfs/citus_stat_statements/9.4-1.sql"
+#include "udfs/citus_query_stats_per_worker/9.4-1.sql"
+#include "udfs/citus_hll_add_agg/9.4-1.sql"
+#include "udfs/citus_tdigest_add_agg/9.4-1.sql"
+#include "udfs/link_intermediate_result/9.4-1.sql"
+#include "udfs/citus_maintenance_job_stats/9.4-1.sql"
+#include "udfs/task_tracker_assign_task/9.4-1.sql"
+#include "udfs/task_tracker_wait_for_any/9.4-1.sql"
+#include "udfs/worker_read_task_files/9.4-1.sql"
+#include "udfs/master_split_shard/9.4-1.sql"
+#include "udfs/master_append_tables_to_shard/9.4-1.sql"
+#include "udfs/citus_table_size/9.4-1.sql"
+#include "udfs/citus_relation_size/9.4-1.sql"
+#include "udfs/citus_total_relation_size/9.4-1.sql"
+#include "udfs/citus_finish_pg_upgrade/9.4-1.sql"
+#include "udfs/citus_shard_map/9.4-1.sql"
+#include "udfs/citus_shard_map_version/9.4-1.sql"
+#include "udfs/citus_shard_map_lookup/9.4-1.sql"
+#include "udfs/read_inline_intermediate_result/9.4-1.sql"
+#include "udfs/citus_preload_metadata_cache/9.4-1.sql"
+#include "udfs/worker_hash_partition_table/9.4-1.sql"
+#include "udfs/citus_recent_spans/9.4-1.sql"
+#include "udfs/citus_wait_events/9.4-1.sql"
+#include "udfs/citus_node_stats/9.4-1.sql"
+#include "udfs/citus_node_stats_reset/9.4-1.sql"
+#include "udfs/citus_shard_load/9.4-1.sql"
+#include "udfs/citus_shard_load_reset/9.4-1.sql"
+#include "udfs/citus_stat_progress_query/9.4-1.sql"
+#include "udfs/columnar_handler/9.4-1.sql"
+#include "udfs/worker_cached_block_count/9.4-1.sql"
+#include "udfs/worker_prewarm_relation/9.4-1.sql"
+#include "udfs/master_set_coordinator_host/9.4-1.sql"
+#include "udfs/master_reshard_table/9.4-1.sql"
+#include "udfs/worker_save_query_explain_analyze/9.4-1.sql"
+#include "udfs/worker_last_saved_explain_analyze/9.4-1.sql"
+#include "udfs/worker_combine_partial_agg/9.4-1.sql"
+#include "udfs/citus_approximate_count/9.4-1.sql"
+#include "udfs/citus_create_rollup/9.4-1.sql"
+#include "udfs/citus_refresh_rollup/9.4-1.sql"
+#include "udfs/citus_drop_rollup/9.4-1.sql"
+
+-- custom rebalance strategies are now supported
+DROP TRIGGER pg_dist_rebalance_strategy_enterprise_check_trigger
+  ON pg_catalog.pg_dist_rebalance_strategy;
+DROP FUNCTION citus_internal.pg_dist_rebalance_strategy_enterprise_check();
+
+CREATE TABLE citus.pg_dist_metadata_delta(
+    deltaid bigserial PRIMARY KEY,
+    nodeid int NOT NULL,
+    command text NOT NULL
+);
+ALTER TABLE citus.pg_dist_metadata_delta SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.pg_dist_metadata_delta TO public;
+COMMENT ON TABLE pg_catalog.pg_dist_metadata_delta
+    IS 'metadata changes that out of sync metadata nodes have yet to apply';
+
+CREATE TABLE citus.pg_dist_rollup(
+    rollup_name name PRIMARY KEY,
+    source_table regclass NOT NULL,
+    id_column name NOT NULL,
+    aggregation_command text NOT NULL,
+    rollup_owner regrole NOT NULL,
+    last_aggregated_id bigint NOT NULL DEFAULT 0
+);
+ALTER TABLE citus.pg_dist_rollup SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.pg_dist_rollup TO public;
+COMMENT ON TABLE pg_catalog.pg_dist_rollup
+    IS 'rollups of distributed tables and the ids up to which they are aggregated';
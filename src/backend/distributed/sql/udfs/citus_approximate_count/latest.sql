@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_approximate_count(logicalrelid regclass)
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_approximate_count$$;
+COMMENT ON FUNCTION pg_catalog.citus_approximate_count(regclass)
+    IS 'estimate the number of rows in the specified table from the statistics of its shards';
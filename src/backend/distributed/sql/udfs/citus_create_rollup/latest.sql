@@ -0,0 +1,10 @@
+CREATE FUNCTION pg_catalog.citus_create_rollup(
+    rollup_name name,
+    source_table regclass,
+    id_column name,
+    aggregation_command text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_create_rollup$$;
+COMMENT ON FUNCTION pg_catalog.citus_create_rollup(name, regclass, name, text)
+    IS 'create a rollup that runs the aggregation command for the ids between $1 (exclusive) and $2 (inclusive) that were added to the source table since its last refresh';
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_drop_rollup(rollup_name name)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_drop_rollup$$;
+COMMENT ON FUNCTION pg_catalog.citus_drop_rollup(name)
+    IS 'stop refreshing the rollup, the rollup table is left as is';
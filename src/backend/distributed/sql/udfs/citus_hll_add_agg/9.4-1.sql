@@ -0,0 +1,64 @@
+CREATE FUNCTION pg_catalog.citus_hll_add_trans(bytea, anyelement)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_hll_add_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_hll_add_trans(bytea, anyelement)
+    IS 'adds a value to a HyperLogLog sketch';
+
+CREATE FUNCTION pg_catalog.citus_hll_add_trans(bytea, anyelement, integer)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_hll_add_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_hll_add_trans(bytea, anyelement, integer)
+    IS 'adds a value to a HyperLogLog sketch of the given precision';
+
+CREATE FUNCTION pg_catalog.citus_hll_union_trans(bytea, bytea)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_hll_union_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_hll_union_trans(bytea, bytea)
+    IS 'merges two HyperLogLog sketches';
+
+CREATE FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+    RETURNS bigint
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_hll_cardinality$$;
+COMMENT ON FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+    IS 'estimates the number of distinct values in a HyperLogLog sketch';
+
+CREATE AGGREGATE pg_catalog.citus_hll_add_agg(anyelement) (
+    sfunc = pg_catalog.citus_hll_add_trans,
+    combinefunc = pg_catalog.citus_hll_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_add_agg(anyelement)
+    IS 'builds a HyperLogLog sketch of the distinct values';
+
+CREATE AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, integer) (
+    sfunc = pg_catalog.citus_hll_add_trans,
+    combinefunc = pg_catalog.citus_hll_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, integer)
+    IS 'builds a HyperLogLog sketch of the given precision of the distinct values';
+
+CREATE AGGREGATE pg_catalog.citus_hll_union_agg(bytea) (
+    sfunc = pg_catalog.citus_hll_union_trans,
+    combinefunc = pg_catalog.citus_hll_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_union_agg(bytea)
+    IS 'merges HyperLogLog sketches';
+
+CREATE AGGREGATE pg_catalog.approx_count_distinct(anyelement) (
+    sfunc = pg_catalog.citus_hll_add_trans,
+    combinefunc = pg_catalog.citus_hll_union_trans,
+    finalfunc = pg_catalog.citus_hll_cardinality,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.approx_count_distinct(anyelement)
+    IS 'estimates the number of distinct values using a HyperLogLog sketch';
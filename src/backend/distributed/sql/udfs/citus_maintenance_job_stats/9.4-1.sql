@@ -0,0 +1,17 @@
+CREATE FUNCTION pg_catalog.citus_maintenance_job_stats(
+	OUT job_name text,
+	OUT running bool,
+	OUT last_start_time timestamptz,
+	OUT last_end_time timestamptz,
+	OUT last_duration float8,
+	OUT lag float8)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_maintenance_job_stats$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_maintenance_job_stats()
+     IS 'returns the last run of each maintenance daemon job and how long it is overdue, in milliseconds';
+
+CREATE VIEW citus.citus_maintenance_jobs AS SELECT * FROM pg_catalog.citus_maintenance_job_stats();
+ALTER VIEW citus.citus_maintenance_jobs SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_maintenance_jobs TO public;
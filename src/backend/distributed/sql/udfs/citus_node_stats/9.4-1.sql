@@ -0,0 +1,25 @@
+CREATE FUNCTION pg_catalog.citus_node_stats(
+	OUT nodename text,
+	OUT nodeport int,
+	OUT tasks bigint,
+	OUT total_task_time float8,
+	OUT task_failures bigint,
+	OUT task_retries bigint,
+	OUT task_latency_histogram bigint[],
+	OUT connections bigint,
+	OUT total_connection_time float8,
+	OUT connection_failures bigint,
+	OUT connection_latency_histogram bigint[],
+	OUT bytes_sent bigint,
+	OUT bytes_received bigint,
+	OUT latency_bucket_bounds float8[])
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_node_stats$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_node_stats()
+     IS 'returns latency histograms and throughput counters of the remote work per node';
+
+CREATE VIEW citus.citus_node_stats AS SELECT * FROM pg_catalog.citus_node_stats();
+ALTER VIEW citus.citus_node_stats SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_node_stats TO public;
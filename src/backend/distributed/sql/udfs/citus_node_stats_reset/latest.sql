@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.citus_node_stats_reset()
+RETURNS VOID
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_node_stats_reset$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_node_stats_reset()
+     IS 'zeroes the statistics shown in citus_node_stats';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_node_stats_reset() FROM PUBLIC;
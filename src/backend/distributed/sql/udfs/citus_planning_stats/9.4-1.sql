@@ -0,0 +1,24 @@
+CREATE FUNCTION pg_catalog.citus_planning_stats(
+	OUT queryid bigint,
+	OUT userid oid,
+	OUT dbid oid,
+	OUT calls bigint,
+	OUT total_time float8,
+	OUT other_time float8,
+	OUT standard_planner_time float8,
+	OUT fast_path_planner_time float8,
+	OUT router_planner_time float8,
+	OUT recursive_planning_time float8,
+	OUT restriction_equivalence_time float8,
+	OUT logical_planner_time float8,
+	OUT physical_planner_time float8)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_planning_stats$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_planning_stats()
+     IS 'returns the time spent in each distributed planning phase per query';
+
+CREATE VIEW citus.citus_planning_stats AS SELECT * FROM pg_catalog.citus_planning_stats();
+ALTER VIEW citus.citus_planning_stats SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_planning_stats TO public;
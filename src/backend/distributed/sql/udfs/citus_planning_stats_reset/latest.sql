@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.citus_planning_stats_reset()
+RETURNS VOID
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_planning_stats_reset$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_planning_stats_reset()
+     IS 'removes all the statistics collected by citus.track_planning_stats';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_planning_stats_reset() FROM PUBLIC;
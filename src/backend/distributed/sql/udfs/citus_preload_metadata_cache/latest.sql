@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.citus_preload_metadata_cache()
+RETURNS int
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_preload_metadata_cache$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_preload_metadata_cache()
+     IS 'loads the metadata of the tables in citus.metadata_cache_preload_tables into the cache of the backend';
@@ -0,0 +1,19 @@
+-- citus_query_stats() also returns the planning and execution statistics
+DROP FUNCTION pg_catalog.citus_query_stats();
+CREATE FUNCTION pg_catalog.citus_query_stats(OUT queryid bigint,
+											 OUT userid oid,
+											 OUT dbid oid,
+											 OUT executor bigint,
+											 OUT partition_key text,
+											 OUT calls bigint,
+											 OUT plans bigint,
+											 OUT total_plan_time float8,
+											 OUT total_exec_time float8,
+											 OUT rows bigint,
+											 OUT remote_bytes bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_stats$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_query_stats()
+     IS 'returns the statistics of distributed queries per executor and partition key value';
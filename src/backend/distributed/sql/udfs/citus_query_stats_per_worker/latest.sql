@@ -0,0 +1,34 @@
+CREATE FUNCTION pg_catalog.citus_query_stats_per_worker(OUT queryid bigint,
+														OUT userid oid,
+														OUT dbid oid,
+														OUT nodeid int,
+														OUT calls bigint,
+														OUT tasks bigint,
+														OUT rows bigint,
+														OUT remote_bytes bigint,
+														OUT total_time float8)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_stats_per_worker$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_query_stats_per_worker()
+     IS 'returns the statistics of distributed queries per worker';
+
+CREATE VIEW citus.citus_stat_statements_workers AS
+SELECT
+  queryid,
+  userid,
+  dbid,
+  nodeid,
+  nodename,
+  nodeport,
+  calls,
+  tasks,
+  rows,
+  remote_bytes,
+  total_time,
+  total_time / nullif(calls, 0) AS mean_time
+FROM pg_catalog.citus_query_stats_per_worker()
+JOIN pg_catalog.pg_dist_node USING (nodeid);
+ALTER VIEW citus.citus_stat_statements_workers SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements_workers TO public;
@@ -0,0 +1,26 @@
+CREATE FUNCTION pg_catalog.citus_recent_spans(
+	OUT trace_id text,
+	OUT span_id text,
+	OUT pid int,
+	OUT queryid bigint,
+	OUT task_id int,
+	OUT shard_id bigint,
+	OUT nodename text,
+	OUT nodeport int,
+	OUT ready_time timestamptz,
+	OUT send_time timestamptz,
+	OUT first_row_time timestamptz,
+	OUT end_time timestamptz,
+	OUT rows bigint,
+	OUT succeeded bool,
+	OUT userid oid)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_recent_spans$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_recent_spans()
+     IS 'returns the spans of the most recent tasks when distributed tracing is enabled';
+
+CREATE VIEW citus.citus_recent_spans AS SELECT * FROM pg_catalog.citus_recent_spans();
+ALTER VIEW citus.citus_recent_spans SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_recent_spans TO public;
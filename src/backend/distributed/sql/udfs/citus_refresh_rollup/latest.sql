@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_refresh_rollup(rollup_name name)
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_refresh_rollup$$;
+COMMENT ON FUNCTION pg_catalog.citus_refresh_rollup(name)
+    IS 'aggregate the rows that were added to the source table of the rollup since its last refresh and return the id up to which it is aggregated';
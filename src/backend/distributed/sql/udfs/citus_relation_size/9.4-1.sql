@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_relation_size(logicalrelid regclass, exact boolean)
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_relation_size$$;
+COMMENT ON FUNCTION pg_catalog.citus_relation_size(regclass, boolean)
+    IS 'get disk space used by the ''main'' fork, optionally bypassing the shard size cache';
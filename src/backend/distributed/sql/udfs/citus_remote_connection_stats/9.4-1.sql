@@ -0,0 +1,55 @@
+DROP FUNCTION pg_catalog.citus_remote_connection_stats(
+	OUT hostname text,
+	OUT port int,
+	OUT database_name text,
+	OUT connection_count_to_node int);
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_remote_connection_stats(
+	OUT hostname text,
+	OUT port int,
+	OUT database_name text,
+	OUT connection_count_to_node int,
+	OUT connection_wait_count bigint,
+	OUT connection_wait_time float8,
+	OUT connection_establishment_count bigint,
+	OUT connection_establishment_time float8,
+	OUT ssl_connection_count bigint,
+	OUT interactive_connection_wait_count bigint,
+	OUT interactive_connection_wait_time float8,
+	OUT batch_connection_wait_count bigint,
+	OUT batch_connection_wait_time float8)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_remote_connection_stats$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_remote_connection_stats(
+	OUT hostname text,
+	OUT port int,
+	OUT database_name text,
+	OUT connection_count_to_node int,
+	OUT connection_wait_count bigint,
+	OUT connection_wait_time float8,
+	OUT connection_establishment_count bigint,
+	OUT connection_establishment_time float8,
+	OUT ssl_connection_count bigint,
+	OUT interactive_connection_wait_count bigint,
+	OUT interactive_connection_wait_time float8,
+	OUT batch_connection_wait_count bigint,
+	OUT batch_connection_wait_time float8)
+     IS 'returns statistics about remote connections';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_remote_connection_stats(
+		OUT hostname text,
+		OUT port int,
+		OUT database_name text,
+		OUT connection_count_to_node int,
+		OUT connection_wait_count bigint,
+		OUT connection_wait_time float8,
+		OUT connection_establishment_count bigint,
+		OUT connection_establishment_time float8,
+		OUT ssl_connection_count bigint,
+		OUT interactive_connection_wait_count bigint,
+		OUT interactive_connection_wait_time float8,
+		OUT batch_connection_wait_count bigint,
+		OUT batch_connection_wait_time float8)
+FROM PUBLIC;
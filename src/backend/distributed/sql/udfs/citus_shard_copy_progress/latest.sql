@@ -0,0 +1,23 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_copy_progress(
+	OUT pid int,
+	OUT table_name regclass,
+	OUT shardid bigint,
+	OUT source_name text,
+	OUT source_port int,
+	OUT target_name text,
+	OUT target_port int,
+	OUT status text)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_copy_progress$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_copy_progress(
+	OUT pid int,
+	OUT table_name regclass,
+	OUT shardid bigint,
+	OUT source_name text,
+	OUT source_port int,
+	OUT target_name text,
+	OUT target_port int,
+	OUT status text)
+     IS 'returns the progress of ongoing shard copies';
@@ -0,0 +1,19 @@
+CREATE FUNCTION pg_catalog.citus_shard_load(
+	OUT shardid bigint,
+	OUT partition_key text,
+	OUT calls bigint,
+	OUT total_time float8,
+	OUT max_error bigint)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_load$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_load()
+     IS 'returns the estimated load of the most loaded shards and partition key values';
+
+CREATE VIEW citus.citus_shard_load AS
+SELECT s.logicalrelid, l.*
+FROM pg_catalog.citus_shard_load() l
+LEFT JOIN pg_catalog.pg_dist_shard s USING (shardid);
+ALTER VIEW citus.citus_shard_load SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_shard_load TO public;
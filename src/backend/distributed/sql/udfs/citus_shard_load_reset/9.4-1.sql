@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.citus_shard_load_reset()
+RETURNS VOID
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_load_reset$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_load_reset()
+     IS 'removes the statistics shown in citus_shard_load';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_shard_load_reset() FROM PUBLIC;
@@ -0,0 +1,13 @@
+CREATE FUNCTION pg_catalog.citus_shard_map(
+	OUT table_name regclass,
+	OUT colocation_id int,
+	OUT shard_id bigint,
+	OUT shard_min_value int,
+	OUT shard_max_value int,
+	OUT node_id int)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_map$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_map()
+     IS 'returns the hash range and the primary node of each shard of hash-distributed tables';
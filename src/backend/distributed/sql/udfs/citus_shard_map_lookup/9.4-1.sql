@@ -0,0 +1,12 @@
+CREATE FUNCTION pg_catalog.citus_shard_map_lookup(
+	table_name regclass,
+	distribution_values anyarray,
+	OUT value_index int,
+	OUT shard_id bigint,
+	OUT node_id int)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_map_lookup$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_map_lookup(regclass, anyarray)
+     IS 'returns the shard and the primary node of each of the given distribution values';
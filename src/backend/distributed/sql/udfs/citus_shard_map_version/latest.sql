@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.citus_shard_map_version()
+RETURNS bigint
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_map_version$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_shard_map_version()
+     IS 'returns a version of the shard map that changes whenever citus_shard_map() changes';
@@ -0,0 +1,23 @@
+CREATE FUNCTION pg_catalog.citus_stat_progress_query(
+	OUT pid int,
+	OUT initiator_node_identifier int,
+	OUT transaction_number bigint,
+	OUT nodename text,
+	OUT nodeport int,
+	OUT tasks bigint,
+	OUT tasks_queued bigint,
+	OUT tasks_running bigint,
+	OUT tasks_done bigint,
+	OUT rows_received bigint,
+	OUT bytes_received bigint)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_stat_progress_query$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_stat_progress_query()
+     IS 'returns the progress of running distributed executions per worker';
+
+CREATE VIEW citus.citus_stat_progress_query AS
+SELECT * FROM pg_catalog.citus_stat_progress_query();
+ALTER VIEW citus.citus_stat_progress_query SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_progress_query TO public;
@@ -0,0 +1,56 @@
+-- citus_stat_statements also shows the planning and execution statistics
+DROP VIEW pg_catalog.citus_stat_statements;
+DROP FUNCTION pg_catalog.citus_stat_statements();
+
+CREATE FUNCTION pg_catalog.citus_stat_statements(OUT queryid bigint,
+												 OUT userid oid,
+												 OUT dbid oid,
+												 OUT query text,
+												 OUT executor bigint,
+												 OUT partition_key text,
+												 OUT calls bigint,
+												 OUT plans bigint,
+												 OUT total_plan_time float8,
+												 OUT total_exec_time float8,
+												 OUT rows bigint,
+												 OUT remote_bytes bigint)
+RETURNS SETOF record
+LANGUAGE plpgsql
+AS $citus_stat_statements$
+BEGIN
+ IF EXISTS (
+ 	SELECT extname FROM pg_extension
+ 	WHERE extname = 'pg_stat_statements')
+ THEN
+ 	RETURN QUERY SELECT pss.queryid, pss.userid, pss.dbid, pss.query, cqs.executor,
+ 						cqs.partition_key, cqs.calls, cqs.plans, cqs.total_plan_time,
+ 						cqs.total_exec_time, cqs.rows, cqs.remote_bytes
+ 				 FROM pg_stat_statements(true) pss
+ 				 	JOIN citus_query_stats() cqs
+ 				 	USING (queryid, userid, dbid);
+ ELSE
+    RAISE EXCEPTION 'pg_stat_statements is not installed'
+    	USING HINT = 'install pg_stat_statements extension and try again';
+ END IF;
+END;
+$citus_stat_statements$;
+
+CREATE VIEW citus.citus_stat_statements AS
+SELECT
+  queryid,
+  userid,
+  dbid,
+  query,
+  pg_catalog.citus_executor_name(executor::int) AS executor,
+  partition_key,
+  calls,
+  plans,
+  total_plan_time,
+  total_plan_time / nullif(plans, 0) AS mean_plan_time,
+  total_exec_time,
+  total_exec_time / nullif(calls, 0) AS mean_exec_time,
+  rows,
+  remote_bytes
+FROM pg_catalog.citus_stat_statements();
+ALTER VIEW citus.citus_stat_statements SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements TO public;
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_table_size(logicalrelid regclass, exact boolean)
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_table_size$$;
+COMMENT ON FUNCTION pg_catalog.citus_table_size(regclass, boolean)
+    IS 'get disk space used by the specified table, excluding indexes, optionally bypassing the shard size cache';
@@ -0,0 +1,54 @@
+CREATE FUNCTION pg_catalog.citus_tdigest_add_trans(bytea, double precision)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_tdigest_add_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_tdigest_add_trans(bytea, double precision)
+    IS 'adds a value to a t-digest';
+
+CREATE FUNCTION pg_catalog.citus_tdigest_add_trans(bytea, double precision, integer)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_tdigest_add_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_tdigest_add_trans(bytea, double precision, integer)
+    IS 'adds a value to a t-digest of the given compression';
+
+CREATE FUNCTION pg_catalog.citus_tdigest_union_trans(bytea, bytea)
+    RETURNS bytea
+    LANGUAGE C CALLED ON NULL INPUT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_tdigest_union_trans$$;
+COMMENT ON FUNCTION pg_catalog.citus_tdigest_union_trans(bytea, bytea)
+    IS 'merges two t-digests';
+
+CREATE FUNCTION pg_catalog.citus_tdigest_percentile(bytea, double precision)
+    RETURNS double precision
+    LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$citus_tdigest_percentile$$;
+COMMENT ON FUNCTION pg_catalog.citus_tdigest_percentile(bytea, double precision)
+    IS 'estimates the value at the given percentile of a t-digest';
+
+CREATE AGGREGATE pg_catalog.citus_tdigest_add_agg(double precision) (
+    sfunc = pg_catalog.citus_tdigest_add_trans,
+    combinefunc = pg_catalog.citus_tdigest_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_tdigest_add_agg(double precision)
+    IS 'builds a t-digest of the values';
+
+CREATE AGGREGATE pg_catalog.citus_tdigest_add_agg(double precision, integer) (
+    sfunc = pg_catalog.citus_tdigest_add_trans,
+    combinefunc = pg_catalog.citus_tdigest_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_tdigest_add_agg(double precision, integer)
+    IS 'builds a t-digest of the given compression of the values';
+
+CREATE AGGREGATE pg_catalog.citus_tdigest_union_agg(bytea) (
+    sfunc = pg_catalog.citus_tdigest_union_trans,
+    combinefunc = pg_catalog.citus_tdigest_union_trans,
+    stype = bytea,
+    parallel = safe
+);
+COMMENT ON AGGREGATE pg_catalog.citus_tdigest_union_agg(bytea)
+    IS 'merges t-digests';
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_total_relation_size(logicalrelid regclass, exact boolean)
+    RETURNS bigint
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_total_relation_size$$;
+COMMENT ON FUNCTION pg_catalog.citus_total_relation_size(regclass, boolean)
+    IS 'get total disk space used by the specified table, optionally bypassing the shard size cache';
@@ -0,0 +1,13 @@
+CREATE FUNCTION pg_catalog.citus_wait_events(
+	OUT pid int,
+	OUT wait_event text)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_wait_events$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_wait_events()
+     IS 'returns the names of the Citus wait events backends are waiting in';
+
+CREATE VIEW citus.citus_wait_events AS SELECT * FROM pg_catalog.citus_wait_events();
+ALTER VIEW citus.citus_wait_events SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_wait_events TO public;
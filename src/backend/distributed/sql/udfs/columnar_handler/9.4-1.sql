@@ -0,0 +1,21 @@
+-- table access methods only exist as of PostgreSQL 12
+DO $proc$
+BEGIN
+IF current_setting('server_version_num')::int >= 120000 THEN
+  EXECUTE $$
+    CREATE FUNCTION pg_catalog.columnar_handler(internal)
+    RETURNS table_am_handler
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', 'columnar_handler';
+
+    COMMENT ON FUNCTION pg_catalog.columnar_handler(internal)
+        IS 'returns the routines of the columnar table access method';
+
+    CREATE ACCESS METHOD columnar TYPE TABLE HANDLER pg_catalog.columnar_handler;
+
+    COMMENT ON ACCESS METHOD columnar
+        IS 'stores rows in compressed stripes of column chunks';
+  $$;
+END IF;
+END;
+$proc$;
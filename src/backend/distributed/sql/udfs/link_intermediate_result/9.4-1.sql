@@ -0,0 +1,8 @@
+CREATE OR REPLACE FUNCTION pg_catalog.link_intermediate_result(
+    source_result_id text,
+    target_result_id text)
+RETURNS void
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$link_intermediate_result$$;
+COMMENT ON FUNCTION pg_catalog.link_intermediate_result(text,text)
+IS 'make an intermediate result of the current transaction available under another result id';
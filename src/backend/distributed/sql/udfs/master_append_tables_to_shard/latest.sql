@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.master_append_tables_to_shard(shard_id bigint,
+                                                         source_table_names text[],
+                                                         source_node_names text[],
+                                                         source_node_ports integer[])
+    RETURNS real
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$master_append_tables_to_shard$$;
+COMMENT ON FUNCTION pg_catalog.master_append_tables_to_shard(bigint, text[], text[], integer[])
+    IS 'append given tables to all shard placements in parallel and update metadata';
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.master_reshard_table(table_name regclass, shard_count integer)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$master_reshard_table$$;
+COMMENT ON FUNCTION pg_catalog.master_reshard_table(regclass, integer)
+    IS 'change the number of shards of a table and its colocated tables';
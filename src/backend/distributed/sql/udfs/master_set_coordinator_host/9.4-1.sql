@@ -0,0 +1,17 @@
+CREATE FUNCTION pg_catalog.master_set_coordinator_host(
+    host text,
+    port integer default current_setting('port')::int,
+    node_role noderole default 'primary',
+    node_cluster name default 'default')
+  RETURNS VOID
+  LANGUAGE C STRICT
+  AS 'MODULE_PATHNAME', $$master_set_coordinator_host$$;
+COMMENT ON FUNCTION pg_catalog.master_set_coordinator_host(
+    host text,
+    port integer,
+    node_role noderole,
+    node_cluster name)
+  IS 'add the coordinator to pg_dist_node or set its hostname and port';
+
+REVOKE ALL ON FUNCTION pg_catalog.master_set_coordinator_host(text,int,noderole,name)
+  FROM PUBLIC;
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.master_split_shard(shard_id bigint, split_point integer)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$master_split_shard$$;
+COMMENT ON FUNCTION pg_catalog.master_split_shard(bigint, integer)
+    IS 'split a shard and its colocated shards at the given hash value';
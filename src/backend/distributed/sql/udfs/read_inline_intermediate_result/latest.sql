@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.read_inline_intermediate_result(result_data text)
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$read_inline_intermediate_result$$;
+COMMENT ON FUNCTION pg_catalog.read_inline_intermediate_result(text)
+IS 'return an intermediate result that was inlined into the query as a set of records';
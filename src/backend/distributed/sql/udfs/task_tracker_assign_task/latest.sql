@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.task_tracker_assign_task(bigint, integer, text, integer)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$task_tracker_assign_task$$;
+COMMENT ON FUNCTION pg_catalog.task_tracker_assign_task(bigint, integer, text, integer)
+    IS 'assign a task to execute with the given scheduling priority';
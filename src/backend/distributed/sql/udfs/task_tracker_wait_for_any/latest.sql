@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.task_tracker_wait_for_any(job_ids bigint[], task_ids integer[],
+                                                     timeout integer)
+    RETURNS boolean
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$task_tracker_wait_for_any$$;
+COMMENT ON FUNCTION pg_catalog.task_tracker_wait_for_any(bigint[], integer[], integer)
+    IS 'wait until any of the given tasks finishes or the timeout in milliseconds passes';
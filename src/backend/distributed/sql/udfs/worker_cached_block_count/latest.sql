@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.worker_cached_block_count(relation regclass)
+RETURNS bigint
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_cached_block_count$$;
+
+COMMENT ON FUNCTION pg_catalog.worker_cached_block_count(regclass)
+     IS 'returns the number of blocks of a relation in the buffer cache';
+
+REVOKE ALL ON FUNCTION pg_catalog.worker_cached_block_count(regclass) FROM PUBLIC;
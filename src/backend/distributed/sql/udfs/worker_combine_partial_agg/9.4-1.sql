@@ -0,0 +1,23 @@
+CREATE FUNCTION pg_catalog.worker_combine_partial_agg_sfunc(internal, oid, cstring)
+    RETURNS internal
+    LANGUAGE C PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$coord_combine_agg_sfunc$$;
+COMMENT ON FUNCTION pg_catalog.worker_combine_partial_agg_sfunc(internal, oid, cstring)
+    IS 'transition function for worker_combine_partial_agg';
+
+-- select worker_combine_partial_agg(agg, col)
+-- equivalent to
+-- select to_cstring(agg_combine(from_cstring(col)))
+CREATE AGGREGATE pg_catalog.worker_combine_partial_agg(oid, cstring) (
+    STYPE = internal,
+    SFUNC = pg_catalog.worker_combine_partial_agg_sfunc,
+    FINALFUNC = pg_catalog.worker_partial_agg_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.worker_combine_partial_agg(oid, cstring)
+    IS 'support aggregate for combining the partial aggregates of the shards of a node';
+
+REVOKE ALL ON FUNCTION pg_catalog.worker_combine_partial_agg_sfunc FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_catalog.worker_combine_partial_agg FROM PUBLIC;
+
+GRANT EXECUTE ON FUNCTION pg_catalog.worker_combine_partial_agg_sfunc TO PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_catalog.worker_combine_partial_agg TO PUBLIC;
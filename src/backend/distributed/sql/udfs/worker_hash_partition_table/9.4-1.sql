@@ -0,0 +1,14 @@
+CREATE FUNCTION pg_catalog.worker_hash_partition_table(job_id bigint,
+                                                       task_id integer,
+                                                       filter_query text,
+                                                       partition_column text,
+                                                       partition_column_type oid,
+                                                       hash_ranges anyarray,
+                                                       skewed_hashes integer[],
+                                                       skew_partition_counts integer[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_hash_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_hash_partition_table(bigint, integer, text, text, oid,
+                                                           anyarray, integer[], integer[])
+    IS 'hash partition query results, spreading the rows of skewed values over several partitions';
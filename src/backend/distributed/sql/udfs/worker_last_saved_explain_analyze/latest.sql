@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.worker_last_saved_explain_analyze(
+	OUT explain_analyze_output text,
+	OUT execution_duration float8)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_last_saved_explain_analyze$$;
+
+COMMENT ON FUNCTION pg_catalog.worker_last_saved_explain_analyze()
+     IS 'returns the plan saved by the last call to worker_save_query_explain_analyze';
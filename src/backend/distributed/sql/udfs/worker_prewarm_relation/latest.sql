@@ -0,0 +1,10 @@
+CREATE FUNCTION pg_catalog.worker_prewarm_relation(relation regclass,
+												   max_block_count bigint)
+RETURNS bigint
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_prewarm_relation$$;
+
+COMMENT ON FUNCTION pg_catalog.worker_prewarm_relation(regclass, bigint)
+     IS 'loads the first blocks of a relation into the buffer cache';
+
+REVOKE ALL ON FUNCTION pg_catalog.worker_prewarm_relation(regclass, bigint) FROM PUBLIC;
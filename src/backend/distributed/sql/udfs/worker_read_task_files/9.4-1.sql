@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.worker_read_task_files(job_id bigint, task_id integer)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE PARALLEL UNSAFE
+    AS 'MODULE_PATHNAME', $$worker_read_task_files$$;
+COMMENT ON FUNCTION pg_catalog.worker_read_task_files(bigint, integer)
+    IS 'read the partition files fetched for a merge task';
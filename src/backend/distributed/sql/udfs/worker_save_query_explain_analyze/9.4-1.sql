@@ -0,0 +1,15 @@
+CREATE FUNCTION pg_catalog.worker_save_query_explain_analyze(query text,
+															 verbose boolean,
+															 costs boolean,
+															 buffers boolean,
+															 timing boolean,
+															 summary boolean,
+															 format text)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_save_query_explain_analyze$$;
+
+COMMENT ON FUNCTION pg_catalog.worker_save_query_explain_analyze(text, boolean, boolean,
+																 boolean, boolean,
+																 boolean, text)
+     IS 'runs a query with EXPLAIN ANALYZE, returns its rows and saves its plan';
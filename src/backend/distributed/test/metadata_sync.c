@@ -14,6 +14,7 @@
 #include "fmgr.h"
 
 #include "catalog/pg_type.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_sync.h"
@@ -106,7 +107,7 @@ wait_until_metadata_sync(PG_FUNCTION_ARGS)
 
 	int waitFlags = WL_SOCKET_READABLE | WL_TIMEOUT | WL_POSTMASTER_DEATH;
 	int waitResult = WaitLatchOrSocket(NULL, waitFlags, PQsocket(connection->pgConn),
-									   timeout, 0);
+									   timeout, WAIT_EVENT_CITUS_METADATA_SYNC);
 	if (waitResult & WL_POSTMASTER_DEATH)
 	{
 		ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -0,0 +1,325 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/planner_benchmarks.c
+ *
+ * This file contains functions to measure the time and memory that shard
+ * pruning, distributed planning and deparsing of task queries take, such
+ * that these code paths can be profiled in isolation.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "funcapi.h"
+
+#include "access/htup_details.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_router_planner.h"
+#include "distributed/shard_pruning.h"
+#include "lib/stringinfo.h"
+#include "nodes/makefuncs.h"
+#include "nodes/memnodes.h"
+#include "nodes/nodes.h"
+#include "nodes/pg_list.h"
+#include "optimizer/clauses.h"
+#include "portability/instr_time.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+#define PLANNER_BENCHMARK_COLUMNS 2
+
+
+/* the operation that a benchmark runs repeatedly */
+typedef void (*BenchmarkOperation)(void *context);
+
+
+/* arguments of a shard pruning operation */
+typedef struct PruneBenchmarkContext
+{
+	Oid relationId;
+	List *whereClauseList;
+} PruneBenchmarkContext;
+
+
+/* arguments of a task query deparsing operation */
+typedef struct DeparseBenchmarkContext
+{
+	Query *jobQuery;
+	List *taskList;
+} DeparseBenchmarkContext;
+
+
+/* local function forward declarations */
+static Datum RunPlannerBenchmark(FunctionCallInfo fcinfo, BenchmarkOperation operation,
+								 void *context, int iterationCount);
+static Size MemoryContextUsedBytes(MemoryContext context);
+static void PruneBenchmarkOperation(void *context);
+static void PlanBenchmarkOperation(void *context);
+static void DeparseBenchmarkOperation(void *context);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(citus_bench_prune);
+PG_FUNCTION_INFO_V1(citus_bench_plan);
+PG_FUNCTION_INFO_V1(citus_bench_deparse);
+
+
+/*
+ * citus_bench_prune prunes the shards of the given table using the given
+ * WHERE clause as often as the given number of iterations, and returns the
+ * time in nanoseconds and the memory in bytes that pruning took on average.
+ */
+Datum
+citus_bench_prune(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	char *whereClause = text_to_cstring(PG_GETARG_TEXT_P(1));
+	int iterationCount = PG_GETARG_INT32(2);
+
+	if (!IsCitusTable(relationId))
+	{
+		ereport(ERROR, (errmsg("relation %s is not distributed",
+							   generate_qualified_relation_name(relationId))));
+	}
+
+	StringInfo queryString = makeStringInfo();
+	appendStringInfo(queryString, "SELECT 1 FROM %s WHERE %s",
+					 generate_qualified_relation_name(relationId), whereClause);
+
+	Query *query = ParseQueryString(queryString->data, NULL, 0);
+
+	/* the planner simplifies the quals before pruning, so do the same */
+	Node *quals = eval_const_expressions(NULL, query->jointree->quals);
+
+	PruneBenchmarkContext *context = palloc0(sizeof(PruneBenchmarkContext));
+	context->relationId = relationId;
+	context->whereClauseList = make_ands_implicit((Expr *) quals);
+
+	return RunPlannerBenchmark(fcinfo, PruneBenchmarkOperation, context,
+							   iterationCount);
+}
+
+
+/*
+ * citus_bench_plan plans the given query with the distributed planner as
+ * often as the given number of iterations, and returns the time in
+ * nanoseconds and the memory in bytes that planning took on average.
+ */
+Datum
+citus_bench_plan(PG_FUNCTION_ARGS)
+{
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(0));
+	int iterationCount = PG_GETARG_INT32(1);
+
+	Query *query = ParseQueryString(queryString, NULL, 0);
+
+	return RunPlannerBenchmark(fcinfo, PlanBenchmarkOperation, query, iterationCount);
+}
+
+
+/*
+ * citus_bench_deparse plans the given query once, and then deparses the
+ * queries of all its tasks as often as the given number of iterations. It
+ * returns the time in nanoseconds and the memory in bytes that deparsing
+ * the task queries took on average.
+ */
+Datum
+citus_bench_deparse(PG_FUNCTION_ARGS)
+{
+	char *queryString = text_to_cstring(PG_GETARG_TEXT_P(0));
+	int iterationCount = PG_GETARG_INT32(1);
+	int cursorOptions = 0;
+
+	Query *query = ParseQueryString(queryString, NULL, 0);
+
+	PlannedStmt *plan = distributed_planner(copyObject(query), cursorOptions, NULL);
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	if (customScan == NULL)
+	{
+		ereport(ERROR, (errmsg("query is not planned by the distributed planner")));
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->jobQuery == NULL)
+	{
+		ereport(ERROR, (errmsg("query does not have task queries to deparse")));
+	}
+
+	DeparseBenchmarkContext *context = palloc0(sizeof(DeparseBenchmarkContext));
+	context->jobQuery = workerJob->jobQuery;
+	context->taskList = workerJob->taskList;
+
+	return RunPlannerBenchmark(fcinfo, DeparseBenchmarkOperation, context,
+							   iterationCount);
+}
+
+
+/*
+ * RunPlannerBenchmark runs the given operation as often as the given number
+ * of iterations, each time in a fresh memory context, and returns a record
+ * with the average time in nanoseconds and the average memory in bytes that
+ * the operation took.
+ */
+static Datum
+RunPlannerBenchmark(FunctionCallInfo fcinfo, BenchmarkOperation operation,
+					void *context, int iterationCount)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[PLANNER_BENCHMARK_COLUMNS];
+	bool isNulls[PLANNER_BENCHMARK_COLUMNS];
+	instr_time totalDuration;
+	Size totalAllocatedBytes = 0;
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	if (iterationCount <= 0)
+	{
+		ereport(ERROR, (errmsg("number of iterations must be positive")));
+	}
+
+	MemoryContext benchmarkContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Planner Benchmark",
+														   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	/* memory that the empty context already counts as used */
+	Size emptyContextBytes = MemoryContextUsedBytes(benchmarkContext);
+
+	INSTR_TIME_SET_ZERO(totalDuration);
+
+	for (int iteration = 0; iteration < iterationCount; iteration++)
+	{
+		instr_time startTime;
+		instr_time endTime;
+
+		CHECK_FOR_INTERRUPTS();
+
+		INSTR_TIME_SET_CURRENT(startTime);
+
+		operation(context);
+
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(totalDuration, endTime, startTime);
+
+		totalAllocatedBytes += MemoryContextUsedBytes(benchmarkContext) -
+							   emptyContextBytes;
+
+		MemoryContextReset(benchmarkContext);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Float8GetDatum(INSTR_TIME_GET_DOUBLE(totalDuration) * 1e9 /
+							   iterationCount);
+	values[1] = Int64GetDatum(totalAllocatedBytes / iterationCount);
+
+	tupleDescriptor = BlessTupleDesc(tupleDescriptor);
+	HeapTuple resultTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(resultTuple));
+}
+
+
+/*
+ * MemoryContextUsedBytes returns the number of bytes that are allocated in the
+ * given memory context and its children, and not free for reuse.
+ */
+static Size
+MemoryContextUsedBytes(MemoryContext context)
+{
+	MemoryContextCounters counters;
+
+	memset(&counters, 0, sizeof(counters));
+	context->methods->stats(context, NULL, NULL, &counters);
+
+	Size usedBytes = counters.totalspace - counters.freespace;
+
+	for (MemoryContext child = context->firstchild; child != NULL;
+		 child = child->nextchild)
+	{
+		usedBytes += MemoryContextUsedBytes(child);
+	}
+
+	return usedBytes;
+}
+
+
+/*
+ * PruneBenchmarkOperation prunes the shards of the table in the given
+ * PruneBenchmarkContext.
+ */
+static void
+PruneBenchmarkOperation(void *context)
+{
+	PruneBenchmarkContext *pruneContext = (PruneBenchmarkContext *) context;
+	Index rangeTableId = 1;
+
+	PruneShards(pruneContext->relationId, rangeTableId, pruneContext->whereClauseList,
+				NULL);
+}
+
+
+/*
+ * PlanBenchmarkOperation plans a copy of the given query, since the planner
+ * modifies the query it plans.
+ */
+static void
+PlanBenchmarkOperation(void *context)
+{
+	Query *query = (Query *) context;
+	int cursorOptions = 0;
+
+	distributed_planner(copyObject(query), cursorOptions, NULL);
+}
+
+
+/*
+ * DeparseBenchmarkOperation deparses the query of each task in the given
+ * DeparseBenchmarkContext from the job query, the way the planner does.
+ */
+static void
+DeparseBenchmarkOperation(void *context)
+{
+	DeparseBenchmarkContext *deparseContext = (DeparseBenchmarkContext *) context;
+
+	Task *task = NULL;
+	foreach_ptr(task, deparseContext->taskList)
+	{
+		Query *taskQuery = copyObject(deparseContext->jobQuery);
+		StringInfo queryString = makeStringInfo();
+
+		if (taskQuery->commandType == CMD_INSERT)
+		{
+			RangeTblEntry *insertRte = ExtractResultRelationRTE(taskQuery);
+
+			deparse_shard_query(taskQuery, insertRte->relid, task->anchorShardId,
+								queryString);
+		}
+		else
+		{
+			UpdateRelationToShardNames((Node *) taskQuery, task->relationShardList);
+			pg_get_query_def(taskQuery, queryString);
+		}
+	}
+}
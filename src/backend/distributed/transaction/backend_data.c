@@ -29,6 +29,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/tuplestore.h"
+#include "distributed/worker_transaction.h"
 #include "nodes/execnodes.h"
 #include "postmaster/autovacuum.h" /* to access autovacuum_max_workers */
 #if PG_VERSION_NUM >= PG_VERSION_12
@@ -38,8 +39,6 @@
 #include "storage/lmgr.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
-#include "storage/spin.h"
-#include "storage/s_lock.h"
 #include "utils/timestamp.h"
 
 
@@ -52,10 +51,6 @@
  */
 typedef struct BackendManagementShmemData
 {
-	int trancheId;
-	NamedLWLockTranche namedLockTranche;
-	LWLock lock;
-
 	/*
 	 * We prefer to use an atomic integer over sequences for two
 	 * reasons (i) orders of magnitude performance difference
@@ -77,6 +72,9 @@ static BackendData *MyBackendData = NULL;
 
 static void BackendManagementShmemInit(void);
 static size_t BackendManagementShmemSize(void);
+static void BeginBackendDataChange(void);
+static void EndBackendDataChange(void);
+static void ReadBackendData(BackendData *backendData, BackendData *result);
 
 
 PG_FUNCTION_INFO_V1(assign_distributed_transaction_id);
@@ -99,7 +97,7 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 {
 	Oid userId = GetUserId();
 
-	/* prepare data before acquiring spinlock to protect against errors */
+	/* prepare data before changing the backend data to protect against errors */
 	int32 initiatorNodeIdentifier = PG_GETARG_INT32(0);
 	uint64 transactionNumber = PG_GETARG_INT64(1);
 	TimestampTz timestamp = PG_GETARG_TIMESTAMPTZ(2);
@@ -112,23 +110,15 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 		ereport(ERROR, (errmsg("backend is not ready for distributed transactions")));
 	}
 
-	/*
-	 * Note that we don't need to lock shared memory (i.e., LockBackendSharedMemory()) here
-	 * since this function is executed after AssignDistributedTransactionId() issued on the
-	 * initiator node, which already takes the required lock to enforce the consistency.
-	 */
-
-	SpinLockAcquire(&MyBackendData->mutex);
-
-	/* if an id is already assigned, release the lock and error */
+	/* only this backend changes its data, so it can read it without retrying */
 	if (MyBackendData->transactionId.transactionNumber != 0)
 	{
-		SpinLockRelease(&MyBackendData->mutex);
-
 		ereport(ERROR, (errmsg("the backend has already been assigned a "
 							   "transaction id")));
 	}
 
+	BeginBackendDataChange();
+
 	MyBackendData->databaseId = MyDatabaseId;
 	MyBackendData->userId = userId;
 
@@ -141,7 +131,7 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 		MyBackendData->transactionId.initiatorNodeIdentifier;
 	MyBackendData->citusBackend.transactionOriginator = false;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataChange();
 
 	PG_RETURN_VOID();
 }
@@ -218,7 +208,6 @@ get_global_active_transactions(PG_FUNCTION_ARGS)
 {
 	TupleDesc tupleDescriptor = NULL;
 	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
-	List *connectionList = NIL;
 	StringInfo queryToSend = makeStringInfo();
 
 	CheckCitusVersion(ERROR);
@@ -229,60 +218,18 @@ get_global_active_transactions(PG_FUNCTION_ARGS)
 	/* add active transactions for local node */
 	StoreAllActiveTransactions(tupleStore, tupleDescriptor);
 
-	int32 localGroupId = GetLocalGroupId();
-
-	/* open connections in parallel */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = 0;
-
-		if (workerNode->groupId == localGroupId)
-		{
-			/* we already get these transactions via GetAllActiveTransactions() */
-			continue;
-		}
-
-		MultiConnection *connection = StartNodeConnection(connectionFlags, nodeName,
-														  nodePort);
-
-		connectionList = lappend(connectionList, connection);
-	}
-
-	FinishConnectionListEstablishment(connectionList);
+	/* we already get the local transactions via GetAllActiveTransactions() */
+	List *remoteResultList = ExecuteQueryOnRemoteNodes(workerNodeList, NULL,
+													   queryToSend->data,
+													   RemoteMonitoringTimeout);
 
-	/* send commands in parallel */
-	MultiConnection *connection = NULL;
-	foreach_ptr(connection, connectionList)
+	RemoteQueryResult *remoteResult = NULL;
+	foreach_ptr(remoteResult, remoteResultList)
 	{
-		int querySent = SendRemoteCommand(connection, queryToSend->data);
-		if (querySent == 0)
-		{
-			ReportConnectionError(connection, WARNING);
-		}
-	}
-
-	/* receive query results */
-	foreach_ptr(connection, connectionList)
-	{
-		bool raiseInterrupts = true;
+		PGresult *result = remoteResult->result;
 		Datum values[ACTIVE_TRANSACTION_COLUMN_COUNT];
 		bool isNulls[ACTIVE_TRANSACTION_COLUMN_COUNT];
 
-		if (PQstatus(connection->pgConn) != CONNECTION_OK)
-		{
-			continue;
-		}
-
-		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-		if (!IsResponseOK(result))
-		{
-			ReportResultError(connection, result, WARNING);
-			continue;
-		}
-
 		int64 rowCount = PQntuples(result);
 		int64 colCount = PQnfields(result);
 
@@ -291,6 +238,7 @@ get_global_active_transactions(PG_FUNCTION_ARGS)
 		{
 			ereport(WARNING, (errmsg("unexpected number of columns from "
 									 "get_all_active_transactions")));
+			PQclear(result);
 			continue;
 		}
 
@@ -310,7 +258,6 @@ get_global_active_transactions(PG_FUNCTION_ARGS)
 		}
 
 		PQclear(result);
-		ForgetResults(connection);
 	}
 
 	/* clean up and return the tuplestore */
@@ -353,37 +300,25 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 	bool showAllTransactions = superuser();
 	const Oid userId = GetUserId();
 
-	/*
-	 * We don't want to initialize memory while spinlock is held so we
-	 * prefer to do it here. This initialization is done only for the first
-	 * row.
-	 */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
-
 	if (is_member_of_role(userId, DEFAULT_ROLE_MONITOR))
 	{
 		showAllTransactions = true;
 	}
 
-	/* we're reading all distributed transactions, prevent new backends */
-	LockBackendSharedMemory(LW_SHARED);
-
+	/*
+	 * Backends are read one at a time without locking, such that monitoring
+	 * never delays backends that start or end a distributed transaction.
+	 */
 	for (int backendIndex = 0; backendIndex < MaxBackends; ++backendIndex)
 	{
-		BackendData *currentBackend =
-			&backendManagementShmemData->backends[backendIndex];
+		BackendData currentBackend;
 
-		/* to work on data after releasing g spinlock to protect against errors */
-		int initiatorNodeIdentifier = -1;
-		uint64 transactionNumber = 0;
-
-		SpinLockAcquire(&currentBackend->mutex);
+		ReadBackendData(&backendManagementShmemData->backends[backendIndex],
+						&currentBackend);
 
 		/* we're only interested in backends initiated by Citus */
-		if (currentBackend->citusBackend.initiatorNodeIdentifier < 0)
+		if (currentBackend.citusBackend.initiatorNodeIdentifier < 0)
 		{
-			SpinLockRelease(&currentBackend->mutex);
 			continue;
 		}
 
@@ -391,15 +326,12 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		 * Unless the user has a role that allows seeing all transactions (superuser,
 		 * pg_monitor), skip over transactions belonging to other users.
 		 */
-		if (!showAllTransactions && currentBackend->userId != userId)
+		if (!showAllTransactions && currentBackend.userId != userId)
 		{
-			SpinLockRelease(&currentBackend->mutex);
 			continue;
 		}
 
-		Oid databaseId = currentBackend->databaseId;
 		int backendPid = ProcGlobal->allProcs[backendIndex].pid;
-		initiatorNodeIdentifier = currentBackend->citusBackend.initiatorNodeIdentifier;
 
 		/*
 		 * We prefer to use worker_query instead of transactionOriginator in the user facing
@@ -410,32 +342,20 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		 * inside a distributed transaction.
 		 */
 		bool coordinatorOriginatedQuery =
-			currentBackend->citusBackend.transactionOriginator;
-
-		transactionNumber = currentBackend->transactionId.transactionNumber;
-		TimestampTz transactionIdTimestamp = currentBackend->transactionId.timestamp;
+			currentBackend.citusBackend.transactionOriginator;
 
-		SpinLockRelease(&currentBackend->mutex);
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
 
-		values[0] = ObjectIdGetDatum(databaseId);
+		values[0] = ObjectIdGetDatum(currentBackend.databaseId);
 		values[1] = Int32GetDatum(backendPid);
-		values[2] = Int32GetDatum(initiatorNodeIdentifier);
+		values[2] = Int32GetDatum(currentBackend.citusBackend.initiatorNodeIdentifier);
 		values[3] = !coordinatorOriginatedQuery;
-		values[4] = UInt64GetDatum(transactionNumber);
-		values[5] = TimestampTzGetDatum(transactionIdTimestamp);
+		values[4] = UInt64GetDatum(currentBackend.transactionId.transactionNumber);
+		values[5] = TimestampTzGetDatum(currentBackend.transactionId.timestamp);
 
 		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
-
-		/*
-		 * We don't want to initialize memory while spinlock is held so we
-		 * prefer to do it here. This initialization is done for the rows
-		 * starting from the second one.
-		 */
-		memset(values, 0, sizeof(values));
-		memset(isNulls, false, sizeof(isNulls));
 	}
-
-	UnlockBackendSharedMemory();
 }
 
 
@@ -478,26 +398,15 @@ BackendManagementShmemInit(void)
 
 	if (!alreadyInitialized)
 	{
-		char *trancheName = "Backend Management Tranche";
-
-		NamedLWLockTranche *namedLockTranche =
-			&backendManagementShmemData->namedLockTranche;
-
 		/* start by zeroing out all the memory */
 		memset(backendManagementShmemData, 0,
 			   BackendManagementShmemSize());
 
-		namedLockTranche->trancheId = LWLockNewTrancheId();
-
-		LWLockRegisterTranche(namedLockTranche->trancheId, trancheName);
-		LWLockInitialize(&backendManagementShmemData->lock,
-						 namedLockTranche->trancheId);
-
 		/* start the distributed transaction ids from 1 */
 		pg_atomic_init_u64(&backendManagementShmemData->nextTransactionNumber, 1);
 
 		/*
-		 * We need to init per backend's spinlock before any backend
+		 * We need to init per backend's data before any backend
 		 * starts its execution. Note that we initialize TotalProcs (e.g., not
 		 * MaxBackends) since some of the blocking processes could be prepared
 		 * transactions, which aren't covered by MaxBackends.
@@ -511,7 +420,7 @@ BackendManagementShmemInit(void)
 			BackendData *backendData =
 				&backendManagementShmemData->backends[backendIndex];
 			backendData->citusBackend.initiatorNodeIdentifier = -1;
-			SpinLockInit(&backendData->mutex);
+			pg_atomic_init_u64(&backendData->cancelledTransactionNumber, 0);
 		}
 	}
 
@@ -622,18 +531,14 @@ InitializeBackendData(void)
 
 	Assert(MyBackendData);
 
-	LockBackendSharedMemory(LW_EXCLUSIVE);
-
 	/* zero out the backend data */
 	UnSetDistributedTransactionId();
-
-	UnlockBackendSharedMemory();
 }
 
 
 /*
- * UnSetDistributedTransactionId simply acquires the mutex and resets the backend's
- * distributed transaction data in shared memory to the initial values.
+ * UnSetDistributedTransactionId simply resets the backend's distributed
+ * transaction data in shared memory to the initial values.
  */
 void
 UnSetDistributedTransactionId(void)
@@ -641,7 +546,7 @@ UnSetDistributedTransactionId(void)
 	/* backend does not exist if the extension is not created */
 	if (MyBackendData)
 	{
-		SpinLockAcquire(&MyBackendData->mutex);
+		BeginBackendDataChange();
 
 		MyBackendData->databaseId = 0;
 		MyBackendData->userId = 0;
@@ -653,37 +558,88 @@ UnSetDistributedTransactionId(void)
 		MyBackendData->citusBackend.initiatorNodeIdentifier = -1;
 		MyBackendData->citusBackend.transactionOriginator = false;
 
-		SpinLockRelease(&MyBackendData->mutex);
+		EndBackendDataChange();
+
+		pg_atomic_write_u64(&MyBackendData->cancelledTransactionNumber, 0);
 	}
 }
 
 
 /*
- * LockBackendSharedMemory is a simple wrapper around LWLockAcquire on the
- * shared memory lock.
+ * BeginBackendDataChange marks the data of the current backend as being
+ * changed, such that concurrent readers retry until the change is done.
  *
- * We use the backend shared memory lock for preventing new backends to be part
- * of a new distributed transaction or an existing backend to leave a distributed
- * transaction while we're reading the all backends' data.
- *
- * The primary goal is to provide consistent view of the current distributed
- * transactions while doing the deadlock detection.
+ * The change happens in a critical section, since an error in the middle of
+ * it would leave the data marked as being changed forever. Callers should
+ * therefore only assign prepared values between BeginBackendDataChange and
+ * EndBackendDataChange.
  */
-void
-LockBackendSharedMemory(LWLockMode lockMode)
+static void
+BeginBackendDataChange(void)
 {
-	LWLockAcquire(&backendManagementShmemData->lock, lockMode);
+	volatile BackendData *backendData = MyBackendData;
+
+	START_CRIT_SECTION();
+
+	backendData->changeCount++;
+	pg_write_barrier();
 }
 
 
 /*
- * UnlockBackendSharedMemory is a simple wrapper around LWLockRelease on the
- * shared memory lock.
+ * EndBackendDataChange marks the change of the data of the current backend
+ * as done.
  */
-void
-UnlockBackendSharedMemory(void)
+static void
+EndBackendDataChange(void)
 {
-	LWLockRelease(&backendManagementShmemData->lock);
+	volatile BackendData *backendData = MyBackendData;
+
+	pg_write_barrier();
+	backendData->changeCount++;
+
+	Assert((backendData->changeCount & 1) == 0);
+
+	END_CRIT_SECTION();
+}
+
+
+/*
+ * ReadBackendData copies the data of a backend into result without locking.
+ * If the owning backend changes its data while it is copied, the copy is
+ * retried, which is rare since backends only change their data when a
+ * distributed transaction starts or ends.
+ */
+static void
+ReadBackendData(BackendData *backendData, BackendData *result)
+{
+	volatile BackendData *sharedData = backendData;
+
+	while (true)
+	{
+		uint32 changeCountBefore = sharedData->changeCount;
+		pg_read_barrier();
+
+		result->databaseId = sharedData->databaseId;
+		result->userId = sharedData->userId;
+		result->citusBackend = sharedData->citusBackend;
+		result->transactionId = sharedData->transactionId;
+
+		pg_read_barrier();
+		uint32 changeCountAfter = sharedData->changeCount;
+
+		if (changeCountBefore == changeCountAfter && (changeCountBefore & 1) == 0)
+		{
+			result->changeCount = changeCountBefore;
+			break;
+		}
+
+		/* the owning backend is changing its data, try again */
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	pg_atomic_init_u64(&result->cancelledTransactionNumber,
+					   pg_atomic_read_u64(&backendData->cancelledTransactionNumber));
 }
 
 
@@ -735,7 +691,7 @@ AssignDistributedTransactionId(void)
 	TimestampTz currentTimestamp = GetCurrentTimestamp();
 	Oid userId = GetUserId();
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataChange();
 
 	MyBackendData->databaseId = MyDatabaseId;
 	MyBackendData->userId = userId;
@@ -748,7 +704,7 @@ AssignDistributedTransactionId(void)
 	MyBackendData->citusBackend.initiatorNodeIdentifier = localGroupId;
 	MyBackendData->citusBackend.transactionOriginator = true;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataChange();
 }
 
 
@@ -760,17 +716,17 @@ void
 MarkCitusInitiatedCoordinatorBackend(void)
 {
 	/*
-	 * GetLocalGroupId may throw exception which can cause leaving spin lock
-	 * unreleased. Calling GetLocalGroupId function before the lock to avoid this.
+	 * GetLocalGroupId may throw exception, which is not allowed while the
+	 * backend data is being changed. Calling it before the change to avoid this.
 	 */
 	int32 localGroupId = GetLocalGroupId();
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataChange();
 
 	MyBackendData->citusBackend.initiatorNodeIdentifier = localGroupId;
 	MyBackendData->citusBackend.transactionOriginator = true;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataChange();
 }
 
 
@@ -790,8 +746,8 @@ CurrentDistributedTransactionNumber(void)
 
 /*
  * GetBackendDataForProc writes the backend data for the given process to
- * result. If the process is part of a lock group (parallel query) it
- * returns the leader data instead.
+ * result without locking. If the process is part of a lock group (parallel
+ * query) it returns the leader data instead.
  */
 void
 GetBackendDataForProc(PGPROC *proc, BackendData *result)
@@ -803,13 +759,7 @@ GetBackendDataForProc(PGPROC *proc, BackendData *result)
 		pgprocno = proc->lockGroupLeader->pgprocno;
 	}
 
-	BackendData *backendData = &backendManagementShmemData->backends[pgprocno];
-
-	SpinLockAcquire(&backendData->mutex);
-
-	*result = *backendData;
-
-	SpinLockRelease(&backendData->mutex);
+	ReadBackendData(&backendManagementShmemData->backends[pgprocno], result);
 }
 
 
@@ -821,6 +771,7 @@ void
 CancelTransactionDueToDeadlock(PGPROC *proc)
 {
 	BackendData *backendData = &backendManagementShmemData->backends[proc->pgprocno];
+	BackendData currentBackendData;
 
 	/* backend might not have used citus yet and thus not initialized backend data */
 	if (!backendData)
@@ -828,13 +779,19 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 		return;
 	}
 
-	SpinLockAcquire(&backendData->mutex);
+	ReadBackendData(backendData, &currentBackendData);
 
 	/* send a SIGINT only if the process is still in a distributed transaction */
-	if (backendData->transactionId.transactionNumber != 0)
+	uint64 transactionNumber = currentBackendData.transactionId.transactionNumber;
+	if (transactionNumber != 0)
 	{
-		backendData->cancelledDueToDeadlock = true;
-		SpinLockRelease(&backendData->mutex);
+		/*
+		 * The backend may end the transaction in the meantime, which is why
+		 * the number of the cancelled transaction is recorded rather than a
+		 * flag that would also apply to the next transaction.
+		 */
+		pg_atomic_write_u64(&backendData->cancelledTransactionNumber,
+							transactionNumber);
 
 		if (kill(proc->pid, SIGINT) != 0)
 		{
@@ -844,10 +801,6 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 							"be cancelled", proc->pid)));
 		}
 	}
-	else
-	{
-		SpinLockRelease(&backendData->mutex);
-	}
 }
 
 
@@ -859,24 +812,22 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 bool
 MyBackendGotCancelledDueToDeadlock(void)
 {
-	bool cancelledDueToDeadlock = false;
-
 	/* backend might not have used citus yet and thus not initialized backend data */
 	if (!MyBackendData)
 	{
 		return false;
 	}
 
-	SpinLockAcquire(&MyBackendData->mutex);
-
-	if (IsInDistributedTransaction(MyBackendData))
+	/* only this backend changes its data, so it can read it without retrying */
+	if (!IsInDistributedTransaction(MyBackendData))
 	{
-		cancelledDueToDeadlock = MyBackendData->cancelledDueToDeadlock;
+		return false;
 	}
 
-	SpinLockRelease(&MyBackendData->mutex);
+	uint64 cancelledTransactionNumber =
+		pg_atomic_read_u64(&MyBackendData->cancelledTransactionNumber);
 
-	return cancelledDueToDeadlock;
+	return cancelledTransactionNumber == MyBackendData->transactionId.transactionNumber;
 }
 
 
@@ -29,6 +29,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/tuplestore.h"
+#include "distributed/worker_transaction.h"
 #include "executor/spi.h"
 #include "nodes/execnodes.h"
 #include "storage/ipc.h"
@@ -312,7 +313,6 @@ static List *
 CitusStatActivity(const char *statQuery)
 {
 	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
-	List *connectionList = NIL;
 
 	/*
 	 * For the local node, we can avoid opening connections. This might be
@@ -329,53 +329,15 @@ CitusStatActivity(const char *statQuery)
 	 */
 	char *nodeUser = CurrentUserName();
 
-	int32 localGroupId = GetLocalGroupId();
+	List *remoteResultList = ExecuteQueryOnRemoteNodes(workerNodeList, nodeUser,
+													   statQuery,
+													   RemoteMonitoringTimeout);
 
-	/* open connections in parallel */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
+	RemoteQueryResult *remoteResult = NULL;
+	foreach_ptr(remoteResult, remoteResultList)
 	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = 0;
-
-		if (workerNode->groupId == localGroupId)
-		{
-			/* we already get these stats via GetLocalNodeCitusDistStat() */
-			continue;
-		}
-
-		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
-																	  nodeName, nodePort,
-																	  nodeUser, NULL);
-
-		connectionList = lappend(connectionList, connection);
-	}
-
-	FinishConnectionListEstablishment(connectionList);
-
-	/* send commands in parallel */
-	MultiConnection *connection = NULL;
-	foreach_ptr(connection, connectionList)
-	{
-		int querySent = SendRemoteCommand(connection, statQuery);
-		if (querySent == 0)
-		{
-			ReportConnectionError(connection, WARNING);
-		}
-	}
-
-	/* receive query results */
-	foreach_ptr(connection, connectionList)
-	{
-		bool raiseInterrupts = true;
-
-		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-		if (!IsResponseOK(result))
-		{
-			ReportResultError(connection, result, WARNING);
-			continue;
-		}
+		MultiConnection *connection = remoteResult->connection;
+		PGresult *result = remoteResult->result;
 
 		int64 rowCount = PQntuples(result);
 		int64 colCount = PQnfields(result);
@@ -388,6 +350,7 @@ CitusStatActivity(const char *statQuery)
 			 */
 			ereport(WARNING, (errmsg("unexpected number of columns from "
 									 "citus stat query")));
+			PQclear(result);
 			continue;
 		}
 
@@ -406,7 +369,6 @@ CitusStatActivity(const char *statQuery)
 		}
 
 		PQclear(result);
-		ForgetResults(connection);
 	}
 
 	return citusStatsList;
@@ -38,6 +38,16 @@ typedef struct QueuedTransactionNode
 } QueuedTransactionNode;
 
 
+/* used for the iterative search of strongly connected components */
+typedef struct ComponentSearchFrame
+{
+	TransactionNode *transactionNode;
+
+	/* next outgoing edge of the transaction node to follow */
+	ListCell *nextWaitsForCell;
+} ComponentSearchFrame;
+
+
 /* GUC, determining whether debug messages for deadlock detection sent to LOG */
 bool LogDistributedDeadlockDetection = false;
 
@@ -52,6 +62,12 @@ static void BuildDeadlockPathList(QueuedTransactionNode *cycledTransactionNode,
 								  TransactionNode **transactionNodeStack,
 								  List **deadlockPath);
 static void ResetVisitedFields(HTAB *adjacencyList);
+static void MarkTransactionNodesInCycles(HTAB *adjacencyList);
+static void SearchStronglyConnectedComponents(TransactionNode *rootTransactionNode,
+											  ComponentSearchFrame *searchStack,
+											  TransactionNode **componentStack,
+											  int *componentStackSize,
+											  int *nextComponentIndex);
 static bool AssociateDistributedTransactionWithBackendProc(TransactionNode *
 														   transactionNode);
 static TransactionNode * GetOrCreateTransactionNode(HTAB *adjacencyList,
@@ -88,14 +104,16 @@ check_distributed_deadlocks(PG_FUNCTION_ARGS)
  * adding the wait edges from the local node and then adding the
  * remote wait edges to form a global wait graph. Later, the wait
  * graph is converted into another graph representation (adjacency
- * lists) for more efficient searches. Finally, a DFS is done on
- * the adjacency lists. Finding a cycle in the graph unveils a
- * distributed deadlock. Upon finding a deadlock, the youngest
- * participant backend is cancelled.
+ * lists) for more efficient searches. The strongly connected
+ * components of the graph are computed once to find the transactions
+ * that are part of a cycle. Finally, a DFS is done on the adjacency
+ * lists, starting from those transactions. Finding a cycle in the
+ * graph unveils a distributed deadlock. Upon finding a deadlock, the
+ * youngest participant backend is cancelled.
  *
- * The complexity of the algorithm is O(N) for each distributed
- * transaction that's checked for deadlocks. Note that there exists
- *  0 to MaxBackends number of transactions.
+ * Finding the cyclic transactions is O(N + E) for the whole graph, so
+ * the common case of a graph without deadlocks does not need a DFS
+ * per transaction. Each DFS is O(N + E) as well.
  *
  * The function returns true if a deadlock is found. Otherwise, returns
  * false.
@@ -124,6 +142,8 @@ CheckForDistributedDeadlocks(void)
 
 	int edgeCount = waitGraph->edgeCount;
 
+	MarkTransactionNodesInCycles(adjacencyLists);
+
 	/*
 	 * We iterate on transaction nodes and search for deadlocks where the
 	 * starting node is the given transaction node.
@@ -145,6 +165,12 @@ CheckForDistributedDeadlocks(void)
 			continue;
 		}
 
+		/* there is no deadlock path starting from a transaction outside of a cycle */
+		if (!transactionNode->transactionInCycle)
+		{
+			continue;
+		}
+
 		ResetVisitedFields(adjacencyLists);
 
 		bool deadlockFound = CheckDeadlockForTransactionNode(transactionNode,
@@ -354,6 +380,169 @@ ResetVisitedFields(HTAB *adjacencyList)
 }
 
 
+/*
+ * MarkTransactionNodesInCycles sets transactionInCycle for all transaction
+ * nodes that are part of a cycle in the wait graph, using Tarjan's algorithm
+ * for strongly connected components. A transaction is part of a cycle if its
+ * component has multiple transactions, or if it waits for itself.
+ */
+static void
+MarkTransactionNodesInCycles(HTAB *adjacencyList)
+{
+	HASH_SEQ_STATUS status;
+	TransactionNode *transactionNode = NULL;
+	long transactionCount = hash_get_num_entries(adjacencyList);
+	int componentStackSize = 0;
+	int nextComponentIndex = 1;
+
+	if (transactionCount == 0)
+	{
+		return;
+	}
+
+	ComponentSearchFrame *searchStack =
+		palloc0(transactionCount * sizeof(ComponentSearchFrame));
+	TransactionNode **componentStack =
+		palloc0(transactionCount * sizeof(TransactionNode *));
+
+	hash_seq_init(&status, adjacencyList);
+	while ((transactionNode = (TransactionNode *) hash_seq_search(&status)) != 0)
+	{
+		transactionNode->componentIndex = 0;
+		transactionNode->componentLowLink = 0;
+		transactionNode->onComponentStack = false;
+		transactionNode->transactionInCycle = false;
+	}
+
+	hash_seq_init(&status, adjacencyList);
+	while ((transactionNode = (TransactionNode *) hash_seq_search(&status)) != 0)
+	{
+		/* a component index of 0 means the node has not been visited yet */
+		if (transactionNode->componentIndex == 0)
+		{
+			SearchStronglyConnectedComponents(transactionNode, searchStack,
+											  componentStack, &componentStackSize,
+											  &nextComponentIndex);
+		}
+	}
+
+	pfree(searchStack);
+	pfree(componentStack);
+}
+
+
+/*
+ * SearchStronglyConnectedComponents visits all transaction nodes reachable
+ * from the given root that were not visited yet, and marks the ones that are
+ * part of a cycle. It implements the recursion of Tarjan's algorithm with an
+ * explicit stack, since wait graphs can be deep.
+ */
+static void
+SearchStronglyConnectedComponents(TransactionNode *rootTransactionNode,
+								  ComponentSearchFrame *searchStack,
+								  TransactionNode **componentStack,
+								  int *componentStackSize,
+								  int *nextComponentIndex)
+{
+	int searchStackSize = 0;
+
+	rootTransactionNode->componentIndex = *nextComponentIndex;
+	rootTransactionNode->componentLowLink = *nextComponentIndex;
+	(*nextComponentIndex)++;
+	rootTransactionNode->onComponentStack = true;
+	componentStack[(*componentStackSize)++] = rootTransactionNode;
+
+	searchStack[searchStackSize].transactionNode = rootTransactionNode;
+	searchStack[searchStackSize].nextWaitsForCell =
+		list_head(rootTransactionNode->waitsFor);
+	searchStackSize++;
+
+	while (searchStackSize > 0)
+	{
+		ComponentSearchFrame *frame = &searchStack[searchStackSize - 1];
+		TransactionNode *transactionNode = frame->transactionNode;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (frame->nextWaitsForCell != NULL)
+		{
+			TransactionNode *waitsForNode =
+				(TransactionNode *) lfirst(frame->nextWaitsForCell);
+
+			frame->nextWaitsForCell = lnext(frame->nextWaitsForCell);
+
+			if (waitsForNode == transactionNode)
+			{
+				/* a transaction waiting for itself is a cycle on its own */
+				transactionNode->transactionInCycle = true;
+			}
+			else if (waitsForNode->componentIndex == 0)
+			{
+				/* descend into the node, each node is pushed at most once */
+				waitsForNode->componentIndex = *nextComponentIndex;
+				waitsForNode->componentLowLink = *nextComponentIndex;
+				(*nextComponentIndex)++;
+				waitsForNode->onComponentStack = true;
+				componentStack[(*componentStackSize)++] = waitsForNode;
+
+				searchStack[searchStackSize].transactionNode = waitsForNode;
+				searchStack[searchStackSize].nextWaitsForCell =
+					list_head(waitsForNode->waitsFor);
+				searchStackSize++;
+			}
+			else if (waitsForNode->onComponentStack)
+			{
+				transactionNode->componentLowLink =
+					Min(transactionNode->componentLowLink,
+						waitsForNode->componentIndex);
+			}
+
+			continue;
+		}
+
+		/* all outgoing edges are followed, pop the node */
+		searchStackSize--;
+
+		if (searchStackSize > 0)
+		{
+			TransactionNode *parentNode = searchStack[searchStackSize - 1].transactionNode;
+
+			parentNode->componentLowLink = Min(parentNode->componentLowLink,
+											   transactionNode->componentLowLink);
+		}
+
+		if (transactionNode->componentLowLink != transactionNode->componentIndex)
+		{
+			/* the node belongs to the component of a node below it on the stack */
+			continue;
+		}
+
+		/* the node is the root of a component, pop the component */
+		int componentStart = *componentStackSize - 1;
+		while (componentStack[componentStart] != transactionNode)
+		{
+			componentStart--;
+		}
+
+		bool componentHasCycle = (*componentStackSize - componentStart) > 1;
+
+		for (int stackIndex = componentStart; stackIndex < *componentStackSize;
+			 stackIndex++)
+		{
+			TransactionNode *componentNode = componentStack[stackIndex];
+
+			componentNode->onComponentStack = false;
+			if (componentHasCycle)
+			{
+				componentNode->transactionInCycle = true;
+			}
+		}
+
+		*componentStackSize = componentStart;
+	}
+}
+
+
 /*
  * AssociateDistributedTransactionWithBackendProc gets a transaction node
  * and searches the corresponding backend. Once found, transactionNodes'
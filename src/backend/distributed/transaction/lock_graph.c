@@ -26,6 +26,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
 #include "distributed/tuplestore.h"
+#include "distributed/worker_transaction.h"
 #include "storage/proc.h"
 #include "utils/builtins.h"
 #include "utils/hsearch.h"
@@ -45,12 +46,27 @@ typedef struct PROCStack
 } PROCStack;
 
 
+/* GUC, minimum age of a waiting transaction to collect its wait edges */
+int DistributedDeadlockDetectionMinAge = 0;
+
+/*
+ * Bitmask of the lock manager partitions locked while building the local
+ * wait graph, and whether a process waiting on a lock in another partition
+ * was encountered. See BuildLocalWaitGraph().
+ */
+static uint32 LockedPartitionMask = 0;
+static bool SawWaitInUnlockedPartition = false;
+
+
 static void AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex);
 static void ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
 static WaitGraph * BuildLocalWaitGraph(void);
+static uint32 WaitingLockPartitionMask(void);
+static void AddLocalWaitEdges(WaitGraph *waitGraph, PROCStack *remaining);
 static bool IsProcessWaitingForSafeOperations(PGPROC *proc);
-static void LockLockData(void);
-static void UnlockLockData(void);
+static bool IsWaitLockPartitionLocked(PGPROC *proc);
+static void LockLockData(uint32 partitionMask);
+static void UnlockLockData(uint32 partitionMask);
 static void AddEdgesForLockWaits(WaitGraph *waitGraph, PGPROC *waitingProc,
 								 PROCStack *remaining);
 static void AddEdgesForWaitQueue(WaitGraph *waitGraph, PGPROC *waitingProc,
@@ -92,58 +108,21 @@ BuildGlobalWaitGraph(void)
 {
 	List *workerNodeList = ActiveReadableNodeList();
 	char *nodeUser = CitusExtensionOwnerName();
-	List *connectionList = NIL;
-	int32 localGroupId = GetLocalGroupId();
+	const char *command = "SELECT * FROM dump_local_wait_edges()";
 
+	/* we already have local wait edges, so the local node is skipped */
 	WaitGraph *waitGraph = BuildLocalWaitGraph();
 
-	/* open connections in parallel */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = 0;
-
-		if (workerNode->groupId == localGroupId)
-		{
-			/* we already have local wait edges */
-			continue;
-		}
-
-		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
-																	  nodeName, nodePort,
-																	  nodeUser, NULL);
-
-		connectionList = lappend(connectionList, connection);
-	}
-
-	FinishConnectionListEstablishment(connectionList);
-
-	/* send commands in parallel */
-	MultiConnection *connection = NULL;
-	foreach_ptr(connection, connectionList)
-	{
-		const char *command = "SELECT * FROM dump_local_wait_edges()";
-
-		int querySent = SendRemoteCommand(connection, command);
-		if (querySent == 0)
-		{
-			ReportConnectionError(connection, WARNING);
-		}
-	}
+	/* deadlock detection needs the edges of all nodes, so wait for them */
+	long timeout = 0;
+	List *remoteResultList = ExecuteQueryOnRemoteNodes(workerNodeList, nodeUser,
+													   command, timeout);
 
 	/* receive dump_local_wait_edges results */
-	foreach_ptr(connection, connectionList)
+	RemoteQueryResult *remoteResult = NULL;
+	foreach_ptr(remoteResult, remoteResultList)
 	{
-		bool raiseInterrupts = true;
-
-		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-		if (!IsResponseOK(result))
-		{
-			ReportResultError(connection, result, WARNING);
-			continue;
-		}
+		PGresult *result = remoteResult->result;
 
 		int64 rowCount = PQntuples(result);
 		int64 colCount = PQnfields(result);
@@ -152,6 +131,7 @@ BuildGlobalWaitGraph(void)
 		{
 			ereport(WARNING, (errmsg("unexpected number of columns from "
 									 "dump_local_wait_edges")));
+			PQclear(result);
 			continue;
 		}
 
@@ -161,7 +141,6 @@ BuildGlobalWaitGraph(void)
 		}
 
 		PQclear(result);
-		ForgetResults(connection);
 	}
 
 	return waitGraph;
@@ -331,12 +310,20 @@ ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
 /*
  * BuildLocalWaitGraph builds a wait graph for distributed transactions
  * that originate from the local node.
+ *
+ * Locking all lock manager partitions stalls every lock acquisition on the
+ * node, so we first find the partitions that have waiting processes without
+ * taking any locks, and only lock those. On a node without waiting distributed
+ * transactions, no partition needs to be locked at all. If a process that waits
+ * on a lock in another partition shows up while building the graph, e.g. since
+ * it started waiting in the meantime, we rebuild it with all partitions locked.
  */
 static WaitGraph *
 BuildLocalWaitGraph(void)
 {
 	PROCStack remaining;
 	int totalProcs = TotalProcCount();
+	uint32 allPartitionsMask = (uint32) ((1ULL << NUM_LOCK_PARTITIONS) - 1);
 
 	/*
 	 * Try hard to avoid allocations while holding lock. Thus we pre-allocate
@@ -354,7 +341,94 @@ BuildLocalWaitGraph(void)
 	remaining.procAdded = (bool *) palloc0(sizeof(bool *) * totalProcs);
 	remaining.procCount = 0;
 
-	LockLockData();
+	uint32 partitionMask = WaitingLockPartitionMask();
+	if (partitionMask == 0)
+	{
+		/* no distributed transaction is waiting for a lock */
+		return waitGraph;
+	}
+
+	LockLockData(partitionMask);
+	AddLocalWaitEdges(waitGraph, &remaining);
+	UnlockLockData(partitionMask);
+
+	if (SawWaitInUnlockedPartition && partitionMask != allPartitionsMask)
+	{
+		waitGraph->edgeCount = 0;
+		remaining.procCount = 0;
+		memset(remaining.procAdded, 0, sizeof(bool *) * totalProcs);
+
+		LockLockData(allPartitionsMask);
+		AddLocalWaitEdges(waitGraph, &remaining);
+		UnlockLockData(allPartitionsMask);
+	}
+
+	return waitGraph;
+}
+
+
+/*
+ * WaitingLockPartitionMask returns a bitmask of the lock manager partitions
+ * that contain a lock some process is waiting for, or 0 if no distributed
+ * transaction is waiting for a lock.
+ *
+ * The process array is read without locks, so the result is only a hint.
+ * Any process that waits in another partition once the partitions are locked
+ * is caught by IsWaitLockPartitionLocked().
+ */
+static uint32
+WaitingLockPartitionMask(void)
+{
+	uint32 partitionMask = 0;
+	bool distributedTransactionWaiting = false;
+	int totalProcs = TotalProcCount();
+
+	for (int curBackend = 0; curBackend < totalProcs; curBackend++)
+	{
+		PGPROC *currentProc = &ProcGlobal->allProcs[curBackend];
+
+		if (currentProc->pid == 0 || !IsProcessWaitingForLock(currentProc))
+		{
+			continue;
+		}
+
+		LOCK *waitLock = currentProc->waitLock;
+		if (waitLock == NULL)
+		{
+			continue;
+		}
+
+		/*
+		 * Blocking processes can be outside of distributed transactions, so
+		 * we need the partitions of all waiting processes.
+		 */
+		uint32 lockHashCode = LockTagHashCode(&waitLock->tag);
+		partitionMask |= 1U << LockHashPartition(lockHashCode);
+
+		if (!distributedTransactionWaiting)
+		{
+			BackendData currentBackendData;
+
+			GetBackendDataForProc(currentProc, &currentBackendData);
+			distributedTransactionWaiting =
+				IsInDistributedTransaction(&currentBackendData);
+		}
+	}
+
+	return distributedTransactionWaiting ? partitionMask : 0;
+}
+
+
+/*
+ * AddLocalWaitEdges adds the edges of the local wait graph for the processes
+ * in distributed transactions. The caller should hold the lock manager
+ * partitions in LockedPartitionMask.
+ */
+static void
+AddLocalWaitEdges(WaitGraph *waitGraph, PROCStack *remaining)
+{
+	int totalProcs = TotalProcCount();
+	TimestampTz currentTimestamp = GetCurrentTimestamp();
 
 	/*
 	 * Build lock-graph.  We do so by first finding all procs which we are
@@ -399,12 +473,27 @@ BuildLocalWaitGraph(void)
 			continue;
 		}
 
-		AddProcToVisit(&remaining, currentProc);
+		/*
+		 * Skip transactions that are too young to have been waiting for long.
+		 * A transaction cannot wait for longer than it exists, so this never
+		 * skips a transaction that waited longer than the minimum age. A cycle
+		 * among young transactions is found by a later detection round, and
+		 * they are still visited when an older transaction waits for them.
+		 */
+		if (DistributedDeadlockDetectionMinAge > 0 &&
+			!TimestampDifferenceExceeds(currentBackendData.transactionId.timestamp,
+										currentTimestamp,
+										DistributedDeadlockDetectionMinAge))
+		{
+			continue;
+		}
+
+		AddProcToVisit(remaining, currentProc);
 	}
 
-	while (remaining.procCount > 0)
+	while (remaining->procCount > 0)
 	{
-		PGPROC *waitingProc = remaining.procs[--remaining.procCount];
+		PGPROC *waitingProc = remaining->procs[--remaining->procCount];
 
 		/* only blocked processes result in wait edges */
 		if (!IsProcessWaitingForLock(waitingProc))
@@ -422,18 +511,14 @@ BuildLocalWaitGraph(void)
 		 * Record an edge for everyone already holding the lock in a
 		 * conflicting manner ("hard edges" in postgres parlance).
 		 */
-		AddEdgesForLockWaits(waitGraph, waitingProc, &remaining);
+		AddEdgesForLockWaits(waitGraph, waitingProc, remaining);
 
 		/*
 		 * Record an edge for everyone in front of us in the wait-queue
 		 * for the lock ("soft edges" in postgres parlance).
 		 */
-		AddEdgesForWaitQueue(waitGraph, waitingProc, &remaining);
+		AddEdgesForWaitQueue(waitGraph, waitingProc, remaining);
 	}
-
-	UnlockLockData();
-
-	return waitGraph;
 }
 
 
@@ -452,6 +537,10 @@ BuildLocalWaitGraph(void)
  * done, even before the execution of the command that triggered the extension
  * finishes. Thus, recording such waits on our lock graphs could yield detecting
  * wrong distributed deadlocks.
+ *
+ * A process waiting on a lock in a partition that we did not lock is also
+ * skipped, since its lock cannot be inspected safely. The caller then
+ * rebuilds the wait graph with all partitions locked.
  */
 static bool
 IsProcessWaitingForSafeOperations(PGPROC *proc)
@@ -461,6 +550,12 @@ IsProcessWaitingForSafeOperations(PGPROC *proc)
 		return false;
 	}
 
+	if (!IsWaitLockPartitionLocked(proc))
+	{
+		SawWaitInUnlockedPartition = true;
+		return true;
+	}
+
 	/* get the transaction that the backend associated with */
 	PGXACT *pgxact = &ProcGlobal->allPgXact[proc->pgprocno];
 	if (pgxact->vacuumFlags & PROC_IS_AUTOVACUUM)
@@ -478,21 +573,45 @@ IsProcessWaitingForSafeOperations(PGPROC *proc)
 
 
 /*
- * LockLockData takes locks the shared lock data structure, which prevents
- * concurrent lock acquisitions/releases.
+ * IsWaitLockPartitionLocked returns whether the lock that the given waiting
+ * process waits for is in a lock manager partition that we hold.
+ */
+static bool
+IsWaitLockPartitionLocked(PGPROC *proc)
+{
+	LOCK *waitLock = proc->waitLock;
+	if (waitLock == NULL)
+	{
+		return false;
+	}
+
+	uint32 lockHashCode = LockTagHashCode(&waitLock->tag);
+
+	return (LockedPartitionMask & (1U << LockHashPartition(lockHashCode))) != 0;
+}
+
+
+/*
+ * LockLockData takes locks on the given partitions of the shared lock data
+ * structure, which prevents concurrent lock acquisitions/releases in them.
+ * The partitions are locked in ascending order, like Postgres' own deadlock
+ * detector does, to avoid deadlocks among the lock manager locks.
  *
- * The function also acquires lock on the backend shared memory to prevent
- * new backends to start.
+ * The backend data is read without locking, see GetBackendDataForProc.
  */
 static void
-LockLockData(void)
+LockLockData(uint32 partitionMask)
 {
-	LockBackendSharedMemory(LW_SHARED);
-
 	for (int partitionNum = 0; partitionNum < NUM_LOCK_PARTITIONS; partitionNum++)
 	{
-		LWLockAcquire(LockHashPartitionLockByIndex(partitionNum), LW_SHARED);
+		if (partitionMask & (1U << partitionNum))
+		{
+			LWLockAcquire(LockHashPartitionLockByIndex(partitionNum), LW_SHARED);
+		}
 	}
+
+	LockedPartitionMask = partitionMask;
+	SawWaitInUnlockedPartition = false;
 }
 
 
@@ -500,19 +619,19 @@ LockLockData(void)
  * UnlockLockData unlocks the locks on the shared lock data structure in reverse
  * order since LWLockRelease searches the given lock from the end of the
  * held_lwlocks array.
- *
- * The function also releases the shared memory lock to allow new backends to
- * start.
  */
 static void
-UnlockLockData(void)
+UnlockLockData(uint32 partitionMask)
 {
 	for (int partitionNum = NUM_LOCK_PARTITIONS - 1; partitionNum >= 0; partitionNum--)
 	{
-		LWLockRelease(LockHashPartitionLockByIndex(partitionNum));
+		if (partitionMask & (1U << partitionNum))
+		{
+			LWLockRelease(LockHashPartitionLockByIndex(partitionNum));
+		}
 	}
 
-	UnlockBackendSharedMemory();
+	LockedPartitionMask = 0;
 }
 
 
@@ -34,6 +34,7 @@
 bool EnforceForeignKeyRestrictions = true;
 
 #define PARALLEL_MODE_FLAG_OFFSET 3
+#define PARALLEL_RECORDED_FLAG_OFFSET 6
 
 /* simply set parallel bits as defined below for select, dml and ddl */
 #define PARALLEL_ACCESS_MASK (int) (0 | \
@@ -66,6 +67,12 @@ bool EnforceForeignKeyRestrictions = true;
  *  - 4th bit is set for PARALLEL DML accesses to a relation
  *  - 5th bit is set for PARALLEL DDL accesses to a relation
  *
+ * The last 3 bits are set once a parallel access of the corresponding type to
+ * the relation itself, rather than to one of its partitions, is recorded along
+ * with the accesses to all of its partitions. They are only valid as long as
+ * parallelRecordedEpoch matches ParallelAccessEpoch, which changes whenever a
+ * relation, and thereby possibly its partitions, changes. Repeated parallel
+ * accesses of the same type then only cost a single hash lookup.
  */
 typedef struct RelationAccessHashKey
 {
@@ -77,10 +84,17 @@ typedef struct RelationAccessHashEntry
 	RelationAccessHashKey key;
 
 	int relationAccessMode;
+	uint64 parallelRecordedEpoch;
 } RelationAccessHashEntry;
 
 static HTAB *RelationAccessHash;
 
+/* incremented on relcache invalidations to invalidate the recorded flags */
+static uint64 ParallelAccessEpoch = 0;
+
+/* whether an access to a reference table is recorded in the transaction */
+static bool ReferenceTableAccessRecorded = false;
+
 
 /* functions related to access recording */
 static void RecordRelationAccessBase(Oid relationId, ShardPlacementAccessType accessType);
@@ -93,8 +107,14 @@ static RelationAccessMode GetRelationAccessMode(Oid relationId,
 												ShardPlacementAccessType accessType);
 static void RecordParallelRelationAccess(Oid relationId, ShardPlacementAccessType
 										 placementAccess);
-static void RecordParallelRelationAccessToCache(Oid relationId,
-												ShardPlacementAccessType placementAccess);
+static bool ParallelRelationAccessRecorded(Oid relationId,
+										   ShardPlacementAccessType placementAccess);
+static void RecordParallelRelationAccessWithPartitions(Oid relationId,
+													   ShardPlacementAccessType
+													   placementAccess);
+static RelationAccessHashEntry * RecordParallelRelationAccessToCache(Oid relationId,
+																	 ShardPlacementAccessType
+																	 placementAccess);
 
 /* functions related to access conflict checks */
 static char * PlacementAccessTypeToText(ShardPlacementAccessType accessType);
@@ -124,6 +144,19 @@ void
 ResetRelationAccessHash()
 {
 	hash_delete_all(RelationAccessHash);
+	ReferenceTableAccessRecorded = false;
+}
+
+
+/*
+ * InvalidateParallelRelationAccessCache is called on relcache invalidations and
+ * makes sure that the next parallel access to a relation records the accesses
+ * to its partitions again, since the partitions may have changed.
+ */
+void
+InvalidateParallelRelationAccessCache(Oid relationId)
+{
+	ParallelAccessEpoch++;
 }
 
 
@@ -253,10 +286,14 @@ RecordPlacementAccessToCache(Oid relationId, ShardPlacementAccessType accessType
 	if (!found)
 	{
 		hashEntry->relationAccessMode = 0;
+		hashEntry->parallelRecordedEpoch = ParallelAccessEpoch;
 	}
 
 	/* set the bit representing the access type */
 	hashEntry->relationAccessMode |= (1 << (accessType));
+
+	/* we only get here for reference tables */
+	ReferenceTableAccessRecorded = true;
 }
 
 
@@ -484,6 +521,61 @@ RecordParallelRelationAccess(Oid relationId, ShardPlacementAccessType placementA
 		return;
 	}
 
+	/*
+	 * If the same access was already recorded, it passed the conflict checks
+	 * then, and any conflicting access since then would have errored out.
+	 */
+	if (ParallelRelationAccessRecorded(relationId, placementAccess))
+	{
+		return;
+	}
+
+	if (PartitionTable(relationId))
+	{
+		Oid parentOid = PartitionParentOid(relationId);
+
+		/* only record the parent */
+		RecordParallelRelationAccessToCache(parentOid, placementAccess);
+	}
+
+	RecordParallelRelationAccessWithPartitions(relationId, placementAccess);
+}
+
+
+/*
+ * ParallelRelationAccessRecorded returns whether a parallel access of the given
+ * type to the given relation and all of its partitions is already recorded.
+ */
+static bool
+ParallelRelationAccessRecorded(Oid relationId, ShardPlacementAccessType placementAccess)
+{
+	RelationAccessHashKey hashKey;
+	bool found = false;
+
+	hashKey.relationId = relationId;
+
+	RelationAccessHashEntry *hashEntry = hash_search(RelationAccessHash, &hashKey,
+													 HASH_FIND, &found);
+	if (!found || hashEntry->parallelRecordedEpoch != ParallelAccessEpoch)
+	{
+		return false;
+	}
+
+	int parallelRecordedBit = placementAccess + PARALLEL_RECORDED_FLAG_OFFSET;
+	return (hashEntry->relationAccessMode & (1 << parallelRecordedBit)) != 0;
+}
+
+
+/*
+ * RecordParallelRelationAccessWithPartitions checks for conflicting accesses and
+ * records the parallel access to the given relation and, if it is partitioned,
+ * to all of its partitions. The parent of a partition is recorded by the caller,
+ * such that we look it up only once for all partitions.
+ */
+static void
+RecordParallelRelationAccessWithPartitions(Oid relationId,
+										   ShardPlacementAccessType placementAccess)
+{
 	/* act accordingly if it's a conflicting access */
 	CheckConflictingParallelRelationAccesses(relationId, placementAccess);
 
@@ -496,26 +588,37 @@ RecordParallelRelationAccess(Oid relationId, ShardPlacementAccessType placementA
 		foreach_oid(partitionOid, partitionList)
 		{
 			/* recursively record all relation accesses of its partitions */
-			RecordParallelRelationAccess(partitionOid, placementAccess);
+			RecordParallelRelationAccessWithPartitions(partitionOid, placementAccess);
 		}
 	}
-	else if (PartitionTable(relationId))
-	{
-		Oid parentOid = PartitionParentOid(relationId);
 
-		/* only record the parent */
-		RecordParallelRelationAccessToCache(parentOid, placementAccess);
+	RelationAccessHashEntry *hashEntry =
+		RecordParallelRelationAccessToCache(relationId, placementAccess);
+
+	/* flags recorded in an older epoch are no longer valid */
+	if (hashEntry->parallelRecordedEpoch != ParallelAccessEpoch)
+	{
+		int parallelRecordedMask = (1 << (PLACEMENT_ACCESS_SELECT +
+										  PARALLEL_RECORDED_FLAG_OFFSET)) |
+								   (1 << (PLACEMENT_ACCESS_DML +
+										  PARALLEL_RECORDED_FLAG_OFFSET)) |
+								   (1 << (PLACEMENT_ACCESS_DDL +
+										  PARALLEL_RECORDED_FLAG_OFFSET));
+
+		hashEntry->relationAccessMode &= ~parallelRecordedMask;
+		hashEntry->parallelRecordedEpoch = ParallelAccessEpoch;
 	}
 
-	RecordParallelRelationAccessToCache(relationId, placementAccess);
+	int parallelRecordedBit = placementAccess + PARALLEL_RECORDED_FLAG_OFFSET;
+	hashEntry->relationAccessMode |= (1 << parallelRecordedBit);
 }
 
 
 /*
  * RecordParallelRelationAccessToCache is a utility function which saves the given
- * relation id's access to the RelationAccessHash.
+ * relation id's access to the RelationAccessHash and returns the hash entry.
  */
-static void
+static RelationAccessHashEntry *
 RecordParallelRelationAccessToCache(Oid relationId,
 									ShardPlacementAccessType placementAccess)
 {
@@ -529,6 +632,17 @@ RecordParallelRelationAccessToCache(Oid relationId,
 	if (!found)
 	{
 		hashEntry->relationAccessMode = 0;
+		hashEntry->parallelRecordedEpoch = ParallelAccessEpoch;
+
+		/*
+		 * Reference tables can be part of a parallel access, for instance in
+		 * a join with a distributed table.
+		 */
+		if (!ReferenceTableAccessRecorded && IsCitusTable(relationId) &&
+			PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+		{
+			ReferenceTableAccessRecorded = true;
+		}
 	}
 
 	/* set the bit representing the access type */
@@ -537,6 +651,8 @@ RecordParallelRelationAccessToCache(Oid relationId,
 	/* set the bit representing access mode */
 	int parallelRelationAccessBit = placementAccess + PARALLEL_MODE_FLAG_OFFSET;
 	hashEntry->relationAccessMode |= (1 << parallelRelationAccessBit);
+
+	return hashEntry;
 }
 
 
@@ -811,6 +927,12 @@ CheckConflictingParallelRelationAccesses(Oid relationId, ShardPlacementAccessTyp
 		return;
 	}
 
+	if (!ReferenceTableAccessRecorded)
+	{
+		/* only accesses to reference tables can conflict */
+		return;
+	}
+
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
 	if (!(cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH &&
 		  cacheEntry->referencedRelationsViaForeignKey != NIL))
@@ -17,7 +17,9 @@
 #include "access/xact.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
+#include "distributed/lag_aware_routing.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
@@ -33,10 +35,8 @@
 #define PREPARED_TRANSACTION_NAME_FORMAT "citus_%u_%u_"UINT64_FORMAT "_%u"
 
 
-static void StartRemoteTransactionSavepointBegin(MultiConnection *connection,
-												 SubTransactionId subId);
-static void FinishRemoteTransactionSavepointBegin(MultiConnection *connection,
-												  SubTransactionId subId);
+static bool RemoteTransactionHasSavepoint(MultiConnection *connection,
+										  SubTransactionId subId);
 static void StartRemoteTransactionSavepointRelease(MultiConnection *connection,
 												   SubTransactionId subId);
 static void FinishRemoteTransactionSavepointRelease(MultiConnection *connection,
@@ -46,6 +46,7 @@ static void StartRemoteTransactionSavepointRollback(MultiConnection *connection,
 static void FinishRemoteTransactionSavepointRollback(MultiConnection *connection,
 													 SubTransactionId subId);
 
+static void SendRemoteTransactionPrepare(MultiConnection *connection);
 static void Assign2PCIdentifier(MultiConnection *connection);
 static void WarnAboutLeakedPreparedTransaction(MultiConnection *connection, bool commit);
 
@@ -61,6 +62,33 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 {
 	RemoteTransaction *transaction = &connection->remoteTransaction;
 
+	char *beginCommand = RemoteTransactionBeginCommand(connection);
+
+	if (!SendRemoteCommand(connection, beginCommand))
+	{
+		const bool raiseErrors = true;
+
+		HandleRemoteTransactionConnectionError(connection, raiseErrors);
+	}
+
+	transaction->beginSent = true;
+}
+
+
+/*
+ * RemoteTransactionBeginCommand marks the transaction on the connection as
+ * starting, and returns the command that opens the transaction block on the
+ * remote node, assigns the distributed transaction id and replays the
+ * savepoints and SET LOCALs of the current transaction.
+ *
+ * Callers that send the command themselves, possibly together with other
+ * commands, have to set beginSent once it is sent.
+ */
+char *
+RemoteTransactionBeginCommand(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
 	Assert(transaction->transactionState == REMOTE_TRANS_NOT_STARTED);
 
 	/* remember transaction as being in-progress */
@@ -73,7 +101,6 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 
 	/* append context for in-progress SAVEPOINTs for this transaction */
 	List *activeSubXacts = ActiveSubXactContexts();
-	transaction->lastSuccessfulSubXact = TopSubTransactionId;
 	transaction->lastQueuedSubXact = TopSubTransactionId;
 
 	SubXactContext *subXactState = NULL;
@@ -98,14 +125,91 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 		appendStringInfoString(beginAndSetDistributedTransactionId, activeSetStmts->data);
 	}
 
-	if (!SendRemoteCommand(connection, beginAndSetDistributedTransactionId->data))
+	return beginAndSetDistributedTransactionId->data;
+}
+
+
+/*
+ * RemoteTransactionSavepointCommand returns the command that establishes the
+ * savepoints that were created since the last command was sent over the
+ * connection, or NULL if there are none, and marks them as sent. The number
+ * of SAVEPOINT statements in the command is stored in savepointCount.
+ *
+ * Savepoints are not sent to all connections when they are created, but only
+ * in front of the next command that is sent over a connection. Connections
+ * that are not used within a subtransaction therefore never need to hear
+ * about its savepoint.
+ */
+char *
+RemoteTransactionSavepointCommand(struct MultiConnection *connection,
+								  int *savepointCount)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo savepointCommand = NULL;
+
+	*savepointCount = 0;
+
+	if (transaction->transactionState == REMOTE_TRANS_NOT_STARTED ||
+		transaction->transactionFailed)
+	{
+		return NULL;
+	}
+
+	List *activeSubXacts = ActiveSubXacts();
+	int subId = 0;
+	foreach_int(subId, activeSubXacts)
+	{
+		/* savepoints that are older than the last sent one were sent before */
+		if (subId <= transaction->lastQueuedSubXact)
+		{
+			continue;
+		}
+
+		if (savepointCommand == NULL)
+		{
+			savepointCommand = makeStringInfo();
+		}
+
+		appendStringInfo(savepointCommand, "SAVEPOINT savepoint_%u;", subId);
+		transaction->lastQueuedSubXact = subId;
+		(*savepointCount)++;
+	}
+
+	if (savepointCommand == NULL)
+	{
+		return NULL;
+	}
+
+	return savepointCommand->data;
+}
+
+
+/*
+ * StartRemoteTransactionSavepoints sends the savepoints that were created
+ * since the last command was sent over the connection in a non-blocking
+ * manner, and returns whether there were any. The caller has to clear the
+ * results.
+ */
+bool
+StartRemoteTransactionSavepoints(struct MultiConnection *connection)
+{
+	int savepointCount = 0;
+
+	char *savepointCommand = RemoteTransactionSavepointCommand(connection,
+															   &savepointCount);
+	if (savepointCommand == NULL)
+	{
+		return false;
+	}
+
+	if (!SendRemoteCommand(connection, savepointCommand))
 	{
 		const bool raiseErrors = true;
 
 		HandleRemoteTransactionConnectionError(connection, raiseErrors);
 	}
 
-	transaction->beginSent = true;
+	return true;
 }
 
 
@@ -161,7 +265,6 @@ FinishRemoteTransactionBegin(struct MultiConnection *connection)
 	if (clearSuccessful)
 	{
 		transaction->transactionState = REMOTE_TRANS_STARTED;
-		transaction->lastSuccessfulSubXact = transaction->lastQueuedSubXact;
 	}
 
 	if (!transaction->transactionFailed)
@@ -223,6 +326,8 @@ StartRemoteTransactionCommit(MultiConnection *connection)
 	/* can't commit if we already started to commit or abort */
 	Assert(transaction->transactionState < REMOTE_TRANS_1PC_ABORTING);
 
+	transaction->commitLsnRequested = false;
+
 	if (transaction->transactionFailed)
 	{
 		/* abort the transaction if it failed */
@@ -248,6 +353,12 @@ StartRemoteTransactionCommit(MultiConnection *connection)
 		appendStringInfo(&command, "COMMIT PREPARED %s",
 						 quote_literal_cstr(transaction->preparedName));
 
+		if (ShouldRequestCommitLsn(connection))
+		{
+			appendStringInfoString(&command, COMMIT_LSN_QUERY);
+			transaction->commitLsnRequested = true;
+		}
+
 		transaction->transactionState = REMOTE_TRANS_2PC_COMMITTING;
 
 		if (!SendRemoteCommand(connection, command.data))
@@ -259,10 +370,19 @@ StartRemoteTransactionCommit(MultiConnection *connection)
 	}
 	else
 	{
+		char *commitCommand = "COMMIT";
+
+		/* read-your-writes routing needs to know where the commit ended up */
+		if (ShouldRequestCommitLsn(connection))
+		{
+			commitCommand = "COMMIT" COMMIT_LSN_QUERY;
+			transaction->commitLsnRequested = true;
+		}
+
 		/* initiate remote transaction commit */
 		transaction->transactionState = REMOTE_TRANS_1PC_COMMITTING;
 
-		if (!SendRemoteCommand(connection, "COMMIT"))
+		if (!SendRemoteCommand(connection, commitCommand))
 		{
 			/*
 			 * For a moment there I thought we were in trouble.
@@ -329,6 +449,14 @@ FinishRemoteTransactionCommit(MultiConnection *connection)
 	else
 	{
 		transaction->transactionState = REMOTE_TRANS_COMMITTED;
+
+		if (transaction->commitLsnRequested)
+		{
+			PGresult *lsnResult = GetRemoteCommandResult(connection, raiseErrors);
+
+			RecordCommitLsn(connection, lsnResult);
+			PQclear(lsnResult);
+		}
 	}
 
 	PQclear(result);
@@ -480,6 +608,29 @@ RemoteTransactionAbort(MultiConnection *connection)
  */
 void
 StartRemoteTransactionPrepare(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assign2PCIdentifier(connection);
+
+	/* log transactions to workers in pg_dist_transaction */
+	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+	if (workerNode != NULL)
+	{
+		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
+	}
+
+	SendRemoteTransactionPrepare(connection);
+}
+
+
+/*
+ * SendRemoteTransactionPrepare sends PREPARE TRANSACTION for the 2PC
+ * identifier already assigned to the connection's transaction. Logging the
+ * transaction in pg_dist_transaction is left to the caller.
+ */
+static void
+SendRemoteTransactionPrepare(struct MultiConnection *connection)
 {
 	RemoteTransaction *transaction = &connection->remoteTransaction;
 	StringInfoData command;
@@ -494,15 +645,6 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 	/* can't prepare if already started to prepare/abort/commit */
 	Assert(transaction->transactionState < REMOTE_TRANS_PREPARING);
 
-	Assign2PCIdentifier(connection);
-
-	/* log transactions to workers in pg_dist_transaction */
-	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
-	if (workerNode != NULL)
-	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
-	}
-
 	initStringInfo(&command);
 	appendStringInfo(&command, "PREPARE TRANSACTION %s",
 					 quote_literal_cstr(transaction->preparedName));
@@ -596,12 +738,15 @@ RemoteTransactionBeginIfNecessary(MultiConnection *connection)
  * RemoteTransactionsBeginIfNecessary begins, if necessary according to this
  * session's coordinated transaction state, and the remote transaction's
  * state, an explicit transaction on all the connections.  This is done in
- * parallel, to lessen latency penalties.
+ * parallel, to lessen latency penalties. Connections that already are in a
+ * transaction are sent the savepoints that were created since they were last
+ * used.
  */
 void
 RemoteTransactionsBeginIfNecessary(List *connectionList)
 {
 	MultiConnection *connection = NULL;
+	List *savepointConnectionList = NIL;
 
 	/*
 	 * Don't do anything if not in a coordinated transaction. That allows the
@@ -628,6 +773,12 @@ RemoteTransactionsBeginIfNecessary(List *connectionList)
 		 */
 		if (transaction->transactionState != REMOTE_TRANS_NOT_STARTED)
 		{
+			if (StartRemoteTransactionSavepoints(connection))
+			{
+				savepointConnectionList = lappend(savepointConnectionList,
+												  connection);
+			}
+
 			continue;
 		}
 
@@ -637,6 +788,19 @@ RemoteTransactionsBeginIfNecessary(List *connectionList)
 	bool raiseInterrupts = true;
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
+	/* get result of all the SAVEPOINTs */
+	foreach_ptr(connection, savepointConnectionList)
+	{
+		const bool raiseErrors = true;
+
+		if (connection->remoteTransaction.transactionFailed)
+		{
+			continue;
+		}
+
+		ClearResults(connection, raiseErrors);
+	}
+
 	/* get result of all the BEGINs */
 	foreach_ptr(connection, connectionList)
 	{
@@ -802,6 +966,8 @@ CoordinatedRemoteTransactionsPrepare(void)
 {
 	dlist_iter iter;
 	List *connectionList = NIL;
+	List *groupIdList = NIL;
+	List *transactionNameList = NIL;
 
 	/* issue PREPARE TRANSACTION; to all relevant remote nodes */
 
@@ -820,12 +986,30 @@ CoordinatedRemoteTransactionsPrepare(void)
 			continue;
 		}
 
-		StartRemoteTransactionPrepare(connection);
+		Assign2PCIdentifier(connection);
+
+		WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+		if (workerNode != NULL)
+		{
+			groupIdList = lappend_int(groupIdList, workerNode->groupId);
+			transactionNameList = lappend(transactionNameList,
+										  transaction->preparedName);
+		}
+
+		SendRemoteTransactionPrepare(connection);
 		connectionList = lappend(connectionList, connection);
 	}
 
+	/*
+	 * Log the transactions to workers in pg_dist_transaction while the
+	 * workers are preparing. The records only become visible to recovery
+	 * when the local transaction commits, so the order does not matter.
+	 */
+	LogTransactionRecordList(groupIdList, transactionNameList);
+
 	bool raiseInterrupts = true;
-	WaitForAllConnections(connectionList, raiseInterrupts);
+	WaitForAllConnectionsWithTimeout(connectionList, raiseInterrupts, -1,
+									 WAIT_EVENT_CITUS_TWO_PHASE_PREPARE);
 
 	/* Wait for result */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -887,7 +1071,8 @@ CoordinatedRemoteTransactionsCommit(void)
 	}
 
 	bool raiseInterrupts = false;
-	WaitForAllConnections(connectionList, raiseInterrupts);
+	WaitForAllConnectionsWithTimeout(connectionList, raiseInterrupts, -1,
+									 WAIT_EVENT_CITUS_TRANSACTION_COMMIT);
 
 	/* wait for the replies to the commands to come in */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -964,59 +1149,27 @@ CoordinatedRemoteTransactionsAbort(void)
 
 
 /*
- * CoordinatedRemoteTransactionsSavepointBegin sends the SAVEPOINT command for
- * the given sub-transaction id to all connections participating in the current
- * transaction.
+ * RemoteTransactionHasSavepoint returns whether the SAVEPOINT command for the
+ * given active sub-transaction id was sent over the connection.
+ *
+ * Savepoints are sent to a connection in the order in which they were created,
+ * and sub-transaction ids are assigned incrementally, so all active savepoints
+ * up to the last one sent over the connection were sent.
  */
-void
-CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
+static bool
+RemoteTransactionHasSavepoint(MultiConnection *connection, SubTransactionId subId)
 {
-	dlist_iter iter;
-	const bool raiseInterrupts = true;
-	List *connectionList = NIL;
-
-	/* asynchronously send SAVEPOINT */
-	dlist_foreach(iter, &InProgressTransactions)
-	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
-		RemoteTransaction *transaction = &connection->remoteTransaction;
-		if (transaction->transactionFailed)
-		{
-			continue;
-		}
-
-		StartRemoteTransactionSavepointBegin(connection, subId);
-		connectionList = lappend(connectionList, connection);
-	}
-
-	WaitForAllConnections(connectionList, raiseInterrupts);
-
-	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
-	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
-		RemoteTransaction *transaction = &connection->remoteTransaction;
-		if (transaction->transactionFailed)
-		{
-			continue;
-		}
-
-		FinishRemoteTransactionSavepointBegin(connection, subId);
+	RemoteTransaction *transaction = &connection->remoteTransaction;
 
-		if (!transaction->transactionFailed)
-		{
-			transaction->lastSuccessfulSubXact = subId;
-		}
-	}
+	return subId <= transaction->lastQueuedSubXact;
 }
 
 
 /*
  * CoordinatedRemoteTransactionsSavepointRelease sends the RELEASE SAVEPOINT
  * command for the given sub-transaction id to all connections participating in
- * the current transaction.
+ * the current transaction that were used since the savepoint was created.
+ * Other connections never saw the savepoint.
  */
 void
 CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
@@ -1031,7 +1184,8 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
-		if (transaction->transactionFailed)
+		if (transaction->transactionFailed ||
+			!RemoteTransactionHasSavepoint(connection, subId))
 		{
 			continue;
 		}
@@ -1043,10 +1197,9 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed)
 		{
@@ -1061,7 +1214,8 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 /*
  * CoordinatedRemoteTransactionsSavepointRollback sends the ROLLBACK TO SAVEPOINT
  * command for the given sub-transaction id to all connections participating in
- * the current transaction.
+ * the current transaction that were used since the savepoint was created.
+ * Other connections did not run any commands that need to be rolled back.
  */
 void
 CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
@@ -1077,6 +1231,11 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 
+		if (!RemoteTransactionHasSavepoint(connection, subId))
+		{
+			continue;
+		}
+
 		/* cancel any ongoing queries before issuing rollback */
 		SendCancelationRequest(connection);
 
@@ -1085,22 +1244,16 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 
 		if (transaction->transactionFailed)
 		{
-			if (transaction->lastSuccessfulSubXact <= subId)
-			{
-				transaction->transactionRecovering = true;
-
-				/*
-				 * Clear the results of the failed query so we can send the ROLLBACK
-				 * TO SAVEPOINT command for a savepoint that can recover the transaction
-				 * from failure.
-				 */
-				ForgetResults(connection);
-			}
-			else
-			{
-				continue;
-			}
+			/*
+			 * The savepoint was sent before or together with the command that
+			 * failed, so rolling back to it can recover the transaction. Clear
+			 * the results of the failed query so we can send the ROLLBACK TO
+			 * SAVEPOINT command.
+			 */
+			transaction->transactionRecovering = true;
+			ForgetResults(connection);
 		}
+
 		StartRemoteTransactionSavepointRollback(connection, subId);
 		connectionList = lappend(connectionList, connection);
 	}
@@ -1108,10 +1261,9 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed && !transaction->transactionRecovering)
 		{
@@ -1123,44 +1275,6 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 }
 
 
-/*
- * StartRemoteTransactionSavepointBegin initiates SAVEPOINT command for the given
- * subtransaction id in a non-blocking manner.
- */
-static void
-StartRemoteTransactionSavepointBegin(MultiConnection *connection, SubTransactionId subId)
-{
-	const bool raiseErrors = true;
-	StringInfo savepointCommand = makeStringInfo();
-	appendStringInfo(savepointCommand, "SAVEPOINT savepoint_%u", subId);
-
-	if (!SendRemoteCommand(connection, savepointCommand->data))
-	{
-		HandleRemoteTransactionConnectionError(connection, raiseErrors);
-	}
-}
-
-
-/*
- * FinishRemoteTransactionSavepointBegin finishes the work
- * StartRemoteTransactionSavepointBegin initiated. It blocks if necessary (i.e.
- * if PQisBusy() would return true).
- */
-static void
-FinishRemoteTransactionSavepointBegin(MultiConnection *connection, SubTransactionId subId)
-{
-	const bool raiseErrors = true;
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-	if (!IsResponseOK(result))
-	{
-		HandleRemoteTransactionResultError(connection, result, raiseErrors);
-	}
-
-	PQclear(result);
-	ForgetResults(connection);
-}
-
-
 /*
  * StartRemoteTransactionSavepointRelease initiates RELEASE SAVEPOINT command for
  * the given subtransaction id in a non-blocking manner.
@@ -21,9 +21,12 @@
 #include "access/xact.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/columnar.h"
 #include "distributed/connection_management.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/foreign_key_relationship.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/inline_intermediate_results.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
@@ -31,8 +34,10 @@
 #include "distributed/repartition_join_execution.h"
 #include "distributed/transaction_management.h"
 #include "distributed/placement_connection.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/subplan_result_cache.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_log_messages.h"
 #include "utils/hsearch.h"
@@ -57,6 +62,9 @@ bool SelectOpensTransactionBlock = true;
 /* controls use of locks to enforce safe commutativity */
 bool AllModificationsCommutative = false;
 
+/* whether commutative writes run on all placements of a shard in parallel */
+bool EnableParallelReplicaWrites = false;
+
 /* we've deprecated this flag, keeping here for some time not to break existing users */
 bool EnableDeadlockPrevention = true;
 
@@ -247,6 +255,10 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * callbacks still can perform work if needed.
 			 */
 			ResetShardPlacementTransactionState();
+			ForeignConstraintRelationshipGraphTransactionEnd(true);
+#if PG_VERSION_NUM >= PG_VERSION_12
+			ColumnarResetPendingWrites();
+#endif
 
 			if (CurrentCoordinatedTransactionState == COORD_TRANS_PREPARED)
 			{
@@ -299,6 +311,10 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 				SwallowErrors(RemoveIntermediateResultsDirectory);
 			}
 			ResetShardPlacementTransactionState();
+			ForeignConstraintRelationshipGraphTransactionEnd(false);
+#if PG_VERSION_NUM >= PG_VERSION_12
+			ColumnarResetPendingWrites();
+#endif
 
 			/* handles both already prepared and open transactions */
 			if (CurrentCoordinatedTransactionState > COORD_TRANS_IDLE)
@@ -365,12 +381,22 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 */
 			RemoveIntermediateResultsDirectory();
 
+#if PG_VERSION_NUM >= PG_VERSION_12
+			ColumnarResetPendingWrites();
+#endif
+
 			UnSetDistributedTransactionId();
 			break;
 		}
 
 		case XACT_EVENT_PRE_COMMIT:
 		{
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+			/* write the rows buffered for columnar tables while we still can fail */
+			ColumnarFlushAllPendingWrites();
+#endif
+
 			/*
 			 * If the distributed query involves 2PC, we already removed
 			 * the intermediate result directory on XACT_EVENT_PREPARE. However,
@@ -437,6 +463,13 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 		case XACT_EVENT_PARALLEL_PRE_COMMIT:
 		case XACT_EVENT_PRE_PREPARE:
 		{
+#if PG_VERSION_NUM >= PG_VERSION_12
+			if (event == XACT_EVENT_PRE_PREPARE)
+			{
+				ColumnarFlushAllPendingWrites();
+			}
+#endif
+
 			if (InCoordinatedTransaction())
 			{
 				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
@@ -465,6 +498,9 @@ ResetGlobalVariables()
 	TransactionModifiedNodeMetadata = false;
 
 	ResetWorkerErrorIndication();
+	ResetSubPlanResultCache();
+	ResetInlinedIntermediateResults();
+	QueryResultCacheTransactionEnd();
 }
 
 
@@ -505,11 +541,11 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 		 */
 		case SUBXACT_EVENT_START_SUB:
 		{
+			/*
+			 * The savepoint is only sent to a connection in front of the next
+			 * command on that connection, see RemoteTransactionSavepointCommand.
+			 */
 			PushSubXact(subId);
-			if (InCoordinatedTransaction())
-			{
-				CoordinatedRemoteTransactionsSavepointBegin(subId);
-			}
 			break;
 		}
 
@@ -520,6 +556,9 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 				CoordinatedRemoteTransactionsSavepointRelease(subId);
 			}
 			PopSubXact(subId);
+#if PG_VERSION_NUM >= PG_VERSION_12
+			ColumnarAtEOSubXact(true, subId, parentSubid);
+#endif
 			break;
 		}
 
@@ -541,6 +580,9 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 				CoordinatedRemoteTransactionsSavepointRollback(subId);
 			}
 			PopSubXact(subId);
+#if PG_VERSION_NUM >= PG_VERSION_12
+			ColumnarAtEOSubXact(false, subId, parentSubid);
+#endif
 
 			break;
 		}
@@ -52,13 +52,59 @@
 PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
+/*
+ * PreparedTransactionRecovery describes a prepared transaction on a worker
+ * that should be committed or aborted, and the recovery record to delete
+ * once that succeeds, if any.
+ */
+typedef struct PreparedTransactionRecovery
+{
+	char *transactionName;
+	bool shouldCommit;
+	bool hasRecoveryRecord;
+	ItemPointerData recoveryRecordTid;
+} PreparedTransactionRecovery;
+
+
+/*
+ * WorkerRecoveryState tracks the recovery of prepared transactions on a
+ * single worker while all workers are recovered in parallel.
+ */
+typedef struct WorkerRecoveryState
+{
+	WorkerNode *workerNode;
+	MultiConnection *connection;
+
+	/* prepared transactions seen before and after the recovery record snapshot */
+	HTAB *pendingTransactionSet;
+	HTAB *recheckTransactionSet;
+
+	/* PreparedTransactionRecovery list, in the order they should be recovered */
+	List *recoveryList;
+
+	/* recovery records that can be deleted, as ItemPointers */
+	List *deletableRecordList;
+
+	/* whether committing or aborting a prepared transaction failed */
+	bool recoveryFailed;
+} WorkerRecoveryState;
+
+
 /* Local functions forward declarations */
-static int RecoverWorkerTransactions(WorkerNode *workerNode);
-static List * PendingWorkerTransactionList(MultiConnection *connection);
+static List * StartWorkerRecoveryStates(List *workerList);
+static void FetchPendingTransactionSets(List *workerStateList, bool isRecheck);
+static WorkerRecoveryState * WorkerRecoveryStateForGroup(List *workerStateList,
+														 int32 groupId);
+static void PlanRecordRecovery(WorkerRecoveryState *workerState,
+							   HTAB *activeTransactionNumberSet, char *transactionName,
+							   ItemPointer recordTid);
+static void PlanAbortRecovery(WorkerRecoveryState *workerState,
+							  HTAB *activeTransactionNumberSet);
+static int ExecuteRecoveryInParallel(List *workerStateList);
+static char * PreparedTransactionRecoveryCommand(
+	PreparedTransactionRecovery *recovery);
 static bool IsTransactionInProgress(HTAB *activeTransactionNumberSet,
 									char *preparedTransactionName);
-static bool RecoverPreparedTransactionOnWorker(MultiConnection *connection,
-											   char *transactionName, bool shouldCommit);
 
 
 /*
@@ -83,24 +129,58 @@ recover_prepared_transactions(PG_FUNCTION_ARGS)
  */
 void
 LogTransactionRecord(int32 groupId, char *transactionName)
+{
+	List *groupIdList = list_make1_int(groupId);
+	List *transactionNameList = list_make1(transactionName);
+
+	LogTransactionRecordList(groupIdList, transactionNameList);
+}
+
+
+/*
+ * LogTransactionRecordList registers a list of transactions on workers in
+ * pg_dist_transaction, the i-th transaction name belonging to the i-th group
+ * id. All records are inserted with the relation opened once, which is what
+ * a distributed transaction that prepares on many workers needs.
+ */
+void
+LogTransactionRecordList(List *groupIdList, List *transactionNameList)
 {
 	Datum values[Natts_pg_dist_transaction];
 	bool isNulls[Natts_pg_dist_transaction];
+	ListCell *groupIdCell = NULL;
+	ListCell *transactionNameCell = NULL;
 
-	/* form new transaction tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
+	Assert(list_length(groupIdList) == list_length(transactionNameList));
 
-	values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
-	values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+	if (groupIdList == NIL)
+	{
+		return;
+	}
 
-	/* open transaction relation and insert new tuple */
+	/* open transaction relation and insert the new tuples */
 	Relation pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
 
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
 
-	CatalogTupleInsert(pgDistTransaction, heapTuple);
+	forboth(groupIdCell, groupIdList, transactionNameCell, transactionNameList)
+	{
+		int32 groupId = lfirst_int(groupIdCell);
+		char *transactionName = (char *) lfirst(transactionNameCell);
+
+		/* form new transaction tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
+		values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+
+		HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+		CatalogTupleInsert(pgDistTransaction, heapTuple);
+
+		heap_freetuple(heapTuple);
+	}
 
 	CommandCounterIncrement();
 
@@ -112,64 +192,37 @@ LogTransactionRecord(int32 groupId, char *transactionName)
 /*
  * RecoverTwoPhaseCommits recovers any pending prepared
  * transactions started by this node on other nodes.
+ *
+ * All workers are recovered in parallel. Each step below is done on all
+ * workers at once, and the prepared transactions are committed or aborted
+ * in rounds of one command per worker. The recovery records of all workers
+ * are deleted together at the end.
  */
 int
 RecoverTwoPhaseCommits(void)
 {
-	int recoveredTransactionCount = 0;
-
-	List *workerList = ActivePrimaryNodeList(NoLock);
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerList)
-	{
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode);
-	}
-
-	return recoveredTransactionCount;
-}
-
-
-/*
- * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
- */
-static int
-RecoverWorkerTransactions(WorkerNode *workerNode)
-{
-	int recoveredTransactionCount = 0;
-
-	int32 groupId = workerNode->groupId;
-	char *nodeName = workerNode->workerName;
-	int nodePort = workerNode->workerPort;
-
-
-	ScanKeyData scanKey[1];
-	int scanKeyCount = 1;
-	bool indexOK = true;
 	HeapTuple heapTuple = NULL;
+	bool indexOK = false;
 
-	HASH_SEQ_STATUS status;
-
-	bool recoveryFailed = false;
-
-	int connectionFlags = 0;
-	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName, nodePort);
-	if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
-	{
-		ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
-								 nodeName, nodePort)));
-
-		return 0;
-	}
+	List *workerList = ActivePrimaryNodeList(NoLock);
 
 	MemoryContext localContext = AllocSetContextCreateExtended(CurrentMemoryContext,
-															   "RecoverWorkerTransactions",
+															   "RecoverTwoPhaseCommits",
 															   ALLOCSET_DEFAULT_MINSIZE,
 															   ALLOCSET_DEFAULT_INITSIZE,
 															   ALLOCSET_DEFAULT_MAXSIZE);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
+	List *workerStateList = StartWorkerRecoveryStates(workerList);
+	if (workerStateList == NIL)
+	{
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextDelete(localContext);
+
+		return 0;
+	}
+
 	/* take table lock first to avoid running concurrently */
 	Relation pgDistTransaction = heap_open(DistTransactionRelationId(),
 										   ShareUpdateExclusiveLock);
@@ -205,232 +258,491 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	 * We therefore observe the set of prepared transactions one more time in
 	 * step 4. The aforementioned transactions would show up in Q, but not in
 	 * P. We can skip those transactions and recover them later.
+	 *
+	 * Each step is done for all workers before moving on to the next one, so
+	 * the order holds for every worker.
 	 */
 
-	/* find stale prepared transactions on the remote node */
-	List *pendingTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *pendingTransactionSet = ListToHashSet(pendingTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	bool isRecheck = false;
+	FetchPendingTransactionSets(workerStateList, isRecheck);
 
 	/* find in-progress distributed transactions */
 	List *activeTransactionNumberList = ActiveDistributedTransactionNumbers();
 	HTAB *activeTransactionNumberSet = ListToHashSet(activeTransactionNumberList,
 													 sizeof(uint64), false);
 
-	/* scan through all recovery records of the current worker */
-	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
-				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
-
 	/* get a snapshot of pg_dist_transaction */
 	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
 													DistTransactionGroupIndexId(),
 													indexOK,
-													NULL, scanKeyCount, scanKey);
+													NULL, 0, NULL);
 
-	/* find stale prepared transactions on the remote node */
-	List *recheckTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *recheckTransactionSet = ListToHashSet(recheckTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	isRecheck = true;
+	FetchPendingTransactionSets(workerStateList, isRecheck);
 
 	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
 	{
 		bool isNull = false;
-		bool foundPreparedTransactionBeforeCommit = false;
-		bool foundPreparedTransactionAfterCommit = false;
+
+		Datum groupIdDatum = heap_getattr(heapTuple, Anum_pg_dist_transaction_groupid,
+										  tupleDescriptor, &isNull);
+		int32 groupId = DatumGetInt32(groupIdDatum);
+
+		WorkerRecoveryState *workerState =
+			WorkerRecoveryStateForGroup(workerStateList, groupId);
+		if (workerState == NULL)
+		{
+			/* the worker is not active or could not be reached */
+			continue;
+		}
 
 		Datum transactionNameDatum = heap_getattr(heapTuple,
 												  Anum_pg_dist_transaction_gid,
 												  tupleDescriptor, &isNull);
 		char *transactionName = TextDatumGetCString(transactionNameDatum);
 
-		bool isTransactionInProgress = IsTransactionInProgress(activeTransactionNumberSet,
-															   transactionName);
-		if (isTransactionInProgress)
+		PlanRecordRecovery(workerState, activeTransactionNumberSet, transactionName,
+						   &heapTuple->t_self);
+	}
+
+	systable_endscan(scanDescriptor);
+
+	WorkerRecoveryState *workerState = NULL;
+	foreach_ptr(workerState, workerStateList)
+	{
+		PlanAbortRecovery(workerState, activeTransactionNumberSet);
+	}
+
+	int recoveredTransactionCount = ExecuteRecoveryInParallel(workerStateList);
+
+	/* delete the recovery records of all workers in one go */
+	foreach_ptr(workerState, workerStateList)
+	{
+		ItemPointer recordTid = NULL;
+		foreach_ptr(recordTid, workerState->deletableRecordList)
 		{
-			/*
-			 * Do not touch in progress transactions as we might mistakenly
-			 * commit a transaction that is actually in the process of
-			 * aborting or vice-versa.
-			 */
+			simple_heap_delete(pgDistTransaction, recordTid);
+		}
+	}
+
+	heap_close(pgDistTransaction, NoLock);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(localContext);
+
+	return recoveredTransactionCount;
+}
+
+
+/*
+ * StartWorkerRecoveryStates connects to the given workers in parallel and
+ * returns a WorkerRecoveryState for each worker that we could connect to.
+ */
+static List *
+StartWorkerRecoveryStates(List *workerList)
+{
+	List *connectionList = NIL;
+	List *workerStateList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerList)
+	{
+		int connectionFlags = 0;
+		MultiConnection *connection = StartNodeConnection(connectionFlags,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *workerCell = NULL;
+	ListCell *connectionCell = NULL;
+	forboth(workerCell, workerList, connectionCell, connectionList)
+	{
+		workerNode = (WorkerNode *) lfirst(workerCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
+									 workerNode->workerName,
+									 workerNode->workerPort)));
 			continue;
 		}
 
-		/*
-		 * Remove the transaction from the pending list such that only transactions
-		 * that need to be aborted remain at the end.
-		 */
-		hash_search(pendingTransactionSet, transactionName, HASH_REMOVE,
-					&foundPreparedTransactionBeforeCommit);
+		WorkerRecoveryState *workerState = palloc0(sizeof(WorkerRecoveryState));
+		workerState->workerNode = workerNode;
+		workerState->connection = connection;
+
+		workerStateList = lappend(workerStateList, workerState);
+	}
+
+	return workerStateList;
+}
+
 
-		hash_search(recheckTransactionSet, transactionName, HASH_FIND,
-					&foundPreparedTransactionAfterCommit);
+/*
+ * FetchPendingTransactionSets finds the pending prepared transactions that
+ * were started by this node on all given workers in parallel, and stores
+ * them in the pending or, if isRecheck is true, the recheck set of each
+ * worker.
+ */
+static void
+FetchPendingTransactionSets(List *workerStateList, bool isRecheck)
+{
+	StringInfo command = makeStringInfo();
+	bool raiseInterrupts = true;
+	int32 coordinatorId = GetLocalGroupId();
 
-		if (foundPreparedTransactionBeforeCommit && foundPreparedTransactionAfterCommit)
+	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
+							  "WHERE gid LIKE 'citus\\_%d\\_%%'",
+					 coordinatorId);
+
+	/* send commands in parallel */
+	WorkerRecoveryState *workerState = NULL;
+	foreach_ptr(workerState, workerStateList)
+	{
+		MultiConnection *connection = workerState->connection;
+
+		int querySent = SendRemoteCommand(connection, command->data);
+		if (querySent == 0)
 		{
-			/*
-			 * The transaction was committed, but the prepared transaction still exists
-			 * on the worker. Try committing it.
-			 *
-			 * We double check that the recovery record exists both before and after
-			 * checking ActiveDistributedTransactionNumbers(), since we may have
-			 * observed a prepared transaction that was committed immediately after.
-			 */
-			bool shouldCommit = true;
-			bool commitSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																	  transactionName,
-																	  shouldCommit);
-			if (!commitSucceeded)
-			{
-				/*
-				 * Failed to commit on the current worker. Stop without throwing
-				 * an error to allow recover_prepared_transactions to continue with
-				 * other workers.
-				 */
-				recoveryFailed = true;
-				break;
-			}
+			ReportConnectionError(connection, ERROR);
+		}
+	}
 
-			recoveredTransactionCount++;
+	/* receive the prepared transactions */
+	foreach_ptr(workerState, workerStateList)
+	{
+		MultiConnection *connection = workerState->connection;
+		List *transactionNames = NIL;
 
-			/*
-			 * We successfully committed the prepared transaction, safe to delete
-			 * the recovery record.
-			 */
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
 		}
-		else if (foundPreparedTransactionAfterCommit)
+
+		int rowCount = PQntuples(result);
+
+		for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
 		{
-			/*
-			 * We found a committed pg_dist_transaction record that initially did
-			 * not have a prepared transaction, but did when we checked again.
-			 *
-			 * If a transaction started and committed just after we observed the
-			 * set of prepared transactions, and just before we called
-			 * ActiveDistributedTransactionNumbers, then we would see a recovery
-			 * record without a prepared transaction in pendingTransactionSet,
-			 * but there may be prepared transactions that failed to commit.
-			 * We should not delete the records for those prepared transactions,
-			 * since we would otherwise roll back them on the next call to
-			 * recover_prepared_transactions.
-			 *
-			 * In addition, if the transaction started after the call to
-			 * ActiveDistributedTransactionNumbers and finished just before our
-			 * pg_dist_transaction snapshot, then it may still be in the process
-			 * of comitting the prepared transactions in the post-commit callback
-			 * and we should not touch the prepared transactions.
-			 *
-			 * To handle these cases, we just leave the records and prepared
-			 * transactions for the next call to recover_prepared_transactions
-			 * and skip them here.
-			 */
+			const int columnIndex = 0;
+			char *transactionName = PQgetvalue(result, rowIndex, columnIndex);
 
-			continue;
+			transactionNames = lappend(transactionNames, pstrdup(transactionName));
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+
+		HTAB *transactionSet = ListToHashSet(transactionNames, NAMEDATALEN, true);
+		if (isRecheck)
+		{
+			workerState->recheckTransactionSet = transactionSet;
 		}
 		else
 		{
-			/*
-			 * We found a recovery record without any prepared transaction. It
-			 * must have already been committed, so it's safe to delete the
-			 * recovery record.
-			 *
-			 * Transactions that started after we observed pendingTransactionSet,
-			 * but successfully committed their prepared transactions before
-			 * ActiveDistributedTransactionNumbers are indistinguishable from
-			 * transactions that committed at an earlier time, in which case it's
-			 * safe delete the recovery record as well.
-			 */
+			workerState->pendingTransactionSet = transactionSet;
 		}
+	}
+}
+
 
-		simple_heap_delete(pgDistTransaction, &heapTuple->t_self);
+/*
+ * WorkerRecoveryStateForGroup returns the WorkerRecoveryState of the worker
+ * in the given group, or NULL if there is none.
+ */
+static WorkerRecoveryState *
+WorkerRecoveryStateForGroup(List *workerStateList, int32 groupId)
+{
+	WorkerRecoveryState *workerState = NULL;
+	foreach_ptr(workerState, workerStateList)
+	{
+		if (workerState->workerNode->groupId == groupId)
+		{
+			return workerState;
+		}
 	}
 
-	systable_endscan(scanDescriptor);
-	heap_close(pgDistTransaction, NoLock);
+	return NULL;
+}
+
+
+/*
+ * PlanRecordRecovery decides what to do with a recovery record of the given
+ * worker and its prepared transaction, if any. Prepared transactions to
+ * commit are added to the recovery list of the worker, and records that can
+ * be deleted right away to its list of deletable records.
+ */
+static void
+PlanRecordRecovery(WorkerRecoveryState *workerState, HTAB *activeTransactionNumberSet,
+				   char *transactionName, ItemPointer recordTid)
+{
+	bool foundPreparedTransactionBeforeCommit = false;
+	bool foundPreparedTransactionAfterCommit = false;
 
-	if (!recoveryFailed)
+	bool isTransactionInProgress = IsTransactionInProgress(activeTransactionNumberSet,
+														   transactionName);
+	if (isTransactionInProgress)
 	{
-		char *pendingTransactionName = NULL;
-		bool abortSucceeded = true;
+		/*
+		 * Do not touch in progress transactions as we might mistakenly
+		 * commit a transaction that is actually in the process of
+		 * aborting or vice-versa.
+		 */
+		return;
+	}
 
+	/*
+	 * Remove the transaction from the pending list such that only transactions
+	 * that need to be aborted remain at the end.
+	 */
+	hash_search(workerState->pendingTransactionSet, transactionName, HASH_REMOVE,
+				&foundPreparedTransactionBeforeCommit);
+
+	hash_search(workerState->recheckTransactionSet, transactionName, HASH_FIND,
+				&foundPreparedTransactionAfterCommit);
+
+	if (foundPreparedTransactionBeforeCommit && foundPreparedTransactionAfterCommit)
+	{
+		/*
+		 * The transaction was committed, but the prepared transaction still exists
+		 * on the worker. Try committing it, and delete the recovery record once
+		 * that succeeded.
+		 *
+		 * We double check that the recovery record exists both before and after
+		 * checking ActiveDistributedTransactionNumbers(), since we may have
+		 * observed a prepared transaction that was committed immediately after.
+		 */
+		PreparedTransactionRecovery *recovery =
+			palloc0(sizeof(PreparedTransactionRecovery));
+		recovery->transactionName = transactionName;
+		recovery->shouldCommit = true;
+		recovery->hasRecoveryRecord = true;
+		ItemPointerCopy(recordTid, &recovery->recoveryRecordTid);
+
+		workerState->recoveryList = lappend(workerState->recoveryList, recovery);
+	}
+	else if (foundPreparedTransactionAfterCommit)
+	{
+		/*
+		 * We found a committed pg_dist_transaction record that initially did
+		 * not have a prepared transaction, but did when we checked again.
+		 *
+		 * If a transaction started and committed just after we observed the
+		 * set of prepared transactions, and just before we called
+		 * ActiveDistributedTransactionNumbers, then we would see a recovery
+		 * record without a prepared transaction in pendingTransactionSet,
+		 * but there may be prepared transactions that failed to commit.
+		 * We should not delete the records for those prepared transactions,
+		 * since we would otherwise roll back them on the next call to
+		 * recover_prepared_transactions.
+		 *
+		 * In addition, if the transaction started after the call to
+		 * ActiveDistributedTransactionNumbers and finished just before our
+		 * pg_dist_transaction snapshot, then it may still be in the process
+		 * of comitting the prepared transactions in the post-commit callback
+		 * and we should not touch the prepared transactions.
+		 *
+		 * To handle these cases, we just leave the records and prepared
+		 * transactions for the next call to recover_prepared_transactions
+		 * and skip them here.
+		 */
+	}
+	else
+	{
 		/*
-		 * All remaining prepared transactions that are not part of an in-progress
-		 * distributed transaction should be aborted since we did not find a recovery
-		 * record, which implies the disributed transaction aborted.
+		 * We found a recovery record without any prepared transaction. It
+		 * must have already been committed, so it's safe to delete the
+		 * recovery record.
+		 *
+		 * Transactions that started after we observed pendingTransactionSet,
+		 * but successfully committed their prepared transactions before
+		 * ActiveDistributedTransactionNumbers are indistinguishable from
+		 * transactions that committed at an earlier time, in which case it's
+		 * safe delete the recovery record as well.
 		 */
-		hash_seq_init(&status, pendingTransactionSet);
+		ItemPointer deletableTid = palloc0(sizeof(ItemPointerData));
+		ItemPointerCopy(recordTid, deletableTid);
 
-		while ((pendingTransactionName = hash_seq_search(&status)) != NULL)
+		workerState->deletableRecordList = lappend(workerState->deletableRecordList,
+												   deletableTid);
+	}
+}
+
+
+/*
+ * PlanAbortRecovery adds the prepared transactions of the given worker that
+ * are left in its pending set after all recovery records were planned to its
+ * recovery list to be aborted.
+ */
+static void
+PlanAbortRecovery(WorkerRecoveryState *workerState, HTAB *activeTransactionNumberSet)
+{
+	HASH_SEQ_STATUS status;
+	char *pendingTransactionName = NULL;
+
+	/*
+	 * All remaining prepared transactions that are not part of an in-progress
+	 * distributed transaction should be aborted since we did not find a recovery
+	 * record, which implies the disributed transaction aborted.
+	 */
+	hash_seq_init(&status, workerState->pendingTransactionSet);
+
+	while ((pendingTransactionName = hash_seq_search(&status)) != NULL)
+	{
+		bool isTransactionInProgress = IsTransactionInProgress(
+			activeTransactionNumberSet,
+			pendingTransactionName);
+		if (isTransactionInProgress)
 		{
-			bool isTransactionInProgress = IsTransactionInProgress(
-				activeTransactionNumberSet,
-				pendingTransactionName);
-			if (isTransactionInProgress)
+			continue;
+		}
+
+		PreparedTransactionRecovery *recovery =
+			palloc0(sizeof(PreparedTransactionRecovery));
+		recovery->transactionName = pendingTransactionName;
+		recovery->shouldCommit = false;
+		recovery->hasRecoveryRecord = false;
+
+		workerState->recoveryList = lappend(workerState->recoveryList, recovery);
+	}
+}
+
+
+/*
+ * ExecuteRecoveryInParallel commits or aborts the prepared transactions in
+ * the recovery lists of all workers, and returns the number of recovered
+ * transactions.
+ *
+ * COMMIT PREPARED and ROLLBACK PREPARED cannot run in a multi-statement
+ * command, so each round sends one command to every worker that has work
+ * left and waits for all of them. When a command fails on a worker, we stop
+ * recovering that worker without throwing an error, to continue with the
+ * other workers. Its remaining transactions are left for the next call.
+ */
+static int
+ExecuteRecoveryInParallel(List *workerStateList)
+{
+	int recoveredTransactionCount = 0;
+	bool raiseInterrupts = true;
+
+	while (true)
+	{
+		List *connectionList = NIL;
+		List *sentStateList = NIL;
+
+		/* send the next command to each worker in parallel */
+		WorkerRecoveryState *workerState = NULL;
+		foreach_ptr(workerState, workerStateList)
+		{
+			MultiConnection *connection = workerState->connection;
+
+			if (workerState->recoveryFailed || workerState->recoveryList == NIL)
+			{
+				continue;
+			}
+
+			PreparedTransactionRecovery *recovery =
+				(PreparedTransactionRecovery *) linitial(workerState->recoveryList);
+			char *command = PreparedTransactionRecoveryCommand(recovery);
+
+			int querySent = SendRemoteCommand(connection, command);
+			if (querySent == 0)
 			{
+				ReportConnectionError(connection, WARNING);
+				workerState->recoveryFailed = true;
 				continue;
 			}
 
-			bool shouldCommit = false;
-			abortSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																pendingTransactionName,
-																shouldCommit);
-			if (!abortSucceeded)
+			connectionList = lappend(connectionList, connection);
+			sentStateList = lappend(sentStateList, workerState);
+		}
+
+		if (sentStateList == NIL)
+		{
+			break;
+		}
+
+		WaitForAllConnections(connectionList, raiseInterrupts);
+
+		/* receive the results */
+		foreach_ptr(workerState, sentStateList)
+		{
+			MultiConnection *connection = workerState->connection;
+			PreparedTransactionRecovery *recovery =
+				(PreparedTransactionRecovery *) linitial(workerState->recoveryList);
+
+			workerState->recoveryList = list_delete_first(workerState->recoveryList);
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
 			{
-				hash_seq_term(&status);
-				break;
+				ReportResultError(connection, result, WARNING);
+				PQclear(result);
+				ForgetResults(connection);
+
+				workerState->recoveryFailed = true;
+				continue;
 			}
 
+			PQclear(result);
+			ForgetResults(connection);
+
+			ereport(LOG, (errmsg("recovered a prepared transaction on %s:%d",
+								 connection->hostname, connection->port),
+						  errcontext("%s", PreparedTransactionRecoveryCommand(
+										 recovery))));
+
 			recoveredTransactionCount++;
+
+			if (recovery->hasRecoveryRecord)
+			{
+				/*
+				 * We successfully committed the prepared transaction, safe to
+				 * delete the recovery record.
+				 */
+				ItemPointer deletableTid = palloc0(sizeof(ItemPointerData));
+				ItemPointerCopy(&recovery->recoveryRecordTid, deletableTid);
+
+				workerState->deletableRecordList =
+					lappend(workerState->deletableRecordList, deletableTid);
+			}
 		}
 	}
 
-	MemoryContextSwitchTo(oldContext);
-	MemoryContextDelete(localContext);
-
 	return recoveredTransactionCount;
 }
 
 
 /*
- * PendingWorkerTransactionList returns a list of pending prepared
- * transactions on a remote node that were started by this node.
+ * PreparedTransactionRecoveryCommand returns the COMMIT PREPARED or ROLLBACK
+ * PREPARED command that recovers the given prepared transaction.
  */
-static List *
-PendingWorkerTransactionList(MultiConnection *connection)
+static char *
+PreparedTransactionRecoveryCommand(PreparedTransactionRecovery *recovery)
 {
 	StringInfo command = makeStringInfo();
-	bool raiseInterrupts = true;
-	List *transactionNames = NIL;
-	int32 coordinatorId = GetLocalGroupId();
-
-	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
-							  "WHERE gid LIKE 'citus\\_%d\\_%%'",
-					 coordinatorId);
-
-	int querySent = SendRemoteCommand(connection, command->data);
-	if (querySent == 0)
-	{
-		ReportConnectionError(connection, ERROR);
-	}
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-	if (!IsResponseOK(result))
+	if (recovery->shouldCommit)
 	{
-		ReportResultError(connection, result, ERROR);
+		/* should have committed this prepared transaction */
+		appendStringInfo(command, "COMMIT PREPARED %s",
+						 quote_literal_cstr(recovery->transactionName));
 	}
-
-	int rowCount = PQntuples(result);
-
-	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	else
 	{
-		const int columnIndex = 0;
-		char *transactionName = PQgetvalue(result, rowIndex, columnIndex);
-
-		transactionNames = lappend(transactionNames, pstrdup(transactionName));
+		/* should have aborted this prepared transaction */
+		appendStringInfo(command, "ROLLBACK PREPARED %s",
+						 quote_literal_cstr(recovery->transactionName));
 	}
 
-	PQclear(result);
-	ForgetResults(connection);
-
-	return transactionNames;
+	return command->data;
 }
 
 
@@ -461,49 +773,3 @@ IsTransactionInProgress(HTAB *activeTransactionNumberSet, char *preparedTransact
 
 	return isTransactionInProgress;
 }
-
-
-/*
- * RecoverPreparedTransactionOnWorker recovers a single prepared transaction over
- * the given connection. If shouldCommit is true we send
- */
-static bool
-RecoverPreparedTransactionOnWorker(MultiConnection *connection, char *transactionName,
-								   bool shouldCommit)
-{
-	StringInfo command = makeStringInfo();
-	PGresult *result = NULL;
-	bool raiseInterrupts = false;
-
-	if (shouldCommit)
-	{
-		/* should have committed this prepared transaction */
-		appendStringInfo(command, "COMMIT PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-	else
-	{
-		/* should have aborted this prepared transaction */
-		appendStringInfo(command, "ROLLBACK PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-
-	int executeCommand = ExecuteOptionalRemoteCommand(connection, command->data, &result);
-	if (executeCommand == QUERY_SEND_FAILED)
-	{
-		return false;
-	}
-	if (executeCommand == RESPONSE_NOT_OKAY)
-	{
-		return false;
-	}
-
-	PQclear(result);
-	ClearResults(connection, raiseInterrupts);
-
-	ereport(LOG, (errmsg("recovered a prepared transaction on %s:%d",
-						 connection->hostname, connection->port),
-				  errcontext("%s", command->data)));
-
-	return true;
-}
@@ -19,12 +19,14 @@
 #include <unistd.h>
 
 #include "access/xact.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/resource_lock.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/pg_dist_transaction.h"
 #include "distributed/transaction_recovery.h"
@@ -33,6 +35,10 @@
 #include "utils/memutils.h"
 
 
+/* GUC, time in milliseconds to wait for each node in cluster-wide monitoring */
+int RemoteMonitoringTimeout = 0;
+
+
 static void SendCommandToMetadataWorkersParams(const char *command,
 											   const char *user, int parameterCount,
 											   const Oid *parameterTypes,
@@ -47,6 +53,13 @@ static void SendCommandListToAllWorkersInternal(List *commandList, bool failOnEr
 												const char *superuser);
 static List * OpenConnectionsToWorkersInParallel(TargetWorkerSet targetWorkerSet,
 												 const char *user);
+static List * OpenNewConnectionsToWorkerList(List *workerNodeList, const char *user);
+static int SendBareCommandListToWorkerList(List *workerNodeList, const char *user,
+										   List *commandList, bool failOnError);
+static void SendCommandListToWorkerListInTransactions(List *workerNodeList,
+													  const char *user,
+													  List *commandList,
+													  bool failOnError);
 static void GetConnectionsResults(List *connectionList, bool failOnError);
 static void SendCommandToWorkersOutsideTransaction(TargetWorkerSet targetWorkerSet,
 												   const char *command, const char *user,
@@ -158,24 +171,8 @@ SendCommandListToAllWorkersInternal(List *commandList, bool failOnError, const
 {
 	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
 
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		if (failOnError)
-		{
-			SendCommandListToWorkerInSingleTransaction(workerNode->workerName,
-													   workerNode->workerPort,
-													   superuser,
-													   commandList);
-		}
-		else
-		{
-			SendOptionalCommandListToWorkerInTransaction(workerNode->workerName,
-														 workerNode->workerPort,
-														 superuser,
-														 commandList);
-		}
-	}
+	SendCommandListToWorkerListInTransactions(workerNodeList, superuser, commandList,
+											  failOnError);
 }
 
 
@@ -224,7 +221,7 @@ TargetWorkerSetNodeList(TargetWorkerSet targetWorkerSet, LOCKMODE lockMode)
 
 /*
  * SendBareCommandListToMetadataWorkers sends a list of commands to metadata
- * workers in serial. Commands are committed immediately: new connections are
+ * workers in parallel. Commands are committed immediately: new connections are
  * always used and no transaction block is used (hence "bare"). The connections
  * are made as the extension owner to ensure write access to the Citus metadata
  * tables. Primarly useful for INDEX commands using CONCURRENTLY.
@@ -235,10 +232,43 @@ SendBareCommandListToMetadataWorkers(List *commandList)
 	TargetWorkerSet targetWorkerSet = WORKERS_WITH_METADATA;
 	List *workerNodeList = TargetWorkerSetNodeList(targetWorkerSet, ShareLock);
 	char *nodeUser = CitusExtensionOwnerName();
+	bool failOnError = true;
 
 	ErrorIfAnyMetadataNodeOutOfSync(workerNodeList);
 
-	/* run commands serially */
+	SendBareCommandListToWorkerList(workerNodeList, nodeUser, commandList, failOnError);
+}
+
+
+/*
+ * SendBareOptionalCommandListToAllWorkersAsUser sends a list of commands
+ * to all workers in parallel. Commands are committed immediately: new
+ * connections are always used and no transaction block is used (hence "bare").
+ * The highest error code is returned if any of the commands fails, in which
+ * case the remaining commands are not sent to that worker.
+ */
+int
+SendBareOptionalCommandListToAllWorkersAsUser(List *commandList, const char *user)
+{
+	TargetWorkerSet targetWorkerSet = ALL_WORKERS;
+	List *workerNodeList = TargetWorkerSetNodeList(targetWorkerSet, ShareLock);
+	bool failOnError = false;
+
+	return SendBareCommandListToWorkerList(workerNodeList, user, commandList,
+										   failOnError);
+}
+
+
+/*
+ * OpenNewConnectionsToWorkerList opens new connections to all nodes in the
+ * given worker list as the given user, and waits for them to be established
+ * in parallel.
+ */
+static List *
+OpenNewConnectionsToWorkerList(List *workerNodeList, const char *user)
+{
+	List *connectionList = NIL;
+
 	WorkerNode *workerNode = NULL;
 	foreach_ptr(workerNode, workerNodeList)
 	{
@@ -246,65 +276,205 @@ SendBareCommandListToMetadataWorkers(List *commandList)
 		int nodePort = workerNode->workerPort;
 		int connectionFlags = FORCE_NEW_CONNECTION;
 
-		MultiConnection *workerConnection = GetNodeUserDatabaseConnection(connectionFlags,
-																		  nodeName,
-																		  nodePort,
-																		  nodeUser, NULL);
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  user, NULL);
+
+		/*
+		 * connection can only be NULL for optional connections, which we don't
+		 * support in this codepath.
+		 */
+		Assert(connection != NULL);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	return connectionList;
+}
 
-		/* iterate over the commands and execute them in the same connection */
-		const char *commandString = NULL;
-		foreach_ptr(commandString, commandList)
+
+/*
+ * SendBareCommandListToWorkerList sends the given commands to all given workers
+ * outside of a transaction block, over new connections that are closed
+ * afterwards.
+ *
+ * The workers execute the commands in parallel, but each worker executes them
+ * one at a time and in order, since bare commands such as CREATE INDEX
+ * CONCURRENTLY cannot be combined into a multi-statement query. If failOnError
+ * is true, any failure is raised as an error. Otherwise, failures are reported
+ * as warnings, the remaining commands are skipped on the failed worker and the
+ * highest error code is returned.
+ */
+static int
+SendBareCommandListToWorkerList(List *workerNodeList, const char *user,
+								List *commandList, bool failOnError)
+{
+	List *connectionList = OpenNewConnectionsToWorkerList(workerNodeList, user);
+	List *activeConnectionList = list_copy(connectionList);
+	int elevel = failOnError ? ERROR : WARNING;
+	int maxError = RESPONSE_OKAY;
+	MultiConnection *connection = NULL;
+
+	const char *commandString = NULL;
+	foreach_ptr(commandString, commandList)
+	{
+		List *sentConnectionList = NIL;
+
+		/* send the command to all workers on which no command failed yet */
+		foreach_ptr(connection, activeConnectionList)
+		{
+			int querySent = SendRemoteCommand(connection, commandString);
+			if (querySent == 0)
+			{
+				ReportConnectionError(connection, elevel);
+				maxError = Max(maxError, QUERY_SEND_FAILED);
+				continue;
+			}
+
+			sentConnectionList = lappend(sentConnectionList, connection);
+		}
+
+		/* wait for the command to finish on all of them */
+		activeConnectionList = NIL;
+		foreach_ptr(connection, sentConnectionList)
 		{
-			ExecuteCriticalRemoteCommand(workerConnection, commandString);
+			bool raiseInterrupts = true;
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+
+			bool isResponseOK = IsResponseOK(result);
+			if (!isResponseOK)
+			{
+				ReportResultError(connection, result, elevel);
+				maxError = Max(maxError, RESPONSE_NOT_OKAY);
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+
+			if (isResponseOK)
+			{
+				activeConnectionList = lappend(activeConnectionList, connection);
+			}
 		}
+	}
 
-		CloseConnection(workerConnection);
+	foreach_ptr(connection, connectionList)
+	{
+		CloseConnection(connection);
 	}
+
+	return maxError;
 }
 
 
 /*
- * SendBareOptionalCommandListToAllWorkersAsUser sends a list of commands
- * to all workers in serial. Commands are committed immediately: new
- * connections are always used and no transaction block is used (hence "bare").
+ * SendCommandListToWorkerListInTransactions sends the given commands to all
+ * given workers, each in a separate transaction over a new connection that is
+ * closed afterwards.
+ *
+ * The transactions run in parallel, and the command list is sent to each
+ * worker as a single multi-statement query after BEGIN, such that each worker
+ * only costs a few round trips regardless of the number of commands. The
+ * transactions are committed once all workers finished executing the
+ * commands. If failOnError is true, any failure is raised as an error.
+ * Otherwise, the transactions of the workers on which a command failed are
+ * rolled back with a warning, and the others are committed.
  */
-int
-SendBareOptionalCommandListToAllWorkersAsUser(List *commandList, const char *user)
+static void
+SendCommandListToWorkerListInTransactions(List *workerNodeList, const char *user,
+										  List *commandList, bool failOnError)
 {
-	TargetWorkerSet targetWorkerSet = ALL_WORKERS;
-	List *workerNodeList = TargetWorkerSetNodeList(targetWorkerSet, ShareLock);
-	int maxError = RESPONSE_OKAY;
+	List *sentConnectionList = NIL;
+	bool raiseInterrupts = true;
 
-	/* run commands serially */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
+	if (commandList == NIL)
 	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = FORCE_NEW_CONNECTION;
+		return;
+	}
 
-		MultiConnection *workerConnection = GetNodeUserDatabaseConnection(connectionFlags,
-																		  nodeName,
-																		  nodePort, user,
-																		  NULL);
+	List *connectionList = OpenNewConnectionsToWorkerList(workerNodeList, user);
 
-		/* iterate over the commands and execute them in the same connection */
-		const char *commandString = NULL;
-		foreach_ptr(commandString, commandList)
+	StringInfo commandBatch = makeStringInfo();
+	const char *commandString = NULL;
+	foreach_ptr(commandString, commandList)
+	{
+		if (commandBatch->len > 0)
 		{
-			int result = ExecuteOptionalRemoteCommand(workerConnection, commandString,
-													  NULL);
-			if (result != RESPONSE_OKAY)
+			appendStringInfoChar(commandBatch, ';');
+		}
+
+		appendStringInfoString(commandBatch, commandString);
+	}
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		if (failOnError)
+		{
+			MarkRemoteTransactionCritical(connection);
+		}
+	}
+
+	RemoteTransactionListBegin(connectionList);
+
+	/* send all commands at once to each worker on which BEGIN succeeded */
+	foreach_ptr(connection, connectionList)
+	{
+		if (connection->remoteTransaction.transactionFailed)
+		{
+			continue;
+		}
+
+		int querySent = SendRemoteCommand(connection, commandBatch->data);
+		if (querySent == 0)
+		{
+			HandleRemoteTransactionConnectionError(connection, failOnError);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+	}
+
+	/* a command may consist of multiple statements, so check all results */
+	foreach_ptr(connection, sentConnectionList)
+	{
+		bool failed = false;
+
+		while (true)
+		{
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (result == NULL)
 			{
-				maxError = Max(maxError, result);
 				break;
 			}
+
+			/* only report the first failure, later statements are skipped anyway */
+			if (!failed && !IsResponseOK(result))
+			{
+				HandleRemoteTransactionResultError(connection, result, failOnError);
+				failed = true;
+			}
+
+			PQclear(result);
 		}
+	}
 
-		CloseConnection(workerConnection);
+	/* commit in parallel, failed transactions are rolled back instead */
+	foreach_ptr(connection, connectionList)
+	{
+		StartRemoteTransactionCommit(connection);
 	}
 
-	return maxError;
+	foreach_ptr(connection, connectionList)
+	{
+		FinishRemoteTransactionCommit(connection);
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		CloseConnection(connection);
+	}
 }
 
 
@@ -328,6 +498,106 @@ SendCommandToMetadataWorkersParams(const char *command,
 }
 
 
+/*
+ * ExecuteQueryOnRemoteNodes runs the given query as the given user on all
+ * nodes in workerNodeList other than the local node, in parallel, and returns
+ * a list of RemoteQueryResults for the nodes that answered successfully.
+ * Failures are reported as warnings. A NULL user means the current user.
+ *
+ * Connections come from the connection cache, so repeated calls reuse them.
+ * Nodes that do not answer within timeout milliseconds are skipped and their
+ * connection is shut down, since it cannot be reused while the query is still
+ * running. A timeout of 0 waits for all nodes.
+ *
+ * The caller is responsible for clearing the results.
+ */
+List *
+ExecuteQueryOnRemoteNodes(List *workerNodeList, const char *user, const char *query,
+						  long timeout)
+{
+	List *connectionList = NIL;
+	List *sentConnectionList = NIL;
+	List *remoteResultList = NIL;
+	int32 localGroupId = GetLocalGroupId();
+	bool raiseInterrupts = true;
+
+	/* open connections in parallel */
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		const char *nodeName = workerNode->workerName;
+		int nodePort = workerNode->workerPort;
+		int connectionFlags = 0;
+
+		if (workerNode->groupId == localGroupId)
+		{
+			/* callers get the local results without a connection */
+			continue;
+		}
+
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  user, NULL);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* send commands in parallel */
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		int querySent = SendRemoteCommand(connection, query);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+	}
+
+	WaitForAllConnectionsWithTimeout(sentConnectionList, raiseInterrupts,
+									 timeout > 0 ? timeout : -1,
+									 WAIT_EVENT_CITUS_REMOTE_COMMAND);
+
+	/* receive query results */
+	foreach_ptr(connection, sentConnectionList)
+	{
+		if (PQstatus(connection->pgConn) == CONNECTION_OK &&
+			PQisBusy(connection->pgConn))
+		{
+			ereport(WARNING, (errmsg("timed out waiting for a response from "
+									 "node %s:%d", connection->hostname,
+									 connection->port)));
+
+			ShutdownConnection(connection);
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, WARNING);
+			PQclear(result);
+			ForgetResults(connection);
+			continue;
+		}
+
+		ForgetResults(connection);
+
+		RemoteQueryResult *remoteResult = palloc0(sizeof(RemoteQueryResult));
+		remoteResult->connection = connection;
+		remoteResult->result = result;
+
+		remoteResultList = lappend(remoteResultList, remoteResult);
+	}
+
+	return remoteResultList;
+}
+
+
 /*
  * SendCommandToWorkersOptionalInParallel sends the given command to workers in parallel.
  * It does error if there is a problem while sending the query, but it doesn't error
@@ -562,11 +832,14 @@ SendCommandListToWorkerInSingleTransaction(const char *nodeName, int32 nodePort,
 	MarkRemoteTransactionCritical(workerConnection);
 	RemoteTransactionBegin(workerConnection);
 
-	/* iterate over the commands and execute them in the same connection */
+	/*
+	 * Iterate over the commands and execute them in the same connection. A
+	 * command may consist of multiple statements, so check all their results.
+	 */
 	const char *commandString = NULL;
 	foreach_ptr(commandString, commandList)
 	{
-		ExecuteCriticalRemoteCommand(workerConnection, commandString);
+		ExecuteRemoteCommandBatch(workerConnection, commandString, ERROR);
 	}
 
 	RemoteTransactionCommit(workerConnection);
@@ -574,6 +847,29 @@ SendCommandListToWorkerInSingleTransaction(const char *nodeName, int32 nodePort,
 }
 
 
+/*
+ * SendCommandListToWorkerInSingleBatch is like
+ * SendCommandListToWorkerInSingleTransaction, but sends the commands as a
+ * single multi-statement query, such that a long list of commands takes one
+ * round trip rather than one round trip per command.
+ */
+void
+SendCommandListToWorkerInSingleBatch(const char *nodeName, int32 nodePort,
+									 const char *nodeUser, List *commandList)
+{
+	StringInfo commandBatch = makeStringInfo();
+
+	const char *commandString = NULL;
+	foreach_ptr(commandString, commandList)
+	{
+		appendStringInfo(commandBatch, "%s;\n", commandString);
+	}
+
+	SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, nodeUser,
+											   list_make1(commandBatch->data));
+}
+
+
 /*
  * ErrorIfAnyMetadataNodeOutOfSync raises an error if any of the given
  * metadata nodes are out of sync. It is safer to avoid metadata changing
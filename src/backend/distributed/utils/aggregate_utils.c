@@ -8,6 +8,10 @@
  * calling finalfunc on workers, instead passing state to coordinator where
  * it uses combinefunc in coord_combine_agg & applying finalfunc only at end.
  *
+ * worker_combine_partial_agg reuses coord_combine_agg_sfunc & worker_partial_agg_ffunc
+ * to combine the partial states of the shards of a node into a single state before
+ * passing it to the coordinator.
+ *
  * Copyright Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -51,6 +55,25 @@ typedef struct StypeBox
 	bool valueInit;
 } StypeBox;
 
+/*
+ * AggregateCallCache holds the catalog lookups that the support aggregates
+ * need on every row. It is kept in fn_extra of the support function, such
+ * that the catalogs are consulted once per aggregate in the query rather than
+ * once per row, which dominates the cost of combining many partial states on
+ * the coordinator.
+ */
+typedef struct AggregateCallCache
+{
+	Oid agg;
+
+	/* transfn of the aggregate for workers, combinefn for the coordinator */
+	FmgrInfo transitionFunction;
+
+	/* input function of the transition type, only used on the coordinator */
+	FmgrInfo inputFunction;
+	Oid inputIOParam;
+} AggregateCallCache;
+
 static HeapTuple GetAggregateForm(Oid oid, Form_pg_aggregate *form);
 static HeapTuple GetProcForm(Oid oid, Form_pg_proc *form);
 static HeapTuple GetTypeForm(Oid oid, Form_pg_type *form);
@@ -63,6 +86,8 @@ static StypeBox * TryCreateStypeBoxFromFcinfoAggref(FunctionCallInfo fcinfo);
 static void HandleTransition(StypeBox *box, FunctionCallInfo fcinfo,
 							 FunctionCallInfo innerFcinfo);
 static void HandleStrictUninit(StypeBox *box, FunctionCallInfo fcinfo, Datum value);
+static AggregateCallCache * GetAggregateCallCache(FunctionCallInfo fcinfo, Oid agg,
+												  bool combine);
 static bool TypecheckWorkerPartialAggArgType(FunctionCallInfo fcinfo, StypeBox *box);
 static bool TypecheckCoordCombineAggReturnType(FunctionCallInfo fcinfo, Oid ffunc,
 											   StypeBox *box);
@@ -327,6 +352,72 @@ HandleStrictUninit(StypeBox *box, FunctionCallInfo fcinfo, Datum value)
 }
 
 
+/*
+ * GetAggregateCallCache returns the cached lookups for the given aggregate,
+ * performing them if this is the first call for the aggregate. When combine
+ * is true the combine function and the input function of the transition type
+ * are looked up, otherwise the transition function.
+ */
+static AggregateCallCache *
+GetAggregateCallCache(FunctionCallInfo fcinfo, Oid agg, bool combine)
+{
+	AggregateCallCache *cache = (AggregateCallCache *) fcinfo->flinfo->fn_extra;
+	MemoryContext cacheContext = fcinfo->flinfo->fn_mcxt;
+	Form_pg_aggregate aggform;
+
+	if (cache != NULL && cache->agg == agg)
+	{
+		return cache;
+	}
+
+	if (cache == NULL)
+	{
+		cache = MemoryContextAllocZero(cacheContext, sizeof(AggregateCallCache));
+		fcinfo->flinfo->fn_extra = cache;
+	}
+
+	HeapTuple aggtuple = GetAggregateForm(agg, &aggform);
+
+	if (combine)
+	{
+		if (aggform->aggcombinefn == InvalidOid)
+		{
+			ereport(ERROR, (errmsg(
+								"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
+		}
+
+		if (aggform->aggtranstype == INTERNALOID)
+		{
+			ereport(ERROR,
+					(errmsg(
+						 "coord_combine_agg_sfunc does not support aggregates with INTERNAL transition state")));
+		}
+	}
+
+	Oid transitionFunctionId = combine ? aggform->aggcombinefn : aggform->aggtransfn;
+	Oid transtype = aggform->aggtranstype;
+	ReleaseSysCache(aggtuple);
+
+	fmgr_info_cxt(transitionFunctionId, &cache->transitionFunction, cacheContext);
+
+	if (combine)
+	{
+		Form_pg_type transtypeform;
+		HeapTuple transtypetuple = GetTypeForm(transtype, &transtypeform);
+		cache->inputIOParam = getTypeIOParam(transtypetuple);
+		Oid inputFunctionId = transtypeform->typinput;
+		ReleaseSysCache(transtypetuple);
+
+		fmgr_info_cxt(inputFunctionId, &cache->inputFunction, cacheContext);
+	}
+
+	/* only mark the cache valid once all lookups succeeded */
+	cache->agg = agg;
+
+	return cache;
+}
+
+
 /*
  * worker_partial_agg_sfunc advances transition state,
  * essentially implementing the following pseudocode:
@@ -340,14 +431,14 @@ Datum
 worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 {
 	StypeBox *box = NULL;
-	Form_pg_aggregate aggform;
 	LOCAL_FCINFO(innerFcinfo, FUNC_MAX_ARGS);
-	FmgrInfo info;
 	int argumentIndex = 0;
 	bool initialCall = PG_ARGISNULL(0);
 
 	if (initialCall)
 	{
+		Form_pg_aggregate aggform;
+
 		box = pallocInAggContext(fcinfo, sizeof(StypeBox));
 		box->agg = PG_GETARG_OID(1);
 
@@ -356,6 +447,14 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 			ereport(ERROR, (errmsg(
 								"worker_partial_agg_sfunc could not confirm type correctness")));
 		}
+
+		HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
+		InitializeStypeBox(fcinfo, box, aggtuple, aggform->aggtranstype);
+		ReleaseSysCache(aggtuple);
+
+		get_typlenbyval(box->transtype,
+						&box->transtypeLen,
+						&box->transtypeByVal);
 	}
 	else
 	{
@@ -363,22 +462,11 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 		Assert(box->agg == PG_GETARG_OID(1));
 	}
 
-	HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
-	Oid aggsfunc = aggform->aggtransfn;
-	if (initialCall)
-	{
-		InitializeStypeBox(fcinfo, box, aggtuple, aggform->aggtranstype);
-	}
-	ReleaseSysCache(aggtuple);
-	if (initialCall)
-	{
-		get_typlenbyval(box->transtype,
-						&box->transtypeLen,
-						&box->transtypeByVal);
-	}
+	bool combine = false;
+	AggregateCallCache *cache = GetAggregateCallCache(fcinfo, box->agg, combine);
+	FmgrInfo *info = &cache->transitionFunction;
 
-	fmgr_info(aggsfunc, &info);
-	if (info.fn_strict)
+	if (info->fn_strict)
 	{
 		for (argumentIndex = 2; argumentIndex < PG_NARGS(); argumentIndex++)
 		{
@@ -400,7 +488,7 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 		}
 	}
 
-	InitFunctionCallInfoData(*innerFcinfo, &info, fcinfo->nargs - 1, fcinfo->fncollation,
+	InitFunctionCallInfoData(*innerFcinfo, info, fcinfo->nargs - 1, fcinfo->fncollation,
 							 fcinfo->context, fcinfo->resultinfo);
 	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
 	for (argumentIndex = 1; argumentIndex < innerFcinfo->nargs; argumentIndex++)
@@ -492,80 +580,58 @@ Datum
 coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 {
 	LOCAL_FCINFO(innerFcinfo, 3);
-	FmgrInfo info;
-	Form_pg_aggregate aggform;
-	Form_pg_type transtypeform;
 	Datum value;
 	StypeBox *box = NULL;
+	Oid agg = PG_ARGISNULL(0) ? PG_GETARG_OID(1) :
+			  ((StypeBox *) PG_GETARG_POINTER(0))->agg;
 
-	if (PG_ARGISNULL(0))
-	{
-		box = pallocInAggContext(fcinfo, sizeof(StypeBox));
-		box->agg = PG_GETARG_OID(1);
-	}
-	else
-	{
-		box = (StypeBox *) PG_GETARG_POINTER(0);
-		Assert(box->agg == PG_GETARG_OID(1));
-	}
+	/* also checks whether the aggregate can be combined */
+	bool combine = true;
+	AggregateCallCache *cache = GetAggregateCallCache(fcinfo, agg, combine);
 
-	HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
-
-	if (aggform->aggcombinefn == InvalidOid)
-	{
-		ereport(ERROR, (errmsg(
-							"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
-	}
-
-	if (aggform->aggtranstype == INTERNALOID)
+	if (PG_ARGISNULL(0))
 	{
-		ereport(ERROR,
-				(errmsg(
-					 "coord_combine_agg_sfunc does not support aggregates with INTERNAL transition state")));
-	}
+		Form_pg_aggregate aggform;
 
-	Oid combine = aggform->aggcombinefn;
+		box = pallocInAggContext(fcinfo, sizeof(StypeBox));
+		box->agg = agg;
 
-	if (PG_ARGISNULL(0))
-	{
+		HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
 		InitializeStypeBox(fcinfo, box, aggtuple, aggform->aggtranstype);
-	}
+		ReleaseSysCache(aggtuple);
 
-	ReleaseSysCache(aggtuple);
-
-	if (PG_ARGISNULL(0))
-	{
 		get_typlenbyval(box->transtype,
 						&box->transtypeLen,
 						&box->transtypeByVal);
 	}
+	else
+	{
+		box = (StypeBox *) PG_GETARG_POINTER(0);
+		Assert(box->agg == PG_GETARG_OID(1));
+	}
 
 	bool valueNull = PG_ARGISNULL(2);
-	HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
-	Oid ioparam = getTypeIOParam(transtypetuple);
-	Oid deserial = transtypeform->typinput;
-	ReleaseSysCache(transtypetuple);
+	FmgrInfo *info = &cache->inputFunction;
 
-	fmgr_info(deserial, &info);
-	if (valueNull && info.fn_strict)
+	if (valueNull && info->fn_strict)
 	{
 		value = (Datum) 0;
 	}
 	else
 	{
-		InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
+		InitFunctionCallInfoData(*innerFcinfo, info, 3, fcinfo->fncollation,
 								 fcinfo->context, fcinfo->resultinfo);
 		fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
-		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
+		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(cache->inputIOParam));
 		fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
 
 		value = FunctionCallInvoke(innerFcinfo);
 		valueNull = innerFcinfo->isnull;
 	}
 
-	fmgr_info(combine, &info);
+	info = &cache->transitionFunction;
 
-	if (info.fn_strict)
+	if (info->fn_strict)
 	{
 		if (valueNull)
 		{
@@ -584,7 +650,7 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 		}
 	}
 
-	InitFunctionCallInfoData(*innerFcinfo, &info, 2, fcinfo->fncollation,
+	InitFunctionCallInfoData(*innerFcinfo, info, 2, fcinfo->fncollation,
 							 fcinfo->context, fcinfo->resultinfo);
 	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
 	fcSetArgExt(innerFcinfo, 1, value, valueNull);
@@ -0,0 +1,863 @@
+/*-------------------------------------------------------------------------
+ *
+ * approximate_aggregates.c
+ *
+ * Implementation of mergeable sketches for approximate aggregates, which
+ * allow workers to send a compact summary of their rows to the coordinator
+ * instead of the rows themselves:
+ *
+ * - a HyperLogLog sketch to approximate count(distinct), which is built by
+ *   citus_hll_add_agg, merged by citus_hll_union_agg and estimated by
+ *   citus_hll_cardinality.
+ * - a t-digest to approximate percentiles, which is built by
+ *   citus_tdigest_add_agg, merged by citus_tdigest_union_agg and queried by
+ *   citus_tdigest_percentile.
+ *
+ * Sketches are stored as bytea, such that no additional types are needed and
+ * the aggregates can be distributed using worker_partial_agg and
+ * coord_combine_agg. When called as aggregates, the transition functions
+ * modify the sketch in place.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <math.h>
+
+#include "catalog/pg_collation.h"
+#include "distributed/citus_safe_lib.h"
+#include "fmgr.h"
+#include "utils/builtins.h"
+#include "utils/typcache.h"
+
+
+/* precision (log2 of the number of registers) of HyperLogLog sketches */
+#define HLL_MIN_PRECISION 4
+#define HLL_MAX_PRECISION 18
+#define HLL_DEFAULT_PRECISION 12
+
+/* compression (roughly the number of centroids) of t-digests */
+#define TDIGEST_MIN_COMPRESSION 10
+#define TDIGEST_MAX_COMPRESSION 10000
+#define TDIGEST_DEFAULT_COMPRESSION 100
+
+/* a t-digest buffers this many centroids per unit of compression */
+#define TDIGEST_BUFFER_FACTOR 5
+#define TDIGEST_INITIAL_CAPACITY 32
+
+
+/*
+ * HllSketch is a HyperLogLog sketch with a register per 2^precision hash
+ * values, each of which holds the maximum position of the leftmost 1-bit of
+ * the remaining bits of the hashes that map to it.
+ */
+typedef struct HllSketch
+{
+	int32 vl_len_;
+	int32 precision;
+	uint8 registers[FLEXIBLE_ARRAY_MEMBER];
+} HllSketch;
+
+#define HLL_SKETCH_SIZE(precision) \
+	(offsetof(HllSketch, registers) + ((Size) 1 << (precision)))
+
+
+/* Centroid summarizes the values close to its mean */
+typedef struct Centroid
+{
+	double mean;
+	double weight;
+} Centroid;
+
+
+/*
+ * TDigest is a t-digest, which summarizes a distribution using centroids
+ * that are small near the tails of the distribution and large in the middle.
+ * Centroids are added unsorted until the capacity is reached, after which
+ * they are merged such that their number stays proportional to compression.
+ */
+typedef struct TDigest
+{
+	int32 vl_len_;
+	int32 compression;
+	int32 centroidCount;
+	int32 capacity;
+	double totalWeight;
+	double min;
+	double max;
+	Centroid centroids[FLEXIBLE_ARRAY_MEMBER];
+} TDigest;
+
+#define TDIGEST_SIZE(capacity) \
+	(offsetof(TDigest, centroids) + (Size) (capacity) * sizeof(Centroid))
+
+
+/* cache of the hash function of the input type of citus_hll_add_trans */
+typedef struct HllHashFunctionCache
+{
+	Oid typeId;
+	FmgrInfo hashFunction;
+} HllHashFunctionCache;
+
+
+static HllSketch * CreateHllSketch(int precision);
+static HllSketch * GetHllSketchArgument(FunctionCallInfo fcinfo, int argumentIndex);
+static HllSketch * CopyHllSketch(HllSketch *sketch);
+static void HllSketchAddHash(HllSketch *sketch, uint64 hash);
+static void HllSketchUnion(HllSketch *sketch, HllSketch *otherSketch);
+static uint64 HashHllValue(FunctionCallInfo fcinfo, Datum value);
+static TDigest * CreateTDigest(int compression, int capacity);
+static TDigest * GetTDigestArgument(FunctionCallInfo fcinfo, int argumentIndex);
+static TDigest * CopyTDigest(TDigest *digest, int capacity);
+static TDigest * TDigestAddCentroid(TDigest *digest, double mean, double weight);
+static void TDigestCompress(TDigest *digest);
+static double TDigestScale(double quantile, int compression);
+static int CompareCentroids(const void *leftElement, const void *rightElement);
+static double TDigestPercentile(TDigest *digest, double percentile);
+static bool ModifyStateInPlace(FunctionCallInfo fcinfo);
+
+
+PG_FUNCTION_INFO_V1(citus_hll_add_trans);
+PG_FUNCTION_INFO_V1(citus_hll_union_trans);
+PG_FUNCTION_INFO_V1(citus_hll_cardinality);
+PG_FUNCTION_INFO_V1(citus_tdigest_add_trans);
+PG_FUNCTION_INFO_V1(citus_tdigest_union_trans);
+PG_FUNCTION_INFO_V1(citus_tdigest_percentile);
+
+
+/*
+ * citus_hll_add_trans is the transition function of citus_hll_add_agg and
+ * approx_count_distinct, which adds the hash of the given value to the
+ * sketch. The optional third argument sets the precision of a new sketch.
+ */
+Datum
+citus_hll_add_trans(PG_FUNCTION_ARGS)
+{
+	HllSketch *sketch = NULL;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		int precision = HLL_DEFAULT_PRECISION;
+
+		if (PG_NARGS() > 2 && !PG_ARGISNULL(2))
+		{
+			precision = PG_GETARG_INT32(2);
+		}
+
+		sketch = CreateHllSketch(precision);
+	}
+	else
+	{
+		sketch = GetHllSketchArgument(fcinfo, 0);
+
+		if (!ModifyStateInPlace(fcinfo))
+		{
+			sketch = CopyHllSketch(sketch);
+		}
+	}
+
+	HllSketchAddHash(sketch, HashHllValue(fcinfo, PG_GETARG_DATUM(1)));
+
+	PG_RETURN_BYTEA_P(sketch);
+}
+
+
+/*
+ * citus_hll_union_trans is the transition and combine function of the
+ * HyperLogLog aggregates, which merges the second sketch into the first.
+ */
+Datum
+citus_hll_union_trans(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	HllSketch *otherSketch = GetHllSketchArgument(fcinfo, 1);
+
+	if (PG_ARGISNULL(0))
+	{
+		/* never modify the input in place */
+		PG_RETURN_BYTEA_P(CopyHllSketch(otherSketch));
+	}
+
+	HllSketch *sketch = GetHllSketchArgument(fcinfo, 0);
+
+	if (sketch->precision > otherSketch->precision)
+	{
+		/* the merged sketch has the lowest precision of the two */
+		HllSketch *newSketch = CopyHllSketch(otherSketch);
+		HllSketchUnion(newSketch, sketch);
+
+		PG_RETURN_BYTEA_P(newSketch);
+	}
+
+	if (!ModifyStateInPlace(fcinfo))
+	{
+		sketch = CopyHllSketch(sketch);
+	}
+
+	HllSketchUnion(sketch, otherSketch);
+
+	PG_RETURN_BYTEA_P(sketch);
+}
+
+
+/*
+ * citus_hll_cardinality returns the estimated number of distinct values
+ * that were added to the given sketch. A NULL sketch represents no values.
+ */
+Datum
+citus_hll_cardinality(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	HllSketch *sketch = GetHllSketchArgument(fcinfo, 0);
+	uint32 registerCount = 1 << sketch->precision;
+	uint32 zeroRegisterCount = 0;
+	double harmonicSum = 0.0;
+	double alpha = 0.0;
+
+	for (uint32 registerIndex = 0; registerIndex < registerCount; registerIndex++)
+	{
+		uint8 registerValue = sketch->registers[registerIndex];
+
+		harmonicSum += ldexp(1.0, -registerValue);
+
+		if (registerValue == 0)
+		{
+			zeroRegisterCount++;
+		}
+	}
+
+	switch (registerCount)
+	{
+		case 16:
+		{
+			alpha = 0.673;
+			break;
+		}
+
+		case 32:
+		{
+			alpha = 0.697;
+			break;
+		}
+
+		case 64:
+		{
+			alpha = 0.709;
+			break;
+		}
+
+		default:
+		{
+			alpha = 0.7213 / (1.0 + 1.079 / registerCount);
+			break;
+		}
+	}
+
+	double estimate = alpha * registerCount * registerCount / harmonicSum;
+
+	/* use linear counting for small cardinalities, where HyperLogLog is biased */
+	if (estimate <= 2.5 * registerCount && zeroRegisterCount > 0)
+	{
+		estimate = registerCount * log((double) registerCount / zeroRegisterCount);
+	}
+
+	PG_RETURN_INT64((int64) rint(estimate));
+}
+
+
+/*
+ * CreateHllSketch returns an empty sketch of the given precision.
+ */
+static HllSketch *
+CreateHllSketch(int precision)
+{
+	if (precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("hll precision %d is out of range", precision),
+						errdetail("Precision should be between %d and %d.",
+								  HLL_MIN_PRECISION, HLL_MAX_PRECISION)));
+	}
+
+	Size sketchSize = HLL_SKETCH_SIZE(precision);
+	HllSketch *sketch = palloc0(sketchSize);
+	SET_VARSIZE(sketch, sketchSize);
+	sketch->precision = precision;
+
+	return sketch;
+}
+
+
+/*
+ * GetHllSketchArgument returns the sketch in the given argument, and errors
+ * out if it is not a valid sketch.
+ */
+static HllSketch *
+GetHllSketchArgument(FunctionCallInfo fcinfo, int argumentIndex)
+{
+	HllSketch *sketch = (HllSketch *) PG_GETARG_BYTEA_P(argumentIndex);
+
+	if (VARSIZE(sketch) < offsetof(HllSketch, registers) ||
+		sketch->precision < HLL_MIN_PRECISION || sketch->precision > HLL_MAX_PRECISION ||
+		VARSIZE(sketch) != HLL_SKETCH_SIZE(sketch->precision))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid hll sketch")));
+	}
+
+	return sketch;
+}
+
+
+/*
+ * CopyHllSketch returns a copy of the given sketch in the current memory
+ * context.
+ */
+static HllSketch *
+CopyHllSketch(HllSketch *sketch)
+{
+	HllSketch *newSketch = palloc(VARSIZE(sketch));
+	memcpy_s(newSketch, VARSIZE(sketch), sketch, VARSIZE(sketch));
+
+	return newSketch;
+}
+
+
+/*
+ * HllSketchAddHash adds the given hash value to the sketch. The first bits of
+ * the hash select a register, which keeps the maximum rank (position of the
+ * leftmost 1-bit) of the remaining bits.
+ */
+static void
+HllSketchAddHash(HllSketch *sketch, uint64 hash)
+{
+	int precision = sketch->precision;
+	uint32 registerIndex = (uint32) (hash >> (64 - precision));
+	uint64 remainingBits = hash << precision;
+	uint8 rank = 1;
+
+	while (rank <= 64 - precision && (remainingBits & UINT64CONST(0x8000000000000000)) == 0)
+	{
+		remainingBits <<= 1;
+		rank++;
+	}
+
+	if (rank > sketch->registers[registerIndex])
+	{
+		sketch->registers[registerIndex] = rank;
+	}
+}
+
+
+/*
+ * HllSketchUnion merges the other sketch into the given sketch, whose
+ * precision should not be higher. Registers of a more precise sketch are
+ * folded, moving the bits that no longer select a register into the rank.
+ */
+static void
+HllSketchUnion(HllSketch *sketch, HllSketch *otherSketch)
+{
+	int precisionDifference = otherSketch->precision - sketch->precision;
+	uint32 otherRegisterCount = 1 << otherSketch->precision;
+
+	Assert(precisionDifference >= 0);
+
+	for (uint32 otherIndex = 0; otherIndex < otherRegisterCount; otherIndex++)
+	{
+		uint8 rank = otherSketch->registers[otherIndex];
+		uint32 registerIndex = otherIndex >> precisionDifference;
+		uint32 foldedBits = otherIndex & ((1 << precisionDifference) - 1);
+
+		if (rank == 0)
+		{
+			continue;
+		}
+
+		if (foldedBits != 0)
+		{
+			/* the rank is now determined by the folded bits */
+			rank = 1;
+			while ((foldedBits & (1 << (precisionDifference - rank))) == 0)
+			{
+				rank++;
+			}
+		}
+		else
+		{
+			rank += precisionDifference;
+		}
+
+		if (rank > sketch->registers[registerIndex])
+		{
+			sketch->registers[registerIndex] = rank;
+		}
+	}
+}
+
+
+/*
+ * HashHllValue returns the 64-bit hash of the given value of the second
+ * argument of the function, using the extended hash function of its type.
+ */
+static uint64
+HashHllValue(FunctionCallInfo fcinfo, Datum value)
+{
+	HllHashFunctionCache *cache = (HllHashFunctionCache *) fcinfo->flinfo->fn_extra;
+	Oid typeId = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	Oid collationId = PG_GET_COLLATION();
+
+	if (cache == NULL || cache->typeId != typeId)
+	{
+		TypeCacheEntry *typeEntry =
+			lookup_type_cache(typeId, TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+
+		if (!OidIsValid(typeEntry->hash_extended_proc_finfo.fn_oid))
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+							errmsg("could not identify an extended hash function for "
+								   "type %s", format_type_be(typeId))));
+		}
+
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+									   sizeof(HllHashFunctionCache));
+		cache->typeId = typeId;
+		fmgr_info_copy(&cache->hashFunction, &typeEntry->hash_extended_proc_finfo,
+					   fcinfo->flinfo->fn_mcxt);
+
+		fcinfo->flinfo->fn_extra = cache;
+	}
+
+	if (!OidIsValid(collationId))
+	{
+		collationId = DEFAULT_COLLATION_OID;
+	}
+
+	Datum hash = FunctionCall2Coll(&cache->hashFunction, collationId, value,
+								   Int64GetDatum(0));
+
+	return DatumGetUInt64(hash);
+}
+
+
+/*
+ * citus_tdigest_add_trans is the transition function of citus_tdigest_add_agg,
+ * which adds the given value to the t-digest. The optional third argument sets
+ * the compression of a new t-digest.
+ */
+Datum
+citus_tdigest_add_trans(PG_FUNCTION_ARGS)
+{
+	TDigest *digest = NULL;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	double value = PG_GETARG_FLOAT8(1);
+	if (isnan(value))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("cannot add NaN to a t-digest")));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		int compression = TDIGEST_DEFAULT_COMPRESSION;
+
+		if (PG_NARGS() > 2 && !PG_ARGISNULL(2))
+		{
+			compression = PG_GETARG_INT32(2);
+		}
+
+		digest = CreateTDigest(compression, TDIGEST_INITIAL_CAPACITY);
+	}
+	else
+	{
+		digest = GetTDigestArgument(fcinfo, 0);
+
+		if (!ModifyStateInPlace(fcinfo))
+		{
+			digest = CopyTDigest(digest, digest->capacity);
+		}
+	}
+
+	digest = TDigestAddCentroid(digest, value, 1.0);
+
+	PG_RETURN_BYTEA_P(digest);
+}
+
+
+/*
+ * citus_tdigest_union_trans is the transition and combine function of the
+ * t-digest aggregates, which merges the second t-digest into the first.
+ */
+Datum
+citus_tdigest_union_trans(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+
+	TDigest *otherDigest = GetTDigestArgument(fcinfo, 1);
+	TDigest *digest = NULL;
+
+	if (PG_ARGISNULL(0))
+	{
+		/* never modify the input in place */
+		PG_RETURN_BYTEA_P(CopyTDigest(otherDigest, otherDigest->capacity));
+	}
+
+	digest = GetTDigestArgument(fcinfo, 0);
+
+	if (!ModifyStateInPlace(fcinfo))
+	{
+		digest = CopyTDigest(digest, digest->capacity);
+	}
+
+	for (int centroidIndex = 0; centroidIndex < otherDigest->centroidCount;
+		 centroidIndex++)
+	{
+		Centroid *centroid = &otherDigest->centroids[centroidIndex];
+		digest = TDigestAddCentroid(digest, centroid->mean, centroid->weight);
+	}
+
+	/* keep the extremes exact, they are not always centroids of their own */
+	digest->min = Min(digest->min, otherDigest->min);
+	digest->max = Max(digest->max, otherDigest->max);
+
+	PG_RETURN_BYTEA_P(digest);
+}
+
+
+/*
+ * citus_tdigest_percentile returns the estimated value below which the given
+ * fraction of the values in the t-digest fall, interpolating between the
+ * centroids like percentile_cont interpolates between values.
+ */
+Datum
+citus_tdigest_percentile(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+	{
+		PG_RETURN_NULL();
+	}
+
+	TDigest *digest = GetTDigestArgument(fcinfo, 0);
+	double percentile = PG_GETARG_FLOAT8(1);
+
+	if (percentile < 0 || percentile > 1 || isnan(percentile))
+	{
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						errmsg("percentile value %g is not between 0 and 1",
+							   percentile)));
+	}
+
+	if (digest->centroidCount == 0)
+	{
+		PG_RETURN_NULL();
+	}
+
+	/* compress a copy, the argument may be stored elsewhere */
+	digest = CopyTDigest(digest, digest->centroidCount);
+	TDigestCompress(digest);
+
+	PG_RETURN_FLOAT8(TDigestPercentile(digest, percentile));
+}
+
+
+/*
+ * CreateTDigest returns an empty t-digest with the given compression and room
+ * for the given number of centroids.
+ */
+static TDigest *
+CreateTDigest(int compression, int capacity)
+{
+	if (compression < TDIGEST_MIN_COMPRESSION || compression > TDIGEST_MAX_COMPRESSION)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("t-digest compression %d is out of range", compression),
+						errdetail("Compression should be between %d and %d.",
+								  TDIGEST_MIN_COMPRESSION, TDIGEST_MAX_COMPRESSION)));
+	}
+
+	Size digestSize = TDIGEST_SIZE(capacity);
+	TDigest *digest = palloc0(digestSize);
+	SET_VARSIZE(digest, digestSize);
+	digest->compression = compression;
+	digest->capacity = capacity;
+	digest->min = INFINITY;
+	digest->max = -INFINITY;
+
+	return digest;
+}
+
+
+/*
+ * GetTDigestArgument returns the t-digest in the given argument, and errors
+ * out if it is not a valid t-digest.
+ */
+static TDigest *
+GetTDigestArgument(FunctionCallInfo fcinfo, int argumentIndex)
+{
+	TDigest *digest = (TDigest *) PG_GETARG_BYTEA_P(argumentIndex);
+
+	if (VARSIZE(digest) < offsetof(TDigest, centroids) ||
+		digest->compression < TDIGEST_MIN_COMPRESSION ||
+		digest->compression > TDIGEST_MAX_COMPRESSION ||
+		digest->capacity < 0 || digest->centroidCount < 0 ||
+		digest->centroidCount > digest->capacity ||
+		VARSIZE(digest) != TDIGEST_SIZE(digest->capacity))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid t-digest")));
+	}
+
+	return digest;
+}
+
+
+/*
+ * CopyTDigest returns a copy of the given t-digest in the current memory
+ * context, with room for the given number of centroids.
+ */
+static TDigest *
+CopyTDigest(TDigest *digest, int capacity)
+{
+	Size digestSize = TDIGEST_SIZE(capacity);
+	TDigest *newDigest = palloc0(digestSize);
+
+	Assert(capacity >= digest->centroidCount);
+
+	memcpy_s(newDigest, digestSize, digest, TDIGEST_SIZE(digest->centroidCount));
+	SET_VARSIZE(newDigest, digestSize);
+	newDigest->capacity = capacity;
+
+	return newDigest;
+}
+
+
+/*
+ * TDigestAddCentroid adds a centroid to the t-digest. When there is no room,
+ * the centroids are merged first, and a larger copy is returned if merging
+ * did not free up enough room. Sketches are copied rather than resized in
+ * place, since aggregates free the previous state when a new one is returned.
+ */
+static TDigest *
+TDigestAddCentroid(TDigest *digest, double mean, double weight)
+{
+	if (digest->centroidCount == digest->capacity)
+	{
+		int maxCapacity = TDIGEST_BUFFER_FACTOR * digest->compression;
+
+		TDigestCompress(digest);
+
+		if (digest->centroidCount > digest->capacity / 2 &&
+			digest->capacity < maxCapacity)
+		{
+			digest = CopyTDigest(digest, Min(digest->capacity * 2, maxCapacity));
+		}
+		else if (digest->centroidCount == digest->capacity)
+		{
+			digest = CopyTDigest(digest, digest->capacity + 1);
+		}
+	}
+
+	Centroid *centroid = &digest->centroids[digest->centroidCount];
+	centroid->mean = mean;
+	centroid->weight = weight;
+
+	digest->centroidCount++;
+	digest->totalWeight += weight;
+	digest->min = Min(digest->min, mean);
+	digest->max = Max(digest->max, mean);
+
+	return digest;
+}
+
+
+/*
+ * TDigestCompress sorts the centroids and merges neighbours as long as the
+ * merged centroid spans at most one unit of the scale function, which keeps
+ * centroids near the tails small.
+ */
+static void
+TDigestCompress(TDigest *digest)
+{
+	int compression = digest->compression;
+	int mergedCount = 0;
+
+	if (digest->centroidCount <= 1)
+	{
+		return;
+	}
+
+	qsort(digest->centroids, digest->centroidCount, sizeof(Centroid),
+		  CompareCentroids);
+
+	double totalWeight = digest->totalWeight;
+	double weightSoFar = 0.0;
+	double lowerScale = TDigestScale(0.0, compression);
+	Centroid current = digest->centroids[0];
+
+	for (int centroidIndex = 1; centroidIndex < digest->centroidCount; centroidIndex++)
+	{
+		Centroid *next = &digest->centroids[centroidIndex];
+		double mergedWeight = current.weight + next->weight;
+		double upperQuantile = (weightSoFar + mergedWeight) / totalWeight;
+
+		if (TDigestScale(upperQuantile, compression) - lowerScale <= 1.0)
+		{
+			current.mean += (next->mean - current.mean) * next->weight / mergedWeight;
+			current.weight = mergedWeight;
+		}
+		else
+		{
+			weightSoFar += current.weight;
+			lowerScale = TDigestScale(weightSoFar / totalWeight, compression);
+
+			digest->centroids[mergedCount++] = current;
+			current = *next;
+		}
+	}
+
+	digest->centroids[mergedCount++] = current;
+	digest->centroidCount = mergedCount;
+}
+
+
+/*
+ * TDigestScale is the scale function of the t-digest, which maps a quantile
+ * to the number of centroids that may precede it.
+ */
+static double
+TDigestScale(double quantile, int compression)
+{
+	return compression / (2.0 * M_PI) * asin(2.0 * Min(quantile, 1.0) - 1.0);
+}
+
+
+/*
+ * CompareCentroids orders centroids by their mean.
+ */
+static int
+CompareCentroids(const void *leftElement, const void *rightElement)
+{
+	const Centroid *leftCentroid = (const Centroid *) leftElement;
+	const Centroid *rightCentroid = (const Centroid *) rightElement;
+
+	if (leftCentroid->mean < rightCentroid->mean)
+	{
+		return -1;
+	}
+	else if (leftCentroid->mean > rightCentroid->mean)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * TDigestPercentile returns the value at the given percentile of a compressed
+ * t-digest. The weight of a centroid is taken to be centered on its mean, and
+ * values are interpolated linearly between the means, and between the outer
+ * means and the extremes.
+ */
+static double
+TDigestPercentile(TDigest *digest, double percentile)
+{
+	Centroid *centroids = digest->centroids;
+	int centroidCount = digest->centroidCount;
+	double targetWeight = percentile * digest->totalWeight;
+	double weightSoFar = 0.0;
+
+	if (centroidCount == 1 || percentile == 0.0)
+	{
+		return centroidCount == 1 ? centroids[0].mean : digest->min;
+	}
+
+	if (percentile == 1.0)
+	{
+		return digest->max;
+	}
+
+	double firstCenter = centroids[0].weight / 2.0;
+	if (targetWeight <= firstCenter)
+	{
+		return digest->min + (centroids[0].mean - digest->min) *
+			   targetWeight / firstCenter;
+	}
+
+	for (int centroidIndex = 0; centroidIndex < centroidCount - 1; centroidIndex++)
+	{
+		Centroid *current = &centroids[centroidIndex];
+		Centroid *next = &centroids[centroidIndex + 1];
+		double currentCenter = weightSoFar + current->weight / 2.0;
+		double nextCenter = weightSoFar + current->weight + next->weight / 2.0;
+
+		if (targetWeight <= nextCenter)
+		{
+			return current->mean + (next->mean - current->mean) *
+				   (targetWeight - currentCenter) / (nextCenter - currentCenter);
+		}
+
+		weightSoFar += current->weight;
+	}
+
+	Centroid *last = &centroids[centroidCount - 1];
+	double lastCenter = digest->totalWeight - last->weight / 2.0;
+
+	return last->mean + (digest->max - last->mean) *
+		   (targetWeight - lastCenter) / (digest->totalWeight - lastCenter);
+}
+
+
+/*
+ * ModifyStateInPlace returns whether the function is called as an aggregate
+ * transition function, in which case the state in the first argument belongs
+ * to the aggregate and can be modified in place.
+ */
+static bool
+ModifyStateInPlace(FunctionCallInfo fcinfo)
+{
+	return AggCheckCallContext(fcinfo, NULL) != 0;
+}
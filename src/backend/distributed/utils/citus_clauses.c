@@ -9,6 +9,7 @@
 #include "postgres.h"
 
 #include "distributed/citus_clauses.h"
+#include "distributed/citus_ruleutils.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_router_planner.h"
@@ -23,6 +24,7 @@
 #include "optimizer/clauses.h"
 #include "optimizer/planmain.h"
 #include "utils/datum.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 
 
@@ -33,6 +35,7 @@ static Expr * citus_evaluate_expr(Expr *expr, Oid result_type, int32 result_typm
 								  MasterEvaluationContext *masterEvaluationContext);
 static bool CitusIsVolatileFunctionIdChecker(Oid func_id, void *context);
 static bool CitusIsMutableFunctionIdChecker(Oid func_id, void *context);
+static bool CitusIsMutableFunctionOtherThanNextval(Node *node);
 static bool ShouldEvaluateExpression(Expr *expression);
 static bool ShouldEvaluateFunctionWithMasterContext(MasterEvaluationContext *
 													evaluationContext);
@@ -54,6 +57,23 @@ RequiresMasterEvaluation(Query *query)
 }
 
 
+/*
+ * RequiresMasterEvaluationExceptSequences is like RequiresMasterEvaluation,
+ * but ignores calls to nextval, for queries in which the workers evaluate
+ * the sequences.
+ */
+bool
+RequiresMasterEvaluationExceptSequences(Query *query)
+{
+	if (query->commandType == CMD_SELECT)
+	{
+		return false;
+	}
+
+	return FindNodeCheck((Node *) query, CitusIsMutableFunctionOtherThanNextval);
+}
+
+
 /*
  * ExecuteMasterEvaluableFunctionsAndParameters evaluates expressions and parameters
  * that can be resolved to a constant.
@@ -70,6 +90,24 @@ ExecuteMasterEvaluableFunctionsAndParameters(Query *query, PlanState *planState)
 }
 
 
+/*
+ * ExecuteMasterEvaluableFunctionsAndParametersExceptSequences evaluates
+ * expressions and parameters that can be resolved to a constant, except for
+ * expressions that call nextval, which are left for the workers.
+ */
+void
+ExecuteMasterEvaluableFunctionsAndParametersExceptSequences(Query *query,
+															PlanState *planState)
+{
+	MasterEvaluationContext masterEvaluationContext;
+
+	masterEvaluationContext.planState = planState;
+	masterEvaluationContext.evaluationMode = EVALUATE_FUNCTIONS_PARAMS_EXCEPT_SEQUENCES;
+
+	PartiallyEvaluateExpression((Node *) query, &masterEvaluationContext);
+}
+
+
 /*
  * ExecuteMasterEvaluableParameters evaluates external paramaters that can be
  * resolved to a constant.
@@ -138,6 +176,17 @@ PartiallyEvaluateExpression(Node *expression,
 													masterEvaluationContext);
 		}
 
+		if (masterEvaluationContext != NULL &&
+			masterEvaluationContext->evaluationMode ==
+			EVALUATE_FUNCTIONS_PARAMS_EXCEPT_SEQUENCES &&
+			contain_nextval_expression_walker(expression, NULL))
+		{
+			/* the workers evaluate nextval, but we can still evaluate the rest */
+			return (Node *) expression_tree_mutator(expression,
+													PartiallyEvaluateExpression,
+													masterEvaluationContext);
+		}
+
 		return (Node *) citus_evaluate_expr((Expr *) expression,
 											exprType(expression),
 											exprTypmod(expression),
@@ -176,7 +225,8 @@ ShouldEvaluateFunctionWithMasterContext(MasterEvaluationContext *evaluationConte
 		return true;
 	}
 
-	return evaluationContext->evaluationMode == EVALUATE_FUNCTIONS_PARAMS;
+	return evaluationContext->evaluationMode == EVALUATE_FUNCTIONS_PARAMS ||
+		   evaluationContext->evaluationMode == EVALUATE_FUNCTIONS_PARAMS_EXCEPT_SEQUENCES;
 }
 
 
@@ -282,7 +332,7 @@ citus_evaluate_expr(Expr *expr, Oid result_type, int32 result_typmod,
 				return expr;
 			}
 		}
-		else if (masterEvaluationContext->evaluationMode != EVALUATE_FUNCTIONS_PARAMS)
+		else if (!ShouldEvaluateFunctionWithMasterContext(masterEvaluationContext))
 		{
 			/* should only get here for node types we should evaluate */
 			Assert(ShouldEvaluateExpression(expr));
@@ -448,4 +498,21 @@ CitusIsMutableFunction(Node *node)
 }
 
 
+/*
+ * CitusIsMutableFunctionOtherThanNextval checks if the given node is a mutable
+ * function other than Citus's internal functions and nextval.
+ */
+static bool
+CitusIsMutableFunctionOtherThanNextval(Node *node)
+{
+	if (IsA(node, FuncExpr) && ((FuncExpr *) node)->funcid == F_NEXTVAL_OID)
+	{
+		/* the arguments are checked separately */
+		return false;
+	}
+
+	return CitusIsMutableFunction(node);
+}
+
+
 /* *INDENT-ON* */
@@ -97,9 +97,11 @@ copyJobInfo(Job *newnode, Job *from)
 	COPY_NODE_FIELD(dependentJobList);
 	COPY_SCALAR_FIELD(subqueryPushdown);
 	COPY_SCALAR_FIELD(requiresMasterEvaluation);
+	COPY_SCALAR_FIELD(evaluateSequencesOnWorkers);
 	COPY_SCALAR_FIELD(deferredPruning);
 	COPY_NODE_FIELD(partitionKeyValue);
 	COPY_NODE_FIELD(localPlannedStatements);
+	COPY_NODE_FIELD(shardQueryStrings);
 	COPY_SCALAR_FIELD(parametersInJobQueryResolved);
 }
 
@@ -134,6 +136,33 @@ CopyNodeDistributedPlan(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(subPlanList);
 	COPY_NODE_FIELD(usedSubPlanNodeList);
 	COPY_SCALAR_FIELD(fastPathRouterPlan);
+	COPY_SCALAR_FIELD(hasPlanningPhaseTimes);
+
+	for (int phase = 0; phase < PLANNING_PHASE_COUNT; phase++)
+	{
+		COPY_SCALAR_FIELD(planningPhaseTimes[phase]);
+	}
+
+	COPY_NODE_FIELD(combineGroupColumnList);
+	COPY_NODE_FIELD(combineGroupOperatorList);
+	COPY_NODE_FIELD(combineGroupCollationList);
+	COPY_NODE_FIELD(combineFunctionList);
+
+	COPY_NODE_FIELD(topNSortColumnList);
+	COPY_NODE_FIELD(topNSortOperatorList);
+	COPY_NODE_FIELD(topNSortCollationList);
+	COPY_NODE_FIELD(topNNullsFirstList);
+	COPY_SCALAR_FIELD(topNCount);
+	COPY_SCALAR_FIELD(remoteScanRowLimit);
+
+	COPY_NODE_FIELD(mergeSortColumnList);
+	COPY_NODE_FIELD(mergeSortOperatorList);
+	COPY_NODE_FIELD(mergeSortCollationList);
+	COPY_NODE_FIELD(mergeNullsFirstList);
+
+	COPY_NODE_FIELD(boundDistributionKeyValue);
+	COPY_SCALAR_FIELD(fastPathPlanCacheEntryId);
+
 	COPY_NODE_FIELD(planningError);
 }
 
@@ -145,6 +174,7 @@ CopyNodeDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_SCALAR_FIELD(subPlanId);
 	COPY_NODE_FIELD(plan);
+	COPY_STRING_FIELD(cacheKey);
 }
 
 
@@ -155,6 +185,8 @@ CopyNodeUsedDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_STRING_FIELD(subPlanId);
 	COPY_SCALAR_FIELD(accessType);
+	COPY_SCALAR_FIELD(partitionRelationId);
+	COPY_SCALAR_FIELD(partitionColumnIndex);
 }
 
 
@@ -209,6 +241,8 @@ CopyNodeMapMergeJob(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(mapTaskList);
 	COPY_NODE_FIELD(mergeTaskList);
+	COPY_NODE_FIELD(skewedHashList);
+	COPY_NODE_FIELD(skewPartitionCountList);
 }
 
 
@@ -327,6 +361,9 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(rowValuesLists);
 	COPY_SCALAR_FIELD(partiallyLocalOrRemote);
 	COPY_SCALAR_FIELD(parametersInQueryStringResolved);
+	COPY_STRING_FIELD(fetchedExplainAnalyzePlan);
+	COPY_SCALAR_FIELD(fetchedExplainAnalyzePlacementIndex);
+	COPY_SCALAR_FIELD(fetchedExplainAnalyzeExecutionDuration);
 }
 
 
@@ -341,6 +378,16 @@ CopyNodeLocalPlannedStatement(COPYFUNC_ARGS)
 }
 
 
+void
+CopyNodeShardQueryString(COPYFUNC_ARGS)
+{
+	DECLARE_FROM_AND_NEW_NODE(ShardQueryString);
+
+	COPY_SCALAR_FIELD(shardId);
+	COPY_STRING_FIELD(queryString);
+}
+
+
 void
 CopyNodeTaskExecution(COPYFUNC_ARGS)
 {
@@ -358,6 +405,7 @@ CopyNodeTaskExecution(COPYFUNC_ARGS)
 	COPY_SCALAR_FIELD(currentNodeIndex);
 	COPY_SCALAR_FIELD(querySourceNodeIndex);
 	COPY_SCALAR_FIELD(failureCount);
+	COPY_SCALAR_FIELD(priority);
 }
 
 
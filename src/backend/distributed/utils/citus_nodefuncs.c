@@ -40,6 +40,7 @@ static const char *CitusNodeTagNamesD[] = {
 	"UsedDistributedSubPlan",
 	"Task",
 	"LocalPlannedStatement",
+	"ShardQueryString",
 	"TaskExecution",
 	"ShardInterval",
 	"ShardPlacement",
@@ -400,6 +401,7 @@ const ExtensibleNodeMethods nodeMethods[] =
 	DEFINE_NODE_METHODS(RelationRowLock),
 	DEFINE_NODE_METHODS(Task),
 	DEFINE_NODE_METHODS(LocalPlannedStatement),
+	DEFINE_NODE_METHODS(ShardQueryString),
 	DEFINE_NODE_METHODS(TaskExecution),
 	DEFINE_NODE_METHODS(DeferredErrorMessage),
 	DEFINE_NODE_METHODS(GroupShardPlacement),
@@ -132,6 +132,23 @@
 	appendStringInfo(str, ")")
 
 
+/* Write a float array, caller must give format to define precision */
+#define WRITE_FLOAT_ARRAY(fldname, count, format) \
+	appendStringInfo(str, " :" CppAsString(fldname) " ("); \
+	{ \
+		int i;\
+		for (i = 0; i < count; i++) \
+		{ \
+			if (i > 0) \
+			{ \
+				appendStringInfo(str, ", "); \
+			} \
+			appendStringInfo(str, format, node->fldname[i]); \
+		}\
+	}\
+	appendStringInfo(str, ")")
+
+
 /* Write an enum array (anything written as ":fldname (%d, %d") */
 #define WRITE_ENUM_ARRAY(fldname, count) WRITE_INT_ARRAY(fldname, count)
 
@@ -198,6 +215,24 @@ OutDistributedPlan(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(subPlanList);
 	WRITE_NODE_FIELD(usedSubPlanNodeList);
 	WRITE_BOOL_FIELD(fastPathRouterPlan);
+	WRITE_BOOL_FIELD(hasPlanningPhaseTimes);
+	WRITE_FLOAT_ARRAY(planningPhaseTimes, PLANNING_PHASE_COUNT, "%.3f");
+	WRITE_NODE_FIELD(combineGroupColumnList);
+	WRITE_NODE_FIELD(combineGroupOperatorList);
+	WRITE_NODE_FIELD(combineGroupCollationList);
+	WRITE_NODE_FIELD(combineFunctionList);
+	WRITE_NODE_FIELD(topNSortColumnList);
+	WRITE_NODE_FIELD(topNSortOperatorList);
+	WRITE_NODE_FIELD(topNSortCollationList);
+	WRITE_NODE_FIELD(topNNullsFirstList);
+	WRITE_INT64_FIELD(topNCount);
+	WRITE_INT64_FIELD(remoteScanRowLimit);
+	WRITE_NODE_FIELD(mergeSortColumnList);
+	WRITE_NODE_FIELD(mergeSortOperatorList);
+	WRITE_NODE_FIELD(mergeSortCollationList);
+	WRITE_NODE_FIELD(mergeNullsFirstList);
+	WRITE_NODE_FIELD(boundDistributionKeyValue);
+	WRITE_UINT64_FIELD(fastPathPlanCacheEntryId);
 
 	WRITE_NODE_FIELD(planningError);
 }
@@ -212,6 +247,7 @@ OutDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_UINT_FIELD(subPlanId);
 	WRITE_NODE_FIELD(plan);
+	WRITE_STRING_FIELD(cacheKey);
 }
 
 void
@@ -223,6 +259,8 @@ OutUsedDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_STRING_FIELD(subPlanId);
 	WRITE_ENUM_FIELD(accessType, SubPlanAccessType);
+	WRITE_OID_FIELD(partitionRelationId);
+	WRITE_INT_FIELD(partitionColumnIndex);
 }
 
 
@@ -341,9 +379,11 @@ OutJobFields(StringInfo str, const Job *node)
 	WRITE_NODE_FIELD(dependentJobList);
 	WRITE_BOOL_FIELD(subqueryPushdown);
 	WRITE_BOOL_FIELD(requiresMasterEvaluation);
+	WRITE_BOOL_FIELD(evaluateSequencesOnWorkers);
 	WRITE_BOOL_FIELD(deferredPruning);
 	WRITE_NODE_FIELD(partitionKeyValue);
 	WRITE_NODE_FIELD(localPlannedStatements);
+	WRITE_NODE_FIELD(shardQueryStrings);
 	WRITE_BOOL_FIELD(parametersInJobQueryResolved);
 }
 
@@ -412,6 +452,8 @@ OutMapMergeJob(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(mapTaskList);
 	WRITE_NODE_FIELD(mergeTaskList);
+	WRITE_NODE_FIELD(skewedHashList);
+	WRITE_NODE_FIELD(skewPartitionCountList);
 }
 
 
@@ -535,6 +577,9 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(rowValuesLists);
 	WRITE_BOOL_FIELD(partiallyLocalOrRemote);
 	WRITE_BOOL_FIELD(parametersInQueryStringResolved);
+	WRITE_STRING_FIELD(fetchedExplainAnalyzePlan);
+	WRITE_INT_FIELD(fetchedExplainAnalyzePlacementIndex);
+	WRITE_FLOAT_FIELD(fetchedExplainAnalyzeExecutionDuration, "%.2f");
 }
 
 
@@ -551,6 +596,18 @@ OutLocalPlannedStatement(OUTFUNC_ARGS)
 }
 
 
+void
+OutShardQueryString(OUTFUNC_ARGS)
+{
+	WRITE_LOCALS(ShardQueryString);
+
+	WRITE_NODE_TYPE("ShardQueryString");
+
+	WRITE_UINT64_FIELD(shardId);
+	WRITE_STRING_FIELD(queryString);
+}
+
+
 void
 OutTaskExecution(OUTFUNC_ARGS)
 {
@@ -569,6 +626,7 @@ OutTaskExecution(OUTFUNC_ARGS)
 	WRITE_UINT_FIELD(currentNodeIndex);
 	WRITE_UINT_FIELD(querySourceNodeIndex);
 	WRITE_UINT_FIELD(failureCount);
+	WRITE_UINT_FIELD(priority);
 }
 
 
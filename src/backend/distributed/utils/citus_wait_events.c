@@ -0,0 +1,154 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.c
+ *   Names of the wait events that Citus reports.
+ *
+ * Before PostgreSQL 13, extensions cannot register names for their wait
+ * events, so pg_stat_activity shows every wait of Citus as Extension. We
+ * therefore report distinct event ids in the extension class, and provide
+ * citus_wait_events() to show their names for the backends of this node,
+ * such that sampling the view attributes waits on remote tasks, connection
+ * slots and intermediate results correctly.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "catalog/pg_authid.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "storage/proc.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+
+
+#define CITUS_WAIT_EVENTS_COLUMNS 2
+
+
+PG_FUNCTION_INFO_V1(citus_wait_events);
+
+
+/*
+ * citus_wait_events returns the pids of the backends on this node that are
+ * waiting in one of the wait events of Citus, along with the name of the
+ * wait event. Like pg_stat_activity, only the backends of the current user
+ * are shown, unless the user is allowed to read all statistics.
+ */
+Datum
+citus_wait_events(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[CITUS_WAIT_EVENTS_COLUMNS];
+	bool isNulls[CITUS_WAIT_EVENTS_COLUMNS];
+	Oid userId = GetUserId();
+	bool canReadAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	CheckCitusVersion(ERROR);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	for (int backendIndex = 0; backendIndex < MaxBackends; backendIndex++)
+	{
+		PGPROC *proc = &ProcGlobal->allProcs[backendIndex];
+
+		/* the wait event is read without locking, same as in pg_stat_activity */
+		int processId = proc->pid;
+		uint32 waitEventInfo = UINT32_ACCESS_ONCE(proc->wait_event_info);
+
+		if (processId == 0 || (!canReadAllStats && proc->roleId != userId))
+		{
+			continue;
+		}
+
+		const char *waitEventName = CitusWaitEventName(waitEventInfo);
+		if (waitEventName == NULL)
+		{
+			continue;
+		}
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int32GetDatum(processId);
+		values[1] = CStringGetTextDatum(waitEventName);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * CitusWaitEventName returns the name of the given wait event, or NULL if it
+ * is not one of the wait events of Citus.
+ */
+const char *
+CitusWaitEventName(uint32 waitEventInfo)
+{
+	switch ((CitusWaitEvent) waitEventInfo)
+	{
+		case WAIT_EVENT_CITUS_REMOTE_TASK_EXECUTION:
+		{
+			return "CitusRemoteTaskExecution";
+		}
+
+		case WAIT_EVENT_CITUS_CONNECTION_ESTABLISHMENT:
+		{
+			return "CitusConnectionEstablishment";
+		}
+
+		case WAIT_EVENT_CITUS_SHARED_CONNECTION_SLOT:
+		{
+			return "CitusSharedConnectionSlot";
+		}
+
+		case WAIT_EVENT_CITUS_REMOTE_COMMAND:
+		{
+			return "CitusRemoteCommand";
+		}
+
+		case WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_WRITE:
+		{
+			return "CitusIntermediateResultWrite";
+		}
+
+		case WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ:
+		{
+			return "CitusIntermediateResultRead";
+		}
+
+		case WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_FETCH:
+		{
+			return "CitusIntermediateResultFetch";
+		}
+
+		case WAIT_EVENT_CITUS_TWO_PHASE_PREPARE:
+		{
+			return "CitusTwoPhasePrepare";
+		}
+
+		case WAIT_EVENT_CITUS_TRANSACTION_COMMIT:
+		{
+			return "CitusTransactionCommit";
+		}
+
+		case WAIT_EVENT_CITUS_METADATA_SYNC:
+		{
+			return "CitusMetadataSync";
+		}
+
+		default:
+		{
+			return NULL;
+		}
+	}
+}
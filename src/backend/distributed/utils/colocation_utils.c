@@ -547,6 +547,56 @@ ColocationId(int shardCount, int replicationFactor, Oid distributionColumnType,
 }
 
 
+/*
+ * UpdateColocationGroupShardCount sets the shard count of the given colocation
+ * group in pg_dist_colocation, after the shards of its tables were resharded.
+ */
+void
+UpdateColocationGroupShardCount(uint32 colocationId, int shardCount)
+{
+	const int scanKeyCount = 1;
+	ScanKeyData scanKey[1];
+	bool indexOK = false;
+	Datum values[Natts_pg_dist_colocation];
+	bool isNull[Natts_pg_dist_colocation];
+	bool replace[Natts_pg_dist_colocation];
+
+	Relation pgDistColocation = heap_open(DistColocationRelationId(), RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistColocation);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_colocation_colocationid,
+				BTEqualStrategyNumber, F_INT4EQ, UInt32GetDatum(colocationId));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistColocation, InvalidOid, indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	if (!HeapTupleIsValid(heapTuple))
+	{
+		ereport(ERROR, (errmsg("could not find valid entry for colocation group %u",
+							   colocationId)));
+	}
+
+	memset(values, 0, sizeof(values));
+	memset(isNull, false, sizeof(isNull));
+	memset(replace, false, sizeof(replace));
+
+	values[Anum_pg_dist_colocation_shardcount - 1] = Int32GetDatum(shardCount);
+	replace[Anum_pg_dist_colocation_shardcount - 1] = true;
+
+	heapTuple = heap_modify_tuple(heapTuple, tupleDescriptor, values, isNull, replace);
+
+	CatalogTupleUpdate(pgDistColocation, &heapTuple->t_self, heapTuple);
+
+	CitusInvalidateRelcacheByRelid(DistColocationRelationId());
+
+	CommandCounterIncrement();
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgDistColocation, NoLock);
+}
+
+
 /*
  * CreateColocationGroup creates a new colocation id and writes it into
  * pg_dist_colocation with the given configuration. It also returns the created
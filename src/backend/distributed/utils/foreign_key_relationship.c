@@ -5,6 +5,10 @@
  *   between distributed tables. Created relationship graph will be hold by
  *   a static variable defined in this file until an invalidation comes in.
  *
+ *   When citus.shared_foreign_key_graph_max_edges is set, the edges of the
+ *   graph are also kept in shared memory, such that the graph only needs to
+ *   be built by a single backend after it is invalidated.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -27,11 +31,16 @@
 #include "distributed/hash_helpers.h"
 #include "distributed/listutils.h"
 #include "distributed/version_compat.h"
+#include "miscadmin.h"
 #include "nodes/pg_list.h"
+#include "storage/ipc.h"
 #include "storage/lockdefs.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
 #include "utils/fmgroids.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
+#include "utils/snapmgr.h"
 
 
 /*
@@ -73,10 +82,45 @@ typedef struct ForeignConstraintRelationshipEdge
 }ForeignConstraintRelationshipEdge;
 
 
+/*
+ * SharedForeignConstraintRelationshipGraph holds the edges of the foreign
+ * constraint relationship graph of a single database in shared memory. The
+ * edges are stored twice, once sorted by referencing relation and once sorted
+ * by referenced relation, followed by one another in the edges array.
+ *
+ * graphVersion is incremented when a transaction that changed the graph
+ * commits. The stored edges are only valid if they were built for the current
+ * graph version.
+ */
+typedef struct SharedForeignConstraintRelationshipGraph
+{
+	int trancheId;
+	char *trancheName;
+	LWLock lock;
+
+	uint64 graphVersion;
+	uint64 builtForVersion;
+	Oid databaseId;
+	bool isValid;
+	int edgeCount;
+
+	ForeignConstraintRelationshipEdge edges[FLEXIBLE_ARRAY_MEMBER];
+} SharedForeignConstraintRelationshipGraph;
+
+
+/* GUC, maximum number of edges of the foreign key graph kept in shared memory */
+int SharedForeignKeyGraphMaxEdges = 0;
+
 static ForeignConstraintRelationshipGraph *fConstraintRelationshipGraph = NULL;
+static SharedForeignConstraintRelationshipGraph *SharedGraph = NULL;
+
+/* whether the current transaction changed the foreign key graph */
+static bool ForeignKeyGraphChangedInTransaction = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 
 static void CreateForeignConstraintRelationshipGraph(void);
-static void PopulateAdjacencyLists(void);
+static List * PopulateAdjacencyLists(void);
 static int CompareForeignConstraintRelationshipEdges(const void *leftElement,
 													 const void *rightElement);
 static void AddForeignConstraintRelationshipEdge(Oid referencingOid, Oid referencedOid);
@@ -86,6 +130,44 @@ static void GetConnectedListHelper(ForeignConstraintRelationshipNode *node,
 								   List **adjacentNodeList, bool
 								   isReferencing);
 static List * GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing);
+static bool CanUseSharedForeignConstraintRelationshipGraph(void);
+static bool SharedForeignConstraintRelationshipList(Oid relationId, bool isReferencing,
+													List **relationIdList);
+static void SharedGraphConnectedListHelper(Oid relationId, bool isReferencing,
+										   HTAB *visitedRelations,
+										   List **relationIdList);
+static int SharedGraphFirstEdgeIndex(ForeignConstraintRelationshipEdge *edges,
+									 int edgeCount, Oid relationId, bool isReferencing);
+static void PublishForeignConstraintRelationshipGraph(List *edgeList,
+													  uint64 graphVersion);
+static int CompareEdgesByReferencing(const void *leftElement, const void *rightElement);
+static int CompareEdgesByReferenced(const void *leftElement, const void *rightElement);
+static void SharedForeignKeyGraphShmemInit(void);
+static size_t SharedForeignKeyGraphShmemSize(void);
+
+
+/*
+ * InitializeSharedForeignKeyGraph requests the necessary shared memory from
+ * Postgres and sets up the shared memory startup hook.
+ */
+void
+InitializeSharedForeignKeyGraph(void)
+{
+	if (SharedForeignKeyGraphMaxEdges == 0)
+	{
+		/* every backend builds its own graph */
+		return;
+	}
+
+	/* allocate shared memory */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedForeignKeyGraphShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedForeignKeyGraphShmemInit;
+}
 
 
 /*
@@ -130,6 +212,12 @@ GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing)
 	List *foreignNodeList = NIL;
 	bool isFound = false;
 
+	if (SharedForeignConstraintRelationshipList(relationId, isReferencing,
+												&foreignConstraintList))
+	{
+		return foreignConstraintList;
+	}
+
 	CreateForeignConstraintRelationshipGraph();
 
 	ForeignConstraintRelationshipNode *relationNode =
@@ -175,6 +263,7 @@ static void
 CreateForeignConstraintRelationshipGraph()
 {
 	HASHCTL info;
+	uint64 sharedGraphVersion = 0;
 
 	/* if we have already created the graph, use it */
 	if (IsForeignConstraintRelationshipGraphValid())
@@ -182,6 +271,20 @@ CreateForeignConstraintRelationshipGraph()
 		return;
 	}
 
+	bool publishGraph = CanUseSharedForeignConstraintRelationshipGraph();
+	if (publishGraph)
+	{
+		LWLockAcquire(&SharedGraph->lock, LW_SHARED);
+		sharedGraphVersion = SharedGraph->graphVersion;
+		LWLockRelease(&SharedGraph->lock);
+
+		/*
+		 * Make sure we see all foreign keys of the transactions that changed
+		 * the graph before the version we just read.
+		 */
+		InvalidateCatalogSnapshot();
+	}
+
 	ClearForeignConstraintRelationshipGraphContext();
 
 	MemoryContext fConstraintRelationshipMemoryContext = AllocSetContextCreateExtended(
@@ -210,10 +313,15 @@ CreateForeignConstraintRelationshipGraph()
 		"foreign key relationship map (oid)",
 		32, &info, hashFlags);
 
-	PopulateAdjacencyLists();
+	List *edgeList = PopulateAdjacencyLists();
 
 	fConstraintRelationshipGraph->isValid = true;
 	MemoryContextSwitchTo(oldContext);
+
+	if (publishGraph)
+	{
+		PublishForeignConstraintRelationshipGraph(edgeList, sharedGraphVersion);
+	}
 }
 
 
@@ -283,9 +391,10 @@ GetConnectedListHelper(ForeignConstraintRelationshipNode *node, List **adjacentN
 
 /*
  * PopulateAdjacencyLists gets foreign constraint relationship information from pg_constraint
- * metadata table and populates them to the foreign constraint relation graph.
+ * metadata table and populates them to the foreign constraint relation graph. It
+ * returns the list of distinct edges that were added to the graph.
  */
-static void
+static List *
 PopulateAdjacencyLists(void)
 {
 	HeapTuple tuple;
@@ -295,6 +404,7 @@ PopulateAdjacencyLists(void)
 	Oid prevReferencingOid = InvalidOid;
 	Oid prevReferencedOid = InvalidOid;
 	List *frelEdgeList = NIL;
+	List *addedEdgeList = NIL;
 
 	Relation pgConstraint = heap_open(ConstraintRelationId, AccessShareLock);
 
@@ -339,6 +449,7 @@ PopulateAdjacencyLists(void)
 			currentFConstraintRelationshipEdge->referencingRelationOID,
 			currentFConstraintRelationshipEdge->
 			referencedRelationOID);
+		addedEdgeList = lappend(addedEdgeList, currentFConstraintRelationshipEdge);
 
 		prevReferencingOid = currentFConstraintRelationshipEdge->referencingRelationOID;
 		prevReferencedOid = currentFConstraintRelationshipEdge->referencedRelationOID;
@@ -346,6 +457,8 @@ PopulateAdjacencyLists(void)
 
 	systable_endscan(scanDescriptor);
 	heap_close(pgConstraint, AccessShareLock);
+
+	return addedEdgeList;
 }
 
 
@@ -436,3 +549,362 @@ ClearForeignConstraintRelationshipGraphContext()
 	hash_destroy(fConstraintRelationshipGraph->nodeMap);
 	fConstraintRelationshipGraph = NULL;
 }
+
+
+/*
+ * MarkForeignConstraintRelationshipGraphChanged is called when the current
+ * transaction changes the foreign key graph. Until the transaction ends, the
+ * backend does not use the shared graph, since it needs to see its own changes
+ * and other backends must not see them before commit.
+ */
+void
+MarkForeignConstraintRelationshipGraphChanged(void)
+{
+	ForeignKeyGraphChangedInTransaction = true;
+}
+
+
+/*
+ * ForeignConstraintRelationshipGraphTransactionEnd invalidates the shared graph
+ * if the transaction that changed the foreign key graph commits. This happens
+ * after the changes became visible to other backends, such that a graph that
+ * is built after the invalidation includes them.
+ */
+void
+ForeignConstraintRelationshipGraphTransactionEnd(bool isCommit)
+{
+	if (!ForeignKeyGraphChangedInTransaction)
+	{
+		return;
+	}
+
+	ForeignKeyGraphChangedInTransaction = false;
+
+	if (isCommit)
+	{
+		InvalidateSharedForeignConstraintRelationshipGraph();
+	}
+}
+
+
+/*
+ * InvalidateSharedForeignConstraintRelationshipGraph makes sure that the next
+ * lookup in any backend rebuilds the graph from pg_constraint.
+ */
+void
+InvalidateSharedForeignConstraintRelationshipGraph(void)
+{
+	if (SharedGraph == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedGraph->lock, LW_EXCLUSIVE);
+	SharedGraph->graphVersion++;
+	SharedGraph->isValid = false;
+	LWLockRelease(&SharedGraph->lock);
+}
+
+
+/*
+ * CanUseSharedForeignConstraintRelationshipGraph returns whether the current
+ * backend can read and publish the shared graph.
+ */
+static bool
+CanUseSharedForeignConstraintRelationshipGraph(void)
+{
+	return SharedGraph != NULL && !ForeignKeyGraphChangedInTransaction;
+}
+
+
+/*
+ * SharedForeignConstraintRelationshipList looks up the relations that are
+ * referenced by (or referencing) the given relation in the shared graph, in
+ * the same order as GetConnectedListHelper would return them. It returns
+ * false if there is no valid shared graph for the current database.
+ */
+static bool
+SharedForeignConstraintRelationshipList(Oid relationId, bool isReferencing,
+										List **relationIdList)
+{
+	HASHCTL info;
+
+	if (!CanUseSharedForeignConstraintRelationshipGraph())
+	{
+		return false;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(Oid);
+	info.hash = oid_hash;
+	info.hcxt = CurrentMemoryContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	HTAB *visitedRelations = hash_create("visited relations", 32, &info, hashFlags);
+
+	LWLockAcquire(&SharedGraph->lock, LW_SHARED);
+
+	if (!SharedGraph->isValid || SharedGraph->databaseId != MyDatabaseId ||
+		SharedGraph->builtForVersion != SharedGraph->graphVersion)
+	{
+		LWLockRelease(&SharedGraph->lock);
+		hash_destroy(visitedRelations);
+
+		return false;
+	}
+
+	/* we don't add the relation itself to the list */
+	hash_search(visitedRelations, &relationId, HASH_ENTER, NULL);
+
+	SharedGraphConnectedListHelper(relationId, isReferencing, visitedRelations,
+								   relationIdList);
+
+	LWLockRelease(&SharedGraph->lock);
+
+	hash_destroy(visitedRelations);
+
+	return true;
+}
+
+
+/*
+ * SharedGraphConnectedListHelper is the equivalent of GetConnectedListHelper
+ * for the shared graph. The caller should hold the lock of the shared graph.
+ */
+static void
+SharedGraphConnectedListHelper(Oid relationId, bool isReferencing,
+							   HTAB *visitedRelations, List **relationIdList)
+{
+	int edgeCount = SharedGraph->edgeCount;
+	ForeignConstraintRelationshipEdge *edges = SharedGraph->edges;
+
+	if (isReferencing)
+	{
+		/* edges sorted by referenced relation follow the ones sorted by referencing */
+		edges = &(SharedGraph->edges[edgeCount]);
+	}
+
+	int edgeIndex = SharedGraphFirstEdgeIndex(edges, edgeCount, relationId,
+											  isReferencing);
+
+	for (; edgeIndex < edgeCount; edgeIndex++)
+	{
+		ForeignConstraintRelationshipEdge *edge = &edges[edgeIndex];
+		Oid nodeId = isReferencing ? edge->referencedRelationOID :
+					 edge->referencingRelationOID;
+		Oid neighborId = isReferencing ? edge->referencingRelationOID :
+						 edge->referencedRelationOID;
+		bool visited = false;
+
+		if (nodeId != relationId)
+		{
+			break;
+		}
+
+		hash_search(visitedRelations, &neighborId, HASH_ENTER, &visited);
+		if (!visited)
+		{
+			*relationIdList = lappend_oid(*relationIdList, neighborId);
+			SharedGraphConnectedListHelper(neighborId, isReferencing, visitedRelations,
+										   relationIdList);
+		}
+	}
+}
+
+
+/*
+ * SharedGraphFirstEdgeIndex returns the index of the first edge of the given
+ * relation in the sorted edges array, or edgeCount if it has no edges.
+ */
+static int
+SharedGraphFirstEdgeIndex(ForeignConstraintRelationshipEdge *edges, int edgeCount,
+						  Oid relationId, bool isReferencing)
+{
+	int lowerBound = 0;
+	int upperBound = edgeCount;
+
+	while (lowerBound < upperBound)
+	{
+		int middle = lowerBound + (upperBound - lowerBound) / 2;
+		Oid middleId = isReferencing ? edges[middle].referencedRelationOID :
+					   edges[middle].referencingRelationOID;
+
+		if (middleId < relationId)
+		{
+			lowerBound = middle + 1;
+		}
+		else
+		{
+			upperBound = middle;
+		}
+	}
+
+	return lowerBound;
+}
+
+
+/*
+ * PublishForeignConstraintRelationshipGraph stores the given edges in the
+ * shared graph, unless the graph was changed since the given version was read
+ * or the edges do not fit.
+ */
+static void
+PublishForeignConstraintRelationshipGraph(List *edgeList, uint64 graphVersion)
+{
+	int edgeCount = list_length(edgeList);
+	if (edgeCount > SharedForeignKeyGraphMaxEdges)
+	{
+		ereport(DEBUG1, (errmsg("foreign key graph has %d edges, which do not fit "
+								"in shared memory", edgeCount),
+						 errhint("Consider increasing "
+								 "citus.shared_foreign_key_graph_max_edges.")));
+		return;
+	}
+
+	/* sort the edges before taking the lock */
+	ForeignConstraintRelationshipEdge *sortedEdges =
+		palloc0(2 * Max(edgeCount, 1) * sizeof(ForeignConstraintRelationshipEdge));
+
+	int edgeIndex = 0;
+	ForeignConstraintRelationshipEdge *edge = NULL;
+	foreach_ptr(edge, edgeList)
+	{
+		sortedEdges[edgeIndex] = *edge;
+		sortedEdges[edgeCount + edgeIndex] = *edge;
+		edgeIndex++;
+	}
+
+	qsort(sortedEdges, edgeCount, sizeof(ForeignConstraintRelationshipEdge),
+		  CompareEdgesByReferencing);
+	qsort(&sortedEdges[edgeCount], edgeCount, sizeof(ForeignConstraintRelationshipEdge),
+		  CompareEdgesByReferenced);
+
+	LWLockAcquire(&SharedGraph->lock, LW_EXCLUSIVE);
+
+	if (SharedGraph->graphVersion == graphVersion)
+	{
+		memcpy(SharedGraph->edges, sortedEdges,
+			   2 * edgeCount * sizeof(ForeignConstraintRelationshipEdge));
+
+		SharedGraph->databaseId = MyDatabaseId;
+		SharedGraph->edgeCount = edgeCount;
+		SharedGraph->builtForVersion = graphVersion;
+		SharedGraph->isValid = true;
+	}
+
+	LWLockRelease(&SharedGraph->lock);
+
+	pfree(sortedEdges);
+}
+
+
+/*
+ * CompareEdgesByReferencing orders edges by referencing and then referenced
+ * relation, which is the order of the adjacency lists in the local graph.
+ */
+static int
+CompareEdgesByReferencing(const void *leftElement, const void *rightElement)
+{
+	const ForeignConstraintRelationshipEdge *leftEdge =
+		(const ForeignConstraintRelationshipEdge *) leftElement;
+	const ForeignConstraintRelationshipEdge *rightEdge =
+		(const ForeignConstraintRelationshipEdge *) rightElement;
+
+	if (leftEdge->referencingRelationOID != rightEdge->referencingRelationOID)
+	{
+		return leftEdge->referencingRelationOID < rightEdge->referencingRelationOID ?
+			   -1 : 1;
+	}
+
+	if (leftEdge->referencedRelationOID != rightEdge->referencedRelationOID)
+	{
+		return leftEdge->referencedRelationOID < rightEdge->referencedRelationOID ?
+			   -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * CompareEdgesByReferenced orders edges by referenced and then referencing
+ * relation, which is the order of the back adjacency lists in the local graph.
+ */
+static int
+CompareEdgesByReferenced(const void *leftElement, const void *rightElement)
+{
+	const ForeignConstraintRelationshipEdge *leftEdge =
+		(const ForeignConstraintRelationshipEdge *) leftElement;
+	const ForeignConstraintRelationshipEdge *rightEdge =
+		(const ForeignConstraintRelationshipEdge *) rightElement;
+
+	if (leftEdge->referencedRelationOID != rightEdge->referencedRelationOID)
+	{
+		return leftEdge->referencedRelationOID < rightEdge->referencedRelationOID ?
+			   -1 : 1;
+	}
+
+	if (leftEdge->referencingRelationOID != rightEdge->referencingRelationOID)
+	{
+		return leftEdge->referencingRelationOID < rightEdge->referencingRelationOID ?
+			   -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * SharedForeignKeyGraphShmemInit initializes the shared graph, which starts
+ * out invalid.
+ */
+static void
+SharedForeignKeyGraphShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SharedGraph =
+		(SharedForeignConstraintRelationshipGraph *) ShmemInitStruct(
+			"Shared Foreign Key Graph", SharedForeignKeyGraphShmemSize(),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		SharedGraph->trancheId = LWLockNewTrancheId();
+		SharedGraph->trancheName = "Shared Foreign Key Graph Tranche";
+		LWLockRegisterTranche(SharedGraph->trancheId, SharedGraph->trancheName);
+
+		LWLockInitialize(&SharedGraph->lock, SharedGraph->trancheId);
+
+		SharedGraph->graphVersion = 0;
+		SharedGraph->builtForVersion = 0;
+		SharedGraph->databaseId = InvalidOid;
+		SharedGraph->isValid = false;
+		SharedGraph->edgeCount = 0;
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * SharedForeignKeyGraphShmemSize calculates the size of the shared graph,
+ * with room for two copies of each edge.
+ */
+static size_t
+SharedForeignKeyGraphShmemSize(void)
+{
+	Size size = offsetof(SharedForeignConstraintRelationshipGraph, edges);
+	size = add_size(size, mul_size(2 * sizeof(ForeignConstraintRelationshipEdge),
+								   SharedForeignKeyGraphMaxEdges));
+
+	return size;
+}
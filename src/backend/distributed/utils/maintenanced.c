@@ -9,6 +9,20 @@
  * can then perform work like deadlock detection, prepared transaction
  * recovery, and cleanup.
  *
+ * Jobs that may take long, such as metadata sync and prepared transaction
+ * recovery, are dispatched to short-lived job workers, so that they do not
+ * delay the other jobs.
+ *
+ * On servers with many rarely used databases, citus.maintenance_daemon_idle_timeout
+ * lets the maintenance daemon of a database exit once nobody uses the
+ * database, such that idle databases do not each keep a process, its memory
+ * and its connections to the other nodes around. The next session that uses
+ * Citus in the database starts the daemon again. Daemons that detect
+ * distributed deadlocks across nodes with metadata keep running, since under
+ * MX distributed transactions can deadlock without any session in the local
+ * database. Without MX, every distributed transaction has a session in the
+ * database, which keeps the daemon running.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -32,25 +46,34 @@
 #include "catalog/namespace.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/incremental_rollup.h"
+#include "distributed/lag_aware_routing.h"
+#include "distributed/listutils.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/statistics_collection.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
 #include "nodes/makefuncs.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
 #include "nodes/makefuncs.h"
 #include "storage/ipc.h"
 #include "storage/proc.h"
+#include "storage/procarray.h"
 #include "storage/latch.h"
 #include "storage/lmgr.h"
 #include "storage/lwlock.h"
 #include "tcop/tcopprot.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
+#include "utils/timestamp.h"
 
 /*
  * Shared memory data for all maintenance workers.
@@ -68,6 +91,42 @@ typedef struct MaintenanceDaemonControlData
 } MaintenanceDaemonControlData;
 
 
+/*
+ * MaintenanceJobType lists the periodic jobs of the maintenance daemon.
+ */
+typedef enum MaintenanceJobType
+{
+	MAINTENANCE_JOB_METADATA_SYNC = 0,
+	MAINTENANCE_JOB_TRANSACTION_RECOVERY,
+	MAINTENANCE_JOB_DEADLOCK_DETECTION,
+	MAINTENANCE_JOB_STATISTICS_COLLECTION,
+	MAINTENANCE_JOB_SHARD_SIZE_REFRESH,
+	MAINTENANCE_JOB_SECONDARY_LSN_REFRESH,
+	MAINTENANCE_JOB_ROLLUP_REFRESH,
+	MAINTENANCE_JOB_COUNT
+} MaintenanceJobType;
+
+
+/*
+ * Per job state of a maintenance daemon, as shown in citus_maintenance_jobs.
+ */
+typedef struct MaintenanceJobData
+{
+	/* pid of the job worker running the job, 0 if it runs in the daemon */
+	pid_t workerPid;
+
+	bool running;
+	TimestampTz lastStartTime;
+	TimestampTz lastEndTime;
+
+	/* job specific outcome of the last run, see MaintenanceJobs */
+	bool lastResult;
+
+	/* when the job is due next, 0 if it is not scheduled */
+	TimestampTz nextRunTime;
+} MaintenanceJobData;
+
+
 /*
  * Per database worker state.
  */
@@ -82,8 +141,34 @@ typedef struct MaintenanceDaemonDBData
 	bool daemonStarted;
 	bool triggerMetadataSync;
 	Latch *latch; /* pointer to the background worker's latch */
+
+	MaintenanceJobData jobs[MAINTENANCE_JOB_COUNT];
 } MaintenanceDaemonDBData;
 
+
+/*
+ * MaintenanceJobArgs is passed to a job worker in bgw_extra.
+ */
+typedef struct MaintenanceJobArgs
+{
+	Oid userOid;
+	MaintenanceJobType jobType;
+} MaintenanceJobArgs;
+
+
+/*
+ * MaintenanceJob describes a periodic job. The function runs the job in a
+ * transaction and returns a job specific result: whether metadata sync or
+ * statistics collection succeeded, or whether a deadlock was found.
+ */
+typedef bool (*MaintenanceJobFunction)(void);
+
+typedef struct MaintenanceJob
+{
+	const char *name;
+	MaintenanceJobFunction function;
+} MaintenanceJob;
+
 /* config variable for distributed deadlock detection timeout */
 double DistributedDeadlockDetectionTimeoutFactor = 2.0;
 int Recover2PCInterval = 60000;
@@ -92,6 +177,9 @@ int Recover2PCInterval = 60000;
 int MetadataSyncInterval = 60000;
 int MetadataSyncRetryInterval = 5000;
 
+/* config variable for stopping the maintenance daemons of idle databases */
+int MaintenanceDaemonIdleTimeout = 0;
+
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static MaintenanceDaemonControlData *MaintenanceDaemonControl = NULL;
 
@@ -113,6 +201,54 @@ static void MaintenanceDaemonErrorContext(void *arg);
 static bool LockCitusExtension(void);
 static bool MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData);
 static void WarnMaintenanceDaemonNotStarted(void);
+static bool StopIdleMaintenanceDaemon(MaintenanceDaemonDBData *dbData,
+									  double *timeout);
+static bool RunMetadataSyncJob(void);
+static bool RunTransactionRecoveryJob(void);
+static bool RunDeadlockDetectionJob(void);
+static bool RunStatisticsCollectionJob(void);
+static bool RunShardSizeRefreshJob(void);
+static bool RunSecondaryLsnRefreshJob(void);
+static bool RunRollupRefreshJob(void);
+static void StartMaintenanceJob(MaintenanceJobType jobType, Oid userOid);
+static bool MaintenanceJobRunning(MaintenanceJobType jobType);
+static void CheckMaintenanceJobCompletion(MaintenanceJobType jobType);
+static void CompleteMaintenanceJob(MaintenanceJobType jobType, bool jobResult);
+static double MaintenanceJobTimeout(MaintenanceJobType jobType, double timeout);
+static bool RunMaintenanceJob(MaintenanceJobType jobType);
+static MaintenanceJobData * LockMaintenanceJobData(Oid databaseOid,
+												   MaintenanceJobType jobType);
+static void SetMaintenanceJobNextRunTime(MaintenanceJobType jobType,
+										 TimestampTz nextRunTime);
+static void MaintenanceJobShmemExit(int code, Datum arg);
+static void MaintenanceJobErrorContext(void *arg);
+
+PG_FUNCTION_INFO_V1(citus_maintenance_job_stats);
+
+static const MaintenanceJob MaintenanceJobs[MAINTENANCE_JOB_COUNT] = {
+	{ "metadata_sync", RunMetadataSyncJob },
+	{ "transaction_recovery", RunTransactionRecoveryJob },
+	{ "deadlock_detection", RunDeadlockDetectionJob },
+	{ "statistics_collection", RunStatisticsCollectionJob },
+	{ "shard_size_refresh", RunShardSizeRefreshJob },
+	{ "secondary_lsn_refresh", RunSecondaryLsnRefreshJob },
+	{ "rollup_refresh", RunRollupRefreshJob }
+};
+
+/* state of the jobs that the maintenance daemon dispatched, local to the daemon */
+static BackgroundWorkerHandle *MaintenanceJobHandles[MAINTENANCE_JOB_COUNT];
+static bool MaintenanceJobCompletionPending[MAINTENANCE_JOB_COUNT];
+static TimestampTz MaintenanceJobNextRunTime[MAINTENANCE_JOB_COUNT];
+static bool RetryStatsCollection = false;
+
+/* whether the last deadlock detection had MX nodes to check, local to the daemon */
+static bool DeadlockDetectionHasMetadataNodes = false;
+
+/* since when no other process is connected to the database, 0 if not idle */
+static TimestampTz MaintenanceDaemonIdleSince = 0;
+
+/* job that a job worker runs */
+static MaintenanceJobType MyMaintenanceJobType = MAINTENANCE_JOB_COUNT;
 
 
 /*
@@ -212,6 +348,7 @@ InitializeMaintenanceDaemonBackend(void)
 		dbData->userOid = extensionOwner;
 		dbData->workerPid = 0;
 		dbData->triggerMetadataSync = false;
+		memset(dbData->jobs, 0, sizeof(dbData->jobs));
 		LWLockRelease(&MaintenanceDaemonControl->lock);
 
 		pid_t pid;
@@ -260,12 +397,11 @@ void
 CitusMaintenanceDaemonMain(Datum main_arg)
 {
 	Oid databaseOid = DatumGetObjectId(main_arg);
-	TimestampTz nextStatsCollectionTime USED_WITH_LIBCURL_ONLY =
-		TimestampTzPlusMilliseconds(GetCurrentTimestamp(), 60 * 1000);
-	bool retryStatsCollection USED_WITH_LIBCURL_ONLY = false;
 	ErrorContextCallback errorCallback;
-	TimestampTz lastRecoveryTime = 0;
-	TimestampTz nextMetadataSyncTime = 0;
+
+	/* collect statistics for the first time a minute after start */
+	MaintenanceJobNextRunTime[MAINTENANCE_JOB_STATISTICS_COLLECTION] =
+		TimestampTzPlusMilliseconds(GetCurrentTimestamp(), 60 * 1000);
 
 	/*
 	 * Look up this worker's configuration.
@@ -330,7 +466,6 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	{
 		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
 		double timeout = 10000.0; /* use this if the deadlock detection is disabled */
-		bool foundDeadlock = false;
 
 		CHECK_FOR_INTERRUPTS();
 
@@ -349,105 +484,44 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 		 * Perform Work. If a specific task needs to be called sooner than
 		 * timeout indicates, it's ok to lower it to that value. Expensive
 		 * tasks should do their own time math about whether to re-run checks.
+		 *
+		 * Statistics collection, metadata sync, 2PC recovery and refreshing
+		 * the shard size cache can take long, for instance when a node is
+		 * unreachable, so each of them runs in its own job worker. We get notified when a job worker exits. Deadlock
+		 * detection runs in the daemon itself, so it is never delayed by them.
 		 */
+		for (int jobIndex = 0; jobIndex < MAINTENANCE_JOB_COUNT; jobIndex++)
+		{
+			CheckMaintenanceJobCompletion((MaintenanceJobType) jobIndex);
+		}
 
 #ifdef HAVE_LIBCURL
 		if (EnableStatisticsCollection &&
-			GetCurrentTimestamp() >= nextStatsCollectionTime)
+			!MaintenanceJobRunning(MAINTENANCE_JOB_STATISTICS_COLLECTION))
 		{
-			bool statsCollectionSuccess = false;
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			/*
-			 * Lock the extension such that it cannot be dropped or created
-			 * concurrently. Skip statistics collection if citus extension is
-			 * not accessible.
-			 *
-			 * Similarly, we skip statistics collection if there exists any
-			 * version mismatch or the extension is not fully created yet.
-			 */
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping statistics collection")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
-			{
-				FlushDistTableCache();
-				WarnIfSyncDNS();
-				statsCollectionSuccess = CollectBasicUsageStatistics();
-			}
-
-			/*
-			 * If statistics collection was successful the next collection is
-			 * 24-hours later. Also, if this was a retry attempt we don't do
-			 * any more retries until 24-hours later, so we limit number of
-			 * retries to one.
-			 */
-			if (statsCollectionSuccess || retryStatsCollection)
-			{
-				nextStatsCollectionTime =
-					TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
-												STATS_COLLECTION_TIMEOUT_MILLIS);
-				retryStatsCollection = false;
-			}
-			else
+			if (GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_STATISTICS_COLLECTION])
 			{
-				nextStatsCollectionTime =
-					TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
-												STATS_COLLECTION_RETRY_TIMEOUT_MILLIS);
-				retryStatsCollection = true;
+				StartMaintenanceJob(MAINTENANCE_JOB_STATISTICS_COLLECTION,
+									myDbData->userOid);
 			}
 
-			CommitTransactionCommand();
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_STATISTICS_COLLECTION,
+											timeout);
 		}
 #endif
 
 		if (!RecoveryInProgress() &&
-			(MetadataSyncTriggeredCheckAndReset(myDbData) ||
-			 GetCurrentTimestamp() >= nextMetadataSyncTime))
+			!MaintenanceJobRunning(MAINTENANCE_JOB_METADATA_SYNC))
 		{
-			bool metadataSyncFailed = false;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			/*
-			 * Some functions in ruleutils.c, which we use to get the DDL for
-			 * metadata propagation, require an active snapshot.
-			 */
-			PushActiveSnapshot(GetTransactionSnapshot());
-
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping metadata sync")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			if (MetadataSyncTriggeredCheckAndReset(myDbData) ||
+				GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_METADATA_SYNC])
 			{
-				MetadataSyncResult result = SyncMetadataToNodes();
-				metadataSyncFailed = (result != METADATA_SYNC_SUCCESS);
-
-				/*
-				 * Notification means we had an attempt on synchronization
-				 * without being blocked for pg_dist_node access.
-				 */
-				if (result != METADATA_SYNC_FAILED_LOCK)
-				{
-					Async_Notify(METADATA_SYNC_CHANNEL, NULL);
-				}
+				StartMaintenanceJob(MAINTENANCE_JOB_METADATA_SYNC, myDbData->userOid);
 			}
 
-			PopActiveSnapshot();
-			CommitTransactionCommand();
-			ProcessCompletedNotifies();
-
-			int64 nextTimeout = metadataSyncFailed ? MetadataSyncRetryInterval :
-								MetadataSyncInterval;
-			nextMetadataSyncTime =
-				TimestampTzPlusMilliseconds(GetCurrentTimestamp(), nextTimeout);
-			timeout = Min(timeout, nextTimeout);
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_METADATA_SYNC, timeout);
 		}
 
 		/*
@@ -455,71 +529,83 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 		 * since we'll write to the pg_dist_transaction log.
 		 */
 		if (Recover2PCInterval > 0 && !RecoveryInProgress() &&
-			TimestampDifferenceExceeds(lastRecoveryTime, GetCurrentTimestamp(),
-									   Recover2PCInterval))
+			!MaintenanceJobRunning(MAINTENANCE_JOB_TRANSACTION_RECOVERY))
 		{
-			int recoveredTransactionCount = 0;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			if (!LockCitusExtension())
-			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping 2PC recovery")));
-			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			if (GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_TRANSACTION_RECOVERY])
 			{
 				/*
-				 * Record last recovery time at start to ensure we run once per
+				 * Schedule the next recovery at start to ensure we run once per
 				 * Recover2PCInterval even if RecoverTwoPhaseCommits takes some time.
 				 */
-				lastRecoveryTime = GetCurrentTimestamp();
+				SetMaintenanceJobNextRunTime(MAINTENANCE_JOB_TRANSACTION_RECOVERY,
+											 TimestampTzPlusMilliseconds(
+												 GetCurrentTimestamp(),
+												 Recover2PCInterval));
 
-				recoveredTransactionCount = RecoverTwoPhaseCommits();
+				StartMaintenanceJob(MAINTENANCE_JOB_TRANSACTION_RECOVERY,
+									myDbData->userOid);
 			}
 
-			CommitTransactionCommand();
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_TRANSACTION_RECOVERY,
+											timeout);
+		}
 
-			if (recoveredTransactionCount > 0)
+		if (ShardSizeCacheEnabled() && ShardSizeCacheRefreshInterval > 0 &&
+			!MaintenanceJobRunning(MAINTENANCE_JOB_SHARD_SIZE_REFRESH))
+		{
+			if (GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_SHARD_SIZE_REFRESH])
 			{
-				ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
-									 "transactions",
-									 recoveredTransactionCount)));
+				StartMaintenanceJob(MAINTENANCE_JOB_SHARD_SIZE_REFRESH,
+									myDbData->userOid);
 			}
 
-			/* make sure we don't wait too long */
-			timeout = Min(timeout, Recover2PCInterval);
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_SHARD_SIZE_REFRESH,
+											timeout);
 		}
 
-		/* the config value -1 disables the distributed deadlock detection  */
-		if (DistributedDeadlockDetectionTimeoutFactor != -1.0)
+		if (RollupRefreshInterval > 0 && !RecoveryInProgress() &&
+			!MaintenanceJobRunning(MAINTENANCE_JOB_ROLLUP_REFRESH))
 		{
-			double deadlockTimeout =
-				DistributedDeadlockDetectionTimeoutFactor * (double) DeadlockTimeout;
-
-			InvalidateMetadataSystemCache();
-			StartTransactionCommand();
-
-			/*
-			 * We skip the deadlock detection if citus extension
-			 * is not accessible.
-			 *
-			 * Similarly, we skip to run the deadlock checks if
-			 * there exists any version mismatch or the extension
-			 * is not fully created yet.
-			 */
-			if (!LockCitusExtension())
+			if (GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_ROLLUP_REFRESH])
 			{
-				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping deadlock detection")));
+				StartMaintenanceJob(MAINTENANCE_JOB_ROLLUP_REFRESH, myDbData->userOid);
 			}
-			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_ROLLUP_REFRESH, timeout);
+		}
+
+		/*
+		 * Reading the replay positions of secondaries is a single quick query
+		 * per secondary that runs every second or so, hence we run it in the
+		 * daemon rather than starting a job worker each time.
+		 */
+		if (SecondaryLsnRefreshInterval > 0)
+		{
+			if (GetCurrentTimestamp() >=
+				MaintenanceJobNextRunTime[MAINTENANCE_JOB_SECONDARY_LSN_REFRESH])
 			{
-				foundDeadlock = CheckForDistributedDeadlocks();
+				RunMaintenanceJob(MAINTENANCE_JOB_SECONDARY_LSN_REFRESH);
+
+				SetMaintenanceJobNextRunTime(MAINTENANCE_JOB_SECONDARY_LSN_REFRESH,
+											 TimestampTzPlusMilliseconds(
+												 GetCurrentTimestamp(),
+												 SecondaryLsnRefreshInterval));
 			}
 
-			CommitTransactionCommand();
+			timeout = MaintenanceJobTimeout(MAINTENANCE_JOB_SECONDARY_LSN_REFRESH,
+											timeout);
+		}
+
+		/* the config value -1 disables the distributed deadlock detection  */
+		if (DistributedDeadlockDetectionTimeoutFactor != -1.0)
+		{
+			double deadlockTimeout =
+				DistributedDeadlockDetectionTimeoutFactor * (double) DeadlockTimeout;
+
+			bool foundDeadlock = RunMaintenanceJob(MAINTENANCE_JOB_DEADLOCK_DETECTION);
 
 			/*
 			 * If we find any deadlocks, run the distributed deadlock detection
@@ -536,10 +622,30 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 				deadlockTimeout = deadlockTimeout / 20.0;
 			}
 
+			SetMaintenanceJobNextRunTime(MAINTENANCE_JOB_DEADLOCK_DETECTION,
+										 TimestampTzPlusMilliseconds(
+											 GetCurrentTimestamp(),
+											 (int64) deadlockTimeout));
+
 			/* make sure we don't wait too long */
 			timeout = Min(timeout, deadlockTimeout);
 		}
 
+		if (MaintenanceDaemonIdleTimeout > 0)
+		{
+			if (StopIdleMaintenanceDaemon(myDbData, &timeout))
+			{
+				elog(LOG, "stopping maintenance daemon on idle database %u",
+					 databaseOid);
+
+				proc_exit(0);
+			}
+		}
+		else
+		{
+			MaintenanceDaemonIdleSince = 0;
+		}
+
 		/*
 		 * Wait until timeout, or until somebody wakes us up. Also cast the timeout to
 		 * integer where we've calculated it using double for not losing the precision.
@@ -593,159 +699,987 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 
 
 /*
- * MaintenanceDaemonShmemSize computes how much shared memory is required.
+ * StopIdleMaintenanceDaemon returns true and marks the daemon as stopped if
+ * no other process has been connected to the database for
+ * citus.maintenance_daemon_idle_timeout, and the daemon has no pending 2PC
+ * recovery or metadata sync and no MX nodes to check for distributed deadlocks.
+ * Otherwise, it lowers the timeout such that the daemon wakes up when the
+ * idle timeout is reached.
+ *
+ * Sessions are in the process array before they use Citus and call
+ * InitializeMaintenanceDaemonBackend(), and both hold the exclusive lock, so
+ * a session either keeps the daemon running or starts a new one.
  */
-static size_t
-MaintenanceDaemonShmemSize(void)
+static bool
+StopIdleMaintenanceDaemon(MaintenanceDaemonDBData *dbData, double *timeout)
 {
-	Size size = 0;
-
-	size = add_size(size, sizeof(MaintenanceDaemonControlData));
+	TimestampTz currentTime = GetCurrentTimestamp();
+	long secs = 0;
+	int microsecs = 0;
 
 	/*
-	 * We request enough shared memory to have one hash-table entry for each
-	 * worker process. We couldn't start more anyway, so there's little point
-	 * in allocating more.
+	 * Under MX, distributed transactions that run through the workers can
+	 * deadlock while nobody is connected to this database, and only this
+	 * daemon detects that.
 	 */
-	Size hashSize = hash_estimate_size(max_worker_processes,
-									   sizeof(MaintenanceDaemonDBData));
-	size = add_size(size, hashSize);
-
-	return size;
-}
-
+	if (DistributedDeadlockDetectionTimeoutFactor != -1.0 &&
+		DeadlockDetectionHasMetadataNodes)
+	{
+		MaintenanceDaemonIdleSince = 0;
 
-/*
- * MaintenanceDaemonShmemInit initializes the requested shared memory for the
- * maintenance daemon.
- */
-static void
-MaintenanceDaemonShmemInit(void)
-{
-	bool alreadyInitialized = false;
-	HASHCTL hashInfo;
+		return false;
+	}
 
-	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	/* job workers are connected to the database as well */
+	for (int jobIndex = 0; jobIndex < MAINTENANCE_JOB_COUNT; jobIndex++)
+	{
+		if (MaintenanceJobRunning((MaintenanceJobType) jobIndex))
+		{
+			return false;
+		}
+	}
 
-	MaintenanceDaemonControl =
-		(MaintenanceDaemonControlData *) ShmemInitStruct("Citus Maintenance Daemon",
-														 MaintenanceDaemonShmemSize(),
-														 &alreadyInitialized);
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
-	/*
-	 * Might already be initialized on EXEC_BACKEND type platforms that call
-	 * shared library initialization functions in every backend.
-	 */
-	if (!alreadyInitialized)
+	/* the daemon itself is connected to the database */
+	if (CountDBBackends(dbData->databaseOid) > 1 || dbData->triggerMetadataSync)
 	{
-		MaintenanceDaemonControl->trancheId = LWLockNewTrancheId();
-		MaintenanceDaemonControl->lockTrancheName = "Citus Maintenance Daemon";
-		LWLockRegisterTranche(MaintenanceDaemonControl->trancheId,
-							  MaintenanceDaemonControl->lockTrancheName);
+		MaintenanceDaemonIdleSince = 0;
+		LWLockRelease(&MaintenanceDaemonControl->lock);
 
-		LWLockInitialize(&MaintenanceDaemonControl->lock,
-						 MaintenanceDaemonControl->trancheId);
+		return false;
 	}
 
+	if (MaintenanceDaemonIdleSince == 0)
+	{
+		MaintenanceDaemonIdleSince = currentTime;
+	}
 
-	memset(&hashInfo, 0, sizeof(hashInfo));
-	hashInfo.keysize = sizeof(Oid);
-	hashInfo.entrysize = sizeof(MaintenanceDaemonDBData);
-	hashInfo.hash = tag_hash;
-	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+	TimestampTz stopTime = TimestampTzPlusMilliseconds(MaintenanceDaemonIdleSince,
+													   MaintenanceDaemonIdleTimeout);
+	if (currentTime < stopTime)
+	{
+		TimestampDifference(currentTime, stopTime, &secs, &microsecs);
+		*timeout = Min(*timeout, secs * 1000.0 + microsecs / 1000.0);
 
-	MaintenanceDaemonDBHash = ShmemInitHash("Maintenance Database Hash",
-											max_worker_processes, max_worker_processes,
-											&hashInfo, hashFlags);
+		LWLockRelease(&MaintenanceDaemonControl->lock);
 
-	LWLockRelease(AddinShmemInitLock);
+		return false;
+	}
 
-	if (prev_shmem_startup_hook != NULL)
+	/*
+	 * Transactions that ended before the database became idle may still need
+	 * recovery, and nodes may still need metadata, so we wait for the jobs
+	 * to take care of them.
+	 */
+	if (!RecoveryInProgress())
 	{
-		prev_shmem_startup_hook();
+		MaintenanceJobData *recoveryJob =
+			&dbData->jobs[MAINTENANCE_JOB_TRANSACTION_RECOVERY];
+		MaintenanceJobData *metadataSyncJob =
+			&dbData->jobs[MAINTENANCE_JOB_METADATA_SYNC];
+
+		if ((Recover2PCInterval > 0 &&
+			 recoveryJob->lastEndTime < MaintenanceDaemonIdleSince) ||
+			!metadataSyncJob->lastResult)
+		{
+			LWLockRelease(&MaintenanceDaemonControl->lock);
+
+			return false;
+		}
 	}
+
+	/* from here on, sessions start a new daemon */
+	dbData->daemonStarted = false;
+	dbData->workerPid = 0;
+	dbData->latch = NULL;
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return true;
 }
 
 
 /*
- * MaintenaceDaemonShmemExit is the before_shmem_exit handler for cleaning up MaintenanceDaemonDBHash
+ * CitusMaintenanceJobMain is the main routine of a job worker, which runs a
+ * single job of the maintenance daemon of a database and exits. Job workers
+ * are started by StartMaintenanceJob() and are not restarted on errors; the
+ * maintenance daemon schedules the job again instead.
  */
-static void
-MaintenanceDaemonShmemExit(int code, Datum arg)
+void
+CitusMaintenanceJobMain(Datum main_arg)
 {
-	Oid databaseOid = DatumGetObjectId(arg);
+	Oid databaseOid = DatumGetObjectId(main_arg);
+	MaintenanceJobArgs jobArgs;
+	ErrorContextCallback errorCallback;
+
+	memcpy_s(&jobArgs, sizeof(jobArgs), MyBgworkerEntry->bgw_extra, sizeof(jobArgs));
+
+	MyMaintenanceJobType = jobArgs.jobType;
 
 	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
 	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *)
 										hash_search(MaintenanceDaemonDBHash, &databaseOid,
 													HASH_FIND, NULL);
-	if (myDbData && myDbData->workerPid == MyProcPid)
+	if (!myDbData)
 	{
-		myDbData->daemonStarted = false;
-		myDbData->workerPid = 0;
+		/* the maintenance daemon was stopped in the meantime */
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+		proc_exit(0);
 	}
 
+	before_shmem_exit(MaintenanceJobShmemExit, main_arg);
+
+	/* from this point, DROP DATABASE will attempt to kill the job worker */
+	myDbData->jobs[MyMaintenanceJobType].workerPid = MyProcPid;
+
 	LWLockRelease(&MaintenanceDaemonControl->lock);
-}
 
+	BackgroundWorkerUnblockSignals();
 
-/* MaintenanceDaemonSigTermHandler calls proc_exit(0) */
-static void
-MaintenanceDaemonSigTermHandler(SIGNAL_ARGS)
-{
-	int save_errno = errno;
+	memset(&errorCallback, 0, sizeof(errorCallback));
+	errorCallback.callback = MaintenanceJobErrorContext;
+	errorCallback.arg = (void *) &jobArgs;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
 
-	got_SIGTERM = true;
-	if (MyProc != NULL)
-	{
-		SetLatch(&MyProc->procLatch);
-	}
+	/* connect to database, after that we can actually access catalogs */
+	BackgroundWorkerInitializeConnectionByOid(databaseOid, jobArgs.userOid, 0);
 
-	errno = save_errno;
+	/* make worker recognizable in pg_stat_activity */
+	pgstat_report_appname("Citus Maintenance Job");
+
+	RunMaintenanceJob(MyMaintenanceJobType);
+
+	proc_exit(0);
 }
 
 
 /*
- * MaintenanceDaemonSigHupHandler set a flag to re-read config file at next
- * convenient time.
+ * RunMetadataSyncJob syncs the metadata to the nodes that need it and returns
+ * whether that succeeded.
  */
-static void
-MaintenanceDaemonSigHupHandler(SIGNAL_ARGS)
+static bool
+RunMetadataSyncJob(void)
 {
-	int save_errno = errno;
+	bool metadataSyncFailed = false;
 
-	got_SIGHUP = true;
-	if (MyProc != NULL)
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * Some functions in ruleutils.c, which we use to get the DDL for
+	 * metadata propagation, require an active snapshot.
+	 */
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!LockCitusExtension())
 	{
-		SetLatch(&MyProc->procLatch);
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping metadata sync")));
 	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		MetadataSyncResult result = SyncMetadataToNodes();
+		metadataSyncFailed = (result != METADATA_SYNC_SUCCESS);
 
-	errno = save_errno;
-}
+		/*
+		 * Notification means we had an attempt on synchronization
+		 * without being blocked for pg_dist_node access.
+		 */
+		if (result != METADATA_SYNC_FAILED_LOCK)
+		{
+			Async_Notify(METADATA_SYNC_CHANNEL, NULL);
+		}
+	}
 
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	ProcessCompletedNotifies();
 
-/*
- * MaintenanceDaemonErrorContext adds some context to log messages to make it
- * easier to associate them with the maintenance daemon.
- */
-static void
-MaintenanceDaemonErrorContext(void *arg)
-{
-	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *) arg;
-	errcontext("Citus maintenance daemon for database %u user %u",
-			   myDbData->databaseOid, myDbData->userOid);
+	return !metadataSyncFailed;
 }
 
 
 /*
- * LockCitusExtension acquires a lock on the Citus extension or returns
- * false if the extension does not exist or is being dropped.
+ * RunTransactionRecoveryJob recovers the prepared transactions that this node
+ * left on other nodes.
  */
 static bool
-LockCitusExtension(void)
+RunTransactionRecoveryJob(void)
 {
-	Oid extensionOid = get_extension_oid("citus", true);
+	int recoveredTransactionCount = 0;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping 2PC recovery")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		recoveredTransactionCount = RecoverTwoPhaseCommits();
+	}
+
+	CommitTransactionCommand();
+
+	if (recoveredTransactionCount > 0)
+	{
+		ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
+							 "transactions",
+							 recoveredTransactionCount)));
+	}
+
+	return true;
+}
+
+
+/*
+ * RunDeadlockDetectionJob checks for distributed deadlocks and returns
+ * whether it found one.
+ */
+static bool
+RunDeadlockDetectionJob(void)
+{
+	bool foundDeadlock = false;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * We skip the deadlock detection if citus extension
+	 * is not accessible.
+	 *
+	 * Similarly, we skip to run the deadlock checks if
+	 * there exists any version mismatch or the extension
+	 * is not fully created yet.
+	 */
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping deadlock detection")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		foundDeadlock = CheckForDistributedDeadlocks();
+		DeadlockDetectionHasMetadataNodes = ActiveReadableNodeList() != NIL &&
+											ClusterHasKnownMetadataWorkers();
+	}
+
+	CommitTransactionCommand();
+
+	return foundDeadlock;
+}
+
+
+/*
+ * RunStatisticsCollectionJob collects and sends the usage statistics and
+ * returns whether that succeeded.
+ */
+static bool
+RunStatisticsCollectionJob(void)
+{
+	bool statsCollectionSuccess = false;
+
+#ifdef HAVE_LIBCURL
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	/*
+	 * Lock the extension such that it cannot be dropped or created
+	 * concurrently. Skip statistics collection if citus extension is
+	 * not accessible.
+	 *
+	 * Similarly, we skip statistics collection if there exists any
+	 * version mismatch or the extension is not fully created yet.
+	 */
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping statistics collection")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		FlushDistTableCache();
+		WarnIfSyncDNS();
+		statsCollectionSuccess = CollectBasicUsageStatistics();
+	}
+
+	CommitTransactionCommand();
+#endif
+
+	return statsCollectionSuccess;
+}
+
+
+/*
+ * RunShardSizeRefreshJob refreshes the sizes in the shard size cache and
+ * returns whether the sizes of all nodes could be read.
+ */
+static bool
+RunShardSizeRefreshJob(void)
+{
+	bool refreshSucceeded = false;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping shard size refresh")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		refreshSucceeded = RefreshShardSizeCache();
+	}
+
+	CommitTransactionCommand();
+
+	return refreshSucceeded;
+}
+
+
+/*
+ * RunSecondaryLsnRefreshJob reads the replay positions of the secondaries
+ * and returns whether all of them could be reached.
+ */
+static bool
+RunSecondaryLsnRefreshJob(void)
+{
+	bool refreshSucceeded = false;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping secondary lsn refresh")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		refreshSucceeded = RefreshSecondaryReplayLsns();
+	}
+
+	CommitTransactionCommand();
+
+	return refreshSucceeded;
+}
+
+
+/*
+ * RunRollupRefreshJob refreshes the rollups created with citus_create_rollup
+ * and returns whether all of them could be refreshed. Every rollup is
+ * refreshed in its own transaction, such that a rollup whose aggregation
+ * command fails does not hold back the others.
+ */
+static bool
+RunRollupRefreshJob(void)
+{
+	MemoryContext jobContext = CurrentMemoryContext;
+	List *rollupNameList = NIL;
+	bool refreshSucceeded = true;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping rollup refresh")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		MemoryContext transactionContext = MemoryContextSwitchTo(jobContext);
+		rollupNameList = RollupNameList();
+		MemoryContextSwitchTo(transactionContext);
+	}
+
+	CommitTransactionCommand();
+
+	char *rollupName = NULL;
+	foreach_ptr(rollupName, rollupNameList)
+	{
+		StartTransactionCommand();
+
+		PG_TRY();
+		{
+			if (LockCitusExtension())
+			{
+				RefreshRollup(rollupName);
+			}
+
+			CommitTransactionCommand();
+		}
+		PG_CATCH();
+		{
+			MemoryContextSwitchTo(jobContext);
+
+			ErrorData *errorData = CopyErrorData();
+			FlushErrorState();
+			AbortCurrentTransaction();
+
+			ereport(WARNING, (errmsg("could not refresh rollup \"%s\": %s",
+									 rollupName, errorData->message)));
+
+			FreeErrorData(errorData);
+			refreshSucceeded = false;
+		}
+		PG_END_TRY();
+	}
+
+	return refreshSucceeded;
+}
+
+
+/*
+ * StartMaintenanceJob starts a job worker for the given job. If there is no
+ * background worker slot left, we run the job in the maintenance daemon
+ * instead, as it used to be.
+ */
+static void
+StartMaintenanceJob(MaintenanceJobType jobType, Oid userOid)
+{
+	BackgroundWorker worker;
+	MaintenanceJobArgs jobArgs;
+
+	memset(&worker, 0, sizeof(worker));
+
+	SafeSnprintf(worker.bgw_name, sizeof(worker.bgw_name),
+				 "Citus Maintenance Job %u/%u: %s",
+				 MyDatabaseId, userOid, MaintenanceJobs[jobType].name);
+
+	/* request ability to connect to target database */
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+
+	/* the maintenance daemon schedules failed jobs again */
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy_s(worker.bgw_library_name,
+			 sizeof(worker.bgw_library_name), "citus");
+	strcpy_s(worker.bgw_function_name, sizeof(worker.bgw_function_name),
+			 "CitusMaintenanceJobMain");
+
+	worker.bgw_main_arg = ObjectIdGetDatum(MyDatabaseId);
+
+	jobArgs.userOid = userOid;
+	jobArgs.jobType = jobType;
+	memcpy_s(worker.bgw_extra, sizeof(worker.bgw_extra), &jobArgs, sizeof(jobArgs));
+
+	/* get notified through our latch when the job worker exits */
+	worker.bgw_notify_pid = MyProcPid;
+
+	if (!RegisterDynamicBackgroundWorker(&worker, &MaintenanceJobHandles[jobType]))
+	{
+		ereport(DEBUG1, (errmsg("could not start a job worker, running %s in "
+								"the maintenance daemon",
+								MaintenanceJobs[jobType].name)));
+
+		MaintenanceJobHandles[jobType] = NULL;
+
+		bool jobResult = RunMaintenanceJob(jobType);
+		CompleteMaintenanceJob(jobType, jobResult);
+	}
+}
+
+
+/*
+ * MaintenanceJobRunning returns whether the given job runs in a job worker.
+ */
+static bool
+MaintenanceJobRunning(MaintenanceJobType jobType)
+{
+	return MaintenanceJobHandles[jobType] != NULL;
+}
+
+
+/*
+ * CheckMaintenanceJobCompletion completes the given job if its job worker
+ * has exited.
+ */
+static void
+CheckMaintenanceJobCompletion(MaintenanceJobType jobType)
+{
+	BackgroundWorkerHandle *handle = MaintenanceJobHandles[jobType];
+	pid_t workerPid = 0;
+
+	if (handle == NULL ||
+		GetBackgroundWorkerPid(handle, &workerPid) != BGWH_STOPPED)
+	{
+		return;
+	}
+
+	pfree(handle);
+	MaintenanceJobHandles[jobType] = NULL;
+
+	MaintenanceJobData *jobData = LockMaintenanceJobData(MyDatabaseId, jobType);
+	bool jobResult = jobData != NULL && jobData->lastResult;
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	CompleteMaintenanceJob(jobType, jobResult);
+}
+
+
+/*
+ * CompleteMaintenanceJob schedules the next run of a job that finished with
+ * the given result.
+ */
+static void
+CompleteMaintenanceJob(MaintenanceJobType jobType, bool jobResult)
+{
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	if (jobType == MAINTENANCE_JOB_METADATA_SYNC)
+	{
+		bool metadataSyncFailed = !jobResult;
+		int64 nextTimeout = metadataSyncFailed ? MetadataSyncRetryInterval :
+							MetadataSyncInterval;
+
+		SetMaintenanceJobNextRunTime(jobType,
+									 TimestampTzPlusMilliseconds(currentTime,
+																 nextTimeout));
+	}
+	else if (jobType == MAINTENANCE_JOB_SHARD_SIZE_REFRESH)
+	{
+		/* nodes that could not be reached are tried again in the next refresh */
+		SetMaintenanceJobNextRunTime(jobType,
+									 TimestampTzPlusMilliseconds(
+										 currentTime,
+										 ShardSizeCacheRefreshInterval));
+	}
+	else if (jobType == MAINTENANCE_JOB_ROLLUP_REFRESH)
+	{
+		/* rollups that failed to refresh are tried again in the next refresh */
+		SetMaintenanceJobNextRunTime(jobType,
+									 TimestampTzPlusMilliseconds(
+										 currentTime,
+										 RollupRefreshInterval));
+	}
+	else if (jobType == MAINTENANCE_JOB_STATISTICS_COLLECTION)
+	{
+		bool statsCollectionSuccess = jobResult;
+
+		/*
+		 * If statistics collection was successful the next collection is
+		 * 24-hours later. Also, if this was a retry attempt we don't do
+		 * any more retries until 24-hours later, so we limit number of
+		 * retries to one.
+		 */
+		if (statsCollectionSuccess || RetryStatsCollection)
+		{
+			SetMaintenanceJobNextRunTime(jobType,
+										 TimestampTzPlusMilliseconds(
+											 currentTime,
+											 STATS_COLLECTION_TIMEOUT_MILLIS));
+			RetryStatsCollection = false;
+		}
+		else
+		{
+			SetMaintenanceJobNextRunTime(jobType,
+										 TimestampTzPlusMilliseconds(
+											 currentTime,
+											 STATS_COLLECTION_RETRY_TIMEOUT_MILLIS));
+			RetryStatsCollection = true;
+		}
+	}
+}
+
+
+/*
+ * MaintenanceJobTimeout lowers the given timeout of the maintenance daemon
+ * such that it wakes up when the given job is due, unless the job is running.
+ */
+static double
+MaintenanceJobTimeout(MaintenanceJobType jobType, double timeout)
+{
+	long secs = 0;
+	int microsecs = 0;
+
+	if (MaintenanceJobRunning(jobType))
+	{
+		/* we get woken up when the job worker exits */
+		return timeout;
+	}
+
+	TimestampDifference(GetCurrentTimestamp(), MaintenanceJobNextRunTime[jobType],
+						&secs, &microsecs);
+
+	return Min(timeout, secs * 1000.0 + microsecs / 1000.0);
+}
+
+
+/*
+ * RunMaintenanceJob runs the given job in the current process and records
+ * its timing and result for citus_maintenance_jobs.
+ */
+static bool
+RunMaintenanceJob(MaintenanceJobType jobType)
+{
+	MaintenanceJobData *jobData = LockMaintenanceJobData(MyDatabaseId, jobType);
+	if (jobData != NULL)
+	{
+		jobData->running = true;
+		jobData->lastStartTime = GetCurrentTimestamp();
+	}
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	bool jobResult = MaintenanceJobs[jobType].function();
+
+	jobData = LockMaintenanceJobData(MyDatabaseId, jobType);
+	if (jobData != NULL)
+	{
+		jobData->running = false;
+		jobData->lastEndTime = GetCurrentTimestamp();
+		jobData->lastResult = jobResult;
+	}
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return jobResult;
+}
+
+
+/*
+ * LockMaintenanceJobData acquires the maintenance daemon lock in exclusive
+ * mode and returns the shared state of the given job of the maintenance daemon
+ * of the given database, or NULL if there is none. The caller should release
+ * the lock.
+ *
+ * We look up the daemon every time, since its entry is removed when the
+ * database is dropped.
+ */
+static MaintenanceJobData *
+LockMaintenanceJobData(Oid databaseOid, MaintenanceJobType jobType)
+{
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *)
+									  hash_search(MaintenanceDaemonDBHash, &databaseOid,
+												  HASH_FIND, NULL);
+	if (dbData == NULL)
+	{
+		return NULL;
+	}
+
+	return &dbData->jobs[jobType];
+}
+
+
+/*
+ * SetMaintenanceJobNextRunTime records when the given job is due next.
+ */
+static void
+SetMaintenanceJobNextRunTime(MaintenanceJobType jobType, TimestampTz nextRunTime)
+{
+	MaintenanceJobNextRunTime[jobType] = nextRunTime;
+
+	MaintenanceJobData *jobData = LockMaintenanceJobData(MyDatabaseId, jobType);
+	if (jobData != NULL)
+	{
+		jobData->nextRunTime = nextRunTime;
+	}
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * MaintenanceJobShmemExit is the before_shmem_exit handler of a job worker.
+ * If the job did not finish, e.g. because it errored out, it is recorded
+ * as failed.
+ */
+static void
+MaintenanceJobShmemExit(int code, Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+
+	MaintenanceJobData *jobData = LockMaintenanceJobData(databaseOid,
+														 MyMaintenanceJobType);
+	if (jobData != NULL && jobData->workerPid == MyProcPid)
+	{
+		if (jobData->running)
+		{
+			jobData->running = false;
+			jobData->lastEndTime = GetCurrentTimestamp();
+			jobData->lastResult = false;
+		}
+
+		jobData->workerPid = 0;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * MaintenanceJobErrorContext adds some context to log messages to make it
+ * easier to associate them with a job worker.
+ */
+static void
+MaintenanceJobErrorContext(void *arg)
+{
+	MaintenanceJobArgs *jobArgs = (MaintenanceJobArgs *) arg;
+	errcontext("Citus maintenance job %s for database %u user %u",
+			   MaintenanceJobs[jobArgs->jobType].name, MyDatabaseId,
+			   jobArgs->userOid);
+}
+
+
+/*
+ * citus_maintenance_job_stats returns the last run of each job of the
+ * maintenance daemon of the current database, and how long the job is
+ * overdue.
+ */
+Datum
+citus_maintenance_job_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	MaintenanceJobData jobs[MAINTENANCE_JOB_COUNT];
+	bool found = false;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_SHARED);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *)
+									  hash_search(MaintenanceDaemonDBHash, &MyDatabaseId,
+												  HASH_FIND, &found);
+	if (found)
+	{
+		memcpy_s(jobs, sizeof(jobs), dbData->jobs, sizeof(jobs));
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	if (!found)
+	{
+		tuplestore_donestoring(tupleStore);
+		PG_RETURN_VOID();
+	}
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	for (int jobIndex = 0; jobIndex < MAINTENANCE_JOB_COUNT; jobIndex++)
+	{
+		MaintenanceJobData *jobData = &jobs[jobIndex];
+		Datum values[6];
+		bool isNulls[6];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = CStringGetTextDatum(MaintenanceJobs[jobIndex].name);
+		values[1] = BoolGetDatum(jobData->running);
+
+		if (jobData->lastStartTime != 0)
+		{
+			values[2] = TimestampTzGetDatum(jobData->lastStartTime);
+		}
+		else
+		{
+			isNulls[2] = true;
+		}
+
+		if (jobData->lastEndTime != 0 && jobData->lastEndTime >= jobData->lastStartTime)
+		{
+			long secs = 0;
+			int microsecs = 0;
+
+			TimestampDifference(jobData->lastStartTime, jobData->lastEndTime,
+								&secs, &microsecs);
+
+			values[3] = TimestampTzGetDatum(jobData->lastEndTime);
+			values[4] = Float8GetDatum(secs * 1000.0 + microsecs / 1000.0);
+		}
+		else
+		{
+			isNulls[3] = true;
+			isNulls[4] = true;
+		}
+
+		if (jobData->nextRunTime != 0)
+		{
+			long secs = 0;
+			int microsecs = 0;
+
+			/* TimestampDifference returns 0 if the job is not due yet */
+			TimestampDifference(jobData->nextRunTime, currentTime, &secs, &microsecs);
+
+			values[5] = Float8GetDatum(secs * 1000.0 + microsecs / 1000.0);
+		}
+		else
+		{
+			isNulls[5] = true;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * MaintenanceDaemonShmemSize computes how much shared memory is required.
+ */
+static size_t
+MaintenanceDaemonShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(MaintenanceDaemonControlData));
+
+	/*
+	 * We request enough shared memory to have one hash-table entry for each
+	 * worker process. We couldn't start more anyway, so there's little point
+	 * in allocating more.
+	 */
+	Size hashSize = hash_estimate_size(max_worker_processes,
+									   sizeof(MaintenanceDaemonDBData));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * MaintenanceDaemonShmemInit initializes the requested shared memory for the
+ * maintenance daemon.
+ */
+static void
+MaintenanceDaemonShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonControl =
+		(MaintenanceDaemonControlData *) ShmemInitStruct("Citus Maintenance Daemon",
+														 MaintenanceDaemonShmemSize(),
+														 &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		MaintenanceDaemonControl->trancheId = LWLockNewTrancheId();
+		MaintenanceDaemonControl->lockTrancheName = "Citus Maintenance Daemon";
+		LWLockRegisterTranche(MaintenanceDaemonControl->trancheId,
+							  MaintenanceDaemonControl->lockTrancheName);
+
+		LWLockInitialize(&MaintenanceDaemonControl->lock,
+						 MaintenanceDaemonControl->trancheId);
+	}
+
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(Oid);
+	hashInfo.entrysize = sizeof(MaintenanceDaemonDBData);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	MaintenanceDaemonDBHash = ShmemInitHash("Maintenance Database Hash",
+											max_worker_processes, max_worker_processes,
+											&hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * MaintenaceDaemonShmemExit is the before_shmem_exit handler for cleaning up MaintenanceDaemonDBHash
+ */
+static void
+MaintenanceDaemonShmemExit(int code, Datum arg)
+{
+	Oid databaseOid = DatumGetObjectId(arg);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *)
+										hash_search(MaintenanceDaemonDBHash, &databaseOid,
+													HASH_FIND, NULL);
+	if (myDbData && myDbData->workerPid == MyProcPid)
+	{
+		myDbData->daemonStarted = false;
+		myDbData->workerPid = 0;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/* MaintenanceDaemonSigTermHandler calls proc_exit(0) */
+static void
+MaintenanceDaemonSigTermHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGTERM = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/*
+ * MaintenanceDaemonSigHupHandler set a flag to re-read config file at next
+ * convenient time.
+ */
+static void
+MaintenanceDaemonSigHupHandler(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	got_SIGHUP = true;
+	if (MyProc != NULL)
+	{
+		SetLatch(&MyProc->procLatch);
+	}
+
+	errno = save_errno;
+}
+
+
+/*
+ * MaintenanceDaemonErrorContext adds some context to log messages to make it
+ * easier to associate them with the maintenance daemon.
+ */
+static void
+MaintenanceDaemonErrorContext(void *arg)
+{
+	MaintenanceDaemonDBData *myDbData = (MaintenanceDaemonDBData *) arg;
+	errcontext("Citus maintenance daemon for database %u user %u",
+			   myDbData->databaseOid, myDbData->userOid);
+}
+
+
+/*
+ * LockCitusExtension acquires a lock on the Citus extension or returns
+ * false if the extension does not exist or is being dropped.
+ */
+static bool
+LockCitusExtension(void)
+{
+	Oid extensionOid = get_extension_oid("citus", true);
 	if (extensionOid == InvalidOid)
 	{
 		/* citus extension does not exist */
@@ -778,6 +1712,7 @@ StopMaintenanceDaemon(Oid databaseId)
 {
 	bool found = false;
 	pid_t workerPid = 0;
+	pid_t jobWorkerPids[MAINTENANCE_JOB_COUNT] = { 0 };
 
 	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
@@ -789,6 +1724,11 @@ StopMaintenanceDaemon(Oid databaseId)
 	if (found)
 	{
 		workerPid = dbData->workerPid;
+
+		for (int jobIndex = 0; jobIndex < MAINTENANCE_JOB_COUNT; jobIndex++)
+		{
+			jobWorkerPids[jobIndex] = dbData->jobs[jobIndex].workerPid;
+		}
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
@@ -797,6 +1737,15 @@ StopMaintenanceDaemon(Oid databaseId)
 	{
 		kill(workerPid, SIGTERM);
 	}
+
+	/* job workers may still be connected to the database, stop them as well */
+	for (int jobIndex = 0; jobIndex < MAINTENANCE_JOB_COUNT; jobIndex++)
+	{
+		if (jobWorkerPids[jobIndex] > 0)
+		{
+			kill(jobWorkerPids[jobIndex], SIGTERM);
+		}
+	}
 }
 
 
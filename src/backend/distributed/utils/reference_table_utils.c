@@ -49,6 +49,10 @@ static void ReplicateSingleShardTableToAllNodes(Oid relationId);
 static void ReplicateShardToAllNodes(ShardInterval *shardInterval);
 static void ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName,
 								 int nodePort);
+static void ActivateReplicatedShardPlacement(ShardInterval *shardInterval,
+											 ShardPlacement *targetPlacement,
+											 char *nodeName, int nodePort);
+static ShardPlacement * ReferenceTableSourcePlacement(uint64 shardId, int copyIndex);
 static void ConvertToReferenceTableMetadata(Oid relationId, uint64 shardId);
 static bool AnyRelationsModifiedInTransaction(List *relationIdList);
 
@@ -502,9 +506,6 @@ ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
 	 */
 	if (targetPlacement == NULL || targetPlacement->shardState != SHARD_STATE_ACTIVE)
 	{
-		uint64 placementId = 0;
-		int32 groupId = 0;
-
 		ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node %s:%d",
 								get_rel_name(shardInterval->relationId), nodeName,
 								nodePort)));
@@ -512,36 +513,56 @@ ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
 		EnsureNoModificationsHaveBeenDone();
 		SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
 												   ddlCommandList);
-		if (targetPlacement == NULL)
-		{
-			groupId = GroupForNode(nodeName, nodePort);
 
-			placementId = GetNextPlacementId();
-			InsertShardPlacementRow(shardId, placementId, SHARD_STATE_ACTIVE, 0,
-									groupId);
-		}
-		else
-		{
-			groupId = targetPlacement->groupId;
-			placementId = targetPlacement->placementId;
-			UpdateShardPlacementState(placementId, SHARD_STATE_ACTIVE);
-		}
+		ActivateReplicatedShardPlacement(shardInterval, targetPlacement, nodeName,
+										 nodePort);
+	}
+}
 
-		/*
-		 * Although ReplicateShardToAllNodes is used only for reference tables,
-		 * during the upgrade phase, the placements are created before the table is
-		 * marked as a reference table. All metadata (including the placement
-		 * metadata) will be copied to workers after all reference table changed
-		 * are finished.
-		 */
-		if (ShouldSyncTableMetadata(shardInterval->relationId))
-		{
-			char *placementCommand = PlacementUpsertCommand(shardId, placementId,
-															SHARD_STATE_ACTIVE, 0,
-															groupId);
 
-			SendCommandToWorkersWithMetadata(placementCommand);
-		}
+/*
+ * ActivateReplicatedShardPlacement records that the given shard was copied to
+ * the given node, by inserting a placement row or by marking the existing
+ * (inactive) placement in targetPlacement as active.
+ */
+static void
+ActivateReplicatedShardPlacement(ShardInterval *shardInterval,
+								 ShardPlacement *targetPlacement, char *nodeName,
+								 int nodePort)
+{
+	uint64 shardId = shardInterval->shardId;
+	uint64 placementId = 0;
+	int32 groupId = 0;
+
+	if (targetPlacement == NULL)
+	{
+		groupId = GroupForNode(nodeName, nodePort);
+
+		placementId = GetNextPlacementId();
+		InsertShardPlacementRow(shardId, placementId, SHARD_STATE_ACTIVE, 0,
+								groupId);
+	}
+	else
+	{
+		groupId = targetPlacement->groupId;
+		placementId = targetPlacement->placementId;
+		UpdateShardPlacementState(placementId, SHARD_STATE_ACTIVE);
+	}
+
+	/*
+	 * Although ReplicateShardToAllNodes is used only for reference tables,
+	 * during the upgrade phase, the placements are created before the table is
+	 * marked as a reference table. All metadata (including the placement
+	 * metadata) will be copied to workers after all reference table changed
+	 * are finished.
+	 */
+	if (ShouldSyncTableMetadata(shardInterval->relationId))
+	{
+		char *placementCommand = PlacementUpsertCommand(shardId, placementId,
+														SHARD_STATE_ACTIVE, 0,
+														groupId);
+
+		SendCommandToWorkersWithMetadata(placementCommand);
 	}
 }
 
@@ -708,6 +729,11 @@ ReferenceTableReplicationFactor(void)
  * table to update the replication factor column when necessary. This function
  * skips reference tables if that node already has healthy placement of that
  * reference table to prevent unnecessary data transfer.
+ *
+ * The reference tables are copied in parallel, each one from one of the
+ * existing placements in turn, such that the copies are spread over all nodes
+ * that have the reference tables. Indexes of each table are created once its
+ * data is copied.
  */
 void
 ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
@@ -739,6 +765,10 @@ ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
 			BlockWritesToShardList(referenceShardIntervalList);
 		}
 
+		List *copyShardIntervalList = NIL;
+		List *sourcePlacementList = NIL;
+		List *targetPlacementList = NIL;
+
 		ShardInterval *shardInterval = NULL;
 		foreach_ptr(shardInterval, referenceShardIntervalList)
 		{
@@ -746,7 +776,45 @@ ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
 
 			LockShardDistributionMetadata(shardId, ExclusiveLock);
 
-			ReplicateShardToNode(shardInterval, nodeName, nodePort);
+			List *shardPlacementList = ShardPlacementList(shardId);
+			ShardPlacement *targetPlacement =
+				SearchShardPlacementInList(shardPlacementList, nodeName, nodePort);
+			if (targetPlacement != NULL &&
+				targetPlacement->shardState == SHARD_STATE_ACTIVE)
+			{
+				continue;
+			}
+
+			int copyIndex = list_length(copyShardIntervalList);
+			ShardPlacement *sourcePlacement =
+				ReferenceTableSourcePlacement(shardId, copyIndex);
+
+			ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node "
+									"%s:%d", get_rel_name(shardInterval->relationId),
+									nodeName, nodePort)));
+
+			copyShardIntervalList = lappend(copyShardIntervalList, shardInterval);
+			sourcePlacementList = lappend(sourcePlacementList, sourcePlacement);
+			targetPlacementList = lappend(targetPlacementList, targetPlacement);
+		}
+
+		if (copyShardIntervalList != NIL)
+		{
+			EnsureNoModificationsHaveBeenDone();
+
+			CopyShardListToNode(copyShardIntervalList, sourcePlacementList, nodeName,
+								nodePort);
+
+			int copyIndex = 0;
+			foreach_ptr(shardInterval, copyShardIntervalList)
+			{
+				ShardPlacement *targetPlacement = list_nth(targetPlacementList,
+														   copyIndex);
+
+				ActivateReplicatedShardPlacement(shardInterval, targetPlacement,
+												 nodeName, nodePort);
+				copyIndex++;
+			}
 		}
 
 		/* create foreign constraints between reference tables */
@@ -760,3 +828,30 @@ ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
 		}
 	}
 }
+
+
+/*
+ * ReferenceTableSourcePlacement returns the active placement of the given
+ * reference table shard to copy it from. Successive copies are given
+ * successive placements, such that copies of multiple reference tables pull
+ * from all nodes that have them.
+ */
+static ShardPlacement *
+ReferenceTableSourcePlacement(uint64 shardId, int copyIndex)
+{
+	List *activePlacementList = ActiveShardPlacementList(shardId);
+	if (activePlacementList == NIL)
+	{
+		/* check for corrupt metadata */
+		ereport(ERROR, (errmsg("reference table shard "
+							   UINT64_FORMAT
+							   " does not have an active shard placement",
+							   shardId)));
+	}
+
+	/* sort placements to spread copies the same way for all reference tables */
+	activePlacementList = SortList(activePlacementList, CompareShardPlacementsByWorker);
+
+	return (ShardPlacement *) list_nth(activePlacementList,
+									   copyIndex % list_length(activePlacementList));
+}
@@ -68,17 +68,27 @@ static const int lock_mode_to_string_map_count = sizeof(lockmode_to_string_map)
 												 sizeof(lockmode_to_string_map[0]);
 
 
+/* config variable managed via guc.c */
+int ShardLockEscalationThreshold = 0;
+
+
 /* local function forward declarations */
 static LOCKMODE IntToLockMode(int mode);
 static void LockReferencedReferenceShardResources(uint64 shardId, LOCKMODE lockMode);
 static void LockShardListResources(List *shardIntervalList, LOCKMODE lockMode);
-static void LockShardListResourcesOnFirstWorker(LOCKMODE lockmode,
-												List *shardIntervalList);
-static bool IsFirstWorkerNode();
+static void LockShardListResourcesOnOwnerNodes(LOCKMODE lockMode,
+											   List *shardIntervalList);
+static WorkerNode * ShardResourceLockOwnerNode(uint64 shardId, List *workerNodeList);
+static void LockShardListResourcesOnNode(WorkerNode *workerNode, LOCKMODE lockMode,
+										 List *shardIntervalList);
 static void CitusRangeVarCallbackForLockTable(const RangeVar *rangeVar, Oid relationId,
 											  Oid oldRelationId, void *arg);
 static AclResult CitusLockTableAclCheck(Oid relationId, LOCKMODE lockmode, Oid userId);
 static void SetLocktagForShardDistributionMetadata(int64 shardId, LOCKTAG *tag);
+static void LockShardRangeResource(uint64 rangeId, LOCKMODE lockMode);
+static LOCKMODE ShardRangeIntentionLockMode(LOCKMODE shardLockMode);
+static LOCKMODE ShardRangeEscalatedLockMode(LOCKMODE shardLockMode);
+static int CompareUInt64(const void *leftElement, const void *rightElement);
 
 
 /* exports for SQL callable functions */
@@ -162,23 +172,104 @@ lock_shard_resources(PG_FUNCTION_ARGS)
 
 
 /*
- * LockShardListResourcesOnFirstWorker acquires the resource locks for the specified
- * shards on the first worker. Acquiring a lock with or without metadata does not
- * matter for us. So, worker does not have to be an MX node, acquiring the lock
- * on any worker node is enough. Note that the function does not sort the shard list,
- * therefore the caller should sort the shard list in order to avoid deadlocks.
+ * LockShardListResourcesOnOwnerNodes acquires the resource locks for the specified
+ * shards on the nodes that own the locks. To avoid all writes to reference tables
+ * queueing on a single node, the ownership of the locks is spread across the
+ * worker nodes by shard ID, see ShardResourceLockOwnerNode.
+ *
+ * The locks are acquired in the order of shard ID, regardless of the node that
+ * owns them, such that concurrent writers on different nodes cannot deadlock.
+ * Consecutive shards with the same owner are locked in a single round trip, and
+ * locks owned by the local node are acquired without a round trip.
  */
 static void
-LockShardListResourcesOnFirstWorker(LOCKMODE lockmode, List *shardIntervalList)
+LockShardListResourcesOnOwnerNodes(LOCKMODE lockMode, List *shardIntervalList)
 {
+	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+	if (list_length(workerNodeList) == 0)
+	{
+		/* no other nodes to serialize with */
+		return;
+	}
+
+	/* all nodes need to agree on the owner of a lock */
+	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
+
+	/* lock shards in order of shard id to prevent deadlock */
+	shardIntervalList = SortList(shardIntervalList, CompareShardIntervalsById);
+
+	WorkerNode *currentOwnerNode = NULL;
+	List *currentShardIntervalList = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		WorkerNode *ownerNode =
+			ShardResourceLockOwnerNode(shardInterval->shardId, workerNodeList);
+
+		if (ownerNode != currentOwnerNode && currentShardIntervalList != NIL)
+		{
+			LockShardListResourcesOnNode(currentOwnerNode, lockMode,
+										 currentShardIntervalList);
+			currentShardIntervalList = NIL;
+		}
+
+		currentOwnerNode = ownerNode;
+		currentShardIntervalList = lappend(currentShardIntervalList, shardInterval);
+	}
+
+	if (currentShardIntervalList != NIL)
+	{
+		LockShardListResourcesOnNode(currentOwnerNode, lockMode,
+									 currentShardIntervalList);
+	}
+}
+
+
+/*
+ * ShardResourceLockOwnerNode returns the node in the sorted worker node list
+ * that owns the resource lock of the given shard.
+ */
+static WorkerNode *
+ShardResourceLockOwnerNode(uint64 shardId, List *workerNodeList)
+{
+	int ownerNodeIndex = shardId % list_length(workerNodeList);
+
+	return (WorkerNode *) list_nth(workerNodeList, ownerNodeIndex);
+}
+
+
+/*
+ * LockShardListResourcesOnNode acquires the resource locks for the specified
+ * shards on the given node. Acquiring a lock with or without metadata does not
+ * matter for us. So, the node does not have to be an MX node. If the node is
+ * the local node, we skip acquiring the locks remotely to avoid an extra
+ * round-trip and/or self-deadlocks. Note that the function does not sort the
+ * shard list, therefore the caller should sort the shard list in order to
+ * avoid deadlocks.
+ */
+static void
+LockShardListResourcesOnNode(WorkerNode *workerNode, LOCKMODE lockMode,
+							 List *shardIntervalList)
+{
+	if (workerNode->groupId == GetLocalGroupId())
+	{
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			LockShardResource(shardInterval->shardId, lockMode);
+		}
+
+		return;
+	}
+
 	StringInfo lockCommand = makeStringInfo();
 	int processedShardIntervalCount = 0;
 	int totalShardIntervalCount = list_length(shardIntervalList);
-	WorkerNode *firstWorkerNode = GetFirstPrimaryWorkerNode();
 	int connectionFlags = 0;
 	const char *superuser = CitusExtensionOwnerName();
 
-	appendStringInfo(lockCommand, "SELECT lock_shard_resources(%d, ARRAY[", lockmode);
+	appendStringInfo(lockCommand, "SELECT lock_shard_resources(%d, ARRAY[", lockMode);
 
 	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
@@ -203,50 +294,19 @@ LockShardListResourcesOnFirstWorker(LOCKMODE lockmode, List *shardIntervalList)
 	 * Use the superuser connection to make sure we are allowed to lock.
 	 * This also helps ensure we only use one connection.
 	 */
-	MultiConnection *firstWorkerConnection = GetNodeUserDatabaseConnection(
-		connectionFlags,
-		firstWorkerNode
-		->workerName,
-		firstWorkerNode
-		->workerPort,
-		superuser,
-		NULL);
+	MultiConnection *connection = GetNodeUserDatabaseConnection(connectionFlags,
+																workerNode->workerName,
+																workerNode->workerPort,
+																superuser, NULL);
 
 	/* the SELECT .. FOR UPDATE breaks if we lose the connection */
-	MarkRemoteTransactionCritical(firstWorkerConnection);
+	MarkRemoteTransactionCritical(connection);
 
 	/* make sure we are in a tranasaction block to hold the lock until commit */
-	RemoteTransactionBeginIfNecessary(firstWorkerConnection);
+	RemoteTransactionBeginIfNecessary(connection);
 
-	/* grab the lock on the first worker node */
-	ExecuteCriticalRemoteCommand(firstWorkerConnection, lockCommand->data);
-}
-
-
-/*
- * IsFirstWorkerNode checks whether the node is the first worker node sorted
- * according to the host name and port number.
- */
-static bool
-IsFirstWorkerNode()
-{
-	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
-
-	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
-
-	if (list_length(workerNodeList) == 0)
-	{
-		return false;
-	}
-
-	WorkerNode *firstWorkerNode = (WorkerNode *) linitial(workerNodeList);
-
-	if (firstWorkerNode->groupId == GetLocalGroupId())
-	{
-		return true;
-	}
-
-	return false;
+	/* grab the lock on the owner node */
+	ExecuteCriticalRemoteCommand(connection, lockCommand->data);
 }
 
 
@@ -319,6 +379,23 @@ IntToLockMode(int mode)
 }
 
 
+/*
+ * LockShardMove returns after acquiring a lock that is held for the duration
+ * of a move or copy of the shard that does not block writes to it, such that
+ * only one of those runs at a time.
+ */
+void
+LockShardMove(uint64 shardId, LOCKMODE lockMode)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = false;
+
+	SET_LOCKTAG_SHARD_MOVE(tag, MyDatabaseId, shardId);
+	(void) LockAcquire(&tag, lockMode, sessionLock, dontWait);
+}
+
+
 /*
  * LockColocationId returns after acquiring a co-location ID lock, typically used
  * for rebalancing and replication.
@@ -461,16 +538,15 @@ LockReferencedReferenceShardResources(uint64 shardId, LOCKMODE lockMode)
 		GetSortedReferenceShardIntervals(referencedRelationList);
 
 	if (list_length(referencedShardIntervalList) > 0 &&
-		ClusterHasKnownMetadataWorkers() &&
-		!IsFirstWorkerNode())
+		ClusterHasKnownMetadataWorkers())
 	{
 		/*
 		 * When there is metadata, all nodes can write to the reference table,
 		 * but the writes need to be serialised. To achieve that, all nodes will
-		 * take the shard resource lock on the first worker node via RPC, except
-		 * for the first worker node which will just take it the regular way.
+		 * take the shard resource lock on the node that owns it via RPC, except
+		 * for the owner node itself which will just take it the regular way.
 		 */
-		LockShardListResourcesOnFirstWorker(lockMode, referencedShardIntervalList);
+		LockShardListResourcesOnOwnerNodes(lockMode, referencedShardIntervalList);
 	}
 
 	ShardInterval *referencedShardInterval = NULL;
@@ -514,6 +590,11 @@ GetSortedReferenceShardIntervals(List *relationList)
  * This task may be assigned to multiple backends at the same time, so the lock
  * manages any concurrency issues associated with shard file fetching and DML
  * command execution.
+ *
+ * When shard lock escalation is enabled, we first take an intention lock on
+ * the range of shard IDs that the shard belongs to, such that the shard lock
+ * conflicts with escalated locks of multi-shard modifications on that range
+ * (see LockShardRangeResources).
  */
 void
 LockShardResource(uint64 shardId, LOCKMODE lockmode)
@@ -524,13 +605,23 @@ LockShardResource(uint64 shardId, LOCKMODE lockmode)
 
 	AssertArg(shardId != INVALID_SHARD_ID);
 
+	if (ShardLockEscalationThreshold > 0)
+	{
+		LockShardRangeResource(shardId / SHARD_RESOURCE_RANGE_SIZE,
+							   ShardRangeIntentionLockMode(lockmode));
+	}
+
 	SET_LOCKTAG_SHARD_RESOURCE(tag, MyDatabaseId, shardId);
 
 	(void) LockAcquire(&tag, lockmode, sessionLock, dontWait);
 }
 
 
-/* Releases the lock associated with the relay file fetching/DML task. */
+/*
+ * Releases the lock associated with the relay file fetching/DML task. An
+ * intention lock on the range of the shard is kept until the end of the
+ * transaction, since other shards in the range may still be locked.
+ */
 void
 UnlockShardResource(uint64 shardId, LOCKMODE lockmode)
 {
@@ -543,6 +634,156 @@ UnlockShardResource(uint64 shardId, LOCKMODE lockmode)
 }
 
 
+/*
+ * LockShardRangeResources takes the locks that a multi-shard modification
+ * would take on the given shards with the given lock mode, but as a lock on
+ * each range of SHARD_RESOURCE_RANGE_SIZE shard IDs that the shards belong to,
+ * rather than a lock per shard. This keeps the number of locks of modifications
+ * on many shards low, such that they do not exhaust the shared lock table.
+ *
+ * Locks on individual shards take a weak intention lock on their range (see
+ * LockShardResource), and the mode of the escalated lock is chosen such that
+ * it conflicts with the intention lock whenever the lock on the individual
+ * shards would conflict. Escalated locks may conflict where shard locks would
+ * not, but never the other way around.
+ */
+void
+LockShardRangeResources(uint64 *shardIdArray, int shardIdCount, LOCKMODE lockMode)
+{
+	LOCKMODE rangeLockMode = ShardRangeEscalatedLockMode(lockMode);
+	uint64 *rangeIdArray = palloc0(shardIdCount * sizeof(uint64));
+
+	for (int shardIdIndex = 0; shardIdIndex < shardIdCount; shardIdIndex++)
+	{
+		rangeIdArray[shardIdIndex] = shardIdArray[shardIdIndex] /
+									 SHARD_RESOURCE_RANGE_SIZE;
+	}
+
+	/* lock ranges in order of range ID to prevent deadlock */
+	qsort(rangeIdArray, shardIdCount, sizeof(uint64), CompareUInt64);
+
+	for (int rangeIdIndex = 0; rangeIdIndex < shardIdCount; rangeIdIndex++)
+	{
+		uint64 rangeId = rangeIdArray[rangeIdIndex];
+
+		if (rangeIdIndex > 0 && rangeIdArray[rangeIdIndex - 1] == rangeId)
+		{
+			continue;
+		}
+
+		LockShardRangeResource(rangeId, rangeLockMode);
+	}
+
+	pfree(rangeIdArray);
+}
+
+
+/*
+ * LockShardRangeResource acquires a lock on the given range of shard IDs.
+ */
+static void
+LockShardRangeResource(uint64 rangeId, LOCKMODE lockMode)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = false;
+
+	SET_LOCKTAG_SHARD_RANGE_RESOURCE(tag, MyDatabaseId, rangeId);
+
+	(void) LockAcquire(&tag, lockMode, sessionLock, dontWait);
+}
+
+
+/*
+ * ShardRangeIntentionLockMode returns the mode of the lock on the range of
+ * a shard that is taken along with a lock on the shard in the given mode.
+ * Intention locks never conflict with each other, so shard locks that do not
+ * conflict with each other remain that way.
+ */
+static LOCKMODE
+ShardRangeIntentionLockMode(LOCKMODE shardLockMode)
+{
+	switch (shardLockMode)
+	{
+		case AccessShareLock:
+		case RowShareLock:
+		case RowExclusiveLock:
+		{
+			/* only conflicts with ranges locked for ExclusiveLock or stronger */
+			return AccessShareLock;
+		}
+
+		case ShareUpdateExclusiveLock:
+		{
+			/* also conflicts with ranges locked for ShareUpdateExclusiveLock */
+			return RowShareLock;
+		}
+
+		default:
+		{
+			/* conflicts with all locks on ranges */
+			return RowExclusiveLock;
+		}
+	}
+}
+
+
+/*
+ * ShardRangeEscalatedLockMode returns the mode of the lock on a range of
+ * shards that replaces locks on the individual shards in the given mode.
+ *
+ * An escalated RowExclusiveLock becomes a ShareLock, which does not conflict
+ * with itself or with any intention lock for commutative writes. An escalated
+ * ShareUpdateExclusiveLock becomes an ExclusiveLock, which conflicts with
+ * itself and with all intention locks except those for commutative writes.
+ * Stronger locks become an AccessExclusiveLock, which conflicts with
+ * everything.
+ */
+static LOCKMODE
+ShardRangeEscalatedLockMode(LOCKMODE shardLockMode)
+{
+	switch (shardLockMode)
+	{
+		case RowExclusiveLock:
+		{
+			return ShareLock;
+		}
+
+		case ShareUpdateExclusiveLock:
+		{
+			return ExclusiveLock;
+		}
+
+		default:
+		{
+			return AccessExclusiveLock;
+		}
+	}
+}
+
+
+/*
+ * CompareUInt64 is a comparator for sorting an array of uint64 values.
+ */
+static int
+CompareUInt64(const void *leftElement, const void *rightElement)
+{
+	uint64 leftValue = *((const uint64 *) leftElement);
+	uint64 rightValue = *((const uint64 *) rightElement);
+
+	if (leftValue < rightValue)
+	{
+		return -1;
+	}
+	else if (leftValue > rightValue)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
 /*
  * LockJobResource acquires a lock for creating resources associated with the
  * given jobId. This resource is typically a job schema (namespace), and less
@@ -620,13 +861,13 @@ LockShardsInPlacementListMetadata(List *shardPlacementList, LOCKMODE lockMode)
  * writes on the given shards.
  *
  * If the modified shard is a reference table's shard and the cluster is an MX
- * cluster we need to get shard resource lock on the first worker node to
- * prevent divergence possibility between placements of the reference table.
+ * cluster we need to get shard resource lock on the node that owns the lock
+ * to prevent divergence possibility between placements of the reference table.
  *
- * In other workers, by acquiring a lock on the first worker, we're serializing
- * non-commutative modifications to a reference table. If the node executing the
- * command is the first worker, defined via IsFirstWorker(), we skip acquiring
- * the lock remotely to avoid an extra round-trip and/or self-deadlocks.
+ * By acquiring the lock on the owner node, we're serializing non-commutative
+ * modifications to a reference table across all nodes. The ownership of the
+ * locks is spread across the worker nodes by shard ID, such that writes to
+ * different reference tables do not all queue on the same node.
  *
  * Finally, if we're not dealing with reference tables on MX cluster, we'll
  * always acquire the lock with LockShardListResources() call.
@@ -639,9 +880,9 @@ SerializeNonCommutativeWrites(List *shardIntervalList, LOCKMODE lockMode)
 
 	if (ReferenceTableShardId(firstShardId))
 	{
-		if (ClusterHasKnownMetadataWorkers() && !IsFirstWorkerNode())
+		if (ClusterHasKnownMetadataWorkers())
 		{
-			LockShardListResourcesOnFirstWorker(lockMode, shardIntervalList);
+			LockShardListResourcesOnOwnerNodes(lockMode, shardIntervalList);
 		}
 
 		/*
@@ -706,18 +947,36 @@ LockRelationShardResources(List *relationShardList, LOCKMODE lockMode)
  */
 void
 LockParentShardResourceIfPartition(uint64 shardId, LOCKMODE lockMode)
+{
+	uint64 parentShardId = ParentShardIdIfPartition(shardId);
+
+	if (parentShardId != INVALID_SHARD_ID)
+	{
+		LockShardResource(parentShardId, lockMode);
+	}
+}
+
+
+/*
+ * ParentShardIdIfPartition returns the ID of the colocated shard of the parent
+ * table if the given shard belongs to a partition, and INVALID_SHARD_ID
+ * otherwise.
+ */
+uint64
+ParentShardIdIfPartition(uint64 shardId)
 {
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
 
-	if (PartitionTable(relationId))
+	if (!PartitionTable(relationId))
 	{
-		int shardIndex = ShardIndex(shardInterval);
-		Oid parentRelationId = PartitionParentOid(relationId);
-		uint64 parentShardId = ColocatedShardIdInRelation(parentRelationId, shardIndex);
-
-		LockShardResource(parentShardId, lockMode);
+		return INVALID_SHARD_ID;
 	}
+
+	int shardIndex = ShardIndex(shardInterval);
+	Oid parentRelationId = PartitionParentOid(relationId);
+
+	return ColocatedShardIdInRelation(parentRelationId, shardIndex);
 }
 
 
@@ -11,6 +11,7 @@
 #include "stdint.h"
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
@@ -24,6 +25,7 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/worker_protocol.h"
 #include "utils/catcache.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
 
 
@@ -281,9 +283,9 @@ FindShardInterval(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry)
 
 	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
 	{
-		searchedValue = FunctionCall1Coll(cacheEntry->hashFunction,
-										  cacheEntry->partitionColumn->varcollid,
-										  partitionColumnValue);
+		searchedValue = HashPartitionColumnValue(cacheEntry->hashFunction,
+												 cacheEntry->partitionColumn->varcollid,
+												 partitionColumnValue);
 	}
 
 	int shardIndex = FindShardIntervalIndex(searchedValue, cacheEntry);
@@ -325,7 +327,29 @@ FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 		return INVALID_SHARD_INDEX;
 	}
 
-	if (partitionMethod == DISTRIBUTE_BY_HASH)
+	if (useBinarySearch && cacheEntry->sortedShardMinValues != NULL)
+	{
+		int64 searchedBound = ShardBoundValue(searchedValue,
+											  cacheEntry->shardBoundTypeId);
+
+		/* the first shard that does not end before the value, if it contains it */
+		shardIndex = ShardBoundIndex(cacheEntry->sortedShardMaxValues, shardCount,
+									 searchedBound, true);
+		if (shardIndex == shardCount ||
+			cacheEntry->sortedShardMinValues[shardIndex] > searchedBound)
+		{
+			shardIndex = INVALID_SHARD_INDEX;
+		}
+
+		if (shardIndex == INVALID_SHARD_INDEX && partitionMethod == DISTRIBUTE_BY_HASH)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+							errmsg("cannot find shard interval"),
+							errdetail("Hash of the partition column value "
+									  "does not fall into any shards.")));
+		}
+	}
+	else if (partitionMethod == DISTRIBUTE_BY_HASH)
 	{
 		if (useBinarySearch)
 		{
@@ -345,23 +369,17 @@ FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 										  "does not fall into any shards.")));
 			}
 		}
+		else if (cacheEntry->uniformHashShardIndexShift >= 0)
+		{
+			/* power of 2 shard count, all shards cover the same range */
+			uint64 hashToken = (uint32) (DatumGetInt32(searchedValue) - INT32_MIN);
+
+			shardIndex = (int) (hashToken >> cacheEntry->uniformHashShardIndexShift);
+		}
 		else
 		{
-			int hashedValue = DatumGetInt32(searchedValue);
-			uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
-
-			shardIndex = (uint32) (hashedValue - INT32_MIN) / hashTokenIncrement;
-			Assert(shardIndex <= shardCount);
-
-			/*
-			 * If the shard count is not power of 2, the range of the last
-			 * shard becomes larger than others. For that extra piece of range,
-			 * we still need to use the last shard.
-			 */
-			if (shardIndex == shardCount)
-			{
-				shardIndex = shardCount - 1;
-			}
+			shardIndex = UniformHashShardIndex(DatumGetInt32(searchedValue),
+											   shardCount);
 		}
 	}
 	else if (partitionMethod == DISTRIBUTE_BY_NONE)
@@ -385,6 +403,196 @@ FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 }
 
 
+/*
+ * UniformHashShardIndex returns the index of the shard that covers the given
+ * hash value, when the shards have a uniform hash distribution.
+ */
+int
+UniformHashShardIndex(int32 hashedValue, int shardCount)
+{
+	uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
+
+	int shardIndex = (uint32) (hashedValue - INT32_MIN) / hashTokenIncrement;
+	Assert(shardIndex <= shardCount);
+
+	/*
+	 * If the shard count is not power of 2, the range of the last
+	 * shard becomes larger than others. For that extra piece of range,
+	 * we still need to use the last shard.
+	 */
+	if (shardIndex == shardCount)
+	{
+		shardIndex = shardCount - 1;
+	}
+
+	return shardIndex;
+}
+
+
+/*
+ * UniformHashShardIndexShift returns the number of bits to shift a hash token
+ * (the hash value minus INT32_MIN) to the right to get its shard index, when
+ * the shards have a uniform hash distribution. This only works if the shard
+ * count is a power of 2, otherwise the function returns -1.
+ */
+int
+UniformHashShardIndexShift(int shardCount)
+{
+	if (shardCount <= 0 || (shardCount & (shardCount - 1)) != 0)
+	{
+		return -1;
+	}
+
+	int shift = 32;
+	while (shardCount > 1)
+	{
+		shardCount >>= 1;
+		shift--;
+	}
+
+	return shift;
+}
+
+
+/*
+ * HashPartitionColumnValue returns the hash of the given partition column
+ * value using the given hash function. The hash functions of int4 and int8,
+ * which are by far the most common distribution column types, are computed
+ * inline to avoid the function call overhead when partitioning many rows.
+ * Other types go through the function manager.
+ */
+Datum
+HashPartitionColumnValue(FmgrInfo *hashFunction, Oid collation, Datum value)
+{
+	switch (hashFunction->fn_oid)
+	{
+		case F_HASHINT4:
+		{
+			/* same as hashint4() */
+			return hash_uint32((uint32) DatumGetInt32(value));
+		}
+
+		case F_HASHINT8:
+		{
+			/* same as hashint8(), which is compatible with hashint4() */
+			int64 int64Value = DatumGetInt64(value);
+			uint32 lowHalf = (uint32) int64Value;
+			uint32 highHalf = (uint32) (int64Value >> 32);
+
+			lowHalf ^= (int64Value >= 0) ? highHalf : ~highHalf;
+
+			return hash_uint32(lowHalf);
+		}
+
+		default:
+		{
+			return FunctionCall1Coll(hashFunction, collation, value);
+		}
+	}
+}
+
+
+/*
+ * BuildSortedShardBoundArrays sets the contiguous arrays of the min and max
+ * values of the sorted shard intervals of the given cache entry, if its shard
+ * intervals are int4 or int8 ranges that are all initialized and do not
+ * overlap, which holds for all hash distributed tables. The arrays are
+ * allocated in the current memory context.
+ */
+void
+BuildSortedShardBoundArrays(CitusTableCacheEntry *cacheEntry)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	cacheEntry->sortedShardMinValues = NULL;
+	cacheEntry->sortedShardMaxValues = NULL;
+	cacheEntry->shardBoundTypeId = InvalidOid;
+
+	if (shardCount == 0 || cacheEntry->hasUninitializedShardInterval ||
+		cacheEntry->hasOverlappingShardInterval)
+	{
+		return;
+	}
+
+	Oid shardBoundTypeId = sortedShardIntervalArray[0]->valueTypeId;
+	if (shardBoundTypeId != INT4OID && shardBoundTypeId != INT8OID)
+	{
+		return;
+	}
+
+	int64 *sortedShardMinValues = palloc(shardCount * sizeof(int64));
+	int64 *sortedShardMaxValues = palloc(shardCount * sizeof(int64));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+
+		sortedShardMinValues[shardIndex] =
+			ShardBoundValue(shardInterval->minValue, shardBoundTypeId);
+		sortedShardMaxValues[shardIndex] =
+			ShardBoundValue(shardInterval->maxValue, shardBoundTypeId);
+	}
+
+	cacheEntry->sortedShardMinValues = sortedShardMinValues;
+	cacheEntry->sortedShardMaxValues = sortedShardMaxValues;
+	cacheEntry->shardBoundTypeId = shardBoundTypeId;
+}
+
+
+/*
+ * ShardBoundValue returns the given int4 or int8 shard bound or partition
+ * column value as an int64.
+ */
+int64
+ShardBoundValue(Datum value, Oid shardBoundTypeId)
+{
+	if (shardBoundTypeId == INT8OID)
+	{
+		return DatumGetInt64(value);
+	}
+
+	return (int64) DatumGetInt32(value);
+}
+
+
+/*
+ * ShardBoundIndex returns the index of the first of the sorted bounds that is
+ * greater than or equal to (if includeValue) or greater than the given value,
+ * or boundCount if there is none.
+ *
+ * The loop halves the search range without branching on the comparison, which
+ * compilers turn into a conditional move, so the search does not suffer from
+ * branch mispredictions.
+ */
+int
+ShardBoundIndex(int64 *sortedBounds, int boundCount, int64 value, bool includeValue)
+{
+	int64 *base = sortedBounds;
+	int remainingCount = boundCount;
+
+	if (boundCount == 0)
+	{
+		return 0;
+	}
+
+	while (remainingCount > 1)
+	{
+		int halfCount = remainingCount / 2;
+		int64 middleBound = base[halfCount - 1];
+		bool middleBoundBefore = includeValue ? middleBound < value :
+								 middleBound <= value;
+
+		base = middleBoundBefore ? base + halfCount : base;
+		remainingCount -= halfCount;
+	}
+
+	bool lastBoundBefore = includeValue ? *base < value : *base <= value;
+
+	return (int) (base - sortedBounds) + (lastBoundBefore ? 1 : 0);
+}
+
+
 /*
  * SearchCachedShardInterval performs a binary search for a shard interval
  * matching a given partition column value and returns it's index in the cached
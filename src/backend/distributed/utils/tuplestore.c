@@ -10,9 +10,28 @@
 
 #include "postgres.h"
 
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_13
+#include "access/toast_internals.h"
+#else
+#include "access/tuptoaster.h"
+#endif
 #include "distributed/tuplestore.h"
 #include "miscadmin.h"
 
+
+/*
+ * Values that are smaller than this are not worth compressing, and pglz
+ * refuses to compress values below 32 bytes anyway.
+ */
+#define SPILL_COMPRESSION_MIN_VALUE_SIZE 128
+
+
+/* config variable managed via guc.c */
+bool CompressSpilledResults = false;
+
+
 /*
  * CheckTuplestoreReturn checks if a tuplestore can be returned in the callsite
  * of the UDF.
@@ -84,3 +103,51 @@ SetupTuplestore(FunctionCallInfo fcinfo, TupleDesc *tupleDescriptor)
 
 	return tupstore;
 }
+
+
+/*
+ * CompressValuesForTuplestore replaces the large variable-length values among
+ * the given values by pglz-compressed copies, if citus.compress_spilled_results
+ * is enabled and the given tuple store already spilled to a temporary file.
+ *
+ * Compressed values are stored in the tuple store as they are, which reduces
+ * the size of its temporary file for text-heavy results, and they are
+ * decompressed transparently when they are used, like compressed values in a
+ * heap page. Values that do not compress well are left as they are. The
+ * compressed copies are allocated in the current memory context.
+ */
+void
+CompressValuesForTuplestore(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor,
+							Datum *values, bool *nulls)
+{
+	if (!CompressSpilledResults || tuplestore_in_memory(tupleStore))
+	{
+		return;
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (attributeForm->attlen != -1 || attributeForm->attisdropped ||
+			nulls[columnIndex])
+		{
+			continue;
+		}
+
+		struct varlena *value = (struct varlena *) DatumGetPointer(values[columnIndex]);
+
+		/* skip values that are short, compressed or stored elsewhere already */
+		if (VARATT_IS_EXTENDED(value) ||
+			VARSIZE(value) < SPILL_COMPRESSION_MIN_VALUE_SIZE)
+		{
+			continue;
+		}
+
+		Datum compressedValue = toast_compress_datum(values[columnIndex]);
+		if (DatumGetPointer(compressedValue) != NULL)
+		{
+			values[columnIndex] = compressedValue;
+		}
+	}
+}
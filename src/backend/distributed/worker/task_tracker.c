@@ -27,10 +27,12 @@
 
 #include "postgres.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include <unistd.h>
 
 #include "commands/dbcommands.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
@@ -51,6 +53,7 @@
 #include "storage/shmem.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 
 int TaskTrackerDelay = 200;       /* process sleep interval in millisecs */
@@ -68,6 +71,9 @@ static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static volatile sig_atomic_t got_SIGHUP = false;
 static volatile sig_atomic_t got_SIGTERM = false;
 
+/* time at which files were last removed from the trash directory */
+static TimestampTz LastTrashCleanupTime = 0;
+
 /* initialization forward declarations */
 static Size TaskTrackerShmemSize(void);
 static void TaskTrackerShmemInit(void);
@@ -81,15 +87,17 @@ static void TrackerCleanupJobSchemas(void);
 static void TrackerCleanupConnections(HTAB *WorkerTasksHash);
 static void TrackerRegisterShutDown(HTAB *WorkerTasksHash);
 static void TrackerDelayLoop(void);
+static void TrackerRemoveTrashedFiles(void);
 static List * SchedulableTaskList(HTAB *WorkerTasksHash);
 static WorkerTask * SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash);
 static uint32 CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
 										 bool (*CriteriaFunction)(WorkerTask *));
 static bool RunningTask(WorkerTask *workerTask);
 static bool SchedulableTask(WorkerTask *workerTask);
-static int CompareTasksByTime(const void *first, const void *second);
+static int CompareTasksByPriority(const void *first, const void *second);
 static void ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList);
 static void ManageWorkerTasksHash(HTAB *WorkerTasksHash);
+static void WakeTaskStatusWaiters(void);
 static void ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void RemoveWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void CreateJobDirectoryIfNotExists(uint64 jobId);
@@ -209,6 +217,11 @@ TaskTrackerMain(Datum main_arg)
 	/* We can now handle ereport(ERROR) */
 	PG_exception_stack = &local_sigjmp_buf;
 
+	/* let task assignments wake us up */
+	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	WorkerTasksSharedState->taskTrackerLatch = MyLatch;
+	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+
 	/*
 	 * We run validation and cache cleanup functions as this process is starting
 	 * up. If these functions throw an error, we won't try running them again.
@@ -230,11 +243,6 @@ TaskTrackerMain(Datum main_arg)
 		/*
 		 * Emergency bailout if postmaster has died. This is to avoid the
 		 * necessity for manual cleanup of all postmaster children.
-		 *
-		 * XXX: Note that PostgreSQL background processes no longer nap between
-		 * their loops, but instead uses latches to wake up when necessary. We
-		 * should switch to using latches in here too, and have the task tracker
-		 * assign function notify us when there is a new task.
 		 */
 		if (!PostmasterIsAlive())
 		{
@@ -270,6 +278,9 @@ TaskTrackerMain(Datum main_arg)
 		/* Call the function that does the actual work */
 		ManageWorkerTasksHash(TaskTrackerTaskHash);
 
+		/* remove the files of directories that were moved to the trash */
+		TrackerRemoveTrashedFiles();
+
 		/* Sleep for the configured time */
 		TrackerDelayLoop();
 	}
@@ -332,6 +343,103 @@ WorkerTasksHashFind(uint64 jobId, uint32 taskId)
 }
 
 
+/*
+ * WorkerTaskFinished returns whether the given worker task reached a status in
+ * which the master node stops waiting on it.
+ */
+bool
+WorkerTaskFinished(WorkerTask *workerTask)
+{
+	TaskStatus taskStatus = workerTask->taskStatus;
+
+	return taskStatus == TASK_SUCCEEDED || taskStatus == TASK_PERMANENTLY_FAILED ||
+		   taskStatus == TASK_CANCELED || taskStatus == TASK_TO_REMOVE;
+}
+
+
+/*
+ * RegisterTaskStatusWaiter registers the current backend to be woken up by the
+ * task tracker whenever a task finishes. The function returns false if all
+ * waiter slots are taken, in which case the caller needs to poll. Note that
+ * the caller needs to hold an exclusive lock over the shared hash.
+ */
+bool
+RegisterTaskStatusWaiter(void)
+{
+	int waiterCount = WorkerTasksSharedState->taskStatusWaiterCount;
+	if (waiterCount >= MAX_TASK_STATUS_WAITERS)
+	{
+		return false;
+	}
+
+	WorkerTasksSharedState->taskStatusWaiters[waiterCount] = MyProc->pgprocno;
+	WorkerTasksSharedState->taskStatusWaiterCount++;
+
+	return true;
+}
+
+
+/*
+ * UnregisterTaskStatusWaiter removes the current backend from the backends
+ * waiting for task completion. Note that the caller needs to hold an exclusive
+ * lock over the shared hash.
+ */
+void
+UnregisterTaskStatusWaiter(void)
+{
+	int waiterCount = WorkerTasksSharedState->taskStatusWaiterCount;
+	int *waiters = WorkerTasksSharedState->taskStatusWaiters;
+
+	for (int waiterIndex = 0; waiterIndex < waiterCount; waiterIndex++)
+	{
+		if (waiters[waiterIndex] == MyProc->pgprocno)
+		{
+			waiters[waiterIndex] = waiters[waiterCount - 1];
+			WorkerTasksSharedState->taskStatusWaiterCount--;
+			break;
+		}
+	}
+}
+
+
+/*
+ * WakeTaskStatusWaiters sets the latches of all backends waiting for a task to
+ * finish. Note that the caller needs to hold an exclusive lock over the shared
+ * hash.
+ */
+static void
+WakeTaskStatusWaiters(void)
+{
+	int waiterCount = WorkerTasksSharedState->taskStatusWaiterCount;
+
+	for (int waiterIndex = 0; waiterIndex < waiterCount; waiterIndex++)
+	{
+		int pgprocno = WorkerTasksSharedState->taskStatusWaiters[waiterIndex];
+
+		SetLatch(&ProcGlobal->allProcs[pgprocno].procLatch);
+	}
+}
+
+
+/*
+ * WakeTaskTracker sets the task tracker's latch so that it schedules newly
+ * assigned tasks without waiting for its next round.
+ */
+void
+WakeTaskTracker(void)
+{
+	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+
+	Latch *taskTrackerLatch = WorkerTasksSharedState->taskTrackerLatch;
+	if (taskTrackerLatch != NULL)
+	{
+		SetLatch(taskTrackerLatch);
+	}
+
+	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+}
+
+
 /*
  * TrackerCleanupJobDirectories cleans up all files in the job cache directory
  * as part of this process's start-up logic. The task tracker process manages
@@ -351,6 +459,9 @@ TrackerCleanupJobDirectories(void)
 	CitusCreateDirectory(jobCacheDirectory);
 
 	FreeStringInfo(jobCacheDirectory);
+
+	/* intermediate results may also be stored outside of the data directory */
+	RemoveIntermediateResultScratchDirectories();
 }
 
 
@@ -393,6 +504,7 @@ TrackerCleanupJobSchemas(void)
 		 */
 		WorkerTask *cleanupTask = WorkerTasksHashEnter(jobId, taskIndex);
 		cleanupTask->assignedAt = HIGH_PRIORITY_TASK_TIME;
+		cleanupTask->priority = HIGH_PRIORITY_TASK_PRIORITY;
 		cleanupTask->taskStatus = TASK_ASSIGNED;
 
 		strlcpy(cleanupTask->taskCallString, JOB_SCHEMA_CLEANUP, MaxTaskStringSize);
@@ -461,31 +573,56 @@ TrackerRegisterShutDown(HTAB *WorkerTasksHash)
 }
 
 
-/* Sleeps either for the configured time or until a signal is received. */
+/*
+ * Sleeps either for the configured time, until a signal is received, or until
+ * a new task is assigned.
+ */
 static void
 TrackerDelayLoop(void)
 {
-	const long SignalCheckInterval = 1000000L; /* check signal every second */
+	int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
 
-	/*
-	 * On some platforms, signals do not interrupt the sleep. To ensure we
-	 * respond promptly when someone signals us, we break down the sleep into
-	 * 1-second increments, and check for interrupts after each nap.
-	 */
-	long trackerDelay = TaskTrackerDelay * 1000L;
-	while (trackerDelay > (SignalCheckInterval - 1))
+	int rc = WaitLatch(MyLatch, latchFlags, TaskTrackerDelay, PG_WAIT_EXTENSION);
+
+	ResetLatch(MyLatch);
+
+	if (rc & WL_POSTMASTER_DEATH)
 	{
-		if (got_SIGHUP || got_SIGTERM)
-		{
-			break;
-		}
-		pg_usleep(SignalCheckInterval);
-		trackerDelay -= SignalCheckInterval;
+		exit(1);
+	}
+}
+
+
+/*
+ * TrackerRemoveTrashedFiles removes files from the directories that were
+ * moved to the trash, at most citus.deferred_cleanup_files_per_second per
+ * second, such that removing the files of large queries does not slow down
+ * other queries.
+ */
+static void
+TrackerRemoveTrashedFiles(void)
+{
+	TimestampTz currentTime = GetCurrentTimestamp();
+	double elapsedSeconds = TaskTrackerDelay / 1000.0;
+
+	if (LastTrashCleanupTime != 0)
+	{
+		elapsedSeconds = (currentTime - LastTrashCleanupTime) / (double) USECS_PER_SEC;
 	}
-	if (!(got_SIGHUP || got_SIGTERM))
+
+	/* do not save up more than a second worth of removals */
+	elapsedSeconds = Min(elapsedSeconds, 1.0);
+
+	double maxFileCount = DeferredCleanupFilesPerSecond * elapsedSeconds;
+	if (maxFileCount < 1.0)
 	{
-		pg_usleep(trackerDelay);
+		/* wait until at least one file may be removed */
+		return;
 	}
+
+	LastTrashCleanupTime = currentTime;
+
+	RemoveTrashedFiles((int) Min(maxFileCount, (double) INT_MAX));
 }
 
 
@@ -586,6 +723,8 @@ TaskTrackerShmemInit(void)
 						 WorkerTasksSharedState->taskHashTrancheId);
 
 		WorkerTasksSharedState->conninfosValid = true;
+		WorkerTasksSharedState->taskTrackerLatch = NULL;
+		WorkerTasksSharedState->taskStatusWaiterCount = 0;
 	}
 
 	/*  allocate hash table */
@@ -693,12 +832,13 @@ SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
 	{
 		if (SchedulableTask(currentTask))
 		{
-			/* tasks in the priority queue only need the first three fields */
+			/* tasks in the priority queue only need the first four fields */
 			WorkerTask *queueTask = WORKER_TASK_AT(priorityQueue, queueIndex);
 
 			queueTask->jobId = currentTask->jobId;
 			queueTask->taskId = currentTask->taskId;
 			queueTask->assignedAt = currentTask->assignedAt;
+			queueTask->priority = currentTask->priority;
 
 			queueIndex++;
 		}
@@ -707,7 +847,7 @@ SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
 	}
 
 	/* now order elements in the queue according to our sorting criterion */
-	SafeQsort(priorityQueue, queueSize, WORKER_TASK_SIZE, CompareTasksByTime);
+	SafeQsort(priorityQueue, queueSize, WORKER_TASK_SIZE, CompareTasksByPriority);
 
 	return priorityQueue;
 }
@@ -767,13 +907,22 @@ SchedulableTask(WorkerTask *workerTask)
 }
 
 
-/* Comparison function to compare two worker tasks by their assignment times. */
+/*
+ * Comparison function to compare two worker tasks by their priorities, and then
+ * by their assignment times.
+ */
 static int
-CompareTasksByTime(const void *first, const void *second)
+CompareTasksByPriority(const void *first, const void *second)
 {
 	WorkerTask *firstTask = (WorkerTask *) first;
 	WorkerTask *secondTask = (WorkerTask *) second;
 
+	/* tasks on longer dependency chains go first */
+	if (firstTask->priority != secondTask->priority)
+	{
+		return (firstTask->priority > secondTask->priority) ? -1 : 1;
+	}
+
 	/* tasks that are assigned earlier have higher priority */
 	int timeDiff = firstTask->assignedAt - secondTask->assignedAt;
 	return timeDiff;
@@ -832,6 +981,7 @@ static void
 ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 {
 	HASH_SEQ_STATUS status;
+	bool taskFinished = false;
 
 	/* ask the scheduler if we have new tasks to schedule */
 	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
@@ -858,8 +1008,16 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 	WorkerTask *currentTask = (WorkerTask *) hash_seq_search(&status);
 	while (currentTask != NULL)
 	{
+		TaskStatus previousStatus = currentTask->taskStatus;
+
 		ManageWorkerTask(currentTask, WorkerTasksHash);
 
+		if (currentTask->taskStatus != previousStatus &&
+			WorkerTaskFinished(currentTask))
+		{
+			taskFinished = true;
+		}
+
 		/*
 		 * Typically, we delete worker tasks in the task tracker protocol
 		 * process. This task however was canceled mid-query, and the protocol
@@ -873,6 +1031,12 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
 
+	/* let backends waiting on task completion know that something finished */
+	if (taskFinished)
+	{
+		WakeTaskStatusWaiters();
+	}
+
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 }
 
@@ -1028,7 +1192,7 @@ ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash)
 			if (workerTask->taskId == JOB_CLEANUP_TASK_ID)
 			{
 				StringInfo jobDirectoryName = JobDirectoryName(workerTask->jobId);
-				CitusRemoveDirectory(jobDirectoryName->data);
+				CitusRemoveDirectoryDeferred(jobDirectoryName->data);
 			}
 
 			workerTask->taskStatus = TASK_TO_REMOVE;
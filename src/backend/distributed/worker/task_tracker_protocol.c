@@ -16,6 +16,7 @@
 #include "postgres.h"
 #include "funcapi.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 
 #include <time.h>
 
@@ -35,21 +36,27 @@
 #include "distributed/worker_protocol.h"
 #include "storage/lwlock.h"
 #include "storage/pmsignal.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
 #include "utils/lsyscache.h"
 
 
 /* Local functions forward declarations */
 static bool TaskTrackerRunning(void);
-static void CreateTask(uint64 jobId, uint32 taskId, char *taskCallString);
-static void UpdateTask(WorkerTask *workerTask, char *taskCallString);
+static void CreateTask(uint64 jobId, uint32 taskId, uint32 priority,
+					   char *taskCallString);
+static void UpdateTask(WorkerTask *workerTask, uint32 priority, char *taskCallString);
 static void CleanupTask(WorkerTask *workerTask);
+static bool AnyWorkerTaskFinished(Datum *jobIdDatumArray, Datum *taskIdDatumArray,
+								  int taskCount);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(task_tracker_assign_task);
 PG_FUNCTION_INFO_V1(task_tracker_task_status);
+PG_FUNCTION_INFO_V1(task_tracker_wait_for_any);
 PG_FUNCTION_INFO_V1(task_tracker_cleanup_job);
 PG_FUNCTION_INFO_V1(task_tracker_conninfo_cache_invalidate);
 
@@ -57,7 +64,8 @@ PG_FUNCTION_INFO_V1(task_tracker_conninfo_cache_invalidate);
 /*
  * task_tracker_assign_task creates a new task in the shared hash or updates an
  * already existing task. The function also creates a schema for the job if it
- * doesn't already exist.
+ * doesn't already exist. The optional fourth argument is the task's scheduling
+ * priority; tasks assigned without one get the lowest priority.
  */
 Datum
 task_tracker_assign_task(PG_FUNCTION_ARGS)
@@ -65,6 +73,12 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 	uint64 jobId = PG_GETARG_INT64(0);
 	uint32 taskId = PG_GETARG_UINT32(1);
 	text *taskCallStringText = PG_GETARG_TEXT_P(2);
+	uint32 priority = 0;
+
+	if (PG_NARGS() > 3)
+	{
+		priority = PG_GETARG_UINT32(3);
+	}
 
 	StringInfo jobSchemaName = JobSchemaName(jobId);
 
@@ -119,15 +133,18 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 	WorkerTask *workerTask = WorkerTasksHashFind(jobId, taskId);
 	if (workerTask == NULL)
 	{
-		CreateTask(jobId, taskId, taskCallString);
+		CreateTask(jobId, taskId, priority, taskCallString);
 	}
 	else
 	{
-		UpdateTask(workerTask, taskCallString);
+		UpdateTask(workerTask, priority, taskCallString);
 	}
 
 	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
 
+	/* schedule the task right away instead of on the tracker's next round */
+	WakeTaskTracker();
+
 	PG_RETURN_VOID();
 }
 
@@ -174,6 +191,95 @@ task_tracker_task_status(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * task_tracker_wait_for_any blocks until any of the given tasks has succeeded,
+ * permanently failed, or been canceled, or until the given timeout in
+ * milliseconds has passed. The task tracker wakes us up as soon as it sees a
+ * task finish, which lets the master node learn about task completion without
+ * repeatedly polling task statuses. The function returns whether any of the
+ * tasks has finished.
+ */
+Datum
+task_tracker_wait_for_any(PG_FUNCTION_ARGS)
+{
+	ArrayType *jobIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType *taskIdArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	int32 timeout = PG_GETARG_INT32(2);
+	const long pollInterval = 10L; /* milliseconds, when out of waiter slots */
+	bool taskFinished = false;
+
+	CheckCitusVersion(ERROR);
+
+	int32 taskCount = ArrayObjectCount(jobIdArrayObject);
+	if (ArrayObjectCount(taskIdArrayObject) != taskCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("job id and task id arrays must have the same length")));
+	}
+
+	Datum *jobIdDatumArray = DeconstructArrayObject(jobIdArrayObject);
+	Datum *taskIdDatumArray = DeconstructArrayObject(taskIdArrayObject);
+
+	TimestampTz waitDeadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														   timeout);
+
+	for (;;)
+	{
+		long secondsRemaining = 0;
+		int microsecondsRemaining = 0;
+
+		LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+
+		taskFinished = AnyWorkerTaskFinished(jobIdDatumArray, taskIdDatumArray,
+											 taskCount);
+
+		TimestampDifference(GetCurrentTimestamp(), waitDeadline, &secondsRemaining,
+							&microsecondsRemaining);
+		long timeRemaining = secondsRemaining * 1000L + microsecondsRemaining / 1000;
+
+		if (taskFinished || timeRemaining <= 0)
+		{
+			LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+			break;
+		}
+
+		/*
+		 * We register while holding the lock so that a task finishing after our
+		 * check above still sets our latch before we go to sleep.
+		 */
+		bool waiterRegistered = RegisterTaskStatusWaiter();
+
+		LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+
+		if (!waiterRegistered)
+		{
+			timeRemaining = Min(timeRemaining, pollInterval);
+		}
+
+		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
+		int rc = WaitLatch(MyLatch, latchFlags, timeRemaining, PG_WAIT_EXTENSION);
+
+		ResetLatch(MyLatch);
+
+		if (waiterRegistered)
+		{
+			LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+			UnregisterTaskStatusWaiter();
+			LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+		}
+
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	PG_RETURN_BOOL(taskFinished);
+}
+
+
 /*
  * task_tracker_cleanup_job finds all tasks for the given job, and cleans up
  * files, connections, and shared hash enties associated with these tasks.
@@ -231,7 +337,7 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 	 * schema drop call can block if another process is creating the schema or
 	 * writing to a table within the schema.
 	 */
-	CitusRemoveDirectory(jobDirectoryName->data);
+	CitusRemoveDirectoryDeferred(jobDirectoryName->data);
 
 	RemoveJobSchema(jobSchemaName);
 	UnlockJobResource(jobId, AccessExclusiveLock);
@@ -359,7 +465,7 @@ CreateJobSchema(StringInfo schemaName, char *schemaOwner)
  * hold an exclusive lock over the shared hash.
  */
 static void
-CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
+CreateTask(uint64 jobId, uint32 taskId, uint32 priority, char *taskCallString)
 {
 	const char *databaseName = CurrentDatabaseName();
 	char *userName = CurrentUserName();
@@ -369,11 +475,13 @@ CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
 	if (taskId == JOB_CLEANUP_TASK_ID)
 	{
 		assignmentTime = HIGH_PRIORITY_TASK_TIME;
+		priority = HIGH_PRIORITY_TASK_PRIORITY;
 	}
 
 	/* enter the worker task into shared hash and initialize the task */
 	WorkerTask *workerTask = WorkerTasksHashEnter(jobId, taskId);
 	workerTask->assignedAt = assignmentTime;
+	workerTask->priority = priority;
 	strlcpy(workerTask->taskCallString, taskCallString, MaxTaskStringSize);
 
 	workerTask->taskStatus = TASK_ASSIGNED;
@@ -385,16 +493,22 @@ CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
 
 
 /*
- * UpdateTask updates the call string text for an already existing task. Note
- * that this function expects the caller to hold an exclusive lock over the
- * shared hash.
+ * UpdateTask updates the call string text and priority for an already existing
+ * task. Note that this function expects the caller to hold an exclusive lock
+ * over the shared hash.
  */
 static void
-UpdateTask(WorkerTask *workerTask, char *taskCallString)
+UpdateTask(WorkerTask *workerTask, uint32 priority, char *taskCallString)
 {
 	TaskStatus taskStatus = workerTask->taskStatus;
 	Assert(taskStatus != TASK_STATUS_INVALID_FIRST);
 
+	/* cleanup tasks keep their high priority */
+	if (workerTask->taskId == JOB_CLEANUP_TASK_ID)
+	{
+		priority = HIGH_PRIORITY_TASK_PRIORITY;
+	}
+
 	/*
 	 * 1. If the task has succeeded or has been canceled, we don't do anything.
 	 * 2. If the task has permanently failed, we update the task call string,
@@ -410,17 +524,43 @@ UpdateTask(WorkerTask *workerTask, char *taskCallString)
 	else if (taskStatus == TASK_PERMANENTLY_FAILED)
 	{
 		strlcpy(workerTask->taskCallString, taskCallString, MaxTaskStringSize);
+		workerTask->priority = priority;
 		workerTask->failureCount = 0;
 		workerTask->taskStatus = TASK_ASSIGNED;
 	}
 	else
 	{
 		strlcpy(workerTask->taskCallString, taskCallString, MaxTaskStringSize);
+		workerTask->priority = priority;
 		workerTask->failureCount = 0;
 	}
 }
 
 
+/*
+ * AnyWorkerTaskFinished returns whether any of the tasks identified by the given
+ * job and task ids has finished, or no longer exists in the shared hash. Note
+ * that this function expects the caller to hold a lock over the shared hash.
+ */
+static bool
+AnyWorkerTaskFinished(Datum *jobIdDatumArray, Datum *taskIdDatumArray, int taskCount)
+{
+	for (int taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		uint64 jobId = DatumGetInt64(jobIdDatumArray[taskIndex]);
+		uint32 taskId = DatumGetUInt32(taskIdDatumArray[taskIndex]);
+
+		WorkerTask *workerTask = WorkerTasksHashFind(jobId, taskId);
+		if (workerTask == NULL || WorkerTaskFinished(workerTask))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /* Cleans up connection and shared hash entry associated with the given task. */
 static void
 CleanupTask(WorkerTask *workerTask)
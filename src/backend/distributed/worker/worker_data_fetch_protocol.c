@@ -269,9 +269,8 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 		}
 		else if (resultStatus == CLIENT_RESULT_BUSY)
 		{
-			/* remote node did not respond; wait for longer */
-			long sleepIntervalPerCycle = RemoteTaskCheckInterval * 1000L;
-			pg_usleep(sleepIntervalPerCycle);
+			/* remote node did not respond; wait for it to send something */
+			MultiClientWaitForInput(connectionId);
 		}
 		else
 		{
@@ -301,6 +300,7 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 		else if (copyStatus == CLIENT_COPY_MORE)
 		{
 			/* remote node will continue to send more data */
+			MultiClientWaitForInput(connectionId);
 		}
 		else
 		{
@@ -32,6 +32,8 @@
 #include "commands/tablecmds.h"
 #include "common/string.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "distributed/task_tracker_protocol.h"
@@ -39,6 +41,7 @@
 #include "executor/spi.h"
 #include "nodes/makefuncs.h"
 #include "parser/parse_type.h"
+#include "parser/parser.h"
 #include "storage/lmgr.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
@@ -48,10 +51,22 @@
 #include "distributed/resource_lock.h"
 
 
+/* Config variables managed via guc.c */
+bool EnableMergeFileScan = false; /* merge task files into views over the files */
+
+
 /* Local functions forward declarations */
 static List * ArrayObjectToCStringList(ArrayType *arrayObject);
 static void CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 							List *columnNameList, List *columnTypeList);
+static StringInfo TaskFilesViewQueryString(StringInfo schemaName,
+										   StringInfo relationName,
+										   List *columnNameList, List *columnTypeList,
+										   uint64 jobId, uint32 taskId);
+static bool MergeTableColumnLists(const char *createMergeTableQuery,
+								  StringInfo mergeTableName, List **columnNameList,
+								  List **columnTypeList);
+static List * TaskFileList(StringInfo sourceDirectoryName, Oid userId);
 static void CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 									   StringInfo sourceDirectoryName, Oid userId);
 
@@ -59,6 +74,7 @@ static void CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relatio
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_merge_files_into_table);
 PG_FUNCTION_INFO_V1(worker_merge_files_and_run_query);
+PG_FUNCTION_INFO_V1(worker_read_task_files);
 PG_FUNCTION_INFO_V1(worker_cleanup_job_schema_cache);
 PG_FUNCTION_INFO_V1(worker_create_schema);
 PG_FUNCTION_INFO_V1(worker_repartition_cleanup);
@@ -175,10 +191,44 @@ worker_merge_files_into_table(PG_FUNCTION_ARGS)
 		EnsureSchemaOwner(schemaId);
 	}
 
-	/* create the task table and copy files into the table */
 	List *columnNameList = ArrayObjectToCStringList(columnNameObject);
 	List *columnTypeList = ArrayObjectToCStringList(columnTypeObject);
 
+	/*
+	 * When merge file scans are enabled, the task table is a view that reads
+	 * the task files on demand, so the files are not loaded into the database.
+	 */
+	if (EnableMergeFileScan)
+	{
+		StringInfo createViewQuery = TaskFilesViewQueryString(jobSchemaName,
+															  taskTableName,
+															  columnNameList,
+															  columnTypeList,
+															  jobId, taskId);
+
+		int connected = SPI_connect();
+		if (connected != SPI_OK_CONNECT)
+		{
+			ereport(ERROR, (errmsg("could not connect to SPI manager")));
+		}
+
+		int createViewResult = SPI_exec(createViewQuery->data, 0);
+		if (createViewResult < 0)
+		{
+			ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+								   createViewQuery->data)));
+		}
+
+		int finished = SPI_finish();
+		if (finished != SPI_OK_FINISH)
+		{
+			ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+		}
+
+		PG_RETURN_VOID();
+	}
+
+	/* create the task table and copy files into the table */
 	CreateTaskTable(jobSchemaName, taskTableName, columnNameList, columnTypeList);
 
 	/* need superuser to copy from files */
@@ -263,23 +313,51 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 							   setSearchPathString->data)));
 	}
 
-	int createMergeTableResult = SPI_exec(createMergeTableQuery, 0);
-	if (createMergeTableResult < 0)
+	appendStringInfo(mergeTableName, "%s%s", intermediateTableName->data,
+					 MERGE_TABLE_SUFFIX);
+
+	/*
+	 * When merge file scans are enabled and the merge table is a plain table
+	 * definition, we create a view over the task files in its place. The query
+	 * then reads the files directly instead of through a loaded merge table.
+	 */
+	List *columnNameList = NIL;
+	List *columnTypeList = NIL;
+	if (EnableMergeFileScan &&
+		MergeTableColumnLists(createMergeTableQuery, mergeTableName,
+							  &columnNameList, &columnTypeList))
 	{
-		ereport(ERROR, (errmsg("execution was not successful \"%s\"",
-							   createMergeTableQuery)));
+		StringInfo createViewQuery = TaskFilesViewQueryString(jobSchemaName,
+															  mergeTableName,
+															  columnNameList,
+															  columnTypeList,
+															  jobId, taskId);
+
+		int createViewResult = SPI_exec(createViewQuery->data, 0);
+		if (createViewResult < 0)
+		{
+			ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+								   createViewQuery->data)));
+		}
 	}
+	else
+	{
+		int createMergeTableResult = SPI_exec(createMergeTableQuery, 0);
+		if (createMergeTableResult < 0)
+		{
+			ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+								   createMergeTableQuery)));
+		}
 
-	/* need superuser to copy from files */
-	GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
-	SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
+		/* need superuser to copy from files */
+		GetUserIdAndSecContext(&savedUserId, &savedSecurityContext);
+		SetUserIdAndSecContext(CitusExtensionOwner(), SECURITY_LOCAL_USERID_CHANGE);
 
-	appendStringInfo(mergeTableName, "%s%s", intermediateTableName->data,
-					 MERGE_TABLE_SUFFIX);
-	CopyTaskFilesFromDirectory(jobSchemaName, mergeTableName, taskDirectoryName,
-							   userId);
+		CopyTaskFilesFromDirectory(jobSchemaName, mergeTableName, taskDirectoryName,
+								   userId);
 
-	SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+		SetUserIdAndSecContext(savedUserId, savedSecurityContext);
+	}
 
 	int createIntermediateTableResult = SPI_exec(createIntermediateTableQuery, 0);
 	if (createIntermediateTableResult < 0)
@@ -298,6 +376,44 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_read_task_files returns the records in the files that were fetched
+ * into the given merge task's directory, parsed according to the column
+ * definition list specified by the caller, e.g.:
+ *
+ * SELECT * FROM worker_read_task_files(201010, 101103) AS (a int, b text)
+ *
+ * Like the merge functions, it only reads the files fetched by the current user.
+ */
+Datum
+worker_read_task_files(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+
+	StringInfo taskDirectoryName = TaskDirectoryName(jobId, taskId);
+	char *copyFormat = BinaryWorkerCopyFormat ? "binary" : "text";
+	TupleDesc tupleDescriptor = NULL;
+	ListCell *taskFileCell = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	List *taskFileList = TaskFileList(taskDirectoryName, GetUserId());
+	foreach(taskFileCell, taskFileList)
+	{
+		char *taskFileName = (char *) lfirst(taskFileCell);
+
+		ReadFileIntoTupleStore(taskFileName, copyFormat, tupleDescriptor, tupleStore);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
 /*
  * worker_cleanup_job_schema_cache walks over all schemas in the database, and
  * removes schemas whose names start with the job schema prefix. Note that this
@@ -486,6 +602,109 @@ CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 }
 
 
+/*
+ * TaskFilesViewQueryString builds a query that creates a view in the given
+ * schema, which reads the files of the given task with worker_read_task_files()
+ * using the given column names and types.
+ */
+static StringInfo
+TaskFilesViewQueryString(StringInfo schemaName, StringInfo relationName,
+						 List *columnNameList, List *columnTypeList,
+						 uint64 jobId, uint32 taskId)
+{
+	StringInfo createViewQuery = makeStringInfo();
+	StringInfo columnsString = makeStringInfo();
+	ListCell *columnNameCell = NULL;
+	ListCell *columnTypeCell = NULL;
+
+	forboth(columnNameCell, columnNameList, columnTypeCell, columnTypeList)
+	{
+		const char *columnName = (const char *) lfirst(columnNameCell);
+		const char *columnType = (const char *) lfirst(columnTypeCell);
+		Oid columnTypeId = InvalidOid;
+		int32 columnTypeMod = -1;
+		bool missingOK = false;
+
+		/* resolve the type so that we only put a well-formed type name in the view */
+		parseTypeString(columnType, &columnTypeId, &columnTypeMod, missingOK);
+
+		if (columnsString->len > 0)
+		{
+			appendStringInfoString(columnsString, ", ");
+		}
+
+		appendStringInfo(columnsString, "%s %s", quote_identifier(columnName),
+						 format_type_with_typemod(columnTypeId, columnTypeMod));
+	}
+
+	appendStringInfo(createViewQuery,
+					 "CREATE VIEW %s AS SELECT * FROM pg_catalog.worker_read_task_files("
+					 UINT64_FORMAT ", %u) AS task_files (%s)",
+					 quote_qualified_identifier(schemaName->data, relationName->data),
+					 jobId, taskId, columnsString->data);
+
+	return createViewQuery;
+}
+
+
+/*
+ * MergeTableColumnLists parses the given merge table query, and if it only
+ * defines the columns of the given merge table, returns the names and types
+ * of these columns through the output parameters. Otherwise, the function
+ * returns false.
+ */
+static bool
+MergeTableColumnLists(const char *createMergeTableQuery, StringInfo mergeTableName,
+					  List **columnNameList, List **columnTypeList)
+{
+	ListCell *tableElementCell = NULL;
+
+	List *parseTreeList = raw_parser(createMergeTableQuery);
+	if (list_length(parseTreeList) != 1)
+	{
+		return false;
+	}
+
+	Node *parseTree = ((RawStmt *) linitial(parseTreeList))->stmt;
+	if (!IsA(parseTree, CreateStmt))
+	{
+		return false;
+	}
+
+	CreateStmt *createStatement = (CreateStmt *) parseTree;
+	if (createStatement->relation->schemaname != NULL ||
+		strncmp(createStatement->relation->relname, mergeTableName->data,
+				NAMEDATALEN) != 0 ||
+		createStatement->inhRelations != NIL || createStatement->constraints != NIL ||
+		createStatement->partspec != NULL || createStatement->ofTypename != NULL)
+	{
+		return false;
+	}
+
+	foreach(tableElementCell, createStatement->tableElts)
+	{
+		Node *tableElement = (Node *) lfirst(tableElementCell);
+		if (!IsA(tableElement, ColumnDef))
+		{
+			return false;
+		}
+
+		ColumnDef *columnDefinition = (ColumnDef *) tableElement;
+		if (columnDefinition->constraints != NIL)
+		{
+			return false;
+		}
+
+		char *columnType = TypeNameToString(columnDefinition->typeName);
+
+		*columnNameList = lappend(*columnNameList, columnDefinition->colname);
+		*columnTypeList = lappend(*columnTypeList, columnType);
+	}
+
+	return true;
+}
+
+
 /*
  * ColumnDefinitionList creates and returns a list of column definition objects
  * from two lists of column names and types. As an example, this function takes
@@ -555,21 +774,19 @@ CreateStatement(RangeVar *relation, List *columnDefinitionList)
 
 
 /*
- * CopyTaskFilesFromDirectory finds all files in the given directory, except for
- * those having an attempt suffix. The function then copies these files into the
- * database table identified by the given schema and table name.
+ * TaskFileList finds all files in the given directory, except for those having
+ * an attempt suffix, and returns their full paths.
  *
- * The function makes sure all files were generated by the current user by checking
- * whether the filename ends with the username, since this is added to local file
+ * The function makes sure all files were generated by the given user by checking
+ * whether the filename ends with the user id, since this is added to local file
  * names by functions such as worker_fetch_partition-file. Files that were generated
  * by other users calling worker_fetch_partition_file directly are skipped.
  */
-static void
-CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
-						   StringInfo sourceDirectoryName, Oid userId)
+static List *
+TaskFileList(StringInfo sourceDirectoryName, Oid userId)
 {
 	const char *directoryName = sourceDirectoryName->data;
-	uint64 copiedRowTotal = 0;
+	List *taskFileList = NIL;
 	StringInfo expectedFileSuffix = makeStringInfo();
 
 	DIR *directory = AllocateDir(directoryName);
@@ -585,8 +802,6 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 	for (; directoryEntry != NULL; directoryEntry = ReadDir(directory, directoryName))
 	{
 		const char *baseFilename = directoryEntry->d_name;
-		const char *queryString = NULL;
-		uint64 copiedRowCount = 0;
 
 		/* if system file or lingering task file, skip it */
 		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
@@ -611,9 +826,37 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 		StringInfo fullFilename = makeStringInfo();
 		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
 
+		taskFileList = lappend(taskFileList, fullFilename->data);
+	}
+
+	FreeDir(directory);
+
+	return taskFileList;
+}
+
+
+/*
+ * CopyTaskFilesFromDirectory copies the task files in the given directory, as
+ * found by TaskFileList(), into the database table identified by the given
+ * schema and table name.
+ */
+static void
+CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
+						   StringInfo sourceDirectoryName, Oid userId)
+{
+	uint64 copiedRowTotal = 0;
+	ListCell *taskFileCell = NULL;
+
+	List *taskFileList = TaskFileList(sourceDirectoryName, userId);
+	foreach(taskFileCell, taskFileList)
+	{
+		char *fullFilename = (char *) lfirst(taskFileCell);
+		const char *queryString = NULL;
+		uint64 copiedRowCount = 0;
+
 		/* build relation object and copy statement */
 		RangeVar *relation = makeRangeVar(schemaName->data, relationName->data, -1);
-		CopyStmt *copyStatement = CopyStatement(relation, fullFilename->data);
+		CopyStmt *copyStatement = CopyStatement(relation, fullFilename);
 		if (BinaryWorkerCopyFormat)
 		{
 			DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
@@ -636,8 +879,6 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 
 	ereport(DEBUG2, (errmsg("copied " UINT64_FORMAT " rows into table: \"%s.%s\"",
 							copiedRowTotal, schemaName->data, relationName->data)));
-
-	FreeDir(directory);
 }
 
 
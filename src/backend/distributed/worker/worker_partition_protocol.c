@@ -46,14 +46,19 @@
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/timestamp.h"
 
 
 /* Config variables managed via guc.c */
 bool BinaryWorkerCopyFormat = false;   /* binary format for copying between workers */
 int PartitionBufferSize = 16384; /* total partitioning buffer size in KB */
+bool EnableDeferredDirectoryCleanup = false; /* move directories to the trash */
+int DeferredCleanupFilesPerSecond = 1000; /* files removed from the trash per second */
 
 /* Local variables */
-static uint32 FileBufferSizeInBytes = 0; /* file buffer size to init later */
+static uint64 PartitionBufferSizeInBytes = 0; /* buffer budget to init later */
+static uint64 BufferedPartitionBytes = 0; /* bytes buffered across all files */
+static uint32 TrashedDirectoryCount = 0; /* directories moved to the trash */
 
 
 /* Local functions forward declarations */
@@ -63,16 +68,22 @@ static ShardInterval ** SyntheticShardIntervalArrayForShardMinValues(
 	Datum *shardMinValues,
 	int shardCount);
 static StringInfo InitTaskAttemptDirectory(uint64 jobId, uint32 taskId);
-static uint32 FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount);
 static FileOutputStream * OpenPartitionFiles(StringInfo directoryName, uint32 fileCount);
 static void ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fileCount);
 static void RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName);
+static int RemoveDirectoryLimited(const char *filename, int maxFileCount);
 static void FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite);
-static void FileOutputStreamFlush(FileOutputStream *file);
+static void FileOutputStreamFlush(FileOutputStream *file, int flushLength);
+static void FlushPartitionFileBuffers(FileOutputStream *partitionFileArray,
+									  uint32 fileCount);
+static SkewedPartitionContext * CreateSkewedPartitionContext(
+	ArrayType *skewedHashObject, ArrayType *skewPartitionCountObject,
+	HashPartitionContext *hashPartitionContext, uint32 taskId);
 static void FilterAndPartitionTable(const char *filterQuery,
 									const char *columnName, Oid columnType,
 									PartitionIdFunction partitionIdFunction,
 									const void *partitionIdContext,
+									SkewedPartitionContext *skewContext,
 									FileOutputStream *partitionFileArray,
 									uint32 fileCount);
 static int ColumnIndex(TupleDesc rowDescriptor, const char *columnName);
@@ -82,6 +93,9 @@ static void OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fil
 static void OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount);
 static uint32 RangePartitionId(Datum partitionValue, Oid partitionCollation,
 							   const void *context);
+static uint32 SkewedPartitionId(SkewedPartitionContext *skewContext,
+							   Datum partitionValue, uint32 partitionId,
+							   uint32 fileCount, uint32 *partitionCopyCount);
 static uint32 HashPartitionId(Datum partitionValue, Oid partitionCollation,
 							  const void *context);
 static StringInfo UserPartitionFilename(StringInfo directoryName, uint32 partitionId);
@@ -149,11 +163,10 @@ worker_range_partition_table(PG_FUNCTION_ARGS)
 
 	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
 															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
 
 	/* call the partitioning function that does the actual work */
 	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
-							&RangePartitionId, (const void *) partitionContext,
+							&RangePartitionId, (const void *) partitionContext, NULL,
 							partitionFileArray, fileCount);
 
 	/* close partition files and atomically rename (commit) them */
@@ -174,6 +187,10 @@ worker_range_partition_table(PG_FUNCTION_ARGS)
  *
  * This function applies hash partitioning through the use of a function pointer
  * and a hash context object; for details, see HashPartitionId().
+ *
+ * The optional last two arguments list the hash values of frequent partition
+ * column values whose rows are spread over or copied to several partitions;
+ * for details, see SkewedPartitionId().
  */
 Datum
 worker_hash_partition_table(PG_FUNCTION_ARGS)
@@ -217,18 +234,28 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 			GetFunctionInfo(partitionColumnType, BTREE_AM_OID, BTORDER_PROC);
 	}
 
+	SkewedPartitionContext *skewContext = NULL;
+	if (PG_NARGS() > 6)
+	{
+		ArrayType *skewedHashObject = PG_GETARG_ARRAYTYPE_P(6);
+		ArrayType *skewPartitionCountObject = PG_GETARG_ARRAYTYPE_P(7);
+
+		skewContext = CreateSkewedPartitionContext(skewedHashObject,
+												   skewPartitionCountObject,
+												   partitionContext, taskId);
+	}
+
 	/* init directories and files to write the partitioned data to */
 	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
 	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
 
 	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
 															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
 
 	/* call the partitioning function that does the actual work */
 	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
 							&HashPartitionId, (const void *) partitionContext,
-							partitionFileArray, fileCount);
+							skewContext, partitionFileArray, fileCount);
 
 	/* close partition files and atomically rename (commit) them */
 	ClosePartitionFiles(partitionFileArray, fileCount);
@@ -239,6 +266,83 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * CreateSkewedPartitionContext creates the context for spreading the rows of
+ * the given skewed hash values over several partitions. The partition counts
+ * are positive for hash values whose rows are spread over the partitions, and
+ * negative for hash values whose rows are copied to all of them.
+ */
+static SkewedPartitionContext *
+CreateSkewedPartitionContext(ArrayType *skewedHashObject,
+							 ArrayType *skewPartitionCountObject,
+							 HashPartitionContext *hashPartitionContext, uint32 taskId)
+{
+	uint32 partitionCount = hashPartitionContext->partitionCount;
+
+	if (ARR_ELEMTYPE(skewedHashObject) != INT4OID ||
+		ARR_ELEMTYPE(skewPartitionCountObject) != INT4OID)
+	{
+		ereport(ERROR, (errmsg("skewed hash values and partition counts must be "
+							   "integer arrays")));
+	}
+
+	int skewedHashCount = ArrayObjectCount(skewedHashObject);
+	if (ArrayObjectCount(skewPartitionCountObject) != skewedHashCount)
+	{
+		ereport(ERROR, (errmsg("the number of skewed hash values and partition "
+							   "counts do not match")));
+	}
+
+	Datum *skewedHashDatumArray = DeconstructArrayObject(skewedHashObject);
+	Datum *skewPartitionCountDatumArray =
+		DeconstructArrayObject(skewPartitionCountObject);
+
+	SkewedPartitionContext *skewContext = palloc0(sizeof(SkewedPartitionContext));
+	skewContext->hashFunction = hashPartitionContext->hashFunction;
+	skewContext->skewedHashCount = skewedHashCount;
+	skewContext->skewedHashArray = palloc0(skewedHashCount * sizeof(int32));
+	skewContext->skewPartitionCountArray = palloc0(skewedHashCount * sizeof(int32));
+	skewContext->skewedPartitionArray = palloc0(partitionCount * sizeof(bool));
+
+	/* start at a different partition in each task to even out the spread rows */
+	skewContext->spreadRowCount = taskId;
+
+	for (int skewIndex = 0; skewIndex < skewedHashCount; skewIndex++)
+	{
+		int32 skewedHash = DatumGetInt32(skewedHashDatumArray[skewIndex]);
+		int32 skewPartitionCount = DatumGetInt32(skewPartitionCountDatumArray[skewIndex]);
+		uint32 partitionId = 0;
+
+		if (skewPartitionCount == 0 || Abs(skewPartitionCount) > partitionCount)
+		{
+			ereport(ERROR, (errmsg("invalid partition count %d for skewed hash "
+								   "value %d", skewPartitionCount, skewedHash)));
+		}
+
+		/* same as in HashPartitionId, a hash value of 0 goes to the 0th bucket */
+		if (skewedHash != 0 && hashPartitionContext->hasUniformHashDistribution)
+		{
+			partitionId = UniformHashShardIndex(skewedHash, partitionCount);
+		}
+		else if (skewedHash != 0)
+		{
+			partitionId =
+				SearchCachedShardInterval(Int32GetDatum(skewedHash),
+										  hashPartitionContext->
+										  syntheticShardIntervalArray,
+										  partitionCount, InvalidOid,
+										  hashPartitionContext->comparisonFunction);
+		}
+
+		skewContext->skewedHashArray[skewIndex] = skewedHash;
+		skewContext->skewPartitionCountArray[skewIndex] = skewPartitionCount;
+		skewContext->skewedPartitionArray[partitionId] = true;
+	}
+
+	return skewContext;
+}
+
+
 /*
  * SyntheticShardIntervalArrayForShardMinValues returns a shard interval pointer array
  * which gets the shardMinValues from the input shardMinValues array. Note that
@@ -428,23 +532,15 @@ InitTaskAttemptDirectory(uint64 jobId, uint32 taskId)
 }
 
 
-/* Calculates and returns the buffer size to use for each file. */
-static uint32
-FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount)
-{
-	double partitionBufferSize = (double) partitionBufferSizeInKB * 1024.0;
-	uint32 fileBufferSize = (uint32) rint(partitionBufferSize / fileCount);
-
-	return fileBufferSize;
-}
-
-
 /*
  * OpenPartitionFiles takes in a directory name and file count, and opens new
  * partition files in this directory. The names for these new files are modeled
  * after Hadoop's naming conventions for map files. These file names, virtual
  * file descriptors, and file buffers are stored together in file output stream
  * objects. These objects are then returned in an array from this function.
+ *
+ * All files share one buffer budget of citus.partition_buffer_size, rather
+ * than each getting an equal slice of it; see FlushPartitionFileBuffers().
  */
 static FileOutputStream *
 OpenPartitionFiles(StringInfo directoryName, uint32 fileCount)
@@ -455,6 +551,9 @@ OpenPartitionFiles(StringInfo directoryName, uint32 fileCount)
 
 	FileOutputStream *partitionFileArray = palloc0(fileCount * sizeof(FileOutputStream));
 
+	PartitionBufferSizeInBytes = (uint64) PartitionBufferSize * 1024L;
+	BufferedPartitionBytes = 0;
+
 	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
 		StringInfo filePath = UserPartitionFilename(directoryName, fileIndex);
@@ -488,7 +587,7 @@ ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fileCount)
 	{
 		FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
 
-		FileOutputStreamFlush(partitionFile);
+		FileOutputStreamFlush(partitionFile, partitionFile->fileBuffer->len);
 
 		FileClose(partitionFile->fileCompat.fd);
 		FreeStringInfo(partitionFile->fileBuffer);
@@ -803,6 +902,215 @@ CitusRemoveDirectory(const char *filename)
 }
 
 
+/*
+ * CitusRemoveDirectoryDeferred removes the given directory like
+ * CitusRemoveDirectory, except that when citus.enable_deferred_directory_cleanup
+ * is set it only moves the directory to the trash directory, from which the
+ * task tracker removes the files in the background. Moving the directory is a
+ * single rename, such that transactions that created many files do not spend
+ * their commit removing them.
+ */
+void
+CitusRemoveDirectoryDeferred(const char *filename)
+{
+	if (!EnableDeferredDirectoryCleanup)
+	{
+		CitusRemoveDirectory(filename);
+		return;
+	}
+
+	StringInfo trashDirectoryName = makeStringInfo();
+	appendStringInfo(trashDirectoryName, "base/%s/%s", PG_JOB_CACHE_DIR,
+					 TRASH_DIRECTORY_NAME);
+
+	int makeOK = mkdir(trashDirectoryName->data, S_IRWXU);
+	if (makeOK != 0 && errno != EEXIST)
+	{
+		CitusRemoveDirectory(filename);
+		return;
+	}
+
+	/* the trash is emptied on restart, so names only need to be unique until then */
+	StringInfo trashedName = makeStringInfo();
+	appendStringInfo(trashedName, "%s/%d_" INT64_FORMAT "_%u", trashDirectoryName->data,
+					 MyProcPid, (int64) GetCurrentTimestamp(), TrashedDirectoryCount++);
+
+	int renamed = rename(filename, trashedName->data);
+	if (renamed != 0)
+	{
+		if (errno == ENOENT)
+		{
+			/* nothing to remove */
+			return;
+		}
+
+		/* fall back to removing the files right away */
+		CitusRemoveDirectory(filename);
+	}
+}
+
+
+/*
+ * RemoveTrashedFiles removes at most maxFileCount files and directories from
+ * the directories that CitusRemoveDirectoryDeferred moved to the trash, and
+ * returns the number of files it removed.
+ */
+int
+RemoveTrashedFiles(int maxFileCount)
+{
+	int removedFileCount = 0;
+
+	StringInfo trashDirectoryName = makeStringInfo();
+	appendStringInfo(trashDirectoryName, "base/%s/%s", PG_JOB_CACHE_DIR,
+					 TRASH_DIRECTORY_NAME);
+
+	const char *directoryName = trashDirectoryName->data;
+	DIR *directory = AllocateDir(directoryName);
+	if (directory == NULL)
+	{
+		if (errno == ENOENT)
+		{
+			/* nothing was moved to the trash yet */
+			return 0;
+		}
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open directory \"%s\": %m",
+							   directoryName)));
+	}
+
+	StringInfo fullFilename = makeStringInfo();
+	struct dirent *directoryEntry = ReadDir(directory, directoryName);
+	for (; directoryEntry != NULL && removedFileCount < maxFileCount;
+		 directoryEntry = ReadDir(directory, directoryName))
+	{
+		const char *baseFilename = directoryEntry->d_name;
+
+		/* if system file, skip it */
+		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
+			strncmp(baseFilename, "..", MAXPGPATH) == 0)
+		{
+			continue;
+		}
+
+		resetStringInfo(fullFilename);
+		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
+
+		removedFileCount += RemoveDirectoryLimited(fullFilename->data,
+												   maxFileCount - removedFileCount);
+	}
+
+	FreeStringInfo(fullFilename);
+	FreeDir(directory);
+	FreeStringInfo(trashDirectoryName);
+
+	return removedFileCount;
+}
+
+
+/*
+ * RemoveDirectoryLimited recursively removes at most maxFileCount files and
+ * directories from the given directory, and the directory itself once it is
+ * empty. It returns the number of files it removed. Files that are already
+ * gone are skipped.
+ */
+static int
+RemoveDirectoryLimited(const char *filename, int maxFileCount)
+{
+	struct stat fileStat;
+	int removedFileCount = 0;
+	int removed = 0;
+
+	if (maxFileCount <= 0)
+	{
+		return 0;
+	}
+
+	int statOK = stat(filename, &fileStat);
+	if (statOK < 0)
+	{
+		if (errno == ENOENT)
+		{
+			return 0;
+		}
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file \"%s\": %m", filename)));
+	}
+
+	if (S_ISDIR(fileStat.st_mode) && !FileIsLink(filename, fileStat))
+	{
+		const char *directoryName = filename;
+
+		DIR *directory = AllocateDir(directoryName);
+		if (directory == NULL)
+		{
+			if (errno == ENOENT)
+			{
+				return 0;
+			}
+
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open directory \"%s\": %m",
+								   directoryName)));
+		}
+
+		StringInfo fullFilename = makeStringInfo();
+		struct dirent *directoryEntry = ReadDir(directory, directoryName);
+		for (; directoryEntry != NULL && removedFileCount < maxFileCount;
+			 directoryEntry = ReadDir(directory, directoryName))
+		{
+			const char *baseFilename = directoryEntry->d_name;
+
+			/* if system file, skip it */
+			if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
+				strncmp(baseFilename, "..", MAXPGPATH) == 0)
+			{
+				continue;
+			}
+
+			resetStringInfo(fullFilename);
+			appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
+
+			removedFileCount += RemoveDirectoryLimited(fullFilename->data,
+													   maxFileCount - removedFileCount);
+		}
+
+		FreeStringInfo(fullFilename);
+		FreeDir(directory);
+
+		if (removedFileCount >= maxFileCount)
+		{
+			/* the directory may not be empty yet, continue next time */
+			return removedFileCount;
+		}
+
+		removed = rmdir(filename);
+		if (removed != 0 && (errno == ENOTEMPTY || errno == EEXIST))
+		{
+			return removedFileCount;
+		}
+	}
+	else
+	{
+		removed = unlink(filename);
+	}
+
+	if (removed != 0)
+	{
+		if (errno == ENOENT)
+		{
+			return removedFileCount;
+		}
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not remove file \"%s\": %m", filename)));
+	}
+
+	return removedFileCount + 1;
+}
+
+
 /* Moves directory from old path to the new one. */
 static void
 RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName)
@@ -819,40 +1127,83 @@ RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName)
 
 /*
  * FileOutputStreamWrite appends given data to file stream's internal buffers.
- * The function then checks if buffered data exceeds preconfigured buffer size;
- * if so, the function flushes the buffer to the underlying file.
+ * The caller is responsible for calling FlushPartitionFileBuffers() to keep
+ * the buffered data within the configured buffer size.
  */
 static void
 FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite)
 {
 	StringInfo fileBuffer = file->fileBuffer;
-	uint32 newBufferSize = fileBuffer->len + dataToWrite->len;
 
 	appendBinaryStringInfo(fileBuffer, dataToWrite->data, dataToWrite->len);
 
-	if (newBufferSize > FileBufferSizeInBytes)
-	{
-		FileOutputStreamFlush(file);
-
-		resetStringInfo(fileBuffer);
-	}
+	BufferedPartitionBytes += dataToWrite->len;
 }
 
 
-/* Flushes data buffered in the file stream object to the underlying file. */
+/*
+ * FileOutputStreamFlush writes the first flushLength bytes buffered in the file
+ * stream object to the underlying file, and keeps the rest in the buffer.
+ */
 static void
-FileOutputStreamFlush(FileOutputStream *file)
+FileOutputStreamFlush(FileOutputStream *file, int flushLength)
 {
 	StringInfo fileBuffer = file->fileBuffer;
 
 	errno = 0;
-	int written = FileWriteCompat(&file->fileCompat, fileBuffer->data, fileBuffer->len,
+	int written = FileWriteCompat(&file->fileCompat, fileBuffer->data, flushLength,
 								  PG_WAIT_IO);
-	if (written != fileBuffer->len)
+	if (written != flushLength)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
 						errmsg("could not write %d bytes to partition file \"%s\"",
-							   fileBuffer->len, file->filePath->data)));
+							   flushLength, file->filePath->data)));
+	}
+
+	int remainingLength = fileBuffer->len - flushLength;
+	if (remainingLength > 0)
+	{
+		memmove(fileBuffer->data, fileBuffer->data + flushLength, remainingLength);
+	}
+
+	fileBuffer->len = remainingLength;
+	fileBuffer->data[remainingLength] = '\0';
+
+	BufferedPartitionBytes -= flushLength;
+}
+
+
+/*
+ * FlushPartitionFileBuffers flushes partition file buffers until the data that
+ * is buffered across all files fits into citus.partition_buffer_size again. We
+ * always flush the file with the most buffered data, so that skewed partitions
+ * get large writes and partitions that see few rows don't hold on to memory.
+ * Flushes are rounded down to whole blocks, which keeps writes block aligned;
+ * the remainder stays buffered for the next flush.
+ */
+static void
+FlushPartitionFileBuffers(FileOutputStream *partitionFileArray, uint32 fileCount)
+{
+	while (BufferedPartitionBytes > PartitionBufferSizeInBytes)
+	{
+		FileOutputStream *largestFile = &partitionFileArray[0];
+
+		for (uint32 fileIndex = 1; fileIndex < fileCount; fileIndex++)
+		{
+			FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
+			if (partitionFile->fileBuffer->len > largestFile->fileBuffer->len)
+			{
+				largestFile = partitionFile;
+			}
+		}
+
+		int flushLength = largestFile->fileBuffer->len;
+		if (flushLength >= BLCKSZ)
+		{
+			flushLength -= flushLength % BLCKSZ;
+		}
+
+		FileOutputStreamFlush(largestFile, flushLength);
 	}
 }
 
@@ -862,13 +1213,16 @@ FileOutputStreamFlush(FileOutputStream *file)
  * results in a read-only fashion. For each resulting row, the function applies
  * the partitioning function and determines the partition identifier. Then, the
  * function chooses the partition file corresponding to this identifier, and
- * serializes the row into this file using the copy command's text format.
+ * serializes the row into this file using the copy command's text format. If
+ * a skew context is given, the rows of skewed values may instead be written to
+ * other partitions or to several partitions; see SkewedPartitionId().
  */
 static void
 FilterAndPartitionTable(const char *filterQuery,
 						const char *partitionColumnName, Oid partitionColumnType,
 						PartitionIdFunction partitionIdFunction,
 						const void *partitionIdContext,
+						SkewedPartitionContext *skewContext,
 						FileOutputStream *partitionFileArray,
 						uint32 fileCount)
 {
@@ -942,6 +1296,7 @@ FilterAndPartitionTable(const char *filterQuery,
 			TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
 			bool partitionKeyNull = false;
 			uint32 partitionId = 0;
+			uint32 partitionCopyCount = 1;
 
 			Datum partitionKey = SPI_getbinval(row, rowDescriptor,
 											   partitionColumnIndex, &partitionKeyNull);
@@ -961,6 +1316,13 @@ FilterAndPartitionTable(const char *filterQuery,
 				{
 					ereport(ERROR, (errmsg("invalid distribution column value")));
 				}
+
+				if (skewContext != NULL)
+				{
+					partitionId = SkewedPartitionId(skewContext, partitionKey,
+													partitionId, fileCount,
+													&partitionCopyCount);
+				}
 			}
 			else
 			{
@@ -975,8 +1337,15 @@ FilterAndPartitionTable(const char *filterQuery,
 
 			StringInfo rowText = rowOutputState->fe_msgbuf;
 
-			FileOutputStream *partitionFile = &partitionFileArray[partitionId];
-			FileOutputStreamWrite(partitionFile, rowText);
+			for (uint32 copyIndex = 0; copyIndex < partitionCopyCount; copyIndex++)
+			{
+				uint32 copyPartitionId = (partitionId + copyIndex) % fileCount;
+
+				FileOutputStream *partitionFile = &partitionFileArray[copyPartitionId];
+				FileOutputStreamWrite(partitionFile, rowText);
+			}
+
+			FlushPartitionFileBuffers(partitionFileArray, fileCount);
 
 			resetStringInfo(rowText);
 			MemoryContextReset(rowOutputState->rowcontext);
@@ -1122,7 +1491,7 @@ OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fileCount)
 	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
 		/* Generate header for a binary copy */
-		FileOutputStream partitionFile = { };
+		FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
 		CopyOutStateData headerOutputStateData;
 		CopyOutState headerOutputState = (CopyOutState) & headerOutputStateData;
 
@@ -1131,8 +1500,7 @@ OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fileCount)
 
 		AppendCopyBinaryHeaders(headerOutputState);
 
-		partitionFile = partitionFileArray[fileIndex];
-		FileOutputStreamWrite(&partitionFile, headerOutputState->fe_msgbuf);
+		FileOutputStreamWrite(partitionFile, headerOutputState->fe_msgbuf);
 	}
 }
 
@@ -1147,7 +1515,7 @@ OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount)
 	for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
 		/* Generate footer for a binary copy */
-		FileOutputStream partitionFile = { };
+		FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
 		CopyOutStateData footerOutputStateData;
 		CopyOutState footerOutputState = (CopyOutState) & footerOutputStateData;
 
@@ -1156,8 +1524,7 @@ OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount)
 
 		AppendCopyBinaryFooters(footerOutputState);
 
-		partitionFile = partitionFileArray[fileIndex];
-		FileOutputStreamWrite(&partitionFile, footerOutputState->fe_msgbuf);
+		FileOutputStreamWrite(partitionFile, footerOutputState->fe_msgbuf);
 	}
 }
 
@@ -1220,6 +1587,56 @@ RangePartitionId(Datum partitionValue, Oid partitionCollation, const void *conte
 }
 
 
+/*
+ * SkewedPartitionId returns the partition for a row with the given partition
+ * value that hash partitioning put into the given partition. If the value is
+ * one of the skewed values whose rows are spread, the rows are assigned to the
+ * partitions that follow the given partition in turn. If the rows of the value
+ * are copied, the function sets partitionCopyCount to the number of partitions
+ * from the given one on that the row should be written to.
+ *
+ * Since the other side of the join copies its rows of the value to each of the
+ * partitions that this side spreads them over, every pair of matching rows
+ * still meets in exactly one partition.
+ */
+static uint32
+SkewedPartitionId(SkewedPartitionContext *skewContext, Datum partitionValue,
+				  uint32 partitionId, uint32 fileCount, uint32 *partitionCopyCount)
+{
+	/* most rows are not in a partition of a skewed value, skip hashing them again */
+	if (!skewContext->skewedPartitionArray[partitionId])
+	{
+		return partitionId;
+	}
+
+	Datum hashDatum = HashPartitionColumnValue(skewContext->hashFunction,
+											   DEFAULT_COLLATION_OID, partitionValue);
+	int32 hashValue = DatumGetInt32(hashDatum);
+
+	for (int skewIndex = 0; skewIndex < skewContext->skewedHashCount; skewIndex++)
+	{
+		if (skewContext->skewedHashArray[skewIndex] != hashValue)
+		{
+			continue;
+		}
+
+		int32 skewPartitionCount = skewContext->skewPartitionCountArray[skewIndex];
+		if (skewPartitionCount < 0)
+		{
+			*partitionCopyCount = (uint32) -skewPartitionCount;
+			return partitionId;
+		}
+
+		uint32 spreadOffset = skewContext->spreadRowCount % skewPartitionCount;
+		skewContext->spreadRowCount++;
+
+		return (partitionId + spreadOffset) % fileCount;
+	}
+
+	return partitionId;
+}
+
+
 /*
  * HashPartitionId determines the partition number for the given data value
  * using hash partitioning. More specifically, the function returns zero if the
@@ -1238,9 +1655,8 @@ HashPartitionId(Datum partitionValue, Oid partitionCollation, const void *contex
 	ShardInterval **syntheticShardIntervalArray =
 		hashPartitionContext->syntheticShardIntervalArray;
 	FmgrInfo *comparisonFunction = hashPartitionContext->comparisonFunction;
-	Datum hashDatum = FunctionCall1Coll(hashFunction, DEFAULT_COLLATION_OID,
-										partitionValue);
-	int32 hashResult = 0;
+	Datum hashDatum = HashPartitionColumnValue(hashFunction, DEFAULT_COLLATION_OID,
+											   partitionValue);
 	uint32 hashPartitionId = 0;
 
 	if (hashDatum == 0)
@@ -1250,10 +1666,8 @@ HashPartitionId(Datum partitionValue, Oid partitionCollation, const void *contex
 
 	if (hashPartitionContext->hasUniformHashDistribution)
 	{
-		uint64 hashTokenIncrement = HASH_TOKEN_COUNT / partitionCount;
-
-		hashResult = DatumGetInt32(hashDatum);
-		hashPartitionId = (uint32) (hashResult - INT32_MIN) / hashTokenIncrement;
+		hashPartitionId = UniformHashShardIndex(DatumGetInt32(hashDatum),
+												partitionCount);
 	}
 	else
 	{
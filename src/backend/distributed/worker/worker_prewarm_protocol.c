@@ -0,0 +1,140 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_prewarm_protocol.c
+ *
+ * Routines for warming up the buffer cache of a node for shards that are
+ * moved to it. The coordinator asks the source node how many blocks of each
+ * shard relation are in its buffer cache, and asks the target node to load
+ * as many blocks of the new placements into its buffer cache.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/heapam.h"
+#include "catalog/pg_class.h"
+#include "distributed/metadata_cache.h"
+#include "storage/buf_internals.h"
+#include "storage/bufmgr.h"
+#include "storage/relfilenode.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+
+static bool RelationHasStorage(Relation relation);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_cached_block_count);
+PG_FUNCTION_INFO_V1(worker_prewarm_relation);
+
+
+/*
+ * worker_cached_block_count returns the number of blocks of the main fork of
+ * the given relation that are in the buffer cache.
+ */
+Datum
+worker_cached_block_count(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int64 cachedBlockCount = 0;
+
+	CheckCitusVersion(ERROR);
+
+	Relation relation = relation_open(relationId, AccessShareLock);
+	RelFileNode relFileNode = relation->rd_node;
+	bool hasStorage = RelationHasStorage(relation);
+
+	relation_close(relation, AccessShareLock);
+
+	if (!hasStorage)
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	for (int bufferIndex = 0; bufferIndex < NBuffers; bufferIndex++)
+	{
+		BufferDesc *bufferDesc = GetBufferDescriptor(bufferIndex);
+		uint32 bufferState = LockBufHdr(bufferDesc);
+
+		if ((bufferState & BM_VALID) &&
+			bufferDesc->tag.forkNum == MAIN_FORKNUM &&
+			RelFileNodeEquals(bufferDesc->tag.rnode, relFileNode))
+		{
+			cachedBlockCount++;
+		}
+
+		UnlockBufHdr(bufferDesc, bufferState);
+	}
+
+	PG_RETURN_INT64(cachedBlockCount);
+}
+
+
+/*
+ * worker_prewarm_relation loads up to the given number of blocks of the main
+ * fork of the given relation into the buffer cache, starting at the first
+ * block, and returns the number of blocks it loaded.
+ */
+Datum
+worker_prewarm_relation(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int64 maxBlockCount = PG_GETARG_INT64(1);
+
+	CheckCitusVersion(ERROR);
+
+	Relation relation = relation_open(relationId, AccessShareLock);
+
+	AclResult aclResult = pg_class_aclcheck(relationId, GetUserId(), ACL_SELECT);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, OBJECT_TABLE, get_rel_name(relationId));
+	}
+
+	if (!RelationHasStorage(relation) || maxBlockCount <= 0)
+	{
+		relation_close(relation, AccessShareLock);
+		PG_RETURN_INT64(0);
+	}
+
+	int64 blockCount = RelationGetNumberOfBlocksInFork(relation, MAIN_FORKNUM);
+	if (blockCount > maxBlockCount)
+	{
+		blockCount = maxBlockCount;
+	}
+
+	for (BlockNumber blockNumber = 0; blockNumber < blockCount; blockNumber++)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		Buffer buffer = ReadBufferExtended(relation, MAIN_FORKNUM, blockNumber,
+										   RBM_NORMAL, NULL);
+		ReleaseBuffer(buffer);
+	}
+
+	relation_close(relation, AccessShareLock);
+
+	PG_RETURN_INT64(blockCount);
+}
+
+
+/*
+ * RelationHasStorage returns whether the given relation has blocks of its
+ * own, which is not the case for views, foreign tables and partitioned
+ * tables and indexes.
+ */
+static bool
+RelationHasStorage(Relation relation)
+{
+	char relationKind = relation->rd_rel->relkind;
+
+	return relationKind == RELKIND_RELATION || relationKind == RELKIND_INDEX ||
+		   relationKind == RELKIND_MATVIEW || relationKind == RELKIND_TOASTVALUE;
+}
@@ -17,14 +17,45 @@
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_shard_visibility.h"
 #include "nodes/nodeFuncs.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 
 
+/*
+ * KnownShardCacheEntry records whether a relation is a known shard. The
+ * outcome depends on the name and namespace of the relation, which are
+ * covered by invalidations of the relation itself, and, if the name looks
+ * like a shard name, on the metadata and name of the distributed table
+ * that owns the shard. Entries of the latter kind are only valid as long
+ * as KnownShardCacheEpoch has not moved on.
+ */
+typedef struct KnownShardCacheEntry
+{
+	Oid relationId;
+	bool isKnownShard;
+	bool dependsOnMetadata;
+	uint64 epoch;
+} KnownShardCacheEntry;
+
+
 /* Config variable managed via guc.c */
 bool OverrideTableVisibility = true;
 
+/* relation ID -> KnownShardCacheEntry, kept current by relcache invalidations */
+static HTAB *KnownShardCacheHash = NULL;
+
+/* distributed tables that cached entries depend on */
+static HTAB *KnownShardOwnerHash = NULL;
+
+/* bumped when an entry in KnownShardOwnerHash is invalidated */
+static uint64 KnownShardCacheEpoch = 0;
+
 static bool ReplaceTableVisibleFunctionWalker(Node *inputNode);
+static void InitializeKnownShardCache(void);
+static bool LookupKnownShard(Oid shardRelationId, bool *dependsOnMetadata,
+							 Oid *distributedRelationId);
 
 PG_FUNCTION_INFO_V1(citus_table_is_visible);
 PG_FUNCTION_INFO_V1(relation_is_a_known_shard);
@@ -108,7 +139,6 @@ citus_table_is_visible(PG_FUNCTION_ARGS)
 bool
 RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 {
-	bool missingOk = true;
 	char relKind = '\0';
 
 	if (!OidIsValid(shardRelationId))
@@ -133,12 +163,11 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		}
 	}
 
-	Relation relation = try_relation_open(shardRelationId, AccessShareLock);
-	if (relation == NULL)
+	/* the cache does not know about dropped relations, so check existence first */
+	if (!SearchSysCacheExists1(RELOID, ObjectIdGetDatum(shardRelationId)))
 	{
 		return false;
 	}
-	relation_close(relation, NoLock);
 
 	/* we're not interested in the relations that are not in the search path */
 	if (!RelationIsVisible(shardRelationId) && onlySearchPath)
@@ -157,8 +186,72 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		shardRelationId = IndexGetRelation(shardRelationId, false);
 	}
 
+	if (KnownShardCacheHash == NULL)
+	{
+		InitializeKnownShardCache();
+	}
+
+	bool found = false;
+	KnownShardCacheEntry *cacheEntry = hash_search(KnownShardCacheHash,
+												   &shardRelationId, HASH_FIND,
+												   &found);
+	if (found && (!cacheEntry->dependsOnMetadata ||
+				  cacheEntry->epoch == KnownShardCacheEpoch))
+	{
+		return cacheEntry->isKnownShard;
+	}
+
+	bool dependsOnMetadata = false;
+	Oid distributedRelationId = InvalidOid;
+	bool isKnownShard = LookupKnownShard(shardRelationId, &dependsOnMetadata,
+										 &distributedRelationId);
+
+	/*
+	 * Names that look like a shard name without a matching shard in the
+	 * metadata are rare and we would not learn when such a shard gets
+	 * added, so we only cache outcomes for which we know the owner.
+	 */
+	if (dependsOnMetadata && !OidIsValid(distributedRelationId))
+	{
+		return isKnownShard;
+	}
+
+	if (dependsOnMetadata)
+	{
+		hash_search(KnownShardOwnerHash, &distributedRelationId, HASH_ENTER, NULL);
+	}
+
+	cacheEntry = hash_search(KnownShardCacheHash, &shardRelationId, HASH_ENTER, NULL);
+	cacheEntry->isKnownShard = isKnownShard;
+	cacheEntry->dependsOnMetadata = dependsOnMetadata;
+	cacheEntry->epoch = KnownShardCacheEpoch;
+
+	return isKnownShard;
+}
+
+
+/*
+ * LookupKnownShard checks whether the given relation, which is not an index,
+ * is a shard of a distributed table using its name and the metadata. It sets
+ * dependsOnMetadata when the name looks like a shard name, and in that case
+ * distributedRelationId to the distributed table that owns the shard ID in
+ * the name, if any.
+ */
+static bool
+LookupKnownShard(Oid shardRelationId, bool *dependsOnMetadata,
+				 Oid *distributedRelationId)
+{
+	bool missingOk = true;
+
+	*dependsOnMetadata = false;
+	*distributedRelationId = InvalidOid;
+
 	/* get the shard's relation name */
 	char *shardRelationName = get_rel_name(shardRelationId);
+	if (shardRelationName == NULL)
+	{
+		return false;
+	}
 
 	uint64 shardId = ExtractShardIdFromTableName(shardRelationName, missingOk);
 	if (shardId == INVALID_SHARD_ID)
@@ -170,6 +263,8 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		return false;
 	}
 
+	*dependsOnMetadata = true;
+
 	/* try to get the relation id */
 	Oid relationId = LookupShardRelation(shardId, true);
 	if (!OidIsValid(relationId))
@@ -178,6 +273,8 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		return false;
 	}
 
+	*distributedRelationId = relationId;
+
 	/* verify that their namespaces are the same */
 	if (get_rel_namespace(shardRelationId) != get_rel_namespace(relationId))
 	{
@@ -190,6 +287,11 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 	 * appended to its name could be misleading.
 	 */
 	char *generatedRelationName = get_rel_name(relationId);
+	if (generatedRelationName == NULL)
+	{
+		return false;
+	}
+
 	AppendShardIdToName(&generatedRelationName, shardId);
 	if (strncmp(shardRelationName, generatedRelationName, NAMEDATALEN) == 0)
 	{
@@ -201,6 +303,70 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 }
 
 
+/*
+ * InitializeKnownShardCache creates the hashes that cache the outcome of
+ * RelationIsAKnownShard.
+ */
+static void
+InitializeKnownShardCache(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(KnownShardCacheEntry);
+	info.hash = oid_hash;
+	info.hcxt = CacheMemoryContext;
+
+	KnownShardCacheHash = hash_create("Known Shard Cache Hash", 256, &info,
+									  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(Oid);
+	info.hash = oid_hash;
+	info.hcxt = CacheMemoryContext;
+
+	KnownShardOwnerHash = hash_create("Known Shard Owner Hash", 32, &info,
+									  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+
+/*
+ * InvalidateKnownShardCache is called on relcache invalidations. It removes
+ * the entry of the relation itself, and invalidates all entries that depend
+ * on the metadata when the relation owns shards we cached. Changes to the
+ * shard metadata send invalidations for the distributed table, so those are
+ * covered as well.
+ */
+void
+InvalidateKnownShardCache(Oid relationId)
+{
+	if (KnownShardCacheHash == NULL)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid)
+	{
+		hash_destroy(KnownShardCacheHash);
+		hash_destroy(KnownShardOwnerHash);
+		KnownShardCacheHash = NULL;
+		KnownShardOwnerHash = NULL;
+		return;
+	}
+
+	hash_search(KnownShardCacheHash, &relationId, HASH_REMOVE, NULL);
+
+	bool found = false;
+	hash_search(KnownShardOwnerHash, &relationId, HASH_REMOVE, &found);
+	if (found)
+	{
+		KnownShardCacheEpoch++;
+	}
+}
+
+
 /*
  * ReplaceTableVisibleFunction is a wrapper around ReplaceTableVisibleFunctionWalker.
  * The replace functionality can be enabled/disable via a GUC. This function also
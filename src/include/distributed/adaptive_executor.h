@@ -10,11 +10,84 @@ extern int MaxAdaptiveExecutorPoolSize;
 /* GUC, number of ms to wait between opening connections to the same worker */
 extern int ExecutorSlowStartInterval;
 
+/* GUC, maximum number of shard commands sent in a single round trip */
+extern int ExecutorBatchSize;
+
+/* GUC, determining whether results are requested from workers in binary format */
+extern bool EnableBinaryProtocol;
+
+/* GUC, determining whether read-only results are returned while tasks still run */
+extern bool EnableStreamingExecution;
+
+/* GUC, determining whether results are streamed when fetched incrementally */
+extern bool EnableCursorStreaming;
+
+/* GUC, determining whether RETURNING rows of modifications are streamed */
+extern bool EnableStreamingReturning;
+
+/* GUC, memory in kB the tuple store of a scan uses before spilling, -1 for work_mem */
+extern int ExecutorResultMemory;
+
+/* GUC, time in ms after which slow reads are also started on another placement */
+extern int HedgedReadDelay;
+
+/* GUC, determining whether tasks are skipped once a LIMIT has enough rows */
+extern bool EnableLimitCancellation;
+
+/* GUC, determining whether pool sizes are based on observed latencies */
+extern bool EnableAdaptivePoolSizing;
+
+/* GUC, determining whether BEGIN is sent in the same command as the first task */
+extern bool EnableCoalescedBegin;
+
+/* GUC, determining whether remote tasks are sent before local tasks are executed */
+extern bool EnableConcurrentLocalExecution;
+
+/* GUC, number of parallel workers the scans of large shards share per node */
+extern int ParallelWorkersPerNode;
+
+
+/*
+ * WorkerPoolExecutionStats describes how the execution on a single worker went,
+ * as shown by EXPLAIN ANALYZE when citus.explain_worker_pools is enabled and
+ * recorded per worker in citus_stat_statements. The
+ * times are in milliseconds, and latencies are relative to the start of the
+ * remote execution.
+ */
+typedef struct WorkerPoolExecutionStats
+{
+	char *nodeName;
+	int nodePort;
+
+	/* number of placement executions sent to the worker */
+	int taskCount;
+
+	/* connections established for the execution and the time it took */
+	int connectionCount;
+	double connectionTime;
+
+	/* total time placement executions waited before being sent */
+	double queueWaitTime;
+
+	/* time at which the first and the last result was received */
+	bool receivedResults;
+	double firstByteTime;
+	double lastByteTime;
+
+	/* number of rows and bytes of column data received */
+	uint64 rowCount;
+	uint64 byteCount;
+} WorkerPoolExecutionStats;
+
+
 extern uint64 ExecuteTaskList(RowModifyLevel modLevel, List *taskList,
 							  int targetPoolSize, bool localExecutionSupported);
 extern uint64 ExecuteUtilityTaskList(List *utilityTaskList, bool localExecutionSupported);
+extern uint64 ExecuteUtilityTaskListExtended(List *utilityTaskList, int targetPoolSize,
+											 bool localExecutionSupported);
 extern uint64 ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
 												int targetPoolSize, List *jobIdList);
+extern void FinishStreamingExecutions(void);
 
 
 #endif /* ADAPTIVE_EXECUTOR_H */
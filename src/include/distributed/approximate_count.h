@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * approximate_count.h
+ *	Functions and global variables to answer count(*) queries on distributed
+ *	tables from the statistics of their shards.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef APPROXIMATE_COUNT_H
+#define APPROXIMATE_COUNT_H
+
+#include "nodes/parsenodes.h"
+
+extern bool EnableApproximateCount;
+
+extern bool RewriteCountToApproximateCount(Query *query);
+
+#endif /* APPROXIMATE_COUNT_H */
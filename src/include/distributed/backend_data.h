@@ -17,9 +17,8 @@
 #include "datatype/timestamp.h"
 #include "distributed/transaction_identifier.h"
 #include "nodes/pg_list.h"
-#include "storage/lwlock.h"
+#include "port/atomics.h"
 #include "storage/proc.h"
-#include "storage/s_lock.h"
 
 
 /*
@@ -46,20 +45,27 @@ typedef struct CitusInitiatedBackend
  */
 typedef struct BackendData
 {
+	/*
+	 * Only the backend that owns the data changes the fields below, and it
+	 * increments changeCount before and after doing so. Other backends read
+	 * the fields without locking and retry when changeCount was odd or has
+	 * changed in the meantime, see ReadBackendData().
+	 */
+	uint32 changeCount;
+
 	Oid databaseId;
 	Oid userId;
-	slock_t mutex;
-	bool cancelledDueToDeadlock;
 	CitusInitiatedBackend citusBackend;
 	DistributedTransactionId transactionId;
+
+	/* transaction number of the transaction cancelled due to a deadlock, or 0 */
+	pg_atomic_uint64 cancelledTransactionNumber;
 } BackendData;
 
 
 extern void InitializeBackendManagement(void);
 extern int TotalProcCount(void);
 extern void InitializeBackendData(void);
-extern void LockBackendSharedMemory(LWLockMode lockMode);
-extern void UnlockBackendSharedMemory(void);
 extern void UnSetDistributedTransactionId(void);
 extern void AssignDistributedTransactionId(void);
 extern void MarkCitusInitiatedCoordinatorBackend(void);
@@ -29,7 +29,10 @@ typedef enum MasterEvaluationMode
 	EVALUATE_PARAMS,
 
 	/* evaluate both the functions/expressions and the external paramaters */
-	EVALUATE_FUNCTIONS_PARAMS
+	EVALUATE_FUNCTIONS_PARAMS,
+
+	/* same as above, but leave nextval calls to the workers */
+	EVALUATE_FUNCTIONS_PARAMS_EXCEPT_SEQUENCES
 } MasterEvaluationMode;
 
 /*
@@ -44,8 +47,12 @@ typedef struct MasterEvaluationContext
 
 
 extern bool RequiresMasterEvaluation(Query *query);
+extern bool RequiresMasterEvaluationExceptSequences(Query *query);
 extern void ExecuteMasterEvaluableFunctionsAndParameters(Query *query,
 														 PlanState *planState);
+extern void ExecuteMasterEvaluableFunctionsAndParametersExceptSequences(Query *query,
+																		PlanState *
+																		planState);
 extern void ExecuteMasterEvaluableParameters(Query *query, PlanState *planState);
 extern Node * PartiallyEvaluateExpression(Node *expression,
 										  MasterEvaluationContext *masterEvaluationContext);
@@ -14,6 +14,7 @@
 #include "distributed/multi_server_executor.h"
 #include "executor/execdesc.h"
 #include "nodes/plannodes.h"
+#include "portability/instr_time.h"
 
 typedef struct CitusScanState
 {
@@ -26,9 +27,43 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+
+	/* execution that is still running while its results are being returned */
+	struct DistributedExecution *distributedExecution;
+
+	/* number of tuples read from the tuple store in forward direction */
+	uint64 streamedTupleCount;
+
+	/* executor flags the scan was started with */
+	int eflags;
+
+	/* whether the first ExecutorRun of the query asked for a limited number of rows */
+	bool incrementalFetch;
+
+	/* whether rows that were already returned are removed from the tuple store */
+	bool trimTupleStore;
+
+	/* WorkerPoolExecutionStats of the execution, if any were collected */
+	List *workerPoolStatsList;
+
+	/* total size of the rows built from the results of the workers */
+	uint64 receivedRowBytes;
+
+	/* time at which the scan started, if citus_stat_statements records it */
+	instr_time executionStartTime;
+
+	/* key of the result in the query result cache, if it may be cached */
+	struct QueryResultCacheRequest *resultCacheRequest;
+
+	/* whether a multi-row INSERT is executed through COPY instead of tasks */
+	bool executeInsertAsCopy;
 } CitusScanState;
 
 
+/* GUC, whether fast path queries keep their parameters in the shard query */
+extern bool EnableParameterizedShardQueries;
+
+
 /* custom scan methods for all executors */
 extern CustomScanMethods AdaptiveExecutorCustomScanMethods;
 extern CustomScanMethods TaskTrackerCustomScanMethods;
@@ -45,5 +80,6 @@ extern EState * ScanStateGetExecutorState(CitusScanState *scanState);
 extern CustomScan * FetchCitusCustomScanIfExists(Plan *plan);
 extern bool IsCitusPlan(Plan *plan);
 extern bool IsCitusCustomScan(Plan *plan);
+extern MultiExecutorType CitusCustomScanExecutorType(CustomScan *customScan);
 
 #endif /* CITUS_CUSTOM_SCAN_H */
@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.h
+ *   Wait events that Citus reports while waiting for remote nodes, shared
+ *   connection slots and intermediate results.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CITUS_WAIT_EVENTS_H
+#define CITUS_WAIT_EVENTS_H
+
+#include "pgstat.h"
+
+
+/*
+ * CitusWaitEvent lists the wait events in the extension class that Citus
+ * uses. pg_stat_activity shows all of them as Extension, the citus_wait_events
+ * view shows their names.
+ */
+typedef enum CitusWaitEvent
+{
+	WAIT_EVENT_CITUS_REMOTE_TASK_EXECUTION = PG_WAIT_EXTENSION + 1,
+	WAIT_EVENT_CITUS_CONNECTION_ESTABLISHMENT,
+	WAIT_EVENT_CITUS_SHARED_CONNECTION_SLOT,
+	WAIT_EVENT_CITUS_REMOTE_COMMAND,
+	WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_WRITE,
+	WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_READ,
+	WAIT_EVENT_CITUS_INTERMEDIATE_RESULT_FETCH,
+	WAIT_EVENT_CITUS_TWO_PHASE_PREPARE,
+	WAIT_EVENT_CITUS_TRANSACTION_COMMIT,
+	WAIT_EVENT_CITUS_METADATA_SYNC
+} CitusWaitEvent;
+
+
+extern const char * CitusWaitEventName(uint32 waitEventInfo);
+
+#endif /* CITUS_WAIT_EVENTS_H */
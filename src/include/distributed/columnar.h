@@ -0,0 +1,156 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar.h
+ *	  Type and function declarations for the columnar table access method.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/tupdesc.h"
+#include "nodes/bitmapset.h"
+#include "storage/bufpage.h"
+#include "storage/relfilenode.h"
+#include "utils/relcache.h"
+#include "utils/snapshot.h"
+
+
+/* the metapage is the first block, stripes start at the second block */
+#define COLUMNAR_METAPAGE_BLOCKNO 0
+#define COLUMNAR_FIRST_STRIPE_BLOCKNO 1
+
+#define COLUMNAR_METAPAGE_MAGIC_NUMBER 0x434F4C4D
+#define COLUMNAR_STRIPE_MAGIC_NUMBER 0x434F4C53
+#define COLUMNAR_STORAGE_VERSION 1
+
+/* stripe bytes are stored in the data area of each page, after the header */
+#define COLUMNAR_PAGE_DATA_OFFSET MAXALIGN(SizeOfPageHeaderData)
+#define COLUMNAR_BYTES_PER_PAGE (BLCKSZ - COLUMNAR_PAGE_DATA_OFFSET)
+#define COLUMNAR_STRIPE_BLOCK_COUNT(stripeLength) \
+	((BlockNumber) (((stripeLength) + COLUMNAR_BYTES_PER_PAGE - 1) / \
+					COLUMNAR_BYTES_PER_PAGE))
+
+/* stripe flags set by VACUUM */
+#define COLUMNAR_STRIPE_FROZEN 0x0001
+#define COLUMNAR_STRIPE_ABORTED 0x0002
+
+
+/* compression types of column chunks */
+typedef enum ColumnarCompressionType
+{
+	COLUMNAR_COMPRESSION_NONE = 0,
+	COLUMNAR_COMPRESSION_PGLZ = 1
+} ColumnarCompressionType;
+
+
+/*
+ * ColumnarMetapage is stored at the start of the first block of a columnar
+ * relation and tracks which blocks are reserved for stripes.
+ */
+typedef struct ColumnarMetapage
+{
+	uint32 magicNumber;
+	uint32 version;
+
+	/* first block that is not reserved for a stripe */
+	BlockNumber nextStripeBlock;
+
+	/* row number of the first row of the next stripe */
+	uint64 nextRowNumber;
+} ColumnarMetapage;
+
+
+/*
+ * ColumnarStripeHeader is stored at the start of the first block of each
+ * stripe. It is written together with the reservation of the stripe's
+ * blocks, such that readers can always step over a stripe, also if its
+ * writer crashed before writing the rest of it. The skip list and the column
+ * chunks follow the header.
+ */
+typedef struct ColumnarStripeHeader
+{
+	uint32 magicNumber;
+	uint16 flags;
+	uint16 columnCount;
+
+	/* transaction and command that wrote the stripe */
+	TransactionId xid;
+	CommandId cid;
+
+	BlockNumber blockCount;
+	uint32 chunkGroupCount;
+	uint64 firstRowNumber;
+	uint64 rowCount;
+
+	/* length of the skip list, followed by the length of the column chunks */
+	uint32 skipListLength;
+	uint64 dataLength;
+} ColumnarStripeHeader;
+
+
+/* opaque state of a columnar read */
+typedef struct ColumnarReadState ColumnarReadState;
+
+
+/* GUC variables */
+extern int ColumnarCompression;
+extern int ColumnarStripeRowCount;
+extern int ColumnarChunkGroupRowCount;
+extern bool EnableColumnarScan;
+
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+
+#include "nodes/pathnodes.h"
+
+/* columnar_tableam.c */
+extern bool IsColumnarTable(Relation relation);
+
+/* columnar_storage.c */
+extern void ColumnarReadMetapage(Relation relation, ColumnarMetapage *metapage);
+extern BlockNumber ColumnarWriteStripe(Relation relation, char *stripeData,
+									   uint64 stripeLength);
+extern bool ColumnarReadStripeHeader(Relation relation, BlockNumber blockNumber,
+									 ColumnarStripeHeader *stripeHeader);
+extern void ColumnarReadStripeData(Relation relation, BlockNumber firstBlock,
+								   uint64 offset, char *data, uint64 length);
+extern void ColumnarSetStripeFlags(Relation relation, BlockNumber blockNumber,
+								   uint16 flags);
+
+/* columnar_writer.c */
+extern void ColumnarWriteRow(Relation relation, Datum *values, bool *nulls,
+							 CommandId commandId);
+extern void ColumnarFlushPendingWrites(Relation relation);
+extern void ColumnarDiscardPendingWrites(RelFileNode relFileNode);
+extern void ColumnarFlushAllPendingWrites(void);
+extern void ColumnarResetPendingWrites(void);
+extern void ColumnarAtEOSubXact(bool isCommit, SubTransactionId subId,
+								SubTransactionId parentSubId);
+
+/* columnar_reader.c */
+extern ColumnarReadState * ColumnarBeginRead(Relation relation, Snapshot snapshot,
+											 Bitmapset *projectedColumns,
+											 List *whereClauseList);
+extern bool ColumnarReadNextRow(ColumnarReadState *readState, Datum *values,
+								bool *nulls, uint64 *rowNumber);
+extern void ColumnarRescan(ColumnarReadState *readState);
+extern void ColumnarEndRead(ColumnarReadState *readState);
+extern BlockNumber ColumnarRowBlockNumber(ColumnarReadState *readState);
+extern uint64 ColumnarChunkGroupsSkipped(ColumnarReadState *readState);
+extern bool ColumnarStripeVisible(ColumnarStripeHeader *stripeHeader,
+								  Snapshot snapshot);
+
+/* columnar_customscan.c */
+extern void AddColumnarScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+								RangeTblEntry *rangeTableEntry);
+extern void RegisterColumnarScanMethods(void);
+
+#endif
+
+#endif /* COLUMNAR_H */
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_intermediate_results.h
+ *    Writing and reading intermediate results in a block-columnar format
+ *    with per-block min/max values.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_INTERMEDIATE_RESULTS_H
+#define COLUMNAR_INTERMEDIATE_RESULTS_H
+
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+#include "nodes/bitmapset.h"
+#include "nodes/pg_list.h"
+
+
+/* opaque, defined in columnar_intermediate_results.c */
+typedef struct ColumnarResultWriter ColumnarResultWriter;
+typedef struct ColumnarResultReader ColumnarResultReader;
+
+
+/* GUC variable */
+extern bool ColumnarIntermediateResults;
+
+
+extern bool CanUseColumnarResultFormat(TupleDesc tupleDescriptor);
+extern ColumnarResultWriter * CreateColumnarResultWriter(TupleDesc tupleDescriptor);
+extern void AppendColumnarResultHeader(ColumnarResultWriter *writer, StringInfo output);
+extern bool AppendColumnarResultRow(ColumnarResultWriter *writer, Datum *columnValues,
+									bool *columnNulls);
+extern void FlushColumnarResultBlock(ColumnarResultWriter *writer, StringInfo output);
+extern ColumnarResultReader * OpenColumnarResultReader(char *fileName,
+													   TupleDesc tupleDescriptor,
+													   Bitmapset *projectedColumns,
+													   List *whereClauseList);
+extern bool ReadNextColumnarResultRow(ColumnarResultReader *reader,
+									  Datum *columnValues, bool *columnNulls);
+extern void CloseColumnarResultReader(ColumnarResultReader *reader);
+
+#endif /* COLUMNAR_INTERMEDIATE_RESULTS_H */
@@ -142,6 +142,7 @@ extern List * PreprocessGrantStmt(Node *node, const char *queryString);
 
 
 /* index.c - forward declarations */
+extern int MaxIndexBuildPoolSize;
 extern bool IsIndexRenameStmt(RenameStmt *renameStmt);
 extern List * PreprocessIndexStmt(Node *createIndexStatement,
 								  const char *createIndexCommand);
@@ -272,6 +273,9 @@ extern char * GenerateBackupNameForProcCollision(const ObjectAddress *address);
 extern ObjectWithArgs * ObjectWithArgsFromOid(Oid funcOid);
 
 /* vacuum.c - forward declarations */
+extern int MaxVacuumPoolSize;
+extern bool VacuumShardsByDeadTuples;
+extern bool UpdateShardStatisticsOnAnalyze;
 extern void PostprocessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand);
 
 extern bool ShouldPropagateSetCommand(VariableSetStmt *setStmt);
@@ -23,6 +23,18 @@
 
 #define INVALID_PARTITION_COLUMN_INDEX -1
 
+/* maximum number of shards to stream at the same time in COPY table TO STDOUT */
+extern int CopyToParallelStreams;
+
+/* whether binary COPY FROM STDIN only decodes the distribution column */
+extern bool EnableBinaryCopyPassthrough;
+
+/* whether COPY data sent to remote shard placements is compressed */
+extern bool CompressCopyData;
+
+/* whether COPY into a partitioned table sends rows to the shards of the partitions */
+extern bool EnableCopyPartitionRouting;
+
 
 /*
  * CitusCopyDest indicates the source or destination of a COPY command.
@@ -77,6 +89,30 @@ typedef struct CopyCoercionData
 	Oid typioparam; /* inputFunction has an extra param */
 } CopyCoercionData;
 
+/*
+ * CopySerializationPlan describes how rows with the given input column types
+ * are coerced into the given columns of a distributed table and serialised for
+ * the workers. Building it takes several syscache lookups per column, so it is
+ * cached in the metadata cache entry of the table, and rebuilt when the table
+ * changes or a COPY uses different input types or columns.
+ */
+typedef struct CopySerializationPlan
+{
+	/* memory context that holds the plan, a child of CacheMemoryContext */
+	MemoryContext context;
+
+	int columnCount;
+	Oid *inputTypeArray;
+	List *columnNameList;
+
+	bool binary;
+	CopyCoercionData *columnCoercionPaths;
+	FmgrInfo *columnOutputFunctions;
+} CopySerializationPlan;
+
+/* state for routing rows to partitions, defined in multi_copy.c */
+typedef struct CopyPartitionRouting CopyPartitionRouting;
+
 /* CopyDestReceiver can be used to stream results into a distributed table */
 typedef struct CitusCopyDestReceiver
 {
@@ -132,6 +168,9 @@ typedef struct CitusCopyDestReceiver
 
 	/* copy into intermediate result */
 	char *intermediateResultIdPrefix;
+
+	/* routing of rows to the shards of partitions, NULL if not used */
+	CopyPartitionRouting *partitionRouting;
 } CitusCopyDestReceiver;
 
 
@@ -161,6 +200,7 @@ extern void CheckCopyPermissions(CopyStmt *copyStatement);
 extern bool IsCopyResultStmt(CopyStmt *copyStatement);
 extern void ConversionPathForTypes(Oid inputType, Oid destType, CopyCoercionData *result);
 extern Datum CoerceColumnValue(Datum inputValue, CopyCoercionData *coercionPath);
+extern void FreeCopySerializationPlan(CopySerializationPlan *serializationPlan);
 
 
 #endif /* MULTI_COPY_H */
@@ -64,7 +64,13 @@ enum MultiConnectionMode
 	 * establishments may be suspended until a connection slot is available to
 	 * the remote host.
 	 */
-	WAIT_FOR_CONNECTION = 1 << 6
+	WAIT_FOR_CONNECTION = 1 << 6,
+
+	/*
+	 * The connection is opened to execute one of many tasks, which makes it a
+	 * connection of the batch workload class unless citus.workload_class is set.
+	 */
+	MULTI_SHARD_EXECUTION = 1 << 7
 };
 
 
@@ -131,6 +137,12 @@ typedef struct MultiConnection
 	/* time connection establishment was started, for timeout */
 	TimestampTz connectionStart;
 
+	/* whether the establishment of the connection is reflected in the stats */
+	bool connectionEstablishmentRecorded;
+
+	/* WorkloadClass under which the connection is counted in the shared pool */
+	int workloadClass;
+
 	/* membership in list of list of connections in ConnectionHashEntry */
 	dlist_node connectionNode;
 
@@ -146,6 +158,15 @@ typedef struct MultiConnection
 	/* number of bytes sent to PQputCopyData() since last flush */
 	uint64 copyBytesWrittenSinceLastFlush;
 
+	/* commands that are (to be) prepared over this connection, see remote_commands.c */
+	List *preparedStatementList;
+
+	/* number of statements prepared over this connection, used for naming */
+	uint64 preparedStatementCount;
+
+	/* WorkerPreparedStatementGeneration when preparedStatementList was last valid */
+	uint64 preparedStatementGeneration;
+
 	MultiConnectionStructInitializationState initilizationState;
 } MultiConnection;
 
@@ -192,9 +213,15 @@ extern int NodeConnectionTimeout;
 /* maximum number of connections to cache per worker per session */
 extern int MaxCachedConnectionsPerWorker;
 
+/* number of connections to open per worker at the start of a session */
+extern int WarmConnectionsPerWorker;
+
 /* parameters used for outbound connections */
 extern char *NodeConninfo;
 
+/* whether to connect to the local node over a Unix-domain socket */
+extern bool UseUnixSocketForLocalNode;
+
 /* the hash table */
 extern HTAB *ConnectionHash;
 extern HTAB *ConnParamsHash;
@@ -205,6 +232,8 @@ extern struct MemoryContextData *ConnectionContext;
 
 extern void AfterXactConnectionHandling(bool isCommit);
 extern void InitializeConnectionManagement(void);
+extern int GetMaxCachedConnectionsPerWorker(void);
+extern void WarmUpWorkerConnections(void);
 
 extern void InitConnParams(void);
 extern void ResetConnParams(void);
@@ -241,6 +270,7 @@ extern void ShutdownConnection(MultiConnection *connection);
 /* dealing with a connection */
 extern void FinishConnectionListEstablishment(List *multiConnectionList);
 extern void FinishConnectionEstablishment(MultiConnection *connection);
+extern void MarkConnectionEstablished(MultiConnection *connection);
 extern void ClaimConnectionExclusively(MultiConnection *connection);
 extern void UnclaimConnection(MultiConnection *connection);
 
@@ -21,8 +21,28 @@
 #include "distributed/citus_custom_scan.h"
 
 
+/* prefix of the placeholders for shard names in a ShardQueryTemplate */
+#define SHARD_QUERY_TEMPLATE_SLOT_PREFIX "citus_shard_slot_"
+
+/*
+ * ShardQueryTemplate is a deparsed query in which the shard names are left
+ * out, such that the query strings of tasks that only differ in the shards
+ * they access can be built without deparsing the query for each task.
+ */
+typedef struct ShardQueryTemplate
+{
+	/* parts of the query string between the shard names */
+	List *queryStringFragmentList;
+
+	/* relation whose shard name follows each fragment, except the last one */
+	List *slotRelationIdList;
+	List *slotRelationNameList;
+} ShardQueryTemplate;
+
+
 extern void RebuildQueryStrings(Job *workerJob);
 extern bool UpdateRelationToShardNames(Node *node, List *relationShardList);
+extern bool ShouldLazyDeparseQuery(Task *task);
 extern void SetTaskQueryIfShouldLazyDeparse(Task *task, Query *query);
 extern void SetTaskQueryString(Task *task, char *queryString);
 extern void SetTaskQueryStringList(Task *task, List *queryStringList);
@@ -32,5 +52,8 @@ extern char * TaskQueryStringForAllPlacements(Task *task);
 extern char * TaskQueryStringForPlacement(Task *task, int placementIndex);
 extern bool UpdateRelationsToLocalShardTables(Node *node, List *relationShardList);
 extern int GetTaskQueryType(Task *task);
+extern ShardQueryTemplate * BuildShardQueryTemplate(Query *query, Task *referenceTask);
+extern char * ShardQueryStringFromTemplate(ShardQueryTemplate *queryTemplate,
+										   List *relationShardList);
 
 #endif /* DEPARSE_SHARD_QUERY_H */
@@ -31,6 +31,14 @@ typedef struct TransactionNode
 	PGPROC *initiatorProc;
 
 	bool transactionVisited;
+
+	/* state of the search for strongly connected components */
+	int componentIndex;
+	int componentLowLink;
+	bool onComponentStack;
+
+	/* whether the transaction is part of a cycle in the wait graph */
+	bool transactionInCycle;
 } TransactionNode;
 
 
@@ -0,0 +1,57 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_tracing.h
+ *   Trace context propagation to the workers and per-task spans of
+ *   distributed queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISTRIBUTED_TRACING_H
+#define DISTRIBUTED_TRACING_H
+
+#include "datatype/timestamp.h"
+
+
+/* length of a trace id in hexadecimal notation, without the terminator */
+#define TRACE_ID_LENGTH 32
+
+
+/*
+ * TaskSpan describes the execution of a task on a single placement, with
+ * the times at which the placement execution became ready to run, at which
+ * the command was sent, at which the first row arrived and at which the
+ * execution finished. Times that were not reached are 0.
+ */
+typedef struct TaskSpan
+{
+	const char *traceId;
+	uint64 spanId;
+	uint64 queryId;
+	uint32 taskId;
+	uint64 shardId;
+	char *nodeName;
+	int nodePort;
+	TimestampTz readyTime;
+	TimestampTz sendTime;
+	TimestampTz firstRowTime;
+	TimestampTz endTime;
+	uint64 rowCount;
+	bool succeeded;
+} TaskSpan;
+
+
+/* GUC variables */
+extern bool EnableDistributedTracing;
+extern int TraceSpanBufferSize;
+
+
+extern void InitializeDistributedTracing(void);
+extern const char * CurrentTraceId(void);
+extern uint64 NextTraceSpanId(void);
+extern char * TraceParentComment(const char *traceId, uint64 spanId);
+extern void RecordTaskSpan(TaskSpan *span);
+
+#endif /* DISTRIBUTED_TRACING_H */
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * fast_path_plan_cache.h
+ *	  Backend-wide cache of distributed plans for fast-path router queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef FAST_PATH_PLAN_CACHE_H
+#define FAST_PATH_PLAN_CACHE_H
+
+#include "postgres.h"
+
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "nodes/plannodes.h"
+
+
+/* GUC, maximum number of plans in the fast-path plan cache */
+extern int FastPathPlanCacheSize;
+
+
+extern bool FastPathQueryIsCacheable(Query *query, int cursorOptions,
+									 ParamListInfo boundParams,
+									 Node *distributionKeyValue);
+extern PlannedStmt * PlanFastPathQueryViaCache(Query *query, int cursorOptions,
+											   Const *distributionKeyValue);
+extern void CacheFastPathShardQueryString(uint64 entryId, uint64 shardId,
+										  char *queryString);
+extern void InvalidateFastPathPlanCache(Oid relationId);
+extern char * NormalizedQueryString(Query *query);
+
+#endif /* FAST_PATH_PLAN_CACHE_H */
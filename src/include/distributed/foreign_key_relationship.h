@@ -15,10 +15,17 @@
 #include "utils/hsearch.h"
 #include "nodes/primnodes.h"
 
+/* GUC, maximum number of edges of the foreign key graph kept in shared memory */
+extern int SharedForeignKeyGraphMaxEdges;
+
+extern void InitializeSharedForeignKeyGraph(void);
 extern List * ReferencedRelationIdList(Oid relationId);
 extern List * ReferencingRelationIdList(Oid relationId);
 extern void SetForeignConstraintRelationshipGraphInvalid(void);
 extern bool IsForeignConstraintRelationshipGraphValid(void);
 extern void ClearForeignConstraintRelationshipGraphContext(void);
+extern void MarkForeignConstraintRelationshipGraphChanged(void);
+extern void ForeignConstraintRelationshipGraphTransactionEnd(bool isCommit);
+extern void InvalidateSharedForeignConstraintRelationshipGraph(void);
 
 #endif
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * incremental_rollup.h
+ *   Rollups of distributed tables that only aggregate the rows that were
+ *   added since their last refresh.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCREMENTAL_ROLLUP_H
+#define INCREMENTAL_ROLLUP_H
+
+#include "nodes/pg_list.h"
+
+
+/* GUC, time between refreshes of the rollups, in milliseconds */
+extern int RollupRefreshInterval;
+
+
+extern List * RollupNameList(void);
+extern int64 RefreshRollup(char *rollupName);
+
+#endif /* INCREMENTAL_ROLLUP_H */
@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * inline_intermediate_results.h
+ *   Functions for inlining small intermediate results into the queries that
+ *   read them, instead of sending them to the workers as files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INLINE_INTERMEDIATE_RESULTS_H
+#define INLINE_INTERMEDIATE_RESULTS_H
+
+#include "nodes/execnodes.h"
+#include "tcop/dest.h"
+
+
+/* GUC variables */
+extern int MaxInlineIntermediateResultSize;
+
+
+extern DestReceiver * CreateInlineResultDestReceiver(char *resultId,
+													 EState *executorState,
+													 List *initialNodeList,
+													 bool writeLocalFile);
+extern bool IntermediateResultIsInlined(char *resultId);
+extern void ForgetInlinedIntermediateResult(char *resultId);
+extern char * InlineIntermediateResults(char *queryString);
+extern void ResetInlinedIntermediateResults(void);
+
+#endif /* INLINE_INTERMEDIATE_RESULTS_H */
@@ -17,6 +17,7 @@
 #include "executor/execdesc.h"
 
 extern bool EnableRepartitionedInsertSelect;
+extern bool SortInsertSelectUpserts;
 
 extern TupleTableSlot * CoordinatorInsertSelectExecScan(CustomScanState *node);
 extern bool ExecutingInsertSelect(void);
@@ -12,13 +12,28 @@
 #define INTERMEDIATE_RESULT_PRUNING_H
 
 #include "distributed/subplan_execution.h"
+#include "distributed/worker_manager.h"
 
 /*
  * UINT32_MAX is reserved in pg_dist_node, so we can use it safely.
  */
 #define LOCAL_NODE_ID UINT32_MAX
 
+
+/*
+ * IntermediateResultForward describes a worker node fetching an intermediate
+ * result from another worker node that already has it.
+ */
+typedef struct IntermediateResultForward
+{
+	WorkerNode *sourceNode;
+	WorkerNode *targetNode;
+} IntermediateResultForward;
+
+
 extern bool LogIntermediateResults;
+extern int IntermediateResultSeedNodeCount;
+extern bool EnablePartitionedIntermediateResults;
 
 extern List * FindSubPlanUsages(DistributedPlan *plan);
 extern List * FindAllWorkerNodesUsingSubplan(HTAB *intermediateResultsHash,
@@ -28,5 +43,7 @@ extern void RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 										   DistributedPlan *distributedPlan);
 extern IntermediateResultsHashEntry * SearchIntermediateResult(HTAB *resultsHash,
 															   char *resultId);
+extern List * PlanIntermediateResultForwarding(char *resultId, List *workerNodeList,
+											   List **forwardRoundList);
 
 #endif /* INTERMEDIATE_RESULT_PRUNING_H */
@@ -0,0 +1,36 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.h
+ *    Custom scan that reads the records of intermediate result files as
+ *    the query asks for them.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_SCAN_H
+#define INTERMEDIATE_RESULT_SCAN_H
+
+#include "distributed/pg_version_constants.h"
+
+#include "nodes/extensible.h"
+#include "nodes/parsenodes.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_12
+#include "nodes/pathnodes.h"
+#else
+#include "nodes/relation.h"
+#endif
+
+
+/* GUC variable */
+extern bool EnableIntermediateResultScan;
+
+
+extern CustomScanMethods IntermediateResultScanMethods;
+
+
+extern void AddIntermediateResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+										  RangeTblEntry *rangeTableEntry);
+
+#endif /* INTERMEDIATE_RESULT_SCAN_H */
@@ -48,17 +48,52 @@ typedef struct DistributedResultFragment
 } DistributedResultFragment;
 
 
+/* state for reading an intermediate result one record at a time */
+typedef struct IntermediateResultReader IntermediateResultReader;
+
+
+/* GUC, whether to compress intermediate results that we broadcast */
+extern bool CompressIntermediateResults;
+
+/* GUC, scratch directories across which result files are striped */
+extern char *IntermediateResultDirectories;
+
+/* GUC, number of tasks over which fragments between two nodes are fetched */
+extern int FragmentTransferParallelism;
+
+
 /* intermediate_results.c */
 extern DestReceiver * CreateRemoteFileDestReceiver(const char *resultId,
 												   EState *executorState,
 												   List *initialNodeList, bool
 												   writeLocalFile);
+extern void ForwardIntermediateResult(const char *resultId, List *forwardRoundList);
+extern void LinkIntermediateResult(const char *sourceResultId,
+								   const char *targetResultId, List *nodeList,
+								   bool linkLocalFile);
 extern void SendQueryResultViaCopy(const char *resultId);
 extern void ReceiveQueryResultViaCopy(const char *resultId);
 extern void RemoveIntermediateResultsDirectory(void);
 extern int64 IntermediateResultSize(const char *resultId);
 extern char * QueryResultFileName(const char *resultId);
-extern char * CreateIntermediateResultsDirectory(void);
+extern void CreateIntermediateResultsDirectory(void);
+extern void RemoveIntermediateResultScratchDirectories(void);
+extern IntermediateResultReader * BeginIntermediateResultRead(char *resultId,
+															  char *copyFormat,
+															  TupleDesc tupleDescriptor,
+															  Bitmapset *projectedColumns,
+															  List *whereClauseList);
+extern bool ReadNextIntermediateResultRow(IntermediateResultReader *reader,
+										  ExprContext *econtext, Datum *columnValues,
+										  bool *columnNulls);
+extern void EndIntermediateResultRead(IntermediateResultReader *reader);
+
+/* partitioned_intermediate_results.c */
+extern DestReceiver * CreateNodePartitionedResultDestReceiver(const char *resultId,
+															  EState *executorState,
+															  List *nodeList,
+															  Oid relationId,
+															  int partitionColumnIndex);
 
 /* distributed_intermediate_results.c */
 extern List ** RedistributeTaskListResults(const char *resultIdPrefix,
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * lag_aware_routing.h
+ *   Routing of reads to secondary nodes that have replayed the writes of
+ *   the current session, used when citus.use_secondary_nodes is 'lag_aware'.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef LAG_AWARE_ROUTING_H
+#define LAG_AWARE_ROUTING_H
+
+#include "libpq-fe.h"
+
+#include "distributed/connection_management.h"
+
+
+/* appended to COMMIT to get the WAL position of the worker in the same round trip */
+#define COMMIT_LSN_QUERY "; SELECT pg_current_wal_lsn()"
+
+
+/* GUC variables */
+extern int SecondaryLsnRefreshInterval;
+
+
+extern void InitializeSecondaryLsnCache(void);
+extern bool RefreshSecondaryReplayLsns(void);
+extern bool ShouldRequestCommitLsn(MultiConnection *connection);
+extern void RecordCommitLsn(MultiConnection *connection, PGresult *result);
+extern List * LagAwareReadPlacementList(List *placementList, List *secondaryNodeList);
+
+#endif /* LAG_AWARE_ROUTING_H */
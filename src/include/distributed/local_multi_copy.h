@@ -9,11 +9,25 @@
  */
 #define LOCAL_COPY_FLUSH_THRESHOLD (1 * 512 * 1024)
 
+/*
+ * LOCAL_SHARD_INSERT_BATCH_SIZE is the maximum number of tuples that are
+ * buffered for a local shard before they are inserted directly into it.
+ */
+#define LOCAL_SHARD_INSERT_BATCH_SIZE 1000
+
+typedef struct LocalShardInsertState LocalShardInsertState;
+
 extern void WriteTupleToLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 								   int64
 								   shardId,
 								   CopyOutState localCopyOutState);
 extern void FinishLocalCopyToShard(CitusCopyDestReceiver *copyDest, int64 shardId,
 								   CopyOutState localCopyOutState);
+extern LocalShardInsertState * BeginLocalShardInsert(CitusCopyDestReceiver *copyDest,
+													 int64 shardId);
+extern void InsertTupleIntoLocalShard(TupleTableSlot *slot,
+									  CitusCopyDestReceiver *copyDest,
+									  LocalShardInsertState *insertState);
+extern void FinishLocalShardInsert(LocalShardInsertState *insertState);
 
 #endif /* LOCAL_MULTI_COPY */
@@ -58,6 +58,9 @@ typedef struct WaitGraph
 } WaitGraph;
 
 
+/* GUC, minimum age of a waiting transaction to collect its wait edges */
+extern int DistributedDeadlockDetectionMinAge;
+
 extern WaitGraph * BuildGlobalWaitGraph(void);
 extern bool IsProcessWaitingForLock(PGPROC *proc);
 extern bool IsInDistributedTransaction(BackendData *backendData);
@@ -20,6 +20,7 @@
 
 /* config variable for */
 extern double DistributedDeadlockDetectionTimeoutFactor;
+extern int MaintenanceDaemonIdleTimeout;
 
 extern void StopMaintenanceDaemon(Oid databaseId);
 extern void TriggerMetadataSync(Oid databaseId);
@@ -27,5 +28,6 @@ extern void InitializeMaintenanceDaemon(void);
 extern void InitializeMaintenanceDaemonBackend(void);
 
 extern void CitusMaintenanceDaemonMain(Datum main_arg);
+extern void CitusMaintenanceJobMain(Datum main_arg);
 
 #endif /* MAINTENANCED_H */
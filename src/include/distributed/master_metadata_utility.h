@@ -35,6 +35,16 @@
 #define PG_TOTAL_RELATION_SIZE_FUNCTION "pg_total_relation_size(%s)"
 #define CSTORE_TABLE_SIZE_FUNCTION "cstore_table_size(%s)"
 
+/*
+ * Estimates the row count of a shard like the planner does, by scaling the row
+ * count of the last VACUUM or ANALYZE to the current number of pages.
+ */
+#define SHARD_ROW_COUNT_ESTIMATE_FUNCTION \
+	"coalesce((SELECT (CASE WHEN relpages > 0 THEN reltuples / relpages * " \
+	"(pg_relation_size(oid) / current_setting('block_size')::int) " \
+	"ELSE greatest(reltuples, 0) END)::bigint FROM pg_class " \
+	"WHERE oid = %s::regclass), 0)"
+
 /* In-memory representation of a typed tuple in pg_dist_shard. */
 typedef struct ShardInterval
 {
@@ -110,18 +120,24 @@ extern bool NodeGroupHasShardPlacements(int32 groupId,
 extern List * ActiveShardPlacementList(uint64 shardId);
 extern ShardPlacement * ActiveShardPlacement(uint64 shardId, bool missingOk);
 extern List * BuildShardPlacementList(ShardInterval *shardInterval);
+extern List * BuildShardPlacementListForShardIdRange(uint64 minShardId,
+													 uint64 maxShardId);
 extern List * AllShardPlacementsOnNodeGroup(int32 groupId);
 extern List * GroupShardPlacementsForTableOnGroup(Oid relationId, int32 groupId);
 extern StringInfo GenerateSizeQueryOnMultiplePlacements(List *shardIntervalList,
 														char *sizeQuery);
+extern uint64 DistributedTableRowCountEstimate(Oid relationId);
 
 /* Function declarations to modify shard and shard placement data */
 extern void InsertShardRow(Oid relationId, uint64 shardId, char storageType,
 						   text *shardMinValue, text *shardMaxValue);
+extern void InsertShardRowList(List *shardIntervalList);
 extern void DeleteShardRow(uint64 shardId);
+extern void DeleteShardRowList(List *shardIntervalList);
 extern uint64 InsertShardPlacementRow(uint64 shardId, uint64 placementId,
 									  char shardState, uint64 shardLength,
 									  int32 groupId);
+extern void InsertShardPlacementRowList(List *groupShardPlacementList);
 extern void InsertIntoPgDistPartition(Oid relationId, char distributionMethod,
 									  Var *distributionColumn, uint32 colocationId,
 									  char replicationModel);
@@ -132,6 +148,7 @@ extern void UpdatePartitionShardPlacementStates(ShardPlacement *parentShardPlace
 extern void MarkShardPlacementInactive(ShardPlacement *shardPlacement);
 extern void UpdateShardPlacementState(uint64 placementId, char shardState);
 extern void DeleteShardPlacementRow(uint64 placementId);
+extern void DeleteShardPlacementRowList(List *placementList);
 extern void CreateDistributedTable(Oid relationId, Var *distributionColumn,
 								   char distributionMethod, char *colocateWithTableName,
 								   bool viaDeprecatedAPI);
@@ -141,7 +158,7 @@ extern void EnsureDependenciesExistOnAllNodes(const ObjectAddress *target);
 extern List * GetDistributableDependenciesForObject(const ObjectAddress *target);
 extern bool ShouldPropagate(void);
 extern bool ShouldPropagateObject(const ObjectAddress *address);
-extern void ReplicateAllDependenciesToNode(const char *nodeName, int nodePort);
+extern List * DependencyCreateCommandListForNode(const char *nodeName, int nodePort);
 
 /* Remaining metadata utility functions  */
 extern char * TableOwner(Oid relationId);
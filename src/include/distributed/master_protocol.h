@@ -64,8 +64,9 @@
 	"SELECT worker_apply_shard_ddl_command (" UINT64_FORMAT ", %s, %s)"
 #define WORKER_APPLY_SHARD_DDL_COMMAND_WITHOUT_SCHEMA \
 	"SELECT worker_apply_shard_ddl_command (" UINT64_FORMAT ", %s)"
-#define WORKER_APPEND_TABLE_TO_SHARD \
-	"SELECT worker_append_table_to_shard (%s, %s, %s, %u)"
+#define WORKER_APPEND_TABLE_TO_SHARD_CALL \
+	"worker_append_table_to_shard (%s, %s, %s, %u)"
+#define WORKER_APPEND_TABLE_TO_SHARD "SELECT " WORKER_APPEND_TABLE_TO_SHARD_CALL
 #define WORKER_APPLY_INTER_SHARD_DDL_COMMAND \
 	"SELECT worker_apply_inter_shard_ddl_command (" UINT64_FORMAT ", %s, " UINT64_FORMAT \
 	", %s, %s)"
@@ -93,6 +94,10 @@ extern int ShardMaxSize;
 extern int ShardPlacementPolicy;
 extern int NextShardId;
 extern int NextPlacementId;
+extern int MaxParallelShardCopies;
+extern bool PrewarmMovedShards;
+extern int MaxParallelShardMoves;
+extern bool CapacityAwareShardPlacement;
 
 
 extern bool IsCoordinator(void);
@@ -122,6 +127,9 @@ extern void CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shard
 											 bool useExclusiveConnections);
 extern void CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId,
 								  bool useExclusiveConnections);
+extern List * CapacityAwareShardPlacementNodes(List *shardIntervalList,
+											  List *workerNodeList,
+											  int replicationFactor);
 extern void CreateReferenceTableShard(Oid distributedTableId);
 extern List * WorkerCreateShardCommandList(Oid relationId, int shardIndex, uint64 shardId,
 										   List *ddlCommandList,
@@ -145,24 +153,38 @@ extern Datum master_stage_shard_placement_row(PG_FUNCTION_ARGS);
 /* Function declarations to help with data staging and deletion */
 extern Datum master_create_empty_shard(PG_FUNCTION_ARGS);
 extern Datum master_append_table_to_shard(PG_FUNCTION_ARGS);
+extern Datum master_append_tables_to_shard(PG_FUNCTION_ARGS);
 extern Datum master_update_shard_statistics(PG_FUNCTION_ARGS);
 extern Datum master_apply_delete_command(PG_FUNCTION_ARGS);
 extern Datum master_drop_sequences(PG_FUNCTION_ARGS);
 extern Datum master_modify_multiple_shards(PG_FUNCTION_ARGS);
 extern Datum lock_relation_if_exists(PG_FUNCTION_ARGS);
 extern Datum master_drop_all_shards(PG_FUNCTION_ARGS);
+extern int DropShards(Oid relationId, char *schemaName, char *relationName,
+					  List *deletableShardIntervalList);
 
 /* function declarations for shard creation functionality */
 extern Datum master_create_worker_shards(PG_FUNCTION_ARGS);
 extern Datum isolate_tenant_to_new_shard(PG_FUNCTION_ARGS);
+extern Datum master_split_shard(PG_FUNCTION_ARGS);
 
 /* function declarations for shard repair functionality */
 extern Datum master_copy_shard_placement(PG_FUNCTION_ARGS);
+extern Datum citus_shard_copy_progress(PG_FUNCTION_ARGS);
 
 /* function declarations for shard copy functinality */
 extern List * CopyShardCommandList(ShardInterval *shardInterval, const
 								   char *sourceNodeName,
 								   int32 sourceNodePort, bool includeData);
+extern List * CopyShardDataCommandList(ShardInterval *shardInterval,
+									   const char *sourceNodeName,
+									   int32 sourceNodePort, bool includeData);
+extern List * CopyShardIndexCommandList(ShardInterval *shardInterval);
+extern void CopyShardListToNode(List *shardIntervalList, List *sourcePlacementList,
+								char *targetNodeName, int32 targetNodePort);
+extern void CopyShardRelationships(List *shardIntervalList, char *targetNodeName,
+								   int32 targetNodePort);
+extern List * WorkerApplyShardDDLCommandList(List *ddlCommandList, int64 shardId);
 extern List * CopyShardForeignConstraintCommandList(ShardInterval *shardInterval);
 extern void CopyShardForeignConstraintCommandListGrouped(ShardInterval *shardInterval,
 														 List **
@@ -25,10 +25,16 @@ extern bool EnableVersionChecks;
 typedef enum
 {
 	USE_SECONDARY_NODES_NEVER = 0,
-	USE_SECONDARY_NODES_ALWAYS = 1
+	USE_SECONDARY_NODES_ALWAYS = 1,
+
+	/* read from secondaries that replayed the session's writes, else primaries */
+	USE_SECONDARY_NODES_LAG_AWARE = 2
 } ReadFromSecondariesType;
 extern int ReadFromSecondaries;
 
+/* GUC variable */
+extern char *MetadataCachePreloadTables;
+
 
 /*
  * While upgrading pg_dist_local_group can be empty temporarily, in that
@@ -57,6 +63,13 @@ typedef struct
 	bool hasUniformHashDistribution; /* valid for hash partitioned tables */
 	bool hasOverlappingShardInterval;
 
+	/*
+	 * For uniform hash distributions with a power of 2 shard count, the shard
+	 * index of a hash value is found by a right shift of this many bits. It
+	 * is -1 for other shard counts, which need a division.
+	 */
+	int uniformHashShardIndexShift;
+
 	/* pg_dist_partition metadata for this table */
 	char *partitionKeyString;
 	Var *partitionColumn;
@@ -68,6 +81,26 @@ typedef struct
 	int shardIntervalArrayLength;
 	ShardInterval **sortedShardIntervalArray;
 
+	/*
+	 * For append and range distributed tables with overlapping shard intervals,
+	 * the index of the shard with the largest max value among the first i + 1
+	 * shards that have min/max values, for each i below
+	 * initializedShardIntervalCount. NULL for other tables.
+	 */
+	int *maxValuePrefixShardIndexArray;
+	int initializedShardIntervalCount;
+
+	/*
+	 * For tables whose shard intervals are int4 or int8 ranges that are all
+	 * initialized and do not overlap, the min and max values of the sorted
+	 * shard intervals in contiguous arrays, such that searching for a shard
+	 * touches a few cache lines rather than every shard interval it compares
+	 * with. shardBoundTypeId is the type of the values. NULL for other tables.
+	 */
+	int64 *sortedShardMinValues;
+	int64 *sortedShardMaxValues;
+	Oid shardBoundTypeId;
+
 	/* comparator for partition column's type, NULL if DISTRIBUTE_BY_NONE */
 	FmgrInfo *shardColumnCompareFunction;
 
@@ -95,6 +128,9 @@ typedef struct
 	/* pg_dist_placement metadata */
 	GroupShardPlacement **arrayOfPlacementArrays;
 	int *arrayOfPlacementArrayLengths;
+
+	/* how rows are serialised when copying into the table, built on first COPY */
+	struct CopySerializationPlan *copySerializationPlan;
 } CitusTableCacheEntry;
 
 typedef struct DistObjectCacheEntryKey
@@ -43,6 +43,8 @@ extern List * ShardListInsertCommand(List *shardIntervalList);
 extern List * ShardDeleteCommandList(ShardInterval *shardInterval);
 extern char * NodeDeleteCommand(uint32 nodeId);
 extern char * NodeStateUpdateCommand(uint32 nodeId, bool isActive);
+extern char * NodeLocationUpdateCommand(uint32 nodeId, const char *nodeName,
+										int32 nodePort);
 extern char * ShouldHaveShardsUpdateCommand(uint32 nodeId, bool shouldHaveShards);
 extern char * ColocationIdUpdateCommand(Oid relationId, uint32 colocationId);
 extern char * CreateSchemaDDLCommand(Oid schemaId);
@@ -53,6 +55,9 @@ extern void CreateTableMetadataOnWorkers(Oid relationId);
 extern void MarkNodeHasMetadata(const char *nodeName, int32 nodePort, bool hasMetadata);
 extern void MarkNodeMetadataSynced(const char *nodeName, int32 nodePort, bool synced);
 extern MetadataSyncResult SyncMetadataToNodes(void);
+extern void RecordMetadataDelta(List *unsyncedNodeIdList, int32 changedNodeId,
+								char *command);
+extern void DeleteMetadataDeltas(int32 nodeId);
 extern bool SendOptionalCommandListToWorkerInTransaction(const char *nodeName, int32
 														 nodePort,
 														 const char *nodeUser,
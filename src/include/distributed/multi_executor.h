@@ -10,6 +10,7 @@
 #ifndef MULTI_EXECUTOR_H
 #define MULTI_EXECUTOR_H
 
+#include "commands/copy.h"
 #include "executor/execdesc.h"
 #include "nodes/parsenodes.h"
 #include "nodes/execnodes.h"
@@ -57,6 +58,12 @@ typedef struct TransactionProperties
 
 	/* if true, the current execution requires 2PC to be globally enabled */
 	bool requires2PC;
+
+	/*
+	 * If true, tasks run on secondaries that replayed the writes of the session
+	 * when there are any, see citus.use_secondary_nodes = lag_aware.
+	 */
+	bool readFromSecondaries;
 } TransactionProperties;
 
 
@@ -65,6 +72,8 @@ extern bool WritableStandbyCoordinator;
 extern bool ForceMaxQueryParallelization;
 extern int MaxAdaptiveExecutorPoolSize;
 extern int ExecutorSlowStartInterval;
+extern int ExecutorBatchSize;
+extern bool EnableStreamingExecution;
 extern bool SortReturning;
 extern int ExecutorLevel;
 
@@ -74,6 +83,9 @@ extern void CitusExecutorRun(QueryDesc *queryDesc, ScanDirection direction, uint
 							 bool execute_once);
 extern void AdaptiveExecutorPreExecutorRun(CitusScanState *scanState);
 extern TupleTableSlot * AdaptiveExecutor(CitusScanState *scanState);
+extern void ContinueStreamingExecution(CitusScanState *scanState,
+									   bool forwardScanDirection);
+extern void FinishStreamingExecution(CitusScanState *scanState, bool discardResults);
 
 /*
  * ExecutionParams contains parameters that are used during the execution.
@@ -130,6 +142,11 @@ extern TupleTableSlot * ReturnTupleFromTuplestore(CitusScanState *scanState);
 extern void LoadTuplesIntoTupleStore(CitusScanState *citusScanState, Job *workerJob);
 extern void ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc
 								   tupleDescriptor, Tuplestorestate *tupstore);
+extern void ReadCopyDataIntoTupleStore(char *fileName,
+									   copy_data_source_cb dataSourceCallback,
+									   char *copyFormat, TupleDesc tupleDescriptor,
+									   Tuplestorestate *tupstore);
+extern Relation StubRelation(TupleDesc tupleDescriptor);
 extern Query * ParseQueryString(const char *queryString, Oid *paramOids, int numParams);
 extern Query * RewriteRawQueryStmt(RawStmt *rawStmt, const char *queryString,
 								   Oid *paramOids, int numParams);
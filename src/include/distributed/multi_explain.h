@@ -10,10 +10,20 @@
 #ifndef MULTI_EXPLAIN_H
 #define MULTI_EXPLAIN_H
 
+#include "commands/explain.h"
 #include "executor/executor.h"
 
 /* Config variables managed via guc.c to explain distributed query plans */
 extern bool ExplainDistributedQueries;
 extern bool ExplainAllTasks;
+extern bool ExplainWorkerPools;
+extern bool ExplainAnalyzeSinglePass;
+
+extern void CitusExplainOneQuery(Query *query, int cursorOptions, IntoClause *into,
+								 ExplainState *es, const char *queryString,
+								 ParamListInfo params, QueryEnvironment *queryEnv);
+extern bool CanExplainAnalyzeTasksInSinglePass(void);
+extern char * WrapQueryForExplainAnalyze(const char *queryString,
+										 TupleDesc tupleDescriptor);
 
 #endif /* MULTI_EXPLAIN_H */
@@ -86,6 +86,7 @@ typedef struct JoinOrderNode
 /* Config variables managed via guc.c */
 extern bool LogMultiJoinOrder;
 extern bool EnableSingleHashRepartitioning;
+extern bool EnableCostBasedJoinOrder;
 
 
 /* Function declaration for determining table join orders */
@@ -108,6 +109,7 @@ extern Var * DistPartitionKey(Oid relationId);
 extern Var * ForceDistPartitionKey(Oid relationId);
 extern char PartitionMethod(Oid relationId);
 extern char TableReplicationModel(Oid relationId);
+extern uint64 EstimatedTableSize(Oid relationId);
 
 
 #endif   /* MULTI_JOIN_ORDER_H */
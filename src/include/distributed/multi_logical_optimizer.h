@@ -42,6 +42,14 @@
 #define HLL_CARDINALITY_FUNC_NAME "hll_cardinality"
 #define HLL_FORCE_GROUPAGG_GUC_NAME "hll.force_groupagg"
 
+/* Definitions related to the built-in sketches in approximate_aggregates.c */
+#define CITUS_HLL_ADD_AGGREGATE_NAME "citus_hll_add_agg"
+#define CITUS_HLL_UNION_AGGREGATE_NAME "citus_hll_union_agg"
+#define CITUS_HLL_CARDINALITY_FUNC_NAME "citus_hll_cardinality"
+#define CITUS_TDIGEST_ADD_AGGREGATE_NAME "citus_tdigest_add_agg"
+#define CITUS_TDIGEST_UNION_AGGREGATE_NAME "citus_tdigest_union_agg"
+#define CITUS_TDIGEST_PERCENTILE_FUNC_NAME "citus_tdigest_percentile"
+
 /* Definitions related to Top-N approximations */
 #define TOPN_ADD_AGGREGATE_NAME "topn_add_agg"
 #define TOPN_UNION_AGGREGATE_NAME "topn_union_agg"
@@ -79,10 +87,11 @@ typedef enum
 	AGGREGATE_TOPN_ADD_AGG = 18,
 	AGGREGATE_TOPN_UNION_AGG = 19,
 	AGGREGATE_ANY_VALUE = 20,
+	AGGREGATE_PERCENTILE_CONT = 21,
 
 	/* AGGREGATE_CUSTOM must come last */
-	AGGREGATE_CUSTOM_COMBINE = 21,
-	AGGREGATE_CUSTOM_ROW_GATHER = 22,
+	AGGREGATE_CUSTOM_COMBINE = 22,
+	AGGREGATE_CUSTOM_ROW_GATHER = 23,
 } AggregateType;
 
 
@@ -94,6 +103,14 @@ typedef enum
 } CoordinatorAggregationStrategyType;
 
 
+/* Enumeration for citus.count_distinct_approximation_method GUC */
+typedef enum
+{
+	COUNT_DISTINCT_APPROXIMATION_HLL_EXTENSION,
+	COUNT_DISTINCT_APPROXIMATION_BUILTIN,
+} CountDistinctApproximationMethodType;
+
+
 /*
  * PushDownStatus indicates whether a node can be pushed down below its child
  * using the commutative and distributive relational algebraic properties.
@@ -138,13 +155,15 @@ static const char *const AggregateNames[] = {
 	"bit_and", "bit_or", "bool_and", "bool_or", "every",
 	"hll_add_agg", "hll_union_agg",
 	"topn_add_agg", "topn_union_agg",
-	"any_value"
+	"any_value", "percentile_cont"
 };
 
 
 /* Config variable managed via guc.c */
 extern int LimitClauseRowFetchCount;
 extern double CountDistinctErrorRate;
+extern int CountDistinctApproximationMethod;
+extern bool EnableApproximatePercentiles;
 extern int CoordinatorAggregationStrategy;
 
 
@@ -163,6 +182,7 @@ extern bool IsPartitionColumn(Expr *columnExpression, Query *query);
 extern void FindReferencedTableColumn(Expr *columnExpression, List *parentQueryList,
 									  Query *query, Oid *relationId, Var **column);
 extern char * WorkerColumnName(AttrNumber resno);
+extern Oid CoordCombineAggOid(void);
 extern bool IsGroupBySubsetOfDistinct(List *groupClauses, List *distinctClauses);
 
 #endif   /* MULTI_LOGICAL_OPTIMIZER_H */
@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_logical_replication.h
+ *    Declarations for public functions and variables used in logical
+ *    replication of shards between nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_LOGICAL_REPLICATION_H
+#define MULTI_LOGICAL_REPLICATION_H
+
+
+#include "nodes/pg_list.h"
+
+
+#define SHARD_MOVE_PUBLICATION_PREFIX "citus_shard_move_publication_"
+#define SHARD_MOVE_SUBSCRIPTION_PREFIX "citus_shard_move_subscription_"
+
+
+extern bool ShouldUseLogicalReplication(List *shardIntervalList,
+										char shardReplicationMode,
+										char *sourceNodeName, int32 sourceNodePort);
+extern void LockShardListForLogicalReplication(List *shardIntervalList);
+extern void LogicallyReplicateShards(List *shardIntervalList, char *sourceNodeName,
+									 int32 sourceNodePort, char *targetNodeName,
+									 int32 targetNodePort);
+
+
+#endif /* MULTI_LOGICAL_REPLICATION_H */
@@ -28,6 +28,7 @@
 #include "distributed/worker_manager.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/planning_stats.h"
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
 #include "utils/array.h"
@@ -43,6 +44,8 @@
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
 #define HASH_PARTITION_COMMAND "SELECT worker_hash_partition_table \
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
+#define SKEWED_HASH_PARTITION_COMMAND "SELECT worker_hash_partition_table \
+ (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s, %s, %s)"
 #define MERGE_FILES_INTO_TABLE_COMMAND "SELECT worker_merge_files_into_table \
  (" UINT64_FORMAT ", %d, '%s', '%s')"
 #define MERGE_FILES_AND_RUN_QUERY_COMMAND \
@@ -98,7 +101,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_ADAPTIVE = 4
 } TaskAssignmentPolicyType;
 
 
@@ -136,6 +140,19 @@ typedef struct LocalPlannedStatement
 } LocalPlannedStatement;
 
 
+/*
+ * ShardQueryString represents the deparsed, parameterized query string of a
+ * job query on a shard. The scope for the ShardQueryString is Task.
+ */
+typedef struct ShardQueryString
+{
+	CitusNode type;
+
+	uint64 shardId;
+	char *queryString;
+} ShardQueryString;
+
+
 /*
  * Job represents a logical unit of work that contains one set of data transfers
  * in our physical plan. The physical planner maps each SQL query into one or
@@ -152,12 +169,16 @@ typedef struct Job
 	List *dependentJobList;
 	bool subqueryPushdown;
 	bool requiresMasterEvaluation; /* only applies to modify jobs */
+	bool evaluateSequencesOnWorkers; /* only applies to insert jobs */
 	bool deferredPruning;
 	Const *partitionKeyValue;
 
 	/* for local shard queries, we may save the local plan here */
 	List *localPlannedStatements;
 
+	/* for parameterized shard queries, we may save the query strings here */
+	List *shardQueryStrings;
+
 	/*
 	 * When we evaluate functions and parameters in jobQuery then we
 	 * should no longer send the list of parameters along with the
@@ -179,6 +200,14 @@ typedef struct MapMergeJob
 	ShardInterval **sortedShardIntervalArray; /* only applies to range partitioning */
 	List *mapTaskList;
 	List *mergeTaskList;
+
+	/*
+	 * Hash values of frequent partition column values in dual hash partition
+	 * joins, and the number of partitions their rows are spread over (> 0) or
+	 * copied to (< 0). See AssignSkewedJoinValues().
+	 */
+	List *skewedHashList;
+	List *skewPartitionCountList;
 } MapMergeJob;
 
 
@@ -323,6 +352,15 @@ typedef struct Task
 	 * query.
 	 */
 	bool parametersInQueryStringResolved;
+
+	/*
+	 * EXPLAIN ANALYZE output that the task returned along with its rows, and
+	 * the placement and duration of the execution it describes, if the task
+	 * was executed with citus.explain_analyze_single_pass.
+	 */
+	char *fetchedExplainAnalyzePlan;
+	int fetchedExplainAnalyzePlacementIndex;
+	double fetchedExplainAnalyzeExecutionDuration;
 } Task;
 
 
@@ -421,6 +459,73 @@ typedef struct DistributedPlan
 	 */
 	bool fastPathRouterPlan;
 
+	/*
+	 * Time spent in each phase of distributed planning, in milliseconds. Only
+	 * set on top-level plans when planning phases are tracked, see
+	 * planning_stats.c.
+	 */
+	bool hasPlanningPhaseTimes;
+	double planningPhaseTimes[PLANNING_PHASE_COUNT];
+
+	/*
+	 * When the remote scan is read by a grouped aggregate that can be applied
+	 * to its own results, rows received from the workers are combined per
+	 * group before they are stored, see received_row_combiner.c. The group
+	 * columns are remote scan columns with their equality operators and
+	 * collations. combineFunctionList holds a transition function for each
+	 * remote scan column, or InvalidOid for columns whose first value is
+	 * kept. The lists are empty if received rows cannot be combined.
+	 */
+	List *combineGroupColumnList;
+	List *combineGroupOperatorList;
+	List *combineGroupCollationList;
+	List *combineFunctionList;
+
+	/*
+	 * When the remote scan is sorted and limited by the coordinator, only the
+	 * first topNCount rows in sort order of the rows received from the
+	 * workers are stored, see received_row_top_n.c. The sort columns are
+	 * remote scan columns with their sort operators, collations and whether
+	 * NULLs sort first. topNCount is 0 if received rows cannot be bounded.
+	 */
+	List *topNSortColumnList;
+	List *topNSortOperatorList;
+	List *topNSortCollationList;
+	List *topNNullsFirstList;
+	int64 topNCount;
+
+	/*
+	 * When the remote scan is read by a Limit without an ORDER BY, only the
+	 * first remoteScanRowLimit rows received from the workers are needed and
+	 * the executor may skip or cancel the remaining tasks once it has them.
+	 * remoteScanRowLimit is 0 if all rows are needed.
+	 */
+	int64 remoteScanRowLimit;
+
+	/*
+	 * When the worker queries are sorted the same way as the remote scan is
+	 * sorted by the coordinator, the Sort above the remote scan is removed
+	 * and the sorted results of the tasks are merged instead, see
+	 * received_row_merger.c. The sort columns are remote scan columns with
+	 * their sort operators, collations and whether NULLs sort first. The
+	 * lists are empty if the results of the tasks are not merged.
+	 */
+	List *mergeSortColumnList;
+	List *mergeSortOperatorList;
+	List *mergeSortCollationList;
+	List *mergeNullsFirstList;
+
+	/*
+	 * Plans taken from the fast-path plan cache while parameterized shard
+	 * queries are enabled keep the distribution key parameter in the job
+	 * query. boundDistributionKeyValue is then the value that is bound to
+	 * the parameter when the plan is executed, and fastPathPlanCacheEntryId
+	 * identifies the cache entry that keeps the shard query strings. Both
+	 * are unset for other plans, see fast_path_plan_cache.c.
+	 */
+	Const *boundDistributionKeyValue;
+	uint64 fastPathPlanCacheEntryId;
+
 	/*
 	 * NULL if this a valid plan, an error description otherwise. This will
 	 * e.g. be set if SQL features are present that a planner doesn't support,
@@ -442,6 +547,9 @@ typedef struct DistributedSubPlan
 
 	uint32 subPlanId;
 	PlannedStmt *plan;
+
+	/* deparsed query to reuse earlier results with, NULL if not reusable */
+	char *cacheKey;
 } DistributedSubPlan;
 
 
@@ -468,6 +576,14 @@ typedef struct UsedDistributedSubPlan
 
 	/* how the subplan is used by a distributed query */
 	SubPlanAccessType accessType;
+
+	/*
+	 * Distributed table that the tasks join the result with on its
+	 * distribution key, and the index of the result column that it is joined
+	 * on. Each node then only needs the rows of the shards it has.
+	 */
+	Oid partitionRelationId;
+	int partitionColumnIndex;
 } UsedDistributedSubPlan;
 
 
@@ -539,6 +655,7 @@ extern void SetPlacementNodeMetadata(ShardPlacement *placement, WorkerNode *work
 extern int CompareTasksByTaskId(const void *leftElement, const void *rightElement);
 
 /* function declaration for creating Task */
+extern bool IsInnerTableOfOuterJoin(RelationRestriction *relationRestriction);
 extern List * QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 									   RelationRestrictionContext *
 									   relationRestrictionContext,
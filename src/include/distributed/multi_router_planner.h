@@ -26,6 +26,7 @@
 #define CITUS_TABLE_ALIAS "citus_table_alias"
 
 extern bool EnableRouterExecution;
+extern bool EnableSequenceEvaluationOnWorkers;
 extern bool EnableFastPathRouterPlanner;
 
 extern DistributedPlan * CreateRouterPlan(Query *originalQuery, Query *query,
@@ -50,11 +51,12 @@ extern List * FindRouterWorkerList(List *shardIntervalList, bool shardsPresent,
 extern List * RouterInsertTaskList(Query *query, bool parametersInQueryResolved,
 								   DeferredErrorMessage **planningError);
 extern Const * ExtractInsertPartitionKeyValue(Query *query);
-extern List * TargetShardIntervalsForRestrictInfo(RelationRestrictionContext *
-												  restrictionContext,
+extern List * TargetShardIntervalsForRestrictInfo(PlannerRestrictionContext *
+												  plannerRestrictionContext,
 												  bool *multiShardQuery,
 												  Const **partitionValueConst);
 extern List * WorkersContainingAllShards(List *prunedShardIntervalsList);
+extern List * WorkersContainingAllRelationShards(List *relationShardList);
 extern List * IntersectPlacementList(List *lhsPlacementList, List *rhsPlacementList);
 extern DeferredErrorMessage * ModifyQuerySupported(Query *queryTree, Query *originalQuery,
 												   bool multiShardQuery,
@@ -84,6 +86,11 @@ extern List * TargetShardIntervalForFastPathQuery(Query *query,
 extern void GenerateSingleShardRouterTaskList(Job *job,
 											  List *relationShardList,
 											  List *placementList, uint64 shardId);
+extern void GenerateSingleShardRouterTaskListWithQueryString(Job *job,
+															 List *relationShardList,
+															 List *placementList,
+															 uint64 shardId,
+															 char *queryString);
 
 /*
  * FastPathPlanner is a subset of router planner, that's why we prefer to
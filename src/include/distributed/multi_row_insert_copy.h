@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_row_insert_copy.h
+ *    Executing large multi-row INSERTs through COPY.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_ROW_INSERT_COPY_H
+#define MULTI_ROW_INSERT_COPY_H
+
+#include "nodes/execnodes.h"
+#include "nodes/parsenodes.h"
+
+
+/* GUC variable */
+extern int MultiRowInsertCopyThreshold;
+
+
+extern bool CanExecuteMultiRowInsertAsCopy(Query *jobQuery);
+extern void ExecuteMultiRowInsertAsCopy(Query *jobQuery, EState *executorState);
+
+#endif /* MULTI_ROW_INSERT_COPY_H */
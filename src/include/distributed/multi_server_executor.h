@@ -31,8 +31,9 @@
 
 /* Task tracker executor related defines */
 #define TASK_ASSIGNMENT_QUERY "SELECT task_tracker_assign_task \
- ("UINT64_FORMAT ", %u, %s);"
+ ("UINT64_FORMAT ", %u, %s, %u);"
 #define TASK_STATUS_QUERY "SELECT task_tracker_task_status("UINT64_FORMAT ", %u);"
+#define TASK_STATUS_WAIT_QUERY "SELECT task_tracker_wait_for_any(%s, %s, %d);"
 #define JOB_CLEANUP_QUERY "SELECT task_tracker_cleanup_job("UINT64_FORMAT ")"
 #define JOB_CLEANUP_TASK_ID INT_MAX
 
@@ -123,6 +124,7 @@ struct TaskExecution
 	uint32 currentNodeIndex;
 	uint32 querySourceNodeIndex; /* only applies to map fetch tasks */
 	uint32 failureCount;
+	uint32 priority;             /* longest chain of tasks waiting on this task */
 };
 
 
@@ -136,6 +138,7 @@ typedef struct TrackerTaskState
 	uint64 jobId;
 	uint32 taskId;
 	TaskStatus status;
+	uint32 priority;
 	StringInfo taskAssignmentQuery;
 } TrackerTaskState;
 
@@ -162,12 +165,15 @@ typedef struct TaskTracker
 	bool connectionBusy;
 	TrackerTaskState *connectionBusyOnTask;
 	List *connectionBusyOnTaskList;
+	bool connectionBusyOnWait;      /* status check waits for a task to finish */
+	uint32 pendingTaskCount;        /* queued or assigned tasks not yet finished */
 } TaskTracker;
 
 
 /* Config variable managed via guc.c */
 extern int RemoteTaskCheckInterval;
 extern int MaxAssignTaskBatchSize;
+extern int TaskStatusWaitTimeout;
 extern int TaskExecutorType;
 extern bool EnableRepartitionJoins;
 extern bool BinaryMasterCopyFormat;
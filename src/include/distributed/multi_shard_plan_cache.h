@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_shard_plan_cache.h
+ *	  Backend-wide cache of distributed plans for multi-shard prepared
+ *	  SELECT queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_SHARD_PLAN_CACHE_H
+#define MULTI_SHARD_PLAN_CACHE_H
+
+#include "postgres.h"
+
+#include "distributed/distributed_planner.h"
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "nodes/plannodes.h"
+
+
+/* GUC, maximum number of plans in the multi-shard plan cache */
+extern int MultiShardPlanCacheSize;
+
+
+extern bool MultiShardQueryIsCacheable(Query *query, int cursorOptions,
+									   ParamListInfo boundParams);
+extern PlannedStmt * PlanMultiShardQueryViaCache(Query *query, int cursorOptions,
+												 ParamListInfo boundParams);
+extern bool PlanningMultiShardPlanTemplate(void);
+extern void RecordMultiShardPlanRestrictions(PlannerRestrictionContext *
+											 plannerRestrictionContext);
+extern void InvalidateMultiShardPlanCache(Oid relationId);
+
+#endif /* MULTI_SHARD_PLAN_CACHE_H */
@@ -0,0 +1,34 @@
+/*-------------------------------------------------------------------------
+ *
+ * node_stats.h
+ *   Cumulative per-node latency histograms and throughput counters of the
+ *   remote work done by this node.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef NODE_STATS_H
+#define NODE_STATS_H
+
+
+/* statistics of a single node, kept in shared memory */
+typedef struct NodeStatsHashEntry NodeStatsHashEntry;
+
+
+/* GUC variable */
+extern int NodeStatsMax;
+
+
+extern void InitializeNodeStats(void);
+extern NodeStatsHashEntry * GetNodeStats(const char *hostname, int port);
+extern void RecordNodeTaskExecution(NodeStatsHashEntry *nodeStats, double taskTime,
+									bool succeeded);
+extern void RecordNodeTaskRetry(NodeStatsHashEntry *nodeStats);
+extern void RecordNodeBytes(NodeStatsHashEntry *nodeStats, uint64 bytesSent,
+							uint64 bytesReceived);
+extern void RecordNodeConnectionAttempt(const char *hostname, int port,
+										double establishmentTime, bool succeeded);
+
+#endif /* NODE_STATS_H */
@@ -0,0 +1,23 @@
+/*-------------------------------------------------------------------------
+ *
+ * partition_pruning.h
+ *	  Functions for pruning the partitions of distributed partitioned tables
+ *	  on the coordinator.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARTITION_PRUNING_H
+#define PARTITION_PRUNING_H
+
+#include "nodes/parsenodes.h"
+
+
+/* GUC, whether partitioned tables are pruned to a single partition */
+extern bool EnableCoordinatorPartitionPruning;
+
+extern void PruneDistributedPartitionedTables(Query *query);
+
+#endif /* PARTITION_PRUNING_H */
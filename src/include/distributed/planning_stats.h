@@ -0,0 +1,53 @@
+/*-------------------------------------------------------------------------
+ *
+ * planning_stats.h
+ *   Per-phase timing of the distributed planner and cumulative planning
+ *   statistics per query.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PLANNING_STATS_H
+#define PLANNING_STATS_H
+
+#include "nodes/plannodes.h"
+
+
+/*
+ * PlanningPhase lists the parts of distributed planning whose time is
+ * tracked separately. Time is always charged to the innermost phase only,
+ * so the phases of a single planner invocation never overlap.
+ */
+typedef enum PlanningPhase
+{
+	PLANNING_PHASE_OTHER = 0,
+	PLANNING_PHASE_STANDARD_PLANNER,
+	PLANNING_PHASE_FAST_PATH,
+	PLANNING_PHASE_ROUTER,
+	PLANNING_PHASE_RECURSIVE_PLANNING,
+	PLANNING_PHASE_RESTRICTION_EQUIVALENCE,
+	PLANNING_PHASE_LOGICAL_PLANNING,
+	PLANNING_PHASE_PHYSICAL_PLANNING,
+
+	/* must be last */
+	PLANNING_PHASE_COUNT
+} PlanningPhase;
+
+
+/* GUC variables */
+extern bool TrackPlanningStats;
+extern bool ExplainPlanningPhases;
+extern int PlanningStatsMax;
+
+
+extern void InitializePlanningStats(void);
+extern void StartPlanningPhaseTracking(void);
+extern void FinishPlanningPhaseTracking(PlannedStmt *plan, uint64 queryId);
+extern PlanningPhase BeginPlanningPhase(PlanningPhase phase);
+extern void EndPlanningPhase(PlanningPhase previousPhase);
+extern PlanningPhase CurrentPlanningPhase(void);
+extern const char * PlanningPhaseName(PlanningPhase phase);
+
+#endif /* PLANNING_STATS_H */
@@ -0,0 +1,54 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_progress.h
+ *    Progress of long-running distributed executions per worker.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef QUERY_PROGRESS_H
+#define QUERY_PROGRESS_H
+
+#include "distributed/worker_manager.h"
+#include "nodes/pg_list.h"
+
+
+/* progress of the tasks of a distributed execution on a single worker */
+typedef struct QueryProgressWorker
+{
+	/* distributed transaction of the execution, if it has one yet */
+	int initiatorNodeIdentifier;
+	uint64 transactionNumber;
+
+	char nodeName[MAX_NODE_LENGTH + 1];
+	int nodePort;
+
+	/* placement executions that became ready, and how far along they are */
+	uint64 taskCount;
+	uint64 queuedTaskCount;
+	uint64 runningTaskCount;
+	uint64 doneTaskCount;
+
+	uint64 rowsReceived;
+	uint64 bytesReceived;
+} QueryProgressWorker;
+
+/* progress of a distributed execution, kept in dynamic shared memory */
+typedef struct QueryProgress
+{
+	int workerCount;
+	QueryProgressWorker *workers;
+} QueryProgress;
+
+
+/* GUC variable */
+extern int QueryProgressMinTaskCount;
+
+
+extern QueryProgress * StartQueryProgress(List *taskList);
+extern QueryProgressWorker * QueryProgressForWorker(QueryProgress *queryProgress,
+													char *nodeName, int nodePort);
+extern void FinishQueryProgress(QueryProgress *queryProgress);
+
+#endif /* QUERY_PROGRESS_H */
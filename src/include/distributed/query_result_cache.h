@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_result_cache.h
+ *    Shared memory cache of the results of read-only distributed queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef QUERY_RESULT_CACHE_H
+#define QUERY_RESULT_CACHE_H
+
+#include "nodes/pg_list.h"
+
+
+struct CitusScanState;
+
+
+/* GUC variables */
+extern int QueryResultCacheSize;
+extern int QueryResultCacheTTL;
+
+
+extern void InitializeQueryResultCache(void);
+extern bool ReadCachedQueryResult(struct CitusScanState *scanState);
+extern void CacheQueryResult(struct CitusScanState *scanState);
+extern void RecordTaskListModification(List *taskList);
+extern void RecordRelationModification(Oid relationId);
+extern void InvalidateQueryResultCache(void);
+extern void QueryResultCacheTransactionEnd(void);
+
+#endif /* QUERY_RESULT_CACHE_H */
@@ -10,10 +10,31 @@
 #ifndef QUERY_STATS_H
 #define QUERY_STATS_H
 
+#include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "nodes/pg_list.h"
+
+
+/* which statements citus_stat_statements keeps track of */
+typedef enum
+{
+	STAT_STATEMENTS_TRACK_NONE = 0,
+	STAT_STATEMENTS_TRACK_ALL = 1
+} StatStatementsTrackType;
+
+
+/* GUC variables */
+extern int StatStatementsTrack;
+extern int StatStatementsMax;
+extern double StatStatementsPartitionKeySampleRate;
+
 
 extern void InitializeCitusQueryStats(void);
+extern bool CitusQueryStatsEnabled(void);
+extern void CitusQueryStatsPlanningEntry(uint64 queryId, MultiExecutorType executorType,
+										 Job *workerJob, double planningTime);
 extern void CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-										  char *partitionKey);
+										  Job *workerJob, double executionTime,
+										  uint64 rowCount, List *workerPoolStatsList);
 
 #endif /* QUERY_STATS_H */
@@ -0,0 +1,36 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_combiner.h
+ *    Combining rows received from the workers per group before they are
+ *    stored in the tuple store of the remote scan.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RECEIVED_ROW_COMBINER_H
+#define RECEIVED_ROW_COMBINER_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "distributed/multi_physical_planner.h"
+#include "nodes/execnodes.h"
+#include "utils/tuplestore.h"
+
+
+/* opaque, defined in received_row_combiner.c */
+typedef struct ReceivedRowCombiner ReceivedRowCombiner;
+
+
+/* GUC variable */
+extern bool EnableCombineOnReceive;
+
+
+extern ReceivedRowCombiner * CreateReceivedRowCombiner(DistributedPlan *distributedPlan,
+													   TupleDesc tupleDescriptor,
+													   PlanState *parent);
+extern void CombineReceivedRow(ReceivedRowCombiner *combiner, HeapTuple heapTuple);
+extern void FlushReceivedRowCombiner(ReceivedRowCombiner *combiner,
+									 Tuplestorestate *tupleStore);
+
+#endif /* RECEIVED_ROW_COMBINER_H */
@@ -0,0 +1,37 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_merger.h
+ *    Merging the sorted results that the tasks of a remote scan return,
+ *    instead of sorting all received rows on the coordinator.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RECEIVED_ROW_MERGER_H
+#define RECEIVED_ROW_MERGER_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "distributed/multi_physical_planner.h"
+#include "utils/tuplestore.h"
+
+
+/* opaque, defined in received_row_merger.c */
+typedef struct ReceivedRowMerger ReceivedRowMerger;
+typedef struct ReceivedRowRun ReceivedRowRun;
+
+
+/* GUC variable */
+extern bool EnableSortedMerge;
+
+
+extern ReceivedRowMerger * CreateReceivedRowMerger(DistributedPlan *distributedPlan,
+												   TupleDesc tupleDescriptor,
+												   List *taskList);
+extern ReceivedRowRun * ReceivedRowMergerRun(ReceivedRowMerger *merger, Task *task);
+extern void AddReceivedRowToRun(ReceivedRowRun *run, HeapTuple heapTuple);
+extern void FlushReceivedRowMerger(ReceivedRowMerger *merger,
+								   Tuplestorestate *tupleStore);
+
+#endif /* RECEIVED_ROW_MERGER_H */
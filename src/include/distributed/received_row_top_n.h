@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * received_row_top_n.h
+ *    Keeping only the first rows in sort order of the rows received from
+ *    the workers when the coordinator applies ORDER BY ... LIMIT.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RECEIVED_ROW_TOP_N_H
+#define RECEIVED_ROW_TOP_N_H
+
+#include "access/htup.h"
+#include "access/tupdesc.h"
+#include "distributed/multi_physical_planner.h"
+#include "utils/tuplestore.h"
+
+
+/* opaque, defined in received_row_top_n.c */
+typedef struct ReceivedRowTopN ReceivedRowTopN;
+
+
+/* GUC variable */
+extern bool EnableTopNOnReceive;
+
+
+extern ReceivedRowTopN * CreateReceivedRowTopN(DistributedPlan *distributedPlan,
+											   TupleDesc tupleDescriptor);
+extern void AddReceivedRowToTopN(ReceivedRowTopN *topN, HeapTuple heapTuple);
+extern void FlushReceivedRowTopN(ReceivedRowTopN *topN, Tuplestorestate *tupleStore);
+
+#endif /* RECEIVED_ROW_TOP_N_H */
@@ -22,6 +22,14 @@
 #include "nodes/relation.h"
 #endif
 
+
+/* GUC variables */
+extern bool EnableSubPlanRestrictionPushdown;
+extern bool EnableSemiJoinReduction;
+extern int BroadcastJoinThreshold;
+extern bool EnableLocalTableJoinPushdown;
+
+
 extern List * GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 												   PlannerRestrictionContext *
 												   plannerRestrictionContext);
@@ -36,6 +36,7 @@ typedef enum RelationAccessMode
 
 extern void AllocateRelationAccessHash(void);
 extern void ResetRelationAccessHash(void);
+extern void InvalidateParallelRelationAccessCache(Oid relationId);
 extern void RecordRelationAccessIfReferenceTable(Oid relationId,
 												 ShardPlacementAccessType accessType);
 extern void RecordParallelRelationAccessForTaskList(List *taskList);
@@ -29,6 +29,11 @@ bool RestrictionEquivalenceForPartitionKeysViaEquivalences(PlannerRestrictionCon
 														   allAttributeEquivalenceList);
 extern List * GenerateAllAttributeEquivalences(PlannerRestrictionContext *
 											   plannerRestrictionContext);
+extern List * RestrictionClausesForRelation(RangeTblEntry *rangeTableEntry,
+										   Index rangeTableIndex,
+										   PlannerRestrictionContext *
+										   plannerRestrictionContext,
+										   bool includeEquivalentRestrictions);
 extern uint32 ReferenceRelationCount(RelationRestrictionContext *restrictionContext);
 
 extern List * DistributedRelationIdList(Query *query);
@@ -21,6 +21,29 @@
 /* GUC, determining whether statements sent to remote nodes are logged */
 extern bool LogRemoteCommands;
 
+/* GUC, determining whether parameterized commands are prepared on the workers */
+extern bool EnableWorkerPreparedStatements;
+
+
+/*
+ * WorkerPreparedStatement represents a parameterized command that was sent
+ * over a connection before, and that may have been prepared on the remote
+ * node under statementName.
+ */
+typedef struct WorkerPreparedStatement
+{
+	char *command;
+	int parameterCount;
+	Oid *parameterTypes;
+
+	/* number of times the command was sent over the connection */
+	uint64 useCount;
+
+	/* whether the command is prepared on the remote node under statementName */
+	bool prepared;
+	char statementName[NAMEDATALEN];
+} WorkerPreparedStatement;
+
 
 /* simple helpers */
 extern bool IsResponseOK(PGresult *result);
@@ -45,10 +68,34 @@ extern void ExecuteCriticalRemoteCommand(MultiConnection *connection,
 extern int ExecuteOptionalRemoteCommand(MultiConnection *connection,
 										const char *command,
 										PGresult **result);
+extern int ExecuteRemoteCommandBatch(MultiConnection *connection,
+									 const char *commandBatch, int elevel);
 extern int SendRemoteCommand(MultiConnection *connection, const char *command);
 extern int SendRemoteCommandParams(MultiConnection *connection, const char *command,
 								   int parameterCount, const Oid *parameterTypes,
 								   const char *const *parameterValues);
+extern int SendRemoteCommandParamsExtended(MultiConnection *connection,
+										   const char *command, int parameterCount,
+										   const Oid *parameterTypes,
+										   const char *const *parameterValues,
+										   const int *parameterLengths,
+										   const int *parameterFormats,
+										   bool binaryResults);
+extern WorkerPreparedStatement * GetWorkerPreparedStatement(MultiConnection *connection,
+															 const char *command,
+															 int parameterCount,
+															 const Oid *
+															 parameterTypes);
+extern int SendRemotePrepare(MultiConnection *connection,
+							 WorkerPreparedStatement *preparedStatement);
+extern int SendRemotePreparedCommand(MultiConnection *connection,
+									 WorkerPreparedStatement *preparedStatement,
+									 const char *const *parameterValues,
+									 const int *parameterLengths,
+									 const int *parameterFormats,
+									 bool binaryResults);
+extern void FreeWorkerPreparedStatements(MultiConnection *connection);
+extern void InvalidateWorkerPreparedStatements(void);
 extern List * ReadFirstColumnAsText(PGresult *queryResult);
 extern PGresult * GetRemoteCommandResult(MultiConnection *connection,
 										 bool raiseInterrupts);
@@ -58,6 +105,8 @@ extern bool PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg);
 
 /* waiting for multiple command results */
 extern void WaitForAllConnections(List *connectionList, bool raiseInterrupts);
+extern void WaitForAllConnectionsWithTimeout(List *connectionList, bool raiseInterrupts,
+											 long timeout, uint32 waitEventInfo);
 
 extern bool SendCancelationRequest(MultiConnection *connection);
 
@@ -69,13 +69,11 @@ typedef struct RemoteTransaction
 	bool transactionFailed;
 
 	/*
-	 * Id of last savepoint that successfully began before transaction failure.
-	 * Since savepoint ids are assigned incrementally, rolling back to any savepoint
-	 * with id equal to or less than this id recovers the transaction from failures.
+	 * Id of last savepoint sent over the connection. Savepoints are only sent
+	 * in front of the next command on the connection, and since savepoint ids
+	 * are assigned incrementally, active savepoints with an id equal to or less
+	 * than this id exist on the remote side.
 	 */
-	SubTransactionId lastSuccessfulSubXact;
-
-	/* Id of last savepoint queued before first query of transaction */
 	SubTransactionId lastQueuedSubXact;
 
 	/* waiting for the result of a recovering ROLLBACK TO SAVEPOINT command */
@@ -86,6 +84,9 @@ typedef struct RemoteTransaction
 
 	/* set when BEGIN is sent over the connection */
 	bool beginSent;
+
+	/* set when the WAL position of the worker is requested along with COMMIT */
+	bool commitLsnRequested;
 } RemoteTransaction;
 
 
@@ -96,6 +97,10 @@ extern bool ParsePreparedTransactionName(char *preparedTransactionName, int32 *g
 
 /* change an individual remote transaction's state */
 extern void StartRemoteTransactionBegin(struct MultiConnection *connection);
+extern char * RemoteTransactionBeginCommand(struct MultiConnection *connection);
+extern char * RemoteTransactionSavepointCommand(struct MultiConnection *connection,
+												int *savepointCount);
+extern bool StartRemoteTransactionSavepoints(struct MultiConnection *connection);
 extern void FinishRemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionListBegin(List *connectionList);
@@ -142,7 +147,6 @@ extern void CoordinatedRemoteTransactionsAbort(void);
 extern void CheckRemoteTransactionsHealth(void);
 
 /* remote savepoint commands */
-extern void CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId);
 extern void CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId);
 extern void CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId);
 
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartitioned_aggregation.h
+ *    Planning GROUP BY queries and window functions that are not partitioned
+ *    by the distribution column by repartitioning their input across the
+ *    workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REPARTITIONED_AGGREGATION_H
+#define REPARTITIONED_AGGREGATION_H
+
+#include "nodes/parsenodes.h"
+#include "nodes/primnodes.h"
+
+
+/* GUC variables */
+extern bool EnableRepartitionedAggregation;
+extern bool EnableRepartitionedWindowFunctions;
+
+
+extern bool WrapGroupingForRepartitionedAggregation(Query *query);
+extern bool WrapWindowFunctionsForRepartitioning(Query *query);
+extern bool CanRepartitionWindowFunctions(Query *query);
+extern Var * WindowPartitionColumn(List *windowClauseList, List *targetList);
+
+#endif /* REPARTITIONED_AGGREGATION_H */
@@ -38,9 +38,18 @@ typedef enum AdvisoryLocktagClass
 	ADV_LOCKTAG_CLASS_CITUS_JOB = 6,
 	ADV_LOCKTAG_CLASS_CITUS_REBALANCE_COLOCATION = 7,
 	ADV_LOCKTAG_CLASS_CITUS_COLOCATED_SHARDS_METADATA = 8,
+	ADV_LOCKTAG_CLASS_CITUS_SHARD_MOVE = 9,
+	ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE = 10,
 } AdvisoryLocktagClass;
 
 
+/*
+ * Shard resource locks of multi-shard modifications can be escalated to locks
+ * on ranges of this many consecutive shard IDs.
+ */
+#define SHARD_RESOURCE_RANGE_SIZE 1024
+
+
 /* reuse advisory lock, but with different, unused field 4 (4)*/
 #define SET_LOCKTAG_SHARD_METADATA_RESOURCE(tag, db, shardid) \
 	SET_LOCKTAG_ADVISORY(tag, \
@@ -73,6 +82,22 @@ typedef enum AdvisoryLocktagClass
 						 (uint32) (jobid), \
 						 ADV_LOCKTAG_CLASS_CITUS_JOB)
 
+/* reuse advisory lock, but with different, unused field 4 (9) */
+#define SET_LOCKTAG_SHARD_MOVE(tag, db, shardid) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 (uint32) ((shardid) >> 32), \
+						 (uint32) (shardid), \
+						 ADV_LOCKTAG_CLASS_CITUS_SHARD_MOVE)
+
+/* reuse advisory lock, but with different, unused field 4 (10) */
+#define SET_LOCKTAG_SHARD_RANGE_RESOURCE(tag, db, rangeid) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 (uint32) ((rangeid) >> 32), \
+						 (uint32) (rangeid), \
+						 ADV_LOCKTAG_CLASS_CITUS_SHARD_RANGE)
+
 /* reuse advisory lock, but with different, unused field 4 (7)
  * Also it has the database hardcoded to MyDatabaseId, to ensure the locks
  * are local to each database */
@@ -84,6 +109,10 @@ typedef enum AdvisoryLocktagClass
 						 ADV_LOCKTAG_CLASS_CITUS_REBALANCE_COLOCATION)
 
 
+/* config variable managed via guc.c */
+extern int ShardLockEscalationThreshold;
+
+
 /* Lock shard/relation metadata for safe modifications */
 extern void LockShardDistributionMetadata(int64 shardId, LOCKMODE lockMode);
 extern bool TryLockShardDistributionMetadata(int64 shardId, LOCKMODE lockMode);
@@ -97,11 +126,16 @@ extern void LockReferencedReferenceShardDistributionMetadata(uint64 shardId,
 /* Lock shard data, for DML commands or remote fetches */
 extern void LockShardResource(uint64 shardId, LOCKMODE lockmode);
 extern void UnlockShardResource(uint64 shardId, LOCKMODE lockmode);
+extern void LockShardRangeResources(uint64 *shardIdArray, int shardIdCount,
+									LOCKMODE lockMode);
 
 /* Lock a job schema or partition task directory */
 extern void LockJobResource(uint64 jobId, LOCKMODE lockmode);
 extern void UnlockJobResource(uint64 jobId, LOCKMODE lockmode);
 
+/* Lock out other non-blocking moves of a shard */
+extern void LockShardMove(uint64 shardId, LOCKMODE lockMode);
+
 /* Lock a co-location group */
 extern void LockColocationId(int colocationId, LOCKMODE lockMode);
 extern void UnlockColocationId(int colocationId, LOCKMODE lockMode);
@@ -116,6 +150,7 @@ extern List * GetSortedReferenceShardIntervals(List *relationList);
 
 /* Lock parent table's colocated shard resource */
 extern void LockParentShardResourceIfPartition(uint64 shardId, LOCKMODE lockMode);
+extern uint64 ParentShardIdIfPartition(uint64 shardId);
 
 /* Lock mode translation between text and enum */
 extern LOCKMODE LockModeTextToLockMode(const char *lockModeName);
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_load_stats.h
+ *    Sampled statistics of the most loaded shards and partition key values.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_LOAD_STATS_H
+#define SHARD_LOAD_STATS_H
+
+#include "distributed/multi_physical_planner.h"
+
+
+/* GUC variables */
+extern int ShardLoadStatsMax;
+extern double ShardLoadStatsSampleRate;
+
+
+extern void InitializeShardLoadStats(void);
+extern bool ShardLoadStatsEnabled(void);
+extern void RecordShardLoad(Job *workerJob, double executionTime);
+
+#endif /* SHARD_LOAD_STATS_H */
@@ -0,0 +1,17 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_map.h
+ *   Export of the shard map for drivers that route queries themselves.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_MAP_H
+#define SHARD_MAP_H
+
+
+extern void NotifyShardMapChanged(void);
+
+#endif /* SHARD_MAP_H */
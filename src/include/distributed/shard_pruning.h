@@ -16,6 +16,9 @@
 
 #define INVALID_SHARD_INDEX -1
 
+/* GUC, maximum number of values in a range that are hashed for pruning */
+extern int MaxRangePruningValues;
+
 /* Function declarations for shard pruning */
 extern List * PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 						  Const **partitionValueConst);
@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_size_cache.h
+ *   Shared memory cache of the on-disk sizes of shard placements, which is
+ *   refreshed periodically by the maintenance daemon.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_SIZE_CACHE_H
+#define SHARD_SIZE_CACHE_H
+
+
+/*
+ * ShardSizeType lists the sizes that are cached for each shard placement,
+ * which correspond to the Postgres size functions of the same name.
+ */
+typedef enum ShardSizeType
+{
+	SHARD_RELATION_SIZE = 0,    /* pg_relation_size */
+	SHARD_TABLE_SIZE,           /* pg_table_size */
+	SHARD_TOTAL_RELATION_SIZE,  /* pg_total_relation_size */
+
+	/* must be last */
+	SHARD_SIZE_TYPE_COUNT
+} ShardSizeType;
+
+
+/* GUC variables */
+extern int ShardSizeCacheMaxShards;
+extern int ShardSizeCacheRefreshInterval;
+
+
+extern void InitializeShardSizeCache(void);
+extern bool ShardSizeCacheEnabled(void);
+extern bool CachedPlacementSize(uint64 shardId, int32 groupId, ShardSizeType sizeType,
+								uint64 *placementSize);
+extern bool RefreshShardSizeCache(void);
+
+#endif /* SHARD_SIZE_CACHE_H */
@@ -50,6 +50,14 @@ extern int ShardIndex(ShardInterval *shardInterval);
 extern ShardInterval * FindShardInterval(Datum partitionColumnValue,
 										 CitusTableCacheEntry *cacheEntry);
 extern int FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry);
+extern int UniformHashShardIndex(int32 hashedValue, int shardCount);
+extern int UniformHashShardIndexShift(int shardCount);
+extern Datum HashPartitionColumnValue(FmgrInfo *hashFunction, Oid collation,
+									  Datum value);
+extern void BuildSortedShardBoundArrays(CitusTableCacheEntry *cacheEntry);
+extern int64 ShardBoundValue(Datum value, Oid shardBoundTypeId);
+extern int ShardBoundIndex(int64 *sortedBounds, int boundCount, int64 value,
+						   bool includeValue);
 extern int SearchCachedShardInterval(Datum partitionColumnValue,
 									 ShardInterval **shardIntervalCache,
 									 int shardCount, Oid shardIntervalCollation,
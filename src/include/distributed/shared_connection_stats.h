@@ -11,16 +11,51 @@
 #ifndef SHARED_CONNECTION_STATS_H
 #define SHARED_CONNECTION_STATS_H
 
+/*
+ * WorkloadClass determines the priority with which a connection is admitted
+ * to the shared pool of connections to a node. Interactive connections are
+ * admitted first, batch connections are limited to citus.batch_pool_share of
+ * the pool.
+ */
+typedef enum WorkloadClass
+{
+	WORKLOAD_CLASS_INTERACTIVE = 0,
+	WORKLOAD_CLASS_BATCH = 1,
+
+	/* only used for citus.workload_class, derive the class per connection */
+	WORKLOAD_CLASS_AUTO = 2
+} WorkloadClass;
+
+#define WORKLOAD_CLASS_COUNT 2
+
 extern int MaxSharedPoolSize;
+extern int WorkloadClassSetting;
+extern int BatchWorkloadPoolShare;
+extern int NodeFailureThreshold;
+extern int NodeProbeInterval;
 
 
 extern void InitializeSharedConnectionStats(void);
-extern void WaitForSharedConnection(void);
 extern void WakeupWaiterBackendsForSharedConnection(void);
 extern int GetMaxSharedPoolSize(void);
-extern bool TryToIncrementSharedConnectionCounter(const char *hostname, int port);
-extern void WaitLoopForSharedConnection(const char *hostname, int port);
-extern void DecrementSharedConnectionCounter(const char *hostname, int port);
-extern void IncrementSharedConnectionCounter(const char *hostname, int port);
+extern WorkloadClass ConnectionWorkloadClass(uint32 flags);
+extern bool TryToIncrementSharedConnectionCounter(const char *hostname, int port,
+												  WorkloadClass workloadClass);
+extern void WaitLoopForSharedConnection(const char *hostname, int port,
+										WorkloadClass workloadClass);
+extern void DecrementSharedConnectionCounter(const char *hostname, int port,
+											 WorkloadClass workloadClass);
+extern void IncrementSharedConnectionCounter(const char *hostname, int port,
+											 WorkloadClass workloadClass);
+extern int GetSharedConnectionCounter(const char *hostname, int port);
+extern void RecordSharedConnectionEstablishment(const char *hostname, int port,
+												double establishmentTime, bool usesSSL);
+extern void RecordSharedTaskExecutions(const char *hostname, int port, int taskCount,
+									   double totalTaskTime);
+extern void RecordNodeConnectionFailure(const char *hostname, int port);
+extern void RecordNodeConnectionSuccess(const char *hostname, int port);
+extern bool NodeIsSuspect(const char *hostname, int port);
+extern bool GetSharedNodeLatencies(const char *hostname, int port,
+								   double *connectionTime, double *taskTime);
 
 #endif /* SHARED_CONNECTION_STATS_H */
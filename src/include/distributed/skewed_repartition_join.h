@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * skewed_repartition_join.h
+ *    Spreading the rows of frequent join values over several partitions in
+ *    dual hash partition joins.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SKEWED_REPARTITION_JOIN_H
+#define SKEWED_REPARTITION_JOIN_H
+
+#include "distributed/multi_logical_planner.h"
+#include "distributed/multi_physical_planner.h"
+#include "nodes/nodes.h"
+
+
+/* GUC variable */
+extern double RepartitionJoinSkewThreshold;
+
+
+extern void AssignSkewedJoinValues(JoinType joinType,
+								   MultiPartition *leftPartitionNode,
+								   MapMergeJob *leftMapMergeJob,
+								   MultiPartition *rightPartitionNode,
+								   MapMergeJob *rightMapMergeJob);
+
+#endif /* SKEWED_REPARTITION_JOIN_H */
@@ -17,7 +17,7 @@
 extern int MaxIntermediateResult;
 extern int SubPlanLevel;
 
-extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
+extern void ExecuteSubPlans(DistributedPlan *distributedPlan, bool allowInlining);
 
 /**
  * IntermediateResultsHashEntry is used to store which nodes need to receive
@@ -32,12 +32,20 @@ extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
  * writeLocalFile indicates if the intermediate result is accessed during local
  * execution. Note that there can possibly be an item for the local node in the
  * NodeIdList.
+ *
+ * usageCount is the number of times the intermediate result is used in the
+ * plan. If it is used once, and the tasks that use it join it with
+ * partitionRelationId on the distribution key, each node only needs the rows
+ * that belong to its own shards.
  */
 typedef struct IntermediateResultsHashEntry
 {
 	char key[NAMEDATALEN];
 	List *nodeIdList;
 	bool writeLocalFile;
+	int usageCount;
+	Oid partitionRelationId;
+	int partitionColumnIndex;
 } IntermediateResultsHashEntry;
 
 #endif /* SUBPLAN_EXECUTION_H */
@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * subplan_result_cache.h
+ *    Reusing the intermediate results of identical subplans within a
+ *    transaction.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SUBPLAN_RESULT_CACHE_H
+#define SUBPLAN_RESULT_CACHE_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/parsenodes.h"
+
+
+/* GUC variable */
+extern bool EnableSubPlanResultCache;
+
+
+extern char * SubPlanResultCacheKey(Query *subPlanQuery);
+extern bool ReuseCachedSubPlanResult(DistributedSubPlan *subPlan, char *resultId,
+									 List *nodeList, bool writeLocalFile);
+extern void CacheSubPlanResult(DistributedSubPlan *subPlan, char *resultId,
+							   List *nodeList, bool writeLocalFile);
+extern void RecordDistributedModification(void);
+extern void ResetSubPlanResultCache(void);
+
+#endif /* SUBPLAN_RESULT_CACHE_H */
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * task_coalescing.h
+ *    Merging the tasks of a multi-shard read that go to the same node into
+ *    a single UNION ALL query.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TASK_COALESCING_H
+#define TASK_COALESCING_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/pg_list.h"
+
+
+/* GUC variables */
+extern bool EnableTaskCoalescing;
+extern bool EnableNodePreAggregation;
+
+
+extern List * CoalesceTasksPerNode(DistributedPlan *distributedPlan, List *taskList);
+
+#endif /* TASK_COALESCING_H */
@@ -15,11 +15,13 @@
 #ifndef TASK_TRACKER_H
 #define TASK_TRACKER_H
 
+#include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "utils/hsearch.h"
 
 
 #define HIGH_PRIORITY_TASK_TIME 1   /* assignment time for high priority tasks */
+#define HIGH_PRIORITY_TASK_PRIORITY PG_UINT32_MAX /* priority for cleanup tasks */
 #define RESERVED_JOB_ID 1           /* reserved for cleanup and shutdown tasks */
 #define SHUTDOWN_MARKER_TASK_ID UINT_MAX /* used to identify task tracker shutdown */
 #define MAX_TASK_FAILURE_COUNT 2    /* allowed failure count for one task */
@@ -27,6 +29,7 @@
 #define TASK_CALL_STRING_SIZE 12288 /* max length of task call string */
 #define TEMPLATE0_NAME "template0"  /* skip job schema cleanup for template0 */
 #define JOB_SCHEMA_CLEANUP "SELECT worker_cleanup_job_schema_cache()"
+#define MAX_TASK_STATUS_WAITERS 64  /* backends that can wait on task completion */
 
 
 /*
@@ -81,6 +84,7 @@ typedef struct WorkerTask
 	uint64 jobId;      /* job id (upper 32-bits reserved); part of hash table key */
 	uint32 taskId;     /* task id; part of hash table key */
 	uint32 assignedAt; /* task assignment time in epoch seconds */
+	uint32 priority;   /* tasks with higher priorities are scheduled first */
 
 	TaskStatus taskStatus;  /* task's current execution status */
 	char databaseName[NAMEDATALEN];   /* name to use for local backend connection */
@@ -106,6 +110,13 @@ typedef struct WorkerTasksSharedStateData
 	char *taskHashTrancheName;
 	LWLock taskHashLock;
 	bool conninfosValid;
+
+	/* latch of the task tracker process, set when new tasks are assigned */
+	Latch *taskTrackerLatch;
+
+	/* backends waiting for a task to finish, woken up by the task tracker */
+	int taskStatusWaiterCount;
+	int taskStatusWaiters[MAX_TASK_STATUS_WAITERS];
 } WorkerTasksSharedStateData;
 
 
@@ -127,6 +138,10 @@ extern void TaskTrackerMain(Datum main_arg);
 /* Function declarations local to the worker module */
 extern WorkerTask * WorkerTasksHashEnter(uint64 jobId, uint32 taskId);
 extern WorkerTask * WorkerTasksHashFind(uint64 jobId, uint32 taskId);
+extern bool WorkerTaskFinished(WorkerTask *workerTask);
+extern bool RegisterTaskStatusWaiter(void);
+extern void UnregisterTaskStatusWaiter(void);
+extern void WakeTaskTracker(void);
 
 /* Function declarations for starting up and running the task tracker */
 extern void TaskTrackerRegister(void);
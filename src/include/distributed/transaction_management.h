@@ -91,6 +91,9 @@ extern dlist_head InProgressTransactions;
 /* controls use of locks to enforce safe commutativity */
 extern bool AllModificationsCommutative;
 
+/* whether commutative writes run on all placements of a shard in parallel */
+extern bool EnableParallelReplicaWrites;
+
 /* we've deprecated this flag, keeping here for some time not to break existing users */
 extern bool EnableDeadlockPrevention;
 
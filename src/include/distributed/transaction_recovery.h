@@ -11,6 +11,8 @@
 #ifndef TRANSACTION_RECOVERY_H
 #define TRANSACTION_RECOVERY_H
 
+#include "nodes/pg_list.h"
+
 
 /* GUC to configure interval for 2PC auto-recovery */
 extern int Recover2PCInterval;
@@ -18,6 +20,7 @@ extern int Recover2PCInterval;
 
 /* Functions declarations for worker transactions */
 extern void LogTransactionRecord(int32 groupId, char *transactionName);
+extern void LogTransactionRecordList(List *groupIdList, List *transactionNameList);
 extern int RecoverTwoPhaseCommits(void);
 
 
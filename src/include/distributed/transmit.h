@@ -18,10 +18,15 @@
 #include "storage/fd.h"
 
 
+/* size of the buffer used to read files and of the copy data messages we send */
+#define TRANSMIT_BUFFER_SIZE (1024 * 1024)
+
 /* Function declarations for transmitting files between two nodes */
 extern void RedirectCopyDataToRegularFile(const char *filename);
 extern void SendRegularFile(const char *filename);
 extern File FileOpenForTransmit(const char *filename, int fileFlags, int fileMode);
+extern void SendCopyInStart(void);
+extern bool ReceiveCopyData(StringInfo copyData);
 
 /* Function declaration local to commands and worker modules */
 extern void FreeStringInfo(StringInfo stringInfo);
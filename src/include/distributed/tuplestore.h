@@ -12,10 +12,17 @@
 #define CITUS_TUPLESTORE_H
 #include "funcapi.h"
 
+/* GUC variable */
+extern bool CompressSpilledResults;
+
 /* Function declaration for getting oid for the given function name */
 extern
 ReturnSetInfo * CheckTuplestoreReturn(FunctionCallInfo fcinfo, TupleDesc *tupdesc);
 
 extern
 Tuplestorestate * SetupTuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc);
+
+extern void CompressValuesForTuplestore(Tuplestorestate *tupleStore,
+										TupleDesc tupleDescriptor,
+										Datum *values, bool *nulls);
 #endif
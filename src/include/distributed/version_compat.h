@@ -36,6 +36,10 @@
 #define GetSysCacheOid2Compat GetSysCacheOid2
 #define GetSysCacheOid3Compat GetSysCacheOid3
 #define GetSysCacheOid4Compat GetSysCacheOid4
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize, true)
+#define BuildTupleHashTableCompat BuildTupleHashTable
+#define WaitForLockersCompat WaitForLockers
 
 #define fcGetArgValue(fc, n) ((fc)->args[n].value)
 #define fcGetArgNull(fc, n) ((fc)->args[n].isnull)
@@ -72,6 +76,13 @@ FileReadCompat(FileCompat *file, char *buffer, int amount, uint32 wait_event_inf
 }
 
 
+static inline void
+FileSkipCompat(FileCompat *file, off_t amount)
+{
+	file->offset += amount;
+}
+
+
 static inline FileCompat
 FileCompatFromFileStart(File fileDesc)
 {
@@ -105,6 +116,20 @@ FileCompatFromFileStart(File fileDesc)
 	GetSysCacheOid3(cacheId, key1, key2, key3)
 #define GetSysCacheOid4Compat(cacheId, oidcol, key1, key2, key3, key4) \
 	GetSysCacheOid4(cacheId, key1, key2, key3, key4)
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize)
+
+/* PG12 added collations of the key columns */
+#define BuildTupleHashTableCompat(parent, inputDesc, numCols, keyColIdx, eqfuncoids, \
+								  hashfunctions, collations, nbuckets, additionalsize, \
+								  tablecxt, tempcxt, use_variable_hash_iv) \
+	BuildTupleHashTable(parent, inputDesc, numCols, keyColIdx, eqfuncoids, \
+						hashfunctions, nbuckets, additionalsize, tablecxt, tempcxt, \
+						use_variable_hash_iv)
+
+/* PG12 added progress reporting while waiting */
+#define WaitForLockersCompat(heaplocktag, lockmode, progress) \
+	WaitForLockers(heaplocktag, lockmode)
 
 #define LOCAL_FCINFO(name, nargs) \
 	FunctionCallInfoData name ## data; \
@@ -134,6 +159,13 @@ FileReadCompat(FileCompat *file, char *buffer, int amount, uint32 wait_event_inf
 }
 
 
+static inline void
+FileSkipCompat(FileCompat *file, off_t amount)
+{
+	FileSeek(file->fd, amount, SEEK_CUR);
+}
+
+
 static inline FileCompat
 FileCompatFromFileStart(File fileDesc)
 {
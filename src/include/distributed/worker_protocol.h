@@ -32,6 +32,7 @@
 #define PG_JOB_CACHE_DIR "pgsql_job_cache"
 #define MASTER_JOB_DIRECTORY_PREFIX "master_job_"
 #define JOB_DIRECTORY_PREFIX "job_"
+#define TRASH_DIRECTORY_NAME "trash"
 #define JOB_SCHEMA_PREFIX "pg_merge_job_"
 #define TASK_FILE_PREFIX "task_"
 #define TASK_TABLE_PREFIX "task_"
@@ -86,6 +87,24 @@ typedef struct HashPartitionContext
 } HashPartitionContext;
 
 
+/*
+ * SkewedPartitionContext keeps the hash values of partition column values that
+ * are so frequent that their rows are spread over several partitions in a
+ * repartition join. For each hash value, one side of the join spreads its rows
+ * over the partitions starting at the partition of the hash value, and the
+ * other side copies its rows to each of these partitions.
+ */
+typedef struct SkewedPartitionContext
+{
+	FmgrInfo *hashFunction;
+	int32 *skewedHashArray;
+	int32 *skewPartitionCountArray; /* > 0 spreads rows, < 0 copies rows */
+	int skewedHashCount;
+	bool *skewedPartitionArray;     /* partitions that skewed hash values fall in */
+	uint64 spreadRowCount;
+} SkewedPartitionContext;
+
+
 /*
  * FileOutputStream helps buffer write operations to a file; these writes are
  * then regularly flushed to the underlying file. This structure differs from
@@ -103,6 +122,9 @@ typedef struct FileOutputStream
 /* Config variables managed via guc.c */
 extern int PartitionBufferSize;
 extern bool BinaryWorkerCopyFormat;
+extern bool EnableMergeFileScan;
+extern bool EnableDeferredDirectoryCleanup;
+extern int DeferredCleanupFilesPerSecond;
 
 
 /* Function declarations local to the worker module */
@@ -118,6 +140,8 @@ extern bool JobDirectoryElement(const char *filename);
 extern bool DirectoryExists(StringInfo directoryName);
 extern void CitusCreateDirectory(StringInfo directoryName);
 extern void CitusRemoveDirectory(const char *filename);
+extern void CitusRemoveDirectoryDeferred(const char *filename);
+extern int RemoveTrashedFiles(int maxFileCount);
 extern StringInfo InitTaskDirectory(uint64 jobId, uint32 taskId);
 extern void RemoveJobSchema(StringInfo schemaName);
 extern Datum * DeconstructArrayObject(ArrayType *arrayObject);
@@ -156,6 +180,7 @@ extern Datum worker_hash_partition_table(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_into_table(PG_FUNCTION_ARGS);
 extern Datum worker_create_schema(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_and_run_query(PG_FUNCTION_ARGS);
+extern Datum worker_read_task_files(PG_FUNCTION_ARGS);
 extern Datum worker_cleanup_job_schema_cache(PG_FUNCTION_ARGS);
 
 /* Function declarations for fetching regular and foreign tables */
@@ -12,7 +12,9 @@
 #ifndef WORKER_TRANSACTION_H
 #define WORKER_TRANSACTION_H
 
+#include "distributed/connection_management.h"
 #include "distributed/worker_manager.h"
+#include "libpq-fe.h"
 #include "storage/lockdefs.h"
 
 
@@ -28,6 +30,21 @@ typedef enum TargetWorkerSet
 } TargetWorkerSet;
 
 
+/*
+ * RemoteQueryResult is the successful result of a query on a remote node,
+ * as returned by ExecuteQueryOnRemoteNodes.
+ */
+typedef struct RemoteQueryResult
+{
+	MultiConnection *connection;
+	PGresult *result;
+} RemoteQueryResult;
+
+
+/* config variable managed via guc.c */
+extern int RemoteMonitoringTimeout;
+
+
 /* Functions declarations for worker transactions */
 extern List * GetWorkerTransactions(void);
 extern List * TargetWorkerSetNodeList(TargetWorkerSet targetWorkerSet, LOCKMODE lockMode);
@@ -49,12 +66,17 @@ extern void SendCommandListToWorkerInSingleTransaction(const char *nodeName,
 													   int32 nodePort,
 													   const char *nodeUser,
 													   List *commandList);
+extern void SendCommandListToWorkerInSingleBatch(const char *nodeName, int32 nodePort,
+												 const char *nodeUser,
+												 List *commandList);
 extern void SendCommandToWorkersOptionalInParallel(TargetWorkerSet targetWorkerSet,
 												   const char *command,
 												   const char *user);
 void SendCommandToWorkersInParallel(TargetWorkerSet targetWorkerSet,
 									const char *command, const char *user);
 extern void RemoveWorkerTransaction(const char *nodeName, int32 nodePort);
+extern List * ExecuteQueryOnRemoteNodes(List *workerNodeList, const char *user,
+										const char *query, long timeout);
 
 /* helper functions for worker transactions */
 extern bool IsWorkerTransactionActive(void);
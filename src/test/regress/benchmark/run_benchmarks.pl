@@ -0,0 +1,275 @@
+#!/usr/bin/perl -w
+#----------------------------------------------------------------------
+#
+# run_benchmarks.pl - Benchmark runner for Citus
+#
+# Runs pgbench workloads against a Citus cluster and reports their
+# throughput and latency percentiles as JSON. pg_regress_multi.pl starts
+# the cluster and calls this script when it is passed --benchmark.
+#
+# Each workload consists of workloads/<name>.setup.sql, which psql runs
+# once to create and load the tables, and workloads/<name>.sql, which is
+# the pgbench script. Both can refer to the :rows variable, and to
+# @abs_workdir@ for files that the server reads or writes.
+#
+# The workloads are parameterized through environment variables:
+#
+#   BENCH_WORKLOADS  workloads to run, separated by spaces (default: all)
+#   BENCH_ROWS       number of rows that the setup scripts load (100000)
+#   BENCH_CLIENTS    number of concurrent pgbench clients (8)
+#   BENCH_JOBS       number of pgbench threads (4)
+#   BENCH_DURATION   seconds to measure each workload (30)
+#   BENCH_WARMUP     seconds to run each workload before measuring (5)
+#   BENCH_PROTOCOL   pgbench query protocol (prepared)
+#   BENCH_SEED       seed for the random numbers in the pgbench scripts (42)
+#   BENCH_RESULTS    file to write the JSON results to
+#
+# Portions Copyright (c) Citus Data, Inc.
+#
+# src/test/regress/benchmark/run_benchmarks.pl
+#
+#----------------------------------------------------------------------
+
+use strict;
+use warnings;
+
+use Cwd 'abs_path';
+use File::Basename;
+use File::Path qw(make_path remove_tree);
+use File::Spec::Functions;
+use Getopt::Long;
+use JSON::PP;
+use POSIX qw(strftime);
+
+my $benchmarkdir = dirname(abs_path(__FILE__));
+my $workloaddir = catfile($benchmarkdir, "workloads");
+
+my @defaultWorkloads = ("router_lookup", "multi_shard_aggregate", "copy_ingest",
+                        "repartition_join", "insert_select");
+
+# Option parsing
+my $bindir = "";
+my $host = "localhost";
+my $port = 57636;
+my $user = "postgres";
+my $dbname = "regression";
+my @workerPorts = ();
+my $workdir = catfile("tmp_check", "benchmark");
+
+GetOptions(
+    'bindir=s' => \$bindir,
+    'host=s' => \$host,
+    'port=s' => \$port,
+    'user=s' => \$user,
+    'dbname=s' => \$dbname,
+    'worker-port=s' => \@workerPorts,
+    'workdir=s' => \$workdir);
+
+my @workloads = split(' ', $ENV{BENCH_WORKLOADS} || join(' ', @defaultWorkloads));
+my $rows = $ENV{BENCH_ROWS} || 100000;
+my $clients = $ENV{BENCH_CLIENTS} || 8;
+my $jobs = $ENV{BENCH_JOBS} || 4;
+my $duration = $ENV{BENCH_DURATION} || 30;
+my $warmup = defined $ENV{BENCH_WARMUP} ? $ENV{BENCH_WARMUP} : 5;
+my $protocol = $ENV{BENCH_PROTOCOL} || "prepared";
+my $seed = defined $ENV{BENCH_SEED} ? $ENV{BENCH_SEED} : 42;
+
+remove_tree($workdir);
+make_path($workdir) or die "could not create $workdir directory";
+$workdir = abs_path($workdir);
+
+my $resultsFile = $ENV{BENCH_RESULTS} || catfile($workdir, "results.json");
+
+my $psql = $bindir ? catfile($bindir, "psql") : "psql";
+my $pgbench = $bindir ? catfile($bindir, "pgbench") : "pgbench";
+my @connectionArgs = ('-h', $host, '-p', $port, '-U', $user);
+
+# Runs psql with the given arguments against the given database, and dies on errors
+sub RunPsql
+{
+    my ($database, @args) = @_;
+
+    system($psql, ('-X', '-q', '-v', 'ON_ERROR_STOP=1', @connectionArgs,
+                   '-d', $database, @args)) == 0
+        or die "Could not run psql @args";
+}
+
+# Returns the single value that the given query returns
+sub QueryValue
+{
+    my ($database, $query) = @_;
+
+    open(my $fh, '-|', $psql, ('-X', '-A', '-t', @connectionArgs, '-d', $database,
+                               '-c', $query))
+        or die "Could not run psql";
+    my $value = <$fh>;
+    close($fh) or die "Could not run query $query";
+
+    chomp($value) if defined $value;
+    return $value;
+}
+
+# Copies a workload file into the working directory, replacing @abs_workdir@
+sub PrepareWorkloadFile
+{
+    my ($fileName) = @_;
+    my $sourcePath = catfile($workloaddir, $fileName);
+    my $targetPath = catfile($workdir, $fileName);
+
+    open(my $in, '<', $sourcePath) or die "Could not open $sourcePath";
+    open(my $out, '>', $targetPath) or die "Could not create $targetPath";
+    while (my $line = <$in>)
+    {
+        $line =~ s/\@abs_workdir\@/$workdir/g;
+        print $out $line;
+    }
+    close($in);
+    close($out);
+
+    return $targetPath;
+}
+
+# Returns the given percentile of a sorted list of numbers, by nearest rank
+sub Percentile
+{
+    my ($percentile, @sortedValues) = @_;
+
+    return undef if !@sortedValues;
+
+    my $rank = int(($percentile / 100.0) * scalar(@sortedValues) + 0.999999);
+    $rank = 1 if $rank < 1;
+
+    return $sortedValues[$rank - 1];
+}
+
+# Rounds a latency in microseconds to milliseconds with 3 decimals
+sub Milliseconds
+{
+    my ($microseconds) = @_;
+
+    return undef if !defined $microseconds;
+    return sprintf("%.3f", $microseconds / 1000.0) + 0;
+}
+
+# Runs pgbench for a workload, returns the pgbench output
+sub RunPgbench
+{
+    my ($scriptPath, $seconds, @extraArgs) = @_;
+
+    my @args = ('-n', @connectionArgs, '-c', $clients, '-j', $jobs, '-T', $seconds,
+                '-M', $protocol, "--random-seed=$seed", '-D', "rows=$rows",
+                '-f', $scriptPath, @extraArgs, $dbname);
+
+    open(my $fh, '-|', $pgbench, @args) or die "Could not run pgbench";
+    my $output = do { local $/; <$fh> };
+    close($fh) or die "pgbench failed for $scriptPath:\n$output";
+
+    return $output;
+}
+
+###
+# Create the database on the coordinator and add the workers
+###
+if (!QueryValue("postgres", "SELECT 1 FROM pg_database WHERE datname = '$dbname'"))
+{
+    RunPsql("postgres", '-c', "CREATE DATABASE $dbname;");
+}
+
+RunPsql($dbname, '-c', "CREATE EXTENSION IF NOT EXISTS citus;");
+
+for my $workerPort (@workerPorts)
+{
+    RunPsql($dbname, '-c', "SELECT master_add_node('$host', $workerPort) " .
+                           "WHERE NOT EXISTS (SELECT 1 FROM pg_dist_node " .
+                           "WHERE nodename = '$host' AND nodeport = $workerPort);");
+}
+
+my %results = (
+    citus_version => QueryValue($dbname, "SELECT citus_version()"),
+    server_version_num => QueryValue($dbname, "SHOW server_version_num") + 0,
+    worker_count => QueryValue($dbname, "SELECT count(*) FROM pg_dist_node " .
+                                        "WHERE noderole = 'primary' AND isactive") + 0,
+    started_at => strftime("%Y-%m-%dT%H:%M:%SZ", gmtime()),
+    parameters => {
+        rows => $rows + 0,
+        clients => $clients + 0,
+        jobs => $jobs + 0,
+        duration => $duration + 0,
+        warmup => $warmup + 0,
+        protocol => $protocol,
+        seed => $seed + 0,
+    },
+    workloads => [],
+);
+
+###
+# Run the workloads
+###
+for my $workload (@workloads)
+{
+    print "running workload $workload\n";
+
+    my $setupPath = PrepareWorkloadFile("$workload.setup.sql");
+    my $scriptPath = PrepareWorkloadFile("$workload.sql");
+
+    RunPsql($dbname, '-v', "rows=$rows", '-f', $setupPath);
+
+    if ($warmup > 0)
+    {
+        RunPgbench($scriptPath, $warmup);
+    }
+
+    my $logPrefix = catfile($workdir, $workload);
+    my $output = RunPgbench($scriptPath, $duration, '--log', "--log-prefix=$logPrefix");
+
+    # pgbench reports throughput with and without connection setup, use the latter
+    my ($tps) = $output =~ /tps = ([0-9.]+) \((?:excluding|without)/;
+    ($tps) = $output =~ /tps = ([0-9.]+)/ if !defined $tps;
+    my ($transactions) = $output =~ /number of transactions actually processed: (\d+)/;
+
+    # per-transaction logs have the latency in microseconds in the third column
+    my @latencies = ();
+    for my $logFile (glob("$logPrefix.*"))
+    {
+        open(my $log, '<', $logFile) or die "Could not open $logFile";
+        while (my $line = <$log>)
+        {
+            my @fields = split(' ', $line);
+            push(@latencies, $fields[2]) if @fields > 2;
+        }
+        close($log);
+    }
+
+    my @sortedLatencies = sort { $a <=> $b } @latencies;
+    my $latencySum = 0;
+    $latencySum += $_ for @sortedLatencies;
+
+    my %workloadResult = (
+        name => $workload,
+        transactions => ($transactions || 0) + 0,
+        tps => defined $tps ? $tps + 0 : undef,
+        latency_ms => {
+            avg => @sortedLatencies ?
+                   Milliseconds($latencySum / scalar(@sortedLatencies)) : undef,
+            p50 => Milliseconds(Percentile(50, @sortedLatencies)),
+            p90 => Milliseconds(Percentile(90, @sortedLatencies)),
+            p95 => Milliseconds(Percentile(95, @sortedLatencies)),
+            p99 => Milliseconds(Percentile(99, @sortedLatencies)),
+            max => Milliseconds($sortedLatencies[-1]),
+        },
+    );
+
+    push(@{$results{workloads}}, \%workloadResult);
+
+    printf("  %d transactions, %.1f tps, latency p50 %s ms, p99 %s ms\n",
+           $workloadResult{transactions}, $workloadResult{tps} || 0,
+           $workloadResult{latency_ms}{p50} // "-", $workloadResult{latency_ms}{p99} // "-");
+}
+
+open(my $out, '>', $resultsFile) or die "Could not create $resultsFile";
+print $out JSON::PP->new->canonical->pretty->encode(\%results);
+close($out);
+
+print "results written to $resultsFile\n";
+
+exit 0;
@@ -0,0 +1,12 @@
+-- COPY of a batch of 1000 rows into a hash-distributed table
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+DROP TABLE IF EXISTS bench_ingest;
+CREATE TABLE bench_ingest (
+    event_id bigint NOT NULL,
+    device_id bigint NOT NULL,
+    payload text
+);
+SELECT create_distributed_table('bench_ingest', 'device_id');
+COPY (SELECT s, s % 1000, md5(s::text) FROM generate_series(1, 1000) s)
+TO '@abs_workdir@/copy_ingest.data' WITH (format csv);
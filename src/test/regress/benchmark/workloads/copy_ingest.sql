@@ -0,0 +1 @@
+COPY bench_ingest FROM '@abs_workdir@/copy_ingest.data' WITH (format csv);
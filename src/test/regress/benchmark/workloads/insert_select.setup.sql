@@ -0,0 +1,19 @@
+-- co-located INSERT ... SELECT that rolls up raw data into a summary table
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+DROP TABLE IF EXISTS bench_page_views, bench_daily_views;
+CREATE TABLE bench_page_views (
+    site_id bigint NOT NULL,
+    page_id int NOT NULL,
+    view_day int NOT NULL
+);
+SELECT create_distributed_table('bench_page_views', 'site_id');
+CREATE TABLE bench_daily_views (
+    site_id bigint NOT NULL,
+    view_day int NOT NULL,
+    view_count bigint NOT NULL,
+    PRIMARY KEY (site_id, view_day)
+);
+SELECT create_distributed_table('bench_daily_views', 'site_id', colocate_with => 'bench_page_views');
+INSERT INTO bench_page_views SELECT s % 1009, s % 101, s % 30 FROM generate_series(1, :rows) s;
+VACUUM ANALYZE bench_page_views;
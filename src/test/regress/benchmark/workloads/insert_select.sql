@@ -0,0 +1,7 @@
+\set view_day random(0, 29)
+INSERT INTO bench_daily_views (site_id, view_day, view_count)
+SELECT site_id, view_day, count(*)
+FROM bench_page_views
+WHERE view_day = :view_day
+GROUP BY site_id, view_day
+ON CONFLICT (site_id, view_day) DO UPDATE SET view_count = excluded.view_count;
@@ -0,0 +1,13 @@
+-- aggregates that are pushed down to all shards and combined on the coordinator
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+DROP TABLE IF EXISTS bench_events;
+CREATE TABLE bench_events (
+    event_id bigint NOT NULL,
+    user_id bigint NOT NULL,
+    category int NOT NULL,
+    amount numeric NOT NULL
+);
+SELECT create_distributed_table('bench_events', 'user_id');
+INSERT INTO bench_events SELECT s, s % 10007, s % 100, (s % 997) / 10.0 FROM generate_series(1, :rows) s;
+VACUUM ANALYZE bench_events;
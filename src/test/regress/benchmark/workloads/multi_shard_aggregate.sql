@@ -0,0 +1,6 @@
+\set category random(0, 89)
+SELECT category, count(*), sum(amount), avg(amount)
+FROM bench_events
+WHERE category BETWEEN :category AND :category + 10
+GROUP BY category
+ORDER BY category;
@@ -0,0 +1,19 @@
+-- joins on a column other than the distribution column, which repartition
+-- one of the tables
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+DROP TABLE IF EXISTS bench_orders, bench_customers;
+CREATE TABLE bench_customers (
+    customer_id bigint NOT NULL,
+    region int NOT NULL
+);
+SELECT create_distributed_table('bench_customers', 'customer_id');
+CREATE TABLE bench_orders (
+    order_id bigint NOT NULL,
+    customer_id bigint NOT NULL,
+    total numeric NOT NULL
+);
+SELECT create_distributed_table('bench_orders', 'order_id');
+INSERT INTO bench_customers SELECT s, s % 50 FROM generate_series(1, greatest(:rows / 10, 1)) s;
+INSERT INTO bench_orders SELECT s, s % greatest(:rows / 10, 1) + 1, (s % 997) / 10.0 FROM generate_series(1, :rows) s;
+VACUUM ANALYZE bench_customers, bench_orders;
@@ -0,0 +1,5 @@
+\set region random(0, 49)
+SET citus.enable_repartition_joins TO on;
+SELECT count(*), sum(o.total)
+FROM bench_orders o JOIN bench_customers c ON (o.customer_id = c.customer_id)
+WHERE c.region = :region;
@@ -0,0 +1,12 @@
+-- fast-path router queries on the primary key of a hash-distributed table
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+DROP TABLE IF EXISTS bench_accounts;
+CREATE TABLE bench_accounts (
+    account_id bigint PRIMARY KEY,
+    balance bigint NOT NULL,
+    filler text
+);
+SELECT create_distributed_table('bench_accounts', 'account_id');
+INSERT INTO bench_accounts SELECT s, s % 1000, md5(s::text) FROM generate_series(1, :rows) s;
+VACUUM ANALYZE bench_accounts;
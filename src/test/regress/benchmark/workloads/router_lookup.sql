@@ -0,0 +1,2 @@
+\set account_id random(1, :rows)
+SELECT balance, filler FROM bench_accounts WHERE account_id = :account_id;
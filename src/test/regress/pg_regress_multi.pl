@@ -49,6 +49,7 @@ sub Usage()
     print "  --pg_ctl-timeout    	Timeout for pg_ctl\n";
     print "  --connection-timeout	Timeout for connecting to worker nodes\n";
     print "  --mitmproxy        	Start a mitmproxy for one of the workers\n";
+    print "  --benchmark         	Run the given benchmark script instead of tests\n";
     exit 1;
 }
 
@@ -80,9 +81,12 @@ my $pgCtlTimeout = undef;
 my $connectionTimeout = 5000;
 my $useMitmproxy = 0;
 my $mitmFifoPath = catfile($TMP_CHECKDIR, "mitmproxy.fifo");
+my @masterScratchDirs = (catfile($TMP_CHECKDIR, $MASTERDIR, "scratch.1"),
+                         catfile($TMP_CHECKDIR, $MASTERDIR, "scratch.2"));
 my $conninfo = "";
 my $publicWorker1Host = "localhost";
 my $publicWorker2Host = "localhost";
+my $benchmark = "";
 
 my $serversAreShutdown = "TRUE";
 my $usingWindows = 0;
@@ -114,6 +118,7 @@ GetOptions(
     'conninfo=s' => \$conninfo,
     'worker-1-public-hostname=s' => \$publicWorker1Host,
     'worker-2-public-hostname=s' => \$publicWorker2Host,
+    'benchmark=s' => \$benchmark,
     'help' => sub { Usage() });
 
 # Update environment to include [DY]LD_LIBRARY_PATH/LIBDIR/etc -
@@ -416,10 +421,24 @@ push(@pgOptions, '-c', "citus.task_tracker_delay=10ms");
 push(@pgOptions, '-c', "citus.remote_task_check_interval=1ms");
 push(@pgOptions, '-c', "citus.shard_replication_factor=2");
 push(@pgOptions, '-c', "citus.node_connection_timeout=${connectionTimeout}");
+push(@pgOptions, '-c', "citus.query_result_cache_size=1MB");
 
 # we disable slow start by default to encourage parallelism within tests
 push(@pgOptions, '-c', "citus.executor_slow_start_interval=0ms");
 
+# benchmarks should measure the defaults rather than the test settings above
+if ($benchmark)
+{
+  push(@pgOptions, '-c', "citus.shard_count=32");
+  push(@pgOptions, '-c', "citus.shard_replication_factor=1");
+  push(@pgOptions, '-c', "citus.shard_max_size=1GB");
+  push(@pgOptions, '-c', "citus.max_running_tasks_per_node=8");
+  push(@pgOptions, '-c', "citus.expire_cached_shards=off");
+  push(@pgOptions, '-c', "citus.sort_returning=off");
+  push(@pgOptions, '-c', "citus.query_result_cache_size=0");
+  push(@pgOptions, '-c', "citus.executor_slow_start_interval=10ms");
+}
+
 if ($useMitmproxy)
 {
   # make tests reproducible by never trying to negotiate ssl
@@ -595,6 +614,10 @@ close $fh;
 if (!$conninfo)
 {
     make_path(catfile($TMP_CHECKDIR, $MASTERDIR, 'log')) or die "Could not create $MASTERDIR directory";
+    for my $scratchDir (@masterScratchDirs)
+    {
+        make_path($scratchDir) or die "Could not create $scratchDir directory";
+    }
     for my $port (@workerPorts)
     {
         make_path(catfile($TMP_CHECKDIR, "worker.$port", "log"))
@@ -768,9 +791,14 @@ if ($followercluster)
 # Start servers
 if (!$conninfo)
 {
+    # the master stripes intermediate results across scratch directories, while the
+    # workers keep them in their data directories
+    my $masterScratchDirList = join(",", map { abs_path($_) } @masterScratchDirs);
+
     if(system(catfile("$bindir", "pg_ctl"),
         ('start', '-w',
-            '-o', join(" ", @pgOptions)." -c port=$masterPort $synchronousReplication",
+            '-o', join(" ", @pgOptions)." -c port=$masterPort $synchronousReplication".
+                  " -c citus.intermediate_result_directories=$masterScratchDirList",
         '-D', catfile($TMP_CHECKDIR, $MASTERDIR, 'data'), '-l', catfile($TMP_CHECKDIR, $MASTERDIR, 'log', 'postmaster.log'))) != 0)
     {
     system("tail", ("-n20", catfile($TMP_CHECKDIR, $MASTERDIR, "log", "postmaster.log")));
@@ -955,6 +983,27 @@ if ($vanillatest)
 	    $exitcode = system("make", ("-C", catfile("$postgresBuilddir", "src", "test", "regress"), "installcheck-parallel"))
 	}
 }
+elsif ($benchmark)
+{
+    my @benchmarkArguments = (
+        '--host', $host,
+        '--port', $masterPort,
+        '--user', $user,
+        '--workdir', catfile($TMP_CHECKDIR, "benchmark")
+    );
+
+    if ($bindir)
+    {
+        push(@benchmarkArguments, '--bindir', $bindir);
+    }
+
+    for my $port (@workerPorts)
+    {
+        push(@benchmarkArguments, '--worker-port', $port);
+    }
+
+    $exitcode = system($^X, $benchmark, @benchmarkArguments);
+}
 elsif ($isolationtester)
 {
     push(@arguments, "--dbname=regression");
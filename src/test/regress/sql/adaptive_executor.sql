@@ -34,4 +34,315 @@ SELECT sum(result::bigint) FROM run_command_on_workers($$
 $$);
 END;
 
+-- send multiple shard modifications in a single round trip, use a single
+-- connection per worker such that both shards on a worker end up in one batch
+SET citus.max_adaptive_executor_pool_size TO 1;
+SET citus.executor_batch_size TO 4;
+SET client_min_messages TO DEBUG1;
+UPDATE test SET y = y + 1;
+
+-- each shard command is sent separately without batching
+SET citus.executor_batch_size TO 1;
+UPDATE test SET y = y;
+SET citus.executor_batch_size TO 4;
+RESET client_min_messages;
+SELECT * FROM test ORDER BY x;
+
+BEGIN;
+DELETE FROM test WHERE x = 1;
+SET LOCAL client_min_messages TO DEBUG1;
+UPDATE test SET y = y * 10;
+RESET client_min_messages;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+
+SELECT * FROM test ORDER BY x;
+RESET citus.executor_batch_size;
+SET citus.max_adaptive_executor_pool_size TO 2;
+
+-- return rows while the remaining tasks are still running
+SET citus.enable_streaming_execution TO on;
+SELECT * FROM test ORDER BY x;
+SELECT count(*) FROM (SELECT * FROM test LIMIT 1) l;
+
+BEGIN;
+DECLARE streaming_cursor SCROLL CURSOR FOR SELECT y FROM test;
+FETCH 1 FROM streaming_cursor;
+FETCH BACKWARD 1 FROM streaming_cursor;
+FETCH ALL FROM streaming_cursor;
+CLOSE streaming_cursor;
+SELECT * FROM test ORDER BY x;
+COMMIT;
+
+-- a PL/pgSQL loop can modify the rows that it reads
+BEGIN;
+DO $$
+DECLARE
+    r record;
+BEGIN
+    FOR r IN SELECT x FROM test LOOP
+        UPDATE test SET y = y + 1 WHERE x = r.x;
+    END LOOP;
+END;
+$$;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+RESET citus.enable_streaming_execution;
+
+-- stream results when a cursor fetches them in batches
+SET citus.enable_cursor_streaming TO on;
+BEGIN;
+DECLARE streaming_cursor NO SCROLL CURSOR FOR SELECT y FROM test;
+FETCH 1 FROM streaming_cursor;
+FETCH ALL FROM streaming_cursor;
+CLOSE streaming_cursor;
+SELECT * FROM test ORDER BY x;
+COMMIT;
+
+-- the cursor finishes its execution when another one needs its connections
+BEGIN;
+UPDATE test SET y = y + 1;
+DECLARE streaming_cursor NO SCROLL CURSOR FOR SELECT y FROM test;
+FETCH 1 FROM streaming_cursor;
+UPDATE test SET y = y + 1;
+FETCH ALL FROM streaming_cursor;
+CLOSE streaming_cursor;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+
+-- a PL/pgSQL loop can modify the rows that it reads
+BEGIN;
+DO $$
+DECLARE
+    r record;
+BEGIN
+    FOR r IN SELECT x FROM test LOOP
+        UPDATE test SET y = y + 1 WHERE x = r.x;
+    END LOOP;
+END;
+$$;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+RESET citus.enable_cursor_streaming;
+
+-- open remote transaction blocks in the same command as the first query
+SET citus.enable_coalesced_begin TO on;
+BEGIN;
+UPDATE test SET y = y + 1 WHERE x = 1;
+SELECT * FROM test WHERE x = 1;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+
+BEGIN;
+SELECT x / (y - y) FROM test WHERE x = 3;
+ROLLBACK;
+
+-- savepoints are replayed with a separate BEGIN
+BEGIN;
+SAVEPOINT s1;
+SELECT * FROM test ORDER BY x;
+ROLLBACK TO SAVEPOINT s1;
+UPDATE test SET y = y * 10;
+SELECT * FROM test ORDER BY x;
+ROLLBACK;
+
+SELECT * FROM test ORDER BY x;
+RESET citus.enable_coalesced_begin;
+
+-- combine rows per group while receiving them
+SET citus.enable_combine_on_receive TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT y, count(*), min(x), max(x) FROM test GROUP BY y ORDER BY y;
+SELECT y, count(*) FROM test GROUP BY y HAVING max(x) > 18 ORDER BY y;
+ROLLBACK;
+RESET citus.enable_combine_on_receive;
+
+-- keep only the first rows in sort order while receiving them
+SET citus.enable_top_n_on_receive TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT x, y FROM test ORDER BY x DESC LIMIT 3 OFFSET 1;
+SELECT x, y FROM test ORDER BY y, x LIMIT 4;
+ROLLBACK;
+RESET citus.enable_top_n_on_receive;
+
+-- merge the sorted results of the workers
+SET citus.enable_sorted_merge TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT x, y FROM test WHERE x > 12 ORDER BY y, x DESC;
+SELECT x, y FROM test ORDER BY x LIMIT 3;
+ROLLBACK;
+RESET citus.enable_sorted_merge;
+
+-- skip the remaining tasks once a LIMIT without ORDER BY has enough rows
+SET citus.enable_limit_cancellation TO on;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 1) t;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT count(*) FROM (SELECT x, y FROM test LIMIT 5) t;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 5 OFFSET 16) t;
+ROLLBACK;
+RESET citus.enable_limit_cancellation;
+
+-- start slow reads on a second placement and cancel the query that loses
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE hedged_test (x int, y int);
+SELECT create_distributed_table('hedged_test','x');
+SET citus.shard_replication_factor TO 1;
+INSERT INTO hedged_test SELECT i, i % 3 FROM generate_series(1, 20) i;
+-- every read of x = 1 advances the sequence, but only the reads that are not
+-- cancelled insert a row
+SELECT run_command_on_workers($$CREATE SEQUENCE adaptive_executor.hedge_starts$$);
+SELECT run_command_on_workers($$CREATE TABLE adaptive_executor.hedge_ends (x int)$$);
+CREATE FUNCTION slow_read(x int) RETURNS int AS $$
+BEGIN
+	IF x = 1 THEN
+		PERFORM nextval('adaptive_executor.hedge_starts');
+		PERFORM pg_sleep(2);
+		INSERT INTO adaptive_executor.hedge_ends VALUES (x);
+	END IF;
+	RETURN x;
+END; $$ LANGUAGE plpgsql VOLATILE;
+SELECT create_distributed_function('slow_read(int)');
+SET citus.hedged_read_delay TO '500ms';
+SELECT x, slow_read(x) FROM hedged_test WHERE x = 1;
+SELECT count(*), sum(slow_read(x)) FROM hedged_test;
+RESET citus.hedged_read_delay;
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT CASE WHEN is_called THEN last_value ELSE 0 END
+  FROM adaptive_executor.hedge_starts
+$$);
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM adaptive_executor.hedge_ends
+$$);
+SELECT run_command_on_workers($$DROP TABLE adaptive_executor.hedge_ends$$);
+SELECT run_command_on_workers($$DROP SEQUENCE adaptive_executor.hedge_starts$$);
+DROP TABLE hedged_test;
+
+
+-- cached results are not used once a table of the query is modified
+SET citus.query_result_cache_ttl TO '1h';
+SELECT count(*), sum(x) FROM test;
+SELECT count(*), sum(x) FROM test;
+INSERT INTO test VALUES (5, 2);
+SELECT count(*), sum(x) FROM test;
+BEGIN;
+DELETE FROM test WHERE x = 5;
+SELECT count(*), sum(x) FROM test;
+COMMIT;
+SELECT count(*), sum(x) FROM test;
+-- queries that only differ in a constant have their own results
+SELECT count(*) FROM test WHERE y = 2;
+SELECT count(*) FROM test WHERE y = 3;
+SELECT count(*) FROM test WHERE y = 2;
+RESET citus.query_result_cache_ttl;
+
+-- send a single query per node for multi-shard reads
+SET citus.enable_task_coalescing TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT y, count(*), min(x), max(x) FROM test GROUP BY y ORDER BY y;
+SELECT x, y FROM test ORDER BY x DESC LIMIT 3;
+SELECT count(DISTINCT y), sum(x) FROM test WHERE x > 10;
+PREPARE coalesced_select(int) AS SELECT count(*), sum(y) FROM test WHERE x > $1;
+EXECUTE coalesced_select(5);
+EXECUTE coalesced_select(15);
+DEALLOCATE coalesced_select;
+ROLLBACK;
+RESET citus.enable_task_coalescing;
+
+-- combine the partial aggregates of the shards of a node on the node
+SET citus.enable_node_preaggregation TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT y, count(*), min(x), max(x) FROM test GROUP BY y ORDER BY y;
+SELECT y, avg(x), bool_and(x > 4) FROM test WHERE y < 2 GROUP BY y ORDER BY y;
+SELECT count(DISTINCT y), sum(x) FROM test WHERE x > 10;
+ROLLBACK;
+RESET citus.enable_node_preaggregation;
+
+-- compress the large values of results that spill to disk
+SET work_mem TO '64kB';
+SET citus.compress_spilled_results TO on;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(4, 20) i;
+SELECT count(*), count(DISTINCT v), sum(length(v))
+FROM (SELECT repeat(x::text, 5000) AS v FROM test WHERE y < 2 ORDER BY x LIMIT 100) s;
+ROLLBACK;
+RESET citus.compress_spilled_results;
+RESET work_mem;
+
+-- return the RETURNING rows of modifications while the tasks still run
+CREATE TABLE returning_test (x int, y int);
+SELECT create_distributed_table('returning_test','x');
+INSERT INTO returning_test SELECT i, i % 3 FROM generate_series(1, 100) i;
+SET citus.enable_streaming_returning TO on;
+WITH updated AS (UPDATE returning_test SET y = y + 1 RETURNING x, y)
+SELECT count(*), sum(x), sum(y) FROM updated;
+UPDATE returning_test SET y = y + 1 WHERE x = 7 RETURNING x, y;
+BEGIN;
+WITH deleted AS (DELETE FROM returning_test WHERE x <= 50 RETURNING x)
+SELECT count(*) FROM deleted;
+SELECT count(*) FROM returning_test;
+ROLLBACK;
+-- rows are still sorted when sort_returning is on
+SET citus.sort_returning TO on;
+UPDATE returning_test SET y = y + 1 WHERE x > 96 RETURNING x, y;
+RESET citus.sort_returning;
+RESET citus.enable_streaming_returning;
+DROP TABLE returning_test;
+
+-- record a span per task when distributed tracing is enabled
+SET citus.enable_distributed_tracing TO on;
+SELECT count(*) >= 0 FROM test;
+RESET citus.enable_distributed_tracing;
+SELECT count(*), count(DISTINCT trace_id), count(DISTINCT span_id), bool_and(succeeded),
+	   bool_and(ready_time <= send_time AND send_time <= end_time)
+FROM citus_recent_spans WHERE pid = pg_backend_pid();
+
+-- the current backend is not waiting in any Citus wait event
+SELECT count(*) FROM citus_wait_events WHERE pid = pg_backend_pid();
+
+-- node statistics count the tasks and the bytes received per node
+SELECT citus_node_stats_reset();
+SELECT count(*) >= 0 FROM test;
+SELECT count(*), sum(tasks) > 0, bool_and(bytes_received > 0), sum(task_failures),
+	   bool_and(array_length(task_latency_histogram, 1) = 17)
+FROM citus_node_stats WHERE tasks > 0;
+
+-- the load of router queries is counted per shard and partition key value
+SET citus.shard_load_stats_sample_rate TO 1.0;
+SELECT citus_shard_load_reset();
+SELECT count(*) >= 0 FROM test WHERE x = 1;
+SELECT count(*) >= 0 FROM test WHERE x = 1;
+SELECT count(*) >= 0 FROM test WHERE x = 2;
+RESET citus.shard_load_stats_sample_rate;
+SELECT partition_key, calls, max_error FROM citus_shard_load
+WHERE logicalrelid = 'test'::regclass AND partition_key IS NOT NULL ORDER BY 1;
+SELECT sum(calls) FROM citus_shard_load
+WHERE logicalrelid = 'test'::regclass AND partition_key IS NULL;
+
+-- progress is only shown while executions run
+SET citus.query_progress_min_task_count TO 1;
+SELECT count(*) >= 0 FROM test;
+RESET citus.query_progress_min_task_count;
+SELECT count(*) FROM citus_stat_progress_query WHERE pid = pg_backend_pid();
+
+-- tasks share the parallel workers of the node, which has 2 of the 4 shards
+SET citus.parallel_workers_per_node TO 6;
+SET min_parallel_table_scan_size TO 0;
+SELECT x, y, current_setting('max_parallel_workers_per_gather') AS parallel_workers
+FROM test ORDER BY x;
+-- the result of SET LOCAL is skipped along with that of the coalesced BEGIN
+SET citus.enable_coalesced_begin TO on;
+BEGIN;
+SELECT x, y, current_setting('max_parallel_workers_per_gather') AS parallel_workers
+FROM test ORDER BY x;
+ROLLBACK;
+RESET citus.enable_coalesced_begin;
+RESET min_parallel_table_scan_size;
+RESET citus.parallel_workers_per_node;
+
 DROP SCHEMA adaptive_executor CASCADE;
@@ -61,4 +61,20 @@ WHERE
 
 SET citus.enable_single_hash_repartition_joins TO OFF;
 
+-- frequent join values are spread over several partitions
+CREATE TABLE skewed_left (a int, b int);
+CREATE TABLE skewed_right (a int, b int);
+SELECT create_distributed_table('skewed_left', 'a');
+SELECT create_distributed_table('skewed_right', 'a');
+INSERT INTO skewed_left SELECT i, CASE WHEN i % 2 = 0 THEN 1 ELSE i END FROM generate_series(1,1000) i;
+INSERT INTO skewed_right SELECT i, i % 100 FROM generate_series(1,1000) i;
+ANALYZE skewed_left, skewed_right;
+
+SELECT count(*) FROM skewed_left l, skewed_right r WHERE l.b = r.b;
+SET citus.repartition_join_skew_threshold TO 0.1;
+SELECT count(*) FROM skewed_left l, skewed_right r WHERE l.b = r.b;
+RESET citus.repartition_join_skew_threshold;
+
+DROP TABLE skewed_left, skewed_right;
+
 DROP SCHEMA adaptive_executor CASCADE;
@@ -12,3 +12,7 @@ SELECT master_add_node('localhost', 12345, groupid => 0) = :master_nodeid;
 
 -- start_metadata_sync_to_node() for coordinator should raise a notice
 SELECT start_metadata_sync_to_node('localhost', :master_port);
+
+-- setting the coordinator host to its current address keeps the same node
+SELECT master_set_coordinator_host('localhost', :master_port);
+SELECT nodeid = :master_nodeid FROM pg_dist_node WHERE groupid = 0;
@@ -0,0 +1,44 @@
+CREATE SCHEMA approximate_aggregates;
+SET search_path TO approximate_aggregates;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 4756000;
+CREATE TABLE t (a int, b double precision, c text);
+SELECT create_distributed_table('t', 'a');
+INSERT INTO t SELECT i, i, (i % 1000)::text FROM generate_series(1, 10000) i;
+
+-- HyperLogLog sketches are built on the workers and merged on the coordinator
+SELECT approx_count_distinct(a) BETWEEN 9000 AND 11000 AS close FROM t;
+SELECT approx_count_distinct(c) BETWEEN 950 AND 1050 AS close FROM t;
+SELECT octet_length(citus_hll_add_agg(a)) FROM t;
+SELECT citus_hll_cardinality(citus_hll_add_agg(a, 14)) BETWEEN 9500 AND 10500 AS close FROM t;
+SELECT citus_hll_cardinality(citus_hll_union_agg(sketch)) BETWEEN 9000 AND 11000 AS close
+FROM (SELECT c, citus_hll_add_agg(a) AS sketch FROM t GROUP BY c) s;
+SELECT citus_hll_cardinality(NULL);
+SELECT citus_hll_add_agg(a, 3) FROM t;
+
+-- t-digests are exact at the extremes and for small inputs
+SELECT citus_tdigest_percentile(citus_tdigest_add_agg(b), 0) AS min,
+       citus_tdigest_percentile(citus_tdigest_add_agg(b), 1) AS max
+FROM t;
+SELECT citus_tdigest_percentile(citus_tdigest_add_agg(b), 0.5) AS median FROM t WHERE a <= 10;
+SELECT abs(citus_tdigest_percentile(citus_tdigest_add_agg(b), 0.5) - 5000.5) < 50 AS close FROM t;
+SELECT abs(citus_tdigest_percentile(citus_tdigest_add_agg(b), 0.99) - 9900.01) < 50 AS close FROM t;
+SELECT octet_length(citus_tdigest_add_agg(b)) < 10000 AS small FROM t;
+SELECT citus_tdigest_percentile(citus_tdigest_add_agg(b), 1.5) FROM t;
+
+-- approximate count(distinct) without the hll extension
+SET citus.count_distinct_error_rate TO 0.01;
+SET citus.count_distinct_approximation_method TO 'builtin';
+SELECT count(distinct c) BETWEEN 950 AND 1050 AS close FROM t;
+SELECT a % 2 AS parity, count(distinct c) BETWEEN 475 AND 525 AS close FROM t GROUP BY 1 ORDER BY 1;
+RESET citus.count_distinct_approximation_method;
+RESET citus.count_distinct_error_rate;
+
+-- approximate percentile_cont
+SET citus.enable_approximate_percentiles TO on;
+SELECT abs(percentile_cont(0.9) WITHIN GROUP (ORDER BY b) - 9000.1) < 50 AS close FROM t;
+SELECT percentile_cont(0.5) WITHIN GROUP (ORDER BY b) AS median FROM t WHERE a <= 10;
+SELECT a % 2 AS parity, percentile_cont(0) WITHIN GROUP (ORDER BY b) AS min FROM t GROUP BY 1 ORDER BY 1;
+RESET citus.enable_approximate_percentiles;
+DROP SCHEMA approximate_aggregates CASCADE;
@@ -0,0 +1,57 @@
+CREATE SCHEMA binary_protocol;
+SET search_path TO binary_protocol;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 4754000;
+
+CREATE TABLE t (id int, num numeric, txt text, arr int[], flag bool);
+SELECT create_distributed_table('t', 'id');
+INSERT INTO t VALUES (1, 1.5, 'one', '{1}', true), (2, NULL, 'two', '{1,2}', false), (3, 3.25, NULL, NULL, NULL);
+
+SET citus.enable_binary_protocol TO on;
+
+-- multi-shard queries
+SELECT * FROM t ORDER BY id;
+SELECT count(*), sum(num), max(txt) FROM t;
+SELECT id, array_length(arr, 1) FROM t ORDER BY 2, 1;
+
+-- router queries and RETURNING
+SELECT txt, flag FROM t WHERE id = 2;
+UPDATE t SET num = num * 2 WHERE id = 1 RETURNING id, num;
+DELETE FROM t WHERE id = 3 RETURNING *;
+
+-- prepared statements with parameters
+PREPARE select_by_id(int) AS SELECT id, num, txt FROM t WHERE id = $1;
+EXECUTE select_by_id(1);
+EXECUTE select_by_id(2);
+
+-- parameters are sent in binary format, except for custom types
+CREATE TYPE mood AS ENUM ('happy', 'sad');
+CREATE TABLE params (id int, data bytea, doc jsonb, nums bigint[], m mood, moods mood[]);
+SELECT create_distributed_table('params', 'id');
+PREPARE insert_params(int, bytea, jsonb, bigint[], mood, mood[]) AS
+	INSERT INTO params VALUES ($1, $2, $3, $4, $5, $6) RETURNING id, data, doc, nums, m, moods;
+EXECUTE insert_params(1, '\x00ff10', '{"a": [1, 2]}', '{1,NULL,3}', 'happy', '{happy,sad}');
+EXECUTE insert_params(2, NULL, NULL, NULL, NULL, NULL);
+EXECUTE insert_params(3, '', '[]', '{}', 'sad', '{}');
+EXECUTE insert_params(4, '\xdeadbeef', '"text"', '{9223372036854775807}', 'sad', '{sad}');
+EXECUTE insert_params(5, '\x', '{}', '{-1}', 'happy', '{}');
+EXECUTE insert_params(6, '\x01', 'null', '{0}', 'happy', NULL);
+EXECUTE insert_params(7, '\x02', '{"b": null}', '{7}', 'sad', '{sad,happy}');
+PREPARE select_params(int, jsonb, bigint[]) AS
+	SELECT id, data FROM params WHERE id = $1 AND doc = $2 AND nums = $3;
+EXECUTE select_params(1, '{"a": [1, 2]}', '{1,NULL,3}');
+EXECUTE select_params(4, '"text"', '{9223372036854775807}');
+SELECT * FROM params ORDER BY id;
+
+-- workers report the base type of domain columns
+SELECT id, id::information_schema.cardinal_number AS card,
+       txt::information_schema.character_data AS chars
+FROM t ORDER BY id;
+
+-- results should be the same in text format
+RESET citus.enable_binary_protocol;
+SELECT * FROM t ORDER BY id;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA binary_protocol CASCADE;
@@ -0,0 +1,81 @@
+--
+-- COLUMNAR
+--
+-- Tests the columnar table access method, which requires PostgreSQL 12
+SHOW server_version \gset
+SELECT substring(:'server_version', '\d+')::int > 11 AS server_version_above_eleven
+\gset
+\if :server_version_above_eleven
+\else
+\q
+\endif
+
+SET citus.next_shard_id TO 2960000;
+SET citus.shard_replication_factor TO 1;
+CREATE SCHEMA columnar_test;
+SET search_path TO columnar_test;
+
+CREATE TABLE test_columnar (id int, val text) USING columnar;
+INSERT INTO test_columnar SELECT i, 'value ' || i FROM generate_series(1, 100) i;
+SELECT count(*), sum(id) FROM test_columnar WHERE id > 50;
+
+-- rows of rolled back subtransactions are discarded
+BEGIN;
+INSERT INTO test_columnar VALUES (101, 'value 101');
+SAVEPOINT s1;
+INSERT INTO test_columnar VALUES (102, 'value 102');
+ROLLBACK TO SAVEPOINT s1;
+SELECT count(*) FROM test_columnar;
+COMMIT;
+SELECT count(*) FROM test_columnar;
+
+-- columnar tables are append-only
+UPDATE test_columnar SET val = 'updated' WHERE id = 1;
+DELETE FROM test_columnar WHERE id = 1;
+
+-- the columnar scan only reads the columns that the query uses
+EXPLAIN (costs off) SELECT sum(id) FROM test_columnar;
+EXPLAIN (costs off) SELECT count(*) FROM test_columnar WHERE val = 'value 1';
+SET citus.enable_columnar_scan TO off;
+EXPLAIN (costs off) SELECT sum(id) FROM test_columnar;
+RESET citus.enable_columnar_scan;
+
+-- chunk groups whose min/max values refute the quals are skipped
+SET citus.columnar_chunk_group_row_count TO 1000;
+CREATE TABLE test_chunk_groups (id int, val text) USING columnar;
+INSERT INTO test_chunk_groups SELECT i, 'value ' || i FROM generate_series(1, 10000) i;
+RESET citus.columnar_chunk_group_row_count;
+EXPLAIN (analyze, costs off, timing off, summary off)
+SELECT count(*) FROM test_chunk_groups WHERE id > 9500;
+SELECT count(*), min(val) FROM test_chunk_groups WHERE id > 9500;
+
+-- reading the table in a transaction writes its stripe, which then aborts
+CREATE TABLE test_vacuum (id int) USING columnar;
+INSERT INTO test_vacuum SELECT generate_series(1, 100);
+BEGIN;
+INSERT INTO test_vacuum SELECT generate_series(101, 200);
+SELECT count(*) FROM test_vacuum;
+ROLLBACK;
+SELECT pg_relation_size('test_vacuum') AS size_before_vacuum \gset
+
+-- VACUUM marks the aborted stripe and only counts the committed rows
+VACUUM test_vacuum;
+SELECT reltuples FROM pg_class WHERE oid = 'test_vacuum'::regclass;
+SELECT count(*), sum(id) FROM test_vacuum;
+
+-- VACUUM FULL leaves out the aborted stripe
+VACUUM FULL test_vacuum;
+SELECT pg_relation_size('test_vacuum') < :size_before_vacuum AS vacuum_full_shrinks;
+SELECT count(*), sum(id) FROM test_vacuum;
+
+-- columnar tables can be distributed, and their shards are columnar as well
+SELECT create_distributed_table('test_columnar', 'id');
+SELECT count(*), max(val) FROM test_columnar WHERE id <= 10;
+SELECT run_command_on_workers($$
+	SELECT string_agg(DISTINCT amname, ',')
+	FROM pg_class JOIN pg_am ON (relam = pg_am.oid)
+	WHERE relname LIKE 'test_columnar_%'
+$$);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_test CASCADE;
@@ -175,6 +175,16 @@ ROLLBACK;
 
 RESET citus.enable_cte_inlining;
 
+-- connections to the local node use a Unix-domain socket when enabled
+ALTER SYSTEM SET citus.use_unix_socket_for_local_node TO on;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SELECT nodeport = :master_port AS local_node, bool_and(result::bool) AS over_unix_socket
+FROM run_command_on_placements('test', 'SELECT inet_client_addr() IS NULL')
+GROUP BY 1 ORDER BY 1;
+ALTER SYSTEM RESET citus.use_unix_socket_for_local_node;
+SELECT pg_reload_conf();
+
 DELETE FROM test;
 DROP TABLE test;
 DROP TABLE dist_table;
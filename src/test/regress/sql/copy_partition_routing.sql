@@ -0,0 +1,76 @@
+CREATE SCHEMA copy_partition_routing;
+SET search_path TO copy_partition_routing;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 4757000;
+
+CREATE TABLE events (key int, day date, value int DEFAULT -1) PARTITION BY RANGE (day);
+CREATE TABLE events_jan PARTITION OF events
+	FOR VALUES FROM ('2020-01-01') TO ('2020-02-01');
+CREATE TABLE events_feb PARTITION OF events
+	FOR VALUES FROM ('2020-02-01') TO ('2020-03-01');
+CREATE TABLE events_other PARTITION OF events DEFAULT;
+SELECT create_distributed_table('events', 'key');
+
+-- rows are sent to the shards of the partitions, NULL keys to the parent shard
+SET client_min_messages TO DEBUG1;
+COPY events FROM STDIN WITH (FORMAT csv);
+1,2020-01-05,10
+2,2020-01-31,20
+3,2020-02-01,30
+4,2020-02-29,40
+5,2020-03-01,50
+6,,60
+\.
+RESET client_min_messages;
+SELECT key, value FROM events_jan ORDER BY key;
+SELECT key, value FROM events_feb ORDER BY key;
+SELECT key, value FROM events_other ORDER BY key;
+
+-- omitted columns get the defaults of the partitioned table
+ALTER TABLE events_jan ALTER COLUMN value SET DEFAULT 0;
+SET client_min_messages TO DEBUG1;
+COPY events (key, day) FROM STDIN WITH (FORMAT csv);
+7,2020-01-10
+\.
+RESET client_min_messages;
+SELECT key, value FROM events_jan WHERE key = 7;
+
+-- without routing, the workers find the partitions
+SET citus.enable_copy_partition_routing TO off;
+SET client_min_messages TO DEBUG1;
+COPY events FROM STDIN WITH (FORMAT csv);
+8,2020-02-10,80
+9,2021-01-01,90
+\.
+RESET client_min_messages;
+RESET citus.enable_copy_partition_routing;
+SELECT key, value FROM events_feb ORDER BY key;
+SELECT key, value FROM events_other ORDER BY key;
+
+-- list partitioning
+CREATE TABLE orders (key int, status text, amount int) PARTITION BY LIST (status);
+CREATE TABLE orders_open PARTITION OF orders FOR VALUES IN ('new', 'paid');
+CREATE TABLE orders_closed PARTITION OF orders FOR VALUES IN ('shipped');
+SELECT create_distributed_table('orders', 'key');
+SET client_min_messages TO DEBUG1;
+COPY orders FROM STDIN WITH (FORMAT csv);
+1,new,10
+2,paid,20
+3,shipped,30
+4,new,40
+\.
+RESET client_min_messages;
+SELECT key, amount FROM orders_open ORDER BY key;
+SELECT key, amount FROM orders_closed ORDER BY key;
+
+-- rows that fit no partition go to the parent shard, where the worker rejects them
+\set VERBOSITY terse
+COPY orders FROM STDIN WITH (FORMAT csv);
+5,returned,50
+\.
+\set VERBOSITY default
+SELECT count(*) FROM orders;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_partition_routing CASCADE;
@@ -84,6 +84,26 @@ WITH shard_1 AS (
 SELECT count(*), sum(x) FROM all_rows;
 ROLLBACK;
 
+-- the same, with the fragments fetched over several tasks per node pair
+BEGIN;
+SET LOCAL citus.fragment_transfer_parallelism TO 4;
+CREATE TABLE distributed_result_info AS
+  SELECT * FROM redistribute_task_list_results('test', $$ SELECT * FROM source_table $$, 'target_table');
+SELECT * FROM distributed_result_info ORDER BY shardid;
+WITH shard_1 AS (
+    SELECT t.* FROM colocated_with_target, (
+      SELECT * FROM read_intermediate_results('{test_from_4213581_to_0,test_from_4213582_to_0}'::text[], 'binary') AS res (x int)) t
+      WHERE colocated_with_target.a = 1
+), shard_2 AS (
+    SELECT t.* FROM colocated_with_target, (
+      SELECT * FROM read_intermediate_results('{test_from_4213582_to_1,test_from_4213583_to_1}'::text[], 'binary') AS res (x int)) t
+      WHERE colocated_with_target.a = 2
+), all_rows AS (
+    (SELECT * FROM shard_1) UNION (SELECT * FROM shard_2)
+)
+SELECT count(*), sum(x) FROM all_rows;
+ROLLBACK;
+
 DROP TABLE source_table, target_table, colocated_with_target;
 
 --
@@ -131,6 +131,28 @@ SELECT get_global_active_transactions();
 
 
 SELECT citus.mitmproxy('conn.allow()');
+
+-- skip a node right away once its last 2 connection attempts timed out
+ALTER SYSTEM SET citus.node_failure_threshold TO 2;
+ALTER SYSTEM SET citus.node_probe_interval TO '2s';
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SELECT citus.mitmproxy('conn.delay(500)');
+SELECT count(*) FROM single_replicatated;
+SELECT count(*) FROM single_replicatated;
+-- the node is now skipped without waiting, reads of replicated tables fail over
+-- and modifications error out
+SELECT count(*) FROM single_replicatated;
+SELECT count(*) FROM products;
+UPDATE products SET price = price + 1;
+-- once the probe interval passed, a query connects to the node again
+SELECT citus.mitmproxy('conn.allow()');
+SELECT pg_sleep(2);
+SELECT count(*) FROM single_replicatated;
+ALTER SYSTEM RESET citus.node_failure_threshold;
+ALTER SYSTEM RESET citus.node_probe_interval;
+SELECT pg_reload_conf();
+
 SET citus.node_connection_timeout TO DEFAULT;
 DROP SCHEMA fail_connect CASCADE;
 SET search_path TO default;
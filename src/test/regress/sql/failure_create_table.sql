@@ -43,8 +43,9 @@ SELECT citus.mitmproxy('conn.allow()');
 SELECT count(*) FROM pg_dist_shard;
 SELECT run_command_on_workers($$SELECT count(*) FROM information_schema.tables WHERE table_schema = 'failure_create_table' and table_name LIKE 'test_table%' ORDER BY 1$$);
 
--- Now, kill the connection after sending create table command with worker_apply_shard_ddl_command UDF
-SELECT citus.mitmproxy('conn.onQuery(query="SELECT worker_apply_shard_ddl_command").after(1).kill()');
+-- Now, kill the connection on sending create table commands with worker_apply_shard_ddl_command UDF,
+-- which are sent for all shards on the worker at once
+SELECT citus.mitmproxy('conn.onQuery(query="SELECT worker_apply_shard_ddl_command").kill()');
 SELECT create_distributed_table('test_table','id');
 
 SELECT citus.mitmproxy('conn.allow()');
@@ -0,0 +1,60 @@
+CREATE SCHEMA fast_path_plan_cache;
+SET search_path TO fast_path_plan_cache;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 4755000;
+
+CREATE TABLE kv (key int, value text);
+SELECT create_distributed_table('kv', 'key');
+INSERT INTO kv VALUES (1, 'one'), (2, 'two'), (3, 'three');
+
+SET citus.fast_path_plan_cache_size TO 2;
+
+-- the second and third query reuse the plan of the first one
+SET client_min_messages TO DEBUG1;
+SELECT value FROM kv WHERE key = 1;
+SELECT value FROM kv WHERE key = 2;
+SELECT value FROM kv WHERE key = 30000;
+RESET client_min_messages;
+
+-- modifications
+UPDATE kv SET value = 'updated' WHERE key = 3 RETURNING *;
+UPDATE kv SET value = 'again' WHERE key = 1 RETURNING *;
+DELETE FROM kv WHERE key = 2;
+SELECT * FROM kv WHERE key = 2;
+
+-- cached plans are invalidated when the table changes
+SELECT value FROM kv WHERE key = 1;
+SET client_min_messages TO DEBUG1;
+SELECT value FROM kv WHERE key = 3;
+RESET client_min_messages;
+CREATE INDEX kv_value_idx ON kv (value);
+SET client_min_messages TO DEBUG1;
+SELECT value FROM kv WHERE key = 3;
+RESET client_min_messages;
+ALTER TABLE kv ADD COLUMN extra int DEFAULT 5;
+SELECT * FROM kv WHERE key = 1;
+SELECT * FROM kv WHERE key = 3;
+
+-- more query shapes than fit in the cache
+SELECT key FROM kv WHERE key = 1;
+SELECT extra FROM kv WHERE key = 3;
+SELECT count(*) FROM kv WHERE key = 3;
+SELECT key FROM kv WHERE key = 3;
+
+-- the distribution key value is sent as a parameter with parameterized shard queries
+SET citus.enable_parameterized_shard_queries TO on;
+SELECT * FROM kv WHERE key = 1;
+SELECT * FROM kv WHERE key = 3;
+SELECT * FROM kv WHERE key = 2;
+UPDATE kv SET extra = extra + 1 WHERE key = 3 RETURNING *;
+UPDATE kv SET extra = extra + 1 WHERE key = 3 RETURNING *;
+RESET citus.enable_parameterized_shard_queries;
+
+-- results should be the same without the cache
+RESET citus.fast_path_plan_cache_size;
+SELECT * FROM kv WHERE key = 1;
+SELECT * FROM kv ORDER BY key;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA fast_path_plan_cache CASCADE;
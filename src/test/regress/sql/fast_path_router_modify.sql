@@ -173,4 +173,68 @@ RESET citus.enable_fast_path_router_planner;
 
 RESET client_min_messages;
 RESET citus.log_remote_commands;
+-- keep the parameters in the shard queries of prepared statements
+SET citus.enable_parameterized_shard_queries TO on;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE parameterized_fast_path(key int, value_1 int, value_2 text);
+SELECT create_distributed_table('parameterized_fast_path', 'key');
+INSERT INTO parameterized_fast_path SELECT i, i, i::text FROM generate_series(1, 10) i;
+
+PREPARE parameterized_select(int, text) AS
+	SELECT value_1 FROM parameterized_fast_path WHERE key = $1 AND value_2 <> $2;
+PREPARE parameterized_update(int, int) AS
+	UPDATE parameterized_fast_path SET value_1 = value_1 + $2 WHERE key = $1 RETURNING value_1;
+
+EXECUTE parameterized_select(1, 'x');
+EXECUTE parameterized_select(2, 'x');
+EXECUTE parameterized_select(3, 'x');
+EXECUTE parameterized_select(4, 'x');
+EXECUTE parameterized_select(5, 'x');
+EXECUTE parameterized_select(6, 'x');
+EXECUTE parameterized_select(6, '6');
+EXECUTE parameterized_select(NULL, 'x');
+
+EXECUTE parameterized_update(1, 10);
+EXECUTE parameterized_update(2, 10);
+EXECUTE parameterized_update(3, 10);
+EXECUTE parameterized_update(4, 10);
+EXECUTE parameterized_update(5, 10);
+EXECUTE parameterized_update(6, 10);
+EXECUTE parameterized_update(6, 10);
+
+SELECT key, value_1 FROM parameterized_fast_path WHERE key <= 6 ORDER BY key;
+
+-- repeated executions over the same connection use worker prepared statements
+SET citus.enable_worker_prepared_statements TO on;
+EXECUTE parameterized_select(6, 'x');
+EXECUTE parameterized_select(6, 'x');
+EXECUTE parameterized_select(6, 'x');
+EXECUTE parameterized_update(6, 10);
+EXECUTE parameterized_update(6, 10);
+EXECUTE parameterized_update(6, 10);
+
+-- changing the result type does not break prepared statements on the workers
+ALTER TABLE parameterized_fast_path ALTER COLUMN value_1 TYPE bigint;
+EXECUTE parameterized_select(6, 'x');
+EXECUTE parameterized_select(6, 'x');
+RESET citus.enable_worker_prepared_statements;
+
+DEALLOCATE parameterized_select;
+DEALLOCATE parameterized_update;
+DROP TABLE parameterized_fast_path;
+RESET citus.enable_parameterized_shard_queries;
+
+-- INSERTs into replicated shards can run on all placements in parallel
+SET citus.enable_parallel_replica_writes TO on;
+INSERT INTO modify_fast_path_replication_2 VALUES (100, 1, 'parallel');
+BEGIN;
+INSERT INTO modify_fast_path_replication_2 VALUES (101, 1, 'parallel');
+INSERT INTO modify_fast_path_replication_2 VALUES (100, 2, 'parallel');
+COMMIT;
+SELECT nodeport, sum(result::int) FROM run_command_on_placements(
+	'modify_fast_path_replication_2',
+	'SELECT count(*) FROM %s WHERE value_2 = ''parallel''')
+GROUP BY nodeport ORDER BY nodeport;
+RESET citus.enable_parallel_replica_writes;
+
 DROP SCHEMA fast_path_router_modify CASCADE;
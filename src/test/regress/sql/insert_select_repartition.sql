@@ -100,6 +100,18 @@ FROM
 ON CONFLICT(col_1) DO UPDATE SET col_2 = EXCLUDED.col_2;
 RESET client_min_messages;
 
+-- sort the upserted rows on the conflict target
+SET citus.sort_insert_select_upserts TO on;
+SET client_min_messages TO DEBUG2;
+INSERT INTO target_table
+SELECT
+	col_1, col_2
+FROM
+	source_table
+ON CONFLICT(col_1) DO UPDATE SET col_2 = EXCLUDED.col_2;
+RESET client_min_messages;
+RESET citus.sort_insert_select_upserts;
+
 SELECT * FROM target_table ORDER BY 1;
 
 DROP TABLE source_table, target_table;
@@ -559,6 +571,22 @@ DO UPDATE SET
  cardinality = enriched.cardinality + excluded.cardinality,
  sum = enriched.sum + excluded.sum;
 
+-- append-distributed target with non-overlapping shard ranges
+CREATE TABLE append_source_table(a int, b int);
+SELECT create_distributed_table('append_source_table', 'a');
+INSERT INTO append_source_table SELECT i, i * i FROM generate_series(1, 10) i;
+
+CREATE TABLE append_target_table(a int, b int);
+SELECT create_distributed_table('append_target_table', 'a', 'append');
+CALL public.create_range_partitioned_shards('append_target_table', '{0,6}','{5,50}');
+
+SET client_min_messages TO DEBUG1;
+INSERT INTO append_target_table SELECT a, b FROM append_source_table;
+RESET client_min_messages;
+
+SELECT * FROM append_target_table ORDER BY a;
+SELECT shardid, result FROM run_command_on_placements('append_target_table', 'select count(*) from %s') ORDER BY shardid;
+
 -- clean-up
 SET client_min_messages TO WARNING;
 DROP SCHEMA insert_select_repartition CASCADE;
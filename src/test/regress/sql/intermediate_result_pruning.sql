@@ -61,6 +61,17 @@ SELECT
 FROM
 	some_values_1 JOIN ref_table USING (key);
 
+-- with a single seed node, the coordinator only sends the
+-- result to one worker, which forwards it to the other
+SET citus.intermediate_result_seed_node_count TO 1;
+WITH some_values_1 AS
+	(SELECT key, random() FROM table_1 WHERE value IN ('3', '4'))
+SELECT
+	count(*)
+FROM
+	some_values_1 JOIN ref_table USING (key);
+RESET citus.intermediate_result_seed_node_count;
+
 
 -- a similar query as above, but this time use the CTE inside
 -- another CTE
@@ -628,6 +639,23 @@ inserts AS (
 
 SET citus.task_assignment_policy to DEFAULT;
 SET client_min_messages TO DEFAULT;
+-- a CTE that is only joined on the distribution column is split over the nodes
+CREATE TABLE partitioned_result (key int, value int);
+SELECT create_distributed_table('partitioned_result', 'key');
+INSERT INTO partitioned_result SELECT i, i FROM generate_series(1, 100) i;
+WITH keys AS (
+  SELECT key FROM partitioned_result ORDER BY key LIMIT 50
+)
+SELECT count(*), sum(value)
+FROM partitioned_result JOIN keys ON (partitioned_result.key = keys.key);
+SET citus.enable_partitioned_intermediate_results TO off;
+WITH keys AS (
+  SELECT key FROM partitioned_result ORDER BY key LIMIT 50
+)
+SELECT count(*), sum(value)
+FROM partitioned_result JOIN keys ON (partitioned_result.key = keys.key);
+RESET citus.enable_partitioned_intermediate_results;
+DROP TABLE partitioned_result;
 DROP TABLE table_1, table_2, table_3, ref_table, accounts, stats, range_partitioned;
 DROP SCHEMA intermediate_result_pruning;
 
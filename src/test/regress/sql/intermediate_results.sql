@@ -255,4 +255,107 @@ END;
 -- results should have been deleted after transaction commit
 SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
 
+-- compressed intermediate results
+SET citus.compress_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('compressed', $$SELECT s, 'hello-'||s FROM generate_series(1,10000) s$$);
+SELECT count(*), sum(x), count(DISTINCT y) FROM read_intermediate_result('compressed', 'binary') AS res (x int, y text);
+SELECT * FROM read_intermediate_result('compressed', 'binary') AS res (x int, y text) ORDER BY x LIMIT 3;
+-- results that do not compress well are stored as is
+SELECT create_intermediate_result('incompressible', $$SELECT md5(s::text) FROM generate_series(1,3) s$$);
+SELECT * FROM read_intermediate_result('incompressible', 'binary') AS res (m text);
+-- compressed results can be read when compression is disabled
+SET LOCAL citus.compress_intermediate_results TO off;
+SELECT count(*), sum(x) FROM read_intermediate_result('compressed', 'binary') AS res (x int, y text);
+SELECT create_intermediate_result('uncompressed', $$SELECT s, 'hello-'||s FROM generate_series(1,10000) s$$);
+SELECT count(*), sum(x) FROM read_intermediate_result('uncompressed', 'binary') AS res (x int, y text);
+END;
+
+-- compressed results are sent to workers and fetched back as is
+BEGIN;
+SELECT broadcast_intermediate_result('compressed_squares', 'SELECT s, s*s FROM generate_series(1,10000) s');
+SELECT fetch_intermediate_results(ARRAY['compressed_squares']::text[], 'localhost', :worker_1_port) > 0 AS fetched;
+SELECT count(*), sum(x2) FROM read_intermediate_result('compressed_squares', 'binary') AS res (x int, x2 int);
+END;
+RESET citus.compress_intermediate_results;
+
+-- link an intermediate result under another result id
+BEGIN;
+SELECT create_intermediate_result('link_source', 'SELECT s FROM generate_series(1,5) s');
+SELECT link_intermediate_result('link_source', 'link_target');
+SELECT sum(s) FROM read_intermediate_result('link_target', 'binary') AS res (s int);
+END;
+
+-- identical subplans reuse the earlier result until data is modified
+CREATE TABLE cached_results (a int, b int);
+SELECT create_distributed_table('cached_results', 'a');
+INSERT INTO cached_results SELECT s, s % 5 FROM generate_series(1,20) s;
+SET citus.enable_subplan_result_cache TO on;
+BEGIN;
+SET LOCAL client_min_messages TO DEBUG1;
+SELECT count(*) FROM cached_results WHERE b IN (SELECT b FROM cached_results ORDER BY b LIMIT 2);
+SELECT count(*) FROM cached_results WHERE b IN (SELECT b FROM cached_results ORDER BY b LIMIT 2);
+INSERT INTO cached_results VALUES (21, 0);
+SELECT count(*) FROM cached_results WHERE b IN (SELECT b FROM cached_results ORDER BY b LIMIT 2);
+END;
+RESET citus.enable_subplan_result_cache;
+
+-- intermediate results are read one record at a time
+SET citus.enable_intermediate_result_scan TO on;
+BEGIN;
+SELECT create_intermediate_result('streamed', 'SELECT s, s*s FROM generate_series(1,100) s');
+EXPLAIN (COSTS OFF) SELECT * FROM read_intermediate_result('streamed', 'binary') AS res (x int, x2 int) WHERE x2 > 9000;
+SELECT * FROM read_intermediate_result('streamed', 'binary') AS res (x int, x2 int) WHERE x2 > 9000 ORDER BY x;
+SELECT count(*), sum(x2) FROM read_intermediate_results(ARRAY['streamed', 'notexistingfile', 'streamed'], 'binary') AS res (x int, x2 int);
+END;
+RESET citus.enable_intermediate_result_scan;
+
+-- columnar intermediate results skip unused columns and blocks
+SET citus.columnar_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('columnar', $$SELECT s, 'hello-'||s, CASE WHEN s % 2 = 0 THEN s END FROM generate_series(1,30000) s$$);
+SELECT count(*), sum(x), count(y), count(z) FROM read_intermediate_result('columnar', 'binary') AS res (x int, y text, z int);
+SET LOCAL citus.enable_intermediate_result_scan TO on;
+EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF) SELECT y FROM read_intermediate_result('columnar', 'binary') AS res (x int, y text, z int) WHERE x > 25000;
+SELECT y FROM read_intermediate_result('columnar', 'binary') AS res (x int, y text, z int) WHERE x BETWEEN 24999 AND 25001 ORDER BY x;
+SELECT count(*) FROM read_intermediate_result('columnar', 'binary') AS res (x int, y text, z int) WHERE z IS NULL AND x <= 10;
+END;
+RESET citus.columnar_intermediate_results;
+
+-- small subplan results are inlined into the worker queries
+SELECT * FROM read_inline_intermediate_result(E'1\tone\n2\t\\N\n') AS res (x int, y text);
+SET citus.max_inline_intermediate_result_size TO '1kB';
+BEGIN;
+SET LOCAL client_min_messages TO DEBUG1;
+SELECT count(*) FROM cached_results WHERE b IN (SELECT b FROM cached_results ORDER BY b LIMIT 2);
+END;
+WITH escaped AS (SELECT a, CASE WHEN a % 2 = 0 THEN E'back\\slash ''quoted''' END AS t FROM cached_results ORDER BY a LIMIT 4)
+SELECT a, t FROM cached_results JOIN escaped USING (a) ORDER BY a;
+-- larger results are still sent as files
+WITH padded AS (SELECT a, repeat('x', 100) AS pad FROM cached_results ORDER BY a LIMIT 100)
+SELECT count(*), sum(length(pad)) FROM cached_results JOIN padded USING (a);
+RESET citus.max_inline_intermediate_result_size;
+
+-- the coordinator stripes result files across its scratch directories
+SELECT string_to_array(current_setting('citus.intermediate_result_directories'), ',')
+	   AS scratch_dirs \gset
+BEGIN;
+SELECT sum(create_intermediate_result('striped_' || i,
+									  format('SELECT generate_series(1, %s)', i)))
+FROM generate_series(1, 20) i;
+SELECT count(*), sum(x) FROM read_intermediate_results(
+	ARRAY(SELECT 'striped_' || i FROM generate_series(1, 20) i), 'binary') AS res (x int);
+SELECT count(DISTINCT n) AS scratch_dirs, count(*) AS result_files
+FROM unnest(:'scratch_dirs'::text[]) WITH ORDINALITY AS scratch (dir, n),
+	 pg_ls_dir(dir || '/pgsql_job_cache', true, false) xact_dir,
+	 pg_ls_dir(dir || '/pgsql_job_cache/' || xact_dir, true, false) result_file
+WHERE result_file LIKE 'striped\_%';
+END;
+-- the result directories are removed from all scratch directories
+SELECT count(DISTINCT n) AS scratch_dirs, count(*) AS result_files
+FROM unnest(:'scratch_dirs'::text[]) WITH ORDINALITY AS scratch (dir, n),
+	 pg_ls_dir(dir || '/pgsql_job_cache', true, false) xact_dir,
+	 pg_ls_dir(dir || '/pgsql_job_cache/' || xact_dir, true, false) result_file
+WHERE result_file LIKE 'striped\_%';
+
 DROP SCHEMA intermediate_results CASCADE;
@@ -1046,6 +1046,19 @@ INSERT INTO event_responses VALUES (16, 666, 'maybe'), (17, 777, 'no')
 ON CONFLICT (event_id, user_id)
 DO UPDATE SET response = EXCLUDED.response RETURNING *;
 
+-- remote tasks of read-only queries can be sent before local tasks are executed
+RESET client_min_messages;
+RESET citus.enable_local_execution;
+RESET citus.enable_fast_path_router_planner;
+SELECT count(*) AS event_response_count FROM event_responses \gset
+SET citus.enable_concurrent_local_execution TO on;
+SELECT count(*) = :event_response_count FROM event_responses;
+BEGIN;
+SELECT count(*) > 0 FROM event_responses WHERE event_id = 16;
+SELECT count(*) = :event_response_count FROM event_responses;
+COMMIT;
+RESET citus.enable_concurrent_local_execution;
+
 \c - - - :master_port
 
 SET client_min_messages TO ERROR;
@@ -64,12 +64,17 @@ SELECT master_copy_shard_placement(
 
 ALTER TABLE data DROP CONSTRAINT distfk;
 
--- replicate shard that contains key-1
+-- replicate shard that contains key-1, copying the co-located shards in parallel
+SET citus.max_parallel_shard_copies TO 4;
 SELECT master_copy_shard_placement(
            get_shard_id_for_distribution_column('data', 'key-1'),
            'localhost', :worker_2_port,
            'localhost', :worker_1_port,
            do_repair := false);
+RESET citus.max_parallel_shard_copies;
+
+-- no shard copies are in progress once the copy is done
+SELECT count(*) FROM citus_shard_copy_progress();
 
 -- forcefully mark the old replica as inactive
 UPDATE pg_dist_shard_placement SET shardstate = 3
@@ -204,6 +204,22 @@ SELECT * FROM get_shardid_test_table1_540007;
 -- test non-existing value
 SELECT get_shard_id_for_distribution_column('get_shardid_test_table1', 4);
 
+-- test the shard map and looking up many values at once
+SELECT shard_id, shard_min_value, shard_max_value FROM citus_shard_map()
+WHERE table_name = 'get_shardid_test_table1'::regclass ORDER BY shard_min_value;
+SELECT value_index, shard_id,
+       node_id IN (SELECT nodeid FROM pg_dist_node JOIN pg_dist_placement USING (groupid)
+                   WHERE shardid = shard_id) AS node_has_placement
+FROM citus_shard_map_lookup('get_shardid_test_table1', ARRAY[1, 2, 3, 4, NULL])
+ORDER BY value_index;
+
+-- test preloading the metadata cache, relations that are missing or not Citus tables are skipped
+SET citus.metadata_cache_preload_tables TO 'get_shardid_test_table1, pg_class, "missing table"';
+SELECT citus_preload_metadata_cache();
+SET citus.metadata_cache_preload_tables TO '*';
+SELECT citus_preload_metadata_cache() = (SELECT count(*) FROM pg_dist_partition) AS preloaded_all;
+RESET citus.metadata_cache_preload_tables;
+
 -- test array type
 SET citus.shard_count TO 4;
 CREATE TABLE get_shardid_test_table2(column1 text[], column2 int);
@@ -587,3 +587,68 @@ SELECT true AS valid FROM explain_xml($$
   )
   SELECT * FROM result JOIN series ON (s = l_quantity) JOIN orders_hash_part ON (s = o_orderkey)
 $$);
+
+-- Test showing the time spent in each planning phase
+CREATE FUNCTION explain_planning_phases(query text)
+RETURNS jsonb
+AS $BODY$
+DECLARE
+  result jsonb;
+BEGIN
+  EXECUTE format('EXPLAIN (FORMAT JSON, SUMMARY) %s', query) INTO result;
+  RETURN result->0->'Plan'->'Distributed Query'->'Planning Phases';
+END;
+$BODY$ LANGUAGE plpgsql;
+
+SELECT explain_planning_phases('SELECT l_orderkey FROM lineitem WHERE l_orderkey = 1') IS NULL;
+SET citus.explain_planning_phases TO on;
+SELECT explain_planning_phases('SELECT l_orderkey FROM lineitem WHERE l_orderkey = 1') ? 'Router Planner';
+SELECT explain_json('SELECT l_orderkey FROM lineitem WHERE l_orderkey = 1')->0->'Plan'->'Distributed Query' ? 'Planning Phases';
+RESET citus.explain_planning_phases;
+
+-- Test cumulative planning statistics
+SELECT citus_planning_stats_reset();
+SET citus.track_planning_stats TO on;
+SELECT l_orderkey FROM lineitem WHERE l_orderkey = 0;
+RESET citus.track_planning_stats;
+SELECT calls, total_time >= router_planner_time FROM citus_planning_stats;
+SELECT citus_planning_stats_reset();
+SELECT count(*) FROM citus_planning_stats;
+DROP FUNCTION explain_planning_phases(text);
+
+-- Test worker pool statistics (with TIMING FALSE for consistent output)
+SET citus.explain_worker_pools TO on;
+EXPLAIN (COSTS FALSE, ANALYZE TRUE, TIMING FALSE, SUMMARY FALSE)
+	SELECT l_quantity FROM lineitem WHERE l_orderkey = 1 AND l_linenumber = 1;
+RESET citus.explain_worker_pools;
+
+-- Test capturing the worker plans while EXPLAIN ANALYZE runs the tasks
+CREATE FUNCTION explain_analyze_tasks_shown(query text)
+RETURNS text
+AS $BODY$
+DECLARE
+  result jsonb;
+BEGIN
+  EXECUTE format('EXPLAIN (ANALYZE, FORMAT JSON) %s', query) INTO result;
+  RETURN result->0->'Plan'->'Distributed Query'->'Job'->>'Tasks Shown';
+END;
+$BODY$ LANGUAGE plpgsql;
+
+SELECT explain_analyze_tasks_shown('SELECT l_orderkey FROM lineitem WHERE l_quantity < 0');
+SET citus.explain_analyze_single_pass TO on;
+SELECT explain_analyze_tasks_shown('SELECT l_orderkey FROM lineitem WHERE l_quantity < 0');
+SELECT explain_analyze_tasks_shown('SELECT l_orderkey FROM lineitem WHERE l_orderkey = 1');
+RESET citus.explain_analyze_single_pass;
+DROP FUNCTION explain_analyze_tasks_shown(text);
+
+-- Test citus_stat_statements statistics per partition key value and worker
+SELECT citus_stat_statements_reset();
+SET citus.stat_statements_track TO 'all';
+SELECT l_quantity FROM lineitem WHERE l_orderkey = 1 AND l_linenumber = 1;
+SELECT l_quantity FROM lineitem WHERE l_orderkey = 1 AND l_linenumber = 1;
+RESET citus.stat_statements_track;
+SELECT citus_executor_name(executor::int), partition_key, calls, plans, rows, remote_bytes
+FROM citus_query_stats();
+SELECT sum(calls), sum(tasks), sum(rows), sum(remote_bytes) FROM citus_query_stats_per_worker();
+SELECT citus_stat_statements_reset();
+SELECT count(*) FROM citus_query_stats();
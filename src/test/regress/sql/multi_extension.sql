@@ -310,6 +310,27 @@ BEGIN
 END;
 $$;
 
+-- the daemon of a database that is not used and has no nodes to check for
+-- deadlocks stops, and the next session that uses Citus starts it again
+ALTER SYSTEM SET citus.maintenance_daemon_idle_timeout TO '100ms';
+ALTER SYSTEM SET citus.recover_2pc_interval TO -1;
+SELECT pg_reload_conf();
+DO $$
+BEGIN
+    FOR i IN 1 .. 200 LOOP
+        EXIT WHEN test_daemon.maintenance_daemon_died('another');
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;
+$$;
+SELECT test_daemon.maintenance_daemon_died('another');
+\c another
+SELECT datname, current_database() FROM test.maintenance_worker();
+\c regression
+ALTER SYSTEM RESET citus.maintenance_daemon_idle_timeout;
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+SELECT pg_reload_conf();
+
 -- drop the database and see that the daemon is dead
 DROP DATABASE another;
 SELECT
@@ -341,7 +362,30 @@ CREATE EXTENSION citus;
 ALTER FUNCTION assign_distributed_transaction_id(initiator_node_identifier integer, transaction_number bigint, transaction_stamp timestamp with time zone)
 RENAME TO dummy_assign_function;
 
-\c - - - :master_port
+-- without metadata on the workers, distributed transactions need a session in
+-- the database, so the daemon of an idle database with workers stops as well
+\c regression - - :master_port
+ALTER SYSTEM SET citus.maintenance_daemon_idle_timeout TO '100ms';
+ALTER SYSTEM SET citus.recover_2pc_interval TO -1;
+SELECT pg_reload_conf();
+DO $$
+BEGIN
+    FOR i IN 1 .. 200 LOOP
+        PERFORM pg_stat_clear_snapshot();
+        EXIT WHEN NOT EXISTS (SELECT 1 FROM pg_stat_activity
+                              WHERE application_name = 'Citus Maintenance Daemon'
+                              AND datname = 'another');
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;
+$$;
+SELECT count(*) FROM pg_stat_activity
+WHERE application_name = 'Citus Maintenance Daemon' AND datname = 'another';
+ALTER SYSTEM RESET citus.maintenance_daemon_idle_timeout;
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+SELECT pg_reload_conf();
+
+\c another - - :master_port
 SET citus.shard_replication_factor to 1;
 -- create_distributed_table command should fail
 CREATE TABLE t1(a int, b int);
@@ -347,3 +347,39 @@ WHERE o_orderkey IN (1, 2)
 SET citus.task_executor_type TO DEFAULT;
 
 DROP TABLE lineitem_hash_partitioned;
+
+-- IN lists that are the only restriction on the distribution column are
+-- pruned in a single pass over the array
+CREATE TABLE array_pruning (key int, value int);
+SELECT create_distributed_table('array_pruning', 'key');
+INSERT INTO array_pruning SELECT i, i FROM generate_series(1, 100) i;
+
+SELECT count(*), sum(key) FROM array_pruning
+	WHERE key IN (1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20);
+SELECT count(*), sum(key) FROM array_pruning WHERE key = ANY ('{1,1,1}');
+SELECT count(*), sum(key) FROM array_pruning WHERE key = ANY ('{1,2,NULL,101}');
+SELECT count(*), sum(key) FROM array_pruning WHERE key IN (1, 2, 3) AND value > 1;
+SELECT count(*), sum(key) FROM array_pruning WHERE key IN (1, 2, 3) AND key > 1;
+SELECT count(*), sum(key) FROM array_pruning WHERE key IN (1, 2, 3) OR value = 5;
+
+DROP TABLE array_pruning;
+
+-- short ranges on the distribution column are pruned by hashing their values
+SET citus.max_range_pruning_values TO 10;
+SELECT coordinator_plan($Q$
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey BETWEEN 1 AND 2;
+$Q$);
+SELECT coordinator_plan($Q$
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey >= 3 AND o_orderkey < 5;
+$Q$);
+SELECT coordinator_plan($Q$
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey BETWEEN 1 AND 100;
+$Q$);
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey BETWEEN 1 AND 3;
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey > 3 AND o_orderkey < 4;
+SELECT count(*) FROM orders_hash_partitioned
+	WHERE o_orderkey BETWEEN 2 AND 3 OR o_orderkey = 4;
+RESET citus.max_range_pruning_values;
@@ -45,8 +45,11 @@ SET client_min_messages = ERROR; -- avoid version dependant warning about WAL
 CREATE INDEX lineitem_orderkey_hash_index ON lineitem USING hash (l_partkey);
 CREATE UNIQUE INDEX index_test_range_index_a ON index_test_range(a);
 CREATE UNIQUE INDEX index_test_range_index_a_b ON index_test_range(a,b);
+-- build one shard index at a time per worker
+SET citus.max_index_build_pool_size TO 1;
 CREATE UNIQUE INDEX index_test_hash_index_a ON index_test_hash(a);
 CREATE UNIQUE INDEX index_test_hash_index_a_b ON index_test_hash(a,b);
+RESET citus.max_index_build_pool_size;
 CREATE UNIQUE INDEX index_test_hash_index_a_b_partial ON index_test_hash(a,b) WHERE c IS NOT NULL;
 CREATE UNIQUE INDEX index_test_range_index_a_b_partial ON index_test_range(a,b) WHERE c IS NOT NULL;
 CREATE UNIQUE INDEX index_test_hash_index_a_b_c ON index_test_hash(a) INCLUDE (b,c);
@@ -171,6 +174,11 @@ CREATE INDEX CONCURRENTLY ith_b_idx ON index_test_hash(b);
 -- the failure results in an INVALID index
 SELECT indisvalid AS "Index Valid?" FROM pg_index WHERE indexrelid='ith_b_idx'::regclass;
 
+-- retrying with IF NOT EXISTS only builds the index on placements that lack a valid one
+CREATE INDEX CONCURRENTLY IF NOT EXISTS ith_b_idx ON index_test_hash(b);
+SELECT indisvalid AS "Index Valid?" FROM pg_index WHERE indexrelid='ith_b_idx'::regclass;
+SELECT result AS "Shard Index Valid?", count(*) FROM run_command_on_placements('index_test_hash', $$SELECT bool_and(indisvalid) FROM pg_index WHERE indexrelid = to_regclass(replace('%s', 'index_test_hash', 'ith_b_idx'))$$) GROUP BY result;
+
 -- we can clean it up and recreate with an DROP IF EXISTS
 DROP INDEX CONCURRENTLY IF EXISTS ith_b_idx;
 CREATE INDEX CONCURRENTLY ith_b_idx ON index_test_hash(b);
@@ -315,4 +315,32 @@ INSERT INTO target_table SELECT * FROM cte_2 ON CONFLICT(col_1) DO UPDATE SET co
 SELECT * FROM target_table ORDER BY 1;
 
 RESET client_min_messages;
+
+-- rollups only aggregate the rows that were added since their last refresh
+CREATE TABLE page_events(event_id bigserial, page_id int);
+SELECT create_distributed_table('page_events', 'page_id');
+CREATE TABLE page_rollup(page_id int primary key, event_count bigint);
+SELECT create_distributed_table('page_rollup', 'page_id', colocate_with := 'page_events');
+
+SELECT citus_create_rollup('page_rollup', 'page_events', 'event_id', $$
+	INSERT INTO page_rollup
+	SELECT page_id, count(*) FROM page_events
+	WHERE event_id > $1 AND event_id <= $2
+	GROUP BY page_id
+	ON CONFLICT (page_id) DO UPDATE
+	SET event_count = page_rollup.event_count + EXCLUDED.event_count
+$$);
+SELECT citus_create_rollup('page_id_rollup', 'page_events', 'page_id', 'SELECT 1');
+
+INSERT INTO page_events (page_id) SELECT s % 3 FROM generate_series(1, 10) s;
+SELECT citus_refresh_rollup('page_rollup');
+INSERT INTO page_events (page_id) SELECT s % 3 FROM generate_series(1, 5) s;
+SELECT citus_refresh_rollup('page_rollup');
+SELECT citus_refresh_rollup('page_rollup');
+SELECT * FROM page_rollup ORDER BY 1;
+SELECT rollup_name, source_table, last_aggregated_id FROM pg_dist_rollup;
+
+SELECT citus_drop_rollup('page_rollup');
+DROP TABLE page_events, page_rollup;
+
 DROP SCHEMA on_conflict CASCADE;
@@ -135,6 +135,26 @@ JOIN (
      WHERE event_type = 5
 ) AS some_users ON (some_users.user_id = bar.user_id);
 
+-- Validate that the cost based join order repartitions the smaller table, while
+-- the rule based join order repartitions whichever table comes first
+SET citus.enable_single_hash_repartition_joins TO on;
+CREATE TABLE big_table (a int, b int);
+SELECT create_distributed_table('big_table', 'a');
+CREATE TABLE small_table (a int, b int);
+SELECT create_distributed_table('small_table', 'a');
+UPDATE pg_dist_placement SET shardlength = 1000000000
+WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'big_table'::regclass);
+UPDATE pg_dist_placement SET shardlength = 1000
+WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'small_table'::regclass);
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM small_table s, big_table b WHERE s.a = b.b AND s.b = b.a;
+SET citus.enable_cost_based_join_order TO on;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM small_table s, big_table b WHERE s.a = b.b AND s.b = b.a;
+RESET citus.enable_cost_based_join_order;
+RESET citus.enable_single_hash_repartition_joins;
+DROP TABLE big_table, small_table;
+
 -- Reset client logging level to its previous value
 SET client_min_messages TO NOTICE;
 
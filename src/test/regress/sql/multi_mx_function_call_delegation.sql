@@ -248,6 +248,10 @@ select mx_call_func(2, 0) from mx_call_dist_table_1;
 select mx_call_func(2, 0) where mx_call_func(0, 2) = 0;
 select mx_call_func(2, 0), mx_call_func(0, 2);
 
+-- batches of calls over constant rows are grouped by worker and pushed down
+select mx_call_func(2, y) from (values (1), (2), (3), (4)) v(y);
+select mx_call_func(x, y) from unnest(array[2, 2, 2], array[5, 6, 7]) u(x, y);
+
 DO $$ BEGIN perform mx_call_func_tbl(40); END; $$;
 SELECT * FROM mx_call_dist_table_1 WHERE id >= 40 ORDER BY id, val;
 
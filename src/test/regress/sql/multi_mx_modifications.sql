@@ -304,3 +304,11 @@ INSERT INTO app_analytics_events_mx (app_id, name) VALUES (103, 'Mynt') RETURNIN
 SELECT 1 FROM setval('app_analytics_events_mx_id_seq'::regclass, :last_value);
 ALTER SEQUENCE app_analytics_events_mx_id_seq
   MINVALUE :min_value MAXVALUE :max_value;
+
+-- let the workers evaluate nextval, which gives values from their own range
+\c - - - :master_port
+SET citus.enable_sequence_evaluation_on_workers TO on;
+INSERT INTO app_analytics_events_mx (app_id, name) VALUES (104, 'Lyft'), (105, 'Uber');
+SELECT app_id, id >= (1::bigint << 48) AS generated_on_worker
+  FROM app_analytics_events_mx WHERE app_id IN (104, 105) ORDER BY app_id;
+RESET citus.enable_sequence_evaluation_on_workers;
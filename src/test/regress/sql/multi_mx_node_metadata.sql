@@ -108,9 +108,15 @@ COMMIT;
 SELECT 1 FROM master_update_node(:nodeid_1, 'localhost', 23456);
 SELECT nodeid, hasmetadata, metadatasynced FROM pg_dist_node ORDER BY nodeid;
 
+-- worker_2 only needs the new location of worker 1 to get back in sync
+SELECT nodeid, command FROM pg_dist_metadata_delta ORDER BY deltaid;
+
 -- Make the node writeable.
 SELECT mark_node_readonly('localhost', :worker_2_port, FALSE);
 SELECT wait_until_metadata_sync();
+SELECT count(*) FROM pg_dist_metadata_delta;
+SELECT job_name, last_start_time IS NOT NULL AS ran
+FROM citus_maintenance_jobs WHERE job_name = 'metadata_sync';
 
 -- Mark the node readonly again, so the following master_update_node warns
 SELECT mark_node_readonly('localhost', :worker_2_port, TRUE);
@@ -1166,6 +1166,24 @@ DROP TABLE partitioning_test, partitioning_test_2008, partitioning_test_2009,
 
 DROP SCHEMA partitioning_schema CASCADE;
 RESET SEARCH_PATH;
+-- test pruning partitions of distributed partitioned tables on the coordinator
+CREATE TABLE partitioning_pruning_test (id int, time date) PARTITION BY RANGE (time);
+CREATE TABLE partitioning_pruning_test_2009 PARTITION OF partitioning_pruning_test FOR VALUES FROM ('2009-01-01') TO ('2010-01-01');
+CREATE TABLE partitioning_pruning_test_2010 PARTITION OF partitioning_pruning_test FOR VALUES FROM ('2010-01-01') TO ('2011-01-01');
+SELECT create_distributed_table('partitioning_pruning_test', 'id');
+INSERT INTO partitioning_pruning_test VALUES (1, '2009-06-01'), (2, '2010-06-01'), (3, '2010-07-01');
+SET citus.enable_coordinator_partition_pruning TO on;
+SET client_min_messages TO DEBUG1;
+-- only the 2010 partition matches
+SELECT count(*) FROM partitioning_pruning_test WHERE time >= '2010-03-01';
+SELECT count(*) FROM partitioning_pruning_test WHERE time BETWEEN '2009-01-01' AND '2009-12-31' AND id > 0;
+-- both partitions match
+SELECT count(*) FROM partitioning_pruning_test WHERE time >= '2009-03-01';
+-- filters on other columns do not prune
+SELECT count(*) FROM partitioning_pruning_test WHERE id = 2 OR time = '2010-06-01';
+RESET client_min_messages;
+RESET citus.enable_coordinator_partition_pruning;
+DROP TABLE partitioning_pruning_test;
 DROP TABLE IF EXISTS
 	partitioning_hash_test,
 	partitioning_hash_join_test,
@@ -38,6 +38,21 @@ CREATE FUNCTION print_sorted_shard_intervals(regclass)
 	AS 'citus'
 	LANGUAGE C STRICT;
 
+CREATE FUNCTION citus_bench_prune(regclass, text, int,
+								  OUT ns_per_op float8, OUT bytes_per_op bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION citus_bench_plan(text, int,
+								 OUT ns_per_op float8, OUT bytes_per_op bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION citus_bench_deparse(text, int,
+									OUT ns_per_op float8, OUT bytes_per_op bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
 -- ===================================================================
 -- test shard pruning functionality
 -- ===================================================================
@@ -113,6 +128,15 @@ SELECT print_sorted_shard_intervals('pruning_range');
 UPDATE pg_dist_shard set shardminvalue = NULL, shardmaxvalue = NULL WHERE shardid = 800007;
 SELECT print_sorted_shard_intervals('pruning_range');
 
+-- shards with overlapping ranges are pruned using the running maximum of max values
+UPDATE pg_dist_shard SET shardminvalue = 'a', shardmaxvalue = 'm' WHERE shardid = 800004;
+UPDATE pg_dist_shard SET shardminvalue = 'c', shardmaxvalue = 'd' WHERE shardid = 800005;
+UPDATE pg_dist_shard SET shardminvalue = 'e', shardmaxvalue = 'z' WHERE shardid = 800006;
+SELECT print_sorted_shard_intervals('pruning_range');
+SELECT prune_using_single_value('pruning_range', 'c');
+SELECT prune_using_single_value('pruning_range', 'f');
+SELECT prune_using_single_value('pruning_range', 'n');
+
 -- ===================================================================
 -- test pruning using values whose types are coerced
 -- ===================================================================
@@ -177,5 +201,26 @@ EXECUTE coerce_numeric_2(1);
 EXECUTE coerce_numeric_2(1);
 
 
+-- micro-benchmarks of pruning, planning and deparsing only check that they measure
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_prune('pruning', $$species = 'tomato'$$, 100);
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_prune('pruning', $$species IN ('tomato', 'rose') AND plant_id > 5$$, 100);
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_plan($$SELECT * FROM pruning WHERE species = 'tomato'$$, 100);
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_plan($$SELECT count(*) FROM pruning$$, 100);
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_deparse($$SELECT species, count(*) FROM pruning GROUP BY 1$$, 10);
+SELECT ns_per_op > 0 AS timed, bytes_per_op > 0 AS allocated
+FROM citus_bench_deparse($$INSERT INTO pruning VALUES ('tomato', now(), 1)$$, 10);
+
+-- errors for tables and queries that are not distributed
+CREATE TABLE local_pruning (species text);
+SELECT * FROM citus_bench_prune('local_pruning', $$species = 'tomato'$$, 1);
+SELECT * FROM citus_bench_deparse($$SELECT * FROM local_pruning$$, 1);
+SELECT * FROM citus_bench_plan($$SELECT count(*) FROM pruning$$, 0);
+DROP TABLE local_pruning;
+
 SET search_path TO public;
 DROP SCHEMA prune_shard_list CASCADE;
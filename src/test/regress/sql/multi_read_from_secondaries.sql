@@ -110,4 +110,17 @@ INSERT INTO dest_table (a, b)
 
 \c "dbname=regression options='-c\ citus.use_secondary_nodes=never'"
 UPDATE pg_dist_node SET noderole = 'primary';
+
+-- with lag_aware, writes are allowed and reads fall back to primaries when
+-- no secondary is known to have replayed them
+\c "dbname=regression options='-c\ citus.use_secondary_nodes=lag_aware'"
+INSERT INTO dest_table (a, b) VALUES (3, 3);
+SELECT a FROM dest_table ORDER BY 1;
+SELECT a FROM dest_table WHERE a = 3;
+BEGIN;
+INSERT INTO dest_table (a, b) VALUES (4, 4);
+SELECT count(*) FROM dest_table WHERE a = 4;
+COMMIT;
+
+\c "dbname=regression options='-c\ citus.use_secondary_nodes=never'"
 DROP TABLE source_table, dest_table;
@@ -48,3 +48,18 @@ SET citus.task_executor_type TO 'task-tracker';
 SELECT * FROM (SELECT median(ARRAY[1,2,sum(l_suppkey)]) as median, count(*)
     	  FROM lineitem GROUP BY l_partkey) AS a
   WHERE median > 2;
+
+-- with repartitioned aggregation, a GROUP BY on a column other than the
+-- distribution column is planned as a repartitioned subquery
+RESET citus.task_executor_type;
+SET citus.enable_repartitioned_aggregation TO on;
+
+SELECT l_suppkey, count(*), count(DISTINCT l_partkey), sum(l_quantity)
+  FROM lineitem GROUP BY l_suppkey
+  ORDER BY 2 DESC, 1 LIMIT 5;
+
+SELECT l_suppkey, count(*)
+  FROM lineitem GROUP BY l_suppkey HAVING count(*) >= 6
+  ORDER BY l_suppkey;
+
+RESET citus.enable_repartitioned_aggregation;
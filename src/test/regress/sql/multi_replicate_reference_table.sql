@@ -586,10 +586,13 @@ SELECT 1 FROM master_add_inactive_node('localhost', :worker_2_port);
 
 SELECT count(*) - :ref_table_placements FROM pg_dist_shard_placement WHERE shardid = :ref_table_shard;
 
+-- reference tables are copied in parallel
+SET citus.max_parallel_shard_copies TO 4;
 SELECT 1 FROM master_activate_node('localhost', :worker_2_port);
 
 SELECT count(*) - :ref_table_placements FROM pg_dist_shard_placement WHERE shardid = :ref_table_shard;
 
+RESET citus.max_parallel_shard_copies;
 SELECT min(result) = max(result) AS consistent FROM run_command_on_placements('ref_table', 'SELECT sum(a) FROM %s');
 
 -- test that metadata is synced when master_copy_shard_placement replicates
@@ -365,6 +365,37 @@ SELECT a.author_id as first_author, b.word_count as second_word_count
 	WHERE a.author_id = 2 and a.author_id = b.author_id
 	LIMIT 3;
 
+-- joins through subqueries prune with the filters on the distribution key of
+-- the relations they are joined with, including IN lists
+SELECT count(*)
+	FROM articles_hash a,
+		 (SELECT author_id FROM articles_hash WHERE word_count > 10000) b
+	WHERE a.author_id IN (1, 3) AND a.author_id = b.author_id;
+
+-- a filter in a correlated subquery does not restrict the outer query
+SELECT count(*)
+	FROM articles_hash a
+	WHERE NOT EXISTS (SELECT 1 FROM articles_hash b
+					  WHERE b.author_id = a.author_id AND b.author_id IN (1, 3));
+
+-- the nullable side of an outer join is not pruned with the filters of the
+-- other side, and filters on the nullable side do not restrict the other side
+SELECT count(*)
+	FROM articles_hash a LEFT JOIN articles_hash b ON (a.author_id = b.author_id)
+	WHERE a.author_id IN (1, 3);
+
+SELECT count(*)
+	FROM articles_hash a LEFT JOIN articles_hash b
+		ON (a.author_id = b.author_id AND b.author_id IN (1, 3));
+
+-- relations in subqueries with aggregates are not pruned
+SELECT count(*)
+	FROM articles_hash a,
+		 (SELECT author_id, max(word_count) AS max_word_count
+		  FROM articles_hash GROUP BY author_id) b
+	WHERE a.author_id IN (1, 3) AND a.author_id = b.author_id AND
+		  a.word_count = b.max_word_count;
+
 -- single shard select with limit is router plannable
 SELECT *
 	FROM articles_hash
@@ -322,6 +322,22 @@ SELECT *
 	FROM articles_hash
 	WHERE author_id = 68719476736; -- this is bigint
 
+-- identical filters on the dist. key can go through fast-path
+SELECT *
+	FROM articles_hash
+	WHERE author_id = 1 and author_id = 1;
+
+-- single element arrays can go through fast-path
+SELECT *
+	FROM articles_hash
+	WHERE author_id = ANY('{1}');
+
+-- cannot go through fast-path due to
+-- filters on different values of the dist. key
+SELECT *
+	FROM articles_hash
+	WHERE author_id = 1 and author_id = 2;
+
 -- cannot go through fast-path due to
 -- multiple filters on the dist. key
 SELECT *
@@ -27,3 +27,29 @@ SELECT * FROM source_table_xyz ORDER BY 1;
 
 DROP TABLE source_table_xyz;
 DROP TYPE composite_key_type;
+
+-- multi-row INSERTs with enough rows are executed through COPY
+CREATE TABLE insert_via_copy (key int PRIMARY KEY, value text DEFAULT 'default', id bigserial);
+SELECT create_distributed_table('insert_via_copy', 'key');
+
+SET citus.multi_row_insert_copy_threshold TO 3;
+INSERT INTO insert_via_copy (key, value) VALUES (1, 'a'), (2, 'b'), (3, DEFAULT), (4, 'd');
+
+-- below the threshold, the rows are sent as INSERTs
+INSERT INTO insert_via_copy (key, value) VALUES (5, 'e'), (6, 'f');
+
+-- ON CONFLICT cannot be expressed in COPY
+INSERT INTO insert_via_copy (key, value) VALUES (1, 'x'), (2, 'y'), (7, 'g')
+ON CONFLICT DO NOTHING;
+
+SELECT key, value, id FROM insert_via_copy ORDER BY key;
+
+-- the rows are visible in the transaction and roll back with it
+BEGIN;
+INSERT INTO insert_via_copy (key) VALUES (10), (11), (12);
+SELECT count(*) FROM insert_via_copy;
+ROLLBACK;
+SELECT count(*) FROM insert_via_copy;
+
+RESET citus.multi_row_insert_copy_threshold;
+DROP TABLE insert_via_copy;
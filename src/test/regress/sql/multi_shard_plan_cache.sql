@@ -0,0 +1,65 @@
+CREATE SCHEMA multi_shard_plan_cache;
+SET search_path TO multi_shard_plan_cache;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 4756000;
+
+CREATE TABLE events (key int, value int);
+SELECT create_distributed_table('events', 'key');
+CREATE TABLE details (key int, detail text);
+SELECT create_distributed_table('details', 'key', colocate_with => 'events');
+INSERT INTO events SELECT i, i * 10 FROM generate_series(1, 8) i;
+INSERT INTO details VALUES (1, 'one'), (2, 'two'), (5, 'five');
+
+SET citus.multi_shard_plan_cache_size TO 2;
+
+-- only the shards of the given keys are queried after the first execution
+PREPARE in_list(int, int) AS
+	SELECT key, value FROM events WHERE key IN ($1, $2) ORDER BY key;
+EXECUTE in_list(1, 2);
+EXECUTE in_list(3, 4);
+EXECUTE in_list(5, 6);
+EXECUTE in_list(7, 8);
+EXECUTE in_list(1, 8);
+EXECUTE in_list(1, 1);
+EXECUTE in_list(100, 200);
+
+-- parameters that do not prune are sent to all shards
+PREPARE aggregate(int) AS SELECT count(*), sum(value) FROM events WHERE value > $1;
+EXECUTE aggregate(0);
+EXECUTE aggregate(30);
+EXECUTE aggregate(50);
+EXECUTE aggregate(70);
+EXECUTE aggregate(80);
+EXECUTE aggregate(10);
+EXECUTE aggregate(-1);
+
+-- tables on the inner side of outer joins do not prune
+PREPARE outer_join(int, int) AS
+	SELECT e.key, d.detail FROM events e LEFT JOIN details d USING (key)
+	WHERE e.key IN ($1, $2) ORDER BY 1;
+EXECUTE outer_join(1, 3);
+EXECUTE outer_join(2, 4);
+EXECUTE outer_join(5, 6);
+EXECUTE outer_join(7, 8);
+EXECUTE outer_join(1, 2);
+EXECUTE outer_join(3, 5);
+EXECUTE outer_join(6, 7);
+
+-- cached plans are invalidated when a table changes
+ALTER TABLE events ADD COLUMN extra int DEFAULT 3;
+PREPARE with_extra(int, int) AS
+	SELECT key, extra FROM events WHERE key IN ($1, $2) ORDER BY key;
+EXECUTE with_extra(1, 2);
+EXECUTE with_extra(3, 4);
+EXECUTE in_list(1, 2);
+EXECUTE aggregate(40);
+
+-- results should be the same without the cache
+RESET citus.multi_shard_plan_cache_size;
+EXECUTE in_list(5, 6);
+EXECUTE aggregate(40);
+EXECUTE outer_join(1, 3);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA multi_shard_plan_cache CASCADE;
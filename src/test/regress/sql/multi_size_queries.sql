@@ -36,6 +36,13 @@ SELECT citus_table_size('customer_copy_hash'),
        citus_table_size('customer_copy_hash'),
        citus_table_size('supplier');
 
+-- The exact mode always asks the workers, it matches the default mode when
+-- the shard size cache is disabled
+SELECT citus_table_size('customer_copy_hash', exact := true),
+       citus_relation_size('customer_copy_hash', exact := true),
+       citus_total_relation_size('supplier', exact := true) =
+       citus_total_relation_size('supplier');
+
 CREATE INDEX index_1 on customer_copy_hash(c_custkey);
 VACUUM (FULL) customer_copy_hash;
 
@@ -78,5 +85,13 @@ SELECT citus_total_relation_size('customer_copy_hash');
 ALTER SYSTEM RESET citus.node_conninfo;
 SELECT pg_reload_conf();
 
+-- Test approximate counts from the statistics of the shards
+VACUUM ANALYZE customer_copy_hash;
+SELECT citus_approximate_count('customer_copy_hash') =
+       (SELECT count(*) FROM customer_copy_hash);
+SET citus.enable_approximate_count TO on;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM customer_copy_hash;
+RESET citus.enable_approximate_count;
+
 DROP INDEX index_1;
 DROP INDEX index_2;
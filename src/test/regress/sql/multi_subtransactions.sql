@@ -305,6 +305,22 @@ COMMIT;
 
 SELECT * FROM researchers WHERE lab_id=10;
 
+-- Savepoints are only sent to connections when they are next used
+BEGIN;
+INSERT INTO researchers VALUES (40, 20, 'Alonzo Church');
+SAVEPOINT s1;
+SAVEPOINT s2;
+INSERT INTO researchers VALUES (41, 20, 'Haskell Curry');
+ROLLBACK TO SAVEPOINT s2;
+RELEASE SAVEPOINT s1;
+SAVEPOINT s3;
+INSERT INTO researchers VALUES (42, 20, 'Dana Scott');
+ROLLBACK TO SAVEPOINT s3;
+INSERT INTO researchers VALUES (43, 20, 'Robin Milner');
+COMMIT;
+
+SELECT * FROM researchers WHERE lab_id=20 ORDER BY id;
+
 -- Clean-up
 DROP TABLE artists;
 DROP TABLE researchers;
@@ -82,9 +82,19 @@ ALTER SEQUENCE standalone_sequence OWNED BY testserialtable.group_id;
 -- an edge case, but it's OK to change an owner to the same distributed table
 ALTER SEQUENCE testserialtable_id_seq OWNED BY testserialtable.id;
 
--- drop distributed table
+-- DDL commands of multiple shards can be sent to a worker in a single query
+SET citus.shard_ddl_batch_size TO 8;
+ALTER TABLE testserialtable ADD COLUMN batched_col integer;
+SELECT DISTINCT success, result FROM run_command_on_placements('testserialtable',
+	'SELECT count(*) FROM pg_attribute WHERE attrelid = ''%s''::regclass AND attname = ''batched_col''');
+RESET citus.shard_ddl_batch_size;
+
+-- drop distributed table, truncating and dropping multiple shards per command
 \c - - - :master_port
+SET citus.shard_ddl_batch_size TO 8;
+TRUNCATE testserialtable;
 DROP TABLE testserialtable;
+RESET citus.shard_ddl_batch_size;
 
 -- verify owned sequence is dropped
 \c - - - :worker_1_port
@@ -256,6 +256,13 @@ $cmd$, 'task_assignment_test_table_2');
 -- different workers
 SELECT count(DISTINCT value) FROM explain_outputs;
 
+-- the adaptive policy picks the placement on the least loaded
+-- worker at execution time, reads should work as usual
+SET citus.task_assignment_policy TO 'adaptive';
+SELECT count(*) FROM task_assignment_replicated_hash;
+SELECT count(*) FROM task_assignment_reference_table;
+SELECT count(*) FROM task_assignment_replicated_hash WHERE test_id = 1;
+
 RESET citus.task_assignment_policy;
 RESET client_min_messages;
 
@@ -0,0 +1,102 @@
+--
+-- MULTI_TENANT_ISOLATION
+--
+-- Tests isolate_tenant_to_new_shard(), master_split_shard() and master_reshard_table()
+SET citus.next_shard_id TO 1990000;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE SCHEMA tenant_isolation;
+SET search_path TO tenant_isolation;
+
+CREATE TABLE orders (tenant_id int, order_id int, PRIMARY KEY (tenant_id, order_id));
+CREATE TABLE line_items (tenant_id int, order_id int, quantity int);
+SELECT create_distributed_table('orders', 'tenant_id');
+SELECT create_distributed_table('line_items', 'tenant_id', colocate_with => 'orders');
+ALTER TABLE line_items ADD CONSTRAINT line_items_order_fkey
+    FOREIGN KEY (tenant_id, order_id) REFERENCES orders;
+
+CREATE TABLE countries (code text PRIMARY KEY);
+SELECT create_reference_table('countries');
+
+INSERT INTO orders SELECT i % 10, i FROM generate_series(1, 100) i;
+INSERT INTO line_items SELECT tenant_id, order_id, 1 FROM orders;
+
+-- only hash distributed tables can be split
+SELECT isolate_tenant_to_new_shard('countries', 'nl');
+
+-- colocated tables need to be isolated together
+SELECT isolate_tenant_to_new_shard('orders', 5);
+
+SELECT isolate_tenant_to_new_shard('orders', 5, 'CASCADE') > 0 AS isolated;
+
+-- both tables have a shard for the tenant only
+SELECT logicalrelid, count(*) AS shard_count,
+       count(*) FILTER (WHERE shardminvalue = shardmaxvalue) AS tenant_shard_count
+FROM pg_dist_shard
+WHERE logicalrelid IN ('orders'::regclass, 'line_items'::regclass)
+GROUP BY logicalrelid ORDER BY logicalrelid;
+
+-- the tenant is in its own shard
+SELECT isolate_tenant_to_new_shard('orders', 5, 'CASCADE');
+
+-- no data was lost and the tables are still colocated
+SELECT count(*) FROM orders;
+SELECT count(*) FROM line_items;
+SELECT count(*) FROM orders JOIN line_items USING (tenant_id, order_id)
+WHERE tenant_id = 5;
+SELECT count(*) FROM orders JOIN line_items USING (tenant_id, order_id);
+
+-- foreign keys are recreated on the new shards
+\set VERBOSITY terse
+INSERT INTO line_items VALUES (5, 1000, 1);
+\set VERBOSITY default
+
+-- split the remaining original shard in the middle of its range
+SELECT master_split_shard(shardid,
+                          ((shardminvalue::bigint + shardmaxvalue::bigint) / 2)::int)
+FROM pg_dist_shard WHERE logicalrelid = 'orders'::regclass
+ORDER BY shardid LIMIT 1;
+
+SELECT logicalrelid, count(*) AS shard_count
+FROM pg_dist_shard
+WHERE logicalrelid IN ('orders'::regclass, 'line_items'::regclass)
+GROUP BY logicalrelid ORDER BY logicalrelid;
+
+SELECT count(*) FROM orders;
+SELECT count(*) FROM orders JOIN line_items USING (tenant_id, order_id);
+
+-- only shards of hash distributed tables can be split
+SELECT master_split_shard(shardid, 0)
+FROM pg_dist_shard WHERE logicalrelid = 'countries'::regclass;
+
+-- reshard a colocation group
+CREATE TABLE events (tenant_id int, event_id int, PRIMARY KEY (tenant_id, event_id));
+CREATE TABLE event_details (tenant_id int, event_id int, detail text);
+SELECT create_distributed_table('events', 'tenant_id', colocate_with => 'none');
+SELECT create_distributed_table('event_details', 'tenant_id', colocate_with => 'events');
+INSERT INTO events SELECT i % 10, i FROM generate_series(1, 100) i;
+INSERT INTO event_details SELECT tenant_id, event_id, 'detail' FROM events;
+
+-- new shards cannot span existing shards, and shards cannot be merged
+SELECT master_reshard_table('events', 3);
+SELECT master_reshard_table('events', 1);
+SELECT master_reshard_table('countries', 4);
+
+SELECT master_reshard_table('events', 4);
+SELECT master_reshard_table('events', 4);
+
+-- the tables have the shards create_distributed_table would have given them
+SELECT logicalrelid, shardminvalue, shardmaxvalue
+FROM pg_dist_shard
+WHERE logicalrelid IN ('events'::regclass, 'event_details'::regclass)
+ORDER BY logicalrelid, shardminvalue::int;
+
+SELECT shardcount FROM pg_dist_colocation
+WHERE colocationid = (SELECT colocationid FROM pg_dist_partition
+                      WHERE logicalrelid = 'events'::regclass);
+
+SELECT count(*) FROM events;
+SELECT count(*) FROM events JOIN event_details USING (tenant_id, event_id);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA tenant_isolation CASCADE;
@@ -105,6 +105,26 @@ SELECT lock_shard_resources(5, ARRAY[-1]);
 -- lock shard metadata: lock nothing
 SELECT lock_shard_resources(5, ARRAY[]::bigint[]);
 
+-- escalate the shard locks of multi-shard modifications to locks on shard ranges
+ALTER SYSTEM SET citus.shard_lock_escalation_threshold TO 3;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+BEGIN;
+UPDATE lockable_table SET name = 'escalated';
+SELECT objsubid, classid, objid, mode FROM pg_locks
+WHERE locktype = 'advisory' AND pid = pg_backend_pid() AND objsubid IN (5, 10)
+ORDER BY objsubid, objid, mode;
+END;
+-- locks on individual shards take an intention lock on their range
+BEGIN;
+SELECT lock_shard_resources(7, ARRAY[999001]);
+SELECT objsubid, classid, objid, mode FROM pg_locks
+WHERE locktype = 'advisory' AND pid = pg_backend_pid() AND objsubid IN (5, 10)
+ORDER BY objsubid, objid, mode;
+END;
+ALTER SYSTEM RESET citus.shard_lock_escalation_threshold;
+SELECT pg_reload_conf();
+
 -- drop table
 DROP TABLE sharded_table;
 DROP TABLE lockable_table;
@@ -143,6 +163,14 @@ ANALYZE dustbunnies;
 VACUUM (FULL) dustbunnies;
 VACUUM ANALYZE dustbunnies;
 
+-- vacuum the shards with the most dead tuples first, one at a time per node
+SET citus.vacuum_shards_by_dead_tuples TO on;
+SET citus.max_vacuum_pool_size TO 1;
+VACUUM dustbunnies;
+ANALYZE dustbunnies;
+RESET citus.vacuum_shards_by_dead_tuples;
+RESET citus.max_vacuum_pool_size;
+
 \c - - :public_worker_1_host :worker_1_port
 -- disable auto-VACUUM for next test
 ALTER TABLE dustbunnies_990002 SET (autovacuum_enabled = false);
@@ -192,6 +220,13 @@ VACUUM dustbunnies;
 ANALYZE dustbunnies;
 SET citus.enable_ddl_propagation to DEFAULT;
 
+-- ANALYZE can refresh the shard sizes used by the cost-based join order
+RESET citus.log_remote_commands;
+SET citus.update_shard_statistics_on_analyze TO on;
+ANALYZE dustbunnies;
+SELECT bool_and(shardlength > 0) FROM pg_dist_placement WHERE shardid = 990002;
+RESET citus.update_shard_statistics_on_analyze;
+
 -- test worker_hash
 SELECT worker_hash(123);
 SELECT worker_hash('1997-08-08'::date);
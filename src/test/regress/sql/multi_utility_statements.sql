@@ -105,6 +105,26 @@ COPY nation TO :'dev_null';
 COPY nation TO STDOUT;
 -- ensure individual cols can be copied out, too
 COPY nation(n_name) TO STDOUT;
+-- shards can also be streamed in parallel, in which case rows are not ordered
+CREATE TABLE copy_to_parallel (key int, value text);
+SELECT create_distributed_table('copy_to_parallel', 'key');
+INSERT INTO copy_to_parallel SELECT i, 'row' FROM generate_series(1, 8) i;
+SET citus.copy_to_parallel_streams TO 4;
+COPY copy_to_parallel(value) TO STDOUT;
+RESET citus.copy_to_parallel_streams;
+DROP TABLE copy_to_parallel;
+-- rows can be sent to the shards in compressed blocks
+CREATE TABLE copy_compressed (key int, value text);
+SELECT create_distributed_table('copy_compressed', 'key');
+SET citus.compress_copy_data TO on;
+INSERT INTO copy_compressed SELECT i, repeat('row', 100) FROM generate_series(1, 1000) i;
+COPY copy_compressed FROM STDIN WITH (format csv);
+1001,one
+1002,two
+\.
+SELECT count(*), count(DISTINCT value) FROM copy_compressed;
+RESET citus.compress_copy_data;
+DROP TABLE copy_compressed;
 
 -- Test that we can create on-commit drop tables, along with changing column names
 
@@ -803,7 +803,58 @@ SELECT create_distributed_table('table1','tenant_id');
 UPDATE table2 SET id=20 FROM table1_view WHERE table1_view.id=table2.id;
 UPDATE table2_p1 SET id=20 FROM table1_view WHERE table1_view.id=table2_p1.id;
 
+-- the filters on the distribution key of the outer query are added
+-- to the subquery when it is recursively planned
+SET client_min_messages TO DEBUG1;
+SET citus.enable_subplan_restriction_pushdown TO on;
+SELECT true AS valid FROM explain_json_2($$
+    SELECT
+        count(*)
+    FROM
+        users_table,
+        (SELECT events_table.user_id FROM events_table, users_table WHERE events_table.value_2 = users_table.value_2) AS foo
+    WHERE
+        users_table.user_id = foo.user_id AND users_table.user_id IN (1, 2);
+$$);
+RESET citus.enable_subplan_restriction_pushdown;
+
+-- subqueries are filtered on the join keys of the intermediate result
+-- of a recursively planned subquery
+SET citus.enable_semi_join_reduction TO on;
+SELECT true AS valid FROM explain_json_2($$
+    SELECT
+        count(*)
+    FROM
+        (SELECT user_id, count(*) AS cnt FROM events_table GROUP BY user_id) AS foo,
+        (SELECT events_table.user_id FROM events_table, users_table WHERE events_table.value_2 = users_table.value_2) AS bar
+    WHERE
+        foo.user_id = bar.user_id;
+$$);
+RESET citus.enable_semi_join_reduction;
+
+-- small distributed tables that are not joined on their distribution
+-- column are broadcast rather than repartitioned
+SET client_min_messages TO WARNING;
+CREATE TABLE broadcast_table (key int, value int);
+SELECT create_distributed_table('broadcast_table', 'key');
+INSERT INTO broadcast_table SELECT i, i % 5 FROM generate_series(1, 10) i;
+SELECT count(*) > 0 AS updated FROM (
+    SELECT master_update_shard_statistics(shardid) FROM pg_dist_shard
+    WHERE logicalrelid = 'broadcast_table'::regclass) shard_sizes;
+SET client_min_messages TO DEBUG1;
+SET citus.broadcast_join_threshold TO '1MB';
+SELECT true AS valid FROM explain_json_2($$
+    SELECT
+        count(*)
+    FROM
+        events_table, broadcast_table
+    WHERE
+        events_table.value_2 = broadcast_table.value AND broadcast_table.key < 5;
+$$);
+RESET citus.broadcast_join_threshold;
+
 RESET client_min_messages;
+DROP TABLE broadcast_table;
 DROP FUNCTION explain_json_2(text);
 
 SET search_path TO 'public';
@@ -0,0 +1,77 @@
+--
+-- SHARD_MOVE_LOGICAL_REPLICATION
+--
+-- Tests moving shards using logical replication
+SET citus.next_shard_id TO 1996000;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+CREATE SCHEMA logical_move;
+SET search_path TO logical_move;
+
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', false);
+CREATE TABLE accounts (id int PRIMARY KEY, balance int);
+CREATE TABLE logs (account_id int, message text);
+SELECT create_distributed_table('accounts', 'id');
+SELECT create_distributed_table('logs', 'account_id', colocate_with => 'none');
+INSERT INTO accounts SELECT i, 100 FROM generate_series(1, 100) i;
+INSERT INTO logs SELECT i, 'opened' FROM generate_series(1, 100) i;
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', true);
+
+-- logical replication requires a replica identity
+SELECT master_move_shard_placement(1996002, 'localhost', :worker_1_port, 'localhost', :worker_2_port,
+                                   shard_transfer_mode => 'force_logical');
+
+-- in auto mode, writes are blocked instead
+SELECT master_move_shard_placement(1996002, 'localhost', :worker_1_port, 'localhost', :worker_2_port);
+
+-- tables with a primary key are replicated logically
+SELECT master_move_shard_placement(1996000, 'localhost', :worker_1_port, 'localhost', :worker_2_port,
+                                   shard_transfer_mode => 'force_logical');
+
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (1996000, 1996001, 1996002, 1996003) ORDER BY shardid;
+
+-- the data and the constraints are moved along with the shard
+SELECT count(*), sum(balance) FROM accounts;
+SELECT count(*) FROM logs;
+INSERT INTO accounts VALUES (1, 100);
+UPDATE accounts SET balance = balance - 10 WHERE id = 1;
+SELECT balance FROM accounts WHERE id = 1;
+
+-- no publications or subscriptions are left behind
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_publication WHERE pubname LIKE 'citus_shard_move_%'$$) ORDER BY nodeport;
+SELECT * FROM run_command_on_workers($$SELECT count(*) FROM pg_subscription WHERE subname LIKE 'citus_shard_move_%'$$) ORDER BY nodeport;
+
+-- repairs do not use logical replication
+SELECT master_copy_shard_placement(1996000, 'localhost', :worker_2_port, 'localhost', :worker_1_port,
+                                   do_repair => true, transfer_mode => 'force_logical');
+
+-- blocks that are loaded into the buffer cache are counted per relation
+\c - - - :worker_1_port
+SET search_path TO logical_move;
+-- a rewrite does not go through the buffer cache
+VACUUM FULL accounts_1996001;
+SELECT worker_cached_block_count('accounts_1996001');
+SELECT worker_prewarm_relation('accounts_1996001', 1000);
+SELECT worker_cached_block_count('accounts_1996001');
+
+-- moved shards are loaded into the buffer cache of the target node
+\c - - - :master_port
+SET search_path TO logical_move;
+SET citus.prewarm_moved_shards TO on;
+SELECT master_move_shard_placement(1996001, 'localhost', :worker_1_port,
+                                   'localhost', :worker_2_port);
+RESET citus.prewarm_moved_shards;
+SELECT count(*), sum(balance) FROM accounts;
+\c - - - :worker_2_port
+SET search_path TO logical_move;
+SELECT relname,
+	   worker_cached_block_count(oid) * current_setting('block_size')::int =
+	   pg_relation_size(oid) AS all_blocks_cached
+FROM pg_class
+WHERE relname IN ('accounts_1996001', 'accounts_pkey_1996001') ORDER BY relname;
+\c - - - :master_port
+SET search_path TO logical_move;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA logical_move CASCADE;
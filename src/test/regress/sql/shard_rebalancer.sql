@@ -0,0 +1,123 @@
+--
+-- SHARD_REBALANCER
+--
+-- Tests rebalance_table_shards() and get_rebalance_table_shards_plan()
+SET citus.next_shard_id TO 1995000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+CREATE SCHEMA shard_rebalancer;
+SET search_path TO shard_rebalancer;
+
+-- place all shards on the first worker
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', false);
+CREATE TABLE events (tenant_id int, event_id int);
+CREATE TABLE event_details (tenant_id int, event_id int, details text);
+SELECT create_distributed_table('events', 'tenant_id');
+SELECT create_distributed_table('event_details', 'tenant_id', colocate_with => 'events');
+INSERT INTO events SELECT i % 10, i FROM generate_series(1, 100) i;
+INSERT INTO event_details SELECT tenant_id, event_id, 'x' FROM events;
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', true);
+
+-- unknown strategies and reference tables are rejected
+SELECT * FROM get_rebalance_table_shards_plan('events', rebalance_strategy => 'unknown');
+CREATE TABLE countries (code text PRIMARY KEY);
+SELECT create_reference_table('countries');
+SELECT * FROM get_rebalance_table_shards_plan('countries');
+
+-- half of the shard groups move to the second worker
+SELECT * FROM get_rebalance_table_shards_plan('events');
+
+-- excluding a shard of a colocated table excludes its shard group
+SELECT * FROM get_rebalance_table_shards_plan('events', excluded_shard_list => '{1995004}');
+SELECT * FROM get_rebalance_table_shards_plan('events', max_shard_moves => 1);
+
+-- thresholds below the minimum of the strategy are raised to the minimum
+SELECT count(*) >= 0 AS planned
+FROM get_rebalance_table_shards_plan('events', threshold => 0, rebalance_strategy => 'by_disk_size');
+
+-- the moves commit on their own, so they cannot run in a transaction block
+BEGIN;
+SELECT rebalance_table_shards('events');
+ROLLBACK;
+BEGIN;
+SELECT master_drain_node('localhost', :worker_1_port);
+ROLLBACK;
+
+SELECT rebalance_table_shards('events');
+
+SELECT nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('events'::regclass, 'event_details'::regclass)
+GROUP BY nodeport ORDER BY nodeport;
+
+SELECT count(*) FROM events JOIN event_details USING (tenant_id, event_id);
+
+-- the table is balanced now
+SELECT * FROM get_rebalance_table_shards_plan('events');
+SELECT * FROM get_rebalance_progress();
+
+-- nodes that should not have shards are drained
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', false);
+SELECT * FROM get_rebalance_table_shards_plan('events', drain_only => true);
+SELECT rebalance_table_shards('events', drain_only => true);
+
+SELECT nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid IN ('events'::regclass, 'event_details'::regclass)
+GROUP BY nodeport ORDER BY nodeport;
+
+SELECT count(*) FROM events JOIN event_details USING (tenant_id, event_id);
+
+SELECT 1 FROM master_set_node_property('localhost', :worker_2_port, 'shouldhaveshards', true);
+
+-- custom rebalance strategies can be added
+CREATE FUNCTION only_worker_1(shardid bigint, nodeidarg int)
+    RETURNS boolean AS $$
+    SELECT nodeport = 57637 FROM pg_dist_node WHERE nodeid = nodeidarg
+    $$ LANGUAGE sql;
+SELECT citus_add_rebalance_strategy(
+        'only_worker_1',
+        'citus_shard_cost_1',
+        'citus_node_capacity_1',
+        'shard_rebalancer.only_worker_1',
+        0,
+        0
+    );
+SELECT * FROM get_rebalance_table_shards_plan('events', rebalance_strategy => 'only_worker_1');
+DELETE FROM pg_dist_rebalance_strategy WHERE name = 'only_worker_1';
+
+-- new tables can be placed by the capacity of the nodes
+CREATE FUNCTION capacity_high_worker_1(nodeidarg int)
+    RETURNS real AS $$
+    SELECT (CASE WHEN nodeport = 57637 THEN 3 ELSE 1 END)::real
+    FROM pg_dist_node WHERE nodeid = nodeidarg
+    $$ LANGUAGE sql;
+SELECT citus_add_rebalance_strategy(
+        'capacity_high_worker_1',
+        'citus_shard_cost_1',
+        'shard_rebalancer.capacity_high_worker_1',
+        'citus_shard_allowed_on_node_true',
+        0,
+        0
+    );
+SELECT citus_set_default_rebalance_strategy('capacity_high_worker_1');
+SET citus.capacity_aware_shard_placement TO on;
+SET citus.shard_count TO 8;
+CREATE TABLE page_views (tenant_id int, page_id int);
+SELECT create_distributed_table('page_views', 'tenant_id', colocate_with => 'none');
+
+SELECT nodeport, count(*)
+FROM pg_dist_shard JOIN pg_dist_shard_placement USING (shardid)
+WHERE logicalrelid = 'page_views'::regclass
+GROUP BY nodeport ORDER BY nodeport;
+
+-- the new table does not need to be rebalanced
+SELECT * FROM get_rebalance_table_shards_plan('page_views');
+
+RESET citus.capacity_aware_shard_placement;
+SET citus.shard_count TO 4;
+SELECT citus_set_default_rebalance_strategy('by_shard_count');
+DELETE FROM pg_dist_rebalance_strategy WHERE name = 'capacity_high_worker_1';
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_rebalancer CASCADE;
@@ -217,8 +217,63 @@ BEGIN;
 		database_name = 'regression'
 	ORDER BY
 		hostname, port;
+	-- no backend had to wait for a connection slot
+	SELECT
+		connection_wait_count, connection_wait_time
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+	-- the connections opened above are reflected in the establishment stats
+	SELECT
+		connection_establishment_count >= 2, connection_establishment_time > 0
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+	-- neither workload class had to wait for a connection slot
+	SELECT
+		interactive_connection_wait_count, batch_connection_wait_count
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
 COMMIT;
 
+-- the first query after enabling warm connections opens them on all workers
+-- and they are kept open even though no connections are cached otherwise
+SET citus.warm_connections_per_worker TO 3;
+SELECT count(*) FROM test WHERE a = 1;
+SELECT
+	connection_count_to_node
+FROM
+	citus_remote_connection_stats()
+WHERE
+	port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+	database_name = 'regression'
+ORDER BY
+	hostname, port;
+RESET citus.warm_connections_per_worker;
+SELECT count(*) FROM test WHERE a = 1;
+SELECT
+	connection_count_to_node
+FROM
+	citus_remote_connection_stats()
+WHERE
+	port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+	database_name = 'regression'
+ORDER BY
+	hostname, port;
+
 -- in case other tests relies on these setting, reset them
 ALTER SYSTEM RESET citus.distributed_deadlock_detection_factor;
 ALTER SYSTEM RESET citus.recover_2pc_interval;
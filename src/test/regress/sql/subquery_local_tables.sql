@@ -200,6 +200,14 @@ ORDER BY 1;
 
 SET client_min_messages TO DEFAULT;
 
+-- local tables that are joined with distributed tables are sent to the workers
+SELECT count(*) AS local_join_count
+FROM users_table_local JOIN events_table_local USING (user_id)
+WHERE users_table_local.value_1 = 3 \gset
+SELECT count(*) = :local_join_count
+FROM users_table_local JOIN events_table USING (user_id)
+WHERE users_table_local.value_1 = 3;
+
 -- Test https://github.com/citusdata/citus/issues/2717
 create table test_dist (id int, table_name text, column_name text);
 select create_distributed_table('test_dist','id');
@@ -7,6 +7,7 @@
 \set JobId 401010
 \set SimpleTaskId 101101
 \set RecoverableTaskId 801102
+\set PrioritizedTaskId 801103
 
 \set SimpleTaskTable lineitem_simple_task
 \set BadQueryString '\'SELECT COUNT(*) FROM bad_table_name\''
@@ -49,3 +50,15 @@ SELECT task_tracker_assign_task(:JobId, :RecoverableTaskId, :GoodQueryString);
 SELECT pg_sleep(2.0);
 
 SELECT task_tracker_task_status(:JobId, :RecoverableTaskId);
+
+-- Tasks may also be assigned with a scheduling priority. Tasks with higher
+-- priorities are scheduled before the others.
+
+SELECT task_tracker_assign_task(:JobId, :PrioritizedTaskId, :GoodQueryString, 3);
+
+-- Instead of sleeping, we wait for the task tracker to tell us the task finished.
+
+SELECT task_tracker_wait_for_any(ARRAY[:JobId]::bigint[], ARRAY[:PrioritizedTaskId],
+								 10000);
+
+SELECT task_tracker_task_status(:JobId, :PrioritizedTaskId);
@@ -616,3 +616,23 @@ GROUP BY 1 ORDER BY 1;
 select null = sum(null::int2) over ()
 from public.users_table as ut limit 1;
 
+
+-- window functions that are not partitioned by the distribution column are
+-- computed on the workers after repartitioning the rows, with the same results
+SET citus.enable_repartitioned_window_functions TO on;
+CREATE TEMP TABLE repartitioned_windows AS
+SELECT user_id, value_2, time,
+       rank() OVER (PARTITION BY value_2 ORDER BY time, user_id),
+       count(*) OVER (PARTITION BY value_2, event_type)
+FROM events_table WHERE value_2 IS NOT NULL;
+RESET citus.enable_repartitioned_window_functions;
+CREATE TEMP TABLE coordinator_windows AS
+SELECT user_id, value_2, time,
+       rank() OVER (PARTITION BY value_2 ORDER BY time, user_id),
+       count(*) OVER (PARTITION BY value_2, event_type)
+FROM events_table WHERE value_2 IS NOT NULL;
+SELECT count(*) > 0 FROM repartitioned_windows;
+SELECT count(*) FROM (
+	SELECT * FROM repartitioned_windows EXCEPT ALL SELECT * FROM coordinator_windows
+) differences;
+DROP TABLE repartitioned_windows, coordinator_windows;
@@ -33,3 +33,27 @@ SELECT COUNT(*) AS diff_lhs FROM ( :Select_All FROM :Task_Table_Name EXCEPT ALL
 
 SELECT COUNT(*) AS diff_rhs FROM ( :Select_All FROM lineitem EXCEPT ALL
        		   	    	   :Select_All FROM :Task_Table_Name ) diff;
+
+-- When merge file scans are enabled, the task table is a view that reads the
+-- partition files directly. Its contents should be the same.
+
+DROP TABLE :Task_Table_Name;
+SET citus.enable_merge_file_scan TO on;
+
+SELECT worker_merge_files_into_table(:JobId, :TaskId,
+       ARRAY['orderkey', 'partkey', 'suppkey', 'linenumber', 'quantity', 'extendedprice',
+             'discount', 'tax', 'returnflag', 'linestatus', 'shipdate', 'commitdate',
+	     'receiptdate', 'shipinstruct', 'shipmode', 'comment']::_text,
+       ARRAY['bigint', 'integer', 'integer', 'integer', 'decimal(15, 2)', 'decimal(15, 2)',
+             'decimal(15, 2)', 'decimal(15, 2)', 'char(1)', 'char(1)', 'date', 'date',
+	     'date', 'char(25)', 'char(10)', 'varchar(44)']::_text);
+
+SELECT relkind FROM pg_class WHERE oid = :'Task_Table_Name'::regclass;
+
+SELECT COUNT(*) AS diff_lhs FROM ( :Select_All FROM :Task_Table_Name EXCEPT ALL
+       		   	    	   :Select_All FROM lineitem ) diff;
+
+SELECT COUNT(*) AS diff_rhs FROM ( :Select_All FROM lineitem EXCEPT ALL
+       		   	    	   :Select_All FROM :Task_Table_Name ) diff;
+
+RESET citus.enable_merge_file_scan;